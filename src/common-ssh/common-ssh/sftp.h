@@ -24,10 +24,13 @@
 #include "ssh.h"
 
 #include <guacamole/object.h>
+#include <guacamole/timestamp.h>
 #include <guacamole/user.h>
 #include <libssh2.h>
 #include <libssh2_sftp.h>
 
+#include <pthread.h>
+
 /**
  * Maximum number of bytes per path.
  */
@@ -38,6 +41,94 @@
  */
 #define GUAC_COMMON_SSH_SFTP_MAX_DEPTH 1024
 
+/**
+ * The number of bytes of a file being downloaded that are requested from the
+ * SFTP server at once. libssh2 splits each such request into several SFTP
+ * read requests which are all outstanding at the same time, such that
+ * downloads are not limited to a single chunk per round trip.
+ */
+#define GUAC_COMMON_SSH_SFTP_READ_AHEAD 131072
+
+/**
+ * The number of bytes of a file being uploaded that are buffered before being
+ * written to the SFTP server at once. Data is acknowledged as soon as it has
+ * been buffered, and libssh2 splits each such write into several SFTP write
+ * requests which are all outstanding at the same time.
+ */
+#define GUAC_COMMON_SSH_SFTP_WRITE_BEHIND 262144
+
+/**
+ * The maximum number of completed directory listings that are retained for
+ * each SFTP filesystem.
+ */
+#define GUAC_COMMON_SSH_SFTP_LS_CACHE_SIZE 8
+
+/**
+ * The number of milliseconds for which a completed directory listing may be
+ * reused in place of listing the directory again over SFTP.
+ */
+#define GUAC_COMMON_SSH_SFTP_LS_CACHE_DURATION 10000
+
+/**
+ * A single entry within a directory listing.
+ */
+typedef struct guac_common_ssh_sftp_ls_entry {
+
+    /**
+     * The absolute path of the entry within the filesystem object.
+     */
+    char* path;
+
+    /**
+     * Non-zero if the entry is a directory (or a symbolic link to a
+     * directory), zero otherwise.
+     */
+    int is_directory;
+
+} guac_common_ssh_sftp_ls_entry;
+
+/**
+ * The entries of a directory, as read over SFTP. Once complete, a listing is
+ * never modified and may be retained within the cache of its filesystem and
+ * shared by any number of listing operations.
+ */
+typedef struct guac_common_ssh_sftp_listing {
+
+    /**
+     * The absolute path of the listed directory within the filesystem
+     * object.
+     */
+    char directory_name[GUAC_COMMON_SSH_SFTP_MAX_PATH];
+
+    /**
+     * All entries of the directory that have been read so far.
+     */
+    guac_common_ssh_sftp_ls_entry* entries;
+
+    /**
+     * The number of entries within the entries array.
+     */
+    int count;
+
+    /**
+     * The number of entries that the entries array has room for.
+     */
+    int capacity;
+
+    /**
+     * The time at which the listing was completed.
+     */
+    guac_timestamp completed;
+
+    /**
+     * The number of references to this listing, including any reference held
+     * by the cache of its filesystem. The listing is freed when this reaches
+     * zero. Access is guarded by the listing_cache_lock of the filesystem.
+     */
+    int refcount;
+
+} guac_common_ssh_sftp_listing;
+
 /**
  * Representation of an SFTP-driven filesystem object. Unlike guac_object, this
  * structure is not tied to any particular user.
@@ -80,6 +171,19 @@ typedef struct guac_common_ssh_sftp_filesystem {
      */
     int disable_upload;
 
+    /**
+     * Lock which guards the listing cache, as well as the reference counts of
+     * all listings.
+     */
+    pthread_mutex_t listing_cache_lock;
+
+    /**
+     * The most recently completed directory listings, any of which may be
+     * reused if listed again within GUAC_COMMON_SSH_SFTP_LS_CACHE_DURATION.
+     * Unused slots are NULL.
+     */
+    guac_common_ssh_sftp_listing* listing_cache[GUAC_COMMON_SSH_SFTP_LS_CACHE_SIZE];
+
 } guac_common_ssh_sftp_filesystem;
 
 /**
@@ -95,9 +199,24 @@ typedef struct guac_common_ssh_sftp_ls_state {
     /**
      * Reference to the directory currently being listed over SFTP. This
      * directory must already be open from a call to libssh2_sftp_opendir().
+     * If the listing is instead being sent from the listing cache, this will
+     * be NULL.
      */
     LIBSSH2_SFTP_HANDLE* directory;
 
+    /**
+     * The listing being sent. If the directory is being listed over SFTP,
+     * entries are added to this listing as they are read, and the completed
+     * listing is added to the listing cache of the filesystem.
+     */
+    guac_common_ssh_sftp_listing* listing;
+
+    /**
+     * The index of the next entry of a cached listing to send. This is unused
+     * if the directory is being listed over SFTP.
+     */
+    int next_entry;
+
     /**
      * The absolute path of the directory being listed.
      */
@@ -110,6 +229,65 @@ typedef struct guac_common_ssh_sftp_ls_state {
 
 } guac_common_ssh_sftp_ls_state;
 
+/**
+ * The current state of a file download.
+ */
+typedef struct guac_common_ssh_sftp_download_state {
+
+    /**
+     * Reference to the file being downloaded over SFTP. This file must
+     * already be open from a call to libssh2_sftp_open().
+     */
+    LIBSSH2_SFTP_HANDLE* file;
+
+    /**
+     * Data which has been read from the file but not yet sent to the user.
+     */
+    char buffer[GUAC_COMMON_SSH_SFTP_READ_AHEAD];
+
+    /**
+     * The offset of the first byte within buffer that has not yet been sent
+     * to the user.
+     */
+    size_t offset;
+
+    /**
+     * The number of bytes of data within buffer.
+     */
+    size_t length;
+
+} guac_common_ssh_sftp_download_state;
+
+/**
+ * The current state of a file upload.
+ */
+typedef struct guac_common_ssh_sftp_upload_state {
+
+    /**
+     * Reference to the file being uploaded over SFTP. This file must already
+     * be open from a call to libssh2_sftp_open().
+     */
+    LIBSSH2_SFTP_HANDLE* file;
+
+    /**
+     * Data which has been received from the user and acknowledged but not
+     * yet written to the file.
+     */
+    char buffer[GUAC_COMMON_SSH_SFTP_WRITE_BEHIND];
+
+    /**
+     * The number of bytes of data within buffer.
+     */
+    size_t length;
+
+    /**
+     * Non-zero if writing buffered data to the file has failed, in which
+     * case all further data is rejected.
+     */
+    int failed;
+
+} guac_common_ssh_sftp_upload_state;
+
 /**
  * Creates a new Guacamole filesystem object which provides access to files
  * and directories via SFTP using the given SSH session. When the filesystem
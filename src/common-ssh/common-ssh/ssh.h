@@ -42,6 +42,36 @@
  */
 typedef char* guac_ssh_credential_handler(guac_client* client, char* cred_name);
 
+/**
+ * The smallest receive window, in bytes, that will be used for channels opened
+ * on an SSH session. This is the window libssh2 uses by default, and is the
+ * window of any channel opened by libssh2 itself, such as the channel used for
+ * SFTP.
+ */
+#define GUAC_COMMON_SSH_MIN_WINDOW_SIZE (2 * 1024 * 1024)
+
+/**
+ * The largest receive window, in bytes, that will be used for channels opened
+ * on an SSH session.
+ */
+#define GUAC_COMMON_SSH_MAX_WINDOW_SIZE (64 * 1024 * 1024)
+
+/**
+ * The bandwidth, in bytes per second, that channel receive windows should be
+ * able to sustain when automatically sized from the round-trip time of the
+ * SSH connection. A window must be at least as large as the product of
+ * bandwidth and round-trip time for the sender to never stall waiting for
+ * the window to be adjusted.
+ */
+#define GUAC_COMMON_SSH_AUTO_WINDOW_BANDWIDTH 125000000
+
+/**
+ * The largest maximum packet size, in bytes, that will be requested for
+ * channels opened on an SSH session. This is also the packet size libssh2
+ * uses by default, as larger packets may exceed what libssh2 will accept.
+ */
+#define GUAC_COMMON_SSH_MAX_PACKET_SIZE 32768
+
 /**
  * An SSH session, backed by libssh2 and associated with a particular
  * Guacamole client.
@@ -73,6 +103,25 @@ typedef struct guac_common_ssh_session {
      */
     guac_ssh_credential_handler* credential_handler;
 
+    /**
+     * The smoothed round-trip time of the SSH connection, in microseconds, as
+     * measured by the kernel once the SSH handshake completed. If the
+     * round-trip time could not be measured, this will be zero.
+     */
+    int rtt;
+
+    /**
+     * The receive window, in bytes, to use for channels opened on this
+     * session. This is set by guac_common_ssh_set_channel_sizes().
+     */
+    unsigned int window_size;
+
+    /**
+     * The maximum packet size, in bytes, to request for channels opened on
+     * this session. This is set by guac_common_ssh_set_channel_sizes().
+     */
+    unsigned int packet_size;
+
 } guac_common_ssh_session;
 
 /**
@@ -145,6 +194,43 @@ guac_common_ssh_session* guac_common_ssh_create_session(guac_client* client,
         int timeout, int keepalive, const char* host_key,
         guac_ssh_credential_handler* credential_handler);
 
+/**
+ * Sets the receive window and maximum packet size used for channels opened on
+ * the given SSH session, clamping each to the range supported. If the window
+ * size is zero, the window is instead sized automatically from the measured
+ * round-trip time of the connection (see GUAC_COMMON_SSH_AUTO_WINDOW_BANDWIDTH).
+ * If the packet size is zero, GUAC_COMMON_SSH_MAX_PACKET_SIZE is used. Sessions
+ * created with guac_common_ssh_create_session() initially behave as if this
+ * function were invoked with both sizes set to zero.
+ *
+ * @param session
+ *     The SSH session to configure.
+ *
+ * @param window_size
+ *     The receive window to use for new channels, in bytes, or zero to size
+ *     the window automatically.
+ *
+ * @param packet_size
+ *     The maximum packet size to request for new channels, in bytes, or zero
+ *     to use the default.
+ */
+void guac_common_ssh_set_channel_sizes(guac_common_ssh_session* session,
+        int window_size, int packet_size);
+
+/**
+ * Opens a new channel of type "session" on the given SSH session, using the
+ * receive window and maximum packet size configured for that session. The
+ * channel is opened exactly as with libssh2_channel_open_session(), and
+ * libssh2 must be in blocking mode.
+ *
+ * @param session
+ *     The SSH session to open a channel on.
+ *
+ * @return
+ *     The newly-opened channel, or NULL if the channel could not be opened.
+ */
+LIBSSH2_CHANNEL* guac_common_ssh_open_channel(guac_common_ssh_session* session);
+
 /**
  * Disconnects and destroys the given SSH session, freeing all associated
  * resources. Any associated user must be explicitly destroyed, and will not
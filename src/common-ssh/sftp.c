@@ -25,6 +25,7 @@
 #include <guacamole/object.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
+#include <guacamole/stream.h>
 #include <guacamole/string.h>
 #include <guacamole/user.h>
 #include <libssh2.h>
@@ -284,11 +285,276 @@ static int guac_ssh_append_path(char* fullpath, const char* path_a,
 
 }
 
+/**
+ * Releases a reference to the given directory listing, freeing the listing
+ * and all of its entries if no references remain. The listing_cache_lock of
+ * the filesystem must already be held.
+ *
+ * @param listing
+ *     The listing to release.
+ */
+static void guac_common_ssh_sftp_listing_release_locked(
+        guac_common_ssh_sftp_listing* listing) {
+
+    if (--listing->refcount > 0)
+        return;
+
+    for (int i = 0; i < listing->count; i++)
+        guac_mem_free(listing->entries[i].path);
+
+    guac_mem_free(listing->entries);
+    guac_mem_free(listing);
+
+}
+
+/**
+ * Releases a reference to the given directory listing, freeing the listing
+ * and all of its entries if no references remain.
+ *
+ * @param filesystem
+ *     The filesystem that the listing was made from.
+ *
+ * @param listing
+ *     The listing to release.
+ */
+static void guac_common_ssh_sftp_listing_release(
+        guac_common_ssh_sftp_filesystem* filesystem,
+        guac_common_ssh_sftp_listing* listing) {
+
+    pthread_mutex_lock(&filesystem->listing_cache_lock);
+    guac_common_ssh_sftp_listing_release_locked(listing);
+    pthread_mutex_unlock(&filesystem->listing_cache_lock);
+
+}
+
+/**
+ * Adds a new entry to the end of the given, incomplete directory listing.
+ *
+ * @param listing
+ *     The listing to add an entry to.
+ *
+ * @param path
+ *     The absolute path of the entry within the filesystem object.
+ *
+ * @param is_directory
+ *     Non-zero if the entry is a directory (or a symbolic link to a
+ *     directory), zero otherwise.
+ */
+static void guac_common_ssh_sftp_listing_add(
+        guac_common_ssh_sftp_listing* listing, const char* path,
+        int is_directory) {
+
+    /* Grow entry storage geometrically as needed */
+    if (listing->count == listing->capacity) {
+        listing->capacity = listing->capacity ? guac_mem_ckd_mul_or_die(
+                    listing->capacity, 2) : 64;
+        listing->entries = guac_mem_realloc_or_die(listing->entries,
+                sizeof(guac_common_ssh_sftp_ls_entry), listing->capacity);
+    }
+
+    guac_common_ssh_sftp_ls_entry* entry = &listing->entries[listing->count++];
+    entry->path = guac_strdup(path);
+    entry->is_directory = is_directory;
+
+}
+
+/**
+ * Returns a new reference to the cached listing of the directory having the
+ * given name, if that directory was listed within the last
+ * GUAC_COMMON_SSH_SFTP_LS_CACHE_DURATION milliseconds. Expired listings are
+ * removed from the cache. The returned reference must eventually be released
+ * with guac_common_ssh_sftp_listing_release().
+ *
+ * @param filesystem
+ *     The filesystem whose listing cache should be searched.
+ *
+ * @param name
+ *     The absolute path of the directory within the filesystem object.
+ *
+ * @return
+ *     A new reference to the cached listing of the given directory, or NULL
+ *     if no such listing is cached.
+ */
+static guac_common_ssh_sftp_listing* guac_common_ssh_sftp_listing_acquire(
+        guac_common_ssh_sftp_filesystem* filesystem, const char* name) {
+
+    guac_common_ssh_sftp_listing* found = NULL;
+    guac_timestamp now = guac_timestamp_current();
+
+    pthread_mutex_lock(&filesystem->listing_cache_lock);
+
+    for (int i = 0; i < GUAC_COMMON_SSH_SFTP_LS_CACHE_SIZE; i++) {
+
+        guac_common_ssh_sftp_listing* listing = filesystem->listing_cache[i];
+        if (listing == NULL)
+            continue;
+
+        /* Drop any listing that is too old to be reused */
+        if (now - listing->completed > GUAC_COMMON_SSH_SFTP_LS_CACHE_DURATION) {
+            filesystem->listing_cache[i] = NULL;
+            guac_common_ssh_sftp_listing_release_locked(listing);
+            continue;
+        }
+
+        if (found == NULL && strcmp(listing->directory_name, name) == 0) {
+            listing->refcount++;
+            found = listing;
+        }
+
+    }
+
+    pthread_mutex_unlock(&filesystem->listing_cache_lock);
+    return found;
+
+}
+
+/**
+ * Marks the given directory listing as complete and adds it to the listing
+ * cache of the filesystem, replacing any cached listing of the same
+ * directory, or otherwise the oldest cached listing if the cache is full.
+ *
+ * @param filesystem
+ *     The filesystem that the listing was made from.
+ *
+ * @param listing
+ *     The completed listing to add to the cache.
+ */
+static void guac_common_ssh_sftp_listing_store(
+        guac_common_ssh_sftp_filesystem* filesystem,
+        guac_common_ssh_sftp_listing* listing) {
+
+    pthread_mutex_lock(&filesystem->listing_cache_lock);
+
+    listing->completed = guac_timestamp_current();
+
+    /* Prefer replacing a listing of the same directory, then an unused slot,
+     * then the oldest listing */
+    int index = 0;
+    for (int i = 0; i < GUAC_COMMON_SSH_SFTP_LS_CACHE_SIZE; i++) {
+
+        guac_common_ssh_sftp_listing* current = filesystem->listing_cache[i];
+        if (current == NULL || strcmp(current->directory_name,
+                    listing->directory_name) == 0) {
+            index = i;
+            if (current != NULL)
+                break;
+        }
+
+        else if (filesystem->listing_cache[index] != NULL
+                && current->completed < filesystem->listing_cache[index]->completed)
+            index = i;
+
+    }
+
+    if (filesystem->listing_cache[index] != NULL)
+        guac_common_ssh_sftp_listing_release_locked(
+                filesystem->listing_cache[index]);
+
+    listing->refcount++;
+    filesystem->listing_cache[index] = listing;
+
+    pthread_mutex_unlock(&filesystem->listing_cache_lock);
+
+}
+
+/**
+ * Removes all listings from the listing cache of the given filesystem, such
+ * that changes to the filesystem are visible to subsequent listings.
+ *
+ * @param filesystem
+ *     The filesystem whose listing cache should be cleared.
+ */
+static void guac_common_ssh_sftp_invalidate_listings(
+        guac_common_ssh_sftp_filesystem* filesystem) {
+
+    pthread_mutex_lock(&filesystem->listing_cache_lock);
+
+    for (int i = 0; i < GUAC_COMMON_SSH_SFTP_LS_CACHE_SIZE; i++) {
+        if (filesystem->listing_cache[i] != NULL) {
+            guac_common_ssh_sftp_listing_release_locked(
+                    filesystem->listing_cache[i]);
+            filesystem->listing_cache[i] = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&filesystem->listing_cache_lock);
+
+}
+
+/**
+ * Allocates the state of a new upload to the given file, which will be
+ * written by guac_common_ssh_sftp_blob_handler() and closed by
+ * guac_common_ssh_sftp_end_handler(). If the file could not be opened, no
+ * state is allocated.
+ *
+ * @param file
+ *     The file to upload to, as returned by libssh2_sftp_open(), or NULL if
+ *     the file could not be opened.
+ *
+ * @return
+ *     The state of the new upload, or NULL if the given file is NULL.
+ */
+static guac_common_ssh_sftp_upload_state* guac_common_ssh_sftp_upload_alloc(
+        LIBSSH2_SFTP_HANDLE* file) {
+
+    if (file == NULL)
+        return NULL;
+
+    guac_common_ssh_sftp_upload_state* upload =
+        guac_mem_alloc(sizeof(guac_common_ssh_sftp_upload_state));
+
+    upload->file = file;
+    upload->length = 0;
+    upload->failed = 0;
+
+    return upload;
+
+}
+
+/**
+ * Writes all data buffered for the given upload to its file. libssh2 keeps
+ * several SFTP write requests outstanding while doing so, returning once the
+ * server has acknowledged only part of the data, and must be called again
+ * for the remainder.
+ *
+ * @param upload
+ *     The upload whose buffered data should be written.
+ *
+ * @return
+ *     Zero if all buffered data was written successfully, non-zero
+ *     otherwise.
+ */
+static int guac_common_ssh_sftp_upload_flush(
+        guac_common_ssh_sftp_upload_state* upload) {
+
+    size_t written = 0;
+    while (written < upload->length) {
+
+        ssize_t result = libssh2_sftp_write(upload->file,
+                upload->buffer + written, upload->length - written);
+
+        if (result <= 0) {
+            upload->failed = 1;
+            break;
+        }
+
+        written += result;
+
+    }
+
+    upload->length = 0;
+    return upload->failed;
+
+}
+
 /**
  * Handler for blob messages which continue an inbound SFTP data transfer
- * (upload). The data associated with the given stream is expected to be a
- * pointer to an open LIBSSH2_SFTP_HANDLE for the file to which the data
- * should be written.
+ * (upload). Received data is buffered and acknowledged immediately, being
+ * written to the file only once GUAC_COMMON_SSH_SFTP_WRITE_BEHIND bytes
+ * have been buffered (or the upload ends). The data associated with the
+ * given stream is expected to be a pointer to a
+ * guac_common_ssh_sftp_upload_state, or NULL if the file could not be
+ * opened.
  *
  * @param user
  *     The user receiving the blob message.
@@ -308,12 +574,25 @@ static int guac_ssh_append_path(char* fullpath, const char* path_a,
 static int guac_common_ssh_sftp_blob_handler(guac_user* user,
         guac_stream* stream, void* data, int length) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
+    /* Pull upload state from stream */
+    guac_common_ssh_sftp_upload_state* upload =
+        (guac_common_ssh_sftp_upload_state*) stream->data;
+
+    /* Write buffered data first if the new data would not fit */
+    if (upload != NULL && !upload->failed
+            && upload->length + length > sizeof(upload->buffer)) {
+        if (guac_common_ssh_sftp_upload_flush(upload) == 0)
+            guac_user_log(user, GUAC_LOG_DEBUG, "Buffered data written");
+    }
 
-    /* Attempt write */
-    if (libssh2_sftp_write(file, data, length) == length) {
-        guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes written", length);
+    /* Buffer data, acknowledging it as soon as it is buffered */
+    if (upload != NULL && !upload->failed && length >= 0
+            && (size_t) length <= sizeof(upload->buffer)) {
+
+        memcpy(upload->buffer + upload->length, data, length);
+        upload->length += length;
+
+        guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes buffered", length);
         guac_protocol_send_ack(user->socket, stream, "SFTP: OK",
                 GUAC_PROTOCOL_STATUS_SUCCESS);
         guac_socket_flush(user->socket);
@@ -333,9 +612,10 @@ static int guac_common_ssh_sftp_blob_handler(guac_user* user,
 
 /**
  * Handler for end messages which terminate an inbound SFTP data transfer
- * (upload). The data associated with the given stream is expected to be a
- * pointer to an open LIBSSH2_SFTP_HANDLE for the file to which the data
- * has been written and which should now be closed.
+ * (upload). Any remaining buffered data is written before the file is
+ * closed. The data associated with the given stream is expected to be a
+ * pointer to a guac_common_ssh_sftp_upload_state, or NULL if the file could
+ * not be opened.
  *
  * @param user
  *     The user receiving the end message.
@@ -349,11 +629,33 @@ static int guac_common_ssh_sftp_blob_handler(guac_user* user,
 static int guac_common_ssh_sftp_end_handler(guac_user* user,
         guac_stream* stream) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
+    /* Pull upload state from stream */
+    guac_common_ssh_sftp_upload_state* upload =
+        (guac_common_ssh_sftp_upload_state*) stream->data;
+
+    if (upload == NULL) {
+        guac_user_log(user, GUAC_LOG_INFO, "Unable to close file");
+        guac_protocol_send_ack(user->socket, stream, "SFTP: Close failed",
+                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+        guac_socket_flush(user->socket);
+        return 0;
+    }
+
+    /* Write any remaining data, noting if earlier writes failed */
+    int write_failed = upload->failed
+        || guac_common_ssh_sftp_upload_flush(upload);
 
     /* Attempt to close file */
-    if (libssh2_sftp_close(file) == 0) {
+    int close_failed = libssh2_sftp_close(upload->file) != 0;
+    guac_mem_free(upload);
+
+    if (write_failed) {
+        guac_user_log(user, GUAC_LOG_INFO, "Unable to write to file");
+        guac_protocol_send_ack(user->socket, stream, "SFTP: Write failed",
+                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+        guac_socket_flush(user->socket);
+    }
+    else if (!close_failed) {
         guac_user_log(user, GUAC_LOG_DEBUG, "File closed");
         guac_protocol_send_ack(user->socket, stream, "SFTP: OK",
                 GUAC_PROTOCOL_STATUS_SUCCESS);
@@ -418,6 +720,9 @@ int guac_common_ssh_sftp_handle_file_stream(
                 "File \"%s\" opened",
                 fullpath);
 
+        /* Cached listings may no longer include every file */
+        guac_common_ssh_sftp_invalidate_listings(filesystem);
+
         guac_protocol_send_ack(user->socket, stream, "SFTP: File opened",
                 GUAC_PROTOCOL_STATUS_SUCCESS);
         guac_socket_flush(user->socket);
@@ -434,17 +739,68 @@ int guac_common_ssh_sftp_handle_file_stream(
     stream->blob_handler = guac_common_ssh_sftp_blob_handler;
     stream->end_handler = guac_common_ssh_sftp_end_handler;
 
-    /* Store file within stream */
-    stream->data = file;
+    /* Store upload state within stream */
+    stream->data = guac_common_ssh_sftp_upload_alloc(file);
     return 0;
 
 }
 
+/**
+ * Closes the file of the given download and frees the download state.
+ *
+ * @param user
+ *     The user that was receiving the download.
+ *
+ * @param download
+ *     The state of the download to free.
+ */
+static void guac_common_ssh_sftp_download_free(guac_user* user,
+        guac_common_ssh_sftp_download_state* download) {
+
+    /* Close file */
+    if (libssh2_sftp_close(download->file) == 0)
+        guac_user_log(user, GUAC_LOG_DEBUG, "File closed");
+    else
+        guac_user_log(user, GUAC_LOG_INFO, "Unable to close file");
+
+    guac_mem_free(download);
+
+}
+
+/**
+ * Allocates the state of a new download of the given file, which will be
+ * read and sent to the user by guac_common_ssh_sftp_ack_handler().
+ *
+ * @param file
+ *     The file to download, which must already be open from a call to
+ *     libssh2_sftp_open().
+ *
+ * @return
+ *     The state of the new download, which must be freed with
+ *     guac_common_ssh_sftp_download_free().
+ */
+static guac_common_ssh_sftp_download_state* guac_common_ssh_sftp_download_alloc(
+        LIBSSH2_SFTP_HANDLE* file) {
+
+    guac_common_ssh_sftp_download_state* download =
+        guac_mem_alloc(sizeof(guac_common_ssh_sftp_download_state));
+
+    download->file = file;
+    download->offset = 0;
+    download->length = 0;
+
+    return download;
+
+}
+
 /**
  * Handler for ack messages which continue an outbound SFTP data transfer
  * (download), signaling the current status and requesting additional data.
- * The data associated with the given stream is expected to be a pointer to an
- * open LIBSSH2_SFTP_HANDLE for the file from which the data is to be read.
+ * As many blobs are sent as the window of the stream allows. Data is read
+ * from the SFTP server up to GUAC_COMMON_SSH_SFTP_READ_AHEAD bytes at a
+ * time, with libssh2 keeping several reads outstanding, and buffered until
+ * the window allows it to be sent. The data associated with the given stream
+ * is expected to be a pointer to a guac_common_ssh_sftp_download_state.
  *
  * @param user
  *     The user receiving the ack message.
@@ -466,58 +822,65 @@ int guac_common_ssh_sftp_handle_file_stream(
 static int guac_common_ssh_sftp_ack_handler(guac_user* user,
         guac_stream* stream, char* message, guac_protocol_status status) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
-
-    /* If successful, read data */
-    if (status == GUAC_PROTOCOL_STATUS_SUCCESS) {
+    /* Pull download state from stream */
+    guac_common_ssh_sftp_download_state* download =
+        (guac_common_ssh_sftp_download_state*) stream->data;
 
-        /* Attempt read into buffer */
-        char buffer[4096];
-        int bytes_read = libssh2_sftp_read(file, buffer, sizeof(buffer)); 
-
-        /* If bytes read, send as blob */
-        if (bytes_read > 0) {
-            guac_protocol_send_blob(user->socket, stream,
-                    buffer, bytes_read);
+    /* Return stream to user if the transfer has failed */
+    if (status != GUAC_PROTOCOL_STATUS_SUCCESS) {
+        guac_common_ssh_sftp_download_free(user, download);
+        guac_user_free_stream(user, stream);
+        return 0;
+    }
 
-            guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes sent to user",
-                    bytes_read);
+    /* Read and send data until the window of the stream is full */
+    while (guac_stream_can_send(stream)) {
 
-        }
+        /* Read further data only once everything already read has been
+         * sent */
+        if (download->offset == download->length) {
 
-        /* If bytes could not be read, handle EOF or error condition */
-        else {
+            ssize_t bytes_read = libssh2_sftp_read(download->file,
+                    download->buffer, sizeof(download->buffer));
 
             /* If EOF, send end */
             if (bytes_read == 0) {
                 guac_user_log(user, GUAC_LOG_DEBUG, "File sent");
                 guac_protocol_send_end(user->socket, stream);
                 guac_user_free_stream(user, stream);
+                guac_common_ssh_sftp_download_free(user, download);
+                break;
             }
 
-            /* Otherwise, fail stream */
-            else {
+            /* Otherwise, fail stream on error */
+            if (bytes_read < 0) {
                 guac_user_log(user, GUAC_LOG_INFO, "Error reading file");
                 guac_protocol_send_end(user->socket, stream);
                 guac_user_free_stream(user, stream);
+                guac_common_ssh_sftp_download_free(user, download);
+                break;
             }
 
-            /* Close file */
-            if (libssh2_sftp_close(file) == 0)
-                guac_user_log(user, GUAC_LOG_DEBUG, "File closed");
-            else
-                guac_user_log(user, GUAC_LOG_INFO, "Unable to close file");
+            download->offset = 0;
+            download->length = bytes_read;
 
         }
 
-        guac_socket_flush(user->socket);
+        /* Send as much buffered data as fits within a single blob */
+        size_t length = download->length - download->offset;
+        if (length > GUAC_PROTOCOL_BLOB_MAX_LENGTH)
+            length = GUAC_PROTOCOL_BLOB_MAX_LENGTH;
+
+        guac_stream_send_blob(user->socket, stream,
+                download->buffer + download->offset, length);
+        download->offset += length;
+
+        guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes sent to user",
+                (int) length);
 
     }
 
-    /* Otherwise, return stream to user */
-    else
-        guac_user_free_stream(user, stream);
+    guac_socket_flush(user->socket);
 
     return 0;
 }
@@ -550,7 +913,7 @@ guac_stream* guac_common_ssh_sftp_download_file(
     /* Allocate stream */
     stream = guac_user_alloc_stream(user);
     stream->ack_handler = guac_common_ssh_sftp_ack_handler;
-    stream->data = file;
+    stream->data = guac_common_ssh_sftp_download_alloc(file);
 
     /* Send stream start, strip name */
     filename = basename(filename);
@@ -583,6 +946,26 @@ void guac_common_ssh_sftp_set_upload_path(
 
 }
 
+/**
+ * Frees the given directory listing state, closing the directory being
+ * listed, if any, and releasing its listing.
+ *
+ * @param list_state
+ *     The directory listing state to free.
+ */
+static void guac_common_ssh_sftp_ls_state_free(
+        guac_common_ssh_sftp_ls_state* list_state) {
+
+    if (list_state->directory != NULL)
+        libssh2_sftp_closedir(list_state->directory);
+
+    guac_common_ssh_sftp_listing_release(list_state->filesystem,
+            list_state->listing);
+
+    guac_mem_free(list_state);
+
+}
+
 /**
  * Handler for ack messages received due to receipt of a "body" or "blob"
  * instruction associated with a SFTP directory list operation.
@@ -607,7 +990,9 @@ void guac_common_ssh_sftp_set_upload_path(
 static int guac_common_ssh_sftp_ls_ack_handler(guac_user* user,
         guac_stream* stream, char* message, guac_protocol_status status) {
 
-    int bytes_read;
+    int bytes_read = 1;
+    int window_full = 0;
+    int complete;
 
     char filename[GUAC_COMMON_SSH_SFTP_MAX_PATH];
     LIBSSH2_SFTP_ATTRIBUTES attributes;
@@ -616,66 +1001,100 @@ static int guac_common_ssh_sftp_ls_ack_handler(guac_user* user,
         (guac_common_ssh_sftp_ls_state*) stream->data;
 
     guac_common_ssh_sftp_filesystem* filesystem = list_state->filesystem;
+    guac_common_ssh_sftp_listing* listing = list_state->listing;
 
     LIBSSH2_SFTP* sftp = filesystem->sftp_session;
 
     /* If unsuccessful, free stream and abort */
     if (status != GUAC_PROTOCOL_STATUS_SUCCESS) {
-        libssh2_sftp_closedir(list_state->directory);
+        guac_common_ssh_sftp_ls_state_free(list_state);
         guac_user_free_stream(user, stream);
-        guac_mem_free(list_state);
         return 0;
     }
 
-    /* While directory entries remain */
-    while ((bytes_read = libssh2_sftp_readdir(list_state->directory,
-                filename, sizeof(filename), &attributes)) > 0) {
+    /* Send the following entries of a cached listing */
+    if (list_state->directory == NULL) {
 
-        char absolute_path[GUAC_COMMON_SSH_SFTP_MAX_PATH];
-
-        /* Skip current and parent directory entries */
-        if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0)
-            continue;
+        while (list_state->next_entry < listing->count
+                && !window_full) {
 
-        /* Concatenate into absolute path - skip if invalid */
-        if (!guac_ssh_append_filename(absolute_path, 
-                    list_state->directory_name, filename)) {
+            guac_common_ssh_sftp_ls_entry* entry =
+                &listing->entries[list_state->next_entry++];
 
-            guac_user_log(user, GUAC_LOG_DEBUG,
-                    "Skipping filename \"%s\" - filename is invalid or "
-                    "resulting path is too long", filename);
+            window_full = guac_common_json_write_property(user, stream,
+                    &list_state->json_state, entry->path, entry->is_directory
+                        ? GUAC_USER_STREAM_INDEX_MIMETYPE
+                        : "application/octet-stream");
 
-            continue;
         }
 
-        /* Stat explicitly if symbolic link (might point to directory) */
-        if (LIBSSH2_SFTP_S_ISLNK(attributes.permissions))
-            libssh2_sftp_stat(sftp, absolute_path, &attributes);
+        complete = (list_state->next_entry == listing->count);
 
-        /* Determine mimetype */
-        const char* mimetype;
-        if (LIBSSH2_SFTP_S_ISDIR(attributes.permissions))
-            mimetype = GUAC_USER_STREAM_INDEX_MIMETYPE;
-        else
-            mimetype = "application/octet-stream";
+    }
 
-        /* Write entry, waiting for next ack if a blob is written */
-        if (guac_common_json_write_property(user, stream,
-                    &list_state->json_state, absolute_path, mimetype))
-            break;
+    /* Otherwise, read and send entries while directory entries remain */
+    else {
+
+        while (!window_full
+                && (bytes_read = libssh2_sftp_readdir(list_state->directory,
+                        filename, sizeof(filename), &attributes)) > 0) {
+
+            char absolute_path[GUAC_COMMON_SSH_SFTP_MAX_PATH];
+
+            /* Skip current and parent directory entries */
+            if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0)
+                continue;
+
+            /* Concatenate into absolute path - skip if invalid */
+            if (!guac_ssh_append_filename(absolute_path, 
+                        list_state->directory_name, filename)) {
+
+                guac_user_log(user, GUAC_LOG_DEBUG,
+                        "Skipping filename \"%s\" - filename is invalid or "
+                        "resulting path is too long", filename);
+
+                continue;
+            }
+
+            /* Stat explicitly if symbolic link (might point to directory) */
+            if (LIBSSH2_SFTP_S_ISLNK(attributes.permissions))
+                libssh2_sftp_stat(sftp, absolute_path, &attributes);
+
+            /* Determine mimetype */
+            int is_directory = LIBSSH2_SFTP_S_ISDIR(attributes.permissions);
+            const char* mimetype;
+            if (is_directory)
+                mimetype = GUAC_USER_STREAM_INDEX_MIMETYPE;
+            else
+                mimetype = "application/octet-stream";
+
+            /* Record entry for later reuse of the listing */
+            guac_common_ssh_sftp_listing_add(listing, absolute_path,
+                    is_directory);
+
+            /* Write entry, waiting for next ack if the window is full */
+            window_full = guac_common_json_write_property(user, stream,
+                    &list_state->json_state, absolute_path, mimetype);
+
+        }
+
+        complete = (bytes_read <= 0);
+
+        /* Retain listing only if the entire directory was read */
+        if (bytes_read == 0)
+            guac_common_ssh_sftp_listing_store(filesystem, listing);
 
     }
 
     /* Complete JSON and cleanup at end of directory */
-    if (bytes_read <= 0) {
+    if (complete) {
 
         /* Complete JSON object */
         guac_common_json_end_object(user, stream, &list_state->json_state);
         guac_common_json_flush(user, stream, &list_state->json_state);
 
         /* Clean up resources */
-        libssh2_sftp_closedir(list_state->directory);
-        guac_mem_free(list_state);
+        guac_common_ssh_sftp_ls_state_free(list_state);
 
         /* Signal of stream */
         guac_protocol_send_end(user->socket, stream);
@@ -720,6 +1139,57 @@ static int guac_common_ssh_sftp_translate_name(char* fullpath,
 
 }
 
+/**
+ * Begins sending the given directory listing to the given user as the body of
+ * the given filesystem object, continuing as acks are received.
+ *
+ * @param user
+ *     The user requesting the directory listing.
+ *
+ * @param object
+ *     The Guacamole protocol object associated with the SFTP filesystem.
+ *
+ * @param name
+ *     The name of the directory within the filesystem object.
+ *
+ * @param directory
+ *     The open handle of the directory being listed over SFTP, or NULL if the
+ *     given listing is complete and was retrieved from the listing cache.
+ *
+ * @param listing
+ *     The listing to send. If the directory is being listed over SFTP, this
+ *     must be a new, empty listing. The reference to the listing becomes
+ *     owned by the listing operation.
+ */
+static void guac_common_ssh_sftp_send_listing(guac_user* user,
+        guac_object* object, const char* name, LIBSSH2_SFTP_HANDLE* directory,
+        guac_common_ssh_sftp_listing* listing) {
+
+    /* Init directory listing state */
+    guac_common_ssh_sftp_ls_state* list_state =
+        guac_mem_alloc(sizeof(guac_common_ssh_sftp_ls_state));
+
+    list_state->filesystem = (guac_common_ssh_sftp_filesystem*) object->data;
+    list_state->directory = directory;
+    list_state->listing = listing;
+    list_state->next_entry = 0;
+    guac_strlcpy(list_state->directory_name, listing->directory_name,
+            sizeof(list_state->directory_name));
+
+    /* Allocate stream for body */
+    guac_stream* stream = guac_user_alloc_stream(user);
+    stream->ack_handler = guac_common_ssh_sftp_ls_ack_handler;
+    stream->data = list_state;
+
+    /* Init JSON object state */
+    guac_common_json_begin_object(user, stream, &list_state->json_state);
+
+    /* Associate new stream with get request */
+    guac_protocol_send_body(user->socket, object, stream,
+            GUAC_USER_STREAM_INDEX_MIMETYPE, name);
+
+}
+
 /**
  * Handler for get messages. In context of SFTP and the filesystem exposed via
  * the Guacamole protocol, get messages request the body of a file within the
@@ -755,6 +1225,17 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
         return 0;
     }
 
+    /* Send any recent listing of the requested directory without again
+     * listing the directory over SFTP */
+    guac_common_ssh_sftp_listing* listing =
+        guac_common_ssh_sftp_listing_acquire(filesystem, name);
+
+    if (listing != NULL) {
+        guac_common_ssh_sftp_send_listing(user, object, name, NULL, listing);
+        guac_socket_flush(user->socket);
+        return 0;
+    }
+
     /* Attempt to read file information */
     if (libssh2_sftp_stat(sftp, fullpath, &attributes)) {
         guac_user_log(user, GUAC_LOG_INFO, "Unable to read file \"%s\"",
@@ -773,35 +1254,21 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
             return 0;
         }
 
-        /* Init directory listing state */
-        guac_common_ssh_sftp_ls_state* list_state =
-            guac_mem_alloc(sizeof(guac_common_ssh_sftp_ls_state));
-
-        list_state->directory = dir;
-        list_state->filesystem = filesystem;
-
-        int length = guac_strlcpy(list_state->directory_name, name,
-                sizeof(list_state->directory_name));
-
         /* Bail out if directory name is too long to store */
-        if (length >= sizeof(list_state->directory_name)) {
+        if (strlen(name) >= GUAC_COMMON_SSH_SFTP_MAX_PATH) {
             guac_user_log(user, GUAC_LOG_INFO, "Unable to read directory "
                     "\"%s\": Path too long", fullpath);
-            guac_mem_free(list_state);
+            libssh2_sftp_closedir(dir);
             return 0;
         }
 
-        /* Allocate stream for body */
-        guac_stream* stream = guac_user_alloc_stream(user);
-        stream->ack_handler = guac_common_ssh_sftp_ls_ack_handler;
-        stream->data = list_state;
-
-        /* Init JSON object state */
-        guac_common_json_begin_object(user, stream, &list_state->json_state);
+        /* Build a new listing as the directory is read */
+        listing = guac_mem_zalloc(sizeof(guac_common_ssh_sftp_listing));
+        guac_strlcpy(listing->directory_name, name,
+                sizeof(listing->directory_name));
+        listing->refcount = 1;
 
-        /* Associate new stream with get request */
-        guac_protocol_send_body(user->socket, object, stream,
-                GUAC_USER_STREAM_INDEX_MIMETYPE, name);
+        guac_common_ssh_sftp_send_listing(user, object, name, dir, listing);
 
     }
 
@@ -828,7 +1295,7 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
         /* Allocate stream for body */
         guac_stream* stream = guac_user_alloc_stream(user);
         stream->ack_handler = guac_common_ssh_sftp_ack_handler;
-        stream->data = file;
+        stream->data = guac_common_ssh_sftp_download_alloc(file);
 
         /* Associate new stream with get request */
         guac_protocol_send_body(user->socket, object, stream,
@@ -901,6 +1368,7 @@ static int guac_common_ssh_sftp_put_handler(guac_user* user,
     /* Acknowledge stream if successful */
     if (file != NULL) {
         guac_user_log(user, GUAC_LOG_DEBUG, "File \"%s\" opened", fullpath);
+        guac_common_ssh_sftp_invalidate_listings(filesystem);
         guac_protocol_send_ack(user->socket, stream, "SFTP: File opened",
                 GUAC_PROTOCOL_STATUS_SUCCESS);
     }
@@ -917,8 +1385,8 @@ static int guac_common_ssh_sftp_put_handler(guac_user* user,
     stream->blob_handler = guac_common_ssh_sftp_blob_handler;
     stream->end_handler = guac_common_ssh_sftp_end_handler;
 
-    /* Store file within stream */
-    stream->data = file;
+    /* Store upload state within stream */
+    stream->data = guac_common_ssh_sftp_upload_alloc(file);
 
     guac_socket_flush(user->socket);
     return 0;
@@ -968,6 +1436,14 @@ guac_common_ssh_sftp_filesystem* guac_common_ssh_create_sftp_filesystem(
     if (sftp_session == NULL)
         return NULL;
 
+    /* The SFTP channel is opened by libssh2 with its default window, which
+     * can only be grown after the fact */
+    if (session->window_size > GUAC_COMMON_SSH_MIN_WINDOW_SIZE)
+        libssh2_channel_receive_window_adjust2(
+                libssh2_sftp_get_channel(sftp_session),
+                session->window_size - GUAC_COMMON_SSH_MIN_WINDOW_SIZE,
+                1, NULL);
+
     /* Allocate data for SFTP session */
     guac_common_ssh_sftp_filesystem* filesystem =
         guac_mem_alloc(sizeof(guac_common_ssh_sftp_filesystem));
@@ -998,6 +1474,11 @@ guac_common_ssh_sftp_filesystem* guac_common_ssh_create_sftp_filesystem(
     /* Initially upload files to current directory */
     strcpy(filesystem->upload_path, ".");
 
+    /* No directories have yet been listed */
+    pthread_mutex_init(&filesystem->listing_cache_lock, NULL);
+    for (int i = 0; i < GUAC_COMMON_SSH_SFTP_LS_CACHE_SIZE; i++)
+        filesystem->listing_cache[i] = NULL;
+
     /* Return allocated filesystem */
     return filesystem;
 
@@ -1009,6 +1490,10 @@ void guac_common_ssh_destroy_sftp_filesystem(
     /* Shutdown SFTP session */
     libssh2_sftp_shutdown(filesystem->sftp_session);
 
+    /* Free any cached directory listings */
+    guac_common_ssh_sftp_invalidate_listings(filesystem);
+    pthread_mutex_destroy(&filesystem->listing_cache_lock);
+
     /* Free associated memory */
     guac_mem_free(filesystem->name);
     guac_mem_free(filesystem);
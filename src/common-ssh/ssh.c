@@ -41,10 +41,12 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
 #include <pwd.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/select.h>
@@ -468,18 +470,81 @@ static void check_if_algs_are_supported(guac_client* client, LIBSSH2_SESSION* se
     }
 }
 
+/**
+ * Returns the smoothed round-trip time of the TCP connection associated with
+ * the given socket, as measured by the kernel.
+ *
+ * @param fd
+ *     The file descriptor of the connected socket.
+ *
+ * @return
+ *     The round-trip time of the connection, in microseconds, or zero if the
+ *     round-trip time cannot be determined on this platform.
+ */
+static int guac_common_ssh_get_rtt(int fd) {
+
+#ifdef TCP_INFO
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0)
+        return info.tcpi_rtt;
+#endif
+
+    return 0;
+
+}
+
+void guac_common_ssh_set_channel_sizes(guac_common_ssh_session* session,
+        int window_size, int packet_size) {
+
+    /* Size the window automatically to cover the bandwidth-delay product of
+     * the connection, if not specified */
+    if (window_size <= 0) {
+        uint64_t product = (uint64_t) session->rtt
+            * GUAC_COMMON_SSH_AUTO_WINDOW_BANDWIDTH / 1000000;
+        window_size = product > GUAC_COMMON_SSH_MAX_WINDOW_SIZE
+            ? GUAC_COMMON_SSH_MAX_WINDOW_SIZE : (int) product;
+    }
+
+    if (window_size < GUAC_COMMON_SSH_MIN_WINDOW_SIZE)
+        window_size = GUAC_COMMON_SSH_MIN_WINDOW_SIZE;
+    else if (window_size > GUAC_COMMON_SSH_MAX_WINDOW_SIZE)
+        window_size = GUAC_COMMON_SSH_MAX_WINDOW_SIZE;
+
+    if (packet_size <= 0 || packet_size > GUAC_COMMON_SSH_MAX_PACKET_SIZE)
+        packet_size = GUAC_COMMON_SSH_MAX_PACKET_SIZE;
+
+    session->window_size = window_size;
+    session->packet_size = packet_size;
+
+}
+
+LIBSSH2_CHANNEL* guac_common_ssh_open_channel(guac_common_ssh_session* session) {
+
+    static const char type[] = "session";
+
+    return libssh2_channel_open_ex(session->session, type, sizeof(type) - 1,
+            session->window_size, session->packet_size, NULL, 0);
+
+}
+
 guac_common_ssh_session* guac_common_ssh_create_session(guac_client* client,
         const char* hostname, const char* port, guac_common_ssh_user* user,
         int timeout, int keepalive, const char* host_key,
         guac_ssh_credential_handler* credential_handler) {
 
-    int fd = guac_tcp_connect(hostname, port, timeout);
+    guac_tcp_connect_timings timings;
+    int fd = guac_tcp_connect_timed(hostname, port, timeout, &timings);
     if (fd < 0) {
         guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
             "Failed to open TCP connection to %s on %s.", hostname, port);
         return NULL;
     }
 
+    /* Report time spent resolving and connecting to the SSH server */
+    guac_client_record_connect_phase(client, "ssh_resolve", timings.resolve);
+    guac_client_record_connect_phase(client, "ssh_connect", timings.connect);
+
     /* Allocate new session */
     guac_common_ssh_session* common_session =
         guac_mem_alloc(sizeof(guac_common_ssh_session));
@@ -565,6 +630,10 @@ guac_common_ssh_session* guac_common_ssh_create_session(guac_client* client,
     common_session->session = session;
     common_session->fd = fd;
     common_session->credential_handler = credential_handler;
+    common_session->rtt = guac_common_ssh_get_rtt(fd);
+
+    /* Size channel windows for the measured round-trip time by default */
+    guac_common_ssh_set_channel_sizes(common_session, 0, 0);
 
     /* Attempt authentication */
     if (guac_common_ssh_authenticate(common_session)) {
@@ -23,23 +23,28 @@
 #include <guacamole/client.h>
 #include <guacamole/mem.h>
 #include <guacamole/protocol.h>
+#include <guacamole/socket.h>
 #include <guacamole/stream.h>
 #include <guacamole/string.h>
-#include <guacamole/user.h>
 #include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 
-guac_common_clipboard* guac_common_clipboard_alloc(int buffer_size) {
+guac_common_clipboard* guac_common_clipboard_alloc(guac_client* client,
+        int buffer_size) {
 
     guac_common_clipboard* clipboard = guac_mem_alloc(sizeof(guac_common_clipboard));
 
     /* Init clipboard */
+    clipboard->client = client;
     clipboard->mimetype[0] = '\0';
     clipboard->buffer = guac_mem_alloc(buffer_size);
     clipboard->available = buffer_size;
     clipboard->length = 0;
 
+    guac_client_account_memory(client, GUAC_CLIENT_MEMORY_CLIPBOARD,
+            buffer_size);
+
     pthread_mutex_init(&(clipboard->lock), NULL);
 
     return clipboard;
@@ -52,6 +57,8 @@ void guac_common_clipboard_free(guac_common_clipboard* clipboard) {
     pthread_mutex_destroy(&(clipboard->lock));
 
     /* Free buffer */
+    guac_client_account_memory(clipboard->client, GUAC_CLIENT_MEMORY_CLIPBOARD,
+            -(int64_t) clipboard->available);
     guac_mem_free(clipboard->buffer);
 
     /* Free base structure */
@@ -59,32 +66,29 @@ void guac_common_clipboard_free(guac_common_clipboard* clipboard) {
 
 }
 
-/**
- * Callback for guac_client_foreach_user() which sends clipboard data to each
- * connected client.
- *
- * @param user
- *     The user to send the clipboard data to.
- *
- * @param
- *     A pointer to the guac_common_clipboard structure containing the
- *     clipboard data that should be sent to the given user.
- *
- * @return
- *     Always NULL.
- */
-static void* __send_user_clipboard(guac_user* user, void* data) {
+void guac_common_clipboard_send(guac_common_clipboard* clipboard, guac_client* client) {
 
-    guac_common_clipboard* clipboard = (guac_common_clipboard*) data;
+    pthread_mutex_lock(&(clipboard->lock));
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Broadcasting clipboard to all connected users.");
 
     char* current = clipboard->buffer;
     int remaining = clipboard->length;
 
-    /* Begin stream */
-    guac_stream* stream = guac_user_alloc_stream(user);
-    guac_protocol_send_clipboard(user->socket, stream, clipboard->mimetype);
+    /* Begin stream. The clipboard is written only once, to the broadcast
+     * socket, such that each block is encoded once and the same encoded
+     * data is then shared by all connected users. */
+    guac_stream* stream = guac_client_alloc_stream(client);
+    if (stream == NULL) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Unable to broadcast "
+                "clipboard: no streams available.");
+        pthread_mutex_unlock(&(clipboard->lock));
+        return;
+    }
+
+    guac_protocol_send_clipboard(client->socket, stream, clipboard->mimetype);
 
-    guac_user_log(user, GUAC_LOG_DEBUG,
+    guac_client_log(client, GUAC_LOG_DEBUG,
             "Created stream %i for %s clipboard data.",
             stream->index, clipboard->mimetype);
 
@@ -94,13 +98,10 @@ static void* __send_user_clipboard(guac_user* user, void* data) {
         /* Calculate size of next block */
         int block_size = GUAC_COMMON_CLIPBOARD_BLOCK_SIZE;
         if (remaining < block_size)
-            block_size = remaining; 
+            block_size = remaining;
 
         /* Send block */
-        guac_protocol_send_blob(user->socket, stream, current, block_size);
-        guac_user_log(user, GUAC_LOG_DEBUG,
-                "Sent %i bytes of clipboard data on stream %i.",
-                block_size, stream->index);
+        guac_protocol_send_blob(client->socket, stream, current, block_size);
 
         /* Next block */
         remaining -= block_size;
@@ -108,25 +109,15 @@ static void* __send_user_clipboard(guac_user* user, void* data) {
 
     }
 
-    guac_user_log(user, GUAC_LOG_DEBUG,
-            "Clipboard stream %i complete.",
-            stream->index);
+    guac_client_log(client, GUAC_LOG_DEBUG,
+            "Sent %i bytes of clipboard data on stream %i.",
+            clipboard->length, stream->index);
 
     /* End stream */
-    guac_protocol_send_end(user->socket, stream);
-    guac_socket_flush(user->socket);
-    guac_user_free_stream(user, stream);
-
-    return NULL;
-
-}
-
-void guac_common_clipboard_send(guac_common_clipboard* clipboard, guac_client* client) {
-
-    pthread_mutex_lock(&(clipboard->lock));
+    guac_protocol_send_end(client->socket, stream);
+    guac_socket_flush(client->socket);
+    guac_client_free_stream(client, stream);
 
-    guac_client_log(client, GUAC_LOG_DEBUG, "Broadcasting clipboard to all connected users.");
-    guac_client_foreach_user(client, __send_user_clipboard, clipboard);
     guac_client_log(client, GUAC_LOG_DEBUG, "Broadcast of clipboard complete.");
 
     pthread_mutex_unlock(&(clipboard->lock));
@@ -148,7 +139,7 @@ void guac_common_clipboard_reset(guac_common_clipboard* clipboard,
 
 }
 
-void guac_common_clipboard_append(guac_common_clipboard* clipboard, const char* data, int length) {
+int guac_common_clipboard_append(guac_common_clipboard* clipboard, const char* data, int length) {
 
     pthread_mutex_lock(&(clipboard->lock));
 
@@ -165,5 +156,7 @@ void guac_common_clipboard_append(guac_common_clipboard* clipboard, const char*
 
     pthread_mutex_unlock(&(clipboard->lock));
 
+    return length;
+
 }
 
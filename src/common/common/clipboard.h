@@ -48,6 +48,12 @@
  */
 typedef struct guac_common_clipboard {
 
+    /**
+     * The guac_client to which the memory allocated for the clipboard buffer
+     * is attributed.
+     */
+    guac_client* client;
+
     /**
      * Lock which restricts simultaneous access to the clipboard, guaranteeing
      * ordered modifications to the clipboard and that changes to the clipboard
@@ -79,11 +85,16 @@ typedef struct guac_common_clipboard {
 
 /**
  * Creates a new clipboard.
- * 
+ *
+ * @param client
+ *     The guac_client on whose behalf the clipboard is being created, to
+ *     which the memory allocated for the clipboard buffer is attributed.
+ *
  * @param buffer_size
  *     The buffer size in bytes.
  */
-guac_common_clipboard* guac_common_clipboard_alloc(int buffer_size);
+guac_common_clipboard* guac_common_clipboard_alloc(guac_client* client,
+        int buffer_size);
 
 /**
  * Frees the given clipboard.
@@ -95,7 +106,9 @@ void guac_common_clipboard_free(guac_common_clipboard* clipboard);
 
 /**
  * Sends the contents of the clipboard along the given client, splitting
- * the contents as necessary.
+ * the contents as necessary. The contents are written once to the broadcast
+ * socket of the client, such that they are encoded only once regardless of
+ * the number of connected users.
  *
  * @param clipboard
  *     The clipboard whose contents should be sent.
@@ -129,8 +142,13 @@ void guac_common_clipboard_reset(guac_common_clipboard* clipboard, const char* m
  *
  * @param length
  *     The number of bytes to append from the data given.
+ *
+ * @return
+ *     The number of bytes actually appended, which will be less than the
+ *     number of bytes given if the clipboard buffer has been filled and the
+ *     data was truncated.
  */
-void guac_common_clipboard_append(guac_common_clipboard* clipboard, const char* data, int length);
+int guac_common_clipboard_append(guac_common_clipboard* clipboard, const char* data, int length);
 
 #endif
 
@@ -22,9 +22,17 @@
 
 #include "config.h"
 
+#include <guacamole/protocol-constants.h>
 #include <guacamole/stream.h>
 #include <guacamole/user.h>
 
+/**
+ * The number of bytes of JSON that are buffered before being sent as a single
+ * blob. This is the largest blob that may be sent within one instruction, such
+ * that JSON is sent in as few blobs as possible.
+ */
+#define GUAC_COMMON_JSON_BUFFER_SIZE GUAC_PROTOCOL_BLOB_MAX_LENGTH
+
 /**
  * The current streaming state of an arbitrary JSON object, consisting of
  * any number of property name/value pairs.
@@ -36,7 +44,7 @@ typedef struct guac_common_json_state {
      * body of the object being sent over the Guacamole protocol will be
      * built here.
      */
-    char buffer[4096];
+    char buffer[GUAC_COMMON_JSON_BUFFER_SIZE];
 
     /**
      * The number of bytes currently used within the JSON buffer.
@@ -54,7 +62,9 @@ typedef struct guac_common_json_state {
 /**
  * Given a stream, the user to which it belongs, and the current stream state
  * of a JSON object, flushes the contents of the JSON buffer to a blob
- * instruction. Note that this will flush the JSON buffer only, and will not
+ * instruction. The blob is counted against the window of the stream (see
+ * guac_stream_send_blob()), but is sent regardless of whether the window is
+ * already full. Note that this will flush the JSON buffer only, and will not
  * necessarily flush the underlying guac_socket of the user.
  *
  * @param user
@@ -92,7 +102,9 @@ void guac_common_json_flush(guac_user* user, guac_stream* stream,
  *     The number of bytes in the buffer.
  *
  * @return
- *     Non-zero if at least one blob was written, zero otherwise.
+ *     Non-zero if at least one blob was written and the window of the stream
+ *     is now full, such that no further JSON should be written until an ack
+ *     is received, zero otherwise.
  */
 int guac_common_json_write(guac_user* user, guac_stream* stream,
         guac_common_json_state* json_state, const char* buffer, int length);
@@ -101,7 +113,7 @@ int guac_common_json_write(guac_user* user, guac_stream* stream,
  * Given a stream, the user to which it belongs, and the current stream state
  * of a JSON object state, writes the given string as a proper JSON string,
  * including starting and ending quotes. The contents of the string will be
- * escaped as necessary.
+ * escaped as necessary, including any control characters.
  *
  * @param user
  *     The user to which the data will be flushed as necessary.
@@ -118,7 +130,9 @@ int guac_common_json_write(guac_user* user, guac_stream* stream,
  *     The string to write.
  *
  * @return
- *     Non-zero if at least one blob was written, zero otherwise.
+ *     Non-zero if at least one blob was written and the window of the stream
+ *     is now full, such that no further JSON should be written until an ack
+ *     is received, zero otherwise.
  */
 int guac_common_json_write_string(guac_user* user,
         guac_stream* stream, guac_common_json_state* json_state,
@@ -147,7 +161,9 @@ int guac_common_json_write_string(guac_user* user,
  *     The value of the property to write.
  *
  * @return
- *     Non-zero if at least one blob was written, zero otherwise.
+ *     Non-zero if at least one blob was written and the window of the stream
+ *     is now full, such that no further JSON should be written until an ack
+ *     is received, zero otherwise.
  */
 int guac_common_json_write_property(guac_user* user, guac_stream* stream,
         guac_common_json_state* json_state, const char* name,
@@ -187,7 +203,9 @@ void guac_common_json_begin_object(guac_user* user, guac_stream* stream,
  *     The state object whose in-progress JSON object should be terminated.
  *
  * @return
- *     Non-zero if at least one blob was written, zero otherwise.
+ *     Non-zero if at least one blob was written and the window of the stream
+ *     is now full, such that no further JSON should be written until an ack
+ *     is received, zero otherwise.
  */
 int guac_common_json_end_object(guac_user* user, guac_stream* stream,
         guac_common_json_state* json_state);
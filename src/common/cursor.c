@@ -22,7 +22,6 @@
 #include "common/cursor.h"
 #include "common/ibar_cursor.h"
 #include "common/pointer_cursor.h"
-#include "common/surface.h"
 
 #include <cairo/cairo.h>
 #include <guacamole/client.h>
@@ -261,15 +260,6 @@ void guac_common_cursor_set_argb(guac_common_cursor* cursor, int hx, int hy,
 
 }
 
-void guac_common_cursor_set_surface(guac_common_cursor* cursor, int hx, int hy,
-    guac_common_surface* surface) {
-
-    /* Set cursor to surface contents */
-    guac_common_cursor_set_argb(cursor, hx, hy, surface->buffer,
-            surface->width, surface->height, surface->stride);
-
-}
-
 void guac_common_cursor_set_pointer(guac_common_cursor* cursor) {
 
     guac_common_cursor_set_argb(cursor, 0, 0,
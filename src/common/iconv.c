@@ -22,6 +22,7 @@
 
 #include <guacamole/unicode.h>
 #include <stdint.h>
+#include <string.h>
 
 /**
  * Lookup table for Unicode code points, indexed by CP-1252 codepoint.
@@ -61,11 +62,256 @@ const static int __GUAC_RDP_CP1252_CODEPOINT[32] = {
     0x0178, /* 0x9F */
 };
 
+/**
+ * Returns the number of bytes used by the given reader to represent each
+ * ASCII character, storing the ASCII character that the reader does not read
+ * verbatim (if any) within the given int. Readers not recognized by this
+ * function must always be invoked individually for each character.
+ *
+ * @param reader
+ *     The reader to test.
+ *
+ * @param special
+ *     Pointer to an int that should receive the ASCII character that must
+ *     always be read using the given reader, or zero if all non-null ASCII
+ *     characters are read verbatim.
+ *
+ * @return
+ *     The number of bytes used by the given reader for each ASCII character,
+ *     or zero if the given reader is not recognized.
+ */
+static int guac_iconv_reader_ascii_width(guac_iconv_read* reader,
+        int* special) {
+
+    *special = 0;
+
+    if (reader == GUAC_READ_UTF8 || reader == GUAC_READ_CP1252
+            || reader == GUAC_READ_ISO8859_1)
+        return 1;
+
+    if (reader == GUAC_READ_UTF16)
+        return 2;
+
+    /* Normalized readers must handle all carriage returns themselves */
+    *special = '\r';
+
+    if (reader == GUAC_READ_UTF8_NORMALIZED
+            || reader == GUAC_READ_CP1252_NORMALIZED
+            || reader == GUAC_READ_ISO8859_1_NORMALIZED)
+        return 1;
+
+    if (reader == GUAC_READ_UTF16_NORMALIZED)
+        return 2;
+
+    return 0;
+
+}
+
+/**
+ * Returns the number of bytes used by the given writer to represent each
+ * ASCII character, storing the ASCII character that the writer does not write
+ * verbatim (if any) within the given int. Writers not recognized by this
+ * function must always be invoked individually for each character.
+ *
+ * @param writer
+ *     The writer to test.
+ *
+ * @param special
+ *     Pointer to an int that should receive the ASCII character that must
+ *     always be written using the given writer, or zero if all non-null
+ *     ASCII characters are written verbatim.
+ *
+ * @return
+ *     The number of bytes used by the given writer for each ASCII character,
+ *     or zero if the given writer is not recognized.
+ */
+static int guac_iconv_writer_ascii_width(guac_iconv_write* writer,
+        int* special) {
+
+    *special = 0;
+
+    if (writer == GUAC_WRITE_UTF8 || writer == GUAC_WRITE_CP1252
+            || writer == GUAC_WRITE_ISO8859_1)
+        return 1;
+
+    if (writer == GUAC_WRITE_UTF16)
+        return 2;
+
+    /* CRLF writers must handle all newlines themselves */
+    *special = '\n';
+
+    if (writer == GUAC_WRITE_UTF8_CRLF
+            || writer == GUAC_WRITE_CP1252_CRLF
+            || writer == GUAC_WRITE_ISO8859_1_CRLF)
+        return 1;
+
+    if (writer == GUAC_WRITE_UTF16_CRLF)
+        return 2;
+
+    return 0;
+
+}
+
+/**
+ * Returns a 64-bit value having each of its bytes set to the given value.
+ */
+#define GUAC_ICONV_REPEAT_BYTE(value) (UINT64_C(0x0101010101010101) * (value))
+
+/**
+ * Returns non-zero if any byte of the given 64-bit value is zero.
+ */
+#define GUAC_ICONV_HAS_ZERO_BYTE(value) \
+    (((value) - GUAC_ICONV_REPEAT_BYTE(0x01)) & ~(value) & GUAC_ICONV_REPEAT_BYTE(0x80))
+
+/**
+ * Converts the longest possible run of non-null ASCII characters from the
+ * given input to the given output, where each character occupies a fixed
+ * number of bytes in each. Characters are validated eight at a time where
+ * the input uses one byte per character. Conversion stops before the first
+ * character that is not ASCII, is null, is one of the given special
+ * characters, or does not fit within the remaining input or output.
+ *
+ * @param input
+ *     Pointer to the location within the input buffer of the next character
+ *     to read. This pointer is advanced past all characters converted.
+ *
+ * @param in_remaining
+ *     The number of bytes remaining in the input buffer.
+ *
+ * @param in_width
+ *     The number of bytes used by each ASCII character within the input (1
+ *     or 2).
+ *
+ * @param output
+ *     Pointer to the location within the output buffer that the next
+ *     character should be written to. This pointer is advanced past all
+ *     characters written.
+ *
+ * @param out_remaining
+ *     The number of bytes remaining in the output buffer.
+ *
+ * @param out_width
+ *     The number of bytes used by each ASCII character within the output (1
+ *     or 2).
+ *
+ * @param in_special
+ *     An ASCII character that must not be converted by this function, or
+ *     zero if there is no such character.
+ *
+ * @param out_special
+ *     An additional ASCII character that must not be converted by this
+ *     function, or zero if there is no such character.
+ *
+ * @return
+ *     The number of characters converted.
+ */
+static int guac_iconv_convert_ascii(const char** input, int in_remaining,
+        int in_width, char** output, int out_remaining, int out_width,
+        int in_special, int out_special) {
+
+    int max_count = in_remaining / in_width;
+    if (max_count > out_remaining / out_width)
+        max_count = out_remaining / out_width;
+
+    const unsigned char* current = (const unsigned char*) *input;
+    unsigned char* written = (unsigned char*) *output;
+    int count = 0;
+
+    /* Validate eight single-byte characters at a time */
+    if (in_width == 1) {
+
+        uint64_t in_mask = GUAC_ICONV_REPEAT_BYTE(in_special);
+        uint64_t out_mask = GUAC_ICONV_REPEAT_BYTE(out_special);
+
+        while (max_count - count >= 8) {
+
+            uint64_t block;
+            memcpy(&block, current, sizeof(block));
+
+            if ((block & GUAC_ICONV_REPEAT_BYTE(0x80))
+                    || GUAC_ICONV_HAS_ZERO_BYTE(block)
+                    || GUAC_ICONV_HAS_ZERO_BYTE(block ^ in_mask)
+                    || GUAC_ICONV_HAS_ZERO_BYTE(block ^ out_mask))
+                break;
+
+            /* Copy directly or widen to 16-bit characters */
+            if (out_width == 1)
+                memcpy(written, current, 8);
+            else {
+                for (int i = 0; i < 8; i++) {
+                    uint16_t value = current[i];
+                    memcpy(written + i * 2, &value, 2);
+                }
+            }
+
+            current += 8;
+            written += 8 * out_width;
+            count += 8;
+
+        }
+
+    }
+
+    /* Convert remaining characters individually */
+    for (; count < max_count; count++) {
+
+        int value;
+        if (in_width == 1)
+            value = *current;
+        else {
+            uint16_t unit;
+            memcpy(&unit, current, 2);
+            value = unit;
+        }
+
+        if (value == 0 || value >= 0x80
+                || value == in_special || value == out_special)
+            break;
+
+        if (out_width == 1)
+            *written = value;
+        else {
+            uint16_t unit = value;
+            memcpy(written, &unit, 2);
+        }
+
+        current += in_width;
+        written += out_width;
+
+    }
+
+    *input = (const char*) current;
+    *output = (char*) written;
+    return count;
+
+}
+
 int guac_iconv(guac_iconv_read* reader, const char** input, int in_remaining,
                guac_iconv_write* writer, char** output, int out_remaining) {
 
+    /* Determine whether runs of ASCII may be converted in bulk, bypassing
+     * the reader and writer */
+    int in_special, out_special;
+    int in_width = guac_iconv_reader_ascii_width(reader, &in_special);
+    int out_width = guac_iconv_writer_ascii_width(writer, &out_special);
+    int bulk = in_width && out_width;
+
     while (in_remaining > 0 && out_remaining > 0) {
 
+        /* Convert any run of ASCII directly */
+        if (bulk) {
+
+            int count = guac_iconv_convert_ascii(input, in_remaining, in_width,
+                    output, out_remaining, out_width, in_special, out_special);
+
+            in_remaining -= count * in_width;
+            out_remaining -= count * out_width;
+
+            if (in_remaining <= 0 || out_remaining <= 0)
+                break;
+
+        }
+
         int value;
         const char* read_start;
         char* write_start;
@@ -22,6 +22,7 @@
 #include "common/json.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -30,12 +31,26 @@
 #include <guacamole/stream.h>
 #include <guacamole/user.h>
 
+/**
+ * For each possible byte value, the character which must follow a backslash
+ * to escape that byte within a JSON string, 'u' if the byte must instead be
+ * escaped as a "\u" sequence, or zero if the byte may be written as-is.
+ */
+static const char guac_common_json_escapes[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', /* 0x00 - 0x07 */
+    'b', 't', 'n', 'u', 'f', 'r', 'u', 'u', /* 0x08 - 0x0F */
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', /* 0x10 - 0x17 */
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', /* 0x18 - 0x1F */
+    ['"']  = '"',
+    ['\\'] = '\\'
+};
+
 void guac_common_json_flush(guac_user* user, guac_stream* stream,
         guac_common_json_state* json_state) {
 
     /* If JSON buffer is non-empty, write contents to blob and reset */
     if (json_state->size > 0) {
-        guac_protocol_send_blob(user->socket, stream,
+        guac_stream_send_blob(user->socket, stream,
                 json_state->buffer, json_state->size);
 
         /* Reset JSON buffer size */
@@ -56,17 +71,17 @@ int guac_common_json_write(guac_user* user, guac_stream* stream,
      */
     while (length > 0) {
 
-        /* Ensure provided data does not exceed size of buffer */
-        int blob_length = length;
-        if (blob_length > sizeof(json_state->buffer))
-            blob_length = sizeof(json_state->buffer);
-
-        /* Flush if more room is needed */
-        if (json_state->size + blob_length > sizeof(json_state->buffer)) {
+        /* Flush if no room remains */
+        if (json_state->size == sizeof(json_state->buffer)) {
             guac_common_json_flush(user, stream, json_state);
             blob_written = 1;
         }
 
+        /* Fill as much of the JSON buffer as possible */
+        int blob_length = sizeof(json_state->buffer) - json_state->size;
+        if (blob_length > length)
+            blob_length = length;
+
         /* Append data to JSON buffer */
         memcpy(json_state->buffer + json_state->size,
                 buffer, blob_length);
@@ -79,7 +94,8 @@ int guac_common_json_write(guac_user* user, guac_stream* stream,
 
     }
 
-    return blob_written;
+    /* Further data should be written only if the stream can accept it */
+    return blob_written && !guac_stream_can_send(stream);
 
 }
 
@@ -94,32 +110,42 @@ int guac_common_json_write_string(guac_user* user,
             json_state, "\"", 1);
 
     /* Write given string, escaping as necessary */
-    const char* current = str;
+    const unsigned char* current = (const unsigned char*) str;
+    const unsigned char* unescaped = current;
     for (; *current != '\0'; current++) {
 
-        /* Escape all quotes and back-slashes */
-        if (*current == '"' || *current == '\\') {
+        /* Characters not requiring escaping are written in runs */
+        char escape = guac_common_json_escapes[*current];
+        if (!escape)
+            continue;
 
-            /* Write any string content up to current character */
-            if (current != str)
-                blob_written |= guac_common_json_write(user, stream,
-                        json_state, str, current - str);
-
-            /* Escape the character that was just read */
+        /* Write any string content up to current character */
+        if (current != unescaped)
             blob_written |= guac_common_json_write(user, stream,
-                    json_state, "\\", 1);
+                    json_state, (const char*) unescaped, current - unescaped);
+
+        /* Escape the character that was just read */
+        char sequence[7];
+        if (escape == 'u')
+            snprintf(sequence, sizeof(sequence), "\\u%04x", *current);
+        else {
+            sequence[0] = '\\';
+            sequence[1] = escape;
+            sequence[2] = '\0';
+        }
 
-            /* Reset string */
-            str = current;
+        blob_written |= guac_common_json_write(user, stream,
+                json_state, sequence, strlen(sequence));
 
-        }
+        /* Resume string after escaped character */
+        unescaped = current + 1;
 
     }
 
     /* Write any remaining string content */
-    if (current != str)
+    if (current != unescaped)
         blob_written |= guac_common_json_write(user, stream,
-                json_state, str, current - str);
+                json_state, (const char*) unescaped, current - unescaped);
 
     /* Write ending quote */
     blob_written |= guac_common_json_write(user, stream,
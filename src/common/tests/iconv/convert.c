@@ -127,3 +127,100 @@ void test_iconv__normalize_crlf() {
     }
 }
 
+
+/**
+ * Writes the given ASCII string to the given buffer using the given number of
+ * bytes per character, including the null terminator.
+ *
+ * @param buffer
+ *     The buffer to write to.
+ *
+ * @param str
+ *     The ASCII string to write.
+ *
+ * @param width
+ *     The number of bytes to use per character (1 for UTF-8, CP-1252 and
+ *     ISO 8859-1, 2 for UTF-16).
+ *
+ * @return
+ *     The number of bytes written.
+ */
+static int write_ascii(unsigned char* buffer, const char* str, int width) {
+
+    int length = 0;
+
+    do {
+        buffer[length++] = *str;
+        if (width == 2)
+            buffer[length++] = 0;
+    } while (*(str++) != '\0');
+
+    return length;
+
+}
+
+/**
+ * Test which verifies that long runs of ASCII text, which may be converted in
+ * bulk, are converted between every supported encoding identically to text
+ * converted one character at a time, including when the output buffer is too
+ * small to contain the entire converted string.
+ */
+void test_iconv__ascii_runs() {
+
+    const char* text =
+        "The quick brown fox jumps over the lazy dog.\n"
+        "The quick brown fox jumps over the lazy dog.\n"
+        "Pack my box with five dozen liquor jugs.";
+
+    const char* text_windows =
+        "The quick brown fox jumps over the lazy dog.\r\n"
+        "The quick brown fox jumps over the lazy dog.\r\n"
+        "Pack my box with five dozen liquor jugs.";
+
+    for (int i = 0; i < NUM_SUPPORTED_ENCODINGS; i++) {
+        for (int j = 0; j < NUM_SUPPORTED_ENCODINGS; j++) {
+
+            encoding_test_parameters* from = &test_params[i];
+            encoding_test_parameters* to = &test_params[j];
+
+            int from_width = (from->reader == GUAC_READ_UTF16) ? 2 : 1;
+            int to_width = (to->writer == GUAC_WRITE_UTF16) ? 2 : 1;
+
+            unsigned char input[512];
+            unsigned char expected[512];
+
+            test_string in_string = {
+                .buffer = input,
+                .size = write_ascii(input, text_windows, from_width)
+            };
+
+            test_string out_string = {
+                .buffer = expected,
+                .size = write_ascii(expected, text, to_width)
+            };
+
+            printf("# \"%s\" -> \"%s\" (ASCII) ...\n", from->name, to->name);
+            verify_conversion(from->reader_normalized, &in_string,
+                    to->writer, &out_string);
+
+            out_string.size = write_ascii(expected, text_windows, to_width);
+            verify_conversion(from->reader_normalized, &in_string,
+                    to->writer_crlf, &out_string);
+
+            /* Output must stop exactly at the end of a truncated buffer */
+            char output[37];
+            const char* current_input = (const char*) input;
+            char* current_output = output;
+
+            guac_iconv(from->reader, &current_input, in_string.size,
+                    to->writer, &current_output, sizeof(output));
+
+            CU_ASSERT_EQUAL(sizeof(output) / to_width * to_width,
+                    current_output - output);
+            CU_ASSERT_EQUAL(0, memcmp(output, expected,
+                        current_output - output));
+
+        }
+    }
+
+}
@@ -0,0 +1,72 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/json.h"
+
+#include <CUnit/CUnit.h>
+
+#include <string.h>
+
+/**
+ * Writes the given string as a JSON string to a new, empty JSON state,
+ * verifying that no blob is written and that the resulting JSON matches the
+ * expected value.
+ *
+ * @param str
+ *     The string to write.
+ *
+ * @param expected
+ *     The JSON that should result from writing the given string.
+ */
+static void verify_json_string(const char* str, const char* expected) {
+
+    guac_common_json_state json_state;
+    json_state.size = 0;
+    json_state.properties_written = 0;
+
+    /* Short strings must be buffered without touching the user or stream */
+    CU_ASSERT_EQUAL(guac_common_json_write_string(NULL, NULL, &json_state,
+                str), 0);
+
+    CU_ASSERT_EQUAL_FATAL(json_state.size, strlen(expected));
+    CU_ASSERT_NSTRING_EQUAL(json_state.buffer, expected, json_state.size);
+
+}
+
+/**
+ * Test which verifies that guac_common_json_write_string() writes strings
+ * containing no special characters as-is, surrounded by quotes.
+ */
+void test_json__write_string_plain() {
+    verify_json_string("", "\"\"");
+    verify_json_string("/home/user/file.txt", "\"/home/user/file.txt\"");
+    verify_json_string("caf\xC3\xA9", "\"caf\xC3\xA9\"");
+}
+
+/**
+ * Test which verifies that guac_common_json_write_string() escapes quotes,
+ * backslashes and control characters.
+ */
+void test_json__write_string_escaped() {
+    verify_json_string("\"quoted\"", "\"\\\"quoted\\\"\"");
+    verify_json_string("C:\\Users", "\"C:\\\\Users\"");
+    verify_json_string("a\tb\nc\rd", "\"a\\tb\\nc\\rd\"");
+    verify_json_string("\x01\x1F", "\"\\u0001\\u001f\"");
+}
+
@@ -0,0 +1,475 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "cluster.h"
+#include "log.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/string.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/**
+ * The number of seconds to wait for a connection to another node of the
+ * cluster to be established before giving up.
+ */
+#define GUACD_CLUSTER_CONNECT_TIMEOUT 5
+
+/**
+ * The directory shared by all nodes of the cluster, or NULL if connections
+ * are not shared across nodes.
+ */
+static char* guacd_cluster_registry = NULL;
+
+/**
+ * The hostname or address at which other nodes can reach this guacd.
+ */
+static char* guacd_cluster_host = NULL;
+
+/**
+ * The port on which other nodes can reach this guacd.
+ */
+static char* guacd_cluster_port = NULL;
+
+/**
+ * Produces the path of the registry entry for the connection having the
+ * given ID. As connection IDs are received from users joining connections,
+ * only IDs consisting of a "$" followed by letters, digits, and hyphens are
+ * accepted, such that no ID can refer to a file outside the registry. The
+ * "$" is omitted from the path.
+ *
+ * @param connection_id
+ *     The ID of the connection.
+ *
+ * @param prefix
+ *     A prefix to prepend to the filename of the entry, such as "." for a
+ *     temporary file that should not be mistaken for an entry.
+ *
+ * @param path
+ *     The buffer that should receive the path.
+ *
+ * @param length
+ *     The size of the path buffer, in bytes.
+ *
+ * @return
+ *     Zero if the path was produced successfully, non-zero if the ID is not
+ *     valid or the buffer is too small.
+ */
+static int guacd_cluster_entry_path(const char* connection_id,
+        const char* prefix, char* path, size_t length) {
+
+    if (*connection_id != '$')
+        return 1;
+
+    connection_id++;
+
+    size_t id_length = strlen(connection_id);
+    if (id_length == 0 || id_length >= GUACD_CLUSTER_MAX_ID_LENGTH)
+        return 1;
+
+    for (const char* c = connection_id; *c != '\0'; c++) {
+        if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z')
+                    || (*c >= '0' && *c <= '9') || *c == '-'))
+            return 1;
+    }
+
+    return snprintf(path, length, "%s/%s%s", guacd_cluster_registry, prefix,
+            connection_id) >= length;
+
+}
+
+/**
+ * Reads the node named by the registry entry at the given path. Each entry
+ * consists of the hostname of the owning node and its port, each on its own
+ * line.
+ *
+ * @param path
+ *     The path of the registry entry to read.
+ *
+ * @param buffer
+ *     The buffer that should receive the contents of the entry. The host and
+ *     port returned will point within this buffer.
+ *
+ * @param length
+ *     The size of the buffer, in bytes.
+ *
+ * @param host
+ *     Storage for a pointer to the hostname of the owning node.
+ *
+ * @param port
+ *     Storage for a pointer to the port of the owning node.
+ *
+ * @return
+ *     Zero if the entry was read successfully, non-zero if the entry does
+ *     not exist or is malformed.
+ */
+static int guacd_cluster_read_entry(const char* path, char* buffer,
+        size_t length, char** host, char** port) {
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    ssize_t size = read(fd, buffer, length - 1);
+    close(fd);
+
+    if (size <= 0)
+        return 1;
+
+    buffer[size] = '\0';
+
+    char* newline = strchr(buffer, '\n');
+    if (newline == NULL || newline == buffer)
+        return 1;
+
+    *newline = '\0';
+    *host = buffer;
+    *port = newline + 1;
+
+    /* The port may or may not be terminated by a newline */
+    newline = strchr(*port, '\n');
+    if (newline != NULL)
+        *newline = '\0';
+
+    return **port == '\0';
+
+}
+
+/**
+ * Returns whether the given host and port are those of this node.
+ *
+ * @param host
+ *     The hostname of the node to test.
+ *
+ * @param port
+ *     The port of the node to test.
+ *
+ * @return
+ *     Non-zero if the given host and port are those of this node, zero
+ *     otherwise.
+ */
+static int guacd_cluster_is_self(const char* host, const char* port) {
+    return strcmp(host, guacd_cluster_host) == 0
+        && strcmp(port, guacd_cluster_port) == 0;
+}
+
+/**
+ * Removes all registry entries naming this node, such as those left behind
+ * if an earlier instance of guacd on this node terminated unexpectedly.
+ */
+static void guacd_cluster_remove_stale(void) {
+
+    DIR* registry = opendir(guacd_cluster_registry);
+    if (registry == NULL) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to read cluster registry "
+                "\"%s\": %s", guacd_cluster_registry, strerror(errno));
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(registry)) != NULL) {
+
+        /* Skip ".", "..", and temporary files */
+        if (entry->d_name[0] == '.')
+            continue;
+
+        char path[4096];
+        if (snprintf(path, sizeof(path), "%s/%s", guacd_cluster_registry,
+                    entry->d_name) >= sizeof(path))
+            continue;
+
+        char buffer[GUACD_CLUSTER_MAX_ENTRY_LENGTH];
+        char* host;
+        char* port;
+
+        if (!guacd_cluster_read_entry(path, buffer, sizeof(buffer), &host, &port)
+                && guacd_cluster_is_self(host, port)) {
+            guacd_log(GUAC_LOG_DEBUG, "Removing stale cluster registry entry "
+                    "for connection \"$%s\".", entry->d_name);
+            unlink(path);
+        }
+
+    }
+
+    closedir(registry);
+
+}
+
+void guacd_cluster_init(const char* registry, const char* host,
+        const char* port) {
+
+    if (registry == NULL)
+        return;
+
+    if (host == NULL) {
+        guacd_log(GUAC_LOG_WARNING, "No host was given at which other nodes "
+                "of the cluster can reach this node. Connections will not be "
+                "shared across nodes.");
+        return;
+    }
+
+    guac_mem_free(guacd_cluster_registry);
+    guac_mem_free(guacd_cluster_host);
+    guac_mem_free(guacd_cluster_port);
+
+    guacd_cluster_registry = guac_strdup(registry);
+    guacd_cluster_host = guac_strdup(host);
+    guacd_cluster_port = guac_strdup(port);
+
+    guacd_cluster_remove_stale();
+
+    guacd_log(GUAC_LOG_INFO, "Sharing connections with other nodes through "
+            "cluster registry \"%s\" as %s, port %s.", registry, host, port);
+
+}
+
+void guacd_cluster_register(const char* connection_id) {
+
+    if (guacd_cluster_registry == NULL)
+        return;
+
+    char path[4096];
+    char temp_path[4096];
+
+    if (guacd_cluster_entry_path(connection_id, "", path, sizeof(path))
+            || guacd_cluster_entry_path(connection_id, ".", temp_path,
+                sizeof(temp_path))) {
+        guacd_log(GUAC_LOG_WARNING, "Connection \"%s\" cannot be registered "
+                "with the cluster registry.", connection_id);
+        return;
+    }
+
+    char entry[GUACD_CLUSTER_MAX_ENTRY_LENGTH];
+    int length = snprintf(entry, sizeof(entry), "%s\n%s\n",
+            guacd_cluster_host, guacd_cluster_port);
+    if (length >= sizeof(entry)) {
+        guacd_log(GUAC_LOG_WARNING, "Cluster host and port are too long to "
+                "be registered.");
+        return;
+    }
+
+    /* Write the entry under a temporary name first, such that other nodes
+     * never observe a partially-written entry */
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to register connection \"%s\" "
+                "with the cluster registry: %s", connection_id,
+                strerror(errno));
+        return;
+    }
+
+    int failed = write(fd, entry, length) != length;
+    if (close(fd))
+        failed = 1;
+
+    if (failed || rename(temp_path, path)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to register connection \"%s\" "
+                "with the cluster registry: %s", connection_id,
+                strerror(errno));
+        unlink(temp_path);
+        return;
+    }
+
+    guacd_log(GUAC_LOG_DEBUG, "Connection \"%s\" registered with the cluster "
+            "registry.", connection_id);
+
+}
+
+void guacd_cluster_deregister(const char* connection_id) {
+
+    if (guacd_cluster_registry == NULL)
+        return;
+
+    char path[4096];
+    if (guacd_cluster_entry_path(connection_id, "", path, sizeof(path)))
+        return;
+
+    if (unlink(path) && errno != ENOENT)
+        guacd_log(GUAC_LOG_WARNING, "Unable to remove connection \"%s\" from "
+                "the cluster registry: %s", connection_id, strerror(errno));
+
+}
+
+/**
+ * Behaves exactly as write(), but writes as much as possible, returning
+ * successfully only if the entire buffer was written.
+ *
+ * @param fd
+ *     The file descriptor to write to.
+ *
+ * @param buffer
+ *     The buffer containing the data to be written.
+ *
+ * @param length
+ *     The number of bytes in the buffer to write.
+ *
+ * @return
+ *     Zero if all data was written, non-zero if an error occurred.
+ */
+static int guacd_cluster_write_all(int fd, const char* buffer, size_t length) {
+
+    while (length > 0) {
+
+        ssize_t written = write(fd, buffer, length);
+        if (written < 0)
+            return 1;
+
+        length -= written;
+        buffer += written;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Opens a TCP connection to the given node of the cluster.
+ *
+ * @param host
+ *     The hostname or address of the node.
+ *
+ * @param port
+ *     The port of the node.
+ *
+ * @return
+ *     A file descriptor connected to the given node, or -1 if no connection
+ *     could be established.
+ */
+static int guacd_cluster_open(const char* host, const char* port) {
+
+    struct addrinfo hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_protocol = IPPROTO_TCP
+    };
+
+    struct addrinfo* addresses;
+    int retval = getaddrinfo(host, port, &hints, &addresses);
+    if (retval != 0) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to resolve cluster node \"%s\": "
+                "%s", host, gai_strerror(retval));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* current = addresses; current != NULL;
+            current = current->ai_next) {
+
+        fd = socket(current->ai_family, SOCK_STREAM, 0);
+        if (fd < 0)
+            continue;
+
+        /* Bound the time spent connecting to an unresponsive node */
+        struct timeval timeout = { .tv_sec = GUACD_CLUSTER_CONNECT_TIMEOUT };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        if (connect(fd, current->ai_addr, current->ai_addrlen) == 0) {
+
+            /* Relayed data must not be subject to the connect timeout */
+            struct timeval no_timeout = { 0 };
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &no_timeout,
+                    sizeof(no_timeout));
+
+            /* Avoid adding latency to relayed instructions */
+            const int SO_TRUE = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+                    (const void*) &SO_TRUE, sizeof(SO_TRUE));
+
+            break;
+
+        }
+
+        close(fd);
+        fd = -1;
+
+    }
+
+    freeaddrinfo(addresses);
+
+    if (fd < 0)
+        guacd_log(GUAC_LOG_WARNING, "Unable to connect to cluster node %s, "
+                "port %s: %s", host, port, strerror(errno));
+
+    return fd;
+
+}
+
+int guacd_cluster_connect(const char* connection_id) {
+
+    if (guacd_cluster_registry == NULL)
+        return -1;
+
+    char path[4096];
+    if (guacd_cluster_entry_path(connection_id, "", path, sizeof(path)))
+        return -1;
+
+    char buffer[GUACD_CLUSTER_MAX_ENTRY_LENGTH];
+    char* host;
+    char* port;
+
+    if (guacd_cluster_read_entry(path, buffer, sizeof(buffer), &host, &port))
+        return -1;
+
+    /* An entry naming this node is stale, as the connection would otherwise
+     * have been found locally. Relaying to ourselves would loop forever. */
+    if (guacd_cluster_is_self(host, port)) {
+        guacd_log(GUAC_LOG_DEBUG, "Ignoring stale cluster registry entry for "
+                "connection \"%s\".", connection_id);
+        return -1;
+    }
+
+    int fd = guacd_cluster_open(host, port);
+    if (fd < 0)
+        return -1;
+
+    /* Select the connection on the owning node exactly as the user selected
+     * it on this node (connection IDs are validated as pure ASCII above, so
+     * their length in bytes is also their length in characters) */
+    char select[GUACD_CLUSTER_MAX_ID_LENGTH + 32];
+    int length = snprintf(select, sizeof(select), "6.select,%zu.%s;",
+            strlen(connection_id), connection_id);
+
+    if (guacd_cluster_write_all(fd, select, length)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to select connection \"%s\" on "
+                "cluster node %s, port %s: %s", connection_id, host, port,
+                strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    guacd_log(GUAC_LOG_INFO, "Relaying user to connection \"%s\" on cluster "
+            "node %s, port %s", connection_id, host, port);
+
+    return fd;
+
+}
@@ -0,0 +1,104 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_CLUSTER_H
+#define GUACD_CLUSTER_H
+
+#include "config.h"
+
+/**
+ * The maximum length of the contents of a cluster registry entry, including
+ * the hostname and port of the owning node, in bytes.
+ */
+#define GUACD_CLUSTER_MAX_ENTRY_LENGTH 1024
+
+/**
+ * The maximum length of a connection ID that may be registered with the
+ * cluster registry, in bytes, including the "$" prefix.
+ */
+#define GUACD_CLUSTER_MAX_ID_LENGTH 128
+
+/**
+ * Begins registering all connections handled by this guacd within the given
+ * cluster registry, such that other guacd nodes sharing the same registry
+ * can relay users joining those connections to this node. The registry is a
+ * directory shared by all nodes, such as a directory on a network
+ * filesystem, containing one file per active connection that names the node
+ * handling that connection. Any entries left behind for this node by an
+ * earlier instance of guacd are removed. If no registry is given, connections
+ * are not registered and only connections handled by this node may be
+ * joined.
+ *
+ * @param registry
+ *     The directory shared by all nodes of the cluster, or NULL if
+ *     connections should not be shared across nodes.
+ *
+ * @param host
+ *     The hostname or address at which other nodes of the cluster can reach
+ *     this guacd.
+ *
+ * @param port
+ *     The port on which other nodes of the cluster can reach this guacd.
+ */
+void guacd_cluster_init(const char* registry, const char* host,
+        const char* port);
+
+/**
+ * Records within the cluster registry that the connection having the given
+ * ID is handled by this node. Failure to register a connection is logged but
+ * otherwise ignored, as the connection may still be joined through this node.
+ * If no cluster registry is in use, this function has no effect.
+ *
+ * @param connection_id
+ *     The ID of the connection to register.
+ */
+void guacd_cluster_register(const char* connection_id);
+
+/**
+ * Removes any entry previously added to the cluster registry by
+ * guacd_cluster_register() for the connection having the given ID. If no
+ * cluster registry is in use, this function has no effect.
+ *
+ * @param connection_id
+ *     The ID of the connection to deregister.
+ */
+void guacd_cluster_deregister(const char* connection_id);
+
+/**
+ * Looks up the node handling the connection having the given ID within the
+ * cluster registry and, if that connection is handled by some other node,
+ * opens a connection to the guacd of that node and selects the given
+ * connection, such that all data subsequently written to the returned file
+ * descriptor is handled by the owning node exactly as if the user had
+ * connected to that node directly. The "args" instruction sent by the owning
+ * node in response has not yet been read.
+ *
+ * @param connection_id
+ *     The ID of the connection to be joined.
+ *
+ * @return
+ *     A file descriptor connected to the guacd of the node handling the
+ *     given connection, which must eventually be closed by the caller, or -1
+ *     if no cluster registry is in use, the connection is not registered to
+ *     any other node, or the owning node cannot be reached.
+ */
+int guacd_cluster_connect(const char* connection_id);
+
+#endif
+
@@ -25,9 +25,12 @@
 
 #include <guacamole/client.h>
 #include <guacamole/mem.h>
+#include <guacamole/parser-constants.h>
+#include <guacamole/socket-constants.h>
 #include <guacamole/string.h>
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,6 +40,116 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+/**
+ * Returns whether the given name is the name of a resource limit which may be
+ * specified within the "limits" section.
+ *
+ * @param name
+ *     The name to test.
+ *
+ * @return
+ *     Non-zero if the name is "cpu", "memory", or "bandwidth", zero
+ *     otherwise.
+ */
+static int guacd_conf_is_limit(const char* name) {
+    return strcmp(name, "cpu") == 0
+        || strcmp(name, "memory") == 0
+        || strcmp(name, "bandwidth") == 0;
+}
+
+/**
+ * Parses the value of the resource limit having the given name, storing the
+ * parsed value within the given limits. The name must be a valid limit name,
+ * as determined by guacd_conf_is_limit().
+ *
+ * @param name
+ *     The name of the limit being parsed.
+ *
+ * @param value
+ *     The value to parse.
+ *
+ * @param limits
+ *     The limits that should receive the parsed value.
+ *
+ * @return
+ *     Zero if the value was parsed successfully, non-zero if the value is
+ *     invalid, in which case guacd_conf_parse_error is set.
+ */
+static int guacd_conf_parse_limit(const char* name, const char* value,
+        guacd_config_limits* limits) {
+
+    char* end;
+    errno = 0;
+
+    /* CPU limits are numbers of CPUs, which may be fractional */
+    if (strcmp(name, "cpu") == 0) {
+
+        double cpus = strtod(value, &end);
+        if (errno || *value == '\0' || *end != '\0' || cpus < 0 || cpus > 1048576) {
+            guacd_conf_parse_error = "Invalid CPU limit. The CPU limit must be a non-negative number of CPUs.";
+            return 1;
+        }
+
+        limits->cpu = (long) (cpus * 1000 + 0.5);
+        return 0;
+
+    }
+
+    long amount = strtol(value, &end, 10);
+    if (errno || *value == '\0' || *end != '\0' || amount < 0 || amount > INT_MAX) {
+        guacd_conf_parse_error = "Invalid memory or bandwidth limit. Memory and bandwidth limits must be non-negative integers.";
+        return 1;
+    }
+
+    if (strcmp(name, "memory") == 0)
+        limits->memory = amount;
+    else
+        limits->bandwidth = amount;
+
+    return 0;
+
+}
+
+/**
+ * Returns the resource limits specific to the given protocol, adding a new
+ * entry for that protocol (with every limit deferring to the defaults) if no
+ * such entry yet exists.
+ *
+ * @param config
+ *     The configuration containing the protocol-specific limits.
+ *
+ * @param protocol
+ *     The name of the protocol.
+ *
+ * @param length
+ *     The number of characters within the protocol name.
+ *
+ * @return
+ *     The limits specific to the given protocol, or NULL if there is no room
+ *     for another protocol, in which case guacd_conf_parse_error is set.
+ */
+static guacd_config_limits* guacd_conf_get_protocol_limits(guacd_config* config,
+        const char* protocol, size_t length) {
+
+    for (int i = 0; i < config->protocol_limit_count; i++) {
+        guacd_config_limits* limits = &config->protocol_limits[i];
+        if (strlen(limits->protocol) == length
+                && strncmp(limits->protocol, protocol, length) == 0)
+            return limits;
+    }
+
+    if (config->protocol_limit_count >= GUACD_CONF_MAX_LIMITS) {
+        guacd_conf_parse_error = "Too many protocol-specific limits. No more than 16 protocols may have their own limits.";
+        return NULL;
+    }
+
+    guacd_config_limits* limits = &config->protocol_limits[config->protocol_limit_count++];
+    limits->protocol = guac_strndup(protocol, length);
+    limits->cpu = limits->memory = limits->bandwidth = -1;
+    return limits;
+
+}
+
 /**
  * Updates the configuration with the given parameter/value pair, flagging
  * errors as necessary.
@@ -62,6 +175,45 @@ static int guacd_conf_callback(const char* section, const char* param, const cha
             return 0;
         }
 
+        /* Maximum instruction length */
+        else if (strcmp(param, "max_instruction_length") == 0) {
+
+            char* end;
+            errno = 0;
+            long length = strtol(value, &end, 10);
+
+            /* Invalid instruction length */
+            if (errno || *value == '\0' || *end != '\0' || length <= 0
+                    || length > GUAC_INSTRUCTION_MAX_LENGTH_LIMIT) {
+                guacd_conf_parse_error = "Invalid maximum instruction length. The maximum instruction length must be a positive number of characters no greater than 1048576.";
+                return 1;
+            }
+
+            /* Valid instruction length */
+            config->max_instruction_length = length;
+            return 0;
+
+        }
+
+        /* Output buffer size */
+        else if (strcmp(param, "output_buffer_size") == 0) {
+
+            char* end;
+            errno = 0;
+            long size = strtol(value, &end, 10);
+
+            /* Invalid buffer size */
+            if (errno || *value == '\0' || *end != '\0' || size < 0) {
+                guacd_conf_parse_error = "Invalid output buffer size. The output buffer size must be a non-negative number of bytes.";
+                return 1;
+            }
+
+            /* Valid buffer size */
+            config->output_buffer_size = size;
+            return 0;
+
+        }
+
     }
 
     /* Options related to daemon startup */
@@ -91,6 +243,215 @@ static int guacd_conf_callback(const char* section, const char* param, const cha
 
         }
 
+        /* CPU placement policy */
+        else if (strcmp(param, "cpu_placement") == 0) {
+
+            int policy = guacd_parse_placement_policy(value);
+
+            /* Invalid policy */
+            if (policy < 0) {
+                guacd_conf_parse_error = "Invalid CPU placement policy. Valid policies are: \"none\", \"spread\", and \"pack\".";
+                return 1;
+            }
+
+            /* Valid policy */
+            config->placement_policy = policy;
+            return 0;
+
+        }
+
+        /* CPUs assigned to each connection */
+        else if (strcmp(param, "cpus_per_connection") == 0) {
+
+            char* end;
+            errno = 0;
+            long count = strtol(value, &end, 10);
+
+            /* Invalid number of CPUs */
+            if (errno || *value == '\0' || *end != '\0' || count < 0
+                    || count > GUACD_PLACEMENT_MAX_CPUS) {
+                guacd_conf_parse_error = "Invalid number of CPUs per connection. The number of CPUs must be a non-negative integer no greater than 1024.";
+                return 1;
+            }
+
+            /* Valid number of CPUs */
+            config->cpus_per_connection = count;
+            return 0;
+
+        }
+
+        /* Maximum time to wait for connections to end when draining */
+        else if (strcmp(param, "drain_timeout") == 0) {
+
+            char* end;
+            errno = 0;
+            long timeout = strtol(value, &end, 10);
+
+            /* Invalid timeout */
+            if (errno || *value == '\0' || *end != '\0' || timeout < 0
+                    || timeout > INT_MAX) {
+                guacd_conf_parse_error = "Invalid drain timeout. The drain timeout must be a non-negative number of seconds.";
+                return 1;
+            }
+
+            /* Valid timeout */
+            config->drain_timeout = timeout;
+            return 0;
+
+        }
+
+    }
+
+    /* Image encoding options */
+    else if (strcmp(section, "encoder") == 0) {
+
+        /* Encoder backend */
+        if (strcmp(param, "backend") == 0) {
+            guac_mem_free(config->encoder_backend);
+            config->encoder_backend = guac_strdup(value);
+            return 0;
+        }
+
+    }
+
+    /* Metrics export options */
+    else if (strcmp(section, "metrics") == 0) {
+
+        /* Export socket */
+        if (strcmp(param, "socket") == 0) {
+            guac_mem_free(config->metrics_socket);
+            config->metrics_socket = guac_strdup(value);
+            return 0;
+        }
+
+    }
+
+    /* Options for sharing connections across nodes */
+    else if (strcmp(section, "cluster") == 0) {
+
+        /* Directory shared by all nodes */
+        if (strcmp(param, "registry") == 0) {
+            guac_mem_free(config->cluster_registry);
+            config->cluster_registry = guac_strdup(value);
+            return 0;
+        }
+
+        /* Host at which other nodes can reach this node */
+        else if (strcmp(param, "host") == 0) {
+            guac_mem_free(config->cluster_host);
+            config->cluster_host = guac_strdup(value);
+            return 0;
+        }
+
+        /* Port on which other nodes can reach this node */
+        else if (strcmp(param, "port") == 0) {
+            guac_mem_free(config->cluster_port);
+            config->cluster_port = guac_strdup(value);
+            return 0;
+        }
+
+    }
+
+    /* Per-connection resource limits */
+    else if (strcmp(section, "limits") == 0) {
+
+        /* Directory for per-connection cgroups */
+        if (strcmp(param, "cgroup") == 0) {
+            guac_mem_free(config->cgroup);
+            config->cgroup = guac_strdup(value);
+            return 0;
+        }
+
+        /* Default limits */
+        else if (guacd_conf_is_limit(param))
+            return guacd_conf_parse_limit(param, value, &config->limits);
+
+        /* Protocol-specific limits, named PROTOCOL_LIMIT */
+        const char* separator = strrchr(param, '_');
+        if (separator != NULL && separator != param
+                && guacd_conf_is_limit(separator + 1)) {
+
+            guacd_config_limits* limits = guacd_conf_get_protocol_limits(
+                    config, param, separator - param);
+            if (limits == NULL)
+                return 1;
+
+            return guacd_conf_parse_limit(separator + 1, value, limits);
+
+        }
+
+    }
+
+    /* Pre-forked process pools, with one parameter per protocol */
+    else if (strcmp(section, "pool") == 0) {
+
+        char* end;
+        errno = 0;
+        long size = strtol(value, &end, 10);
+
+        /* Invalid pool size */
+        if (errno || *value == '\0' || *end != '\0' || size < 0
+                || size > GUACD_CONF_MAX_POOL_SIZE) {
+            guacd_conf_parse_error = "Invalid pool size. The pool size must be a non-negative number of processes no greater than 64.";
+            return 1;
+        }
+
+        /* Update the size of the pool if already configured */
+        for (int i = 0; i < config->pool_count; i++) {
+            if (strcmp(config->pools[i].protocol, param) == 0) {
+                config->pools[i].size = size;
+                return 0;
+            }
+        }
+
+        /* Otherwise, add a new pool */
+        if (config->pool_count >= GUACD_CONF_MAX_POOLS) {
+            guacd_conf_parse_error = "Too many process pools. No more than 16 protocols may have a process pool.";
+            return 1;
+        }
+
+        guacd_config_pool* pool = &(config->pools[config->pool_count++]);
+        pool->protocol = guac_strdup(param);
+        pool->size = size;
+        return 0;
+
+    }
+
+    /* Sharing of connections having identical parameters, with one
+     * parameter per protocol */
+    else if (strcmp(section, "share") == 0) {
+
+        guacd_share_mode mode;
+        if (strcmp(value, "none") == 0)
+            mode = GUACD_SHARE_NONE;
+        else if (strcmp(value, "view-only") == 0)
+            mode = GUACD_SHARE_VIEW_ONLY;
+        else if (strcmp(value, "takeover") == 0)
+            mode = GUACD_SHARE_TAKEOVER;
+        else {
+            guacd_conf_parse_error = "Invalid sharing mode. The sharing mode must be \"none\", \"view-only\", or \"takeover\".";
+            return 1;
+        }
+
+        /* Update the mode of the protocol if already configured */
+        for (int i = 0; i < config->share_count; i++) {
+            if (strcmp(config->shares[i].protocol, param) == 0) {
+                config->shares[i].mode = mode;
+                return 0;
+            }
+        }
+
+        /* Otherwise, add a new mode */
+        if (config->share_count >= GUACD_SHARE_MAX_PROTOCOLS) {
+            guacd_conf_parse_error = "Too many sharing modes. No more than 16 protocols may have a sharing mode.";
+            return 1;
+        }
+
+        guacd_config_share* share = &(config->shares[config->share_count++]);
+        share->protocol = guac_strdup(param);
+        share->mode = mode;
+        return 0;
+
     }
 
     /* SSL-specific options */
@@ -184,6 +545,22 @@ guacd_config* guacd_conf_load(void) {
     conf->foreground = 0;
     conf->print_version = 0;
     conf->max_log_level = GUAC_LOG_INFO;
+    conf->encoder_backend = NULL;
+    conf->placement_policy = GUACD_PLACEMENT_NONE;
+    conf->cpus_per_connection = 0;
+    conf->drain_timeout = 0;
+    conf->cgroup = NULL;
+    conf->limits.protocol = NULL;
+    conf->limits.cpu = conf->limits.memory = conf->limits.bandwidth = 0;
+    conf->protocol_limit_count = 0;
+    conf->metrics_socket = NULL;
+    conf->cluster_registry = NULL;
+    conf->cluster_host = NULL;
+    conf->cluster_port = NULL;
+    conf->pool_count = 0;
+    conf->share_count = 0;
+    conf->output_buffer_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+    conf->max_instruction_length = GUAC_INSTRUCTION_MAX_LENGTH;
 
 #ifdef ENABLE_SSL
     conf->cert_file = NULL;
@@ -21,6 +21,7 @@
 
 #include "conf.h"
 #include "conf-parse.h"
+#include "placement.h"
 
 #include <guacamole/client.h>
 
@@ -535,3 +536,15 @@ int guacd_parse_log_level(const char* name) {
 
 }
 
+int guacd_parse_placement_policy(const char* name) {
+
+    /* Translate placement policy name */
+    if (strcmp(name, "none")   == 0) return GUACD_PLACEMENT_NONE;
+    if (strcmp(name, "spread") == 0) return GUACD_PLACEMENT_SPREAD;
+    if (strcmp(name, "pack")   == 0) return GUACD_PLACEMENT_PACK;
+
+    /* No such policy */
+    return -1;
+
+}
+
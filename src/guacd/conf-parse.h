@@ -53,6 +53,13 @@ int guacd_parse_conf(guacd_param_callback* callback, char* buffer, int length, v
  */
 int guacd_parse_log_level(const char* name);
 
+/**
+ * Parses the given placement policy name ("none", "spread", or "pack"),
+ * returning the corresponding guacd_placement_policy, or -1 if no such
+ * policy exists.
+ */
+int guacd_parse_placement_policy(const char* name);
+
 /**
  * Human-readable description of the current error, if any.
  */
@@ -21,6 +21,8 @@
 #define GUACD_CONF_H
 
 #include "config.h"
+#include "placement.h"
+#include "share.h"
 
 #include <guacamole/client.h>
 
@@ -36,6 +38,96 @@
  */
 #define GUACD_DEFAULT_BIND_PORT "4822"
 
+/**
+ * The maximum number of protocols which may have a pool of pre-forked
+ * connection processes.
+ */
+#define GUACD_CONF_MAX_POOLS 16
+
+/**
+ * The maximum number of idle, pre-forked connection processes which may be
+ * kept for any one protocol.
+ */
+#define GUACD_CONF_MAX_POOL_SIZE 64
+
+/**
+ * The maximum number of protocols which may have their own resource limits,
+ * overriding the default limits of all connections.
+ */
+#define GUACD_CONF_MAX_LIMITS 16
+
+/**
+ * The resources that a connection process may consume.
+ */
+typedef struct guacd_config_limits {
+
+    /**
+     * The protocol that these limits apply to, or NULL if these are the
+     * default limits of all connections.
+     */
+    char* protocol;
+
+    /**
+     * The maximum CPU time that the connection process may consume, in
+     * thousandths of a CPU, zero if CPU time is unlimited, or -1 if the
+     * default limit applies.
+     */
+    long cpu;
+
+    /**
+     * The maximum amount of memory that the connection process may use, in
+     * mebibytes, zero if memory is unlimited, or -1 if the default limit
+     * applies.
+     */
+    long memory;
+
+    /**
+     * The maximum rate at which data may be sent to each user of the
+     * connection, in kibibytes per second, zero if bandwidth is unlimited, or
+     * -1 if the default limit applies.
+     */
+    long bandwidth;
+
+} guacd_config_limits;
+
+/**
+ * The number of idle, pre-forked connection processes which guacd should
+ * keep available for a particular protocol.
+ */
+typedef struct guacd_config_pool {
+
+    /**
+     * The name of the protocol that the pooled processes should be
+     * initialized for, such as "rdp" or "vnc".
+     */
+    char* protocol;
+
+    /**
+     * The number of idle processes to keep available for the protocol.
+     */
+    int size;
+
+} guacd_config_pool;
+
+/**
+ * How new connections of a particular protocol should be handled if identical
+ * to an existing connection.
+ */
+typedef struct guacd_config_share {
+
+    /**
+     * The name of the protocol that the sharing mode applies to, such as
+     * "vnc".
+     */
+    char* protocol;
+
+    /**
+     * How identical connections using the protocol should be handled.
+     */
+    guacd_share_mode mode;
+
+} guacd_config_share;
+
 /**
  * The contents of a guacd configuration file.
  */
@@ -51,6 +143,17 @@ typedef struct guacd_config {
      */
     char* bind_port;
 
+    /**
+     * The size of the output buffer of each user's connection, in bytes.
+     */
+    size_t output_buffer_size;
+
+    /**
+     * The maximum number of characters to accept within any one element of
+     * the instructions received from each user.
+     */
+    int max_instruction_length;
+
     /**
      * The file to write the PID in, if any.
      */
@@ -83,6 +186,101 @@ typedef struct guacd_config {
      */
     guac_client_log_level max_log_level;
 
+    /**
+     * The name of the encoder backend to use for JPEG and WebP encoding, or
+     * NULL if images should always be encoded in software.
+     */
+    char* encoder_backend;
+
+    /**
+     * How connection processes should be assigned to CPUs.
+     */
+    guacd_placement_policy placement_policy;
+
+    /**
+     * The number of CPUs to assign to each connection process, or zero if
+     * each connection process should be assigned all CPUs of a NUMA node.
+     */
+    int cpus_per_connection;
+
+    /**
+     * The maximum number of seconds that guacd should wait for existing
+     * connections to end after being asked to drain, or zero to wait
+     * indefinitely.
+     */
+    int drain_timeout;
+
+    /**
+     * The cgroup v2 directory beneath which a cgroup should be created for
+     * each connection process to enforce its CPU and memory limits, or NULL
+     * if CPU and memory should not be limited.
+     */
+    char* cgroup;
+
+    /**
+     * The default resource limits of all connections.
+     */
+    guacd_config_limits limits;
+
+    /**
+     * Resource limits specific to individual protocols. Only the first
+     * protocol_limit_count entries are valid.
+     */
+    guacd_config_limits protocol_limits[GUACD_CONF_MAX_LIMITS];
+
+    /**
+     * The number of protocols having their own resource limits.
+     */
+    int protocol_limit_count;
+
+    /**
+     * The path of the UNIX domain socket through which the metrics of all
+     * connection processes should be exported, or NULL if metrics should not
+     * be tracked.
+     */
+    char* metrics_socket;
+
+    /**
+     * The directory shared by all guacd nodes of a cluster through which
+     * connections are shared across nodes, or NULL if only connections
+     * handled by this node may be joined.
+     */
+    char* cluster_registry;
+
+    /**
+     * The hostname or address at which other nodes of the cluster can reach
+     * this guacd, or NULL if not specified.
+     */
+    char* cluster_host;
+
+    /**
+     * The port on which other nodes of the cluster can reach this guacd, or
+     * NULL if the port that guacd binds to should be used.
+     */
+    char* cluster_port;
+
+    /**
+     * The process pools configured for each protocol. Only the first
+     * pool_count entries are valid.
+     */
+    guacd_config_pool pools[GUACD_CONF_MAX_POOLS];
+
+    /**
+     * The number of protocols which have a configured process pool.
+     */
+    int pool_count;
+
+    /**
+     * The sharing modes configured for each protocol. Only the first
+     * share_count entries are valid.
+     */
+    guacd_config_share shares[GUACD_SHARE_MAX_PROTOCOLS];
+
+    /**
+     * The number of protocols which have a configured sharing mode.
+     */
+    int share_count;
+
 } guacd_config;
 
 #endif
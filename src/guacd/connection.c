@@ -19,11 +19,16 @@
 
 #include "config.h"
 
+#include "cluster.h"
 #include "connection.h"
+#include "drain.h"
 #include "log.h"
 #include "move-fd.h"
 #include "proc.h"
 #include "proc-map.h"
+#include "proc-pool.h"
+#include "relay.h"
+#include "share.h"
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
@@ -32,6 +37,7 @@
 #include <guacamole/plugin.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
+#include <guacamole/string.h>
 #include <guacamole/user.h>
 
 #ifdef ENABLE_SSL
@@ -45,6 +51,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 /**
  * Behaves exactly as write(), but writes as much as possible, returning
@@ -114,6 +121,7 @@ static void* guacd_connection_write_thread(void* data) {
     while ((length = guac_parser_shift(params->parser, buffer, sizeof(buffer))) > 0) {
         if (__write_all(params->fd, buffer, length) < 0)
             break;
+        guacd_metrics_add(params->metrics, &params->metrics->bytes_received, length);
     }
 
     /* Parser is no longer needed */
@@ -123,6 +131,7 @@ static void* guacd_connection_write_thread(void* data) {
     while ((length = guac_socket_read(params->socket, buffer, sizeof(buffer))) > 0) {
         if (__write_all(params->fd, buffer, length) < 0)
             break;
+        guacd_metrics_add(params->metrics, &params->metrics->bytes_received, length);
     }
 
     return NULL;
@@ -144,6 +153,7 @@ void* guacd_connection_io_thread(void* data) {
         if (guac_socket_write(params->socket, buffer, length))
             break;
         guac_socket_flush(params->socket);
+        guacd_metrics_add(params->metrics, &params->metrics->bytes_sent, length);
     }
 
     /* Wait for write thread to die */
@@ -159,36 +169,91 @@ void* guacd_connection_io_thread(void* data) {
 }
 
 /**
- * Adds the given socket as a new user to the given process, automatically
- * reading/writing from the socket via read/write threads. The given socket,
- * parser, and any associated resources will be freed unless the user is not
- * added successfully.
- *
- * If adding the user fails for any reason, non-zero is returned. Zero is
- * returned upon success.
- *
- * @param proc
- *     The existing process to add the user to.
+ * Attempts to relay all data between the given socket and the given file
+ * descriptor using the relay thread shared by all connections (see
+ * guacd_relay_add()), rather than a dedicated pair of threads. Any data
+ * already buffered by the given guac_parser is written first. If relaying
+ * starts successfully, the given socket, parser, and file descriptor are
+ * freed or owned by the relay.
  *
  * @param parser
- *     The parser associated with the given guac_socket (used to handle the
- *     user's connection handshake thus far).
+ *     The parser associated with the given guac_socket, which may have
+ *     unhandled data in its parsing buffers.
  *
  * @param socket
- *     The socket associated with the user to be added to the existing
- *     process.
+ *     The guac_socket which is directly handling I/O from a user's connection
+ *     to guacd.
+ *
+ * @param socket_fd
+ *     The file descriptor underlying the given guac_socket, or -1 if the
+ *     guac_socket does not expose raw connection data through a file
+ *     descriptor (such as when SSL/TLS is in use without kernel TLS).
+ *
+ * @param fd
+ *     The file descriptor which is being handled by a guac_socket within the
+ *     connection-specific process.
+ *
+ * @param metrics
+ *     The metrics session of the connection-specific process, or NULL if
+ *     that process is not tracked.
  *
  * @return
- *     Zero if the user was added successfully, non-zero if an error occurred.
+ *     Zero if relaying has started, non-zero if the connection must instead
+ *     be handled by guacd_connection_io_thread(), in which case nothing has
+ *     been freed (though the parser will no longer contain buffered data).
+ */
+static int guacd_connection_relay(guac_parser* parser, guac_socket* socket,
+        int socket_fd, int fd, guacd_metrics_session* metrics) {
+
+    char buffer[8192];
+    int length;
+
+    if (socket_fd < 0)
+        return 1;
+
+    /* Data already read from the socket must be received first */
+    while ((length = guac_parser_shift(parser, buffer, sizeof(buffer))) > 0) {
+        if (__write_all(fd, buffer, length) < 0)
+            break;
+        guacd_metrics_add(metrics, &metrics->bytes_received, length);
+    }
+
+    /* The relay requires a descriptor which survives freeing the socket */
+    int relay_fd = dup(socket_fd);
+    if (relay_fd < 0)
+        return 1;
+
+    if (guacd_relay_add(relay_fd, fd, metrics)) {
+        close(relay_fd);
+        return 1;
+    }
+
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+
+    return 0;
+
+}
+
+/**
+ * Allocates a new pair of connected sockets, sending one end to the given
+ * process such that the process handles the other end as a new user.
+ *
+ * @param proc
+ *     The existing process to add the user to.
+ *
+ * @return
+ *     The file descriptor of guacd's end of the new user's connection to the
+ *     given process, or -1 if an error occurred.
  */
-static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* socket) {
+static int guacd_connect_user(guacd_proc* proc) {
 
     int sockets[2];
 
     /* Set up socket pair */
     if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
         guacd_log(GUAC_LOG_ERROR, "Unable to allocate file descriptors for I/O transfer: %s", strerror(errno));
-        return 1;
+        return -1;
     }
 
     int user_fd = sockets[0];
@@ -197,16 +262,58 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
     /* Send user file descriptor to process */
     if (!guacd_send_fd(proc->fd_socket, proc_fd)) {
         guacd_log(GUAC_LOG_ERROR, "Unable to add user.");
-        return 1;
+        close(user_fd);
+        close(proc_fd);
+        return -1;
     }
 
     /* Close our end of the process file descriptor */
     close(proc_fd);
 
+    return user_fd;
+
+}
+
+/**
+ * Relays all data between the given socket and the given file descriptor,
+ * which must have been returned by guacd_connect_user() or
+ * guacd_cluster_connect(), via the shared relay thread or, if that is not
+ * possible, via read/write threads. The given socket, parser, and any
+ * associated resources will be freed when the connection terminates.
+ *
+ * @param metrics
+ *     The metrics session of the process handling the user, or NULL if that
+ *     process is not tracked (such as when the process is on another node).
+ *
+ * @param parser
+ *     The parser associated with the given guac_socket.
+ *
+ * @param socket
+ *     The socket associated with the user.
+ *
+ * @param socket_fd
+ *     The file descriptor underlying the given socket, or -1 if data must be
+ *     read and written through the socket itself.
+ *
+ * @param user_fd
+ *     The file descriptor of guacd's end of the user's connection to the
+ *     process handling the user.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guacd_relay_user(guacd_metrics_session* metrics,
+        guac_parser* parser, guac_socket* socket, int socket_fd, int user_fd) {
+
+    /* Relay without dedicated threads where possible */
+    if (!guacd_connection_relay(parser, socket, socket_fd, user_fd, metrics))
+        return 0;
+
     guacd_connection_io_thread_params* params = guac_mem_alloc(sizeof(guacd_connection_io_thread_params));
     params->parser = parser;
     params->socket = socket;
     params->fd = user_fd;
+    params->metrics = metrics;
 
     /* Start I/O thread */
     pthread_t io_thread;
@@ -217,6 +324,208 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
 
 }
 
+/**
+ * Adds the given socket as a new user to the given process, automatically
+ * reading/writing from the socket via the shared relay thread or, if that
+ * is not possible, via read/write threads. The given socket,
+ * parser, and any associated resources will be freed unless the user is not
+ * added successfully.
+ *
+ * If adding the user fails for any reason, non-zero is returned. Zero is
+ * returned upon success.
+ *
+ * @param proc
+ *     The existing process to add the user to.
+ *
+ * @param parser
+ *     The parser associated with the given guac_socket (used to handle the
+ *     user's connection handshake thus far).
+ *
+ * @param socket
+ *     The socket associated with the user to be added to the existing
+ *     process.
+ *
+ * @param socket_fd
+ *     The file descriptor underlying the given socket, or -1 if data must be
+ *     read and written through the socket itself (such as when SSL/TLS is in
+ *     use without kernel TLS).
+ *
+ * @return
+ *     Zero if the user was added successfully, non-zero if an error occurred.
+ */
+static int guacd_add_user(guacd_proc* proc, guac_parser* parser,
+        guac_socket* socket, int socket_fd) {
+
+    int user_fd = guacd_connect_user(proc);
+    if (user_fd < 0)
+        return 1;
+
+    return guacd_relay_user(proc->metrics, parser, socket, socket_fd,
+            user_fd);
+
+}
+
+/**
+ * The state of a search for a running process whose connection may be shared
+ * by a new user.
+ */
+typedef struct guacd_share_search {
+
+    /**
+     * The share key of the new user's connection.
+     */
+    const char* key;
+
+    /**
+     * A newly-allocated copy of the connection ID of the first matching
+     * process found, or NULL if no such process has yet been found.
+     */
+    char* connection_id;
+
+} guacd_share_search;
+
+/**
+ * Callback for guacd_proc_map_foreach() which records the connection ID of
+ * the given process if its share key matches that of the search given as
+ * data.
+ *
+ * @param proc
+ *     The process being considered.
+ *
+ * @param data
+ *     The guacd_share_search being performed.
+ */
+static void guacd_find_shared_proc(guacd_proc* proc, void* data) {
+
+    guacd_share_search* search = (guacd_share_search*) data;
+
+    if (search->connection_id == NULL && proc->share_key != NULL
+            && strcmp(proc->share_key, search->key) == 0)
+        search->connection_id = guac_strdup(proc->client->connection_id);
+
+}
+
+/**
+ * Adds the given socket as a new user of a connection that may be shared,
+ * reading the user's handshake on behalf of the given new process. If a
+ * running process already handles a connection with exactly the same
+ * parameters, the user joins that process instead and the given new process
+ * is left without any user. Otherwise, the user becomes the owner of the
+ * given new process, which may then be shared by later users. As with
+ * guacd_add_user(), the given socket, parser, and any associated resources
+ * will be freed unless the user is not added successfully.
+ *
+ * @param map
+ *     The map of existing client processes.
+ *
+ * @param proc
+ *     The new process that will handle the connection if it cannot be
+ *     shared.
+ *
+ * @param protocol
+ *     The name of the protocol selected by the user.
+ *
+ * @param mode
+ *     The manner in which connections of the selected protocol are shared.
+ *
+ * @param parser
+ *     The parser associated with the given guac_socket.
+ *
+ * @param socket
+ *     The socket associated with the user to be added.
+ *
+ * @param socket_fd
+ *     The file descriptor underlying the given socket, or -1 if data must be
+ *     read and written through the socket itself.
+ *
+ * @param joined
+ *     Set to non-zero if the user joined an existing process rather than the
+ *     given new process, or zero otherwise.
+ *
+ * @return
+ *     Zero if the user was added successfully, non-zero if an error occurred.
+ */
+static int guacd_add_shared_user(guacd_proc_map* map, guacd_proc* proc,
+        const char* protocol, guacd_share_mode mode, guac_parser* parser,
+        guac_socket* socket, int socket_fd, int* joined) {
+
+    *joined = 0;
+
+    int user_fd = guacd_connect_user(proc);
+    if (user_fd < 0)
+        return 1;
+
+    /* Read the handshake on behalf of the new process */
+    guacd_share_handshake handshake;
+    if (guacd_share_handshake_read(&handshake, parser, socket, user_fd)) {
+        guacd_log_handshake_failure();
+        guacd_share_handshake_destroy(&handshake);
+        close(user_fd);
+        return 1;
+    }
+
+    char* key = guacd_share_handshake_key(protocol, &handshake);
+
+    /* Find any running process having identical parameters */
+    guacd_share_search search = { .key = key };
+    guacd_proc_map_foreach(map, guacd_find_shared_proc, &search);
+
+    guacd_proc* existing = NULL;
+    if (search.connection_id != NULL) {
+        existing = guacd_proc_map_retrieve(map, search.connection_id);
+        guac_mem_free(search.connection_id);
+    }
+
+    /* Join the existing process if possible */
+    if (existing != NULL) {
+
+        int shared_fd = guacd_connect_user(existing);
+        if (shared_fd >= 0) {
+
+            if (!guacd_share_handshake_replay(&handshake, shared_fd, 1,
+                        mode == GUACD_SHARE_VIEW_ONLY)) {
+
+                guacd_log(GUAC_LOG_INFO, "Joining existing connection "
+                        "\"%s\" having identical parameters%s",
+                        existing->client->connection_id,
+                        mode == GUACD_SHARE_VIEW_ONLY ? " (view only)" : "");
+
+                guacd_share_handshake_destroy(&handshake);
+                guac_mem_free(key);
+                close(user_fd);
+
+                *joined = 1;
+                return guacd_relay_user(existing->metrics, parser, socket,
+                        socket_fd, shared_fd);
+
+            }
+
+            close(shared_fd);
+
+        }
+
+        guacd_log(GUAC_LOG_DEBUG, "Unable to share existing connection. "
+                "A new connection will be established instead.");
+
+    }
+
+    /* Otherwise, establish a new connection that others may share */
+    if (guacd_share_handshake_replay(&handshake, user_fd, 0, 0)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to add user.");
+        guacd_share_handshake_destroy(&handshake);
+        guac_mem_free(key);
+        close(user_fd);
+        return 1;
+    }
+
+    guacd_share_handshake_destroy(&handshake);
+    proc->share_key = key;
+
+    return guacd_relay_user(proc->metrics, parser, socket, socket_fd,
+            user_fd);
+
+}
+
 /**
  * Routes the connection on the given socket according to the Guacamole
  * protocol, adding new users and creating new client processes as needed. If a
@@ -233,11 +542,17 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
  *     The socket associated with the new connection that must be routed to
  *     a new or existing process within the given map.
  *
+ * @param socket_fd
+ *     The file descriptor underlying the given socket, or -1 if data must be
+ *     read and written through the socket itself (such as when SSL/TLS is in
+ *     use without kernel TLS).
+ *
  * @return
  *     Zero if the connection was successfully routed, non-zero if routing has
  *     failed.
  */
-static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
+static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket,
+        int socket_fd) {
 
     guac_parser* parser = guac_parser_alloc();
 
@@ -271,6 +586,8 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
 
     guacd_proc* proc;
     int new_process;
+    guacd_share_mode share_mode = GUACD_SHARE_NONE;
+    char* protocol = NULL;
 
     const char* identifier = parser->argv[0];
 
@@ -280,6 +597,15 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
         proc = guacd_proc_map_retrieve(map, identifier);
         new_process = 0;
 
+        /* The requested connection may instead be handled by another node
+         * of the cluster, in which case the user is relayed to that node */
+        if (proc == NULL) {
+            int remote_fd = guacd_cluster_connect(identifier);
+            if (remote_fd >= 0)
+                return guacd_relay_user(NULL, parser, socket, socket_fd,
+                        remote_fd);
+        }
+
         /* Warn and ward off client if requested connection does not exist */
         if (proc == NULL) {
             guacd_log(GUAC_LOG_INFO, "Connection \"%s\" does not exist", identifier);
@@ -293,30 +619,69 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
 
     }
 
+    /* New connections are refused while draining, such that existing
+     * connections may end naturally before guacd stops */
+    else if (guacd_drain_active()) {
+        guacd_log(GUAC_LOG_INFO, "Refusing new connection for protocol "
+                "\"%s\" while draining", identifier);
+        guac_protocol_send_error(socket, "Server is shutting down.",
+                GUAC_PROTOCOL_STATUS_SERVER_BUSY);
+        guac_parser_free(parser);
+        return 1;
+    }
+
     /* Otherwise, create new client */
     else {
 
         guacd_log(GUAC_LOG_INFO, "Creating new client for protocol \"%s\"",
                 identifier);
 
-        /* Create new process */
-        proc = guacd_create_proc(identifier);
+        /* Use an idle, pre-forked process if one is available, creating a
+         * new process otherwise */
+        proc = guacd_proc_pool_take(identifier);
+        if (proc != NULL)
+            guacd_log(GUAC_LOG_DEBUG, "Using idle process %i from pool for "
+                    "protocol \"%s\"", (int) proc->pid, identifier);
+        else
+            proc = guacd_create_proc(identifier);
+
         new_process = 1;
 
+        /* The handshake of shareable connections is read by guacd itself,
+         * overwriting the parsed identifier */
+        share_mode = guacd_share_get_mode(identifier);
+        if (share_mode != GUACD_SHARE_NONE)
+            protocol = guac_strdup(identifier);
+
     }
 
     /* Abort if no process exists for the requested connection */
     if (proc == NULL) {
         guacd_log_guac_error(GUAC_LOG_INFO, "Connection did not succeed");
         guac_parser_free(parser);
+        guac_mem_free(protocol);
         return 1;
     }
 
-    /* Add new user (in the case of a new process, this will be the owner */
-    int add_user_failed = guacd_add_user(proc, parser, socket);
+    int add_user_failed;
+    int joined = 0;
+
+    /* Add new user (in the case of a new process, this will be the owner,
+     * unless an identical existing connection is shared instead) */
+    if (share_mode != GUACD_SHARE_NONE)
+        add_user_failed = guacd_add_shared_user(map, proc, protocol,
+                share_mode, parser, socket, socket_fd, &joined);
+    else
+        add_user_failed = guacd_add_user(proc, parser, socket, socket_fd);
+
+    guac_mem_free(protocol);
+
+    /* The new process is no longer needed if another is shared instead */
+    if (joined)
+        guacd_proc_free(proc);
 
     /* If new process was created, manage that process */
-    if (new_process) {
+    else if (new_process) {
 
         /* The new process will only be active if the user was added */
         if (!add_user_failed) {
@@ -327,11 +692,13 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
 
             /* Store process, allowing other users to join */
             guacd_proc_map_add(map, proc);
+            guacd_cluster_register(proc->client->connection_id);
 
             /* Wait for child to finish */
             waitpid(proc->pid, NULL, 0);
 
             /* Remove client */
+            guacd_cluster_deregister(proc->client->connection_id);
             if (guacd_proc_map_remove(map, proc->client->connection_id) == NULL)
                 guacd_log(GUAC_LOG_ERROR, "Internal failure removing "
                         "client \"%s\". Client record will never be freed.",
@@ -347,14 +714,7 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
             guac_parser_free(parser);
 
         /* Force process to stop and clean up */
-        guacd_proc_stop(proc);
-
-        /* Free skeleton client */
-        guac_client_free(proc->client);
-
-        /* Clean up */
-        close(proc->fd_socket);
-        guac_mem_free(proc);
+        guacd_proc_free(proc);
 
     }
 
@@ -372,12 +732,17 @@ void* guacd_connection_thread(void* data) {
 
     guac_socket* socket;
 
+    /* Raw connection data is available only if SSL/TLS is not in use, or if
+     * encryption is handled by the kernel */
+    int socket_fd = connected_socket_fd;
+
 #ifdef ENABLE_SSL
 
     SSL_CTX* ssl_context = params->ssl_context;
 
     /* If SSL chosen, use it */
     if (ssl_context != NULL) {
+        socket_fd = -1;
         socket = guac_socket_open_secure(ssl_context, connected_socket_fd);
         if (socket == NULL) {
             guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to set up SSL/TLS");
@@ -385,6 +750,16 @@ void* guacd_connection_thread(void* data) {
             guac_mem_free(params);
             return NULL;
         }
+
+        /* If the kernel has taken over encryption (kTLS), handle the
+         * connection exactly as an unencrypted connection from this point
+         * forward */
+        int offload_fd = guac_socket_ssl_offload(socket);
+        if (offload_fd >= 0) {
+            guac_socket_free(socket);
+            socket = guac_socket_open(offload_fd);
+            socket_fd = offload_fd;
+        }
     }
     else
         socket = guac_socket_open(connected_socket_fd);
@@ -395,7 +770,7 @@ void* guacd_connection_thread(void* data) {
 #endif
 
     /* Route connection according to Guacamole, creating a new process if needed */
-    if (guacd_route_connection(map, socket))
+    if (guacd_route_connection(map, socket, socket_fd))
         guac_socket_free(socket);
 
     guac_mem_free(params);
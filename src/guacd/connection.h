@@ -22,6 +22,7 @@
 
 #include "config.h"
 
+#include "metrics.h"
 #include "proc-map.h"
 
 #ifdef ENABLE_SSL
@@ -98,6 +99,13 @@ typedef struct guacd_connection_io_thread_params {
      */
     int fd;
 
+    /**
+     * The metrics session of the connection-specific process, which receives
+     * counts of all bytes transferred, or NULL if that process is not
+     * tracked.
+     */
+    guacd_metrics_session* metrics;
+
 } guacd_connection_io_thread_params;
 
 /**
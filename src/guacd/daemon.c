@@ -19,12 +19,19 @@
 
 #include "config.h"
 
+#include "cluster.h"
 #include "conf.h"
 #include "conf-args.h"
 #include "conf-file.h"
 #include "connection.h"
+#include "drain.h"
 #include "log.h"
+#include "metrics.h"
+#include "placement.h"
+#include "proc-limits.h"
 #include "proc-map.h"
+#include "proc-pool.h"
+#include "share.h"
 
 #include <guacamole/mem.h>
 
@@ -53,6 +60,27 @@
 #define GUACD_DEV_NULL "/dev/null"
 #define GUACD_ROOT     "/"
 
+#ifdef ENABLE_SSL
+/**
+ * The session ID context associated with all TLS sessions established by
+ * guacd. OpenSSL will refuse to resume any session whose context does not
+ * match.
+ */
+#define GUACD_SSL_SESSION_ID_CONTEXT "guacd"
+
+/**
+ * The maximum number of TLS sessions to retain within the server-side session
+ * cache for later resumption.
+ */
+#define GUACD_SSL_SESSION_CACHE_SIZE 1024
+
+/**
+ * The number of seconds that a TLS session (whether cached server-side or
+ * encoded within a session ticket) may be resumed after it is established.
+ */
+#define GUACD_SSL_SESSION_TIMEOUT 3600
+#endif
+
 /**
  * Redirects the given file descriptor to /dev/null. The given flags must match
  * the read/write flags of the file descriptor given (if the given file
@@ -85,6 +113,36 @@ static int redirect_fd(int fd, int flags) {
 
 }
 
+#ifdef ENABLE_SSL
+/**
+ * Configures the given SSL_CTX such that TLS sessions established through
+ * that context may later be resumed by the same client, whether by session
+ * ID (using the server-side session cache) or by session ticket. Resumed
+ * sessions skip the certificate exchange and key agreement of a full
+ * handshake, greatly reducing the cost of many connections being
+ * re-established at once.
+ *
+ * @param ssl_context
+ *     The SSL_CTX to configure.
+ */
+static void guacd_ssl_enable_resumption(SSL_CTX* ssl_context) {
+
+    SSL_CTX_set_session_id_context(ssl_context,
+            (const unsigned char*) GUACD_SSL_SESSION_ID_CONTEXT,
+            sizeof(GUACD_SSL_SESSION_ID_CONTEXT) - 1);
+
+    /* All handshakes occur within this process, thus the internal cache is
+     * shared by all connections */
+    SSL_CTX_set_session_cache_mode(ssl_context, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ssl_context, GUACD_SSL_SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ssl_context, GUACD_SSL_SESSION_TIMEOUT);
+
+    /* Session tickets allow resumption without relying on the cache */
+    SSL_CTX_clear_options(ssl_context, SSL_OP_NO_TICKET);
+
+}
+#endif
+
 /**
  * Turns the current process into a daemon through a series of fork() calls.
  * The standard I/O file descriptors for STDIN, STDOUT, and STDERR will be
@@ -113,6 +171,7 @@ static int daemonize(void) {
     /* Exit if we are the parent */
     if (pid > 0) {
         guacd_log(GUAC_LOG_DEBUG, "Exiting and passing control to PID %i", pid);
+        guacd_log_flush();
         _exit(0);
     }
 
@@ -129,6 +188,7 @@ static int daemonize(void) {
     /* Exit if we are the parent */
     if (pid > 0) {
         guacd_log(GUAC_LOG_DEBUG, "Exiting and passing control to PID %i", pid);
+        guacd_log_flush();
         _exit(0);
     }
 
@@ -272,6 +332,29 @@ static void signal_stop_handler(int signal) {
 
 }
 
+/**
+ * A flag that, if non-zero, indicates that the daemon should stop creating
+ * new connections and stop once all existing connections have ended.
+ */
+int drain_requested = 0;
+
+/**
+ * A signal handler that will set a flag telling the daemon to begin draining
+ * (see guacd_drain_start()). As with signal_stop_handler(), the signal itself
+ * interrupts any pending accept() call, allowing the daemon loop to notice
+ * the flag.
+ *
+ * @param signal
+ *     The signal that was received. Unused in this function since only
+ *     signals that should result in draining the daemon should invoke this.
+ */
+static void signal_drain_handler(int signal) {
+
+    /* Instruct the daemon to begin draining */
+    drain_requested = 1;
+
+}
+
 /**
  * A callback for guacd_proc_map_foreach which will stop every process in the
  * map.
@@ -344,6 +427,9 @@ int main(int argc, char* argv[]) {
 
     /* Init logging as early as possible */
     guacd_log_level = config->max_log_level;
+    guacd_encoder_backend = config->encoder_backend;
+    guacd_output_buffer_size = config->output_buffer_size;
+    guacd_max_instruction_length = config->max_instruction_length;
     openlog(GUACD_LOG_NAME, LOG_PID, LOG_DAEMON);
 
     /* Log start */
@@ -446,6 +532,16 @@ int main(int argc, char* argv[]) {
         ssl_context = SSL_CTX_new(TLS_server_method());
 #endif
 
+#ifdef SSL_OP_ENABLE_KTLS
+        /* Allow the kernel to handle encryption where supported, such that
+         * encrypted connections can be relayed just like unencrypted
+         * connections */
+        SSL_CTX_set_options(ssl_context, SSL_OP_ENABLE_KTLS);
+#endif
+
+        /* Avoid full handshakes for reconnecting clients */
+        guacd_ssl_enable_resumption(ssl_context);
+
         /* Load key */
         if (config->key_file != NULL) {
             guacd_log(GUAC_LOG_INFO, "Using PEM keyfile %s", config->key_file);
@@ -517,12 +613,40 @@ int main(int argc, char* argv[]) {
     sigaction(SIGINT, &signal_stop_action, NULL);
     sigaction(SIGTERM, &signal_stop_action, NULL);
 
+    /* Drain if SIGUSR1 is caught */
+    struct sigaction signal_drain_action = { .sa_handler = signal_drain_handler };
+    sigaction(SIGUSR1, &signal_drain_action, NULL);
+
     /* Log listening status */
     guacd_log(GUAC_LOG_INFO, "Listening on host %s, port %s", bound_address, bound_port);
 
     /* Free addresses */
     freeaddrinfo(addresses);
 
+    /* Assign connection processes to CPUs if requested */
+    guacd_placement_init(config->placement_policy, config->cpus_per_connection);
+
+    /* Limit resources of connection processes if requested */
+    guacd_proc_limits_init(config->cgroup, &config->limits,
+            config->protocol_limits, config->protocol_limit_count);
+
+    /* Track and export metrics of all connection processes if requested,
+     * necessarily before any such process is created */
+    if (config->metrics_socket != NULL)
+        guacd_metrics_init(config->metrics_socket);
+
+    /* Share connections with other nodes of the cluster if requested */
+    guacd_cluster_init(config->cluster_registry, config->cluster_host,
+            config->cluster_port != NULL ? config->cluster_port
+                                         : config->bind_port);
+
+    /* Begin pre-forking idle processes for any protocols with pools */
+    guacd_proc_pool_start(config->pools, config->pool_count);
+
+    /* Share connections having identical parameters if requested */
+    for (int i = 0; i < config->share_count; i++)
+        guacd_share_set_mode(config->shares[i].protocol, config->shares[i].mode);
+
     /* Listen for connections */
     if (listen(socket_fd, 5) < 0) {
         guacd_log(GUAC_LOG_ERROR, "Could not listen on socket: %s", strerror(errno));
@@ -539,6 +663,11 @@ int main(int argc, char* argv[]) {
         connected_socket_fd = accept(socket_fd,
                 (struct sockaddr*) &client_addr, &client_addr_len);
 
+        /* Begin draining once requested, refusing this and any future new
+         * connections */
+        if (drain_requested)
+            guacd_drain_start(map, config->drain_timeout);
+
         if (connected_socket_fd < 0) {
             if (errno == EINTR)
                 guacd_log(GUAC_LOG_DEBUG, "Accepting of further client connection(s) interrupted by signal.");
@@ -573,6 +702,9 @@ int main(int argc, char* argv[]) {
 
     }
 
+    /* Terminate idle processes */
+    guacd_proc_pool_stop();
+
     /* Stop all connections */
     if (map != NULL) {
 
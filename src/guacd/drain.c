@@ -0,0 +1,159 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "drain.h"
+#include "log.h"
+#include "proc-map.h"
+#include "proc-pool.h"
+
+#include <guacamole/mem.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Non-zero if guacd is draining, zero otherwise.
+ */
+static int guacd_drain_draining = 0;
+
+/**
+ * The state of the thread which waits for the connections of a draining
+ * guacd to end.
+ */
+typedef struct guacd_drain_state {
+
+    /**
+     * The map of all running connection processes.
+     */
+    guacd_proc_map* map;
+
+    /**
+     * The time after which any remaining connections are stopped, or zero
+     * to wait indefinitely, as returned by time().
+     */
+    time_t deadline;
+
+    /**
+     * The thread running the main daemon loop, which receives SIGTERM once
+     * draining completes.
+     */
+    pthread_t daemon_thread;
+
+} guacd_drain_state;
+
+/**
+ * Callback for guacd_proc_map_foreach() which counts the processes within
+ * the map.
+ *
+ * @param proc
+ *     The process being counted.
+ *
+ * @param data
+ *     A pointer to the int containing the count thus far.
+ */
+static void guacd_drain_count_proc(guacd_proc* proc, void* data) {
+    (*((int*) data))++;
+}
+
+/**
+ * Waits for every connection within the map of the given guacd_drain_state
+ * to end, or for its deadline to pass, and then stops guacd.
+ *
+ * @param data
+ *     The guacd_drain_state of the draining guacd.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_drain_thread(void* data) {
+
+    guacd_drain_state* state = (guacd_drain_state*) data;
+
+    for (;;) {
+
+        int count = 0;
+        guacd_proc_map_foreach(state->map, guacd_drain_count_proc, &count);
+
+        if (count == 0) {
+            guacd_log(GUAC_LOG_INFO, "All connections have ended. Stopping "
+                    "guacd.");
+            break;
+        }
+
+        if (state->deadline != 0 && time(NULL) >= state->deadline) {
+            guacd_log(GUAC_LOG_INFO, "Drain timeout elapsed with %i "
+                    "connection(s) remaining. Stopping guacd.", count);
+            break;
+        }
+
+        sleep(GUACD_DRAIN_CHECK_INTERVAL);
+
+    }
+
+    /* Interrupt the daemon loop exactly as an external SIGTERM would */
+    pthread_kill(state->daemon_thread, SIGTERM);
+
+    guac_mem_free(state);
+    return NULL;
+
+}
+
+void guacd_drain_start(guacd_proc_map* map, int timeout) {
+
+    if (__atomic_exchange_n(&guacd_drain_draining, 1, __ATOMIC_SEQ_CST))
+        return;
+
+    if (timeout > 0)
+        guacd_log(GUAC_LOG_INFO, "Draining. New connections will be refused "
+                "and guacd will stop once all existing connections have "
+                "ended, or after %i seconds.", timeout);
+    else
+        guacd_log(GUAC_LOG_INFO, "Draining. New connections will be refused "
+                "and guacd will stop once all existing connections have "
+                "ended.");
+
+    /* Idle processes will never be used */
+    guacd_proc_pool_stop();
+
+    guacd_drain_state* state = guac_mem_alloc(sizeof(guacd_drain_state));
+    state->map = map;
+    state->deadline = timeout > 0 ? time(NULL) + timeout : 0;
+    state->daemon_thread = pthread_self();
+
+    pthread_t thread;
+    int error = pthread_create(&thread, NULL, guacd_drain_thread, state);
+    if (error) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to wait for existing connections "
+                "to end: %s", strerror(error));
+        guac_mem_free(state);
+        return;
+    }
+
+    pthread_detach(thread);
+
+}
+
+int guacd_drain_active(void) {
+    return __atomic_load_n(&guacd_drain_draining, __ATOMIC_RELAXED);
+}
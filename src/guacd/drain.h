@@ -0,0 +1,61 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_DRAIN_H
+#define GUACD_DRAIN_H
+
+#include "config.h"
+#include "proc-map.h"
+
+/**
+ * The number of seconds between each check for whether all connections of a
+ * draining guacd have ended.
+ */
+#define GUACD_DRAIN_CHECK_INTERVAL 1
+
+/**
+ * Begins draining guacd, such that no new connections are created but users
+ * may still join existing connections, including connections relayed from
+ * other nodes of the cluster. Once every connection within the given map has
+ * ended, or once the given timeout has elapsed, SIGTERM is sent to the
+ * calling thread, stopping guacd exactly as if SIGTERM had been received
+ * from outside. Any connections still running at that point are stopped.
+ * This function must be called from the thread running the main daemon
+ * loop, and has no effect if guacd is already draining.
+ *
+ * @param map
+ *     The map of all running connection processes.
+ *
+ * @param timeout
+ *     The maximum number of seconds to wait for existing connections to end,
+ *     or zero to wait indefinitely.
+ */
+void guacd_drain_start(guacd_proc_map* map, int timeout);
+
+/**
+ * Returns whether guacd is draining, in which case new connections must be
+ * refused.
+ *
+ * @return
+ *     Non-zero if guacd is draining, zero otherwise.
+ */
+int guacd_drain_active(void);
+
+#endif
+
@@ -22,28 +22,142 @@
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
+#include <guacamole/string.h>
+#include <guacamole/timestamp.h>
 
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 #include <unistd.h>
 
 int guacd_log_level = GUAC_LOG_INFO;
 
-void vguacd_log(guac_client_log_level level, const char* format,
-        va_list args) {
+/**
+ * A single formatted log message awaiting output by the logging thread.
+ */
+typedef struct guacd_log_record {
 
-    const char* priority_name;
-    int priority;
+    /**
+     * The level at which the message was logged.
+     */
+    guac_client_log_level level;
 
-    char message[2048];
+    /**
+     * The formatted message, including null terminator.
+     */
+    char message[GUACD_LOG_MAX_LENGTH];
 
-    /* Don't bother if the log level is too high */
-    if (level > guacd_log_level)
-        return;
+} guacd_log_record;
 
-    /* Copy log message into buffer */
-    vsnprintf(message, sizeof(message), format, args);
+/**
+ * The state of asynchronous logging within the current process. All members
+ * other than the records being written by the logging thread are guarded by
+ * the lock.
+ */
+typedef struct guacd_log_state {
+
+    /**
+     * Lock which guards access to all other members.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever messages are added to or removed
+     * from the queue, or when the logging thread must stop.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * Ring of messages awaiting output. The oldest message is at index head.
+     * Each message remains within the ring (and is thus not overwritten)
+     * until it has been written.
+     */
+    guacd_log_record records[GUACD_LOG_QUEUE_SIZE];
+
+    /**
+     * The index of the oldest message within the ring.
+     */
+    int head;
+
+    /**
+     * The number of messages within the ring, including any message
+     * currently being written.
+     */
+    int count;
+
+    /**
+     * The logging thread, valid only if started is non-zero.
+     */
+    pthread_t thread;
+
+    /**
+     * Non-zero if the logging thread has been started within the current
+     * process.
+     */
+    int started;
+
+    /**
+     * Non-zero if the logging thread has stopped (or must stop) such that
+     * messages must instead be written synchronously.
+     */
+    int stopping;
+
+    /**
+     * The number of messages which could not be queued since the last
+     * message was queued.
+     */
+    int dropped;
+
+    /**
+     * The most recently logged message other than repeats, and the level at
+     * which it was logged.
+     */
+    guacd_log_record last;
+
+    /**
+     * The number of times the most recently logged message has been repeated
+     * since its repetition was last reported.
+     */
+    int repeated;
+
+    /**
+     * The time that repetitions of the most recently logged message were
+     * last reported, or that the message was first logged.
+     */
+    guac_timestamp repeated_since;
+
+} guacd_log_state;
+
+/**
+ * Asynchronous logging state of the current process.
+ */
+static guacd_log_state guacd_log_global = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .modified = PTHREAD_COND_INITIALIZER
+};
+
+/**
+ * Control which ensures process-wide handlers are registered only once.
+ */
+static pthread_once_t guacd_log_handlers_registered = PTHREAD_ONCE_INIT;
+
+/**
+ * Writes the given message to syslog and STDERR at the given level, blocking
+ * until the write completes.
+ *
+ * @param level
+ *     The level at which the message was logged.
+ *
+ * @param message
+ *     The message to write.
+ */
+static void guacd_log_write(guac_client_log_level level, const char* message) {
+
+    const char* priority_name;
+    int priority;
 
     /* Convert log level to syslog priority */
     switch (level) {
@@ -94,6 +208,297 @@ void vguacd_log(guac_client_log_level level, const char* format,
 
 }
 
+/**
+ * Adds a message to the queue of messages awaiting output by the logging
+ * thread, or writes that message immediately if the logging thread is not
+ * running. If the queue is full, the message is dropped. The lock of the
+ * logging state must be held.
+ *
+ * @param state
+ *     The logging state to add the message to.
+ *
+ * @param level
+ *     The level at which the message was logged.
+ *
+ * @param message
+ *     The message to add.
+ */
+static void guacd_log_enqueue(guacd_log_state* state,
+        guac_client_log_level level, const char* message) {
+
+    /* Write directly if there is no thread to write on our behalf */
+    if (!state->started || state->stopping) {
+        guacd_log_write(level, message);
+        return;
+    }
+
+    /* Leave room in the queue to note any dropped messages */
+    if (state->count >= GUACD_LOG_QUEUE_SIZE - 1) {
+        state->dropped++;
+        return;
+    }
+
+    guacd_log_record* record = &(state->records[
+        (state->head + state->count) % GUACD_LOG_QUEUE_SIZE]);
+
+    record->level = level;
+    strncpy(record->message, message, sizeof(record->message) - 1);
+    record->message[sizeof(record->message) - 1] = '\0';
+
+    state->count++;
+    pthread_cond_broadcast(&(state->modified));
+
+}
+
+/**
+ * Adds a message noting the number of repetitions of the most recently
+ * logged message, if that message has been repeated since repetitions were
+ * last noted. The lock of the logging state must be held.
+ *
+ * @param state
+ *     The logging state to add the message to.
+ *
+ * @param now
+ *     The current time.
+ */
+static void guacd_log_enqueue_repeated(guacd_log_state* state,
+        guac_timestamp now) {
+
+    if (state->repeated > 0) {
+
+        char message[GUACD_LOG_MAX_LENGTH];
+        int length = snprintf(message, sizeof(message),
+                "Last message repeated %i time(s): ", state->repeated);
+
+        /* Include as much of the repeated message as will fit */
+        guac_strlcpy(message + length, state->last.message,
+                sizeof(message) - length);
+
+        guacd_log_enqueue(state, state->last.level, message);
+        state->repeated = 0;
+
+    }
+
+    state->repeated_since = now;
+
+}
+
+/**
+ * Adds a message noting the number of messages dropped since the logging
+ * thread last had room for new messages, if any messages have been dropped.
+ * The lock of the logging state must be held.
+ *
+ * @param state
+ *     The logging state to add the message to.
+ */
+static void guacd_log_enqueue_dropped(guacd_log_state* state) {
+
+    /* The queue must have room for the note itself and at least one further
+     * message, otherwise the note would simply be dropped as well */
+    if (state->dropped == 0 || state->count >= GUACD_LOG_QUEUE_SIZE - 2)
+        return;
+
+    char message[GUACD_LOG_MAX_LENGTH];
+    snprintf(message, sizeof(message), "%i log message(s) dropped as log "
+            "output could not keep up.", state->dropped);
+
+    state->dropped = 0;
+    guacd_log_enqueue(state, GUAC_LOG_WARNING, message);
+
+}
+
+/**
+ * Writes each queued log message in order until the logging thread is
+ * stopped, at which point any remaining messages are written before the
+ * thread exits. The lock of the logging state is not held while messages
+ * are written.
+ *
+ * @param data
+ *     The guacd_log_state whose messages should be written.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_log_thread(void* data) {
+
+    guacd_log_state* state = (guacd_log_state*) data;
+
+    pthread_mutex_lock(&(state->lock));
+
+    for (;;) {
+
+        /* Wait for messages, stopping only once all have been written */
+        if (state->count == 0) {
+            if (state->stopping)
+                break;
+            pthread_cond_wait(&(state->modified), &(state->lock));
+            continue;
+        }
+
+        guacd_log_record* record = &(state->records[state->head]);
+
+        pthread_mutex_unlock(&(state->lock));
+        guacd_log_write(record->level, record->message);
+        pthread_mutex_lock(&(state->lock));
+
+        state->head = (state->head + 1) % GUACD_LOG_QUEUE_SIZE;
+        state->count--;
+
+        /* Wake any threads waiting for the log to be flushed */
+        pthread_cond_broadcast(&(state->modified));
+
+    }
+
+    pthread_mutex_unlock(&(state->lock));
+    return NULL;
+
+}
+
+/**
+ * Stops the logging thread of the current process, if running, writing all
+ * remaining log messages. Messages logged after this function has been
+ * invoked are written synchronously. This function is automatically invoked
+ * when the process exits.
+ */
+static void guacd_log_stop(void) {
+
+    guacd_log_state* state = &guacd_log_global;
+
+    pthread_mutex_lock(&(state->lock));
+
+    guacd_log_enqueue_repeated(state, guac_timestamp_current_coarse());
+    guacd_log_enqueue_dropped(state);
+
+    int started = state->started;
+    state->stopping = 1;
+    pthread_cond_broadcast(&(state->modified));
+
+    pthread_mutex_unlock(&(state->lock));
+
+    if (started)
+        pthread_join(state->thread, NULL);
+
+}
+
+/**
+ * Acquires the lock of the logging state prior to fork(), such that the
+ * child process inherits that state in a consistent form.
+ */
+static void guacd_log_atfork_prepare(void) {
+    pthread_mutex_lock(&(guacd_log_global.lock));
+}
+
+/**
+ * Releases the lock acquired by guacd_log_atfork_prepare() within the parent
+ * process after fork().
+ */
+static void guacd_log_atfork_parent(void) {
+    pthread_mutex_unlock(&(guacd_log_global.lock));
+}
+
+/**
+ * Resets the logging state within a child process after fork(). The logging
+ * thread of the parent does not exist within the child, and any messages
+ * still queued remain the responsibility of the parent, thus the child
+ * starts with an empty queue and with no logging thread.
+ */
+static void guacd_log_atfork_child(void) {
+
+    guacd_log_state* state = &guacd_log_global;
+
+    state->head = 0;
+    state->count = 0;
+    state->started = 0;
+    state->stopping = 0;
+    state->dropped = 0;
+    state->repeated = 0;
+
+    pthread_cond_init(&(state->modified), NULL);
+    pthread_mutex_unlock(&(state->lock));
+
+}
+
+/**
+ * Registers the handlers which maintain the logging state across fork() and
+ * flush any remaining messages at exit.
+ */
+static void guacd_log_register_handlers(void) {
+    pthread_atfork(guacd_log_atfork_prepare, guacd_log_atfork_parent,
+            guacd_log_atfork_child);
+    atexit(guacd_log_stop);
+}
+
+void vguacd_log(guac_client_log_level level, const char* format,
+        va_list args) {
+
+    char message[GUACD_LOG_MAX_LENGTH];
+
+    /* Don't bother if the log level is too high */
+    if (level > guacd_log_level)
+        return;
+
+    /* Copy log message into buffer */
+    vsnprintf(message, sizeof(message), format, args);
+
+    pthread_once(&guacd_log_handlers_registered, guacd_log_register_handlers);
+
+    guacd_log_state* state = &guacd_log_global;
+    pthread_mutex_lock(&(state->lock));
+
+    /* Start logging thread within this process if not yet started */
+    if (!state->started && !state->stopping) {
+        if (pthread_create(&(state->thread), NULL, guacd_log_thread, state))
+            state->stopping = 1;
+        else
+            state->started = 1;
+    }
+
+    guac_timestamp now = guac_timestamp_current_coarse();
+
+    /* Count repetitions of the same message rather than logging each */
+    if (level == state->last.level
+            && strcmp(message, state->last.message) == 0) {
+
+        state->repeated++;
+
+        if (now - state->repeated_since >= GUACD_LOG_REPEAT_INTERVAL)
+            guacd_log_enqueue_repeated(state, now);
+
+    }
+
+    /* Log any other message normally */
+    else {
+
+        guacd_log_enqueue_repeated(state, now);
+        guacd_log_enqueue_dropped(state);
+        guacd_log_enqueue(state, level, message);
+
+        state->last.level = level;
+        strcpy(state->last.message, message);
+
+    }
+
+    pthread_mutex_unlock(&(state->lock));
+
+}
+
+void guacd_log_flush(void) {
+
+    guacd_log_state* state = &guacd_log_global;
+
+    pthread_mutex_lock(&(state->lock));
+
+    guacd_log_enqueue_repeated(state, guac_timestamp_current_coarse());
+    guacd_log_enqueue_dropped(state);
+
+    /* Wait for the logging thread to write all queued messages */
+    while (state->started && !state->stopping && state->count > 0)
+        pthread_cond_wait(&(state->modified), &(state->lock));
+
+    pthread_mutex_unlock(&(state->lock));
+
+}
+
 void guacd_log(guac_client_log_level level, const char* format, ...) {
     va_list args;
     va_start(args, format);
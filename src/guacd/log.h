@@ -35,9 +35,35 @@ extern int guacd_log_level;
  */
 #define GUACD_LOG_NAME "guacd"
 
+/**
+ * The maximum number of bytes in any single log message, including null
+ * terminator. Longer messages are truncated.
+ */
+#define GUACD_LOG_MAX_LENGTH 2048
+
+/**
+ * The maximum number of log messages which may be awaiting output by the
+ * logging thread. Messages logged while this many messages are already
+ * waiting are dropped, with the number of dropped messages noted in the log
+ * once space is available.
+ */
+#define GUACD_LOG_QUEUE_SIZE 128
+
+/**
+ * The number of milliseconds between reports of the number of times the most
+ * recent log message has been repeated. Identical consecutive messages are
+ * written only once, with a count of additional occurrences written after
+ * this interval, when a different message is logged, or when the log is
+ * flushed.
+ */
+#define GUACD_LOG_REPEAT_INTERVAL 5000
+
 /**
  * Writes a message to guacd's logs. This function takes a format and va_list,
- * similar to vprintf.
+ * similar to vprintf. Messages above the current log level are ignored
+ * without being formatted. Other messages are formatted immediately but
+ * written to syslog and STDERR asynchronously by a dedicated logging thread,
+ * such that the calling thread is never blocked by slow log output.
  */
 void vguacd_log(guac_client_log_level level, const char* format, va_list args);
 
@@ -47,6 +73,14 @@ void vguacd_log(guac_client_log_level level, const char* format, va_list args);
  */
 void guacd_log(guac_client_log_level level, const char* format, ...);
 
+/**
+ * Waits for all log messages logged thus far to be written to syslog and
+ * STDERR. This function must be invoked before a process exits through any
+ * means that bypasses atexit(), such as _exit(), if messages logged by that
+ * process must not be lost.
+ */
+void guacd_log_flush(void);
+
 /**
  * Writes a message using the logging facilities of the given client. This
  * function accepts parameters identically to printf.
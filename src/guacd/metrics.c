@@ -0,0 +1,948 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "metrics.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/timestamp.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The region of memory shared with all connection processes, containing
+ * GUACD_METRICS_MAX_SESSIONS sessions, or NULL if metrics are not enabled.
+ */
+static guacd_metrics_session* guacd_metrics_sessions = NULL;
+
+/**
+ * Lock which serializes the assignment of sessions to new connection
+ * processes. This lock is used only within guacd itself, connection
+ * processes never assign sessions.
+ */
+static pthread_mutex_t guacd_metrics_claim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The file descriptor of the UNIX domain socket accepting connections for
+ * metrics export.
+ */
+static int guacd_metrics_socket = -1;
+
+/**
+ * Writes the given string as the value of a Prometheus label, escaping any
+ * characters that have special meaning within label values.
+ *
+ * @param output
+ *     The stream to write to.
+ *
+ * @param value
+ *     The label value to write.
+ */
+static void guacd_metrics_write_label(FILE* output, const char* value) {
+
+    for (; *value != '\0'; value++) {
+        switch (*value) {
+
+            case '\\':
+                fputs("\\\\", output);
+                break;
+
+            case '"':
+                fputs("\\\"", output);
+                break;
+
+            case '\n':
+                fputs("\\n", output);
+                break;
+
+            default:
+                fputc(*value, output);
+
+        }
+    }
+
+}
+
+/**
+ * Writes the labels identifying the given session, without the surrounding
+ * braces, as required by every metric in the Prometheus text exposition
+ * format.
+ *
+ * @param output
+ *     The stream to write to.
+ *
+ * @param session
+ *     The session whose labels should be written.
+ */
+static void guacd_metrics_write_session_labels(FILE* output,
+        guacd_metrics_session* session) {
+
+    fputs("connection_id=\"", output);
+    guacd_metrics_write_label(output, session->connection_id);
+    fputs("\",protocol=\"", output);
+    guacd_metrics_write_label(output, session->protocol);
+    fprintf(output, "\",pid=\"%i\"",
+            (int) __atomic_load_n(&session->pid, __ATOMIC_RELAXED));
+
+}
+
+/**
+ * Writes the given raw value of a metric, followed by a newline, scaling that
+ * value as required.
+ *
+ * @param output
+ *     The stream to write to.
+ *
+ * @param value
+ *     The raw value to write.
+ *
+ * @param scale
+ *     The factor by which the raw value must be divided to produce the value
+ *     of the metric, such as 1000000 for values stored in microseconds but
+ *     exported in seconds.
+ */
+static void guacd_metrics_write_value(FILE* output, uint64_t value,
+        uint64_t scale) {
+
+    if (scale > 1)
+        fprintf(output, "%" PRIu64 ".%0*" PRIu64 "\n", value / scale,
+                (int) (scale == 1000 ? 3 : 6), value % scale);
+    else
+        fprintf(output, "%" PRIu64 "\n", value);
+
+}
+
+/**
+ * Writes a single metric family in the Prometheus text exposition format,
+ * consisting of the current value of one specific field of every session in
+ * use.
+ *
+ * @param output
+ *     The stream to write to.
+ *
+ * @param name
+ *     The name of the metric.
+ *
+ * @param type
+ *     The Prometheus type of the metric, such as "counter" or "gauge".
+ *
+ * @param help
+ *     A human-readable description of the metric.
+ *
+ * @param offset
+ *     The offset of the uint64_t or int64_t field within
+ *     guacd_metrics_session that provides the value of the metric.
+ *
+ * @param scale
+ *     The factor by which each raw value must be divided to produce the
+ *     value of the metric, such as 1000000 for values stored in microseconds
+ *     but exported in seconds.
+ */
+static void guacd_metrics_write_family(FILE* output, const char* name,
+        const char* type, const char* help, size_t offset, uint64_t scale) {
+
+    fprintf(output, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+
+    for (int i = 0; i < GUACD_METRICS_MAX_SESSIONS; i++) {
+
+        guacd_metrics_session* session = &guacd_metrics_sessions[i];
+        if (!__atomic_load_n(&session->in_use, __ATOMIC_ACQUIRE))
+            continue;
+
+        uint64_t value = __atomic_load_n(
+                (uint64_t*) ((char*) session + offset), __ATOMIC_RELAXED);
+
+        fprintf(output, "%s{", name);
+        guacd_metrics_write_session_labels(output, session);
+        fputs("} ", output);
+        guacd_metrics_write_value(output, value, scale);
+
+    }
+
+}
+
+/**
+ * Writes the metric family describing the duration of each phase of
+ * connection establishment recorded by every session in use, in the
+ * Prometheus text exposition format. Each phase is distinguished by an
+ * additional "phase" label.
+ *
+ * @param output
+ *     The stream to write to.
+ */
+static void guacd_metrics_write_connect_phases(FILE* output) {
+
+    const char* name = "guacd_session_connect_phase_seconds";
+    fprintf(output, "# HELP %s Time spent within each phase of establishing "
+            "the connection to the remote desktop server.\n"
+            "# TYPE %s gauge\n", name, name);
+
+    for (int i = 0; i < GUACD_METRICS_MAX_SESSIONS; i++) {
+
+        guacd_metrics_session* session = &guacd_metrics_sessions[i];
+        if (!__atomic_load_n(&session->in_use, __ATOMIC_ACQUIRE))
+            continue;
+
+        int count = __atomic_load_n(&session->connect_phase_count,
+                __ATOMIC_ACQUIRE);
+
+        for (int j = 0; j < count && j < GUAC_CLIENT_MAX_CONNECT_PHASES; j++) {
+
+            guacd_metrics_connect_phase* phase = &session->connect_phases[j];
+            uint64_t duration = __atomic_load_n(&phase->duration,
+                    __ATOMIC_RELAXED);
+
+            fprintf(output, "%s{", name);
+            guacd_metrics_write_session_labels(output, session);
+            fputs(",phase=\"", output);
+            guacd_metrics_write_label(output, phase->name);
+            fputs("\"} ", output);
+            guacd_metrics_write_value(output, duration, 1000);
+
+        }
+
+    }
+
+}
+
+/**
+ * Writes a single component of the latency measured by every session in use
+ * as part of the metric family describing input latency, in the Prometheus
+ * text exposition format. Each component is distinguished by an additional
+ * "component" label.
+ *
+ * @param output
+ *     The stream to write to.
+ *
+ * @param name
+ *     The name of the metric family.
+ *
+ * @param component
+ *     The value of the "component" label.
+ *
+ * @param offset
+ *     The offset of the guac_client_latency_histogram within
+ *     guacd_metrics_session that provides the values of the component.
+ */
+static void guacd_metrics_write_latency_component(FILE* output,
+        const char* name, const char* component, size_t offset) {
+
+    for (int i = 0; i < GUACD_METRICS_MAX_SESSIONS; i++) {
+
+        guacd_metrics_session* session = &guacd_metrics_sessions[i];
+        if (!__atomic_load_n(&session->in_use, __ATOMIC_ACQUIRE))
+            continue;
+
+        guac_client_latency_histogram* histogram =
+            (guac_client_latency_histogram*) ((char*) session + offset);
+
+        /* Prometheus buckets are cumulative */
+        uint64_t cumulative = 0;
+        for (int j = 0; j < GUAC_CLIENT_LATENCY_BUCKETS; j++) {
+
+            cumulative += __atomic_load_n(&histogram->buckets[j],
+                    __ATOMIC_RELAXED);
+
+            fprintf(output, "%s_bucket{", name);
+            guacd_metrics_write_session_labels(output, session);
+            fprintf(output, ",component=\"%s\",le=\"", component);
+
+            if (j < GUAC_CLIENT_LATENCY_BUCKETS - 1)
+                fprintf(output, "%i.%03i", (1 << j) / 1000, (1 << j) % 1000);
+            else
+                fputs("+Inf", output);
+
+            fprintf(output, "\"} %" PRIu64 "\n", cumulative);
+
+        }
+
+        fprintf(output, "%s_sum{", name);
+        guacd_metrics_write_session_labels(output, session);
+        fprintf(output, ",component=\"%s\"} ", component);
+        guacd_metrics_write_value(output,
+                __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED), 1000);
+
+        fprintf(output, "%s_count{", name);
+        guacd_metrics_write_session_labels(output, session);
+        fprintf(output, ",component=\"%s\"} ", component);
+        guacd_metrics_write_value(output,
+                __atomic_load_n(&histogram->count, __ATOMIC_RELAXED), 1);
+
+    }
+
+}
+
+/**
+ * Writes the metric family describing the latency between user input and the
+ * display of the resulting changes, as measured by every session in use, in
+ * the Prometheus text exposition format.
+ *
+ * @param output
+ *     The stream to write to.
+ */
+static void guacd_metrics_write_latency(FILE* output) {
+
+    const char* name = "guacd_session_input_latency_seconds";
+    fprintf(output, "# HELP %s Time between user input and confirmation that "
+            "the resulting changes have been rendered by that user.\n"
+            "# TYPE %s histogram\n", name, name);
+
+    guacd_metrics_write_latency_component(output, name, "server",
+            offsetof(guacd_metrics_session, latency.server));
+
+    guacd_metrics_write_latency_component(output, name, "encode",
+            offsetof(guacd_metrics_session, latency.encode));
+
+    guacd_metrics_write_latency_component(output, name, "network",
+            offsetof(guacd_metrics_session, latency.network));
+
+    guacd_metrics_write_latency_component(output, name, "total",
+            offsetof(guacd_metrics_session, latency.total));
+
+}
+
+/**
+ * The value of the "category" label of each subsystem to which memory may be
+ * attributed, indexed by guac_client_memory_category.
+ */
+static const char* guacd_metrics_memory_categories[GUAC_CLIENT_MEMORY_CATEGORIES] = {
+    "display",
+    "terminal",
+    "audio",
+    "clipboard",
+    "recording"
+};
+
+/**
+ * Writes a metric family describing the memory attributed to each subsystem
+ * of every session in use, in the Prometheus text exposition format. Each
+ * subsystem is distinguished by an additional "category" label.
+ *
+ * @param output
+ *     The stream to write to.
+ *
+ * @param name
+ *     The name of the metric.
+ *
+ * @param help
+ *     A human-readable description of the metric.
+ *
+ * @param offset
+ *     The offset of the array of GUAC_CLIENT_MEMORY_CATEGORIES uint64_t
+ *     values within guacd_metrics_session that provides the value of the
+ *     metric for each subsystem.
+ */
+static void guacd_metrics_write_memory(FILE* output, const char* name,
+        const char* help, size_t offset) {
+
+    fprintf(output, "# HELP %s %s\n# TYPE %s gauge\n", name, help, name);
+
+    for (int i = 0; i < GUACD_METRICS_MAX_SESSIONS; i++) {
+
+        guacd_metrics_session* session = &guacd_metrics_sessions[i];
+        if (!__atomic_load_n(&session->in_use, __ATOMIC_ACQUIRE))
+            continue;
+
+        uint64_t* values = (uint64_t*) ((char*) session + offset);
+        for (int j = 0; j < GUAC_CLIENT_MEMORY_CATEGORIES; j++) {
+
+            fprintf(output, "%s{", name);
+            guacd_metrics_write_session_labels(output, session);
+            fprintf(output, ",category=\"%s\"} ",
+                    guacd_metrics_memory_categories[j]);
+            guacd_metrics_write_value(output,
+                    __atomic_load_n(&values[j], __ATOMIC_RELAXED), 1);
+
+        }
+
+    }
+
+}
+
+/**
+ * Writes all metrics of all sessions in use to the given file descriptor in
+ * the Prometheus text exposition format.
+ *
+ * @param fd
+ *     The file descriptor to write to. This file descriptor is closed by
+ *     this function.
+ */
+static void guacd_metrics_export(int fd) {
+
+    FILE* output = fdopen(fd, "w");
+    if (output == NULL) {
+        close(fd);
+        return;
+    }
+
+    int count = 0;
+    for (int i = 0; i < GUACD_METRICS_MAX_SESSIONS; i++)
+        count += __atomic_load_n(&guacd_metrics_sessions[i].in_use, __ATOMIC_ACQUIRE) != 0;
+
+    fprintf(output, "# HELP guacd_sessions Number of connection processes "
+            "currently running.\n# TYPE guacd_sessions gauge\n"
+            "guacd_sessions %i\n", count);
+
+    guacd_metrics_write_family(output, "guacd_session_start_time_seconds",
+            "gauge", "Time that the connection process was created, in "
+            "seconds since the epoch.",
+            offsetof(guacd_metrics_session, start_time), 1);
+
+    guacd_metrics_write_family(output, "guacd_session_cpu_seconds_total",
+            "counter", "Total CPU time consumed by the connection process.",
+            offsetof(guacd_metrics_session, cpu_time), 1000000);
+
+    guacd_metrics_write_family(output, "guacd_session_received_bytes_total",
+            "counter", "Total bytes received from users of the connection.",
+            offsetof(guacd_metrics_session, bytes_received), 1);
+
+    guacd_metrics_write_family(output, "guacd_session_sent_bytes_total",
+            "counter", "Total bytes sent to users of the connection.",
+            offsetof(guacd_metrics_session, bytes_sent), 1);
+
+    guacd_metrics_write_family(output, "guacd_session_users",
+            "gauge", "Number of users currently connected.",
+            offsetof(guacd_metrics_session, users), 1);
+
+    guacd_metrics_write_family(output, "guacd_session_frames_total",
+            "counter", "Total frames sent to users of the connection.",
+            offsetof(guacd_metrics_session, frames), 1);
+
+    guacd_metrics_write_family(output, "guacd_session_render_lag_seconds",
+            "gauge", "Delay of the most recent frame to compensate for "
+            "client-side processing lag.",
+            offsetof(guacd_metrics_session, render_lag), 1000);
+
+    guacd_metrics_write_family(output, "guacd_session_queue_depth",
+            "gauge", "Number of display operations awaiting encoding.",
+            offsetof(guacd_metrics_session, queue_depth), 1);
+
+    guacd_metrics_write_family(output, "guacd_session_resident_memory_bytes",
+            "gauge", "Physical memory currently used by the connection "
+            "process.",
+            offsetof(guacd_metrics_session, resident_memory), 1);
+
+    guacd_metrics_write_memory(output, "guacd_session_memory_bytes",
+            "Memory currently attributed to each subsystem of the "
+            "connection.", offsetof(guacd_metrics_session, memory));
+
+    guacd_metrics_write_memory(output, "guacd_session_memory_peak_bytes",
+            "Greatest memory ever attributed to each subsystem of the "
+            "connection at any one time.",
+            offsetof(guacd_metrics_session, memory_peak));
+
+    guacd_metrics_write_family(output, "guacd_session_memory_reclaims_total",
+            "counter", "Total number of times unneeded memory has been "
+            "reclaimed.",
+            offsetof(guacd_metrics_session, memory_reclaims), 1);
+
+    guacd_metrics_write_family(output,
+            "guacd_session_memory_reclaimed_bytes_total", "counter",
+            "Total memory attributed to subsystems of the connection that "
+            "has been released by reclaiming unneeded memory.",
+            offsetof(guacd_metrics_session, memory_reclaimed), 1);
+
+    guacd_metrics_write_connect_phases(output);
+    guacd_metrics_write_latency(output);
+
+    fclose(output);
+
+}
+
+/**
+ * Thread which accepts connections to the metrics export socket, writing a
+ * snapshot of all metrics to each.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_metrics_export_thread(void* data) {
+
+    for (;;) {
+
+        int fd = accept(guacd_metrics_socket, NULL, NULL);
+        if (fd < 0) {
+
+            if (errno == EINTR)
+                continue;
+
+            guacd_log(GUAC_LOG_ERROR, "Exporting of metrics has failed: %s",
+                    strerror(errno));
+            break;
+
+        }
+
+        guacd_metrics_export(fd);
+
+    }
+
+    return NULL;
+
+}
+
+int guacd_metrics_init(const char* socket_path) {
+
+    if (guacd_metrics_sessions != NULL)
+        return 0;
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        guacd_log(GUAC_LOG_ERROR, "Path of metrics socket is too long: %s",
+                socket_path);
+        return 1;
+    }
+
+    strcpy(address.sun_path, socket_path);
+
+    /* Allocate sessions within memory that remains shared after fork() */
+    guacd_metrics_session* sessions = mmap(NULL,
+            GUACD_METRICS_MAX_SESSIONS * sizeof(guacd_metrics_session),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (sessions == MAP_FAILED) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to allocate shared memory for "
+                "metrics: %s", strerror(errno));
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to create metrics socket: %s",
+                strerror(errno));
+        goto fail_socket;
+    }
+
+    /* Replace any socket remaining from a previous instance of guacd */
+    unlink(socket_path);
+
+    if (bind(fd, (struct sockaddr*) &address, sizeof(address))
+            || listen(fd, 5)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to listen on metrics socket "
+                "\"%s\": %s", socket_path, strerror(errno));
+        goto fail_listen;
+    }
+
+    guacd_metrics_socket = fd;
+    guacd_metrics_sessions = sessions;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, guacd_metrics_export_thread, NULL)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to start thread for exporting "
+                "metrics.");
+        guacd_metrics_sessions = NULL;
+        guacd_metrics_socket = -1;
+        goto fail_listen;
+    }
+
+    pthread_detach(thread);
+
+    guacd_log(GUAC_LOG_INFO, "Exporting metrics on \"%s\"", socket_path);
+    return 0;
+
+fail_listen:
+    close(fd);
+
+fail_socket:
+    munmap(sessions, GUACD_METRICS_MAX_SESSIONS * sizeof(guacd_metrics_session));
+    return 1;
+
+}
+
+guacd_metrics_session* guacd_metrics_claim(const char* connection_id,
+        const char* protocol) {
+
+    if (guacd_metrics_sessions == NULL)
+        return NULL;
+
+    guacd_metrics_session* session = NULL;
+
+    pthread_mutex_lock(&guacd_metrics_claim_lock);
+
+    for (int i = 0; i < GUACD_METRICS_MAX_SESSIONS; i++) {
+        if (!__atomic_load_n(&guacd_metrics_sessions[i].in_use, __ATOMIC_ACQUIRE)) {
+            session = &guacd_metrics_sessions[i];
+            break;
+        }
+    }
+
+    if (session != NULL) {
+
+        memset(session, 0, sizeof(guacd_metrics_session));
+        snprintf(session->connection_id, sizeof(session->connection_id),
+                "%s", connection_id);
+        snprintf(session->protocol, sizeof(session->protocol), "%s",
+                protocol);
+        session->start_time = time(NULL);
+
+        /* Publish session only once fully initialized */
+        __atomic_store_n(&session->in_use, 1, __ATOMIC_RELEASE);
+
+    }
+
+    pthread_mutex_unlock(&guacd_metrics_claim_lock);
+
+    if (session == NULL)
+        guacd_log(GUAC_LOG_DEBUG, "All %i metrics sessions are in use. "
+                "Metrics will not be tracked for connection \"%s\".",
+                GUACD_METRICS_MAX_SESSIONS, connection_id);
+
+    return session;
+
+}
+
+void guacd_metrics_set_pid(guacd_metrics_session* session, pid_t pid) {
+    if (session != NULL)
+        __atomic_store_n(&session->pid, pid, __ATOMIC_RELAXED);
+}
+
+void guacd_metrics_release(guacd_metrics_session* session) {
+    if (session != NULL)
+        __atomic_store_n(&session->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * The session of the current connection process that is being updated by
+ * guacd_metrics_sampling_thread.
+ */
+static guacd_metrics_session* guacd_metrics_sampled_session = NULL;
+
+/**
+ * The client of the current connection process.
+ */
+static guac_client* guacd_metrics_sampled_client = NULL;
+
+/**
+ * Lock which guards guacd_metrics_sampling_stopping.
+ */
+static pthread_mutex_t guacd_metrics_sampling_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Condition which is signalled when sampling must stop.
+ */
+static pthread_cond_t guacd_metrics_sampling_stop = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Non-zero if guacd_metrics_sampling_thread must stop.
+ */
+static int guacd_metrics_sampling_stopping = 0;
+
+/**
+ * The thread updating the session of the current connection process.
+ */
+static pthread_t guacd_metrics_sampling_thread;
+
+/**
+ * Non-zero if guacd_metrics_sampling_thread has been started and not yet
+ * joined.
+ */
+static int guacd_metrics_sampling_running = 0;
+
+/**
+ * The number of frames sent by the guac_display of the current connection
+ * process as of the most recent check for idleness.
+ */
+static uint64_t guacd_metrics_reclaim_frames = 0;
+
+/**
+ * The time that the guac_display of the current connection process was last
+ * seen to send a frame, or zero if no check for idleness has yet occurred.
+ */
+static guac_timestamp guacd_metrics_reclaim_activity = 0;
+
+/**
+ * Non-zero if unneeded memory has already been reclaimed since the
+ * connection process became idle.
+ */
+static int guacd_metrics_reclaim_idle = 0;
+
+/**
+ * The number of layers shrunk by the guac_display of the current connection
+ * process as of the last time unneeded memory was reclaimed.
+ */
+static uint64_t guacd_metrics_reclaim_shrinks = 0;
+
+/**
+ * Atomically copies each value of the given latency histogram into the given
+ * histogram within a session.
+ *
+ * @param dst
+ *     The histogram within the session that should be updated.
+ *
+ * @param src
+ *     The histogram to copy.
+ */
+static void guacd_metrics_store_latency(guac_client_latency_histogram* dst,
+        const guac_client_latency_histogram* src) {
+
+    for (int i = 0; i < GUAC_CLIENT_LATENCY_BUCKETS; i++)
+        __atomic_store_n(&dst->buckets[i], src->buckets[i], __ATOMIC_RELAXED);
+
+    __atomic_store_n(&dst->sum, src->sum, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->count, src->count, __ATOMIC_RELAXED);
+
+}
+
+/**
+ * Updates the session of the current connection process with the current
+ * state of that process.
+ *
+ * @param session
+ *     The session to update.
+ *
+ * @param client
+ *     The client of the current connection process.
+ */
+static void guacd_metrics_sample(guacd_metrics_session* session,
+        guac_client* client) {
+
+    /* Total CPU time of this process, including all threads */
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        uint64_t cpu_time =
+              (uint64_t) usage.ru_utime.tv_sec * 1000000 + usage.ru_utime.tv_usec
+            + (uint64_t) usage.ru_stime.tv_sec * 1000000 + usage.ru_stime.tv_usec;
+        __atomic_store_n(&session->cpu_time, cpu_time, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&session->users,
+            (uint64_t) client->connected_users, __ATOMIC_RELAXED);
+
+    /* Rendering statistics, if the plugin uses guac_display */
+    guac_display_stats stats;
+    if (!guac_display_get_client_stats(client, &stats)) {
+        __atomic_store_n(&session->frames, stats.frames, __ATOMIC_RELAXED);
+        __atomic_store_n(&session->render_lag,
+                (uint64_t) stats.render_lag, __ATOMIC_RELAXED);
+        __atomic_store_n(&session->queue_depth,
+                (uint64_t) stats.queue_depth, __ATOMIC_RELAXED);
+    }
+
+    /* Connection phases, if recorded by the plugin. Recorded phases never
+     * change name or order, thus only newly-recorded phases need names
+     * copied, and this must happen before those phases are published. */
+    guac_client_connect_phase phases[GUAC_CLIENT_MAX_CONNECT_PHASES];
+    int count = guac_client_get_connect_phases(client, phases,
+            GUAC_CLIENT_MAX_CONNECT_PHASES);
+
+    int published = __atomic_load_n(&session->connect_phase_count,
+            __ATOMIC_RELAXED);
+
+    for (int i = 0; i < count; i++) {
+
+        guacd_metrics_connect_phase* phase = &session->connect_phases[i];
+        if (i >= published)
+            memcpy(phase->name, phases[i].name, sizeof(phase->name));
+
+        __atomic_store_n(&phase->duration, (uint64_t) phases[i].duration,
+                __ATOMIC_RELAXED);
+
+    }
+
+    if (count > published)
+        __atomic_store_n(&session->connect_phase_count, count,
+                __ATOMIC_RELEASE);
+
+    /* Input latency, broken down into its components */
+    guac_client_latency_stats latency;
+    guac_client_get_latency_stats(client, &latency);
+    guacd_metrics_store_latency(&session->latency.server, &latency.server);
+    guacd_metrics_store_latency(&session->latency.encode, &latency.encode);
+    guacd_metrics_store_latency(&session->latency.network, &latency.network);
+    guacd_metrics_store_latency(&session->latency.total, &latency.total);
+
+    /* Memory attributed to each subsystem of the client */
+    guac_client_memory_stats memory;
+    guac_client_get_memory_stats(client, &memory);
+    for (int i = 0; i < GUAC_CLIENT_MEMORY_CATEGORIES; i++) {
+        __atomic_store_n(&session->memory[i], memory.usage[i], __ATOMIC_RELAXED);
+        __atomic_store_n(&session->memory_peak[i], memory.peak[i], __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&session->memory_reclaims, memory.reclaims, __ATOMIC_RELAXED);
+    __atomic_store_n(&session->memory_reclaimed, memory.reclaimed, __ATOMIC_RELAXED);
+
+    /* Total physical memory of this process (the second field of statm is
+     * the resident set size, in pages) */
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+
+        uint64_t size, resident;
+        if (fscanf(statm, "%" SCNu64 " %" SCNu64, &size, &resident) == 2)
+            __atomic_store_n(&session->resident_memory,
+                    resident * (uint64_t) sysconf(_SC_PAGESIZE),
+                    __ATOMIC_RELAXED);
+
+        fclose(statm);
+
+    }
+
+}
+
+/**
+ * Reclaims unneeded memory within the current connection process if the
+ * guac_display of the given client has sent no frames for
+ * GUACD_METRICS_RECLAIM_IDLE_TIME, or if any layer of that display has been
+ * shrunk since memory was last reclaimed and the display has since sent no
+ * frames for a full sampling interval (such that memory is not reclaimed in
+ * the midst of an interactive resize). Memory is reclaimed only once for
+ * each period of idleness. This function must be invoked only after the
+ * given session has been updated by guacd_metrics_sample().
+ *
+ * @param session
+ *     The session of the current connection process.
+ *
+ * @param client
+ *     The client of the current connection process.
+ */
+static void guacd_metrics_reclaim(guacd_metrics_session* session,
+        guac_client* client) {
+
+    guac_timestamp now = guac_timestamp_current();
+
+    guac_display_stats stats;
+    if (guac_display_get_client_stats(client, &stats))
+        stats.layer_shrinks = 0;
+
+    /* Any frame sent since the last check ends any period of idleness */
+    uint64_t frames = __atomic_load_n(&session->frames, __ATOMIC_RELAXED);
+    if (guacd_metrics_reclaim_activity == 0
+            || frames != guacd_metrics_reclaim_frames) {
+        guacd_metrics_reclaim_frames = frames;
+        guacd_metrics_reclaim_activity = now;
+        guacd_metrics_reclaim_idle = 0;
+        return;
+    }
+
+    int reclaim = stats.layer_shrinks != guacd_metrics_reclaim_shrinks;
+
+    if (!guacd_metrics_reclaim_idle
+            && now - guacd_metrics_reclaim_activity >= GUACD_METRICS_RECLAIM_IDLE_TIME) {
+        guacd_metrics_reclaim_idle = 1;
+        reclaim = 1;
+    }
+
+    if (!reclaim)
+        return;
+
+    guacd_metrics_reclaim_shrinks = stats.layer_shrinks;
+
+    size_t reclaimed = guac_client_reclaim_memory(client);
+    if (reclaimed)
+        guacd_log(GUAC_LOG_DEBUG, "Reclaimed %zu bytes of unneeded memory "
+                "from connection \"%s\".", reclaimed, client->connection_id);
+
+}
+
+/**
+ * Thread which periodically updates the session of the current connection
+ * process, until guacd_metrics_stop_sampling() is called.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_metrics_sampling_thread_main(void* data) {
+
+    pthread_mutex_lock(&guacd_metrics_sampling_lock);
+    while (!guacd_metrics_sampling_stopping) {
+
+        guacd_metrics_sample(guacd_metrics_sampled_session,
+                guacd_metrics_sampled_client);
+
+        guacd_metrics_reclaim(guacd_metrics_sampled_session,
+                guacd_metrics_sampled_client);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += GUACD_METRICS_INTERVAL / 1000;
+        deadline.tv_nsec += (GUACD_METRICS_INTERVAL % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_cond_timedwait(&guacd_metrics_sampling_stop,
+                &guacd_metrics_sampling_lock, &deadline);
+
+    }
+    pthread_mutex_unlock(&guacd_metrics_sampling_lock);
+
+    return NULL;
+
+}
+
+void guacd_metrics_start_sampling(guacd_metrics_session* session,
+        guac_client* client) {
+
+    if (session == NULL || guacd_metrics_sampling_running)
+        return;
+
+    guacd_metrics_sampled_session = session;
+    guacd_metrics_sampled_client = client;
+
+    if (pthread_create(&guacd_metrics_sampling_thread, NULL,
+                guacd_metrics_sampling_thread_main, NULL)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to start thread for updating "
+                "metrics. Only the data relayed by guacd will be tracked.");
+        return;
+    }
+
+    guacd_metrics_sampling_running = 1;
+
+}
+
+void guacd_metrics_stop_sampling(void) {
+
+    if (!guacd_metrics_sampling_running)
+        return;
+
+    pthread_mutex_lock(&guacd_metrics_sampling_lock);
+    guacd_metrics_sampling_stopping = 1;
+    pthread_cond_signal(&guacd_metrics_sampling_stop);
+    pthread_mutex_unlock(&guacd_metrics_sampling_lock);
+
+    pthread_join(guacd_metrics_sampling_thread, NULL);
+    guacd_metrics_sampling_running = 0;
+
+    /* Record final values, as the client is about to be freed */
+    guacd_metrics_sample(guacd_metrics_sampled_session,
+            guacd_metrics_sampled_client);
+
+}
+
@@ -0,0 +1,325 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_METRICS_H
+#define GUACD_METRICS_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * The maximum number of connection processes whose metrics may be tracked at
+ * any one time. Processes created while all slots are in use are simply not
+ * tracked.
+ */
+#define GUACD_METRICS_MAX_SESSIONS 4096
+
+/**
+ * The maximum number of bytes, including null terminator, of the connection
+ * ID and protocol name stored for each tracked connection process.
+ */
+#define GUACD_METRICS_MAX_NAME_LENGTH 64
+
+/**
+ * The number of milliseconds between each update of the metrics of a
+ * connection process by that process.
+ */
+#define GUACD_METRICS_INTERVAL 1000
+
+/**
+ * The number of milliseconds that a connection process must go without
+ * sending any frames before unneeded memory is reclaimed. Memory is reclaimed only once for each such period
+ * of idleness.
+ */
+#define GUACD_METRICS_RECLAIM_IDLE_TIME 30000
+
+/**
+ * The duration of a single phase of establishing the connection to the
+ * remote desktop server, as recorded by the connection process using
+ * guac_client_record_connect_phase().
+ */
+typedef struct guacd_metrics_connect_phase {
+
+    /**
+     * The name of the phase, as given to guac_client_record_connect_phase().
+     * This is written only once, before the phase is published by updating
+     * the connect_phase_count of the containing session.
+     */
+    char name[GUAC_CLIENT_CONNECT_PHASE_NAME_LENGTH];
+
+    /**
+     * The amount of time spent within the phase, in milliseconds.
+     */
+    uint64_t duration;
+
+} guacd_metrics_connect_phase;
+
+/**
+ * The metrics of a single connection process. Each session resides within a
+ * region of memory shared by guacd and all connection processes. Counters
+ * that describe data relayed by guacd are updated by guacd itself, while all
+ * other values are updated periodically by the connection process. All
+ * values must be read and written using the atomic operations of this
+ * header, as different processes access them concurrently.
+ */
+typedef struct guacd_metrics_session {
+
+    /**
+     * Non-zero if this session is currently assigned to a connection
+     * process, zero if it is free.
+     */
+    int in_use;
+
+    /**
+     * The process ID of the connection process, or zero if not yet known.
+     */
+    pid_t pid;
+
+    /**
+     * The connection ID of the guac_client within the connection process.
+     */
+    char connection_id[GUACD_METRICS_MAX_NAME_LENGTH];
+
+    /**
+     * The name of the protocol handled by the connection process.
+     */
+    char protocol[GUACD_METRICS_MAX_NAME_LENGTH];
+
+    /**
+     * The time that the connection process was created, in seconds since the
+     * epoch.
+     */
+    int64_t start_time;
+
+    /**
+     * The total number of bytes received from all users of the connection
+     * and relayed by guacd to the connection process.
+     */
+    uint64_t bytes_received;
+
+    /**
+     * The total number of bytes sent by the connection process and relayed
+     * by guacd to users of the connection.
+     */
+    uint64_t bytes_sent;
+
+    /**
+     * The total amount of CPU time consumed by the connection process, in
+     * microseconds.
+     */
+    uint64_t cpu_time;
+
+    /**
+     * The number of users currently connected.
+     */
+    uint64_t users;
+
+    /**
+     * The total number of frames sent by the guac_display of the connection,
+     * if any.
+     */
+    uint64_t frames;
+
+    /**
+     * The amount of time that the most recent frame was delayed to
+     * compensate for client-side processing lag, in milliseconds.
+     */
+    uint64_t render_lag;
+
+    /**
+     * The number of operations most recently waiting to be handled by the
+     * worker threads of the guac_display of the connection, if any.
+     */
+    uint64_t queue_depth;
+
+    /**
+     * The phases of connection establishment recorded by the connection
+     * process, in the order first recorded. Only the first
+     * connect_phase_count entries are valid.
+     */
+    guacd_metrics_connect_phase connect_phases[GUAC_CLIENT_MAX_CONNECT_PHASES];
+
+    /**
+     * The number of valid entries within connect_phases.
+     */
+    int connect_phase_count;
+
+    /**
+     * The latency between user input and the display of the resulting
+     * changes, as measured by the guac_client of the connection process and
+     * broken down into its components.
+     */
+    guac_client_latency_stats latency;
+
+    /**
+     * The number of bytes of memory currently attributed to each subsystem
+     * of the guac_client of the connection process, indexed by
+     * guac_client_memory_category.
+     */
+    uint64_t memory[GUAC_CLIENT_MEMORY_CATEGORIES];
+
+    /**
+     * The greatest number of bytes of memory ever attributed to each
+     * subsystem of the guac_client of the connection process at any one
+     * time, indexed by guac_client_memory_category.
+     */
+    uint64_t memory_peak[GUAC_CLIENT_MEMORY_CATEGORIES];
+
+    /**
+     * The amount of physical memory currently used by the connection
+     * process, in bytes, or zero if not known.
+     */
+    uint64_t resident_memory;
+
+    /**
+     * The number of times unneeded memory has been reclaimed by the
+     * connection process.
+     */
+    uint64_t memory_reclaims;
+
+    /**
+     * The total number of bytes of memory attributed to subsystems of the
+     * guac_client that have been released by reclaiming unneeded memory.
+     */
+    uint64_t memory_reclaimed;
+
+} guacd_metrics_session;
+
+/**
+ * Atomically adds the given number of bytes to the given counter of a
+ * session. If the session is not being tracked, this function has no effect.
+ *
+ * @param session
+ *     The session whose counter should be updated, or NULL if the relevant
+ *     connection process is not tracked.
+ *
+ * @param counter
+ *     A pointer to the counter within the given session, such as
+ *     &session->bytes_sent. This is ignored if session is NULL.
+ *
+ * @param length
+ *     The number of bytes to add to the counter.
+ */
+#define guacd_metrics_add(session, counter, length)                           \
+    do {                                                                      \
+        if ((session) != NULL)                                                \
+            __atomic_fetch_add((counter), (uint64_t) (length),                \
+                    __ATOMIC_RELAXED);                                        \
+    } while (0)
+
+/**
+ * Creates the memory region shared with all connection processes that holds
+ * the metrics of each process and begins exporting those metrics through a
+ * UNIX domain socket at the given path. Each connection to that socket
+ * receives a snapshot of all metrics in the Prometheus text exposition
+ * format, after which the connection is closed. This function must be called
+ * before any connection process is created, and has no effect if called
+ * more than once.
+ *
+ * @param socket_path
+ *     The path of the UNIX domain socket to create. Any file already present
+ *     at this path is replaced.
+ *
+ * @return
+ *     Zero if metrics are now being exported, non-zero otherwise.
+ */
+int guacd_metrics_init(const char* socket_path);
+
+/**
+ * Assigns an unused session to a new connection process. This function must
+ * be called by guacd prior to creating the process, such that the process
+ * inherits the same session. If metrics are not enabled or all sessions are
+ * in use, NULL is returned and the process will not be tracked.
+ *
+ * @param connection_id
+ *     The connection ID of the guac_client of the new process.
+ *
+ * @param protocol
+ *     The name of the protocol that the new process will handle.
+ *
+ * @return
+ *     The session assigned to the new process, or NULL if the process will
+ *     not be tracked.
+ */
+guacd_metrics_session* guacd_metrics_claim(const char* connection_id,
+        const char* protocol);
+
+/**
+ * Records the process ID of the connection process assigned the given
+ * session. If the session is NULL, this function has no effect.
+ *
+ * @param session
+ *     The session of the connection process, or NULL if the process is not
+ *     tracked.
+ *
+ * @param pid
+ *     The process ID of the connection process.
+ */
+void guacd_metrics_set_pid(guacd_metrics_session* session, pid_t pid);
+
+/**
+ * Frees the given session, such that it may be assigned to a future
+ * connection process. This function must be called by guacd only once the
+ * connection process has terminated. If the session is NULL, this function
+ * has no effect.
+ *
+ * @param session
+ *     The session to free, or NULL if the process was not tracked.
+ */
+void guacd_metrics_release(guacd_metrics_session* session);
+
+/**
+ * Starts a thread within the current connection process which periodically
+ * updates the given session with the CPU time and memory consumed by the
+ * process, the number of connected users, the statistics of the guac_display
+ * of the given client, the phases of connection establishment recorded for
+ * the given client, and the memory attributed to each subsystem of the given
+ * client. The same thread reclaims unneeded memory via
+ * guac_client_reclaim_memory() once the connection has been idle for
+ * GUACD_METRICS_RECLAIM_IDLE_TIME, and after any layer of the display has
+ * been shrunk once the display has stopped changing. If the session is NULL,
+ * this function has no effect. The
+ * thread runs until guacd_metrics_stop_sampling() is called, which must
+ * happen before the given client is freed.
+ *
+ * @param session
+ *     The session of the current connection process, or NULL if the process
+ *     is not tracked.
+ *
+ * @param client
+ *     The guac_client of the current connection process.
+ */
+void guacd_metrics_start_sampling(guacd_metrics_session* session,
+        guac_client* client);
+
+/**
+ * Stops the thread started by guacd_metrics_start_sampling() within the
+ * current connection process, if any, after updating the session one final
+ * time. Once this function returns, the guac_client given to
+ * guacd_metrics_start_sampling() is no longer referenced and may be freed.
+ */
+void guacd_metrics_stop_sampling(void);
+
+#endif
+
@@ -0,0 +1,388 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "placement.h"
+
+#include <guacamole/client.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+
+/**
+ * The CPUs of a single NUMA node which are available to guacd, along with
+ * the number of connection processes currently assigned to that node.
+ */
+typedef struct guacd_placement_node {
+
+    /**
+     * The ID of this node, as used by the kernel.
+     */
+    int id;
+
+    /**
+     * The CPUs of this node which are available to guacd.
+     */
+    cpu_set_t cpus;
+
+    /**
+     * The number of CPUs within cpus.
+     */
+    int cpu_count;
+
+    /**
+     * The number of connection processes currently assigned to this node.
+     */
+    int load;
+
+} guacd_placement_node;
+
+/**
+ * All NUMA nodes having CPUs available to guacd.
+ */
+static guacd_placement_node guacd_placement_nodes[GUACD_PLACEMENT_MAX_NODES];
+
+/**
+ * The number of valid entries within guacd_placement_nodes.
+ */
+static int guacd_placement_node_count = 0;
+
+/**
+ * The number of connection processes currently assigned to each CPU.
+ */
+static int guacd_placement_cpu_load[CPU_SETSIZE];
+
+/**
+ * The policy followed when assigning connection processes to CPUs.
+ */
+static guacd_placement_policy guacd_placement_current_policy = GUACD_PLACEMENT_NONE;
+
+/**
+ * The number of CPUs to assign to each connection process, or zero to assign
+ * all CPUs of a node.
+ */
+static int guacd_placement_cpus_per_connection = 0;
+
+/**
+ * Lock which guards the load of all nodes and CPUs.
+ */
+static pthread_mutex_t guacd_placement_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Parses the given list of CPUs, in the format used by the kernel within
+ * sysfs (comma-separated CPU numbers and ranges of CPU numbers, such as
+ * "0-3,8,10-11"), adding each CPU to the given set.
+ *
+ * @param list
+ *     The list of CPUs to parse.
+ *
+ * @param cpus
+ *     The set that should receive each CPU listed.
+ *
+ * @return
+ *     Zero if the list was parsed successfully, non-zero otherwise.
+ */
+static int guacd_placement_parse_cpulist(const char* list, cpu_set_t* cpus) {
+
+    CPU_ZERO(cpus);
+
+    while (*list != '\0' && *list != '\n') {
+
+        char* end;
+        long first = strtol(list, &end, 10);
+        if (end == list || first < 0)
+            return 1;
+
+        long last = first;
+        if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first)
+                return 1;
+        }
+
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, cpus);
+
+        list = end;
+        if (*list == ',')
+            list++;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Reads the CPUs of the NUMA node having the given ID from sysfs.
+ *
+ * @param id
+ *     The ID of the NUMA node.
+ *
+ * @param cpus
+ *     The set that should receive the CPUs of the node.
+ *
+ * @return
+ *     Zero if the CPUs of the node were read successfully, non-zero if no
+ *     such node exists or its CPUs could not be read.
+ */
+static int guacd_placement_read_node(int id, cpu_set_t* cpus) {
+
+    char path[256];
+    snprintf(path, sizeof(path), GUACD_PLACEMENT_NODE_PATH "/node%i/cpulist", id);
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return 1;
+
+    char list[4096];
+    int result = fgets(list, sizeof(list), file) == NULL
+        || guacd_placement_parse_cpulist(list, cpus);
+
+    fclose(file);
+    return result;
+
+}
+
+void guacd_placement_init(guacd_placement_policy policy,
+        int cpus_per_connection) {
+
+    if (policy == GUACD_PLACEMENT_NONE)
+        return;
+
+    cpu_set_t available;
+    if (sched_getaffinity(0, sizeof(available), &available)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to determine available CPUs: %s. "
+                "Connection processes will not be assigned to specific CPUs.",
+                strerror(errno));
+        return;
+    }
+
+    pthread_mutex_lock(&guacd_placement_lock);
+
+    /* Group available CPUs by NUMA node, ignoring nodes without CPUs */
+    guacd_placement_node_count = 0;
+    for (int id = 0; id < GUACD_PLACEMENT_MAX_NODES; id++) {
+
+        guacd_placement_node* node = &guacd_placement_nodes[guacd_placement_node_count];
+        if (guacd_placement_read_node(id, &node->cpus))
+            continue;
+
+        CPU_AND(&node->cpus, &node->cpus, &available);
+        node->cpu_count = CPU_COUNT(&node->cpus);
+        if (node->cpu_count == 0)
+            continue;
+
+        node->id = id;
+        node->load = 0;
+        guacd_placement_node_count++;
+
+    }
+
+    /* Without NUMA information, treat all available CPUs as one node */
+    if (guacd_placement_node_count == 0) {
+        guacd_placement_node* node = &guacd_placement_nodes[0];
+        node->id = 0;
+        node->cpus = available;
+        node->cpu_count = CPU_COUNT(&available);
+        node->load = 0;
+        guacd_placement_node_count = 1;
+    }
+
+    guacd_placement_current_policy = policy;
+    guacd_placement_cpus_per_connection = cpus_per_connection;
+
+    guacd_log(GUAC_LOG_INFO, "Connection processes will be %s across %i "
+            "CPU(s) within %i NUMA node(s).",
+            policy == GUACD_PLACEMENT_PACK ? "packed" : "spread",
+            CPU_COUNT(&available), guacd_placement_node_count);
+
+    pthread_mutex_unlock(&guacd_placement_lock);
+
+}
+
+/**
+ * Selects the node that a new connection process should be assigned to,
+ * according to the current policy. The caller must hold guacd_placement_lock.
+ *
+ * @return
+ *     The index of the selected node within guacd_placement_nodes.
+ */
+static int guacd_placement_select_node(void) {
+
+    /* When packing, use the first node with remaining capacity */
+    if (guacd_placement_current_policy == GUACD_PLACEMENT_PACK) {
+        for (int i = 0; i < guacd_placement_node_count; i++) {
+
+            guacd_placement_node* node = &guacd_placement_nodes[i];
+
+            int capacity = node->cpu_count;
+            if (guacd_placement_cpus_per_connection > 0)
+                capacity /= guacd_placement_cpus_per_connection;
+
+            if (node->load < capacity || (capacity == 0 && node->load == 0))
+                return i;
+
+        }
+    }
+
+    /* Otherwise (or if all nodes are at capacity), use the node having the
+     * fewest processes relative to its number of CPUs */
+    int selected = 0;
+    for (int i = 1; i < guacd_placement_node_count; i++) {
+
+        guacd_placement_node* node = &guacd_placement_nodes[i];
+        guacd_placement_node* best = &guacd_placement_nodes[selected];
+
+        if ((long) node->load * best->cpu_count < (long) best->load * node->cpu_count)
+            selected = i;
+
+    }
+
+    return selected;
+
+}
+
+void guacd_placement_assign(guacd_placement* placement) {
+
+    placement->node = -1;
+
+    if (guacd_placement_current_policy == GUACD_PLACEMENT_NONE)
+        return;
+
+    pthread_mutex_lock(&guacd_placement_lock);
+
+    int index = guacd_placement_select_node();
+    guacd_placement_node* node = &guacd_placement_nodes[index];
+
+    int count = guacd_placement_cpus_per_connection;
+
+    /* Use the entire node unless fewer CPUs were requested */
+    if (count <= 0 || count >= node->cpu_count)
+        placement->cpus = node->cpus;
+
+    /* Otherwise, use the least-loaded CPUs of the node */
+    else {
+
+        CPU_ZERO(&placement->cpus);
+
+        for (int i = 0; i < count; i++) {
+
+            int selected = -1;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+
+                if (!CPU_ISSET(cpu, &node->cpus) || CPU_ISSET(cpu, &placement->cpus))
+                    continue;
+
+                if (selected == -1 || guacd_placement_cpu_load[cpu]
+                        < guacd_placement_cpu_load[selected])
+                    selected = cpu;
+
+            }
+
+            CPU_SET(selected, &placement->cpus);
+
+        }
+
+    }
+
+    /* Record the new process against its node and CPUs */
+    node->load++;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &placement->cpus))
+            guacd_placement_cpu_load[cpu]++;
+    }
+
+    placement->node = index;
+
+    pthread_mutex_unlock(&guacd_placement_lock);
+
+}
+
+void guacd_placement_apply(const guacd_placement* placement) {
+
+    if (placement->node < 0)
+        return;
+
+    if (sched_setaffinity(0, sizeof(placement->cpus), &placement->cpus)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to assign connection process to "
+                "CPUs: %s", strerror(errno));
+        return;
+    }
+
+    guacd_log(GUAC_LOG_DEBUG, "Connection process assigned to %i CPU(s) of "
+            "NUMA node %i.", CPU_COUNT(&placement->cpus),
+            guacd_placement_nodes[placement->node].id);
+
+}
+
+void guacd_placement_release(guacd_placement* placement) {
+
+    if (placement->node < 0)
+        return;
+
+    pthread_mutex_lock(&guacd_placement_lock);
+
+    guacd_placement_nodes[placement->node].load--;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &placement->cpus))
+            guacd_placement_cpu_load[cpu]--;
+    }
+
+    pthread_mutex_unlock(&guacd_placement_lock);
+
+    placement->node = -1;
+
+}
+
+#else
+
+void guacd_placement_init(guacd_placement_policy policy,
+        int cpus_per_connection) {
+
+    /* Assigning processes to CPUs requires sched_setaffinity() */
+    if (policy != GUACD_PLACEMENT_NONE)
+        guacd_log(GUAC_LOG_WARNING, "Assigning connection processes to "
+                "specific CPUs is not supported on this platform.");
+
+}
+
+void guacd_placement_assign(guacd_placement* placement) {
+    placement->node = -1;
+}
+
+void guacd_placement_apply(const guacd_placement* placement) {
+    /* Not supported */
+}
+
+void guacd_placement_release(guacd_placement* placement) {
+    /* Not supported */
+}
+
+#endif
+
@@ -0,0 +1,147 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_PLACEMENT_H
+#define GUACD_PLACEMENT_H
+
+#include "config.h"
+
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+
+/**
+ * The directory containing one subdirectory per NUMA node, each describing
+ * the CPUs of that node within a "cpulist" file.
+ */
+#define GUACD_PLACEMENT_NODE_PATH "/sys/devices/system/node"
+
+/**
+ * The maximum number of NUMA nodes that connection processes may be placed
+ * across. Any further nodes are ignored.
+ */
+#define GUACD_PLACEMENT_MAX_NODES 64
+
+/**
+ * The maximum number of CPUs that may be assigned to any one connection
+ * process.
+ */
+#define GUACD_PLACEMENT_MAX_CPUS 1024
+
+/**
+ * How connection processes are assigned to CPUs.
+ */
+typedef enum guacd_placement_policy {
+
+    /**
+     * Connection processes are not assigned to any particular CPUs and may
+     * run on any CPU available to guacd.
+     */
+    GUACD_PLACEMENT_NONE,
+
+    /**
+     * Each new connection process is assigned to the NUMA node that has the
+     * fewest connection processes relative to its number of CPUs, spreading
+     * load evenly across all nodes.
+     */
+    GUACD_PLACEMENT_SPREAD,
+
+    /**
+     * Each new connection process is assigned to the first NUMA node that
+     * has not yet reached its capacity, filling each node before moving on
+     * to the next. A node reaches capacity once every CPU of that node has
+     * been assigned a connection process.
+     */
+    GUACD_PLACEMENT_PACK
+
+} guacd_placement_policy;
+
+/**
+ * The CPUs assigned to a single connection process.
+ */
+typedef struct guacd_placement {
+
+    /**
+     * The index of the NUMA node containing the assigned CPUs, or -1 if the
+     * process was not assigned to any CPUs.
+     */
+    int node;
+
+#ifdef HAVE_SCHED_SETAFFINITY
+    /**
+     * The CPUs that the process is assigned to. This is only meaningful if
+     * node is not -1.
+     */
+    cpu_set_t cpus;
+#endif
+
+} guacd_placement;
+
+/**
+ * Determines the CPUs and NUMA nodes available to guacd and begins assigning
+ * each future connection process to CPUs according to the given policy. If
+ * CPU affinity is not supported on the current platform, or the policy is
+ * GUACD_PLACEMENT_NONE, connection processes are not assigned to any
+ * particular CPUs.
+ *
+ * @param policy
+ *     The policy to follow when assigning connection processes to CPUs.
+ *
+ * @param cpus_per_connection
+ *     The number of CPUs that each connection process should be assigned,
+ *     all within the same NUMA node, or zero if each process should be
+ *     assigned every CPU of its node.
+ */
+void guacd_placement_init(guacd_placement_policy policy,
+        int cpus_per_connection);
+
+/**
+ * Assigns CPUs to a new connection process according to the configured
+ * policy. This function must be called by guacd prior to creating the
+ * process, and the resulting placement must eventually be released with
+ * guacd_placement_release().
+ *
+ * @param placement
+ *     The guacd_placement to populate with the assigned CPUs.
+ */
+void guacd_placement_assign(guacd_placement* placement);
+
+/**
+ * Restricts the current process (and any threads and processes it later
+ * creates) to the CPUs of the given placement. This function must be called
+ * within the connection process itself, before any threads are created. If
+ * the given placement does not assign any CPUs, this function has no effect.
+ *
+ * @param placement
+ *     The placement to apply.
+ */
+void guacd_placement_apply(const guacd_placement* placement);
+
+/**
+ * Releases the CPUs assigned by the given placement, such that they are
+ * considered available to future connection processes. This function must
+ * be called by guacd once the connection process has terminated.
+ *
+ * @param placement
+ *     The placement to release.
+ */
+void guacd_placement_release(guacd_placement* placement);
+
+#endif
+
@@ -0,0 +1,263 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "conf.h"
+#include "proc-limits.h"
+#include "log.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/**
+ * The cgroup v2 directory beneath which each connection process is given its
+ * own cgroup, or NULL if cgroups are not used.
+ */
+static char* guacd_proc_limits_cgroup = NULL;
+
+/**
+ * The limits applied to connections lacking protocol-specific limits.
+ */
+static guacd_config_limits guacd_proc_limits_defaults = { NULL, 0, 0, 0 };
+
+/**
+ * Protocol-specific limits overriding guacd_proc_limits_defaults.
+ */
+static const guacd_config_limits* guacd_proc_limits_overrides = NULL;
+
+/**
+ * The number of entries within guacd_proc_limits_overrides.
+ */
+static int guacd_proc_limits_override_count = 0;
+
+/**
+ * Writes the given value to the given file within the given directory,
+ * replacing any existing contents of that file.
+ *
+ * @param dir
+ *     The directory containing the file.
+ *
+ * @param file
+ *     The name of the file to write.
+ *
+ * @param value
+ *     The value to write.
+ *
+ * @return
+ *     Zero if the value was written successfully, non-zero otherwise, in
+ *     which case errno is set appropriately.
+ */
+static int guacd_proc_limits_write(const char* dir, const char* file,
+        const char* value) {
+
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, file) >= sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return 1;
+    }
+
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    if (fd < 0)
+        return 1;
+
+    size_t length = strlen(value);
+    int result = write(fd, value, length) != length;
+
+    /* Preserve the original error across close() */
+    int error = errno;
+    close(fd);
+    errno = error;
+
+    return result;
+
+}
+
+/**
+ * Produces the path of the cgroup for the connection having the given ID.
+ * Connection IDs begin with a "$", which is omitted from the path.
+ *
+ * @param connection_id
+ *     The ID of the connection.
+ *
+ * @param path
+ *     The buffer that should receive the path.
+ *
+ * @param length
+ *     The size of the path buffer, in bytes.
+ *
+ * @return
+ *     Zero if the path was produced successfully, non-zero if the buffer is
+ *     too small.
+ */
+static int guacd_proc_limits_cgroup_path(const char* connection_id, char* path,
+        size_t length) {
+
+    if (*connection_id == '$')
+        connection_id++;
+
+    return snprintf(path, length, "%s/%s", guacd_proc_limits_cgroup,
+            connection_id) >= length;
+
+}
+
+void guacd_proc_limits_init(const char* cgroup, const guacd_config_limits* defaults,
+        const guacd_config_limits* overrides, int count) {
+
+    guacd_proc_limits_defaults = *defaults;
+    guacd_proc_limits_overrides = overrides;
+    guacd_proc_limits_override_count = count;
+
+    if (cgroup == NULL)
+        return;
+
+    /* Child cgroups can only be limited if the relevant controllers are
+     * enabled for them */
+    if (guacd_proc_limits_write(cgroup, "cgroup.subtree_control", "+cpu +memory")) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to enable CPU and memory "
+                "controllers within cgroup \"%s\": %s. CPU and memory "
+                "limits will not be enforced.", cgroup, strerror(errno));
+        return;
+    }
+
+    guac_mem_free(guacd_proc_limits_cgroup);
+    guacd_proc_limits_cgroup = guac_strdup(cgroup);
+
+    guacd_log(GUAC_LOG_INFO, "Connection processes will be limited using "
+            "cgroups beneath \"%s\".", cgroup);
+
+}
+
+/**
+ * Returns the limits applying to the given protocol, combining any
+ * protocol-specific limits with the defaults.
+ *
+ * @param protocol
+ *     The name of the protocol.
+ *
+ * @return
+ *     The limits applying to the given protocol.
+ */
+static guacd_config_limits guacd_proc_limits_get(const char* protocol) {
+
+    guacd_config_limits limits = guacd_proc_limits_defaults;
+
+    for (int i = 0; i < guacd_proc_limits_override_count; i++) {
+
+        const guacd_config_limits* override = &guacd_proc_limits_overrides[i];
+        if (strcmp(override->protocol, protocol) != 0)
+            continue;
+
+        if (override->cpu >= 0)
+            limits.cpu = override->cpu;
+
+        if (override->memory >= 0)
+            limits.memory = override->memory;
+
+        if (override->bandwidth >= 0)
+            limits.bandwidth = override->bandwidth;
+
+        break;
+
+    }
+
+    return limits;
+
+}
+
+size_t guacd_proc_limits_apply(const char* protocol, const char* connection_id) {
+
+    guacd_config_limits limits = guacd_proc_limits_get(protocol);
+
+    /* CPU and memory limits require a cgroup for this process */
+    if (guacd_proc_limits_cgroup == NULL || (limits.cpu == 0 && limits.memory == 0))
+        return limits.bandwidth * 1024;
+
+    char path[4096];
+    if (guacd_proc_limits_cgroup_path(connection_id, path, sizeof(path))) {
+        guacd_log(GUAC_LOG_WARNING, "Path of cgroup for connection is too "
+                "long. CPU and memory limits will not be enforced.");
+        return limits.bandwidth * 1024;
+    }
+
+    if (mkdir(path, 0755) && errno != EEXIST) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to create cgroup \"%s\": %s. CPU "
+                "and memory limits will not be enforced.", path,
+                strerror(errno));
+        return limits.bandwidth * 1024;
+    }
+
+    char value[64];
+
+    /* Limit CPU time to the given number of CPUs, in thousandths of a CPU */
+    if (limits.cpu > 0) {
+        snprintf(value, sizeof(value), "%li %i",
+                limits.cpu * GUACD_PROC_LIMITS_CPU_PERIOD / 1000,
+                GUACD_PROC_LIMITS_CPU_PERIOD);
+        if (guacd_proc_limits_write(path, "cpu.max", value))
+            guacd_log(GUAC_LOG_WARNING, "Unable to limit CPU usage of "
+                    "connection process: %s", strerror(errno));
+    }
+
+    /* Limit memory to the given number of MiB */
+    if (limits.memory > 0) {
+        snprintf(value, sizeof(value), "%li", limits.memory * 1048576);
+        if (guacd_proc_limits_write(path, "memory.max", value))
+            guacd_log(GUAC_LOG_WARNING, "Unable to limit memory usage of "
+                    "connection process: %s", strerror(errno));
+    }
+
+    /* Move this process (and any processes it later creates) into the new
+     * cgroup */
+    if (guacd_proc_limits_write(path, "cgroup.procs", "0"))
+        guacd_log(GUAC_LOG_WARNING, "Unable to move connection process into "
+                "cgroup \"%s\": %s", path, strerror(errno));
+    else
+        guacd_log(GUAC_LOG_DEBUG, "Connection process moved into cgroup "
+                "\"%s\".", path);
+
+    return limits.bandwidth * 1024;
+
+}
+
+void guacd_proc_limits_release(const char* connection_id) {
+
+    if (guacd_proc_limits_cgroup == NULL)
+        return;
+
+    char path[4096];
+    if (guacd_proc_limits_cgroup_path(connection_id, path, sizeof(path)))
+        return;
+
+    /* The cgroup will only exist if limits were applied */
+    if (rmdir(path) && errno != ENOENT)
+        guacd_log(GUAC_LOG_DEBUG, "Unable to remove cgroup \"%s\": %s",
+                path, strerror(errno));
+
+}
+
@@ -0,0 +1,91 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACD_PROC_LIMITS_H
+#define GUACD_PROC_LIMITS_H
+
+#include "config.h"
+#include "conf.h"
+
+#include <stddef.h>
+
+/**
+ * The period over which the CPU limit of each connection process is
+ * enforced, in microseconds. This is the period written to "cpu.max".
+ */
+#define GUACD_PROC_LIMITS_CPU_PERIOD 100000
+
+/**
+ * Begins enforcing the given resource limits for all future connection
+ * processes. CPU and memory limits are enforced by placing each connection
+ * process within its own cgroup beneath the given cgroup v2 directory, which
+ * must already have been delegated to guacd. Bandwidth limits are enforced
+ * separately by each connection process for each of its users. If no cgroup
+ * directory is given, CPU and memory limits are ignored.
+ *
+ * @param cgroup
+ *     The cgroup v2 directory beneath which each connection process should
+ *     be given its own cgroup, or NULL if cgroups should not be used.
+ *
+ * @param defaults
+ *     The limits applied to any connection for which no protocol-specific
+ *     limit has been given. A limit of zero is unlimited.
+ *
+ * @param overrides
+ *     An array of protocol-specific limits, each overriding the
+ *     corresponding default limit unless negative.
+ *
+ * @param count
+ *     The number of entries within the overrides array.
+ */
+void guacd_proc_limits_init(const char* cgroup, const guacd_config_limits* defaults,
+        const guacd_config_limits* overrides, int count);
+
+/**
+ * Applies the configured CPU and memory limits for the given protocol to the
+ * current process by moving it into a new cgroup for the given connection.
+ * This function must be called within the connection process itself, before
+ * any threads are created. Failure to apply limits is logged but otherwise
+ * ignored.
+ *
+ * @param protocol
+ *     The protocol that the current process is handling.
+ *
+ * @param connection_id
+ *     The ID of the connection being handled by the current process.
+ *
+ * @return
+ *     The maximum number of bytes per second that should be sent to each
+ *     user of the connection, or zero if bandwidth is unlimited.
+ */
+size_t guacd_proc_limits_apply(const char* protocol, const char* connection_id);
+
+/**
+ * Removes the cgroup created by guacd_proc_limits_apply() for the given
+ * connection, if any. This function must be called by guacd once every
+ * process of the connection has terminated.
+ *
+ * @param connection_id
+ *     The ID of the connection whose cgroup should be removed.
+ */
+void guacd_proc_limits_release(const char* connection_id);
+
+#endif
+
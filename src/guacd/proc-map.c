@@ -18,21 +18,28 @@
  */
 
 #include "config.h"
-#include "common/list.h"
 #include "proc.h"
 #include "proc-map.h"
 
 #include <guacamole/client.h>
 #include <guacamole/mem.h>
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 /**
- * A value to be stored in the buckets, containing the guacd proc itself,
- * as well as a link to the element in the list of all guacd processes.
+ * The FNV-1a offset basis for 64-bit hashes.
  */
-typedef struct guacd_proc_map_entry {
+#define GUACD_PROC_MAP_FNV_OFFSET 0xCBF29CE484222325ULL
+
+/**
+ * The FNV-1a prime for 64-bit hashes.
+ */
+#define GUACD_PROC_MAP_FNV_PRIME 0x100000001B3ULL
+
+struct guacd_proc_map_entry {
 
     /**
      * The guacd process itself.
@@ -40,108 +47,161 @@ typedef struct guacd_proc_map_entry {
     guacd_proc* proc;
 
     /**
-     * A pointer to the corresponding entry in the list of all processes.
+     * The hash code of the connection ID of the process, as returned by
+     * __guacd_client_hash(). The hash code is stored such that entries can
+     * be redistributed among buckets and quickly compared against lookups
+     * without rehashing or comparing connection IDs.
+     */
+    uint64_t hash;
+
+    /**
+     * The next entry within the same bucket, or NULL if this is the last
+     * entry.
      */
-    guac_common_list_element* element;
+    guacd_proc_map_entry* next;
 
-} guacd_proc_map_entry;
+};
 
 /**
- * Returns a hash code based on the given connection ID.
+ * Returns a hash code based on the given connection ID, using the 64-bit
+ * variant of FNV-1a. The upper half of the hash code selects the shard of
+ * the connection, while the lower half selects the bucket within that shard.
  *
  * @param str
  *     The string containing the connection ID.
  *
  * @return
- *     A reasonably well-distributed hash code for the given string.
+ *     A well-distributed hash code for the given string.
  */
-static unsigned int __guacd_client_hash(const char* str) {
+static uint64_t __guacd_client_hash(const char* str) {
 
-    unsigned int hash_value = 0;
-    int c;
+    uint64_t hash_value = GUACD_PROC_MAP_FNV_OFFSET;
+    unsigned char c;
 
     /* Apply each character in string to the hash code */
-    while ((c = *(str++)))
-        hash_value = hash_value * 65599 + c;
+    while ((c = (unsigned char) *(str++))) {
+        hash_value ^= c;
+        hash_value *= GUACD_PROC_MAP_FNV_PRIME;
+    }
 
     return hash_value;
 
 }
 
 /**
- * Locates the bucket corresponding to the hash code indicated by the given id,
- * where the hash code is dictated by __guacd_client_hash().  Each bucket is an
- * instance of guac_common_list.
+ * Returns the shard of the given map which contains (or would contain) the
+ * process having the given hash code.
  *
  * @param map
- *     The map to retrieve the hash bucket from.
+ *     The map to retrieve the shard from.
  *
- * @param id
- *     The ID whose hash code determines the bucket being retrieved.
+ * @param hash
+ *     The hash code of the connection ID, as returned by
+ *     __guacd_client_hash().
  *
  * @return
- *     The bucket corresponding to the hash code for the given ID, represented
- *     by a guac_common_list.
+ *     The shard corresponding to the given hash code.
  */
-static guac_common_list* __guacd_proc_find_bucket(guacd_proc_map* map,
-        const char* id) {
-
-    const int index = __guacd_client_hash(id) % GUACD_PROC_MAP_BUCKETS;
-    return map->__buckets[index];
-
+static guacd_proc_map_shard* __guacd_proc_find_shard(guacd_proc_map* map,
+        uint64_t hash) {
+    return &map->__shards[(hash >> 32) & (GUACD_PROC_MAP_SHARDS - 1)];
 }
 
 /**
- * Given a bucket of guacd_proc instances, returns the guacd_proc having the
- * guac_client with the given ID, or NULL if no such client is stored.
+ * Returns a pointer to the link within the given shard which points to the
+ * entry for the process having the given connection ID. If no such process
+ * is stored, the returned link is the NULL link at the end of the relevant
+ * bucket. The caller must hold at least the read lock of the shard.
+ *
+ * @param shard
+ *     The shard to search.
  *
- * @param bucket
- *     The bucket of guacd_proc instances to search, represented as a
- *     guac_common_list.
+ * @param hash
+ *     The hash code of the given connection ID, as returned by
+ *     __guacd_client_hash().
  *
  * @param id
- *     The ID of the guac_client whose corresponding guacd_proc instance should
- *     be located within the bucket.
+ *     The ID of the guac_client whose corresponding entry should be located.
  *
  * @return
- *     The guac_common_list_element containing the guacd_proc instance
- *     corresponding to the guac_client having the given ID, or NULL of no such
- *     element exists.
+ *     A pointer to the link pointing to the matching entry, or to the NULL
+ *     link terminating the relevant bucket if there is no such entry.
  */
-static guac_common_list_element* __guacd_proc_find(guac_common_list* bucket,
-        const char* id) {
+static guacd_proc_map_entry** __guacd_proc_find(guacd_proc_map_shard* shard,
+        uint64_t hash, const char* id) {
 
-    guac_common_list_element* current = bucket->head;
+    guacd_proc_map_entry** current =
+        &shard->buckets[hash & (shard->bucket_count - 1)];
 
-    /* Search for matching element within bucket */
-    while (current != NULL) {
+    /* Search for matching entry within bucket, comparing connection IDs only
+     * if the hash codes match */
+    while (*current != NULL) {
 
-        /* Check connection ID */
-        guacd_proc* proc = ((guacd_proc_map_entry*) current->data)->proc;
-        if (strcmp(proc->client->connection_id, id) == 0)
+        guacd_proc_map_entry* entry = *current;
+        if (entry->hash == hash
+                && strcmp(entry->proc->client->connection_id, id) == 0)
             break;
 
-        current = current->next;
+        current = &entry->next;
     }
 
     return current;
 
 }
 
-guacd_proc_map* guacd_proc_map_alloc(void) {
+/**
+ * Doubles the number of buckets within the given shard, redistributing all
+ * entries among the new buckets. If the new buckets cannot be allocated, the
+ * shard is left unchanged. The caller must hold the write lock of the shard.
+ *
+ * @param shard
+ *     The shard to grow.
+ */
+static void __guacd_proc_map_grow(guacd_proc_map_shard* shard) {
 
-    guacd_proc_map* map = guac_mem_alloc(sizeof(guacd_proc_map));
-    map->processes = guac_common_list_alloc();
-    guac_common_list** current;
+    size_t bucket_count = shard->bucket_count * 2;
+    guacd_proc_map_entry** buckets = guac_mem_zalloc(sizeof(guacd_proc_map_entry*),
+            bucket_count);
+
+    /* Continue with existing buckets if no memory is available */
+    if (buckets == NULL)
+        return;
 
-    int i;
+    /* Move each entry into its new bucket */
+    for (size_t i = 0; i < shard->bucket_count; i++) {
 
-    /* Init all buckets */
-    current = map->__buckets;
+        guacd_proc_map_entry* current = shard->buckets[i];
+        while (current != NULL) {
+
+            guacd_proc_map_entry* next = current->next;
+            guacd_proc_map_entry** bucket = &buckets[current->hash & (bucket_count - 1)];
+
+            current->next = *bucket;
+            *bucket = current;
+
+            current = next;
+        }
 
-    for (i=0; i<GUACD_PROC_MAP_BUCKETS; i++) {
-        *current = guac_common_list_alloc();
-        current++;
+    }
+
+    guac_mem_free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucket_count = bucket_count;
+
+}
+
+guacd_proc_map* guacd_proc_map_alloc(void) {
+
+    guacd_proc_map* map = guac_mem_alloc(sizeof(guacd_proc_map));
+
+    /* Init all shards */
+    for (int i = 0; i < GUACD_PROC_MAP_SHARDS; i++) {
+        guacd_proc_map_shard* shard = &map->__shards[i];
+        pthread_rwlock_init(&shard->lock, NULL);
+        shard->buckets = guac_mem_zalloc(sizeof(guacd_proc_map_entry*),
+                GUACD_PROC_MAP_INITIAL_BUCKETS);
+        shard->bucket_count = GUACD_PROC_MAP_INITIAL_BUCKETS;
+        shard->length = 0;
     }
 
     return map;
@@ -151,90 +211,80 @@ guacd_proc_map* guacd_proc_map_alloc(void) {
 int guacd_proc_map_add(guacd_proc_map* map, guacd_proc* proc) {
 
     const char* identifier = proc->client->connection_id;
-    guac_common_list* bucket = __guacd_proc_find_bucket(map, identifier);
-    guac_common_list_element* found;
+    uint64_t hash = __guacd_client_hash(identifier);
+    guacd_proc_map_shard* shard = __guacd_proc_find_shard(map, hash);
 
-    /* Retrieve corresponding element, if any */
-    guac_common_list_lock(bucket);
-    found = __guacd_proc_find(bucket, identifier);
+    /* Retrieve corresponding entry, if any */
+    pthread_rwlock_wrlock(&shard->lock);
+    guacd_proc_map_entry** found = __guacd_proc_find(shard, hash, identifier);
 
-    /* If no such element, we can add the new client successfully */
-    if (found == NULL) {
+    /* If no such entry, we can add the new client successfully */
+    if (*found == NULL) {
 
         guacd_proc_map_entry* entry = guac_mem_alloc(sizeof(guacd_proc_map_entry));
-
-        guac_common_list_lock(map->processes);
-        entry->element = guac_common_list_add(map->processes, proc);
-        guac_common_list_unlock(map->processes);
-
         entry->proc = proc;
+        entry->hash = hash;
+        entry->next = NULL;
+        *found = entry;
 
-        guac_common_list_add(bucket, entry);
-        guac_common_list_unlock(bucket);
+        /* Keep buckets short as the shard grows */
+        if (++shard->length > shard->bucket_count)
+            __guacd_proc_map_grow(shard);
 
+        pthread_rwlock_unlock(&shard->lock);
         return 0;
     }
 
     /* Otherwise, fail - already exists */
-    guac_common_list_unlock(bucket);
+    pthread_rwlock_unlock(&shard->lock);
     return 1;
 
 }
 
 guacd_proc* guacd_proc_map_retrieve(guacd_proc_map* map, const char* id) {
 
-    guacd_proc* proc;
-
-    guac_common_list* bucket = __guacd_proc_find_bucket(map, id);
-    guac_common_list_element* found;
+    guacd_proc* proc = NULL;
 
-    /* Retrieve corresponding element, if any */
-    guac_common_list_lock(bucket);
-    found = __guacd_proc_find(bucket, id);
+    uint64_t hash = __guacd_client_hash(id);
+    guacd_proc_map_shard* shard = __guacd_proc_find_shard(map, hash);
 
-    /* If no such element, fail */
-    if (found == NULL) {
-        guac_common_list_unlock(bucket);
-        return NULL;
-    }
+    /* Retrieve corresponding entry, if any, concurrently with any other
+     * retrievals from the same shard */
+    pthread_rwlock_rdlock(&shard->lock);
 
-    proc = ((guacd_proc_map_entry*) found->data)->proc;
+    guacd_proc_map_entry* found = *__guacd_proc_find(shard, hash, id);
+    if (found != NULL)
+        proc = found->proc;
 
-    guac_common_list_unlock(bucket);
+    pthread_rwlock_unlock(&shard->lock);
     return proc;
 
 }
 
 guacd_proc* guacd_proc_map_remove(guacd_proc_map* map, const char* id) {
 
-    guacd_proc* proc;
-
-    guac_common_list* bucket = __guacd_proc_find_bucket(map, id);
-    guac_common_list_element* found;
+    uint64_t hash = __guacd_client_hash(id);
+    guacd_proc_map_shard* shard = __guacd_proc_find_shard(map, hash);
 
-    /* Retrieve corresponding element, if any */
-    guac_common_list_lock(bucket);
-    found = __guacd_proc_find(bucket, id);
+    /* Retrieve corresponding entry, if any */
+    pthread_rwlock_wrlock(&shard->lock);
+    guacd_proc_map_entry** found = __guacd_proc_find(shard, hash, id);
 
-    /* If no such element, fail */
-    if (found == NULL) {
-        guac_common_list_unlock(bucket);
+    /* If no such entry, fail */
+    if (*found == NULL) {
+        pthread_rwlock_unlock(&shard->lock);
         return NULL;
     }
 
-    guacd_proc_map_entry* entry = (guacd_proc_map_entry*) found->data;
-
-    /* Find and remove the key from the process list */
-    guac_common_list_lock(map->processes);
-    guac_common_list_remove(map->processes, entry->element);
-    guac_common_list_unlock(map->processes);
+    /* Unlink entry from its bucket */
+    guacd_proc_map_entry* entry = *found;
+    *found = entry->next;
+    shard->length--;
 
-    proc = entry->proc;
-    guac_common_list_remove(bucket, found);
+    pthread_rwlock_unlock(&shard->lock);
 
-    free (entry);
-
-    guac_common_list_unlock(bucket);
+    guacd_proc* proc = entry->proc;
+    guac_mem_free(entry);
     return proc;
 
 }
@@ -242,30 +292,45 @@ guacd_proc* guacd_proc_map_remove(guacd_proc_map* map, const char* id) {
 void guacd_proc_map_foreach(guacd_proc_map* map,
         guacd_proc_map_foreach_callback* callback, void* data) {
 
-    guac_common_list* list = map->processes;
+    for (int i = 0; i < GUACD_PROC_MAP_SHARDS; i++) {
+
+        guacd_proc_map_shard* shard = &map->__shards[i];
+        pthread_rwlock_rdlock(&shard->lock);
 
-    guac_common_list_lock(list);
+        /* Invoke the callback for every entry in the shard */
+        for (size_t j = 0; j < shard->bucket_count; j++) {
+            guacd_proc_map_entry* current;
+            for (current = shard->buckets[j]; current != NULL; current = current->next)
+                callback(current->proc, data);
+        }
 
-    /* Invoke the callback for every element in the list */
-    guac_common_list_element* element;
-    for (element = list->head; element != NULL; element = element->next)
-        callback((guacd_proc*) element->data, data);
+        pthread_rwlock_unlock(&shard->lock);
 
-    guac_common_list_unlock(list);
+    }
 
 }
 
 void guacd_proc_map_free(guacd_proc_map* map) {
 
-    /* Free the list of all processes */
-    guac_common_list_free(map->processes, NULL);
+    /* Free each shard, including all remaining entries */
+    for (int i = 0; i < GUACD_PROC_MAP_SHARDS; i++) {
+
+        guacd_proc_map_shard* shard = &map->__shards[i];
+
+        for (size_t j = 0; j < shard->bucket_count; j++) {
+            guacd_proc_map_entry* current = shard->buckets[j];
+            while (current != NULL) {
+                guacd_proc_map_entry* next = current->next;
+                guac_mem_free(current);
+                current = next;
+            }
+        }
+
+        guac_mem_free(shard->buckets);
+        pthread_rwlock_destroy(&shard->lock);
 
-    /* Free each bucket */
-    guac_common_list** buckets = map->__buckets;
-    int i;
-    for (i = 0; i < GUACD_PROC_MAP_BUCKETS; i++) {
-        guac_common_list_free(*(buckets + i), free);
     }
 
-}
+    guac_mem_free(map);
 
+}
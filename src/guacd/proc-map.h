@@ -21,11 +21,13 @@
 #define _GUACD_PROC_MAP_H
 
 #include "config.h"
-#include "common/list.h"
 #include "proc.h"
 
 #include <guacamole/client.h>
 
+#include <pthread.h>
+#include <stddef.h>
+
 /**
  * The maximum number of concurrent connections to a single instance
  * of guacd.
@@ -38,26 +40,68 @@
 #define GUACD_THREAD_STACK_SIZE 8388608
 
 /**
- * The number of hash buckets in each process map.
+ * The number of independently-locked shards within each process map. Each
+ * connection ID is assigned to exactly one shard based on its hash code, such
+ * that operations on connections within different shards never contend for
+ * the same lock. This MUST be a power of two.
  */
-#define GUACD_PROC_MAP_BUCKETS GUACD_CLIENT_MAX_CONNECTIONS*2
+#define GUACD_PROC_MAP_SHARDS 64
 
 /**
- * Set of all active connections to guacd, indexed by connection ID.
+ * The number of hash buckets initially allocated for each shard of a process
+ * map. The number of buckets within a shard doubles whenever the shard
+ * contains more processes than buckets. This MUST be a power of two.
  */
-typedef struct guacd_proc_map {
+#define GUACD_PROC_MAP_INITIAL_BUCKETS 16
+
+/**
+ * A single process stored within a process map.
+ */
+typedef struct guacd_proc_map_entry guacd_proc_map_entry;
+
+/**
+ * A subset of the processes stored within a process map, consisting of all
+ * processes whose connection IDs hash to that subset.
+ */
+typedef struct guacd_proc_map_shard {
+
+    /**
+     * Lock which guards access to the contents of this shard. Retrieving a
+     * process requires only the read lock, such that any number of users may
+     * join connections concurrently. Adding or removing a process requires
+     * the write lock.
+     */
+    pthread_rwlock_t lock;
 
     /**
-     * Internal hash buckets. Each bucket is a linked list containing all
-     * guac_client instances which hash to this bucket location.
+     * Hash buckets, each a singly-linked list of all entries within this
+     * shard whose hash codes map to that bucket.
      */
-    guac_common_list* __buckets[GUACD_PROC_MAP_BUCKETS];
+    guacd_proc_map_entry** buckets;
+
+    /**
+     * The number of hash buckets within this shard. This is always a power
+     * of two.
+     */
+    size_t bucket_count;
+
+    /**
+     * The number of processes currently stored within this shard.
+     */
+    size_t length;
+
+} guacd_proc_map_shard;
+
+/**
+ * Set of all active connections to guacd, indexed by connection ID.
+ */
+typedef struct guacd_proc_map {
 
     /**
-     * All processes present in the map. For internal use only. To operate on these
-     * keys, use guacd_proc_map_foreach().
+     * Internal shards. For internal use only. To operate on all processes
+     * within the map, use guacd_proc_map_foreach().
      */
-    guac_common_list* processes;
+    guacd_proc_map_shard __shards[GUACD_PROC_MAP_SHARDS];
 
 } guacd_proc_map;
 
@@ -148,6 +192,8 @@ typedef void guacd_proc_map_foreach_callback(guacd_proc* proc, void* data);
 /**
  * Invoke the provided callback with any provided arbitrary data and each guacd
  * proc contained in the provided map, once each and in no particular order.
+ * Processes cannot be added to or removed from the map while the callback is
+ * being invoked for processes of the same shard.
  *
  * @param map
  *     The map from which all guacd processes should be extracted and provided
@@ -0,0 +1,369 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "conf.h"
+#include "log.h"
+#include "proc.h"
+#include "proc-pool.h"
+
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+#include <guacamole/string.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The idle processes maintained for a single protocol.
+ */
+typedef struct guacd_proc_pool {
+
+    /**
+     * The protocol that each process within this pool is initialized for.
+     */
+    char* protocol;
+
+    /**
+     * The number of idle processes that should be kept within this pool.
+     */
+    int size;
+
+    /**
+     * The number of idle processes currently within this pool.
+     */
+    int count;
+
+    /**
+     * The idle processes currently within this pool. Only the first count
+     * entries are valid.
+     */
+    guacd_proc* idle[GUACD_CONF_MAX_POOL_SIZE];
+
+    /**
+     * The time before which no further attempt should be made to add
+     * processes to this pool, as returned by time(). This is set whenever
+     * a process cannot be created or an idle process dies unexpectedly.
+     */
+    time_t retry_after;
+
+} guacd_proc_pool;
+
+/**
+ * All process pools, one per configured protocol.
+ */
+static guacd_proc_pool guacd_proc_pools[GUACD_CONF_MAX_POOLS];
+
+/**
+ * The number of valid entries within guacd_proc_pools.
+ */
+static int guacd_proc_pool_count = 0;
+
+/**
+ * Lock which guards access to all process pools.
+ */
+static pthread_mutex_t guacd_proc_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Condition which is signalled whenever a process is taken from a pool or
+ * the pools are being stopped, waking the thread which tops up the pools.
+ */
+static pthread_cond_t guacd_proc_pool_modified = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Non-zero if the pools are being stopped and must no longer be topped up.
+ */
+static int guacd_proc_pool_stopping = 0;
+
+/**
+ * The thread which tops up the process pools.
+ */
+static pthread_t guacd_proc_pool_thread;
+
+/**
+ * Non-zero if guacd_proc_pool_thread has been started.
+ */
+static int guacd_proc_pool_running = 0;
+
+/**
+ * Returns whether the given idle process is still running. As guacd ignores
+ * SIGCHLD, terminated children are reaped automatically and no longer exist
+ * at all.
+ *
+ * @param proc
+ *     The process to test.
+ *
+ * @return
+ *     Non-zero if the process is still running, zero otherwise.
+ */
+static int guacd_proc_pool_alive(guacd_proc* proc) {
+    return !(kill(proc->pid, 0) == -1 && errno == ESRCH);
+}
+
+/**
+ * Removes any idle processes of the given pool which have died, such as a
+ * process whose client plugin could not be loaded. The caller must hold
+ * guacd_proc_pool_lock.
+ *
+ * @param pool
+ *     The pool to remove dead processes from.
+ *
+ * @param dead
+ *     An array with room for at least GUACD_CONF_MAX_POOL_SIZE processes,
+ *     which will receive each removed process such that each can be freed
+ *     after guacd_proc_pool_lock is released.
+ *
+ * @return
+ *     The number of processes stored within the dead array.
+ */
+static int guacd_proc_pool_prune(guacd_proc_pool* pool, guacd_proc** dead) {
+
+    int dead_count = 0;
+
+    for (int i = 0; i < pool->count;) {
+
+        guacd_proc* proc = pool->idle[i];
+        if (guacd_proc_pool_alive(proc)) {
+            i++;
+            continue;
+        }
+
+        /* Replace dead process with last process in pool */
+        pool->idle[i] = pool->idle[--pool->count];
+        dead[dead_count++] = proc;
+
+    }
+
+    /* Back off rather than continuously replace processes that die */
+    if (dead_count > 0) {
+        guacd_log(GUAC_LOG_WARNING, "%i idle process(es) for protocol "
+                "\"%s\" terminated unexpectedly. The pool will not be "
+                "refilled for %i seconds.", dead_count, pool->protocol,
+                GUACD_PROC_POOL_RETRY_DELAY);
+        pool->retry_after = time(NULL) + GUACD_PROC_POOL_RETRY_DELAY;
+    }
+
+    return dead_count;
+
+}
+
+/**
+ * Thread which tops up all process pools, periodically removing any idle
+ * processes which have died and forking new processes to replace those taken
+ * or removed.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_proc_pool_refill_thread(void* data) {
+
+    guacd_proc* dead[GUACD_CONF_MAX_POOL_SIZE];
+
+    pthread_mutex_lock(&guacd_proc_pool_lock);
+    while (!guacd_proc_pool_stopping) {
+
+        int added = 0;
+
+        for (int i = 0; i < guacd_proc_pool_count
+                && !guacd_proc_pool_stopping; i++) {
+
+            guacd_proc_pool* pool = &guacd_proc_pools[i];
+
+            /* Free any idle processes that have died */
+            int dead_count = guacd_proc_pool_prune(pool, dead);
+            if (dead_count > 0) {
+                pthread_mutex_unlock(&guacd_proc_pool_lock);
+                for (int j = 0; j < dead_count; j++)
+                    guacd_proc_free(dead[j]);
+                pthread_mutex_lock(&guacd_proc_pool_lock);
+            }
+
+            if (pool->count >= pool->size || time(NULL) < pool->retry_after)
+                continue;
+
+            /* Fork a new process without blocking connections that are
+             * taking processes from the pools */
+            pthread_mutex_unlock(&guacd_proc_pool_lock);
+            guacd_proc* proc = guacd_create_proc(pool->protocol);
+            pthread_mutex_lock(&guacd_proc_pool_lock);
+
+            if (proc == NULL) {
+                guacd_log(GUAC_LOG_WARNING, "Unable to create idle process "
+                        "for protocol \"%s\". The pool will not be refilled "
+                        "for %i seconds.", pool->protocol,
+                        GUACD_PROC_POOL_RETRY_DELAY);
+                pool->retry_after = time(NULL) + GUACD_PROC_POOL_RETRY_DELAY;
+                continue;
+            }
+
+            /* Discard the new process if it is no longer needed */
+            if (guacd_proc_pool_stopping || pool->count >= pool->size) {
+                pthread_mutex_unlock(&guacd_proc_pool_lock);
+                guacd_proc_free(proc);
+                pthread_mutex_lock(&guacd_proc_pool_lock);
+                continue;
+            }
+
+            pool->idle[pool->count++] = proc;
+            added = 1;
+
+        }
+
+        /* Continue filling immediately if any pool may still be short */
+        if (added)
+            continue;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += GUACD_PROC_POOL_INTERVAL / 1000;
+        deadline.tv_nsec += (GUACD_PROC_POOL_INTERVAL % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_cond_timedwait(&guacd_proc_pool_modified,
+                &guacd_proc_pool_lock, &deadline);
+
+    }
+    pthread_mutex_unlock(&guacd_proc_pool_lock);
+
+    return NULL;
+
+}
+
+void guacd_proc_pool_start(guacd_config_pool* pools, int count) {
+
+    pthread_mutex_lock(&guacd_proc_pool_lock);
+
+    /* Copy all non-empty pools */
+    for (int i = 0; i < count && guacd_proc_pool_count < GUACD_CONF_MAX_POOLS; i++) {
+
+        if (pools[i].size <= 0)
+            continue;
+
+        guacd_proc_pool* pool = &guacd_proc_pools[guacd_proc_pool_count++];
+        pool->protocol = guac_strdup(pools[i].protocol);
+        pool->size = pools[i].size;
+        pool->count = 0;
+        pool->retry_after = 0;
+
+        guacd_log(GUAC_LOG_INFO, "Keeping %i idle process(es) available for "
+                "protocol \"%s\".", pool->size, pool->protocol);
+
+    }
+
+    /* Start topping up pools only if there are pools to fill */
+    if (guacd_proc_pool_count > 0 && !guacd_proc_pool_running) {
+        if (pthread_create(&guacd_proc_pool_thread, NULL,
+                    guacd_proc_pool_refill_thread, NULL))
+            guacd_log(GUAC_LOG_ERROR, "Unable to start thread for process "
+                    "pools. Processes will be created only as connections "
+                    "require them.");
+        else
+            guacd_proc_pool_running = 1;
+    }
+
+    pthread_mutex_unlock(&guacd_proc_pool_lock);
+
+}
+
+guacd_proc* guacd_proc_pool_take(const char* protocol) {
+
+    guacd_proc* proc = NULL;
+
+    pthread_mutex_lock(&guacd_proc_pool_lock);
+
+    for (int i = 0; i < guacd_proc_pool_count; i++) {
+
+        guacd_proc_pool* pool = &guacd_proc_pools[i];
+        if (strcmp(pool->protocol, protocol) != 0)
+            continue;
+
+        /* Take the most recently created process that is still running,
+         * leaving any dead processes to be cleaned up by the refill thread */
+        for (int j = pool->count - 1; j >= 0; j--) {
+            if (guacd_proc_pool_alive(pool->idle[j])) {
+                proc = pool->idle[j];
+                pool->idle[j] = pool->idle[--pool->count];
+                break;
+            }
+        }
+
+        break;
+
+    }
+
+    /* Wake refill thread to replace the process taken */
+    if (proc != NULL)
+        pthread_cond_signal(&guacd_proc_pool_modified);
+
+    pthread_mutex_unlock(&guacd_proc_pool_lock);
+
+    return proc;
+
+}
+
+void guacd_proc_pool_stop(void) {
+
+    guacd_proc* idle[GUACD_CONF_MAX_POOL_SIZE];
+
+    /* Stop topping up the pools */
+    pthread_mutex_lock(&guacd_proc_pool_lock);
+    guacd_proc_pool_stopping = 1;
+    pthread_cond_signal(&guacd_proc_pool_modified);
+    pthread_mutex_unlock(&guacd_proc_pool_lock);
+
+    if (guacd_proc_pool_running) {
+        pthread_join(guacd_proc_pool_thread, NULL);
+        guacd_proc_pool_running = 0;
+    }
+
+    /* Terminate all remaining idle processes */
+    pthread_mutex_lock(&guacd_proc_pool_lock);
+    for (int i = 0; i < guacd_proc_pool_count; i++) {
+
+        guacd_proc_pool* pool = &guacd_proc_pools[i];
+
+        int count = pool->count;
+        memcpy(idle, pool->idle, count * sizeof(guacd_proc*));
+        pool->count = 0;
+
+        pthread_mutex_unlock(&guacd_proc_pool_lock);
+        for (int j = 0; j < count; j++)
+            guacd_proc_free(idle[j]);
+        pthread_mutex_lock(&guacd_proc_pool_lock);
+
+        guac_mem_free(pool->protocol);
+
+    }
+    guacd_proc_pool_count = 0;
+    pthread_mutex_unlock(&guacd_proc_pool_lock);
+
+}
+
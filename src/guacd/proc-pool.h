@@ -0,0 +1,82 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_PROC_POOL_H
+#define GUACD_PROC_POOL_H
+
+#include "config.h"
+#include "conf.h"
+#include "proc.h"
+
+/**
+ * The number of milliseconds between each check of the process pools for
+ * idle processes which have died or which need to be replaced.
+ */
+#define GUACD_PROC_POOL_INTERVAL 1000
+
+/**
+ * The number of seconds to wait before again attempting to fill the pool of
+ * a protocol whose idle processes could not be created or died unexpectedly,
+ * such that a protocol whose plugin cannot be loaded does not result in
+ * processes being forked continuously.
+ */
+#define GUACD_PROC_POOL_RETRY_DELAY 60
+
+/**
+ * Begins maintaining pools of idle connection processes for each of the given
+ * protocols. Each idle process is forked and initialized for its protocol,
+ * including loading the client plugin, before any connection requires it,
+ * and waits to receive its first user. As idle processes are taken from a
+ * pool, the pool is topped up in the background by a dedicated thread. This
+ * function has no effect if no pools are given or every pool has a size of
+ * zero.
+ *
+ * @param pools
+ *     The pools to maintain. The contents of this array are copied and need
+ *     not remain valid after this function returns.
+ *
+ * @param count
+ *     The number of entries in the pools array.
+ */
+void guacd_proc_pool_start(guacd_config_pool* pools, int count);
+
+/**
+ * Removes and returns an idle process from the pool of the given protocol,
+ * if such a process is available. The returned process is entirely owned by
+ * the caller, exactly as if it had been returned by guacd_create_proc(), and
+ * will be replaced within the pool in the background.
+ *
+ * @param protocol
+ *     The protocol that the returned process must be initialized for.
+ *
+ * @return
+ *     An idle process initialized for the given protocol, or NULL if the
+ *     protocol has no pool or its pool is currently empty, in which case a
+ *     new process must be created with guacd_create_proc().
+ */
+guacd_proc* guacd_proc_pool_take(const char* protocol);
+
+/**
+ * Stops topping up all process pools and terminates any idle processes that
+ * remain. Processes already taken from a pool are unaffected.
+ */
+void guacd_proc_pool_stop(void);
+
+#endif
+
@@ -22,9 +22,11 @@
 #include "log.h"
 #include "move-fd.h"
 #include "proc.h"
+#include "proc-limits.h"
 #include "proc-map.h"
 
 #include <guacamole/client.h>
+#include <guacamole/encoder.h>
 #include <guacamole/error.h>
 #include <guacamole/mem.h>
 #include <guacamole/parser.h>
@@ -33,6 +35,10 @@
 #include <guacamole/socket.h>
 #include <guacamole/user.h>
 
+#ifdef ENABLE_URING
+#include <guacamole/socket-uring.h>
+#endif
+
 #include <errno.h>
 #include <pthread.h>
 #include <signal.h>
@@ -66,6 +72,13 @@ typedef struct guacd_user_thread_params {
 
 } guacd_user_thread_params;
 
+/**
+ * The maximum number of bytes per second to send to each user of the current
+ * connection process, or zero if bandwidth is unlimited. This is set within
+ * the connection process by guacd_exec_proc().
+ */
+static size_t guacd_proc_bandwidth_limit = 0;
+
 /**
  * Handles a user's entire connection and socket lifecycle.
  *
@@ -84,16 +97,37 @@ static void* guacd_user_thread(void* data) {
     guacd_proc* proc = params->proc;
     guac_client* client = proc->client;
 
-    /* Get guac_socket for user's file descriptor */
-    guac_socket* socket = guac_socket_open(params->fd);
+    guac_socket* socket = NULL;
+
+#ifdef ENABLE_URING
+    /* Perform all I/O for the user through io_uring where supported, unless
+     * output must be throttled (only possible for guac_socket_open()) */
+    if (guacd_proc_bandwidth_limit == 0) {
+        socket = guac_socket_open_uring(params->fd, guacd_output_buffer_size);
+        if (socket == NULL)
+            guacd_log_guac_error(GUAC_LOG_DEBUG, "Unable to use io_uring for "
+                    "user connection");
+    }
+#endif
+
+    /* Otherwise, get guac_socket for user's file descriptor */
+    if (socket == NULL)
+        socket = guac_socket_open_buffered(params->fd,
+                guacd_output_buffer_size);
+
     if (socket == NULL)
         return NULL;
 
+    /* Throttle output to each user, if requested */
+    if (guacd_proc_bandwidth_limit > 0)
+        guac_socket_limit_bandwidth(socket, guacd_proc_bandwidth_limit);
+
     /* Create skeleton user */
     guac_user* user = guac_user_alloc();
     user->socket = socket;
     user->client = client;
     user->owner  = params->owner;
+    user->max_instruction_length = guacd_max_instruction_length;
 
     /* Handle user connection from handshake until disconnect/completion */
     guac_user_handle_connection(user, GUACD_USEC_TIMEOUT);
@@ -288,6 +322,12 @@ static int guacd_timed_client_free(guac_client* client, int timeout) {
     return !free_operation.completed;
 }
 
+char* guacd_encoder_backend = NULL;
+
+size_t guacd_output_buffer_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+
+int guacd_max_instruction_length = GUAC_INSTRUCTION_MAX_LENGTH;
+
 /**
  * A reference to the current guacd process.
  */
@@ -333,6 +373,27 @@ static void guacd_exec_proc(guacd_proc* proc, const char* protocol) {
         goto cleanup_process;
     }
 
+    /* Restrict this process to its assigned CPUs before any threads are
+     * created, such that thread pools (like those of guac_display) are sized
+     * to match */
+    guacd_placement_apply(&proc->placement);
+
+    /* Likewise apply any CPU and memory limits, noting the bandwidth limit
+     * for future users */
+    guacd_proc_bandwidth_limit = guacd_proc_limits_apply(protocol,
+            proc->client->connection_id);
+
+    /* Load any configured encoder backend within this process only, as
+     * hardware encoder contexts cannot safely be shared across fork() */
+    if (guacd_encoder_backend != NULL) {
+        if (guac_encoder_load(guacd_encoder_backend))
+            guacd_log_guac_error(GUAC_LOG_WARNING, "Unable to load encoder "
+                    "backend. Images will be encoded in software");
+        else
+            guacd_log(GUAC_LOG_DEBUG, "Using encoder backend \"%s\".",
+                    guacd_encoder_backend);
+    }
+
     /* Init client for selected protocol */
     guac_client* client = proc->client;
     if (guac_client_load_plugin(client, protocol)) {
@@ -354,6 +415,9 @@ static void guacd_exec_proc(guacd_proc* proc, const char* protocol) {
     /* Enable keep alive on the broadcast socket */
     guac_socket_require_keep_alive(client->socket);
 
+    /* Publish metrics for this process, if tracked */
+    guacd_metrics_start_sampling(proc->metrics, client);
+
     guacd_proc_self = proc;
 
     /* Clean up and exit if SIGINT or SIGTERM signals are caught */
@@ -377,6 +441,9 @@ cleanup_client:
     /* Request client to stop/disconnect */
     guac_client_stop(client);
 
+    /* Metrics can no longer be read from the client once freed */
+    guacd_metrics_stop_sampling();
+
     /* Attempt to free client cleanly */
     guacd_log(GUAC_LOG_DEBUG, "Requesting termination of client...");
     result = guacd_timed_client_free(client, GUACD_CLIENT_FREE_TIMEOUT);
@@ -409,6 +476,7 @@ cleanup_client:
 cleanup_process:
 
     /* Free up all internal resources outside the client */
+    guac_encoder_unload();
     close(proc->fd_socket);
     guac_mem_free(proc);
 
@@ -450,12 +518,20 @@ guacd_proc* guacd_create_proc(const char* protocol) {
     /* Init logging */
     proc->client->log_handler = guacd_client_log;
 
+    /* Track metrics for the new process, if enabled */
+    proc->metrics = guacd_metrics_claim(proc->client->connection_id, protocol);
+
+    /* Assign CPUs to the new process, if requested */
+    guacd_placement_assign(&proc->placement);
+
     /* Fork */
     proc->pid = fork();
     if (proc->pid < 0) {
         guacd_log(GUAC_LOG_ERROR, "Cannot fork child process: %s", strerror(errno));
         close(parent_socket);
         close(child_socket);
+        guacd_metrics_release(proc->metrics);
+        guacd_placement_release(&proc->placement);
         guac_client_free(proc->client);
         guac_mem_free(proc);
         return NULL;
@@ -480,6 +556,8 @@ guacd_proc* guacd_create_proc(const char* protocol) {
         proc->fd_socket = child_socket;
         close(parent_socket);
 
+        guacd_metrics_set_pid(proc->metrics, proc->pid);
+
     }
 
     return proc;
@@ -536,3 +614,21 @@ void guacd_proc_stop(guacd_proc* proc) {
     close(proc->fd_socket);
 
 }
+
+void guacd_proc_free(guacd_proc* proc) {
+
+    /* Force process to stop and clean up */
+    guacd_proc_stop(proc);
+    guacd_metrics_release(proc->metrics);
+    guacd_placement_release(&proc->placement);
+    guacd_proc_limits_release(proc->client->connection_id);
+
+    /* Free skeleton client */
+    guac_client_free(proc->client);
+
+    /* Clean up */
+    close(proc->fd_socket);
+    guac_mem_free(proc->share_key);
+    guac_mem_free(proc);
+
+}
@@ -21,6 +21,8 @@
 #define GUACD_PROC_H
 
 #include "config.h"
+#include "metrics.h"
+#include "placement.h"
 
 #include <guacamole/client.h>
 #include <guacamole/parser.h>
@@ -78,8 +80,50 @@ typedef struct guacd_proc {
      */
     guac_client* client;
 
+    /**
+     * The metrics session tracking this process, or NULL if this process is
+     * not tracked. This is assigned by the parent prior to creating the
+     * process, such that both parent and child refer to the same session.
+     * See guacd_metrics_claim().
+     */
+    guacd_metrics_session* metrics;
+
+    /**
+     * The CPUs assigned to this process. This is assigned by the parent
+     * prior to creating the process and applied by the child. See
+     * guacd_placement_assign().
+     */
+    guacd_placement placement;
+
+    /**
+     * A key which uniquely identifies the parameters of the connection
+     * handled by this process, if identical connections may share this
+     * process (see guacd_share_handshake_key()), or NULL otherwise.
+     */
+    char* share_key;
+
 } guacd_proc;
 
+/**
+ * The name of the encoder backend that each connection process should load
+ * before initializing its client, or NULL if all image encoding should be
+ * performed in software. See guac_encoder_load().
+ */
+extern char* guacd_encoder_backend;
+
+/**
+ * The size of the output buffer to allocate for the socket of each user of a
+ * connection process, in bytes. See guac_socket_open_buffered().
+ */
+extern size_t guacd_output_buffer_size;
+
+/**
+ * The maximum number of characters to accept within any one element of the
+ * instructions received from each user of a connection process. See
+ * guac_parser_set_max_length().
+ */
+extern int guacd_max_instruction_length;
+
 /**
  * Creates a new background process for handling the given protocol, returning
  * a structure allowing communication with and monitoring of the process
@@ -105,5 +149,14 @@ guacd_proc* guacd_create_proc(const char* protocol);
  */
 void guacd_proc_stop(guacd_proc* proc);
 
+/**
+ * Stops the given process, waiting for it to terminate, and frees all
+ * associated resources. This function must be called by the parent process.
+ *
+ * @param proc
+ *     The process to stop and free.
+ */
+void guacd_proc_free(guacd_proc* proc);
+
 #endif
 
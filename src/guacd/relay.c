@@ -0,0 +1,533 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "metrics.h"
+#include "relay.h"
+
+#ifdef GUACD_RELAY_SUPPORTED
+
+#include <guacamole/mem.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef struct guacd_relay guacd_relay;
+
+/**
+ * A single direction of a relayed connection, with data read from one file
+ * descriptor being held within a pipe until it can be written to the other.
+ */
+typedef struct guacd_relay_pipe {
+
+    /**
+     * The file descriptor that data is read from.
+     */
+    int src;
+
+    /**
+     * The file descriptor that data is written to.
+     */
+    int dst;
+
+    /**
+     * The read and write ends of the pipe holding data in transit from src
+     * to dst, in that order.
+     */
+    int fds[2];
+
+    /**
+     * The number of bytes currently held within the pipe.
+     */
+    size_t pending;
+
+    /**
+     * Non-zero if the end of src has been reached, zero otherwise.
+     */
+    int eof;
+
+    /**
+     * The metrics session of the connection-specific process, or NULL if
+     * that process is not tracked.
+     */
+    guacd_metrics_session* metrics;
+
+    /**
+     * The counter within metrics that receives the number of bytes
+     * delivered to dst. This is ignored if metrics is NULL.
+     */
+    uint64_t* transferred;
+
+} guacd_relay_pipe;
+
+/**
+ * One of the two file descriptors of a relayed connection, as registered
+ * with epoll.
+ */
+typedef struct guacd_relay_endpoint {
+
+    /**
+     * The relayed connection that this file descriptor belongs to.
+     */
+    guacd_relay* relay;
+
+    /**
+     * The file descriptor of this endpoint.
+     */
+    int fd;
+
+    /**
+     * The epoll events currently requested for this file descriptor.
+     */
+    uint32_t events;
+
+    /**
+     * The direction of the relay which reads from this file descriptor.
+     */
+    guacd_relay_pipe* in;
+
+    /**
+     * The direction of the relay which writes to this file descriptor.
+     */
+    guacd_relay_pipe* out;
+
+} guacd_relay_endpoint;
+
+/**
+ * A connection being relayed in both directions between a user's connection
+ * to guacd and the connection-specific process.
+ */
+struct guacd_relay {
+
+    /**
+     * The file descriptor of the user's connection to guacd.
+     */
+    guacd_relay_endpoint user;
+
+    /**
+     * The file descriptor handled by the connection-specific process.
+     */
+    guacd_relay_endpoint proc;
+
+    /**
+     * Data received from the user and awaiting delivery to the process.
+     */
+    guacd_relay_pipe to_proc;
+
+    /**
+     * Data received from the process and awaiting delivery to the user.
+     */
+    guacd_relay_pipe to_user;
+
+    /**
+     * Non-zero if relaying has ended and all file descriptors have been
+     * closed, zero otherwise.
+     */
+    int closed;
+
+    /**
+     * The next relay which was closed while handling the same batch of epoll
+     * events, and which must be freed once that batch is complete.
+     */
+    guacd_relay* next_closed;
+
+};
+
+/**
+ * Guards the one-time initialization of the relay thread.
+ */
+static pthread_once_t guacd_relay_once = PTHREAD_ONCE_INIT;
+
+/**
+ * The epoll file descriptor of the relay thread, or -1 if the relay thread
+ * could not be started.
+ */
+static int guacd_relay_epoll_fd = -1;
+
+/**
+ * Transfers as much data as possible through the given direction of a
+ * relayed connection, without blocking.
+ *
+ * @param pipe
+ *     The guacd_relay_pipe to transfer data through.
+ *
+ * @return
+ *     Non-zero if relaying in this direction has ended, either because all
+ *     data has been delivered after the end of the source was reached or
+ *     because an error occurred, zero otherwise.
+ */
+static int guacd_relay_pump(guacd_relay_pipe* pipe) {
+
+    int progress;
+    do {
+
+        progress = 0;
+
+        /* Deliver anything already in transit */
+        if (pipe->pending > 0) {
+
+            ssize_t written = splice(pipe->fds[0], NULL, pipe->dst, NULL,
+                    pipe->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+            if (written > 0) {
+                pipe->pending -= written;
+                guacd_metrics_add(pipe->metrics, pipe->transferred, written);
+                progress = 1;
+            }
+            else if (written == 0 || (errno != EAGAIN && errno != EINTR))
+                return 1;
+
+        }
+
+        /* Read further data if there is room */
+        if (!pipe->eof && pipe->pending < GUACD_RELAY_PIPE_SIZE) {
+
+            ssize_t received = splice(pipe->src, NULL, pipe->fds[1], NULL,
+                    GUACD_RELAY_PIPE_SIZE - pipe->pending,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+            if (received > 0) {
+                pipe->pending += received;
+                progress = 1;
+            }
+            else if (received == 0)
+                pipe->eof = 1;
+            else if (errno != EAGAIN && errno != EINTR)
+                return 1;
+
+        }
+
+    } while (progress);
+
+    return pipe->eof && pipe->pending == 0;
+
+}
+
+/**
+ * Updates the epoll events requested for the given endpoint, such that the
+ * relay thread is woken only when data can be read from the endpoint and
+ * there is room to hold it, or when data is waiting to be written to the
+ * endpoint and it may be possible to write it.
+ *
+ * @param endpoint
+ *     The guacd_relay_endpoint to update.
+ */
+static void guacd_relay_update(guacd_relay_endpoint* endpoint) {
+
+    uint32_t events = 0;
+
+    if (!endpoint->in->eof && endpoint->in->pending < GUACD_RELAY_PIPE_SIZE)
+        events |= EPOLLIN;
+
+    if (endpoint->out->pending > 0)
+        events |= EPOLLOUT;
+
+    if (events == endpoint->events)
+        return;
+
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = endpoint
+    };
+
+    if (epoll_ctl(guacd_relay_epoll_fd, EPOLL_CTL_MOD, endpoint->fd, &event))
+        guacd_log(GUAC_LOG_DEBUG, "Unable to update relayed connection: %s",
+                strerror(errno));
+    else
+        endpoint->events = events;
+
+}
+
+/**
+ * Closes all file descriptors of the given relayed connection, marking the
+ * relay as closed. The relay itself is not freed, as further events for the
+ * relay may remain within the batch currently being handled by the relay
+ * thread.
+ *
+ * @param relay
+ *     The guacd_relay to close.
+ */
+static void guacd_relay_close(guacd_relay* relay) {
+
+    epoll_ctl(guacd_relay_epoll_fd, EPOLL_CTL_DEL, relay->user.fd, NULL);
+    epoll_ctl(guacd_relay_epoll_fd, EPOLL_CTL_DEL, relay->proc.fd, NULL);
+
+    close(relay->user.fd);
+    close(relay->proc.fd);
+
+    close(relay->to_proc.fds[0]);
+    close(relay->to_proc.fds[1]);
+    close(relay->to_user.fds[0]);
+    close(relay->to_user.fds[1]);
+
+    relay->closed = 1;
+
+}
+
+/**
+ * The start routine of the thread shared by all relayed connections,
+ * transferring data for each connection as its file descriptors become
+ * ready.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_relay_thread(void* data) {
+
+    struct epoll_event events[GUACD_RELAY_MAX_EVENTS];
+
+    for (;;) {
+
+        int count = epoll_wait(guacd_relay_epoll_fd, events,
+                GUACD_RELAY_MAX_EVENTS, -1);
+
+        if (count < 0) {
+
+            if (errno == EINTR)
+                continue;
+
+            guacd_log(GUAC_LOG_ERROR, "Relaying of connections has failed: "
+                    "%s", strerror(errno));
+            break;
+
+        }
+
+        guacd_relay* closed = NULL;
+
+        for (int i = 0; i < count; i++) {
+
+            guacd_relay_endpoint* endpoint =
+                (guacd_relay_endpoint*) events[i].data.ptr;
+
+            guacd_relay* relay = endpoint->relay;
+            if (relay->closed)
+                continue;
+
+            /* The connection ends once either direction ends, as the other
+             * direction can then no longer be meaningfully used */
+            if (guacd_relay_pump(&relay->to_proc)
+                    || guacd_relay_pump(&relay->to_user)) {
+                guacd_relay_close(relay);
+                relay->next_closed = closed;
+                closed = relay;
+                continue;
+            }
+
+            guacd_relay_update(&relay->user);
+            guacd_relay_update(&relay->proc);
+
+        }
+
+        /* Free relays only once no events may still refer to them */
+        while (closed != NULL) {
+            guacd_relay* next = closed->next_closed;
+            guac_mem_free(closed);
+            closed = next;
+        }
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Creates the epoll file descriptor and starts the relay thread. If either
+ * cannot be created, guacd_relay_epoll_fd is left as -1.
+ */
+static void guacd_relay_init(void) {
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to relay connections using "
+                "epoll: %s", strerror(errno));
+        return;
+    }
+
+    guacd_relay_epoll_fd = epoll_fd;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, guacd_relay_thread, NULL)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to start thread for relaying "
+                "connections.");
+        close(epoll_fd);
+        guacd_relay_epoll_fd = -1;
+        return;
+    }
+
+    pthread_detach(thread);
+
+}
+
+/**
+ * Sets or clears the O_NONBLOCK flag of the given file descriptor.
+ *
+ * @param fd
+ *     The file descriptor to modify.
+ *
+ * @param nonblocking
+ *     Non-zero to set O_NONBLOCK, zero to clear it.
+ *
+ * @return
+ *     Zero on success, non-zero if an error occurs.
+ */
+static int guacd_relay_set_nonblocking(int fd, int nonblocking) {
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+        return 1;
+
+    if (nonblocking)
+        flags |= O_NONBLOCK;
+    else
+        flags &= ~O_NONBLOCK;
+
+    return fcntl(fd, F_SETFL, flags) < 0;
+
+}
+
+/**
+ * Initializes the given direction of a relayed connection, creating the pipe
+ * which will hold data in transit.
+ *
+ * @param pipe
+ *     The guacd_relay_pipe to initialize.
+ *
+ * @param src
+ *     The file descriptor that data should be read from.
+ *
+ * @param dst
+ *     The file descriptor that data should be written to.
+ *
+ * @return
+ *     Zero on success, non-zero if the pipe could not be created.
+ */
+static int guacd_relay_pipe_init(guacd_relay_pipe* pipe, int src, int dst) {
+
+    if (pipe2(pipe->fds, O_CLOEXEC | O_NONBLOCK))
+        return 1;
+
+#ifdef F_SETPIPE_SZ
+    /* Request at least enough room for the data tracked as pending (this is
+     * only an optimization; failure simply means splice() will stop early) */
+    fcntl(pipe->fds[1], F_SETPIPE_SZ, GUACD_RELAY_PIPE_SIZE);
+#endif
+
+    pipe->src = src;
+    pipe->dst = dst;
+    pipe->pending = 0;
+    pipe->eof = 0;
+
+    return 0;
+
+}
+
+int guacd_relay_add(int user_fd, int proc_fd,
+        guacd_metrics_session* metrics) {
+
+    pthread_once(&guacd_relay_once, guacd_relay_init);
+    if (guacd_relay_epoll_fd < 0)
+        return 1;
+
+    guacd_relay* relay = guac_mem_zalloc(sizeof(guacd_relay));
+
+    if (guacd_relay_pipe_init(&relay->to_proc, user_fd, proc_fd))
+        goto fail_to_proc;
+
+    if (guacd_relay_pipe_init(&relay->to_user, proc_fd, user_fd))
+        goto fail_to_user;
+
+    /* Count all data relayed in each direction */
+    relay->to_proc.metrics = relay->to_user.metrics = metrics;
+    if (metrics != NULL) {
+        relay->to_proc.transferred = &metrics->bytes_received;
+        relay->to_user.transferred = &metrics->bytes_sent;
+    }
+
+    relay->user.relay = relay;
+    relay->user.fd = user_fd;
+    relay->user.events = EPOLLIN;
+    relay->user.in = &relay->to_proc;
+    relay->user.out = &relay->to_user;
+
+    relay->proc.relay = relay;
+    relay->proc.fd = proc_fd;
+    relay->proc.events = EPOLLIN;
+    relay->proc.in = &relay->to_user;
+    relay->proc.out = &relay->to_proc;
+
+    if (guacd_relay_set_nonblocking(user_fd, 1)
+            || guacd_relay_set_nonblocking(proc_fd, 1))
+        goto fail_register;
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &relay->user };
+    if (epoll_ctl(guacd_relay_epoll_fd, EPOLL_CTL_ADD, user_fd, &event))
+        goto fail_register;
+
+    /* Once the first file descriptor is registered, the relay belongs to the
+     * relay thread. If the second cannot be registered, the user's connection
+     * is shut down such that the relay thread cleans up both. */
+    event.data.ptr = &relay->proc;
+    if (epoll_ctl(guacd_relay_epoll_fd, EPOLL_CTL_ADD, proc_fd, &event)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to relay connection: %s",
+                strerror(errno));
+        shutdown(user_fd, SHUT_RDWR);
+    }
+
+    return 0;
+
+fail_register:
+    guacd_relay_set_nonblocking(user_fd, 0);
+    guacd_relay_set_nonblocking(proc_fd, 0);
+    close(relay->to_user.fds[0]);
+    close(relay->to_user.fds[1]);
+
+fail_to_user:
+    close(relay->to_proc.fds[0]);
+    close(relay->to_proc.fds[1]);
+
+fail_to_proc:
+    guac_mem_free(relay);
+    return 1;
+
+}
+
+#else
+
+int guacd_relay_add(int user_fd, int proc_fd,
+        guacd_metrics_session* metrics) {
+
+    /* Relaying without dedicated threads requires epoll and splice() */
+    return 1;
+
+}
+
+#endif
+
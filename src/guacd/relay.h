@@ -0,0 +1,77 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_RELAY_H
+#define GUACD_RELAY_H
+
+#include "config.h"
+#include "metrics.h"
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SPLICE)
+/**
+ * Defined if connections can be relayed by the shared relay thread using
+ * epoll and splice(). If not defined, guacd_relay_add() always fails.
+ */
+#define GUACD_RELAY_SUPPORTED
+#endif
+
+/**
+ * The maximum number of bytes that may be held in transit within the kernel
+ * for each direction of a relayed connection.
+ */
+#define GUACD_RELAY_PIPE_SIZE 65536
+
+/**
+ * The maximum number of epoll events handled by the relay thread in a single
+ * pass.
+ */
+#define GUACD_RELAY_MAX_EVENTS 64
+
+/**
+ * Begins relaying all data between the given pair of file descriptors in
+ * both directions, until either end is closed or an error occurs. Rather than
+ * using dedicated threads for each connection, all relayed connections are
+ * multiplexed on a single thread shared by the entire guacd process, with
+ * data transferred between the file descriptors with splice() such that it
+ * never needs to be copied through user space. Once the relay is started,
+ * both file descriptors are owned by the relay and will be closed
+ * automatically when relaying ends.
+ *
+ * @param user_fd
+ *     The file descriptor of the connection of the user to guacd.
+ *
+ * @param proc_fd
+ *     The file descriptor which is being handled by a guac_socket within the
+ *     connection-specific process.
+ *
+ * @param metrics
+ *     The metrics session of the connection-specific process, which will
+ *     receive counts of all bytes relayed in each direction, or NULL if that
+ *     process is not tracked.
+ *
+ * @return
+ *     Zero if relaying has started, non-zero if the connection cannot be
+ *     relayed in this manner, in which case neither file descriptor has been
+ *     closed and both remain owned by the caller.
+ */
+int guacd_relay_add(int user_fd, int proc_fd,
+        guacd_metrics_session* metrics);
+
+#endif
+
@@ -0,0 +1,462 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "log.h"
+#include "proc.h"
+#include "share.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+#include <guacamole/string.h>
+#include <guacamole/unicode.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The sharing mode of a single protocol.
+ */
+typedef struct guacd_share_protocol {
+
+    /**
+     * The name of the protocol, such as "vnc".
+     */
+    char* protocol;
+
+    /**
+     * How identical connections using the protocol should be handled.
+     */
+    guacd_share_mode mode;
+
+} guacd_share_protocol;
+
+/**
+ * The sharing modes of all protocols that have sharing configured. Only the
+ * first guacd_share_protocol_count entries are valid.
+ */
+static guacd_share_protocol guacd_share_protocols[GUACD_SHARE_MAX_PROTOCOLS];
+
+/**
+ * The number of valid entries within guacd_share_protocols.
+ */
+static int guacd_share_protocol_count = 0;
+
+int guacd_share_set_mode(const char* protocol, guacd_share_mode mode) {
+
+    /* Update the mode of the protocol if already configured */
+    for (int i = 0; i < guacd_share_protocol_count; i++) {
+        if (strcmp(guacd_share_protocols[i].protocol, protocol) == 0) {
+            guacd_share_protocols[i].mode = mode;
+            return 0;
+        }
+    }
+
+    if (guacd_share_protocol_count >= GUACD_SHARE_MAX_PROTOCOLS)
+        return 1;
+
+    guacd_share_protocol* entry = &guacd_share_protocols[guacd_share_protocol_count++];
+    entry->protocol = guac_strdup(protocol);
+    entry->mode = mode;
+    return 0;
+
+}
+
+guacd_share_mode guacd_share_get_mode(const char* protocol) {
+
+    for (int i = 0; i < guacd_share_protocol_count; i++) {
+        if (strcmp(guacd_share_protocols[i].protocol, protocol) == 0)
+            return guacd_share_protocols[i].mode;
+    }
+
+    return GUACD_SHARE_NONE;
+
+}
+
+/**
+ * Appends the given data to the end of the given buffer, growing that buffer
+ * as necessary.
+ *
+ * @param buffer
+ *     A pointer to the buffer to append to, which may point to NULL if no
+ *     buffer has yet been allocated.
+ *
+ * @param length
+ *     A pointer to the number of bytes currently within the buffer.
+ *
+ * @param size
+ *     A pointer to the number of bytes allocated for the buffer.
+ *
+ * @param data
+ *     The data to append.
+ *
+ * @param data_length
+ *     The number of bytes of data to append.
+ */
+static void guacd_share_append(char** buffer, size_t* length, size_t* size,
+        const char* data, size_t data_length) {
+
+    size_t required = guac_mem_ckd_add_or_die(*length, data_length);
+    if (required > *size) {
+        *size = guac_mem_ckd_mul_or_die(required, 2);
+        *buffer = guac_mem_realloc_or_die(*buffer, *size);
+    }
+
+    memcpy(*buffer + *length, data, data_length);
+    *length = required;
+
+}
+
+/**
+ * Appends the given instruction to the end of the given buffer, serialized
+ * according to the Guacamole protocol.
+ *
+ * @param buffer
+ *     A pointer to the buffer to append to, which may point to NULL if no
+ *     buffer has yet been allocated.
+ *
+ * @param length
+ *     A pointer to the number of bytes currently within the buffer.
+ *
+ * @param size
+ *     A pointer to the number of bytes allocated for the buffer.
+ *
+ * @param opcode
+ *     The opcode of the instruction.
+ *
+ * @param argc
+ *     The number of arguments of the instruction.
+ *
+ * @param argv
+ *     The arguments of the instruction.
+ */
+static void guacd_share_append_instruction(char** buffer, size_t* length,
+        size_t* size, const char* opcode, int argc, char** argv) {
+
+    for (int i = -1; i < argc; i++) {
+
+        const char* value = (i < 0) ? opcode : argv[i];
+
+        /* Element lengths are in Unicode characters, not bytes */
+        char prefix[32];
+        int prefix_length = snprintf(prefix, sizeof(prefix), "%zu.",
+                guac_utf8_strlen(value));
+
+        guacd_share_append(buffer, length, size, prefix, prefix_length);
+        guacd_share_append(buffer, length, size, value, strlen(value));
+        guacd_share_append(buffer, length, size, (i + 1 < argc) ? "," : ";", 1);
+
+    }
+
+}
+
+/**
+ * Writes the entire contents of the given buffer to the given file
+ * descriptor, retrying as necessary.
+ *
+ * @param fd
+ *     The file descriptor to write to.
+ *
+ * @param buffer
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes to write.
+ *
+ * @return
+ *     Zero if all data was written, non-zero if an error occurred.
+ */
+static int guacd_share_write_all(int fd, const char* buffer, size_t length) {
+
+    while (length > 0) {
+
+        ssize_t written = write(fd, buffer, length);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+
+        buffer += written;
+        length -= written;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Reads the "args" instruction sent by a connection process at the start of
+ * a user's handshake.
+ *
+ * @param fd
+ *     The file descriptor of guacd's end of the user's connection to the
+ *     connection process. This file descriptor remains open.
+ *
+ * @param callback
+ *     The function to invoke with the parser once the "args" instruction has
+ *     been read.
+ *
+ * @param data
+ *     Arbitrary data to pass to the callback.
+ *
+ * @return
+ *     Zero if the "args" instruction was read and the callback succeeded,
+ *     non-zero otherwise.
+ */
+static int guacd_share_read_args(int fd,
+        int callback(guac_parser* parser, void* data), void* data) {
+
+    int args_fd = dup(fd);
+    if (args_fd < 0)
+        return 1;
+
+    guac_socket* socket = guac_socket_open(args_fd);
+    guac_parser* parser = guac_parser_alloc();
+
+    int result = 1;
+    if (guac_parser_expect(parser, socket, GUACD_USEC_TIMEOUT, "args"))
+        guacd_log_guac_error(GUAC_LOG_DEBUG, "Error reading \"args\" from "
+                "connection process");
+
+    /* The connection process sends nothing else until the user responds */
+    else if (guac_parser_length(parser) > 0)
+        guacd_log(GUAC_LOG_DEBUG, "Unexpected data following \"args\" from "
+                "connection process");
+
+    else
+        result = callback(parser, data);
+
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+    return result;
+
+}
+
+/**
+ * The data required by guacd_share_relay_args().
+ */
+typedef struct guacd_share_relay_args_data {
+
+    /**
+     * The handshake that should receive the argument names.
+     */
+    guacd_share_handshake* handshake;
+
+    /**
+     * The socket of the user's connection to guacd.
+     */
+    guac_socket* socket;
+
+} guacd_share_relay_args_data;
+
+/**
+ * Callback for guacd_share_read_args() which stores the argument names of
+ * the "args" instruction within a guacd_share_handshake and relays that
+ * instruction to the user.
+ *
+ * @param parser
+ *     The parser containing the "args" instruction.
+ *
+ * @param data
+ *     A pointer to a guacd_share_relay_args_data structure.
+ *
+ * @return
+ *     Zero if the "args" instruction was relayed successfully, non-zero
+ *     otherwise.
+ */
+static int guacd_share_relay_args(guac_parser* parser, void* data) {
+
+    guacd_share_relay_args_data* relay = (guacd_share_relay_args_data*) data;
+    guacd_share_handshake* handshake = relay->handshake;
+
+    /* The first argument is the protocol version, not an argument name */
+    if (parser->argc < 1)
+        return 1;
+
+    handshake->arg_count = parser->argc - 1;
+    handshake->arg_names = guac_mem_alloc(sizeof(char*), handshake->arg_count);
+    for (int i = 0; i < handshake->arg_count; i++)
+        handshake->arg_names[i] = guac_strdup(parser->argv[i + 1]);
+
+    char* buffer = NULL;
+    size_t length = 0;
+    size_t size = 0;
+    guacd_share_append_instruction(&buffer, &length, &size,
+            parser->opcode, parser->argc, parser->argv);
+
+    int result = guac_socket_write(relay->socket, buffer, length)
+        || guac_socket_flush(relay->socket);
+
+    guac_mem_free(buffer);
+    return result;
+
+}
+
+/**
+ * Callback for guacd_share_read_args() which verifies that the argument
+ * names of the "args" instruction are identical to those within a
+ * guacd_share_handshake.
+ *
+ * @param parser
+ *     The parser containing the "args" instruction.
+ *
+ * @param data
+ *     A pointer to the guacd_share_handshake to compare against.
+ *
+ * @return
+ *     Zero if the argument names are identical, non-zero otherwise.
+ */
+static int guacd_share_compare_args(guac_parser* parser, void* data) {
+
+    guacd_share_handshake* handshake = (guacd_share_handshake*) data;
+
+    if (parser->argc - 1 != handshake->arg_count)
+        return 1;
+
+    for (int i = 0; i < handshake->arg_count; i++) {
+        if (strcmp(parser->argv[i + 1], handshake->arg_names[i]) != 0)
+            return 1;
+    }
+
+    return 0;
+
+}
+
+int guacd_share_handshake_read(guacd_share_handshake* handshake,
+        guac_parser* parser, guac_socket* socket, int fd) {
+
+    *handshake = (guacd_share_handshake) { 0 };
+
+    /* Relay the "args" of the connection process to the user, noting the
+     * names of all arguments */
+    guacd_share_relay_args_data relay = {
+        .handshake = handshake,
+        .socket = socket
+    };
+
+    if (guacd_share_read_args(fd, guacd_share_relay_args, &relay))
+        return 1;
+
+    /* Read (but do not yet forward) everything up to "connect" */
+    for (;;) {
+
+        if (guac_parser_read(parser, socket, GUACD_USEC_TIMEOUT)) {
+            guacd_log_handshake_failure();
+            guacd_log_guac_error(GUAC_LOG_DEBUG, "Error reading handshake");
+            return 1;
+        }
+
+        if (strcmp(parser->opcode, "connect") == 0)
+            break;
+
+        guacd_share_append_instruction(&handshake->instructions,
+                &handshake->length, &handshake->size,
+                parser->opcode, parser->argc, parser->argv);
+
+    }
+
+    handshake->connect_argc = parser->argc;
+    handshake->connect_argv = guac_mem_alloc(sizeof(char*), parser->argc);
+    for (int i = 0; i < parser->argc; i++)
+        handshake->connect_argv[i] = guac_strdup(parser->argv[i]);
+
+    return 0;
+
+}
+
+char* guacd_share_handshake_key(const char* protocol,
+        const guacd_share_handshake* handshake) {
+
+    char* key = NULL;
+    size_t length = 0;
+    size_t size = 0;
+
+    /* The key is simply the serialized connection parameters, excluding the
+     * protocol version of the user, beneath an opcode of the protocol name */
+    int argc = handshake->connect_argc > 0 ? handshake->connect_argc - 1 : 0;
+    guacd_share_append_instruction(&key, &length, &size, protocol,
+            argc, handshake->connect_argv + (handshake->connect_argc - argc));
+
+    guacd_share_append(&key, &length, &size, "", 1);
+    return key;
+
+}
+
+int guacd_share_handshake_replay(const guacd_share_handshake* handshake,
+        int fd, int expect_args, int read_only) {
+
+    /* The "args" of any other process have already been answered on behalf
+     * of the user, but must match those the user actually answered */
+    if (expect_args && guacd_share_read_args(fd, guacd_share_compare_args,
+                (void*) handshake)) {
+        guacd_log(GUAC_LOG_DEBUG, "Arguments of existing connection do not "
+                "match those of new connection");
+        return 1;
+    }
+
+    char* buffer = NULL;
+    size_t length = 0;
+    size_t size = 0;
+
+    if (handshake->length > 0)
+        guacd_share_append(&buffer, &length, &size,
+                handshake->instructions, handshake->length);
+
+    /* Force the "read-only" parameter if requested, leaving all other
+     * parameters exactly as received */
+    char** argv = guac_mem_alloc(sizeof(char*), handshake->connect_argc);
+    for (int i = 0; i < handshake->connect_argc; i++) {
+        argv[i] = handshake->connect_argv[i];
+        if (read_only && i > 0 && i - 1 < handshake->arg_count
+                && strcmp(handshake->arg_names[i - 1], "read-only") == 0)
+            argv[i] = (char*) "true";
+    }
+
+    guacd_share_append_instruction(&buffer, &length, &size, "connect",
+            handshake->connect_argc, argv);
+
+    int result = guacd_share_write_all(fd, buffer, length);
+
+    guac_mem_free(argv);
+    guac_mem_free(buffer);
+    return result;
+
+}
+
+void guacd_share_handshake_destroy(guacd_share_handshake* handshake) {
+
+    for (int i = 0; i < handshake->arg_count; i++)
+        guac_mem_free(handshake->arg_names[i]);
+
+    for (int i = 0; i < handshake->connect_argc; i++)
+        guac_mem_free(handshake->connect_argv[i]);
+
+    guac_mem_free(handshake->arg_names);
+    guac_mem_free(handshake->connect_argv);
+    guac_mem_free(handshake->instructions);
+
+}
+
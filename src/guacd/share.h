@@ -0,0 +1,226 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACD_SHARE_H
+#define GUACD_SHARE_H
+
+#include "config.h"
+
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+#include <stddef.h>
+
+/**
+ * The maximum number of protocols which may have upstream sharing enabled.
+ */
+#define GUACD_SHARE_MAX_PROTOCOLS 16
+
+/**
+ * How new connections that are identical to an existing connection should be
+ * handled.
+ */
+typedef enum guacd_share_mode {
+
+    /**
+     * Every connection has its own process and its own connection to the
+     * remote desktop server, even if identical to another connection.
+     */
+    GUACD_SHARE_NONE,
+
+    /**
+     * New connections that are identical to an existing connection join that
+     * connection as read-only users.
+     */
+    GUACD_SHARE_VIEW_ONLY,
+
+    /**
+     * New connections that are identical to an existing connection join that
+     * connection as full participants, able to interact with the remote
+     * desktop just as the original user can.
+     */
+    GUACD_SHARE_TAKEOVER
+
+} guacd_share_mode;
+
+/**
+ * The portion of a user's handshake that guacd reads on behalf of the
+ * connection process, before that process is chosen, such that connections
+ * which are identical to existing connections can be recognized.
+ */
+typedef struct guacd_share_handshake {
+
+    /**
+     * The names of all arguments accepted by the protocol, in the order
+     * given by the "args" instruction of the connection process, excluding
+     * the protocol version.
+     */
+    char** arg_names;
+
+    /**
+     * The number of entries in arg_names.
+     */
+    int arg_count;
+
+    /**
+     * Every instruction received from the user prior to "connect", serialized
+     * exactly as they should be sent to the connection process.
+     */
+    char* instructions;
+
+    /**
+     * The number of bytes of instructions.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for instructions.
+     */
+    size_t size;
+
+    /**
+     * The arguments of the "connect" instruction received from the user,
+     * starting with the protocol version of the user.
+     */
+    char** connect_argv;
+
+    /**
+     * The number of entries in connect_argv.
+     */
+    int connect_argc;
+
+} guacd_share_handshake;
+
+/**
+ * Sets how new connections using the given protocol should be handled if
+ * identical to an existing connection. This function is not threadsafe and
+ * must be called only while guacd is starting, before any connections are
+ * accepted.
+ *
+ * @param protocol
+ *     The name of the protocol, such as "vnc".
+ *
+ * @param mode
+ *     How identical connections using the protocol should be handled.
+ *
+ * @return
+ *     Zero if the mode was set successfully, non-zero if too many protocols
+ *     have sharing enabled.
+ */
+int guacd_share_set_mode(const char* protocol, guacd_share_mode mode);
+
+/**
+ * Returns how new connections using the given protocol should be handled if
+ * identical to an existing connection.
+ *
+ * @param protocol
+ *     The name of the protocol, such as "vnc".
+ *
+ * @return
+ *     How identical connections using the given protocol should be handled.
+ */
+guacd_share_mode guacd_share_get_mode(const char* protocol);
+
+/**
+ * Reads the handshake of a new user up to and including the "connect"
+ * instruction, relaying the "args" instruction of the given connection
+ * process to the user. Nothing read from the user is sent to the connection
+ * process, allowing the resulting handshake to instead be replayed to
+ * whichever process should ultimately handle the connection.
+ *
+ * @param handshake
+ *     The handshake structure to populate. This must eventually be freed
+ *     with guacd_share_handshake_destroy(), even if reading fails.
+ *
+ * @param parser
+ *     The parser that has been used to read the "select" instruction from
+ *     the user.
+ *
+ * @param socket
+ *     The socket of the user's connection to guacd.
+ *
+ * @param fd
+ *     The file descriptor of guacd's end of the user's connection to the
+ *     connection process.
+ *
+ * @return
+ *     Zero if the handshake was read successfully, non-zero otherwise.
+ */
+int guacd_share_handshake_read(guacd_share_handshake* handshake,
+        guac_parser* parser, guac_socket* socket, int fd);
+
+/**
+ * Returns a newly-allocated string which is identical for any two handshakes
+ * of the given protocol that would establish identical connections. Only
+ * handshakes having exactly the same connection parameters (including any
+ * credentials) produce the same key, such that sharing an existing connection
+ * never grants access that the user could not have obtained otherwise.
+ *
+ * @param protocol
+ *     The name of the protocol of the connection.
+ *
+ * @param handshake
+ *     The handshake read with guacd_share_handshake_read().
+ *
+ * @return
+ *     A newly-allocated key that must eventually be freed with
+ *     guac_mem_free().
+ */
+char* guacd_share_handshake_key(const char* protocol,
+        const guacd_share_handshake* handshake);
+
+/**
+ * Replays the given handshake to the connection process having the given
+ * file descriptor. If the process is not the one whose "args" instruction was
+ * relayed to the user, the "args" instruction of that process is read and
+ * discarded first.
+ *
+ * @param handshake
+ *     The handshake read with guacd_share_handshake_read().
+ *
+ * @param fd
+ *     The file descriptor of guacd's end of the user's connection to the
+ *     connection process.
+ *
+ * @param expect_args
+ *     Non-zero if the "args" instruction of the connection process has not
+ *     yet been read and must be discarded, zero otherwise.
+ *
+ * @param read_only
+ *     Non-zero if the "read-only" parameter of the connection should be
+ *     forced to "true", zero if all parameters should be sent as received.
+ *
+ * @return
+ *     Zero if the handshake was replayed successfully, non-zero otherwise.
+ */
+int guacd_share_handshake_replay(const guacd_share_handshake* handshake,
+        int fd, int expect_args, int read_only);
+
+/**
+ * Frees all memory associated with the given handshake. The handshake
+ * structure itself is not freed.
+ *
+ * @param handshake
+ *     The handshake to destroy.
+ */
+void guacd_share_handshake_destroy(guacd_share_handshake* handshake);
+
+#endif
+
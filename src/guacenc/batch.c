@@ -0,0 +1,438 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "batch.h"
+#include "encode.h"
+#include "log.h"
+
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+#include <guacamole/recording.h>
+#include <guacamole/string.h>
+#include <guacamole/timestamp.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+guacenc_batch* guacenc_batch_alloc(const char* codec,
+        guacenc_video_hwaccel hwaccel, int width, int height, int bitrate,
+        int start, int end, bool force, bool follow, int thumbnails) {
+
+    guacenc_batch* batch = guac_mem_zalloc(sizeof(guacenc_batch));
+    batch->codec = codec;
+    batch->hwaccel = hwaccel;
+    batch->width = width;
+    batch->height = height;
+    batch->bitrate = bitrate;
+    batch->start = start;
+    batch->end = end;
+    batch->force = force;
+    batch->follow = follow;
+    batch->thumbnails = thumbnails;
+
+    batch->size = GUACENC_BATCH_INITIAL_SIZE;
+    batch->paths = guac_mem_alloc(sizeof(char*), batch->size);
+
+    pthread_mutex_init(&batch->lock, NULL);
+
+    return batch;
+
+}
+
+void guacenc_batch_free(guacenc_batch* batch) {
+
+    if (batch == NULL)
+        return;
+
+    for (int i = 0; i < batch->count; i++)
+        guac_mem_free(batch->paths[i]);
+
+    pthread_mutex_destroy(&batch->lock);
+    guac_mem_free(batch->paths);
+    guac_mem_free(batch);
+
+}
+
+/**
+ * Adds the given path to the given batch as a single recording, expanding
+ * the batch as necessary.
+ *
+ * @param batch
+ *     The batch to add the recording to.
+ *
+ * @param path
+ *     The path of the recording to add. This path is copied and need not
+ *     remain valid after this function returns.
+ */
+static void guacenc_batch_add_file(guacenc_batch* batch, const char* path) {
+
+    /* Double the available space whenever space runs out */
+    if (batch->count == batch->size) {
+        batch->size = guac_mem_ckd_mul_or_die(batch->size, 2);
+        batch->paths = guac_mem_realloc_or_die(batch->paths,
+                sizeof(char*), batch->size);
+    }
+
+    batch->paths[batch->count++] = guac_strdup(path);
+
+}
+
+/**
+ * Comparator for qsort() which orders recording paths lexically.
+ *
+ * @param a
+ *     A pointer to the first path being compared.
+ *
+ * @param b
+ *     A pointer to the second path being compared.
+ *
+ * @return
+ *     A negative value, zero, or a positive value if the first path sorts
+ *     before, the same as, or after the second path, respectively.
+ */
+static int guacenc_batch_compare_paths(const void* a, const void* b) {
+    return strcmp(*((char* const*) a), *((char* const*) b));
+}
+
+/**
+ * Adds each regular file within the given directory to the given batch,
+ * excluding hidden files and any previously-written output. Recordings are
+ * added in lexical order.
+ *
+ * @param batch
+ *     The batch to add the recordings to.
+ *
+ * @param path
+ *     The path of the directory containing the recordings.
+ *
+ * @param dir
+ *     The directory stream of the directory at the given path.
+ */
+static void guacenc_batch_add_directory(guacenc_batch* batch,
+        const char* path, DIR* dir) {
+
+    int first = batch->count;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+
+        /* Skip hidden files, including "." and ".." */
+        const char* name = entry->d_name;
+        if (name[0] == '.')
+            continue;
+
+        /* Skip the output of any previous encoding */
+        size_t length = strlen(name);
+        if (length >= 4 && (strcmp(name + length - 4, ".m4v") == 0
+                    || strcmp(name + length - 4, ".mp4") == 0
+                    || strcmp(name + length - 4, ".png") == 0))
+            continue;
+
+        /* Skip input event sidecars, which contain no graphics */
+        size_t suffix_length = strlen(GUAC_RECORDING_EVENTS_SUFFIX);
+        if (length >= suffix_length && strcmp(name + length - suffix_length,
+                    GUAC_RECORDING_EVENTS_SUFFIX) == 0)
+            continue;
+
+        char file_path[4096];
+        const char* elements[] = { path, "/", name };
+        if (guac_strljoin(file_path, elements, 3, "",
+                    sizeof(file_path)) >= sizeof(file_path)) {
+            guacenc_log(GUAC_LOG_WARNING, "Skipping \"%s\" within \"%s\": "
+                    "Name too long", name, path);
+            continue;
+        }
+
+        /* Only regular files can be recordings */
+        struct stat file_stat;
+        if (stat(file_path, &file_stat) || !S_ISREG(file_stat.st_mode))
+            continue;
+
+        guacenc_batch_add_file(batch, file_path);
+
+    }
+
+    qsort(batch->paths + first, batch->count - first, sizeof(char*),
+            guacenc_batch_compare_paths);
+
+}
+
+int guacenc_batch_add(guacenc_batch* batch, const char* path) {
+
+    /* Add regular files (or anything that is not a directory) as-is, leaving
+     * any errors to be reported when encoding is attempted */
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+
+        if (errno == ENOTDIR || errno == ENOENT) {
+            guacenc_batch_add_file(batch, path);
+            return 0;
+        }
+
+        guacenc_log(GUAC_LOG_ERROR, "%s: %s", path, strerror(errno));
+        return 1;
+
+    }
+
+    guacenc_batch_add_directory(batch, path, dir);
+    closedir(dir);
+    return 0;
+
+}
+
+int guacenc_batch_add_list(guacenc_batch* batch, const char* list_path) {
+
+    /* Read list from STDIN if requested */
+    FILE* list = stdin;
+    if (strcmp(list_path, "-") != 0) {
+        list = fopen(list_path, "r");
+        if (list == NULL) {
+            guacenc_log(GUAC_LOG_ERROR, "%s: %s", list_path, strerror(errno));
+            return 1;
+        }
+    }
+
+    int result = 0;
+
+    char path[4096];
+    while (fgets(path, sizeof(path), list) != NULL) {
+
+        /* Strip trailing line ending */
+        path[strcspn(path, "\r\n")] = '\0';
+
+        /* Ignore blank lines */
+        if (path[0] == '\0')
+            continue;
+
+        if (guacenc_batch_add(batch, path))
+            result = 1;
+
+    }
+
+    if (list != stdin)
+        fclose(list);
+
+    return result;
+
+}
+
+/**
+ * Acquires a read lock on the recording open at the given file descriptor,
+ * ensuring the recording is not still being written. The lock is held until
+ * the file descriptor is closed.
+ *
+ * @param fd
+ *     The file descriptor of the open recording.
+ *
+ * @param path
+ *     The path of the open recording (for logging purposes).
+ *
+ * @return
+ *     Zero if the lock was acquired, non-zero if the recording is in
+ *     progress or cannot be locked.
+ */
+static int guacenc_batch_lock(int fd, const char* path) {
+
+    /* Lock entire input file for reading by the current process */
+    struct flock file_lock = {
+        .l_type   = F_RDLCK,
+        .l_whence = SEEK_SET,
+        .l_start  = 0,
+        .l_len    = 0,
+        .l_pid    = getpid()
+    };
+
+    if (fcntl(fd, F_SETLK, &file_lock) == 0)
+        return 0;
+
+    /* Warn if lock cannot be acquired */
+    if (errno == EACCES || errno == EAGAIN)
+        guacenc_log(GUAC_LOG_WARNING, "Refusing to encode in-progress "
+                "recording \"%s\" (specify the -f option to override "
+                "this behavior).", path);
+
+    /* Log an error if locking fails in an unexpected way */
+    else
+        guacenc_log(GUAC_LOG_ERROR, "Cannot lock \"%s\" for reading: %s",
+                path, strerror(errno));
+
+    return 1;
+
+}
+
+/**
+ * Encodes the recording at the given path using the options of the given
+ * batch, logging the time taken and throughput achieved.
+ *
+ * @param batch
+ *     The batch containing the recording.
+ *
+ * @param path
+ *     The path of the recording to encode.
+ *
+ * @return
+ *     Zero if the recording was encoded successfully, non-zero otherwise.
+ */
+static int guacenc_batch_encode(guacenc_batch* batch, const char* path) {
+
+    /* Generate output filename (hardware backends produce H.264 and followed
+     * recordings produce fragmented video, both of which require a container
+     * rather than a raw MPEG-4 video stream) */
+    char out_path[4096];
+    int len = snprintf(out_path, sizeof(out_path), "%s%s", path,
+            batch->hwaccel != GUACENC_VIDEO_HWACCEL_NONE || batch->follow
+            ? ".mp4" : ".m4v");
+
+    /* Do not write if filename exceeds maximum length */
+    if (len >= sizeof(out_path)) {
+        guacenc_log(GUAC_LOG_ERROR, "Cannot write output file for \"%s\": "
+                "Name too long", path);
+        return 1;
+    }
+
+    /* Open input file */
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        guacenc_log(GUAC_LOG_ERROR, "%s: %s", path, strerror(errno));
+        return 1;
+    }
+
+    /* Skip in-progress recordings unless explicitly forced or followed */
+    if (!batch->force && !batch->follow && guacenc_batch_lock(fd, path)) {
+        close(fd);
+        return 1;
+    }
+
+    guac_timestamp started = guac_timestamp_current();
+
+    /* Attempt encoding (the file descriptor is closed by guacenc_encode()) */
+    if (guacenc_encode(fd, path, out_path, batch->codec, batch->hwaccel,
+                batch->width, batch->height, batch->bitrate, batch->start,
+                batch->end, batch->follow, batch->thumbnails))
+        return 1;
+
+    /* Note input size for sake of reporting throughput (a followed recording
+     * may have grown while it was being encoded) */
+    struct stat file_stat;
+    off_t size = stat(path, &file_stat) ? 0 : file_stat.st_size;
+
+    /* Avoid division by zero for trivially short encodings */
+    guac_timestamp elapsed = guac_timestamp_current() - started;
+    if (elapsed <= 0)
+        elapsed = 1;
+
+    guacenc_log(GUAC_LOG_INFO, "Encoded \"%s\" (%jd bytes) in %.2f "
+            "seconds (%.2f MiB/s).", path, (intmax_t) size, elapsed / 1000.0,
+            (size / 1048576.0) / (elapsed / 1000.0));
+
+    return 0;
+
+}
+
+/**
+ * Worker thread which repeatedly claims and encodes the next unclaimed
+ * recording of a batch until no recordings remain.
+ *
+ * @param data
+ *     The guacenc_batch containing the recordings to encode.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacenc_batch_worker(void* data) {
+
+    guacenc_batch* batch = (guacenc_batch*) data;
+
+    for (;;) {
+
+        /* Claim next recording, if any */
+        pthread_mutex_lock(&batch->lock);
+        if (batch->next >= batch->count) {
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+        const char* path = batch->paths[batch->next++];
+        pthread_mutex_unlock(&batch->lock);
+
+        /* Log granular success/failure at debug level */
+        if (guacenc_batch_encode(batch, path)) {
+
+            pthread_mutex_lock(&batch->lock);
+            batch->failures++;
+            pthread_mutex_unlock(&batch->lock);
+
+            guacenc_log(GUAC_LOG_DEBUG,
+                    "%s was NOT successfully encoded.", path);
+
+        }
+        else
+            guacenc_log(GUAC_LOG_DEBUG, "%s was successfully encoded.", path);
+
+    }
+
+    return NULL;
+
+}
+
+int guacenc_batch_run(guacenc_batch* batch, int workers) {
+
+    /* There is no benefit to more workers than recordings */
+    if (workers > batch->count)
+        workers = batch->count;
+
+    /* The current thread always acts as one of the workers, thus only the
+     * remainder need be created */
+    int created = 0;
+    pthread_t* threads = NULL;
+    if (workers > 1) {
+
+        threads = guac_mem_alloc(sizeof(pthread_t), workers - 1);
+        for (created = 0; created < workers - 1; created++) {
+            if (pthread_create(&threads[created], NULL,
+                        guacenc_batch_worker, batch)) {
+                guacenc_log(GUAC_LOG_WARNING, "Only %i of %i worker threads "
+                        "could be started.", created + 1, workers);
+                break;
+            }
+        }
+
+    }
+
+    guacenc_batch_worker(batch);
+
+    /* Wait for all other workers to finish */
+    for (int i = 0; i < created; i++)
+        pthread_join(threads[i], NULL);
+
+    guac_mem_free(threads);
+    return batch->failures;
+
+}
+
@@ -0,0 +1,258 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_BATCH_H
+#define GUACENC_BATCH_H
+
+#include "config.h"
+#include "video.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/**
+ * The number of recordings for which space is initially allocated within a
+ * guacenc_batch. Space for additional recordings is allocated as needed.
+ */
+#define GUACENC_BATCH_INITIAL_SIZE 64
+
+/**
+ * A set of recordings to be encoded by a pool of worker threads, along with
+ * the options common to the encoding of all those recordings.
+ */
+typedef struct guacenc_batch {
+
+    /**
+     * The name of the codec to use for all video encodings, as defined by
+     * ffmpeg / libavcodec.
+     */
+    const char* codec;
+
+    /**
+     * The hardware encoding backend to use for all video encodings, or
+     * GUACENC_VIDEO_HWACCEL_NONE to encode in software.
+     */
+    guacenc_video_hwaccel hwaccel;
+
+    /**
+     * The width of all desired videos, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of all desired videos, in pixels.
+     */
+    int height;
+
+    /**
+     * The desired overall bitrate of all encoded videos, in bits per second.
+     */
+    int bitrate;
+
+    /**
+     * The number of milliseconds into each recording at which encoding should
+     * begin.
+     */
+    int start;
+
+    /**
+     * The number of milliseconds into each recording at which encoding should
+     * end, or a negative value to encode until the end of each recording.
+     */
+    int end;
+
+    /**
+     * Whether recordings that appear to be in progress (have an associated
+     * lock) should be encoded regardless.
+     */
+    bool force;
+
+    /**
+     * Whether each recording should be followed as it is written, continuing
+     * to encode newly-written data until the recording is no longer in
+     * progress. Followed recordings are written as fragmented MP4 (".mp4").
+     */
+    bool follow;
+
+    /**
+     * The number of milliseconds between each thumbnail if thumbnails should
+     * be written in place of video, zero if a thumbnail should be written for
+     * every frame, or a negative value if video should be encoded.
+     */
+    int thumbnails;
+
+    /**
+     * The paths of all recordings within this batch. Each path is owned by
+     * the batch and is freed when the batch is freed.
+     */
+    char** paths;
+
+    /**
+     * The number of recordings within this batch.
+     */
+    int count;
+
+    /**
+     * The number of entries for which space is currently allocated within
+     * the paths array.
+     */
+    int size;
+
+    /**
+     * The index of the next recording to be claimed by a worker thread.
+     */
+    int next;
+
+    /**
+     * The number of recordings which could not be encoded, including any
+     * recordings skipped because they are still in progress.
+     */
+    int failures;
+
+    /**
+     * Lock which must be acquired while claiming a recording or updating the
+     * number of failures.
+     */
+    pthread_mutex_t lock;
+
+} guacenc_batch;
+
+/**
+ * Allocates a new, empty batch of recordings that will be encoded using the
+ * given options.
+ *
+ * @param codec
+ *     The name of the codec to use for all video encodings, as defined by
+ *     ffmpeg / libavcodec. If a hardware encoding backend is requested, this
+ *     codec is used only if that backend cannot be used.
+ *
+ * @param hwaccel
+ *     The hardware encoding backend to use for all video encodings, or
+ *     GUACENC_VIDEO_HWACCEL_NONE to encode in software. Videos encoded with a
+ *     hardware backend are written to MP4 files (".mp4") rather than raw
+ *     MPEG-4 video files (".m4v"), as each backend encodes H.264.
+ *
+ * @param width
+ *     The width of all desired videos, in pixels.
+ *
+ * @param height
+ *     The height of all desired videos, in pixels.
+ *
+ * @param bitrate
+ *     The desired overall bitrate of all encoded videos, in bits per second.
+ *
+ * @param start
+ *     The number of milliseconds into each recording at which encoding should
+ *     begin.
+ *
+ * @param end
+ *     The number of milliseconds into each recording at which encoding should
+ *     end, or a negative value to encode until the end of each recording.
+ *
+ * @param force
+ *     Whether recordings that appear to be in progress (have an associated
+ *     lock) should be encoded regardless.
+ *
+ * @param follow
+ *     Whether each recording should be followed as it is written, continuing
+ *     to encode newly-written data until the recording is no longer in
+ *     progress. Followed recordings are written as fragmented MP4 files
+ *     (".mp4") that can be played while they are still being encoded.
+ *
+ * @param thumbnails
+ *     The number of milliseconds between each thumbnail if thumbnails should
+ *     be written in place of video, zero if a thumbnail should be written for
+ *     every frame, or a negative value if video should be encoded.
+ *
+ * @return
+ *     A newly-allocated, empty batch, which must eventually be freed with
+ *     guacenc_batch_free().
+ */
+guacenc_batch* guacenc_batch_alloc(const char* codec,
+        guacenc_video_hwaccel hwaccel, int width, int height, int bitrate,
+        int start, int end, bool force, bool follow, int thumbnails);
+
+/**
+ * Adds the recording at the given path to the given batch. If the path refers
+ * to a directory, each regular file within that directory is added instead,
+ * excluding any previously-written output (files ending in ".m4v", ".mp4",
+ * or ".png") and any input event sidecars (files ending in ".events").
+ *
+ * @param batch
+ *     The batch to add the recording(s) to.
+ *
+ * @param path
+ *     The path of the recording or directory of recordings to add.
+ *
+ * @return
+ *     Zero if the recording(s) were added successfully, non-zero if the
+ *     given directory could not be read.
+ */
+int guacenc_batch_add(guacenc_batch* batch, const char* path);
+
+/**
+ * Adds each recording listed within the given file to the given batch, as if
+ * by guacenc_batch_add(). The file must contain one path per line. Blank
+ * lines are ignored.
+ *
+ * @param batch
+ *     The batch to add the recordings to.
+ *
+ * @param list_path
+ *     The path of the file listing the recordings to add, or "-" to read the
+ *     list from standard input.
+ *
+ * @return
+ *     Zero if all listed recordings were added successfully, non-zero if the
+ *     list or any listed directory could not be read.
+ */
+int guacenc_batch_add_list(guacenc_batch* batch, const char* list_path);
+
+/**
+ * Encodes all recordings within the given batch using the given number of
+ * worker threads, returning only after all recordings have been processed.
+ * Each worker claims one recording at a time, acquiring a read lock on that
+ * recording to ensure that in-progress recordings are skipped (unless the
+ * batch was allocated with force or follow set to true), and logs the time taken and
+ * throughput achieved once that recording has been encoded.
+ *
+ * @param batch
+ *     The batch of recordings to encode.
+ *
+ * @param workers
+ *     The maximum number of recordings to encode concurrently. If there are
+ *     fewer recordings than workers, only one worker thread is created per
+ *     recording.
+ *
+ * @return
+ *     The number of recordings that could not be encoded.
+ */
+int guacenc_batch_run(guacenc_batch* batch, int workers);
+
+/**
+ * Frees all memory associated with the given batch. If the given batch is
+ * NULL, this function has no effect.
+ *
+ * @param batch
+ *     The batch to free, which may be NULL.
+ */
+void guacenc_batch_free(guacenc_batch* batch);
+
+#endif
+
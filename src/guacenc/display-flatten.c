@@ -21,6 +21,7 @@
 #include "display.h"
 #include "layer.h"
 #include "log.h"
+#include "profile.h"
 
 #include <cairo/cairo.h>
 #include <guacamole/client.h>
@@ -29,18 +30,12 @@
 #include <stdlib.h>
 #include <string.h>
 
-/**
- * The Guacamole video encoder display related to the current qsort()
- * operation. As qsort() does not provide a means of passing arbitrary data to
- * the comparator, this value must be set prior to invoking qsort() with
- * guacenc_display_layer_comparator.
- */
-guacenc_display* __qsort_display;
-
 /**
  * Comparator which orders layer pointers such that (1) NULL pointers are last,
  * (2) layers with the same parent_index are adjacent, and (3) layers with the
- * same parent_index are ordered by Z.
+ * same parent_index are ordered by Z. The depth of each layer must have been
+ * calculated prior to invoking qsort() with this comparator, as qsort() does
+ * not provide a means of passing the display to the comparator.
  *
  * @see qsort()
  */
@@ -64,10 +59,8 @@ static int guacenc_display_layer_comparator(const void* a, const void* b) {
         return -1;
 
     /* Order such that the deepest layers are first */
-    int a_depth = guacenc_display_get_depth(__qsort_display, layer_a);
-    int b_depth = guacenc_display_get_depth(__qsort_display, layer_b);
-    if (b_depth != a_depth)
-        return b_depth - a_depth;
+    if (layer_b->depth != layer_a->depth)
+        return layer_b->depth - layer_a->depth;
 
     /* Order such that sibling layers are adjacent */
     if (layer_b->parent_index != layer_a->parent_index)
@@ -125,13 +118,22 @@ static int guacenc_display_render_cursor(guacenc_display* display) {
 int guacenc_display_flatten(guacenc_display* display) {
 
     int i;
+    uint64_t start = guacenc_profile_start();
     guacenc_layer* render_order[GUACENC_DISPLAY_MAX_LAYERS];
 
     /* Copy list of layers within display */
     memcpy(render_order, display->layers, sizeof(render_order));
 
+    /* Calculate the depth of each layer for the sake of sorting (the display
+     * cannot be shared through a global, as several displays may be
+     * flattened concurrently) */
+    for (i = 0; i < GUACENC_DISPLAY_MAX_LAYERS; i++) {
+        guacenc_layer* layer = render_order[i];
+        if (layer != NULL)
+            layer->depth = guacenc_display_get_depth(display, layer);
+    }
+
     /* Sort layers by depth, parent, and Z */
-    __qsort_display = display;
     qsort(render_order, GUACENC_DISPLAY_MAX_LAYERS, sizeof(guacenc_layer*),
             guacenc_display_layer_comparator);
 
@@ -199,7 +201,10 @@ int guacenc_display_flatten(guacenc_display* display) {
     }
 
     /* Render cursor on top of everything else */
-    return guacenc_display_render_cursor(display);
+    int result = guacenc_display_render_cursor(display);
+
+    guacenc_profile_stop(&guacenc_profile_stats.composite, start);
+    return result;
 
 }
 
@@ -21,12 +21,14 @@
 #include "display.h"
 #include "layer.h"
 #include "log.h"
+#include "thumbnails.h"
 #include "video.h"
 
 #include <guacamole/client.h>
 #include <guacamole/timestamp.h>
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 int guacenc_display_sync(guacenc_display* display, guac_timestamp timestamp) {
@@ -40,10 +42,55 @@ int guacenc_display_sync(guacenc_display* display, guac_timestamp timestamp) {
     /* Update timestamp of display */
     display->last_sync = timestamp;
 
+    /* Times within the range to be encoded are relative to the start of the
+     * recording, which is the first sync if not otherwise known */
+    if (display->started == 0)
+        display->started = timestamp;
+
+    guac_timestamp elapsed = timestamp - display->started;
+
+    /* Stop once the end of the requested range has been passed */
+    if (display->range_end >= 0 && elapsed > display->range_end) {
+        display->complete = true;
+        return 0;
+    }
+
+    /* Frames prior to the requested range need only update display state,
+     * which has already been done by the drawing instructions themselves */
+    if (elapsed < display->range_start)
+        return 0;
+
+    /* When writing thumbnails, flatten only the frames actually sampled */
+    if (display->thumbnails != NULL) {
+
+        if (!guacenc_thumbnails_due(display->thumbnails, elapsed))
+            return 0;
+
+        if (display->modified) {
+            if (guacenc_display_flatten(display))
+                return 1;
+            display->modified = false;
+        }
+
+        guacenc_layer* def_layer = guacenc_display_get_layer(display, 0);
+        assert(def_layer != NULL);
+
+        return guacenc_thumbnails_write(display->thumbnails, def_layer->frame,
+                elapsed);
+
+    }
+
+    /* If nothing visible has changed, the frame already prepared for the
+     * video is still accurate and can simply be repeated */
+    if (!display->modified)
+        return guacenc_video_advance_timeline(display->output, timestamp);
+
     /* Flatten display to default layer */
     if (guacenc_display_flatten(display))
         return 1;
 
+    display->modified = false;
+
     /* Retrieve default layer (guaranteed to not be NULL) */
     guacenc_layer* def_layer = guacenc_display_get_layer(display, 0);
     assert(def_layer != NULL);
@@ -27,6 +27,14 @@
 
 #include <stdlib.h>
 
+void guacenc_display_mark_modified(guacenc_display* display, int index) {
+
+    /* Only changes to layers (not buffers) are visible */
+    if (index >= 0)
+        display->modified = true;
+
+}
+
 cairo_operator_t guacenc_display_cairo_operator(guac_composite_mode mask) {
 
     /* Translate Guacamole channel mask into Cairo operator */
@@ -84,23 +92,64 @@ cairo_operator_t guacenc_display_cairo_operator(guac_composite_mode mask) {
 
 }
 
+/**
+ * Allocates and initializes the portion of a new Guacamole video encoder
+ * display that is common to all outputs. The output of the returned display
+ * must be associated by the caller.
+ *
+ * @return
+ *     The newly-allocated Guacamole video encoder display.
+ */
+static guacenc_display* guacenc_display_alloc_common() {
+
+    guacenc_display* display =
+        (guacenc_display*) guac_mem_zalloc(sizeof(guacenc_display));
+
+    /* Encode the entire recording by default */
+    display->range_end = -1;
+
+    /* The first frame must always be rendered */
+    display->modified = true;
+
+    /* Allocate special-purpose cursor layer */
+    display->cursor = guacenc_cursor_alloc();
+
+    /* Allocate cache of decoded images */
+    display->image_cache = guacenc_image_cache_alloc();
+
+    return display;
+
+}
+
 guacenc_display* guacenc_display_alloc(const char* path, const char* codec,
-        int width, int height, int bitrate) {
+        guacenc_video_hwaccel hwaccel, int width, int height, int bitrate,
+        bool fragmented) {
 
     /* Prepare video encoding */
-    guacenc_video* video = guacenc_video_alloc(path, codec, width, height, bitrate);
+    guacenc_video* video = guacenc_video_alloc(path, codec, hwaccel,
+            width, height, bitrate, fragmented);
     if (video == NULL)
         return NULL;
 
     /* Allocate display */
-    guacenc_display* display =
-        (guacenc_display*) guac_mem_zalloc(sizeof(guacenc_display));
+    guacenc_display* display = guacenc_display_alloc_common();
 
     /* Associate display with video output */
     display->output = video;
 
-    /* Allocate special-purpose cursor layer */
-    display->cursor = guacenc_cursor_alloc();
+    return display;
+
+}
+
+guacenc_display* guacenc_display_alloc_thumbnails(const char* path,
+        int width, int height, int interval, int start) {
+
+    /* Allocate display */
+    guacenc_display* display = guacenc_display_alloc_common();
+
+    /* Write thumbnails in place of video */
+    display->thumbnails = guacenc_thumbnails_alloc(path, width, height,
+            interval, start);
 
     return display;
 
@@ -114,8 +163,9 @@ int guacenc_display_free(guacenc_display* display) {
     if (display == NULL)
         return 0;
 
-    /* Finalize video */
+    /* Finalize video or thumbnails */
     int retval = guacenc_video_free(display->output);
+    guacenc_thumbnails_free(display->thumbnails);
 
     /* Free all buffers */
     for (i = 0; i < GUACENC_DISPLAY_MAX_BUFFERS; i++)
@@ -132,6 +182,9 @@ int guacenc_display_free(guacenc_display* display) {
     /* Free cursor */
     guacenc_cursor_free(display->cursor);
 
+    /* Free all cached images */
+    guacenc_image_cache_free(display->image_cache);
+
     guac_mem_free(display);
     return retval;
 
@@ -23,14 +23,18 @@
 #include "config.h"
 #include "buffer.h"
 #include "cursor.h"
+#include "image-cache.h"
 #include "image-stream.h"
 #include "layer.h"
+#include "thumbnails.h"
 #include "video.h"
 
 #include <cairo/cairo.h>
 #include <guacamole/protocol.h>
 #include <guacamole/timestamp.h>
 
+#include <stdbool.h>
+
 /**
  * The maximum number of buffers that the Guacamole video encoder will handle
  * within a single Guacamole protocol dump.
@@ -83,6 +87,12 @@ typedef struct guacenc_display {
      */
     guacenc_image_stream* image_streams[GUACENC_DISPLAY_MAX_STREAMS];
 
+    /**
+     * Cache of all recently-decoded images, such that images which repeat
+     * within the recording need not be decoded again.
+     */
+    guacenc_image_cache* image_cache;
+
     /**
      * The timestamp of the last sync instruction handled, or 0 if no sync has
      * yet been read.
@@ -90,15 +100,60 @@ typedef struct guacenc_display {
     guac_timestamp last_sync;
 
     /**
-     * The video that this display is recording to.
+     * The timestamp of the point in time at which the recording began, which
+     * all times within the range to be encoded are relative to. If 0, this
+     * is not yet known, and will be taken from the first sync instruction
+     * handled.
+     */
+    guac_timestamp started;
+
+    /**
+     * The number of milliseconds after the recording began at which encoding
+     * should begin. Frames prior to this point in time still update the state
+     * of the display, but are neither rendered nor encoded.
+     */
+    guac_timestamp range_start;
+
+    /**
+     * The number of milliseconds after the recording began at which encoding
+     * should end, or a negative value if encoding should continue until the
+     * end of the recording.
+     */
+    guac_timestamp range_end;
+
+    /**
+     * Whether the end of the range to be encoded has been reached, and no
+     * further instructions need be handled.
+     */
+    bool complete;
+
+    /**
+     * Whether any visible part of the display (a layer or the mouse cursor)
+     * has changed since the display was last flattened. If no such change
+     * has occurred, the previously-flattened frame is still accurate and
+     * need be neither re-rendered nor re-converted for encoding.
+     */
+    bool modified;
+
+    /**
+     * The video that this display is recording to, or NULL if this display
+     * is instead writing thumbnails.
      */
     guacenc_video* output;
 
+    /**
+     * The series of thumbnails that this display is writing, or NULL if this
+     * display is instead recording to video.
+     */
+    guacenc_thumbnails* thumbnails;
+
 } guacenc_display;
 
 /**
  * Handles a received "sync" instruction having the given timestamp, flushing
- * the current display to the in-progress video encoding.
+ * the current display to the in-progress video encoding. Frames outside the
+ * range to be encoded are not flushed. Once a frame beyond the end of that
+ * range is reached, the display is marked as complete.
  *
  * @param display
  *     The display to flush to the video encoding as a new frame.
@@ -138,7 +193,12 @@ int guacenc_display_flatten(guacenc_display* display);
  *
  * @param codec
  *     The name of the codec to use for the video encoding, as defined by
- *     ffmpeg / libavcodec.
+ *     ffmpeg / libavcodec. If a hardware encoding backend is requested, this
+ *     codec is used only if that backend cannot be used.
+ *
+ * @param hwaccel
+ *     The hardware encoding backend to use, or GUACENC_VIDEO_HWACCEL_NONE to
+ *     encode in software.
  *
  * @param width
  *     The width of the desired video, in pixels.
@@ -150,12 +210,49 @@ int guacenc_display_flatten(guacenc_display* display);
  *     The desired overall bitrate of the resulting encoded video, in bits per
  *     second.
  *
+ * @param fragmented
+ *     Whether the video should be written as fragmented MP4, such that the
+ *     video can be played while it is still being written. The output file
+ *     must be an MP4 file if this is true.
+ *
  * @return
  *     The newly-allocated Guacamole video encoder display, or NULL if the
  *     display could not be allocated.
  */
 guacenc_display* guacenc_display_alloc(const char* path, const char* codec,
-        int width, int height, int bitrate);
+        guacenc_video_hwaccel hwaccel, int width, int height, int bitrate,
+        bool fragmented);
+
+/**
+ * Allocates a new Guacamole video encoder display which writes scaled-down
+ * thumbnails of the flattened display as PNG images, rather than encoding
+ * video. No video encoding takes place, and the display is flattened only
+ * for frames that are to be sampled.
+ *
+ * @param path
+ *     The path of the recording being sampled, which is used as the prefix
+ *     of the name of each thumbnail written.
+ *
+ * @param width
+ *     The maximum width of each thumbnail, in pixels.
+ *
+ * @param height
+ *     The maximum height of each thumbnail, in pixels.
+ *
+ * @param interval
+ *     The number of milliseconds between each thumbnail, or zero if a
+ *     thumbnail should be sampled for every frame.
+ *
+ * @param start
+ *     The number of milliseconds into the recording at which the first
+ *     thumbnail should be sampled.
+ *
+ * @return
+ *     The newly-allocated Guacamole video encoder display, or NULL if the
+ *     display could not be allocated.
+ */
+guacenc_display* guacenc_display_alloc_thumbnails(const char* path,
+        int width, int height, int interval, int start);
 
 /**
  * Frees all memory associated with the given Guacamole video encoder display,
@@ -352,6 +449,21 @@ guacenc_image_stream* guacenc_display_get_image_stream(
  */
 int guacenc_display_free_image_stream(guacenc_display* display, int index);
 
+/**
+ * Records that the layer or buffer having the given index has been drawn to
+ * or resized. Only changes to layers (non-negative indices) are visible, and
+ * so only those mark the display as modified (see the modified member of
+ * guacenc_display). Changes to buffers (negative indices) are ignored.
+ *
+ * @param display
+ *     The Guacamole video encoder display containing the layer or buffer
+ *     that changed.
+ *
+ * @param index
+ *     The index of the layer or buffer that changed.
+ */
+void guacenc_display_mark_modified(guacenc_display* display, int index);
+
 /**
  * Translates the given Guacamole protocol compositing mode (channel mask) to
  * the corresponding Cairo composition operator. If no such operator exists,
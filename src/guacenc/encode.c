@@ -19,50 +19,59 @@
 
 #include "config.h"
 #include "display.h"
+#include "follow.h"
 #include "instructions.h"
 #include "log.h"
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
 #include <guacamole/parser.h>
+#include <guacamole/recording.h>
 #include <guacamole/socket.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <errno.h>
-#include <fcntl.h>
 #include <stdbool.h>
-#include <string.h>
 #include <unistd.h>
 
 /**
- * Reads and handles all Guacamole instructions from the given guac_socket
- * until end-of-stream is reached.
+ * Reads and handles all Guacamole instructions from the given mapped
+ * recording or guac_socket until end-of-stream is reached.
  *
  * @param display
  *     The current internal display of the Guacamole video encoder.
  *
  * @param path
  *     The name of the file being parsed (for logging purposes). This file
- *     must already be open and available through the given socket.
+ *     must already be open and available through the given mapping or
+ *     socket.
+ *
+ * @param mapping
+ *     The mapped recording from which instructions should be read, or NULL
+ *     if instructions should instead be read through the given socket.
  *
  * @param socket
- *     The guac_socket through which instructions should be read.
+ *     The guac_socket through which instructions should be read, if the
+ *     recording has not been mapped.
  *
  * @return
  *     Zero on success, non-zero if parsing of Guacamole protocol data through
- *     the given socket fails.
+ *     the given mapping or socket fails.
  */
 static int guacenc_read_instructions(guacenc_display* display,
-        const char* path, guac_socket* socket) {
+        const char* path, guac_recording_mapping* mapping,
+        guac_socket* socket) {
 
     /* Obtain Guacamole protocol parser */
     guac_parser* parser = guac_parser_alloc();
     if (parser == NULL)
         return 1;
 
-    /* Continuously read and handle all instructions */
-    while (!guac_parser_read(parser, socket, -1)) {
+    /* Continuously read and handle all instructions within the requested
+     * range */
+    while (!display->complete && !(mapping != NULL
+                ? guac_recording_mapping_read(mapping, parser)
+                : guac_parser_read(parser, socket, -1))) {
         if (guacenc_handle_instruction(display, parser->opcode,
                 parser->argc, parser->argv)) {
             guacenc_log(GUAC_LOG_DEBUG, "Handling of \"%s\" instruction "
@@ -71,7 +80,7 @@ static int guacenc_read_instructions(guacenc_display* display,
     }
 
     /* Fail on read/parse error */
-    if (guac_error != GUAC_STATUS_CLOSED) {
+    if (!display->complete && guac_error != GUAC_STATUS_CLOSED) {
         guacenc_log(GUAC_LOG_ERROR, "%s: %s",
                 path, guac_status_string(guac_error));
         guac_parser_free(parser);
@@ -84,72 +93,113 @@ static int guacenc_read_instructions(guacenc_display* display,
 
 }
 
-int guacenc_encode(const char* path, const char* out_path, const char* codec,
-        int width, int height, int bitrate, bool force) {
+/**
+ * Closes the input from which recording instructions were read, whether that
+ * input is a mapped recording or a guac_socket. Exactly one of the given
+ * mapping and socket must be non-NULL.
+ *
+ * @param mapping
+ *     The mapped recording to unmap, or NULL if the recording was read
+ *     through the given socket.
+ *
+ * @param socket
+ *     The guac_socket to free, or NULL if the recording was mapped.
+ */
+static void guacenc_close_input(guac_recording_mapping* mapping,
+        guac_socket* socket) {
 
-    /* Open input file */
-    int fd = open(path, O_RDONLY);
-    if (fd < 0) {
-        guacenc_log(GUAC_LOG_ERROR, "%s: %s", path, strerror(errno));
-        return 1;
-    }
+    if (mapping != NULL)
+        guac_recording_unmap(mapping);
+    else
+        guac_socket_free(socket);
 
-    /* Lock entire input file for reading by the current process */
-    struct flock file_lock = {
-        .l_type   = F_RDLCK,
-        .l_whence = SEEK_SET,
-        .l_start  = 0,
-        .l_len    = 0,
-        .l_pid    = getpid()
-    };
-
-    /* Abort if file cannot be locked for reading */
-    if (!force && fcntl(fd, F_SETLK, &file_lock) == -1) {
-
-        /* Warn if lock cannot be acquired */
-        if (errno == EACCES || errno == EAGAIN)
-            guacenc_log(GUAC_LOG_WARNING, "Refusing to encode in-progress "
-                    "recording \"%s\" (specify the -f option to override "
-                    "this behavior).", path);
-
-        /* Log an error if locking fails in an unexpected way */
-        else
-            guacenc_log(GUAC_LOG_ERROR, "Cannot lock \"%s\" for reading: %s",
-                    path, strerror(errno));
+}
 
-        close(fd);
-        return 1;
-    }
+int guacenc_encode(int fd, const char* path, const char* out_path,
+        const char* codec, guacenc_video_hwaccel hwaccel, int width,
+        int height, int bitrate, int start, int end, bool follow,
+        int thumbnails) {
+
+    /* Allocate display for encoding process, writing either thumbnails or
+     * video */
+    guacenc_display* display;
+    if (thumbnails >= 0)
+        display = guacenc_display_alloc_thumbnails(path, width, height,
+                thumbnails, start);
+    else
+        display = guacenc_display_alloc(out_path, codec, hwaccel,
+                width, height, bitrate, follow);
 
-    /* Allocate display for encoding process */
-    guacenc_display* display = guacenc_display_alloc(out_path, codec,
-            width, height, bitrate);
     if (display == NULL) {
         close(fd);
         return 1;
     }
 
-    /* Obtain guac_socket wrapping file descriptor */
-    guac_socket* socket = guac_socket_open(fd);
-    if (socket == NULL) {
-        guacenc_log(GUAC_LOG_ERROR, "%s: %s", path,
-                guac_status_string(guac_error));
-        close(fd);
-        guacenc_display_free(display);
-        return 1;
+    /* Encode only the requested range, relative to the start of the
+     * recording (compressed recordings store this time, while the first sync
+     * instruction is used for raw recordings) */
+    display->range_start = start;
+    display->range_end = end;
+    bool compressed = !guac_recording_read_start_time(fd, &display->started);
+    if (!compressed)
+        display->started = 0;
+
+    guac_socket* socket = NULL;
+    guac_recording_mapping* mapping = NULL;
+
+    /* Follow in-progress recordings as they are written, reading through a
+     * socket that waits for further data */
+    if (follow) {
+
+        if (compressed) {
+            guacenc_log(GUAC_LOG_ERROR, "%s: Compressed recordings cannot "
+                    "be followed.", path);
+            close(fd);
+            guacenc_display_free(display);
+            return 1;
+        }
+
+        socket = guacenc_follow_open(fd);
+        if (socket == NULL) {
+            close(fd);
+            guacenc_display_free(display);
+            return 1;
+        }
+
+    }
+
+    /* Otherwise, parse raw recordings directly from memory where possible */
+    else
+        mapping = guac_recording_map(fd);
+
+    /* If neither followed nor mapped, obtain guac_socket reading the
+     * recording within the file, beginning at the requested point in time if
+     * the recording supports seeking */
+    if (socket == NULL && mapping == NULL) {
+        socket = guac_recording_open_reader(fd, start);
+        if (socket == NULL) {
+            guacenc_log(GUAC_LOG_ERROR, "%s: %s", path,
+                    guac_status_string(guac_error));
+            close(fd);
+            guacenc_display_free(display);
+            return 1;
+        }
     }
 
-    guacenc_log(GUAC_LOG_INFO, "Encoding \"%s\" to \"%s\" ...", path, out_path);
+    if (thumbnails >= 0)
+        guacenc_log(GUAC_LOG_INFO, "Writing thumbnails of \"%s\" ...", path);
+    else
+        guacenc_log(GUAC_LOG_INFO, "Encoding \"%s\" to \"%s\" ...", path, out_path);
 
     /* Attempt to read all instructions in the file */
-    if (guacenc_read_instructions(display, path, socket)) {
-        guac_socket_free(socket);
+    if (guacenc_read_instructions(display, path, mapping, socket)) {
+        guacenc_close_input(mapping, socket);
         guacenc_display_free(display);
         return 1;
     }
 
     /* Close input and finish encoding process */
-    guac_socket_free(socket);
+    guacenc_close_input(mapping, socket);
     return guacenc_display_free(display);
 
 }
@@ -21,24 +21,36 @@
 #define GUACENC_ENCODE_H
 
 #include "config.h"
+#include "video.h"
 
 #include <stdbool.h>
 
 /**
- * Encodes the given Guacamole protocol dump as video. A read lock will be
- * acquired on the input file to ensure that in-progress recordings are not
- * encoded. This behavior can be overridden by specifying true for the force
- * parameter.
+ * Encodes the given Guacamole protocol dump as video. The given file
+ * descriptor is taken over by this function and will be closed once encoding
+ * has completed or failed. Any check for whether the recording is still in
+ * progress must be performed by the caller prior to calling this function
+ * (see guacenc_batch_run()).
+ *
+ * @param fd
+ *     A file descriptor open for reading on the file containing the raw
+ *     Guacamole protocol dump.
  *
  * @param path
- *     The path to the file containing the raw Guacamole protocol dump.
+ *     The path to the file containing the raw Guacamole protocol dump (for
+ *     logging purposes).
  *
  * @param out_path
  *     The full path to the file in which encoded video should be written.
  *
  * @param codec
  *     The name of the codec to use for the video encoding, as defined by
- *     ffmpeg / libavcodec.
+ *     ffmpeg / libavcodec. If a hardware encoding backend is requested, this
+ *     codec is used only if that backend cannot be used.
+ *
+ * @param hwaccel
+ *     The hardware encoding backend to use, or GUACENC_VIDEO_HWACCEL_NONE to
+ *     encode in software.
  *
  * @param width
  *     The width of the desired video, in pixels.
@@ -50,16 +62,42 @@
  *     The desired overall bitrate of the resulting encoded video, in bits per
  *     second.
  *
- * @param force
- *     Perform the encoding, even if the input file appears to be an
- *     in-progress recording (has an associated lock).
+ * @param start
+ *     The number of milliseconds into the recording at which encoding should
+ *     begin. Reading of a compressed recording begins at the latest keyframe
+ *     at or before this point. Raw recordings cannot be seeked and are read
+ *     from the beginning, but frames prior to this point are neither rendered
+ *     nor encoded.
+ *
+ * @param end
+ *     The number of milliseconds into the recording at which encoding should
+ *     end, or a negative value to encode until the end of the recording.
+ *
+ * @param follow
+ *     Whether the recording should be followed as it is written, much like
+ *     "tail -f", continuing to encode newly-written data until the recording
+ *     is no longer in progress. If true, the video is written as fragmented
+ *     MP4, such that it can be played while it is still being encoded. Only
+ *     raw recordings can be followed.
+ *
+ * @param thumbnails
+ *     The number of milliseconds between each thumbnail if thumbnails should
+ *     be written in place of video, zero if a thumbnail should be written for
+ *     every frame, or a negative value if video should be encoded. Thumbnails
+ *     are scaled to fit within the given width and height and are written as
+ *     PNG images alongside the recording, each named after the recording and
+ *     the number of milliseconds into the recording of the thumbnail. No
+ *     video is encoded, and the given output path, codec, hardware encoding
+ *     backend, and bitrate are ignored.
  *
  * @return
  *     Zero on success, non-zero if an error prevented successful encoding of
  *     the video.
  */
-int guacenc_encode(const char* path, const char* out_path, const char* codec,
-        int width, int height, int bitrate, bool force);
+int guacenc_encode(int fd, const char* path, const char* out_path,
+        const char* codec, guacenc_video_hwaccel hwaccel, int width,
+        int height, int bitrate, int start, int end, bool follow,
+        int thumbnails);
 
 #endif
 
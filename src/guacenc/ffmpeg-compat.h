@@ -68,6 +68,12 @@
 #define AV_PIX_FMT_YUV420P PIX_FMT_YUV420P
 #endif
 
+/* For libavutil < 56.14.100: Hardware frame contexts are unavailable or
+ * lack support for all encoding backends */
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(56,14,100)
+#define GUACENC_HAVE_HWCONTEXT
+#endif
+
 /**
  * Writes the specified frame as a new frame of video. If pending frames of the
  * video are being flushed, the given frame may be NULL (as required by
@@ -0,0 +1,139 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "follow.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+/**
+ * Data associated with a socket which follows an in-progress recording.
+ */
+typedef struct guacenc_follow_data {
+
+    /**
+     * The file descriptor of the recording being followed.
+     */
+    int fd;
+
+} guacenc_follow_data;
+
+/**
+ * Returns whether the recording open at the given file descriptor is still
+ * being written, as indicated by a write lock held by another process.
+ *
+ * @param fd
+ *     The file descriptor of the recording to check.
+ *
+ * @return
+ *     true if the recording is still in progress, false otherwise.
+ */
+static bool guacenc_follow_in_progress(int fd) {
+
+    /* Test whether a read lock on the entire file would conflict with any
+     * lock held elsewhere (only writers hold conflicting locks) */
+    struct flock file_lock = {
+        .l_type   = F_RDLCK,
+        .l_whence = SEEK_SET,
+        .l_start  = 0,
+        .l_len    = 0
+    };
+
+    if (fcntl(fd, F_GETLK, &file_lock) == -1)
+        return false;
+
+    return file_lock.l_type != F_UNLCK;
+
+}
+
+static ssize_t guacenc_follow_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guacenc_follow_data* data = (guacenc_follow_data*) socket->data;
+
+    for (;;) {
+
+        ssize_t retval = read(data->fd, buf, count);
+        if (retval < 0 && errno == EINTR)
+            continue;
+
+        /* Wait for further data only at the end of the file, and only while
+         * the recording is still being written (the lock is checked prior to
+         * the final read such that no data written before the lock is
+         * released can be missed) */
+        if (retval != 0)
+            return retval;
+
+        if (!guacenc_follow_in_progress(data->fd)) {
+            do {
+                retval = read(data->fd, buf, count);
+            } while (retval < 0 && errno == EINTR);
+            return retval;
+        }
+
+        guac_timestamp_msleep(GUACENC_FOLLOW_INTERVAL);
+
+    }
+
+}
+
+static int guacenc_follow_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    /* Reads never fail due to a lack of data; they simply wait */
+    return 1;
+
+}
+
+static int guacenc_follow_free_handler(guac_socket* socket) {
+
+    guacenc_follow_data* data = (guacenc_follow_data*) socket->data;
+
+    close(data->fd);
+    guac_mem_free(data);
+
+    return 0;
+
+}
+
+guac_socket* guacenc_follow_open(int fd) {
+
+    guac_socket* socket = guac_socket_alloc();
+    if (socket == NULL)
+        return NULL;
+
+    guacenc_follow_data* data = guac_mem_alloc(sizeof(guacenc_follow_data));
+    data->fd = fd;
+
+    socket->data = data;
+    socket->read_handler   = guacenc_follow_read_handler;
+    socket->select_handler = guacenc_follow_select_handler;
+    socket->free_handler   = guacenc_follow_free_handler;
+
+    return socket;
+
+}
+
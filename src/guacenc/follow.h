@@ -0,0 +1,52 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_FOLLOW_H
+#define GUACENC_FOLLOW_H
+
+#include "config.h"
+
+#include <guacamole/socket.h>
+
+/**
+ * The number of milliseconds to wait before checking for further data after
+ * the end of an in-progress recording has been reached.
+ */
+#define GUACENC_FOLLOW_INTERVAL 250
+
+/**
+ * Opens a guac_socket which reads the raw recording within the file having
+ * the given file descriptor, following that recording as it is written much
+ * like "tail -f". Once the end of the file has been reached, further reads
+ * wait for more data for as long as the recording remains in progress (the
+ * file remains locked for writing by another process). The end of the
+ * recording is reported only once that lock has been released and all data
+ * has been read. Freeing the returned socket closes the file descriptor.
+ *
+ * @param fd
+ *     The file descriptor of the raw recording to follow.
+ *
+ * @return
+ *     A newly-allocated guac_socket which reads and follows the given
+ *     recording, or NULL if the socket could not be allocated.
+ */
+guac_socket* guacenc_follow_open(int fd);
+
+#endif
+
@@ -19,10 +19,12 @@
 
 #include "config.h"
 
-#include "encode.h"
+#include "batch.h"
 #include "guacenc.h"
 #include "log.h"
 #include "parse.h"
+#include "profile.h"
+#include "thumbnails.h"
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -30,20 +32,30 @@
 #include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 int main(int argc, char* argv[]) {
 
     int i;
 
     /* Load defaults */
+    const char* list_path = NULL;
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    guacenc_video_hwaccel hwaccel = GUACENC_VIDEO_HWACCEL_NONE;
     bool force = false;
+    bool follow = false;
+    bool dimensions = false;
+    int thumbnails = -1;
     int width = GUACENC_DEFAULT_WIDTH;
     int height = GUACENC_DEFAULT_HEIGHT;
     int bitrate = GUACENC_DEFAULT_BITRATE;
+    int start = 0;
+    int end = -1;
 
     /* Parse arguments */
     int opt;
-    while ((opt = getopt(argc, argv, "s:r:f")) != -1) {
+    while ((opt = getopt(argc, argv, "s:r:S:E:H:T:j:l:fFp")) != -1) {
 
         /* -s: Dimensions (WIDTHxHEIGHT) */
         if (opt == 's') {
@@ -51,6 +63,7 @@ int main(int argc, char* argv[]) {
                 guacenc_log(GUAC_LOG_ERROR, "Invalid dimensions.");
                 goto invalid_options;
             }
+            dimensions = true;
         }
 
         /* -r: Bitrate (bits per second) */
@@ -61,10 +74,64 @@ int main(int argc, char* argv[]) {
             }
         }
 
+        /* -S: Start time (milliseconds) */
+        else if (opt == 'S') {
+            if (guacenc_parse_int(optarg, &start) || start < 0) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid start time.");
+                goto invalid_options;
+            }
+        }
+
+        /* -E: End time (milliseconds) */
+        else if (opt == 'E') {
+            if (guacenc_parse_int(optarg, &end) || end < 0) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid end time.");
+                goto invalid_options;
+            }
+        }
+
+        /* -H: Hardware encoding backend */
+        else if (opt == 'H') {
+            if (guacenc_parse_hwaccel(optarg, &hwaccel)) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid hardware encoder.");
+                goto invalid_options;
+            }
+        }
+
+        /* -T: Thumbnail interval (milliseconds, or "sync" for every frame) */
+        else if (opt == 'T') {
+            if (strcmp(optarg, "sync") == 0)
+                thumbnails = 0;
+            else if (guacenc_parse_int(optarg, &thumbnails)) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid thumbnail interval.");
+                goto invalid_options;
+            }
+        }
+
+        /* -j: Number of recordings to encode concurrently */
+        else if (opt == 'j') {
+            if (guacenc_parse_int(optarg, &workers) || workers <= 0) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid number of jobs.");
+                goto invalid_options;
+            }
+        }
+
+        /* -l: File listing recordings to encode */
+        else if (opt == 'l')
+            list_path = optarg;
+
         /* -f: Force */
         else if (opt == 'f')
             force = true;
 
+        /* -F: Follow in-progress recordings */
+        else if (opt == 'F')
+            follow = true;
+
+        /* -p: Report profiling information */
+        else if (opt == 'p')
+            guacenc_profile_stats.enabled = true;
+
         /* Invalid option */
         else {
             goto invalid_options;
@@ -72,6 +139,18 @@ int main(int argc, char* argv[]) {
 
     }
 
+    /* Thumbnails are considerably smaller than video by default */
+    if (thumbnails >= 0 && !dimensions) {
+        width = GUACENC_THUMBNAILS_DEFAULT_WIDTH;
+        height = GUACENC_THUMBNAILS_DEFAULT_HEIGHT;
+    }
+
+    /* The requested range must not be empty */
+    if (end >= 0 && end <= start) {
+        guacenc_log(GUAC_LOG_ERROR, "End time must be after start time.");
+        goto invalid_options;
+    }
+
     /* Log start */
     guacenc_log(GUAC_LOG_INFO, "Guacamole video encoder (guacenc) "
             "version " VERSION);
@@ -85,49 +164,59 @@ int main(int argc, char* argv[]) {
     av_register_all();
 #endif
 
-    /* Track number of overall failures */
-    int total_files = argc - optind;
-    int failures = 0;
+    /* Gather all recordings to be encoded, expanding directories */
+    guacenc_batch* batch = guacenc_batch_alloc("mpeg4", hwaccel, width,
+            height, bitrate, start, end, force, follow, thumbnails);
+
+    if (list_path != NULL && guacenc_batch_add_list(batch, list_path)) {
+        guacenc_batch_free(batch);
+        return 1;
+    }
+
+    for (i = optind; i < argc; i++) {
+        if (guacenc_batch_add(batch, argv[i])) {
+            guacenc_batch_free(batch);
+            return 1;
+        }
+    }
 
     /* Abort if no files given */
+    int total_files = batch->count;
     if (total_files <= 0) {
         guacenc_log(GUAC_LOG_INFO, "No input files specified. Nothing to do.");
+        guacenc_batch_free(batch);
         return 0;
     }
 
-    guacenc_log(GUAC_LOG_INFO, "%i input file(s) provided.", total_files);
-
-    guacenc_log(GUAC_LOG_INFO, "Video will be encoded at %ix%i "
-            "and %i bps.", width, height, bitrate);
-
-    /* Encode all input files */
-    for (i = optind; i < argc; i++) {
+    /* Assume a single worker if the number of processors is unknown */
+    if (workers <= 0)
+        workers = 1;
 
-        /* Get current filename */
-        const char* path = argv[i];
+    guacenc_log(GUAC_LOG_INFO, "%i input file(s) provided.", total_files);
 
-        /* Generate output filename */
-        char out_path[4096];
-        int len = snprintf(out_path, sizeof(out_path), "%s.m4v", path);
+    if (thumbnails > 0)
+        guacenc_log(GUAC_LOG_INFO, "Thumbnails of up to %ix%i will be "
+                "written every %i ms.", width, height, thumbnails);
+    else if (thumbnails == 0)
+        guacenc_log(GUAC_LOG_INFO, "Thumbnails of up to %ix%i will be "
+                "written for every frame.", width, height);
+    else
+        guacenc_log(GUAC_LOG_INFO, "Video will be encoded at %ix%i "
+                "and %i bps.", width, height, bitrate);
 
-        /* Do not write if filename exceeds maximum length */
-        if (len >= sizeof(out_path)) {
-            guacenc_log(GUAC_LOG_ERROR, "Cannot write output file for \"%s\": "
-                    "Name too long", path);
-            continue;
-        }
+    if (end >= 0)
+        guacenc_log(GUAC_LOG_INFO, "Only %i ms through %i ms of each "
+                "recording will be encoded.", start, end);
+    else if (start > 0)
+        guacenc_log(GUAC_LOG_INFO, "Encoding will begin %i ms into each "
+                "recording.", start);
 
-        /* Attempt encoding, log granular success/failure at debug level */
-        if (guacenc_encode(path, out_path, "mpeg4",
-                    width, height, bitrate, force)) {
-            failures++;
-            guacenc_log(GUAC_LOG_DEBUG,
-                    "%s was NOT successfully encoded.", path);
-        }
-        else
-            guacenc_log(GUAC_LOG_DEBUG, "%s was successfully encoded.", path);
+    /* Encode all input files */
+    int failures = guacenc_batch_run(batch, workers);
+    guacenc_batch_free(batch);
 
-    }
+    /* Report where time was spent, if requested */
+    guacenc_profile_report();
 
     /* Warn if at least one file failed */
     if (failures != 0)
@@ -147,7 +236,15 @@ invalid_options:
     fprintf(stderr, "USAGE: %s"
             " [-s WIDTHxHEIGHT]"
             " [-r BITRATE]"
+            " [-S START]"
+            " [-E END]"
+            " [-H nvenc|vaapi|qsv]"
+            " [-T INTERVAL|sync]"
+            " [-j JOBS]"
+            " [-l LIST]"
             " [-f]"
+            " [-F]"
+            " [-p]"
             " [FILE]...\n", argv[0]);
 
     return 1;
@@ -0,0 +1,230 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "image-cache.h"
+#include "log.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Returns the 64-bit FNV-1a hash of the given data.
+ *
+ * @param data
+ *     The data to hash.
+ *
+ * @param length
+ *     The number of bytes of data.
+ *
+ * @return
+ *     The hash of the given data.
+ */
+static uint64_t guacenc_image_cache_hash(const unsigned char* data,
+        size_t length) {
+
+    uint64_t hash = 0xCBF29CE484222325;
+    while (length-- > 0) {
+        hash ^= *(data++);
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+
+}
+
+/**
+ * Removes the given entry from the recency list of the given cache.
+ *
+ * @param cache
+ *     The cache containing the entry.
+ *
+ * @param entry
+ *     The entry to remove from the recency list.
+ */
+static void guacenc_image_cache_unlink(guacenc_image_cache* cache,
+        guacenc_image_cache_entry* entry) {
+
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+
+}
+
+/**
+ * Adds the given entry to the recency list of the given cache as the
+ * most-recently-used entry.
+ *
+ * @param cache
+ *     The cache containing the entry.
+ *
+ * @param entry
+ *     The entry to add to the recency list.
+ */
+static void guacenc_image_cache_link(guacenc_image_cache* cache,
+        guacenc_image_cache_entry* entry) {
+
+    entry->newer = NULL;
+    entry->older = cache->newest;
+
+    if (cache->newest != NULL)
+        cache->newest->newer = entry;
+    else
+        cache->oldest = entry;
+
+    cache->newest = entry;
+
+}
+
+/**
+ * Frees the given entry and the image it holds. The entry must already have
+ * been removed from its hash bucket and from the recency list.
+ *
+ * @param entry
+ *     The entry to free.
+ */
+static void guacenc_image_cache_entry_free(guacenc_image_cache_entry* entry) {
+    cairo_surface_destroy(entry->surface);
+    guac_mem_free(entry->data);
+    guac_mem_free(entry);
+}
+
+/**
+ * Evicts the least-recently-used entry of the given cache, which must not be
+ * empty.
+ *
+ * @param cache
+ *     The cache to evict an entry from.
+ */
+static void guacenc_image_cache_evict(guacenc_image_cache* cache) {
+
+    guacenc_image_cache_entry* entry = cache->oldest;
+    guacenc_image_cache_unlink(cache, entry);
+
+    /* Remove from hash bucket */
+    guacenc_image_cache_entry** current =
+        &cache->buckets[entry->hash % GUACENC_IMAGE_CACHE_BUCKETS];
+
+    while (*current != entry)
+        current = &(*current)->bucket_next;
+
+    *current = entry->bucket_next;
+
+    cache->size -= entry->size;
+    guacenc_image_cache_entry_free(entry);
+
+}
+
+guacenc_image_cache* guacenc_image_cache_alloc() {
+    return guac_mem_zalloc(sizeof(guacenc_image_cache));
+}
+
+cairo_surface_t* guacenc_image_cache_get(guacenc_image_cache* cache,
+        const unsigned char* data, size_t length) {
+
+    uint64_t hash = guacenc_image_cache_hash(data, length);
+
+    guacenc_image_cache_entry* entry =
+        cache->buckets[hash % GUACENC_IMAGE_CACHE_BUCKETS];
+
+    for (; entry != NULL; entry = entry->bucket_next) {
+
+        /* Verify that the encoded data is actually identical */
+        if (entry->hash == hash && entry->length == length
+                && memcmp(entry->data, data, length) == 0) {
+
+            /* Mark as most-recently-used */
+            guacenc_image_cache_unlink(cache, entry);
+            guacenc_image_cache_link(cache, entry);
+
+            cache->hits++;
+            return cairo_surface_reference(entry->surface);
+
+        }
+
+    }
+
+    cache->misses++;
+    return NULL;
+
+}
+
+void guacenc_image_cache_put(guacenc_image_cache* cache,
+        const unsigned char* data, size_t length, cairo_surface_t* surface) {
+
+    size_t size = length + cairo_image_surface_get_stride(surface)
+                         * cairo_image_surface_get_height(surface);
+
+    /* Do not cache images that are too large to be worth caching */
+    if (size > GUACENC_IMAGE_CACHE_MAX_ENTRY_SIZE)
+        return;
+
+    /* Make room for new image */
+    while (cache->oldest != NULL
+            && cache->size + size > GUACENC_IMAGE_CACHE_MAX_SIZE)
+        guacenc_image_cache_evict(cache);
+
+    guacenc_image_cache_entry* entry =
+        guac_mem_alloc(sizeof(guacenc_image_cache_entry));
+
+    entry->hash = guacenc_image_cache_hash(data, length);
+    entry->data = guac_mem_alloc(length);
+    memcpy(entry->data, data, length);
+    entry->length = length;
+    entry->surface = cairo_surface_reference(surface);
+    entry->size = size;
+
+    /* Add to hash bucket and mark as most-recently-used */
+    guacenc_image_cache_entry** bucket =
+        &cache->buckets[entry->hash % GUACENC_IMAGE_CACHE_BUCKETS];
+
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+
+    guacenc_image_cache_link(cache, entry);
+    cache->size += size;
+
+}
+
+void guacenc_image_cache_free(guacenc_image_cache* cache) {
+
+    if (cache == NULL)
+        return;
+
+    guacenc_log(GUAC_LOG_DEBUG, "Decoded image cache: %i hits, %i misses.",
+            cache->hits, cache->misses);
+
+    while (cache->oldest != NULL)
+        guacenc_image_cache_evict(cache);
+
+    guac_mem_free(cache);
+
+}
+
@@ -0,0 +1,205 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_IMAGE_CACHE_H
+#define GUACENC_IMAGE_CACHE_H
+
+#include "config.h"
+
+#include <cairo/cairo.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The number of hash buckets within each guacenc_image_cache.
+ */
+#define GUACENC_IMAGE_CACHE_BUCKETS 4096
+
+/**
+ * The maximum number of bytes of decoded image data and encoded image data
+ * that may be held within a guacenc_image_cache. Once this limit is exceeded,
+ * the least-recently-used images are evicted.
+ */
+#define GUACENC_IMAGE_CACHE_MAX_SIZE 67108864
+
+/**
+ * The maximum number of bytes that a single image may occupy within a
+ * guacenc_image_cache. Larger images are unlikely to repeat and are never
+ * cached.
+ */
+#define GUACENC_IMAGE_CACHE_MAX_ENTRY_SIZE 8388608
+
+/**
+ * A single decoded image within a guacenc_image_cache, along with the encoded
+ * image data that it was decoded from.
+ */
+typedef struct guacenc_image_cache_entry {
+
+    /**
+     * The hash of the encoded image data.
+     */
+    uint64_t hash;
+
+    /**
+     * A copy of the encoded image data, used to verify that images having
+     * the same hash are actually identical.
+     */
+    unsigned char* data;
+
+    /**
+     * The number of bytes of encoded image data.
+     */
+    size_t length;
+
+    /**
+     * The decoded image. The cache holds one reference to this surface.
+     */
+    cairo_surface_t* surface;
+
+    /**
+     * The total number of bytes of encoded and decoded image data accounted
+     * to this entry.
+     */
+    size_t size;
+
+    /**
+     * The next entry within the same hash bucket, or NULL if this is the last
+     * such entry.
+     */
+    struct guacenc_image_cache_entry* bucket_next;
+
+    /**
+     * The next more-recently-used entry, or NULL if this is the
+     * most-recently-used entry.
+     */
+    struct guacenc_image_cache_entry* newer;
+
+    /**
+     * The next less-recently-used entry, or NULL if this is the
+     * least-recently-used entry.
+     */
+    struct guacenc_image_cache_entry* older;
+
+} guacenc_image_cache_entry;
+
+/**
+ * A cache of decoded images, keyed by the exact encoded image data that each
+ * was decoded from, such that images which repeat within a recording (cursors,
+ * icons, tiles, etc.) need only be decoded once. The cache is bounded in size,
+ * evicting the least-recently-used images first. A guacenc_image_cache is not
+ * threadsafe and must be used by only one display.
+ */
+typedef struct guacenc_image_cache {
+
+    /**
+     * All entries within the cache, organized by hash.
+     */
+    guacenc_image_cache_entry* buckets[GUACENC_IMAGE_CACHE_BUCKETS];
+
+    /**
+     * The most-recently-used entry, or NULL if the cache is empty.
+     */
+    guacenc_image_cache_entry* newest;
+
+    /**
+     * The least-recently-used entry, or NULL if the cache is empty.
+     */
+    guacenc_image_cache_entry* oldest;
+
+    /**
+     * The total number of bytes accounted to all entries within the cache.
+     */
+    size_t size;
+
+    /**
+     * The number of lookups which found a cached image.
+     */
+    int hits;
+
+    /**
+     * The number of lookups which did not find a cached image.
+     */
+    int misses;
+
+} guacenc_image_cache;
+
+/**
+ * Allocates a new, empty image cache.
+ *
+ * @return
+ *     A newly-allocated image cache, which must eventually be freed with
+ *     guacenc_image_cache_free().
+ */
+guacenc_image_cache* guacenc_image_cache_alloc();
+
+/**
+ * Returns the cached image that was decoded from exactly the given encoded
+ * image data, if any, marking that image as most-recently-used.
+ *
+ * @param cache
+ *     The cache to search.
+ *
+ * @param data
+ *     The encoded image data.
+ *
+ * @param length
+ *     The number of bytes of encoded image data.
+ *
+ * @return
+ *     A new reference to the cached image, which must eventually be released
+ *     with cairo_surface_destroy(), or NULL if no such image is cached.
+ */
+cairo_surface_t* guacenc_image_cache_get(guacenc_image_cache* cache,
+        const unsigned char* data, size_t length);
+
+/**
+ * Stores the given decoded image within the cache, associating it with the
+ * encoded image data it was decoded from. Less-recently-used images are
+ * evicted as necessary to stay within GUACENC_IMAGE_CACHE_MAX_SIZE. Images
+ * larger than GUACENC_IMAGE_CACHE_MAX_ENTRY_SIZE are not stored.
+ *
+ * @param cache
+ *     The cache to store the image within.
+ *
+ * @param data
+ *     The encoded image data that the image was decoded from. This data is
+ *     copied and need not remain valid after this function returns.
+ *
+ * @param length
+ *     The number of bytes of encoded image data.
+ *
+ * @param surface
+ *     The decoded image. The cache acquires its own reference to this
+ *     surface.
+ */
+void guacenc_image_cache_put(guacenc_image_cache* cache,
+        const unsigned char* data, size_t length, cairo_surface_t* surface);
+
+/**
+ * Frees the given image cache, releasing all cached images. If the given
+ * cache is NULL, this function has no effect.
+ *
+ * @param cache
+ *     The cache to free, which may be NULL.
+ */
+void guacenc_image_cache_free(guacenc_image_cache* cache);
+
+#endif
+
@@ -19,10 +19,12 @@
 
 #include "config.h"
 #include "display.h"
+#include "image-cache.h"
 #include "image-stream.h"
 #include "jpeg.h"
 #include "log.h"
 #include "png.h"
+#include "profile.h"
 
 #ifdef ENABLE_WEBP
 #include "webp.h"
@@ -64,6 +66,27 @@ guacenc_decoder* guacenc_get_decoder(const char* mimetype) {
 
 }
 
+/**
+ * Returns the profiling counter associated with the given decoder, which
+ * must be present within guacenc_decoder_map.
+ *
+ * @param decoder
+ *     The decoder to retrieve the profiling counter of.
+ *
+ * @return
+ *     The profiling counter associated with the given decoder.
+ */
+static guacenc_profile_counter* guacenc_get_decoder_profile(
+        guacenc_decoder* decoder) {
+
+    int i = 0;
+    while (guacenc_decoder_map[i].decoder != decoder)
+        i++;
+
+    return &guacenc_profile_stats.decoders[i];
+
+}
+
 guacenc_image_stream* guacenc_image_stream_alloc(int mask, int index,
         const char* mimetype, int x, int y) {
 
@@ -120,17 +143,31 @@ int guacenc_image_stream_receive(guacenc_image_stream* stream,
 }
 
 int guacenc_image_stream_end(guacenc_image_stream* stream,
-        guacenc_buffer* buffer) {
+        guacenc_buffer* buffer, guacenc_image_cache* cache) {
 
     /* If there is no decoder, simply return success */
     guacenc_decoder* decoder = stream->decoder;
     if (decoder == NULL)
         return 0;
 
-    /* Decode received data to a Cairo surface */
-    cairo_surface_t* surface = stream->decoder(stream->buffer, stream->length);
-    if (surface == NULL)
-        return 1;
+    /* Reuse any identical image that has already been decoded */
+    cairo_surface_t* surface = guacenc_image_cache_get(cache,
+            stream->buffer, stream->length);
+
+    /* Otherwise, decode received data to a Cairo surface */
+    if (surface == NULL) {
+
+        uint64_t start = guacenc_profile_start();
+        surface = decoder(stream->buffer, stream->length);
+        guacenc_profile_stop(guacenc_get_decoder_profile(decoder), start);
+
+        if (surface == NULL)
+            return 1;
+
+        guacenc_image_cache_put(cache, stream->buffer, stream->length,
+                surface);
+
+    }
 
     /* Get surface dimensions */
     int width = cairo_image_surface_get_width(surface);
@@ -22,6 +22,7 @@
 
 #include "config.h"
 #include "buffer.h"
+#include "image-cache.h"
 
 #include <cairo/cairo.h>
 
@@ -200,7 +201,9 @@ int guacenc_image_stream_receive(guacenc_image_stream* stream,
  * given buffer as-is. If no decoder is associated with the given image stream,
  * this function has no effect. Meta-information describing the image draw
  * operation itself is pulled from the guacenc_image_stream, having been stored
- * there when the image stream was created.
+ * there when the image stream was created. If an identical image has already
+ * been decoded and remains within the given cache, the cached image is used
+ * and the decoder is not invoked.
  *
  * @param stream
  *     The image stream that has ended.
@@ -208,12 +211,15 @@ int guacenc_image_stream_receive(guacenc_image_stream* stream,
  * @param buffer
  *     The buffer that the decoded image should be written to.
  *
+ * @param cache
+ *     The cache of previously-decoded images to consult and update.
+ *
  * @return
  *     Zero if the image is written successfully, or non-zero if an error
  *     occurs.
  */
 int guacenc_image_stream_end(guacenc_image_stream* stream,
-        guacenc_buffer* buffer);
+        guacenc_buffer* buffer, guacenc_image_cache* cache);
 
 /**
  * Frees the given image stream and all associated data. If the image stream
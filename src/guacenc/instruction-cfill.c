@@ -46,6 +46,8 @@ int guacenc_handle_cfill(guacenc_display* display, int argc, char** argv) {
     if (buffer == NULL)
         return 1;
 
+    guacenc_display_mark_modified(display, index);
+
     /* Fill with RGBA color */
     if (buffer->cairo != NULL) {
         cairo_set_operator(buffer->cairo, guacenc_display_cairo_operator(mask));
@@ -54,6 +54,8 @@ int guacenc_handle_copy(guacenc_display* display, int argc, char** argv) {
     if (dst == NULL)
         return 1;
 
+    guacenc_display_mark_modified(display, dindex);
+
     /* Expand the destination buffer as necessary to fit the draw operation */
     if (dst->autosize)
         guacenc_buffer_fit(dst, dx + width, dy + height);
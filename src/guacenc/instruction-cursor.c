@@ -51,6 +51,7 @@ int guacenc_handle_cursor(guacenc_display* display, int argc, char** argv) {
 
     /* Update cursor hotspot */
     guacenc_cursor* cursor = display->cursor;
+    display->modified = true;
     cursor->hotspot_x = hotspot_x;
     cursor->hotspot_y = hotspot_y;
 
@@ -37,8 +37,10 @@ int guacenc_handle_dispose(guacenc_display* display, int argc, char** argv) {
     int index = atoi(argv[0]);
 
     /* If non-negative, dispose of layer */
-    if (index >= 0)
+    if (index >= 0) {
+        display->modified = true;
         return guacenc_display_free_layer(display, index);
+    }
 
     /* Otherwise, we're referring to a buffer */
     return guacenc_display_free_buffer(display, index);
@@ -49,8 +49,10 @@ int guacenc_handle_end(guacenc_display* display, int argc, char** argv) {
     if (buffer == NULL)
         return 1;
 
+    guacenc_display_mark_modified(display, stream->index);
+
     /* End image stream, drawing final image to the buffer */
-    return guacenc_image_stream_end(stream, buffer);
+    return guacenc_image_stream_end(stream, buffer, display->image_cache);
 
 }
 
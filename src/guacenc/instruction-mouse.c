@@ -39,8 +39,11 @@ int guacenc_handle_mouse(guacenc_display* display, int argc, char** argv) {
     int x = atoi(argv[0]);
     int y = atoi(argv[1]);
 
-    /* Update cursor properties */
+    /* Update cursor properties, re-rendering only if actually moved */
     guacenc_cursor* cursor = display->cursor;
+    if (cursor->x != x || cursor->y != y)
+        display->modified = true;
+
     cursor->x = x;
     cursor->y = y;
 
@@ -50,6 +50,7 @@ int guacenc_handle_move(guacenc_display* display, int argc, char** argv) {
         return 1;
 
     /* Update layer properties */
+    display->modified = true;
     layer->parent_index = parent_index;
     layer->x = x;
     layer->y = y;
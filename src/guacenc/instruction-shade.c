@@ -43,6 +43,7 @@ int guacenc_handle_shade(guacenc_display* display, int argc, char** argv) {
         return 1;
 
     /* Update layer properties */
+    display->modified = true;
     layer->opacity = opacity;
 
     return 0;
@@ -43,6 +43,8 @@ int guacenc_handle_size(guacenc_display* display, int argc, char** argv) {
     if (buffer == NULL)
         return 1;
 
+    guacenc_display_mark_modified(display, index);
+
     /* Resize layer/buffer */
     return guacenc_buffer_resize(buffer, width, height);
 
@@ -21,10 +21,12 @@
 #include "display.h"
 #include "instructions.h"
 #include "log.h"
+#include "profile.h"
 
 #include <guacamole/client.h>
+#include <guacamole/opcode.h>
 
-#include <string.h>
+#include <pthread.h>
 
 guacenc_instruction_handler_mapping guacenc_instruction_handler_map[] = {
     {"blob",     guacenc_handle_blob},
@@ -44,31 +46,62 @@ guacenc_instruction_handler_mapping guacenc_instruction_handler_map[] = {
     {NULL,       NULL}
 };
 
+/**
+ * Index of the entries of guacenc_instruction_handler_map, built upon the
+ * first call to guacenc_handle_instruction().
+ */
+static guac_opcode_index guacenc_instruction_handler_index;
+
+/**
+ * Guard ensuring guacenc_instruction_handler_index is built exactly once.
+ */
+static pthread_once_t guacenc_instruction_handler_index_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Builds guacenc_instruction_handler_index. This function is
+ * intended to be invoked only through pthread_once().
+ */
+static void guacenc_instruction_handler_init_index(void) {
+    guac_opcode_index_init(&guacenc_instruction_handler_index,
+            guacenc_instruction_handler_map,
+            sizeof(guacenc_instruction_handler_mapping));
+}
+
 int guacenc_handle_instruction(guacenc_display* display, const char* opcode,
         int argc, char** argv) {
 
-    /* Search through mapping for instruction handler having given opcode */
-    guacenc_instruction_handler_mapping* current = guacenc_instruction_handler_map;
-    while (current->opcode != NULL) {
+    /* Build index of mapping if not yet built */
+    pthread_once(&guacenc_instruction_handler_index_once,
+            guacenc_instruction_handler_init_index);
+
+    /* Look up instruction handler having given opcode */
+    const guacenc_instruction_handler_mapping* current =
+        guac_opcode_index_find(&guacenc_instruction_handler_index,
+                guacenc_instruction_handler_map,
+                sizeof(guacenc_instruction_handler_mapping), opcode);
+
+    /* Invoke handler if opcode matches (if defined) */
+    if (current != NULL) {
+
+        /* Invoke defined handler */
+        guacenc_instruction_handler* handler = current->handler;
+        if (handler != NULL) {
 
-        /* Invoke handler if opcode matches (if defined) */
-        if (strcmp(current->opcode, opcode) == 0) {
+            uint64_t start = guacenc_profile_start();
+            int result = handler(display, argc, argv);
 
-            /* Invoke defined handler */
-            guacenc_instruction_handler* handler = current->handler;
-            if (handler != NULL)
-                return handler(display, argc, argv);
+            guacenc_profile_stop(&guacenc_profile_stats.instructions[
+                    current - guacenc_instruction_handler_map], start);
 
-            /* Log defined but unimplemented instructions */
-            guacenc_log(GUAC_LOG_DEBUG, "\"%s\" not implemented", opcode);
-            return 0;
+            return result;
 
         }
 
-        /* Next candidate handler */
-        current++;
+        /* Log defined but unimplemented instructions */
+        guacenc_log(GUAC_LOG_DEBUG, "\"%s\" not implemented", opcode);
+        return 0;
 
-    } /* end opcode search */
+    }
 
     /* Ignore any unknown instructions */
     return 0;
@@ -65,6 +65,13 @@ typedef struct guacenc_layer {
      */
     int z;
 
+    /**
+     * The number of ancestors of this layer, as calculated at the beginning
+     * of the most recent flattening of the display. This value is used only
+     * to determine the order in which layers are rendered.
+     */
+    int depth;
+
     /**
      * The opacity of this layer, where 0 is completely transparent and 255 is
      * completely opaque.
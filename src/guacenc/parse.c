@@ -18,6 +18,8 @@
  */
 
 #include "config.h"
+#include "parse.h"
+#include "video.h"
 
 #include <guacamole/timestamp.h>
 
@@ -69,6 +71,25 @@ int guacenc_parse_dimensions(char* arg, int* width, int* height) {
 
 }
 
+int guacenc_parse_hwaccel(const char* arg, guacenc_video_hwaccel* hwaccel) {
+
+    if (strcmp(arg, "nvenc") == 0)
+        *hwaccel = GUACENC_VIDEO_HWACCEL_NVENC;
+
+    else if (strcmp(arg, "vaapi") == 0)
+        *hwaccel = GUACENC_VIDEO_HWACCEL_VAAPI;
+
+    else if (strcmp(arg, "qsv") == 0)
+        *hwaccel = GUACENC_VIDEO_HWACCEL_QSV;
+
+    /* No other backends are supported */
+    else
+        return 1;
+
+    return 0;
+
+}
+
 guac_timestamp guacenc_parse_timestamp(const char* str) {
 
     int sign = 1;
@@ -21,6 +21,7 @@
 #define GUACENC_PARSE_H
 
 #include "config.h"
+#include "video.h"
 
 #include <guacamole/timestamp.h>
 
@@ -65,6 +66,24 @@ int guacenc_parse_int(char* arg, int* i);
  */
 int guacenc_parse_dimensions(char* arg, int* width, int* height);
 
+/**
+ * Parses the name of a hardware encoding backend ("nvenc", "vaapi", or
+ * "qsv"). A value will be stored in the provided guacenc_video_hwaccel
+ * pointer only if the given name is valid.
+ *
+ * @param arg
+ *     The string to parse.
+ *
+ * @param hwaccel
+ *     A pointer to the guacenc_video_hwaccel in which the backend named by
+ *     the given string should be stored.
+ *
+ * @return
+ *     Zero if parsing was successful, non-zero if the provided string does
+ *     not name a supported hardware encoding backend.
+ */
+int guacenc_parse_hwaccel(const char* arg, guacenc_video_hwaccel* hwaccel);
+
 /**
  * Parses a guac_timestamp from the given string. The string is assumed to
  * consist solely of decimal digits with an optional leading minus sign. If the
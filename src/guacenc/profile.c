@@ -0,0 +1,127 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "image-stream.h"
+#include "instructions.h"
+#include "log.h"
+#include "profile.h"
+
+#include <guacamole/client.h>
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <time.h>
+
+guacenc_profile guacenc_profile_stats;
+
+uint64_t guacenc_profile_start() {
+
+    if (!guacenc_profile_stats.enabled)
+        return 0;
+
+    struct timespec current;
+    clock_gettime(CLOCK_MONOTONIC, &current);
+
+    return (uint64_t) current.tv_sec * 1000000000 + current.tv_nsec;
+
+}
+
+void guacenc_profile_stop(guacenc_profile_counter* counter, uint64_t start) {
+
+    if (!guacenc_profile_stats.enabled)
+        return;
+
+    uint64_t elapsed = guacenc_profile_start() - start;
+
+    __atomic_add_fetch(&counter->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counter->nanoseconds, elapsed, __ATOMIC_RELAXED);
+
+}
+
+/**
+ * Logs the profiling information recorded within the given counter, if the
+ * associated operation has occurred at least once.
+ *
+ * @param category
+ *     The category of the profiled operation, such as "instruction".
+ *
+ * @param name
+ *     The name of the profiled operation within that category.
+ *
+ * @param counter
+ *     The counter associated with the profiled operation.
+ */
+static void guacenc_profile_report_counter(const char* category,
+        const char* name, guacenc_profile_counter* counter) {
+
+    uint64_t count = __atomic_load_n(&counter->count, __ATOMIC_RELAXED);
+    uint64_t nanoseconds = __atomic_load_n(&counter->nanoseconds,
+            __ATOMIC_RELAXED);
+
+    if (count == 0)
+        return;
+
+    guacenc_log(GUAC_LOG_INFO, "Profile: %-11s %-10s %10" PRIu64 " times, "
+            "%10.3f ms total, %8.3f us average", category, name, count,
+            nanoseconds / 1000000.0, nanoseconds / 1000.0 / count);
+
+}
+
+void guacenc_profile_report() {
+
+    if (!guacenc_profile_stats.enabled)
+        return;
+
+    /* Time spent within each instruction handler */
+    guacenc_instruction_handler_mapping* handler =
+        guacenc_instruction_handler_map;
+
+    for (int i = 0; handler->opcode != NULL
+            && i < GUACENC_PROFILE_MAX_ENTRIES; i++, handler++)
+        guacenc_profile_report_counter("instruction", handler->opcode,
+                &guacenc_profile_stats.instructions[i]);
+
+    /* Time spent decoding each type of image */
+    guacenc_decoder_mapping* decoder = guacenc_decoder_map;
+    for (int i = 0; decoder->mimetype != NULL
+            && i < GUACENC_PROFILE_MAX_ENTRIES; i++, decoder++)
+        guacenc_profile_report_counter("decode", decoder->mimetype,
+                &guacenc_profile_stats.decoders[i]);
+
+    /* Time spent within each stage of producing video */
+    guacenc_profile_report_counter("video", "composite",
+            &guacenc_profile_stats.composite);
+
+    guacenc_profile_report_counter("video", "scale",
+            &guacenc_profile_stats.scale);
+
+    guacenc_profile_report_counter("video", "encode",
+            &guacenc_profile_stats.encode);
+
+    /* Peak memory usage (reported by Linux in kilobytes) */
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        guacenc_log(GUAC_LOG_INFO, "Profile: peak memory usage: %li KiB",
+                (long) usage.ru_maxrss);
+
+}
+
@@ -0,0 +1,136 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_PROFILE_H
+#define GUACENC_PROFILE_H
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of instruction handlers or image decoders that can be
+ * profiled individually. This must be at least the number of entries within
+ * guacenc_instruction_handler_map and guacenc_decoder_map.
+ */
+#define GUACENC_PROFILE_MAX_ENTRIES 32
+
+/**
+ * The number of times a profiled operation has occurred and the total time
+ * spent within that operation. All members must be accessed atomically, as
+ * operations may be profiled from several threads at once.
+ */
+typedef struct guacenc_profile_counter {
+
+    /**
+     * The number of times the operation has occurred.
+     */
+    uint64_t count;
+
+    /**
+     * The total number of nanoseconds spent within the operation.
+     */
+    uint64_t nanoseconds;
+
+} guacenc_profile_counter;
+
+/**
+ * Profiling information describing where time is spent while encoding,
+ * accumulated across all recordings encoded by the current process.
+ */
+typedef struct guacenc_profile {
+
+    /**
+     * Whether profiling is enabled. If false, no profiling information is
+     * recorded. This must be set before any encoding begins.
+     */
+    bool enabled;
+
+    /**
+     * The time spent within each instruction handler, indexed by the
+     * position of that handler within guacenc_instruction_handler_map. This
+     * time includes that of any of the other operations below which occur
+     * within the handler.
+     */
+    guacenc_profile_counter instructions[GUACENC_PROFILE_MAX_ENTRIES];
+
+    /**
+     * The time spent decoding images, indexed by the position of the
+     * relevant decoder within guacenc_decoder_map.
+     */
+    guacenc_profile_counter decoders[GUACENC_PROFILE_MAX_ENTRIES];
+
+    /**
+     * The time spent flattening (compositing) the display.
+     */
+    guacenc_profile_counter composite;
+
+    /**
+     * The time spent scaling and converting frames with libswscale.
+     */
+    guacenc_profile_counter scale;
+
+    /**
+     * The time spent encoding frames with libavcodec, including any upload
+     * of frames to a hardware encoder.
+     */
+    guacenc_profile_counter encode;
+
+} guacenc_profile;
+
+/**
+ * The profiling information of the current process.
+ */
+extern guacenc_profile guacenc_profile_stats;
+
+/**
+ * Returns the current time for the sake of timing a profiled operation which
+ * will be recorded with guacenc_profile_stop(). If profiling is disabled, the
+ * current time is not read and zero is returned.
+ *
+ * @return
+ *     The current time, in nanoseconds, relative to an arbitrary point in
+ *     time, or zero if profiling is disabled.
+ */
+uint64_t guacenc_profile_start();
+
+/**
+ * Records a single occurrence of the profiled operation associated with the
+ * given counter, which began at the given time. If profiling is disabled,
+ * this function has no effect.
+ *
+ * @param counter
+ *     The counter associated with the profiled operation.
+ *
+ * @param start
+ *     The time at which the operation began, as returned by
+ *     guacenc_profile_start().
+ */
+void guacenc_profile_stop(guacenc_profile_counter* counter, uint64_t start);
+
+/**
+ * Logs all profiling information recorded thus far, including the peak
+ * memory usage of the current process. If profiling is disabled, this
+ * function has no effect.
+ */
+void guacenc_profile_report();
+
+#endif
+
@@ -0,0 +1,214 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "buffer.h"
+#include "log.h"
+#include "thumbnails.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+#include <guacamole/string.h>
+#include <guacamole/timestamp.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+guacenc_thumbnails* guacenc_thumbnails_alloc(const char* path, int width,
+        int height, int interval, guac_timestamp start) {
+
+    guacenc_thumbnails* thumbnails = guac_mem_alloc(sizeof(guacenc_thumbnails));
+    thumbnails->path = guac_strdup(path);
+    thumbnails->width = width;
+    thumbnails->height = height;
+    thumbnails->interval = interval;
+    thumbnails->next = start;
+
+    return thumbnails;
+
+}
+
+void guacenc_thumbnails_free(guacenc_thumbnails* thumbnails) {
+
+    if (thumbnails == NULL)
+        return;
+
+    guac_mem_free(thumbnails->path);
+    guac_mem_free(thumbnails);
+
+}
+
+bool guacenc_thumbnails_due(guacenc_thumbnails* thumbnails,
+        guac_timestamp elapsed) {
+    return elapsed >= thumbnails->next;
+}
+
+/**
+ * Scales the given ARGB32 image down to the given dimensions, averaging all
+ * source pixels covered by each destination pixel (a box filter). As Cairo
+ * image data is premultiplied, each channel can be averaged independently.
+ *
+ * @param src
+ *     The image data of the source image.
+ *
+ * @param src_width
+ *     The width of the source image, in pixels.
+ *
+ * @param src_height
+ *     The height of the source image, in pixels.
+ *
+ * @param src_stride
+ *     The number of bytes in each row of the source image.
+ *
+ * @param dst
+ *     The image data of the destination image.
+ *
+ * @param dst_width
+ *     The width of the destination image, in pixels. This must not exceed the
+ *     width of the source image.
+ *
+ * @param dst_height
+ *     The height of the destination image, in pixels. This must not exceed the
+ *     height of the source image.
+ *
+ * @param dst_stride
+ *     The number of bytes in each row of the destination image.
+ */
+static void guacenc_thumbnails_downscale(const unsigned char* src,
+        int src_width, int src_height, int src_stride, unsigned char* dst,
+        int dst_width, int dst_height, int dst_stride) {
+
+    for (int dy = 0; dy < dst_height; dy++) {
+
+        /* Rows of the source image covered by this row */
+        int sy_start = dy * src_height / dst_height;
+        int sy_end = (dy + 1) * src_height / dst_height;
+
+        uint32_t* dst_row = (uint32_t*) (dst + dy * dst_stride);
+        for (int dx = 0; dx < dst_width; dx++) {
+
+            /* Columns of the source image covered by this pixel */
+            int sx_start = dx * src_width / dst_width;
+            int sx_end = (dx + 1) * src_width / dst_width;
+
+            uint64_t a = 0, r = 0, g = 0, b = 0;
+            for (int sy = sy_start; sy < sy_end; sy++) {
+
+                const uint32_t* src_row =
+                    (const uint32_t*) (src + sy * src_stride);
+
+                for (int sx = sx_start; sx < sx_end; sx++) {
+                    uint32_t color = src_row[sx];
+                    a += (color >> 24);
+                    r += (color >> 16) & 0xFF;
+                    g += (color >> 8) & 0xFF;
+                    b += color & 0xFF;
+                }
+
+            }
+
+            uint64_t count = (uint64_t) (sy_end - sy_start)
+                           * (sx_end - sx_start);
+
+            dst_row[dx] = (uint32_t) (a / count) << 24
+                        | (uint32_t) (r / count) << 16
+                        | (uint32_t) (g / count) << 8
+                        | (uint32_t) (b / count);
+
+        }
+
+    }
+
+}
+
+int guacenc_thumbnails_write(guacenc_thumbnails* thumbnails,
+        guacenc_buffer* frame, guac_timestamp elapsed) {
+
+    /* Schedule the following thumbnail */
+    if (thumbnails->interval > 0) {
+        while (thumbnails->next <= elapsed)
+            thumbnails->next += thumbnails->interval;
+    }
+
+    /* Nothing to sample if the display is empty */
+    if (frame->surface == NULL)
+        return 0;
+
+    /* Fit frame within the thumbnail dimensions, preserving aspect ratio and
+     * never scaling up */
+    int width = frame->width;
+    int height = frame->height;
+
+    if (width > thumbnails->width) {
+        height = height * thumbnails->width / width;
+        width = thumbnails->width;
+    }
+
+    if (height > thumbnails->height) {
+        width = width * thumbnails->height / height;
+        height = thumbnails->height;
+    }
+
+    if (width <= 0)
+        width = 1;
+
+    if (height <= 0)
+        height = 1;
+
+    /* Generate thumbnail filename */
+    char path[4096];
+    int len = snprintf(path, sizeof(path), "%s.%08" PRId64 ".png",
+            thumbnails->path, (int64_t) elapsed);
+
+    if (len >= sizeof(path)) {
+        guacenc_log(GUAC_LOG_ERROR, "Cannot write thumbnail for \"%s\": "
+                "Name too long", thumbnails->path);
+        return 1;
+    }
+
+    cairo_surface_t* thumbnail = cairo_image_surface_create(
+            CAIRO_FORMAT_ARGB32, width, height);
+
+    /* Scale directly from the flattened frame, which must be up-to-date */
+    cairo_surface_flush(frame->surface);
+    cairo_surface_flush(thumbnail);
+    guacenc_thumbnails_downscale(frame->image, frame->width, frame->height,
+            frame->stride, cairo_image_surface_get_data(thumbnail),
+            width, height, cairo_image_surface_get_stride(thumbnail));
+    cairo_surface_mark_dirty(thumbnail);
+
+    cairo_status_t status = cairo_surface_write_to_png(thumbnail, path);
+    cairo_surface_destroy(thumbnail);
+
+    if (status != CAIRO_STATUS_SUCCESS) {
+        guacenc_log(GUAC_LOG_ERROR, "Cannot write thumbnail \"%s\": %s",
+                path, cairo_status_to_string(status));
+        return 1;
+    }
+
+    guacenc_log(GUAC_LOG_DEBUG, "Wrote thumbnail \"%s\" (%ix%i).",
+            path, width, height);
+
+    return 0;
+
+}
+
@@ -0,0 +1,157 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_THUMBNAILS_H
+#define GUACENC_THUMBNAILS_H
+
+#include "config.h"
+#include "buffer.h"
+
+#include <guacamole/timestamp.h>
+
+#include <stdbool.h>
+
+/**
+ * The maximum width of each thumbnail, in pixels, if no other width is given
+ * on the command line.
+ */
+#define GUACENC_THUMBNAILS_DEFAULT_WIDTH 320
+
+/**
+ * The maximum height of each thumbnail, in pixels, if no other height is
+ * given on the command line.
+ */
+#define GUACENC_THUMBNAILS_DEFAULT_HEIGHT 240
+
+/**
+ * A series of thumbnails of a recording, sampled from the flattened display
+ * at fixed intervals (or at each frame) and written as individual PNG images
+ * in place of encoded video.
+ */
+typedef struct guacenc_thumbnails {
+
+    /**
+     * The path of the recording being sampled. Each thumbnail is saved to a
+     * file whose name is this path followed by the number of milliseconds
+     * into the recording at which the thumbnail was sampled.
+     */
+    char* path;
+
+    /**
+     * The maximum width of each thumbnail, in pixels.
+     */
+    int width;
+
+    /**
+     * The maximum height of each thumbnail, in pixels.
+     */
+    int height;
+
+    /**
+     * The number of milliseconds between each thumbnail, or zero if a
+     * thumbnail should be sampled for every frame.
+     */
+    int interval;
+
+    /**
+     * The number of milliseconds into the recording at which the next
+     * thumbnail should be sampled.
+     */
+    guac_timestamp next;
+
+} guacenc_thumbnails;
+
+/**
+ * Allocates a new series of thumbnails for the recording having the given
+ * path. No thumbnails are written until guacenc_thumbnails_write() is
+ * invoked.
+ *
+ * @param path
+ *     The path of the recording being sampled, which is used as the prefix
+ *     of the name of each thumbnail written.
+ *
+ * @param width
+ *     The maximum width of each thumbnail, in pixels.
+ *
+ * @param height
+ *     The maximum height of each thumbnail, in pixels.
+ *
+ * @param interval
+ *     The number of milliseconds between each thumbnail, or zero if a
+ *     thumbnail should be sampled for every frame.
+ *
+ * @param start
+ *     The number of milliseconds into the recording at which the first
+ *     thumbnail should be sampled.
+ *
+ * @return
+ *     A newly-allocated guacenc_thumbnails, which must eventually be freed
+ *     with guacenc_thumbnails_free().
+ */
+guacenc_thumbnails* guacenc_thumbnails_alloc(const char* path, int width,
+        int height, int interval, guac_timestamp start);
+
+/**
+ * Returns whether a thumbnail should be sampled for the frame at the given
+ * point in time.
+ *
+ * @param thumbnails
+ *     The series of thumbnails being written.
+ *
+ * @param elapsed
+ *     The number of milliseconds into the recording of the current frame.
+ *
+ * @return
+ *     true if a thumbnail should be sampled for the current frame, false
+ *     otherwise.
+ */
+bool guacenc_thumbnails_due(guacenc_thumbnails* thumbnails,
+        guac_timestamp elapsed);
+
+/**
+ * Scales down the given flattened frame using a box filter, such that it fits
+ * within the maximum dimensions of the given thumbnails while preserving its
+ * aspect ratio, and writes the result as the next thumbnail in the series.
+ *
+ * @param thumbnails
+ *     The series of thumbnails being written.
+ *
+ * @param frame
+ *     The flattened frame to sample.
+ *
+ * @param elapsed
+ *     The number of milliseconds into the recording of the given frame.
+ *
+ * @return
+ *     Zero if the thumbnail was written successfully, non-zero otherwise.
+ */
+int guacenc_thumbnails_write(guacenc_thumbnails* thumbnails,
+        guacenc_buffer* frame, guac_timestamp elapsed);
+
+/**
+ * Frees all memory associated with the given series of thumbnails. If the
+ * given series is NULL, this function has no effect.
+ *
+ * @param thumbnails
+ *     The series of thumbnails to free, which may be NULL.
+ */
+void guacenc_thumbnails_free(guacenc_thumbnails* thumbnails);
+
+#endif
+
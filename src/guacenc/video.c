@@ -21,6 +21,7 @@
 #include "buffer.h"
 #include "ffmpeg-compat.h"
 #include "log.h"
+#include "profile.h"
 #include "video.h"
 
 #include <cairo/cairo.h>
@@ -30,8 +31,12 @@
 #endif
 #include <libavutil/common.h>
 #include <libavutil/imgutils.h>
+#ifdef GUACENC_HAVE_HWCONTEXT
+#include <libavutil/hwcontext.h>
+#endif
 #include <libswscale/swscale.h>
 #include <guacamole/client.h>
+#include <guacamole/fifo.h>
 #include <guacamole/mem.h>
 #include <guacamole/timestamp.h>
 
@@ -41,12 +46,203 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+/**
+ * The encoding thread of a guacenc_video, handling each queued
+ * guacenc_video_job in order until a GUACENC_VIDEO_JOB_STOP job is received.
+ *
+ * @param data
+ *     A pointer to the guacenc_video whose jobs should be handled.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacenc_video_encoder_thread(void* data);
+
+#ifdef GUACENC_HAVE_HWCONTEXT
+/**
+ * The libavcodec encoder and hardware device associated with a hardware
+ * encoding backend.
+ */
+typedef struct guacenc_video_hwaccel_backend {
+
+    /**
+     * The name of the libavcodec encoder which encodes frames using the
+     * hardware device.
+     */
+    const char* codec_name;
+
+    /**
+     * The type of the hardware device.
+     */
+    enum AVHWDeviceType device_type;
+
+    /**
+     * The pixel format of frames stored on the hardware device.
+     */
+    enum AVPixelFormat hw_format;
+
+    /**
+     * The pixel format of frames as uploaded to the hardware device. Where
+     * the device accepts RGB, the conversion to YCbCr is left to the device.
+     */
+    enum AVPixelFormat sw_format;
+
+} guacenc_video_hwaccel_backend;
+
+/**
+ * All hardware encoding backends, indexed by their corresponding
+ * guacenc_video_hwaccel values.
+ */
+static const guacenc_video_hwaccel_backend guacenc_video_hwaccel_backends[] = {
+
+    [GUACENC_VIDEO_HWACCEL_NVENC] = {
+        .codec_name  = "h264_nvenc",
+        .device_type = AV_HWDEVICE_TYPE_CUDA,
+        .hw_format   = AV_PIX_FMT_CUDA,
+        .sw_format   = AV_PIX_FMT_RGB32
+    },
+
+    [GUACENC_VIDEO_HWACCEL_VAAPI] = {
+        .codec_name  = "h264_vaapi",
+        .device_type = AV_HWDEVICE_TYPE_VAAPI,
+        .hw_format   = AV_PIX_FMT_VAAPI,
+        .sw_format   = AV_PIX_FMT_NV12
+    },
+
+    [GUACENC_VIDEO_HWACCEL_QSV] = {
+        .codec_name  = "h264_qsv",
+        .device_type = AV_HWDEVICE_TYPE_QSV,
+        .hw_format   = AV_PIX_FMT_QSV,
+        .sw_format   = AV_PIX_FMT_NV12
+    }
+
+};
+
+/**
+ * Allocates and opens an encoding context for the given hardware encoding
+ * backend, opening the default hardware device of that backend and creating
+ * the pool of hardware frames that encoded frames must be uploaded to. If
+ * the backend cannot be used, a warning is logged and NULL is returned.
+ *
+ * @param container_format_context
+ *     The format context of the container that encoded video will be written
+ *     to.
+ *
+ * @param stream
+ *     The stream that encoded video will be written to.
+ *
+ * @param hwaccel
+ *     The hardware encoding backend to use. This must not be
+ *     GUACENC_VIDEO_HWACCEL_NONE.
+ *
+ * @param width
+ *     The width of the desired video, in pixels.
+ *
+ * @param height
+ *     The height of the desired video, in pixels.
+ *
+ * @param bitrate
+ *     The desired overall bitrate of the resulting encoded video, in bits per
+ *     second.
+ *
+ * @param hw_frames_context
+ *     A pointer to the AVBufferRef that should receive a new reference to the
+ *     pool of hardware frames, if the backend can be used.
+ *
+ * @return
+ *     The open encoding context, or NULL if the backend cannot be used.
+ */
+static AVCodecContext* guacenc_video_open_hwaccel(
+        AVFormatContext* container_format_context, AVStream* stream,
+        guacenc_video_hwaccel hwaccel, int width, int height, int bitrate,
+        AVBufferRef** hw_frames_context) {
+
+    const guacenc_video_hwaccel_backend* backend =
+        &guacenc_video_hwaccel_backends[hwaccel];
+
+    /* Pull hardware encoder based on name */
+    const AVCodec* codec = avcodec_find_encoder_by_name(backend->codec_name);
+    if (codec == NULL) {
+        guacenc_log(GUAC_LOG_WARNING, "Hardware encoder \"%s\" is not "
+                "available.", backend->codec_name);
+        return NULL;
+    }
+
+    /* Open default device of the backend */
+    AVBufferRef* device = NULL;
+    if (av_hwdevice_ctx_create(&device, backend->device_type,
+                NULL, NULL, 0) < 0) {
+        guacenc_log(GUAC_LOG_WARNING, "Unable to open hardware device for "
+                "encoder \"%s\".", backend->codec_name);
+        return NULL;
+    }
+
+    /* Allocate pool of hardware frames on that device (the pool holds its
+     * own reference to the device) */
+    AVBufferRef* frames = av_hwframe_ctx_alloc(device);
+    av_buffer_unref(&device);
+    if (frames == NULL)
+        return NULL;
+
+    AVHWFramesContext* frames_context = (AVHWFramesContext*) frames->data;
+    frames_context->format = backend->hw_format;
+    frames_context->sw_format = backend->sw_format;
+    frames_context->width = width;
+    frames_context->height = height;
+    frames_context->initial_pool_size = GUACENC_VIDEO_HWACCEL_POOL_SIZE;
+
+    if (av_hwframe_ctx_init(frames) < 0) {
+        guacenc_log(GUAC_LOG_WARNING, "Unable to allocate hardware frames "
+                "for encoder \"%s\".", backend->codec_name);
+        av_buffer_unref(&frames);
+        return NULL;
+    }
+
+    /* Retrieve encoding context */
+    AVCodecContext* avcodec_context =
+            guacenc_build_avcodeccontext(stream, codec, bitrate, width,
+                    height, /*gop size*/ 10, /*qmax*/ 31, /*qmin*/ 2,
+                    /*pix fmt*/ backend->hw_format,
+                    /*time base*/ (AVRational) { 1, GUACENC_VIDEO_FRAMERATE });
+
+    if (avcodec_context == NULL) {
+        av_buffer_unref(&frames);
+        return NULL;
+    }
+
+    /* If format needs global headers, write them */
+    if (container_format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+        avcodec_context->flags |= GUACENC_FLAG_GLOBAL_HEADER;
+    }
+
+    /* Open codec for use with the pool of hardware frames */
+    avcodec_context->hw_frames_ctx = av_buffer_ref(frames);
+    if (avcodec_context->hw_frames_ctx == NULL
+            || guacenc_open_avcodec(avcodec_context, codec, NULL, stream) < 0) {
+        guacenc_log(GUAC_LOG_WARNING, "Failed to open hardware encoder "
+                "\"%s\".", backend->codec_name);
+        avcodec_free_context(&avcodec_context);
+        av_buffer_unref(&frames);
+        return NULL;
+    }
+
+    guacenc_log(GUAC_LOG_DEBUG, "Using hardware encoder \"%s\".",
+            backend->codec_name);
+
+    *hw_frames_context = frames;
+    return avcodec_context;
+
+}
+#endif
+
 guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
-        int width, int height, int bitrate) {
+        guacenc_video_hwaccel hwaccel, int width, int height, int bitrate,
+        bool fragmented) {
 
     const AVOutputFormat *container_format;
     AVFormatContext *container_format_context;
@@ -80,28 +276,54 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
     }
     video_stream->id = container_format_context->nb_streams - 1;
 
-    /* Retrieve encoding context */
-    AVCodecContext* avcodec_context =
-            guacenc_build_avcodeccontext(video_stream, codec, bitrate, width,
-                    height, /*gop size*/ 10, /*qmax*/ 31, /*qmin*/ 2,
-                    /*pix fmt*/ AV_PIX_FMT_YUV420P,
-                    /*time base*/ (AVRational) { 1, GUACENC_VIDEO_FRAMERATE });
+    AVCodecContext* avcodec_context = NULL;
+    AVBufferRef* hw_frames_context = NULL;
 
-    if (avcodec_context == NULL) {
-        guacenc_log(GUAC_LOG_ERROR, "Failed to allocate context for "
-                "codec \"%s\".", codec_name);
-        goto fail_context;
-    }
+    /* Attempt to use requested hardware encoding backend, if any */
+    if (hwaccel != GUACENC_VIDEO_HWACCEL_NONE) {
+
+#ifdef GUACENC_HAVE_HWCONTEXT
+        avcodec_context = guacenc_video_open_hwaccel(container_format_context,
+                video_stream, hwaccel, width, height, bitrate,
+                &hw_frames_context);
+#else
+        guacenc_log(GUAC_LOG_WARNING, "Hardware encoding is not supported "
+                "by this build of libavutil.");
+#endif
+
+        if (avcodec_context == NULL)
+            guacenc_log(GUAC_LOG_WARNING, "Falling back to software "
+                    "encoding with codec \"%s\".", codec_name);
 
-    /* If format needs global headers, write them */
-    if (container_format_context->oformat->flags & AVFMT_GLOBALHEADER) {
-        avcodec_context->flags |= GUACENC_FLAG_GLOBAL_HEADER;
     }
 
-    /* Open codec for use */
-    if (guacenc_open_avcodec(avcodec_context, codec, NULL, video_stream) < 0) {
-        guacenc_log(GUAC_LOG_ERROR, "Failed to open codec \"%s\".", codec_name);
-        goto fail_codec_open;
+    /* Otherwise, encode in software */
+    if (avcodec_context == NULL) {
+
+        /* Retrieve encoding context */
+        avcodec_context =
+                guacenc_build_avcodeccontext(video_stream, codec, bitrate,
+                        width, height, /*gop size*/ 10, /*qmax*/ 31,
+                        /*qmin*/ 2, /*pix fmt*/ AV_PIX_FMT_YUV420P,
+                        /*time base*/ (AVRational) { 1, GUACENC_VIDEO_FRAMERATE });
+
+        if (avcodec_context == NULL) {
+            guacenc_log(GUAC_LOG_ERROR, "Failed to allocate context for "
+                    "codec \"%s\".", codec_name);
+            goto fail_context;
+        }
+
+        /* If format needs global headers, write them */
+        if (container_format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+            avcodec_context->flags |= GUACENC_FLAG_GLOBAL_HEADER;
+        }
+
+        /* Open codec for use */
+        if (guacenc_open_avcodec(avcodec_context, codec, NULL, video_stream) < 0) {
+            guacenc_log(GUAC_LOG_ERROR, "Failed to open codec \"%s\".", codec_name);
+            goto fail_codec_open;
+        }
+
     }
 
     /* Allocate corresponding frame */
@@ -110,8 +332,13 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
         goto fail_frame;
     }
 
-    /* Copy necessary data for frame from context */
+    /* Copy necessary data for frame from context (frames destined for a
+     * hardware device are prepared in the format uploaded to that device) */
     frame->format = avcodec_context->pix_fmt;
+#ifdef GUACENC_HAVE_HWCONTEXT
+    if (hw_frames_context != NULL)
+        frame->format = ((AVHWFramesContext*) hw_frames_context->data)->sw_format;
+#endif
     frame->width = avcodec_context->width;
     frame->height = avcodec_context->height;
 
@@ -130,8 +357,16 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
         }
     }
 
+    /* Write fragments which can be played as soon as they are written, rather
+     * than a single index at the end of the file, if requested */
+    AVDictionary* options = NULL;
+    if (fragmented)
+        av_dict_set(&options, "movflags",
+                "frag_keyframe+empty_moov+default_base_moof", 0);
+
     /* write the stream header, if needed */
-    ret = avformat_write_header(container_format_context, NULL);
+    ret = avformat_write_header(container_format_context, &options);
+    av_dict_free(&options);
     if (ret < 0) {
         guacenc_log(GUAC_LOG_ERROR, "Error occurred while writing output file header.");
         failed_header = true;
@@ -148,6 +383,7 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
     video->context = avcodec_context;
     video->container_format_context = container_format_context;
     video->next_frame = frame;
+    video->hw_frames_context = hw_frames_context;
     video->width = width;
     video->height = height;
     video->bitrate = bitrate;
@@ -155,6 +391,20 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
     /* No frames have been written or prepared yet */
     video->last_timestamp = 0;
     video->next_pts = 0;
+    video->failed = 0;
+
+    /* Perform all scaling, conversion, and encoding in parallel with the
+     * parsing and rendering of the recording */
+    guac_fifo_init(&video->jobs, video->job_items,
+            GUACENC_VIDEO_JOB_QUEUE_SIZE, sizeof(guacenc_video_job));
+
+    if (pthread_create(&video->encoder_thread, NULL,
+                guacenc_video_encoder_thread, video)) {
+        guacenc_log(GUAC_LOG_ERROR, "Unable to start video encoding thread.");
+        guac_fifo_destroy(&video->jobs);
+        guac_mem_free(video);
+        goto fail_alloc_video;
+    }
 
     return video;
 
@@ -175,6 +425,8 @@ fail_frame_data:
     av_frame_free(&frame);
 
 fail_frame:
+    av_buffer_unref(&hw_frames_context);
+
 fail_codec_open:
     avcodec_free_context(&avcodec_context);
 
@@ -190,6 +442,44 @@ fail_codec:
 
 }
 
+#ifdef GUACENC_HAVE_HWCONTEXT
+/**
+ * Uploads the given frame to the hardware device of the given video,
+ * returning a new hardware frame having the same contents and timestamp.
+ *
+ * @param video
+ *     The video whose hardware device the frame should be uploaded to. This
+ *     video must be using a hardware encoding backend.
+ *
+ * @param frame
+ *     The frame to upload, which must be in the software format of the
+ *     video's pool of hardware frames.
+ *
+ * @return
+ *     A newly-allocated hardware frame which must eventually be freed with
+ *     av_frame_free(), or NULL if the frame could not be uploaded.
+ */
+static AVFrame* guacenc_video_upload_frame(guacenc_video* video,
+        AVFrame* frame) {
+
+    AVFrame* hw_frame = av_frame_alloc();
+    if (hw_frame == NULL)
+        return NULL;
+
+    if (av_hwframe_get_buffer(video->hw_frames_context, hw_frame, 0) < 0
+            || av_hwframe_transfer_data(hw_frame, frame, 0) < 0) {
+        guacenc_log(GUAC_LOG_ERROR, "Unable to upload frame #%" PRId64
+                " to hardware device.", video->next_pts);
+        av_frame_free(&hw_frame);
+        return NULL;
+    }
+
+    hw_frame->pts = frame->pts;
+    return hw_frame;
+
+}
+#endif
+
 /**
  * Flushes the specified frame as a new frame of video, updating the internal
  * video timestamp by one frame's worth of time. The pts member of the given
@@ -211,12 +501,31 @@ fail_codec:
  */
 static int guacenc_video_write_frame(guacenc_video* video, AVFrame* frame) {
 
+    uint64_t start = guacenc_profile_start();
+
     /* Set timestamp of frame, if frame given */
     if (frame != NULL)
         frame->pts = video->next_pts;
 
+    /* Frames must first be uploaded if encoding in hardware */
+    AVFrame* hw_frame = NULL;
+#ifdef GUACENC_HAVE_HWCONTEXT
+    if (frame != NULL && video->hw_frames_context != NULL) {
+
+        hw_frame = guacenc_video_upload_frame(video, frame);
+        if (hw_frame == NULL)
+            return -1;
+
+        frame = hw_frame;
+
+    }
+#endif
+
     /* Write frame to video */
     int got_data = guacenc_avcodec_encode_video(video, frame);
+    av_frame_free(&hw_frame);
+
+    guacenc_profile_stop(&guacenc_profile_stats.encode, start);
     if (got_data < 0)
         return -1;
 
@@ -267,13 +576,17 @@ int guacenc_video_advance_timeline(guacenc_video* video,
                         + elapsed * 1000 / GUACENC_VIDEO_FRAMERATE;
 
         /* Flush frames to bring timeline in sync, duplicating if necessary */
-        do {
-            if (guacenc_video_flush_frame(video)) {
-                guacenc_log(GUAC_LOG_ERROR, "Unable to flush frame to video "
-                        "stream.");
-                return 1;
-            }
-        } while (--elapsed != 0);
+        guacenc_video_job job = {
+            .type = GUACENC_VIDEO_JOB_FLUSH,
+            .count = elapsed
+        };
+
+        if (__atomic_load_n(&video->failed, __ATOMIC_ACQUIRE)
+                || !guac_fifo_enqueue(&video->jobs, &job)) {
+            guacenc_log(GUAC_LOG_ERROR, "Unable to flush frame to video "
+                    "stream.");
+            return 1;
+        }
 
     }
 
@@ -407,7 +720,9 @@ void guacenc_video_prepare_frame(guacenc_video* video, guacenc_buffer* buffer) {
     if (buffer == NULL || buffer->surface == NULL)
         return;
 
-    /* Obtain destination frame */
+    /* Obtain destination frame (only the dimensions of this frame are used
+     * here, which never change, as its contents are owned by the encoding
+     * thread) */
     AVFrame* dst = video->next_frame;
 
     /* Determine width of image if height is scaled to match destination */
@@ -439,9 +754,39 @@ void guacenc_video_prepare_frame(guacenc_video* video, guacenc_buffer* buffer) {
         return;
     }
 
+    /* Scale and convert the copied frame within the encoding thread */
+    guacenc_video_job job = {
+        .type = GUACENC_VIDEO_JOB_PREPARE,
+        .source = src
+    };
+
+    if (!guac_fifo_enqueue(&video->jobs, &job)) {
+        av_freep(&src->data[0]);
+        av_frame_free(&src);
+    }
+
+}
+
+/**
+ * Scales and converts the given RGB32 frame, replacing the contents of the
+ * frame that will be written upon the next flush. The given frame and its
+ * image data are freed by this function.
+ *
+ * @param video
+ *     The video whose next frame should be replaced.
+ *
+ * @param src
+ *     The RGB32 frame produced by guacenc_video_frame_convert() that should
+ *     become the next frame of video.
+ */
+static void guacenc_video_scale_frame(guacenc_video* video, AVFrame* src) {
+
+    /* Obtain destination frame */
+    AVFrame* dst = video->next_frame;
+
     /* Prepare scaling context */
     struct SwsContext* sws = sws_getContext(src->width, src->height,
-            AV_PIX_FMT_RGB32, dst->width, dst->height, AV_PIX_FMT_YUV420P,
+            AV_PIX_FMT_RGB32, dst->width, dst->height, dst->format,
             SWS_BICUBIC, NULL, NULL, NULL);
 
     /* Abort if scaling context could not be created */
@@ -454,8 +799,10 @@ void guacenc_video_prepare_frame(guacenc_video* video, guacenc_buffer* buffer) {
     }
 
     /* Apply scaling, copying the source frame to the destination */
+    uint64_t start = guacenc_profile_start();
     sws_scale(sws, (const uint8_t* const*) src->data, src->linesize,
             0, src->height, dst->data, dst->linesize);
+    guacenc_profile_stop(&guacenc_profile_stats.scale, start);
 
     /* Free scaling context */
     sws_freeContext(sws);
@@ -466,12 +813,53 @@ void guacenc_video_prepare_frame(guacenc_video* video, guacenc_buffer* buffer) {
 
 }
 
+static void* guacenc_video_encoder_thread(void* data) {
+
+    guacenc_video* video = (guacenc_video*) data;
+
+    guacenc_video_job job;
+    while (guac_fifo_dequeue(&video->jobs, &job)) {
+
+        switch (job.type) {
+
+            case GUACENC_VIDEO_JOB_PREPARE:
+                guacenc_video_scale_frame(video, job.source);
+                break;
+
+            case GUACENC_VIDEO_JOB_FLUSH:
+
+                /* Stop writing frames after the first failure, reporting the
+                 * failure to the thread reading the recording */
+                while (job.count-- > 0 && !video->failed) {
+                    if (guacenc_video_flush_frame(video))
+                        __atomic_store_n(&video->failed, 1, __ATOMIC_RELEASE);
+                }
+
+                break;
+
+            case GUACENC_VIDEO_JOB_STOP:
+                return NULL;
+
+        }
+
+    }
+
+    return NULL;
+
+}
+
 int guacenc_video_free(guacenc_video* video) {
 
     /* Ignore NULL video */
     if (video == NULL)
         return 0;
 
+    /* Wait for all queued jobs to be completed */
+    guacenc_video_job job = { .type = GUACENC_VIDEO_JOB_STOP };
+    guac_fifo_enqueue(&video->jobs, &job);
+    pthread_join(video->encoder_thread, NULL);
+    guac_fifo_destroy(&video->jobs);
+
     /* Write final frame */
     guacenc_video_flush_frame(video);
 
@@ -497,6 +885,7 @@ int guacenc_video_free(guacenc_video* video) {
     /* Free frame encoding data */
     av_freep(&video->next_frame->data[0]);
     av_frame_free(&video->next_frame);
+    av_buffer_unref(&video->hw_frames_context);
 
     /* Clean up encoding context */
     if (video->context != NULL) {
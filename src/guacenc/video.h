@@ -23,6 +23,7 @@
 #include "config.h"
 #include "buffer.h"
 
+#include <guacamole/fifo.h>
 #include <guacamole/timestamp.h>
 #include <libavcodec/avcodec.h>
 
@@ -34,6 +35,8 @@
 #include <libavformat/avformat.h>
 #endif
 
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -42,6 +45,103 @@
  */
 #define GUACENC_VIDEO_FRAMERATE 25
 
+/**
+ * The maximum number of jobs that may be awaiting the encoding thread of a
+ * guacenc_video at any given time. Once this many jobs are pending, further
+ * frames will block until the encoding thread catches up.
+ */
+#define GUACENC_VIDEO_JOB_QUEUE_SIZE 8
+
+/**
+ * The number of frames to allocate within the pool of hardware frames used
+ * by a hardware encoding backend. Some backends (QSV) require this pool to be
+ * of a fixed size.
+ */
+#define GUACENC_VIDEO_HWACCEL_POOL_SIZE 20
+
+/**
+ * All hardware encoding backends which may be used to encode video. Each
+ * hardware backend encodes H.264, and frames are uploaded to the associated
+ * device prior to encoding. If a hardware backend cannot be used, encoding
+ * falls back to software automatically.
+ */
+typedef enum guacenc_video_hwaccel {
+
+    /**
+     * No hardware encoding. All video is encoded in software.
+     */
+    GUACENC_VIDEO_HWACCEL_NONE,
+
+    /**
+     * NVIDIA NVENC ("h264_nvenc"). Frames are uploaded as RGB and their
+     * conversion to YCbCr is performed on the GPU.
+     */
+    GUACENC_VIDEO_HWACCEL_NVENC,
+
+    /**
+     * VA-API ("h264_vaapi"). Frames are uploaded as NV12.
+     */
+    GUACENC_VIDEO_HWACCEL_VAAPI,
+
+    /**
+     * Intel Quick Sync Video ("h264_qsv"). Frames are uploaded as NV12.
+     */
+    GUACENC_VIDEO_HWACCEL_QSV
+
+} guacenc_video_hwaccel;
+
+/**
+ * All types of jobs that may be handled by the encoding thread of a
+ * guacenc_video.
+ */
+typedef enum guacenc_video_job_type {
+
+    /**
+     * Convert the associated source frame into the frame that will be written
+     * upon the next flush, replacing its contents.
+     */
+    GUACENC_VIDEO_JOB_PREPARE,
+
+    /**
+     * Write the most recently prepared frame the associated number of times.
+     */
+    GUACENC_VIDEO_JOB_FLUSH,
+
+    /**
+     * Stop the encoding thread. No further jobs will be handled.
+     */
+    GUACENC_VIDEO_JOB_STOP
+
+} guacenc_video_job_type;
+
+/**
+ * A single unit of work for the encoding thread of a guacenc_video. Jobs are
+ * handled strictly in the order they are queued, such that the encoded video
+ * is identical to that which would be produced if all work were performed on
+ * the thread reading the recording.
+ */
+typedef struct guacenc_video_job {
+
+    /**
+     * The type of this job.
+     */
+    guacenc_video_job_type type;
+
+    /**
+     * For GUACENC_VIDEO_JOB_PREPARE jobs, the RGB32 frame that should be
+     * scaled and converted to become the next frame of video. This frame
+     * and its image data are freed by the encoding thread once converted.
+     */
+    AVFrame* source;
+
+    /**
+     * For GUACENC_VIDEO_JOB_FLUSH jobs, the number of times the most recently
+     * prepared frame should be written.
+     */
+    int count;
+
+} guacenc_video_job;
+
 /**
  * A video which is actively being encoded. Frames can be added to the video
  * as they are generated, along with their associated timestamps, and the
@@ -86,10 +186,19 @@ typedef struct guacenc_video {
     /**
      * An image data area containing the next frame to be written, encoded as
      * YCbCr image data in the format required by avcodec_encode_video2(), for
-     * use and re-use as frames are rendered.
+     * use and re-use as frames are rendered. If a hardware encoding backend
+     * is in use, this frame is instead in the software format accepted by the
+     * hardware device, and is uploaded to that device as each frame is
+     * written.
      */
     AVFrame* next_frame;
 
+    /**
+     * The pool of hardware frames to which each frame is uploaded prior to
+     * encoding, or NULL if frames are encoded in software.
+     */
+    AVBufferRef* hw_frames_context;
+
     /**
      * The presentation timestamp that should be used for the next frame. This
      * is equivalent to the frame number.
@@ -102,6 +211,30 @@ typedef struct guacenc_video {
      */
     guac_timestamp last_timestamp;
 
+    /**
+     * The thread which scales, converts, and encodes frames of this video,
+     * allowing that work to proceed in parallel with the parsing and
+     * rendering of further instructions.
+     */
+    pthread_t encoder_thread;
+
+    /**
+     * Queue of all jobs awaiting the encoding thread.
+     */
+    guac_fifo jobs;
+
+    /**
+     * Storage for all jobs within the jobs queue.
+     */
+    guacenc_video_job job_items[GUACENC_VIDEO_JOB_QUEUE_SIZE];
+
+    /**
+     * Non-zero if the encoding thread has failed to write a frame, in which
+     * case no further frames will be written. This value must only be
+     * accessed atomically.
+     */
+    int failed;
+
 } guacenc_video;
 
 /**
@@ -116,7 +249,12 @@ typedef struct guacenc_video {
  *
  * @param codec_name
  *     The name of the codec to use for the video encoding, as defined by
- *     ffmpeg / libavcodec.
+ *     ffmpeg / libavcodec. If a hardware encoding backend is requested, this
+ *     codec is used only if that backend cannot be used.
+ *
+ * @param hwaccel
+ *     The hardware encoding backend to use, or GUACENC_VIDEO_HWACCEL_NONE to
+ *     encode in software.
  *
  * @param width
  *     The width of the desired video, in pixels.
@@ -127,9 +265,15 @@ typedef struct guacenc_video {
  * @param bitrate
  *     The desired overall bitrate of the resulting encoded video, in bits per
  *     second.
+ *
+ * @param fragmented
+ *     Whether the video should be written as fragmented MP4, such that the
+ *     video can be played while it is still being written. The output file
+ *     must be an MP4 file if this is true.
  */
 guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
-        int width, int height, int bitrate);
+        guacenc_video_hwaccel hwaccel, int width, int height, int bitrate,
+        bool fragmented);
 
 /**
  * Advances the timeline of the encoding process to the given timestamp, such
@@ -151,6 +295,10 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
  *     timeline should be advanced to, as dictated by a parsed "sync"
  *     instruction.
  *
+ * Frames are encoded asynchronously by a dedicated encoding thread. If that
+ * thread has failed to write a previously-queued frame, the failure is
+ * reported by the next call to this function.
+ *
  * @return
  *     Zero if the timeline was adjusted successfully, non-zero if an error
  *     occurs (such as during the encoding of duplicate frames).
@@ -0,0 +1,241 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacload.h"
+#include "log.h"
+#include "report.h"
+#include "script.h"
+#include "session.h"
+
+#include <guacamole/mem.h>
+
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Parses the given string as a positive integer, as given for a numeric
+ * command line option.
+ *
+ * @param str
+ *     The string to parse.
+ *
+ * @param value
+ *     Pointer to the int that should receive the parsed value.
+ *
+ * @return
+ *     Zero if the string is a positive integer, non-zero otherwise.
+ */
+static int guacload_parse_positive(const char* str, int* value) {
+
+    char* end;
+    long parsed = strtol(str, &end, 10);
+
+    if (*str == '\0' || *end != '\0' || parsed <= 0 || parsed > 1000000)
+        return 1;
+
+    *value = parsed;
+    return 0;
+
+}
+
+int main(int argc, char* argv[]) {
+
+    /* Load defaults */
+    guacload_config config = {
+        .hostname = GUACLOAD_DEFAULT_HOSTNAME,
+        .port     = GUACLOAD_DEFAULT_PORT,
+        .width    = GUACLOAD_DEFAULT_WIDTH,
+        .height   = GUACLOAD_DEFAULT_HEIGHT,
+        .duration = GUACLOAD_DEFAULT_DURATION,
+        .rate     = GUACLOAD_DEFAULT_RATE,
+        .workload = GUACLOAD_SCRIPT_MIXED
+    };
+
+    int connections = GUACLOAD_DEFAULT_CONNECTIONS;
+
+    /* Connection parameters can be no more numerous than the arguments
+     * containing them */
+    char** parameters = guac_mem_alloc(sizeof(char*), argc);
+    config.parameters = parameters;
+
+    /* Parse arguments */
+    int opt;
+    while ((opt = getopt(argc, argv, "a:d:H:n:p:r:s:w:")) != -1) {
+
+        /* -a: Connection parameter */
+        if (opt == 'a') {
+            if (strchr(optarg, '=') == NULL) {
+                guacload_log(GUAC_LOG_ERROR, "Connection parameters must be "
+                        "given as NAME=VALUE.");
+                goto invalid_options;
+            }
+            parameters[config.parameter_count++] = optarg;
+        }
+
+        /* -d: Duration of each connection, in seconds */
+        else if (opt == 'd') {
+            if (guacload_parse_positive(optarg, &config.duration)) {
+                guacload_log(GUAC_LOG_ERROR, "Invalid duration.");
+                goto invalid_options;
+            }
+        }
+
+        /* -H: Hostname of guacd */
+        else if (opt == 'H')
+            config.hostname = optarg;
+
+        /* -n: Number of concurrent connections */
+        else if (opt == 'n') {
+            if (guacload_parse_positive(optarg, &connections)) {
+                guacload_log(GUAC_LOG_ERROR, "Invalid number of "
+                        "connections.");
+                goto invalid_options;
+            }
+        }
+
+        /* -p: Port of guacd */
+        else if (opt == 'p')
+            config.port = optarg;
+
+        /* -r: Input events per second */
+        else if (opt == 'r') {
+            if (guacload_parse_positive(optarg, &config.rate)
+                    || config.rate > 1000) {
+                guacload_log(GUAC_LOG_ERROR, "Invalid input rate.");
+                goto invalid_options;
+            }
+        }
+
+        /* -s: Display size */
+        else if (opt == 's') {
+            if (sscanf(optarg, "%ix%i", &config.width, &config.height) != 2
+                    || config.width <= 0 || config.height <= 0) {
+                guacload_log(GUAC_LOG_ERROR, "Invalid display size.");
+                goto invalid_options;
+            }
+        }
+
+        /* -w: Input workload */
+        else if (opt == 'w') {
+            if (guacload_script_parse_type(optarg, &config.workload)) {
+                guacload_log(GUAC_LOG_ERROR, "Invalid workload.");
+                goto invalid_options;
+            }
+        }
+
+        /* Invalid option */
+        else {
+            goto invalid_options;
+        }
+
+    }
+
+    /* Exactly one protocol or connection ID is required */
+    if (argc - optind != 1)
+        goto invalid_options;
+
+    config.selection = argv[optind];
+
+    /* Log start */
+    guacload_log(GUAC_LOG_INFO, "Guacamole load generator (guacload) "
+            "version " VERSION);
+
+    guacload_log(GUAC_LOG_INFO, "Opening %i connection(s) to \"%s\" via "
+            "%s:%s for %i second(s) ...", connections, config.selection,
+            config.hostname, config.port, config.duration);
+
+    /* Connections closed by guacd must fail only that connection */
+    signal(SIGPIPE, SIG_IGN);
+
+    guacload_session* sessions = guac_mem_alloc(sizeof(guacload_session),
+            connections);
+    int* started = guac_mem_zalloc(sizeof(int), connections);
+
+    /* Start all connections at once */
+    for (int i = 0; i < connections; i++) {
+
+        guacload_session_init(&sessions[i], &config, i + 1);
+
+        if (pthread_create(&sessions[i].thread, NULL, guacload_session_run,
+                    &sessions[i])) {
+            guacload_log(GUAC_LOG_ERROR, "Unable to start thread for "
+                    "connection %i.", i + 1);
+            continue;
+        }
+
+        started[i] = 1;
+
+    }
+
+    /* Wait for all connections to finish */
+    int failures = 0;
+    for (int i = 0; i < connections; i++) {
+
+        if (started[i])
+            pthread_join(sessions[i].thread, NULL);
+
+        if (!sessions[i].completed)
+            failures++;
+
+    }
+
+    guacload_report_write(stdout, sessions, connections);
+
+    for (int i = 0; i < connections; i++)
+        guacload_session_destroy(&sessions[i]);
+
+    guac_mem_free(started);
+    guac_mem_free(sessions);
+    guac_mem_free(parameters);
+
+    /* Warn if at least one connection failed */
+    if (failures != 0) {
+        guacload_log(GUAC_LOG_WARNING, "%i of %i connection(s) failed or "
+                "ended early.", failures, connections);
+        return 1;
+    }
+
+    guacload_log(GUAC_LOG_INFO, "All connections completed successfully.");
+    return 0;
+
+    /* Display usage and exit with error if options are invalid */
+invalid_options:
+
+    fprintf(stderr, "USAGE: %s"
+            " [-a NAME=VALUE]..."
+            " [-d DURATION]"
+            " [-H HOSTNAME]"
+            " [-n CONNECTIONS]"
+            " [-p PORT]"
+            " [-r RATE]"
+            " [-s WIDTHxHEIGHT]"
+            " [-w idle|type|scroll|drag|mixed]"
+            " PROTOCOL|CONNECTION-ID\n", argv[0]);
+
+    guac_mem_free(parameters);
+    return 1;
+
+}
+
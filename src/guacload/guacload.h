@@ -0,0 +1,104 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACLOAD_H
+#define GUACLOAD_H
+
+#include "config.h"
+
+/**
+ * The default log level below which no messages should be logged.
+ */
+#define GUACLOAD_DEFAULT_LOG_LEVEL GUAC_LOG_INFO
+
+/**
+ * The hostname or address of the guacd instance that should be connected to
+ * if no other hostname is specified.
+ */
+#define GUACLOAD_DEFAULT_HOSTNAME "localhost"
+
+/**
+ * The port of the guacd instance that should be connected to if no other port
+ * is specified.
+ */
+#define GUACLOAD_DEFAULT_PORT "4822"
+
+/**
+ * The number of concurrent connections to open if no other number is
+ * specified.
+ */
+#define GUACLOAD_DEFAULT_CONNECTIONS 1
+
+/**
+ * The number of seconds that each connection should be driven with input if
+ * no other duration is specified.
+ */
+#define GUACLOAD_DEFAULT_DURATION 30
+
+/**
+ * The number of input events to send per second within each connection if no
+ * other rate is specified.
+ */
+#define GUACLOAD_DEFAULT_RATE 20
+
+/**
+ * The width of the display requested for each connection, in pixels, if no
+ * other size is specified.
+ */
+#define GUACLOAD_DEFAULT_WIDTH 1024
+
+/**
+ * The height of the display requested for each connection, in pixels, if no
+ * other size is specified.
+ */
+#define GUACLOAD_DEFAULT_HEIGHT 768
+
+/**
+ * The resolution of the display requested for each connection, in DPI.
+ */
+#define GUACLOAD_DEFAULT_DPI 96
+
+/**
+ * The number of seconds to wait for the TCP connection to guacd to be
+ * established.
+ */
+#define GUACLOAD_CONNECT_TIMEOUT 15
+
+/**
+ * The number of milliseconds to wait for each instruction from guacd before
+ * the connection is considered unresponsive.
+ */
+#define GUACLOAD_RESPONSE_TIMEOUT 15000
+
+/**
+ * The number of milliseconds that may elapse without any instruction being
+ * sent to guacd before a "nop" is sent to keep the connection alive. This
+ * must be well below the timeout used by guacd to detect unresponsive
+ * users.
+ */
+#define GUACLOAD_KEEP_ALIVE_INTERVAL 2000
+
+/**
+ * The maximum number of milliseconds that a connection may sleep between
+ * input events before checking whether guacd has closed the connection.
+ */
+#define GUACLOAD_POLL_INTERVAL 100
+
+#endif
+
@@ -0,0 +1,134 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "report.h"
+#include "samples.h"
+#include "session.h"
+
+#include <guacamole/timestamp.h>
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Writes a single line summarizing the distribution of the given samples.
+ *
+ * @param output
+ *     The file to write the summary to.
+ *
+ * @param label
+ *     The human-readable label describing the samples.
+ *
+ * @param samples
+ *     The samples to summarize, which must already be sorted with
+ *     guacload_samples_sort().
+ */
+static void guacload_report_write_samples(FILE* output, const char* label,
+        const guacload_samples* samples) {
+
+    if (samples->count == 0) {
+        fprintf(output, "%-16s (no samples)\n", label);
+        return;
+    }
+
+    fprintf(output, "%-16s p50 %" PRIi64 "ms, p90 %" PRIi64 "ms, "
+            "p99 %" PRIi64 "ms, max %" PRIi64 "ms (%zu samples)\n", label,
+            guacload_samples_percentile(samples, 50),
+            guacload_samples_percentile(samples, 90),
+            guacload_samples_percentile(samples, 99),
+            guacload_samples_percentile(samples, 100),
+            samples->count);
+
+}
+
+void guacload_report_write(FILE* output, const guacload_session* sessions,
+        int count) {
+
+    guacload_samples connect_times;
+    guacload_samples lag;
+    guacload_samples_init(&connect_times);
+    guacload_samples_init(&lag);
+
+    int connected = 0;
+    int completed = 0;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t events = 0;
+
+    /* Rates of concurrent sessions are summed, each over its own lifetime */
+    double frame_rate = 0;
+    double byte_rate = 0;
+
+    for (int i = 0; i < count; i++) {
+
+        const guacload_session* session = &sessions[i];
+        if (!session->connected)
+            continue;
+
+        connected++;
+        if (session->completed)
+            completed++;
+
+        guacload_samples_add(&connect_times, session->connect_time);
+        guacload_samples_merge(&lag, &session->lag);
+
+        frames += session->frames;
+        bytes += session->bytes;
+        events += session->events;
+
+        if (session->elapsed > 0) {
+            frame_rate += session->frames * 1000.0 / session->elapsed;
+            byte_rate += session->bytes * 1000.0 / session->elapsed;
+        }
+
+    }
+
+    guacload_samples_sort(&connect_times);
+    guacload_samples_sort(&lag);
+
+    fprintf(output, "%-16s %i attempted, %i ready, %i failed, "
+            "%i ended early\n", "Connections:", count, connected,
+            count - connected, connected - completed);
+
+    guacload_report_write_samples(output, "Connect time:", &connect_times);
+
+    if (connected > 0) {
+
+        fprintf(output, "%-16s %" PRIu64 " total, %.1f/s overall, "
+                "%.1f/s per connection\n", "Frames:", frames,
+                frame_rate, frame_rate / connected);
+
+        fprintf(output, "%-16s %" PRIu64 " total, %.0f bytes/s overall, "
+                "%.0f bytes/s per connection\n", "Received:", bytes,
+                byte_rate, byte_rate / connected);
+
+        fprintf(output, "%-16s %" PRIu64 " total\n", "Input events:",
+                events);
+
+        guacload_report_write_samples(output, "Input lag:", &lag);
+
+    }
+
+    guacload_samples_destroy(&connect_times);
+    guacload_samples_destroy(&lag);
+
+}
+
@@ -0,0 +1,49 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACLOAD_REPORT_H
+#define GUACLOAD_REPORT_H
+
+#include "config.h"
+#include "session.h"
+
+#include <stdio.h>
+
+/**
+ * Writes a human-readable summary of the measurements taken across all given
+ * sessions, which must have finished running, to the given file. Connect
+ * times and input lag are summarized as percentiles across all sessions,
+ * while frame and byte rates are summed across all sessions (the load on
+ * guacd as a whole) and averaged per session (the experience of a single
+ * user).
+ *
+ * @param output
+ *     The file to write the summary to.
+ *
+ * @param sessions
+ *     An array of all sessions run.
+ *
+ * @param count
+ *     The number of sessions within the array.
+ */
+void guacload_report_write(FILE* output, const guacload_session* sessions,
+        int count);
+
+#endif
+
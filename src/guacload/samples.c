@@ -0,0 +1,110 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "samples.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/timestamp.h>
+
+#include <stdlib.h>
+
+void guacload_samples_init(guacload_samples* samples) {
+    samples->values = NULL;
+    samples->count = 0;
+    samples->capacity = 0;
+}
+
+void guacload_samples_destroy(guacload_samples* samples) {
+    guac_mem_free(samples->values);
+    guacload_samples_init(samples);
+}
+
+void guacload_samples_add(guacload_samples* samples, guac_timestamp value) {
+
+    /* Double available space as needed */
+    if (samples->count == samples->capacity) {
+
+        size_t capacity = samples->capacity * 2;
+        if (capacity == 0)
+            capacity = GUACLOAD_SAMPLES_INITIAL_CAPACITY;
+
+        samples->values = guac_mem_realloc(samples->values,
+                sizeof(guac_timestamp), capacity);
+        samples->capacity = capacity;
+
+    }
+
+    samples->values[samples->count++] = value;
+
+}
+
+void guacload_samples_merge(guacload_samples* samples,
+        const guacload_samples* other) {
+
+    for (size_t i = 0; i < other->count; i++)
+        guacload_samples_add(samples, other->values[i]);
+
+}
+
+/**
+ * Comparator for qsort() which orders guac_timestamp values ascending.
+ *
+ * @param a
+ *     A pointer to the first guac_timestamp being compared.
+ *
+ * @param b
+ *     A pointer to the second guac_timestamp being compared.
+ *
+ * @return
+ *     A negative value if a is less than b, a positive value if a is greater
+ *     than b, or zero if they are equal.
+ */
+static int guacload_samples_compare(const void* a, const void* b) {
+
+    guac_timestamp value_a = *((const guac_timestamp*) a);
+    guac_timestamp value_b = *((const guac_timestamp*) b);
+
+    return (value_a > value_b) - (value_a < value_b);
+
+}
+
+void guacload_samples_sort(guacload_samples* samples) {
+    if (samples->count > 0)
+        qsort(samples->values, samples->count, sizeof(guac_timestamp),
+                guacload_samples_compare);
+}
+
+guac_timestamp guacload_samples_percentile(const guacload_samples* samples,
+        int percentile) {
+
+    if (samples->count == 0)
+        return 0;
+
+    /* Nearest rank, with ranks starting at 1 */
+    size_t rank = (percentile * samples->count + 99) / 100;
+    if (rank < 1)
+        rank = 1;
+    else if (rank > samples->count)
+        rank = samples->count;
+
+    return samples->values[rank - 1];
+
+}
+
@@ -0,0 +1,132 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACLOAD_SAMPLES_H
+#define GUACLOAD_SAMPLES_H
+
+#include "config.h"
+
+#include <guacamole/timestamp.h>
+
+#include <stddef.h>
+
+/**
+ * The number of samples for which space is initially allocated within a
+ * guacload_samples. Space for additional samples is allocated as needed.
+ */
+#define GUACLOAD_SAMPLES_INITIAL_CAPACITY 256
+
+/**
+ * A growable set of duration samples, each in milliseconds, from which
+ * percentiles may be calculated. A guacload_samples is not threadsafe; each
+ * set of samples is expected to be populated by a single thread and only
+ * merged with others once that thread has finished.
+ */
+typedef struct guacload_samples {
+
+    /**
+     * All samples added thus far, in the order they were added or, once
+     * guacload_samples_sort() has been invoked, in ascending order.
+     */
+    guac_timestamp* values;
+
+    /**
+     * The number of samples currently stored within values.
+     */
+    size_t count;
+
+    /**
+     * The number of samples that values has room for.
+     */
+    size_t capacity;
+
+} guacload_samples;
+
+/**
+ * Initializes the given guacload_samples such that it contains no samples.
+ * The samples must eventually be freed with guacload_samples_destroy().
+ *
+ * @param samples
+ *     The guacload_samples to initialize.
+ */
+void guacload_samples_init(guacload_samples* samples);
+
+/**
+ * Frees all memory associated with the given guacload_samples. The
+ * guacload_samples structure itself is not freed.
+ *
+ * @param samples
+ *     The guacload_samples to destroy.
+ */
+void guacload_samples_destroy(guacload_samples* samples);
+
+/**
+ * Adds a single sample to the given guacload_samples.
+ *
+ * @param samples
+ *     The guacload_samples to add the sample to.
+ *
+ * @param value
+ *     The sample to add, in milliseconds.
+ */
+void guacload_samples_add(guacload_samples* samples, guac_timestamp value);
+
+/**
+ * Adds all samples within one guacload_samples to another. The samples being
+ * added are not modified.
+ *
+ * @param samples
+ *     The guacload_samples to add the samples to.
+ *
+ * @param other
+ *     The guacload_samples containing the samples to add.
+ */
+void guacload_samples_merge(guacload_samples* samples,
+        const guacload_samples* other);
+
+/**
+ * Sorts the samples within the given guacload_samples in ascending order.
+ * This function must be invoked before guacload_samples_percentile().
+ *
+ * @param samples
+ *     The guacload_samples to sort.
+ */
+void guacload_samples_sort(guacload_samples* samples);
+
+/**
+ * Returns the smallest sample that is at least as large as the given
+ * percentage of all samples (the "nearest rank" percentile). The samples
+ * must have been sorted with guacload_samples_sort() since they were last
+ * added to.
+ *
+ * @param samples
+ *     The sorted guacload_samples to calculate the percentile of.
+ *
+ * @param percentile
+ *     The percentile to calculate, from 0 to 100 inclusive.
+ *
+ * @return
+ *     The requested percentile, in milliseconds, or zero if there are no
+ *     samples.
+ */
+guac_timestamp guacload_samples_percentile(const guacload_samples* samples,
+        int percentile);
+
+#endif
+
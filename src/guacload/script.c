@@ -0,0 +1,232 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "script.h"
+
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <string.h>
+
+/**
+ * The X11 keysym of the Return key.
+ */
+#define GUACLOAD_KEYSYM_RETURN 0xFF0D
+
+/**
+ * The mouse button mask bit of the left mouse button.
+ */
+#define GUACLOAD_MOUSE_LEFT 0x01
+
+/**
+ * The mouse button mask bit of the scroll wheel being scrolled up.
+ */
+#define GUACLOAD_MOUSE_UP 0x08
+
+/**
+ * The mouse button mask bit of the scroll wheel being scrolled down.
+ */
+#define GUACLOAD_MOUSE_DOWN 0x10
+
+int guacload_script_parse_type(const char* name, guacload_script_type* type) {
+
+    if (strcmp(name, "idle") == 0)
+        *type = GUACLOAD_SCRIPT_IDLE;
+
+    else if (strcmp(name, "type") == 0)
+        *type = GUACLOAD_SCRIPT_TYPE;
+
+    else if (strcmp(name, "scroll") == 0)
+        *type = GUACLOAD_SCRIPT_SCROLL;
+
+    else if (strcmp(name, "drag") == 0)
+        *type = GUACLOAD_SCRIPT_DRAG;
+
+    else if (strcmp(name, "mixed") == 0)
+        *type = GUACLOAD_SCRIPT_MIXED;
+
+    /* No other workloads exist */
+    else
+        return 1;
+
+    return 0;
+
+}
+
+void guacload_script_init(guacload_script* script, guacload_script_type type,
+        int width, int height) {
+    script->type = type;
+    script->width = width;
+    script->height = height;
+    script->step = 0;
+}
+
+/**
+ * Sends the key event representing the given step of typing
+ * GUACLOAD_SCRIPT_TEXT. Each character is pressed on one step and released on
+ * the next.
+ *
+ * @param socket
+ *     The guac_socket connected to guacd.
+ *
+ * @param step
+ *     The step of typing to perform.
+ *
+ * @param timestamp
+ *     The timestamp to associate with the key event.
+ *
+ * @return
+ *     Zero if the key event was sent successfully, non-zero otherwise.
+ */
+static int guacload_script_step_type(guac_socket* socket, unsigned int step,
+        guac_timestamp timestamp) {
+
+    const char* text = GUACLOAD_SCRIPT_TEXT;
+    unsigned char c = text[(step / 2) % (sizeof(GUACLOAD_SCRIPT_TEXT) - 1)];
+
+    /* Printable ASCII characters have keysyms identical to their codepoints */
+    int keysym = (c == '\n') ? GUACLOAD_KEYSYM_RETURN : c;
+
+    return guac_protocol_send_key(socket, keysym, step % 2 == 0, timestamp);
+
+}
+
+/**
+ * Sends the mouse event representing the given step of scrolling within the
+ * middle of the display. Each scroll wheel click is pressed on one step and
+ * released on the next.
+ *
+ * @param script
+ *     The guacload_script describing the workload being performed.
+ *
+ * @param socket
+ *     The guac_socket connected to guacd.
+ *
+ * @param step
+ *     The step of scrolling to perform.
+ *
+ * @param timestamp
+ *     The timestamp to associate with the mouse event.
+ *
+ * @return
+ *     Zero if the mouse event was sent successfully, non-zero otherwise.
+ */
+static int guacload_script_step_scroll(guacload_script* script,
+        guac_socket* socket, unsigned int step, guac_timestamp timestamp) {
+
+    int mask = 0;
+
+    /* Scroll down, then back up by the same amount */
+    if (step % 2 == 0) {
+        unsigned int click = (step / 2) % (GUACLOAD_SCRIPT_SCROLL_CLICKS * 2);
+        mask = (click < GUACLOAD_SCRIPT_SCROLL_CLICKS)
+            ? GUACLOAD_MOUSE_DOWN : GUACLOAD_MOUSE_UP;
+    }
+
+    return guac_protocol_send_mouse(socket, script->width / 2,
+            script->height / 2, mask, timestamp);
+
+}
+
+/**
+ * Sends the mouse event representing the given step of dragging across the
+ * display. Each drag presses the left mouse button, moves the mouse in a
+ * straight line across half the width of the display, and releases the
+ * button. Alternate drags move in opposite directions, returning the dragged
+ * object to where it started.
+ *
+ * @param script
+ *     The guacload_script describing the workload being performed.
+ *
+ * @param socket
+ *     The guac_socket connected to guacd.
+ *
+ * @param step
+ *     The step of dragging to perform.
+ *
+ * @param timestamp
+ *     The timestamp to associate with the mouse event.
+ *
+ * @return
+ *     Zero if the mouse event was sent successfully, non-zero otherwise.
+ */
+static int guacload_script_step_drag(guacload_script* script,
+        guac_socket* socket, unsigned int step, guac_timestamp timestamp) {
+
+    unsigned int length = GUACLOAD_SCRIPT_DRAG_STEPS + 2;
+    unsigned int drag = step / length;
+    unsigned int offset = step % length;
+
+    /* Progress along the drag, from 0 (pressed) to the number of motion steps
+     * (released) */
+    unsigned int progress = offset;
+    if (progress > GUACLOAD_SCRIPT_DRAG_STEPS)
+        progress = GUACLOAD_SCRIPT_DRAG_STEPS;
+
+    /* Odd drags move back to where the previous drag started */
+    if (drag % 2 == 1)
+        progress = GUACLOAD_SCRIPT_DRAG_STEPS - progress;
+
+    int distance = script->width / 2;
+    int x = script->width / 4
+          + distance * progress / GUACLOAD_SCRIPT_DRAG_STEPS;
+    int y = script->height / 8;
+
+    /* Hold the left button throughout, releasing only on the final step */
+    int mask = (offset == length - 1) ? 0 : GUACLOAD_MOUSE_LEFT;
+
+    return guac_protocol_send_mouse(socket, x, y, mask, timestamp);
+
+}
+
+int guacload_script_step(guacload_script* script, guac_socket* socket,
+        guac_timestamp timestamp) {
+
+    unsigned int step = script->step++;
+    guacload_script_type type = script->type;
+
+    /* Rotate between each workload, restarting each from its beginning */
+    if (type == GUACLOAD_SCRIPT_MIXED) {
+        type = GUACLOAD_SCRIPT_TYPE + (step / GUACLOAD_SCRIPT_MIXED_STEPS) % 3;
+        step %= GUACLOAD_SCRIPT_MIXED_STEPS;
+    }
+
+    switch (type) {
+
+        case GUACLOAD_SCRIPT_TYPE:
+            return guacload_script_step_type(socket, step, timestamp);
+
+        case GUACLOAD_SCRIPT_SCROLL:
+            return guacload_script_step_scroll(script, socket, step,
+                    timestamp);
+
+        case GUACLOAD_SCRIPT_DRAG:
+            return guacload_script_step_drag(script, socket, step,
+                    timestamp);
+
+        /* Nothing is sent while idle */
+        default:
+            return 0;
+
+    }
+
+}
+
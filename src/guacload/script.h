@@ -0,0 +1,175 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACLOAD_SCRIPT_H
+#define GUACLOAD_SCRIPT_H
+
+#include "config.h"
+
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+/**
+ * The text repeatedly typed by the GUACLOAD_SCRIPT_TYPE workload.
+ */
+#define GUACLOAD_SCRIPT_TEXT "The quick brown fox jumps over the lazy dog.\n"
+
+/**
+ * The number of scroll wheel clicks sent in each direction by the
+ * GUACLOAD_SCRIPT_SCROLL workload before the direction is reversed.
+ */
+#define GUACLOAD_SCRIPT_SCROLL_CLICKS 20
+
+/**
+ * The number of mouse motion events making up each drag performed by the
+ * GUACLOAD_SCRIPT_DRAG workload, not including the events pressing and
+ * releasing the mouse button.
+ */
+#define GUACLOAD_SCRIPT_DRAG_STEPS 40
+
+/**
+ * The number of steps of each workload performed by the GUACLOAD_SCRIPT_MIXED
+ * workload before moving on to the next workload. This is a whole number of
+ * drags (and an even number of steps) such that each workload ends with all
+ * keys and mouse buttons released.
+ */
+#define GUACLOAD_SCRIPT_MIXED_STEPS ((GUACLOAD_SCRIPT_DRAG_STEPS + 2) * 5)
+
+/**
+ * The scripted input workloads that guacload can drive each connection with.
+ */
+typedef enum guacload_script_type {
+
+    /**
+     * No input is sent. The connection is only observed.
+     */
+    GUACLOAD_SCRIPT_IDLE,
+
+    /**
+     * The text GUACLOAD_SCRIPT_TEXT is typed repeatedly, one key press or
+     * release at a time.
+     */
+    GUACLOAD_SCRIPT_TYPE,
+
+    /**
+     * The scroll wheel is repeatedly clicked in the middle of the display,
+     * reversing direction every GUACLOAD_SCRIPT_SCROLL_CLICKS clicks.
+     */
+    GUACLOAD_SCRIPT_SCROLL,
+
+    /**
+     * The left mouse button is pressed near the top-left of the display and
+     * the mouse dragged back and forth across the display, as if moving a
+     * window by its title bar.
+     */
+    GUACLOAD_SCRIPT_DRAG,
+
+    /**
+     * Typing, scrolling, and dragging are performed in turn, each for
+     * GUACLOAD_SCRIPT_MIXED_STEPS steps.
+     */
+    GUACLOAD_SCRIPT_MIXED
+
+} guacload_script_type;
+
+/**
+ * The state of a scripted input workload being performed within a single
+ * connection.
+ */
+typedef struct guacload_script {
+
+    /**
+     * The workload being performed.
+     */
+    guacload_script_type type;
+
+    /**
+     * The width of the remote display, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the remote display, in pixels.
+     */
+    int height;
+
+    /**
+     * The number of steps performed thus far.
+     */
+    unsigned int step;
+
+} guacload_script;
+
+/**
+ * Parses the given workload name, as accepted on the command line.
+ *
+ * @param name
+ *     The name of the workload: "idle", "type", "scroll", "drag", or "mixed".
+ *
+ * @param type
+ *     Pointer to the guacload_script_type that should receive the parsed
+ *     workload.
+ *
+ * @return
+ *     Zero if the workload name was recognized, non-zero otherwise.
+ */
+int guacload_script_parse_type(const char* name, guacload_script_type* type);
+
+/**
+ * Initializes the given guacload_script such that the given workload will be
+ * performed from its beginning.
+ *
+ * @param script
+ *     The guacload_script to initialize.
+ *
+ * @param type
+ *     The workload to perform.
+ *
+ * @param width
+ *     The width of the remote display, in pixels.
+ *
+ * @param height
+ *     The height of the remote display, in pixels.
+ */
+void guacload_script_init(guacload_script* script, guacload_script_type type,
+        int width, int height);
+
+/**
+ * Performs the next step of the given workload, sending a single input event
+ * over the given socket. The socket is not flushed. If the workload is
+ * GUACLOAD_SCRIPT_IDLE, nothing is sent.
+ *
+ * @param script
+ *     The guacload_script describing the workload being performed.
+ *
+ * @param socket
+ *     The guac_socket connected to guacd.
+ *
+ * @param timestamp
+ *     The timestamp to associate with the input event.
+ *
+ * @return
+ *     Zero if the step was performed successfully, non-zero if an error
+ *     occurred writing to the socket.
+ */
+int guacload_script_step(guacload_script* script, guac_socket* socket,
+        guac_timestamp timestamp);
+
+#endif
+
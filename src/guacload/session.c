@@ -0,0 +1,637 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "guacload.h"
+#include "log.h"
+#include "samples.h"
+#include "script.h"
+#include "session.h"
+
+#include <guacamole/error.h>
+#include <guacamole/mem.h>
+#include <guacamole/parser.h>
+#include <guacamole/protocol.h>
+#include <guacamole/protocol-constants.h>
+#include <guacamole/socket.h>
+#include <guacamole/tcp.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/unicode.h>
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+void guacload_session_init(guacload_session* session,
+        const guacload_config* config, int number) {
+
+    memset(session, 0, sizeof(guacload_session));
+    session->config = config;
+    session->number = number;
+
+    guacload_samples_init(&session->lag);
+
+}
+
+void guacload_session_destroy(guacload_session* session) {
+    guacload_samples_destroy(&session->lag);
+}
+
+/**
+ * Writes a single element of an instruction, including its length prefix,
+ * to the given socket.
+ *
+ * @param socket
+ *     The guac_socket to write to.
+ *
+ * @param value
+ *     The value of the element to write.
+ *
+ * @return
+ *     Zero if the element was written successfully, non-zero otherwise.
+ */
+static int guacload_session_write_element(guac_socket* socket,
+        const char* value) {
+
+    return
+           guac_socket_write_int(socket, guac_utf8_strlen(value))
+        || guac_socket_write_string(socket, ".")
+        || guac_socket_write_string(socket, value);
+
+}
+
+/**
+ * Sends an arbitrary instruction over the given socket. This is used for the
+ * instructions which only a Guacamole client would send, and for which
+ * libguac therefore provides no dedicated function.
+ *
+ * @param socket
+ *     The guac_socket to send the instruction over.
+ *
+ * @param opcode
+ *     The opcode of the instruction.
+ *
+ * @param args
+ *     A NULL-terminated array of the arguments of the instruction.
+ *
+ * @return
+ *     Zero if the instruction was sent successfully, non-zero otherwise.
+ */
+static int guacload_session_send(guac_socket* socket, const char* opcode,
+        const char** args) {
+
+    int ret_val;
+
+    guac_socket_instruction_begin(socket);
+
+    ret_val = guacload_session_write_element(socket, opcode);
+    for (; *args != NULL && !ret_val; args++) {
+        ret_val = guac_socket_write_string(socket, ",")
+               || guacload_session_write_element(socket, *args);
+    }
+
+    ret_val = ret_val || guac_socket_write_string(socket, ";");
+
+    guac_socket_instruction_end(socket);
+    return ret_val;
+
+}
+
+/**
+ * Returns the number of bytes occupied by the given instruction element on
+ * the wire, including its length prefix and the following separator.
+ *
+ * @param value
+ *     The value of the element.
+ *
+ * @return
+ *     The number of bytes occupied by the element.
+ */
+static uint64_t guacload_session_element_length(const char* value) {
+
+    /* Length prefix */
+    uint64_t length = 1;
+    for (int chars = guac_utf8_strlen(value); chars >= 10; chars /= 10)
+        length++;
+
+    /* Period, value, and trailing comma or semicolon */
+    return length + 1 + strlen(value) + 1;
+
+}
+
+/**
+ * Returns the number of bytes occupied on the wire by the instruction most
+ * recently read by the given parser.
+ *
+ * @param parser
+ *     The guac_parser that has just read an instruction.
+ *
+ * @return
+ *     The number of bytes occupied by the instruction.
+ */
+static uint64_t guacload_session_instruction_length(guac_parser* parser) {
+
+    uint64_t length = guacload_session_element_length(parser->opcode);
+    for (int i = 0; i < parser->argc; i++)
+        length += guacload_session_element_length(parser->argv[i]);
+
+    return length;
+
+}
+
+/**
+ * Returns the value of the connection parameter having the given name, as
+ * given on the command line.
+ *
+ * @param config
+ *     The options containing all connection parameters given.
+ *
+ * @param name
+ *     The name of the connection parameter.
+ *
+ * @return
+ *     The value of the connection parameter, or an empty string if no such
+ *     parameter was given.
+ */
+static const char* guacload_session_get_parameter(
+        const guacload_config* config, const char* name) {
+
+    size_t length = strlen(name);
+
+    for (int i = 0; i < config->parameter_count; i++) {
+        const char* parameter = config->parameters[i];
+        if (strncmp(parameter, name, length) == 0 && parameter[length] == '=')
+            return parameter + length + 1;
+    }
+
+    return "";
+
+}
+
+/**
+ * Performs the client side of the Guacamole protocol handshake, returning
+ * once guacd has reported the connection as ready.
+ *
+ * @param session
+ *     The guacload_session being connected.
+ *
+ * @param socket
+ *     The guac_socket connected to guacd.
+ *
+ * @param parser
+ *     The guac_parser to use to read instructions from guacd.
+ *
+ * @return
+ *     Zero if the handshake succeeded, non-zero otherwise.
+ */
+static int guacload_session_handshake(guacload_session* session,
+        guac_socket* socket, guac_parser* parser) {
+
+    const guacload_config* config = session->config;
+    int usec_timeout = GUACLOAD_RESPONSE_TIMEOUT * 1000;
+
+    if (guac_protocol_send_select(socket, config->selection)
+            || guac_socket_flush(socket)) {
+        guacload_log_guac_error(GUAC_LOG_ERROR, "Connection %i: Unable to "
+                "send \"select\"", session->number);
+        return 1;
+    }
+
+    if (guac_parser_expect(parser, socket, usec_timeout, "args")) {
+        guacload_log_guac_error(GUAC_LOG_ERROR, "Connection %i: \"args\" "
+                "was not received", session->number);
+        return 1;
+    }
+
+    /* Provide a value for every parameter requested, echoing the protocol
+     * version in place of the version advertised by guacd, if any */
+    const char** values = guac_mem_alloc(sizeof(char*), parser->argc + 1);
+
+    for (int i = 0; i < parser->argc; i++) {
+        const char* name = parser->argv[i];
+        if (i == 0 && strncmp(name, "VERSION_", 8) == 0)
+            values[i] = GUACAMOLE_PROTOCOL_VERSION;
+        else
+            values[i] = guacload_session_get_parameter(config, name);
+    }
+
+    values[parser->argc] = NULL;
+
+    char width[16], height[16], dpi[16], name[32];
+    snprintf(width, sizeof(width), "%i", config->width);
+    snprintf(height, sizeof(height), "%i", config->height);
+    snprintf(dpi, sizeof(dpi), "%i", GUACLOAD_DEFAULT_DPI);
+    snprintf(name, sizeof(name), GUACLOAD_LOG_NAME "-%i", session->number);
+
+    const char* size_args[] = { width, height, dpi, NULL };
+    const char* image_args[] = {
+        "image/png", "image/jpeg", "image/webp", NULL
+    };
+    const char* name_args[] = { name, NULL };
+    const char* no_args[] = { NULL };
+
+    /* No audio or video is accepted, as neither would be consumed */
+    int failed = guacload_session_send(socket, "size", size_args)
+              || guacload_session_send(socket, "audio", no_args)
+              || guacload_session_send(socket, "video", no_args)
+              || guacload_session_send(socket, "image", image_args)
+              || guacload_session_send(socket, "name", name_args)
+              || guac_protocol_send_connect(socket, values)
+              || guac_socket_flush(socket);
+
+    guac_mem_free(values);
+
+    if (failed) {
+        guacload_log_guac_error(GUAC_LOG_ERROR, "Connection %i: Unable to "
+                "complete handshake", session->number);
+        return 1;
+    }
+
+    /* Wait for the connection to be reported as ready */
+    while (guac_parser_read(parser, socket, usec_timeout) == 0) {
+
+        if (strcmp(parser->opcode, "ready") == 0) {
+            guacload_log(GUAC_LOG_DEBUG, "Connection %i: Joined connection "
+                    "\"%s\".", session->number,
+                    parser->argc > 0 ? parser->argv[0] : "");
+            return 0;
+        }
+
+        if (strcmp(parser->opcode, "error") == 0) {
+            guacload_log(GUAC_LOG_ERROR, "Connection %i: guacd reported an "
+                    "error: %s", session->number,
+                    parser->argc > 0 ? parser->argv[0] : "");
+            return 1;
+        }
+
+        /* Prompting for parameters cannot be answered non-interactively */
+        if (strcmp(parser->opcode, "required") == 0) {
+            guacload_log(GUAC_LOG_ERROR, "Connection %i: Additional "
+                    "parameters are required (see -a).", session->number);
+            return 1;
+        }
+
+    }
+
+    guacload_log_guac_error(GUAC_LOG_ERROR, "Connection %i: \"ready\" was "
+            "not received", session->number);
+    return 1;
+
+}
+
+/**
+ * The state shared between the thread sending input within a connection and
+ * the thread reading and acknowledging the frames that result.
+ */
+typedef struct guacload_session_io {
+
+    /**
+     * The guacload_session being driven.
+     */
+    guacload_session* session;
+
+    /**
+     * The guac_socket connected to guacd.
+     */
+    guac_socket* socket;
+
+    /**
+     * The guac_parser to use to read instructions from guacd.
+     */
+    guac_parser* parser;
+
+    /**
+     * Lock which must be acquired while accessing pending_input, stopping,
+     * or closed.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * The timestamp of the earliest input event not yet followed by a frame,
+     * or zero if no such input event exists.
+     */
+    guac_timestamp pending_input;
+
+    /**
+     * Non-zero if the connection is being deliberately closed, such that
+     * the resulting read failure is not an error.
+     */
+    int stopping;
+
+    /**
+     * Non-zero if the connection has been closed by guacd or has failed.
+     */
+    int closed;
+
+} guacload_session_io;
+
+/**
+ * Handles a single instruction received from guacd after the connection has
+ * become ready, acknowledging frames and recording measurements.
+ *
+ * @param io
+ *     The state of the connection receiving the instruction.
+ *
+ * @return
+ *     Zero if the connection should continue, non-zero if guacd has closed
+ *     the connection or an error occurred.
+ */
+static int guacload_session_handle(guacload_session_io* io) {
+
+    guacload_session* session = io->session;
+    guac_parser* parser = io->parser;
+
+    session->bytes += guacload_session_instruction_length(parser);
+
+    /* Acknowledge each frame exactly as a Guacamole client would, such that
+     * guacd can measure processing lag and throttle accordingly */
+    if (strcmp(parser->opcode, "sync") == 0 && parser->argc >= 1) {
+
+        session->frames++;
+
+        pthread_mutex_lock(&io->lock);
+        if (io->pending_input != 0) {
+            guacload_samples_add(&session->lag,
+                    guac_timestamp_current() - io->pending_input);
+            io->pending_input = 0;
+        }
+        pthread_mutex_unlock(&io->lock);
+
+        const char* sync_args[] = { parser->argv[0], NULL };
+        return guacload_session_send(io->socket, "sync", sync_args)
+            || guac_socket_flush(io->socket);
+
+    }
+
+    if (strcmp(parser->opcode, "error") == 0) {
+        guacload_log(GUAC_LOG_ERROR, "Connection %i: guacd reported an "
+                "error: %s", session->number,
+                parser->argc > 0 ? parser->argv[0] : "");
+        return 1;
+    }
+
+    if (strcmp(parser->opcode, "disconnect") == 0) {
+        guacload_log(GUAC_LOG_WARNING, "Connection %i: guacd closed the "
+                "connection.", session->number);
+        return 1;
+    }
+
+    /* All drawing and streaming instructions are parsed but otherwise
+     * ignored */
+    return 0;
+
+}
+
+/**
+ * Reads and handles all instructions received from guacd until the
+ * connection is closed. Each read is allowed the full response timeout, as a
+ * partially-read instruction cannot be resumed after guac_parser_read()
+ * times out. This function is intended to be used as the entry point of a
+ * thread, taking a pointer to a guacload_session_io.
+ *
+ * @param data
+ *     A pointer to the guacload_session_io of the connection.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacload_session_read(void* data) {
+
+    guacload_session_io* io = (guacload_session_io*) data;
+    guacload_session* session = io->session;
+
+    int usec_timeout = GUACLOAD_RESPONSE_TIMEOUT * 1000;
+
+    for (;;) {
+
+        if (guac_parser_read(io->parser, io->socket, usec_timeout)) {
+
+            pthread_mutex_lock(&io->lock);
+            if (!io->stopping)
+                guacload_log_guac_error(GUAC_LOG_ERROR, "Connection %i: "
+                        "Connection lost", session->number);
+            pthread_mutex_unlock(&io->lock);
+
+            break;
+
+        }
+
+        if (guacload_session_handle(io))
+            break;
+
+    }
+
+    pthread_mutex_lock(&io->lock);
+    io->closed = 1;
+    pthread_mutex_unlock(&io->lock);
+
+    return NULL;
+
+}
+
+/**
+ * Drives the given connection with input for the configured duration, while
+ * a separate thread handles all instructions received in the meantime.
+ *
+ * @param session
+ *     The guacload_session being driven.
+ *
+ * @param fd
+ *     The file descriptor of the TCP connection to guacd, which is shut down
+ *     once the duration has elapsed.
+ *
+ * @param socket
+ *     The guac_socket connected to guacd.
+ *
+ * @param parser
+ *     The guac_parser to use to read instructions from guacd.
+ *
+ * @return
+ *     Zero if the connection remained open for the full duration, non-zero
+ *     otherwise.
+ */
+static int guacload_session_drive(guacload_session* session, int fd,
+        guac_socket* socket, guac_parser* parser) {
+
+    const guacload_config* config = session->config;
+
+    guacload_session_io io = {
+        .session = session,
+        .socket  = socket,
+        .parser  = parser
+    };
+
+    pthread_mutex_init(&io.lock, NULL);
+
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, guacload_session_read, &io)) {
+        guacload_log(GUAC_LOG_ERROR, "Connection %i: Unable to start "
+                "thread for reading.", session->number);
+        pthread_mutex_destroy(&io.lock);
+        return 1;
+    }
+
+    guacload_script script;
+    guacload_script_init(&script, config->workload, config->width,
+            config->height);
+
+    guac_timestamp start = guac_timestamp_current();
+    guac_timestamp end = start + (guac_timestamp) config->duration * 1000;
+
+    /* Input is sent at the rate requested, except while idle */
+    guac_timestamp interval = 0;
+    if (config->workload != GUACLOAD_SCRIPT_IDLE)
+        interval = 1000 / config->rate;
+
+    guac_timestamp now = start;
+    guac_timestamp next_input = start;
+    guac_timestamp last_sent = start;
+
+    int result = 0;
+
+    while (now < end) {
+
+        pthread_mutex_lock(&io.lock);
+        int closed = io.closed;
+        pthread_mutex_unlock(&io.lock);
+
+        if (closed) {
+            result = 1;
+            break;
+        }
+
+        /* Send the next input event once due, skipping any events missed
+         * while falling behind rather than sending them in a burst */
+        if (interval > 0 && now >= next_input) {
+
+            pthread_mutex_lock(&io.lock);
+            int failed = guacload_script_step(&script, socket, now);
+            if (io.pending_input == 0)
+                io.pending_input = now;
+            pthread_mutex_unlock(&io.lock);
+
+            if (failed || guac_socket_flush(socket)) {
+                result = 1;
+                break;
+            }
+
+            session->events++;
+
+            next_input += interval;
+            if (next_input < now)
+                next_input = now + interval;
+
+            last_sent = now;
+
+        }
+
+        /* Keep the connection alive while nothing else is being sent */
+        else if (now - last_sent >= GUACLOAD_KEEP_ALIVE_INTERVAL) {
+
+            if (guac_protocol_send_nop(socket) || guac_socket_flush(socket)) {
+                result = 1;
+                break;
+            }
+
+            last_sent = now;
+
+        }
+
+        /* Sleep until the next scheduled event, waking periodically to
+         * notice if the connection has closed */
+        guac_timestamp wake = last_sent + GUACLOAD_KEEP_ALIVE_INTERVAL;
+        if (interval > 0 && next_input < wake)
+            wake = next_input;
+        if (end < wake)
+            wake = end;
+
+        guac_timestamp wait = wake - guac_timestamp_current();
+        if (wait > GUACLOAD_POLL_INTERVAL)
+            wait = GUACLOAD_POLL_INTERVAL;
+        if (wait > 0)
+            guac_timestamp_msleep(wait);
+
+        now = guac_timestamp_current();
+
+    }
+
+    session->elapsed = guac_timestamp_current() - start;
+
+    /* Leave gracefully if guacd is still listening, and stop reading */
+    pthread_mutex_lock(&io.lock);
+    io.stopping = 1;
+    pthread_mutex_unlock(&io.lock);
+
+    if (!result) {
+        guac_protocol_send_disconnect(socket);
+        guac_socket_flush(socket);
+    }
+
+    shutdown(fd, SHUT_RDWR);
+    pthread_join(reader, NULL);
+
+    pthread_mutex_destroy(&io.lock);
+    return result;
+
+}
+
+void* guacload_session_run(void* data) {
+
+    guacload_session* session = (guacload_session*) data;
+    const guacload_config* config = session->config;
+
+    guac_timestamp start = guac_timestamp_current();
+
+    int fd = guac_tcp_connect(config->hostname, config->port,
+            GUACLOAD_CONNECT_TIMEOUT);
+
+    if (fd < 0) {
+        guacload_log_guac_error(GUAC_LOG_ERROR, "Connection %i: Unable to "
+                "connect to guacd at %s:%s", session->number,
+                config->hostname, config->port);
+        return NULL;
+    }
+
+    guac_socket* socket = guac_socket_open(fd);
+    guac_parser* parser = guac_parser_alloc();
+
+    if (guacload_session_handshake(session, socket, parser) == 0) {
+
+        session->connect_time = guac_timestamp_current() - start;
+        session->connected = 1;
+
+        guacload_log(GUAC_LOG_DEBUG, "Connection %i: Ready after %"
+                PRIi64 "ms.", session->number, session->connect_time);
+
+        session->completed = !guacload_session_drive(session, fd, socket,
+                parser);
+
+    }
+
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+
+    return NULL;
+
+}
+
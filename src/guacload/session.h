@@ -0,0 +1,211 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACLOAD_SESSION_H
+#define GUACLOAD_SESSION_H
+
+#include "config.h"
+#include "samples.h"
+#include "script.h"
+
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * The options shared by all connections opened by guacload.
+ */
+typedef struct guacload_config {
+
+    /**
+     * The hostname or address of guacd.
+     */
+    const char* hostname;
+
+    /**
+     * The port of guacd.
+     */
+    const char* port;
+
+    /**
+     * The protocol to connect with, or the ID of an existing connection to
+     * join, as sent within the "select" instruction.
+     */
+    const char* selection;
+
+    /**
+     * All connection parameters given on the command line, each of the form
+     * "NAME=VALUE". Parameters requested by guacd which are not present here
+     * are sent with empty values.
+     */
+    char* const* parameters;
+
+    /**
+     * The number of entries within parameters.
+     */
+    int parameter_count;
+
+    /**
+     * The width of the display to request, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the display to request, in pixels.
+     */
+    int height;
+
+    /**
+     * The number of seconds to drive each connection with input once its
+     * handshake has completed.
+     */
+    int duration;
+
+    /**
+     * The number of input events to send per second within each connection.
+     */
+    int rate;
+
+    /**
+     * The scripted input workload to perform within each connection.
+     */
+    guacload_script_type workload;
+
+} guacload_config;
+
+/**
+ * A single connection to guacd, along with the measurements taken while that
+ * connection was driven with input.
+ */
+typedef struct guacload_session {
+
+    /**
+     * The options to use when connecting.
+     */
+    const guacload_config* config;
+
+    /**
+     * The number of this connection, starting at 1, for use within log
+     * messages.
+     */
+    int number;
+
+    /**
+     * The thread driving this connection.
+     */
+    pthread_t thread;
+
+    /**
+     * Non-zero if the handshake completed and guacd reported the connection
+     * as ready, zero otherwise.
+     */
+    int connected;
+
+    /**
+     * Non-zero if the connection remained open for the full duration
+     * requested, zero otherwise.
+     */
+    int completed;
+
+    /**
+     * The number of milliseconds between starting to connect to guacd and
+     * receiving the "ready" instruction.
+     */
+    guac_timestamp connect_time;
+
+    /**
+     * The number of milliseconds that the connection was driven with input
+     * after becoming ready.
+     */
+    guac_timestamp elapsed;
+
+    /**
+     * The number of frames (received "sync" instructions) after the
+     * connection became ready.
+     */
+    uint64_t frames;
+
+    /**
+     * The number of bytes of Guacamole protocol data received after the
+     * connection became ready.
+     */
+    uint64_t bytes;
+
+    /**
+     * The number of input events sent.
+     */
+    uint64_t events;
+
+    /**
+     * For each frame that followed input, the number of milliseconds between
+     * sending the earliest input event not yet followed by a frame and
+     * receiving the end of that frame. This is the lag a user would
+     * perceive between acting and seeing the display update, and includes
+     * the time taken by the remote desktop to respond.
+     */
+    guacload_samples lag;
+
+} guacload_session;
+
+/**
+ * Initializes the given guacload_session such that it may be run with
+ * guacload_session_run(). The session must eventually be destroyed with
+ * guacload_session_destroy().
+ *
+ * @param session
+ *     The guacload_session to initialize.
+ *
+ * @param config
+ *     The options to use when connecting. These options must remain valid
+ *     for the lifetime of the session.
+ *
+ * @param number
+ *     The number of this connection, starting at 1.
+ */
+void guacload_session_init(guacload_session* session,
+        const guacload_config* config, int number);
+
+/**
+ * Frees all memory associated with the given guacload_session. The
+ * guacload_session structure itself is not freed.
+ *
+ * @param session
+ *     The guacload_session to destroy.
+ */
+void guacload_session_destroy(guacload_session* session);
+
+/**
+ * Connects to guacd, completes the Guacamole protocol handshake, and drives
+ * the resulting connection with the configured input workload for the
+ * configured duration, acknowledging each frame received and recording
+ * measurements within the session. This function is intended to be used as
+ * the entry point of a thread, taking a pointer to a guacload_session
+ * initialized with guacload_session_init().
+ *
+ * @param data
+ *     A pointer to the guacload_session to run.
+ *
+ * @return
+ *     Always NULL.
+ */
+void* guacload_session_run(void* data);
+
+#endif
+
@@ -0,0 +1,171 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "batch.h"
+#include "events.h"
+#include "interpret.h"
+#include "log.h"
+
+#include <guacamole/mem.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+guaclog_batch* guaclog_batch_alloc(char* const* paths, int count,
+        guaclog_events* events, bool force) {
+
+    guaclog_batch* batch = guac_mem_zalloc(sizeof(guaclog_batch));
+    batch->paths = paths;
+    batch->count = count;
+    batch->events = events;
+    batch->force = force;
+
+    pthread_mutex_init(&batch->lock, NULL);
+    return batch;
+
+}
+
+/**
+ * Interprets the recording at the given path using the options of the given
+ * batch.
+ *
+ * @param batch
+ *     The batch containing the recording.
+ *
+ * @param path
+ *     The path of the recording to interpret.
+ *
+ * @return
+ *     Zero if the recording was interpreted successfully, non-zero otherwise.
+ */
+static int guaclog_batch_interpret(guaclog_batch* batch, const char* path) {
+
+    /* Input events of all recordings may share a single output */
+    if (batch->events != NULL)
+        return guaclog_interpret(path, NULL, batch->events, batch->force);
+
+    /* Generate output filename */
+    char out_path[4096];
+    int len = snprintf(out_path, sizeof(out_path), "%s.txt", path);
+
+    /* Do not write if filename exceeds maximum length */
+    if (len >= sizeof(out_path)) {
+        guaclog_log(GUAC_LOG_ERROR, "Cannot write output file for \"%s\": "
+                "Name too long", path);
+        return 1;
+    }
+
+    return guaclog_interpret(path, out_path, NULL, batch->force);
+
+}
+
+/**
+ * Worker thread which repeatedly claims and interprets the next recording
+ * within the given batch until no recordings remain.
+ *
+ * @param data
+ *     The guaclog_batch containing the recordings to interpret.
+ *
+ * @return
+ *     NULL in all cases.
+ */
+static void* guaclog_batch_worker(void* data) {
+
+    guaclog_batch* batch = (guaclog_batch*) data;
+
+    for (;;) {
+
+        /* Claim next recording, if any */
+        pthread_mutex_lock(&batch->lock);
+        if (batch->next >= batch->count) {
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+        const char* path = batch->paths[batch->next++];
+        pthread_mutex_unlock(&batch->lock);
+
+        /* Log granular success/failure at debug level */
+        if (guaclog_batch_interpret(batch, path)) {
+
+            pthread_mutex_lock(&batch->lock);
+            batch->failures++;
+            pthread_mutex_unlock(&batch->lock);
+
+            guaclog_log(GUAC_LOG_DEBUG,
+                    "%s was NOT successfully interpreted.", path);
+
+        }
+        else
+            guaclog_log(GUAC_LOG_DEBUG, "%s was successfully "
+                    "interpreted.", path);
+
+    }
+
+    return NULL;
+
+}
+
+int guaclog_batch_run(guaclog_batch* batch, int workers) {
+
+    /* There is no benefit to more workers than recordings */
+    if (workers > batch->count)
+        workers = batch->count;
+
+    /* The current thread always acts as one of the workers, thus only the
+     * remainder need be created */
+    int created = 0;
+    pthread_t* threads = NULL;
+    if (workers > 1) {
+
+        threads = guac_mem_alloc(sizeof(pthread_t), workers - 1);
+        for (created = 0; created < workers - 1; created++) {
+            if (pthread_create(&threads[created], NULL,
+                        guaclog_batch_worker, batch)) {
+                guaclog_log(GUAC_LOG_WARNING, "Only %i of %i worker threads "
+                        "could be started.", created + 1, workers);
+                break;
+            }
+        }
+
+    }
+
+    guaclog_batch_worker(batch);
+
+    /* Wait for all other workers to finish */
+    for (int i = 0; i < created; i++)
+        pthread_join(threads[i], NULL);
+
+    guac_mem_free(threads);
+    return batch->failures;
+
+}
+
+void guaclog_batch_free(guaclog_batch* batch) {
+
+    /* Ignore NULL batch */
+    if (batch == NULL)
+        return;
+
+    pthread_mutex_destroy(&batch->lock);
+    guac_mem_free(batch);
+
+}
+
@@ -0,0 +1,131 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACLOG_BATCH_H
+#define GUACLOG_BATCH_H
+
+#include "config.h"
+#include "events.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/**
+ * A set of recordings to be interpreted by a pool of worker threads, along
+ * with the options common to the interpretation of all those recordings.
+ */
+typedef struct guaclog_batch {
+
+    /**
+     * The paths of all recordings within this batch. These paths are not
+     * owned by the batch and must remain valid for the lifetime of the batch.
+     */
+    char* const* paths;
+
+    /**
+     * The number of recordings within this batch.
+     */
+    int count;
+
+    /**
+     * The shared output to which the input events of all recordings should
+     * be appended as JSON lines, or NULL if each recording should instead be
+     * interpreted into its own human-readable text file ("FILE.txt").
+     */
+    guaclog_events* events;
+
+    /**
+     * Whether recordings that appear to be in progress (have an associated
+     * lock) should be interpreted regardless.
+     */
+    bool force;
+
+    /**
+     * The index of the next recording to be claimed by a worker thread.
+     */
+    int next;
+
+    /**
+     * The number of recordings which could not be interpreted, including any
+     * recordings skipped because they are still in progress.
+     */
+    int failures;
+
+    /**
+     * Lock which must be acquired while claiming a recording or updating the
+     * number of failures.
+     */
+    pthread_mutex_t lock;
+
+} guaclog_batch;
+
+/**
+ * Allocates a new batch of recordings that will be interpreted using the
+ * given options. The resulting guaclog_batch must eventually be freed through
+ * a call to guaclog_batch_free().
+ *
+ * @param paths
+ *     The paths of all recordings to interpret. These paths must remain valid
+ *     for the lifetime of the batch.
+ *
+ * @param count
+ *     The number of paths within the given array.
+ *
+ * @param events
+ *     The shared output to which the input events of all recordings should
+ *     be appended as JSON lines, or NULL if each recording should instead be
+ *     interpreted into its own human-readable text file ("FILE.txt").
+ *
+ * @param force
+ *     Whether recordings that appear to be in progress (have an associated
+ *     lock) should be interpreted regardless.
+ *
+ * @return
+ *     A newly-allocated guaclog_batch.
+ */
+guaclog_batch* guaclog_batch_alloc(char* const* paths, int count,
+        guaclog_events* events, bool force);
+
+/**
+ * Interprets all recordings within the given batch using up to the given
+ * number of concurrent worker threads, including the current thread. This
+ * function blocks until all recordings have been interpreted or have failed.
+ *
+ * @param batch
+ *     The batch of recordings to interpret.
+ *
+ * @param workers
+ *     The maximum number of recordings to interpret concurrently.
+ *
+ * @return
+ *     The number of recordings which could not be interpreted.
+ */
+int guaclog_batch_run(guaclog_batch* batch, int workers);
+
+/**
+ * Frees all memory associated with the given batch. If the given batch is
+ * NULL, this function has no effect.
+ *
+ * @param batch
+ *     The batch to free, which may be NULL.
+ */
+void guaclog_batch_free(guaclog_batch* batch);
+
+#endif
+
@@ -0,0 +1,104 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "events.h"
+#include "log.h"
+
+#include <guacamole/mem.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+guaclog_events* guaclog_events_alloc(const char* path) {
+
+    FILE* output;
+
+    /* Write to STDOUT if requested */
+    if (strcmp(path, "-") == 0)
+        output = stdout;
+
+    /* Otherwise, open output file, refusing to overwrite existing files */
+    else {
+
+        int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR);
+        if (fd == -1) {
+            guaclog_log(GUAC_LOG_ERROR, "Failed to open output file "
+                    "\"%s\": %s", path, strerror(errno));
+            return NULL;
+        }
+
+        output = fdopen(fd, "wb");
+        if (output == NULL) {
+            guaclog_log(GUAC_LOG_ERROR, "Failed to allocate stream for "
+                    "output file \"%s\": %s", path, strerror(errno));
+            close(fd);
+            return NULL;
+        }
+
+    }
+
+    guaclog_events* events = guac_mem_zalloc(sizeof(guaclog_events));
+    events->output = output;
+    pthread_mutex_init(&events->lock, NULL);
+
+    return events;
+
+}
+
+int guaclog_events_append(guaclog_events* events, const char* buffer,
+        size_t length) {
+
+    pthread_mutex_lock(&events->lock);
+    size_t written = fwrite(buffer, 1, length, events->output);
+    pthread_mutex_unlock(&events->lock);
+
+    return written != length;
+
+}
+
+int guaclog_events_free(guaclog_events* events) {
+
+    /* Ignore NULL events */
+    if (events == NULL)
+        return 0;
+
+    int result;
+    if (events->output == stdout)
+        result = fflush(events->output);
+    else
+        result = fclose(events->output);
+
+    if (result)
+        guaclog_log(GUAC_LOG_ERROR, "Failed to write key events: %s",
+                strerror(errno));
+
+    pthread_mutex_destroy(&events->lock);
+    guac_mem_free(events);
+
+    return result != 0;
+
+}
+
@@ -0,0 +1,99 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACLOG_EVENTS_H
+#define GUACLOG_EVENTS_H
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * A single output file to which the key events of any number of recordings
+ * are written as JSON Lines, one JSON object per key event. Recordings may be
+ * interpreted concurrently, with the events of each recording appended to the
+ * output atomically once that recording has been fully interpreted, such that
+ * the events of different recordings are never interleaved.
+ */
+typedef struct guaclog_events {
+
+    /**
+     * Output file stream.
+     */
+    FILE* output;
+
+    /**
+     * Lock which must be held while writing to the output file stream.
+     */
+    pthread_mutex_t lock;
+
+} guaclog_events;
+
+/**
+ * Allocates a new guaclog_events which writes key events to the file at the
+ * given path. Existing files will not be overwritten. The resulting
+ * guaclog_events must eventually be freed through a call to
+ * guaclog_events_free().
+ *
+ * @param path
+ *     The full path to the file in which key events should be written, or
+ *     "-" if key events should be written to STDOUT.
+ *
+ * @return
+ *     The newly-allocated guaclog_events, or NULL if the output file could
+ *     not be opened.
+ */
+guaclog_events* guaclog_events_alloc(const char* path);
+
+/**
+ * Appends the given buffer of complete JSON lines to the output of the given
+ * guaclog_events. This function is threadsafe.
+ *
+ * @param events
+ *     The guaclog_events to append to.
+ *
+ * @param buffer
+ *     The JSON lines to append, each terminated by a newline character.
+ *
+ * @param length
+ *     The number of bytes within the given buffer.
+ *
+ * @return
+ *     Zero if the buffer was appended successfully, non-zero otherwise.
+ */
+int guaclog_events_append(guaclog_events* events, const char* buffer,
+        size_t length);
+
+/**
+ * Flushes and closes the output of the given guaclog_events, freeing all
+ * associated memory. If the given guaclog_events is NULL, this function has
+ * no effect.
+ *
+ * @param events
+ *     The guaclog_events to free, which may be NULL.
+ *
+ * @return
+ *     Zero if all key events were written successfully, non-zero otherwise.
+ */
+int guaclog_events_free(guaclog_events* events);
+
+#endif
+
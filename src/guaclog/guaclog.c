@@ -19,29 +19,46 @@
 
 #include "config.h"
 
+#include "batch.h"
+#include "events.h"
 #include "guaclog.h"
-#include "interpret.h"
 #include "log.h"
 
 #include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 int main(int argc, char* argv[]) {
 
-    int i;
-
     /* Load defaults */
     bool force = false;
+    const char* events_path = NULL;
+    int workers = 1;
 
     /* Parse arguments */
     int opt;
-    while ((opt = getopt(argc, argv, "s:r:f")) != -1) {
+    while ((opt = getopt(argc, argv, "s:r:fj:o:")) != -1) {
 
         /* -f: Force */
         if (opt == 'f')
             force = true;
 
+        /* -j: Number of recordings to interpret concurrently */
+        else if (opt == 'j') {
+            char* end;
+            workers = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || workers <= 0) {
+                guaclog_log(GUAC_LOG_ERROR, "Invalid number of jobs.");
+                goto invalid_options;
+            }
+        }
+
+        /* -o: Write all key events to a single JSON Lines file */
+        else if (opt == 'o')
+            events_path = optarg;
+
         /* Invalid option */
         else {
             goto invalid_options;
@@ -55,7 +72,6 @@ int main(int argc, char* argv[]) {
 
     /* Track number of overall failures */
     int total_files = argc - optind;
-    int failures = 0;
 
     /* Abort if no files given */
     if (total_files <= 0) {
@@ -65,34 +81,28 @@ int main(int argc, char* argv[]) {
 
     guaclog_log(GUAC_LOG_INFO, "%i input file(s) provided.", total_files);
 
-    /* Interpret all input files */
-    for (i = optind; i < argc; i++) {
+    /* Open shared output for key events, if requested */
+    guaclog_events* events = NULL;
+    if (events_path != NULL) {
 
-        /* Get current filename */
-        const char* path = argv[i];
+        events = guaclog_events_alloc(events_path);
+        if (events == NULL)
+            return 1;
 
-        /* Generate output filename */
-        char out_path[4096];
-        int len = snprintf(out_path, sizeof(out_path), "%s.txt", path);
+        guaclog_log(GUAC_LOG_INFO, "Writing key events of all input files "
+                "to \"%s\" ...", events_path);
 
-        /* Do not write if filename exceeds maximum length */
-        if (len >= sizeof(out_path)) {
-            guaclog_log(GUAC_LOG_ERROR, "Cannot write output file for \"%s\": "
-                    "Name too long", path);
-            continue;
-        }
+    }
 
-        /* Attempt interpreting, log granular success/failure at debug level */
-        if (guaclog_interpret(path, out_path, force)) {
-            failures++;
-            guaclog_log(GUAC_LOG_DEBUG,
-                    "%s was NOT successfully interpreted.", path);
-        }
-        else
-            guaclog_log(GUAC_LOG_DEBUG, "%s was successfully "
-                    "interpreted.", path);
+    /* Interpret all input files */
+    guaclog_batch* batch = guaclog_batch_alloc(argv + optind, total_files,
+            events, force);
+    int failures = guaclog_batch_run(batch, workers);
+    guaclog_batch_free(batch);
 
-    }
+    /* Failing to write the shared output fails every input file */
+    if (guaclog_events_free(events))
+        failures = total_files;
 
     /* Warn if at least one file failed */
     if (failures != 0)
@@ -111,6 +121,8 @@ invalid_options:
 
     fprintf(stderr, "USAGE: %s"
             " [-f]"
+            " [-j JOBS]"
+            " [-o OUTPUT]"
             " [FILE]...\n", argv[0]);
 
     return 1;
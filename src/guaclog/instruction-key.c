@@ -21,6 +21,8 @@
 #include "log.h"
 #include "state.h"
 
+#include <guacamole/timestamp-types.h>
+
 #include <stdbool.h>
 #include <stdlib.h>
 
@@ -36,8 +38,13 @@ int guaclog_handle_key(guaclog_state* state, int argc, char** argv) {
     int keysym = atoi(argv[0]);
     bool pressed = (atoi(argv[1]) != 0);
 
+    /* Timestamps are not present within older recordings */
+    guac_timestamp timestamp = 0;
+    if (argc >= 3)
+        timestamp = strtoll(argv[2], NULL, 10);
+
     /* Update interpreter state accordingly */
-    return guaclog_state_update_key(state, keysym, pressed);
+    return guaclog_state_update_key(state, keysym, pressed, timestamp);
 
 }
 
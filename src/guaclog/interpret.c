@@ -18,6 +18,7 @@
  */
 
 #include "config.h"
+#include "events.h"
 #include "instructions.h"
 #include "log.h"
 #include "state.h"
@@ -25,6 +26,7 @@
 #include <guacamole/client.h>
 #include <guacamole/error.h>
 #include <guacamole/parser.h>
+#include <guacamole/recording.h>
 #include <guacamole/socket.h>
 
 #include <sys/stat.h>
@@ -36,25 +38,32 @@
 #include <unistd.h>
 
 /**
- * Reads and handles all Guacamole instructions from the given guac_socket
- * until end-of-stream is reached.
+ * Reads and handles all Guacamole instructions from the given mapped
+ * recording or guac_socket until end-of-stream is reached.
  *
  * @param state
  *     The current state of the Guacamole input log interpreter.
  *
  * @param path
  *     The name of the file being parsed (for logging purposes). This file
- *     must already be open and available through the given socket.
+ *     must already be open and available through the given mapping or
+ *     socket.
+ *
+ * @param mapping
+ *     The mapped recording from which instructions should be read, or NULL
+ *     if instructions should instead be read through the given socket.
  *
  * @param socket
- *     The guac_socket through which instructions should be read.
+ *     The guac_socket through which instructions should be read, if the
+ *     recording has not been mapped.
  *
  * @return
  *     Zero on success, non-zero if parsing of Guacamole protocol data through
- *     the given socket fails.
+ *     the given mapping or socket fails.
  */
 static int guaclog_read_instructions(guaclog_state* state,
-        const char* path, guac_socket* socket) {
+        const char* path, guac_recording_mapping* mapping,
+        guac_socket* socket) {
 
     /* Obtain Guacamole protocol parser */
     guac_parser* parser = guac_parser_alloc();
@@ -62,7 +71,9 @@ static int guaclog_read_instructions(guaclog_state* state,
         return 1;
 
     /* Continuously read and handle all instructions */
-    while (!guac_parser_read(parser, socket, -1)) {
+    while (!(mapping != NULL
+                ? guac_recording_mapping_read(mapping, parser)
+                : guac_parser_read(parser, socket, -1))) {
         guaclog_handle_instruction(state, parser->opcode,
                 parser->argc, parser->argv);
     }
@@ -81,7 +92,63 @@ static int guaclog_read_instructions(guaclog_state* state,
 
 }
 
-int guaclog_interpret(const char* path, const char* out_path, bool force) {
+/**
+ * Handles all key events within the given mapped input event sidecar. Other
+ * input events are ignored.
+ *
+ * @param state
+ *     The current state of the Guacamole input log interpreter.
+ *
+ * @param events
+ *     The mapped input event sidecar from which events should be read.
+ *
+ * @return
+ *     Zero on success, non-zero if the interpreter state could not be
+ *     updated.
+ */
+static int guaclog_read_events(guaclog_state* state,
+        guac_recording_events* events) {
+
+    guac_recording_event event;
+    while (!guac_recording_events_read(events, &event)) {
+
+        if (event.type != GUAC_RECORDING_EVENT_KEY)
+            continue;
+
+        if (guaclog_state_update_key(state, event.keysym, event.pressed != 0,
+                    event.timestamp))
+            return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Closes the input from which recording instructions were read, whether that
+ * input is a mapped recording or a guac_socket. Exactly one of the given
+ * mapping and socket must be non-NULL.
+ *
+ * @param mapping
+ *     The mapped recording to unmap, or NULL if the recording was read
+ *     through the given socket.
+ *
+ * @param socket
+ *     The guac_socket to free, or NULL if the recording was mapped.
+ */
+static void guaclog_close_input(guac_recording_mapping* mapping,
+        guac_socket* socket) {
+
+    if (mapping != NULL)
+        guac_recording_unmap(mapping);
+    else
+        guac_socket_free(socket);
+
+}
+
+int guaclog_interpret(const char* path, const char* out_path,
+        guaclog_events* events, bool force) {
 
     /* Open input file */
     int fd = open(path, O_RDONLY);
@@ -118,34 +185,64 @@ int guaclog_interpret(const char* path, const char* out_path, bool force) {
     }
 
     /* Allocate input state for interpreting process */
-    guaclog_state* state = guaclog_state_alloc(out_path);
+    guaclog_state* state;
+    if (events != NULL)
+        state = guaclog_state_alloc_events(path, events);
+    else
+        state = guaclog_state_alloc(out_path);
+
     if (state == NULL) {
         close(fd);
         return 1;
     }
 
-    /* Obtain guac_socket wrapping file descriptor */
-    guac_socket* socket = guac_socket_open(fd);
-    if (socket == NULL) {
-        guaclog_log(GUAC_LOG_ERROR, "%s: %s", path,
-                guac_status_string(guac_error));
-        close(fd);
-        guaclog_state_free(state);
-        return 1;
+    /* Input event sidecars contain only input events, and need not be
+     * parsed as Guacamole protocol data at all */
+    guac_recording_events* events_sidecar = guac_recording_events_map(fd);
+    if (events_sidecar != NULL) {
+
+        guaclog_log(GUAC_LOG_INFO, "Reading input event sidecar \"%s\" ...",
+                path);
+
+        int result = guaclog_read_events(state, events_sidecar);
+        guac_recording_events_unmap(events_sidecar);
+
+        return guaclog_state_free(state) || result;
+
     }
 
-    guaclog_log(GUAC_LOG_INFO, "Writing input events from \"%s\" "
-            "to \"%s\" ...", path, out_path);
+    /* Parse raw recordings directly from memory where possible */
+    guac_socket* socket = NULL;
+    guac_recording_mapping* mapping = guac_recording_map(fd);
+
+    /* Otherwise, obtain guac_socket reading the recording within the file */
+    if (mapping == NULL) {
+        socket = guac_recording_open_reader(fd, 0);
+        if (socket == NULL) {
+            guaclog_log(GUAC_LOG_ERROR, "%s: %s", path,
+                    guac_status_string(guac_error));
+            close(fd);
+            guaclog_state_free(state);
+            return 1;
+        }
+    }
+
+    if (events != NULL)
+        guaclog_log(GUAC_LOG_DEBUG, "Reading input events from \"%s\" "
+                "...", path);
+    else
+        guaclog_log(GUAC_LOG_INFO, "Writing input events from \"%s\" "
+                "to \"%s\" ...", path, out_path);
 
     /* Attempt to read all instructions in the file */
-    if (guaclog_read_instructions(state, path, socket)) {
-        guac_socket_free(socket);
+    if (guaclog_read_instructions(state, path, mapping, socket)) {
+        guaclog_close_input(mapping, socket);
         guaclog_state_free(state);
         return 1;
     }
 
     /* Close input and finish interpreting process */
-    guac_socket_free(socket);
+    guaclog_close_input(mapping, socket);
     return guaclog_state_free(state);
 
 }
@@ -21,12 +21,15 @@
 #define GUACLOG_INTERPRET_H
 
 #include "config.h"
+#include "events.h"
 
 #include <stdbool.h>
 
 /**
  * Interprets all input events within the given Guacamole protocol dump,
- * producing a human-readable log of those input events. A read lock will be
+ * producing a human-readable log of those input events or, if a
+ * guaclog_events is given, appending each input event to that
+ * guaclog_events as a JSON line. A read lock will be
  * acquired on the input file to ensure that in-progress logs are not
  * interpreted. This behavior can be overridden by specifying true for the
  * force parameter.
@@ -36,6 +39,11 @@
  *
  * @param out_path
  *     The full path to the file in which interpreted log should be written.
+ *     This is ignored if events is non-NULL.
+ *
+ * @param events
+ *     The guaclog_events to which input events should be appended as JSON
+ *     lines, or NULL if a human-readable log should be written to out_path.
  *
  * @param force
  *     Interpret even if the input file appears to be an in-progress log (has
@@ -45,7 +53,8 @@
  *     Zero on success, non-zero if an error prevented successful
  *     interpretation of the log.
  */
-int guaclog_interpret(const char* path, const char* out_path, bool force);
+int guaclog_interpret(const char* path, const char* out_path,
+        guaclog_events* events, bool force);
 
 #endif
 
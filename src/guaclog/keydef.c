@@ -30,6 +30,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * The size of the buffer required to hold the name of any key whose
+ * definition is derived from its keysym, including null terminator.
+ */
+#define GUACLOG_KEYDEF_NAME_SIZE 64
+
 /**
  * All known keys.
  */
@@ -173,53 +179,68 @@ static guaclog_keydef* guaclog_get_known_key(int keysym) {
 }
 
 /**
- * Returns a statically-allocated guaclog_keydef representing an unknown key,
- * deriving the name of the key from the hexadecimal value of the keysym.
+ * Populates the given guaclog_keydef such that it represents an unknown key,
+ * deriving the name of the key from the hexadecimal value of the keysym. The
+ * resulting guaclog_keydef refers to the given name buffer and is valid only
+ * while that buffer remains valid.
  *
  * @param keysym
  *     The X11 keysym of the key.
  *
+ * @param unknown_keydef
+ *     The guaclog_keydef to populate.
+ *
+ * @param unknown_keydef_name
+ *     A buffer of at least GUACLOG_KEYDEF_NAME_SIZE bytes which should
+ *     receive the name of the key.
+ *
  * @return
- *     A statically-allocated guaclog_keydef representing the key associated
- *     with the given keysym.
+ *     The given guaclog_keydef, now representing the key associated with the
+ *     given keysym.
  */
-static guaclog_keydef* guaclog_get_unknown_key(int keysym) {
-
-    static char unknown_keydef_name[64];
-    static guaclog_keydef unknown_keydef;
+static guaclog_keydef* guaclog_get_unknown_key(int keysym,
+        guaclog_keydef* unknown_keydef, char* unknown_keydef_name) {
 
     /* Write keysym as hex */
-    int size = snprintf(unknown_keydef_name, sizeof(unknown_keydef_name),
+    int size = snprintf(unknown_keydef_name, GUACLOG_KEYDEF_NAME_SIZE,
             "0x%X", keysym);
 
-    /* Hex string is guaranteed to fit within the provided 64 bytes */
-    assert(size < sizeof(unknown_keydef_name));
+    /* Hex string is guaranteed to fit within the provided buffer */
+    assert(size < GUACLOG_KEYDEF_NAME_SIZE);
 
-    /* Return static key definition */
-    unknown_keydef.keysym = keysym;
-    unknown_keydef.name = unknown_keydef_name;
-    return &unknown_keydef;
+    /* Return populated key definition */
+    unknown_keydef->keysym = keysym;
+    unknown_keydef->name = unknown_keydef_name;
+    unknown_keydef->value = NULL;
+    unknown_keydef->modifier = false;
+    return unknown_keydef;
 
 }
 
 /**
- * Returns a statically-allocated guaclog_keydef representing the key
+ * Populates the given guaclog_keydef such that it represents the key
  * associated with the given keysym, deriving the name and value of the key
- * using its corresponding Unicode character.
+ * using its corresponding Unicode character. The resulting guaclog_keydef
+ * refers to the given name buffer and is valid only while that buffer remains
+ * valid.
  *
  * @param keysym
  *     The X11 keysym of the key.
  *
+ * @param unicode_keydef
+ *     The guaclog_keydef to populate.
+ *
+ * @param unicode_keydef_name
+ *     A buffer of at least GUACLOG_KEYDEF_NAME_SIZE bytes which should
+ *     receive the name of the key.
+ *
  * @return
- *     A statically-allocated guaclog_keydef representing the key associated
- *     with the given keysym, or NULL if the given keysym has no corresponding
- *     Unicode character.
+ *     The given guaclog_keydef, now representing the key associated with the
+ *     given keysym, or NULL if the given keysym has no corresponding Unicode
+ *     character.
  */
-static guaclog_keydef* guaclog_get_unicode_key(int keysym) {
-
-    static char unicode_keydef_name[8];
-
-    static guaclog_keydef unicode_keydef;
+static guaclog_keydef* guaclog_get_unicode_key(int keysym,
+        guaclog_keydef* unicode_keydef, char* unicode_keydef_name) {
 
     int i;
     int mask, bytes;
@@ -260,11 +281,11 @@ static guaclog_keydef* guaclog_get_unicode_key(int keysym) {
     /* Set initial byte */
     *key_name = mask | codepoint;
 
-    /* Return static key definition */
-    unicode_keydef.keysym = keysym;
-    unicode_keydef.name = unicode_keydef.value = unicode_keydef_name;
-    unicode_keydef.modifier = false;
-    return &unicode_keydef;
+    /* Return populated key definition */
+    unicode_keydef->keysym = keysym;
+    unicode_keydef->name = unicode_keydef->value = unicode_keydef_name;
+    unicode_keydef->modifier = false;
+    return unicode_keydef;
 
 }
 
@@ -303,19 +324,27 @@ guaclog_keydef* guaclog_keydef_alloc(int keysym) {
 
     guaclog_keydef* keydef;
 
+    /* Storage for keys whose definitions must be derived. These are copied
+     * prior to returning, and are local such that keys may be allocated
+     * from several threads at once. */
+    guaclog_keydef derived_keydef;
+    char derived_keydef_name[GUACLOG_KEYDEF_NAME_SIZE];
+
     /* Check list of known keys first */
     keydef = guaclog_get_known_key(keysym);
     if (keydef != NULL)
         return guaclog_copy_key(keydef);
 
     /* Failing that, attempt to translate straight into a Unicode character */
-    keydef = guaclog_get_unicode_key(keysym);
+    keydef = guaclog_get_unicode_key(keysym, &derived_keydef,
+            derived_keydef_name);
     if (keydef != NULL)
         return guaclog_copy_key(keydef);
 
     /* Key not known */
     guaclog_log(GUAC_LOG_DEBUG, "Definition not found for key 0x%X.", keysym);
-    return guaclog_copy_key(guaclog_get_unknown_key(keysym));
+    return guaclog_copy_key(guaclog_get_unknown_key(keysym, &derived_keydef,
+                derived_keydef_name));
 
 }
 
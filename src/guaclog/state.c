@@ -26,6 +26,7 @@
 #include <guacamole/string.h>
 
 #include <errno.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -78,9 +79,31 @@ fail_output_fd:
 
 }
 
+guaclog_state* guaclog_state_alloc_events(const char* recording,
+        guaclog_events* events) {
+
+    guaclog_state* state = (guaclog_state*) guac_mem_zalloc(sizeof(guaclog_state));
+
+    /* Buffer all key events of the recording in memory */
+    state->output = open_memstream(&state->buffer, &state->length);
+    if (state->output == NULL) {
+        guaclog_log(GUAC_LOG_ERROR, "Failed to allocate buffer for key "
+                "events of \"%s\": %s", recording, strerror(errno));
+        guac_mem_free(state);
+        return NULL;
+    }
+
+    state->events = events;
+    state->recording = recording;
+
+    return state;
+
+}
+
 int guaclog_state_free(guaclog_state* state) {
 
     int i;
+    int result = 0;
 
     /* Ignore NULL state */
     if (state == NULL)
@@ -93,8 +116,92 @@ int guaclog_state_free(guaclog_state* state) {
     /* Close output file */
     fclose(state->output);
 
+    /* Append all buffered key events to shared output at once, such that
+     * events from different recordings are never interleaved */
+    if (state->events != NULL) {
+        result = guaclog_events_append(state->events,
+                state->buffer, state->length);
+        free(state->buffer);
+    }
+
     guac_mem_free(state);
-    return 0;
+    return result;
+
+}
+
+/**
+ * Writes the given string to the given output stream as a quoted JSON
+ * string, escaping any characters which cannot be represented literally. If
+ * the given string is NULL, a JSON null is written instead.
+ *
+ * @param output
+ *     The output stream to write to.
+ *
+ * @param str
+ *     The string to write, which may be NULL.
+ */
+static void guaclog_state_write_json_string(FILE* output, const char* str) {
+
+    if (str == NULL) {
+        fputs("null", output);
+        return;
+    }
+
+    putc('"', output);
+
+    for (; *str != '\0'; str++) {
+
+        unsigned char c = (unsigned char) *str;
+
+        if (c == '"' || c == '\\')
+            fprintf(output, "\\%c", c);
+        else if (c == '\n')
+            fputs("\\n", output);
+        else if (c < 0x20)
+            fprintf(output, "\\u%04X", c);
+        else
+            putc(c, output);
+
+    }
+
+    putc('"', output);
+
+}
+
+/**
+ * Writes the given key event as a single JSON line to the output of the
+ * given state.
+ *
+ * @param state
+ *     The Guacamole input log interpreter state whose output should receive
+ *     the key event.
+ *
+ * @param keydef
+ *     The definition of the key being pressed or released.
+ *
+ * @param pressed
+ *     true if the key is being pressed, false if the key is being released.
+ *
+ * @param timestamp
+ *     The time at which the key was pressed or released, in milliseconds
+ *     since the Unix epoch, or zero if unknown.
+ */
+static void guaclog_state_write_event(guaclog_state* state,
+        guaclog_keydef* keydef, bool pressed, guac_timestamp timestamp) {
+
+    FILE* output = state->output;
+
+    fputs("{\"recording\":", output);
+    guaclog_state_write_json_string(output, state->recording);
+
+    fprintf(output, ",\"timestamp\":%" PRId64 ",\"keysym\":%i,\"name\":",
+            (int64_t) timestamp, keydef->keysym);
+    guaclog_state_write_json_string(output, keydef->name);
+
+    fputs(",\"value\":", output);
+    guaclog_state_write_json_string(output, keydef->value);
+
+    fprintf(output, ",\"pressed\":%s}\n", pressed ? "true" : "false");
 
 }
 
@@ -211,7 +318,8 @@ static bool guaclog_state_is_shortcut(guaclog_state* state) {
 
 }
 
-int guaclog_state_update_key(guaclog_state* state, int keysym, bool pressed) {
+int guaclog_state_update_key(guaclog_state* state, int keysym, bool pressed,
+        guac_timestamp timestamp) {
 
     int i;
 
@@ -220,6 +328,13 @@ int guaclog_state_update_key(guaclog_state* state, int keysym, bool pressed) {
     if (keydef == NULL)
         return 0;
 
+    /* Write every key event verbatim if producing JSON lines */
+    if (state->events != NULL) {
+        guaclog_state_write_event(state, keydef, pressed, timestamp);
+        guaclog_keydef_free(keydef);
+        return 0;
+    }
+
     /* Update tracked key state for modifiers */
     if (keydef->modifier) {
 
@@ -21,9 +21,13 @@
 #define GUACLOG_STATE_H
 
 #include "config.h"
+#include "events.h"
 #include "keydef.h"
 
+#include <guacamole/timestamp-types.h>
+
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
 /**
@@ -55,10 +59,34 @@ typedef struct guaclog_key_state {
 typedef struct guaclog_state {
 
     /**
-     * Output file stream.
+     * Output file stream. If key events are being written as JSON lines, this
+     * is an in-memory stream whose contents are appended to events when the
+     * state is freed.
      */
     FILE* output;
 
+    /**
+     * The shared output to which key events should be written as JSON lines,
+     * or NULL if interpreted, human-readable text should be written instead.
+     */
+    guaclog_events* events;
+
+    /**
+     * The path of the recording being interpreted, included within each key
+     * event written as a JSON line. This is only used if events is non-NULL.
+     */
+    const char* recording;
+
+    /**
+     * The buffer backing the in-memory output stream, if events is non-NULL.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes within buffer, if events is non-NULL.
+     */
+    size_t length;
+
     /**
      * The number of keys currently being tracked within the key_states array.
      */
@@ -88,6 +116,27 @@ typedef struct guaclog_state {
  */
 guaclog_state* guaclog_state_alloc(const char* path);
 
+/**
+ * Allocates a new state structure for the Guacamole input log interpreter
+ * which, rather than writing interpreted, human-readable text, writes each
+ * key event of the given recording to the given guaclog_events as a JSON
+ * line. Key events are buffered in memory and appended to the given
+ * guaclog_events only when the state is freed.
+ *
+ * @param recording
+ *     The path of the recording being interpreted. This string must remain
+ *     valid until the state is freed.
+ *
+ * @param events
+ *     The guaclog_events to which key events should be appended.
+ *
+ * @return
+ *     The newly-allocated Guacamole input log interpreter state, or NULL if
+ *     the state could not be allocated.
+ */
+guaclog_state* guaclog_state_alloc_events(const char* recording,
+        guaclog_events* events);
+
 /**
  * Frees all memory associated with the given Guacamole input log interpreter
  * state, and finishes any remaining interpreting process. If the given state
@@ -115,11 +164,16 @@ int guaclog_state_free(guaclog_state* state);
  * @param pressed
  *     true if the key is being pressed, false if the key is being released.
  *
+ * @param timestamp
+ *     The time at which the key was pressed or released, in milliseconds
+ *     since the Unix epoch, or zero if unknown.
+ *
  * @return
  *     Zero if the interpreter state was updated successfully, non-zero
  *     otherwise.
  */
-int guaclog_state_update_key(guaclog_state* state, int keysym, bool pressed);
+int guaclog_state_update_key(guaclog_state* state, int keysym, bool pressed,
+        guac_timestamp timestamp);
 
 #endif
 
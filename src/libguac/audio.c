@@ -27,6 +27,11 @@
 #include "guacamole/user.h"
 #include "raw_encoder.h"
 
+#ifdef ENABLE_OPUS
+#include "opus_encoder.h"
+#endif
+
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -53,6 +58,55 @@ static void guac_audio_stream_set_encoder(guac_audio_stream* audio,
 
 }
 
+/**
+ * Returns whether the given buffer of PCM data contains only silence, where
+ * each sample is no louder than GUAC_AUDIO_SILENCE_THRESHOLD. The PCM data
+ * is interpreted using the format of the given audio stream, with 16-bit
+ * samples in little-endian byte order. Any trailing partial sample is
+ * ignored.
+ *
+ * @param audio
+ *     The guac_audio_stream whose PCM format should be used to interpret the
+ *     given data.
+ *
+ * @param data
+ *     The PCM data to test.
+ *
+ * @param length
+ *     The number of bytes of PCM data provided.
+ *
+ * @return
+ *     Non-zero if the PCM data contains only silence, zero otherwise.
+ */
+static int guac_audio_is_silence(guac_audio_stream* audio,
+        const unsigned char* data, int length) {
+
+    /* 16-bit samples are compared against the threshold directly */
+    if (audio->bps == 16) {
+
+        for (int i = 0; i + 1 < length; i += 2) {
+            int sample = (int16_t) (data[i] | (data[i + 1] << 8));
+            if (sample > GUAC_AUDIO_SILENCE_THRESHOLD
+                    || sample < -GUAC_AUDIO_SILENCE_THRESHOLD)
+                return 0;
+        }
+
+        return 1;
+
+    }
+
+    /* 8-bit samples are scaled up to 16 bits for comparison */
+    for (int i = 0; i < length; i++) {
+        int sample = ((int8_t) data[i]) * 256;
+        if (sample > GUAC_AUDIO_SILENCE_THRESHOLD
+                || sample < -GUAC_AUDIO_SILENCE_THRESHOLD)
+            return 0;
+    }
+
+    return 1;
+
+}
+
 /**
  * Assigns a new audio encoder to the given guac_audio_stream based on the
  * audio mimetypes declared as supported by the given user. If no audio encoder
@@ -89,6 +143,16 @@ static void* guac_audio_assign_encoder(guac_user* user, void* data) {
 
         const char* mimetype = user->info.audio_mimetypes[i];
 
+#ifdef ENABLE_OPUS
+        /* If Ogg Opus is supported and can represent this audio, done. */
+        if ((bps == 8 || bps == 16)
+                && audio->channels <= GUAC_OPUS_ENCODER_MAX_CHANNELS
+                && strcmp(mimetype, opus_encoder->mimetype) == 0) {
+            guac_audio_stream_set_encoder(audio, opus_encoder);
+            break;
+        }
+#endif
+
         /* If 16-bit raw audio is supported, done. */
         if (bps == 16 && strcmp(mimetype, raw16_encoder->mimetype) == 0) {
             guac_audio_stream_set_encoder(audio, raw16_encoder);
@@ -169,6 +233,10 @@ void guac_audio_stream_reset(guac_audio_stream* audio,
     audio->channels = channels;
     audio->bps = bps;
 
+    /* Silence is tracked relative to the PCM format, and thus restarts */
+    audio->silence_length = 0;
+    audio->silence_suppressed = 0;
+
     /* Re-init encoder */
     guac_audio_stream_set_encoder(audio, encoder);
 
@@ -206,6 +274,36 @@ void guac_audio_stream_free(guac_audio_stream* audio) {
 void guac_audio_stream_write_pcm(guac_audio_stream* audio, 
         const unsigned char* data, int length) {
 
+    if (guac_audio_is_silence(audio, data, length)) {
+
+        /* Once suppressed, silence is simply discarded */
+        if (audio->silence_suppressed)
+            return;
+
+        /* Let brief silence through untouched, but note its duration */
+        int bytes_per_second = audio->rate * audio->channels * audio->bps / 8;
+        int holdoff = bytes_per_second / 1000 * GUAC_AUDIO_SILENCE_HOLDOFF;
+        if (audio->silence_length < holdoff) {
+            audio->silence_length += length;
+        }
+
+        /* Stop sending data once silence has persisted beyond the holdoff,
+         * first flushing anything already encoded such that audio up to this
+         * point plays out completely */
+        else {
+            guac_audio_stream_flush(audio);
+            audio->silence_suppressed = 1;
+            return;
+        }
+
+    }
+
+    /* Any non-silent data resumes normal encoding */
+    else {
+        audio->silence_length = 0;
+        audio->silence_suppressed = 0;
+    }
+
     /* Write data */
     if (audio->encoder != NULL && audio->encoder->write_handler)
         audio->encoder->write_handler(audio, data, length);
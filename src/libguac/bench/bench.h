@@ -0,0 +1,161 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_BENCH_H
+#define GUAC_BENCH_H
+
+/**
+ * Common helpers for libguac microbenchmarks. Each benchmark is a standalone
+ * program that repeatedly invokes the code being measured and reports
+ * throughput on STDOUT in a consistent, human-readable format. If the
+ * environment variable named by GUAC_BENCH_FORMAT_VARIABLE is set to "json",
+ * each result is instead reported as a single JSON object on its own line,
+ * such that results may be collected and compared across releases.
+ *
+ * @file bench.h
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The minimum amount of time that each measured benchmark should run for, in
+ * nanoseconds. Benchmarks repeat until at least this much time has elapsed to
+ * reduce the impact of timer resolution and scheduling noise.
+ */
+#define GUAC_BENCH_MIN_DURATION 500000000LL
+
+/**
+ * The name of the environment variable that selects the format of reported
+ * results. If set to "json", results are reported as JSON Lines. Otherwise,
+ * results are reported as human-readable, aligned columns.
+ */
+#define GUAC_BENCH_FORMAT_VARIABLE "GUAC_BENCH_FORMAT"
+
+/**
+ * Returns whether results should be reported as JSON Lines rather than as
+ * human-readable text.
+ *
+ * @return
+ *     Non-zero if results should be reported as JSON Lines, zero otherwise.
+ */
+static inline int guac_bench_is_json(void) {
+    const char* format = getenv(GUAC_BENCH_FORMAT_VARIABLE);
+    return format != NULL && strcmp(format, "json") == 0;
+}
+
+/**
+ * Prints a single benchmark result to STDOUT in the selected format. The
+ * name, variant, and unit name are included verbatim and must not contain
+ * characters requiring escaping within JSON strings.
+ *
+ * @param name
+ *     The name of the benchmark.
+ *
+ * @param variant
+ *     The name of the specific implementation, variant, or quantity measured.
+ *
+ * @param value
+ *     The measured value.
+ *
+ * @param unit_name
+ *     The human-readable name of the units of the measured value.
+ */
+static inline void guac_bench_print(const char* name, const char* variant,
+        double value, const char* unit_name) {
+
+    if (guac_bench_is_json())
+        printf("{\"benchmark\":\"%s\",\"variant\":\"%s\","
+                "\"value\":%.6g,\"unit\":\"%s\"}\n",
+                name, variant, value, unit_name);
+
+    else
+        printf("%-32s %-12s %12.2f %s\n", name, variant, value, unit_name);
+
+}
+
+/**
+ * Returns the current value of a monotonic clock, in nanoseconds.
+ *
+ * @return
+ *     The current value of a monotonic clock, in nanoseconds.
+ */
+static inline int64_t guac_bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Prints a single benchmark result to STDOUT as a throughput value.
+ *
+ * @param name
+ *     The name of the benchmark.
+ *
+ * @param variant
+ *     The name of the specific implementation or variant measured.
+ *
+ * @param units
+ *     The number of units of work (pixels, bytes, instructions, etc.)
+ *     processed during the benchmark.
+ *
+ * @param unit_name
+ *     The human-readable name of the throughput units, such as "MPix/s" or
+ *     "MB/s". Throughput is always reported in millions of units per second.
+ *
+ * @param elapsed
+ *     The amount of time taken to process all units, in nanoseconds.
+ */
+static inline void guac_bench_report(const char* name, const char* variant,
+        uint64_t units, const char* unit_name, int64_t elapsed) {
+
+    double seconds = (double) elapsed / 1000000000.0;
+    guac_bench_print(name, variant, (double) units / seconds / 1000000.0,
+            unit_name);
+
+}
+
+/**
+ * Prints a single benchmark result to STDOUT as an absolute value, for
+ * measurements that are not meaningfully expressed as a throughput in
+ * millions of units per second.
+ *
+ * @param name
+ *     The name of the benchmark.
+ *
+ * @param variant
+ *     The name of the specific implementation, variant, or quantity measured.
+ *
+ * @param value
+ *     The measured value.
+ *
+ * @param unit_name
+ *     The human-readable name of the units of the measured value, such as
+ *     "frames/s" or "us/frame".
+ */
+static inline void guac_bench_report_value(const char* name,
+        const char* variant, double value, const char* unit_name) {
+    guac_bench_print(name, variant, value, unit_name);
+}
+
+#endif
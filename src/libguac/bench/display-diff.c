@@ -0,0 +1,139 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+/*
+ * Measures the throughput of the row comparison used by guac_display to
+ * locate changes between the previous and pending frames, comparing the
+ * portable scalar implementation with the implementation selected for the
+ * current CPU.
+ */
+
+#include "bench.h"
+#include "display-plan.h"
+
+#include <guacamole/mem.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The width of the simulated frames to compare, in pixels.
+ */
+#define BENCH_FRAME_WIDTH 1920
+
+/**
+ * The height of the simulated frames to compare, in pixels.
+ */
+#define BENCH_FRAME_HEIGHT 1080
+
+/**
+ * The number of 64-pixel cells spanned by each row of the simulated frames.
+ */
+#define BENCH_FRAME_CELLS ((BENCH_FRAME_WIDTH + 63) / 64)
+
+/**
+ * Compares every row of the given frames using the given implementation,
+ * repeating until at least GUAC_BENCH_MIN_DURATION has elapsed, and reports
+ * the resulting throughput.
+ *
+ * @param name
+ *     The name of the implementation being measured.
+ *
+ * @param diff_row
+ *     The comparison implementation to measure.
+ *
+ * @param frame_a
+ *     The image data of the first frame.
+ *
+ * @param frame_b
+ *     The image data of the second frame.
+ *
+ * @return
+ *     The total number of differing pixels found within a single pass over
+ *     the frames, which may be compared between implementations to verify all
+ *     implementations are equivalent.
+ */
+static uint64_t bench_diff(const char* name,
+        guac_display_plan_diff_row_function* diff_row,
+        const uint32_t* frame_a, const uint32_t* frame_b) {
+
+    uint64_t changed[BENCH_FRAME_CELLS];
+    uint64_t differences = 0;
+    uint64_t pixels = 0;
+    int64_t start = guac_bench_now();
+    int64_t elapsed;
+
+    do {
+
+        differences = 0;
+        for (int y = 0; y < BENCH_FRAME_HEIGHT; y++) {
+
+            size_t offset = (size_t) y * BENCH_FRAME_WIDTH;
+            diff_row(frame_a + offset, frame_b + offset, BENCH_FRAME_WIDTH,
+                    changed);
+
+            for (int i = 0; i < BENCH_FRAME_CELLS; i++) {
+                for (uint64_t mask = changed[i]; mask; mask &= mask - 1)
+                    differences++;
+            }
+
+        }
+
+        pixels += BENCH_FRAME_WIDTH * BENCH_FRAME_HEIGHT;
+
+    } while ((elapsed = guac_bench_now() - start) < GUAC_BENCH_MIN_DURATION);
+
+    guac_bench_report("display-plan-diff", name, pixels, "MPix/s", elapsed);
+    return differences;
+
+}
+
+int main(int argc, char** argv) {
+
+    size_t length = BENCH_FRAME_WIDTH * BENCH_FRAME_HEIGHT;
+    uint32_t* frame_a = guac_mem_alloc(length, sizeof(uint32_t));
+    uint32_t* frame_b = guac_mem_alloc(length, sizeof(uint32_t));
+
+    /* Simulate a mostly-static frame with sparse changes */
+    srand(0x6775);
+    for (size_t i = 0; i < length; i++) {
+        frame_a[i] = 0xFF000000 | (rand() & 0xFFFFFF);
+        frame_b[i] = (rand() % 256) ? frame_a[i] : ~frame_a[i];
+    }
+
+    uint64_t scalar = bench_diff("scalar", guac_display_plan_diff_row_scalar,
+            frame_a, frame_b);
+
+    uint64_t selected = bench_diff(guac_display_plan_get_diff_row_name(),
+            guac_display_plan_get_diff_row(), frame_a, frame_b);
+
+    guac_mem_free(frame_a);
+    guac_mem_free(frame_b);
+
+    if (scalar != selected) {
+        fprintf(stderr, "Comparison implementations produced differing results!\n");
+        return 1;
+    }
+
+    return 0;
+
+}
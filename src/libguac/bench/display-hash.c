@@ -0,0 +1,124 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+/*
+ * Measures the throughput of the sliding-window hash used by guac_display to
+ * detect scrolling and other reuse of previous frame contents, comparing the
+ * portable scalar implementation with the implementation selected for the
+ * current CPU.
+ */
+
+#include "bench.h"
+#include "display-plan.h"
+
+#include <guacamole/mem.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The width of the simulated frame to hash, in pixels.
+ */
+#define BENCH_FRAME_WIDTH 3840
+
+/**
+ * The height of the simulated frame to hash, in pixels.
+ */
+#define BENCH_FRAME_HEIGHT 2160
+
+/**
+ * Hashes every row of the given frame using the given hash implementation,
+ * repeating until at least GUAC_BENCH_MIN_DURATION has elapsed, and reports
+ * the resulting throughput.
+ *
+ * @param name
+ *     The name of the implementation being measured.
+ *
+ * @param hash_row
+ *     The hash implementation to measure.
+ *
+ * @param frame
+ *     The image data to hash.
+ *
+ * @param cell_hash
+ *     Storage for BENCH_FRAME_WIDTH partial cell hashes.
+ *
+ * @return
+ *     The final cell hash of the bottom-right pixel, which may be compared
+ *     between implementations to verify all implementations are equivalent.
+ */
+static uint64_t bench_hash(const char* name,
+        guac_display_plan_hash_row_function* hash_row, const uint32_t* frame,
+        uint64_t* cell_hash) {
+
+    uint64_t pixels = 0;
+    int64_t start = guac_bench_now();
+    int64_t elapsed;
+
+    do {
+
+        memset(cell_hash, 0, BENCH_FRAME_WIDTH * sizeof(uint64_t));
+
+        const uint32_t* row = frame;
+        for (int y = 0; y < BENCH_FRAME_HEIGHT; y++) {
+            hash_row(row, BENCH_FRAME_WIDTH, cell_hash);
+            row += BENCH_FRAME_WIDTH;
+        }
+
+        pixels += BENCH_FRAME_WIDTH * BENCH_FRAME_HEIGHT;
+
+    } while ((elapsed = guac_bench_now() - start) < GUAC_BENCH_MIN_DURATION);
+
+    guac_bench_report("display-plan-hash", name, pixels, "MPix/s", elapsed);
+    return cell_hash[BENCH_FRAME_WIDTH - 1];
+
+}
+
+int main(int argc, char** argv) {
+
+    uint32_t* frame = guac_mem_alloc(BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT,
+            sizeof(uint32_t));
+
+    uint64_t* cell_hash = guac_mem_alloc(BENCH_FRAME_WIDTH, sizeof(uint64_t));
+
+    /* Fill frame with arbitrary, non-repeating data */
+    srand(0x6775);
+    for (size_t i = 0; i < BENCH_FRAME_WIDTH * BENCH_FRAME_HEIGHT; i++)
+        frame[i] = 0xFF000000 | (rand() & 0xFFFFFF);
+
+    uint64_t scalar = bench_hash("scalar", guac_display_plan_hash_row_scalar,
+            frame, cell_hash);
+
+    uint64_t selected = bench_hash(guac_display_plan_get_hash_row_name(),
+            guac_display_plan_get_hash_row(), frame, cell_hash);
+
+    guac_mem_free(cell_hash);
+    guac_mem_free(frame);
+
+    if (scalar != selected) {
+        fprintf(stderr, "Hash implementations produced differing results!\n");
+        return 1;
+    }
+
+    return 0;
+
+}
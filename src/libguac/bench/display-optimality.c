@@ -0,0 +1,330 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Measures the cost of the estimate used by guac_display to choose between
+ * PNG and lossy image formats, comparing a full scan of each image with the
+ * row-sampled scan used by the display worker threads, and reports how often
+ * the sampled estimate reaches the same decision as the full scan.
+ */
+
+#include "bench.h"
+#include "display-plan.h"
+#include "display-priv.h"
+
+#include <guacamole/mem.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * The width of each simulated frame, in pixels.
+ */
+#define BENCH_FRAME_WIDTH 1920
+
+/**
+ * The height of each simulated frame, in pixels.
+ */
+#define BENCH_FRAME_HEIGHT 1080
+
+/**
+ * The number of rectangles within each simulated frame whose format is
+ * estimated.
+ */
+#define BENCH_RECTS 256
+
+/**
+ * The minimum percentage of rectangles for which the sampled estimate must
+ * reach the same decision as the full scan for the benchmark to succeed.
+ */
+#define BENCH_MIN_AGREEMENT 95.0
+
+/**
+ * A rectangle within a simulated frame.
+ */
+typedef struct bench_rect {
+
+    /**
+     * The X coordinate of the upper-left corner of the rectangle.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the rectangle.
+     */
+    int y;
+
+    /**
+     * The width of the rectangle, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the rectangle, in pixels.
+     */
+    int height;
+
+} bench_rect;
+
+/**
+ * Fills the given frame with flat, UI-like content: solid areas of color
+ * separated by one-pixel borders.
+ *
+ * @param frame
+ *     The frame to fill.
+ */
+static void bench_fill_ui(uint32_t* frame) {
+
+    for (int i = 0; i < BENCH_FRAME_WIDTH * BENCH_FRAME_HEIGHT; i++)
+        frame[i] = 0xFFE0E0E0;
+
+    for (int i = 0; i < 400; i++) {
+
+        int width = 16 + rand() % 400;
+        int height = 8 + rand() % 200;
+        int left = rand() % (BENCH_FRAME_WIDTH - width);
+        int top = rand() % (BENCH_FRAME_HEIGHT - height);
+        uint32_t color = 0xFF000000 | (rand() & 0xFFFFFF);
+
+        for (int y = top; y < top + height; y++) {
+            for (int x = left; x < left + width; x++) {
+                int border = (y == top || x == left
+                        || y == top + height - 1 || x == left + width - 1);
+                frame[y * BENCH_FRAME_WIDTH + x] = border ? 0xFF404040 : color;
+            }
+        }
+
+    }
+
+}
+
+/**
+ * Fills the given frame with text-like content: dark, antialiased glyph
+ * shapes on a light background, arranged in lines.
+ *
+ * @param frame
+ *     The frame to fill.
+ */
+static void bench_fill_text(uint32_t* frame) {
+
+    for (int y = 0; y < BENCH_FRAME_HEIGHT; y++) {
+        for (int x = 0; x < BENCH_FRAME_WIDTH; x++) {
+
+            uint32_t color = 0xFFFFFFFF;
+
+            /* Glyphs occupy 12 of every 18 rows, and 7 of every 9 columns */
+            if (y % 18 < 12 && x % 9 < 7 && rand() % 3 == 0) {
+                int shade = rand() % 4 == 0 ? 0x80 + rand() % 0x60 : 0x20;
+                color = 0xFF000000 | (shade * 0x010101);
+            }
+
+            frame[y * BENCH_FRAME_WIDTH + x] = color;
+
+        }
+    }
+
+}
+
+/**
+ * Fills the given frame with photo-like content: smooth gradients
+ * perturbed by per-pixel noise.
+ *
+ * @param frame
+ *     The frame to fill.
+ */
+static void bench_fill_photo(uint32_t* frame) {
+
+    for (int y = 0; y < BENCH_FRAME_HEIGHT; y++) {
+        for (int x = 0; x < BENCH_FRAME_WIDTH; x++) {
+            int red = (x * 255 / BENCH_FRAME_WIDTH + rand() % 8) & 0xFF;
+            int green = (y * 255 / BENCH_FRAME_HEIGHT + rand() % 8) & 0xFF;
+            int blue = ((x + y) / 16 + rand() % 8) & 0xFF;
+            frame[y * BENCH_FRAME_WIDTH + x] = 0xFF000000
+                | (red << 16) | (green << 8) | blue;
+        }
+    }
+
+}
+
+/**
+ * Fills the given frame with a mixture of content: bands of photo-like
+ * content between areas of flat, UI-like content, as with images or video
+ * embedded within an application window.
+ *
+ * @param frame
+ *     The frame to fill.
+ */
+static void bench_fill_mixed(uint32_t* frame) {
+
+    bench_fill_ui(frame);
+
+    for (int y = 0; y < BENCH_FRAME_HEIGHT; y++) {
+
+        /* Photo-like content occupies 96 of every 256 rows */
+        if (y % 256 >= 96)
+            continue;
+
+        for (int x = BENCH_FRAME_WIDTH / 4; x < BENCH_FRAME_WIDTH; x++) {
+            int red = (x + rand() % 32) & 0xFF;
+            int green = (y + rand() % 32) & 0xFF;
+            frame[y * BENCH_FRAME_WIDTH + x] = 0xFF000000
+                | (red << 16) | (green << 8) | (rand() & 0x1F);
+        }
+
+    }
+
+}
+
+/**
+ * Estimates the optimality of PNG for every given rectangle of the given
+ * frame, repeating until at least GUAC_BENCH_MIN_DURATION has elapsed, and
+ * reports the resulting throughput.
+ *
+ * @param name
+ *     The name of the content within the frame.
+ *
+ * @param variant
+ *     The name of the estimate being measured.
+ *
+ * @param frame
+ *     The frame containing the rectangles.
+ *
+ * @param rects
+ *     The BENCH_RECTS rectangles to estimate.
+ *
+ * @param max_rows
+ *     The maximum number of rows of each rectangle to examine.
+ *
+ * @param results
+ *     Storage for the BENCH_RECTS estimates produced by a single pass over
+ *     the rectangles.
+ */
+static void bench_optimality(const char* name, const char* variant,
+        const uint32_t* frame, const bench_rect* rects, int max_rows,
+        int* results) {
+
+    uint64_t pixels = 0;
+    int64_t start = guac_bench_now();
+    int64_t elapsed;
+
+    do {
+
+        for (int i = 0; i < BENCH_RECTS; i++) {
+
+            const bench_rect* rect = &rects[i];
+            const uint32_t* buffer = frame
+                + rect->y * BENCH_FRAME_WIDTH + rect->x;
+
+            results[i] = guac_display_png_optimality(
+                    (const unsigned char*) buffer,
+                    BENCH_FRAME_WIDTH * sizeof(uint32_t),
+                    rect->width, rect->height, max_rows);
+
+            pixels += rect->width * rect->height;
+
+        }
+
+    } while ((elapsed = guac_bench_now() - start) < GUAC_BENCH_MIN_DURATION);
+
+    guac_bench_report(name, variant, pixels, "MPix/s", elapsed);
+
+}
+
+/**
+ * Measures both the full and sampled estimates for rectangles of the given
+ * frame, reporting throughput of each and the percentage of rectangles for
+ * which both estimates agree on whether PNG should be used.
+ *
+ * @param name
+ *     The name of the content within the frame.
+ *
+ * @param frame
+ *     The frame to estimate.
+ *
+ * @param rects
+ *     The BENCH_RECTS rectangles to estimate.
+ *
+ * @return
+ *     The percentage of rectangles for which the full and sampled estimates
+ *     agree.
+ */
+static double bench_content(const char* name, const uint32_t* frame,
+        const bench_rect* rects) {
+
+    int full[BENCH_RECTS];
+    int sampled[BENCH_RECTS];
+
+    bench_optimality(name, "full", frame, rects, 0, full);
+    bench_optimality(name, "sampled", frame, rects,
+            GUAC_DISPLAY_PNG_OPTIMALITY_SAMPLE_ROWS, sampled);
+
+    int agree = 0;
+    for (int i = 0; i < BENCH_RECTS; i++) {
+        if ((full[i] < 0) == (sampled[i] < 0))
+            agree++;
+    }
+
+    double agreement = 100.0 * agree / BENCH_RECTS;
+    guac_bench_report_value(name, "agreement", agreement, "%");
+    return agreement;
+
+}
+
+int main(int argc, char** argv) {
+
+    uint32_t* frame = guac_mem_alloc(BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT,
+            sizeof(uint32_t));
+
+    /* Rectangles of assorted sizes, from small updates to the whole frame */
+    bench_rect rects[BENCH_RECTS];
+    srand(0x6775);
+    for (int i = 0; i < BENCH_RECTS; i++) {
+        bench_rect* rect = &rects[i];
+        rect->width = 64 + rand() % (BENCH_FRAME_WIDTH - 64);
+        rect->height = 64 + rand() % (BENCH_FRAME_HEIGHT - 64);
+        rect->x = rand() % (BENCH_FRAME_WIDTH - rect->width + 1);
+        rect->y = rand() % (BENCH_FRAME_HEIGHT - rect->height + 1);
+    }
+
+    int failed = 0;
+
+    bench_fill_ui(frame);
+    failed |= bench_content("png-optimality-ui", frame, rects) < BENCH_MIN_AGREEMENT;
+
+    bench_fill_text(frame);
+    failed |= bench_content("png-optimality-text", frame, rects) < BENCH_MIN_AGREEMENT;
+
+    bench_fill_photo(frame);
+    failed |= bench_content("png-optimality-photo", frame, rects) < BENCH_MIN_AGREEMENT;
+
+    bench_fill_mixed(frame);
+    failed |= bench_content("png-optimality-mixed", frame, rects) < BENCH_MIN_AGREEMENT;
+
+    guac_mem_free(frame);
+
+    if (failed) {
+        fprintf(stderr, "Sampled estimate disagrees with full scan too often!\n");
+        return 1;
+    }
+
+    return 0;
+
+}
+
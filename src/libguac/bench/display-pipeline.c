@@ -0,0 +1,666 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+/*
+ * Measures the end-to-end cost of guac_display, replaying synthetic
+ * framebuffer sequences representative of common workloads through a real
+ * guac_display whose output is written to a socket that merely counts bytes.
+ * For each workload, the achieved frame rate, the amount of data sent per
+ * frame, the average time spent within each planning phase and encoding, and
+ * the number of system allocations required for planning are reported.
+ */
+
+#include "bench.h"
+#include "display-priv.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/fifo.h>
+#include <guacamole/rect.h>
+#include <guacamole/socket.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The width of the simulated display, in pixels.
+ */
+#define BENCH_DISPLAY_WIDTH 1280
+
+/**
+ * The height of the simulated display, in pixels.
+ */
+#define BENCH_DISPLAY_HEIGHT 720
+
+/**
+ * The number of frames replayed for each workload, not including the initial
+ * frame that establishes the starting contents of the display.
+ */
+#define BENCH_FRAMES 300
+
+/**
+ * The width of each character of simulated text, in pixels.
+ */
+#define BENCH_GLYPH_WIDTH 8
+
+/**
+ * The height of each line of simulated text, in pixels.
+ */
+#define BENCH_GLYPH_HEIGHT 16
+
+/**
+ * The width of the region of the display containing simulated video, in
+ * pixels.
+ */
+#define BENCH_VIDEO_WIDTH 640
+
+/**
+ * The height of the region of the display containing simulated video, in
+ * pixels.
+ */
+#define BENCH_VIDEO_HEIGHT 360
+
+/**
+ * The number of frames between each update of the simulated clock, as would
+ * be the case for a clock showing seconds on an otherwise idle desktop
+ * rendered at 30 frames per second.
+ */
+#define BENCH_CLOCK_INTERVAL 30
+
+/**
+ * The width of each digit of the simulated clock, in pixels.
+ */
+#define BENCH_CLOCK_DIGIT_WIDTH 12
+
+/**
+ * The height of each digit of the simulated clock, in pixels.
+ */
+#define BENCH_CLOCK_DIGIT_HEIGHT 24
+
+/**
+ * The width of the simulated window that is dragged across the display, in
+ * pixels.
+ */
+#define BENCH_WINDOW_WIDTH 400
+
+/**
+ * The height of the simulated window that is dragged across the display, in
+ * pixels.
+ */
+#define BENCH_WINDOW_HEIGHT 300
+
+/**
+ * Function which renders a single frame of a workload.
+ *
+ * @param context
+ *     The raw context of the default layer of the display, which the function
+ *     must draw to, reporting all modified regions with
+ *     guac_display_layer_raw_context_damage().
+ *
+ * @param frame
+ *     The number of the frame to render, where frame 0 is the initial frame
+ *     establishing the starting contents of the display.
+ */
+typedef void bench_workload_render(guac_display_layer_raw_context* context,
+        int frame);
+
+/**
+ * A single workload replayed through guac_display.
+ */
+typedef struct bench_workload {
+
+    /**
+     * The name of the workload, as included within reported results.
+     */
+    const char* name;
+
+    /**
+     * The function that renders each frame of the workload.
+     */
+    bench_workload_render* render;
+
+} bench_workload;
+
+/**
+ * The total number of bytes written to the socket of the simulated client.
+ */
+static uint64_t bench_bytes_written = 0;
+
+/**
+ * Lock guarding access to bench_bytes_written.
+ */
+static pthread_mutex_t bench_bytes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Write handler for the socket of the simulated client, discarding all data
+ * while counting the number of bytes written.
+ *
+ * @param socket
+ *     The guac_socket being written to.
+ *
+ * @param buf
+ *     The data being written.
+ *
+ * @param count
+ *     The number of bytes being written.
+ *
+ * @return
+ *     The number of bytes written, which is always the number of bytes
+ *     provided.
+ */
+static ssize_t bench_socket_write(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    pthread_mutex_lock(&bench_bytes_lock);
+    bench_bytes_written += count;
+    pthread_mutex_unlock(&bench_bytes_lock);
+
+    return count;
+
+}
+
+/**
+ * Returns the total number of bytes written to the socket of the simulated
+ * client thus far.
+ *
+ * @return
+ *     The total number of bytes written.
+ */
+static uint64_t bench_get_bytes_written(void) {
+
+    pthread_mutex_lock(&bench_bytes_lock);
+    uint64_t bytes = bench_bytes_written;
+    pthread_mutex_unlock(&bench_bytes_lock);
+
+    return bytes;
+
+}
+
+/**
+ * Returns an arbitrary but deterministic 32-bit value derived from the given
+ * values.
+ *
+ * @param a
+ *     The first value to hash.
+ *
+ * @param b
+ *     The second value to hash.
+ *
+ * @return
+ *     A 32-bit value derived from the given values.
+ */
+static uint32_t bench_hash(uint32_t a, uint32_t b) {
+
+    uint32_t h = a * 0x9E3779B1 ^ b * 0x85EBCA77;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6D;
+    h ^= h >> 12;
+
+    return h;
+
+}
+
+/**
+ * Returns the color of the simulated desktop background at the given
+ * location.
+ *
+ * @param x
+ *     The X coordinate of the pixel.
+ *
+ * @param y
+ *     The Y coordinate of the pixel.
+ *
+ * @return
+ *     The color of the pixel, in the 32-bit ARGB format used by raw
+ *     contexts.
+ */
+static uint32_t bench_background(int x, int y) {
+    return 0xFF000000
+        | ((0x20 + y * 0x40 / BENCH_DISPLAY_HEIGHT) << 16)
+        | ((0x40 + x * 0x40 / BENCH_DISPLAY_WIDTH) << 8)
+        | 0x80;
+}
+
+/**
+ * Fills the given rectangle of the given context with the simulated desktop
+ * background, reporting the rectangle as modified.
+ *
+ * @param context
+ *     The raw context to draw to.
+ *
+ * @param rect
+ *     The rectangle to fill.
+ */
+static void bench_draw_background(guac_display_layer_raw_context* context,
+        const guac_rect* rect) {
+
+    unsigned char* row = GUAC_DISPLAY_LAYER_RAW_BUFFER(context, *rect);
+    for (int y = rect->top; y < rect->bottom; y++) {
+
+        uint32_t* pixel = (uint32_t*) row;
+        for (int x = rect->left; x < rect->right; x++)
+            *(pixel++) = bench_background(x, y);
+
+        row += context->stride;
+
+    }
+
+    guac_display_layer_raw_context_damage(context, rect);
+
+}
+
+/**
+ * Draws a single character of simulated text at the given location. The
+ * shape of the character is derived from the given value, with the same
+ * value always producing the same shape.
+ *
+ * @param context
+ *     The raw context to draw to.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the character.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the character.
+ *
+ * @param glyph
+ *     An arbitrary value determining the shape of the character.
+ *
+ * @param foreground
+ *     The color of the character.
+ *
+ * @param background
+ *     The color behind the character.
+ */
+static void bench_draw_glyph(guac_display_layer_raw_context* context,
+        int x, int y, uint32_t glyph, uint32_t foreground,
+        uint32_t background) {
+
+    unsigned char* row = context->buffer + y * context->stride
+        + x * GUAC_DISPLAY_LAYER_RAW_BPP;
+
+    for (int dy = 0; dy < BENCH_GLYPH_HEIGHT; dy++) {
+
+        /* Leave a blank margin above and below each character, using the
+         * hash of each line of the glyph as its pixel mask */
+        uint32_t mask = (dy >= 3 && dy < BENCH_GLYPH_HEIGHT - 3)
+            ? bench_hash(glyph, dy) : 0;
+
+        uint32_t* pixel = (uint32_t*) row;
+        for (int dx = 0; dx < BENCH_GLYPH_WIDTH; dx++)
+            pixel[dx] = (dx < BENCH_GLYPH_WIDTH - 1 && (mask & (1 << dx)))
+                ? foreground : background;
+
+        row += context->stride;
+
+    }
+
+}
+
+/**
+ * Renders a frame of a terminal scrolling through lines of text, with each
+ * frame scrolling the terminal up by one line and adding a new line of text
+ * at the bottom.
+ */
+static void bench_render_scrolling_text(guac_display_layer_raw_context* context,
+        int frame) {
+
+    int columns = BENCH_DISPLAY_WIDTH / BENCH_GLYPH_WIDTH;
+    int rows = BENCH_DISPLAY_HEIGHT / BENCH_GLYPH_HEIGHT;
+
+    guac_rect text = {
+        .left   = 0,
+        .top    = 0,
+        .right  = columns * BENCH_GLYPH_WIDTH,
+        .bottom = rows * BENCH_GLYPH_HEIGHT
+    };
+
+    /* Scroll all existing text up by one line */
+    int first_row = 0;
+    if (frame > 0) {
+        unsigned char* buffer = context->buffer;
+        memmove(buffer, buffer + BENCH_GLYPH_HEIGHT * context->stride,
+                (size_t) (text.bottom - BENCH_GLYPH_HEIGHT) * context->stride);
+        first_row = rows - 1;
+    }
+
+    /* Draw new lines of text, each having a different length */
+    for (int row = first_row; row < rows; row++) {
+
+        int line = frame + row;
+        int length = bench_hash(line, 0) % columns;
+
+        for (int column = 0; column < columns; column++) {
+            uint32_t glyph = (column < length) ? bench_hash(line, column + 1) % 96 : 0;
+            bench_draw_glyph(context, column * BENCH_GLYPH_WIDTH,
+                    row * BENCH_GLYPH_HEIGHT, glyph, 0xFFC0C0C0, 0xFF000000);
+        }
+
+    }
+
+    guac_display_layer_raw_context_damage(context, &text);
+
+}
+
+/**
+ * Renders a frame of video playing within a region at the center of an
+ * otherwise static desktop.
+ */
+static void bench_render_video(guac_display_layer_raw_context* context,
+        int frame) {
+
+    if (frame == 0) {
+        guac_rect bounds;
+        guac_rect_init(&bounds, 0, 0, BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT);
+        bench_draw_background(context, &bounds);
+    }
+
+    guac_rect video;
+    guac_rect_init(&video,
+            (BENCH_DISPLAY_WIDTH - BENCH_VIDEO_WIDTH) / 2,
+            (BENCH_DISPLAY_HEIGHT - BENCH_VIDEO_HEIGHT) / 2,
+            BENCH_VIDEO_WIDTH, BENCH_VIDEO_HEIGHT);
+
+    /* Simulate natural imagery as smooth gradients that shift with each
+     * frame, plus a small amount of noise */
+    unsigned char* row = GUAC_DISPLAY_LAYER_RAW_BUFFER(context, video);
+    for (int y = 0; y < BENCH_VIDEO_HEIGHT; y++) {
+
+        uint32_t* pixel = (uint32_t*) row;
+        for (int x = 0; x < BENCH_VIDEO_WIDTH; x++) {
+            uint32_t noise = bench_hash(x + y * BENCH_VIDEO_WIDTH, frame) & 0x0F;
+            *(pixel++) = 0xFF000000
+                | (((x + frame * 4) & 0xFF) << 16)
+                | (((y + frame * 2) & 0xFF) << 8)
+                | (((x + y) / 4 + noise) & 0xFF);
+        }
+
+        row += context->stride;
+
+    }
+
+    guac_display_layer_raw_context_damage(context, &video);
+
+}
+
+/**
+ * Renders a frame of an otherwise idle desktop displaying a clock, where the
+ * clock changes only once every BENCH_CLOCK_INTERVAL frames.
+ */
+static void bench_render_idle_clock(guac_display_layer_raw_context* context,
+        int frame) {
+
+    /* Segments (bits 0 through 6: top, upper right, lower right, bottom,
+     * lower left, upper left, middle) lit for each decimal digit */
+    static const uint8_t segments[10] = {
+        0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F
+    };
+
+    if (frame == 0) {
+        guac_rect bounds;
+        guac_rect_init(&bounds, 0, 0, BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT);
+        bench_draw_background(context, &bounds);
+    }
+
+    else if (frame % BENCH_CLOCK_INTERVAL)
+        return;
+
+    int seconds = frame / BENCH_CLOCK_INTERVAL;
+    int digits[6] = {
+        seconds / 36000 % 10, seconds / 3600 % 10,
+        seconds / 600 % 6,    seconds / 60 % 10,
+        seconds / 10 % 6,     seconds % 10
+    };
+
+    guac_rect clock;
+    guac_rect_init(&clock,
+            BENCH_DISPLAY_WIDTH - 6 * BENCH_CLOCK_DIGIT_WIDTH - 8,
+            BENCH_DISPLAY_HEIGHT - BENCH_CLOCK_DIGIT_HEIGHT - 8,
+            6 * BENCH_CLOCK_DIGIT_WIDTH, BENCH_CLOCK_DIGIT_HEIGHT);
+
+    unsigned char* row = GUAC_DISPLAY_LAYER_RAW_BUFFER(context, clock);
+    for (int y = 0; y < BENCH_CLOCK_DIGIT_HEIGHT; y++) {
+
+        uint32_t* pixel = (uint32_t*) row;
+        for (int x = 0; x < 6 * BENCH_CLOCK_DIGIT_WIDTH; x++) {
+
+            uint8_t lit = segments[digits[x / BENCH_CLOCK_DIGIT_WIDTH]];
+            int dx = x % BENCH_CLOCK_DIGIT_WIDTH;
+            int mid = BENCH_CLOCK_DIGIT_HEIGHT / 2;
+
+            int on = ((lit & 0x01) && y < 2)
+                  || ((lit & 0x08) && y >= BENCH_CLOCK_DIGIT_HEIGHT - 2)
+                  || ((lit & 0x40) && (y == mid || y == mid - 1))
+                  || ((lit & 0x02) && dx >= 8 && dx < 10 && y < mid)
+                  || ((lit & 0x04) && dx >= 8 && dx < 10 && y >= mid)
+                  || ((lit & 0x20) && dx < 2 && y < mid)
+                  || ((lit & 0x10) && dx < 2 && y >= mid);
+
+            *(pixel++) = on ? 0xFFFFFFFF : 0xFF202020;
+
+        }
+
+        row += context->stride;
+
+    }
+
+    guac_display_layer_raw_context_damage(context, &clock);
+
+}
+
+/**
+ * Returns the bounds of the simulated window being dragged across the
+ * display at the given frame.
+ *
+ * @param frame
+ *     The number of the frame.
+ *
+ * @param window
+ *     The guac_rect to populate with the bounds of the window.
+ */
+static void bench_window_bounds(int frame, guac_rect* window) {
+    guac_rect_init(window,
+            frame * 6 % (BENCH_DISPLAY_WIDTH - BENCH_WINDOW_WIDTH),
+            frame * 3 % (BENCH_DISPLAY_HEIGHT - BENCH_WINDOW_HEIGHT),
+            BENCH_WINDOW_WIDTH, BENCH_WINDOW_HEIGHT);
+}
+
+/**
+ * Renders a frame of a window containing text being dragged across the
+ * desktop, with each frame restoring the background behind the previous
+ * location of the window and redrawing the window at its new location.
+ */
+static void bench_render_window_drag(guac_display_layer_raw_context* context,
+        int frame) {
+
+    guac_rect window;
+
+    if (frame == 0) {
+        guac_rect bounds;
+        guac_rect_init(&bounds, 0, 0, BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT);
+        bench_draw_background(context, &bounds);
+    }
+    else {
+        bench_window_bounds(frame - 1, &window);
+        bench_draw_background(context, &window);
+    }
+
+    bench_window_bounds(frame, &window);
+
+    /* Title bar */
+    guac_rect title;
+    guac_rect_init(&title, window.left, window.top, BENCH_WINDOW_WIDTH,
+            BENCH_GLYPH_HEIGHT + 8);
+    guac_display_layer_raw_context_set(context, &title, 0xFF3050A0);
+
+    /* Window body, containing lines of text that move with the window */
+    guac_rect body = window;
+    body.top = title.bottom;
+    guac_display_layer_raw_context_set(context, &body, 0xFFF0F0F0);
+
+    int columns = (BENCH_WINDOW_WIDTH - 16) / BENCH_GLYPH_WIDTH;
+    int rows = (guac_rect_height(&body) - 16) / BENCH_GLYPH_HEIGHT;
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            bench_draw_glyph(context,
+                    body.left + 8 + column * BENCH_GLYPH_WIDTH,
+                    body.top + 8 + row * BENCH_GLYPH_HEIGHT,
+                    bench_hash(row, column) % 96, 0xFF000000, 0xFFF0F0F0);
+        }
+    }
+
+    guac_display_layer_raw_context_damage(context, &window);
+
+}
+
+/**
+ * Waits until all operations of any in-progress frame of the given display
+ * have been fully processed by the worker threads.
+ *
+ * @param display
+ *     The guac_display to wait for.
+ */
+static void bench_wait_for_frame(guac_display* display) {
+
+    for (;;) {
+
+        guac_fifo_lock(&display->ops);
+        int idle = !(display->ops.state.value & GUAC_FIFO_STATE_NONEMPTY)
+            && !display->active_workers;
+        guac_fifo_unlock(&display->ops);
+
+        if (idle)
+            return;
+
+        sched_yield();
+
+    }
+
+}
+
+/**
+ * Renders the given frame of the given workload to the given display,
+ * waiting for that frame to be fully processed.
+ *
+ * @param display
+ *     The guac_display to render to.
+ *
+ * @param workload
+ *     The workload to replay.
+ *
+ * @param frame
+ *     The number of the frame to render.
+ */
+static void bench_render_frame(guac_display* display,
+        const bench_workload* workload, int frame) {
+
+    guac_display_layer* layer = guac_display_default_layer(display);
+
+    guac_display_layer_raw_context* context = guac_display_layer_open_raw(layer);
+    workload->render(context, frame);
+    guac_display_layer_close_raw(layer, context);
+
+    guac_display_end_frame(display);
+    bench_wait_for_frame(display);
+
+}
+
+/**
+ * Replays the given workload through a newly-allocated guac_display,
+ * reporting the resulting measurements.
+ *
+ * @param workload
+ *     The workload to replay.
+ */
+static void bench_replay(const bench_workload* workload) {
+
+    guac_client* client = guac_client_alloc();
+
+    /* Discard all output while counting the number of bytes sent */
+    guac_socket_free(client->socket);
+    client->socket = guac_socket_alloc();
+    client->socket->write_handler = bench_socket_write;
+
+    guac_display* display = guac_display_alloc(client);
+    guac_display_layer_resize(guac_display_default_layer(display),
+            BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT);
+
+    /* Establish initial contents of display, excluding that frame from all
+     * measurements */
+    bench_render_frame(display, workload, 0);
+
+    guac_display_stats before;
+    guac_display_get_stats(display, &before);
+    uint64_t bytes = bench_get_bytes_written();
+
+    int64_t start = guac_bench_now();
+    for (int frame = 1; frame <= BENCH_FRAMES; frame++)
+        bench_render_frame(display, workload, frame);
+    int64_t elapsed = guac_bench_now() - start;
+
+    guac_display_stats after;
+    guac_display_get_stats(display, &after);
+    bytes = bench_get_bytes_written() - bytes;
+
+    uint64_t encode_time =
+          after.png.encode_time  - before.png.encode_time
+        + after.jpeg.encode_time - before.jpeg.encode_time
+        + after.webp.encode_time - before.webp.encode_time;
+
+    char name[64];
+    snprintf(name, sizeof(name), "display-pipeline/%s", workload->name);
+
+    double frames = BENCH_FRAMES;
+    guac_bench_report_value(name, "rate", frames * 1000000000.0 / elapsed, "frames/s");
+    guac_bench_report_value(name, "sent", bytes / frames, "bytes/frame");
+    guac_bench_report_value(name, "draft", (after.draft_time - before.draft_time) / frames, "us/frame");
+    guac_bench_report_value(name, "rects", (after.rects_time - before.rects_time) / frames, "us/frame");
+    guac_bench_report_value(name, "search", (after.search_time - before.search_time) / frames, "us/frame");
+    guac_bench_report_value(name, "combine", (after.combine_time - before.combine_time) / frames, "us/frame");
+    guac_bench_report_value(name, "commit", (after.commit_time - before.commit_time) / frames, "us/frame");
+    guac_bench_report_value(name, "encode", encode_time / frames, "us/frame");
+    guac_bench_report_value(name, "allocations",
+            (after.plan_memory_allocations - before.plan_memory_allocations) / frames,
+            "allocs/frame");
+
+    guac_display_free(display);
+    guac_client_free(client);
+
+}
+
+int main(int argc, char** argv) {
+
+    const bench_workload workloads[] = {
+        { "scrolling-text", bench_render_scrolling_text },
+        { "video",          bench_render_video          },
+        { "idle-clock",     bench_render_idle_clock     },
+        { "window-drag",    bench_render_window_drag    }
+    };
+
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+        bench_replay(&workloads[i]);
+
+    return 0;
+
+}
@@ -0,0 +1,329 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Measures the throughput of guac_fifo and guac_fifo_lockfree under
+ * contention, with equal numbers of threads concurrently adding items to and
+ * removing items from a single FIFO.
+ */
+
+#include "bench.h"
+
+#include <guacamole/fifo.h>
+#include <guacamole/fifo-lockfree.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * The maximum number of items that each FIFO may contain.
+ */
+#define BENCH_FIFO_MAX_ITEMS 64
+
+/**
+ * The number of items added by each producer thread and removed by each
+ * consumer thread.
+ */
+#define BENCH_ITEMS_PER_THREAD 200000
+
+/**
+ * The maximum number of producer (and of consumer) threads.
+ */
+#define BENCH_MAX_THREADS 4
+
+/**
+ * A single item within a FIFO, sized comparably to the items queued within
+ * libguac itself.
+ */
+typedef struct bench_item {
+
+    /**
+     * The index of the producer thread that added this item.
+     */
+    uint64_t producer;
+
+    /**
+     * The zero-based sequence number of this item relative to all other
+     * items added by the same producer thread.
+     */
+    uint64_t sequence;
+
+} bench_item;
+
+/**
+ * A guac_fifo along with the storage required for its items.
+ */
+typedef struct bench_fifo {
+
+    /**
+     * The FIFO being measured.
+     */
+    guac_fifo base;
+
+    /**
+     * Storage for all items in the FIFO.
+     */
+    bench_item items[BENCH_FIFO_MAX_ITEMS];
+
+} bench_fifo;
+
+/**
+ * A guac_fifo_lockfree along with the storage required for its items.
+ */
+typedef struct bench_fifo_lockfree {
+
+    /**
+     * The FIFO being measured.
+     */
+    guac_fifo_lockfree base;
+
+    /**
+     * Storage for all items in the FIFO.
+     */
+    bench_item items[BENCH_FIFO_MAX_ITEMS];
+
+    /**
+     * Storage for the sequence numbers of each item in the FIFO.
+     */
+    size_t sequences[BENCH_FIFO_MAX_ITEMS];
+
+} bench_fifo_lockfree;
+
+/**
+ * The operations of a single FIFO implementation.
+ */
+typedef struct bench_fifo_type {
+
+    /**
+     * The name of the implementation, as included within reported results.
+     */
+    const char* name;
+
+    /**
+     * Adds a copy of the given item to the given FIFO, blocking if the FIFO
+     * is full. Returns non-zero on success.
+     */
+    int (*enqueue)(void* fifo, const void* item);
+
+    /**
+     * Removes the oldest item from the given FIFO, storing it within the
+     * given buffer and blocking if the FIFO is empty. Returns non-zero on
+     * success.
+     */
+    int (*dequeue)(void* fifo, void* item);
+
+} bench_fifo_type;
+
+/**
+ * Adds an item to a bench_fifo.
+ *
+ * @see bench_fifo_type
+ */
+static int bench_fifo_enqueue(void* fifo, const void* item) {
+    return guac_fifo_enqueue(&((bench_fifo*) fifo)->base, item);
+}
+
+/**
+ * Removes an item from a bench_fifo.
+ *
+ * @see bench_fifo_type
+ */
+static int bench_fifo_dequeue(void* fifo, void* item) {
+    return guac_fifo_dequeue(&((bench_fifo*) fifo)->base, item);
+}
+
+/**
+ * Adds an item to a bench_fifo_lockfree.
+ *
+ * @see bench_fifo_type
+ */
+static int bench_fifo_lockfree_enqueue(void* fifo, const void* item) {
+    return guac_fifo_lockfree_enqueue(&((bench_fifo_lockfree*) fifo)->base,
+            item);
+}
+
+/**
+ * Removes an item from a bench_fifo_lockfree.
+ *
+ * @see bench_fifo_type
+ */
+static int bench_fifo_lockfree_dequeue(void* fifo, void* item) {
+    return guac_fifo_lockfree_dequeue(&((bench_fifo_lockfree*) fifo)->base,
+            item);
+}
+
+/**
+ * The state of a single producer or consumer thread.
+ */
+typedef struct bench_thread {
+
+    /**
+     * The operations of the FIFO being measured.
+     */
+    const bench_fifo_type* type;
+
+    /**
+     * The FIFO being measured.
+     */
+    void* fifo;
+
+    /**
+     * The index of this thread among all threads of the same role.
+     */
+    uint64_t index;
+
+    /**
+     * The thread itself.
+     */
+    pthread_t thread;
+
+} bench_thread;
+
+/**
+ * Thread which adds BENCH_ITEMS_PER_THREAD items to the FIFO being measured.
+ *
+ * @param data
+ *     The bench_thread describing the state of this thread.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* bench_producer_thread(void* data) {
+
+    bench_thread* producer = (bench_thread*) data;
+
+    for (uint64_t i = 0; i < BENCH_ITEMS_PER_THREAD; i++) {
+        bench_item item = { .producer = producer->index, .sequence = i };
+        producer->type->enqueue(producer->fifo, &item);
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Thread which removes BENCH_ITEMS_PER_THREAD items from the FIFO being
+ * measured.
+ *
+ * @param data
+ *     The bench_thread describing the state of this thread.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* bench_consumer_thread(void* data) {
+
+    bench_thread* consumer = (bench_thread*) data;
+
+    bench_item item;
+    for (int i = 0; i < BENCH_ITEMS_PER_THREAD; i++)
+        consumer->type->dequeue(consumer->fifo, &item);
+
+    return NULL;
+
+}
+
+/**
+ * Passes BENCH_ITEMS_PER_THREAD items through the given FIFO from each of the
+ * given number of producer threads to the same number of consumer threads,
+ * and reports the resulting throughput.
+ *
+ * @param type
+ *     The operations of the FIFO being measured.
+ *
+ * @param fifo
+ *     The FIFO to measure, which must be initialized and empty.
+ *
+ * @param threads
+ *     The number of producer threads and of consumer threads.
+ */
+static void bench_contend(const bench_fifo_type* type, void* fifo,
+        int threads) {
+
+    bench_thread producers[BENCH_MAX_THREADS];
+    bench_thread consumers[BENCH_MAX_THREADS];
+
+    int64_t start = guac_bench_now();
+
+    for (int i = 0; i < threads; i++) {
+
+        bench_thread* consumer = &consumers[i];
+        *consumer = (bench_thread) { .type = type, .fifo = fifo, .index = i };
+        pthread_create(&consumer->thread, NULL, bench_consumer_thread,
+                consumer);
+
+        bench_thread* producer = &producers[i];
+        *producer = (bench_thread) { .type = type, .fifo = fifo, .index = i };
+        pthread_create(&producer->thread, NULL, bench_producer_thread,
+                producer);
+
+    }
+
+    for (int i = 0; i < threads; i++) {
+        pthread_join(producers[i].thread, NULL);
+        pthread_join(consumers[i].thread, NULL);
+    }
+
+    int64_t elapsed = guac_bench_now() - start;
+
+    char variant[16];
+    snprintf(variant, sizeof(variant), "%ix%i", threads, threads);
+
+    guac_bench_report(type->name, variant,
+            (uint64_t) threads * BENCH_ITEMS_PER_THREAD, "Mitems/s", elapsed);
+
+}
+
+int main(int argc, char** argv) {
+
+    static const bench_fifo_type locked = {
+        .name    = "fifo",
+        .enqueue = bench_fifo_enqueue,
+        .dequeue = bench_fifo_dequeue
+    };
+
+    static const bench_fifo_type lockfree = {
+        .name    = "fifo-lockfree",
+        .enqueue = bench_fifo_lockfree_enqueue,
+        .dequeue = bench_fifo_lockfree_dequeue
+    };
+
+    static bench_fifo fifo;
+    static bench_fifo_lockfree fifo_lockfree;
+
+    guac_fifo_init(&fifo.base, fifo.items, BENCH_FIFO_MAX_ITEMS,
+            sizeof(bench_item));
+
+    guac_fifo_lockfree_init(&fifo_lockfree.base, fifo_lockfree.items,
+            fifo_lockfree.sequences, BENCH_FIFO_MAX_ITEMS,
+            sizeof(bench_item));
+
+    for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+        bench_contend(&locked, &fifo, threads);
+        bench_contend(&lockfree, &fifo_lockfree, threads);
+    }
+
+    guac_fifo_lockfree_destroy(&fifo_lockfree.base);
+    guac_fifo_destroy(&fifo.base);
+
+    return 0;
+
+}
+
@@ -0,0 +1,178 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Measures the throughput of guac_parser_append(), by way of
+ * guac_parser_parse(), for streams of instructions representative of what
+ * guacd receives from users (short input events), what it relays (large
+ * blobs of base64 data), and text containing multibyte characters (whose
+ * element lengths are counted in codepoints rather than bytes).
+ */
+
+#include "bench.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/parser.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The approximate size of each generated stream of instructions, in bytes.
+ */
+#define BENCH_STREAM_SIZE (1 << 20)
+
+/**
+ * The number of bytes of base64 data within each generated "blob"
+ * instruction.
+ */
+#define BENCH_BLOB_LENGTH 8192
+
+/**
+ * Generates a stream of instructions by repeatedly appending the given
+ * instruction until the stream would exceed BENCH_STREAM_SIZE bytes.
+ *
+ * @param instruction
+ *     The instruction to repeat.
+ *
+ * @param length
+ *     Pointer to a size_t that should receive the length of the generated
+ *     stream, in bytes.
+ *
+ * @param count
+ *     Pointer to a size_t that should receive the number of instructions
+ *     within the generated stream.
+ *
+ * @return
+ *     A newly-allocated buffer containing the generated stream, which must
+ *     eventually be freed with guac_mem_free().
+ */
+static char* bench_generate(const char* instruction, size_t* length,
+        size_t* count) {
+
+    size_t instruction_length = strlen(instruction);
+    size_t repeat = BENCH_STREAM_SIZE / instruction_length;
+    if (repeat == 0)
+        repeat = 1;
+
+    char* stream = guac_mem_alloc(repeat, instruction_length);
+    for (size_t i = 0; i < repeat; i++)
+        memcpy(stream + i * instruction_length, instruction,
+                instruction_length);
+
+    *length = repeat * instruction_length;
+    *count = repeat;
+    return stream;
+
+}
+
+/**
+ * Parses every instruction within the given stream, repeating until at least
+ * GUAC_BENCH_MIN_DURATION has elapsed, and reports the resulting throughput.
+ * As parsing modifies the buffer being parsed, each pass parses a fresh copy
+ * of the stream, and only the time spent parsing is measured.
+ *
+ * @param name
+ *     The name of the workload being measured.
+ *
+ * @param instruction
+ *     The instruction making up the stream to parse.
+ *
+ * @return
+ *     Zero if the stream was parsed successfully, non-zero otherwise.
+ */
+static int bench_parse(const char* name, const char* instruction) {
+
+    size_t length;
+    size_t count;
+    char* stream = bench_generate(instruction, &length, &count);
+    char* buffer = guac_mem_alloc(length);
+
+    guac_parser* parser = guac_parser_alloc();
+
+    uint64_t bytes = 0;
+    uint64_t instructions = 0;
+    int64_t elapsed = 0;
+    int result = 0;
+
+    do {
+
+        memcpy(buffer, stream, length);
+
+        int64_t start = guac_bench_now();
+
+        char* current = buffer;
+        size_t remaining = length;
+        while (remaining > 0) {
+
+            int parsed = guac_parser_parse(parser, current, remaining);
+            if (parsed <= 0) {
+                fprintf(stderr, "Unable to parse \"%s\" stream.\n", name);
+                result = 1;
+                goto done;
+            }
+
+            current += parsed;
+            remaining -= parsed;
+
+        }
+
+        elapsed += guac_bench_now() - start;
+
+        bytes += length;
+        instructions += count;
+
+    } while (elapsed < GUAC_BENCH_MIN_DURATION);
+
+    guac_bench_report("parser", name, bytes, "MB/s", elapsed);
+    guac_bench_report("parser", name, instructions, "Minstr/s", elapsed);
+
+done:
+    guac_parser_free(parser);
+    guac_mem_free(buffer);
+    guac_mem_free(stream);
+    return result;
+
+}
+
+int main(int argc, char** argv) {
+
+    /* Build a single blob instruction with a payload of arbitrary base64 */
+    char blob[BENCH_BLOB_LENGTH + 64];
+    int offset = snprintf(blob, sizeof(blob), "4.blob,1.1,%i.",
+            BENCH_BLOB_LENGTH);
+
+    for (int i = 0; i < BENCH_BLOB_LENGTH; i++)
+        blob[offset + i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef"[i % 32];
+
+    strcpy(blob + offset + BENCH_BLOB_LENGTH, ";");
+
+    return bench_parse("input", "5.mouse,3.512,3.384,1.0,13.1700000000000;"
+                                "3.key,5.65307,1.1,13.1700000000000;"
+                                "4.sync,13.1700000000000;")
+        || bench_parse("blob", blob)
+        || bench_parse("unicode", "4.name,14.\xE3\x82\xB2\xE3\x82\xA2\xE3"
+                                  "\x82\xAB\xE3\x83\xA2\xE3\x83\xBC\xE3\x83"
+                                  "\xAB\xE3\x83\xA6\xE3\x83\xBC\xE3\x82\xB6"
+                                  "\xE3\x83\xBC\xE3\x81\xA8\xE3\x83\x86\xE3"
+                                  "\x82\xB9\xE3\x83\x88;");
+
+}
+
@@ -0,0 +1,152 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Measures the cost of obtaining and freeing integers from a guac_pool, both
+ * within a single thread (allocating and freeing integers one at a time, as
+ * for streams, and in large batches, as for the buffers of a busy display)
+ * and concurrently from multiple threads sharing a single pool.
+ */
+
+#include "bench.h"
+
+#include <guacamole/client-constants.h>
+#include <guacamole/pool.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * The maximum number of threads concurrently using the same pool.
+ */
+#define BENCH_MAX_THREADS 4
+
+/**
+ * The number of integers obtained from the pool before any are freed by the
+ * batch benchmark.
+ */
+#define BENCH_BATCH_SIZE 1024
+
+/**
+ * The number of integers each thread obtains and frees by the concurrent
+ * benchmark.
+ */
+#define BENCH_OPERATIONS_PER_THREAD 2000000
+
+/**
+ * Thread which repeatedly obtains an integer from the given pool and then
+ * immediately frees it, BENCH_OPERATIONS_PER_THREAD times.
+ *
+ * @param data
+ *     The guac_pool to use.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* bench_churn_thread(void* data) {
+
+    guac_pool* pool = (guac_pool*) data;
+
+    for (int i = 0; i < BENCH_OPERATIONS_PER_THREAD; i++)
+        guac_pool_free_int(pool, guac_pool_next_int(pool));
+
+    return NULL;
+
+}
+
+/**
+ * Obtains and frees integers from a single pool using the given number of
+ * threads, and reports the combined throughput of all threads, counting each
+ * integer obtained and freed as one operation.
+ *
+ * @param threads
+ *     The number of threads that should concurrently use the pool.
+ */
+static void bench_churn(int threads) {
+
+    guac_pool* pool = guac_pool_alloc(0);
+    pthread_t workers[BENCH_MAX_THREADS];
+
+    int64_t start = guac_bench_now();
+
+    for (int i = 0; i < threads; i++)
+        pthread_create(&workers[i], NULL, bench_churn_thread, pool);
+
+    for (int i = 0; i < threads; i++)
+        pthread_join(workers[i], NULL);
+
+    int64_t elapsed = guac_bench_now() - start;
+
+    char variant[16];
+    snprintf(variant, sizeof(variant), "%i-thread%s", threads,
+            threads == 1 ? "" : "s");
+
+    guac_bench_report("pool-churn", variant,
+            (uint64_t) threads * BENCH_OPERATIONS_PER_THREAD, "Mops/s",
+            elapsed);
+
+    guac_pool_free(pool);
+
+}
+
+/**
+ * Repeatedly obtains BENCH_BATCH_SIZE integers from a pool sized like the
+ * buffer pool of a guac_client and then frees them all, until at least
+ * GUAC_BENCH_MIN_DURATION has elapsed, and reports the resulting
+ * throughput, counting each integer obtained and freed as one operation.
+ */
+static void bench_batch(void) {
+
+    guac_pool* pool = guac_pool_alloc(GUAC_BUFFER_POOL_INITIAL_SIZE);
+    int values[BENCH_BATCH_SIZE];
+
+    uint64_t operations = 0;
+    int64_t start = guac_bench_now();
+    int64_t elapsed;
+
+    do {
+
+        for (int i = 0; i < BENCH_BATCH_SIZE; i++)
+            values[i] = guac_pool_next_int(pool);
+
+        for (int i = 0; i < BENCH_BATCH_SIZE; i++)
+            guac_pool_free_int(pool, values[i]);
+
+        operations += BENCH_BATCH_SIZE;
+
+    } while ((elapsed = guac_bench_now() - start) < GUAC_BENCH_MIN_DURATION);
+
+    guac_bench_report("pool-batch", "1-thread", operations, "Mops/s",
+            elapsed);
+
+    guac_pool_free(pool);
+
+}
+
+int main(int argc, char** argv) {
+
+    for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2)
+        bench_churn(threads);
+
+    bench_batch();
+    return 0;
+
+}
+
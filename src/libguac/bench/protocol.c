@@ -0,0 +1,285 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Measures the cost of serializing instructions with the
+ * guac_protocol_send_*() family of functions, writing each instruction to a
+ * socket which counts and then discards all data. The instructions chosen
+ * are those sent most frequently while a connection is active.
+ */
+
+#include "bench.h"
+
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/protocol-constants.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+/**
+ * The number of instructions sent between each check of the elapsed time.
+ */
+#define BENCH_BATCH_SIZE 1024
+
+/**
+ * The total number of bytes written to the benchmark socket thus far.
+ */
+static uint64_t bench_bytes_written = 0;
+
+/**
+ * Arbitrary data sent within "blob" instructions.
+ */
+static unsigned char bench_blob[GUAC_PROTOCOL_BLOB_MAX_LENGTH];
+
+/**
+ * An arbitrary stream, used by instructions that relate to streams.
+ */
+static const guac_stream bench_stream = { .index = 3 };
+
+/**
+ * An arbitrary visible layer, used by instructions that draw.
+ */
+static const guac_layer bench_layer = { .index = 1 };
+
+/**
+ * An arbitrary off-screen buffer, used as the source of the "copy"
+ * instruction.
+ */
+static const guac_layer bench_buffer = { .index = -7 };
+
+/**
+ * Handler for guac_socket writes which counts the number of bytes written
+ * and then discards them.
+ *
+ * @param socket
+ *     The guac_socket being written to.
+ *
+ * @param buf
+ *     The data being written.
+ *
+ * @param count
+ *     The number of bytes being written.
+ *
+ * @return
+ *     The number of bytes written, which is always the number of bytes
+ *     provided.
+ */
+static ssize_t bench_socket_write(guac_socket* socket, const void* buf,
+        size_t count) {
+    bench_bytes_written += count;
+    return count;
+}
+
+/**
+ * Function which sends a single instruction over the given socket using one
+ * of the guac_protocol_send_*() functions.
+ *
+ * @param socket
+ *     The guac_socket to send the instruction over.
+ *
+ * @param i
+ *     An arbitrary, varying value that should be used to vary the arguments
+ *     of the instruction, as the length of numeric arguments affects the
+ *     cost of serialization.
+ *
+ * @return
+ *     Zero if the instruction was sent successfully, non-zero otherwise.
+ */
+typedef int bench_send_function(guac_socket* socket, int i);
+
+/**
+ * Sends a single "sync" instruction.
+ *
+ * @see bench_send_function
+ */
+static int bench_send_sync(guac_socket* socket, int i) {
+    return guac_protocol_send_sync(socket, 1700000000000LL + i, 1);
+}
+
+/**
+ * Sends a single "mouse" instruction.
+ *
+ * @see bench_send_function
+ */
+static int bench_send_mouse(guac_socket* socket, int i) {
+    return guac_protocol_send_mouse(socket, i & 0x7FF, i & 0x3FF, 0,
+            1700000000000LL + i);
+}
+
+/**
+ * Sends a single "rect" instruction.
+ *
+ * @see bench_send_function
+ */
+static int bench_send_rect(guac_socket* socket, int i) {
+    return guac_protocol_send_rect(socket, &bench_layer, i & 0x7FF,
+            i & 0x3FF, 64, 64);
+}
+
+/**
+ * Sends a single "cfill" instruction.
+ *
+ * @see bench_send_function
+ */
+static int bench_send_cfill(guac_socket* socket, int i) {
+    return guac_protocol_send_cfill(socket, GUAC_COMP_OVER, &bench_layer,
+            i & 0xFF, 0x80, 0x40, 0xFF);
+}
+
+/**
+ * Sends a single "copy" instruction.
+ *
+ * @see bench_send_function
+ */
+static int bench_send_copy(guac_socket* socket, int i) {
+    return guac_protocol_send_copy(socket, &bench_buffer, 0, i & 0x3FF,
+            1280, 16, GUAC_COMP_OVER, &bench_layer, 0, (i + 16) & 0x3FF);
+}
+
+/**
+ * Sends a single "img" instruction.
+ *
+ * @see bench_send_function
+ */
+static int bench_send_img(guac_socket* socket, int i) {
+    return guac_protocol_send_img(socket, &bench_stream, GUAC_COMP_OVER,
+            &bench_layer, "image/webp", i & 0x7FF, i & 0x3FF);
+}
+
+/**
+ * Sends a single "blob" instruction.
+ *
+ * @see bench_send_function
+ */
+static int bench_send_blob(guac_socket* socket, int i) {
+    return guac_protocol_send_blob(socket, &bench_stream, bench_blob,
+            sizeof(bench_blob));
+}
+
+/**
+ * Sends a single "end" instruction.
+ *
+ * @see bench_send_function
+ */
+static int bench_send_end(guac_socket* socket, int i) {
+    return guac_protocol_send_end(socket, &bench_stream);
+}
+
+/**
+ * A single instruction to be measured.
+ */
+typedef struct bench_instruction {
+
+    /**
+     * The opcode of the instruction, as included within reported results.
+     */
+    const char* name;
+
+    /**
+     * The function sending the instruction.
+     */
+    bench_send_function* send;
+
+} bench_instruction;
+
+/**
+ * All instructions to be measured.
+ */
+static const bench_instruction bench_instructions[] = {
+    { "sync",  bench_send_sync  },
+    { "mouse", bench_send_mouse },
+    { "rect",  bench_send_rect  },
+    { "cfill", bench_send_cfill },
+    { "copy",  bench_send_copy  },
+    { "img",   bench_send_img   },
+    { "blob",  bench_send_blob  },
+    { "end",   bench_send_end   },
+    { NULL,    NULL             }
+};
+
+/**
+ * Repeatedly sends the given instruction until at least
+ * GUAC_BENCH_MIN_DURATION has elapsed, and reports the resulting rate of
+ * instructions and of bytes.
+ *
+ * @param socket
+ *     The counting guac_socket to send instructions over.
+ *
+ * @param instruction
+ *     The instruction to measure.
+ *
+ * @return
+ *     Zero if all instructions were sent successfully, non-zero otherwise.
+ */
+static int bench_send(guac_socket* socket,
+        const bench_instruction* instruction) {
+
+    uint64_t instructions = 0;
+    uint64_t bytes_before = bench_bytes_written;
+    int64_t start = guac_bench_now();
+    int64_t elapsed;
+
+    do {
+
+        for (int i = 0; i < BENCH_BATCH_SIZE; i++) {
+            if (instruction->send(socket, i)) {
+                fprintf(stderr, "Unable to send \"%s\".\n",
+                        instruction->name);
+                return 1;
+            }
+        }
+
+        instructions += BENCH_BATCH_SIZE;
+
+    } while ((elapsed = guac_bench_now() - start) < GUAC_BENCH_MIN_DURATION);
+
+    guac_socket_flush(socket);
+
+    guac_bench_report("protocol-send", instruction->name, instructions,
+            "Minstr/s", elapsed);
+    guac_bench_report("protocol-send", instruction->name,
+            bench_bytes_written - bytes_before, "MB/s", elapsed);
+
+    return 0;
+
+}
+
+int main(int argc, char** argv) {
+
+    for (size_t i = 0; i < sizeof(bench_blob); i++)
+        bench_blob[i] = (i * 0x9E) & 0xFF;
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->write_handler = bench_socket_write;
+
+    int result = 0;
+    for (const bench_instruction* current = bench_instructions;
+            current->name != NULL && !result; current++)
+        result = bench_send(socket, current);
+
+    guac_socket_free(socket);
+    return result;
+
+}
+
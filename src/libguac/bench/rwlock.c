@@ -0,0 +1,199 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Measures how acquiring and releasing the read lock of a guac_rwlock scales
+ * as the number of threads concurrently holding that read lock increases,
+ * along with the cost of reentrant acquisition and of the write lock, for
+ * reference.
+ */
+
+#include "bench.h"
+
+#include <guacamole/rwlock.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * The maximum number of threads concurrently acquiring the read lock.
+ */
+#define BENCH_MAX_THREADS 8
+
+/**
+ * The number of lock operations each thread performs between checks of
+ * whether the benchmark has ended.
+ */
+#define BENCH_BATCH_SIZE 256
+
+/**
+ * The lock being measured.
+ */
+static guac_rwlock bench_lock;
+
+/**
+ * Non-zero once all threads should stop acquiring the lock.
+ */
+static int bench_stop = 0;
+
+/**
+ * The state of a single thread acquiring the lock being measured.
+ */
+typedef struct bench_thread {
+
+    /**
+     * The number of times this thread acquired and released the lock.
+     */
+    uint64_t operations;
+
+    /**
+     * Non-zero if this thread should acquire the write lock, zero if this
+     * thread should acquire the read lock.
+     */
+    int write;
+
+    /**
+     * Non-zero if the lock should be acquired reentrantly, with the thread
+     * already holding the read lock.
+     */
+    int reentrant;
+
+    /**
+     * The thread itself.
+     */
+    pthread_t thread;
+
+} bench_thread;
+
+/**
+ * Thread which repeatedly acquires and releases the lock being measured until
+ * bench_stop is set.
+ *
+ * @param data
+ *     The bench_thread describing the state of this thread.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* bench_lock_thread(void* data) {
+
+    bench_thread* current = (bench_thread*) data;
+
+    if (current->reentrant)
+        guac_rwlock_acquire_read_lock(&bench_lock);
+
+    while (!__atomic_load_n(&bench_stop, __ATOMIC_RELAXED)) {
+
+        for (int i = 0; i < BENCH_BATCH_SIZE; i++) {
+
+            if (current->write)
+                guac_rwlock_acquire_write_lock(&bench_lock);
+            else
+                guac_rwlock_acquire_read_lock(&bench_lock);
+
+            guac_rwlock_release_lock(&bench_lock);
+
+        }
+
+        current->operations += BENCH_BATCH_SIZE;
+
+    }
+
+    if (current->reentrant)
+        guac_rwlock_release_lock(&bench_lock);
+
+    return NULL;
+
+}
+
+/**
+ * Acquires and releases the lock being measured from the given number of
+ * threads for GUAC_BENCH_MIN_DURATION, and reports the combined throughput
+ * of all threads.
+ *
+ * @param name
+ *     The name of the benchmark, as included within reported results.
+ *
+ * @param threads
+ *     The number of threads that should concurrently acquire the lock.
+ *
+ * @param write
+ *     Non-zero if the write lock should be acquired, zero if the read lock
+ *     should be acquired.
+ *
+ * @param reentrant
+ *     Non-zero if each thread should already hold the read lock when
+ *     acquiring the lock, zero otherwise.
+ */
+static void bench_acquire(const char* name, int threads, int write,
+        int reentrant) {
+
+    bench_thread workers[BENCH_MAX_THREADS] = { 0 };
+
+    __atomic_store_n(&bench_stop, 0, __ATOMIC_RELAXED);
+    int64_t start = guac_bench_now();
+
+    for (int i = 0; i < threads; i++) {
+        workers[i].write = write;
+        workers[i].reentrant = reentrant;
+        pthread_create(&workers[i].thread, NULL, bench_lock_thread,
+                &workers[i]);
+    }
+
+    struct timespec duration = {
+        .tv_sec  = GUAC_BENCH_MIN_DURATION / 1000000000LL,
+        .tv_nsec = GUAC_BENCH_MIN_DURATION % 1000000000LL
+    };
+
+    nanosleep(&duration, NULL);
+    __atomic_store_n(&bench_stop, 1, __ATOMIC_RELAXED);
+
+    uint64_t operations = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        operations += workers[i].operations;
+    }
+
+    int64_t elapsed = guac_bench_now() - start;
+
+    char variant[16];
+    snprintf(variant, sizeof(variant), "%i-thread%s", threads,
+            threads == 1 ? "" : "s");
+
+    guac_bench_report(name, variant, operations, "Mops/s", elapsed);
+
+}
+
+int main(int argc, char** argv) {
+
+    guac_rwlock_init(&bench_lock);
+
+    for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2)
+        bench_acquire("rwlock-read", threads, 0, 0);
+
+    bench_acquire("rwlock-read-reentrant", 1, 0, 1);
+    bench_acquire("rwlock-write", 1, 1, 0);
+
+    guac_rwlock_destroy(&bench_lock);
+    return 0;
+
+}
+
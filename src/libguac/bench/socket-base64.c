@@ -0,0 +1,181 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Measures the throughput of base64 encoding, both of the encoding kernels
+ * alone (comparing the portable scalar implementation with the
+ * implementation selected for the current CPU) and of
+ * guac_socket_write_base64() as a whole, for writes of varying size to a
+ * socket that discards all data.
+ */
+
+#include "bench.h"
+#include "socket-base64.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/protocol-constants.h>
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The number of bytes of arbitrary data to encode.
+ */
+#define BENCH_DATA_SIZE (3 << 20)
+
+/**
+ * Encodes all data using the given encoding kernel, repeating until at least
+ * GUAC_BENCH_MIN_DURATION has elapsed, and reports the resulting throughput.
+ *
+ * @param name
+ *     The name of the implementation being measured.
+ *
+ * @param encode
+ *     The encoding kernel to measure.
+ *
+ * @param data
+ *     BENCH_DATA_SIZE bytes of data to encode.
+ *
+ * @param output
+ *     Storage for the encoded data, which must have room for at least
+ *     (BENCH_DATA_SIZE / 3 * 4) characters.
+ */
+static void bench_encode(const char* name,
+        guac_socket_base64_encode_function* encode,
+        const unsigned char* data, char* output) {
+
+    uint64_t bytes = 0;
+    int64_t start = guac_bench_now();
+    int64_t elapsed;
+
+    do {
+        encode(data, BENCH_DATA_SIZE / 3, output);
+        bytes += BENCH_DATA_SIZE;
+    } while ((elapsed = guac_bench_now() - start) < GUAC_BENCH_MIN_DURATION);
+
+    guac_bench_report("socket-base64-encode", name, bytes, "MB/s", elapsed);
+
+}
+
+/**
+ * Writes all data to a discarding socket using guac_socket_write_base64() in
+ * chunks of the given size, flushing the base64 data after each full pass,
+ * repeating until at least GUAC_BENCH_MIN_DURATION has elapsed, and reports
+ * the resulting throughput.
+ *
+ * @param name
+ *     The name of the chunk size being measured.
+ *
+ * @param chunk
+ *     The number of bytes to provide to each call to
+ *     guac_socket_write_base64().
+ *
+ * @param data
+ *     BENCH_DATA_SIZE bytes of data to write.
+ *
+ * @return
+ *     Zero if all writes succeeded, non-zero otherwise.
+ */
+static int bench_write(const char* name, size_t chunk,
+        const unsigned char* data) {
+
+    guac_socket* socket = guac_socket_alloc();
+
+    uint64_t bytes = 0;
+    int64_t start = guac_bench_now();
+    int64_t elapsed;
+    int result = 0;
+
+    do {
+
+        for (size_t offset = 0; offset < BENCH_DATA_SIZE; offset += chunk) {
+
+            size_t length = chunk;
+            if (length > BENCH_DATA_SIZE - offset)
+                length = BENCH_DATA_SIZE - offset;
+
+            if (guac_socket_write_base64(socket, data + offset, length)) {
+                result = 1;
+                break;
+            }
+
+        }
+
+        if (result || guac_socket_flush_base64(socket)) {
+            fprintf(stderr, "Unable to write base64 in %s chunks.\n", name);
+            result = 1;
+            break;
+        }
+
+        bytes += BENCH_DATA_SIZE;
+
+    } while ((elapsed = guac_bench_now() - start) < GUAC_BENCH_MIN_DURATION);
+
+    if (!result)
+        guac_bench_report("socket-write-base64", name, bytes, "MB/s",
+                elapsed);
+
+    guac_socket_free(socket);
+    return result;
+
+}
+
+int main(int argc, char** argv) {
+
+    unsigned char* data = guac_mem_alloc(BENCH_DATA_SIZE);
+    char* scalar_output = guac_mem_alloc(BENCH_DATA_SIZE / 3, 4);
+    char* selected_output = guac_mem_alloc(BENCH_DATA_SIZE / 3, 4);
+
+    /* Fill data with arbitrary, non-repeating bytes */
+    srand(0x6775);
+    for (size_t i = 0; i < BENCH_DATA_SIZE; i++)
+        data[i] = rand() & 0xFF;
+
+    bench_encode("scalar", guac_socket_base64_encode_scalar, data,
+            scalar_output);
+
+    bench_encode(guac_socket_get_base64_encode_name(),
+            guac_socket_get_base64_encode(), data, selected_output);
+
+    int result = memcmp(scalar_output, selected_output,
+            BENCH_DATA_SIZE / 3 * 4) != 0;
+
+    if (result)
+        fprintf(stderr, "Encoding implementations produced differing "
+                "results!\n");
+
+    /* Sizes representative of small writes (such as within individual
+     * glyphs or audio packets), full blobs, and entire encoded images */
+    else
+        result = bench_write("16B", 16, data)
+              || bench_write("1KiB", 1024, data)
+              || bench_write("blob", GUAC_PROTOCOL_BLOB_MAX_LENGTH, data)
+              || bench_write("64KiB", 65536, data);
+
+    guac_mem_free(selected_output);
+    guac_mem_free(scalar_output);
+    guac_mem_free(data);
+
+    return result;
+
+}
+
@@ -0,0 +1,231 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Measures the throughput of the guac_utf8_*() functions for text that is
+ * entirely ASCII, as is typical of terminal output, and for text consisting
+ * of multibyte characters.
+ */
+
+#include "bench.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/unicode.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The number of codepoints within each generated string.
+ */
+#define BENCH_CODEPOINTS (1 << 18)
+
+/**
+ * The maximum number of bytes required to encode any single codepoint as
+ * UTF-8.
+ */
+#define BENCH_MAX_CHAR_SIZE 4
+
+/**
+ * Measures guac_utf8_strlen() against the given null-terminated string.
+ *
+ * @param name
+ *     The name of the kind of text being measured.
+ *
+ * @param text
+ *     The null-terminated UTF-8 text to measure.
+ *
+ * @param length
+ *     The length of the text, in bytes.
+ */
+static void bench_strlen(const char* name, const char* text, size_t length) {
+
+    uint64_t bytes = 0;
+    size_t codepoints = 0;
+    int64_t start = guac_bench_now();
+    int64_t elapsed;
+
+    do {
+        codepoints += guac_utf8_strlen(text);
+        bytes += length;
+    } while ((elapsed = guac_bench_now() - start) < GUAC_BENCH_MIN_DURATION);
+
+    guac_bench_report("utf8-strlen", name, bytes, "MB/s", elapsed);
+
+    /* Ensure the result is used */
+    if (codepoints == 0)
+        fprintf(stderr, "No codepoints counted.\n");
+
+}
+
+/**
+ * Measures guac_utf8_read() by decoding every codepoint of the given text
+ * in sequence.
+ *
+ * @param name
+ *     The name of the kind of text being measured.
+ *
+ * @param text
+ *     The UTF-8 text to decode.
+ *
+ * @param length
+ *     The length of the text, in bytes.
+ *
+ * @return
+ *     The sum of all decoded codepoints from the final pass.
+ */
+static uint64_t bench_read(const char* name, const char* text,
+        size_t length) {
+
+    uint64_t codepoints = 0;
+    uint64_t sum;
+    int64_t start = guac_bench_now();
+    int64_t elapsed;
+
+    do {
+
+        sum = 0;
+
+        size_t offset = 0;
+        while (offset < length) {
+
+            int codepoint;
+            int size = guac_utf8_read(text + offset, length - offset,
+                    &codepoint);
+
+            if (size <= 0)
+                break;
+
+            sum += codepoint;
+            offset += size;
+            codepoints++;
+
+        }
+
+    } while ((elapsed = guac_bench_now() - start) < GUAC_BENCH_MIN_DURATION);
+
+    guac_bench_report("utf8-read", name, codepoints, "Mchars/s", elapsed);
+    return sum;
+
+}
+
+/**
+ * Measures guac_utf8_write() by encoding every given codepoint in sequence.
+ *
+ * @param name
+ *     The name of the kind of text being measured.
+ *
+ * @param codepoints
+ *     BENCH_CODEPOINTS codepoints to encode.
+ *
+ * @param output
+ *     Storage for the encoded text, having room for at least
+ *     (BENCH_CODEPOINTS * BENCH_MAX_CHAR_SIZE) bytes.
+ *
+ * @return
+ *     The number of bytes written by the final pass.
+ */
+static size_t bench_write(const char* name, const int* codepoints,
+        char* output) {
+
+    uint64_t written = 0;
+    size_t length;
+    int64_t start = guac_bench_now();
+    int64_t elapsed;
+
+    do {
+
+        length = 0;
+        for (int i = 0; i < BENCH_CODEPOINTS; i++)
+            length += guac_utf8_write(codepoints[i], output + length,
+                    BENCH_MAX_CHAR_SIZE);
+
+        written += BENCH_CODEPOINTS;
+
+    } while ((elapsed = guac_bench_now() - start) < GUAC_BENCH_MIN_DURATION);
+
+    guac_bench_report("utf8-write", name, written, "Mchars/s", elapsed);
+    return length;
+
+}
+
+/**
+ * Runs all benchmarks against text made up of the given codepoints.
+ *
+ * @param name
+ *     The name of the kind of text being measured.
+ *
+ * @param codepoints
+ *     BENCH_CODEPOINTS codepoints making up the text.
+ *
+ * @return
+ *     Zero if all functions produced consistent results, non-zero
+ *     otherwise.
+ */
+static int bench_text(const char* name, const int* codepoints) {
+
+    char* text = guac_mem_alloc(BENCH_CODEPOINTS * BENCH_MAX_CHAR_SIZE + 1);
+
+    uint64_t expected_sum = 0;
+    for (int i = 0; i < BENCH_CODEPOINTS; i++)
+        expected_sum += codepoints[i];
+
+    size_t length = bench_write(name, codepoints, text);
+    text[length] = '\0';
+
+    uint64_t sum = bench_read(name, text, length);
+    bench_strlen(name, text, length);
+
+    int result = 0;
+    if (sum != expected_sum || guac_utf8_strlen(text) != BENCH_CODEPOINTS) {
+        fprintf(stderr, "Decoded \"%s\" text differs from encoded text!\n",
+                name);
+        result = 1;
+    }
+
+    guac_mem_free(text);
+    return result;
+
+}
+
+int main(int argc, char** argv) {
+
+    int* codepoints = guac_mem_alloc(sizeof(int), BENCH_CODEPOINTS);
+
+    /* Printable ASCII */
+    for (int i = 0; i < BENCH_CODEPOINTS; i++)
+        codepoints[i] = 0x20 + (i * 7) % 0x5F;
+
+    int result = bench_text("ascii", codepoints);
+
+    /* An arbitrary mix of two-, three-, and four-byte characters */
+    static const int multibyte[] = { 0xE9, 0x3B1, 0x3042, 0x30AB, 0x4E2D,
+        0xAC00, 0x1F600, 0x2603 };
+
+    for (int i = 0; i < BENCH_CODEPOINTS; i++)
+        codepoints[i] = multibyte[i % (sizeof(multibyte) / sizeof(int))];
+
+    result = result || bench_text("multibyte", codepoints);
+
+    guac_mem_free(codepoints);
+    return result;
+
+}
+
@@ -0,0 +1,141 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "client-latency.h"
+#include "guacamole/client.h"
+#include "guacamole/timestamp.h"
+#include "guacamole/user.h"
+
+#include <pthread.h>
+
+/**
+ * Adds the given sample to the given histogram.
+ *
+ * @param histogram
+ *     The histogram to add the sample to.
+ *
+ * @param value
+ *     The sample to add, in milliseconds. Negative values, as may result from
+ *     adjustments to the system clock, are treated as zero.
+ */
+static void guac_client_latency_record(guac_client_latency_histogram* histogram,
+        guac_timestamp value) {
+
+    if (value < 0)
+        value = 0;
+
+    int bucket = 0;
+    while (bucket < GUAC_CLIENT_LATENCY_BUCKETS - 1
+            && value > ((guac_timestamp) 1 << bucket))
+        bucket++;
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum += value;
+
+}
+
+void guac_client_trace_input(guac_client* client, const guac_user* user) {
+
+    guac_timestamp now = guac_timestamp_current();
+
+    pthread_mutex_lock(&(client->__latency_lock));
+
+    guac_client_latency_trace* trace = &(client->__latency_trace);
+
+    /* Input that never resulted in a confirmed frame must not prevent
+     * further measurement */
+    if (trace->stage != GUAC_CLIENT_LATENCY_IDLE
+            && now - trace->input > GUAC_CLIENT_LATENCY_TRACE_TIMEOUT)
+        trace->stage = GUAC_CLIENT_LATENCY_IDLE;
+
+    if (trace->stage == GUAC_CLIENT_LATENCY_IDLE) {
+        trace->stage = GUAC_CLIENT_LATENCY_INPUT;
+        trace->user = user;
+        trace->input = now;
+    }
+
+    pthread_mutex_unlock(&(client->__latency_lock));
+
+}
+
+void guac_client_trace_damage(guac_client* client) {
+
+    pthread_mutex_lock(&(client->__latency_lock));
+
+    guac_client_latency_trace* trace = &(client->__latency_trace);
+    if (trace->stage == GUAC_CLIENT_LATENCY_INPUT) {
+        trace->stage = GUAC_CLIENT_LATENCY_FLUSH;
+        trace->flush = guac_timestamp_current();
+    }
+
+    pthread_mutex_unlock(&(client->__latency_lock));
+
+}
+
+void guac_client_trace_frame(guac_client* client, guac_timestamp timestamp) {
+
+    pthread_mutex_lock(&(client->__latency_lock));
+
+    guac_client_latency_trace* trace = &(client->__latency_trace);
+    if (trace->stage == GUAC_CLIENT_LATENCY_FLUSH) {
+        trace->stage = GUAC_CLIENT_LATENCY_SENT;
+        trace->frame = timestamp;
+    }
+
+    pthread_mutex_unlock(&(client->__latency_lock));
+
+}
+
+void guac_client_trace_sync(guac_client* client, const guac_user* user,
+        guac_timestamp timestamp) {
+
+    guac_timestamp now = guac_timestamp_current();
+
+    pthread_mutex_lock(&(client->__latency_lock));
+
+    /* Only the user that provided the input can confirm that the resulting
+     * frame has been seen by that user */
+    guac_client_latency_trace* trace = &(client->__latency_trace);
+    if (trace->stage == GUAC_CLIENT_LATENCY_SENT && trace->user == user
+            && timestamp >= trace->frame) {
+
+        guac_client_latency_stats* stats = &(client->__latency_stats);
+        guac_client_latency_record(&stats->server, trace->flush - trace->input);
+        guac_client_latency_record(&stats->encode, trace->frame - trace->flush);
+        guac_client_latency_record(&stats->network, now - trace->frame);
+        guac_client_latency_record(&stats->total, now - trace->input);
+
+        trace->stage = GUAC_CLIENT_LATENCY_IDLE;
+
+    }
+
+    pthread_mutex_unlock(&(client->__latency_lock));
+
+}
+
+void guac_client_get_latency_stats(guac_client* client,
+        guac_client_latency_stats* stats) {
+
+    pthread_mutex_lock(&(client->__latency_lock));
+    *stats = client->__latency_stats;
+    pthread_mutex_unlock(&(client->__latency_lock));
+
+}
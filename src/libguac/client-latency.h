@@ -0,0 +1,114 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_CLIENT_LATENCY_H
+#define GUAC_CLIENT_LATENCY_H
+
+/**
+ * Internal functions for measuring the latency between user input and the
+ * display of the resulting changes, as retrieved with
+ * guac_client_get_latency_stats().
+ *
+ * @file client-latency.h
+ */
+
+#include "guacamole/client.h"
+#include "guacamole/timestamp-types.h"
+#include "guacamole/user.h"
+
+/**
+ * The stage of a guac_client_latency_trace for which no measurement is in
+ * progress.
+ */
+#define GUAC_CLIENT_LATENCY_IDLE 0
+
+/**
+ * The stage of a guac_client_latency_trace that has received user input but
+ * has not yet seen any resulting changes.
+ */
+#define GUAC_CLIENT_LATENCY_INPUT 1
+
+/**
+ * The stage of a guac_client_latency_trace whose resulting changes are part
+ * of a frame that is currently being flushed.
+ */
+#define GUAC_CLIENT_LATENCY_FLUSH 2
+
+/**
+ * The stage of a guac_client_latency_trace whose resulting frame has been
+ * sent but not yet confirmed by the user that provided the input.
+ */
+#define GUAC_CLIENT_LATENCY_SENT 3
+
+/**
+ * Notes receipt of user input from the given user, beginning a new
+ * measurement of latency if no measurement is already in progress. Any
+ * measurement which has been in progress for longer than
+ * GUAC_CLIENT_LATENCY_TRACE_TIMEOUT is abandoned.
+ *
+ * @param client
+ *     The guac_client receiving the input.
+ *
+ * @param user
+ *     The user that provided the input.
+ */
+void guac_client_trace_input(guac_client* client, const guac_user* user);
+
+/**
+ * Notes that a frame containing changes to the remote desktop (other than
+ * changes to the mouse cursor alone) is being flushed. If user input has been
+ * received but no changes yet seen, those changes are considered to be the
+ * result of that input.
+ *
+ * @param client
+ *     The guac_client whose frame is being flushed.
+ */
+void guac_client_trace_damage(guac_client* client);
+
+/**
+ * Notes that a frame has been completely sent, with the given timestamp
+ * being sent within its "sync" instruction.
+ *
+ * @param client
+ *     The guac_client that sent the frame.
+ *
+ * @param timestamp
+ *     The timestamp of the frame.
+ */
+void guac_client_trace_frame(guac_client* client, guac_timestamp timestamp);
+
+/**
+ * Notes receipt of a "sync" instruction from the given user, completing the
+ * measurement in progress if that instruction confirms the frame containing
+ * the changes resulting from that user's input.
+ *
+ * @param client
+ *     The guac_client receiving the "sync" instruction.
+ *
+ * @param user
+ *     The user that sent the "sync" instruction.
+ *
+ * @param timestamp
+ *     The frame timestamp within the "sync" instruction.
+ */
+void guac_client_trace_sync(guac_client* client, const guac_user* user,
+        guac_timestamp timestamp);
+
+#endif
+
@@ -0,0 +1,87 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "guacamole/client.h"
+#include "guacamole/display.h"
+
+#ifdef HAVE_MALLOC_TRIM
+#include <malloc.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+void guac_client_account_memory(guac_client* client,
+        guac_client_memory_category category, int64_t delta) {
+
+    if (delta == 0)
+        return;
+
+    guac_client_memory_stats* stats = &(client->__memory_stats);
+
+    uint64_t usage = __atomic_add_fetch(&(stats->usage[category]),
+            (uint64_t) delta, __ATOMIC_RELAXED);
+
+    /* Freeing memory cannot raise the peak */
+    if (delta < 0)
+        return;
+
+    uint64_t peak = __atomic_load_n(&(stats->peak[category]), __ATOMIC_RELAXED);
+    while (usage > peak) {
+        if (__atomic_compare_exchange_n(&(stats->peak[category]), &peak,
+                    usage, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+
+}
+
+void guac_client_get_memory_stats(guac_client* client,
+        guac_client_memory_stats* stats) {
+
+    guac_client_memory_stats* current = &(client->__memory_stats);
+
+    for (int i = 0; i < GUAC_CLIENT_MEMORY_CATEGORIES; i++) {
+        stats->usage[i] = __atomic_load_n(&(current->usage[i]), __ATOMIC_RELAXED);
+        stats->peak[i] = __atomic_load_n(&(current->peak[i]), __ATOMIC_RELAXED);
+    }
+
+    stats->reclaims = __atomic_load_n(&(current->reclaims), __ATOMIC_RELAXED);
+    stats->reclaimed = __atomic_load_n(&(current->reclaimed), __ATOMIC_RELAXED);
+
+}
+
+size_t guac_client_reclaim_memory(guac_client* client) {
+
+    /* Shrink any layer buffers left oversized by earlier resizes */
+    size_t reclaimed = guac_display_reclaim_client_memory(client);
+
+    guac_client_memory_stats* stats = &(client->__memory_stats);
+    __atomic_add_fetch(&(stats->reclaims), 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&(stats->reclaimed), reclaimed, __ATOMIC_RELAXED);
+
+#ifdef HAVE_MALLOC_TRIM
+    /* Return freed memory to the operating system, including memory freed
+     * long ago by other subsystems but retained by the allocator */
+    malloc_trim(0);
+#endif
+
+    return reclaimed;
+
+}
@@ -19,6 +19,7 @@
 
 #include "config.h"
 
+#include "client-latency.h"
 #include "encode-jpeg.h"
 #include "encode-png.h"
 #include "encode-webp.h"
@@ -36,6 +37,7 @@
 #include "guacamole/timestamp.h"
 #include "guacamole/user.h"
 #include "id.h"
+#include "user-output.h"
 
 #include <dlfcn.h>
 #include <errno.h>
@@ -53,6 +55,20 @@
  */
 #define GUAC_CLIENT_PENDING_USERS_REFRESH_INTERVAL 250
 
+/**
+ * The number of milliseconds that must pass without any further users joining
+ * before pending users are promoted. Users that join in quick succession are
+ * thus promoted together, synchronized by a single call to the
+ * join_pending_handler.
+ */
+#define GUAC_CLIENT_PENDING_USERS_SETTLE_INTERVAL 250
+
+/**
+ * The maximum number of milliseconds that promotion of a pending user may be
+ * delayed while waiting for further users to stop joining.
+ */
+#define GUAC_CLIENT_PENDING_USERS_MAX_DELAY 1000
+
 /**
  * A value that indicates that the pending users timer has yet to be
  * initialized and started.
@@ -139,6 +155,8 @@ guac_stream* guac_client_alloc_stream(guac_client* client) {
     allocd_stream->ack_handler = NULL;
     allocd_stream->blob_handler = NULL;
     allocd_stream->end_handler = NULL;
+    allocd_stream->window = GUAC_STREAM_DEFAULT_WINDOW;
+    allocd_stream->__unacknowledged = 0;
 
     return allocd_stream;
 
@@ -155,9 +173,124 @@ void guac_client_free_stream(guac_client* client, guac_stream* stream) {
 
 }
 
+/**
+ * Moves all full users whose guac_user_output has fallen too far behind
+ * back to the list of pending users, such that their view of the connection
+ * is rebuilt by the join_pending_handler during the promotion of pending
+ * users that follows, rather than by replaying every intermediate change.
+ * The write lock for the list of pending users must already be held.
+ *
+ * @param client
+ *     The client whose lagging users should be resynchronized.
+ */
+static void guac_client_resync_lagging_users(guac_client* client) {
+
+    /* Lagging users are rare, and the write lock for the list of full users
+     * blocks every handler that iterates those users, so acquire that lock
+     * only if there is actually someone to move */
+    int lagging = 0;
+    guac_rwlock_acquire_read_lock(&(client->__users_lock));
+
+    for (guac_user* user = client->__users; user != NULL; user = user->__next) {
+        if (user->__output != NULL
+                && guac_user_output_needs_resync(user->__output)) {
+            lagging = 1;
+            break;
+        }
+    }
+
+    guac_rwlock_release_lock(&(client->__users_lock));
+
+    if (!lagging)
+        return;
+
+    guac_rwlock_acquire_write_lock(&(client->__users_lock));
+
+    guac_user* user = client->__users;
+    while (user != NULL) {
+
+        guac_user* next = user->__next;
+
+        if (user->__output != NULL
+                && guac_user_output_needs_resync(user->__output)) {
+
+            /* Remove from list of full users */
+            if (user->__prev != NULL)
+                user->__prev->__next = user->__next;
+            else
+                client->__users = user->__next;
+
+            if (user->__next != NULL)
+                user->__next->__prev = user->__prev;
+
+            /* Add to list of pending users (both locks remain held,
+             * ensuring the user is always on exactly one list) */
+            guac_user_output_attach(user->__output,
+                    client->__pending_broadcast_log);
+
+            user->__prev = NULL;
+            user->__next = client->__pending_users;
+
+            if (client->__pending_users != NULL)
+                client->__pending_users->__prev = user;
+
+            client->__pending_users = user;
+
+        }
+
+        user = next;
+
+    }
+
+    guac_rwlock_release_lock(&(client->__users_lock));
+
+}
+
+/**
+ * Returns whether promotion of the pending users of the given client should
+ * be deferred, as users are still joining in quick succession and may be
+ * promoted together if promotion waits a little longer. The write lock for
+ * the list of pending users must already be held.
+ *
+ * @param client
+ *     The client whose pending users are being promoted.
+ *
+ * @return
+ *     Non-zero if promotion of pending users should be deferred, zero
+ *     otherwise.
+ */
+static int guac_client_defer_pending_users(guac_client* client) {
+
+    /* Lagging users that have been moved back to the pending list are
+     * resynchronized without delay */
+    if (!client->__pending_users_first_join)
+        return 0;
+
+    /* The first users of a connection (normally just its owner) are promoted
+     * without delay, as there are not yet any users whose synchronization
+     * could be combined with theirs, and any delay here directly delays the
+     * first frame of the connection. The list of full users is modified only
+     * while its own lock is held, which is acquired here after the lock for
+     * the list of pending users, as when pending users are promoted. */
+    guac_rwlock_acquire_read_lock(&(client->__users_lock));
+    int first_users = (client->__users == NULL);
+    guac_rwlock_release_lock(&(client->__users_lock));
+
+    if (first_users)
+        return 0;
+
+    guac_timestamp now = guac_timestamp_current();
+
+    return now - client->__pending_users_last_join < GUAC_CLIENT_PENDING_USERS_SETTLE_INTERVAL
+        && now - client->__pending_users_first_join < GUAC_CLIENT_PENDING_USERS_MAX_DELAY;
+
+}
+
 /**
  * Promote all pending users to full users, calling the join pending handler
- * before, if any.
+ * before, if any. Promotion is deferred while users continue to join in
+ * quick succession, such that all users joining within a short period are
+ * synchronized together by a single call to the join pending handler.
  *
  * @param client
  *     The client for which all pending users should be promoted.
@@ -167,10 +300,17 @@ static void guac_client_promote_pending_users(guac_client* client) {
     /* Acquire the lock for reading and modifying the list of pending users */
     guac_rwlock_acquire_write_lock(&(client->__pending_users_lock));
 
+    /* Users that could not keep up are resynchronized as if newly joined */
+    guac_client_resync_lagging_users(client);
+
     /* Skip user promotion entirely if there's no pending users */
     if (client->__pending_users == NULL)
         goto promotion_complete;
 
+    /* Wait for any burst of joining users to end */
+    if (guac_client_defer_pending_users(client))
+        goto promotion_complete;
+
     /* Run the pending join handler, if one is defined */
     if (client->join_pending_handler) {
 
@@ -186,36 +326,40 @@ static void guac_client_promote_pending_users(guac_client* client) {
         }
     }
 
-    /* The first pending user in the list, if any */
+    /* The first pending user in the list */
     guac_user* first_user = client->__pending_users;
 
-    /* The final user in the list, if any */
+    /* The final user in the list */
     guac_user* last_user = first_user;
 
-    /* Iterate through the pending users to find the final user */
-    guac_user* user = first_user;
-    while (user != NULL) {
+    /* Iterate through the pending users to find the final user, beginning
+     * delivery of data for full users to each once everything sent while
+     * pending has been delivered. This is done before acquiring the lock for
+     * the list of full users, as the pending users remain protected by the
+     * lock for the list of pending users. */
+    for (guac_user* user = first_user; user != NULL; user = user->__next) {
+
+        if (user->__output != NULL)
+            guac_user_output_promote(user->__output,
+                    client->__broadcast_log);
+
         last_user = user;
-        user = user->__next;
+
     }
 
     /* Mark the list as empty */
     client->__pending_users = NULL;
+    client->__pending_users_first_join = 0;
 
-    /* Acquire the lock for reading and modifying the list of full users. */
+    /* Add all formerly-pending users to the start of the user list, holding
+     * the lock for the list of full users only for the splice itself */
     guac_rwlock_acquire_write_lock(&(client->__users_lock));
 
-    /* If any users were removed from the pending list, promote them now */
-    if (last_user != NULL) {
+    if (client->__users != NULL)
+        client->__users->__prev = last_user;
 
-        /* Add all formerly-pending users to the start of the user list */
-        if (client->__users != NULL)
-            client->__users->__prev = last_user;
-
-        last_user->__next = client->__users;
-        client->__users = first_user;
-
-    }
+    last_user->__next = client->__users;
+    client->__users = first_user;
 
     guac_rwlock_release_lock(&(client->__users_lock));
 
@@ -294,8 +438,15 @@ guac_client* guac_client_alloc(void) {
     /* Init locks */
     guac_rwlock_init(&(client->__users_lock));
     guac_rwlock_init(&(client->__pending_users_lock));
-
-    /* Set up broadcast sockets */
+    pthread_mutex_init(&(client->__display_lock), NULL);
+    pthread_mutex_init(&(client->__connect_phases_lock), NULL);
+    pthread_mutex_init(&(client->__latency_lock), NULL);
+
+    /* Set up broadcast sockets, skipping ahead for any full users that fall
+     * too far behind but delivering everything to pending users (this is the
+     * data that synchronizes each user with the connection) */
+    client->__broadcast_log = guac_user_output_log_alloc(1);
+    client->__pending_broadcast_log = guac_user_output_log_alloc(0);
     client->socket = guac_socket_broadcast(client);
     client->pending_socket = guac_socket_broadcast_pending(client);
 
@@ -340,6 +491,10 @@ void guac_client_free(guac_client* client) {
     guac_socket_free(client->socket);
     guac_socket_free(client->pending_socket);
 
+    /* Free the data shared by all users of the broadcast sockets */
+    guac_user_output_log_free(client->__broadcast_log);
+    guac_user_output_log_free(client->__pending_broadcast_log);
+
     /* Free layer pools */
     guac_pool_free(client->__buffer_pool);
     guac_pool_free(client->__layer_pool);
@@ -359,6 +514,9 @@ void guac_client_free(guac_client* client) {
     /* Destroy the reentrant read-write locks */
     guac_rwlock_destroy(&(client->__users_lock));
     guac_rwlock_destroy(&(client->__pending_users_lock));
+    pthread_mutex_destroy(&(client->__display_lock));
+    pthread_mutex_destroy(&(client->__connect_phases_lock));
+    pthread_mutex_destroy(&(client->__latency_lock));
 
     guac_mem_free(client->connection_id);
     guac_mem_free(client);
@@ -454,6 +612,17 @@ static void guac_client_add_pending_user(guac_client* client,
 
     client->__pending_users = user;
 
+    /* Note when this user joined, such that users joining together may be
+     * promoted together */
+    client->__pending_users_last_join = guac_timestamp_current();
+    if (!client->__pending_users_first_join)
+        client->__pending_users_first_join = client->__pending_users_last_join;
+
+    /* Receive everything sent to pending users from this point forward */
+    if (user->__output != NULL)
+        guac_user_output_attach(user->__output,
+                client->__pending_broadcast_log);
+
     /* Increment the user count */
     client->connected_users++;
 
@@ -472,6 +641,10 @@ int guac_client_add_user(guac_client* client, guac_user* user, int argc, char**
 
     if (retval == 0) {
 
+        /* Queue all broadcast data for the user independently of other
+         * users */
+        user->__output = guac_user_output_alloc(client, user);
+
         /*
          * Add the user to the list of pending users, to have their connection
          * state synchronized asynchronously.
@@ -511,6 +684,10 @@ void guac_client_remove_user(guac_client* client, guac_user* user) {
 
     client->connected_users--;
 
+    /* Stop receiving broadcast data along with leaving the lists */
+    if (user->__output != NULL)
+        guac_user_output_detach(user->__output);
+
     /* Update owner pointer if user was owner */
     if (user->owner)
         client->__owner = NULL;
@@ -528,6 +705,12 @@ void guac_client_remove_user(guac_client* client, guac_user* user) {
     else if (client->leave_handler)
         client->leave_handler(user);
 
+    /* The user is no longer reachable through any broadcast socket */
+    if (user->__output != NULL) {
+        guac_user_output_free(user->__output);
+        user->__output = NULL;
+    }
+
 }
 
 void guac_client_foreach_user(guac_client* client, guac_user_callback* callback, void* data) {
@@ -632,7 +815,10 @@ int guac_client_end_multiple_frames(guac_client* client, int frames) {
     guac_client_log(client, GUAC_LOG_TRACE, "Server completed "
             "frame %" PRIu64 "ms (%i logical frames)", client->last_sent_timestamp, frames);
 
-    return guac_protocol_send_sync(client->socket, client->last_sent_timestamp, frames);
+    int retval = guac_protocol_send_sync(client->socket, client->last_sent_timestamp, frames);
+
+    guac_client_trace_frame(client, client->last_sent_timestamp);
+    return retval;
 
 }
 
@@ -765,6 +951,75 @@ int guac_client_get_processing_lag(guac_client* client) {
 
 }
 
+/**
+ * The processing lag of the users of a guac_client that are relevant to
+ * pacing the rate of frames sent.
+ */
+typedef struct guac_client_pacing_lag {
+
+    /**
+     * The processing lag of the owner of the connection, or -1 if the owner
+     * is not connected.
+     */
+    int owner_lag;
+
+    /**
+     * The lowest processing lag of any connected user, or -1 if no users
+     * are connected.
+     */
+    int min_lag;
+
+} guac_client_pacing_lag;
+
+/**
+ * Updates the provided pacing lag, taking into account the processing lag of
+ * the given user.
+ *
+ * @param user
+ *     The guac_user to use to update the pacing lag.
+ *
+ * @param data
+ *     Pointer to the guac_client_pacing_lag to update according to the
+ *     processing lag of the given user.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* __calculate_pacing_lag(guac_user* user, void* data) {
+
+    guac_client_pacing_lag* pacing = (guac_client_pacing_lag*) data;
+
+    if (user->owner)
+        pacing->owner_lag = user->processing_lag;
+
+    if (pacing->min_lag < 0 || user->processing_lag < pacing->min_lag)
+        pacing->min_lag = user->processing_lag;
+
+    return NULL;
+
+}
+
+int guac_client_get_pacing_lag(guac_client* client) {
+
+    guac_client_pacing_lag pacing = {
+        .owner_lag = -1,
+        .min_lag = -1
+    };
+
+    guac_client_foreach_user(client, __calculate_pacing_lag, &pacing);
+
+    /* Pace frames according to the owner, if present, falling back to the
+     * fastest viewer */
+    if (pacing.owner_lag >= 0)
+        return pacing.owner_lag;
+
+    if (pacing.min_lag >= 0)
+        return pacing.min_lag;
+
+    return 0;
+
+}
+
 void guac_client_stream_argv(guac_client* client, guac_socket* socket,
         const char* mimetype, const char* name, const char* value) {
 
@@ -796,7 +1051,7 @@ void guac_client_stream_png(guac_client* client, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/png", x, y);
 
     /* Write PNG data */
-    guac_png_write(socket, stream, surface);
+    guac_png_write(socket, stream, surface, NULL, NULL);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -817,7 +1072,7 @@ void guac_client_stream_jpeg(guac_client* client, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/jpeg", x, y);
 
     /* Write JPEG data */
-    guac_jpeg_write(socket, stream, surface, quality);
+    guac_jpeg_write(socket, stream, surface, quality, NULL, NULL);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -839,7 +1094,7 @@ void guac_client_stream_webp(guac_client* client, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/webp", x, y);
 
     /* Write WebP data */
-    guac_webp_write(socket, stream, surface, quality, lossless);
+    guac_webp_write(socket, stream, surface, quality, lossless, NULL, NULL);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -1076,3 +1331,48 @@ int guac_client_supports_webp(guac_client* client) {
 
 }
 
+void guac_client_record_connect_phase(guac_client* client, const char* name,
+        guac_timestamp duration) {
+
+    pthread_mutex_lock(&(client->__connect_phases_lock));
+
+    /* Replace the duration of any phase of the same name */
+    int i;
+    for (i = 0; i < client->__connect_phase_count; i++) {
+        if (strncmp(client->__connect_phases[i].name, name,
+                    GUAC_CLIENT_CONNECT_PHASE_NAME_LENGTH - 1) == 0)
+            break;
+    }
+
+    /* Otherwise, add a new phase if space remains */
+    if (i == client->__connect_phase_count
+            && i < GUAC_CLIENT_MAX_CONNECT_PHASES) {
+        guac_strlcpy(client->__connect_phases[i].name, name,
+                sizeof(client->__connect_phases[i].name));
+        client->__connect_phase_count++;
+    }
+
+    if (i < client->__connect_phase_count)
+        client->__connect_phases[i].duration = duration;
+
+    pthread_mutex_unlock(&(client->__connect_phases_lock));
+
+}
+
+int guac_client_get_connect_phases(guac_client* client,
+        guac_client_connect_phase* phases, int max_phases) {
+
+    pthread_mutex_lock(&(client->__connect_phases_lock));
+
+    int count = client->__connect_phase_count;
+    if (count > max_phases)
+        count = max_phases;
+
+    memcpy(phases, client->__connect_phases,
+            count * sizeof(guac_client_connect_phase));
+
+    pthread_mutex_unlock(&(client->__connect_phases_lock));
+    return count;
+
+}
+
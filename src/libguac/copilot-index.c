@@ -0,0 +1,233 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "copilot-index.h"
+#include "guacamole/mem.h"
+
+#include <string.h>
+
+guac_copilot_command_index* guac_copilot_command_index_alloc(int history_size) {
+
+    guac_copilot_command_index* index =
+        guac_mem_zalloc(sizeof(guac_copilot_command_index));
+
+    index->history_reserved = history_size;
+    index->size = history_size;
+    index->entries = guac_mem_alloc(history_size,
+            sizeof(guac_copilot_index_entry));
+
+    return index;
+
+}
+
+void guac_copilot_command_index_free(guac_copilot_command_index* index) {
+
+    if (index == NULL)
+        return;
+
+    guac_mem_free(index->entries);
+    guac_mem_free(index);
+
+}
+
+/**
+ * Returns the position of the first entry within the index whose command is
+ * not less than the given string.
+ *
+ * @param index
+ *     The command index to search.
+ *
+ * @param str
+ *     The string to compare commands against.
+ *
+ * @return
+ *     The position of the first entry whose command is not less than the
+ *     given string, or the length of the index if there is no such entry.
+ */
+static int guac_copilot_command_index_lower_bound(
+        guac_copilot_command_index* index, const char* str) {
+
+    int low = 0;
+    int high = index->length;
+
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (strcmp(index->entries[mid].command, str) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+
+}
+
+/**
+ * Returns the entry within the index whose command is equal to the given
+ * string, inserting a new, empty entry at the correct position if no such
+ * entry exists. Space for the new entry must already be available.
+ *
+ * @param index
+ *     The command index to search.
+ *
+ * @param command
+ *     The command to locate.
+ *
+ * @return
+ *     The entry for the given command.
+ */
+static guac_copilot_index_entry* guac_copilot_command_index_locate(
+        guac_copilot_command_index* index, const char* command) {
+
+    int position = guac_copilot_command_index_lower_bound(index, command);
+    guac_copilot_index_entry* entry = &index->entries[position];
+
+    if (position < index->length && strcmp(entry->command, command) == 0)
+        return entry;
+
+    memmove(entry + 1, entry,
+            (index->length - position) * sizeof(guac_copilot_index_entry));
+    index->length++;
+
+    memset(entry, 0, sizeof(guac_copilot_index_entry));
+    entry->command = command;
+    return entry;
+
+}
+
+void guac_copilot_command_index_add_builtin(guac_copilot_command_index* index,
+        const char* command, const char* protocol) {
+
+    if (command == NULL || *command == '\0')
+        return;
+
+    /* Ensure space remains for the full command history */
+    if (index->length + index->history_reserved >= index->size) {
+        index->size = guac_mem_ckd_mul_or_die(index->size, 2);
+        index->entries = guac_mem_realloc_or_die(index->entries, index->size,
+                sizeof(guac_copilot_index_entry));
+    }
+
+    guac_copilot_index_entry* entry =
+        guac_copilot_command_index_locate(index, command);
+
+    /* Only the first built-in command of each value is retained */
+    if (entry->builtin == NULL) {
+        entry->builtin = command;
+        entry->protocol = protocol;
+    }
+
+}
+
+void guac_copilot_command_index_add_history(guac_copilot_command_index* index,
+        const char* command) {
+
+    guac_copilot_index_entry* entry =
+        guac_copilot_command_index_locate(index, command);
+
+    entry->command = command;
+    entry->last_used = ++index->serial;
+
+}
+
+void guac_copilot_command_index_release(guac_copilot_command_index* index,
+        const char* command, const char* other) {
+
+    int position = guac_copilot_command_index_lower_bound(index, command);
+    guac_copilot_index_entry* entry = &index->entries[position];
+
+    /* Nothing to do if a different occurrence is referenced */
+    if (position == index->length || entry->command != command)
+        return;
+
+    if (other != NULL)
+        entry->command = other;
+
+    /* Fall back to the built-in command once absent from the history */
+    else if (entry->builtin != NULL) {
+        entry->command = entry->builtin;
+        entry->last_used = 0;
+    }
+
+    else {
+        index->length--;
+        memmove(entry, entry + 1,
+                (index->length - position) * sizeof(guac_copilot_index_entry));
+    }
+
+}
+
+int guac_copilot_command_index_find(guac_copilot_command_index* index,
+        const char* prefix, const char* protocol, const char** matches,
+        int max_matches) {
+
+    const guac_copilot_index_entry* best[GUAC_COPILOT_INDEX_MAX_MATCHES];
+    int count = 0;
+
+    if (prefix == NULL)
+        prefix = "";
+
+    if (max_matches > GUAC_COPILOT_INDEX_MAX_MATCHES)
+        max_matches = GUAC_COPILOT_INDEX_MAX_MATCHES;
+
+    size_t prefix_length = strlen(prefix);
+
+    /* All matching commands are contiguous, starting at the prefix itself */
+    for (int i = guac_copilot_command_index_lower_bound(index, prefix);
+            i < index->length; i++) {
+
+        const guac_copilot_index_entry* entry = &index->entries[i];
+
+        if (strncmp(entry->command, prefix, prefix_length) != 0)
+            break;
+
+        /* Suggesting exactly what has already been typed is not useful */
+        if (prefix_length > 0 && entry->command[prefix_length] == '\0')
+            continue;
+
+        /* Skip built-in commands for other protocols */
+        if (entry->last_used == 0 && entry->protocol != NULL
+                && protocol != NULL && strcmp(entry->protocol, protocol) != 0)
+            continue;
+
+        /* Insert by rank (most recently used first, then built-in commands
+         * in lexicographic order), dropping the worst match if full */
+        int position = count;
+        while (position > 0 && best[position - 1]->last_used < entry->last_used)
+            position--;
+
+        if (position >= max_matches)
+            continue;
+
+        if (count < max_matches)
+            count++;
+
+        memmove(&best[position + 1], &best[position],
+                (count - position - 1) * sizeof(best[0]));
+        best[position] = entry;
+
+    }
+
+    for (int i = 0; i < count; i++)
+        matches[i] = best[i]->command;
+
+    return count;
+
+}
@@ -0,0 +1,218 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_COPILOT_INDEX_H
+#define GUAC_COPILOT_INDEX_H
+
+/**
+ * A prefix index over the commands known to the copilot, including both the
+ * commands within the session's command history and the built-in commands
+ * of registered workflows. Commands are kept sorted, such that all commands
+ * having a given prefix form a contiguous range that can be located with a
+ * binary search. Once the index has been allocated and all built-in commands
+ * added, neither adding history nor searching allocates memory.
+ *
+ * @file copilot-index.h
+ */
+
+#include "guacamole/copilot.h"
+
+/**
+ * The maximum number of matches that may be returned by a single call to
+ * guac_copilot_command_index_find().
+ */
+#define GUAC_COPILOT_INDEX_MAX_MATCHES 32
+
+/**
+ * A single unique command within a guac_copilot_command_index.
+ */
+typedef struct guac_copilot_index_entry {
+
+    /**
+     * The command. If the command is present within the command history,
+     * this points to the most recent occurrence within the history.
+     * Otherwise, this is the same as builtin.
+     */
+    const char* command;
+
+    /**
+     * The built-in command having the same value as this entry, or NULL if
+     * the command is not built-in.
+     */
+    const char* builtin;
+
+    /**
+     * The protocol to which the built-in command applies, or NULL if the
+     * built-in command applies to all protocols (or the command is not
+     * built-in).
+     */
+    const char* protocol;
+
+    /**
+     * The value of the index serial at the time that this command was last
+     * added to the command history, or zero if the command is not present
+     * within the command history. More recently-used commands have larger
+     * values.
+     */
+    unsigned int last_used;
+
+} guac_copilot_index_entry;
+
+struct guac_copilot_command_index {
+
+    /**
+     * All commands within the index, sorted lexicographically.
+     */
+    guac_copilot_index_entry* entries;
+
+    /**
+     * The number of entries currently within the index.
+     */
+    int length;
+
+    /**
+     * The number of entries for which space has been allocated.
+     */
+    int size;
+
+    /**
+     * The number of entries which must remain available for commands from
+     * the command history.
+     */
+    int history_reserved;
+
+    /**
+     * Counter incremented each time a command is added to the command
+     * history, used to rank commands by recency.
+     */
+    unsigned int serial;
+
+};
+
+/**
+ * Allocates a new, empty command index with space reserved for the given
+ * number of distinct history commands.
+ *
+ * @param history_size
+ *     The maximum number of commands within the command history.
+ *
+ * @return
+ *     A newly-allocated command index, which must eventually be freed with
+ *     guac_copilot_command_index_free().
+ */
+guac_copilot_command_index* guac_copilot_command_index_alloc(int history_size);
+
+/**
+ * Frees the given command index. The commands referenced by the index are
+ * not freed.
+ *
+ * @param index
+ *     The command index to free.
+ */
+void guac_copilot_command_index_free(guac_copilot_command_index* index);
+
+/**
+ * Adds the given built-in command to the index. Built-in commands are ranked
+ * below all commands from the command history.
+ *
+ * @param index
+ *     The command index to add the command to.
+ *
+ * @param command
+ *     The built-in command, which must remain allocated for the lifetime of
+ *     the index.
+ *
+ * @param protocol
+ *     The protocol to which the command applies, or NULL if the command
+ *     applies to all protocols. If non-NULL, this must remain allocated for
+ *     the lifetime of the index.
+ */
+void guac_copilot_command_index_add_builtin(guac_copilot_command_index* index,
+        const char* command, const char* protocol);
+
+/**
+ * Records that the given command was just added to the command history,
+ * ranking it above all other commands. This function does not allocate
+ * memory.
+ *
+ * @param index
+ *     The command index to update.
+ *
+ * @param command
+ *     The command within the command history, which must remain allocated
+ *     until released with guac_copilot_command_index_release().
+ */
+void guac_copilot_command_index_add_history(guac_copilot_command_index* index,
+        const char* command);
+
+/**
+ * Records that the given command within the command history is about to be
+ * overwritten. If the index references that occurrence of the command, the
+ * index is updated to reference the given other occurrence, the built-in
+ * command of the same value, or is removed from the index, in that order of
+ * preference. This function does not allocate memory.
+ *
+ * @param index
+ *     The command index to update.
+ *
+ * @param command
+ *     The command within the command history that is about to be
+ *     overwritten.
+ *
+ * @param other
+ *     The most recent other occurrence of the same command within the
+ *     command history, or NULL if there is no such occurrence.
+ */
+void guac_copilot_command_index_release(guac_copilot_command_index* index,
+        const char* command, const char* other);
+
+/**
+ * Searches the index for commands beginning with the given prefix, storing
+ * the best matches in the given array. Commands from the command history are
+ * ranked above built-in commands, with more recently-used commands ranked
+ * first. This function does not allocate memory.
+ *
+ * @param index
+ *     The command index to search.
+ *
+ * @param prefix
+ *     The prefix that matching commands must begin with, or NULL to match
+ *     all commands. Commands equal to a non-empty prefix are not matched.
+ *
+ * @param protocol
+ *     The protocol of the current session, or NULL if unknown. Built-in
+ *     commands for other protocols are not matched.
+ *
+ * @param matches
+ *     The array to store matching commands within, best matches first. The
+ *     stored pointers remain valid only until the index is next modified.
+ *
+ * @param max_matches
+ *     The maximum number of matches to store. Values larger than
+ *     GUAC_COPILOT_INDEX_MAX_MATCHES are treated as
+ *     GUAC_COPILOT_INDEX_MAX_MATCHES.
+ *
+ * @return
+ *     The number of matches stored.
+ */
+int guac_copilot_command_index_find(guac_copilot_command_index* index,
+        const char* prefix, const char* protocol, const char** matches,
+        int max_matches);
+
+#endif
@@ -25,7 +25,9 @@
 #include <string.h>
 
 /**
- * Helper to create a workflow step.
+ * Helper to create a workflow step. All built-in steps are read-only checks
+ * whose failure does not affect later steps, and so continue on error,
+ * allowing the copilot to send them to the shell together.
  */
 static guac_copilot_workflow_step create_step(const char* description,
         const char* command, int wait_time) {
@@ -35,7 +37,7 @@ static guac_copilot_workflow_step create_step(const char* description,
         .command = guac_strdup(command),
         .expected_output = NULL,
         .wait_time = wait_time,
-        .continue_on_error = 0
+        .continue_on_error = 1
     };
 
     return step;
@@ -18,25 +18,38 @@
  */
 
 #include "config.h"
+#include "copilot-index.h"
 #include "guacamole/client.h"
 #include "guacamole/copilot.h"
 #include "guacamole/mem.h"
 #include "guacamole/protocol.h"
 #include "guacamole/socket.h"
 #include "guacamole/string.h"
+#include "guacamole/timestamp.h"
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #ifdef HAVE_LIBCURL
 #include <curl/curl.h>
 #endif
 
-#define GUAC_COPILOT_HISTORY_SIZE 50
 #define GUAC_OPENAI_API_ENDPOINT "https://api.openai.com/v1/chat/completions"
 #define GUAC_OPENAI_MODEL "gpt-4"
 
+/**
+ * Stops the query thread of the given copilot, if running, cancelling and
+ * freeing all queries that have not yet completed.
+ *
+ * @param copilot
+ *     The copilot whose query thread should be stopped.
+ */
+static void guac_copilot_stop_queries(guac_copilot* copilot);
+
 guac_copilot* guac_copilot_alloc(guac_client* client) {
 
     guac_copilot* copilot = guac_mem_zalloc(sizeof(guac_copilot));
@@ -45,10 +58,15 @@ guac_copilot* guac_copilot_alloc(guac_client* client) {
 
     /* Allocate context */
     copilot->context = guac_mem_zalloc(sizeof(guac_copilot_context));
-    copilot->context->command_history = guac_mem_zalloc(
-            GUAC_COPILOT_HISTORY_SIZE * sizeof(char*));
+    copilot->context->command_history = guac_mem_alloc(
+            GUAC_COPILOT_HISTORY_SIZE, GUAC_COPILOT_MAX_COMMAND_LENGTH);
+    copilot->context->command_start = 0;
     copilot->context->command_count = 0;
 
+    /* Allocate index for local suggestions */
+    copilot->command_index =
+        guac_copilot_command_index_alloc(GUAC_COPILOT_HISTORY_SIZE);
+
     /* Allocate workflow array */
     copilot->workflows = guac_mem_zalloc(10 * sizeof(guac_copilot_workflow*));
     copilot->workflow_count = 0;
@@ -60,6 +78,13 @@ guac_copilot* guac_copilot_alloc(guac_client* client) {
     copilot->recording = 0;
     copilot->recorded_workflow = NULL;
 
+    /* AI queries are performed by a query thread started on demand */
+    pthread_mutex_init(&copilot->query_lock, NULL);
+    pthread_mutex_init(&copilot->workflow_lock, NULL);
+    pthread_mutex_init(&copilot->keystroke_lock, NULL);
+    copilot->query_wake_fd[0] = -1;
+    copilot->query_wake_fd[1] = -1;
+
     guac_client_log(client, GUAC_LOG_INFO, "Guacamole Copilot initialized");
 
     return copilot;
@@ -71,6 +96,12 @@ void guac_copilot_free(guac_copilot* copilot) {
     if (copilot == NULL)
         return;
 
+    /* Abandon any in-progress AI queries before freeing what they reference */
+    guac_copilot_stop_queries(copilot);
+    pthread_mutex_destroy(&copilot->query_lock);
+    pthread_mutex_destroy(&copilot->workflow_lock);
+    pthread_mutex_destroy(&copilot->keystroke_lock);
+
     /* Free context */
     if (copilot->context != NULL) {
         guac_mem_free(copilot->context->protocol);
@@ -80,8 +111,6 @@ void guac_copilot_free(guac_copilot* copilot) {
         guac_mem_free(copilot->context->last_error);
 
         /* Free command history */
-        for (int i = 0; i < copilot->context->command_count; i++)
-            guac_mem_free(copilot->context->command_history[i]);
         guac_mem_free(copilot->context->command_history);
 
         /* Free active apps */
@@ -92,6 +121,9 @@ void guac_copilot_free(guac_copilot* copilot) {
         guac_mem_free(copilot->context);
     }
 
+    /* Free index of commands (referencing history and workflows) */
+    guac_copilot_command_index_free(copilot->command_index);
+
     /* Free workflows */
     for (int i = 0; i < copilot->workflow_count; i++) {
         guac_copilot_workflow* wf = copilot->workflows[i];
@@ -129,6 +161,12 @@ void guac_copilot_free(guac_copilot* copilot) {
     }
     guac_mem_free(copilot->quick_actions);
 
+    /* Free cached suggestions */
+    for (int i = 0; i < GUAC_COPILOT_CACHE_SIZE; i++) {
+        guac_mem_free(copilot->suggestion_cache[i].key);
+        guac_mem_free(copilot->suggestion_cache[i].suggestions);
+    }
+
     guac_mem_free(copilot->ai_endpoint);
     guac_mem_free(copilot->ai_api_key);
 
@@ -167,17 +205,42 @@ void guac_copilot_add_command(guac_copilot* copilot, const char* command) {
         return;
 
     guac_copilot_context* ctx = copilot->context;
+    int slot;
 
-    /* If history is full, remove oldest */
+    /* If history is full, overwrite oldest */
     if (ctx->command_count >= GUAC_COPILOT_HISTORY_SIZE) {
-        guac_mem_free(ctx->command_history[0]);
-        memmove(ctx->command_history, ctx->command_history + 1,
-                (GUAC_COPILOT_HISTORY_SIZE - 1) * sizeof(char*));
+
+        slot = ctx->command_start;
+        ctx->command_start = (ctx->command_start + 1) % GUAC_COPILOT_HISTORY_SIZE;
         ctx->command_count--;
+
+        /* Find most recent remaining occurrence of the oldest command, if
+         * any, such that the index can continue to reference it */
+        const char* oldest = ctx->command_history
+            + slot * GUAC_COPILOT_MAX_COMMAND_LENGTH;
+        const char* other = NULL;
+        for (int i = ctx->command_count - 1; i >= 0; i--) {
+            const char* current = guac_copilot_get_command(ctx, i);
+            if (strcmp(current, oldest) == 0) {
+                other = current;
+                break;
+            }
+        }
+
+        guac_copilot_command_index_release(copilot->command_index,
+                oldest, other);
+
     }
 
+    else
+        slot = (ctx->command_start + ctx->command_count) % GUAC_COPILOT_HISTORY_SIZE;
+
     /* Add new command */
-    ctx->command_history[ctx->command_count++] = guac_strdup(command);
+    char* stored = ctx->command_history + slot * GUAC_COPILOT_MAX_COMMAND_LENGTH;
+    guac_strlcpy(stored, command, GUAC_COPILOT_MAX_COMMAND_LENGTH);
+    ctx->command_count++;
+
+    guac_copilot_command_index_add_history(copilot->command_index, stored);
 
     /* If recording, add to recorded workflow */
     if (copilot->recording && copilot->recorded_workflow != NULL) {
@@ -194,18 +257,136 @@ void guac_copilot_add_command(guac_copilot* copilot, const char* command) {
 
 }
 
+const char* guac_copilot_get_command(const guac_copilot_context* context,
+        int index) {
+
+    int slot = (context->command_start + index) % GUAC_COPILOT_HISTORY_SIZE;
+    return context->command_history + slot * GUAC_COPILOT_MAX_COMMAND_LENGTH;
+
+}
+
+void guac_copilot_track_keystroke(guac_copilot* copilot, int keysym) {
+
+    unsigned int head = copilot->keystroke_head;
+    unsigned int tail = __atomic_load_n(&copilot->keystroke_tail,
+            __ATOMIC_ACQUIRE);
+
+    /* Drop the keystroke rather than wait for space */
+    if (head - tail >= GUAC_COPILOT_KEYSTROKE_BUFFER_SIZE) {
+        __atomic_fetch_add(&copilot->dropped_keystrokes, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    /* Publish keystroke only after it has been stored */
+    copilot->keystrokes[head & (GUAC_COPILOT_KEYSTROKE_BUFFER_SIZE - 1)] = keysym;
+    __atomic_store_n(&copilot->keystroke_head, head + 1, __ATOMIC_RELEASE);
+
+}
+
+/**
+ * Updates the line currently being typed within the given copilot to
+ * reflect a single key press, adding the line to the command history if
+ * Enter was pressed. The keystroke_lock of the copilot must be held.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param keysym
+ *     The X11 keysym of the key that was pressed.
+ */
+static void guac_copilot_apply_keystroke(guac_copilot* copilot, int keysym) {
+
+    switch (keysym) {
+
+        /* Return / KP_Enter complete the current line */
+        case 0xFF0D:
+        case 0xFF8D:
+            if (copilot->typed_length > 0)
+                guac_copilot_add_command(copilot, copilot->typed_input);
+            copilot->typed_length = 0;
+            break;
+
+        /* BackSpace */
+        case 0xFF08:
+            if (copilot->typed_length > 0)
+                copilot->typed_length--;
+            break;
+
+        /* Escape abandons the current line */
+        case 0xFF1B:
+            copilot->typed_length = 0;
+            break;
+
+        /* Printable ASCII is added to the current line, if space remains */
+        default:
+            if (keysym >= 0x20 && keysym <= 0x7E
+                    && copilot->typed_length < GUAC_COPILOT_MAX_COMMAND_LENGTH - 1)
+                copilot->typed_input[copilot->typed_length++] = (char) keysym;
+            break;
+
+    }
+
+    copilot->typed_input[copilot->typed_length] = '\0';
+
+}
+
+void guac_copilot_process_keystrokes(guac_copilot* copilot) {
+
+    if (copilot == NULL)
+        return;
+
+    pthread_mutex_lock(&copilot->keystroke_lock);
+
+    unsigned int tail = copilot->keystroke_tail;
+    unsigned int head = __atomic_load_n(&copilot->keystroke_head,
+            __ATOMIC_ACQUIRE);
+
+    while (tail != head) {
+
+        int keysym = copilot->keystrokes[
+            tail & (GUAC_COPILOT_KEYSTROKE_BUFFER_SIZE - 1)];
+
+        /* Release the slot before interpreting the keystroke */
+        tail++;
+        __atomic_store_n(&copilot->keystroke_tail, tail, __ATOMIC_RELEASE);
+
+        guac_copilot_apply_keystroke(copilot, keysym);
+
+    }
+
+    unsigned int dropped = __atomic_exchange_n(&copilot->dropped_keystrokes,
+            0, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&copilot->keystroke_lock);
+
+    if (dropped)
+        guac_client_log(copilot->client, GUAC_LOG_DEBUG, "Copilot dropped "
+                "%u keystroke(s) that could not be tracked in time.", dropped);
+
+}
+
 int guac_copilot_handle_command(guac_copilot* copilot,
         guac_copilot_command_type command_type, const char* command_data) {
 
     if (copilot == NULL || !copilot->enabled)
         return -1;
 
+    /* Bring context up to date with anything typed since last used */
+    guac_copilot_process_keystrokes(copilot);
+
     guac_client* client = copilot->client;
 
     switch (command_type) {
 
         case GUAC_COPILOT_CMD_SUGGEST:
             {
+                /* Query the AI service without waiting for its response,
+                 * sending local suggestions in the meantime unless the AI
+                 * suggestions were already cached */
+                if (guac_copilot_suggest_commands_async(copilot, NULL,
+                            command_data, 5) > 0)
+                    break;
+
                 char** suggestions = NULL;
                 int count = guac_copilot_suggest_commands(copilot,
                         command_data, &suggestions, 5);
@@ -319,6 +500,11 @@ int guac_copilot_register_workflow(guac_copilot* copilot,
 
     copilot->workflows[copilot->workflow_count++] = workflow;
 
+    /* Suggest the commands of the workflow locally */
+    for (int i = 0; i < workflow->step_count; i++)
+        guac_copilot_command_index_add_builtin(copilot->command_index,
+                workflow->steps[i].command, workflow->protocol);
+
     guac_client_log(copilot->client, GUAC_LOG_INFO,
             "Registered workflow: %s (%d steps)", workflow->name, workflow->step_count);
 
@@ -326,6 +512,255 @@ int guac_copilot_register_workflow(guac_copilot* copilot,
 
 }
 
+/**
+ * The states of the parser locating step markers within terminal output.
+ */
+enum {
+
+    /** Not within a marker */
+    GUAC_COPILOT_MARKER_NONE,
+
+    /** ESC received */
+    GUAC_COPILOT_MARKER_ESC,
+
+    /** ESC ] received; parsing OSC code */
+    GUAC_COPILOT_MARKER_CODE,
+
+    /** Parsing step index */
+    GUAC_COPILOT_MARKER_STEP,
+
+    /** Parsing exit status */
+    GUAC_COPILOT_MARKER_STATUS
+
+};
+
+/**
+ * Sends the next batch of steps of the workflow being executed to the shell
+ * using the input_handler of the given copilot. The batch consists of all
+ * steps up to and including the next step that does not continue on error,
+ * as the steps following such a step must not run if it fails. Each command
+ * is followed by a command printing the step marker. The workflow_lock of the
+ * copilot must be held.
+ *
+ * @param copilot
+ *     The copilot executing the workflow.
+ */
+static void guac_copilot_send_steps(guac_copilot* copilot) {
+
+    guac_copilot_workflow_run* run = &copilot->workflow_run;
+    guac_copilot_workflow* workflow = run->workflow;
+
+    /* Determine extent of batch */
+    int first = run->sent_steps;
+    int last = first;
+    size_t length = 0;
+    while (last < workflow->step_count) {
+        const guac_copilot_workflow_step* step = &workflow->steps[last++];
+        length += strlen(step->command) + 64;
+        if (!step->continue_on_error)
+            break;
+    }
+
+    /* Build all commands of batch, each on its own line */
+    char* input = guac_mem_alloc(length + 1);
+    int pos = 0;
+    for (int i = first; i < last; i++) {
+
+        guac_copilot_workflow_step* step = &workflow->steps[i];
+        pos += snprintf(input + pos, length + 1 - pos,
+                "%s; printf '\\033]%i;%i;%%d\\007' $?\n",
+                step->command, GUAC_COPILOT_STEP_MARKER, i);
+
+        /* Send step start notification */
+        char step_msg[1024];
+        snprintf(step_msg, sizeof(step_msg),
+                "{\"type\":\"workflow_step\",\"step\":%d,\"description\":\"%s\","
+                "\"command\":\"%s\"}",
+                i + 1, step->description, step->command);
+        guac_copilot_send_message(copilot, "workflow", step_msg);
+
+    }
+
+    guac_timestamp now = guac_timestamp_current();
+    if (run->completed_steps == first)
+        run->step_started = now;
+
+    run->sent_steps = last;
+
+    if (copilot->input_handler(copilot, input, pos))
+        guac_client_log(copilot->client, GUAC_LOG_WARNING,
+                "Unable to send workflow steps to shell.");
+
+    guac_mem_free(input);
+
+}
+
+/**
+ * Ends the workflow being executed, sending a report of the time taken by
+ * each completed step to the client. The workflow_lock of the copilot must
+ * be held.
+ *
+ * @param copilot
+ *     The copilot executing the workflow.
+ *
+ * @param success
+ *     Non-zero if all steps of the workflow completed successfully, zero if
+ *     the workflow was aborted due to a failed step.
+ */
+static void guac_copilot_finish_workflow(guac_copilot* copilot, int success) {
+
+    guac_copilot_workflow_run* run = &copilot->workflow_run;
+    guac_copilot_workflow* workflow = run->workflow;
+    int total = (int) (guac_timestamp_current() - run->started);
+
+    size_t size = 256 + run->completed_steps * 64;
+    char* report = guac_mem_alloc(size);
+    int pos = snprintf(report, size,
+            "{\"type\":\"workflow_complete\",\"name\":\"%s\","
+            "\"success\":%s,\"duration\":%d,\"steps\":[",
+            workflow->name, success ? "true" : "false", total);
+
+    for (int i = 0; i < run->completed_steps; i++) {
+        pos += snprintf(report + pos, size - pos,
+                "%s{\"step\":%d,\"status\":%d,\"duration\":%d}",
+                i > 0 ? "," : "", i + 1, run->statuses[i],
+                run->durations[i]);
+
+        guac_client_log(copilot->client, GUAC_LOG_DEBUG,
+                "Workflow %s step %d (\"%s\") exited with status %d "
+                "after %d ms", workflow->name, i + 1,
+                workflow->steps[i].command, run->statuses[i],
+                run->durations[i]);
+    }
+
+    snprintf(report + pos, size - pos, "]}");
+    guac_copilot_send_message(copilot, "workflow", report);
+    guac_mem_free(report);
+
+    guac_client_log(copilot->client, GUAC_LOG_INFO,
+            "Workflow %s %s after %d of %d steps in %d ms", workflow->name,
+            success ? "completed" : "failed", run->completed_steps,
+            workflow->step_count, total);
+
+    run->workflow = NULL;
+
+}
+
+/**
+ * Records completion of the given step of the workflow being executed,
+ * sending further steps or ending the workflow as appropriate. The
+ * workflow_lock of the copilot must be held.
+ *
+ * @param copilot
+ *     The copilot executing the workflow.
+ *
+ * @param step
+ *     The zero-based index of the completed step.
+ *
+ * @param status
+ *     The exit status of the completed step.
+ */
+static void guac_copilot_complete_step(guac_copilot* copilot, int step,
+        int status) {
+
+    guac_copilot_workflow_run* run = &copilot->workflow_run;
+    guac_copilot_workflow* workflow = run->workflow;
+
+    /* Ignore markers not belonging to the next step to complete (such as
+     * markers from a previous, abandoned workflow) */
+    if (step != run->completed_steps || step >= run->sent_steps)
+        return;
+
+    guac_timestamp now = guac_timestamp_current();
+    run->durations[step] = (int) (now - run->step_started);
+    run->statuses[step] = status;
+    run->step_started = now;
+    run->completed_steps++;
+
+    /* Later steps must not run if a step that must succeed fails */
+    if (status != 0 && !workflow->steps[step].continue_on_error)
+        guac_copilot_finish_workflow(copilot, 0);
+
+    else if (run->completed_steps == workflow->step_count)
+        guac_copilot_finish_workflow(copilot, 1);
+
+    /* Send next batch once all sent steps have completed */
+    else if (run->completed_steps == run->sent_steps)
+        guac_copilot_send_steps(copilot);
+
+}
+
+void guac_copilot_handle_output(guac_copilot* copilot, const char* data,
+        int length) {
+
+    if (copilot == NULL || copilot->input_handler == NULL)
+        return;
+
+    pthread_mutex_lock(&copilot->workflow_lock);
+
+    guac_copilot_workflow_run* run = &copilot->workflow_run;
+
+    for (int i = 0; i < length && run->workflow != NULL; i++) {
+
+        unsigned char c = data[i];
+
+        switch (run->marker_state) {
+
+            case GUAC_COPILOT_MARKER_ESC:
+                if (c == ']') {
+                    run->marker_state = GUAC_COPILOT_MARKER_CODE;
+                    run->marker_value = 0;
+                    continue;
+                }
+                break;
+
+            case GUAC_COPILOT_MARKER_CODE:
+            case GUAC_COPILOT_MARKER_STEP:
+            case GUAC_COPILOT_MARKER_STATUS:
+
+                /* Accumulate value, abandoning implausibly long values */
+                if (c >= '0' && c <= '9' && run->marker_value < 10000000) {
+                    run->marker_value = run->marker_value * 10 + c - '0';
+                    continue;
+                }
+
+                /* Only markers having the expected code are relevant */
+                if (c == ';' && run->marker_state == GUAC_COPILOT_MARKER_CODE) {
+                    if (run->marker_value == GUAC_COPILOT_STEP_MARKER) {
+                        run->marker_state = GUAC_COPILOT_MARKER_STEP;
+                        run->marker_value = 0;
+                        continue;
+                    }
+                }
+
+                else if (c == ';' && run->marker_state == GUAC_COPILOT_MARKER_STEP) {
+                    run->marker_step = run->marker_value;
+                    run->marker_state = GUAC_COPILOT_MARKER_STATUS;
+                    run->marker_value = 0;
+                    continue;
+                }
+
+                else if (c == 0x07 && run->marker_state == GUAC_COPILOT_MARKER_STATUS) {
+                    run->marker_state = GUAC_COPILOT_MARKER_NONE;
+                    guac_copilot_complete_step(copilot, run->marker_step,
+                            run->marker_value);
+                    continue;
+                }
+
+                break;
+
+        }
+
+        /* Anything else may only begin a new marker */
+        run->marker_state = (c == 0x1B)
+            ? GUAC_COPILOT_MARKER_ESC : GUAC_COPILOT_MARKER_NONE;
+
+    }
+
+    pthread_mutex_unlock(&copilot->workflow_lock);
+
+}
+
 int guac_copilot_execute_workflow(guac_copilot* copilot,
         const char* workflow_name) {
 
@@ -357,6 +792,35 @@ int guac_copilot_execute_workflow(guac_copilot* copilot,
     snprintf(start_msg, sizeof(start_msg),
             "{\"type\":\"workflow_start\",\"name\":\"%s\",\"steps\":%d}",
             workflow->name, workflow->step_count);
+
+    /* Execute steps directly if input can be sent to the shell */
+    if (copilot->input_handler != NULL && workflow->step_count > 0) {
+
+        pthread_mutex_lock(&copilot->workflow_lock);
+
+        guac_copilot_workflow_run* run = &copilot->workflow_run;
+        if (run->workflow != NULL) {
+            guac_client_log(client, GUAC_LOG_WARNING,
+                    "Workflow %s cannot be executed while workflow %s is "
+                    "still running.", workflow->name, run->workflow->name);
+            pthread_mutex_unlock(&copilot->workflow_lock);
+            return -1;
+        }
+
+        guac_copilot_send_message(copilot, "workflow", start_msg);
+
+        run->workflow = workflow;
+        run->sent_steps = 0;
+        run->completed_steps = 0;
+        run->started = guac_timestamp_current();
+
+        guac_copilot_send_steps(copilot);
+
+        pthread_mutex_unlock(&copilot->workflow_lock);
+        return 0;
+
+    }
+
     guac_copilot_send_message(copilot, "workflow", start_msg);
 
     /* Execute each step */
@@ -392,64 +856,24 @@ int guac_copilot_suggest_commands(guac_copilot* copilot, const char* input,
     if (copilot == NULL || suggestions == NULL)
         return 0;
 
+    guac_copilot_process_keystrokes(copilot);
+
     *suggestions = guac_mem_alloc(max_suggestions * sizeof(char*));
-    int count = 0;
 
     guac_copilot_context* ctx = copilot->context;
 
-    /* If OpenAI API key is available, use AI for suggestions */
-    if (copilot->ai_api_key != NULL && strlen(copilot->ai_api_key) > 0) {
-        
-        char prompt[2048];
-        snprintf(prompt, sizeof(prompt),
-                "User is in a %s session on %s. Current directory: %s. "
-                "Recent commands: ",
-                ctx->protocol ? ctx->protocol : "remote",
-                ctx->os_type ? ctx->os_type : "unknown OS",
-                ctx->current_directory ? ctx->current_directory : "/");
-        
-        /* Add recent command history to prompt */
-        int history_len = strlen(prompt);
-        int cmd_start = (ctx->command_count > 3) ? ctx->command_count - 3 : 0;
-        for (int i = cmd_start; i < ctx->command_count && history_len < 1800; i++) {
-            int added = snprintf(prompt + history_len, sizeof(prompt) - history_len,
-                    "'%s', ", ctx->command_history[i]);
-            if (added > 0)
-                history_len += added;
-        }
-        
-        /* Add the actual request */
-        snprintf(prompt + history_len, sizeof(prompt) - history_len,
-                ". User typed: '%s'. Suggest %d relevant commands (one per line, no explanations).",
-                input ? input : "", max_suggestions);
-        
-        char ai_response[4096];
-        if (guac_copilot_query_openai(copilot, copilot->ai_api_key, prompt,
-                ai_response, sizeof(ai_response)) == 0) {
-            
-            /* Parse response into suggestions (split by newlines) */
-            char* line = strtok(ai_response, "\n");
-            while (line != NULL && count < max_suggestions) {
-                /* Skip empty lines and trim whitespace */
-                while (*line == ' ' || *line == '\t') line++;
-                if (strlen(line) > 0) {
-                    (*suggestions)[count++] = guac_strdup(line);
-                }
-                line = strtok(NULL, "\n");
-            }
-            
-            guac_client_log(copilot->client, GUAC_LOG_DEBUG,
-                    "OpenAI provided %d suggestions", count);
-            
-            if (count > 0)
-                return count; /* Return AI suggestions */
-        }
-        
-        guac_client_log(copilot->client, GUAC_LOG_DEBUG,
-                "Falling back to local suggestions");
-    }
+    /* Suggest known commands beginning with the input, most recent first */
+    const char* matches[GUAC_COPILOT_INDEX_MAX_MATCHES];
+    int count = guac_copilot_command_index_find(copilot->command_index, input,
+            ctx->protocol, matches, max_suggestions);
 
-    /* Fallback: Provide context-based suggestions locally */
+    for (int i = 0; i < count; i++)
+        (*suggestions)[i] = guac_strdup(matches[i]);
+
+    if (count > 0)
+        return count;
+
+    /* Otherwise provide generic context-based suggestions */
     if (ctx->protocol != NULL && strcmp(ctx->protocol, "ssh") == 0) {
 
         if (input == NULL || strlen(input) == 0) {
@@ -483,14 +907,6 @@ int guac_copilot_suggest_commands(guac_copilot* copilot, const char* input,
             (*suggestions)[count++] = guac_strdup("Open PowerShell");
     }
 
-    /* Add suggestions from command history */
-    if (count < max_suggestions && ctx->command_count > 0) {
-        /* Get last unique command */
-        const char* last_cmd = ctx->command_history[ctx->command_count - 1];
-        if (last_cmd != NULL)
-            (*suggestions)[count++] = guac_strdup(last_cmd);
-    }
-
     return count;
 
 }
@@ -608,250 +1024,1659 @@ void guac_copilot_send_message(guac_copilot* copilot,
 #ifdef HAVE_LIBCURL
 
 /**
- * Callback for libcurl to write response data.
+ * The number of bytes initially allocated for a guac_copilot_buffer. Buffers
+ * requiring more space grow by doubling in size.
  */
-static size_t guac_copilot_curl_write_callback(void* contents, size_t size,
-        size_t nmemb, void* userp) {
+#define GUAC_COPILOT_BUFFER_INITIAL_SIZE 1024
 
-    size_t realsize = size * nmemb;
-    char** response = (char**)userp;
+/**
+ * A growable, null-terminated buffer, used to build request payloads and to
+ * accumulate responses. Data is appended in place, growing the underlying
+ * allocation geometrically, such that building large payloads or receiving
+ * large responses requires neither intermediate copies nor a reallocation for
+ * each addition.
+ */
+typedef struct guac_copilot_buffer {
 
-    /* Reallocate buffer to fit new data */
-    size_t current_len = *response ? strlen(*response) : 0;
-    char* new_response = realloc(*response, current_len + realsize + 1);
+    /**
+     * The contents of this buffer, which are always null-terminated, or NULL
+     * if nothing has yet been appended.
+     */
+    char* data;
 
-    if (new_response == NULL) {
-        /* Out of memory */
-        return 0;
-    }
+    /**
+     * The number of bytes currently stored within this buffer, excluding the
+     * null terminator.
+     */
+    size_t length;
 
-    *response = new_response;
-    memcpy(*response + current_len, contents, realsize);
-    (*response)[current_len + realsize] = '\0';
+    /**
+     * The number of bytes allocated for data.
+     */
+    size_t size;
 
-    return realsize;
-}
+} guac_copilot_buffer;
 
 /**
- * Escapes a JSON string by replacing special characters.
+ * Ensures the given buffer has space for at least the given number of
+ * additional bytes, plus a null terminator, doubling the size of its
+ * allocation as many times as required.
+ *
+ * @param buffer
+ *     The buffer to grow.
+ *
+ * @param length
+ *     The number of additional bytes that will be appended.
  */
-static char* guac_copilot_escape_json_string(const char* str) {
-    if (str == NULL)
-        return guac_strdup("");
+static void guac_copilot_buffer_reserve(guac_copilot_buffer* buffer,
+        size_t length) {
+
+    size_t required = guac_mem_ckd_add_or_die(buffer->length, length, 1);
+    if (required <= buffer->size)
+        return;
 
-    size_t len = strlen(str);
-    char* escaped = guac_mem_alloc(len * 2 + 1); /* Worst case: all chars escaped */
-    char* dst = escaped;
+    size_t size = buffer->size ? buffer->size : GUAC_COPILOT_BUFFER_INITIAL_SIZE;
+    while (size < required)
+        size = guac_mem_ckd_mul_or_die(size, 2);
 
-    for (const char* src = str; *src; src++) {
-        switch (*src) {
-            case '"':
-                *dst++ = '\\';
-                *dst++ = '"';
-                break;
-            case '\\':
-                *dst++ = '\\';
-                *dst++ = '\\';
-                break;
-            case '\n':
-                *dst++ = '\\';
-                *dst++ = 'n';
-                break;
-            case '\r':
-                *dst++ = '\\';
-                *dst++ = 'r';
-                break;
-            case '\t':
-                *dst++ = '\\';
-                *dst++ = 't';
-                break;
-            default:
-                *dst++ = *src;
-        }
-    }
-    *dst = '\0';
+    buffer->data = guac_mem_realloc_or_die(buffer->data, size);
+    buffer->size = size;
 
-    return escaped;
 }
 
-int guac_copilot_query_openai(guac_copilot* copilot, const char* api_key,
-        const char* prompt, char* response_buffer, int buffer_size) {
+/**
+ * Appends the given number of bytes to the given buffer.
+ *
+ * @param buffer
+ *     The buffer to append to.
+ *
+ * @param data
+ *     The bytes to append.
+ *
+ * @param length
+ *     The number of bytes to append.
+ */
+static void guac_copilot_buffer_append(guac_copilot_buffer* buffer,
+        const char* data, size_t length) {
 
-    if (copilot == NULL || api_key == NULL || prompt == NULL || 
-            response_buffer == NULL || buffer_size <= 0) {
-        return -1;
-    }
+    guac_copilot_buffer_reserve(buffer, length);
 
-    guac_client* client = copilot->client;
-    CURL* curl;
-    CURLcode res;
-    char* response_data = NULL;
-    int result = -1;
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
 
-    guac_client_log(client, GUAC_LOG_DEBUG,
-            "Querying OpenAI API for copilot assistance");
+}
 
-    /* Initialize curl */
-    curl = curl_easy_init();
-    if (!curl) {
-        guac_client_log(client, GUAC_LOG_ERROR,
-                "Failed to initialize curl for OpenAI API");
-        return -1;
-    }
+/**
+ * Appends the given null-terminated string to the given buffer.
+ *
+ * @param buffer
+ *     The buffer to append to.
+ *
+ * @param str
+ *     The string to append.
+ */
+static void guac_copilot_buffer_append_string(guac_copilot_buffer* buffer,
+        const char* str) {
+    guac_copilot_buffer_append(buffer, str, strlen(str));
+}
 
-    /* Escape the prompt for JSON */
-    char* escaped_prompt = guac_copilot_escape_json_string(prompt);
-
-    /* Build context information */
-    char context_info[1024] = "";
-    if (copilot->context) {
-        snprintf(context_info, sizeof(context_info),
-                "Context: Protocol=%s, OS=%s, Directory=%s, CommandHistory=%d commands",
-                copilot->context->protocol ? copilot->context->protocol : "unknown",
-                copilot->context->os_type ? copilot->context->os_type : "unknown",
-                copilot->context->current_directory ? copilot->context->current_directory : "/",
-                copilot->context->command_count);
-    }
-    char* escaped_context = guac_copilot_escape_json_string(context_info);
-
-    /* Build JSON payload */
-    char json_payload[8192];
-    snprintf(json_payload, sizeof(json_payload),
-            "{"
-            "\"model\":\"%s\","
-            "\"messages\":["
-            "{\"role\":\"system\",\"content\":\"You are a helpful AI assistant for remote desktop and SSH sessions. Provide concise, actionable advice. %s\"},"
-            "{\"role\":\"user\",\"content\":\"%s\"}"
-            "],"
-            "\"max_tokens\":500,"
-            "\"temperature\":0.7"
-            "}",
-            GUAC_OPENAI_MODEL,
-            escaped_context,
-            escaped_prompt);
+/**
+ * Appends the decimal representation of the given integer to the given
+ * buffer.
+ *
+ * @param buffer
+ *     The buffer to append to.
+ *
+ * @param value
+ *     The integer to append.
+ */
+static void guac_copilot_buffer_append_int(guac_copilot_buffer* buffer,
+        int value) {
 
-    guac_mem_free(escaped_prompt);
-    guac_mem_free(escaped_context);
+    /* Sufficient for any 32-bit integer, including sign */
+    char str[16];
+    int length = snprintf(str, sizeof(str), "%i", value);
+    guac_copilot_buffer_append(buffer, str, length);
 
-    /* Set up headers */
-    struct curl_slist* headers = NULL;
-    char auth_header[512];
-    snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", api_key);
-    
-    headers = curl_slist_append(headers, "Content-Type: application/json");
+}
+
+/**
+ * Appends the given string to the given buffer, escaped for inclusion within
+ * a JSON string. Runs of characters that require no escaping are appended
+ * together. A NULL string is treated as empty.
+ *
+ * @param buffer
+ *     The buffer to append to.
+ *
+ * @param str
+ *     The string to escape and append, or NULL.
+ */
+static void guac_copilot_buffer_append_json(guac_copilot_buffer* buffer,
+        const char* str) {
+
+    if (str == NULL)
+        return;
+
+    const char* run = str;
+    for (const char* current = str; *current != '\0'; current++) {
+
+        unsigned char c = (unsigned char) *current;
+        /* Sufficient for the longest (six-character) escape sequence */
+        char escape[8];
+
+        switch (c) {
+            case '"':  strcpy(escape, "\\\""); break;
+            case '\\': strcpy(escape, "\\\\"); break;
+            case '\n': strcpy(escape, "\\n");  break;
+            case '\r': strcpy(escape, "\\r");  break;
+            case '\t': strcpy(escape, "\\t");  break;
+
+            /* All other control characters must be escaped numerically */
+            default:
+                if (c >= 0x20)
+                    continue;
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                break;
+        }
+
+        /* Flush any preceding unescaped characters before the escape */
+        guac_copilot_buffer_append(buffer, run, current - run);
+        guac_copilot_buffer_append_string(buffer, escape);
+        run = current + 1;
+
+    }
+
+    guac_copilot_buffer_append_string(buffer, run);
+
+}
+
+/**
+ * Frees the contents of the given buffer, leaving the buffer empty.
+ *
+ * @param buffer
+ *     The buffer to free.
+ */
+static void guac_copilot_buffer_free(guac_copilot_buffer* buffer) {
+    guac_mem_free(buffer->data);
+    buffer->length = 0;
+    buffer->size = 0;
+}
+
+/**
+ * Callback for libcurl to write response data, appending that data to the
+ * guac_copilot_buffer provided as userp.
+ */
+static size_t guac_copilot_curl_write_callback(char* contents, size_t size,
+        size_t nmemb, void* userp) {
+
+    size_t realsize = size * nmemb;
+    guac_copilot_buffer* response = (guac_copilot_buffer*) userp;
+
+    guac_copilot_buffer_append(response, contents, realsize);
+    return realsize;
+
+}
+
+/**
+ * Begins the JSON payload of a chat completion request within the given
+ * buffer, including a description of the current session context. The
+ * payload is left open within the content of the user message, such that
+ * the prompt may be appended directly with guac_copilot_buffer_append_json()
+ * before the payload is completed with guac_copilot_end_payload().
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param payload
+ *     The empty buffer that should receive the payload.
+ *
+ * @param stream
+ *     Non-zero if the response should be streamed as a series of
+ *     server-sent events as it is generated, zero if the response should be
+ *     sent only once complete.
+ */
+static void guac_copilot_begin_payload(guac_copilot* copilot,
+        guac_copilot_buffer* payload, int stream) {
+
+    guac_copilot_context* ctx = copilot->context;
+
+    guac_copilot_buffer_append_string(payload, "{\"model\":\"");
+    guac_copilot_buffer_append_json(payload, GUAC_OPENAI_MODEL);
+    guac_copilot_buffer_append_string(payload, "\","
+            "\"max_tokens\":500,"
+            "\"temperature\":0.7,"
+            "\"stream\":");
+    guac_copilot_buffer_append_string(payload, stream ? "true" : "false");
+
+    /* System message, including context information */
+    guac_copilot_buffer_append_string(payload, ",\"messages\":["
+            "{\"role\":\"system\",\"content\":\"You are a helpful AI "
+            "assistant for remote desktop and SSH sessions. Provide concise, "
+            "actionable advice.");
+
+    if (ctx != NULL) {
+        guac_copilot_buffer_append_string(payload, " Context: Protocol=");
+        guac_copilot_buffer_append_json(payload,
+                ctx->protocol ? ctx->protocol : "unknown");
+        guac_copilot_buffer_append_string(payload, ", OS=");
+        guac_copilot_buffer_append_json(payload,
+                ctx->os_type ? ctx->os_type : "unknown");
+        guac_copilot_buffer_append_string(payload, ", Directory=");
+        guac_copilot_buffer_append_json(payload,
+                ctx->current_directory ? ctx->current_directory : "/");
+        guac_copilot_buffer_append_string(payload, ", CommandHistory=");
+        guac_copilot_buffer_append_int(payload, ctx->command_count);
+        guac_copilot_buffer_append_string(payload, " commands");
+    }
+
+    /* User message, whose content is the prompt */
+    guac_copilot_buffer_append_string(payload, "\"},"
+            "{\"role\":\"user\",\"content\":\"");
+
+}
+
+/**
+ * Completes a JSON payload begun with guac_copilot_begin_payload().
+ *
+ * @param payload
+ *     The buffer containing the payload.
+ */
+static void guac_copilot_end_payload(guac_copilot_buffer* payload) {
+    guac_copilot_buffer_append_string(payload, "\"}]}");
+}
+
+/**
+ * Configures the given curl handle to POST the given JSON payload to the
+ * OpenAI API, passing the response to the given write callback.
+ *
+ * @param curl
+ *     The curl handle to configure.
+ *
+ * @param api_key
+ *     The OpenAI API key.
+ *
+ * @param payload
+ *     The buffer containing the JSON payload to send, which must remain
+ *     allocated and unmodified until the request has completed. The payload
+ *     is sent directly from this buffer and is not copied.
+ *
+ * @param write_callback
+ *     The function that libcurl should invoke as response data is received.
+ *
+ * @param write_data
+ *     The arbitrary data to pass to write_callback.
+ *
+ * @return
+ *     The list of headers sent with the request, which must remain allocated
+ *     until the request has completed and must eventually be freed with
+ *     curl_slist_free_all().
+ */
+static struct curl_slist* guac_copilot_setup_request(CURL* curl,
+        const char* api_key, const guac_copilot_buffer* payload,
+        curl_write_callback write_callback, void* write_data) {
+
+    /* Set up headers */
+    struct curl_slist* headers = NULL;
+    char auth_header[512];
+    snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", api_key);
+    
+    headers = curl_slist_append(headers, "Content-Type: application/json");
     headers = curl_slist_append(headers, auth_header);
 
     /* Configure curl */
     curl_easy_setopt(curl, CURLOPT_URL, GUAC_OPENAI_API_ENDPOINT);
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_payload);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, guac_copilot_curl_write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_data);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+            (curl_off_t) payload->length);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload->data);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, write_data);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long) GUAC_COPILOT_QUERY_TIMEOUT);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
 
-    /* Perform request */
-    res = curl_easy_perform(curl);
+    /* Prefer HTTP/2, allowing concurrent queries to share one connection,
+     * and keep idle connections alive for reuse by later queries */
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long) CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    return headers;
+
+}
+
+/**
+ * Extracts the message content from the OpenAI API response received by the
+ * given curl handle, unescaping any basic JSON escape sequences.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param curl
+ *     The curl handle that performed the request.
+ *
+ * @param res
+ *     The result of performing the request.
+ *
+ * @param response_data
+ *     The response received, or NULL if no data was received.
+ *
+ * @param response_buffer
+ *     Buffer to store the message content, or a description of the error if
+ *     the request failed.
+ *
+ * @param buffer_size
+ *     Size of the response buffer.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+static int guac_copilot_parse_response(guac_copilot* copilot, CURL* curl,
+        CURLcode res, const char* response_data, char* response_buffer,
+        int buffer_size) {
+
+    guac_client* client = copilot->client;
+    int result = -1;
 
     if (res != CURLE_OK) {
         guac_client_log(client, GUAC_LOG_ERROR,
                 "OpenAI API request failed: %s", curl_easy_strerror(res));
-    } else {
-        long http_code = 0;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        snprintf(response_buffer, buffer_size,
+                "Error: %s", curl_easy_strerror(res));
+        return -1;
+    }
 
-        if (http_code == 200 && response_data) {
-            guac_client_log(client, GUAC_LOG_DEBUG,
-                    "OpenAI API response received successfully");
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+    if (http_code != 200 || response_data == NULL) {
+        guac_client_log(client, GUAC_LOG_ERROR,
+                "OpenAI API returned error. HTTP code: %ld", http_code);
+        snprintf(response_buffer, buffer_size,
+                "Error: OpenAI API returned HTTP %ld", http_code);
+        return -1;
+    }
 
-            /* Parse JSON response to extract the message content */
-            /* Look for "content": in the response */
-            char* content_start = strstr(response_data, "\"content\":");
+    guac_client_log(client, GUAC_LOG_DEBUG,
+            "OpenAI API response received successfully");
+
+    /* Parse JSON response to extract the message content */
+    /* Look for "content": in the response */
+    const char* content_start = strstr(response_data, "\"content\":");
+    if (content_start) {
+        content_start = strchr(content_start, '"');
+        if (content_start) {
+            content_start++; /* Skip opening quote */
+            content_start = strchr(content_start, '"');
             if (content_start) {
-                content_start = strchr(content_start, '"');
-                if (content_start) {
-                    content_start++; /* Skip opening quote */
-                    content_start = strchr(content_start, '"');
-                    if (content_start) {
-                        content_start++; /* Skip second quote */
-                        char* content_end = strstr(content_start, "\",");
-                        if (!content_end)
-                            content_end = strstr(content_start, "\"");
-                        
-                        if (content_end) {
-                            int len = content_end - content_start;
-                            if (len > buffer_size - 1)
-                                len = buffer_size - 1;
-                            
-                            strncpy(response_buffer, content_start, len);
-                            response_buffer[len] = '\0';
-                            
-                            /* Unescape basic JSON escape sequences */
-                            char* src = response_buffer;
-                            char* dst = response_buffer;
-                            while (*src) {
-                                if (*src == '\\' && *(src + 1)) {
-                                    src++;
-                                    switch (*src) {
-                                        case 'n': *dst++ = '\n'; break;
-                                        case 'r': *dst++ = '\r'; break;
-                                        case 't': *dst++ = '\t'; break;
-                                        case '"': *dst++ = '"'; break;
-                                        case '\\': *dst++ = '\\'; break;
-                                        default: *dst++ = *src; break;
-                                    }
-                                    src++;
-                                } else {
-                                    *dst++ = *src++;
-                                }
+                content_start++; /* Skip second quote */
+                const char* content_end = strstr(content_start, "\",");
+                if (!content_end)
+                    content_end = strstr(content_start, "\"");
+                
+                if (content_end) {
+                    int len = content_end - content_start;
+                    if (len > buffer_size - 1)
+                        len = buffer_size - 1;
+                    
+                    strncpy(response_buffer, content_start, len);
+                    response_buffer[len] = '\0';
+                    
+                    /* Unescape basic JSON escape sequences */
+                    char* src = response_buffer;
+                    char* dst = response_buffer;
+                    while (*src) {
+                        if (*src == '\\' && *(src + 1)) {
+                            src++;
+                            switch (*src) {
+                                case 'n': *dst++ = '\n'; break;
+                                case 'r': *dst++ = '\r'; break;
+                                case 't': *dst++ = '\t'; break;
+                                case '"': *dst++ = '"'; break;
+                                case '\\': *dst++ = '\\'; break;
+                                default: *dst++ = *src; break;
                             }
-                            *dst = '\0';
-                            
-                            result = 0; /* Success */
+                            src++;
+                        } else {
+                            *dst++ = *src++;
                         }
                     }
+                    *dst = '\0';
+                    
+                    result = 0; /* Success */
                 }
             }
-
-            if (result != 0) {
-                guac_client_log(client, GUAC_LOG_ERROR,
-                        "Failed to parse OpenAI API response");
-                snprintf(response_buffer, buffer_size,
-                        "Error: Could not parse AI response");
-            }
-        } else {
-            guac_client_log(client, GUAC_LOG_ERROR,
-                    "OpenAI API returned error. HTTP code: %ld", http_code);
-            snprintf(response_buffer, buffer_size,
-                    "Error: OpenAI API returned HTTP %ld", http_code);
         }
     }
 
+    if (result != 0) {
+        guac_client_log(client, GUAC_LOG_ERROR,
+                "Failed to parse OpenAI API response");
+        snprintf(response_buffer, buffer_size,
+                "Error: Could not parse AI response");
+    }
+
+    return result;
+
+}
+
+int guac_copilot_query_openai(guac_copilot* copilot, const char* api_key,
+        const char* prompt, char* response_buffer, int buffer_size) {
+
+    if (copilot == NULL || api_key == NULL || prompt == NULL || 
+            response_buffer == NULL || buffer_size <= 0) {
+        return -1;
+    }
+
+    guac_client* client = copilot->client;
+    guac_copilot_buffer response = { 0 };
+
+    guac_client_log(client, GUAC_LOG_DEBUG,
+            "Querying OpenAI API for copilot assistance");
+
+    /* Initialize curl */
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        guac_client_log(client, GUAC_LOG_ERROR,
+                "Failed to initialize curl for OpenAI API");
+        return -1;
+    }
+
+    guac_copilot_buffer payload = { 0 };
+    guac_copilot_begin_payload(copilot, &payload, 0);
+    guac_copilot_buffer_append_json(&payload, prompt);
+    guac_copilot_end_payload(&payload);
+
+    struct curl_slist* headers = guac_copilot_setup_request(curl, api_key,
+            &payload, guac_copilot_curl_write_callback, &response);
+
+    /* Perform request */
+    CURLcode res = curl_easy_perform(curl);
+    int result = guac_copilot_parse_response(copilot, curl, res,
+            response.data, response_buffer, buffer_size);
+
     /* Cleanup */
-    if (response_data)
-        free(response_data);
+    guac_copilot_buffer_free(&response);
     curl_slist_free_all(headers);
     curl_easy_cleanup(curl);
+    guac_copilot_buffer_free(&payload);
 
     return result;
 }
 
-#else
+/**
+ * The maximum length of a single line of the server-sent event stream
+ * received from the AI service, in bytes. Longer lines are ignored.
+ */
+#define GUAC_COPILOT_QUERY_MAX_EVENT_LENGTH 8192
 
-/* Fallback implementation when libcurl is not available */
-int guac_copilot_query_openai(guac_copilot* copilot, const char* api_key,
-        const char* prompt, char* response_buffer, int buffer_size) {
+/**
+ * An AI query requesting command suggestions, performed by the copilot query
+ * thread. The response is received as a stream of server-sent events, each
+ * containing the next fragment of the generated text, and suggestions are
+ * sent to the recipient as each fragment is received.
+ */
+struct guac_copilot_query {
+
+    /**
+     * The next query in the list containing this query, or NULL if this is
+     * the last query.
+     */
+    guac_copilot_query* next;
+
+    /**
+     * The copilot that submitted this query.
+     */
+    guac_copilot* copilot;
+
+    /**
+     * The user that should receive the suggestions, or NULL if the
+     * suggestions should be sent to all users.
+     */
+    guac_user* user;
+
+    /**
+     * Whether this query has been cancelled. Cancelled queries are freed by
+     * the query thread without their results being delivered.
+     */
+    int cancelled;
+
+    /**
+     * The maximum number of suggestions to send.
+     */
+    int max_suggestions;
+
+    /**
+     * The number of suggestions completed thus far.
+     */
+    int suggestion_count;
+
+    /**
+     * The number of characters of the current suggestion sent thus far,
+     * excluding any leading whitespace.
+     */
+    int suggestion_length;
+
+    /**
+     * The curl handle performing this query, or NULL if the query has not
+     * yet been started by the query thread.
+     */
+    CURL* curl;
 
-    if (copilot == NULL || response_buffer == NULL || buffer_size <= 0)
-        return -1;
+    /**
+     * The headers sent with the request, or NULL if the query has not yet
+     * been started by the query thread.
+     */
+    struct curl_slist* headers;
+
+    /**
+     * The JSON payload of the request.
+     */
+    guac_copilot_buffer payload;
+
+    /**
+     * The suggestion cache key of this query, or NULL if the suggestions
+     * received should not be cached.
+     */
+    char* cache_key;
+
+    /**
+     * All suggestion text received thus far, such that the suggestions may
+     * be cached once the query completes.
+     */
+    char text[GUAC_COPILOT_MAX_SUGGESTIONS_LENGTH];
+
+    /**
+     * The number of bytes currently stored within text.
+     */
+    int text_length;
+
+    /**
+     * Whether the suggestion text received exceeded the size of the text
+     * buffer, in which case the suggestions are not cached.
+     */
+    int text_overflow;
+
+    /**
+     * The current, incomplete line of the event stream.
+     */
+    char event[GUAC_COPILOT_QUERY_MAX_EVENT_LENGTH];
+
+    /**
+     * The number of bytes currently stored within event.
+     */
+    int event_length;
+
+    /**
+     * Whether the current line of the event stream exceeded the size of the
+     * event buffer and is being ignored.
+     */
+    int event_overflow;
+
+    /**
+     * Suggestion text which has been received but not yet sent.
+     */
+    char output[GUAC_PROTOCOL_BLOB_MAX_LENGTH];
+
+    /**
+     * The number of bytes currently stored within output.
+     */
+    int output_length;
+
+    /**
+     * The pipe stream used to send suggestions, or NULL if no suggestions
+     * have yet been sent.
+     */
+    guac_stream* stream;
+
+};
 
-    guac_client_log(copilot->client, GUAC_LOG_WARNING,
-            "OpenAI integration is not available. libcurl was not found during build.");
+/**
+ * Frees the given query and all associated resources. If the query has been
+ * started, it must first have been removed from the curl multi handle of the
+ * query thread.
+ *
+ * @param query
+ *     The query to free.
+ */
+static void guac_copilot_query_free(guac_copilot_query* query) {
 
-    snprintf(response_buffer, buffer_size,
-            "Error: OpenAI integration requires libcurl");
+    if (query->curl != NULL)
+        curl_easy_cleanup(query->curl);
 
-    return -1;
+    curl_slist_free_all(query->headers);
+    guac_copilot_buffer_free(&query->payload);
+    guac_mem_free(query->cache_key);
+    guac_mem_free(query);
+
+}
+
+/**
+ * Wakes the query thread of the given copilot, such that newly-submitted or
+ * cancelled queries are handled without waiting for network activity. The
+ * query_lock of the copilot must be held.
+ *
+ * @param copilot
+ *     The copilot whose query thread should be woken.
+ */
+static void guac_copilot_wake_queries(guac_copilot* copilot) {
+
+    /* The pipe is non-blocking; if it is already full, the query thread has
+     * a wakeup pending regardless */
+    if (copilot->query_wake_fd[1] != -1) {
+        char token = 0;
+        if (write(copilot->query_wake_fd[1], &token, 1) < 0) {
+            /* Ignore - a wakeup is already pending */
+        }
+    }
+
+}
+
+/**
+ * Opens a new pipe stream for sending AI suggestions to the given user. The
+ * query_lock of the copilot must be held.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param user
+ *     The user that should receive the suggestions, or NULL if the
+ *     suggestions should be sent to all users.
+ *
+ * @return
+ *     The newly-opened stream.
+ */
+static guac_stream* guac_copilot_open_suggestions(guac_copilot* copilot,
+        guac_user* user) {
+
+    guac_stream* stream;
+    guac_socket* socket;
+
+    if (user != NULL) {
+        stream = guac_user_alloc_stream(user);
+        socket = user->socket;
+    }
+
+    else {
+        stream = guac_client_alloc_stream(copilot->client);
+        socket = copilot->client->socket;
+    }
+
+    guac_protocol_send_pipe(socket, stream, "text/plain",
+            GUAC_COPILOT_SUGGESTION_STREAM);
+
+    return stream;
+
+}
+
+/**
+ * Sends the given suggestion text over a pipe stream previously opened with
+ * guac_copilot_open_suggestions(). The query_lock of the copilot must be
+ * held.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param user
+ *     The user that should receive the suggestions, or NULL if the
+ *     suggestions should be sent to all users.
+ *
+ * @param stream
+ *     The stream to send the suggestion text over.
+ *
+ * @param text
+ *     The suggestion text to send.
+ *
+ * @param length
+ *     The length of the suggestion text, in bytes.
+ */
+static void guac_copilot_send_suggestions(guac_copilot* copilot,
+        guac_user* user, guac_stream* stream, const char* text, int length) {
+
+    guac_socket* socket = user != NULL
+            ? user->socket : copilot->client->socket;
+
+    guac_protocol_send_blobs(socket, stream, text, length);
+    guac_socket_flush(socket);
+
+}
+
+/**
+ * Ends and frees a pipe stream previously opened with
+ * guac_copilot_open_suggestions(). The query_lock of the copilot must be
+ * held.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param user
+ *     The user that received the suggestions, or NULL if the suggestions
+ *     were sent to all users.
+ *
+ * @param stream
+ *     The stream to end.
+ */
+static void guac_copilot_close_suggestions(guac_copilot* copilot,
+        guac_user* user, guac_stream* stream) {
+
+    if (user != NULL) {
+        guac_protocol_send_end(user->socket, stream);
+        guac_socket_flush(user->socket);
+        guac_user_free_stream(user, stream);
+    }
+
+    else {
+        guac_protocol_send_end(copilot->client->socket, stream);
+        guac_socket_flush(copilot->client->socket);
+        guac_client_free_stream(copilot->client, stream);
+    }
+
+}
+
+/**
+ * Sends all suggestion text buffered within the given query to its
+ * recipient as blobs of the query's pipe stream, opening that stream if
+ * necessary. If the query has been cancelled, the buffered text is
+ * discarded.
+ *
+ * @param query
+ *     The query whose buffered suggestion text should be sent.
+ */
+static void guac_copilot_query_flush(guac_copilot_query* query) {
+
+    if (query->output_length == 0)
+        return;
+
+    guac_copilot* copilot = query->copilot;
+
+    /* Send while holding the lock, such that a user cannot leave (and be
+     * freed) while their suggestions are being sent */
+    pthread_mutex_lock(&copilot->query_lock);
+
+    if (!query->cancelled) {
+
+        /* Open pipe stream on first suggestion */
+        if (query->stream == NULL)
+            query->stream = guac_copilot_open_suggestions(copilot,
+                    query->user);
+
+        guac_copilot_send_suggestions(copilot, query->user, query->stream,
+                query->output, query->output_length);
+
+    }
+
+    pthread_mutex_unlock(&copilot->query_lock);
+
+    query->output_length = 0;
+
+}
+
+/**
+ * Appends a single character of generated text to the suggestions of the
+ * given query, omitting leading whitespace and empty lines, and ignoring
+ * all text beyond the maximum number of suggestions.
+ *
+ * @param query
+ *     The query that received the character.
+ *
+ * @param c
+ *     The character received.
+ */
+static void guac_copilot_query_append(guac_copilot_query* query, char c) {
+
+    if (query->suggestion_count >= query->max_suggestions)
+        return;
+
+    /* Each line of generated text is a separate suggestion */
+    if (c == '\n') {
+
+        if (query->suggestion_length == 0)
+            return;
+
+        query->suggestion_count++;
+        query->suggestion_length = 0;
+
+    }
+
+    /* Skip leading whitespace */
+    else if (query->suggestion_length == 0 && (c == ' ' || c == '\t'
+                || c == '\r'))
+        return;
+
+    else
+        query->suggestion_length++;
+
+    if (query->output_length == sizeof(query->output))
+        guac_copilot_query_flush(query);
+
+    query->output[query->output_length++] = c;
+
+    /* Retain all text for caching */
+    if (query->text_length < (int) sizeof(query->text))
+        query->text[query->text_length++] = c;
+    else
+        query->text_overflow = 1;
+
+}
+
+/**
+ * Parses a single complete line of the server-sent event stream received
+ * for the given query, appending any generated text that it contains to the
+ * query's suggestions. Lines which are not events containing generated text
+ * are ignored.
+ *
+ * @param query
+ *     The query that received the line.
+ *
+ * @param line
+ *     The received line, without its line terminator. This need not be
+ *     null-terminated.
+ *
+ * @param length
+ *     The length of the line, in bytes.
+ */
+static void guac_copilot_query_parse_event(guac_copilot_query* query,
+        const char* line, int length) {
+
+    static const char data_field[] = "data:";
+    static const char content_field[] = "\"content\":";
+
+    /* Only "data" fields contain generated text */
+    if (length < (int) sizeof(data_field) - 1
+            || memcmp(line, data_field, sizeof(data_field) - 1) != 0)
+        return;
+
+    const char* end = line + length;
+
+    /* Locate content of the delta within the event */
+    const char* current = line;
+    for (;;) {
+
+        if (end - current < (int) sizeof(content_field) - 1)
+            return;
+
+        if (memcmp(current, content_field, sizeof(content_field) - 1) == 0)
+            break;
+
+        current++;
+
+    }
+
+    current += sizeof(content_field) - 1;
+    while (current < end && *current == ' ')
+        current++;
+
+    /* Content may be null, which contains no text */
+    if (current == end || *current != '"')
+        return;
+
+    /* Append unescaped content up to closing quote */
+    for (current++; current < end && *current != '"'; current++) {
+
+        if (*current != '\\') {
+            guac_copilot_query_append(query, *current);
+            continue;
+        }
+
+        if (++current == end)
+            return;
+
+        switch (*current) {
+            case 'n': guac_copilot_query_append(query, '\n'); break;
+            case 'r': guac_copilot_query_append(query, '\r'); break;
+            case 't': guac_copilot_query_append(query, '\t'); break;
+
+            /* Non-ASCII escapes are not meaningful within commands */
+            case 'u':
+                current += (end - current > 4) ? 4 : end - current - 1;
+                guac_copilot_query_append(query, '?');
+                break;
+
+            default: guac_copilot_query_append(query, *current); break;
+        }
+
+    }
+
+}
+
+/**
+ * Callback for libcurl which receives the server-sent event stream of a
+ * query, sending suggestions to the query's recipient as soon as each
+ * fragment of generated text arrives.
+ */
+static size_t guac_copilot_query_write_callback(char* contents, size_t size,
+        size_t nmemb, void* userp) {
+
+    guac_copilot_query* query = (guac_copilot_query*) userp;
+    size_t length = size * nmemb;
+
+    /* The body of an unsuccessful response is an error, not an event
+     * stream, and is ignored */
+    long http_code = 0;
+    curl_easy_getinfo(query->curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (http_code != 200)
+        return length;
+
+    for (size_t i = 0; i < length; i++) {
+
+        char c = contents[i];
+
+        /* Parse each line as soon as it is complete */
+        if (c == '\n') {
+            if (!query->event_overflow)
+                guac_copilot_query_parse_event(query, query->event,
+                        query->event_length);
+            query->event_length = 0;
+            query->event_overflow = 0;
+        }
+
+        else if (query->event_length < (int) sizeof(query->event))
+            query->event[query->event_length++] = c;
+
+        else
+            query->event_overflow = 1;
+
+    }
+
+    /* Send everything received now, without waiting for whole suggestions */
+    guac_copilot_query_flush(query);
+
+    return length;
+
+}
+
+/**
+ * Appends the given string to the given buffer, trimming leading and
+ * trailing whitespace and collapsing each run of whitespace into a single
+ * space, such that insignificant differences in whitespace do not affect
+ * the result.
+ *
+ * @param buffer
+ *     The buffer to append to.
+ *
+ * @param size
+ *     The size of the buffer, in bytes.
+ *
+ * @param length
+ *     Pointer to the current length of the contents of the buffer, which
+ *     will be updated as the string is appended. If the string does not fit,
+ *     this is set to the size of the buffer.
+ *
+ * @param str
+ *     The string to append, or NULL to append nothing.
+ */
+static void guac_copilot_append_normalized(char* buffer, int size,
+        int* length, const char* str) {
+
+    int pending_space = 0;
+
+    for (const char* current = str; current != NULL && *current != '\0';
+            current++) {
+
+        char c = *current;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            pending_space = 1;
+            continue;
+        }
+
+        /* Whitespace is significant only between other characters */
+        if (pending_space && *length > 0 && buffer[*length - 1] != '\n') {
+            if (*length >= size - 1)
+                goto overflow;
+            buffer[(*length)++] = ' ';
+        }
+
+        pending_space = 0;
+
+        if (*length >= size - 1)
+            goto overflow;
+
+        buffer[(*length)++] = c;
+
+    }
+
+    buffer[*length] = '\0';
+    return;
+
+overflow:
+    *length = size;
+
+}
+
+/**
+ * Builds the suggestion cache key for the given input within the current
+ * context of the given copilot. The key includes the protocol, operating
+ * system, the most recent commands, and the input, each normalized with
+ * guac_copilot_append_normalized().
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param input
+ *     Partial input from the user (can be NULL).
+ *
+ * @param max_suggestions
+ *     Maximum number of suggestions to request.
+ *
+ * @return
+ *     A newly-allocated string containing the cache key, which must
+ *     eventually be freed with guac_mem_free(), or NULL if the context is
+ *     too large to be cached.
+ */
+static char* guac_copilot_cache_key(guac_copilot* copilot,
+        const char* input, int max_suggestions) {
+
+    guac_copilot_context* ctx = copilot->context;
+
+    char key[2048];
+    int length = snprintf(key, sizeof(key), "%d\n", max_suggestions);
+
+    guac_copilot_append_normalized(key, sizeof(key), &length, ctx->protocol);
+
+    if (length < (int) sizeof(key) - 1)
+        key[length++] = '\n';
+    guac_copilot_append_normalized(key, sizeof(key), &length, ctx->os_type);
+
+    /* Include the same recent commands as the prompt */
+    int cmd_start = (ctx->command_count > 3) ? ctx->command_count - 3 : 0;
+    for (int i = cmd_start; i < ctx->command_count; i++) {
+        if (length < (int) sizeof(key) - 1)
+            key[length++] = '\n';
+        guac_copilot_append_normalized(key, sizeof(key), &length,
+                guac_copilot_get_command(ctx, i));
+    }
+
+    if (length < (int) sizeof(key) - 1)
+        key[length++] = '\n';
+    guac_copilot_append_normalized(key, sizeof(key), &length, input);
+
+    if (length >= (int) sizeof(key) - 1)
+        return NULL;
+
+    key[length] = '\0';
+    return guac_strdup(key);
+
+}
+
+/**
+ * Frees the contents of the given suggestion cache entry, marking the entry
+ * as unused.
+ *
+ * @param entry
+ *     The entry to clear.
+ */
+static void guac_copilot_cache_clear(guac_copilot_cache_entry* entry) {
+    guac_mem_free(entry->key);
+    guac_mem_free(entry->suggestions);
+}
+
+/**
+ * Returns the suggestion cache entry having the given key, if any. Entries
+ * which have expired are removed rather than returned. The query_lock of the
+ * copilot must be held.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param key
+ *     The key of the entry to return.
+ *
+ * @return
+ *     The matching entry, or NULL if no unexpired entry has the given key.
+ */
+static guac_copilot_cache_entry* guac_copilot_cache_lookup(
+        guac_copilot* copilot, const char* key) {
+
+    guac_timestamp now = guac_timestamp_current();
+
+    for (int i = 0; i < GUAC_COPILOT_CACHE_SIZE; i++) {
+
+        guac_copilot_cache_entry* entry = &copilot->suggestion_cache[i];
+        if (entry->key == NULL || strcmp(entry->key, key) != 0)
+            continue;
+
+        if (now - entry->created > GUAC_COPILOT_CACHE_DURATION) {
+            guac_copilot_cache_clear(entry);
+            return NULL;
+        }
+
+        entry->last_used = now;
+        return entry;
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Stores the given suggestions within the suggestion cache, replacing any
+ * existing entry having the same key, or otherwise the least-recently-used
+ * entry. The query_lock of the copilot must be held.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param key
+ *     The key of the suggestions, as returned by guac_copilot_cache_key().
+ *
+ * @param suggestions
+ *     The suggestion text. This need not be null-terminated.
+ *
+ * @param length
+ *     The length of the suggestion text, in bytes.
+ */
+static void guac_copilot_cache_store(guac_copilot* copilot, const char* key,
+        const char* suggestions, int length) {
+
+    guac_copilot_cache_entry* oldest = &copilot->suggestion_cache[0];
+
+    for (int i = 0; i < GUAC_COPILOT_CACHE_SIZE; i++) {
+
+        guac_copilot_cache_entry* entry = &copilot->suggestion_cache[i];
+
+        /* Prefer unused entries and entries for the same key */
+        if (entry->key == NULL || strcmp(entry->key, key) == 0) {
+            oldest = entry;
+            break;
+        }
+
+        if (entry->last_used < oldest->last_used)
+            oldest = entry;
+
+    }
+
+    guac_copilot_cache_clear(oldest);
+
+    oldest->key = guac_strdup(key);
+    oldest->suggestions = guac_mem_alloc(length + 1);
+    memcpy(oldest->suggestions, suggestions, length);
+    oldest->suggestions[length] = '\0';
+
+    oldest->created = oldest->last_used = guac_timestamp_current();
+
+}
+
+/**
+ * Handles a query which has been completed by the curl multi handle of the
+ * query thread, terminating its pipe stream unless cancelled and freeing the
+ * query.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param multi
+ *     The curl multi handle of the query thread.
+ *
+ * @param curl
+ *     The curl handle of the completed query.
+ *
+ * @param res
+ *     The result of performing the query.
+ */
+static void guac_copilot_complete_query(guac_copilot* copilot, CURLM* multi,
+        CURL* curl, CURLcode res) {
+
+    guac_copilot_query* query = NULL;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**) &query);
+    curl_multi_remove_handle(multi, curl);
+
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+    if (res != CURLE_OK)
+        guac_client_log(copilot->client, GUAC_LOG_ERROR,
+                "OpenAI API request failed: %s", curl_easy_strerror(res));
+
+    else if (http_code != 200)
+        guac_client_log(copilot->client, GUAC_LOG_ERROR,
+                "OpenAI API returned error. HTTP code: %ld", http_code);
+
+    else
+        guac_client_log(copilot->client, GUAC_LOG_DEBUG,
+                "OpenAI provided %d suggestions", query->suggestion_count
+                + (query->suggestion_length > 0 ? 1 : 0));
+
+    pthread_mutex_lock(&copilot->query_lock);
+
+    /* Remove from list of active queries */
+    guac_copilot_query** current = &copilot->active_queries;
+    while (*current != query)
+        current = &(*current)->next;
+    *current = query->next;
+
+    /* Terminate pipe stream, if any suggestions were sent */
+    if (!query->cancelled && query->stream != NULL)
+        guac_copilot_close_suggestions(copilot, query->user, query->stream);
+
+    /* Cache complete suggestions for later identical requests */
+    if (res == CURLE_OK && http_code == 200 && query->cache_key != NULL
+            && query->text_length > 0 && !query->text_overflow) {
+        guac_copilot_cache_store(copilot, query->cache_key, query->text,
+                query->text_length);
+    }
+
+    pthread_mutex_unlock(&copilot->query_lock);
+
+    guac_copilot_query_free(query);
+
+}
+
+/**
+ * Starts all newly-submitted queries, and stops and frees all cancelled
+ * queries. The query_lock of the copilot must be held.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param multi
+ *     The curl multi handle of the query thread.
+ */
+static void guac_copilot_update_queries(guac_copilot* copilot, CURLM* multi) {
+
+    /* Stop and free any cancelled active queries */
+    guac_copilot_query** current = &copilot->active_queries;
+    while (*current != NULL) {
+
+        guac_copilot_query* query = *current;
+        if (!query->cancelled) {
+            current = &query->next;
+            continue;
+        }
+
+        *current = query->next;
+        curl_multi_remove_handle(multi, query->curl);
+        guac_copilot_query_free(query);
+
+    }
+
+    /* Start all pending queries that have not been cancelled */
+    guac_copilot_query* query = copilot->pending_queries;
+    copilot->pending_queries = NULL;
+
+    while (query != NULL) {
+
+        guac_copilot_query* next = query->next;
+
+        if (!query->cancelled)
+            query->curl = curl_easy_init();
+
+        if (query->curl == NULL) {
+            if (!query->cancelled)
+                guac_client_log(copilot->client, GUAC_LOG_ERROR,
+                        "Failed to initialize curl for OpenAI API");
+            guac_copilot_query_free(query);
+            query = next;
+            continue;
+        }
+
+        query->headers = guac_copilot_setup_request(query->curl,
+                copilot->ai_api_key, &query->payload,
+                guac_copilot_query_write_callback, query);
+        curl_easy_setopt(query->curl, CURLOPT_PRIVATE, query);
+
+        /* Wait for an existing connection to become available for
+         * multiplexing rather than opening another */
+        curl_easy_setopt(query->curl, CURLOPT_PIPEWAIT, 1L);
+
+        curl_multi_add_handle(multi, query->curl);
+        query->next = copilot->active_queries;
+        copilot->active_queries = query;
+
+        query = next;
+
+    }
+
+}
+
+/**
+ * The copilot query thread, performing all AI queries concurrently through a
+ * single curl multi handle. Connections to the AI service are cached by the
+ * multi handle and reused by later queries, avoiding a new TCP and TLS
+ * handshake per query.
+ *
+ * @param data
+ *     The guac_copilot whose queries should be performed.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_copilot_query_thread(void* data) {
+
+    guac_copilot* copilot = (guac_copilot*) data;
+
+    CURLM* multi = curl_multi_init();
+    if (multi == NULL) {
+        guac_client_log(copilot->client, GUAC_LOG_ERROR,
+                "Failed to initialize curl for OpenAI API");
+        return NULL;
+    }
+
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, (long) CURLPIPE_MULTIPLEX);
+
+    for (;;) {
+
+        pthread_mutex_lock(&copilot->query_lock);
+
+        if (copilot->query_thread_stopping) {
+            pthread_mutex_unlock(&copilot->query_lock);
+            break;
+        }
+
+        guac_copilot_update_queries(copilot, multi);
+        pthread_mutex_unlock(&copilot->query_lock);
+
+        /* Transfer any available data */
+        int running;
+        curl_multi_perform(multi, &running);
+
+        /* Deliver results of all completed queries */
+        int remaining;
+        CURLMsg* msg;
+        while ((msg = curl_multi_info_read(multi, &remaining)) != NULL) {
+            if (msg->msg == CURLMSG_DONE)
+                guac_copilot_complete_query(copilot, multi,
+                        msg->easy_handle, msg->data.result);
+        }
+
+        /* Wait for network activity or for queries to be submitted or
+         * cancelled */
+        struct curl_waitfd wake = {
+            .fd = copilot->query_wake_fd[0],
+            .events = CURL_WAIT_POLLIN
+        };
+
+        curl_multi_wait(multi, &wake, 1, GUAC_COPILOT_QUERY_WAIT_TIMEOUT,
+                NULL);
+
+        /* Consume all pending wakeups */
+        if (wake.revents) {
+            char buffer[64];
+            while (read(copilot->query_wake_fd[0], buffer, sizeof(buffer)) > 0);
+        }
+
+    }
+
+    /* Abandon all queries which have not yet completed */
+    pthread_mutex_lock(&copilot->query_lock);
+
+    guac_copilot_query* query = copilot->active_queries;
+    while (query != NULL) {
+        guac_copilot_query* next = query->next;
+        curl_multi_remove_handle(multi, query->curl);
+        guac_copilot_query_free(query);
+        query = next;
+    }
+
+    copilot->active_queries = NULL;
+    pthread_mutex_unlock(&copilot->query_lock);
+
+    curl_multi_cleanup(multi);
+    return NULL;
+
+}
+
+/**
+ * Starts the query thread of the given copilot, if not already running. The
+ * query_lock of the copilot must be held.
+ *
+ * @param copilot
+ *     The copilot whose query thread should be started.
+ *
+ * @return
+ *     Zero if the query thread is running, non-zero if the query thread
+ *     could not be started.
+ */
+static int guac_copilot_start_queries(guac_copilot* copilot) {
+
+    if (copilot->query_thread_started)
+        return 0;
+
+    if (copilot->query_thread_stopping)
+        return 1;
+
+    /* Create non-blocking pipe for waking the query thread */
+    if (pipe(copilot->query_wake_fd)) {
+        guac_client_log(copilot->client, GUAC_LOG_ERROR,
+                "Unable to create pipe for copilot queries.");
+        copilot->query_wake_fd[0] = -1;
+        copilot->query_wake_fd[1] = -1;
+        return 1;
+    }
+
+    fcntl(copilot->query_wake_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(copilot->query_wake_fd[1], F_SETFL, O_NONBLOCK);
+
+    if (pthread_create(&copilot->query_thread, NULL,
+                guac_copilot_query_thread, copilot)) {
+        guac_client_log(copilot->client, GUAC_LOG_ERROR,
+                "Unable to start copilot query thread.");
+        close(copilot->query_wake_fd[0]);
+        close(copilot->query_wake_fd[1]);
+        copilot->query_wake_fd[0] = -1;
+        copilot->query_wake_fd[1] = -1;
+        return 1;
+    }
+
+    copilot->query_thread_started = 1;
+    return 0;
+
+}
+
+static void guac_copilot_stop_queries(guac_copilot* copilot) {
+
+    pthread_mutex_lock(&copilot->query_lock);
+    copilot->query_thread_stopping = 1;
+    guac_copilot_wake_queries(copilot);
+    int started = copilot->query_thread_started;
+    pthread_mutex_unlock(&copilot->query_lock);
+
+    if (started)
+        pthread_join(copilot->query_thread, NULL);
+
+    /* Free any queries which were never started */
+    guac_copilot_query* query = copilot->pending_queries;
+    while (query != NULL) {
+        guac_copilot_query* next = query->next;
+        guac_copilot_query_free(query);
+        query = next;
+    }
+
+    copilot->pending_queries = NULL;
+
+    if (copilot->query_wake_fd[0] != -1)
+        close(copilot->query_wake_fd[0]);
+
+    if (copilot->query_wake_fd[1] != -1)
+        close(copilot->query_wake_fd[1]);
+
+}
+
+/**
+ * Appends the prompt sent to the AI service when requesting command
+ * suggestions to the given payload, describing the current context and
+ * recent command history. The prompt is escaped for JSON as it is appended,
+ * such that the payload must have been begun with
+ * guac_copilot_begin_payload().
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param input
+ *     Partial input from the user (can be NULL).
+ *
+ * @param max_suggestions
+ *     Maximum number of suggestions to request.
+ *
+ * @param payload
+ *     The buffer containing the payload to append the prompt to.
+ */
+static void guac_copilot_append_suggestion_prompt(guac_copilot* copilot,
+        const char* input, int max_suggestions, guac_copilot_buffer* payload) {
+
+    guac_copilot_context* ctx = copilot->context;
+
+    guac_copilot_buffer_append_string(payload, "User is in a ");
+    guac_copilot_buffer_append_json(payload,
+            ctx->protocol ? ctx->protocol : "remote");
+    guac_copilot_buffer_append_string(payload, " session on ");
+    guac_copilot_buffer_append_json(payload,
+            ctx->os_type ? ctx->os_type : "unknown OS");
+    guac_copilot_buffer_append_string(payload, ". Current directory: ");
+    guac_copilot_buffer_append_json(payload,
+            ctx->current_directory ? ctx->current_directory : "/");
+    guac_copilot_buffer_append_string(payload, ". Recent commands: ");
+
+    /* Add recent command history to prompt */
+    int cmd_start = (ctx->command_count > 3) ? ctx->command_count - 3 : 0;
+    for (int i = cmd_start; i < ctx->command_count; i++) {
+        guac_copilot_buffer_append_string(payload, "'");
+        guac_copilot_buffer_append_json(payload,
+                guac_copilot_get_command(ctx, i));
+        guac_copilot_buffer_append_string(payload, "', ");
+    }
+
+    /* Add the actual request */
+    guac_copilot_buffer_append_string(payload, ". User typed: '");
+    guac_copilot_buffer_append_json(payload, input);
+    guac_copilot_buffer_append_string(payload, "'. Suggest ");
+    guac_copilot_buffer_append_int(payload, max_suggestions);
+    guac_copilot_buffer_append_string(payload, " relevant commands "
+            "(one per line, no explanations).");
+
+}
+
+int guac_copilot_suggest_commands_async(guac_copilot* copilot,
+        guac_user* user, const char* input, int max_suggestions) {
+
+    if (copilot == NULL || copilot->ai_api_key == NULL
+            || strlen(copilot->ai_api_key) == 0)
+        return -1;
+
+    guac_copilot_process_keystrokes(copilot);
+
+    char* cache_key = guac_copilot_cache_key(copilot, input, max_suggestions);
+
+    /* Send suggestions directly from the cache, if available */
+    if (cache_key != NULL) {
+
+        pthread_mutex_lock(&copilot->query_lock);
+
+        guac_copilot_cache_entry* entry = guac_copilot_cache_lookup(copilot,
+                cache_key);
+
+        if (entry != NULL) {
+            guac_stream* stream = guac_copilot_open_suggestions(copilot,
+                    user);
+            guac_copilot_send_suggestions(copilot, user, stream,
+                    entry->suggestions, strlen(entry->suggestions));
+            guac_copilot_close_suggestions(copilot, user, stream);
+        }
+
+        pthread_mutex_unlock(&copilot->query_lock);
+
+        if (entry != NULL) {
+            guac_client_log(copilot->client, GUAC_LOG_DEBUG,
+                    "Copilot suggestions sent from cache");
+            guac_mem_free(cache_key);
+            return 1;
+        }
+
+    }
+
+    guac_copilot_query* query = guac_mem_zalloc(sizeof(guac_copilot_query));
+    query->copilot = copilot;
+    query->user = user;
+    query->max_suggestions = max_suggestions;
+
+    /* Build the prompt directly within the request payload */
+    guac_copilot_begin_payload(copilot, &query->payload, 1);
+    guac_copilot_append_suggestion_prompt(copilot, input, max_suggestions,
+            &query->payload);
+    guac_copilot_end_payload(&query->payload);
+
+    query->cache_key = cache_key;
+
+    pthread_mutex_lock(&copilot->query_lock);
+
+    if (guac_copilot_start_queries(copilot)) {
+        pthread_mutex_unlock(&copilot->query_lock);
+        guac_copilot_query_free(query);
+        return -1;
+    }
+
+    /* Append to end of pending queries, preserving submission order */
+    guac_copilot_query** current = &copilot->pending_queries;
+    while (*current != NULL)
+        current = &(*current)->next;
+    *current = query;
+
+    guac_copilot_wake_queries(copilot);
+    pthread_mutex_unlock(&copilot->query_lock);
+
+    guac_client_log(copilot->client, GUAC_LOG_DEBUG,
+            "Querying OpenAI API for copilot suggestions");
+
+    return 0;
+
+}
+
+void guac_copilot_cancel_queries(guac_copilot* copilot, guac_user* user) {
+
+    if (copilot == NULL)
+        return;
+
+    pthread_mutex_lock(&copilot->query_lock);
+
+    for (guac_copilot_query* query = copilot->pending_queries;
+            query != NULL; query = query->next) {
+        if (query->user == user)
+            query->cancelled = 1;
+    }
+
+    for (guac_copilot_query* query = copilot->active_queries;
+            query != NULL; query = query->next) {
+        if (query->user == user)
+            query->cancelled = 1;
+    }
+
+    guac_copilot_wake_queries(copilot);
+    pthread_mutex_unlock(&copilot->query_lock);
+
+}
+
+#else
+
+/* Fallback implementation when libcurl is not available */
+int guac_copilot_query_openai(guac_copilot* copilot, const char* api_key,
+        const char* prompt, char* response_buffer, int buffer_size) {
+
+    if (copilot == NULL || response_buffer == NULL || buffer_size <= 0)
+        return -1;
+
+    guac_client_log(copilot->client, GUAC_LOG_WARNING,
+            "OpenAI integration is not available. libcurl was not found during build.");
+
+    snprintf(response_buffer, buffer_size,
+            "Error: OpenAI integration requires libcurl");
+
+    return -1;
+}
+
+int guac_copilot_suggest_commands_async(guac_copilot* copilot,
+        guac_user* user, const char* input, int max_suggestions) {
+
+    /* Without libcurl, only local suggestions are available */
+    return -1;
+
+}
+
+void guac_copilot_cancel_queries(guac_copilot* copilot, guac_user* user) {
+    /* No queries are ever submitted without libcurl */
+}
+
+static void guac_copilot_stop_queries(guac_copilot* copilot) {
+    /* No query thread is ever started without libcurl */
 }
 
 #endif
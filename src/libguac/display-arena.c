@@ -0,0 +1,137 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "display-priv.h"
+#include "guacamole/mem.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Rounds the given size up to the nearest multiple of the given power of
+ * two, aborting the process if doing so would overflow.
+ *
+ * @param size
+ *     The size to round.
+ *
+ * @param multiple
+ *     The power of two to round to.
+ *
+ * @return
+ *     The smallest multiple of the given power of two that is not less than
+ *     the given size.
+ */
+static size_t guac_display_arena_round_up(size_t size, size_t multiple) {
+    return guac_mem_ckd_add_or_die(size, multiple - 1) & ~(multiple - 1);
+}
+
+/**
+ * The size of the header of each guac_display_arena_chunk, rounded up such
+ * that the memory following the header remains suitably aligned.
+ */
+#define GUAC_DISPLAY_ARENA_CHUNK_HEADER_SIZE                                 \
+    ((sizeof(guac_display_arena_chunk) + GUAC_DISPLAY_ARENA_ALIGNMENT - 1)   \
+     & ~((size_t) GUAC_DISPLAY_ARENA_ALIGNMENT - 1))
+
+void guac_display_arena_init(guac_display_arena* arena) {
+    *arena = (guac_display_arena) { 0 };
+}
+
+void* guac_display_arena_alloc(guac_display_arena* arena, size_t count, size_t size) {
+
+    size_t length = guac_display_arena_round_up(
+            guac_mem_ckd_mul_or_die(count, size),
+            GUAC_DISPLAY_ARENA_ALIGNMENT);
+
+    arena->requested = guac_mem_ckd_add_or_die(arena->requested, length);
+
+    /* Satisfy from the primary block wherever possible */
+    if (length <= arena->size - arena->used) {
+        void* memory = arena->block + arena->used;
+        arena->used += length;
+        return memory;
+    }
+
+    /* Otherwise, fall back to a separate chunk that will be folded into the
+     * primary block at the next reset */
+    guac_display_arena_chunk* chunk = guac_mem_alloc(
+            guac_mem_ckd_add_or_die(GUAC_DISPLAY_ARENA_CHUNK_HEADER_SIZE, length));
+
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->allocations++;
+
+    return ((unsigned char*) chunk) + GUAC_DISPLAY_ARENA_CHUNK_HEADER_SIZE;
+
+}
+
+/**
+ * Frees all chunks allocated by the given arena since it was last reset.
+ *
+ * @param arena
+ *     The guac_display_arena whose chunks should be freed.
+ */
+static void guac_display_arena_free_chunks(guac_display_arena* arena) {
+
+    guac_display_arena_chunk* current = arena->chunks;
+    while (current != NULL) {
+        guac_display_arena_chunk* next = current->next;
+        guac_mem_free(current);
+        current = next;
+    }
+
+    arena->chunks = NULL;
+
+}
+
+void guac_display_arena_reset(guac_display_arena* arena) {
+
+    if (arena->requested > arena->high_water)
+        arena->high_water = arena->requested;
+
+    /* Grow the primary block to fit everything that was allocated if chunks
+     * were needed */
+    if (arena->chunks != NULL) {
+
+        guac_display_arena_free_chunks(arena);
+
+        /* NOTE: The contents of the old block need not be preserved, hence
+         * the free followed by a fresh allocation rather than a realloc */
+        guac_mem_free(arena->block);
+        arena->size = guac_display_arena_round_up(arena->high_water,
+                GUAC_DISPLAY_ARENA_GRANULARITY);
+        arena->block = guac_mem_alloc(arena->size);
+        arena->allocations++;
+
+    }
+
+    arena->used = 0;
+    arena->requested = 0;
+
+}
+
+void guac_display_arena_destroy(guac_display_arena* arena) {
+    guac_display_arena_free_chunks(arena);
+    guac_mem_free(arena->block);
+    arena->size = 0;
+    arena->used = 0;
+    arena->requested = 0;
+}
@@ -0,0 +1,299 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "display-plan.h"
+#include "display-priv.h"
+#include "encode-context.h"
+#include "guacamole/client.h"
+#include "guacamole/display.h"
+#include "guacamole/layer.h"
+#include "guacamole/protocol.h"
+#include "guacamole/rect.h"
+#include "guacamole/socket.h"
+
+#include <cairo/cairo.h>
+#include <string.h>
+
+/**
+ * Returns whether the given image operation may be packed into an atlas.
+ * Only small operations are packed, and only for opaque layers, as atlases
+ * are copied to their destinations without first clearing those
+ * destinations. Operations on layers that are streaming video are never
+ * packed, as the worker sending each such operation must be able to either
+ * fold the change into the video stream or end that stream.
+ *
+ * @param op
+ *     The image operation to test.
+ *
+ * @return
+ *     Non-zero if the operation may be packed into an atlas, zero otherwise.
+ */
+static int guac_display_atlas_is_eligible(const guac_display_plan_operation* op) {
+
+    guac_display_layer* layer = op->layer;
+
+    /* NOTE: The video session of a layer is otherwise only modified by the
+     * worker threads, none of which are active while atlases are packed */
+    return op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG
+        && layer->opaque
+        && layer->video.session == NULL
+        && guac_rect_width(&op->dest) <= GUAC_DISPLAY_ATLAS_MAX_OP_SIZE
+        && guac_rect_height(&op->dest) <= GUAC_DISPLAY_ATLAS_MAX_OP_SIZE;
+
+}
+
+/**
+ * Resets the given atlas such that it contains no entries.
+ *
+ * @param atlas
+ *     The atlas to reset.
+ */
+static void guac_display_atlas_reset(guac_display_atlas* atlas) {
+    atlas->width = 0;
+    atlas->height = 0;
+    atlas->shelf_x = 0;
+    atlas->shelf_y = 0;
+    atlas->shelf_height = 0;
+    atlas->count = 0;
+}
+
+/**
+ * Attempts to add the given image operation to the given atlas. Entries are
+ * placed left to right along horizontal shelves, with a new shelf started
+ * beneath the tallest entry of the current shelf whenever the current shelf
+ * is full.
+ *
+ * @param atlas
+ *     The atlas that should receive the image operation.
+ *
+ * @param op
+ *     The image operation to add.
+ *
+ * @return
+ *     Zero if the operation was added, non-zero if the atlas has no room for
+ *     the operation.
+ */
+static int guac_display_atlas_add(guac_display_atlas* atlas,
+        const guac_display_plan_operation* op) {
+
+    if (atlas->count >= GUAC_DISPLAY_ATLAS_MAX_ENTRIES)
+        return 1;
+
+    int width = guac_rect_width(&op->dest);
+    int height = guac_rect_height(&op->dest);
+
+    /* Start a new shelf if the current shelf is full */
+    if (atlas->shelf_x + width > GUAC_DISPLAY_ATLAS_WIDTH) {
+        atlas->shelf_y += atlas->shelf_height;
+        atlas->shelf_x = 0;
+        atlas->shelf_height = 0;
+    }
+
+    if (atlas->shelf_y + height > GUAC_DISPLAY_ATLAS_HEIGHT)
+        return 1;
+
+    guac_display_atlas_entry* entry = &atlas->entries[atlas->count++];
+    entry->layer = op->layer;
+    entry->dest = op->dest;
+    entry->x = atlas->shelf_x;
+    entry->y = atlas->shelf_y;
+
+    atlas->shelf_x += width;
+    if (height > atlas->shelf_height)
+        atlas->shelf_height = height;
+
+    if (atlas->shelf_x > atlas->width)
+        atlas->width = atlas->shelf_x;
+
+    if (atlas->shelf_y + atlas->shelf_height > atlas->height)
+        atlas->height = atlas->shelf_y + atlas->shelf_height;
+
+    return 0;
+
+}
+
+unsigned int guac_display_atlas_pack(guac_display* display,
+        guac_display_plan_operation** ops, unsigned int count) {
+
+    display->atlas_count = 0;
+
+    unsigned int eligible = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        if (guac_display_atlas_is_eligible(ops[i]))
+            eligible++;
+    }
+
+    if (eligible < GUAC_DISPLAY_ATLAS_MIN_ENTRIES)
+        return count;
+
+    /* Spread eligible operations evenly across as many atlases as can be
+     * encoded in parallel */
+    int atlases = eligible / GUAC_DISPLAY_ATLAS_MIN_ENTRIES;
+    if (atlases > display->worker_thread_count)
+        atlases = display->worker_thread_count;
+    if (atlases > GUAC_DISPLAY_ATLAS_COUNT)
+        atlases = GUAC_DISPLAY_ATLAS_COUNT;
+    if (atlases < 1)
+        atlases = 1;
+
+    unsigned int per_atlas = (eligible + atlases - 1) / atlases;
+
+    for (int i = 0; i < atlases; i++)
+        guac_display_atlas_reset(&display->atlases[i]);
+
+    int current = 0;
+    unsigned int packed = 0;
+    unsigned int remaining = 0;
+
+    for (unsigned int i = 0; i < count; i++) {
+
+        guac_display_plan_operation* op = ops[i];
+
+        int added = 0;
+        if (guac_display_atlas_is_eligible(op)) {
+
+            /* Move on to the next atlas once the current atlas has its share
+             * of operations or has no more room */
+            while (current < atlases) {
+
+                guac_display_atlas* atlas = &display->atlases[current];
+                if (atlas->count < per_atlas && !guac_display_atlas_add(atlas, op)) {
+                    added = 1;
+                    break;
+                }
+
+                current++;
+
+            }
+
+        }
+
+        if (added)
+            packed++;
+        else
+            ops[remaining++] = op;
+
+    }
+
+    /* Atlases are filled in order, with only the last atlas possibly empty */
+    int used = current < atlases ? current + 1 : atlases;
+    if (used > 0 && display->atlases[used - 1].count == 0)
+        used--;
+
+    /* Client-side buffers are allocated only once actually needed, and are
+     * reused by all later frames */
+    for (int i = 0; i < used; i++) {
+        guac_display_atlas* atlas = &display->atlases[i];
+        if (atlas->buffer == NULL)
+            atlas->buffer = guac_client_alloc_buffer(display->client);
+    }
+
+    display->atlas_count = used;
+    guac_display_stats_record_atlases(display, used, packed);
+
+    return remaining;
+
+}
+
+void LFR_guac_display_atlas_send(guac_display* display,
+        guac_display_atlas* atlas, guac_stream* stream,
+        guac_encode_context* context) {
+
+    guac_socket* socket = display->client->socket;
+
+    size_t stride = (size_t) atlas->width * GUAC_DISPLAY_LAYER_RAW_BPP;
+    size_t size = stride * atlas->height;
+
+    context->atlas_pixels = guac_encode_context_reserve(context->atlas_pixels,
+            &context->atlas_pixels_size, size, 1);
+
+    /* Space between entries is cleared such that it compresses well and no
+     * stale image data from previous atlases is sent */
+    memset(context->atlas_pixels, 0, size);
+
+    /* Compose the image data of all entries into a single image */
+    for (int i = 0; i < atlas->count; i++) {
+
+        guac_display_atlas_entry* entry = &atlas->entries[i];
+        guac_display_layer* layer = entry->layer;
+
+        const unsigned char* src = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(
+                layer->last_frame, entry->dest);
+        unsigned char* dst = context->atlas_pixels
+            + entry->y * stride
+            + entry->x * GUAC_DISPLAY_LAYER_RAW_BPP;
+
+        size_t length = guac_rect_width(&entry->dest) * GUAC_DISPLAY_LAYER_RAW_BPP;
+        for (int y = entry->dest.top; y < entry->dest.bottom; y++) {
+            memcpy(dst, src, length);
+            src += layer->last_frame.buffer_stride;
+            dst += stride;
+        }
+
+    }
+
+    cairo_surface_t* surface = cairo_image_surface_create_for_data(
+            context->atlas_pixels, CAIRO_FORMAT_RGB24, atlas->width,
+            atlas->height, stride);
+
+    if (stream != NULL)
+        guac_display_send_image(display, socket, stream,
+                GUAC_DISPLAY_IMAGE_FORMAT_PNG, atlas->buffer, 0, 0, surface,
+                0, 0, context);
+    else
+        guac_display_stream_image(display, socket,
+                GUAC_DISPLAY_IMAGE_FORMAT_PNG, atlas->buffer, 0, 0, surface,
+                0, 0);
+
+    cairo_surface_destroy(surface);
+
+    /* Place each entry at its destination (the image above is fully drawn
+     * before any following instruction is applied by the client) */
+    for (int i = 0; i < atlas->count; i++) {
+
+        guac_display_atlas_entry* entry = &atlas->entries[i];
+        guac_display_layer* layer = entry->layer;
+
+        guac_protocol_send_copy(socket, atlas->buffer, entry->x, entry->y,
+                guac_rect_width(&entry->dest), guac_rect_height(&entry->dest),
+                GUAC_COMP_OVER, layer->layer, entry->dest.left,
+                entry->dest.top);
+
+        LFR_guac_display_layer_refinement_mark(layer, &entry->dest, 0);
+
+    }
+
+}
+
+void guac_display_atlas_destroy(guac_display* display) {
+
+    for (int i = 0; i < GUAC_DISPLAY_ATLAS_COUNT; i++) {
+
+        guac_display_atlas* atlas = &display->atlases[i];
+        if (atlas->buffer != NULL) {
+            guac_client_free_buffer(display->client, atlas->buffer);
+            atlas->buffer = NULL;
+        }
+
+    }
+
+    display->atlas_count = 0;
+
+}
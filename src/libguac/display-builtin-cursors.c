@@ -18,6 +18,7 @@
  */
 
 #include "display-builtin-cursors.h"
+#include "guacamole/display-types.h"
 
 /**
  * Opaque black. This macro evaluates to the 4 bytes of the single pixel of a
@@ -147,3 +148,10 @@ const guac_display_builtin_cursor guac_display_cursor_pointer = {
     .stride = 44
 
 };
+
+const guac_display_builtin_cursor* const guac_display_builtin_cursors[GUAC_DISPLAY_BUILTIN_CURSOR_COUNT] = {
+    [GUAC_DISPLAY_CURSOR_NONE]    = &guac_display_cursor_none,
+    [GUAC_DISPLAY_CURSOR_DOT]     = &guac_display_cursor_dot,
+    [GUAC_DISPLAY_CURSOR_IBAR]    = &guac_display_cursor_ibar,
+    [GUAC_DISPLAY_CURSOR_POINTER] = &guac_display_cursor_pointer
+};
@@ -22,6 +22,12 @@
 
 #include <unistd.h>
 
+/**
+ * The number of mouse cursor images built into libguac. There is exactly one
+ * built-in cursor for each value of the guac_display_cursor_type enum.
+ */
+#define GUAC_DISPLAY_BUILTIN_CURSOR_COUNT 4
+
 /**
  * Mouse cursor image that is built into libguac. Each actual instance of this
  * structure will correspond to a value within the guac_display_cursor_type
@@ -90,4 +96,10 @@ extern const guac_display_builtin_cursor guac_display_cursor_ibar;
  */
 extern const guac_display_builtin_cursor guac_display_cursor_pointer;
 
+/**
+ * All mouse cursor images built into libguac, indexed by their corresponding
+ * guac_display_cursor_type values.
+ */
+extern const guac_display_builtin_cursor* const guac_display_builtin_cursors[GUAC_DISPLAY_BUILTIN_CURSOR_COUNT];
+
 #endif
@@ -40,37 +40,52 @@ void guac_display_set_cursor_hotspot(guac_display* display, int x, int y) {
     guac_rwlock_release_lock(&display->pending_frame.lock);
 }
 
+void guac_display_set_cursor_buffer(guac_display* display,
+        guac_display_layer* buffer, int hotspot_x, int hotspot_y) {
+
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+
+    display->pending_frame.cursor_source = buffer;
+    display->pending_frame.cursor_source_modified = 1;
+    display->pending_frame.cursor_hotspot_x = hotspot_x;
+    display->pending_frame.cursor_hotspot_y = hotspot_y;
+
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+
+}
+
 void guac_display_set_cursor(guac_display* display,
         guac_display_cursor_type cursor_type) {
 
     /* Translate requested type into built-in cursor */
-    const guac_display_builtin_cursor* cursor;
     switch (cursor_type) {
 
         case GUAC_DISPLAY_CURSOR_NONE:
-            cursor = &guac_display_cursor_none;
-            break;
-
         case GUAC_DISPLAY_CURSOR_DOT:
-            cursor = &guac_display_cursor_dot;
-            break;
-
         case GUAC_DISPLAY_CURSOR_IBAR:
-            cursor = &guac_display_cursor_ibar;
+        case GUAC_DISPLAY_CURSOR_POINTER:
             break;
 
-        case GUAC_DISPLAY_CURSOR_POINTER:
         default:
-            cursor = &guac_display_cursor_pointer;
+            cursor_type = GUAC_DISPLAY_CURSOR_POINTER;
             break;
 
     }
 
-    /* Resize cursor to fit requested icon */
-    guac_display_layer* cursor_layer = guac_display_cursor(display);
+    const guac_display_builtin_cursor* cursor = guac_display_builtin_cursors[cursor_type];
+
+    /* Each built-in cursor has its own dedicated buffer, such that switching
+     * between built-in cursors need not resend any image data */
+    guac_display_layer* cursor_layer = display->builtin_cursor_buffers[cursor_type];
+    guac_display_set_cursor_buffer(display, cursor_layer,
+            cursor->hotspot_x, cursor->hotspot_y);
+
+    /* Resize buffer to fit requested icon */
     guac_display_layer_resize(cursor_layer, cursor->width, cursor->height);
 
-    /* Copy over graphical content of cursor icon ... */
+    /* Copy over graphical content of cursor icon. The buffer will already
+     * contain this content if the cursor has been set before, in which case
+     * the copy results in no changes being sent. */
 
     guac_display_layer_raw_context* context = guac_display_layer_open_raw(cursor_layer);
     GUAC_ASSERT(!cursor_layer->pending_frame.buffer_is_external);
@@ -85,9 +100,6 @@ void guac_display_set_cursor(guac_display* display,
         dst_cursor_row += context->stride;
     }
 
-    /* ... and cursor hotspot */
-    guac_display_set_cursor_hotspot(display, cursor->hotspot_x, cursor->hotspot_y);
-
     /* Update to cursor icon is now complete - notify display */
 
     context->dirty = (guac_rect) {
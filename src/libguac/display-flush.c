@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include "client-latency.h"
 #include "display-plan.h"
 #include "display-priv.h"
 #include "guacamole/assert.h"
@@ -28,27 +29,32 @@
 #include "guacamole/protocol.h"
 #include "guacamole/rect.h"
 #include "guacamole/rwlock.h"
+#include "guacamole/timestamp.h"
 #include "guacamole/user.h"
 
+#include <pthread.h>
+#include <stdint.h>
 #include <string.h>
 
 /**
  * Begins a section related to an optimization phase that should be tracked for
- * performance at the "trace" log level.
+ * performance at the "trace" log level and within the display statistics.
  */
 #define GUAC_DISPLAY_PLAN_BEGIN_PHASE()                                       \
     do {                                                                      \
-        guac_timestamp phase_start = guac_timestamp_current();
+        uint64_t phase_start = guac_display_stats_clock();
 
 /**
  * Ends a section related to an optimization phase that should be tracked for
- * performance at the "trace" log level.
+ * performance at the "trace" log level and within the display statistics.
  *
  * @param display
  *     The guac_display related to the optimizations being performed.
  *
  * @param phase
- *     A human-readable name for the optimization phase being tracked.
+ *     The name of the optimization phase being tracked, as a bare token. The
+ *     time spent is added to the member of guac_display_stats having this
+ *     name followed by "_time".
  *
  * @param n
  *     The ordinal number of this phase relative to other phases, where the
@@ -58,10 +64,13 @@
  *     The total number of optimization phases.
  */
 #define GUAC_DISPLAY_PLAN_END_PHASE(display, phase, n, total)                 \
-        guac_timestamp phase_end = guac_timestamp_current();                  \
+        uint64_t phase_time = guac_display_stats_clock() - phase_start;       \
         guac_client_log(display->client, GUAC_LOG_TRACE, "Render planning "   \
-                "phase %i/%i (%s): %ims", n, total, phase,                    \
-                (int) (phase_end - phase_start));                             \
+                "phase %i/%i (%s): %ims", n, total, #phase,                   \
+                (int) (phase_time / 1000));                                   \
+        pthread_mutex_lock(&display->stats_lock);                             \
+        display->stats.phase##_time += phase_time;                            \
+        pthread_mutex_unlock(&display->stats_lock);                           \
     } while (0)
 
 void guac_display_end_frame(guac_display* display) {
@@ -96,6 +105,44 @@ static void* LFR_guac_display_broadcast_cursor_state(guac_user* user, void* data
 
 }
 
+/**
+ * Fills with black any area of the given layer that is being added by a
+ * change in size between the last and pending frames. If the layer has never
+ * been filled, its entire area is filled. The layer must be opaque.
+ *
+ * @param layer
+ *     The layer being resized.
+ */
+static void LFW_guac_display_layer_fill_added_area(guac_display_layer* layer) {
+
+    guac_socket* socket = layer->display->client->socket;
+
+    int old_width = layer->last_frame_filled ? layer->last_frame.width : 0;
+    int old_height = layer->last_frame_filled ? layer->last_frame.height : 0;
+    int new_width = layer->pending_frame.width;
+    int new_height = layer->pending_frame.height;
+
+    /* Area to the right of the old area, covering the full new height */
+    if (new_width > old_width) {
+        guac_protocol_send_rect(socket, layer->layer, old_width, 0,
+                new_width - old_width, new_height);
+        guac_protocol_send_cfill(socket, GUAC_COMP_OVER, layer->layer,
+                0x00, 0x00, 0x00, 0xFF);
+    }
+
+    /* Area below the old area, excluding anything already filled above */
+    int width = new_width < old_width ? new_width : old_width;
+    if (new_height > old_height && width > 0) {
+        guac_protocol_send_rect(socket, layer->layer, 0, old_height,
+                width, new_height - old_height);
+        guac_protocol_send_cfill(socket, GUAC_COMP_OVER, layer->layer,
+                0x00, 0x00, 0x00, 0xFF);
+    }
+
+    layer->last_frame_filled = 1;
+
+}
+
 /**
  * Finalizes the current pending frame, storing that state as the copy of the
  * last frame. All layer properties that have changed since the last frame will
@@ -127,6 +174,16 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
             continue;
         }
 
+        /* The plan refines the dirty rect only within the visible area of
+         * the layer, and so any changes drawn beyond the edges of the layer
+         * must be tracked separately */
+        guac_rect damage = current->pending_frame_unrefined_dirty;
+        current->pending_frame_unrefined_dirty = (guac_rect) { 0 };
+
+        int damaged_offscreen = !guac_rect_is_empty(&damage)
+            && (damage.right > current->pending_frame.width
+                || damage.bottom > current->pending_frame.height);
+
         /* Always resize the last_frame buffer to match the pending_frame prior
          * to copying over any changes (this is particularly important given
          * that the pending_frame buffer can be replaced with an external
@@ -137,11 +194,24 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
                 || current->last_frame.buffer_width != current->pending_frame.buffer_width
                 || current->last_frame.buffer_height != current->pending_frame.buffer_height) {
 
+            /* The entire pending frame buffer is about to be copied */
+            PFW_LFR_guac_display_layer_restore_stale(current);
+
             size_t buffer_size = guac_mem_ckd_mul_or_die(current->pending_frame.buffer_height,
                     current->pending_frame.buffer_stride);
 
-            guac_mem_free(current->last_frame.buffer);
-            current->last_frame.buffer = guac_mem_zalloc(buffer_size);
+            size_t old_buffer_size = 0;
+            if (current->last_frame.buffer != NULL)
+                old_buffer_size = guac_mem_ckd_mul_or_die(current->last_frame.buffer_height,
+                        current->last_frame.buffer_stride);
+
+            guac_client_account_memory(display->client, GUAC_CLIENT_MEMORY_DISPLAY,
+                    (int64_t) buffer_size - (int64_t) old_buffer_size);
+
+            /* All previous contents are overwritten, thus there is no need
+             * to free and zero a new buffer */
+            current->last_frame.buffer = guac_mem_realloc_or_die(
+                    current->last_frame.buffer, buffer_size);
             memcpy(current->last_frame.buffer, current->pending_frame.buffer, buffer_size);
 
             current->last_frame.buffer_stride = current->pending_frame.buffer_stride;
@@ -151,6 +221,11 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
             current->last_frame.dirty = current->pending_frame.dirty;
             current->pending_frame.dirty = (guac_rect) { 0 };
 
+            /* The previous snapshot of the layer cannot be trusted if the
+             * underlying buffer was replaced */
+            LFW_guac_display_layer_snapshot_invalidate(current);
+            LFW_guac_display_layer_record_invalidate(current);
+
             retval = 1;
 
         }
@@ -158,19 +233,67 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
         /* Copy over pending frame contents if actually changed (this is not
          * necessary if the last_frame buffer was resized to match
          * pending_frame, as a copy from pending_frame to last_frame is
-         * inherently part of that) */
-        else if (!guac_rect_is_empty(&current->pending_frame.dirty)) {
-
-            unsigned char* pending_frame = current->pending_frame.buffer;
-            unsigned char* last_frame = current->last_frame.buffer;
-            size_t row_length = guac_mem_ckd_mul_or_die(current->pending_frame.width, 4);
+         * inherently part of that). Only the dirty rect need be copied, as
+         * it has been refined by the plan to cover every pixel that differs
+         * between the two frames. Changes deferred due to being hidden
+         * beneath other layers remain only within the pending frame.
+         *
+         * External buffers are not ours to exchange with the last frame
+         * buffer (see below) and so must always be copied. Changes drawn
+         * beyond the edges of the layer must also be copied, including
+         * their unrefined extent, as exchanging buffers relies on both
+         * buffers being identical outside the refined dirty rect. */
+        else if (!current->pending_frame_occluded && (damaged_offscreen
+                    || (current->pending_frame.buffer_is_external
+                        && !guac_rect_is_empty(&current->pending_frame.dirty)))) {
+
+            guac_rect bounds;
+            guac_rect_init(&bounds, 0, 0, current->pending_frame.buffer_width,
+                    current->pending_frame.buffer_height);
+
+            guac_rect changed = current->pending_frame.dirty;
+            if (damaged_offscreen)
+                guac_rect_extend(&changed, &damage);
+
+            guac_rect_constrain(&changed, &bounds);
+
+            if (!guac_rect_is_empty(&changed)) {
+
+                const unsigned char* pending_frame = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(current->pending_frame, changed);
+                unsigned char* last_frame = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(current->last_frame, changed);
+                size_t row_length = guac_mem_ckd_mul_or_die(guac_rect_width(&changed),
+                        GUAC_DISPLAY_LAYER_RAW_BPP);
+
+                for (int y = changed.top; y < changed.bottom; y++) {
+                    memcpy(last_frame, pending_frame, row_length);
+                    last_frame += current->last_frame.buffer_stride;
+                    pending_frame += current->pending_frame.buffer_stride;
+                }
 
-            for (int y = 0; y < current->pending_frame.height; y++) {
-                memcpy(last_frame, pending_frame, row_length);
-                last_frame += current->last_frame.buffer_stride;
-                pending_frame += current->pending_frame.buffer_stride;
             }
 
+            /* Changes solely beyond the edges of the layer are not visible
+             * and so do not alone require a frame */
+            if (!guac_rect_is_empty(&current->pending_frame.dirty))
+                retval = 1;
+
+            current->last_frame.dirty = current->pending_frame.dirty;
+            current->pending_frame.dirty = (guac_rect) { 0 };
+
+        }
+
+        /* Buffers that belong to the layer need not be copied at all, as the
+         * pending frame buffer can simply become the last frame buffer. The
+         * changes within the dirty rect are then copied back into the new
+         * pending frame buffer only when that buffer is next accessed, rather
+         * than here, while both frames are locked for writing. */
+        else if (!guac_rect_is_empty(&current->pending_frame.dirty)
+                && !current->pending_frame_occluded) {
+
+            PFW_LFR_guac_display_layer_restore_stale(current);
+            PFW_LFW_guac_display_layer_exchange_buffers(current,
+                    &current->pending_frame.dirty);
+
             current->last_frame.dirty = current->pending_frame.dirty;
             current->pending_frame.dirty = (guac_rect) { 0 };
 
@@ -191,6 +314,14 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
             guac_protocol_send_size(client->socket, current->layer,
                     current->pending_frame.width, current->pending_frame.height);
 
+            /* Opaque layers are transparent client-side wherever they have
+             * not yet been drawn, yet both frames consider those areas to be
+             * black. Filling any newly-added area with black makes such
+             * layers truly opaque, allowing them to be relied upon to hide
+             * the layers beneath them. */
+            if (current->opaque && current->layer->index > 0)
+                LFW_guac_display_layer_fill_added_area(current);
+
             current->last_frame.width = current->pending_frame.width;
             current->last_frame.height = current->pending_frame.height;
 
@@ -198,6 +329,15 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
 
         }
 
+        /* Invalidate any parts of the snapshot of the layer that no longer
+         * match the last frame */
+        PFR_LFW_guac_display_layer_snapshot_update(current,
+                display->pending_frame.timestamp);
+
+        /* Likewise flag any parts of the layer that must be recorded again */
+        PFR_LFW_guac_display_layer_record_update(current,
+                display->pending_frame.timestamp);
+
         /* Commit any change in layer opacity */
         if (current->pending_frame.opacity != current->last_frame.opacity) {
 
@@ -246,6 +386,8 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
          * function) */
         current->last_frame.search_for_copies = current->pending_frame.search_for_copies;
         current->pending_frame.search_for_copies = 0;
+        current->pending_frame.copy_hint_count = 0;
+        current->pending_frame_occluded = 0;
 
         /* Commit any change in lossless setting (no need to synchronize this
          * to the client - it affects only how last_frame is interpreted) */
@@ -268,6 +410,11 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
     display->last_frame.cursor_hotspot_x = display->pending_frame.cursor_hotspot_x;
     display->last_frame.cursor_hotspot_y = display->pending_frame.cursor_hotspot_y;
 
+    /* Commit the source of the cursor image */
+    display->last_frame.cursor_source = display->pending_frame.cursor_source;
+    display->last_frame.cursor_source_modified = display->pending_frame.cursor_source_modified;
+    display->pending_frame.cursor_source_modified = 0;
+
     /* Commit mouse cursor location and notify all other users of change in
      * cursor state */
     if (display->pending_frame.cursor_x != display->last_frame.cursor_x
@@ -278,6 +425,7 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
         display->last_frame.cursor_x = display->pending_frame.cursor_x;
         display->last_frame.cursor_y = display->pending_frame.cursor_y;
         display->last_frame.cursor_mask = display->pending_frame.cursor_mask;
+        display->last_frame.cursor_timestamp = guac_timestamp_current();
         guac_client_foreach_user(client, LFR_guac_display_broadcast_cursor_state, display);
 
         /* NOTE: We DO NOT set retval here, as flushing a frame due purely to
@@ -322,6 +470,11 @@ void guac_display_end_multiple_frames(guac_display* display, int frames) {
 
     guac_rwlock_acquire_write_lock(&display->last_frame.lock);
 
+    /* Changes other than to the mouse cursor are the visible result of any
+     * user input awaiting such a result */
+    if (display->pending_frame_dirty_excluding_mouse)
+        guac_client_trace_damage(display->client);
+
     /* PASS 0: Create naive plan, identify minimal dirty rects by comparing the
      * changes between the pending and last frames.
      *
@@ -332,7 +485,7 @@ void guac_display_end_multiple_frames(guac_display* display, int frames) {
      * passes. */
     GUAC_DISPLAY_PLAN_BEGIN_PHASE();
     plan = PFW_LFR_guac_display_plan_create(display);
-    GUAC_DISPLAY_PLAN_END_PHASE(display, "draft", 1, 5);
+    GUAC_DISPLAY_PLAN_END_PHASE(display, draft, 1, 5);
 
     if (plan != NULL) {
 
@@ -342,26 +495,43 @@ void guac_display_end_multiple_frames(guac_display* display, int frames) {
          * replace those operations with simple rectangle draws. */
         GUAC_DISPLAY_PLAN_BEGIN_PHASE();
         PFR_guac_display_plan_rewrite_as_rects(plan);
-        GUAC_DISPLAY_PLAN_END_PHASE(display, "rects", 2, 5);
+        GUAC_DISPLAY_PLAN_END_PHASE(display, rects, 2, 5);
 
         /* PASS 2 (and 3): Index all modified cells by their graphical contents and
          * search the previous frame for occurrences of the same content. Where any
          * draws could instead be represented as copies from the previous frame, do
-         * so instead of sending new image data. */
+         * so instead of sending new image data. Draws covered by copy hints
+         * (explicit, or found by comparing the rows and columns of scrolled
+         * regions) are rewritten beforehand and are not indexed. */
         GUAC_DISPLAY_PLAN_BEGIN_PHASE();
+        PFW_LFR_guac_display_plan_detect_scrolls(plan);
+        PFR_LFR_guac_display_plan_rewrite_hinted_copies(plan);
         PFR_guac_display_plan_index_dirty_cells(plan);
         PFR_LFR_guac_display_plan_rewrite_as_copies(plan);
-        GUAC_DISPLAY_PLAN_END_PHASE(display, "search", 3, 5);
 
-        /* PASS 4 (and 5): Combine adjacent updates in horizontal and vertical
-         * directions where doing so would be more efficient. The goal of these
-         * passes is to ensure that graphics can be encoded and decoded
+        /* Of the draws that remain, replace those of recently-seen content
+         * with copies from the client-side tile cache */
+        PFR_LFW_guac_display_plan_rewrite_as_tile_copies(plan);
+        GUAC_DISPLAY_PLAN_END_PHASE(display, search, 3, 5);
+
+        /* PASS 4: Combine adjacent updates in horizontal and vertical
+         * directions where doing so would be more efficient. The goal of this
+         * pass is to ensure that graphics can be encoded and decoded
          * efficiently, without defeating the parralelism provided by providing the
          * worker threads with many smaller operations. */
         GUAC_DISPLAY_PLAN_BEGIN_PHASE();
-        PFW_guac_display_plan_combine_horizontally(plan);
-        PFW_guac_display_plan_combine_vertically(plan);
-        GUAC_DISPLAY_PLAN_END_PHASE(display, "combine", 4, 5);
+        PFW_guac_display_plan_combine(plan);
+
+        /* Copies and fills that involve regions being streamed as video
+         * cannot be sent as-is (they would be hidden beneath or copy stale
+         * data from beneath the video) */
+        LFW_guac_display_plan_rewrite_video_overlaps(plan);
+
+        /* Copies and fills are sent directly rather than through the worker
+         * threads, and must be accounted for here when tracking which
+         * regions were sent using lossy compression */
+        PFR_LFW_guac_display_plan_track_refinement(plan);
+        GUAC_DISPLAY_PLAN_END_PHASE(display, combine, 4, 5);
 
     }
 
@@ -376,7 +546,7 @@ void guac_display_end_multiple_frames(guac_display* display, int frames) {
 
     GUAC_DISPLAY_PLAN_BEGIN_PHASE();
     frame_nonempty = PFW_LFW_guac_display_frame_complete(display);
-    GUAC_DISPLAY_PLAN_END_PHASE(display, "commit", 5, 5);
+    GUAC_DISPLAY_PLAN_END_PHASE(display, commit, 5, 5);
 
     guac_rwlock_release_lock(&display->last_frame.lock);
 
@@ -0,0 +1,623 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "display-builtin-cursors.h"
+#include "display-priv.h"
+#include "encode-capture.h"
+#include "encode-jpeg.h"
+#include "encode-png.h"
+#include "encode-webp.h"
+#include "guacamole/client.h"
+#include "guacamole/layer.h"
+#include "guacamole/mem.h"
+#include "guacamole/protocol.h"
+#include "guacamole/socket.h"
+#include "guacamole/stream.h"
+
+#include <cairo/cairo.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The PNG-encoded images of each of the mouse cursors built into libguac,
+ * indexed by their corresponding guac_display_cursor_type values. These images
+ * are encoded only once per process, are never evicted, and are shared by all
+ * guac_display instances. Only the key, data, and length of each entry are
+ * used. If a built-in cursor could not be encoded, the data of its entry is
+ * NULL.
+ */
+static guac_display_image_cache_entry guac_display_image_cache_builtins[GUAC_DISPLAY_BUILTIN_CURSOR_COUNT];
+
+/**
+ * Control object for pthread_once() which ensures the built-in cursors are
+ * encoded exactly once.
+ */
+static pthread_once_t guac_display_image_cache_builtin_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Rotates the bits of the given 64-bit value left by the given number of
+ * bits.
+ *
+ * @param value
+ *     The value to rotate.
+ *
+ * @param bits
+ *     The number of bits to rotate by. This MUST be between 1 and 63
+ *     inclusive.
+ *
+ * @return
+ *     The rotated value.
+ */
+static uint64_t guac_display_image_cache_rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * Thoroughly mixes the bits of the given 64-bit value, such that every bit of
+ * the input affects every bit of the output.
+ *
+ * @param value
+ *     The value to mix.
+ *
+ * @return
+ *     The mixed value.
+ */
+static uint64_t guac_display_image_cache_mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+/**
+ * Initializes the given guac_display_image_cache_key such that it identifies
+ * the result of encoding the given surface with the given parameters. Any
+ * parameters that do not affect the encoded result for the given format are
+ * normalized such that they do not prevent otherwise-identical images from
+ * being found in the cache.
+ *
+ * @param key
+ *     The guac_display_image_cache_key to initialize.
+ *
+ * @param surface
+ *     The Cairo image surface that will be encoded.
+ *
+ * @param format
+ *     The image format that will be used.
+ *
+ * @param quality
+ *     The quality that will be used if the image format is lossy.
+ *
+ * @param lossless
+ *     Whether lossless WebP compression will be used.
+ */
+static void guac_display_image_cache_key_init(guac_display_image_cache_key* key,
+        cairo_surface_t* surface, guac_display_image_format format,
+        int quality, int lossless) {
+
+    const unsigned char* data = cairo_image_surface_get_data(surface);
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+
+    key->width = width;
+    key->height = height;
+    key->surface_format = cairo_image_surface_get_format(surface);
+    key->format = format;
+    key->lossless = (format == GUAC_DISPLAY_IMAGE_FORMAT_WEBP && lossless);
+    key->quality = (format == GUAC_DISPLAY_IMAGE_FORMAT_PNG || key->lossless) ? 0 : quality;
+
+    uint64_t h1 = 0x9E3779B97F4A7C15ULL ^ (uint64_t) width;
+    uint64_t h2 = 0xC2B2AE3D27D4EB4FULL ^ (uint64_t) height;
+
+    /* Hash only the bytes of each row that are actually part of the image
+     * (the stride may include padding with undefined contents) */
+    size_t row_length = (size_t) width * 4;
+
+    for (int y = 0; y < height; y++) {
+
+        const unsigned char* row = data;
+
+        size_t i;
+        for (i = 0; i + 8 <= row_length; i += 8) {
+
+            uint64_t word;
+            memcpy(&word, row + i, sizeof(word));
+
+            h1 ^= guac_display_image_cache_rotl(word * 0x87C37B91114253D5ULL, 31) * 0x4CF5AD432745937FULL;
+            h1 = guac_display_image_cache_rotl(h1, 27) + h2;
+            h1 = h1 * 5 + 0x52DCE729;
+
+            h2 ^= guac_display_image_cache_rotl(word * 0x4CF5AD432745937FULL, 33) * 0x87C37B91114253D5ULL;
+            h2 = guac_display_image_cache_rotl(h2, 31) + h1;
+            h2 = h2 * 5 + 0x38495AB5;
+
+        }
+
+        /* Rows of an odd number of pixels end with a single 32-bit pixel */
+        if (i < row_length) {
+            uint32_t pixel;
+            memcpy(&pixel, row + i, sizeof(pixel));
+            h1 ^= guac_display_image_cache_mix(pixel);
+            h2 += h1;
+        }
+
+        data += stride;
+
+    }
+
+    h1 += h2;
+    h2 += h1;
+
+    key->hash[0] = guac_display_image_cache_mix(h1);
+    key->hash[1] = guac_display_image_cache_mix(h2);
+
+}
+
+/**
+ * Returns whether the two given keys identify the same encoded image.
+ *
+ * @param a
+ *     The first key to compare.
+ *
+ * @param b
+ *     The second key to compare.
+ *
+ * @return
+ *     Non-zero if the keys are identical, zero otherwise.
+ */
+static int guac_display_image_cache_key_equals(const guac_display_image_cache_key* a,
+        const guac_display_image_cache_key* b) {
+    return a->hash[0] == b->hash[0]
+        && a->hash[1] == b->hash[1]
+        && a->width == b->width
+        && a->height == b->height
+        && a->surface_format == b->surface_format
+        && a->format == b->format
+        && a->quality == b->quality
+        && a->lossless == b->lossless;
+}
+
+/**
+ * Returns a pointer to the head pointer of the hash bucket that would contain
+ * the entry having the given key.
+ *
+ * @param cache
+ *     The cache containing the bucket.
+ *
+ * @param key
+ *     The key of the entry.
+ *
+ * @return
+ *     A pointer to the head pointer of the relevant hash bucket.
+ */
+static guac_display_image_cache_entry** guac_display_image_cache_bucket(
+        guac_display_image_cache* cache, const guac_display_image_cache_key* key) {
+    return &cache->buckets[key->hash[0] & (GUAC_DISPLAY_IMAGE_CACHE_BUCKETS - 1)];
+}
+
+/**
+ * Removes the given entry from the least-recently-used list of the given
+ * cache. The entry remains within its hash bucket. The cache lock MUST be
+ * held.
+ *
+ * @param cache
+ *     The cache containing the entry.
+ *
+ * @param entry
+ *     The entry to remove.
+ */
+static void guac_display_image_cache_unlink(guac_display_image_cache* cache,
+        guac_display_image_cache_entry* entry) {
+
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+
+    entry->newer = NULL;
+    entry->older = NULL;
+
+}
+
+/**
+ * Adds the given entry to the least-recently-used list of the given cache as
+ * the most recently used entry. The cache lock MUST be held.
+ *
+ * @param cache
+ *     The cache that should contain the entry.
+ *
+ * @param entry
+ *     The entry to add. This entry MUST NOT already be within the list.
+ */
+static void guac_display_image_cache_link(guac_display_image_cache* cache,
+        guac_display_image_cache_entry* entry) {
+
+    entry->newer = NULL;
+    entry->older = cache->newest;
+
+    if (cache->newest != NULL)
+        cache->newest->newer = entry;
+    else
+        cache->oldest = entry;
+
+    cache->newest = entry;
+
+}
+
+/**
+ * Removes and frees the least recently used entry of the given cache. The
+ * cache lock MUST be held, and the cache MUST NOT be empty.
+ *
+ * @param cache
+ *     The cache to evict an entry from.
+ */
+static void guac_display_image_cache_evict(guac_display_image_cache* cache) {
+
+    guac_display_image_cache_entry* entry = cache->oldest;
+    guac_display_image_cache_unlink(cache, entry);
+
+    /* Remove from hash bucket */
+    guac_display_image_cache_entry** current = guac_display_image_cache_bucket(cache, &entry->key);
+    while (*current != entry)
+        current = &(*current)->next_in_bucket;
+
+    *current = entry->next_in_bucket;
+
+    cache->size -= entry->length;
+    guac_mem_free(entry->data);
+    guac_mem_free(entry);
+
+}
+
+/**
+ * Searches the given cache for the encoded image having the given key,
+ * returning a copy of that image's data if found. The cache lock MUST NOT be
+ * held; it is acquired and released by this function.
+ *
+ * @param cache
+ *     The cache to search.
+ *
+ * @param key
+ *     The key of the encoded image.
+ *
+ * @param length
+ *     Pointer to a size_t that should receive the length of the returned
+ *     data, if found.
+ *
+ * @return
+ *     A newly-allocated copy of the encoded image data, which must eventually
+ *     be freed with guac_mem_free(), or NULL if no such image is cached.
+ */
+static unsigned char* guac_display_image_cache_get(guac_display_image_cache* cache,
+        const guac_display_image_cache_key* key, size_t* length) {
+
+    unsigned char* data = NULL;
+
+    pthread_mutex_lock(&cache->lock);
+
+    guac_display_image_cache_entry* entry = *guac_display_image_cache_bucket(cache, key);
+    while (entry != NULL) {
+
+        if (guac_display_image_cache_key_equals(&entry->key, key)) {
+
+            /* Copy data out such that it can be sent without holding the
+             * lock (sending may block indefinitely) */
+            data = guac_mem_alloc(entry->length);
+            memcpy(data, entry->data, entry->length);
+            *length = entry->length;
+
+            /* Entry is now the most recently used */
+            guac_display_image_cache_unlink(cache, entry);
+            guac_display_image_cache_link(cache, entry);
+            break;
+
+        }
+
+        entry = entry->next_in_bucket;
+
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return data;
+
+}
+
+/**
+ * Stores the encoded image data within the given guac_encode_capture in the
+ * given cache under the given key, evicting the least recently used entries
+ * as necessary. Ownership of the captured data is transferred to the cache,
+ * and the guac_encode_capture is left empty. If the capture overflowed, is
+ * empty, or an identical entry already exists, this function has no effect
+ * beyond freeing the captured data.
+ *
+ * @param cache
+ *     The cache that should receive the encoded image.
+ *
+ * @param key
+ *     The key of the encoded image.
+ *
+ * @param capture
+ *     The guac_encode_capture containing the encoded image data.
+ */
+static void guac_display_image_cache_put(guac_display_image_cache* cache,
+        const guac_display_image_cache_key* key, guac_encode_capture* capture) {
+
+    if (capture->overflow || capture->length == 0) {
+        guac_encode_capture_free(capture);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    /* Another thread may have cached the same image concurrently */
+    guac_display_image_cache_entry** bucket = guac_display_image_cache_bucket(cache, key);
+    for (guac_display_image_cache_entry* current = *bucket; current != NULL;
+            current = current->next_in_bucket) {
+        if (guac_display_image_cache_key_equals(&current->key, key)) {
+            pthread_mutex_unlock(&cache->lock);
+            guac_encode_capture_free(capture);
+            return;
+        }
+    }
+
+    /* Make room for the new entry */
+    while (cache->oldest != NULL
+            && cache->size + capture->length > GUAC_DISPLAY_IMAGE_CACHE_SIZE)
+        guac_display_image_cache_evict(cache);
+
+    guac_display_image_cache_entry* entry = guac_mem_zalloc(sizeof(guac_display_image_cache_entry));
+    entry->key = *key;
+    entry->data = capture->buffer;
+    entry->length = capture->length;
+
+    entry->next_in_bucket = *bucket;
+    *bucket = entry;
+    guac_display_image_cache_link(cache, entry);
+    cache->size += entry->length;
+
+    pthread_mutex_unlock(&cache->lock);
+
+    /* The captured data is now owned by the cache */
+    guac_encode_capture_init(capture, 0);
+
+}
+
+/**
+ * Encodes each of the mouse cursors built into libguac as PNG, storing the
+ * results within guac_display_image_cache_builtins. This function MUST be
+ * invoked only through pthread_once() with
+ * guac_display_image_cache_builtin_once.
+ */
+static void guac_display_image_cache_builtin_init(void) {
+
+    /* The encoded data is needed only as captured, and may be discarded as it
+     * is written (a socket without handlers discards all data) */
+    guac_socket* socket = guac_socket_alloc();
+    if (socket == NULL)
+        return;
+
+    guac_stream stream = { .index = 0 };
+
+    for (int i = 0; i < GUAC_DISPLAY_BUILTIN_CURSOR_COUNT; i++) {
+
+        const guac_display_builtin_cursor* cursor = guac_display_builtin_cursors[i];
+        guac_display_image_cache_entry* entry = &guac_display_image_cache_builtins[i];
+
+        /* The surface is only read from, thus discarding const is safe */
+        cairo_surface_t* surface = cairo_image_surface_create_for_data(
+                (unsigned char*) cursor->buffer, CAIRO_FORMAT_ARGB32,
+                cursor->width, cursor->height, cursor->stride);
+
+        guac_display_image_cache_key_init(&entry->key, surface,
+                GUAC_DISPLAY_IMAGE_FORMAT_PNG, 0, 0);
+
+        guac_encode_capture capture;
+        guac_encode_capture_init(&capture, GUAC_DISPLAY_IMAGE_CACHE_MAX_ENTRY_SIZE);
+
+        if (guac_png_write(socket, &stream, surface, &capture, NULL) > 0
+                && !capture.overflow && capture.length > 0) {
+            entry->data = capture.buffer;
+            entry->length = capture.length;
+        }
+        else
+            guac_encode_capture_free(&capture);
+
+        cairo_surface_destroy(surface);
+
+    }
+
+    guac_socket_free(socket);
+
+}
+
+/**
+ * Returns the PNG-encoded built-in mouse cursor identified by the given key,
+ * if any. As the built-in cursors are never modified once encoded, no locking
+ * is required.
+ *
+ * @param key
+ *     The key of the encoded image to look up.
+ *
+ * @return
+ *     The entry of the built-in cursor identified by the given key, or NULL
+ *     if the key does not identify a built-in cursor.
+ */
+static const guac_display_image_cache_entry* guac_display_image_cache_get_builtin(
+        const guac_display_image_cache_key* key) {
+
+    for (int i = 0; i < GUAC_DISPLAY_BUILTIN_CURSOR_COUNT; i++) {
+        const guac_display_image_cache_entry* entry = &guac_display_image_cache_builtins[i];
+        if (entry->data != NULL && guac_display_image_cache_key_equals(&entry->key, key))
+            return entry;
+    }
+
+    return NULL;
+
+}
+
+void guac_display_image_cache_init(guac_display_image_cache* cache) {
+
+    /* NOTE: This occurs while the display is being allocated, before any
+     * worker threads that may read the built-in cursors exist */
+    pthread_once(&guac_display_image_cache_builtin_once,
+            guac_display_image_cache_builtin_init);
+
+    memset(cache->buckets, 0, sizeof(cache->buckets));
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->size = 0;
+    pthread_mutex_init(&cache->lock, NULL);
+
+}
+
+void guac_display_image_cache_destroy(guac_display_image_cache* cache) {
+
+    while (cache->oldest != NULL)
+        guac_display_image_cache_evict(cache);
+
+    pthread_mutex_destroy(&cache->lock);
+
+}
+
+void guac_display_stream_image(guac_display* display, guac_socket* socket,
+        guac_display_image_format format, const guac_layer* layer, int x, int y,
+        cairo_surface_t* surface, int quality, int lossless) {
+
+    guac_client* client = display->client;
+
+    /* Allocate new stream for image */
+    guac_stream* stream = guac_client_alloc_stream(client);
+    if (stream == NULL) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Image could not be sent: "
+                "all available streams are in use.");
+        return;
+    }
+
+    guac_display_send_image(display, socket, stream, format, layer, x, y,
+            surface, quality, lossless, NULL);
+
+    /* Free allocated stream */
+    guac_client_free_stream(client, stream);
+
+}
+
+void guac_display_send_image(guac_display* display, guac_socket* socket,
+        guac_stream* stream, guac_display_image_format format,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality, int lossless, guac_encode_context* context) {
+
+    const char* mimetype;
+    switch (format) {
+
+        case GUAC_DISPLAY_IMAGE_FORMAT_JPEG:
+            mimetype = "image/jpeg";
+            break;
+
+#ifdef ENABLE_WEBP
+        case GUAC_DISPLAY_IMAGE_FORMAT_WEBP:
+            mimetype = "image/webp";
+            break;
+#endif
+
+        default:
+            format = GUAC_DISPLAY_IMAGE_FORMAT_PNG;
+            mimetype = "image/png";
+            break;
+
+    }
+
+    guac_protocol_send_img(socket, stream, GUAC_COMP_OVER, layer, mimetype, x, y);
+
+    uint64_t encode_start = guac_display_stats_clock();
+    int bytes_written;
+
+    guac_display_image_cache_key key;
+    guac_display_image_cache_key_init(&key, surface, format, quality, lossless);
+
+    /* Built-in mouse cursors are always available already encoded */
+    const guac_display_image_cache_entry* builtin = guac_display_image_cache_get_builtin(&key);
+
+    /* Otherwise, send previously-encoded data if the same image was encoded
+     * recently */
+    size_t length;
+    unsigned char* cached = NULL;
+    if (builtin == NULL)
+        cached = guac_display_image_cache_get(&display->image_cache, &key, &length);
+
+    guac_display_stats_record_cache_lookup(display, builtin != NULL || cached != NULL);
+
+    if (builtin != NULL)
+        bytes_written = guac_protocol_send_blobs(socket, stream, builtin->data, builtin->length) ? -1 : (int) builtin->length;
+
+    else if (cached != NULL) {
+        bytes_written = guac_protocol_send_blobs(socket, stream, cached, length) ? -1 : (int) length;
+        guac_mem_free(cached);
+    }
+
+    /* Otherwise, encode from scratch, capturing the encoded result for
+     * future reuse */
+    else {
+
+        guac_encode_capture capture;
+        guac_encode_capture_init(&capture, GUAC_DISPLAY_IMAGE_CACHE_MAX_ENTRY_SIZE);
+
+        switch (format) {
+
+            case GUAC_DISPLAY_IMAGE_FORMAT_JPEG:
+                bytes_written = guac_jpeg_write(socket, stream, surface, quality, &capture, context);
+                break;
+
+#ifdef ENABLE_WEBP
+            case GUAC_DISPLAY_IMAGE_FORMAT_WEBP:
+                bytes_written = guac_webp_write(socket, stream, surface, quality, lossless, &capture, context);
+                break;
+#endif
+
+            default:
+                bytes_written = guac_png_write(socket, stream, surface, &capture, context);
+                break;
+
+        }
+
+        if (bytes_written > 0)
+            guac_display_image_cache_put(&display->image_cache, &key, &capture);
+        else
+            guac_encode_capture_free(&capture);
+
+    }
+
+    /* Terminate stream */
+    guac_protocol_send_end(socket, stream);
+
+    if (bytes_written > 0)
+        guac_display_stats_record_image(display, format, bytes_written,
+                guac_display_stats_clock() - encode_start);
+
+}
@@ -21,6 +21,7 @@
 #include "guacamole/assert.h"
 #include "guacamole/client.h"
 #include "guacamole/display.h"
+#include "guacamole/fifo.h"
 #include "guacamole/layer.h"
 #include "guacamole/mem.h"
 #include "guacamole/rwlock.h"
@@ -92,6 +93,27 @@ static void guac_imgcpy(void* dst, size_t dst_stride, int dst_width, int dst_hei
 
 }
 
+/**
+ * Returns the number of bytes of image data allocated for the given layer
+ * state by guac_display, or zero if no such image data has been allocated
+ * (including if the buffer has been replaced with an external buffer).
+ *
+ * @param frame_state
+ *     The guac_display_layer_state whose image data should be measured.
+ *
+ * @return
+ *     The number of bytes of image data allocated for the given layer state.
+ */
+static int64_t guac_display_layer_buffer_size(const guac_display_layer_state* frame_state) {
+
+    if (frame_state->buffer == NULL || frame_state->buffer_is_external)
+        return 0;
+
+    return (int64_t) guac_mem_ckd_mul_or_die(frame_state->buffer_height,
+            frame_state->buffer_stride);
+
+}
+
 /**
  * Resizes the layer represented by the given pair of layer states to the given
  * dimensions, allocating a larger underlying image buffer if necessary. If no
@@ -103,14 +125,12 @@ static void guac_imgcpy(void* dst, size_t dst_stride, int dst_width, int dst_hei
  * array must be separately resized with a call to
  * PFW_guac_display_layer_pending_frame_cells_resize().
  *
- * @param last_frame
- *     The guac_display_layer_state representing the state of the layer at the
- *     end of the last frame sent to connected clients.
+ * @param display
+ *     The guac_display containing the layer, to whose guac_client any change
+ *     in allocated memory is attributed.
  *
- * @param pending_frame
- *     The guac_display_layer_state representing the current pending state of
- *     the layer for the upcoming frame to be eventually sent to connected
- *     clients.
+ * @param frame_state
+ *     The guac_display_layer_state whose image buffer should be resized.
  *
  * @param width
  *     The new width, in pixels.
@@ -118,8 +138,8 @@ static void guac_imgcpy(void* dst, size_t dst_stride, int dst_width, int dst_hei
  * @param height
  *     The new height, in pixels.
  */
-static void XFW_guac_display_layer_buffer_resize(guac_display_layer_state* frame_state,
-        int width, int height) {
+static void XFW_guac_display_layer_buffer_resize(guac_display* display,
+        guac_display_layer_state* frame_state, int width, int height) {
 
     /* We should never be trying to resize an externally-maintained buffer */
     GUAC_ASSERT(!frame_state->buffer_is_external);
@@ -133,7 +153,55 @@ static void XFW_guac_display_layer_buffer_resize(guac_display_layer_state* frame
             && height == frame_state->buffer_height)
         return;
 
-    int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+    int old_width = frame_state->buffer_width;
+    int old_height = frame_state->buffer_height;
+    size_t stride = frame_state->buffer_stride;
+    int64_t old_size = guac_display_layer_buffer_size(frame_state);
+
+    /* If the existing rows are wide enough, resize in place. Memory for rows
+     * is reallocated only if the height changes, which typically does not
+     * involve copying for large buffers (the allocator can remap the pages
+     * of the existing allocation). */
+    if (frame_state->buffer != NULL
+            && guac_mem_ckd_mul_or_die(width, GUAC_DISPLAY_LAYER_RAW_BPP) <= stride) {
+
+        if (height != old_height)
+            frame_state->buffer = guac_mem_realloc_or_die(frame_state->buffer,
+                    height, stride);
+
+        /* Clear any portion of the existing rows that is newly exposed,
+         * which may contain data from prior to an earlier shrink */
+        if (width > old_width) {
+            size_t offset = guac_mem_ckd_mul_or_die(old_width, GUAC_DISPLAY_LAYER_RAW_BPP);
+            size_t length = guac_mem_ckd_mul_or_die(width - old_width, GUAC_DISPLAY_LAYER_RAW_BPP);
+            unsigned char* row = frame_state->buffer + offset;
+            for (int y = 0; y < old_height && y < height; y++) {
+                memset(row, 0, length);
+                row += stride;
+            }
+        }
+
+        /* Clear any newly-added rows */
+        if (height > old_height)
+            memset(frame_state->buffer + guac_mem_ckd_mul_or_die(old_height, stride),
+                    0, guac_mem_ckd_mul_or_die(height - old_height, stride));
+
+        frame_state->buffer_width = width;
+        frame_state->buffer_height = height;
+
+        guac_client_account_memory(display->client, GUAC_CLIENT_MEMORY_DISPLAY,
+                guac_display_layer_buffer_size(frame_state) - old_size);
+        return;
+
+    }
+
+    /* Reserve additional row width if this buffer has grown before, as it
+     * is likely to continue growing */
+    int reserved_width = width;
+    if (frame_state->buffer != NULL && old_width > GUAC_DISPLAY_RESIZE_FACTOR)
+        reserved_width += width / GUAC_DISPLAY_RESIZE_HEADROOM;
+
+    stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, reserved_width);
     unsigned char* buffer = guac_mem_zalloc(height, stride);
 
     /* Copy over data from old shared buffer, if that data exists and is
@@ -163,12 +231,18 @@ static void XFW_guac_display_layer_buffer_resize(guac_display_layer_state* frame
     frame_state->buffer_height = height;
     frame_state->buffer_stride = stride;
 
+    guac_client_account_memory(display->client, GUAC_CLIENT_MEMORY_DISPLAY,
+            guac_display_layer_buffer_size(frame_state) - old_size);
+
 }
 
 /**
  * Fully initializes the last and pending frame states for a newly-allocated
  * layer, including its underlying image buffers.
  *
+ * @param display
+ *     The guac_display that will contain the layer.
+ *
  * @param last_frame
  *     The guac_display_layer_state representing the state of the layer at the
  *     end of the last frame sent to connected clients.
@@ -178,7 +252,8 @@ static void XFW_guac_display_layer_buffer_resize(guac_display_layer_state* frame
  *     the layer for the upcoming frame to be eventually sent to connected
  *     clients.
  */
-static void PFW_LFW_guac_display_layer_state_init(guac_display_layer_state* last_frame,
+static void PFW_LFW_guac_display_layer_state_init(guac_display* display,
+        guac_display_layer_state* last_frame,
         guac_display_layer_state* pending_frame) {
 
     last_frame->width = pending_frame->width = GUAC_DISPLAY_RESIZE_FACTOR;
@@ -186,10 +261,10 @@ static void PFW_LFW_guac_display_layer_state_init(guac_display_layer_state* last
     last_frame->opacity = pending_frame->opacity = 0xFF;
     last_frame->parent = pending_frame->parent = GUAC_DEFAULT_LAYER;
 
-    XFW_guac_display_layer_buffer_resize(last_frame,
+    XFW_guac_display_layer_buffer_resize(display, last_frame,
             last_frame->width, last_frame->height);
 
-    XFW_guac_display_layer_buffer_resize(pending_frame,
+    XFW_guac_display_layer_buffer_resize(display, pending_frame,
             pending_frame->width, pending_frame->height);
 
 }
@@ -258,11 +333,13 @@ guac_display_layer* guac_display_add_layer(guac_display* display, guac_layer* la
     display_layer->display = display;
     display_layer->layer = layer;
     display_layer->opaque = opaque;
+    pthread_mutex_init(&display_layer->video.lock, NULL);
 
     /* Init tracking of pending and last frames (NOTE: We need not acquire the
      * display-wide last_frame.lock here as this new layer will not actually be
      * part of the last frame layer list until the pending frame is flushed) */
-    PFW_LFW_guac_display_layer_state_init(&display_layer->last_frame, &display_layer->pending_frame);
+    PFW_LFW_guac_display_layer_state_init(display, &display_layer->last_frame,
+            &display_layer->pending_frame);
     display_layer->last_frame_buffer = guac_client_alloc_buffer(display->client);
     PFW_guac_display_layer_pending_frame_cells_resize(display_layer,
             display_layer->pending_frame.width,
@@ -309,6 +386,13 @@ void guac_display_remove_layer(guac_display_layer* display_layer) {
     if (display_layer->pending_frame.next != NULL)
         display_layer->pending_frame.next->pending_frame.prev = display_layer->pending_frame.prev;
 
+    /* Fall back to the cursor buffer if the layer was serving as the mouse
+     * cursor image */
+    if (display->pending_frame.cursor_source == display_layer) {
+        display->pending_frame.cursor_source = NULL;
+        display->pending_frame.cursor_source_modified = 1;
+    }
+
     guac_rwlock_release_lock(&display->pending_frame.lock);
 
     /*
@@ -332,6 +416,16 @@ void guac_display_remove_layer(guac_display_layer* display_layer) {
     if (display_layer->last_frame.next != NULL)
         display_layer->last_frame.next->last_frame.prev = display_layer->last_frame.prev;
 
+    if (display->last_frame.cursor_source == display_layer)
+        display->last_frame.cursor_source = NULL;
+
+    /* Drop any tiles of the layer that were to be cached at the end of the
+     * current frame */
+    LFW_guac_display_tile_cache_forget_layer(&display->tile_cache, display_layer);
+
+    /* Stop streaming any region of the layer as video */
+    LFW_guac_display_layer_abandon_video(display_layer);
+
     guac_rwlock_release_lock(&display->last_frame.lock);
 
     /*
@@ -358,12 +452,20 @@ void guac_display_remove_layer(guac_display_layer* display_layer) {
      * that we do NOT free the associated memory for the pending frame if it
      * was replaced with an external buffer. */
 
+    guac_client_account_memory(client, GUAC_CLIENT_MEMORY_DISPLAY,
+            -guac_display_layer_buffer_size(&display_layer->pending_frame)
+            - guac_display_layer_buffer_size(&display_layer->last_frame));
+
     if (!display_layer->pending_frame.buffer_is_external)
         guac_mem_free(display_layer->pending_frame.buffer);
 
     guac_mem_free(display_layer->last_frame.buffer);
     guac_mem_free(display_layer->pending_frame_cells);
+    guac_display_layer_snapshot_free(display_layer);
+    guac_display_layer_refinement_free(display_layer);
+    guac_display_layer_record_free(display_layer);
 
+    pthread_mutex_destroy(&display_layer->video.lock);
     guac_mem_free(display_layer);
 
 }
@@ -386,11 +488,235 @@ void PFW_guac_display_layer_resize(guac_display_layer* layer, int width, int hei
     /* Skip resizing underlying buffer if it's the caller that's responsible
      * for resizing the buffer */
     if (!layer->pending_frame.buffer_is_external)
-        XFW_guac_display_layer_buffer_resize(&layer->pending_frame, width, height);
+        XFW_guac_display_layer_buffer_resize(layer->display,
+                &layer->pending_frame, width, height);
 
     PFW_guac_display_layer_pending_frame_cells_resize(layer, width, height);
 
+    if (width < layer->pending_frame.width || height < layer->pending_frame.height)
+        guac_display_stats_record_layer_shrink(layer->display);
+
     layer->pending_frame.width = width;
     layer->pending_frame.height = height;
 
 }
+
+void PFW_LFW_guac_display_layer_exchange_buffers(guac_display_layer* layer,
+        const guac_rect* changed) {
+
+    guac_display_layer_state* pending_frame = &layer->pending_frame;
+    guac_display_layer_state* last_frame = &layer->last_frame;
+
+    GUAC_ASSERT(!pending_frame->buffer_is_external);
+    GUAC_ASSERT(guac_rect_is_empty(&layer->pending_frame_stale));
+
+    /* Any cached Cairo surface refers to the buffer being exchanged */
+    guac_display_layer_cairo_context* cairo_context = &(layer->pending_frame_cairo_context);
+    if (cairo_context->surface != NULL) {
+
+        cairo_surface_flush(cairo_context->surface);
+        cairo_surface_destroy(cairo_context->surface);
+        cairo_destroy(cairo_context->cairo);
+
+        cairo_context->surface = NULL;
+        cairo_context->cairo = NULL;
+
+    }
+
+    unsigned char* buffer = last_frame->buffer;
+    last_frame->buffer = pending_frame->buffer;
+    pending_frame->buffer = buffer;
+
+    /* The entire buffer (not only the visible area of the layer) must be
+     * considered, as nothing prevents drawing beyond the edges of the layer */
+    guac_rect bounds;
+    guac_rect_init(&bounds, 0, 0, pending_frame->buffer_width,
+            pending_frame->buffer_height);
+
+    layer->pending_frame_stale = *changed;
+    guac_rect_constrain(&layer->pending_frame_stale, &bounds);
+
+}
+
+void PFW_LFR_guac_display_layer_restore_stale(guac_display_layer* layer) {
+
+    guac_display_layer_state* pending_frame = &layer->pending_frame;
+    guac_display_layer_state* last_frame = &layer->last_frame;
+
+    guac_rect stale = layer->pending_frame_stale;
+    layer->pending_frame_stale = (guac_rect) { 0 };
+
+    if (guac_rect_is_empty(&stale)
+            || pending_frame->buffer == NULL || last_frame->buffer == NULL)
+        return;
+
+    /* Either buffer may have since been resized or shrunk independently */
+    guac_rect bounds;
+    guac_rect_init(&bounds, 0, 0,
+            pending_frame->buffer_width < last_frame->buffer_width
+                ? pending_frame->buffer_width : last_frame->buffer_width,
+            pending_frame->buffer_height < last_frame->buffer_height
+                ? pending_frame->buffer_height : last_frame->buffer_height);
+
+    guac_rect_constrain(&stale, &bounds);
+    if (guac_rect_is_empty(&stale))
+        return;
+
+    const unsigned char* src = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(*last_frame, stale);
+    unsigned char* dst = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(*pending_frame, stale);
+    size_t row_length = guac_mem_ckd_mul_or_die(guac_rect_width(&stale),
+            GUAC_DISPLAY_LAYER_RAW_BPP);
+
+    for (int y = stale.top; y < stale.bottom; y++) {
+        memcpy(dst, src, row_length);
+        dst += pending_frame->buffer_stride;
+        src += last_frame->buffer_stride;
+    }
+
+}
+
+/**
+ * Replaces the image buffer of the given layer state with a newly-allocated
+ * buffer having the given dimensions and stride, which must be no larger
+ * than those of the current buffer, copying over all data that fits.
+ *
+ * @param display
+ *     The guac_display containing the layer, to whose guac_client the
+ *     memory released is attributed.
+ *
+ * @param frame_state
+ *     The guac_display_layer_state whose image buffer should be shrunk.
+ *
+ * @param width
+ *     The new width of the buffer, in pixels.
+ *
+ * @param height
+ *     The new height of the buffer, in pixels.
+ *
+ * @param stride
+ *     The number of bytes in each row of the new buffer.
+ */
+static void XFW_guac_display_layer_buffer_shrink(guac_display* display,
+        guac_display_layer_state* frame_state, int width, int height,
+        size_t stride) {
+
+    int64_t old_size = guac_display_layer_buffer_size(frame_state);
+    unsigned char* buffer = guac_mem_zalloc(height, stride);
+
+    guac_imgcpy(
+
+            /* Copy to newly-allocated frame buffer ... */
+            buffer, stride,
+            width, height,
+
+            /* ... from old frame buffer. */
+            frame_state->buffer, frame_state->buffer_stride,
+            frame_state->buffer_width, frame_state->buffer_height,
+
+            /* All pixels are 32-bit */
+            GUAC_DISPLAY_LAYER_RAW_BPP);
+
+    guac_mem_free(frame_state->buffer);
+
+    frame_state->buffer = buffer;
+    frame_state->buffer_width = width;
+    frame_state->buffer_height = height;
+    frame_state->buffer_stride = stride;
+
+    guac_client_account_memory(display->client, GUAC_CLIENT_MEMORY_DISPLAY,
+            guac_display_layer_buffer_size(frame_state) - old_size);
+
+}
+
+size_t guac_display_reclaim_memory(guac_display* display) {
+
+    size_t reclaimed = 0;
+
+    /* NOTE: Locks are acquired in the same order as guac_display_end_frame(),
+     * guaranteeing that no frame is being flushed (and thus that no worker
+     * thread is reading from any buffer) while buffers are replaced */
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+    guac_rwlock_acquire_write_lock(&display->last_frame.lock);
+
+    /* Leave buffers untouched if the worker threads have yet to finish
+     * encoding the last frame (the display is clearly not idle) */
+    guac_fifo_lock(&display->ops);
+    int busy = (display->ops.state.value & GUAC_FIFO_STATE_NONEMPTY) || display->active_workers;
+    guac_fifo_unlock(&display->ops);
+
+    guac_display_layer* current = busy ? NULL : display->pending_frame.layers;
+    for (; current != NULL; current = current->pending_frame.next) {
+
+        guac_display_layer_state* pending_frame = &current->pending_frame;
+        guac_display_layer_state* last_frame = &current->last_frame;
+
+        /* Buffers replaced by external buffers are not ours to shrink */
+        if (pending_frame->buffer == NULL || pending_frame->buffer_is_external
+                || last_frame->buffer == NULL)
+            continue;
+
+        /* Skip layers resized since the last frame, as the last_frame buffer
+         * will be reallocated to match the pending_frame buffer when the
+         * next frame is flushed. Shrinking both buffers identically
+         * otherwise avoids that reallocation and copy. */
+        if (last_frame->buffer_stride != pending_frame->buffer_stride
+                || last_frame->buffer_width != pending_frame->buffer_width
+                || last_frame->buffer_height != pending_frame->buffer_height)
+            continue;
+
+        /* Determine the storage the layer would receive if newly allocated */
+        int width  = ((pending_frame->width  + GUAC_DISPLAY_RESIZE_FACTOR - 1) / GUAC_DISPLAY_RESIZE_FACTOR) * GUAC_DISPLAY_RESIZE_FACTOR;
+        int height = ((pending_frame->height + GUAC_DISPLAY_RESIZE_FACTOR - 1) / GUAC_DISPLAY_RESIZE_FACTOR) * GUAC_DISPLAY_RESIZE_FACTOR;
+        size_t stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+
+        size_t required = guac_mem_ckd_mul_or_die(height, stride);
+        size_t allocated = guac_mem_ckd_mul_or_die(pending_frame->buffer_height,
+                pending_frame->buffer_stride);
+
+        if (allocated <= guac_mem_ckd_mul_or_die(required, GUAC_DISPLAY_RECLAIM_FACTOR))
+            continue;
+
+        /* Any cached Cairo surface refers to the buffer being replaced */
+        guac_display_layer_cairo_context* cairo_context = &(current->pending_frame_cairo_context);
+        if (cairo_context->surface != NULL) {
+
+            cairo_surface_flush(cairo_context->surface);
+            cairo_surface_destroy(cairo_context->surface);
+            cairo_destroy(cairo_context->cairo);
+
+            cairo_context->surface = NULL;
+            cairo_context->cairo = NULL;
+
+        }
+
+        XFW_guac_display_layer_buffer_shrink(display, pending_frame,
+                width, height, stride);
+
+        XFW_guac_display_layer_buffer_shrink(display, last_frame,
+                width, height, stride);
+
+        reclaimed += 2 * (allocated - required);
+
+    }
+
+    guac_rwlock_release_lock(&display->last_frame.lock);
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+
+    return reclaimed;
+
+}
+
+size_t guac_display_reclaim_client_memory(guac_client* client) {
+
+    size_t reclaimed = 0;
+
+    /* The display cannot be freed while its memory is being reclaimed */
+    pthread_mutex_lock(&client->__display_lock);
+
+    if (client->__display != NULL)
+        reclaimed = guac_display_reclaim_memory(client->__display);
+
+    pthread_mutex_unlock(&client->__display_lock);
+    return reclaimed;
+
+}
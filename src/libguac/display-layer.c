@@ -19,7 +19,9 @@
 
 #include "display-priv.h"
 #include "guacamole/assert.h"
+#include "guacamole/client.h"
 #include "guacamole/display.h"
+#include "guacamole/mem.h"
 #include "guacamole/rect.h"
 #include "guacamole/rwlock.h"
 
@@ -30,8 +32,11 @@
 /**
  * Notifies the display associated with the given layer that the given layer
  * has been modified in some way for the current pending frame. If the layer is
- * not the cursor layer, the pending_frame_dirty_excluding_mouse flag of the
- * display is updated accordingly.
+ * neither the cursor layer nor a buffer set as the cursor, the
+ * pending_frame_dirty_excluding_mouse flag of the display is updated
+ * accordingly. If the layer is the cursor layer, or is a
+ * buffer set as the cursor with guac_display_set_cursor_buffer(), the cursor
+ * is marked as needing to be resent.
  *
  * @param layer
  *     The layer that was modified.
@@ -40,9 +45,229 @@ static void PFW_guac_display_layer_touch(guac_display_layer* layer) {
 
     guac_display* display = layer->display;
 
-    if (layer != display->cursor_buffer)
+    /* Any change to the cursor buffer makes that buffer the source of the
+     * mouse cursor image once again */
+    if (layer == display->cursor_buffer) {
+        if (display->pending_frame.cursor_source != NULL) {
+            display->pending_frame.cursor_source = NULL;
+            display->pending_frame.cursor_source_modified = 1;
+        }
+    }
+
+    /* Changes to a buffer serving as the mouse cursor image affect only the
+     * mouse cursor, like changes to the cursor buffer itself */
+    else if (layer != display->pending_frame.cursor_source)
         display->pending_frame_dirty_excluding_mouse = 1;
 
+    /* Changes to a buffer serving as the mouse cursor image must be
+     * reflected in the mouse cursor, as well */
+    if (layer == display->pending_frame.cursor_source)
+        display->pending_frame.cursor_source_modified = 1;
+
+}
+
+/**
+ * Restores any stale region of the pending frame buffer of the given layer
+ * (see PFW_LFR_guac_display_layer_restore_stale()), acquiring the
+ * display-level last_frame.lock only if there is actually anything to
+ * restore.
+ *
+ * @param layer
+ *     The layer whose pending frame buffer is about to be accessed.
+ */
+static void PFW_guac_display_layer_restore_stale(guac_display_layer* layer) {
+
+    if (guac_rect_is_empty(&layer->pending_frame_stale))
+        return;
+
+    guac_display* display = layer->display;
+    guac_rwlock_acquire_read_lock(&display->last_frame.lock);
+    PFW_LFR_guac_display_layer_restore_stale(layer);
+    guac_rwlock_release_lock(&display->last_frame.lock);
+
+}
+
+/**
+ * Returns the area of the given rectangle, in pixels. Empty rectangles have
+ * an area of zero.
+ *
+ * @param rect
+ *     The rectangle to measure.
+ *
+ * @return
+ *     The area of the given rectangle, in pixels.
+ */
+static int64_t guac_display_damage_area(const guac_rect* rect) {
+
+    if (guac_rect_is_empty(rect))
+        return 0;
+
+    return (int64_t) guac_rect_width(rect) * guac_rect_height(rect);
+
+}
+
+/**
+ * Adds the given rectangle to the given list of modified regions, coalescing
+ * it with any existing region for which processing both regions together
+ * would include no more than GUAC_DISPLAY_LAYER_DAMAGE_MERGE_AREA pixels of
+ * unmodified area. If the list is full, the rectangle is coalesced with
+ * whichever region results in the least additional area. Coalesced regions
+ * are themselves reconsidered for coalescing with the remaining regions.
+ *
+ * @param damage
+ *     An array of at least GUAC_DISPLAY_LAYER_MAX_DAMAGE rectangles.
+ *
+ * @param count
+ *     A pointer to the number of regions currently within the array. This
+ *     value will be updated by this function.
+ *
+ * @param rect
+ *     The modified region to add.
+ */
+static void guac_display_damage_add(guac_rect* damage, int* count,
+        const guac_rect* rect) {
+
+    if (guac_rect_is_empty(rect))
+        return;
+
+    guac_rect pending = *rect;
+
+    for (;;) {
+
+        int best = -1;
+        int64_t best_cost = INT64_MAX;
+
+        for (int i = 0; i < *count; i++) {
+
+            guac_rect merged = damage[i];
+            guac_rect_extend(&merged, &pending);
+
+            int64_t cost = guac_display_damage_area(&merged)
+                - guac_display_damage_area(&damage[i])
+                - guac_display_damage_area(&pending);
+
+            if (cost < best_cost) {
+                best = i;
+                best_cost = cost;
+            }
+
+        }
+
+        /* Track separately if far enough from all other regions */
+        if (best_cost > GUAC_DISPLAY_LAYER_DAMAGE_MERGE_AREA
+                && *count < GUAC_DISPLAY_LAYER_MAX_DAMAGE) {
+            damage[(*count)++] = pending;
+            return;
+        }
+
+        /* Otherwise, pull the chosen region out of the list and try again
+         * with the combined region */
+        guac_rect_extend(&pending, &damage[best]);
+        damage[best] = damage[--(*count)];
+
+    }
+
+}
+
+void guac_display_layer_raw_context_damage(guac_display_layer_raw_context* context,
+        const guac_rect* rect) {
+
+    if (guac_rect_is_empty(rect))
+        return;
+
+    guac_display_damage_add(context->damage, &context->damage_count, rect);
+    guac_rect_extend(&context->dirty, rect);
+
+}
+
+void guac_display_layer_raw_context_copy_hint(guac_display_layer_raw_context* context,
+        const guac_rect* dest, int src_x, int src_y) {
+
+    if (guac_rect_is_empty(dest))
+        return;
+
+    guac_display_layer_raw_context_damage(context, dest);
+
+    /* Copies that do not move anything are not copies */
+    if (src_x == dest->left && src_y == dest->top)
+        return;
+
+    if (context->copy_hint_count >= GUAC_DISPLAY_LAYER_MAX_COPY_HINTS)
+        return;
+
+    context->copy_hints[context->copy_hint_count++] = (guac_display_copy_hint) {
+        .dest  = *dest,
+        .src_x = src_x,
+        .src_y = src_y
+    };
+
+}
+
+/**
+ * Records that the given rectangle of the pending frame of the given layer
+ * has been modified, updating both the dirty rect and the list of distinct
+ * modified regions of the pending frame.
+ *
+ * @param layer
+ *     The layer that was modified.
+ *
+ * @param rect
+ *     The rectangular region that was modified.
+ */
+static void PFW_guac_display_layer_add_damage(guac_display_layer* layer,
+        const guac_rect* rect) {
+
+    if (guac_rect_is_empty(rect))
+        return;
+
+    guac_display_layer_state* state = &layer->pending_frame;
+
+    /* If the list was already abandoned in favor of the dirty rect, it
+     * cannot be resumed without losing those earlier changes */
+    if (state->damage_count || guac_rect_is_empty(&state->dirty))
+        guac_display_damage_add(state->damage, &state->damage_count, rect);
+
+    guac_rect_extend(&state->dirty, rect);
+
+}
+
+/**
+ * Records all modified regions of the given context within the pending frame
+ * of the given layer. If the dirty rect of the context was modified directly,
+ * rather than through guac_display_layer_raw_context_damage(), the entire
+ * dirty rect is considered modified.
+ *
+ * @param layer
+ *     The layer that was modified.
+ *
+ * @param damage
+ *     The distinct modified regions recorded by the context.
+ *
+ * @param damage_count
+ *     The number of regions within the damage array.
+ *
+ * @param dirty
+ *     The dirty rect of the context.
+ */
+static void PFW_guac_display_layer_commit_damage(guac_display_layer* layer,
+        const guac_rect* damage, int damage_count, const guac_rect* dirty) {
+
+    guac_rect bounds = { 0 };
+    for (int i = 0; i < damage_count; i++) {
+        PFW_guac_display_layer_add_damage(layer, &damage[i]);
+        guac_rect_extend(&bounds, &damage[i]);
+    }
+
+    if (guac_rect_is_empty(dirty))
+        return;
+
+    if (guac_rect_is_empty(&bounds)
+            || bounds.left   != dirty->left
+            || bounds.top    != dirty->top
+            || bounds.right  != dirty->right
+            || bounds.bottom != dirty->bottom)
+        PFW_guac_display_layer_add_damage(layer, dirty);
+
 }
 
 void guac_display_layer_get_bounds(guac_display_layer* layer, guac_rect* bounds) {
@@ -139,6 +364,10 @@ void guac_display_layer_resize(guac_display_layer* layer, int width, int height)
     guac_display* display = layer->display;
     guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
 
+    /* Resizing preserves the contents of the buffer, which must therefore
+     * first be current */
+    PFW_guac_display_layer_restore_stale(layer);
+
     PFW_guac_display_layer_resize(layer, width, height);
     PFW_guac_display_layer_touch(layer);
 
@@ -162,7 +391,7 @@ void guac_display_layer_raw_context_set(guac_display_layer_raw_context* context,
 
     }
 
-    guac_rect_extend(&(context->dirty), dst);
+    guac_display_layer_raw_context_damage(context, dst);
 
 }
 
@@ -182,7 +411,7 @@ void guac_display_layer_raw_context_put(guac_display_layer_raw_context* context,
         src_buffer += stride;
     }
 
-    guac_rect_extend(&(context->dirty), dst);
+    guac_display_layer_raw_context_damage(context, dst);
 
 }
 
@@ -191,6 +420,9 @@ guac_display_layer_raw_context* guac_display_layer_open_raw(guac_display_layer*
     guac_display* display = layer->display;
     guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
 
+    /* The caller may read any part of the buffer */
+    PFW_guac_display_layer_restore_stale(layer);
+
     /* Flush any outstanding Cairo operations before directly accessing buffer */
     guac_display_layer_cairo_context* cairo_context = &(layer->pending_frame_cairo_context);
     if (cairo_context->surface != NULL)
@@ -200,6 +432,8 @@ guac_display_layer_raw_context* guac_display_layer_open_raw(guac_display_layer*
         .buffer = layer->pending_frame.buffer,
         .stride = layer->pending_frame.buffer_stride,
         .dirty = { 0 },
+        .damage_count = 0,
+        .copy_hint_count = 0,
         .hint_from = layer,
         .bounds = {
             .left   = 0,
@@ -222,6 +456,12 @@ void guac_display_layer_close_raw(guac_display_layer* layer, guac_display_layer_
      * buffer details. */
     if (context->buffer != layer->pending_frame.buffer
             && !layer->pending_frame.buffer_is_external) {
+
+        if (layer->pending_frame.buffer != NULL)
+            guac_client_account_memory(display->client, GUAC_CLIENT_MEMORY_DISPLAY,
+                    -(int64_t) guac_mem_ckd_mul_or_die(layer->pending_frame.buffer_height,
+                        layer->pending_frame.buffer_stride));
+
         guac_mem_free(layer->pending_frame.buffer);
         layer->pending_frame.buffer_is_external = 1;
     }
@@ -257,9 +497,16 @@ void guac_display_layer_close_raw(guac_display_layer* layer, guac_display_layer_
 
     }
 
-    guac_rect_extend(&layer->pending_frame.dirty, &context->dirty);
+    PFW_guac_display_layer_commit_damage(layer, context->damage,
+            context->damage_count, &context->dirty);
     PFW_guac_display_layer_touch(layer);
 
+    /* Retain any copy hints for the flush of the pending frame */
+    guac_display_layer_state* state = &layer->pending_frame;
+    for (int i = 0; i < context->copy_hint_count
+            && state->copy_hint_count < GUAC_DISPLAY_LAYER_MAX_COPY_HINTS; i++)
+        state->copy_hints[state->copy_hint_count++] = context->copy_hints[i];
+
     /* Apply any hinting regarding scroll/copy optimization */
     if (context->hint_from != NULL)
         context->hint_from->pending_frame.search_for_copies = 1;
@@ -280,6 +527,9 @@ guac_display_layer_cairo_context* guac_display_layer_open_cairo(guac_display_lay
      * contexts is not safe nor allowed. */
     GUAC_ASSERT(layer->pending_frame.buffer != NULL);
 
+    /* Cairo may read any part of the buffer */
+    PFW_guac_display_layer_restore_stale(layer);
+
     guac_display_layer_cairo_context* context = &(layer->pending_frame_cairo_context);
 
     context->dirty = (guac_rect) { 0 };
@@ -312,7 +562,7 @@ void guac_display_layer_close_cairo(guac_display_layer* layer, guac_display_laye
 
     guac_display* display = layer->display;
 
-    guac_rect_extend(&layer->pending_frame.dirty, &context->dirty);
+    PFW_guac_display_layer_add_damage(layer, &context->dirty);
     PFW_guac_display_layer_touch(layer);
 
     /* Apply any hinting regarding scroll/copy optimization */
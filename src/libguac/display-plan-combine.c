@@ -22,6 +22,8 @@
 #include "guacamole/display.h"
 #include "guacamole/rect.h"
 
+#include <stdint.h>
+
 /**
  * Returns whether the given rectangle crosses the boundaries of any two
  * adjacent cells in a grid, where each cell in the grid is
@@ -100,8 +102,117 @@ static int guac_display_plan_has_common_edge(const guac_display_plan_operation*
 }
 
 /**
- * Returns whether the given pair of operations should be combined into a
- * single operation.
+ * Estimates the complexity of the image data within the given rectangle of
+ * the pending frame of the given layer by sampling a sparse grid of
+ * GUAC_DISPLAY_COST_SAMPLES x GUAC_DISPLAY_COST_SAMPLES pixels and testing
+ * whether each differs from its neighbors. Flat content, such as the
+ * background of text, has a low complexity, while photographic content or
+ * noise has a high complexity.
+ *
+ * @param layer
+ *     The layer containing the image data to sample.
+ *
+ * @param rect
+ *     The rectangle to sample, which must be within the bounds of the pending
+ *     frame of the layer.
+ *
+ * @return
+ *     The estimated complexity of the image data, from 0 (entirely flat) to
+ *     256 (entirely noisy), inclusive.
+ */
+static int PFR_guac_display_plan_sample_complexity(const guac_display_layer* layer,
+        const guac_rect* rect) {
+
+    /* Assume the worst if there is no content to sample */
+    const unsigned char* buffer = layer->pending_frame.buffer;
+    if (buffer == NULL)
+        return 256;
+
+    int width = guac_rect_width(rect);
+    int height = guac_rect_height(rect);
+    if (width < 2 || height < 2)
+        return 256;
+
+    size_t stride = layer->pending_frame.buffer_stride;
+    int differing = 0;
+
+    for (int i = 0; i < GUAC_DISPLAY_COST_SAMPLES; i++) {
+
+        /* Each sampled pixel is compared with its neighbors to the right and
+         * below, thus the final row and column are never sampled directly */
+        int y = rect->top + i * (height - 1) / GUAC_DISPLAY_COST_SAMPLES;
+        const uint32_t* row = (const uint32_t*) (buffer + y * stride);
+        const uint32_t* next_row = (const uint32_t*) (buffer + (y + 1) * stride);
+
+        for (int j = 0; j < GUAC_DISPLAY_COST_SAMPLES; j++) {
+            int x = rect->left + j * (width - 1) / GUAC_DISPLAY_COST_SAMPLES;
+            if (row[x] != row[x + 1] || row[x] != next_row[x])
+                differing++;
+        }
+
+    }
+
+    return differing * 256 / (GUAC_DISPLAY_COST_SAMPLES * GUAC_DISPLAY_COST_SAMPLES);
+
+}
+
+/**
+ * Returns the estimated number of bytes required to send the given rectangle
+ * of the pending frame of the given layer as an image.
+ *
+ * @param layer
+ *     The layer containing the image data.
+ *
+ * @param rect
+ *     The rectangle that would be sent as an image.
+ *
+ * @return
+ *     The estimated cost of sending the image, in bytes.
+ */
+static int64_t PFR_guac_display_plan_image_cost(const guac_display_layer* layer,
+        const guac_rect* rect) {
+
+    int complexity = PFR_guac_display_plan_sample_complexity(layer, rect);
+    int64_t pixel_cost = GUAC_DISPLAY_MIN_PIXEL_COST
+        + complexity * (GUAC_DISPLAY_MAX_PIXEL_COST - GUAC_DISPLAY_MIN_PIXEL_COST) / 256;
+
+    int64_t area = (int64_t) guac_rect_width(rect) * guac_rect_height(rect);
+    return GUAC_DISPLAY_IMAGE_COST + area * pixel_cost / 256;
+
+}
+
+/**
+ * Returns the estimated number of bytes required to perform the given
+ * operation.
+ *
+ * @param op
+ *     The operation to estimate the cost of.
+ *
+ * @return
+ *     The estimated cost of the operation, in bytes.
+ */
+static int64_t PFR_guac_display_plan_op_cost(const guac_display_plan_operation* op) {
+
+    switch (op->type) {
+
+        case GUAC_DISPLAY_PLAN_OPERATION_IMG:
+            return PFR_guac_display_plan_image_cost(op->layer, &op->dest);
+
+        case GUAC_DISPLAY_PLAN_OPERATION_NOP:
+            return 0;
+
+        default:
+            return GUAC_DISPLAY_INSTRUCTION_COST;
+
+    }
+
+}
+
+/**
+ * Determines whether the given pair of operations may be combined into a
+ * single operation and, if so, the estimated number of bytes saved by doing
+ * so. The savings may be negative if combining would increase the amount of
+ * data sent.
  *
  * @param op_a
  *     The first operation to check.
@@ -109,23 +220,34 @@ static int guac_display_plan_has_common_edge(const guac_display_plan_operation*
  * @param op_b
  *     The second operation to check.
  *
+ * @param savings
+ *     Storage for the estimated number of bytes saved by combining the
+ *     operations. This value is only set if the operations may be combined.
+ *
  * @return
- *     Non-zero if the operations would be better represented as a single,
- *     combined operation, zero otherwise.
+ *     Non-zero if the operations may be combined, zero otherwise.
  */
-static int guac_display_plan_should_combine(const guac_display_plan_operation* op_a,
-        const guac_display_plan_operation* op_b) {
-
-    /* Operations can only be combined within the same layer */
-    if (op_a->layer != op_b->layer)
+static int PFR_guac_display_plan_combine_savings(const guac_display_plan_operation* op_a,
+        const guac_display_plan_operation* op_b, int64_t* savings) {
+
+    /* Operations can only be combined within the same layer, and operations
+     * that have already been combined into others no longer exist */
+    if (op_a == op_b || op_a->layer != op_b->layer
+            || op_a->type == GUAC_DISPLAY_PLAN_OPERATION_NOP
+            || op_b->type == GUAC_DISPLAY_PLAN_OPERATION_NOP)
         return 0;
 
-    /* Simulate combination */
+    /* Simulate combination, refusing to combine beyond the size limits for
+     * combined operations (we enforce size limits here to promote
+     * parallelism) */
     guac_rect combined = op_a->dest;
     guac_rect_extend(&combined, &op_b->dest);
+    if (guac_display_plan_rect_crosses_boundary(&combined))
+        return 0;
 
     /* Operations of the same type can be trivially unified under specific
-     * circumstances */
+     * circumstances, saving an instruction without affecting the amount of
+     * image data sent */
     if (op_a->type == op_b->type) {
         switch (op_a->type) {
 
@@ -141,9 +263,10 @@ static int guac_display_plan_should_combine(const guac_display_plan_operation* o
                     int delta_xb = op_b->dest.left - op_b->src.layer_rect.rect.left;
                     int delta_yb = op_b->dest.top  - op_b->src.layer_rect.rect.top;
 
-                    return delta_xa == delta_xb
-                        && delta_ya == delta_yb
-                        && !guac_display_plan_rect_crosses_boundary(&combined);
+                    if (delta_xa == delta_xb && delta_ya == delta_yb) {
+                        *savings = GUAC_DISPLAY_INSTRUCTION_COST;
+                        return 1;
+                    }
 
                 }
                 break;
@@ -152,104 +275,68 @@ static int guac_display_plan_should_combine(const guac_display_plan_operation* o
              * perfectly adjacent (exactly share an edge) and draw the same
              * color */
             case GUAC_DISPLAY_PLAN_OPERATION_RECT:
-                return op_a->src.color == op_b->src.color
-                    && guac_display_plan_has_common_edge(op_a, op_b)
-                    && !guac_display_plan_rect_crosses_boundary(&combined);
-
-            /* Image-drawing operations can be combined if doing so wouldn't
-             * exceed the size limits for images (we enforce size limits here
-             * to promote parallelism) */
-            case GUAC_DISPLAY_PLAN_OPERATION_IMG:
-                return !guac_display_plan_rect_crosses_boundary(&combined);
+                if (op_a->src.color == op_b->src.color
+                        && guac_display_plan_has_common_edge(op_a, op_b)) {
+                    *savings = GUAC_DISPLAY_INSTRUCTION_COST;
+                    return 1;
+                }
+                break;
 
-            /* Other combinations require more complex logic... (see below) */
+            /* Image operations are always combinable (see below) */
             default:
                 break;
 
         }
     }
 
-    /* Combine if result is still small */
-    int combined_width = guac_rect_width(&combined);
-    int combined_height = guac_rect_height(&combined);
-    if (combined_width <= GUAC_DISPLAY_NEGLIGIBLE_WIDTH && combined_height <= GUAC_DISPLAY_NEGLIGIBLE_HEIGHT)
-        return 1;
-
-    /* Estimate costs of the existing update, new update, and both combined */
-    int cost_ab = GUAC_DISPLAY_BASE_COST + combined_width * combined_height;
-    int cost_a  = GUAC_DISPLAY_BASE_COST + op_a->dirty_size;
-    int cost_b  = GUAC_DISPLAY_BASE_COST + op_b->dirty_size;
-
-    /* Reduce cost if no image data */
-    if (op_a->type != GUAC_DISPLAY_PLAN_OPERATION_IMG) cost_a /= GUAC_DISPLAY_DATA_FACTOR;
-    if (op_b->type != GUAC_DISPLAY_PLAN_OPERATION_IMG) cost_b /= GUAC_DISPLAY_DATA_FACTOR;
-
-    /* Combine if cost estimate shows benefit or the increase in cost is
-     * negligible */
-    if ((cost_ab <= cost_b + cost_a)
-            || (cost_ab - cost_a <= cost_a / GUAC_DISPLAY_NEGLIGIBLE_INCREASE)
-            || (cost_ab - cost_b <= cost_b / GUAC_DISPLAY_NEGLIGIBLE_INCREASE))
-        return 1;
-
-    /* Otherwise, do not combine */
-    return 0;
+    /* All other combinations result in an image covering both operations,
+     * including any unchanged area between them */
+    *savings = PFR_guac_display_plan_op_cost(op_a)
+        + PFR_guac_display_plan_op_cost(op_b)
+        - PFR_guac_display_plan_image_cost(op_a->layer, &combined);
+
+    return 1;
 
 }
 
 /**
- * Combines the given pair of operations into a single operation if doing so is
- * advantageous (results in an operation of lesser or negligibly-worse cost).
+ * Combines the given pair of operations into a single operation, storing the
+ * combined operation in the first operation and marking the second as a
+ * GUAC_DISPLAY_PLAN_OPERATION_NOP. The operations must have been verified as
+ * combinable with PFR_guac_display_plan_combine_savings().
  *
  * @param op_a
- *     The first of the pair of operations to be combined. If they operations
- *     are combined, the combined operation will be stored here.
+ *     The first of the pair of operations to be combined, which will receive
+ *     the combined operation.
  *
  * @param op_b
- *     The second of the pair of operations to be combined, which may
- *     potentially be identical to the first. If the operations are combined,
- *     this operation will be updated to be a GUAC_DISPLAY_PLAN_OPERATION_NOP
- *     operation.
- *
- * @return
- *     Non-zero if the operations were combined, zero otherwise.
+ *     The second of the pair of operations to be combined, which will be
+ *     updated to be a GUAC_DISPLAY_PLAN_OPERATION_NOP operation.
  */
-static int guac_display_plan_combine_if_improved(guac_display_plan_operation* op_a,
+static void guac_display_plan_combine_ops(guac_display_plan_operation* op_a,
         guac_display_plan_operation* op_b) {
 
-    if (op_a == op_b)
-        return 0;
-
-    /* Combine any adjacent operations that match the combination criteria
-     * (combining produces a net lower cost) */
-    if (guac_display_plan_should_combine(op_a, op_b)) {
-
-        guac_rect_extend(&op_a->dest, &op_b->dest);
-
-        /* Operations of different types can only be combined as images */
-        if (op_a->type != op_b->type)
-            op_a->type = GUAC_DISPLAY_PLAN_OPERATION_IMG;
+    guac_rect_extend(&op_a->dest, &op_b->dest);
 
-        /* When combining two copy operations, additionally combine their
-         * source rects (NOT just the destination rects) */
-        else if (op_a->type == GUAC_DISPLAY_PLAN_OPERATION_COPY)
-            guac_rect_extend(&op_a->src.layer_rect.rect, &op_b->src.layer_rect.rect);
+    /* Operations of different types can only be combined as images */
+    if (op_a->type != op_b->type)
+        op_a->type = GUAC_DISPLAY_PLAN_OPERATION_IMG;
 
-        op_a->dirty_size += op_b->dirty_size;
+    /* When combining two copy operations, additionally combine their source
+     * rects (NOT just the destination rects) */
+    else if (op_a->type == GUAC_DISPLAY_PLAN_OPERATION_COPY)
+        guac_rect_extend(&op_a->src.layer_rect.rect, &op_b->src.layer_rect.rect);
 
-        if (op_b->last_frame > op_a->last_frame)
-            op_a->last_frame = op_b->last_frame;
+    op_a->dirty_size += op_b->dirty_size;
 
-        op_b->type = GUAC_DISPLAY_PLAN_OPERATION_NOP;
+    if (op_b->last_frame > op_a->last_frame)
+        op_a->last_frame = op_b->last_frame;
 
-        return 1;
-
-    }
-
-    return 0;
+    op_b->type = GUAC_DISPLAY_PLAN_OPERATION_NOP;
 
 }
 
-void PFW_guac_display_plan_combine_horizontally(guac_display_plan* plan) {
+void PFW_guac_display_plan_combine(guac_display_plan* plan) {
 
     guac_display* display = plan->display;
     guac_display_layer* current = display->pending_frame.layers;
@@ -259,70 +346,50 @@ void PFW_guac_display_plan_combine_horizontally(guac_display_plan* plan) {
         if (!guac_rect_is_empty(&current->pending_frame.dirty)) {
 
             /* Loop through all cells in left-to-right, top-to-bottom order,
-             * combining any operations that are combinable and horizontally
-             * adjacent. */
-
+             * combining the operation of each cell with the operation of the
+             * cell to its left or the cell above it, whichever saves more.
+             * Each operation is thus grown in both directions within a single
+             * pass. Operations are only ever combined into operations of
+             * cells that have already been visited, hence the operation of
+             * the cell being visited is always that cell's own operation. */
+
+            int width = current->pending_frame_cells_width;
             guac_display_layer_cell* cell = current->pending_frame_cells;
             for (int y = 0; y < current->pending_frame_cells_height; y++) {
-
-                guac_display_layer_cell* previous = cell++;
-                for (int x = 1; x < current->pending_frame_cells_width; x++) {
-
-                    /* Combine adjacent updates if doing so is advantageous */
-                    if (previous->related_op != NULL && cell->related_op != NULL
-                            && guac_display_plan_combine_if_improved(previous->related_op, cell->related_op)) {
-                        cell->related_op = previous->related_op;
+                for (int x = 0; x < width; x++, cell++) {
+
+                    guac_display_plan_operation* op = cell->related_op;
+                    if (op == NULL)
+                        continue;
+
+                    guac_display_plan_operation* best = NULL;
+                    int64_t best_savings = 0;
+                    int64_t savings;
+
+                    /* Consider combining with the operation to the left */
+                    guac_display_plan_operation* left = (x > 0) ? cell[-1].related_op : NULL;
+                    if (left != NULL
+                            && PFR_guac_display_plan_combine_savings(left, op, &savings)
+                            && savings >= best_savings) {
+                        best = left;
+                        best_savings = savings;
                     }
 
-                    previous++;
-                    cell++;
-
-                }
-            }
-
-        }
-
-        current = current->pending_frame.next;
-
-    }
-
-}
-
-void PFW_guac_display_plan_combine_vertically(guac_display_plan* plan) {
-
-    guac_display* display = plan->display;
-    guac_display_layer* current = display->pending_frame.layers;
-    while (current != NULL) {
-
-        /* Process only layers that have been modified */
-        if (!guac_rect_is_empty(&current->pending_frame.dirty)) {
-
-            /* Loop through all cells in top-to-bottom, left-to-right order,
-             * combining any operations that are combinable and horizontally
-             * adjacent. */
-
-            guac_display_layer_cell* cell_col = current->pending_frame_cells;
-            for (int x = 0; x < current->pending_frame_cells_width; x++) {
-
-                guac_display_layer_cell* previous = cell_col;
-                guac_display_layer_cell* cell = cell_col + current->pending_frame_cells_width;
-
-                for (int y = 1; y < current->pending_frame_cells_height; y++) {
-
-                    /* Combine adjacent updates if doing so is advantageous */
-                    if (previous->related_op != NULL && cell->related_op != NULL
-                            && guac_display_plan_has_common_edge(previous->related_op, cell->related_op)
-                            && guac_display_plan_combine_if_improved(previous->related_op, cell->related_op)) {
-                        cell->related_op = previous->related_op;
+                    /* Consider combining with the operation above */
+                    guac_display_plan_operation* above = (y > 0) ? cell[-width].related_op : NULL;
+                    if (above != NULL && above != left
+                            && PFR_guac_display_plan_combine_savings(above, op, &savings)
+                            && (best == NULL ? savings >= 0 : savings > best_savings)) {
+                        best = above;
+                        best_savings = savings;
                     }
 
-                    previous += current->pending_frame_cells_width;
-                    cell += current->pending_frame_cells_width;
+                    if (best != NULL) {
+                        guac_display_plan_combine_ops(best, op);
+                        cell->related_op = best;
+                    }
 
                 }
-
-                cell_col++;
-
             }
 
         }
@@ -0,0 +1,296 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "display-plan.h"
+#include "display-priv.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define GUAC_DISPLAY_PLAN_DIFF_SSE2
+#endif
+
+#ifdef HAVE_AVX2_TARGET
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GUAC_DISPLAY_PLAN_DIFF_NEON
+#endif
+
+/**
+ * Returns a mask of the pixels that differ between the given buffers, where
+ * each bit of the mask corresponds to a single pixel, starting with the least
+ * significant bit. The buffers are compared one pixel at a time.
+ *
+ * @param buffer_a
+ *     The first buffer to compare.
+ *
+ * @param buffer_b
+ *     The buffer to compare with buffer_a.
+ *
+ * @param count
+ *     The number of pixels to compare. This value MUST NOT exceed 64.
+ *
+ * @return
+ *     A mask of the pixels that differ between the given buffers.
+ */
+static inline uint64_t guac_display_plan_diff_pixels(
+        const uint32_t* restrict buffer_a, const uint32_t* restrict buffer_b,
+        int count) {
+
+    uint64_t changed = 0;
+    for (int i = 0; i < count; i++)
+        changed |= ((uint64_t) (buffer_a[i] != buffer_b[i])) << i;
+
+    return changed;
+
+}
+
+void guac_display_plan_diff_row_scalar(const uint32_t* restrict buffer_a,
+        const uint32_t* restrict buffer_b, int width,
+        uint64_t* restrict changed) {
+
+    for (int x = 0; x < width; x += GUAC_DISPLAY_CELL_SIZE) {
+
+        int count = width - x;
+        if (count > GUAC_DISPLAY_CELL_SIZE)
+            count = GUAC_DISPLAY_CELL_SIZE;
+
+        *(changed++) = guac_display_plan_diff_pixels(buffer_a + x,
+                buffer_b + x, count);
+
+    }
+
+}
+
+#ifdef GUAC_DISPLAY_PLAN_DIFF_SSE2
+
+/**
+ * SSE2 implementation of guac_display_plan_diff_row_function, comparing four
+ * pixels at a time. SSE2 is part of the baseline x86-64 instruction set and
+ * thus requires no runtime check.
+ *
+ * @see guac_display_plan_diff_row_function
+ */
+static void guac_display_plan_diff_row_sse2(const uint32_t* restrict buffer_a,
+        const uint32_t* restrict buffer_b, int width,
+        uint64_t* restrict changed) {
+
+    for (int x = 0; x < width; x += GUAC_DISPLAY_CELL_SIZE) {
+
+        int count = width - x;
+        if (count > GUAC_DISPLAY_CELL_SIZE)
+            count = GUAC_DISPLAY_CELL_SIZE;
+
+        /* Compare four pixels at a time, building a mask of pixels that are
+         * identical ... */
+        uint64_t same = 0;
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+
+            __m128i a = _mm_loadu_si128((const __m128i*) (buffer_a + x + i));
+            __m128i b = _mm_loadu_si128((const __m128i*) (buffer_b + x + i));
+
+            uint64_t equal = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b)));
+            same |= equal << i;
+
+        }
+
+        /* ... and invert that mask to produce the mask of pixels that differ,
+         * comparing any remaining pixels individually */
+        uint64_t mask = ~same;
+        if (i < GUAC_DISPLAY_CELL_SIZE)
+            mask &= (1ULL << i) - 1;
+
+        if (i < count)
+            mask |= guac_display_plan_diff_pixels(buffer_a + x + i,
+                    buffer_b + x + i, count - i) << i;
+
+        *(changed++) = mask;
+
+    }
+
+}
+
+#endif
+
+#ifdef HAVE_AVX2_TARGET
+
+/**
+ * AVX2 implementation of guac_display_plan_diff_row_function, comparing eight
+ * pixels at a time.
+ *
+ * @see guac_display_plan_diff_row_function
+ */
+__attribute__((target("avx2")))
+static void guac_display_plan_diff_row_avx2(const uint32_t* restrict buffer_a,
+        const uint32_t* restrict buffer_b, int width,
+        uint64_t* restrict changed) {
+
+    for (int x = 0; x < width; x += GUAC_DISPLAY_CELL_SIZE) {
+
+        int count = width - x;
+        if (count > GUAC_DISPLAY_CELL_SIZE)
+            count = GUAC_DISPLAY_CELL_SIZE;
+
+        /* Compare eight pixels at a time, building a mask of pixels that are
+         * identical ... */
+        uint64_t same = 0;
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+
+            __m256i a = _mm256_loadu_si256((const __m256i*) (buffer_a + x + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*) (buffer_b + x + i));
+
+            uint64_t equal = (uint32_t) _mm256_movemask_ps(
+                    _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)));
+            same |= equal << i;
+
+        }
+
+        /* ... and invert that mask to produce the mask of pixels that differ,
+         * comparing any remaining pixels individually */
+        uint64_t mask = ~same;
+        if (i < GUAC_DISPLAY_CELL_SIZE)
+            mask &= (1ULL << i) - 1;
+
+        if (i < count)
+            mask |= guac_display_plan_diff_pixels(buffer_a + x + i,
+                    buffer_b + x + i, count - i) << i;
+
+        *(changed++) = mask;
+
+    }
+
+}
+
+#endif
+
+#ifdef GUAC_DISPLAY_PLAN_DIFF_NEON
+
+/**
+ * NEON implementation of guac_display_plan_diff_row_function, comparing four
+ * pixels at a time.
+ *
+ * @see guac_display_plan_diff_row_function
+ */
+static void guac_display_plan_diff_row_neon(const uint32_t* restrict buffer_a,
+        const uint32_t* restrict buffer_b, int width,
+        uint64_t* restrict changed) {
+
+    /* Weight of each lane when reducing a comparison result to a bitmask */
+    const uint32x4_t lane_bits = { 1, 2, 4, 8 };
+
+    for (int x = 0; x < width; x += GUAC_DISPLAY_CELL_SIZE) {
+
+        int count = width - x;
+        if (count > GUAC_DISPLAY_CELL_SIZE)
+            count = GUAC_DISPLAY_CELL_SIZE;
+
+        /* Compare four pixels at a time, building a mask of pixels that
+         * differ */
+        uint64_t mask = 0;
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+
+            uint32x4_t a = vld1q_u32(buffer_a + x + i);
+            uint32x4_t b = vld1q_u32(buffer_b + x + i);
+
+            uint64_t differ = vaddvq_u32(vandq_u32(
+                        vmvnq_u32(vceqq_u32(a, b)), lane_bits));
+            mask |= differ << i;
+
+        }
+
+        /* Compare any remaining pixels individually */
+        if (i < count)
+            mask |= guac_display_plan_diff_pixels(buffer_a + x + i,
+                    buffer_b + x + i, count - i) << i;
+
+        *(changed++) = mask;
+
+    }
+
+}
+
+#endif
+
+/**
+ * The implementation of guac_display_plan_diff_row_function that should be
+ * used on the current CPU. This is initialized exactly once, upon first use,
+ * by guac_display_plan_diff_init().
+ */
+static guac_display_plan_diff_row_function* guac_display_plan_diff_row_impl =
+    guac_display_plan_diff_row_scalar;
+
+/**
+ * Human-readable name of the implementation stored within
+ * guac_display_plan_diff_row_impl.
+ */
+static const char* guac_display_plan_diff_row_impl_name = "scalar";
+
+/**
+ * Control used to ensure guac_display_plan_diff_init() is invoked only once.
+ */
+static pthread_once_t guac_display_plan_diff_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Selects the fastest implementation of guac_display_plan_diff_row_function
+ * that is supported by the current CPU. This function must be invoked only
+ * through pthread_once() with guac_display_plan_diff_once.
+ */
+static void guac_display_plan_diff_init(void) {
+
+#ifdef HAVE_AVX2_TARGET
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        guac_display_plan_diff_row_impl = guac_display_plan_diff_row_avx2;
+        guac_display_plan_diff_row_impl_name = "avx2";
+        return;
+    }
+#endif
+
+#ifdef GUAC_DISPLAY_PLAN_DIFF_SSE2
+    guac_display_plan_diff_row_impl = guac_display_plan_diff_row_sse2;
+    guac_display_plan_diff_row_impl_name = "sse2";
+#endif
+
+#ifdef GUAC_DISPLAY_PLAN_DIFF_NEON
+    /* NEON is mandatory on AArch64 and needs no runtime check */
+    guac_display_plan_diff_row_impl = guac_display_plan_diff_row_neon;
+    guac_display_plan_diff_row_impl_name = "neon";
+#endif
+
+}
+
+guac_display_plan_diff_row_function* guac_display_plan_get_diff_row(void) {
+    pthread_once(&guac_display_plan_diff_once, guac_display_plan_diff_init);
+    return guac_display_plan_diff_row_impl;
+}
+
+const char* guac_display_plan_get_diff_row_name(void) {
+    pthread_once(&guac_display_plan_diff_once, guac_display_plan_diff_init);
+    return guac_display_plan_diff_row_impl_name;
+}
@@ -0,0 +1,392 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "display-plan.h"
+#include "display-priv.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef HAVE_AVX2_TARGET
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GUAC_DISPLAY_PLAN_HASH_NEON
+#endif
+
+/*
+ * NOTE: The hash produced here is a polynomial hash using a multiplier of 62
+ * (historically written as "(hash * 31) << 1"). Because 62 is even, 62^64 is a
+ * multiple of 2^64 and thus zero once truncated to 64 bits. The contribution
+ * of any pixel (or row) therefore vanishes automatically after 64 further
+ * pixels (or rows), which is what makes this a sliding 64x64 window without
+ * any explicit subtraction step.
+ *
+ * The SIMD implementations below rely on the same observation in two ways.
+ * First, the row segment hash at column x can be rewritten in terms of the
+ * hash N columns prior:
+ *
+ *     hash[x] = hash[x - N] * 62^N + (p[x - N + 1] * 62^(N - 1) + ... + p[x])
+ *
+ * where the parenthesized term depends only on nearby pixels, and where the
+ * preceding hashes for N consecutive columns are exactly the contents of the
+ * previous vector. Second, as any hash depends only on the 64 pixels ending at
+ * its column, a long row can be split into independent halves, with the hash
+ * of the second half being "warmed up" using only the 64 pixels preceding it.
+ * Hashing both halves at once hides the latency of the multiplication that
+ * would otherwise serialize each vector with the next.
+ */
+
+/**
+ * 62^2, truncated to 64 bits.
+ */
+#define GUAC_DISPLAY_PLAN_HASH_POW2 3844ULL
+
+/**
+ * 62^3, truncated to 64 bits.
+ */
+#define GUAC_DISPLAY_PLAN_HASH_POW3 238328ULL
+
+/**
+ * 62^4, truncated to 64 bits.
+ */
+#define GUAC_DISPLAY_PLAN_HASH_POW4 14776336ULL
+
+/**
+ * The minimum width of a row, in pixels, for that row to be split into two
+ * independently-hashed halves. Each half must be at least large enough to
+ * warm up the sliding window of the second half (64 pixels).
+ */
+#define GUAC_DISPLAY_PLAN_HASH_SPLIT_WIDTH 256
+
+void guac_display_plan_hash_row_scalar(const uint32_t* restrict row,
+        int width, uint64_t* restrict cell_hash) {
+
+    uint64_t row_hash = 0;
+    for (int x = 0; x < width; x++) {
+
+        /* Update hash value for current row segment */
+        row_hash = ((row_hash * 31) << 1) + row[x];
+
+        /* Incorporate row hash value into overall cell hash */
+        cell_hash[x] = ((cell_hash[x] * 31) << 1) + row_hash;
+
+    }
+
+}
+
+#ifdef HAVE_AVX2_TARGET
+
+/**
+ * Loads four consecutive 32-bit pixels, widening each to 64 bits.
+ *
+ * @param pixels
+ *     A pointer to the first of the four pixels. This pointer need not be
+ *     aligned.
+ *
+ * @return
+ *     A vector containing the four pixels, each within its own 64-bit lane.
+ */
+__attribute__((target("avx2")))
+static inline __m256i guac_display_plan_hash_load_avx2(const uint32_t* pixels) {
+    return _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*) pixels));
+}
+
+/**
+ * Calculates the row segment hashes of the four consecutive columns starting
+ * at the given column, given the row segment hashes of the four columns that
+ * precede it. The given column MUST be at least 3, as the three pixels
+ * preceding that column are read.
+ *
+ * @param row
+ *     The first pixel of the row being hashed.
+ *
+ * @param x
+ *     The first of the four columns to hash.
+ *
+ * @param previous
+ *     The row segment hashes of columns x - 4 through x - 1.
+ *
+ * @return
+ *     The row segment hashes of columns x through x + 3.
+ */
+__attribute__((target("avx2")))
+static inline __m256i guac_display_plan_hash_step_avx2(const uint32_t* row,
+        int x, __m256i previous) {
+
+    /* NOTE: _mm256_mul_epu32() multiplies only the low 32 bits of each lane,
+     * which is sufficient for the (32-bit) pixels and powers of 62 less than
+     * 2^32, but the 64-bit previous hashes must be multiplied in halves */
+
+    __m256i pow4 = _mm256_set1_epi64x(GUAC_DISPLAY_PLAN_HASH_POW4);
+    __m256i carry = _mm256_add_epi64(
+            _mm256_mul_epu32(previous, pow4),
+            _mm256_slli_epi64(_mm256_mul_epu32(
+                    _mm256_srli_epi64(previous, 32), pow4), 32));
+
+    __m256i hash = _mm256_add_epi64(carry,
+            guac_display_plan_hash_load_avx2(row + x));
+
+    hash = _mm256_add_epi64(hash, _mm256_mul_epu32(
+                guac_display_plan_hash_load_avx2(row + x - 1),
+                _mm256_set1_epi64x(62)));
+
+    hash = _mm256_add_epi64(hash, _mm256_mul_epu32(
+                guac_display_plan_hash_load_avx2(row + x - 2),
+                _mm256_set1_epi64x(GUAC_DISPLAY_PLAN_HASH_POW2)));
+
+    hash = _mm256_add_epi64(hash, _mm256_mul_epu32(
+                guac_display_plan_hash_load_avx2(row + x - 3),
+                _mm256_set1_epi64x(GUAC_DISPLAY_PLAN_HASH_POW3)));
+
+    return hash;
+
+}
+
+/**
+ * Incorporates the given row segment hashes into the cell hashes of the four
+ * consecutive columns starting at the given column.
+ *
+ * @param cell_hash
+ *     The array of cell hashes being updated.
+ *
+ * @param x
+ *     The first of the four columns to update.
+ *
+ * @param row_hash
+ *     The row segment hashes of columns x through x + 3.
+ */
+__attribute__((target("avx2")))
+static inline void guac_display_plan_hash_update_avx2(uint64_t* cell_hash,
+        int x, __m256i row_hash) {
+
+    __m256i* current = (__m256i*) (cell_hash + x);
+    __m256i cell = _mm256_loadu_si256(current);
+
+    /* 62 * cell == 64 * cell - 2 * cell */
+    cell = _mm256_sub_epi64(_mm256_slli_epi64(cell, 6),
+            _mm256_slli_epi64(cell, 1));
+
+    _mm256_storeu_si256(current, _mm256_add_epi64(cell, row_hash));
+
+}
+
+/**
+ * AVX2 implementation of guac_display_plan_hash_row_function, processing four
+ * columns at a time within each of two halves of the row.
+ *
+ * @see guac_display_plan_hash_row_function
+ */
+__attribute__((target("avx2")))
+static void guac_display_plan_hash_row_avx2(const uint32_t* restrict row,
+        int width, uint64_t* restrict cell_hash) {
+
+    /* Rows too narrow to fill a single vector are hashed as usual */
+    if (width < 4) {
+        guac_display_plan_hash_row_scalar(row, width, cell_hash);
+        return;
+    }
+
+    /* The first four columns must be hashed individually, as there are no
+     * preceding columns to read */
+    uint64_t initial[4];
+    uint64_t row_hash = 0;
+    for (int x = 0; x < 4; x++) {
+        row_hash = ((row_hash * 31) << 1) + row[x];
+        cell_hash[x] = ((cell_hash[x] * 31) << 1) + row_hash;
+        initial[x] = row_hash;
+    }
+
+    int end = width & ~3;
+    __m256i first_hash = _mm256_loadu_si256((const __m256i*) initial);
+    __m256i last_hash;
+
+    /* Narrow rows are not worth splitting */
+    if (width < GUAC_DISPLAY_PLAN_HASH_SPLIT_WIDTH) {
+
+        for (int x = 4; x < end; x += 4) {
+            first_hash = guac_display_plan_hash_step_avx2(row, x, first_hash);
+            guac_display_plan_hash_update_avx2(cell_hash, x, first_hash);
+        }
+
+        last_hash = first_hash;
+
+    }
+
+    else {
+
+        int half = (width / 2) & ~3;
+
+        /* The second half begins 64 pixels early to warm up its sliding
+         * window, without updating any cell hashes until the window is valid */
+        __m256i second_hash = _mm256_setzero_si256();
+        int first_x = 4;
+        int second_x = half - GUAC_DISPLAY_CELL_SIZE;
+
+        for (; second_x < half; first_x += 4, second_x += 4) {
+            first_hash = guac_display_plan_hash_step_avx2(row, first_x, first_hash);
+            guac_display_plan_hash_update_avx2(cell_hash, first_x, first_hash);
+            second_hash = guac_display_plan_hash_step_avx2(row, second_x, second_hash);
+        }
+
+        /* Hash both halves at once for as long as possible */
+        for (; first_x < half && second_x < end; first_x += 4, second_x += 4) {
+            first_hash = guac_display_plan_hash_step_avx2(row, first_x, first_hash);
+            guac_display_plan_hash_update_avx2(cell_hash, first_x, first_hash);
+            second_hash = guac_display_plan_hash_step_avx2(row, second_x, second_hash);
+            guac_display_plan_hash_update_avx2(cell_hash, second_x, second_hash);
+        }
+
+        /* Finish whichever half remains (the halves may differ in length) */
+
+        for (; first_x < half; first_x += 4) {
+            first_hash = guac_display_plan_hash_step_avx2(row, first_x, first_hash);
+            guac_display_plan_hash_update_avx2(cell_hash, first_x, first_hash);
+        }
+
+        for (; second_x < end; second_x += 4) {
+            second_hash = guac_display_plan_hash_step_avx2(row, second_x, second_hash);
+            guac_display_plan_hash_update_avx2(cell_hash, second_x, second_hash);
+        }
+
+        last_hash = second_hash;
+
+    }
+
+    /* Handle any remaining pixels one at a time */
+    row_hash = (uint64_t) _mm256_extract_epi64(last_hash, 3);
+    for (int x = end; x < width; x++) {
+        row_hash = ((row_hash * 31) << 1) + row[x];
+        cell_hash[x] = ((cell_hash[x] * 31) << 1) + row_hash;
+    }
+
+}
+
+#endif
+
+#ifdef GUAC_DISPLAY_PLAN_HASH_NEON
+
+/**
+ * NEON implementation of guac_display_plan_hash_row_function, processing two
+ * columns at a time.
+ *
+ * @see guac_display_plan_hash_row_function
+ */
+static void guac_display_plan_hash_row_neon(const uint32_t* restrict row,
+        int width, uint64_t* restrict cell_hash) {
+
+    /* The first two columns must be hashed individually, as there are no
+     * preceding columns to read */
+    uint64_t initial[2] = { 0 };
+    uint64_t row_hash = 0;
+    int x = 0;
+    for (; x < 2 && x < width; x++) {
+        row_hash = ((row_hash * 31) << 1) + row[x];
+        cell_hash[x] = ((cell_hash[x] * 31) << 1) + row_hash;
+        initial[x] = row_hash;
+    }
+
+    uint64x2_t hash = vld1q_u64(initial);
+    const uint32x2_t pow2 = vdup_n_u32(GUAC_DISPLAY_PLAN_HASH_POW2);
+
+    for (; x + 2 <= width; x += 2) {
+
+        /* NEON lacks a 64x64-bit multiply, so the previous hashes must be
+         * multiplied by 62^2 in halves */
+        uint64x2_t carry = vaddq_u64(
+                vmull_u32(vmovn_u64(hash), pow2),
+                vshlq_n_u64(vmull_u32(vshrn_n_u64(hash, 32), pow2), 32));
+
+        hash = vaddq_u64(carry, vmovl_u32(vld1_u32(row + x)));
+        hash = vaddq_u64(hash, vmull_u32(vld1_u32(row + x - 1), vdup_n_u32(62)));
+
+        /* Incorporate row hash values into overall cell hashes, where
+         * 62 * cell == 64 * cell - 2 * cell */
+        uint64x2_t cell = vld1q_u64(cell_hash + x);
+        cell = vsubq_u64(vshlq_n_u64(cell, 6), vshlq_n_u64(cell, 1));
+        vst1q_u64(cell_hash + x, vaddq_u64(cell, hash));
+
+    }
+
+    /* Handle any remaining pixel */
+    row_hash = vgetq_lane_u64(hash, 1);
+    for (; x < width; x++) {
+        row_hash = ((row_hash * 31) << 1) + row[x];
+        cell_hash[x] = ((cell_hash[x] * 31) << 1) + row_hash;
+    }
+
+}
+
+#endif
+
+/**
+ * The implementation of guac_display_plan_hash_row() that should be used on
+ * the current CPU. This is initialized exactly once, upon first use, by
+ * guac_display_plan_hash_init().
+ */
+static guac_display_plan_hash_row_function* guac_display_plan_hash_row_impl =
+    guac_display_plan_hash_row_scalar;
+
+/**
+ * Human-readable name of the implementation stored within
+ * guac_display_plan_hash_row_impl.
+ */
+static const char* guac_display_plan_hash_row_impl_name = "scalar";
+
+/**
+ * Control used to ensure guac_display_plan_hash_init() is invoked only once.
+ */
+static pthread_once_t guac_display_plan_hash_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Selects the fastest implementation of guac_display_plan_hash_row() that is
+ * supported by the current CPU. This function must be invoked only through
+ * pthread_once() with guac_display_plan_hash_once.
+ */
+static void guac_display_plan_hash_init(void) {
+
+#ifdef HAVE_AVX2_TARGET
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        guac_display_plan_hash_row_impl = guac_display_plan_hash_row_avx2;
+        guac_display_plan_hash_row_impl_name = "avx2";
+        return;
+    }
+#endif
+
+#ifdef GUAC_DISPLAY_PLAN_HASH_NEON
+    /* NEON is mandatory on AArch64 and needs no runtime check */
+    guac_display_plan_hash_row_impl = guac_display_plan_hash_row_neon;
+    guac_display_plan_hash_row_impl_name = "neon";
+#endif
+
+}
+
+guac_display_plan_hash_row_function* guac_display_plan_get_hash_row(void) {
+    pthread_once(&guac_display_plan_hash_once, guac_display_plan_hash_init);
+    return guac_display_plan_hash_row_impl;
+}
+
+const char* guac_display_plan_get_hash_row_name(void) {
+    pthread_once(&guac_display_plan_hash_once, guac_display_plan_hash_init);
+    return guac_display_plan_hash_row_impl_name;
+}
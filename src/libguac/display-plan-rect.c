@@ -202,12 +202,26 @@ static int guac_display_plan_is_rect_single_color(const unsigned char* restrict
 
 }
 
-void PFR_guac_display_plan_rewrite_as_rects(guac_display_plan* plan) {
+/**
+ * Replaces draw operations with simple rects wherever draws consist only of a
+ * single color, considering only the operations within the given band of the
+ * plan's operations. As operations are added to a plan in top-to-bottom
+ * order, each band roughly corresponds to a horizontal band of the display.
+ * This function is a guac_display_plan_band_callback, and the given data must
+ * be the guac_display_plan being rewritten.
+ *
+ * @see guac_display_plan_band_callback
+ */
+static void PFR_guac_display_plan_rewrite_band_as_rects(void* data, int band, int bands) {
 
+    guac_display_plan* plan = (guac_display_plan*) data;
     uint32_t color = 0x00000000;
 
-    guac_display_plan_operation* op = plan->ops;
-    for (int i = 0; i < plan->length; i++) {
+    size_t first = plan->length * band / bands;
+    size_t last = plan->length * (band + 1) / bands;
+
+    guac_display_plan_operation* op = plan->ops + first;
+    for (size_t i = first; i < last; i++) {
 
         if (op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG) {
 
@@ -238,3 +252,14 @@ void PFR_guac_display_plan_rewrite_as_rects(guac_display_plan* plan) {
     }
 
 }
+
+void PFR_guac_display_plan_rewrite_as_rects(guac_display_plan* plan) {
+
+    /* Each operation is at most a single cell at this point */
+    int bands = guac_display_plan_band_count(plan->display,
+            plan->length * GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_CELL_SIZE);
+
+    guac_display_plan_run_bands(plan->display, bands,
+            PFR_guac_display_plan_rewrite_band_as_rects, plan);
+
+}
@@ -0,0 +1,465 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-plan.h"
+#include "display-priv.h"
+#include "guacamole/display.h"
+#include "guacamole/rect.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The initial value of each row or column hash (the 64-bit FNV offset
+ * basis).
+ */
+#define GUAC_DISPLAY_PLAN_SCROLL_HASH_BASIS 0xCBF29CE484222325ULL
+
+/**
+ * The multiplier applied when incorporating each pixel into a row or column
+ * hash (the 64-bit FNV prime).
+ */
+#define GUAC_DISPLAY_PLAN_SCROLL_HASH_PRIME 0x100000001B3ULL
+
+/**
+ * Incorporates the given pixel into the given row or column hash.
+ *
+ * @param hash
+ *     The hash of all previous pixels in the same row or column.
+ *
+ * @param pixel
+ *     The pixel to incorporate.
+ *
+ * @return
+ *     The hash of all previous pixels and the given pixel.
+ */
+static inline uint64_t guac_display_plan_scroll_hash(uint64_t hash,
+        uint32_t pixel) {
+    return (hash ^ pixel) * GUAC_DISPLAY_PLAN_SCROLL_HASH_PRIME;
+}
+
+/**
+ * Returns the slot at which the search for the given line hash should begin
+ * within an open-addressed table of the given size.
+ *
+ * @param hash
+ *     The line hash to look up.
+ *
+ * @param size
+ *     The number of slots in the table. This MUST be a power of two.
+ *
+ * @return
+ *     The slot at which the search for the given hash should begin.
+ */
+static size_t guac_display_plan_shift_slot(uint64_t hash, size_t size) {
+    return (size_t) ((hash ^ (hash >> 29)) * 0x9E3779B97F4A7C15ULL >> 17)
+        & (size - 1);
+}
+
+int guac_display_plan_find_shift(guac_display_arena* arena,
+        const uint64_t* old_hashes, const uint64_t* new_hashes, int count,
+        int min_length, guac_display_plan_shift* shift) {
+
+    if (count < min_length || count < 2)
+        return 0;
+
+    /* Index every line of the old frame by hash. Each slot contains one plus
+     * the index of the line having that hash, negated if multiple lines share
+     * that hash (such lines, like blank rows, say nothing about where any
+     * particular line has moved), or zero if the slot is unused. */
+    size_t size = 1;
+    while (size < (size_t) count * 2)
+        size <<= 1;
+
+    int* table = guac_display_arena_alloc(arena, size, sizeof(int));
+    memset(table, 0, size * sizeof(int));
+
+    for (int j = 0; j < count; j++) {
+
+        uint64_t hash = old_hashes[j];
+        size_t slot = guac_display_plan_shift_slot(hash, size);
+
+        while (table[slot] != 0) {
+
+            int entry = abs(table[slot]) - 1;
+            if (old_hashes[entry] == hash) {
+                table[slot] = -(entry + 1);
+                break;
+            }
+
+            slot = (slot + 1) & (size - 1);
+
+        }
+
+        if (table[slot] == 0)
+            table[slot] = j + 1;
+
+    }
+
+    /* Each distinct line of the new frame that exists exactly once within
+     * the old frame votes for the offset that it has moved by. Offsets range
+     * from -(count - 1) to count - 1 and are stored relative to count. */
+    int* votes = guac_display_arena_alloc(arena, count * 2, sizeof(int));
+    memset(votes, 0, count * 2 * sizeof(int));
+
+    for (int i = 0; i < count; i++) {
+
+        uint64_t hash = new_hashes[i];
+
+        /* Consecutive identical lines (solid areas) vote only once */
+        if (i > 0 && new_hashes[i - 1] == hash)
+            continue;
+
+        size_t slot = guac_display_plan_shift_slot(hash, size);
+        while (table[slot] != 0) {
+
+            int entry = abs(table[slot]) - 1;
+            if (old_hashes[entry] == hash) {
+                if (table[slot] > 0 && entry != i)
+                    votes[i - entry + count]++;
+                break;
+            }
+
+            slot = (slot + 1) & (size - 1);
+
+        }
+
+    }
+
+    int best = 0;
+    for (int i = 1; i < count * 2; i++) {
+        if (votes[i] > votes[best])
+            best = i;
+    }
+
+    if (votes[best] == 0)
+        return 0;
+
+    /* Locate the longest run of lines that have all moved by the dominant
+     * offset, including lines that could not vote (any line of a solid area
+     * matches equally well at every offset) */
+    int offset = best - count;
+    int first = offset > 0 ? offset : 0;
+    int last = offset < 0 ? count + offset : count;
+
+    int run_start = first;
+    int best_start = first;
+    int best_length = 0;
+
+    for (int i = first; i < last; i++) {
+
+        if (new_hashes[i] != old_hashes[i - offset]) {
+            run_start = i + 1;
+            continue;
+        }
+
+        if (i + 1 - run_start > best_length) {
+            best_start = run_start;
+            best_length = i + 1 - run_start;
+        }
+
+    }
+
+    if (best_length < min_length)
+        return 0;
+
+    shift->offset = offset;
+    shift->start = best_start;
+    shift->length = best_length;
+    return 1;
+
+}
+
+/**
+ * A run of adjacent segments of a layer (vertical strips or horizontal
+ * bands) that have all shifted by the same offset, to be recorded as a
+ * single copy hint.
+ */
+typedef struct guac_display_plan_scroll_group {
+
+    /**
+     * The position of the first segment of the group, in pixels along the
+     * axis perpendicular to the shift.
+     */
+    int segment_start;
+
+    /**
+     * The position just past the last segment of the group, in pixels along
+     * the axis perpendicular to the shift.
+     */
+    int segment_end;
+
+    /**
+     * The shift shared by all segments of the group, with the start and
+     * length narrowed to the lines that have shifted within every segment.
+     */
+    guac_display_plan_shift shift;
+
+} guac_display_plan_scroll_group;
+
+/**
+ * Records the given group of shifted segments as a copy hint within the
+ * pending frame of the given layer, if room remains for another hint.
+ *
+ * @param layer
+ *     The layer to record the hint within.
+ *
+ * @param dirty
+ *     The dirty region of the layer that was searched, relative to which the
+ *     start of the shift of the group is expressed.
+ *
+ * @param group
+ *     The group of shifted segments to record.
+ *
+ * @param vertical
+ *     Non-zero if the segments are vertical strips that have shifted up or
+ *     down, zero if the segments are horizontal bands that have shifted left
+ *     or right.
+ */
+static void PFW_guac_display_plan_add_scroll_hint(guac_display_layer* layer,
+        const guac_rect* dirty, const guac_display_plan_scroll_group* group,
+        int vertical) {
+
+    guac_display_layer_state* state = &layer->pending_frame;
+    if (state->copy_hint_count >= GUAC_DISPLAY_LAYER_MAX_COPY_HINTS)
+        return;
+
+    const guac_display_plan_shift* shift = &group->shift;
+    guac_display_copy_hint* hint = &state->copy_hints[state->copy_hint_count++];
+
+    if (vertical) {
+        guac_rect_init(&hint->dest, group->segment_start,
+                dirty->top + shift->start,
+                group->segment_end - group->segment_start, shift->length);
+        hint->src_x = hint->dest.left;
+        hint->src_y = hint->dest.top - shift->offset;
+    }
+
+    else {
+        guac_rect_init(&hint->dest, dirty->left + shift->start,
+                group->segment_start, shift->length,
+                group->segment_end - group->segment_start);
+        hint->src_x = hint->dest.left - shift->offset;
+        hint->src_y = hint->dest.top;
+    }
+
+}
+
+/**
+ * Searches the dirty region of the given layer for segments (vertical strips
+ * one cell wide, or horizontal bands one cell tall, aligned with the cells of
+ * the layer) whose contents have shifted relative to the previous frame,
+ * recording each run of adjacent segments sharing the same shift as a copy
+ * hint.
+ *
+ * @param plan
+ *     The plan being created for the pending frame.
+ *
+ * @param layer
+ *     The layer to search.
+ *
+ * @param dirty
+ *     The dirty region of the layer.
+ *
+ * @param vertical
+ *     Non-zero to search for contents that have shifted up or down (as when
+ *     scrolling vertically), zero to search for contents that have shifted
+ *     left or right (as when scrolling horizontally).
+ *
+ * @return
+ *     The number of copy hints recorded.
+ */
+static int PFW_LFR_guac_display_plan_detect_layer_scroll(guac_display_plan* plan,
+        guac_display_layer* layer, const guac_rect* dirty, int vertical) {
+
+    guac_display_arena* arena = &plan->display->plan_arena;
+
+    int width = guac_rect_width(dirty);
+    int height = guac_rect_height(dirty);
+
+    /* Segments are perpendicular to the direction of the shift, and each
+     * segment consists of lines parallel to that direction */
+    int segment_origin = vertical ? dirty->left : dirty->top;
+    int segment_limit  = vertical ? dirty->right : dirty->bottom;
+    int lines = vertical ? height : width;
+
+    if (lines < GUAC_DISPLAY_PLAN_SCROLL_MIN_LENGTH)
+        return 0;
+
+    int first_cell = segment_origin / GUAC_DISPLAY_CELL_SIZE;
+    int segments = (segment_limit - 1) / GUAC_DISPLAY_CELL_SIZE - first_cell + 1;
+
+    size_t hash_count = (size_t) segments * lines;
+    uint64_t* old_hashes = guac_display_arena_alloc(arena, hash_count, sizeof(uint64_t));
+    uint64_t* new_hashes = guac_display_arena_alloc(arena, hash_count, sizeof(uint64_t));
+
+    for (size_t i = 0; i < hash_count; i++)
+        old_hashes[i] = new_hashes[i] = GUAC_DISPLAY_PLAN_SCROLL_HASH_BASIS;
+
+    /* Hash every line of every segment in a single pass over the rows of the
+     * dirty region of both frames, such that each frame is read in order */
+    const unsigned char* old_data = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->last_frame, *dirty);
+    const unsigned char* new_data = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->pending_frame, *dirty);
+
+    for (int y = 0; y < height; y++) {
+
+        const uint32_t* old_row = (const uint32_t*) old_data;
+        const uint32_t* new_row = (const uint32_t*) new_data;
+
+        /* Each row of a vertical strip is a line of that strip */
+        if (vertical) {
+
+            int x = 0;
+            for (int segment = 0; segment < segments; segment++) {
+
+                int end = (first_cell + segment + 1) * GUAC_DISPLAY_CELL_SIZE - dirty->left;
+                if (end > width)
+                    end = width;
+
+                size_t index = (size_t) segment * lines + y;
+                uint64_t old_hash = old_hashes[index];
+                uint64_t new_hash = new_hashes[index];
+
+                for (; x < end; x++) {
+                    old_hash = guac_display_plan_scroll_hash(old_hash, old_row[x]);
+                    new_hash = guac_display_plan_scroll_hash(new_hash, new_row[x]);
+                }
+
+                old_hashes[index] = old_hash;
+                new_hashes[index] = new_hash;
+
+            }
+
+        }
+
+        /* Each column of a horizontal band is a line of that band */
+        else {
+
+            size_t base = (size_t) ((dirty->top + y) / GUAC_DISPLAY_CELL_SIZE - first_cell) * lines;
+            uint64_t* old_line = old_hashes + base;
+            uint64_t* new_line = new_hashes + base;
+
+            for (int x = 0; x < width; x++) {
+                old_line[x] = guac_display_plan_scroll_hash(old_line[x], old_row[x]);
+                new_line[x] = guac_display_plan_scroll_hash(new_line[x], new_row[x]);
+            }
+
+        }
+
+        old_data += layer->last_frame.buffer_stride;
+        new_data += layer->pending_frame.buffer_stride;
+
+    }
+
+    /* Find the shift of each segment, grouping adjacent segments that share
+     * the same offset */
+    int hints = 0;
+    int grouped = 0;
+    guac_display_plan_scroll_group group;
+
+    for (int segment = 0; segment < segments; segment++) {
+
+        int segment_start = (first_cell + segment) * GUAC_DISPLAY_CELL_SIZE;
+        int segment_end = segment_start + GUAC_DISPLAY_CELL_SIZE;
+
+        if (segment_start < segment_origin) segment_start = segment_origin;
+        if (segment_end > segment_limit) segment_end = segment_limit;
+
+        guac_display_plan_shift shift;
+        int found = guac_display_plan_find_shift(arena,
+                old_hashes + (size_t) segment * lines,
+                new_hashes + (size_t) segment * lines,
+                lines, GUAC_DISPLAY_PLAN_SCROLL_MIN_LENGTH, &shift);
+
+        /* Extend the current group if this segment has shifted by the same
+         * offset over a sufficiently large common range of lines */
+        if (found && grouped && shift.offset == group.shift.offset) {
+
+            int start = shift.start > group.shift.start ? shift.start : group.shift.start;
+            int end_a = shift.start + shift.length;
+            int end_b = group.shift.start + group.shift.length;
+            int end = end_a < end_b ? end_a : end_b;
+
+            if (end - start >= GUAC_DISPLAY_PLAN_SCROLL_MIN_LENGTH) {
+                group.segment_end = segment_end;
+                group.shift.start = start;
+                group.shift.length = end - start;
+                continue;
+            }
+
+        }
+
+        /* Otherwise, the current group (if any) is complete */
+        if (grouped) {
+            PFW_guac_display_plan_add_scroll_hint(layer, dirty, &group, vertical);
+            hints++;
+            grouped = 0;
+        }
+
+        if (found) {
+            group.segment_start = segment_start;
+            group.segment_end = segment_end;
+            group.shift = shift;
+            grouped = 1;
+        }
+
+    }
+
+    if (grouped) {
+        PFW_guac_display_plan_add_scroll_hint(layer, dirty, &group, vertical);
+        hints++;
+    }
+
+    return hints;
+
+}
+
+void PFW_LFR_guac_display_plan_detect_scrolls(guac_display_plan* plan) {
+
+    guac_display_layer* current = plan->display->pending_frame.layers;
+    while (current != NULL) {
+
+        guac_display_layer_state* state = &current->pending_frame;
+        guac_rect dirty = state->dirty;
+
+        /* Contents can only have shifted within layers that may be searched
+         * for copies, that are not being resized, and for which the caller
+         * has not already described all copies explicitly */
+        if (state->buffer != NULL && current->last_frame.buffer != NULL
+                && state->search_for_copies
+                && state->copy_hint_count == 0
+                && !current->pending_frame_occluded
+                && !guac_rect_is_empty(&dirty)
+                && state->width == current->last_frame.width
+                && state->height == current->last_frame.height) {
+
+            /* Vertical scrolling is by far the most common, with horizontal
+             * scrolling considered only if no vertical shift is found */
+            if (!PFW_LFR_guac_display_plan_detect_layer_scroll(plan, current, &dirty, 1))
+                PFW_LFR_guac_display_plan_detect_layer_scroll(plan, current, &dirty, 0);
+
+        }
+
+        current = state->next;
+
+    }
+
+}
+
@@ -20,6 +20,7 @@
 #include "display-plan.h"
 #include "display-priv.h"
 #include "guacamole/display.h"
+#include "guacamole/mem.h"
 #include "guacamole/rect.h"
 
 #include <string.h>
@@ -51,6 +52,7 @@ static void guac_display_plan_store_indexed_op(guac_display_plan* plan, uint64_t
     if (entry->op == NULL) {
         entry->hash = hash;
         entry->op = op;
+        plan->indexed++;
     }
 
 }
@@ -83,6 +85,7 @@ static guac_display_plan_operation* guac_display_plan_remove_indexed_op(guac_dis
     guac_display_plan_operation* op = entry->op;
     if (op != NULL && entry->hash == hash) {
         entry->op = NULL;
+        plan->indexed--;
         return op;
     }
 
@@ -149,6 +152,9 @@ static int guac_hash_foreach_image_rect(guac_display_plan* plan,
     int x, y;
     uint64_t cell_hash[GUAC_DISPLAY_MAX_WIDTH] = { 0 };
 
+    /* Use the fastest available hash implementation for the current CPU */
+    guac_display_plan_hash_row_function* hash_row = guac_display_plan_get_hash_row();
+
     /* NOTE: Because the hash value of the sliding 64x64 window is available
      * only upon reaching the bottom-right corner of that window, we offset the
      * coordinates here by the relative location of the bottom-right corner
@@ -165,33 +171,22 @@ static int guac_hash_foreach_image_rect(guac_display_plan* plan,
     int start_y = rect->top    - GUAC_DISPLAY_CELL_SIZE + 1;
     int end_y   = rect->bottom - GUAC_DISPLAY_CELL_SIZE + 1;
 
-    for (y = start_y; y < end_y; y++) {
+    int width = end_x - start_x;
 
-        uint64_t* current_cell_hash = cell_hash;
+    for (y = start_y; y < end_y; y++) {
 
         /* Get current row */
-        uint32_t* row = (uint32_t*) data;
+        const uint32_t* row = (const uint32_t*) data;
         data += stride;
 
-        /* Calculate row segment hashes for entire row */
-        uint64_t row_hash = 0;
-        for (x = start_x; x < end_x; x++) {
-
-            /* Get current pixel */
-            uint32_t pixel = *(row++);
-
-            /* Update hash value for current row segment */
-            row_hash = ((row_hash * 31) << 1) + pixel;
-
-            /* Incorporate row hash value into overall cell hash */
-            uint64_t cell_hash = ((*current_cell_hash * 31) << 1) + row_hash;
-            *(current_cell_hash++) = cell_hash;
-
-            /* Invoke callback for every hash generated, breaking out early if
-             * requested */
-            if (y >= rect->top && x >= rect->left)
-                callback(plan, x, y, cell_hash, closure);
+        /* Calculate row segment hashes for entire row, incorporating those
+         * hashes into the overall cell hashes */
+        hash_row(row, width, cell_hash);
 
+        /* Invoke callback for every complete hash generated */
+        if (y >= rect->top) {
+            for (x = rect->left; x < end_x; x++)
+                callback(plan, x, y, cell_hash[x - start_x], closure);
         }
 
     } /* end for each row */
@@ -220,38 +215,76 @@ static void guac_display_cell_init_rect(guac_rect* rect, int x, int y) {
 }
 
 /**
- * Callback for guac_hash_foreach_image_rect() which stores the given operation
- * in the ops_by_hash table of the given display plan.
+ * Callback for guac_hash_foreach_image_rect() which records the given hash
+ * value within the given guac_display_plan_indexed_operation, such that the
+ * associated operation may later be stored in the ops_by_hash table of the
+ * display plan.
  *
  * @param plan
- *     The display plan to store the given operation in.
+ *     The display plan containing the operation being hashed.
  *
  * @param x
  *     The X coordinate of the upper-left corner of the 64x64 rectangle
- *     modified by the given operation.
+ *     modified by the operation.
  *
  * @param y
  *     The Y coordinate of the upper-left corner of the 64x64 rectangle
- *     modified by the given operation.
+ *     modified by the operation.
  *
  * @param hash
  *     The hash value that applies to the 64x64 rectangle at the given
  *     coordinates.
  *
  * @param closure
- *     A pointer to the guac_display_plan_operation that should be stored
- *     within the ops_by_hash table of the given display plan.
+ *     A pointer to the guac_display_plan_indexed_operation that should
+ *     receive the hash value.
  */
-static void guac_display_plan_index_op_for_cell(guac_display_plan* plan, int x, int y, uint64_t hash, void* closure) {
-    guac_display_plan_store_indexed_op(plan, hash, (guac_display_plan_operation*) closure);
+static void guac_display_plan_hash_op_for_cell(guac_display_plan* plan, int x, int y, uint64_t hash, void* closure) {
+    ((guac_display_plan_indexed_operation*) closure)->hash = hash;
 }
 
-void PFR_guac_display_plan_index_dirty_cells(guac_display_plan* plan) {
+/**
+ * The hashes of all operations within a guac_display_plan that are being
+ * calculated by PFR_guac_display_plan_index_dirty_cells().
+ */
+typedef struct guac_display_plan_index {
 
-    memset(plan->ops_by_hash, 0, sizeof(plan->ops_by_hash));
+    /**
+     * The display plan being indexed.
+     */
+    guac_display_plan* plan;
 
-    guac_display_plan_operation* op = plan->ops;
-    for (int i = 0; i < plan->length; i++) {
+    /**
+     * The hash of each operation in the plan, in the same order as the
+     * operations themselves. Operations that cannot be indexed are
+     * represented by entries whose op is NULL.
+     */
+    guac_display_plan_indexed_operation* hashed;
+
+} guac_display_plan_index;
+
+/**
+ * Calculates the hashes of all indexable draw operations within the given band
+ * of a plan's operations. As operations are added to a plan in top-to-bottom
+ * order, each band roughly corresponds to a horizontal band of the display.
+ * This function is a guac_display_plan_band_callback, and the given data must
+ * be the guac_display_plan_index receiving the hashes.
+ *
+ * @see guac_display_plan_band_callback
+ */
+static void PFR_guac_display_plan_hash_band(void* data, int band, int bands) {
+
+    guac_display_plan_index* index = (guac_display_plan_index*) data;
+    guac_display_plan* plan = index->plan;
+
+    size_t first = plan->length * band / bands;
+    size_t last = plan->length * (band + 1) / bands;
+
+    guac_display_plan_operation* op = plan->ops + first;
+    guac_display_plan_indexed_operation* hashed = index->hashed + first;
+    for (size_t i = first; i < last; i++) {
+
+        hashed->op = NULL;
 
         if (op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG) {
 
@@ -267,17 +300,51 @@ void PFR_guac_display_plan_index_dirty_cells(guac_display_plan* plan) {
             if (guac_rect_width(&cell) == GUAC_DISPLAY_CELL_SIZE
                     && guac_rect_height(&cell) == GUAC_DISPLAY_CELL_SIZE) {
                 guac_hash_foreach_image_rect(plan, &layer->pending_frame,
-                        &cell, guac_display_plan_index_op_for_cell, op);
+                        &cell, guac_display_plan_hash_op_for_cell, hashed);
+                hashed->op = op;
             }
 
         }
 
+        hashed++;
         op++;
 
     }
 
 }
 
+void PFR_guac_display_plan_index_dirty_cells(guac_display_plan* plan) {
+
+    memset(plan->ops_by_hash, 0, sizeof(plan->ops_by_hash));
+    plan->indexed = 0;
+
+    guac_display_plan_index index = {
+        .plan = plan,
+        .hashed = guac_display_arena_alloc(&plan->display->plan_arena,
+                plan->length, sizeof(guac_display_plan_indexed_operation))
+    };
+
+    /* Hashing is independent for each operation and may be split across the
+     * worker threads. Each operation is a single cell at this point. */
+    int bands = guac_display_plan_band_count(plan->display,
+            plan->length * GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_CELL_SIZE);
+
+    guac_display_plan_run_bands(plan->display, bands,
+            PFR_guac_display_plan_hash_band, &index);
+
+    /* Populate the index in the original order of the operations, as only the
+     * first operation having any particular hash is stored */
+    for (size_t i = 0; i < plan->length; i++) {
+        guac_display_plan_indexed_operation* hashed = &index.hashed[i];
+        if (hashed->op != NULL)
+            guac_display_plan_store_indexed_op(plan, hashed->hash, hashed->op);
+    }
+
+    /* Retain all hashes for later passes */
+    plan->hashed_ops = index.hashed;
+
+}
+
 /**
  * Compares two rectangular regions of two arbitrary buffers, returning whether
  * those regions contain identical data.
@@ -342,6 +409,114 @@ static int guac_image_cmp(const unsigned char* restrict data_a, int width_a, int
 
 }
 
+/**
+ * Returns whether the given rectangle lies entirely within the given
+ * containing rectangle.
+ *
+ * @param outer
+ *     The containing rectangle.
+ *
+ * @param inner
+ *     The rectangle to test.
+ *
+ * @return
+ *     Non-zero if the given rectangle lies entirely within the containing
+ *     rectangle, zero otherwise.
+ */
+static int guac_display_plan_rect_contains(const guac_rect* outer,
+        const guac_rect* inner) {
+    return inner->left   >= outer->left
+        && inner->top    >= outer->top
+        && inner->right  <= outer->right
+        && inner->bottom <= outer->bottom;
+}
+
+/**
+ * Attempts to rewrite the given draw operation as a copy from the previous
+ * frame of its layer, using the given copy hint. The whole cell containing
+ * the operation is preferred, such that adjacent copies can later be
+ * combined, with the operation's own dirty rect used if the cell extends
+ * beyond the region covered by the hint.
+ *
+ * @param op
+ *     The draw operation to rewrite.
+ *
+ * @param hint
+ *     The copy hint that may cover the operation.
+ *
+ * @return
+ *     Non-zero if the operation was rewritten as a copy, zero otherwise.
+ */
+static int PFR_LFR_guac_display_plan_apply_copy_hint(guac_display_plan_operation* op,
+        const guac_display_copy_hint* hint) {
+
+    guac_display_layer* layer = op->layer;
+
+    guac_rect bounds;
+    guac_rect_init(&bounds, 0, 0, layer->pending_frame.width, layer->pending_frame.height);
+
+    guac_rect dest;
+    guac_display_cell_init_rect(&dest, op->dest.left, op->dest.top);
+    guac_rect_constrain(&dest, &bounds);
+
+    if (!guac_display_plan_rect_contains(&hint->dest, &dest)) {
+        dest = op->dest;
+        if (!guac_display_plan_rect_contains(&hint->dest, &dest))
+            return 0;
+    }
+
+    int width = guac_rect_width(&dest);
+    int height = guac_rect_height(&dest);
+
+    guac_rect src;
+    guac_rect_init(&src, hint->src_x + dest.left - hint->dest.left,
+            hint->src_y + dest.top - hint->dest.top, width, height);
+
+    if (!guac_display_plan_rect_contains(&bounds, &src))
+        return 0;
+
+    /* The hint describes what is likely, not what is certain (the source
+     * region may itself have changed since the previous frame) */
+    const unsigned char* copy_from = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->last_frame, src);
+    const unsigned char* copy_to = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->pending_frame, dest);
+
+    if (guac_image_cmp(copy_from, width, height, layer->last_frame.buffer_stride,
+            copy_to, width, height, layer->pending_frame.buffer_stride))
+        return 0;
+
+    op->type = GUAC_DISPLAY_PLAN_OPERATION_COPY;
+    op->src.layer_rect.layer = layer->last_frame_buffer;
+    op->src.layer_rect.rect = src;
+    op->dest = dest;
+    return 1;
+
+}
+
+void PFR_LFR_guac_display_plan_rewrite_hinted_copies(guac_display_plan* plan) {
+
+    guac_display_plan_operation* op = plan->ops;
+    for (size_t i = 0; i < plan->length; i++, op++) {
+
+        if (op->type != GUAC_DISPLAY_PLAN_OPERATION_IMG)
+            continue;
+
+        /* The previous frame can only serve as a source if it has the same
+         * dimensions, as the layer is otherwise being resized */
+        guac_display_layer* layer = op->layer;
+        if (layer->pending_frame.width != layer->last_frame.width
+                || layer->pending_frame.height != layer->last_frame.height)
+            continue;
+
+        guac_display_layer_state* state = &layer->pending_frame;
+        for (int j = 0; j < state->copy_hint_count; j++) {
+            if (PFR_LFR_guac_display_plan_apply_copy_hint(op, &state->copy_hints[j]))
+                break;
+        }
+
+    }
+
+}
+
 /**
  * Callback for guac_hash_foreach_image_rect() which searches the ops_by_hash
  * table of the given display plan for occurrences of the given hash, replacing
@@ -412,6 +587,11 @@ void PFR_LFR_guac_display_plan_rewrite_as_copies(guac_display_plan* plan) {
     guac_display_layer* current = display->last_frame.layers;
     while (current != NULL) {
 
+        /* There is no need to search further once every indexed draw has
+         * been found (including if copy hints already handled them all) */
+        if (plan->indexed == 0)
+            break;
+
         /* Search only the layers that are specifically noted as possible
          * sources for copies */
         if (current->pending_frame.search_for_copies) {
@@ -434,3 +614,65 @@ void PFR_LFR_guac_display_plan_rewrite_as_copies(guac_display_plan* plan) {
     }
 
 }
+
+void PFR_LFW_guac_display_plan_rewrite_as_tile_copies(guac_display_plan* plan) {
+
+    guac_display* display = plan->display;
+    guac_display_tile_cache* cache = &display->tile_cache;
+
+    unsigned int hits = 0;
+    unsigned int stores = 0;
+
+    LFW_guac_display_tile_cache_begin_frame(cache);
+
+    guac_display_plan_indexed_operation* hashed = plan->hashed_ops;
+    for (size_t i = 0; i < plan->length; i++, hashed++) {
+
+        guac_display_plan_operation* op = hashed->op;
+
+        /* Only draws that have not already been rewritten can benefit, and
+         * only opaque layers are considered (copies of image data with alpha
+         * transparency would need to clear the destination first) */
+        if (op == NULL || op->type != GUAC_DISPLAY_PLAN_OPERATION_IMG
+                || !op->layer->opaque)
+            continue;
+
+        guac_display_layer* layer = op->layer;
+
+        guac_rect cell;
+        guac_display_cell_init_rect(&cell, op->dest.left, op->dest.top);
+
+        /* The client-side contents of regions being streamed as video are
+         * stale and must not be stored, nor does replacing draws within those
+         * regions with copies help */
+        if (LFW_guac_display_layer_video_intersects(layer, &cell))
+            continue;
+
+        const unsigned char* data = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->pending_frame, cell);
+        guac_display_tile_cache_entry* entry = LFW_guac_display_tile_cache_find(cache,
+                hashed->hash, data, layer->pending_frame.buffer_stride);
+
+        /* Replace draw with a copy if the tile is already on the client side */
+        if (entry != NULL) {
+
+            if (entry->stored != cache->frame) {
+                op->type = GUAC_DISPLAY_PLAN_OPERATION_COPY;
+                op->src.layer_rect.layer = cache->buffer;
+                op->src.layer_rect.rect = entry->rect;
+                op->dest = cell;
+                hits++;
+            }
+
+        }
+
+        /* Otherwise, cache the tile for future reuse if it isn't changing so
+         * frequently that it's unlikely to be seen again */
+        else if (op->current_frame - op->last_frame >= GUAC_DISPLAY_TILE_CACHE_MIN_AGE
+                && PFR_LFW_guac_display_tile_cache_store(display, hashed->hash, layer, &cell))
+            stores++;
+
+    }
+
+    guac_display_stats_record_tile_cache(display, hits, stores);
+
+}
@@ -0,0 +1,176 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "display-plan.h"
+#include "display-priv.h"
+#include "guacamole/fifo.h"
+#include "guacamole/flag.h"
+
+#include <stddef.h>
+
+int guac_display_plan_band_count(guac_display* display, size_t area) {
+
+    size_t bands = area / GUAC_DISPLAY_PLAN_MIN_BAND_AREA;
+
+    if (bands > (size_t) display->worker_thread_count)
+        bands = display->worker_thread_count;
+
+    if (bands < 1)
+        bands = 1;
+
+    return (int) bands;
+
+}
+
+/**
+ * Claims and processes bands of the given task until no unclaimed bands
+ * remain. This function is used both by the worker threads and by the thread
+ * that is planning the frame.
+ *
+ * IMPORTANT: The calling thread must NOT hold the lock of the task's state
+ * flag.
+ *
+ * @param task
+ *     The task to process.
+ */
+static void guac_display_plan_task_process(guac_display_plan_task* task) {
+
+    guac_flag_lock(&task->state);
+
+    while (task->next_band < task->bands) {
+
+        int band = task->next_band++;
+
+        /* Process the claimed band without holding the task lock such that
+         * other threads may concurrently claim and process other bands */
+        guac_flag_unlock(&task->state);
+        task->callback(task->data, band, task->bands);
+        guac_flag_lock(&task->state);
+
+        task->finished_bands++;
+
+    }
+
+    guac_flag_unlock(&task->state);
+
+}
+
+void guac_display_plan_task_join(guac_display_plan_task* task) {
+
+    /* NOTE: The operation FIFO is locked here, and will remain locked until
+     * this worker has registered itself, guaranteeing that the planning thread
+     * cannot observe an operation having been dequeued without also observing
+     * the worker that dequeued it */
+    guac_flag_lock(&task->state);
+    task->started++;
+    task->active++;
+    guac_flag_unlock(&task->state);
+
+}
+
+void guac_display_plan_task_work(guac_display_plan_task* task) {
+
+    guac_display_plan_task_process(task);
+
+    /* Signal the planning thread only once absolutely no worker still refers
+     * to the task (the task is allocated by the planning thread and ceases to
+     * exist once that thread stops waiting) */
+    guac_flag_lock(&task->state);
+    task->active--;
+    if (task->finished_bands == task->bands && task->active == 0
+            && task->started == task->enqueued)
+        guac_flag_set(&task->state, GUAC_DISPLAY_PLAN_TASK_STATE_COMPLETE);
+    guac_flag_unlock(&task->state);
+
+}
+
+void guac_display_plan_run_bands(guac_display* display, int bands,
+        guac_display_plan_band_callback* callback, void* data) {
+
+    /* Simply process everything within the current thread if there is no
+     * benefit to involving the worker threads */
+    if (bands <= 1 || display->worker_thread_count <= 1) {
+        for (int band = 0; band < bands; band++)
+            callback(data, band, bands);
+        return;
+    }
+
+    guac_display_plan_task task = {
+        .callback = callback,
+        .data = data,
+        .bands = bands
+    };
+
+    guac_flag_init(&task.state);
+
+    guac_display_plan_operation op = {
+        .type = GUAC_DISPLAY_PLAN_OPERATION_TASK,
+        .src.task = &task
+    };
+
+    /* The current thread processes bands, too, so one fewer worker thread is
+     * needed. Requesting no more than one fewer than the total number of
+     * worker threads also ensures the task can complete even if the current
+     * thread is itself a worker thread (as happens when a worker flushes a
+     * deferred frame). */
+    int helpers = bands - 1;
+    if (helpers > display->worker_thread_count - 1)
+        helpers = display->worker_thread_count - 1;
+
+    /* Keep the operation FIFO locked while enqueuing so that no worker can
+     * pick up the task before the total number of enqueued operations is
+     * known */
+    guac_fifo_lock(&display->ops);
+    for (int i = 0; i < helpers; i++) {
+        if (guac_fifo_enqueue(&display->ops, &op))
+            task.enqueued++;
+    }
+    guac_fifo_unlock(&display->ops);
+
+    guac_display_plan_task_process(&task);
+
+    /* Wait for all worker threads to finish with the task. If the display is
+     * being stopped, any operations not yet picked up by a worker will never
+     * be picked up, and the task is complete once the workers that did pick
+     * it up are finished. */
+    for (;;) {
+
+        guac_fifo_lock(&display->ops);
+        guac_flag_lock(&task.state);
+
+        int complete = task.finished_bands == task.bands && task.active == 0
+            && (task.started == task.enqueued || !guac_fifo_is_valid(&display->ops));
+
+        guac_flag_unlock(&task.state);
+        guac_fifo_unlock(&display->ops);
+
+        if (complete)
+            break;
+
+        if (guac_flag_timedwait_and_lock(&task.state,
+                    GUAC_DISPLAY_PLAN_TASK_STATE_COMPLETE,
+                    GUAC_DISPLAY_PLAN_TASK_WAIT_TIMEOUT))
+            guac_flag_unlock(&task.state);
+
+    }
+
+    guac_flag_destroy(&task.state);
+
+}
@@ -25,9 +25,11 @@
 #include "guacamole/fifo.h"
 #include "guacamole/mem.h"
 #include "guacamole/protocol.h"
+#include "guacamole/rect.h"
 #include "guacamole/socket.h"
 #include "guacamole/timestamp.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <cairo/cairo.h>
 
@@ -76,67 +78,473 @@ static void guac_display_plan_mark_dirty(guac_display_layer* layer,
 }
 
 /**
- * Variant of memcmp() which specifically compares series of 32-bit quantities
- * and determines the overall location and length of the differences in the two
- * provided buffers. The length and location determined are the length and
- * location of the smallest contiguous series of 32-bit quantities that differ
- * between the buffers.
+ * Returns the index of the least significant bit that is set within the given
+ * value. The given value MUST be non-zero.
  *
- * @param buffer_a
- *     The first buffer to compare.
+ * @param value
+ *     The value to search.
  *
- * @param buffer_b
- *     The buffer to compare with buffer_a.
+ * @return
+ *     The index of the least significant set bit, where 0 is the least
+ *     significant bit overall.
+ */
+static inline int guac_display_plan_first_bit(uint64_t value) {
+#ifdef __GNUC__
+    return __builtin_ctzll(value);
+#else
+    int index = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/**
+ * Returns the index of the most significant bit that is set within the given
+ * value. The given value MUST be non-zero.
  *
- * @param count
- *     The number of 32-bit quantities in each buffer.
+ * @param value
+ *     The value to search.
+ *
+ * @return
+ *     The index of the most significant set bit, where 0 is the least
+ *     significant bit overall.
+ */
+static inline int guac_display_plan_last_bit(uint64_t value) {
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(value);
+#else
+    int index = 0;
+    while (value >>= 1)
+        index++;
+    return index;
+#endif
+}
+
+/**
+ * The state of a single band of the dirty rect refinement performed for a
+ * layer by PFW_LFR_guac_display_plan_create().
+ */
+typedef struct guac_display_plan_draft_band {
+
+    /**
+     * The number of cells within the band that have been marked as having
+     * changed since the last frame.
+     */
+    size_t op_count;
+
+    /**
+     * The smallest rectangle containing all cells within the band that have
+     * changed since the last frame.
+     */
+    guac_rect dirty;
+
+} guac_display_plan_draft_band;
+
+/**
+ * The dirty rect refinement being performed for a single layer by
+ * PFW_LFR_guac_display_plan_create(), split into horizontal bands of cells.
+ */
+typedef struct guac_display_plan_draft {
+
+    /**
+     * The layer being refined.
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The rough modified region of the layer, aligned with cell boundaries
+     * and constrained to the bounds of the pending frame.
+     */
+    guac_rect dirty;
+
+    /**
+     * The number of rows of cells within the dirty rect.
+     */
+    int rows;
+
+    /**
+     * The results of refining each band, one element per band.
+     */
+    guac_display_plan_draft_band* bands;
+
+} guac_display_plan_draft;
+
+/**
+ * Refines the dirty rects of all cells within the given band of a layer's
+ * modified region, comparing the pending frame against the last frame. This
+ * function is a guac_display_plan_band_callback, and the given data must be
+ * the guac_display_plan_draft describing the layer being refined.
  *
- * @param pos
- *     A pointer to a size_t that should receive the offset of the difference,
- *     if the two buffers turn out to contain different data. The value of the
- *     size_t will only be modified if at least one difference is found.
+ * @see guac_display_plan_band_callback
+ */
+static void PFW_LFR_guac_display_plan_draft_band(void* data, int band, int bands) {
+
+    guac_display_plan_draft* draft = (guac_display_plan_draft*) data;
+    guac_display_plan_draft_band* result = &draft->bands[band];
+    guac_display_layer* current = draft->layer;
+
+    size_t op_count = 0;
+    guac_rect band_dirty = { 0 };
+
+    /* Bitmaps of changed pixels for each cell in the current line */
+    uint64_t changed[GUAC_DISPLAY_CELL_DIMENSION(GUAC_DISPLAY_MAX_WIDTH)];
+
+    /* Use the fastest available comparison for the current CPU */
+    guac_display_plan_diff_row_function* diff_row = guac_display_plan_get_diff_row();
+
+    /* Each band covers a contiguous range of rows of cells */
+    guac_rect dirty = draft->dirty;
+    int first_row = draft->rows * band / bands;
+    int last_row = draft->rows * (band + 1) / bands;
+
+    dirty.top += first_row * GUAC_DISPLAY_CELL_SIZE;
+    if (dirty.bottom > draft->dirty.top + last_row * GUAC_DISPLAY_CELL_SIZE)
+        dirty.bottom = draft->dirty.top + last_row * GUAC_DISPLAY_CELL_SIZE;
+
+    const unsigned char* flushed_row = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(current->last_frame, dirty);
+    unsigned char* buffer_row = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(current->pending_frame, dirty);
+
+    guac_display_layer_cell* cell_row = current->pending_frame_cells
+        + guac_mem_ckd_mul_or_die(dirty.top / GUAC_DISPLAY_CELL_SIZE, current->pending_frame_cells_width)
+        + dirty.left / GUAC_DISPLAY_CELL_SIZE;
+
+    /* Loop through the rough modified region, refining the dirty rects of
+     * each cell to more accurately contain only what has actually changed
+     * since last frame */ 
+    for (int corner_y = dirty.top; corner_y < dirty.bottom; corner_y += GUAC_DISPLAY_CELL_SIZE) {
+
+        int height = GUAC_DISPLAY_CELL_SIZE;
+        if (corner_y + height > dirty.bottom)
+            height = dirty.bottom - corner_y;
+
+        /* Iteration through the pending_frame_cells array and the image
+         * buffer is a bit complex here, as the pending_frame_cells array
+         * contains cells that represent 64x64 regions, while the image
+         * buffers contain absolutely all pixels. The outer loop goes
+         * through just the pending cells, while the following loop goes
+         * through the Y coordinates that make up that cell. */
+
+        for (int y_off = 0; y_off < height; y_off++) {
+
+            /* At this point, we need to loop through the horizontal
+             * dimension, comparing the 64-pixel rows of image data in the
+             * current line (corner_y + y_off) that are in each applicable
+             * cell. All such rows are compared at once, producing a bitmap
+             * of changed pixels for each cell, and we then jump forward by
+             * one cell at a time to interpret those bitmaps. */
+
+            int y = corner_y + y_off;
+
+            /* Only the pixels that are within the bounds of BOTH the
+             * last_frame and pending_frame are directly comparable. Others
+             * are inherently dirty by virtue of being outside the bounds
+             * of last_frame */
+            int comparable_right = dirty.right;
+            if (comparable_right > current->last_frame.width)
+                comparable_right = current->last_frame.width;
+
+            int comparable_width = comparable_right - dirty.left;
+            if (y >= current->last_frame.height || comparable_width < 0)
+                comparable_width = 0;
+
+            if (comparable_width > 0)
+                diff_row((const uint32_t*) buffer_row,
+                        (const uint32_t*) flushed_row, comparable_width,
+                        changed);
+
+            guac_display_layer_cell* current_cell = cell_row;
+            const uint64_t* current_changed = changed;
+            for (int corner_x = dirty.left; corner_x < dirty.right; corner_x += GUAC_DISPLAY_CELL_SIZE) {
+
+                int width = GUAC_DISPLAY_CELL_SIZE;
+                if (corner_x + width > dirty.right)
+                    width = dirty.right - corner_x;
+
+                /* This SHOULD be impossible, as corner_x would need to
+                 * somehow be outside the bounds of the dirty rect, which
+                 * would have failed the loop condition earlier) */
+                GUAC_ASSERT(width >= 0);
+
+                /* Determine how much of this cell's line lies within the
+                 * comparable region */
+                int cell_comparable_width = comparable_width - (corner_x - dirty.left);
+                if (cell_comparable_width > width)
+                    cell_comparable_width = width;
+                else if (cell_comparable_width < 0)
+                    cell_comparable_width = 0;
+
+                /* Any region outside the bounds of the previous frame is
+                 * dirty (nothing to compare against) */
+                if (width > cell_comparable_width) {
+                    guac_display_plan_mark_dirty(current, current_cell, &op_count, corner_x + cell_comparable_width, y, width - cell_comparable_width);
+                    guac_rect_extend(&band_dirty, &current_cell->dirty);
+                }
+
+                /* Mark the relevant region of the cell as dirty if the
+                 * current 64-pixel line has changed in any way */
+                if (cell_comparable_width > 0 && *current_changed) {
+                    int pos = guac_display_plan_first_bit(*current_changed);
+                    int length = guac_display_plan_last_bit(*current_changed) - pos + 1;
+                    guac_display_plan_mark_dirty(current, current_cell, &op_count, corner_x + pos, y, length);
+                    guac_rect_extend(&band_dirty, &current_cell->dirty);
+                }
+
+                current_changed++;
+                current_cell++;
+
+            }
+
+            flushed_row += current->last_frame.buffer_stride;
+            buffer_row += current->pending_frame.buffer_stride;
+
+        }
+
+        cell_row += current->pending_frame_cells_width;
+
+    }
+
+    result->op_count = op_count;
+    result->dirty = band_dirty;
+
+}
+
+/**
+ * Produces the list of regions of the given layer that must be refined while
+ * planning the current frame, based on the modified regions reported for the
+ * pending frame of that layer. Each resulting region is aligned with cell
+ * boundaries, limited to the given bounds, and touches a distinct set of
+ * cells, such that each region may be refined independently.
+ *
+ * @param layer
+ *     The layer whose modified regions should be retrieved.
+ *
+ * @param bounds
+ *     The bounds of the pending frame of the layer.
+ *
+ * @param regions
+ *     An array of at least GUAC_DISPLAY_LAYER_MAX_DAMAGE rectangles that
+ *     should receive the resulting regions.
  *
  * @return
- *     The number of 32-bit quantities after and including the offset returned
- *     via pos that are different between buffer_a and buffer_b, or zero if
- *     there are no such differences.
+ *     The number of regions stored within the given array.
  */
-static size_t guac_display_memcmp(const uint32_t* restrict buffer_a,
-        const uint32_t* restrict buffer_b, size_t count, size_t* pos) {
+static int PFR_guac_display_plan_get_regions(guac_display_layer* layer,
+        const guac_rect* bounds, guac_rect* regions) {
 
-    /* Locate first difference between the buffers, if any */
-    size_t first = 0;
-    while (first < count) {
+    int count = 0;
 
-        if (*(buffer_a++) != *(buffer_b++))
-            break;
+    const guac_rect* damage = layer->pending_frame.damage;
+    int damage_count = layer->pending_frame.damage_count;
+
+    /* Without a list of distinct regions, the entire dirty rect must be
+     * considered */
+    if (!damage_count) {
+        damage = &layer->pending_frame.dirty;
+        damage_count = 1;
+    }
 
-        first++;
+    for (int i = 0; i < damage_count; i++) {
+
+        /* Re-align each region with nearest multiple of 64 to ensure each
+         * step of the dirty rect refinement loop starts at the topmost
+         * boundary of a cell */
+        guac_rect region = damage[i];
+        guac_rect_align(&region, GUAC_DISPLAY_CELL_SIZE_EXPONENT);
+
+        /* Limit size of each region by bounds of backing surface for pending
+         * frame ONLY (bounds checks against the last frame are performed
+         * within the refinement loop such that everything outside the bounds
+         * of the last frame is considered dirty) */
+        guac_rect_constrain(&region, bounds);
+
+        if (guac_rect_is_empty(&region))
+            continue;
+
+        /* Combine with any regions that now share cells, repeating until the
+         * combined region shares cells with no other region */
+        int merged;
+        do {
+
+            merged = 0;
+            for (int j = 0; j < count; j++) {
+                if (guac_rect_intersects(&regions[j], &region)) {
+                    guac_rect_extend(&region, &regions[j]);
+                    regions[j] = regions[--count];
+                    merged = 1;
+                    break;
+                }
+            }
+
+        } while (merged);
+
+        regions[count++] = region;
 
     }
 
-    /* If we reached the end without finding any differences, no need to search
-     * further - the buffers are identical */
-    if (first >= count)
+    return count;
+
+}
+
+/**
+ * Stores the portions of the given rectangle that lie outside the given hole
+ * within the given array, as up to four disjoint rectangles.
+ *
+ * @param rect
+ *     The rectangle to subtract from.
+ *
+ * @param hole
+ *     The rectangle to subtract.
+ *
+ * @param pieces
+ *     An array of at least four rectangles that should receive the portions
+ *     of rect that lie outside hole.
+ *
+ * @return
+ *     The number of rectangles stored within the given array.
+ */
+static int guac_display_plan_rect_subtract(const guac_rect* rect,
+        const guac_rect* hole, guac_rect* pieces) {
+
+    if (!guac_rect_intersects(rect, hole)) {
+        pieces[0] = *rect;
+        return 1;
+    }
+
+    int count = 0;
+    int top = rect->top;
+    int bottom = rect->bottom;
+
+    /* Full-width strips above and below the hole */
+    if (hole->top > top) {
+        guac_rect_init(&pieces[count++], rect->left, top,
+                guac_rect_width(rect), hole->top - top);
+        top = hole->top;
+    }
+
+    if (hole->bottom < bottom) {
+        guac_rect_init(&pieces[count++], rect->left, hole->bottom,
+                guac_rect_width(rect), bottom - hole->bottom);
+        bottom = hole->bottom;
+    }
+
+    /* Remaining strips to either side of the hole */
+    if (hole->left > rect->left)
+        guac_rect_init(&pieces[count++], rect->left, top,
+                hole->left - rect->left, bottom - top);
+
+    if (hole->right < rect->right)
+        guac_rect_init(&pieces[count++], hole->right, top,
+                rect->right - hole->right, bottom - top);
+
+    return count;
+
+}
+
+/**
+ * Returns whether all changes to the given region of the given layer would
+ * be entirely hidden beneath other opaque layers once the pending frame is
+ * flushed. Only the default layer and its immediate children are considered,
+ * as the positions of more deeply nested layers depend on layers that may
+ * themselves be moving or partially transparent. Layers whose size or
+ * underlying buffer is changing are never considered hidden, as such changes
+ * replace the entire last frame of the layer.
+ *
+ * @param display
+ *     The display containing the layer.
+ *
+ * @param layer
+ *     The layer whose changes should be tested.
+ *
+ * @param dirty
+ *     The region of the layer that has been modified, in the coordinates of
+ *     that layer.
+ *
+ * @return
+ *     Non-zero if the given region is entirely hidden beneath other layers,
+ *     zero otherwise.
+ */
+static int PFR_LFR_guac_display_plan_is_occluded(guac_display* display,
+        guac_display_layer* layer, const guac_rect* dirty) {
+
+    guac_display_layer_state* state = &layer->pending_frame;
+    int is_default = (layer == display->default_layer);
+
+    if (!is_default && (layer->layer->index <= 0 || state->parent != GUAC_DEFAULT_LAYER))
         return 0;
 
-    /* Search through all remaining values in the buffers for the last
-     * difference (which may be identical to the first) */
-    size_t last = first;
-    size_t offset = first + 1;
-    while (offset < count) {
+    if (state->width != layer->last_frame.width
+            || state->height != layer->last_frame.height
+            || state->buffer_stride != layer->last_frame.buffer_stride
+            || state->buffer_width != layer->last_frame.buffer_width
+            || state->buffer_height != layer->last_frame.buffer_height)
+        return 0;
+
+    /* Track the visible remainder of the modified region in the coordinates
+     * of the default layer */
+    guac_rect visible[GUAC_DISPLAY_PLAN_MAX_OCCLUSION_RECTS];
+    int count = 1;
+
+    visible[0] = *dirty;
+    if (!is_default) {
+        visible[0].left += state->x;
+        visible[0].right += state->x;
+        visible[0].top += state->y;
+        visible[0].bottom += state->y;
+    }
+
+    guac_display_layer* current = display->pending_frame.layers;
+    while (current != NULL && count > 0) {
+
+        guac_display_layer_state* other = &current->pending_frame;
+
+        /* Only fully-drawn, opaque children of the default layer that are
+         * stacked above the layer being tested can hide that layer (children
+         * with a negative Z-order may be drawn beneath their parent) */
+        if (current == layer || !current->opaque || !current->last_frame_filled
+                || current->layer->index <= 0
+                || other->parent != GUAC_DEFAULT_LAYER
+                || other->opacity != 0xFF
+                || other->z < 0
+                || (!is_default && other->z <= state->z)) {
+            current = other->next;
+            continue;
+        }
+
+        /* Areas being added to the layer in this frame have not yet been
+         * filled */
+        int width = other->width < current->last_frame.width ? other->width : current->last_frame.width;
+        int height = other->height < current->last_frame.height ? other->height : current->last_frame.height;
 
-        if (*(buffer_a++) != *(buffer_b++))
-            last = offset;
+        guac_rect hole;
+        guac_rect_init(&hole, other->x, other->y, width, height);
 
-        offset++;
+        guac_rect remaining[GUAC_DISPLAY_PLAN_MAX_OCCLUSION_RECTS];
+        int remaining_count = 0;
+
+        for (int i = 0; i < count; i++) {
+
+            guac_rect pieces[4];
+            int piece_count = guac_display_plan_rect_subtract(&visible[i], &hole, pieces);
+
+            if (remaining_count + piece_count > GUAC_DISPLAY_PLAN_MAX_OCCLUSION_RECTS)
+                return 0;
+
+            memcpy(remaining + remaining_count, pieces, piece_count * sizeof(guac_rect));
+            remaining_count += piece_count;
+
+        }
+
+        memcpy(visible, remaining, remaining_count * sizeof(guac_rect));
+        count = remaining_count;
+
+        current = other->next;
 
     }
 
-    /* Final difference found - provide caller with the starting offset and
-     * length (in 32-bit quantities) of differences */
-    *pos = first;
-    return last - first + 1;
+    return count == 0;
 
 }
 
@@ -146,6 +554,11 @@ guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
     guac_timestamp frame_end = guac_timestamp_current();
     size_t op_count = 0;
 
+    /* All memory required to plan the frame comes from the display's arena,
+     * which is reclaimed in its entirety at the start of each new plan */
+    guac_display_arena* arena = &display->plan_arena;
+    guac_display_arena_reset(arena);
+
     /* Loop through each layer, searching for modified regions */
     current = display->pending_frame.layers;
     while (current != NULL) {
@@ -169,16 +582,21 @@ guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
             continue;
         }
 
+        /* Defer changes that would not actually be visible, leaving those
+         * changes within the pending frame until they become visible */
+        current->pending_frame_occluded = PFR_LFR_guac_display_plan_is_occluded(
+                display, current, &dirty);
+
+        if (current->pending_frame_occluded) {
+            current = current->pending_frame.next;
+            continue;
+        }
+
         /* Flush any outstanding Cairo operations before directly accessing buffer */
         guac_display_layer_cairo_context* cairo_context = &(current->pending_frame_cairo_context);
         if (cairo_context->surface != NULL)
             cairo_surface_flush(cairo_context->surface);
 
-        /* Re-align the dirty rect with nearest multiple of 64 to ensure each
-         * step of the dirty rect refinement loop starts at the topmost
-         * boundary of a cell */
-        guac_rect_align(&dirty, GUAC_DISPLAY_CELL_SIZE_EXPONENT);
-
         guac_rect pending_frame_bounds = {
             .left = 0,
             .top = 0,
@@ -186,111 +604,45 @@ guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
             .bottom = current->pending_frame.height
         };
 
-        /* Limit size of dirty rect by bounds of backing surface for pending
-         * frame ONLY (bounds checks against the last frame are performed
-         * within the loop such that everything outside the bounds of the last
-         * frame is considered dirty) */
-        guac_rect_constrain(&dirty, &pending_frame_bounds);
-
-        const unsigned char* flushed_row = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(current->last_frame, dirty);
-        unsigned char* buffer_row = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(current->pending_frame, dirty);
+        /* Refine only the distinct regions reported as modified, falling
+         * back to the overall dirty rect if no such regions were reported */
+        guac_rect regions[GUAC_DISPLAY_LAYER_MAX_DAMAGE];
+        int region_count = PFR_guac_display_plan_get_regions(current,
+                &pending_frame_bounds, regions);
 
-        guac_display_layer_cell* cell_row = current->pending_frame_cells
-            + guac_mem_ckd_mul_or_die(dirty.top / GUAC_DISPLAY_CELL_SIZE, current->pending_frame_cells_width)
-            + dirty.left / GUAC_DISPLAY_CELL_SIZE;
+        /* Changes beyond the visible area of the layer are not refined, yet
+         * must still eventually reach the last frame */
+        current->pending_frame_unrefined_dirty = current->pending_frame.dirty;
 
-        /* Loop through the rough modified region, refining the dirty rects of
-         * each cell to more accurately contain only what has actually changed
-         * since last frame */ 
         current->pending_frame.dirty = (guac_rect) { 0 };
-        for (int corner_y = dirty.top; corner_y < dirty.bottom; corner_y += GUAC_DISPLAY_CELL_SIZE) {
-
-            int height = GUAC_DISPLAY_CELL_SIZE;
-            if (corner_y + height > dirty.bottom)
-                height = dirty.bottom - corner_y;
-
-            /* Iteration through the pending_frame_cells array and the image
-             * buffer is a bit complex here, as the pending_frame_cells array
-             * contains cells that represent 64x64 regions, while the image
-             * buffers contain absolutely all pixels. The outer loop goes
-             * through just the pending cells, while the following loop goes
-             * through the Y coordinates that make up that cell. */
-
-            for (int y_off = 0; y_off < height; y_off++) {
-
-                /* At this point, we need to loop through the horizontal
-                 * dimension, comparing the 64-pixel rows of image data in the
-                 * current line (corner_y + y_off) that are in each applicable
-                 * cell. We jump forward by one cell for each comparison. */
-
-                int y = corner_y + y_off;
-
-                guac_display_layer_cell* current_cell = cell_row;
-                uint32_t* current_flushed = (uint32_t*) flushed_row;
-                uint32_t* current_buffer = (uint32_t*) buffer_row;
-                for (int corner_x = dirty.left; corner_x < dirty.right; corner_x += GUAC_DISPLAY_CELL_SIZE) {
-
-                    int width = GUAC_DISPLAY_CELL_SIZE;
-                    if (corner_x + width > dirty.right)
-                        width = dirty.right - corner_x;
-
-                    /* This SHOULD be impossible, as corner_x would need to
-                     * somehow be outside the bounds of the dirty rect, which
-                     * would have failed the loop condition earlier) */
-                    GUAC_ASSERT(width >= 0);
-
-                    /* Any line that is completely outside the bounds of the
-                     * previous frame is dirty (nothing to compare against) */
-                    if (y >= current->last_frame.height || corner_x >= current->last_frame.width) {
-                        guac_display_plan_mark_dirty(current, current_cell, &op_count, corner_x, y, width);
-                        guac_rect_extend(&current->pending_frame.dirty, &current_cell->dirty);
-                    }
-
-                    /* All other regions must be processed further to determine
-                     * what portion is dirty */
-                    else {
-
-                        /* Only the pixels that are within the bounds of BOTH
-                         * the last_frame and pending_frame are directly
-                         * comparable. Others are inherently dirty by virtue of
-                         * being outside the bounds of last_frame */
-                        int comparable_width = width;
-                        if (corner_x + comparable_width > current->last_frame.width)
-                            comparable_width = current->last_frame.width - corner_x;
-
-                        /* It is impossible for this value to be negative
-                         * because of the last_frame bounds checks that occur
-                         * in the if block prior to this else block */
-                        GUAC_ASSERT(comparable_width >= 0);
-
-                        /* Any region outside the right edge of the previous frame is dirty */
-                        if (width > comparable_width) {
-                            guac_display_plan_mark_dirty(current, current_cell, &op_count, corner_x + comparable_width, y, width - comparable_width);
-                            guac_rect_extend(&current->pending_frame.dirty, &current_cell->dirty);
-                        }
-
-                        /* Mark the relevant region of the cell as dirty if the
-                         * current 64-pixel line has changed in any way */
-                        size_t length, pos;
-                        if ((length = guac_display_memcmp(current_buffer, current_flushed, comparable_width, &pos)) != 0) {
-                            guac_display_plan_mark_dirty(current, current_cell, &op_count, corner_x + pos, y, length);
-                            guac_rect_extend(&current->pending_frame.dirty, &current_cell->dirty);
-                        }
-
-                    }
-
-                    current_flushed += GUAC_DISPLAY_CELL_SIZE;
-                    current_buffer += GUAC_DISPLAY_CELL_SIZE;
-                    current_cell++;
+        current->pending_frame.damage_count = 0;
 
-                }
+        for (int region = 0; region < region_count; region++) {
 
-                flushed_row += current->last_frame.buffer_stride;
-                buffer_row += current->pending_frame.buffer_stride;
+            dirty = regions[region];
 
-            }
+            guac_display_plan_draft draft = {
+                .layer = current,
+                .dirty = dirty,
+                .rows = GUAC_DISPLAY_CELL_DIMENSION(guac_rect_height(&dirty))
+            };
+
+            /* Split refinement of large regions into bands of whole rows of
+             * cells, such that each band touches a distinct set of cells */
+            int bands = guac_display_plan_band_count(display,
+                    (size_t) guac_rect_width(&dirty) * guac_rect_height(&dirty));
+            if (bands > draft.rows)
+                bands = draft.rows;
 
-            cell_row += current->pending_frame_cells_width;
+            draft.bands = guac_display_arena_alloc(arena, bands, sizeof(guac_display_plan_draft_band));
+            guac_display_plan_run_bands(display, bands,
+                    PFW_LFR_guac_display_plan_draft_band, &draft);
+
+            /* Merge the results of each band */
+            for (int i = 0; i < bands; i++) {
+                op_count += draft.bands[i].op_count;
+                guac_rect_extend(&current->pending_frame.dirty, &draft.bands[i].dirty);
+            }
 
         }
 
@@ -302,11 +654,12 @@ guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
     if (!op_count)
         return NULL;
 
-    guac_display_plan* plan = guac_mem_alloc(sizeof(guac_display_plan));
+    guac_display_plan* plan = guac_display_arena_alloc(arena, 1, sizeof(guac_display_plan));
     plan->display = display;
     plan->frame_end = frame_end;
     plan->length = op_count;
-    plan->ops = guac_mem_alloc(plan->length, sizeof(guac_display_plan_operation));
+    plan->ops = guac_display_arena_alloc(arena, plan->length, sizeof(guac_display_plan_operation));
+    plan->hashed_ops = NULL;
 
     /* Convert the dirty rectangles stored in each layer's cells to individual
      * image operations for later optimization */
@@ -364,8 +717,162 @@ guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
 }
 
 void guac_display_plan_free(guac_display_plan* plan) {
-    guac_mem_free(plan->ops);
-    guac_mem_free(plan);
+    guac_display* display = plan->display;
+    guac_display_arena_reset(&display->plan_arena);
+    PFR_guac_display_stats_record_plan_arena(display);
+}
+
+/**
+ * Comparator for qsort() which orders pointers to image operations by
+ * decreasing cost, as represented by the number of dirty pixels within each
+ * operation.
+ *
+ * @param a
+ *     A pointer to a pointer to the first guac_display_plan_operation to
+ *     compare.
+ *
+ * @param b
+ *     A pointer to a pointer to the second guac_display_plan_operation to
+ *     compare.
+ *
+ * @return
+ *     A negative value if the first operation is more costly than the second,
+ *     a positive value if the first operation is less costly than the second,
+ *     or zero if both operations are equally costly.
+ */
+static int guac_display_plan_compare_cost(const void* a, const void* b) {
+
+    const guac_display_plan_operation* op_a = *((guac_display_plan_operation* const*) a);
+    const guac_display_plan_operation* op_b = *((guac_display_plan_operation* const*) b);
+
+    if (op_a->dirty_size > op_b->dirty_size)
+        return -1;
+
+    if (op_a->dirty_size < op_b->dirty_size)
+        return 1;
+
+    return 0;
+
+}
+
+/**
+ * Moves all image operations near the mouse cursor of the last frame to the
+ * beginning of the given array, if the mouse cursor moved recently enough
+ * that the user is likely focused on that area. Only operations on the
+ * default layer are considered, as the position of other layers relative to
+ * the cursor is not known. The relative order of operations is not preserved.
+ *
+ * @param display
+ *     The display whose mouse cursor should be used.
+ *
+ * @param ops
+ *     The array of image operations to reorder.
+ *
+ * @param count
+ *     The number of operations in the array.
+ *
+ * @return
+ *     The number of operations moved to the beginning of the array, which
+ *     may be zero.
+ */
+static unsigned int guac_display_plan_prioritize_cursor(guac_display* display,
+        guac_display_plan_operation** ops, unsigned int count) {
+
+    /* NOTE: The cursor members of the last frame are only modified while the
+     * pending frame lock is held for writing, as it is here */
+    guac_timestamp since = guac_timestamp_current() - display->last_frame.cursor_timestamp;
+    if (since > GUAC_DISPLAY_PLAN_CURSOR_TIMEOUT)
+        return 0;
+
+    guac_rect region;
+    guac_rect_init(&region,
+            display->last_frame.cursor_x - GUAC_DISPLAY_PLAN_CURSOR_RADIUS,
+            display->last_frame.cursor_y - GUAC_DISPLAY_PLAN_CURSOR_RADIUS,
+            GUAC_DISPLAY_PLAN_CURSOR_RADIUS * 2,
+            GUAC_DISPLAY_PLAN_CURSOR_RADIUS * 2);
+
+    unsigned int near_ops = 0;
+    for (unsigned int i = 0; i < count; i++) {
+
+        guac_display_plan_operation* op = ops[i];
+        if (op->layer != display->default_layer || !guac_rect_intersects(&region, &op->dest))
+            continue;
+
+        ops[i] = ops[near_ops];
+        ops[near_ops++] = op;
+
+    }
+
+    return near_ops;
+
+}
+
+/**
+ * Enqueues the given image operation within the operation FIFO of the given
+ * display. If requested, image operations that are larger than
+ * GUAC_DISPLAY_MIN_SPLIT_SIZE are split along a grid of that size, with each
+ * resulting image enqueued separately such that multiple worker threads may
+ * encode portions of the same image in parallel. Operations that are updated
+ * rapidly enough to be candidates for video streaming are never split. The
+ * operation FIFO of the display must already be locked.
+ *
+ * @param display
+ *     The display whose operation FIFO should receive the image operation.
+ *
+ * @param op
+ *     The image operation to enqueue.
+ *
+ * @param split
+ *     Non-zero if the image operation should be split into smaller images
+ *     where possible, zero otherwise.
+ *
+ * @return
+ *     The number of operations actually enqueued.
+ */
+static unsigned int guac_display_plan_enqueue_img(guac_display* display,
+        const guac_display_plan_operation* op, int split) {
+
+    const int split_size = 1 << GUAC_DISPLAY_MIN_SPLIT_SIZE;
+
+    int width = guac_rect_width(&op->dest);
+    int height = guac_rect_height(&op->dest);
+
+    if (!split || (width <= split_size && height <= split_size)
+            || (op->current_frame > op->last_frame
+                && 1000 / (op->current_frame - op->last_frame) >= GUAC_DISPLAY_VIDEO_FRAMERATE)) {
+        guac_fifo_enqueue(&display->ops, op);
+        return 1;
+    }
+
+    guac_rect grid = op->dest;
+    guac_rect_align(&grid, GUAC_DISPLAY_MIN_SPLIT_SIZE);
+
+    unsigned int enqueued = 0;
+    size_t area = (size_t) width * height;
+
+    for (int y = grid.top; y < grid.bottom; y += split_size) {
+        for (int x = grid.left; x < grid.right; x += split_size) {
+
+            guac_display_plan_operation sub_op = *op;
+            guac_rect_init(&sub_op.dest, x, y, split_size, split_size);
+            guac_rect_constrain(&sub_op.dest, &op->dest);
+
+            if (guac_rect_is_empty(&sub_op.dest))
+                continue;
+
+            /* Apportion the cost of the original operation by area */
+            sub_op.dirty_size = op->dirty_size
+                * guac_rect_width(&sub_op.dest) * guac_rect_height(&sub_op.dest)
+                / area;
+
+            guac_fifo_enqueue(&display->ops, &sub_op);
+            enqueued++;
+
+        }
+    }
+
+    return enqueued;
+
 }
 
 void guac_display_plan_apply(guac_display_plan* plan) {
@@ -374,6 +881,16 @@ void guac_display_plan_apply(guac_display_plan* plan) {
     guac_client* client = display->client;
     guac_display_plan_operation* op = plan->ops;
 
+    unsigned int nop_ops = 0;
+    unsigned int copy_ops = 0;
+    unsigned int rect_ops = 0;
+    unsigned int img_ops = 0;
+
+    /* Image operations are enqueued only after all other operations have been
+     * sent, such that they can be ordered by cost */
+    guac_display_plan_operation** pending_img_ops = guac_display_arena_alloc(
+            &display->plan_arena, plan->length, sizeof(guac_display_plan_operation*));
+
     /* Do not allow worker threads to move forward with image encoding until
      * AFTER the non-image instructions have finished being written */
     guac_fifo_lock(&display->ops);
@@ -392,6 +909,7 @@ void guac_display_plan_apply(guac_display_plan* plan) {
                         op->src.layer_rect.rect.left, op->src.layer_rect.rect.top,
                         guac_rect_width(&op->src.layer_rect.rect), guac_rect_height(&op->src.layer_rect.rect),
                         GUAC_COMP_OVER, display_layer->layer, op->dest.left, op->dest.top);
+                copy_ops++;
                 break;
 
             case GUAC_DISPLAY_PLAN_OPERATION_RECT:
@@ -413,15 +931,17 @@ void guac_display_plan_apply(guac_display_plan* plan) {
                 else
                     guac_protocol_send_cfill(client->socket, GUAC_COMP_OVER, display_layer->layer, red, green, blue, 0xFF);
 
+                rect_ops++;
                 break;
 
             /* Simply ignore and drop NOP */
             case GUAC_DISPLAY_PLAN_OPERATION_NOP:
+                nop_ops++;
                 break;
 
             /* All other operations should be handled by the workers */
             default:
-                guac_fifo_enqueue(&display->ops, op);
+                pending_img_ops[img_ops++] = op;
                 break;
 
         }
@@ -430,6 +950,51 @@ void guac_display_plan_apply(guac_display_plan* plan) {
 
     }
 
+    /* Images around the mouse cursor are where the user is most likely
+     * looking, and so are encoded ahead of everything else */
+    unsigned int near_ops = guac_display_plan_prioritize_cursor(display,
+            pending_img_ops, img_ops);
+
+    /* Otherwise, begin encoding the costliest images first, such that the
+     * smaller images fill in the remaining time of each worker rather than
+     * leaving workers idle while one worker encodes a large image at the end
+     * of the frame */
+    qsort(pending_img_ops, near_ops, sizeof(guac_display_plan_operation*),
+            guac_display_plan_compare_cost);
+    qsort(pending_img_ops + near_ops, img_ops - near_ops,
+            sizeof(guac_display_plan_operation*), guac_display_plan_compare_cost);
+
+    /* Small images away from the mouse cursor are packed together into
+     * atlases, each sent as a single image, avoiding the overhead of sending
+     * each as an image of its own */
+    img_ops = near_ops + guac_display_atlas_pack(display,
+            pending_img_ops + near_ops, img_ops - near_ops);
+
+    /* Split large images only if there would otherwise not be enough images
+     * to occupy all workers */
+    int split = img_ops + display->atlas_count
+        < (unsigned int) display->worker_thread_count;
+
+    unsigned int enqueued_ops = 0;
+    for (unsigned int i = 0; i < img_ops; i++)
+        enqueued_ops += guac_display_plan_enqueue_img(display, pending_img_ops[i], split);
+
+    /* Atlases consist of small images and are encoded after everything
+     * else, filling in the remaining time of each worker */
+    for (int i = 0; i < display->atlas_count; i++) {
+
+        guac_display_plan_operation atlas_op = {
+            .type = GUAC_DISPLAY_PLAN_OPERATION_ATLAS,
+            .src.atlas = &display->atlases[i]
+        };
+
+        guac_fifo_enqueue(&display->ops, &atlas_op);
+        enqueued_ops++;
+
+    }
+
     guac_fifo_unlock(&display->ops);
 
+    guac_display_stats_record_ops(display, nop_ops, copy_ops, rect_ops, enqueued_ops);
+
 }
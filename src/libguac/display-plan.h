@@ -21,6 +21,7 @@
 #define GUAC_DISPLAY_PLAN_H
 
 #include "guacamole/display.h"
+#include "guacamole/flag.h"
 #include "guacamole/rect.h"
 #include "guacamole/timestamp.h"
 
@@ -28,23 +29,39 @@
 #include <unistd.h>
 
 /**
- * The width of an update which should be considered negible and thus
- * trivial overhead compared to the cost of two updates.
+ * The estimated cost of any instruction that does not carry image data, such
+ * as "copy" or "rect", in bytes. This accounts for both the size of the
+ * instruction itself and the overhead of processing an additional
+ * instruction on the client side.
  */
-#define GUAC_DISPLAY_NEGLIGIBLE_WIDTH 64
+#define GUAC_DISPLAY_INSTRUCTION_COST 64
 
 /**
- * The height of an update which should be considered negible and thus
- * trivial overhead compared to the cost of two updates.
+ * The estimated fixed cost of sending any image, regardless of its content,
+ * in bytes. This accounts for the "img", "blob", and "end" instructions, the
+ * headers of the encoded image, and the overhead of decoding an additional
+ * image on the client side.
  */
-#define GUAC_DISPLAY_NEGLIGIBLE_HEIGHT 64
+#define GUAC_DISPLAY_IMAGE_COST 512
 
 /**
- * The proportional increase in cost contributed by transfer and processing of
- * image data, compared to processing an equivalent amount of client-side
- * data.
+ * The estimated cost of each pixel of an image whose content is entirely
+ * flat (every pixel identical to its neighbors), in 1/256ths of a byte.
  */
-#define GUAC_DISPLAY_DATA_FACTOR 128
+#define GUAC_DISPLAY_MIN_PIXEL_COST 8
+
+/**
+ * The estimated cost of each pixel of an image whose content is entirely
+ * noisy (every pixel different from its neighbors), in 1/256ths of a byte.
+ */
+#define GUAC_DISPLAY_MAX_PIXEL_COST 1024
+
+/**
+ * The number of rows and columns of pixels sampled from within an image to
+ * estimate the complexity of its content. A total of the square of this
+ * value pixels are sampled.
+ */
+#define GUAC_DISPLAY_COST_SAMPLES 8
 
 /**
  * The maximum width or height to allow when combining any pair of rendering
@@ -59,17 +76,16 @@
 #define GUAC_DISPLAY_MAX_COMBINED_SIZE 9
 
 /**
- * The base cost of every update. Each update should be considered to have
- * this starting cost, plus any additional cost estimated from its
- * content.
- */
-#define GUAC_DISPLAY_BASE_COST 4096
-
-/**
- * An increase in cost is negligible if it is less than
- * 1/GUAC_DISPLAY_NEGLIGIBLE_INCREASE of the old cost.
+ * The minimum width or height of each image produced when splitting a large
+ * image operation across otherwise-idle worker threads, in pixels, as the
+ * exponent of a power of two. Images are split along a grid of this size,
+ * such that each resulting image remains aligned to both the cells of the
+ * display and the block size of the JPEG encoder.
+ *
+ * The current value of 8 means that each image will be split into images no
+ * smaller than 256x256 pixels (except at the edges of the original image).
  */
-#define GUAC_DISPLAY_NEGLIGIBLE_INCREASE 4
+#define GUAC_DISPLAY_MIN_SPLIT_SIZE 8
 
 /**
  * The framerate which, if exceeded, indicates that JPEG is preferred.
@@ -82,6 +98,43 @@
  */
 #define GUAC_DISPLAY_JPEG_MIN_BITMAP_SIZE 4096
 
+/**
+ * The maximum number of rows examined when estimating whether an image would
+ * be better compressed as PNG or using a lossy format. Images taller than
+ * this are estimated from this many evenly-spaced rows, while shorter images
+ * are examined in full.
+ */
+#define GUAC_DISPLAY_PNG_OPTIMALITY_SAMPLE_ROWS 32
+
+/**
+ * The minimum number of consecutive rows (or columns) of a region that must
+ * have moved by the same offset for the region to be considered as having
+ * scrolled.
+ */
+#define GUAC_DISPLAY_PLAN_SCROLL_MIN_LENGTH 32
+
+/**
+ * The distance from the mouse cursor, in pixels, within which image
+ * operations are considered to be near the cursor. Such operations are where
+ * the user is most likely to be looking and are encoded before all others.
+ */
+#define GUAC_DISPLAY_PLAN_CURSOR_RADIUS 128
+
+/**
+ * The amount of time after the mouse cursor was last moved or clicked that
+ * image operations near the cursor continue to be prioritized, in
+ * milliseconds.
+ */
+#define GUAC_DISPLAY_PLAN_CURSOR_TIMEOUT 1000
+
+/**
+ * The maximum number of disjoint rectangles tracked while determining
+ * whether the changes to a layer are entirely hidden beneath other layers.
+ * Changes whose visible remainder cannot be described by this many
+ * rectangles are conservatively considered visible.
+ */
+#define GUAC_DISPLAY_PLAN_MAX_OCCLUSION_RECTS 16
+
 /**
  * The JPEG compression min block size, as the exponent of a power of two. This
  * defines the optimal rectangle block size factor for JPEG compression.
@@ -116,6 +169,32 @@
         ^ ((hash >> 48) & 0xFFFF)               \
         )
 
+/**
+ * The minimum number of pixels that should be processed by each band of a
+ * display planning phase that is split across the worker threads. Phases
+ * involving less work than this are performed entirely by the thread that is
+ * planning the frame, as the overhead of waking the worker threads would
+ * outweigh any benefit.
+ */
+#define GUAC_DISPLAY_PLAN_MIN_BAND_AREA 262144
+
+/**
+ * The number of milliseconds to wait between checks for whether all worker
+ * threads have finished with a guac_display_plan_task. Under normal
+ * circumstances, the thread waiting on a task is signalled as soon as the task
+ * is complete. This timeout matters only if the display is being stopped
+ * while a task is in progress, in which case some worker threads may never
+ * pick up that task.
+ */
+#define GUAC_DISPLAY_PLAN_TASK_WAIT_TIMEOUT 100
+
+/**
+ * Flag value for the state of a guac_display_plan_task that indicates all
+ * bands of the task have been processed and no worker threads still refer to
+ * that task.
+ */
+#define GUAC_DISPLAY_PLAN_TASK_STATE_COMPLETE 1
+
 /**
  * The type of a graphical operation that may be part of a guac_display_plan.
  */
@@ -141,10 +220,122 @@ typedef enum guac_display_plan_operation_type {
     /**
      * Draw arbitrary image data to the destination rect.
      */
-    GUAC_DISPLAY_PLAN_OPERATION_IMG
+    GUAC_DISPLAY_PLAN_OPERATION_IMG,
+
+    /**
+     * Draw the image data of the destination rect using lossless compression,
+     * replacing image data that was previously sent for that rect using lossy
+     * compression. Operations of this type are never part of a
+     * guac_display_plan and are enqueued only by guac_display_refine().
+     */
+    GUAC_DISPLAY_PLAN_OPERATION_REFINE,
+
+    /**
+     * Draw the image data of each of several small, scattered rects by
+     * sending that data packed together as a single image within an
+     * offscreen buffer, and then copying each rect from that buffer to its
+     * destination. Operations of this type are never part of a
+     * guac_display_plan and are enqueued only by guac_display_plan_apply(),
+     * in place of the image operations packed into the associated
+     * guac_display_atlas.
+     */
+    GUAC_DISPLAY_PLAN_OPERATION_ATLAS,
+
+    /**
+     * Assist with the construction of a display plan by processing bands of
+     * the associated guac_display_plan_task. Operations of this type are never
+     * part of a guac_display_plan and do not produce any graphical output.
+     * They serve only to lend idle worker threads to the thread that is
+     * planning the next frame.
+     */
+    GUAC_DISPLAY_PLAN_OPERATION_TASK
 
 } guac_display_plan_operation_type;
 
+/**
+ * A set of small image operations packed together such that they may be sent
+ * as a single image. See guac_display_atlas_pack().
+ */
+typedef struct guac_display_atlas guac_display_atlas;
+
+/**
+ * Callback that performs one horizontal band of a display planning phase that
+ * has been split across the worker threads of a guac_display. Each band of a
+ * task is processed exactly once, possibly concurrently with other bands of
+ * the same task, and the bands of a task must therefore not modify any state
+ * in common.
+ *
+ * @param data
+ *     The arbitrary data provided to guac_display_plan_run_bands().
+ *
+ * @param band
+ *     The index of the band to process, where the first band is band 0.
+ *
+ * @param bands
+ *     The total number of bands within the task.
+ */
+typedef void guac_display_plan_band_callback(void* data, int band, int bands);
+
+/**
+ * A single display planning phase that has been split into horizontal bands
+ * that may be processed concurrently by the worker threads of a guac_display
+ * and by the thread that is planning the frame.
+ */
+typedef struct guac_display_plan_task {
+
+    /**
+     * The function to invoke for each band of this task.
+     */
+    guac_display_plan_band_callback* callback;
+
+    /**
+     * Arbitrary data to pass to the callback for each band.
+     */
+    void* data;
+
+    /**
+     * The total number of bands within this task.
+     */
+    int bands;
+
+    /**
+     * The index of the next band that has not yet been claimed by any thread.
+     */
+    int next_band;
+
+    /**
+     * The number of bands that have been fully processed.
+     */
+    int finished_bands;
+
+    /**
+     * The number of GUAC_DISPLAY_PLAN_OPERATION_TASK operations referring to
+     * this task that were added to the operation FIFO.
+     */
+    int enqueued;
+
+    /**
+     * The number of GUAC_DISPLAY_PLAN_OPERATION_TASK operations referring to
+     * this task that have been picked up by worker threads.
+     */
+    int started;
+
+    /**
+     * The number of worker threads currently processing this task.
+     */
+    int active;
+
+    /**
+     * The current state of this task. The GUAC_DISPLAY_PLAN_TASK_STATE_COMPLETE
+     * flag is set once all bands have been processed and no worker threads
+     * refer to this task. All other members of this structure that change
+     * while the task is running must only be accessed or modified while this
+     * flag is locked.
+     */
+    guac_flag state;
+
+} guac_display_plan_task;
+
 /**
  * A reference to a rectangular region of image data within a layer of the
  * remote Guacamole display.
@@ -219,6 +410,18 @@ typedef struct guac_display_plan_operation {
          */
         guac_display_plan_layer_rect layer_rect;
 
+        /**
+         * The planning task that the worker thread should assist with. This
+         * value applies only to GUAC_DISPLAY_PLAN_OPERATION_TASK operations.
+         */
+        guac_display_plan_task* task;
+
+        /**
+         * The packed image operations that should be sent. This value
+         * applies only to GUAC_DISPLAY_PLAN_OPERATION_ATLAS operations.
+         */
+        guac_display_atlas* atlas;
+
     } src;
 
 } guac_display_plan_operation;
@@ -284,8 +487,213 @@ typedef struct guac_display_plan {
      */
     guac_display_plan_indexed_operation ops_by_hash[GUAC_DISPLAY_PLAN_OPERATION_INDEX_SIZE];
 
+    /**
+     * The number of operations currently stored within ops_by_hash.
+     */
+    size_t indexed;
+
+    /**
+     * The hash of each operation in the plan, in the same order as the
+     * operations themselves, or NULL if the plan has not yet been indexed.
+     * Operations that could not be indexed are represented by entries whose
+     * op is NULL. Unlike ops_by_hash, this array includes every indexed
+     * operation, even those whose hashes collide.
+     */
+    guac_display_plan_indexed_operation* hashed_ops;
+
 } guac_display_plan;
 
+/**
+ * Function that advances the sliding 64x64 window hash used to index and
+ * search for image data by one row. For each pixel in the given row, the hash
+ * of the 64-pixel row segment ending at that pixel is calculated and then
+ * incorporated into the corresponding element of the given cell hash array,
+ * such that each element of that array becomes the hash of the 64x64 region
+ * whose bottom-right corner is that pixel (once 64 rows have been hashed).
+ *
+ * All implementations of this function MUST produce bit-identical results, as
+ * hashes produced from the pending frame are compared against hashes produced
+ * from the last frame.
+ *
+ * @param row
+ *     The first pixel of the row of image data to hash.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ *
+ * @param cell_hash
+ *     An array of at least width partial cell hashes, one for each pixel of
+ *     the row, as produced by previous calls to this function for the rows
+ *     above the given row. Each element should be zero prior to hashing the
+ *     first row.
+ */
+typedef void guac_display_plan_hash_row_function(const uint32_t* restrict row,
+        int width, uint64_t* restrict cell_hash);
+
+/**
+ * Portable, scalar implementation of guac_display_plan_hash_row_function. The
+ * results of this implementation are the reference against which any
+ * SIMD-accelerated implementation must be identical.
+ *
+ * @see guac_display_plan_hash_row_function
+ */
+guac_display_plan_hash_row_function guac_display_plan_hash_row_scalar;
+
+/**
+ * Returns the fastest implementation of guac_display_plan_hash_row_function
+ * supported by the current CPU, as determined at runtime. If no
+ * SIMD-accelerated implementation is supported, this will be
+ * guac_display_plan_hash_row_scalar().
+ *
+ * @return
+ *     The fastest available implementation of
+ *     guac_display_plan_hash_row_function.
+ */
+guac_display_plan_hash_row_function* guac_display_plan_get_hash_row(void);
+
+/**
+ * Returns a human-readable name for the implementation returned by
+ * guac_display_plan_get_hash_row(), such as "avx2", "neon", or "scalar".
+ *
+ * @return
+ *     The name of the implementation of guac_display_plan_hash_row_function
+ *     selected for the current CPU.
+ */
+const char* guac_display_plan_get_hash_row_name(void);
+
+/**
+ * Function that compares a row of image data from two buffers, producing a
+ * bitmap of the pixels that differ for each 64-pixel cell in that row. The
+ * first element of the resulting array corresponds to the first 64 pixels,
+ * the second element to the next 64 pixels, and so on, with the least
+ * significant bit of each element corresponding to the leftmost pixel of the
+ * cell. If the width of the row is not a multiple of 64, the bits of the final
+ * element that lie beyond the end of the row will be zero.
+ *
+ * All implementations of this function MUST produce identical results.
+ *
+ * @param buffer_a
+ *     The first pixel of the row of image data within the first buffer.
+ *
+ * @param buffer_b
+ *     The first pixel of the row of image data within the second buffer.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ *
+ * @param changed
+ *     An array of at least GUAC_DISPLAY_CELL_DIMENSION(width) elements that
+ *     should receive the bitmaps of differing pixels.
+ */
+typedef void guac_display_plan_diff_row_function(const uint32_t* restrict buffer_a,
+        const uint32_t* restrict buffer_b, int width, uint64_t* restrict changed);
+
+/**
+ * Portable, scalar implementation of guac_display_plan_diff_row_function. The
+ * results of this implementation are the reference against which any
+ * SIMD-accelerated implementation must be identical.
+ *
+ * @see guac_display_plan_diff_row_function
+ */
+guac_display_plan_diff_row_function guac_display_plan_diff_row_scalar;
+
+/**
+ * Returns the fastest implementation of guac_display_plan_diff_row_function
+ * supported by the current CPU, as determined at runtime. If no
+ * SIMD-accelerated implementation is supported, this will be
+ * guac_display_plan_diff_row_scalar().
+ *
+ * @return
+ *     The fastest available implementation of
+ *     guac_display_plan_diff_row_function.
+ */
+guac_display_plan_diff_row_function* guac_display_plan_get_diff_row(void);
+
+/**
+ * Returns a human-readable name for the implementation returned by
+ * guac_display_plan_get_diff_row(), such as "avx2", "sse2", "neon", or
+ * "scalar".
+ *
+ * @return
+ *     The name of the implementation of guac_display_plan_diff_row_function
+ *     selected for the current CPU.
+ */
+const char* guac_display_plan_get_diff_row_name(void);
+
+/**
+ * Returns the number of bands that a display planning phase involving the
+ * given amount of work should be split into. The number of bands returned
+ * will never exceed the number of worker threads of the given display, and
+ * will be 1 if the work involved is not large enough to benefit from being
+ * split.
+ *
+ * @param display
+ *     The guac_display that the planning phase is being performed for.
+ *
+ * @param area
+ *     The approximate number of pixels that must be processed by the planning
+ *     phase.
+ *
+ * @return
+ *     The number of bands that the planning phase should be split into.
+ */
+int guac_display_plan_band_count(guac_display* display, size_t area);
+
+/**
+ * Invokes the given callback once for each of the given number of bands,
+ * lending any idle worker threads of the given display to process those bands
+ * concurrently. The calling thread also processes bands, and this function
+ * returns only after all bands have been fully processed. If only a single
+ * band is requested, or if the display has only a single worker thread, all
+ * bands are simply processed in order by the calling thread.
+ *
+ * IMPORTANT: This function may be used only while planning a frame, when the
+ * operation FIFO of the display is known to be empty and no worker threads
+ * are active. The worker threads processing bands act on behalf of the
+ * calling thread, relying on whatever locks the calling thread holds, and
+ * thus do not acquire any locks of their own. The calling thread must not
+ * hold the lock of the operation FIFO.
+ *
+ * @param display
+ *     The guac_display whose worker threads should assist with processing
+ *     the given bands.
+ *
+ * @param bands
+ *     The number of bands to process.
+ *
+ * @param callback
+ *     The function to invoke for each band.
+ *
+ * @param data
+ *     Arbitrary data to pass to the callback for each band.
+ */
+void guac_display_plan_run_bands(guac_display* display, int bands,
+        guac_display_plan_band_callback* callback, void* data);
+
+/**
+ * Processes bands of the given task within the current worker thread until
+ * no unclaimed bands remain. The worker thread must have first registered
+ * itself with the task by a call to guac_display_plan_task_join(). This
+ * function is intended only for use by the guac_display worker threads upon
+ * receiving a GUAC_DISPLAY_PLAN_OPERATION_TASK operation.
+ *
+ * @param task
+ *     The task to assist with.
+ */
+void guac_display_plan_task_work(guac_display_plan_task* task);
+
+/**
+ * Registers the current worker thread as assisting with the given task. This
+ * function MUST be invoked while the operation FIFO that provided the
+ * GUAC_DISPLAY_PLAN_OPERATION_TASK operation is still locked, and MUST be
+ * followed by a call to guac_display_plan_task_work() once that lock has been
+ * released.
+ *
+ * @param task
+ *     The task being joined.
+ */
+void guac_display_plan_task_join(guac_display_plan_task* task);
+
 /**
  * Creates a new guac_display_plan representing the changes necessary to
  * transform the current remote display state seen by each connected user (the
@@ -319,7 +727,12 @@ typedef struct guac_display_plan {
 guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display);
 
 /**
- * Frees all memory associated with the given guac_display_plan.
+ * Frees all memory associated with the given guac_display_plan. All such
+ * memory is allocated from the plan_arena of the associated guac_display and
+ * is retained by that arena for use by future plans.
+ *
+ * IMPORTANT: The calling thread must already hold the write lock for the
+ * display's pending_frame.lock.
  *
  * @param plan
  *     The plan to free.
@@ -336,6 +749,35 @@ void guac_display_plan_free(guac_display_plan* plan);
  */
 void PFR_guac_display_plan_rewrite_as_rects(guac_display_plan* plan);
 
+/**
+ * Walks through all operations currently in the given guac_display_plan,
+ * replacing draw operations with copies from the previous frame wherever the
+ * copy hints of the relevant layer describe a copy that is confirmed by the
+ * image data. This function should be invoked before
+ * guac_display_plan_index_dirty_cells(), such that operations handled by copy
+ * hints need not be hashed.
+ *
+ * @param plan
+ *     The guac_display_plan to modify.
+ */
+void PFR_LFR_guac_display_plan_rewrite_hinted_copies(guac_display_plan* plan);
+
+/**
+ * Searches the modified region of each layer of the given plan for contents
+ * that have scrolled (shifted vertically or horizontally) since the previous
+ * frame, comparing hashes of the rows and columns of the previous and pending
+ * frames within each cell-wide strip or cell-tall band of that region. Each
+ * scrolled region found is recorded as a copy hint within the pending frame
+ * of its layer, to be applied by
+ * PFR_LFR_guac_display_plan_rewrite_hinted_copies(). Layers that already have
+ * copy hints, that are not to be searched for copies, or that are being
+ * resized are ignored.
+ *
+ * @param plan
+ *     The guac_display_plan whose layers should be searched.
+ */
+void PFW_LFR_guac_display_plan_detect_scrolls(guac_display_plan* plan);
+
 /**
  * Walks through all operations currently in the given guac_display_plan,
  * storing the hashes of each outstanding draw operation within ops_by_hash.
@@ -361,23 +803,56 @@ void PFR_LFR_guac_display_plan_rewrite_as_copies(guac_display_plan* plan);
 
 /**
  * Walks through all operations currently in the given guac_display_plan,
- * combining horizontally-adjacent operations wherever doing so appears to be
- * more efficient than performing those operations separately.
+ * replacing draw operations with simple copies wherever draws can be rewritten
+ * as copies that pull image data from the display's client-side tile cache.
+ * Draws of cells that are not cached and have not been modified recently are
+ * added to the tile cache for future reuse. The display plan must first be
+ * indexed by guac_display_plan_index_dirty_cells() before this function can
+ * be used.
  *
  * @param plan
  *     The guac_display_plan to modify.
  */
-void PFW_guac_display_plan_combine_horizontally(guac_display_plan* plan);
+void PFR_LFW_guac_display_plan_rewrite_as_tile_copies(guac_display_plan* plan);
 
 /**
  * Walks through all operations currently in the given guac_display_plan,
- * combining vertically-adjacent operations wherever doing so appears to be
- * more efficient than performing those operations separately.
+ * combining each operation with whichever horizontally- or vertically-adjacent
+ * operation results in the greatest estimated reduction in the number of
+ * bytes sent. Costs are estimated from the size of each operation and the
+ * complexity of the image data it would contain, as determined by sampling
+ * the pending frame of the relevant layer.
  *
  * @param plan
  *     The guac_display_plan to modify.
  */
-void PFW_guac_display_plan_combine_vertically(guac_display_plan* plan);
+void PFW_guac_display_plan_combine(guac_display_plan* plan);
+
+/**
+ * Rewrites any copy or rectangle operations of the given plan that involve a
+ * region of a layer currently being streamed as video as image operations,
+ * such that the worker threads can incorporate those changes into the video
+ * or end the video as appropriate. The last_frame.lock of the associated
+ * guac_display MUST be held for writing, or it must otherwise be known that
+ * no worker threads are active.
+ *
+ * @param plan
+ *     The display plan to rewrite.
+ */
+void LFW_guac_display_plan_rewrite_video_overlaps(guac_display_plan* plan);
+
+/**
+ * Updates the refinement state of each layer of the given plan to account
+ * for the copy and rectangle operations within that plan, which do not pass
+ * through the worker threads. Rectangles are always drawn losslessly, while
+ * copies from the previous frame of a layer carry along the refinement state
+ * of the region copied. The refinement state of each layer is also resized to
+ * match the dimensions that layer will have in the new frame.
+ *
+ * @param plan
+ *     The display plan that is about to be applied.
+ */
+void PFR_LFW_guac_display_plan_track_refinement(guac_display_plan* plan);
 
 /**
  * Enqueues all operations from the given plan within the operation FIFO used
@@ -386,6 +861,18 @@ void PFW_guac_display_plan_combine_vertically(guac_display_plan* plan);
  * these operations, with the final operation resulting in a frame boundary
  * ("sync" instruction) being sent to connected users.
  *
+ * Image operations are enqueued in order of decreasing cost, such that the
+ * most expensive images begin encoding first and smaller images fill in the
+ * remaining time of each worker. If the mouse cursor has moved recently, any
+ * image operations on the default layer that lie within
+ * GUAC_DISPLAY_PLAN_CURSOR_RADIUS pixels of the cursor are enqueued ahead of
+ * all others (again in order of decreasing cost). If there are fewer image
+ * operations than worker threads, large image operations are additionally
+ * split into smaller, aligned images that can be encoded in parallel.
+ *
+ * The pending frame lock of the display associated with the plan must be
+ * held for writing.
+ *
  * @param plan
  *     The guac_display_plan to apply.
  */
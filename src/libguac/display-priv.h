@@ -20,14 +20,19 @@
 #ifndef GUAC_DISPLAY_PRIV_H
 #define GUAC_DISPLAY_PRIV_H
 
+#include "display-builtin-cursors.h"
 #include "display-plan.h"
+#include "encode-context.h"
 #include "guacamole/client.h"
 #include "guacamole/display.h"
 #include "guacamole/fifo.h"
+#include "guacamole/layer.h"
 #include "guacamole/rect.h"
 #include "guacamole/socket.h"
 
+#include <cairo/cairo.h>
 #include <pthread.h>
+#include <stdint.h>
 
 /**
  * The maximum amount of time to wait after flushing a frame when compensating
@@ -38,6 +43,219 @@
  */
 #define GUAC_DISPLAY_MAX_LAG_COMPENSATION 500
 
+/**
+ * The minimum amount of time between logged summaries of the statistics of a
+ * guac_display, in milliseconds. Summaries are logged at the debug level.
+ */
+#define GUAC_DISPLAY_STATS_LOG_INTERVAL 30000
+
+/**
+ * The maximum number of bytes of encoded image data that may be stored within
+ * the guac_display_image_cache of a guac_display.
+ */
+#define GUAC_DISPLAY_IMAGE_CACHE_SIZE 16777216
+
+/**
+ * The maximum number of bytes of encoded image data that may be stored for
+ * any single image within the guac_display_image_cache of a guac_display.
+ * Images larger than this are not cached.
+ */
+#define GUAC_DISPLAY_IMAGE_CACHE_MAX_ENTRY_SIZE (GUAC_DISPLAY_IMAGE_CACHE_SIZE / 4)
+
+/**
+ * The number of hash buckets within the guac_display_image_cache of a
+ * guac_display. This value MUST be a power of two.
+ */
+#define GUAC_DISPLAY_IMAGE_CACHE_BUCKETS 1024
+
+/**
+ * The number of pixels of unmodified area that may be included within a
+ * modified region of a layer as a result of coalescing two modified regions,
+ * before those regions are instead tracked separately. This corresponds to
+ * the area of four 64x64 cells.
+ */
+#define GUAC_DISPLAY_LAYER_DAMAGE_MERGE_AREA 16384
+
+/**
+ * The alignment of all allocations made from a guac_display_arena, in
+ * bytes. This value MUST be a power of two and must be sufficient for any
+ * type stored within the arena.
+ */
+#define GUAC_DISPLAY_ARENA_ALIGNMENT 16
+
+/**
+ * The granularity that the primary block of a guac_display_arena is grown
+ * by, in bytes. This value MUST be a power of two.
+ */
+#define GUAC_DISPLAY_ARENA_GRANULARITY 65536
+
+/**
+ * The number of columns of 64x64 tiles within the client-side buffer used by
+ * the guac_display_tile_cache of a guac_display.
+ */
+#define GUAC_DISPLAY_TILE_CACHE_COLUMNS 32
+
+/**
+ * The number of rows of 64x64 tiles within the client-side buffer used by
+ * the guac_display_tile_cache of a guac_display.
+ */
+#define GUAC_DISPLAY_TILE_CACHE_ROWS 32
+
+/**
+ * The total number of 64x64 tiles that may be stored within the
+ * guac_display_tile_cache of a guac_display.
+ */
+#define GUAC_DISPLAY_TILE_CACHE_SIZE \
+    (GUAC_DISPLAY_TILE_CACHE_COLUMNS * GUAC_DISPLAY_TILE_CACHE_ROWS)
+
+/**
+ * The number of hash buckets within the guac_display_tile_cache of a
+ * guac_display. This value MUST be a power of two.
+ */
+#define GUAC_DISPLAY_TILE_CACHE_BUCKETS 2048
+
+/**
+ * The minimum amount of time that must have elapsed since a cell was last
+ * modified for the new contents of that cell to be stored within the
+ * guac_display_tile_cache, in milliseconds. Cells that change more frequently
+ * than this (video, animations, etc.) are unlikely to ever be seen again and
+ * are not cached.
+ */
+#define GUAC_DISPLAY_TILE_CACHE_MIN_AGE 1000
+
+/**
+ * The maximum width or height of an image operation that may be packed into
+ * a guac_display_atlas, in pixels. Larger images are large enough that the
+ * fixed overhead of sending each as its own image is insignificant.
+ */
+#define GUAC_DISPLAY_ATLAS_MAX_OP_SIZE 64
+
+/**
+ * The width of the client-side buffer of each guac_display_atlas, and thus
+ * the maximum width of each atlas image, in pixels.
+ */
+#define GUAC_DISPLAY_ATLAS_WIDTH 512
+
+/**
+ * The height of the client-side buffer of each guac_display_atlas, and thus
+ * the maximum height of each atlas image, in pixels.
+ */
+#define GUAC_DISPLAY_ATLAS_HEIGHT 512
+
+/**
+ * The maximum number of image operations that may be packed into a single
+ * guac_display_atlas.
+ */
+#define GUAC_DISPLAY_ATLAS_MAX_ENTRIES 256
+
+/**
+ * The minimum number of image operations that must be packed into each
+ * guac_display_atlas. If fewer eligible operations are available, those
+ * operations are sent as individual images.
+ */
+#define GUAC_DISPLAY_ATLAS_MIN_ENTRIES 4
+
+/**
+ * The maximum number of atlases that may be sent within a single frame.
+ * Atlases are encoded in parallel by the worker threads, and a frame may use
+ * no more atlases than there are worker threads.
+ */
+#define GUAC_DISPLAY_ATLAS_COUNT 8
+
+/**
+ * The size of the square tiles that make up the snapshot of each layer sent
+ * to joining users, in pixels. This value MUST be a multiple of
+ * GUAC_DISPLAY_CELL_SIZE.
+ */
+#define GUAC_DISPLAY_SNAPSHOT_TILE_SIZE 256
+
+/**
+ * The maximum number of bytes of encoded image data that will be retained for
+ * any single tile of a layer snapshot. Tiles that encode to more than this are
+ * re-encoded each time they are needed.
+ */
+#define GUAC_DISPLAY_SNAPSHOT_TILE_MAX_SIZE 1048576
+
+/**
+ * Returns the number of snapshot tiles needed to cover the given width or
+ * height, in pixels.
+ *
+ * @param pixels
+ *     The width or height of a layer, in pixels.
+ *
+ * @return
+ *     The number of GUAC_DISPLAY_SNAPSHOT_TILE_SIZE tiles required to cover
+ *     that width or height.
+ */
+#define GUAC_DISPLAY_SNAPSHOT_DIMENSION(pixels) \
+    ((pixels + GUAC_DISPLAY_SNAPSHOT_TILE_SIZE - 1) / GUAC_DISPLAY_SNAPSHOT_TILE_SIZE)
+
+/**
+ * The amount of time that a region sent using lossy compression must remain
+ * unchanged before it is sent again losslessly, in milliseconds.
+ */
+#define GUAC_DISPLAY_REFINE_DELAY 250
+
+/**
+ * The minimum amount of time between adjustments of the lossy encoding
+ * quality of a guac_display, in milliseconds.
+ */
+#define GUAC_DISPLAY_QUALITY_UPDATE_INTERVAL 250
+
+/**
+ * The lowest quality that will be used for lossy encoding, as an integer
+ * value ranging from 0 (lowest quality) to 100 (highest quality).
+ */
+#define GUAC_DISPLAY_QUALITY_MIN 30
+
+/**
+ * The highest quality that will be used for lossy encoding, as an integer
+ * value ranging from 0 (lowest quality) to 100 (highest quality).
+ */
+#define GUAC_DISPLAY_QUALITY_MAX 90
+
+/**
+ * The amount that lossy encoding quality is increased at each adjustment
+ * while the connection appears to have spare capacity.
+ */
+#define GUAC_DISPLAY_QUALITY_STEP_UP 2
+
+/**
+ * The minimum amount that lossy encoding quality is decreased at each
+ * adjustment while the connection appears congested. Quality is decreased
+ * multiplicatively, by a quarter of its distance from
+ * GUAC_DISPLAY_QUALITY_MIN, if that would be larger.
+ */
+#define GUAC_DISPLAY_QUALITY_STEP_DOWN 5
+
+/**
+ * The processing lag above which the connection is considered congested and
+ * lossy encoding quality is reduced, in milliseconds.
+ */
+#define GUAC_DISPLAY_QUALITY_HIGH_LAG 80
+
+/**
+ * The processing lag below which the connection is considered to have spare
+ * capacity and lossy encoding quality may be increased, in milliseconds.
+ * Between this value and GUAC_DISPLAY_QUALITY_HIGH_LAG, quality is left
+ * unchanged, preventing quality from oscillating.
+ */
+#define GUAC_DISPLAY_QUALITY_LOW_LAG 30
+
+/**
+ * The framerate at or above which a region of a layer that would otherwise
+ * be encoded as JPEG or WebP is instead streamed as video, if video encoding
+ * is available and supported by all connected users, in frames per second.
+ */
+#define GUAC_DISPLAY_VIDEO_FRAMERATE 20
+
+/**
+ * The minimum area of a region that may be streamed as video, in pixels.
+ * Smaller regions are cheap enough to send as individual images that the
+ * overhead of a video stream is not worthwhile.
+ */
+#define GUAC_DISPLAY_VIDEO_MIN_SIZE 65536
+
 /*
  * IMPORTANT: All functions defined within the internals of guac_display that
  * DO NOT acquire locks on their own are given prefixes based on whether they
@@ -121,6 +339,26 @@
  */
 #define GUAC_DISPLAY_RESIZE_FACTOR 64
 
+/**
+ * The additional width, as a fraction of the new width, that should be
+ * reserved within each row of a layer's internal storage when that layer
+ * grows beyond its current storage width. Reserving extra width allows a
+ * layer that is repeatedly grown (such as while the browser window is
+ * interactively resized) to continue growing in place, without the stride of
+ * its storage changing and thus without copying its contents. This value is
+ * a divisor, such that a value of 4 reserves an additional 25%.
+ */
+#define GUAC_DISPLAY_RESIZE_HEADROOM 4
+
+/**
+ * The factor by which the internal storage of a layer must exceed the
+ * storage that the layer actually requires before that storage is shrunk by
+ * guac_display_reclaim_memory(). Storage that is only slightly oversized is
+ * left alone, as shrinking it would release little memory while forcing the
+ * layer to be reallocated should it grow again.
+ */
+#define GUAC_DISPLAY_RECLAIM_FACTOR 2
+
 /**
  * Given the width (or height) of a layer in pixels, calculates the width (or
  * height) of that layer's pending_frame_cells array in cells.
@@ -245,6 +483,13 @@
  */
 #define GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_READY 4
 
+/**
+ * Bitwise flag that is set on the state of a guac_display_render_thread when
+ * all graphical changes that the render thread has been notified of have been
+ * flushed from the pending frame.
+ */
+#define GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_FLUSHED 8
+
 /**
  * The state of the mouse cursor, as independently tracked by the render
  * thread. The mouse cursor state may be reported by
@@ -299,9 +544,18 @@ struct guac_display_render_thread {
      * @see GUAC_DISPLAY_RENDER_THREAD_STATE_STOPPING
      * @see GUAC_DISPLAY_RENDER_THREAD_FRAME_MODIFIED
      * @see GUAC_DISPLAY_RENDER_THREAD_FRAME_READY
+     * @see GUAC_DISPLAY_RENDER_THREAD_FRAME_FLUSHED
      */
     guac_flag state;
 
+    /**
+     * The number of times that the render thread has been notified of
+     * graphical changes via guac_display_render_thread_notify_modified() or
+     * guac_display_render_thread_notify_frame(). This value may only be
+     * accessed while holding the lock of the state flag.
+     */
+    unsigned int notifications;
+
     /**
      * The current mouse cursor state, as reported by
      * guac_display_render_thread_notify_user_moved_mouse().
@@ -471,12 +725,39 @@ typedef struct guac_display_layer_state {
      */
     guac_rect dirty;
 
+    /**
+     * The distinct regions of this layer that have been modified since the
+     * last frame, the union of which contains all modified pixels and the
+     * bounding box of which is the dirty rect. This is maintained only for
+     * the pending frame, and only by PFW_guac_display_layer_add_damage(). If
+     * empty while the dirty rect is not, the entire dirty rect must be
+     * considered modified.
+     */
+    guac_rect damage[GUAC_DISPLAY_LAYER_MAX_DAMAGE];
+
+    /**
+     * The number of regions within the damage array.
+     */
+    int damage_count;
+
     /**
      * Whether this layer should be searched for possible scroll/copy
      * optimizations.
      */
     int search_for_copies;
 
+    /**
+     * Hints describing regions of this layer that were copied from elsewhere
+     * within this layer since the last frame. This is maintained only for
+     * the pending frame.
+     */
+    guac_display_copy_hint copy_hints[GUAC_DISPLAY_LAYER_MAX_COPY_HINTS];
+
+    /**
+     * The number of hints within the copy_hints array.
+     */
+    int copy_hint_count;
+
     /* ---------------- LAYER LIST POINTERS ---------------- */
 
     /**
@@ -493,6 +774,234 @@ typedef struct guac_display_layer_state {
 
 } guac_display_layer_state;
 
+/**
+ * A single tile of the snapshot of a guac_display_layer, containing the
+ * PNG-encoded contents of the corresponding region of the layer as of the
+ * last time that region was sent to a joining user.
+ */
+typedef struct guac_display_snapshot_tile {
+
+    /**
+     * The PNG-encoded contents of this tile, or NULL if this tile has not yet
+     * been encoded or could not be retained.
+     */
+    unsigned char* data;
+
+    /**
+     * The number of bytes of encoded image data within data.
+     */
+    size_t length;
+
+    /**
+     * The width of the region of the layer that was encoded, in pixels. Tiles
+     * along the right edge of a layer may be narrower than
+     * GUAC_DISPLAY_SNAPSHOT_TILE_SIZE.
+     */
+    int width;
+
+    /**
+     * The height of the region of the layer that was encoded, in pixels.
+     * Tiles along the bottom edge of a layer may be shorter than
+     * GUAC_DISPLAY_SNAPSHOT_TILE_SIZE.
+     */
+    int height;
+
+    /**
+     * Non-zero if the region of the layer covered by this tile has been
+     * modified since the tile was encoded, zero if data may be sent as-is.
+     */
+    int stale;
+
+} guac_display_snapshot_tile;
+
+/**
+ * A pre-encoded copy of the contents of a guac_display_layer, divided into
+ * tiles that are each refreshed only when needed by a joining user and only
+ * if modified since they were last encoded. This allows users joining an
+ * existing connection to be synchronized without re-encoding the entire
+ * display.
+ */
+typedef struct guac_display_layer_snapshot {
+
+    /**
+     * Two-dimensional array of the tiles of this snapshot, stored in row-major
+     * order, or NULL if no tiles have yet been allocated.
+     */
+    guac_display_snapshot_tile* tiles;
+
+    /**
+     * The width of the tiles array, in tiles.
+     */
+    size_t width;
+
+    /**
+     * The height of the tiles array, in tiles.
+     */
+    size_t height;
+
+} guac_display_layer_snapshot;
+
+/**
+ * The state of the video stream, if any, that is currently used to update a
+ * rapidly-changing region of a guac_display_layer. Video frames are drawn to
+ * a separate overlay layer positioned over that region, leaving the
+ * underlying region of the guac_display_layer untouched (and therefore
+ * stale) until the video stream ends.
+ */
+typedef struct guac_display_layer_video {
+
+    /**
+     * Lock which guards access to all other members of this structure. As
+     * workers only ever hold the display-level last_frame.lock for reading,
+     * this lock is additionally required to serialize worker access to the
+     * video stream. Code that holds last_frame.lock for writing need not
+     * acquire this lock.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * The encoder backend session of the current video stream, or NULL if no
+     * video stream is active. All other members of this structure (other than
+     * lock) are valid only while this is non-NULL.
+     */
+    void* session;
+
+    /**
+     * The region of the guac_display_layer covered by the video stream. The
+     * dimensions of this region are always even.
+     */
+    guac_rect rect;
+
+    /**
+     * The layer that the video stream is played on, positioned at the
+     * upper-left corner of rect within the guac_display_layer.
+     */
+    guac_layer* layer;
+
+    /**
+     * The Guacamole stream carrying the encoded video.
+     */
+    guac_stream* stream;
+
+    /**
+     * The timestamp of the last frame that was encoded, such that multiple
+     * operations within the same frame result in only one encoded frame.
+     */
+    guac_timestamp frame;
+
+    /**
+     * The number of users connected at the time the video stream began. Users
+     * that join later cannot receive the in-progress stream, so the stream is
+     * ended (and may be restarted) if this changes.
+     */
+    int users;
+
+} guac_display_layer_video;
+
+/**
+ * The regions of a guac_display_layer that were last sent to connected
+ * clients using lossy compression, tracked per cell. Such regions are sent
+ * again losslessly once they have remained unchanged for
+ * GUAC_DISPLAY_REFINE_DELAY milliseconds, such that lossy compression never
+ * results in a permanent loss of quality.
+ */
+typedef struct guac_display_layer_refinement {
+
+    /**
+     * Two-dimensional array containing, for each cell, the time at which the
+     * contents of that cell were last sent using lossy compression, stored in
+     * row-major order. Cells whose contents were last sent losslessly have a
+     * value of zero. This is NULL if no cells have yet been allocated.
+     */
+    guac_timestamp* cells;
+
+    /**
+     * The width of the cells array, in cells.
+     */
+    size_t width;
+
+    /**
+     * The height of the cells array, in cells.
+     */
+    size_t height;
+
+    /**
+     * The region of the layer covered by the cells array, in pixels. The
+     * cells along the right and bottom edges of this region may be only
+     * partially within the layer.
+     */
+    guac_rect bounds;
+
+} guac_display_layer_refinement;
+
+/**
+ * The state of a guac_display_layer as last written by guac_display_record(),
+ * allowing each recorded frame to contain only what has changed since the
+ * previous recorded frame.
+ */
+typedef struct guac_display_layer_record {
+
+    /**
+     * Non-zero if this layer has been written by guac_display_record() at
+     * least once, zero if the layer has not yet been recorded at all.
+     */
+    int recorded;
+
+    /**
+     * Two-dimensional array of flags, one for each cell of the layer in
+     * row-major order, with each flag non-zero if the corresponding cell has
+     * been modified since it was last recorded. This is NULL if the layer has
+     * not yet been recorded or has no cells.
+     */
+    unsigned char* cells;
+
+    /**
+     * The width of the cells array, in cells.
+     */
+    size_t width;
+
+    /**
+     * The height of the cells array, in cells.
+     */
+    size_t height;
+
+    /**
+     * The width of the layer as last recorded, in pixels.
+     */
+    int layer_width;
+
+    /**
+     * The height of the layer as last recorded, in pixels.
+     */
+    int layer_height;
+
+    /**
+     * The opacity of the layer as last recorded.
+     */
+    int opacity;
+
+    /**
+     * The X coordinate of the layer as last recorded.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the layer as last recorded.
+     */
+    int y;
+
+    /**
+     * The Z-order of the layer as last recorded.
+     */
+    int z;
+
+    /**
+     * The parent of the layer as last recorded.
+     */
+    const guac_layer* parent;
+
+} guac_display_layer_record;
+
 struct guac_display_layer {
 
     /**
@@ -526,6 +1035,18 @@ struct guac_display_layer {
      */
     guac_display_layer_state last_frame;
 
+    /**
+     * Non-zero if every pixel of this layer has been drawn client-side as of
+     * the last frame, such that the layer truly hides whatever lies beneath
+     * it, zero otherwise. This is tracked only for opaque visible layers
+     * other than the default layer, which are filled with black as they are
+     * resized for this purpose.
+     *
+     * IMPORTANT: The display-level last_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    int last_frame_filled;
+
     /**
      * Off-screen buffer storing the contents of the previously-rendered frame
      * for later use. If graphical updates are recognized as reusing data from
@@ -603,14 +1124,102 @@ struct guac_display_layer {
      */
     size_t pending_frame_cells_height;
 
-};
-
-typedef struct guac_display_state {
+    /**
+     * Non-zero if the changes to the pending frame of this layer are being
+     * deferred while planning the current frame, as they would be entirely
+     * hidden beneath other opaque layers, zero otherwise. Deferred changes
+     * remain part of the pending frame (they are neither refined nor copied
+     * to the last frame) and are sent once they would no longer be hidden.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    int pending_frame_occluded;
 
     /**
-     * Lock that guards concurrent access to any member of ANY STRUCTURE that
-     * relates to this guac_display_state, including the members of this
-     * structure. Unless explicitly documented otherwise, this lock MUST be
+     * The dirty rect of the pending frame of this layer as reported by
+     * callers of the open/close layer functions, before the display plan
+     * refined that rect to cover only the pixels of the visible area of the
+     * layer that actually changed. Unlike the refined dirty rect, this
+     * includes any changes drawn beyond the edges of the layer (but within
+     * its buffer).
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_rect pending_frame_unrefined_dirty;
+
+    /**
+     * The region of the pending frame buffer of this layer that no longer
+     * contains the current contents of the pending frame. The buffers of the
+     * pending and last frames are exchanged when a frame is flushed, rather
+     * than copying the changes of that frame into the last frame, leaving
+     * the changes of that frame missing from the pending frame buffer. Those
+     * changes are copied back from the last frame buffer only once the
+     * pending frame buffer is next accessed. See
+     * PFW_LFW_guac_display_layer_exchange_buffers() and
+     * PFW_LFR_guac_display_layer_restore_stale().
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_rect pending_frame_stale;
+
+    /* ---------------- LAYER VIDEO STATE ---------------- */
+
+    /**
+     * The video stream, if any, currently used to update a rapidly-changing
+     * region of this layer.
+     *
+     * IMPORTANT: The display-level last_frame.lock MUST be acquired before
+     * modifying or reading this member, and video.lock must additionally be
+     * acquired if last_frame.lock is only held for reading.
+     */
+    guac_display_layer_video video;
+
+    /* ---------------- LAYER SNAPSHOT STATE ---------------- */
+
+    /**
+     * The pre-encoded contents of the last frame of this layer, used to
+     * synchronize joining users.
+     *
+     * IMPORTANT: The display-level last_frame.lock MUST be acquired for
+     * writing before modifying or reading this member, unless both
+     * last_frame.lock is held for reading and snapshot_lock is held.
+     */
+    guac_display_layer_snapshot snapshot;
+
+    /* ---------------- LAYER REFINEMENT STATE ---------------- */
+
+    /**
+     * The regions of the last frame of this layer that were sent using lossy
+     * compression and have not yet been sent again losslessly.
+     *
+     * IMPORTANT: The display-level last_frame.lock MUST be acquired for
+     * writing before modifying or reading this member, unless both
+     * last_frame.lock is held for reading and refinement_lock is held.
+     */
+    guac_display_layer_refinement refinement;
+
+    /* ---------------- LAYER RECORDING STATE ---------------- */
+
+    /**
+     * The state of this layer as last written by guac_display_record().
+     *
+     * IMPORTANT: The display-level last_frame.lock MUST be acquired for
+     * writing before modifying or reading this member, unless both
+     * last_frame.lock is held for reading and record_lock is held.
+     */
+    guac_display_layer_record record;
+
+};
+
+typedef struct guac_display_state {
+
+    /**
+     * Lock that guards concurrent access to any member of ANY STRUCTURE that
+     * relates to this guac_display_state, including the members of this
+     * structure. Unless explicitly documented otherwise, this lock MUST be
      * acquired before accessing or modifying the members of this
      * guac_display_state or any nested structure.
      */
@@ -661,6 +1270,20 @@ typedef struct guac_display_state {
      */
     int cursor_hotspot_y;
 
+    /**
+     * The buffer whose contents are currently serving as the mouse cursor
+     * image, as set by guac_display_set_cursor_buffer(), or NULL if the mouse
+     * cursor image is the contents of the cursor_buffer member of guac_display.
+     */
+    guac_display_layer* cursor_source;
+
+    /**
+     * Non-zero if the mouse cursor must be resent regardless of whether the
+     * cursor_buffer member of guac_display has been modified, such as when
+     * cursor_source has changed, zero otherwise.
+     */
+    int cursor_source_modified;
+
     /**
      * The user that moved or clicked the mouse. This is used to ensure we
      * don't attempt to synchronize an out-of-date mouse position to the user
@@ -686,6 +1309,13 @@ typedef struct guac_display_state {
      */
     int cursor_mask;
 
+    /**
+     * The point in time that the mouse cursor was last moved, or that the
+     * state of any mouse button last changed. This is only updated as each
+     * frame is completed, and is thus meaningful only for the last frame.
+     */
+    guac_timestamp cursor_timestamp;
+
     /**
      * The number of logical frames that have been rendered to this display
      * state since the previous display state.
@@ -694,171 +1324,1714 @@ typedef struct guac_display_state {
 
 } guac_display_state;
 
-struct guac_display {
+/**
+ * The image formats that may be used by the guac_display worker threads to
+ * encode image data.
+ */
+typedef enum guac_display_image_format {
 
-    /* NOTE: Any member of this structure that requires protection against
-     * concurrent access is protected by its own lock. The overall display does
-     * not have nor need a top-level lock. */
+    /**
+     * Lossless PNG.
+     */
+    GUAC_DISPLAY_IMAGE_FORMAT_PNG,
 
     /**
-     * The client associated with this display.
+     * Lossy JPEG.
      */
-    guac_client* client;
+    GUAC_DISPLAY_IMAGE_FORMAT_JPEG,
 
-    /* ---------------- DISPLAY FRAME STATES ---------------- */
+    /**
+     * WebP (lossy or lossless).
+     */
+    GUAC_DISPLAY_IMAGE_FORMAT_WEBP
+
+} guac_display_image_format;
+
+/**
+ * A block of memory allocated by a guac_display_arena because its primary
+ * block had insufficient space. The memory provided by the chunk immediately
+ * follows this header.
+ */
+typedef struct guac_display_arena_chunk {
 
     /**
-     * The state of this display at the time the last frame was sent to
-     * connected users.
+     * The next chunk allocated since the arena was last reset, or NULL if
+     * this is the last such chunk.
      */
-    guac_display_state last_frame;
+    struct guac_display_arena_chunk* next;
+
+} guac_display_arena_chunk;
+
+/**
+ * A simple region-based allocator for memory that is needed only while
+ * planning a single frame. Allocations are never freed individually. The
+ * entire arena is instead reset once the frame has been planned, with its
+ * memory retained for the next frame. If the primary block of the arena
+ * proves too small, additional chunks are allocated as needed, and the
+ * primary block is grown to the high-water mark at the next reset, such that
+ * the arena eventually stops allocating memory altogether.
+ */
+typedef struct guac_display_arena {
 
     /**
-     * The pending state of this display that will become the next frame once
-     * it is sent to connected users.
+     * The primary block of memory from which allocations are made, or NULL if
+     * no such block has yet been allocated.
      */
-    guac_display_state pending_frame;
+    unsigned char* block;
 
     /**
-     * Whether the pending frame has been modified in any way outside of
-     * changing the mouse cursor or moving the mouse. This is used to help
-     * inform whether a frame should be flushed to update connected clients
-     * with respect to mouse cursor changes, or whether those changes can be
-     * safely assumed to be part of a larger frame containing general graphical
-     * updates.
-     *
-     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
-     * modifying or reading this member.
+     * The size of the primary block, in bytes.
      */
-    int pending_frame_dirty_excluding_mouse;
+    size_t size;
 
-    /* ---------------- WELL-KNOWN LAYERS / BUFFERS ---------------- */
+    /**
+     * The number of bytes of the primary block that have been allocated
+     * since the arena was last reset.
+     */
+    size_t used;
 
     /**
-     * The default layer of the client display.
+     * The total number of bytes allocated from this arena since it was last
+     * reset, including any bytes allocated from chunks.
      */
-    guac_display_layer* default_layer;
+    size_t requested;
 
     /**
-     * The buffer storing the current mouse cursor. The hotspot position within
-     * the cursor is stored within cursor_hotspot_x and cursor_hotspot_y of
-     * guac_display_state.
+     * All chunks allocated since the arena was last reset, or NULL if every
+     * allocation has been satisfied by the primary block.
      */
-    guac_display_layer* cursor_buffer;
+    guac_display_arena_chunk* chunks;
 
-    /* ---------------- FRAME ENCODING WORKER THREADS ---------------- */
+    /**
+     * The largest number of bytes ever allocated from this arena between
+     * resets.
+     */
+    size_t high_water;
 
     /**
-     * The number of worker threads in the worker_threads array.
+     * The total number of times this arena has had to allocate memory from
+     * the system, including allocations of the primary block.
      */
-    int worker_thread_count;
+    uint64_t allocations;
+
+} guac_display_arena;
+
+/**
+ * A single 64x64 tile stored within the client-side buffer of a
+ * guac_display_tile_cache.
+ */
+typedef struct guac_display_tile_cache_entry {
 
     /**
-     * Pool of worker threads that automatically pull from the ops FIFO,
-     * sending corresponding Guacamole instructions to all connected clients.
+     * The hash of the contents of this tile, as produced by the same sliding
+     * window hash used to search for copies from the previous frame.
      */
-    pthread_t* worker_threads;
+    uint64_t hash;
 
     /**
-     * FIFO of all graphical operations required to transform the remote
-     * display state from the previous frame to the next frame. Operations
-     * added to this FIFO will automatically be pulled and processed by a
-     * worker thread.
+     * Non-zero if this entry currently contains a tile, zero if this entry is
+     * unused.
      */
-    guac_fifo ops;
+    int valid;
 
     /**
-     * Storage for any items within the ops fifo.
+     * The location of this tile within the client-side buffer of the
+     * guac_display_tile_cache. This location never changes.
      */
-    guac_display_plan_operation ops_items[GUAC_DISPLAY_WORKER_FIFO_SIZE];
+    guac_rect rect;
 
     /**
-     * The current number of active worker threads.
-     *
-     * IMPORTANT: This member must only be accessed or modified while the ops
-     * FIFO is locked.
+     * The value of the frame member of the guac_display_tile_cache at the
+     * time this tile was last used, either as the source of a copy or as
+     * the destination of a store. Tiles used within the frame currently being
+     * planned cannot be evicted.
      */
-    unsigned int active_workers;
+    uint64_t last_used;
 
     /**
-     * Whether least one pending frame has been deferred due to the encoding
-     * process being underway for a previous frame at the time it was
-     * completed.
-     *
-     * IMPORTANT: This member must only be accessed or modified while the ops
-     * FIFO is locked.
+     * The value of the frame member of the guac_display_tile_cache at the
+     * time the contents of this tile were stored. Tiles stored within the
+     * frame currently being planned are not yet present on the client side
+     * and cannot be used as the source of a copy.
      */
-    int frame_deferred;
+    uint64_t stored;
 
     /**
-     * The current state of the rendering process. Code that needs to be aware
-     * of whether a frame is currently in the process of being rendered can
-     * monitor the state of this flag, watching for either the
-     * GUAC_DISPLAY_RENDER_STATE_FRAME_IN_PROGRESS or
-     * GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS values.
+     * The next entry within the same hash bucket, or NULL if this is the last
+     * entry in the bucket.
      */
-    guac_flag render_state;
+    struct guac_display_tile_cache_entry* next_in_bucket;
 
-};
+    /**
+     * The next most recently used entry, or NULL if this is the most
+     * recently used entry.
+     */
+    struct guac_display_tile_cache_entry* newer;
+
+    /**
+     * The next least recently used entry, or NULL if this is the least
+     * recently used entry.
+     */
+    struct guac_display_tile_cache_entry* older;
+
+} guac_display_tile_cache_entry;
 
 /**
- * Allocates and inserts a new element into the given linked list of display
- * layers, associating it with the given layer and surface.
- *
- * @param head
- *     A pointer to the head pointer of the list of layers. The head pointer
- *     will be updated by this function to point to the newly-allocated
- *     display layer.
- *
- * @param layer
- *     The Guacamole layer to associated with the new display layer.
- *
- * @param opaque
- *     Non-zero if the new layer will only ever contain opaque image contents
- *     (the alpha channel should be ignored), zero otherwise.
- *
- * @return
- *     The newly-allocated display layer, which has been associated with the
- *     provided layer and surface.
+ * A pending copy of a 64x64 cell of a layer into the client-side buffer of a
+ * guac_display_tile_cache. Stores are sent only after all other graphical
+ * updates for the frame that produced the cell contents have been sent.
  */
-guac_display_layer* guac_display_add_layer(guac_display* display, guac_layer* layer, int opaque);
+typedef struct guac_display_tile_cache_store {
+
+    /**
+     * The entry that will receive the cell contents.
+     */
+    guac_display_tile_cache_entry* entry;
+
+    /**
+     * The layer containing the cell.
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The bounds of the cell within the layer.
+     */
+    guac_rect rect;
+
+} guac_display_tile_cache_store;
 
 /**
- * Removes the given layer from all linked lists containing that layer and
- * frees all associated memory.
+ * A bounded cache of recently-sent 64x64 tiles that are retained on the
+ * client side within an offscreen buffer, allowing draws of previously-seen
+ * image data to be replaced with copies from that buffer. A copy of the
+ * buffer contents is also maintained on the server side, both to verify
+ * matches and to allow the buffer to be synchronized to joining users.
  *
- * @param display_layer
- *     The layer to remove.
+ * IMPORTANT: The members of this structure must only be accessed or modified
+ * while the display-level last_frame.lock is held for writing, with the
+ * exception of the worker thread that sends the pending stores at the end of
+ * a frame, which may do so while holding only the read lock (no other thread
+ * accesses the tile cache while a frame is in progress).
  */
-void guac_display_remove_layer(guac_display_layer* display_layer);
+typedef struct guac_display_tile_cache {
+
+    /**
+     * The client-side buffer containing all cached tiles, or NULL if no tiles
+     * have yet been stored.
+     */
+    guac_layer* buffer;
+
+    /**
+     * The server-side copy of the contents of the client-side buffer, or
+     * NULL if no tiles have yet been stored.
+     */
+    unsigned char* data;
+
+    /**
+     * The number of bytes in each row of the data buffer.
+     */
+    size_t stride;
+
+    /**
+     * A counter which is incremented for each frame planned, used to track
+     * which tiles were used or stored within the frame currently being
+     * planned.
+     */
+    uint64_t frame;
+
+    /**
+     * All entries of this cache, one for each tile within the buffer.
+     */
+    guac_display_tile_cache_entry entries[GUAC_DISPLAY_TILE_CACHE_SIZE];
+
+    /**
+     * Hash table of all valid entries, where each bucket is a singly-linked
+     * list of entries.
+     */
+    guac_display_tile_cache_entry* buckets[GUAC_DISPLAY_TILE_CACHE_BUCKETS];
+
+    /**
+     * The most recently used entry.
+     */
+    guac_display_tile_cache_entry* newest;
+
+    /**
+     * The least recently used entry. Unused entries are always older than any
+     * valid entry.
+     */
+    guac_display_tile_cache_entry* oldest;
+
+    /**
+     * All stores that must be sent at the end of the current frame.
+     */
+    guac_display_tile_cache_store stores[GUAC_DISPLAY_TILE_CACHE_SIZE];
+
+    /**
+     * The number of stores within the stores array.
+     */
+    int store_count;
+
+} guac_display_tile_cache;
 
 /**
- * Resizes the given layer to the given dimensions, including any underlying
- * image buffers.
- *
- * @param layer
- *     The layer to resize.
- *
- * @param width
- *     The new width, in pixels.
- *
- * @param height
- *     The new height, in pixels.
+ * A single image operation packed into a guac_display_atlas.
  */
-void PFW_guac_display_layer_resize(guac_display_layer* layer,
-        int width, int height);
+typedef struct guac_display_atlas_entry {
+
+    /**
+     * The layer that should receive the image data.
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The region of the layer that should receive the image data.
+     */
+    guac_rect dest;
+
+    /**
+     * The X coordinate of the upper-left corner of the image data within the
+     * atlas.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the image data within the
+     * atlas.
+     */
+    int y;
+
+} guac_display_atlas_entry;
 
 /**
- * Worker thread that continuously pulls operations from the operation FIFO of
- * the given guac_display, applying those operations by seding corresponding
- * instructions to connected clients.
- *
- * @param data
- *     A pointer to the guac_display.
+ * A set of small image operations whose image data is packed together into a
+ * single image, sent to an offscreen buffer on the client side, and then
+ * copied from that buffer to each destination. Sending many scattered small
+ * changes in this way avoids the fixed overhead of a separate image stream,
+ * image header, and compression stream for each change. Atlases are always
+ * encoded losslessly, and only operations on opaque layers are packed.
  *
- * @return
- *     Always NULL.
+ * IMPORTANT: The members of this structure are modified only by
+ * guac_display_plan_apply(), while no frame is in progress (the operation
+ * FIFO is locked and no worker threads are active), and are otherwise only
+ * read by the worker thread sending the atlas.
  */
-void* guac_display_worker_thread(void* data);
+struct guac_display_atlas {
+
+    /**
+     * The client-side buffer that receives the atlas image, or NULL if this
+     * atlas has not yet been used.
+     */
+    guac_layer* buffer;
+
+    /**
+     * The width of the region of the atlas used by the current frame, in
+     * pixels.
+     */
+    int width;
+
+    /**
+     * The height of the region of the atlas used by the current frame, in
+     * pixels.
+     */
+    int height;
+
+    /**
+     * The X coordinate at which the next entry will be placed within the
+     * current shelf (row of entries) of the atlas.
+     */
+    int shelf_x;
+
+    /**
+     * The Y coordinate of the top of the current shelf of the atlas.
+     */
+    int shelf_y;
+
+    /**
+     * The height of the tallest entry within the current shelf of the atlas.
+     */
+    int shelf_height;
+
+    /**
+     * All entries packed into this atlas for the current frame.
+     */
+    guac_display_atlas_entry entries[GUAC_DISPLAY_ATLAS_MAX_ENTRIES];
+
+    /**
+     * The number of entries within the entries array.
+     */
+    int count;
+
+};
+
+/**
+ * A key uniquely identifying an encoded image within a
+ * guac_display_image_cache, derived from the exact contents of the image
+ * that was encoded and the parameters used to encode it.
+ */
+typedef struct guac_display_image_cache_key {
+
+    /**
+     * A 128-bit hash of the contents of the image that was encoded.
+     */
+    uint64_t hash[2];
+
+    /**
+     * The width of the image, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the image, in pixels.
+     */
+    int height;
+
+    /**
+     * The Cairo format of the image that was encoded (CAIRO_FORMAT_RGB24 for
+     * opaque layers, CAIRO_FORMAT_ARGB32 otherwise).
+     */
+    int surface_format;
+
+    /**
+     * The format used to encode the image.
+     */
+    guac_display_image_format format;
+
+    /**
+     * The quality used to encode the image, or zero if the encoding used
+     * was lossless.
+     */
+    int quality;
+
+    /**
+     * Non-zero if the image was encoded as lossless WebP, zero otherwise.
+     */
+    int lossless;
+
+} guac_display_image_cache_key;
+
+/**
+ * A single encoded image stored within a guac_display_image_cache.
+ */
+typedef struct guac_display_image_cache_entry {
+
+    /**
+     * The key identifying the encoded image.
+     */
+    guac_display_image_cache_key key;
+
+    /**
+     * The encoded image data, exactly as it was sent within the blobs of the
+     * original image stream.
+     */
+    unsigned char* data;
+
+    /**
+     * The number of bytes of encoded image data.
+     */
+    size_t length;
+
+    /**
+     * The next entry within the same hash bucket, or NULL if this is the last
+     * entry in the bucket.
+     */
+    struct guac_display_image_cache_entry* next_in_bucket;
+
+    /**
+     * The next most recently used entry, or NULL if this is the most
+     * recently used entry.
+     */
+    struct guac_display_image_cache_entry* newer;
+
+    /**
+     * The next least recently used entry, or NULL if this is the least
+     * recently used entry.
+     */
+    struct guac_display_image_cache_entry* older;
+
+} guac_display_image_cache_entry;
+
+/**
+ * A bounded, content-addressed cache of encoded images, allowing identical
+ * image data to be sent again without being re-encoded. Once the total size
+ * of all cached images would exceed GUAC_DISPLAY_IMAGE_CACHE_SIZE, the least
+ * recently used images are evicted.
+ */
+typedef struct guac_display_image_cache {
+
+    /**
+     * Lock which guards access to all other members of this structure.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Hash table of all cached images, where each bucket is a singly-linked
+     * list of entries.
+     */
+    guac_display_image_cache_entry* buckets[GUAC_DISPLAY_IMAGE_CACHE_BUCKETS];
+
+    /**
+     * The most recently used entry, or NULL if the cache is empty.
+     */
+    guac_display_image_cache_entry* newest;
+
+    /**
+     * The least recently used entry, or NULL if the cache is empty.
+     */
+    guac_display_image_cache_entry* oldest;
+
+    /**
+     * The total number of bytes of encoded image data currently cached.
+     */
+    size_t size;
+
+} guac_display_image_cache;
+
+/**
+ * The state of the feedback controller that selects the quality of lossy
+ * image encoding for a guac_display based on measured processing lag and the
+ * rate that encoded image data is being sent.
+ */
+typedef struct guac_display_quality_state {
+
+    /**
+     * The quality currently used for lossy encoding, as an integer value
+     * ranging from GUAC_DISPLAY_QUALITY_MIN to GUAC_DISPLAY_QUALITY_MAX.
+     */
+    int quality;
+
+    /**
+     * Non-zero if the connection is currently considered congested, in which
+     * case lossy encoding should be preferred for all regions that are not
+     * required to be lossless. Once set, this remains set until processing
+     * lag falls below GUAC_DISPLAY_QUALITY_LOW_LAG.
+     */
+    int congested;
+
+    /**
+     * The time that the quality was last adjusted.
+     */
+    guac_timestamp last_update;
+
+    /**
+     * The total number of bytes of encoded image data that had been sent at
+     * the time the quality was last adjusted.
+     */
+    uint64_t last_bytes;
+
+    /**
+     * The smoothed rate that encoded image data is being sent, in bytes per
+     * second.
+     */
+    uint64_t throughput;
+
+    /**
+     * The estimated rate at which the connection becomes congested, in bytes
+     * per second, or zero if no such rate is yet known. This is the smoothed
+     * throughput observed when processing lag last exceeded
+     * GUAC_DISPLAY_QUALITY_HIGH_LAG.
+     */
+    uint64_t capacity;
+
+    /**
+     * The smoothed processing lag of the connection, in milliseconds.
+     */
+    int lag;
+
+} guac_display_quality_state;
+
+struct guac_display {
+
+    /* NOTE: Any member of this structure that requires protection against
+     * concurrent access is protected by its own lock. The overall display does
+     * not have nor need a top-level lock. */
+
+    /**
+     * The client associated with this display.
+     */
+    guac_client* client;
+
+    /* ---------------- DISPLAY FRAME STATES ---------------- */
+
+    /**
+     * The state of this display at the time the last frame was sent to
+     * connected users.
+     */
+    guac_display_state last_frame;
+
+    /**
+     * The pending state of this display that will become the next frame once
+     * it is sent to connected users.
+     */
+    guac_display_state pending_frame;
+
+    /**
+     * Whether the pending frame has been modified in any way outside of
+     * changing the mouse cursor or moving the mouse. This is used to help
+     * inform whether a frame should be flushed to update connected clients
+     * with respect to mouse cursor changes, or whether those changes can be
+     * safely assumed to be part of a larger frame containing general graphical
+     * updates.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    int pending_frame_dirty_excluding_mouse;
+
+    /* ---------------- WELL-KNOWN LAYERS / BUFFERS ---------------- */
+
+    /**
+     * The default layer of the client display.
+     */
+    guac_display_layer* default_layer;
+
+    /**
+     * The buffer storing the current mouse cursor. The hotspot position within
+     * the cursor is stored within cursor_hotspot_x and cursor_hotspot_y of
+     * guac_display_state.
+     */
+    guac_display_layer* cursor_buffer;
+
+    /**
+     * Buffers containing each of the mouse cursor images built into libguac,
+     * indexed by their corresponding guac_display_cursor_type values. Setting
+     * the mouse cursor to a built-in icon references the corresponding buffer
+     * with guac_display_set_cursor_buffer(), such that switching between
+     * built-in icons costs only a single "cursor" instruction.
+     */
+    guac_display_layer* builtin_cursor_buffers[GUAC_DISPLAY_BUILTIN_CURSOR_COUNT];
+
+    /* ---------------- FRAME ENCODING WORKER THREADS ---------------- */
+
+    /**
+     * The number of worker threads in the worker_threads array.
+     */
+    int worker_thread_count;
+
+    /**
+     * Pool of worker threads that automatically pull from the ops FIFO,
+     * sending corresponding Guacamole instructions to all connected clients.
+     */
+    pthread_t* worker_threads;
+
+    /**
+     * FIFO of all graphical operations required to transform the remote
+     * display state from the previous frame to the next frame. Operations
+     * added to this FIFO will automatically be pulled and processed by a
+     * worker thread.
+     */
+    guac_fifo ops;
+
+    /**
+     * Storage for any items within the ops fifo.
+     */
+    guac_display_plan_operation ops_items[GUAC_DISPLAY_WORKER_FIFO_SIZE];
+
+    /**
+     * The current number of active worker threads.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    unsigned int active_workers;
+
+    /**
+     * Whether least one pending frame has been deferred due to the encoding
+     * process being underway for a previous frame at the time it was
+     * completed.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    int frame_deferred;
+
+    /**
+     * The current state of the rendering process. Code that needs to be aware
+     * of whether a frame is currently in the process of being rendered can
+     * monitor the state of this flag, watching for either the
+     * GUAC_DISPLAY_RENDER_STATE_FRAME_IN_PROGRESS or
+     * GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS values.
+     */
+    guac_flag render_state;
+
+    /* ---------------- LOSSY QUALITY CONTROL ---------------- */
+
+    /**
+     * Lock which guards access to the quality member.
+     */
+    pthread_mutex_t quality_lock;
+
+    /**
+     * The current state of the controller that selects lossy encoding
+     * quality.
+     *
+     * IMPORTANT: This member must only be accessed or modified while
+     * quality_lock is held.
+     */
+    guac_display_quality_state quality;
+
+    /* ---------------- FRAME PLANNING MEMORY ---------------- */
+
+    /**
+     * Arena providing all memory required by guac_display_plan while
+     * planning a frame.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be held for
+     * writing while this arena is used.
+     */
+    guac_display_arena plan_arena;
+
+    /* ---------------- ENCODED IMAGE CACHE ---------------- */
+
+    /**
+     * Cache of recently-encoded images, allowing repeated image content to
+     * be sent without being re-encoded.
+     */
+    guac_display_image_cache image_cache;
+
+    /* ---------------- LAYER SNAPSHOTS ---------------- */
+
+    /**
+     * Lock which serializes access to the snapshot of each layer among
+     * threads that hold last_frame.lock only for reading (concurrently
+     * joining users).
+     */
+    pthread_mutex_t snapshot_lock;
+
+    /* ---------------- LOSSY REFINEMENT ---------------- */
+
+    /**
+     * Lock which serializes access to the refinement state of each layer
+     * among threads that hold last_frame.lock only for reading (the worker
+     * threads).
+     */
+    pthread_mutex_t refinement_lock;
+
+    /* ---------------- DISPLAY RECORDING ---------------- */
+
+    /**
+     * Lock which serializes calls to guac_display_record(), guarding the
+     * recording state of each layer and the recording state below among
+     * threads that hold last_frame.lock only for reading.
+     */
+    pthread_mutex_t record_lock;
+
+    /**
+     * The indices of all layers written by the most recent call to
+     * guac_display_record(), such that any of those layers that are later
+     * freed can be disposed within the recording. Guarded by record_lock.
+     */
+    int* record_indices;
+
+    /**
+     * The number of entries within record_indices. Guarded by record_lock.
+     */
+    size_t record_index_count;
+
+    /**
+     * The layer that provided the mouse cursor image as last recorded, or
+     * NULL if the mouse cursor has not yet been recorded. Guarded by
+     * record_lock.
+     */
+    guac_display_layer* record_cursor;
+
+    /**
+     * The X coordinate of the hotspot of the mouse cursor as last recorded.
+     * Guarded by record_lock.
+     */
+    int record_cursor_hotspot_x;
+
+    /**
+     * The Y coordinate of the hotspot of the mouse cursor as last recorded.
+     * Guarded by record_lock.
+     */
+    int record_cursor_hotspot_y;
+
+    /* ---------------- CLIENT-SIDE TILE CACHE ---------------- */
+
+    /**
+     * Cache of recently-sent tiles retained within an offscreen buffer on the
+     * client side.
+     */
+    guac_display_tile_cache tile_cache;
+
+    /* ---------------- IMAGE ATLASES ---------------- */
+
+    /**
+     * Atlases used to send many small image operations as a few larger
+     * images. Only the first atlas_count atlases are part of the current
+     * frame, though any atlas may have a client-side buffer allocated.
+     */
+    guac_display_atlas atlases[GUAC_DISPLAY_ATLAS_COUNT];
+
+    /**
+     * The number of atlases within the atlases array that are part of the
+     * current frame.
+     */
+    int atlas_count;
+
+    /* ---------------- STATISTICS ---------------- */
+
+    /**
+     * Lock which guards access to the stats and logged_stats members.
+     */
+    pthread_mutex_t stats_lock;
+
+    /**
+     * The cumulative statistics of this display. The timestamp, queue_depth,
+     * and queue_size members of this structure are not maintained here and
+     * are instead populated by guac_display_get_stats().
+     *
+     * IMPORTANT: This member must only be accessed or modified while
+     * stats_lock is held.
+     */
+    guac_display_stats stats;
+
+    /**
+     * The statistics of this display at the time they were last logged. This
+     * snapshot is used to derive rates over the logging interval.
+     *
+     * IMPORTANT: This member must only be accessed or modified while
+     * stats_lock is held.
+     */
+    guac_display_stats logged_stats;
+
+};
+
+/**
+ * Allocates and inserts a new element into the given linked list of display
+ * layers, associating it with the given layer and surface.
+ *
+ * @param head
+ *     A pointer to the head pointer of the list of layers. The head pointer
+ *     will be updated by this function to point to the newly-allocated
+ *     display layer.
+ *
+ * @param layer
+ *     The Guacamole layer to associated with the new display layer.
+ *
+ * @param opaque
+ *     Non-zero if the new layer will only ever contain opaque image contents
+ *     (the alpha channel should be ignored), zero otherwise.
+ *
+ * @return
+ *     The newly-allocated display layer, which has been associated with the
+ *     provided layer and surface.
+ */
+guac_display_layer* guac_display_add_layer(guac_display* display, guac_layer* layer, int opaque);
+
+/**
+ * Removes the given layer from all linked lists containing that layer and
+ * frees all associated memory.
+ *
+ * @param display_layer
+ *     The layer to remove.
+ */
+void guac_display_remove_layer(guac_display_layer* display_layer);
+
+/**
+ * Resizes the given layer to the given dimensions, including any underlying
+ * image buffers.
+ *
+ * @param layer
+ *     The layer to resize.
+ *
+ * @param width
+ *     The new width, in pixels.
+ *
+ * @param height
+ *     The new height, in pixels.
+ */
+void PFW_guac_display_layer_resize(guac_display_layer* layer,
+        int width, int height);
+
+/**
+ * Commits the given changed region of the pending frame of the given layer to
+ * the last frame by exchanging the buffers of both frames. The last frame
+ * buffer then contains the pending frame in its entirety, while the pending
+ * frame buffer contains the previous contents of the last frame and is
+ * marked as stale within the changed region (see pending_frame_stale and
+ * PFW_LFR_guac_display_layer_restore_stale()). The buffers of both frames
+ * must have identical dimensions and stride, the pending frame buffer must
+ * not be an external buffer, and the pending frame must not itself be stale
+ * anywhere. As only the changed region is considered stale, both buffers
+ * must already be identical everywhere else, including any area beyond the
+ * edges of the layer.
+ *
+ * @param layer
+ *     The layer whose pending frame should be committed to its last frame.
+ *
+ * @param changed
+ *     The region containing all pixels that differ between the pending and
+ *     last frames of the layer.
+ */
+void PFW_LFW_guac_display_layer_exchange_buffers(guac_display_layer* layer,
+        const guac_rect* changed);
+
+/**
+ * Copies back from the last frame buffer of the given layer any region of the
+ * pending frame buffer that was left stale by
+ * PFW_LFW_guac_display_layer_exchange_buffers(), such that the pending frame
+ * buffer once again contains the current contents of the pending frame. This
+ * function MUST be invoked before the contents of the pending frame buffer
+ * are read or modified. If no region is stale, this function has no effect.
+ *
+ * @param layer
+ *     The layer whose pending frame buffer should be restored.
+ */
+void PFW_LFR_guac_display_layer_restore_stale(guac_display_layer* layer);
+
+/**
+ * Guesses whether the given image would be better compressed as PNG or using
+ * a lossy format like JPEG, based on how often horizontally-adjacent pixels
+ * are identical. Positive values indicate PNG is likely to be superior, while
+ * negative values indicate the opposite. Only up to the given number of
+ * evenly-spaced rows are examined, such that the cost of the estimate can be
+ * bounded for large images.
+ *
+ * @param buffer
+ *     The image data to check, as 32-bit pixels.
+ *
+ * @param stride
+ *     The number of bytes between the start of each row of the image.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param max_rows
+ *     The maximum number of rows to examine. If the image has no more rows
+ *     than this, every row is examined.
+ *
+ * @return
+ *     Positive values if PNG compression is likely to perform better than
+ *     lossy alternatives, negative values if PNG is likely to perform worse,
+ *     or zero if the image is empty.
+ */
+int guac_display_png_optimality(const unsigned char* buffer, size_t stride,
+        int width, int height, int max_rows);
+
+/**
+ * Worker thread that continuously pulls operations from the operation FIFO of
+ * the given guac_display, applying those operations by seding corresponding
+ * instructions to connected clients.
+ *
+ * @param data
+ *     A pointer to the guac_display.
+ *
+ * @return
+ *     Always NULL.
+ */
+void* guac_display_worker_thread(void* data);
+
+/**
+ * Initializes the given guac_display_arena such that it is empty. No memory
+ * is allocated until the first allocation is requested.
+ *
+ * @param arena
+ *     The guac_display_arena to initialize.
+ */
+void guac_display_arena_init(guac_display_arena* arena);
+
+/**
+ * Allocates memory for an array of the given number of elements of the given
+ * size from the given arena. The memory returned is not initialized and
+ * remains valid only until the arena is next reset. If the size of the
+ * requested memory overflows, or if memory cannot be allocated, the process
+ * is aborted.
+ *
+ * @param arena
+ *     The guac_display_arena to allocate memory from.
+ *
+ * @param count
+ *     The number of elements to allocate.
+ *
+ * @param size
+ *     The size of each element, in bytes.
+ *
+ * @return
+ *     A pointer to the allocated memory, aligned to
+ *     GUAC_DISPLAY_ARENA_ALIGNMENT bytes.
+ */
+void* guac_display_arena_alloc(guac_display_arena* arena, size_t count, size_t size);
+
+/**
+ * Releases all memory allocated from the given arena such that it may be
+ * reused by future allocations. If any allocations since the last reset
+ * could not be satisfied from the primary block of the arena, the primary
+ * block is grown to accommodate the high-water mark.
+ *
+ * @param arena
+ *     The guac_display_arena to reset.
+ */
+void guac_display_arena_reset(guac_display_arena* arena);
+
+/**
+ * Frees all memory associated with the given arena. The guac_display_arena
+ * itself is not freed.
+ *
+ * @param arena
+ *     The guac_display_arena to destroy.
+ */
+void guac_display_arena_destroy(guac_display_arena* arena);
+
+/**
+ * A shift of a sequence of lines (rows or columns) of image data relative to
+ * the same sequence within the previous frame, as found by
+ * guac_display_plan_find_shift().
+ */
+typedef struct guac_display_plan_shift {
+
+    /**
+     * The number of lines that the contents have moved by. Positive values
+     * indicate that each line is now further from the start of the sequence
+     * than it was in the previous frame (the contents have moved down or
+     * right), while negative values indicate the opposite.
+     */
+    int offset;
+
+    /**
+     * The index of the first line of the new frame within the longest run of
+     * lines that have moved by the offset.
+     */
+    int start;
+
+    /**
+     * The number of lines within the longest run of lines that have moved by
+     * the offset.
+     */
+    int length;
+
+} guac_display_plan_shift;
+
+/**
+ * Finds the dominant offset by which a sequence of lines of image data has
+ * moved since the previous frame, given the hash of each line in both
+ * frames, along with the longest run of consecutive lines that have moved by
+ * that offset. Lines whose hash is shared by multiple lines of the previous
+ * frame (such as blank lines) do not influence which offset is found, but
+ * may still be part of the run. Offsets of zero (unmoved lines) are never
+ * found.
+ *
+ * @param arena
+ *     The arena to allocate scratch memory from.
+ *
+ * @param old_hashes
+ *     The hash of each line in the previous frame.
+ *
+ * @param new_hashes
+ *     The hash of each line in the new frame.
+ *
+ * @param count
+ *     The number of lines in each frame.
+ *
+ * @param min_length
+ *     The minimum number of consecutive lines that must have moved by the
+ *     same offset for a shift to be found.
+ *
+ * @param shift
+ *     The guac_display_plan_shift to populate with the shift found, if any.
+ *
+ * @return
+ *     Non-zero if a shift was found and stored within the given
+ *     guac_display_plan_shift, zero otherwise.
+ */
+int guac_display_plan_find_shift(guac_display_arena* arena,
+        const uint64_t* old_hashes, const uint64_t* new_hashes, int count,
+        int min_length, guac_display_plan_shift* shift);
+
+/**
+ * Records the current memory usage of the arena used to plan frames within
+ * the statistics of the given display.
+ *
+ * @param display
+ *     The guac_display whose arena should be recorded.
+ */
+void PFR_guac_display_stats_record_plan_arena(guac_display* display);
+
+/**
+ * Initializes the given guac_display_image_cache such that it is empty. The
+ * first time this function is invoked within a process, the mouse cursors
+ * built into libguac are encoded as PNG for use by all future
+ * guac_display_image_cache instances. Those built-in cursors are never
+ * evicted and need never be encoded again.
+ *
+ * @param cache
+ *     The guac_display_image_cache to initialize.
+ */
+void guac_display_image_cache_init(guac_display_image_cache* cache);
+
+/**
+ * Frees all images stored within the given guac_display_image_cache and
+ * releases any associated resources. The guac_display_image_cache itself is
+ * not freed.
+ *
+ * @param cache
+ *     The guac_display_image_cache to destroy.
+ */
+void guac_display_image_cache_destroy(guac_display_image_cache* cache);
+
+/**
+ * Encodes the given surface using the given image format, sending the
+ * resulting image over the given socket and recording the cost of doing so
+ * within the statistics of the given display. If identical image data was
+ * recently encoded using the same parameters, the previously-encoded data is
+ * sent from the display's guac_display_image_cache instead of encoding the
+ * image again.
+ *
+ * @param display
+ *     The guac_display sending the image.
+ *
+ * @param socket
+ *     The socket over which the image should be sent.
+ *
+ * @param format
+ *     The image format to use.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param surface
+ *     A Cairo image surface containing the image data to send.
+ *
+ * @param quality
+ *     The quality to use if the image format is lossy (JPEG or lossy WebP),
+ *     as an integer value ranging from 0 (lowest quality) to 100 (highest
+ *     quality).
+ *
+ * @param lossless
+ *     Zero to use lossy WebP compression, non-zero to use lossless WebP
+ *     compression. This value is ignored for other formats.
+ */
+void guac_display_stream_image(guac_display* display, guac_socket* socket,
+        guac_display_image_format format, const guac_layer* layer, int x, int y,
+        cairo_surface_t* surface, int quality, int lossless);
+
+/**
+ * Encodes the given surface using the given image format, sending the
+ * resulting image over the given socket along the given, already-allocated
+ * stream. This function behaves identically to guac_display_stream_image(),
+ * except that the stream is neither allocated nor freed, and thus remains
+ * allocated for reuse by subsequent images once this function returns.
+ * Reusing a single stream in this way avoids acquiring and releasing a
+ * stream index for every image sent.
+ *
+ * @param display
+ *     The guac_display sending the image.
+ *
+ * @param socket
+ *     The socket over which the image should be sent.
+ *
+ * @param stream
+ *     The stream to use to send the image. This stream must have been
+ *     allocated with guac_client_alloc_stream() and must not be in use by
+ *     any other image.
+ *
+ * @param format
+ *     The image format to use.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param surface
+ *     A Cairo image surface containing the image data to send.
+ *
+ * @param quality
+ *     The quality to use if the image format is lossy (JPEG or lossy WebP),
+ *     as an integer value ranging from 0 (lowest quality) to 100 (highest
+ *     quality).
+ *
+ * @param lossless
+ *     Zero to use lossy WebP compression, non-zero to use lossless WebP
+ *     compression. This value is ignored for other formats.
+ *
+ * @param context
+ *     The guac_encode_context whose encoder objects and scratch buffers
+ *     should be reused if the image must be encoded, or NULL if a temporary
+ *     context should be used.
+ */
+void guac_display_send_image(guac_display* display, guac_socket* socket,
+        guac_stream* stream, guac_display_image_format format,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality, int lossless, guac_encode_context* context);
+
+/**
+ * Attempts to update the given region of the given layer using a video
+ * stream rather than an image, starting a new video stream if the region is
+ * changing at a sufficiently high framerate and ending any existing video
+ * stream that the region does not fit within. The last_frame.lock of the
+ * associated guac_display MUST be held for at least reading.
+ *
+ * @param display_layer
+ *     The layer being updated.
+ *
+ * @param dirty
+ *     The region of the layer being updated.
+ *
+ * @param framerate
+ *     The rate that the region has historically been updated, in frames per
+ *     second.
+ *
+ * @return
+ *     Non-zero if the region has been updated via video and no image need be
+ *     sent, zero if the region must still be sent as an image.
+ */
+int LFR_guac_display_layer_stream_video(guac_display_layer* display_layer,
+        const guac_rect* dirty, int framerate);
+
+/**
+ * Ends the video stream of the given layer, if any, without updating the
+ * underlying region of the layer. This is intended for use only when the
+ * layer itself is being removed. The last_frame.lock of the associated
+ * guac_display MUST be held for writing.
+ *
+ * @param display_layer
+ *     The layer whose video stream should be ended.
+ */
+void LFW_guac_display_layer_abandon_video(guac_display_layer* display_layer);
+
+/**
+ * Returns whether the given rectangle intersects the region of the given
+ * layer currently being updated via video. The last_frame.lock of the
+ * associated guac_display MUST be held for writing, or it must otherwise be
+ * known that no worker threads are active.
+ *
+ * @param display_layer
+ *     The layer to check.
+ *
+ * @param rect
+ *     The rectangle to test.
+ *
+ * @return
+ *     Non-zero if the given layer has an active video stream whose region
+ *     intersects the given rectangle, zero otherwise.
+ */
+int LFW_guac_display_layer_video_intersects(guac_display_layer* display_layer,
+        const guac_rect* rect);
+
+/**
+ * Returns the current value of a monotonic clock with microsecond resolution,
+ * for use in measuring the duration of encoding operations. The value
+ * returned has no meaning other than relative to other values returned by
+ * this function.
+ *
+ * @return
+ *     The current value of the clock, in microseconds.
+ */
+uint64_t guac_display_stats_clock(void);
+
+/**
+ * Records the encoding and sending of an image within the statistics of the
+ * given display.
+ *
+ * @param display
+ *     The guac_display that sent the image.
+ *
+ * @param format
+ *     The format used to encode the image.
+ *
+ * @param bytes
+ *     The number of bytes of encoded image data sent.
+ *
+ * @param encode_time
+ *     The amount of time spent encoding and sending the image, in
+ *     microseconds.
+ */
+void guac_display_stats_record_image(guac_display* display,
+        guac_display_image_format format, size_t bytes, uint64_t encode_time);
+
+/**
+ * Records the encoding and sending of a single frame of video within the
+ * statistics of the given display.
+ *
+ * @param display
+ *     The guac_display that sent the frame.
+ *
+ * @param bytes
+ *     The number of bytes of encoded video data sent.
+ *
+ * @param encode_time
+ *     The amount of time spent encoding and sending the frame, in
+ *     microseconds.
+ */
+void guac_display_stats_record_video(guac_display* display, size_t bytes,
+        uint64_t encode_time);
+
+/**
+ * Records the operations of a display plan that has been applied within the
+ * statistics of the given display.
+ *
+ * @param display
+ *     The guac_display that applied the plan.
+ *
+ * @param nop_ops
+ *     The number of operations that were dropped as having no effect.
+ *
+ * @param copy_ops
+ *     The number of operations sent as copies.
+ *
+ * @param rect_ops
+ *     The number of operations sent as solid-color rectangles.
+ *
+ * @param img_ops
+ *     The number of operations handed to the worker threads for encoding.
+ */
+void guac_display_stats_record_ops(guac_display* display, unsigned int nop_ops,
+        unsigned int copy_ops, unsigned int rect_ops, unsigned int img_ops);
+
+/**
+ * Records the completion of a frame within the statistics of the given
+ * display, logging a summary of those statistics if at least
+ * GUAC_DISPLAY_STATS_LOG_INTERVAL milliseconds have elapsed since the last
+ * summary was logged.
+ *
+ * @param display
+ *     The guac_display that completed a frame.
+ */
+void guac_display_stats_record_frame(guac_display* display);
+
+/**
+ * Records the amount of time that the most recent frame was delayed to
+ * compensate for client-side processing lag.
+ *
+ * @param display
+ *     The guac_display whose frame was delayed.
+ *
+ * @param render_lag
+ *     The duration of the delay, in milliseconds.
+ */
+void guac_display_stats_record_render_lag(guac_display* display, int render_lag);
+
+/**
+ * Records a lookup within the guac_display_image_cache of the given display.
+ *
+ * @param display
+ *     The guac_display whose cache was searched.
+ *
+ * @param hit
+ *     Non-zero if the requested image was found within the cache, zero
+ *     otherwise.
+ */
+void guac_display_stats_record_cache_lookup(guac_display* display, int hit);
+
+/**
+ * Records the results of searching the guac_display_tile_cache of the given
+ * display while planning a frame.
+ *
+ * @param display
+ *     The guac_display whose tile cache was searched.
+ *
+ * @param hits
+ *     The number of draws that were replaced with copies from the tile
+ *     cache.
+ *
+ * @param stores
+ *     The number of new tiles stored within the tile cache.
+ */
+void guac_display_stats_record_tile_cache(guac_display* display,
+        unsigned int hits, unsigned int stores);
+
+/**
+ * Records that the given number of image operations were packed into the
+ * given number of atlases while applying a frame.
+ *
+ * @param display
+ *     The guac_display that packed the image operations.
+ *
+ * @param atlases
+ *     The number of atlases filled.
+ *
+ * @param ops
+ *     The total number of image operations packed into those atlases.
+ */
+void guac_display_stats_record_atlases(guac_display* display,
+        unsigned int atlases, unsigned int ops);
+
+/**
+ * Records that a layer of the given display has been resized such that at
+ * least one of its dimensions is now smaller than before.
+ *
+ * @param display
+ *     The guac_display containing the layer that was resized.
+ */
+void guac_display_stats_record_layer_shrink(guac_display* display);
+
+/**
+ * Initializes the given guac_display_tile_cache such that it is empty. No
+ * client-side buffer is allocated until the first tile is stored.
+ *
+ * @param cache
+ *     The guac_display_tile_cache to initialize.
+ */
+void guac_display_tile_cache_init(guac_display_tile_cache* cache);
+
+/**
+ * Frees the client-side buffer and all server-side resources associated with
+ * the tile cache of the given display. The guac_display_tile_cache itself is
+ * not freed.
+ *
+ * @param display
+ *     The guac_display whose tile cache should be destroyed.
+ */
+void guac_display_tile_cache_destroy(guac_display* display);
+
+/**
+ * Begins use of the given tile cache for planning a new frame. Any stores
+ * from a previous frame that were never sent are discarded, and the tiles
+ * they would have populated are invalidated.
+ *
+ * @param cache
+ *     The guac_display_tile_cache that will be used to plan a frame.
+ */
+void LFW_guac_display_tile_cache_begin_frame(guac_display_tile_cache* cache);
+
+/**
+ * Searches the given tile cache for a tile having the given hash and
+ * containing exactly the given 64x64 region of image data. If found, the
+ * tile is marked as used within the current frame.
+ *
+ * @param cache
+ *     The guac_display_tile_cache to search.
+ *
+ * @param hash
+ *     The hash of the image data.
+ *
+ * @param data
+ *     A pointer to the first pixel of the 64x64 region of image data.
+ *
+ * @param stride
+ *     The number of bytes in each row of the image data.
+ *
+ * @return
+ *     The matching entry, or NULL if no such tile is cached. The returned
+ *     entry may have been stored within the current frame, in which case it
+ *     cannot yet be used as the source of a copy.
+ */
+guac_display_tile_cache_entry* LFW_guac_display_tile_cache_find(
+        guac_display_tile_cache* cache, uint64_t hash,
+        const unsigned char* data, size_t stride);
+
+/**
+ * Stores the given 64x64 cell of the pending frame of the given layer
+ * within the tile cache of the given display, evicting the least recently
+ * used tile. The client-side copy of the tile is not populated until
+ * guac_display_tile_cache_send_stores() is invoked at the end of the frame.
+ *
+ * @param display
+ *     The guac_display whose tile cache should receive the tile.
+ *
+ * @param hash
+ *     The hash of the contents of the cell.
+ *
+ * @param layer
+ *     The layer containing the cell.
+ *
+ * @param rect
+ *     The bounds of the cell within the layer.
+ *
+ * @return
+ *     Non-zero if the tile was stored, zero if every tile of the cache has
+ *     already been used within the current frame.
+ */
+int PFR_LFW_guac_display_tile_cache_store(guac_display* display, uint64_t hash,
+        guac_display_layer* layer, const guac_rect* rect);
+
+/**
+ * Removes all pending stores that refer to the given layer, invalidating the
+ * tiles they would have populated. This function must be invoked before the
+ * layer is freed.
+ *
+ * @param cache
+ *     The guac_display_tile_cache containing the stores.
+ *
+ * @param layer
+ *     The layer being removed.
+ */
+void LFW_guac_display_tile_cache_forget_layer(guac_display_tile_cache* cache,
+        guac_display_layer* layer);
+
+/**
+ * Sends all pending stores of the tile cache of the given display to all
+ * connected users, copying each newly-cached tile into the client-side
+ * buffer. This function is invoked by the worker thread that completes each
+ * frame, after all other graphical updates of that frame have been sent.
+ *
+ * @param display
+ *     The guac_display whose pending stores should be sent.
+ */
+void guac_display_tile_cache_send_stores(guac_display* display);
+
+/**
+ * Synchronizes the client-side buffer of the tile cache of the given display
+ * to a single user over the given socket.
+ *
+ * @param display
+ *     The guac_display whose tile cache should be synchronized.
+ *
+ * @param socket
+ *     The socket over which the buffer contents should be sent.
+ */
+void LFR_guac_display_tile_cache_dup(guac_display* display, guac_socket* socket);
+
+/**
+ * Packs as many of the given image operations as possible into the atlases
+ * of the given display (see guac_display_atlas), such that each atlas may be
+ * sent as a single image by a GUAC_DISPLAY_PLAN_OPERATION_ATLAS operation.
+ * Only small operations on opaque layers that are not streaming video are
+ * packed. Operations are packed only if enough are eligible to fill at least
+ * one atlas with GUAC_DISPLAY_ATLAS_MIN_ENTRIES entries, and are spread
+ * across as many atlases as there are worker threads, such that the atlases
+ * can be encoded in parallel. The given array is compacted such that only
+ * the operations that were not packed remain, in their original order.
+ *
+ * This function may be invoked only by guac_display_plan_apply(), while no
+ * frame is in progress. The atlas_count member of the display is updated to
+ * the number of atlases that were filled.
+ *
+ * @param display
+ *     The display whose atlases should receive the image operations.
+ *
+ * @param ops
+ *     The array of image operations to pack.
+ *
+ * @param count
+ *     The number of operations in the array.
+ *
+ * @return
+ *     The number of operations remaining within the array, none of which
+ *     have been packed into an atlas.
+ */
+unsigned int guac_display_atlas_pack(guac_display* display,
+        guac_display_plan_operation** ops, unsigned int count);
+
+/**
+ * Sends the image data of all entries within the given atlas as a single
+ * lossless image to the client-side buffer of that atlas, followed by copies
+ * of each entry from that buffer to its destination. This function is
+ * intended only for use by the guac_display worker threads upon receiving a
+ * GUAC_DISPLAY_PLAN_OPERATION_ATLAS operation. The last_frame.lock of the
+ * display MUST be held for at least reading.
+ *
+ * @param display
+ *     The display that the atlas belongs to.
+ *
+ * @param atlas
+ *     The atlas to send.
+ *
+ * @param stream
+ *     The stream reserved by the current worker thread for sending images,
+ *     or NULL if no such stream could be reserved.
+ *
+ * @param context
+ *     The guac_encode_context owned by the current worker thread, whose
+ *     encoder objects and scratch buffers should be reused when composing
+ *     and encoding the atlas image.
+ */
+void LFR_guac_display_atlas_send(guac_display* display,
+        guac_display_atlas* atlas, guac_stream* stream,
+        guac_encode_context* context);
+
+/**
+ * Frees the client-side buffers of all atlases of the given display. The
+ * atlases themselves are not freed, as they are a part of the guac_display.
+ *
+ * @param display
+ *     The display whose atlases should be destroyed.
+ */
+void guac_display_atlas_destroy(guac_display* display);
+
+/**
+ * Marks the tiles of the snapshot of the given layer that cover any cell
+ * modified within the given frame as stale, resizing the snapshot to match
+ * the dimensions of the last frame of the layer if necessary. This function
+ * is invoked for each layer as each frame is completed, after the contents
+ * of the pending frame have been copied to the last frame.
+ *
+ * @param layer
+ *     The layer whose snapshot should be updated.
+ *
+ * @param frame
+ *     The timestamp of the frame being completed. Cells having this
+ *     timestamp as their last_frame were modified within that frame.
+ */
+void PFR_LFW_guac_display_layer_snapshot_update(guac_display_layer* layer,
+        guac_timestamp frame);
+
+/**
+ * Marks all tiles of the snapshot of the given layer as stale, such that the
+ * entire layer will be re-encoded when next sent to a joining user. This is
+ * necessary whenever the contents of the last frame change in a way that is
+ * not tracked by the cells of the layer.
+ *
+ * @param layer
+ *     The layer whose snapshot should be invalidated.
+ */
+void LFW_guac_display_layer_snapshot_invalidate(guac_display_layer* layer);
+
+/**
+ * Sends the full contents of the last frame of the given layer over the
+ * given socket using the snapshot of that layer. Tiles of the snapshot that
+ * are not stale are sent as-is, while stale tiles are encoded again from the
+ * last frame and retained for future joining users. The snapshot_lock of the
+ * associated guac_display is acquired and released by this function.
+ *
+ * @param layer
+ *     The layer whose contents should be sent.
+ *
+ * @param socket
+ *     The socket over which the layer contents should be sent.
+ */
+void LFR_guac_display_layer_snapshot_dup(guac_display_layer* layer,
+        guac_socket* socket);
+
+/**
+ * Frees all encoded image data within the snapshot of the given layer. The
+ * guac_display_layer_snapshot itself is not freed.
+ *
+ * @param layer
+ *     The layer whose snapshot should be freed.
+ */
+void guac_display_layer_snapshot_free(guac_display_layer* layer);
+
+/**
+ * Records that the given region of the last frame of the given layer has
+ * been sent to connected clients, such that it may be refined later if sent
+ * using lossy compression. Cells wholly covered by the region take on the
+ * given timestamp, while cells only partially covered keep the later of their
+ * current timestamp and the given timestamp (the remainder of the cell is not
+ * affected). The refinement_lock of the associated guac_display is acquired
+ * and released by this function.
+ *
+ * @param layer
+ *     The layer that was updated.
+ *
+ * @param rect
+ *     The region of the layer that was sent.
+ *
+ * @param sent
+ *     The time at which the region was sent using lossy compression, or zero
+ *     if the region was sent losslessly.
+ */
+void LFR_guac_display_layer_refinement_mark(guac_display_layer* layer,
+        const guac_rect* rect, guac_timestamp sent);
+
+/**
+ * Frees the refinement state of the given layer. The
+ * guac_display_layer_refinement itself is not freed.
+ *
+ * @param layer
+ *     The layer whose refinement state should be freed.
+ */
+void guac_display_layer_refinement_free(guac_display_layer* layer);
+
+/**
+ * Flags the cells of the given layer that were modified within the given
+ * frame as needing to be written again by guac_display_record(), resizing the
+ * recording state of the layer to match the dimensions of its last frame if
+ * necessary. Layers that have not yet been recorded are not affected, as
+ * they will be recorded in their entirety. This function is invoked for each
+ * layer as each frame is completed, after the contents of the pending frame
+ * have been copied to the last frame.
+ *
+ * @param layer
+ *     The layer whose recording state should be updated.
+ *
+ * @param frame
+ *     The timestamp of the frame being completed. Cells having this
+ *     timestamp as their last_frame were modified within that frame.
+ */
+void PFR_LFW_guac_display_layer_record_update(guac_display_layer* layer,
+        guac_timestamp frame);
+
+/**
+ * Flags all cells of the given layer as needing to be written again by
+ * guac_display_record(). This is necessary whenever the contents of the last
+ * frame change in a way that is not tracked by the cells of the layer.
+ *
+ * @param layer
+ *     The layer whose recording state should be invalidated.
+ */
+void LFW_guac_display_layer_record_invalidate(guac_display_layer* layer);
+
+/**
+ * Frees the recording state of the given layer. The
+ * guac_display_layer_record itself is not freed.
+ *
+ * @param layer
+ *     The layer whose recording state should be freed.
+ */
+void guac_display_layer_record_free(guac_display_layer* layer);
+
+/**
+ * Sends again losslessly any regions of the given display that were sent
+ * using lossy compression and have since remained unchanged for at least
+ * GUAC_DISPLAY_REFINE_DELAY milliseconds. The lossless images are encoded by
+ * the worker threads as a frame of their own, and only if no other frame is
+ * in progress. Regions that have pending changes are not refined, as those
+ * changes will be sent with the next frame regardless. This function
+ * acquires and releases the pending_frame and last_frame locks of the
+ * display.
+ *
+ * @param display
+ *     The display to refine.
+ *
+ * @return
+ *     The number of milliseconds after which this function should be invoked
+ *     again, or a negative value if there is nothing left that may need to be
+ *     refined (until more regions are sent using lossy compression).
+ */
+int guac_display_refine(guac_display* display);
+
+/**
+ * Adjusts the quality used for lossy encoding based on the current
+ * processing lag of the client associated with the given display and the
+ * rate at which encoded image data has been sent since the last adjustment.
+ * Adjustments are made no more frequently than every
+ * GUAC_DISPLAY_QUALITY_UPDATE_INTERVAL milliseconds. This function is invoked
+ * by the worker threads after each frame is completed.
+ *
+ * @param display
+ *     The guac_display whose lossy encoding quality should be adjusted.
+ */
+void guac_display_quality_update(guac_display* display);
+
+/**
+ * Returns the quality that should currently be used for lossy encoding.
+ *
+ * @param display
+ *     The guac_display that is encoding image data.
+ *
+ * @return
+ *     A value between GUAC_DISPLAY_QUALITY_MIN and GUAC_DISPLAY_QUALITY_MAX
+ *     inclusive.
+ */
+int guac_display_quality_suggest(guac_display* display);
+
+/**
+ * Returns whether the connection associated with the given display is
+ * currently considered congested, such that lossy encoding should be
+ * preferred wherever lossless encoding is not required, regardless of how
+ * frequently the region being encoded has been updated.
+ *
+ * @param display
+ *     The guac_display that is encoding image data.
+ *
+ * @return
+ *     Non-zero if the connection is congested, zero otherwise.
+ */
+int guac_display_quality_is_congested(guac_display* display);
 
 #endif
@@ -0,0 +1,119 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "display-priv.h"
+#include "guacamole/client.h"
+#include "guacamole/display.h"
+#include "guacamole/timestamp.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+void guac_display_quality_update(guac_display* display) {
+
+    guac_display_quality_state* state = &display->quality;
+    guac_timestamp now = guac_timestamp_current();
+
+    /* Determine the total amount of encoded image data sent thus far */
+    guac_display_stats stats;
+    guac_display_get_stats(display, &stats);
+    uint64_t bytes = stats.png.bytes + stats.jpeg.bytes + stats.webp.bytes;
+
+    int processing_lag = guac_client_get_processing_lag(display->client);
+
+    pthread_mutex_lock(&display->quality_lock);
+
+    guac_timestamp elapsed = now - state->last_update;
+    if (elapsed < GUAC_DISPLAY_QUALITY_UPDATE_INTERVAL) {
+        pthread_mutex_unlock(&display->quality_lock);
+        return;
+    }
+
+    /* Smooth measurements such that a single outlier does not drastically
+     * alter quality */
+    uint64_t rate = (bytes - state->last_bytes) * 1000 / elapsed;
+    state->throughput = (state->throughput * 3 + rate) / 4;
+    state->lag = (state->lag + processing_lag) / 2;
+
+    state->last_update = now;
+    state->last_bytes = bytes;
+
+    /* Reduce quality multiplicatively if the client is falling behind, noting
+     * the rate at which this began to occur */
+    if (state->lag > GUAC_DISPLAY_QUALITY_HIGH_LAG) {
+
+        int step = (state->quality - GUAC_DISPLAY_QUALITY_MIN) / 4;
+        if (step < GUAC_DISPLAY_QUALITY_STEP_DOWN)
+            step = GUAC_DISPLAY_QUALITY_STEP_DOWN;
+
+        state->quality -= step;
+        state->congested = 1;
+
+        if (state->throughput > 0)
+            state->capacity = state->throughput;
+
+    }
+
+    /* Increase quality additively only while the client is keeping up AND
+     * there appears to be room for more data. The known capacity is allowed
+     * to grow slowly such that improved network conditions are eventually
+     * discovered. */
+    else if (state->lag < GUAC_DISPLAY_QUALITY_LOW_LAG) {
+
+        state->congested = 0;
+
+        if (state->capacity == 0 || state->throughput < state->capacity * 7 / 8)
+            state->quality += GUAC_DISPLAY_QUALITY_STEP_UP;
+        else
+            state->capacity += state->capacity / 16;
+
+    }
+
+    /* NOTE: Between the low and high thresholds, quality is intentionally
+     * left unchanged to avoid oscillation */
+
+    if (state->quality < GUAC_DISPLAY_QUALITY_MIN)
+        state->quality = GUAC_DISPLAY_QUALITY_MIN;
+    else if (state->quality > GUAC_DISPLAY_QUALITY_MAX)
+        state->quality = GUAC_DISPLAY_QUALITY_MAX;
+
+    pthread_mutex_unlock(&display->quality_lock);
+
+}
+
+int guac_display_quality_suggest(guac_display* display) {
+
+    pthread_mutex_lock(&display->quality_lock);
+    int quality = display->quality.quality;
+    pthread_mutex_unlock(&display->quality_lock);
+
+    return quality;
+
+}
+
+int guac_display_quality_is_congested(guac_display* display) {
+
+    pthread_mutex_lock(&display->quality_lock);
+    int congested = display->quality.congested;
+    pthread_mutex_unlock(&display->quality_lock);
+
+    return congested;
+
+}
@@ -0,0 +1,356 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "display-priv.h"
+#include "encode-png.h"
+#include "guacamole/client.h"
+#include "guacamole/display.h"
+#include "guacamole/layer.h"
+#include "guacamole/mem.h"
+#include "guacamole/protocol.h"
+#include "guacamole/rect.h"
+#include "guacamole/rwlock.h"
+#include "guacamole/socket.h"
+#include "guacamole/stream.h"
+#include "guacamole/timestamp.h"
+
+#include <cairo/cairo.h>
+#include <pthread.h>
+#include <string.h>
+
+/**
+ * Ensures the recording state of the given layer has exactly enough cells to
+ * cover the last frame of that layer. If the number of cells changes, all
+ * cells are flagged as modified.
+ *
+ * @param layer
+ *     The layer whose recording state should be resized.
+ */
+static void guac_display_layer_record_resize(guac_display_layer* layer) {
+
+    guac_display_layer_record* record = &layer->record;
+
+    size_t width = GUAC_DISPLAY_CELL_DIMENSION(layer->last_frame.width);
+    size_t height = GUAC_DISPLAY_CELL_DIMENSION(layer->last_frame.height);
+
+    if (record->width == width && record->height == height)
+        return;
+
+    guac_mem_free(record->cells);
+    record->cells = NULL;
+    record->width = 0;
+    record->height = 0;
+
+    if (width == 0 || height == 0)
+        return;
+
+    record->cells = guac_mem_alloc(width, height);
+    record->width = width;
+    record->height = height;
+
+    memset(record->cells, 1, width * height);
+
+}
+
+void PFR_LFW_guac_display_layer_record_update(guac_display_layer* layer,
+        guac_timestamp frame) {
+
+    guac_display_layer_record* record = &layer->record;
+
+    /* Layers that have never been recorded will be recorded in full */
+    if (!record->recorded)
+        return;
+
+    guac_display_layer_record_resize(layer);
+
+    if (guac_rect_is_empty(&layer->last_frame.dirty))
+        return;
+
+    guac_display_layer_cell* cell_row = layer->pending_frame_cells;
+    unsigned char* flag_row = record->cells;
+
+    for (size_t y = 0; y < layer->pending_frame_cells_height && y < record->height; y++) {
+
+        for (size_t x = 0; x < layer->pending_frame_cells_width && x < record->width; x++) {
+            if (cell_row[x].last_frame == frame)
+                flag_row[x] = 1;
+        }
+
+        cell_row += layer->pending_frame_cells_width;
+        flag_row += record->width;
+
+    }
+
+}
+
+void LFW_guac_display_layer_record_invalidate(guac_display_layer* layer) {
+
+    guac_display_layer_record* record = &layer->record;
+
+    if (record->cells != NULL)
+        memset(record->cells, 1, record->width * record->height);
+
+}
+
+void guac_display_layer_record_free(guac_display_layer* layer) {
+    guac_mem_free(layer->record.cells);
+}
+
+/**
+ * Writes the given region of the last frame of the given layer to the given
+ * socket as a lossless PNG image, replacing the entire contents of that
+ * region.
+ *
+ * @param layer
+ *     The layer whose last frame contains the image data.
+ *
+ * @param rect
+ *     The region of the layer to write.
+ *
+ * @param socket
+ *     The socket that should receive the image.
+ */
+static void LFR_guac_display_layer_record_rect(guac_display_layer* layer,
+        const guac_rect* rect, guac_socket* socket) {
+
+    guac_client* client = layer->display->client;
+
+    unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(layer->last_frame, *rect);
+    cairo_surface_t* surface = cairo_image_surface_create_for_data(buffer,
+                layer->opaque ? CAIRO_FORMAT_RGB24 : CAIRO_FORMAT_ARGB32,
+                guac_rect_width(rect), guac_rect_height(rect),
+                layer->last_frame.buffer_stride);
+
+    /* The image replaces the region entirely (including any transparency), as
+     * the recorded contents of the region may differ arbitrarily from the
+     * contents that the image represents */
+    guac_stream* stream = guac_client_alloc_stream(client);
+    guac_protocol_send_img(socket, stream, GUAC_COMP_SRC, layer->layer,
+            "image/png", rect->left, rect->top);
+
+    guac_png_write(socket, stream, surface, NULL, NULL);
+
+    guac_protocol_send_end(socket, stream);
+    guac_client_free_stream(client, stream);
+
+    cairo_surface_destroy(surface);
+
+}
+
+/**
+ * Writes all changes to the given layer since the layer was last recorded,
+ * including changes to its size, opacity, and position, to the given socket.
+ * If the layer has not yet been recorded, its full state is written.
+ *
+ * @param layer
+ *     The layer to record.
+ *
+ * @param socket
+ *     The socket that should receive the changes.
+ *
+ * @return
+ *     Non-zero if any part of the contents of the layer was written, zero
+ *     otherwise.
+ */
+static int LFR_guac_display_layer_record(guac_display_layer* layer,
+        guac_socket* socket) {
+
+    guac_display_layer_record* record = &layer->record;
+    const guac_display_layer_state* state = &layer->last_frame;
+    int written = 0;
+
+    if (!record->recorded || record->layer_width != state->width
+            || record->layer_height != state->height) {
+
+        guac_protocol_send_size(socket, layer->layer, state->width, state->height);
+        record->layer_width = state->width;
+        record->layer_height = state->height;
+
+        guac_display_layer_record_resize(layer);
+
+    }
+
+    /* Everything must be written for layers not yet recorded */
+    if (!record->recorded && record->cells != NULL)
+        memset(record->cells, 1, record->width * record->height);
+
+    /* Properties specific to non-buffer layers */
+    if (layer->layer->index > 0) {
+
+        if (!record->recorded || record->opacity != state->opacity) {
+            guac_protocol_send_shade(socket, layer->layer, state->opacity);
+            record->opacity = state->opacity;
+        }
+
+        if (!record->recorded || record->x != state->x || record->y != state->y
+                || record->z != state->z || record->parent != state->parent) {
+
+            guac_protocol_send_move(socket, layer->layer, state->parent,
+                    state->x, state->y, state->z);
+
+            record->x = state->x;
+            record->y = state->y;
+            record->z = state->z;
+            record->parent = state->parent;
+
+        }
+
+    }
+
+    record->recorded = 1;
+
+    if (record->cells == NULL || state->buffer == NULL)
+        return 0;
+
+    guac_rect layer_bounds;
+    guac_rect_init(&layer_bounds, 0, 0, state->width, state->height);
+
+    /* Write each horizontal run of modified cells as a single image */
+    unsigned char* flag_row = record->cells;
+    for (size_t y = 0; y < record->height; y++) {
+
+        size_t x = 0;
+        while (x < record->width) {
+
+            if (!flag_row[x]) {
+                x++;
+                continue;
+            }
+
+            size_t start = x;
+            while (x < record->width && flag_row[x])
+                flag_row[x++] = 0;
+
+            guac_rect rect;
+            guac_rect_init(&rect,
+                    start * GUAC_DISPLAY_CELL_SIZE,
+                    y * GUAC_DISPLAY_CELL_SIZE,
+                    (x - start) * GUAC_DISPLAY_CELL_SIZE,
+                    GUAC_DISPLAY_CELL_SIZE);
+
+            guac_rect_constrain(&rect, &layer_bounds);
+            if (guac_rect_is_empty(&rect))
+                continue;
+
+            LFR_guac_display_layer_record_rect(layer, &rect, socket);
+            written = 1;
+
+        }
+
+        flag_row += record->width;
+
+    }
+
+    return written;
+
+}
+
+void guac_display_record(guac_display* display, guac_socket* socket) {
+
+    guac_rwlock_acquire_read_lock(&display->last_frame.lock);
+    pthread_mutex_lock(&display->record_lock);
+
+    size_t layer_count = 0;
+    guac_display_layer* current = display->last_frame.layers;
+    while (current != NULL) {
+        layer_count++;
+        current = current->last_frame.next;
+    }
+
+    guac_display_layer* cursor = display->cursor_buffer;
+    if (display->last_frame.cursor_source != NULL)
+        cursor = display->last_frame.cursor_source;
+
+    int* indices = guac_mem_alloc(sizeof(int), layer_count);
+    size_t index_count = 0;
+    int cursor_written = 0;
+
+    /* Only the visible layers and the source of the mouse cursor image need
+     * be recorded - the contents of all other buffers are reflected within
+     * the visible layers as they are recorded */
+    current = display->last_frame.layers;
+    while (current != NULL) {
+
+        if (current->layer->index >= 0 || current == cursor) {
+
+            int written = LFR_guac_display_layer_record(current, socket);
+            if (current == cursor)
+                cursor_written = written;
+
+            indices[index_count++] = current->layer->index;
+
+        }
+
+        /* Buffers that are no longer recorded are disposed below, and must be
+         * recorded in full if ever recorded again */
+        else
+            current->record.recorded = 0;
+
+        current = current->last_frame.next;
+
+    }
+
+    /* Dispose of any layers recorded previously that no longer exist */
+    for (size_t i = 0; i < display->record_index_count; i++) {
+
+        int index = display->record_indices[i];
+
+        int found = 0;
+        for (size_t j = 0; j < index_count && !found; j++)
+            found = (indices[j] == index);
+
+        /* The default layer can never be disposed */
+        if (!found && index != 0) {
+            guac_layer disposed = { .index = index };
+            guac_protocol_send_dispose(socket, &disposed);
+        }
+
+    }
+
+    guac_mem_free(display->record_indices);
+    display->record_indices = indices;
+    display->record_index_count = index_count;
+
+    /* Resend the mouse cursor only if its image has changed */
+    if (cursor_written || cursor != display->record_cursor
+            || display->last_frame.cursor_hotspot_x != display->record_cursor_hotspot_x
+            || display->last_frame.cursor_hotspot_y != display->record_cursor_hotspot_y) {
+
+        guac_protocol_send_cursor(socket,
+                display->last_frame.cursor_hotspot_x,
+                display->last_frame.cursor_hotspot_y,
+                cursor->layer, 0, 0,
+                cursor->last_frame.width,
+                cursor->last_frame.height);
+
+        display->record_cursor = cursor;
+        display->record_cursor_hotspot_x = display->last_frame.cursor_hotspot_x;
+        display->record_cursor_hotspot_y = display->last_frame.cursor_hotspot_y;
+
+    }
+
+    guac_protocol_send_sync(socket, guac_timestamp_current(), 1);
+
+    pthread_mutex_unlock(&display->record_lock);
+    guac_rwlock_release_lock(&display->last_frame.lock);
+
+    guac_socket_flush(socket);
+
+}
@@ -0,0 +1,470 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "display-plan.h"
+#include "display-priv.h"
+#include "guacamole/fifo.h"
+#include "guacamole/mem.h"
+#include "guacamole/rect.h"
+#include "guacamole/rwlock.h"
+#include "guacamole/timestamp.h"
+
+#include <pthread.h>
+#include <string.h>
+
+/**
+ * Resizes the refinement state of the given layer to cover the given
+ * dimensions. The state of any cells within both the old and new dimensions
+ * is preserved, while all new cells are considered to have been sent
+ * losslessly.
+ *
+ * @param layer
+ *     The layer whose refinement state should be resized.
+ *
+ * @param width
+ *     The new width of the layer, in pixels.
+ *
+ * @param height
+ *     The new height of the layer, in pixels.
+ */
+static void guac_display_layer_refinement_resize(guac_display_layer* layer,
+        int width, int height) {
+
+    guac_display_layer_refinement* refinement = &layer->refinement;
+    guac_rect_init(&refinement->bounds, 0, 0, width, height);
+
+    size_t new_width = GUAC_DISPLAY_CELL_DIMENSION(width);
+    size_t new_height = GUAC_DISPLAY_CELL_DIMENSION(height);
+
+    if (new_width == refinement->width && new_height == refinement->height)
+        return;
+
+    guac_timestamp* new_cells = NULL;
+    if (new_width != 0 && new_height != 0) {
+
+        new_cells = guac_mem_zalloc(sizeof(guac_timestamp), new_width, new_height);
+
+        size_t copy_width = new_width < refinement->width ? new_width : refinement->width;
+        size_t copy_height = new_height < refinement->height ? new_height : refinement->height;
+
+        for (size_t y = 0; y < copy_height; y++)
+            memcpy(new_cells + y * new_width,
+                    refinement->cells + y * refinement->width,
+                    copy_width * sizeof(guac_timestamp));
+
+    }
+
+    guac_mem_free(refinement->cells);
+    refinement->cells = new_cells;
+    refinement->width = new_width;
+    refinement->height = new_height;
+
+}
+
+/**
+ * Determines the range of cells of the given refinement state that are
+ * touched by the given rectangle.
+ *
+ * @param refinement
+ *     The refinement state containing the cells.
+ *
+ * @param rect
+ *     The rectangle to test, in pixels.
+ *
+ * @param range
+ *     The rectangle to populate with the range of cells touched, in cells.
+ *
+ * @return
+ *     Non-zero if the rectangle touches at least one cell, zero otherwise.
+ */
+static int guac_display_layer_refinement_range(
+        const guac_display_layer_refinement* refinement,
+        const guac_rect* rect, guac_rect* range) {
+
+    guac_rect constrained = *rect;
+    guac_rect_constrain(&constrained, &refinement->bounds);
+
+    if (guac_rect_is_empty(&constrained))
+        return 0;
+
+    range->left = constrained.left >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+    range->top = constrained.top >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+    range->right = GUAC_DISPLAY_CELL_DIMENSION(constrained.right);
+    range->bottom = GUAC_DISPLAY_CELL_DIMENSION(constrained.bottom);
+
+    return 1;
+
+}
+
+/**
+ * Returns the latest time at which any cell touched by the given rectangle
+ * was sent using lossy compression.
+ *
+ * @param refinement
+ *     The refinement state containing the cells.
+ *
+ * @param rect
+ *     The region to test, in pixels.
+ *
+ * @return
+ *     The latest time at which any cell touched by the given rectangle was
+ *     sent using lossy compression, or zero if all such cells were sent
+ *     losslessly.
+ */
+static guac_timestamp guac_display_layer_refinement_latest(
+        const guac_display_layer_refinement* refinement,
+        const guac_rect* rect) {
+
+    guac_rect range;
+    if (!guac_display_layer_refinement_range(refinement, rect, &range))
+        return 0;
+
+    guac_timestamp latest = 0;
+    for (int y = range.top; y < range.bottom; y++) {
+
+        const guac_timestamp* cell = refinement->cells + y * refinement->width + range.left;
+        for (int x = range.left; x < range.right; x++, cell++) {
+            if (*cell > latest)
+                latest = *cell;
+        }
+
+    }
+
+    return latest;
+
+}
+
+/**
+ * Updates the refinement state of the cells touched by the given rectangle.
+ * Cells wholly covered by the rectangle take on the given timestamp, while
+ * cells only partially covered keep the later of their current timestamp
+ * and the given timestamp.
+ *
+ * @param refinement
+ *     The refinement state containing the cells.
+ *
+ * @param rect
+ *     The region that was sent, in pixels.
+ *
+ * @param sent
+ *     The time at which the region was sent using lossy compression, or zero
+ *     if the region was sent losslessly.
+ */
+static void guac_display_layer_refinement_update(
+        guac_display_layer_refinement* refinement,
+        const guac_rect* rect, guac_timestamp sent) {
+
+    guac_rect range;
+    if (!guac_display_layer_refinement_range(refinement, rect, &range))
+        return;
+
+    for (int y = range.top; y < range.bottom; y++) {
+
+        guac_timestamp* cell = refinement->cells + y * refinement->width + range.left;
+        for (int x = range.left; x < range.right; x++, cell++) {
+
+            guac_rect cell_rect;
+            guac_rect_init(&cell_rect,
+                    x << GUAC_DISPLAY_CELL_SIZE_EXPONENT,
+                    y << GUAC_DISPLAY_CELL_SIZE_EXPONENT,
+                    GUAC_DISPLAY_CELL_SIZE, GUAC_DISPLAY_CELL_SIZE);
+            guac_rect_constrain(&cell_rect, &refinement->bounds);
+
+            int covered = cell_rect.left >= rect->left && cell_rect.right <= rect->right
+                       && cell_rect.top >= rect->top && cell_rect.bottom <= rect->bottom;
+
+            if (covered || sent > *cell)
+                *cell = sent;
+
+        }
+
+    }
+
+}
+
+void LFR_guac_display_layer_refinement_mark(guac_display_layer* layer,
+        const guac_rect* rect, guac_timestamp sent) {
+
+    guac_display* display = layer->display;
+
+    pthread_mutex_lock(&display->refinement_lock);
+    guac_display_layer_refinement_update(&layer->refinement, rect, sent);
+    pthread_mutex_unlock(&display->refinement_lock);
+
+}
+
+void guac_display_layer_refinement_free(guac_display_layer* layer) {
+
+    guac_display_layer_refinement* refinement = &layer->refinement;
+
+    guac_mem_free(refinement->cells);
+    refinement->width = 0;
+    refinement->height = 0;
+
+}
+
+/**
+ * Returns the layer whose client-side copy of its previous frame is the given
+ * buffer.
+ *
+ * @param display
+ *     The display containing the layer.
+ *
+ * @param buffer
+ *     The client-side buffer to search for.
+ *
+ * @return
+ *     The layer whose last_frame_buffer is the given buffer, or NULL if no
+ *     such layer exists (the buffer is the client-side tile cache, for
+ *     example).
+ */
+static guac_display_layer* LFR_guac_display_find_last_frame_buffer_owner(
+        guac_display* display, const guac_layer* buffer) {
+
+    guac_display_layer* current = display->last_frame.layers;
+    while (current != NULL) {
+
+        if (current->last_frame_buffer == buffer)
+            return current;
+
+        current = current->last_frame.next;
+
+    }
+
+    return NULL;
+
+}
+
+void PFR_LFW_guac_display_plan_track_refinement(guac_display_plan* plan) {
+
+    guac_display* display = plan->display;
+
+    /* Determine the state of the source of each copy before updating any
+     * destination, as a copy may read from a region that another copy
+     * within the same frame overwrites (the source of every copy is the
+     * previous frame). A negative value indicates a copy whose source is not
+     * tracked. */
+    guac_timestamp* copied = guac_display_arena_alloc(&display->plan_arena,
+            plan->length, sizeof(guac_timestamp));
+
+    guac_display_plan_operation* op = plan->ops;
+    for (size_t i = 0; i < plan->length; i++, op++) {
+
+        copied[i] = -1;
+        if (op->type != GUAC_DISPLAY_PLAN_OPERATION_COPY)
+            continue;
+
+        guac_display_layer* source = LFR_guac_display_find_last_frame_buffer_owner(
+                display, op->src.layer_rect.layer);
+
+        if (source != NULL)
+            copied[i] = guac_display_layer_refinement_latest(&source->refinement,
+                    &op->src.layer_rect.rect);
+
+    }
+
+    guac_display_layer* current = display->pending_frame.layers;
+    while (current != NULL) {
+        guac_display_layer_refinement_resize(current,
+                current->pending_frame.width, current->pending_frame.height);
+        current = current->pending_frame.next;
+    }
+
+    op = plan->ops;
+    for (size_t i = 0; i < plan->length; i++, op++) {
+
+        if (op->type == GUAC_DISPLAY_PLAN_OPERATION_RECT)
+            guac_display_layer_refinement_update(&op->layer->refinement, &op->dest, 0);
+
+        else if (op->type == GUAC_DISPLAY_PLAN_OPERATION_COPY && copied[i] >= 0)
+            guac_display_layer_refinement_update(&op->layer->refinement, &op->dest, copied[i]);
+
+    }
+
+}
+
+/**
+ * Adds operations that losslessly redraw every cell of the given layer that
+ * is due for refinement, merging horizontally adjacent cells into a single
+ * operation. Refined cells are marked as having been sent losslessly, and
+ * the dirty rect of the last frame of the layer is extended to cover them.
+ *
+ * @param layer
+ *     The layer to refine.
+ *
+ * @param now
+ *     The current time.
+ *
+ * @param ops
+ *     The array that should receive the new operations. This array must have
+ *     space for at least one operation per cell of the layer.
+ *
+ * @param next
+ *     A pointer to the number of milliseconds until the next refinement is
+ *     due, or a negative value if none is yet due. This is updated to
+ *     account for any cells of the layer that are not yet due.
+ *
+ * @return
+ *     The number of operations added.
+ */
+static size_t PFR_LFW_guac_display_layer_refine(guac_display_layer* layer,
+        guac_timestamp now, guac_display_plan_operation* ops, int* next) {
+
+    guac_display_layer_refinement* refinement = &layer->refinement;
+    size_t count = 0;
+
+    /* The refinement state of the layer is resized only when a frame is
+     * planned and may thus extend beyond the last frame */
+    guac_rect bounds;
+    guac_rect_init(&bounds, 0, 0, layer->last_frame.width, layer->last_frame.height);
+    guac_rect_constrain(&bounds, &refinement->bounds);
+
+    for (size_t y = 0; y < refinement->height; y++) {
+
+        guac_display_plan_operation* run = NULL;
+        guac_timestamp* cell = refinement->cells + y * refinement->width;
+
+        for (size_t x = 0; x < refinement->width; x++, cell++) {
+
+            guac_rect cell_rect;
+            guac_rect_init(&cell_rect,
+                    x << GUAC_DISPLAY_CELL_SIZE_EXPONENT,
+                    y << GUAC_DISPLAY_CELL_SIZE_EXPONENT,
+                    GUAC_DISPLAY_CELL_SIZE, GUAC_DISPLAY_CELL_SIZE);
+            guac_rect_constrain(&cell_rect, &bounds);
+
+            /* Cells that have pending changes or lie beneath a video will
+             * be redrawn regardless */
+            int due = 0;
+            if (*cell != 0 && !guac_rect_is_empty(&cell_rect)
+                    && !guac_rect_intersects(&cell_rect, &layer->pending_frame.dirty)
+                    && !LFW_guac_display_layer_video_intersects(layer, &cell_rect)) {
+
+                int remaining = GUAC_DISPLAY_REFINE_DELAY - (int) (now - *cell);
+                if (remaining <= 0)
+                    due = 1;
+                else if (*next < 0 || remaining < *next)
+                    *next = remaining;
+
+            }
+
+            if (!due) {
+                run = NULL;
+                continue;
+            }
+
+            *cell = 0;
+            guac_rect_extend(&layer->last_frame.dirty, &cell_rect);
+
+            if (run != NULL) {
+                run->dest.right = cell_rect.right;
+                run->dirty_size += (size_t) guac_rect_width(&cell_rect) * guac_rect_height(&cell_rect);
+                continue;
+            }
+
+            run = &ops[count++];
+            *run = (guac_display_plan_operation) {
+                .layer = layer,
+                .type = GUAC_DISPLAY_PLAN_OPERATION_REFINE,
+                .dest = cell_rect,
+                .dirty_size = (size_t) guac_rect_width(&cell_rect) * guac_rect_height(&cell_rect)
+            };
+
+        }
+
+    }
+
+    return count;
+
+}
+
+int guac_display_refine(guac_display* display) {
+
+    int next = -1;
+
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+
+    /* Refinement is sent as a frame of its own, and so must wait for any
+     * in-progress frame to finish */
+    guac_fifo_lock(&display->ops);
+    int busy = (display->ops.state.value & GUAC_FIFO_STATE_NONEMPTY) || display->active_workers;
+    guac_fifo_unlock(&display->ops);
+
+    if (busy) {
+        next = GUAC_DISPLAY_REFINE_DELAY;
+        goto finished_with_pending_frame_lock;
+    }
+
+    guac_rwlock_acquire_write_lock(&display->last_frame.lock);
+
+    size_t max_ops = 0;
+    guac_display_layer* current = display->last_frame.layers;
+    while (current != NULL) {
+        max_ops += current->refinement.width * current->refinement.height;
+        current = current->last_frame.next;
+    }
+
+    /* The previous frame has already been committed in its entirety, and the
+     * plan arena is not in use outside of flushing a frame */
+    guac_display_arena_reset(&display->plan_arena);
+    guac_display_plan_operation* ops = guac_display_arena_alloc(&display->plan_arena,
+            max_ops, sizeof(guac_display_plan_operation));
+
+    guac_timestamp now = guac_timestamp_current();
+    size_t op_count = 0;
+
+    /* The dirty rect of the last frame of each layer determines what the
+     * worker ending this frame commits to the client-side copy of that
+     * layer's previous frame, and so must now cover only refined cells */
+    current = display->last_frame.layers;
+    while (current != NULL) {
+
+        current->last_frame.dirty = (guac_rect) { 0 };
+        if (current->last_frame.buffer != NULL)
+            op_count += PFR_LFW_guac_display_layer_refine(current, now,
+                    ops + op_count, &next);
+
+        current = current->last_frame.next;
+
+    }
+
+    /* This frame contains nothing that connected clients have not already
+     * received other than the refined images themselves */
+    if (op_count) {
+        display->last_frame.frames = 0;
+        display->last_frame.cursor_source_modified = 0;
+    }
+
+    guac_rwlock_release_lock(&display->last_frame.lock);
+
+    /* Enqueue all refinement at once (see guac_display_plan_apply()) */
+    guac_fifo_lock(&display->ops);
+    for (size_t i = 0; i < op_count; i++)
+        guac_fifo_enqueue(&display->ops, &ops[i]);
+    guac_fifo_unlock(&display->ops);
+
+    guac_display_arena_reset(&display->plan_arena);
+
+finished_with_pending_frame_lock:
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+
+    return next;
+
+}
@@ -67,12 +67,31 @@ static void* guac_display_render_loop(void* data) {
     for (;;) {
 
         guac_display_render_thread_cursor_state cursor_state = render_thread->cursor_state;
+        unsigned int notifications = 0;
 
-        /* Wait indefinitely for any change to the frame state */
-        guac_flag_wait_and_lock(&render_thread->state,
-                  GUAC_DISPLAY_RENDER_THREAD_STATE_STOPPING
-                | GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_READY
-                | GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_MODIFIED);
+        /* Wait for any change to the frame state, using any time spent idle
+         * to refine regions that were sent using lossy compression */
+        for (;;) {
+
+            int refine_wait = guac_display_refine(display);
+
+            /* Wait indefinitely if there is nothing to refine */
+            if (refine_wait < 0) {
+                guac_flag_wait_and_lock(&render_thread->state,
+                          GUAC_DISPLAY_RENDER_THREAD_STATE_STOPPING
+                        | GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_READY
+                        | GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_MODIFIED);
+                break;
+            }
+
+            if (guac_flag_timedwait_and_lock(&render_thread->state,
+                          GUAC_DISPLAY_RENDER_THREAD_STATE_STOPPING
+                        | GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_READY
+                        | GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_MODIFIED,
+                        refine_wait))
+                break;
+
+        }
 
         /* Bail out immediately upon upcoming disconnect */
         if (render_thread->state.value & GUAC_DISPLAY_RENDER_THREAD_STATE_STOPPING) {
@@ -102,6 +121,7 @@ static void* guac_display_render_loop(void* data) {
              * compare here - that will be done by the actual guac_display
              * frame flush) */
             cursor_state = render_thread->cursor_state;
+            notifications = render_thread->notifications;
 
             /* Frame is no longer modified - prepare for possible future wait
              * for further changes */
@@ -114,9 +134,12 @@ static void* guac_display_render_loop(void* data) {
              * to calculate the amount of additional delay required to
              * allow the client to catch up. This value is used later,
              * after everything else related to the frame has been
-             * finalized. */
+             * finalized. Frames are paced according to the owner of the
+             * connection (or the fastest user, if the owner is absent)
+             * such that slower viewers of a shared connection do not hold
+             * back everyone else. */
             int time_since_last_frame = guac_timestamp_current() - client->last_sent_timestamp;
-            int processing_lag = guac_client_get_processing_lag(client);
+            int processing_lag = guac_client_get_pacing_lag(client);
             int required_wait = processing_lag - time_since_last_frame;
 
             /* Do not exceed a reasonable maximum framerate without an
@@ -140,6 +163,9 @@ static void* guac_display_render_loop(void* data) {
                 guac_timestamp_msleep(required_wait);
             }
 
+            guac_display_stats_record_render_lag(display,
+                    required_wait > 0 ? required_wait : 0);
+
             /* Use explicit frame boundaries whenever available */
             if (guac_flag_timedwait_and_lock(&render_thread->state,
                         GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_READY, 0)) {
@@ -172,6 +198,13 @@ static void* guac_display_render_loop(void* data) {
 
         guac_display_end_multiple_frames(display, rendered_frames);
 
+        /* Everything up to the last notification included in the frame has
+         * now been flushed, unless further changes were made meanwhile */
+        guac_flag_lock(&render_thread->state);
+        if (render_thread->notifications == notifications)
+            guac_flag_set(&render_thread->state, GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_FLUSHED);
+        guac_flag_unlock(&render_thread->state);
+
     }
 
     return NULL;
@@ -183,8 +216,10 @@ guac_display_render_thread* guac_display_render_thread_create(guac_display* disp
     guac_display_render_thread* render_thread = guac_mem_alloc(sizeof(guac_display_render_thread));
 
     guac_flag_init(&render_thread->state);
+    guac_flag_set(&render_thread->state, GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_FLUSHED);
     render_thread->display = display;
     render_thread->frames = 0;
+    render_thread->notifications = 0;
     render_thread->cursor_state = (guac_display_render_thread_cursor_state) { 0 };
 
     /* Start render thread (this will immediately begin blocking until frame
@@ -196,13 +231,47 @@ guac_display_render_thread* guac_display_render_thread_create(guac_display* disp
 }
 
 void guac_display_render_thread_notify_modified(guac_display_render_thread* render_thread) {
-    guac_flag_set(&render_thread->state, GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_MODIFIED);
+    guac_flag_set_and_lock(&render_thread->state, GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_MODIFIED);
+    guac_flag_clear(&render_thread->state, GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_FLUSHED);
+    render_thread->notifications++;
+    guac_flag_unlock(&render_thread->state);
 }
 
 void guac_display_render_thread_notify_frame(guac_display_render_thread* render_thread) {
     guac_flag_set_and_lock(&render_thread->state, GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_READY);
+    guac_flag_clear(&render_thread->state, GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_FLUSHED);
     render_thread->frames++;
+    render_thread->notifications++;
+    guac_flag_unlock(&render_thread->state);
+}
+
+int guac_display_render_thread_wait_for_frame(guac_display_render_thread* render_thread,
+        unsigned int msec_timeout) {
+
+    guac_display* display = render_thread->display;
+    guac_timestamp start = guac_timestamp_current();
+
+    /* Wait for the render thread to flush everything it has been told of */
+    if (!guac_flag_timedwait_and_lock(&render_thread->state,
+                GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_FLUSHED, msec_timeout))
+        return 0;
+
     guac_flag_unlock(&render_thread->state);
+
+    /* Wait for any in-progress frame to finish being sent to users, using
+     * only whatever time remains */
+    guac_timestamp elapsed = guac_timestamp_current() - start;
+    if (elapsed >= msec_timeout)
+        elapsed = msec_timeout;
+
+    if (!guac_flag_timedwait_and_lock(&display->render_state,
+                GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS,
+                msec_timeout - elapsed))
+        return 0;
+
+    guac_flag_unlock(&display->render_state);
+    return 1;
+
 }
 
 void guac_display_render_thread_notify_user_moved_mouse(guac_display_render_thread* render_thread,
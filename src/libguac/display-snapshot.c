@@ -0,0 +1,284 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "display-priv.h"
+#include "encode-capture.h"
+#include "encode-png.h"
+#include "guacamole/client.h"
+#include "guacamole/mem.h"
+#include "guacamole/protocol.h"
+#include "guacamole/rect.h"
+#include "guacamole/socket.h"
+#include "guacamole/stream.h"
+
+#include <cairo/cairo.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * The number of cells along each side of a single snapshot tile.
+ */
+#define GUAC_DISPLAY_SNAPSHOT_TILE_CELLS \
+    (GUAC_DISPLAY_SNAPSHOT_TILE_SIZE / GUAC_DISPLAY_CELL_SIZE)
+
+/**
+ * Frees the encoded image data of every tile within the given snapshot, along
+ * with the tiles array itself, leaving the snapshot empty.
+ *
+ * @param snapshot
+ *     The snapshot to clear.
+ */
+static void guac_display_layer_snapshot_clear(guac_display_layer_snapshot* snapshot) {
+
+    size_t count = snapshot->width * snapshot->height;
+    for (size_t i = 0; i < count; i++)
+        guac_mem_free(snapshot->tiles[i].data);
+
+    guac_mem_free(snapshot->tiles);
+    snapshot->width = 0;
+    snapshot->height = 0;
+
+}
+
+/**
+ * Ensures the snapshot of the given layer has exactly enough tiles to cover
+ * the last frame of that layer. If the number of tiles changes, all previous
+ * tiles are discarded and the new tiles are all stale.
+ *
+ * @param layer
+ *     The layer whose snapshot should be resized.
+ */
+static void guac_display_layer_snapshot_resize(guac_display_layer* layer) {
+
+    guac_display_layer_snapshot* snapshot = &layer->snapshot;
+
+    size_t width = GUAC_DISPLAY_SNAPSHOT_DIMENSION(layer->last_frame.width);
+    size_t height = GUAC_DISPLAY_SNAPSHOT_DIMENSION(layer->last_frame.height);
+
+    if (snapshot->width == width && snapshot->height == height)
+        return;
+
+    guac_display_layer_snapshot_clear(snapshot);
+
+    if (width == 0 || height == 0)
+        return;
+
+    snapshot->tiles = guac_mem_zalloc(width, height, sizeof(guac_display_snapshot_tile));
+    snapshot->width = width;
+    snapshot->height = height;
+
+    for (size_t i = 0; i < width * height; i++)
+        snapshot->tiles[i].stale = 1;
+
+}
+
+void PFR_LFW_guac_display_layer_snapshot_update(guac_display_layer* layer,
+        guac_timestamp frame) {
+
+    guac_display_layer_snapshot* snapshot = &layer->snapshot;
+    guac_display_layer_snapshot_resize(layer);
+
+    if (guac_rect_is_empty(&layer->last_frame.dirty))
+        return;
+
+    /* Each cell modified within this frame invalidates the tile containing
+     * that cell (there is no need to resend or re-encode anything now - the
+     * tile will be refreshed only if and when a user joins) */
+    guac_display_layer_cell* cell_row = layer->pending_frame_cells;
+    for (size_t y = 0; y < layer->pending_frame_cells_height; y++) {
+
+        size_t tile_y = y / GUAC_DISPLAY_SNAPSHOT_TILE_CELLS;
+        if (tile_y >= snapshot->height)
+            break;
+
+        guac_display_layer_cell* cell = cell_row;
+        guac_display_snapshot_tile* tile_row = snapshot->tiles + tile_y * snapshot->width;
+
+        for (size_t x = 0; x < layer->pending_frame_cells_width; x++) {
+
+            size_t tile_x = x / GUAC_DISPLAY_SNAPSHOT_TILE_CELLS;
+            if (tile_x >= snapshot->width)
+                break;
+
+            if (cell->last_frame == frame)
+                tile_row[tile_x].stale = 1;
+
+            cell++;
+
+        }
+
+        cell_row += layer->pending_frame_cells_width;
+
+    }
+
+}
+
+void LFW_guac_display_layer_snapshot_invalidate(guac_display_layer* layer) {
+
+    guac_display_layer_snapshot* snapshot = &layer->snapshot;
+
+    size_t count = snapshot->width * snapshot->height;
+    for (size_t i = 0; i < count; i++)
+        snapshot->tiles[i].stale = 1;
+
+}
+
+/**
+ * Encodes the given region of the last frame of the given layer as PNG,
+ * sending the encoded image over the given socket and storing the result
+ * within the given snapshot tile for future reuse.
+ *
+ * @param layer
+ *     The layer whose last frame contains the image data.
+ *
+ * @param tile
+ *     The snapshot tile that should receive the encoded image.
+ *
+ * @param rect
+ *     The region of the layer covered by the tile.
+ *
+ * @param socket
+ *     The socket over which the encoded image should be sent.
+ *
+ * @param stream
+ *     The stream that should carry the encoded image.
+ *
+ * @return
+ *     The number of bytes of encoded image data sent if successful, a
+ *     negative value otherwise.
+ */
+static int LFR_guac_display_snapshot_tile_refresh(guac_display_layer* layer,
+        guac_display_snapshot_tile* tile, const guac_rect* rect,
+        guac_socket* socket, guac_stream* stream) {
+
+    int width = guac_rect_width(rect);
+    int height = guac_rect_height(rect);
+
+    unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(layer->last_frame, *rect);
+    cairo_surface_t* surface = cairo_image_surface_create_for_data(buffer,
+                layer->opaque ? CAIRO_FORMAT_RGB24 : CAIRO_FORMAT_ARGB32,
+                width, height, layer->last_frame.buffer_stride);
+
+    guac_encode_capture capture;
+    guac_encode_capture_init(&capture, GUAC_DISPLAY_SNAPSHOT_TILE_MAX_SIZE);
+
+    int bytes_written = guac_png_write(socket, stream, surface, &capture, NULL);
+    cairo_surface_destroy(surface);
+
+    /* Replace any previous contents of the tile, retaining the new encoded
+     * image only if it was captured in its entirety */
+    guac_mem_free(tile->data);
+    tile->data = NULL;
+    tile->length = 0;
+
+    if (bytes_written > 0 && !capture.overflow && capture.length > 0) {
+        tile->data = capture.buffer;
+        tile->length = capture.length;
+        tile->width = width;
+        tile->height = height;
+        tile->stale = 0;
+    }
+    else
+        guac_encode_capture_free(&capture);
+
+    return bytes_written;
+
+}
+
+void LFR_guac_display_layer_snapshot_dup(guac_display_layer* layer,
+        guac_socket* socket) {
+
+    guac_display* display = layer->display;
+    guac_client* client = display->client;
+    guac_display_layer_snapshot* snapshot = &layer->snapshot;
+
+    pthread_mutex_lock(&display->snapshot_lock);
+
+    /* The snapshot is normally kept in sync with the layer dimensions as each
+     * frame is completed, but a layer may not yet have been part of any
+     * completed frame */
+    guac_display_layer_snapshot_resize(layer);
+
+    guac_rect layer_bounds = {
+        .left   = 0,
+        .top    = 0,
+        .right  = layer->last_frame.width,
+        .bottom = layer->last_frame.height
+    };
+
+    guac_display_snapshot_tile* tile = snapshot->tiles;
+    for (size_t y = 0; y < snapshot->height; y++) {
+        for (size_t x = 0; x < snapshot->width; x++) {
+
+            guac_rect rect;
+            guac_rect_init(&rect,
+                    x * GUAC_DISPLAY_SNAPSHOT_TILE_SIZE,
+                    y * GUAC_DISPLAY_SNAPSHOT_TILE_SIZE,
+                    GUAC_DISPLAY_SNAPSHOT_TILE_SIZE,
+                    GUAC_DISPLAY_SNAPSHOT_TILE_SIZE);
+
+            guac_rect_constrain(&rect, &layer_bounds);
+
+            guac_stream* stream = guac_client_alloc_stream(client);
+            guac_protocol_send_img(socket, stream, GUAC_COMP_OVER, layer->layer,
+                    "image/png", rect.left, rect.top);
+
+            /* Send the retained encoding of any unmodified tile as-is
+             * (this is the common case for all but the most recently changed
+             * regions of the display) */
+            if (!tile->stale && tile->data != NULL
+                    && tile->width == guac_rect_width(&rect)
+                    && tile->height == guac_rect_height(&rect)) {
+                guac_protocol_send_blobs(socket, stream, tile->data, tile->length);
+                guac_display_stats_record_cache_lookup(display, 1);
+            }
+
+            /* Encode only those tiles that have changed since they were last
+             * sent to a joining user */
+            else {
+
+                uint64_t encode_start = guac_display_stats_clock();
+                int bytes_written = LFR_guac_display_snapshot_tile_refresh(layer,
+                        tile, &rect, socket, stream);
+
+                guac_display_stats_record_cache_lookup(display, 0);
+                if (bytes_written > 0)
+                    guac_display_stats_record_image(display,
+                            GUAC_DISPLAY_IMAGE_FORMAT_PNG, bytes_written,
+                            guac_display_stats_clock() - encode_start);
+
+            }
+
+            guac_protocol_send_end(socket, stream);
+            guac_client_free_stream(client, stream);
+
+            tile++;
+
+        }
+    }
+
+    pthread_mutex_unlock(&display->snapshot_lock);
+
+}
+
+void guac_display_layer_snapshot_free(guac_display_layer* layer) {
+    guac_display_layer_snapshot_clear(&layer->snapshot);
+}
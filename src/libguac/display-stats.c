@@ -0,0 +1,325 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "display-priv.h"
+#include "guacamole/client.h"
+#include "guacamole/display.h"
+#include "guacamole/fifo.h"
+#include "guacamole/timestamp.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#ifdef HAVE_CLOCK_GETTIME
+#include <time.h>
+#endif
+
+uint64_t guac_display_stats_clock(void) {
+
+#ifdef HAVE_CLOCK_GETTIME
+
+    struct timespec current;
+
+    /* Get current time, monotonically increasing */
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &current);
+#else
+    clock_gettime(CLOCK_REALTIME, &current);
+#endif
+
+    /* Calculate microseconds */
+    return (uint64_t) current.tv_sec * 1000000 + current.tv_nsec / 1000;
+
+#else
+
+    struct timeval current;
+
+    /* Get current time */
+    gettimeofday(&current, NULL);
+
+    /* Calculate microseconds */
+    return (uint64_t) current.tv_sec * 1000000 + current.tv_usec;
+
+#endif
+
+}
+
+void guac_display_stats_record_image(guac_display* display,
+        guac_display_image_format format, size_t bytes, uint64_t encode_time) {
+
+    pthread_mutex_lock(&display->stats_lock);
+
+    guac_display_encoder_stats* encoder_stats;
+    switch (format) {
+
+        case GUAC_DISPLAY_IMAGE_FORMAT_JPEG:
+            encoder_stats = &display->stats.jpeg;
+            break;
+
+        case GUAC_DISPLAY_IMAGE_FORMAT_WEBP:
+            encoder_stats = &display->stats.webp;
+            break;
+
+        default:
+            encoder_stats = &display->stats.png;
+            break;
+
+    }
+
+    encoder_stats->images++;
+    encoder_stats->bytes += bytes;
+    encoder_stats->encode_time += encode_time;
+
+    pthread_mutex_unlock(&display->stats_lock);
+
+}
+
+void guac_display_stats_record_video(guac_display* display, size_t bytes,
+        uint64_t encode_time) {
+
+    pthread_mutex_lock(&display->stats_lock);
+
+    display->stats.video.images++;
+    display->stats.video.bytes += bytes;
+    display->stats.video.encode_time += encode_time;
+
+    pthread_mutex_unlock(&display->stats_lock);
+
+}
+
+void guac_display_stats_record_ops(guac_display* display, unsigned int nop_ops,
+        unsigned int copy_ops, unsigned int rect_ops, unsigned int img_ops) {
+
+    pthread_mutex_lock(&display->stats_lock);
+
+    display->stats.nop_ops += nop_ops;
+    display->stats.copy_ops += copy_ops;
+    display->stats.rect_ops += rect_ops;
+    display->stats.img_ops += img_ops;
+
+    pthread_mutex_unlock(&display->stats_lock);
+
+}
+
+void guac_display_stats_record_render_lag(guac_display* display, int render_lag) {
+    pthread_mutex_lock(&display->stats_lock);
+    display->stats.render_lag = render_lag;
+    pthread_mutex_unlock(&display->stats_lock);
+}
+
+void guac_display_stats_record_cache_lookup(guac_display* display, int hit) {
+
+    pthread_mutex_lock(&display->stats_lock);
+
+    if (hit)
+        display->stats.cache_hits++;
+    else
+        display->stats.cache_misses++;
+
+    pthread_mutex_unlock(&display->stats_lock);
+
+}
+
+void guac_display_stats_record_tile_cache(guac_display* display,
+        unsigned int hits, unsigned int stores) {
+
+    pthread_mutex_lock(&display->stats_lock);
+
+    display->stats.tile_cache_hits += hits;
+    display->stats.tile_cache_stores += stores;
+
+    pthread_mutex_unlock(&display->stats_lock);
+
+}
+
+void guac_display_stats_record_atlases(guac_display* display,
+        unsigned int atlases, unsigned int ops) {
+
+    pthread_mutex_lock(&display->stats_lock);
+
+    display->stats.atlas_images += atlases;
+    display->stats.atlas_ops += ops;
+
+    pthread_mutex_unlock(&display->stats_lock);
+
+}
+
+void guac_display_stats_record_layer_shrink(guac_display* display) {
+    pthread_mutex_lock(&display->stats_lock);
+    display->stats.layer_shrinks++;
+    pthread_mutex_unlock(&display->stats_lock);
+}
+
+void PFR_guac_display_stats_record_plan_arena(guac_display* display) {
+
+    guac_display_arena* arena = &display->plan_arena;
+
+    pthread_mutex_lock(&display->stats_lock);
+
+    display->stats.plan_memory_high_water = arena->high_water;
+    display->stats.plan_memory_allocations = arena->allocations;
+
+    pthread_mutex_unlock(&display->stats_lock);
+
+}
+
+/**
+ * Logs the statistics of the given encoder over the interval between the two
+ * given snapshots at the debug level.
+ *
+ * @param display
+ *     The guac_display that the statistics apply to.
+ *
+ * @param name
+ *     The human-readable name of the image format being logged.
+ *
+ * @param current
+ *     The current statistics of the encoder.
+ *
+ * @param previous
+ *     The statistics of the encoder at the start of the interval.
+ */
+static void guac_display_stats_log_encoder(guac_display* display,
+        const char* name, const guac_display_encoder_stats* current,
+        const guac_display_encoder_stats* previous) {
+
+    uint64_t images = current->images - previous->images;
+    if (!images)
+        return;
+
+    uint64_t bytes = current->bytes - previous->bytes;
+    uint64_t encode_time = current->encode_time - previous->encode_time;
+
+    guac_client_log(display->client, GUAC_LOG_DEBUG, "Display statistics "
+            "(%s): %" PRIu64 " images, %" PRIu64 " bytes, average %" PRIu64
+            " bytes and %" PRIu64 "us per image.", name, images, bytes,
+            bytes / images, encode_time / images);
+
+}
+
+void guac_display_stats_record_frame(guac_display* display) {
+
+    pthread_mutex_lock(&display->stats_lock);
+
+    guac_timestamp now = guac_timestamp_current();
+    guac_display_stats* current = &display->stats;
+    guac_display_stats* previous = &display->logged_stats;
+
+    current->frames++;
+
+    /* Log a summary of what has been sent since the last summary, if it's
+     * time to do so */
+    guac_timestamp elapsed = now - previous->timestamp;
+    if (elapsed >= GUAC_DISPLAY_STATS_LOG_INTERVAL) {
+
+        uint64_t frames = current->frames - previous->frames;
+
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Display statistics: "
+                "%" PRIu64 " frames in %ims (%" PRIu64 " fps), %" PRIu64
+                " copies, %" PRIu64 " rects, %" PRIu64 " images, %" PRIu64
+                " dropped operations, %ims render lag.", frames, (int) elapsed,
+                frames * 1000 / elapsed,
+                current->copy_ops - previous->copy_ops,
+                current->rect_ops - previous->rect_ops,
+                current->img_ops - previous->img_ops,
+                current->nop_ops - previous->nop_ops,
+                current->render_lag);
+
+        guac_display_stats_log_encoder(display, "PNG", &current->png, &previous->png);
+        guac_display_stats_log_encoder(display, "JPEG", &current->jpeg, &previous->jpeg);
+        guac_display_stats_log_encoder(display, "WebP", &current->webp, &previous->webp);
+        guac_display_stats_log_encoder(display, "video", &current->video, &previous->video);
+
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Display statistics "
+                "(image cache): %" PRIu64 " hits, %" PRIu64 " misses.",
+                current->cache_hits - previous->cache_hits,
+                current->cache_misses - previous->cache_misses);
+
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Display statistics "
+                "(tile cache): %" PRIu64 " draws replaced with copies, %"
+                PRIu64 " tiles stored.",
+                current->tile_cache_hits - previous->tile_cache_hits,
+                current->tile_cache_stores - previous->tile_cache_stores);
+
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Display statistics "
+                "(atlases): %" PRIu64 " atlas images containing %" PRIu64
+                " draws.",
+                current->atlas_images - previous->atlas_images,
+                current->atlas_ops - previous->atlas_ops);
+
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Display statistics "
+                "(planning): %" PRIu64 " bytes peak, %" PRIu64 " allocations.",
+                current->plan_memory_high_water,
+                current->plan_memory_allocations - previous->plan_memory_allocations);
+
+        if (frames)
+            guac_client_log(display->client, GUAC_LOG_DEBUG, "Display "
+                    "statistics (planning phases): average %" PRIu64 "us "
+                    "draft, %" PRIu64 "us rects, %" PRIu64 "us search, %"
+                    PRIu64 "us combine, %" PRIu64 "us commit per frame.",
+                    (current->draft_time - previous->draft_time) / frames,
+                    (current->rects_time - previous->rects_time) / frames,
+                    (current->search_time - previous->search_time) / frames,
+                    (current->combine_time - previous->combine_time) / frames,
+                    (current->commit_time - previous->commit_time) / frames);
+
+        *previous = *current;
+        previous->timestamp = now;
+
+    }
+
+    pthread_mutex_unlock(&display->stats_lock);
+
+}
+
+void guac_display_get_stats(guac_display* display, guac_display_stats* stats) {
+
+    pthread_mutex_lock(&display->stats_lock);
+    *stats = display->stats;
+    pthread_mutex_unlock(&display->stats_lock);
+
+    stats->timestamp = guac_timestamp_current();
+
+    guac_fifo_lock(&display->ops);
+    stats->queue_depth = (int) display->ops.item_count;
+    stats->queue_size = (int) display->ops.max_items;
+    guac_fifo_unlock(&display->ops);
+
+}
+
+int guac_display_get_client_stats(guac_client* client, guac_display_stats* stats) {
+
+    int result = 1;
+
+    /* The display cannot be freed while its statistics are being read */
+    pthread_mutex_lock(&client->__display_lock);
+
+    if (client->__display != NULL) {
+        guac_display_get_stats(client->__display, stats);
+        result = 0;
+    }
+
+    pthread_mutex_unlock(&client->__display_lock);
+    return result;
+
+}
@@ -0,0 +1,392 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "display-priv.h"
+#include "guacamole/client.h"
+#include "guacamole/display.h"
+#include "guacamole/mem.h"
+#include "guacamole/protocol.h"
+#include "guacamole/rect.h"
+#include "guacamole/socket.h"
+
+#include <cairo/cairo.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The width of the client-side buffer of a guac_display_tile_cache, in
+ * pixels.
+ */
+#define GUAC_DISPLAY_TILE_CACHE_WIDTH \
+    (GUAC_DISPLAY_TILE_CACHE_COLUMNS * GUAC_DISPLAY_CELL_SIZE)
+
+/**
+ * The height of the client-side buffer of a guac_display_tile_cache, in
+ * pixels.
+ */
+#define GUAC_DISPLAY_TILE_CACHE_HEIGHT \
+    (GUAC_DISPLAY_TILE_CACHE_ROWS * GUAC_DISPLAY_CELL_SIZE)
+
+/**
+ * Returns a pointer to the head pointer of the hash bucket that would contain
+ * the entry having the given hash.
+ *
+ * @param cache
+ *     The cache containing the bucket.
+ *
+ * @param hash
+ *     The hash of the entry.
+ *
+ * @return
+ *     A pointer to the head pointer of the relevant hash bucket.
+ */
+static guac_display_tile_cache_entry** guac_display_tile_cache_bucket(
+        guac_display_tile_cache* cache, uint64_t hash) {
+    return &cache->buckets[GUAC_DISPLAY_PLAN_OPERATION_HASH(hash)
+        & (GUAC_DISPLAY_TILE_CACHE_BUCKETS - 1)];
+}
+
+/**
+ * Removes the given entry from the least-recently-used list of the given
+ * cache.
+ *
+ * @param cache
+ *     The cache containing the entry.
+ *
+ * @param entry
+ *     The entry to remove.
+ */
+static void guac_display_tile_cache_unlink(guac_display_tile_cache* cache,
+        guac_display_tile_cache_entry* entry) {
+
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+
+    entry->newer = NULL;
+    entry->older = NULL;
+
+}
+
+/**
+ * Adds the given entry to the least-recently-used list of the given cache as
+ * the most recently used entry.
+ *
+ * @param cache
+ *     The cache that should contain the entry.
+ *
+ * @param entry
+ *     The entry to add. This entry MUST NOT already be within the list.
+ */
+static void guac_display_tile_cache_link_newest(guac_display_tile_cache* cache,
+        guac_display_tile_cache_entry* entry) {
+
+    entry->newer = NULL;
+    entry->older = cache->newest;
+
+    if (cache->newest != NULL)
+        cache->newest->newer = entry;
+    else
+        cache->oldest = entry;
+
+    cache->newest = entry;
+
+}
+
+/**
+ * Adds the given entry to the least-recently-used list of the given cache as
+ * the least recently used entry, such that it will be the next entry reused.
+ *
+ * @param cache
+ *     The cache that should contain the entry.
+ *
+ * @param entry
+ *     The entry to add. This entry MUST NOT already be within the list.
+ */
+static void guac_display_tile_cache_link_oldest(guac_display_tile_cache* cache,
+        guac_display_tile_cache_entry* entry) {
+
+    entry->older = NULL;
+    entry->newer = cache->oldest;
+
+    if (cache->oldest != NULL)
+        cache->oldest->older = entry;
+    else
+        cache->newest = entry;
+
+    cache->oldest = entry;
+
+}
+
+/**
+ * Removes the given entry from its hash bucket, if it is currently valid,
+ * marking that entry as unused.
+ *
+ * @param cache
+ *     The cache containing the entry.
+ *
+ * @param entry
+ *     The entry to invalidate.
+ */
+static void guac_display_tile_cache_remove(guac_display_tile_cache* cache,
+        guac_display_tile_cache_entry* entry) {
+
+    if (!entry->valid)
+        return;
+
+    guac_display_tile_cache_entry** current = guac_display_tile_cache_bucket(cache, entry->hash);
+    while (*current != entry)
+        current = &(*current)->next_in_bucket;
+
+    *current = entry->next_in_bucket;
+    entry->next_in_bucket = NULL;
+    entry->valid = 0;
+
+}
+
+/**
+ * Invalidates the given entry, making it the next entry to be reused.
+ *
+ * @param cache
+ *     The cache containing the entry.
+ *
+ * @param entry
+ *     The entry to invalidate.
+ */
+static void guac_display_tile_cache_invalidate(guac_display_tile_cache* cache,
+        guac_display_tile_cache_entry* entry) {
+    guac_display_tile_cache_remove(cache, entry);
+    guac_display_tile_cache_unlink(cache, entry);
+    guac_display_tile_cache_link_oldest(cache, entry);
+}
+
+void guac_display_tile_cache_init(guac_display_tile_cache* cache) {
+
+    memset(cache, 0, sizeof(*cache));
+
+    /* Assign each entry a fixed location within the buffer */
+    for (int i = 0; i < GUAC_DISPLAY_TILE_CACHE_SIZE; i++) {
+
+        guac_display_tile_cache_entry* entry = &cache->entries[i];
+        guac_rect_init(&entry->rect,
+                (i % GUAC_DISPLAY_TILE_CACHE_COLUMNS) * GUAC_DISPLAY_CELL_SIZE,
+                (i / GUAC_DISPLAY_TILE_CACHE_COLUMNS) * GUAC_DISPLAY_CELL_SIZE,
+                GUAC_DISPLAY_CELL_SIZE, GUAC_DISPLAY_CELL_SIZE);
+
+        guac_display_tile_cache_link_newest(cache, entry);
+
+    }
+
+    /* Frame zero is never planned, ensuring no entry appears to have been
+     * used within the current frame until some frame has actually begun */
+    cache->frame = 1;
+
+}
+
+void guac_display_tile_cache_destroy(guac_display* display) {
+
+    guac_display_tile_cache* cache = &display->tile_cache;
+
+    if (cache->buffer != NULL) {
+        guac_client_free_buffer(display->client, cache->buffer);
+        cache->buffer = NULL;
+    }
+
+    guac_mem_free(cache->data);
+
+}
+
+void LFW_guac_display_tile_cache_begin_frame(guac_display_tile_cache* cache) {
+
+    /* Any stores that were never sent do not exist on the client side */
+    for (int i = 0; i < cache->store_count; i++)
+        guac_display_tile_cache_invalidate(cache, cache->stores[i].entry);
+
+    cache->store_count = 0;
+    cache->frame++;
+
+}
+
+guac_display_tile_cache_entry* LFW_guac_display_tile_cache_find(
+        guac_display_tile_cache* cache, uint64_t hash,
+        const unsigned char* data, size_t stride) {
+
+    guac_display_tile_cache_entry* entry = *guac_display_tile_cache_bucket(cache, hash);
+    while (entry != NULL) {
+
+        if (entry->hash == hash) {
+
+            /* Verify that the match is not merely a hash collision */
+            const unsigned char* tile = cache->data
+                + entry->rect.top * cache->stride
+                + entry->rect.left * GUAC_DISPLAY_LAYER_RAW_BPP;
+
+            const unsigned char* current = data;
+            int y;
+            for (y = 0; y < GUAC_DISPLAY_CELL_SIZE; y++) {
+
+                if (memcmp(tile, current, GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_LAYER_RAW_BPP))
+                    break;
+
+                tile += cache->stride;
+                current += stride;
+
+            }
+
+            if (y == GUAC_DISPLAY_CELL_SIZE) {
+                entry->last_used = cache->frame;
+                guac_display_tile_cache_unlink(cache, entry);
+                guac_display_tile_cache_link_newest(cache, entry);
+                return entry;
+            }
+
+        }
+
+        entry = entry->next_in_bucket;
+
+    }
+
+    return NULL;
+
+}
+
+int PFR_LFW_guac_display_tile_cache_store(guac_display* display, uint64_t hash,
+        guac_display_layer* layer, const guac_rect* rect) {
+
+    guac_display_tile_cache* cache = &display->tile_cache;
+
+    /* Tiles used within the current frame must remain as they are until the
+     * frame is complete */
+    guac_display_tile_cache_entry* entry = cache->oldest;
+    if (entry->last_used == cache->frame)
+        return 0;
+
+    /* Allocate buffers only once actually needed */
+    if (cache->buffer == NULL) {
+
+        cache->stride = guac_mem_ckd_mul_or_die(GUAC_DISPLAY_TILE_CACHE_WIDTH,
+                GUAC_DISPLAY_LAYER_RAW_BPP);
+
+        cache->data = guac_mem_zalloc(cache->stride, GUAC_DISPLAY_TILE_CACHE_HEIGHT);
+        cache->buffer = guac_client_alloc_buffer(display->client);
+
+        guac_protocol_send_size(display->client->socket, cache->buffer,
+                GUAC_DISPLAY_TILE_CACHE_WIDTH, GUAC_DISPLAY_TILE_CACHE_HEIGHT);
+
+    }
+
+    /* Reuse least recently used entry */
+    guac_display_tile_cache_remove(cache, entry);
+    guac_display_tile_cache_unlink(cache, entry);
+    guac_display_tile_cache_link_newest(cache, entry);
+
+    guac_display_tile_cache_entry** bucket = guac_display_tile_cache_bucket(cache, hash);
+    entry->next_in_bucket = *bucket;
+    *bucket = entry;
+
+    entry->hash = hash;
+    entry->valid = 1;
+    entry->last_used = cache->frame;
+    entry->stored = cache->frame;
+
+    /* Maintain server-side copy of the tile */
+    const unsigned char* src = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->pending_frame, *rect);
+    unsigned char* dst = cache->data
+        + entry->rect.top * cache->stride
+        + entry->rect.left * GUAC_DISPLAY_LAYER_RAW_BPP;
+
+    for (int y = 0; y < GUAC_DISPLAY_CELL_SIZE; y++) {
+        memcpy(dst, src, GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_LAYER_RAW_BPP);
+        dst += cache->stride;
+        src += layer->pending_frame.buffer_stride;
+    }
+
+    /* Populate client-side copy once the frame has been sent */
+    guac_display_tile_cache_store* store = &cache->stores[cache->store_count++];
+    store->entry = entry;
+    store->layer = layer;
+    store->rect = *rect;
+
+    return 1;
+
+}
+
+void LFW_guac_display_tile_cache_forget_layer(guac_display_tile_cache* cache,
+        guac_display_layer* layer) {
+
+    int kept = 0;
+    for (int i = 0; i < cache->store_count; i++) {
+
+        guac_display_tile_cache_store* store = &cache->stores[i];
+        if (store->layer == layer)
+            guac_display_tile_cache_invalidate(cache, store->entry);
+        else
+            cache->stores[kept++] = *store;
+
+    }
+
+    cache->store_count = kept;
+
+}
+
+void guac_display_tile_cache_send_stores(guac_display* display) {
+
+    guac_display_tile_cache* cache = &display->tile_cache;
+    guac_socket* socket = display->client->socket;
+
+    for (int i = 0; i < cache->store_count; i++) {
+        guac_display_tile_cache_store* store = &cache->stores[i];
+        guac_protocol_send_copy(socket, store->layer->layer,
+                store->rect.left, store->rect.top,
+                GUAC_DISPLAY_CELL_SIZE, GUAC_DISPLAY_CELL_SIZE,
+                GUAC_COMP_OVER, cache->buffer,
+                store->entry->rect.left, store->entry->rect.top);
+    }
+
+    cache->store_count = 0;
+
+}
+
+void LFR_guac_display_tile_cache_dup(guac_display* display, guac_socket* socket) {
+
+    guac_display_tile_cache* cache = &display->tile_cache;
+    if (cache->buffer == NULL)
+        return;
+
+    guac_protocol_send_size(socket, cache->buffer,
+            GUAC_DISPLAY_TILE_CACHE_WIDTH, GUAC_DISPLAY_TILE_CACHE_HEIGHT);
+
+    cairo_surface_t* surface = cairo_image_surface_create_for_data(cache->data,
+            CAIRO_FORMAT_RGB24, GUAC_DISPLAY_TILE_CACHE_WIDTH,
+            GUAC_DISPLAY_TILE_CACHE_HEIGHT, cache->stride);
+
+    guac_display_stream_image(display, socket, GUAC_DISPLAY_IMAGE_FORMAT_PNG,
+            cache->buffer, 0, 0, surface, 0, 0);
+
+    cairo_surface_destroy(surface);
+
+}
@@ -0,0 +1,460 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "display-plan.h"
+#include "display-priv.h"
+#include "encoder-priv.h"
+#include "guacamole/client.h"
+#include "guacamole/layer.h"
+#include "guacamole/protocol.h"
+#include "guacamole/rect.h"
+#include "guacamole/socket.h"
+#include "guacamole/stream.h"
+#include "guacamole/user.h"
+
+#include <cairo/cairo.h>
+#include <pthread.h>
+#include <string.h>
+
+/**
+ * The state of an in-progress check for whether all users of a guac_client
+ * support a particular video mimetype.
+ */
+typedef struct guac_display_video_support {
+
+    /**
+     * The video mimetype being checked.
+     */
+    const char* mimetype;
+
+    /**
+     * Non-zero if every user checked thus far supports the mimetype, zero
+     * otherwise.
+     */
+    int supported;
+
+} guac_display_video_support;
+
+/**
+ * Callback which is invoked by guac_display_video_supported() for each user
+ * associated with a guac_client, clearing an overall support flag if that
+ * user does not support a particular video mimetype.
+ *
+ * @param user
+ *     The user to check for video support.
+ *
+ * @param data
+ *     Pointer to a guac_display_video_support structure.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_display_video_support_callback(guac_user* user, void* data) {
+
+    guac_display_video_support* support = (guac_display_video_support*) data;
+    if (!support->supported)
+        return NULL;
+
+    /* Users that did not declare any video support support nothing */
+    const char** mimetype = user->info.video_mimetypes;
+    support->supported = 0;
+    if (mimetype == NULL)
+        return NULL;
+
+    for (; *mimetype != NULL; mimetype++) {
+        if (strcmp(*mimetype, support->mimetype) == 0) {
+            support->supported = 1;
+            break;
+        }
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Returns the mimetype of video that may be streamed to all users of the
+ * given client, if any.
+ *
+ * @param client
+ *     The client whose users should be checked.
+ *
+ * @return
+ *     The mimetype of the video that the current encoder backend produces if
+ *     that mimetype is supported by every connected user, NULL otherwise.
+ */
+static const char* guac_display_video_supported(guac_client* client) {
+
+    guac_display_video_support support = {
+        .mimetype = guac_encoder_video_mimetype(),
+        .supported = 1
+    };
+
+    if (support.mimetype == NULL)
+        return NULL;
+
+    guac_client_foreach_user(client, guac_display_video_support_callback, &support);
+    return support.supported ? support.mimetype : NULL;
+
+}
+
+/**
+ * Returns whether the given inner rectangle is entirely contained within the
+ * given outer rectangle.
+ *
+ * @param outer
+ *     The rectangle that may contain the inner rectangle.
+ *
+ * @param inner
+ *     The rectangle to test.
+ *
+ * @return
+ *     Non-zero if the inner rectangle is entirely within the outer
+ *     rectangle, zero otherwise.
+ */
+static int guac_display_video_rect_contains(const guac_rect* outer,
+        const guac_rect* inner) {
+    return inner->left   >= outer->left
+        && inner->top    >= outer->top
+        && inner->right  <= outer->right
+        && inner->bottom <= outer->bottom;
+}
+
+/**
+ * Adjusts the given rectangle such that its width and height are even (as
+ * required by common video codecs), growing the rectangle where possible and
+ * shrinking it otherwise, without extending beyond the given bounds.
+ *
+ * @param rect
+ *     The rectangle to adjust.
+ *
+ * @param bounds
+ *     The rectangle that the adjusted rectangle must remain within.
+ */
+static void guac_display_video_rect_align(guac_rect* rect,
+        const guac_rect* bounds) {
+
+    if (guac_rect_width(rect) & 1) {
+        if (rect->right < bounds->right) rect->right++;
+        else if (rect->left > bounds->left) rect->left--;
+        else rect->right--;
+    }
+
+    if (guac_rect_height(rect) & 1) {
+        if (rect->bottom < bounds->bottom) rect->bottom++;
+        else if (rect->top > bounds->top) rect->top--;
+        else rect->bottom--;
+    }
+
+}
+
+/**
+ * Encodes the current contents of the region covered by the video stream of
+ * the given layer as the next frame of that stream.
+ *
+ * @param display_layer
+ *     The layer whose video stream should receive the next frame.
+ *
+ * @return
+ *     Zero if the frame was encoded and sent, non-zero otherwise.
+ */
+static int LFR_guac_display_layer_send_video_frame(guac_display_layer* display_layer) {
+
+    guac_display* display = display_layer->display;
+    guac_display_layer_video* video = &display_layer->video;
+
+    unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(display_layer->last_frame, video->rect);
+    cairo_surface_t* frame = cairo_image_surface_create_for_data(buffer,
+            CAIRO_FORMAT_RGB24, guac_rect_width(&video->rect),
+            guac_rect_height(&video->rect), display_layer->last_frame.buffer_stride);
+
+    uint64_t start = guac_display_stats_clock();
+    int bytes = guac_encoder_video_write(video->session, display->client->socket,
+            video->stream, frame, display->last_frame.timestamp);
+
+    if (bytes >= 0)
+        guac_display_stats_record_video(display, bytes,
+                guac_display_stats_clock() - start);
+
+    cairo_surface_destroy(frame);
+
+    video->frame = display->last_frame.timestamp;
+    return bytes < 0;
+
+}
+
+/**
+ * Ends the video stream of the given layer, disposing of the layer used to
+ * play the video. The video.lock of the layer must be held, or the
+ * display-level last_frame.lock must be held for writing.
+ *
+ * @param display_layer
+ *     The layer whose video stream should be ended.
+ *
+ * @param socket
+ *     The socket that should receive any remaining video data, or NULL if the
+ *     stream is being abandoned.
+ */
+static void guac_display_layer_end_video_stream(guac_display_layer* display_layer,
+        guac_socket* socket) {
+
+    guac_client* client = display_layer->display->client;
+    guac_display_layer_video* video = &display_layer->video;
+
+    guac_encoder_video_end(video->session, socket, video->stream);
+    video->session = NULL;
+
+    guac_protocol_send_end(client->socket, video->stream);
+    guac_client_free_stream(client, video->stream);
+
+    guac_protocol_send_dispose(client->socket, video->layer);
+    guac_client_free_layer(client, video->layer);
+
+}
+
+/**
+ * Ends the video stream of the given layer, bringing the region of the layer
+ * that was covered by the video back up to date with an image. The video.lock
+ * of the layer must be held.
+ *
+ * @param display_layer
+ *     The layer whose video stream should be ended.
+ */
+static void LFR_guac_display_layer_end_video(guac_display_layer* display_layer) {
+
+    guac_display* display = display_layer->display;
+    guac_socket* socket = display->client->socket;
+    guac_display_layer_video* video = &display_layer->video;
+    guac_rect* rect = &video->rect;
+
+    guac_display_layer_end_video_stream(display_layer, socket);
+
+    /* The underlying layer has not been updated while the video was playing
+     * over it */
+    unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(display_layer->last_frame, *rect);
+    cairo_surface_t* surface = cairo_image_surface_create_for_data(buffer,
+            CAIRO_FORMAT_RGB24, guac_rect_width(rect), guac_rect_height(rect),
+            display_layer->last_frame.buffer_stride);
+
+    guac_display_stream_image(display, socket, GUAC_DISPLAY_IMAGE_FORMAT_JPEG,
+            display_layer->layer, rect->left, rect->top, surface,
+            guac_display_quality_suggest(display), 0);
+
+    cairo_surface_destroy(surface);
+    LFR_guac_display_layer_refinement_mark(display_layer, rect,
+            display->last_frame.timestamp);
+
+    /* Likewise, the client-side copy of the previous frame is stale for this
+     * region, and copies from it must not see that stale data once the video
+     * is no longer being accounted for */
+    guac_protocol_send_copy(socket, display_layer->layer, rect->left, rect->top,
+            guac_rect_width(rect), guac_rect_height(rect), GUAC_COMP_SRC,
+            display_layer->last_frame_buffer, rect->left, rect->top);
+
+}
+
+/**
+ * Begins streaming the given region of the given layer as video. The
+ * video.lock of the layer must be held, and the layer must not already have
+ * an active video stream.
+ *
+ * @param display_layer
+ *     The layer to begin streaming video for.
+ *
+ * @param dirty
+ *     The region of the layer that should be streamed as video.
+ *
+ * @param mimetype
+ *     The mimetype of the video that will be streamed.
+ *
+ * @return
+ *     Zero if the video stream was started and its first frame sent, non-zero
+ *     otherwise.
+ */
+static int LFR_guac_display_layer_begin_video(guac_display_layer* display_layer,
+        const guac_rect* dirty, const char* mimetype) {
+
+    guac_display* display = display_layer->display;
+    guac_client* client = display->client;
+    guac_socket* socket = client->socket;
+    guac_display_layer_video* video = &display_layer->video;
+
+    guac_rect bounds;
+    guac_rect_init(&bounds, 0, 0, display_layer->last_frame.width,
+            display_layer->last_frame.height);
+
+    guac_rect rect = *dirty;
+    guac_display_video_rect_align(&rect, &bounds);
+    if (guac_rect_is_empty(&rect))
+        return 1;
+
+    int width = guac_rect_width(&rect);
+    int height = guac_rect_height(&rect);
+
+    void* session = guac_encoder_video_begin(width, height);
+    if (session == NULL)
+        return 1;
+
+    guac_stream* stream = guac_client_alloc_stream(client);
+    if (stream == NULL) {
+        guac_encoder_video_end(session, NULL, NULL);
+        return 1;
+    }
+
+    video->session = session;
+    video->rect = rect;
+    video->stream = stream;
+    video->layer = guac_client_alloc_layer(client);
+    video->users = client->connected_users;
+
+    /* Play the video on a new layer positioned over the region */
+    guac_protocol_send_size(socket, video->layer, width, height);
+    guac_protocol_send_move(socket, video->layer, display_layer->layer,
+            rect.left, rect.top, 0);
+    guac_protocol_send_video(socket, stream, video->layer, mimetype);
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Streaming %ix%i region at "
+            "(%i, %i) of layer %i as \"%s\" video.", width, height,
+            rect.left, rect.top, display_layer->layer->index, mimetype);
+
+    if (LFR_guac_display_layer_send_video_frame(display_layer)) {
+        LFR_guac_display_layer_end_video(display_layer);
+        return 1;
+    }
+
+    return 0;
+
+}
+
+int LFR_guac_display_layer_stream_video(guac_display_layer* display_layer,
+        const guac_rect* dirty, int framerate) {
+
+    guac_display* display = display_layer->display;
+    guac_client* client = display->client;
+    guac_display_layer_video* video = &display_layer->video;
+
+    int handled = 0;
+    pthread_mutex_lock(&video->lock);
+
+    /* Continue any existing video stream that covers the update */
+    if (video->session != NULL) {
+
+        if (!guac_rect_intersects(&video->rect, dirty))
+            goto done;
+
+        guac_rect bounds;
+        guac_rect_init(&bounds, 0, 0, display_layer->last_frame.width,
+                display_layer->last_frame.height);
+
+        /* Anything that the stream cannot represent ends the stream, with the
+         * update then sent as an image as usual */
+        if (!guac_display_video_rect_contains(&video->rect, dirty)
+                || !guac_display_video_rect_contains(&bounds, &video->rect)
+                || display_layer->last_frame.lossless
+                || video->users != client->connected_users) {
+            LFR_guac_display_layer_end_video(display_layer);
+            goto done;
+        }
+
+        /* Only one frame need be encoded no matter how many operations of the
+         * current frame fall within the video */
+        handled = 1;
+        if (video->frame != display->last_frame.timestamp
+                && LFR_guac_display_layer_send_video_frame(display_layer)) {
+            LFR_guac_display_layer_end_video(display_layer);
+            handled = 0;
+        }
+
+        goto done;
+
+    }
+
+    /* Otherwise, start a new video stream only for large, rapidly-changing,
+     * lossy regions of layers that need not consider transparency */
+    if (!display_layer->opaque || display_layer->last_frame.lossless
+            || framerate < GUAC_DISPLAY_VIDEO_FRAMERATE
+            || guac_rect_width(dirty) * guac_rect_height(dirty) < GUAC_DISPLAY_VIDEO_MIN_SIZE)
+        goto done;
+
+    const char* mimetype = guac_display_video_supported(client);
+    if (mimetype != NULL)
+        handled = !LFR_guac_display_layer_begin_video(display_layer, dirty, mimetype);
+
+done:
+    pthread_mutex_unlock(&video->lock);
+    return handled;
+
+}
+
+void LFW_guac_display_layer_abandon_video(guac_display_layer* display_layer) {
+    if (display_layer->video.session != NULL)
+        guac_display_layer_end_video_stream(display_layer, NULL);
+}
+
+int LFW_guac_display_layer_video_intersects(guac_display_layer* display_layer,
+        const guac_rect* rect) {
+    return display_layer->video.session != NULL
+        && guac_rect_intersects(&display_layer->video.rect, rect);
+}
+
+void LFW_guac_display_plan_rewrite_video_overlaps(guac_display_plan* plan) {
+
+    guac_display* display = plan->display;
+
+    /* Nothing to do unless at least one layer is streaming video */
+    guac_display_layer* current = display->last_frame.layers;
+    while (current != NULL && current->video.session == NULL)
+        current = current->last_frame.next;
+
+    if (current == NULL)
+        return;
+
+    guac_display_plan_operation* op = plan->ops;
+    for (int i = 0; i < plan->length; i++, op++) {
+
+        if (op->type != GUAC_DISPLAY_PLAN_OPERATION_COPY
+                && op->type != GUAC_DISPLAY_PLAN_OPERATION_RECT)
+            continue;
+
+        /* Copies and fills drawn beneath a video would be hidden, while
+         * copies from beneath a video would copy stale data. Sending the
+         * affected region as an image instead allows the worker threads to
+         * either fold the change into the video or end the video. */
+        int overlaps = LFW_guac_display_layer_video_intersects(op->layer, &op->dest);
+
+        if (!overlaps && op->type == GUAC_DISPLAY_PLAN_OPERATION_COPY) {
+            for (current = display->last_frame.layers; current != NULL;
+                    current = current->last_frame.next) {
+                if (current->last_frame_buffer == op->src.layer_rect.layer
+                        && LFW_guac_display_layer_video_intersects(current,
+                            &op->src.layer_rect.rect)) {
+                    overlaps = 1;
+                    break;
+                }
+            }
+        }
+
+        if (overlaps)
+            op->type = GUAC_DISPLAY_PLAN_OPERATION_IMG;
+
+    }
+
+}
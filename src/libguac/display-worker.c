@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include "config.h"
 #include "display-plan.h"
 #include "display-priv.h"
 #include "guacamole/client.h"
@@ -114,77 +115,36 @@ static void guac_display_layer_clear_non_opaque(guac_display_layer* display_laye
 
 }
 
-/**
- * Returns an appropriate quality between 0 and 100 for lossy encoding
- * depending on the current processing lag calculated for the given client.
- *
- * @param client
- *     The client for which the lossy quality is being calculated.
- *
- * @return
- *     A value between 0 and 100 inclusive which seems appropriate for the
- *     client based on lag measurements.
- */
-static int guac_display_suggest_quality(guac_client* client) {
-
-    int lag = guac_client_get_processing_lag(client);
-
-    /* Scale quality linearly from 90 to 30 as lag varies from 20ms to 80ms */
-    int quality = 90 - (lag - 20);
-
-    /* Do not exceed 90 for quality */
-    if (quality > 90)
-        return 90;
-
-    /* Do not go below 30 for quality */
-    if (quality < 30)
-        return 30;
-
-    return quality;
-
-}
-
-/**
- * Guesses whether a rectangle within a particular layer would be better
- * compressed as PNG or using a lossy format like JPEG. Positive values
- * indicate PNG is likely to be superior, while negative values indicate the
- * opposite.
- *
- * @param layer
- *     The layer containing the image data to check.
- *
- * @param rect
- *     The rect to check within the given layer.
- *
- * @return
- *     Positive values if PNG compression is likely to perform better than
- *     lossy alternatives, or negative values if PNG is likely to perform
- *     worse.
- */
-static int LFR_guac_display_layer_png_optimality(guac_display_layer* layer,
-        const guac_rect* rect) {
-
-    int x, y;
+int guac_display_png_optimality(const unsigned char* buffer, size_t stride,
+        int width, int height, int max_rows) {
 
     int num_same = 0;
     int num_different = 1;
 
-    /* Get buffer from layer */
-    size_t stride = layer->last_frame.buffer_stride;
-    const unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->last_frame, *rect);
-
     /* Image must be at least 1x1 */
-    if (rect->right - rect->left < 1 || rect->bottom - rect->top< 1)
+    if (width < 1 || height < 1)
         return 0;
 
-    /* For each row */
-    for (y = rect->top; y < rect->bottom; y++) {
+    /* Examine every row of images that are sufficiently short, and only an
+     * evenly-spaced subset of rows otherwise. As the estimate below is based
+     * on the ratio of identical to differing pixels, it is unaffected by the
+     * number of rows examined. */
+    int rows = height;
+    if (max_rows > 0 && rows > max_rows)
+        rows = max_rows;
+
+    /* For each examined row */
+    for (int i = 0; i < rows; i++) {
 
-        uint32_t* row = (uint32_t*) buffer;
+        /* Examine the center of each of the equally-sized bands that the
+         * image would be divided into for the given number of rows */
+        int y = (int) (((int64_t) (2 * i + 1) * height) / (2 * rows));
+
+        const uint32_t* row = (const uint32_t*) (buffer + y * stride);
         uint32_t last_pixel = *(row++) | 0xFF000000;
 
         /* For each pixel in current row */
-        for (x = rect->left + 1; x < rect->right; x++) {
+        for (int x = 1; x < width; x++) {
 
             /* Get next pixel */
             uint32_t current_pixel = *(row++) | 0xFF000000;
@@ -199,9 +159,6 @@ static int LFR_guac_display_layer_png_optimality(guac_display_layer* layer,
 
         }
 
-        /* Advance to next row */
-        buffer += stride;
-
     }
 
     /* Return rough approximation of optimality for PNG compression. As PNG
@@ -213,6 +170,40 @@ static int LFR_guac_display_layer_png_optimality(guac_display_layer* layer,
 
 }
 
+/**
+ * Guesses whether a rectangle within a particular layer would be better
+ * compressed as PNG or using a lossy format like JPEG. Positive values
+ * indicate PNG is likely to be superior, while negative values indicate the
+ * opposite. Only a sample of the rows of large rectangles is examined (see
+ * GUAC_DISPLAY_PNG_OPTIMALITY_SAMPLE_ROWS), such that the cost of the
+ * estimate remains a small fraction of the cost of actually encoding the
+ * rectangle.
+ *
+ * @param layer
+ *     The layer containing the image data to check.
+ *
+ * @param rect
+ *     The rect to check within the given layer.
+ *
+ * @return
+ *     Positive values if PNG compression is likely to perform better than
+ *     lossy alternatives, or negative values if PNG is likely to perform
+ *     worse.
+ */
+static int LFR_guac_display_layer_png_optimality(guac_display_layer* layer,
+        const guac_rect* rect) {
+
+    /* Image must be at least 1x1 */
+    if (rect->right - rect->left < 1 || rect->bottom - rect->top < 1)
+        return 0;
+
+    return guac_display_png_optimality(
+            GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->last_frame, *rect),
+            layer->last_frame.buffer_stride, guac_rect_width(rect),
+            guac_rect_height(rect), GUAC_DISPLAY_PNG_OPTIMALITY_SAMPLE_ROWS);
+
+}
+
 /**
  * Returns whether the given rectangle would be optimally encoded as JPEG
  * rather than PNG.
@@ -243,10 +234,11 @@ static int LFR_guac_display_layer_should_use_jpeg(guac_display_layer* layer,
     int rect_size = rect_width * rect_height;
 
     /* JPEG is preferred if:
-     * - frame rate is high enough
+     * - frame rate is high enough, or the connection is congested
      * - image size is large enough
      * - PNG is not more optimal based on image contents */
-    return framerate >= GUAC_DISPLAY_JPEG_FRAMERATE
+    return (framerate >= GUAC_DISPLAY_JPEG_FRAMERATE
+                || guac_display_quality_is_congested(layer->display))
         && rect_size > GUAC_DISPLAY_JPEG_MIN_BITMAP_SIZE
         && LFR_guac_display_layer_png_optimality(layer, rect) < 0;
 
@@ -278,13 +270,71 @@ static int LFR_guac_display_layer_should_use_webp(guac_display_layer* layer,
         return 0;
 
     /* WebP is preferred if:
-     * - frame rate is high enough
+     * - frame rate is high enough, or the connection is congested
      * - PNG is not more optimal based on image contents */
-    return framerate >= GUAC_DISPLAY_JPEG_FRAMERATE
+    return (framerate >= GUAC_DISPLAY_JPEG_FRAMERATE
+                || guac_display_quality_is_congested(layer->display))
         && LFR_guac_display_layer_png_optimality(layer, rect) < 0;
 
 }
 
+/**
+ * Sends the given surface as an image using the given image format, reusing
+ * the given stream if not NULL. If the stream is NULL, a stream is instead
+ * allocated and freed for this image alone.
+ *
+ * @param display
+ *     The guac_display sending the image.
+ *
+ * @param stream
+ *     The stream reserved by the current worker thread for sending images,
+ *     or NULL if no such stream could be reserved.
+ *
+ * @param context
+ *     The guac_encode_context owned by the current worker thread, whose
+ *     encoder objects and scratch buffers should be reused when encoding.
+ *
+ * @param format
+ *     The image format to use.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param surface
+ *     A Cairo image surface containing the image data to send.
+ *
+ * @param quality
+ *     The quality to use if the image format is lossy (JPEG or lossy WebP),
+ *     as an integer value ranging from 0 (lowest quality) to 100 (highest
+ *     quality).
+ *
+ * @param lossless
+ *     Zero to use lossy WebP compression, non-zero to use lossless WebP
+ *     compression. This value is ignored for other formats.
+ */
+static void guac_display_worker_send_image(guac_display* display,
+        guac_stream* stream, guac_encode_context* context,
+        guac_display_image_format format,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality, int lossless) {
+
+    guac_socket* socket = display->client->socket;
+
+    if (stream != NULL)
+        guac_display_send_image(display, socket, stream, format, layer, x, y,
+                surface, quality, lossless, context);
+    else
+        guac_display_stream_image(display, socket, format, layer, x, y,
+                surface, quality, lossless);
+
+}
+
 void* guac_display_worker_thread(void* data) {
 
     int framerate;
@@ -292,11 +342,31 @@ void* guac_display_worker_thread(void* data) {
 
     guac_display* display = (guac_display*) data;
     guac_client* client = display->client;
-    guac_socket* socket = client->socket;
+
+    /* Reserve a single stream for all images sent by this worker, such that
+     * each image need not acquire and release a stream index of its own
+     * (the stream is reused only once the previous image has ended) */
+    guac_stream* image_stream = guac_client_alloc_stream(client);
+
+    /* Encoder objects and scratch buffers are likewise reused by all images
+     * encoded by this worker */
+    guac_encode_context encode_context;
+    guac_encode_context_init(&encode_context);
 
     guac_display_plan_operation op;
     while (guac_fifo_dequeue_and_lock(&display->ops, &op)) {
 
+        /* Assist with planning the next frame if requested. Planning tasks
+         * are not part of any frame and must not affect tracking of frame
+         * boundaries, nor may they acquire the last_frame lock (the planning
+         * thread holds that lock for writing on our behalf). */
+        if (op.type == GUAC_DISPLAY_PLAN_OPERATION_TASK) {
+            guac_display_plan_task_join(op.src.task);
+            guac_fifo_unlock(&display->ops);
+            guac_display_plan_task_work(op.src.task);
+            continue;
+        }
+
         /* Notify any watchers of render_state that a frame is now in progress */
         guac_flag_set_and_lock(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_IN_PROGRESS);
         guac_flag_clear(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
@@ -345,27 +415,67 @@ void* guac_display_worker_thread(void* data) {
                  * with alpha transparency */
                 guac_display_layer_clear_non_opaque(display_layer, dirty);
 
-                /* Prefer WebP when reasonable */
-                if (LFR_guac_display_layer_should_use_webp(display_layer, dirty, framerate))
-                    guac_client_stream_webp(client, socket, GUAC_COMP_OVER, layer,
+                /* Rapidly-changing regions are best sent as video, if
+                 * possible */
+                if (LFR_guac_display_layer_stream_video(display_layer, dirty, framerate)) {
+                    /* Region has been sent as part of a video stream */
+                }
+
+                /* Otherwise, prefer WebP when reasonable */
+                else if (LFR_guac_display_layer_should_use_webp(display_layer, dirty, framerate)) {
+                    guac_display_worker_send_image(display, image_stream,
+                            &encode_context, GUAC_DISPLAY_IMAGE_FORMAT_WEBP, layer,
                             dirty->left, dirty->top, rect,
-                            guac_display_suggest_quality(client),
+                            guac_display_quality_suggest(display),
                             display_layer->last_frame.lossless ? 1 : 0);
+                    LFR_guac_display_layer_refinement_mark(display_layer, dirty,
+                            display_layer->last_frame.lossless ? 0 : display->last_frame.timestamp);
+                }
 
                 /* If not WebP, JPEG is the next best (lossy) choice */
-                else if (display_layer->opaque && LFR_guac_display_layer_should_use_jpeg(display_layer, dirty, framerate))
-                    guac_client_stream_jpeg(client, socket, GUAC_COMP_OVER, layer,
+                else if (display_layer->opaque && LFR_guac_display_layer_should_use_jpeg(display_layer, dirty, framerate)) {
+                    guac_display_worker_send_image(display, image_stream,
+                            &encode_context, GUAC_DISPLAY_IMAGE_FORMAT_JPEG, layer,
                             dirty->left, dirty->top, rect,
-                            guac_display_suggest_quality(client));
+                            guac_display_quality_suggest(display), 0);
+                    LFR_guac_display_layer_refinement_mark(display_layer, dirty,
+                            display->last_frame.timestamp);
+                }
 
                 /* Use PNG if no lossy formats are appropriate */
-                else
-                    guac_client_stream_png(client, socket, GUAC_COMP_OVER,
-                            layer, dirty->left, dirty->top, rect);
+                else {
+                    guac_display_worker_send_image(display, image_stream,
+                            &encode_context, GUAC_DISPLAY_IMAGE_FORMAT_PNG, layer,
+                            dirty->left, dirty->top, rect, 0, 0);
+                    LFR_guac_display_layer_refinement_mark(display_layer, dirty, 0);
+                }
 
                 cairo_surface_destroy(rect);
                 break;
 
+            /* Many small images packed together are sent as one image */
+            case GUAC_DISPLAY_PLAN_OPERATION_ATLAS:
+                LFR_guac_display_atlas_send(display, op.src.atlas,
+                        image_stream, &encode_context);
+                break;
+
+            /* Regions previously sent using lossy compression are resent
+             * losslessly once they have stopped changing */
+            case GUAC_DISPLAY_PLAN_OPERATION_REFINE: {
+
+                cairo_surface_t* refined = LFR_guac_display_layer_cairo_rect(display_layer, &op.dest);
+
+                guac_display_layer_clear_non_opaque(display_layer, &op.dest);
+                guac_display_worker_send_image(display, image_stream,
+                        &encode_context, GUAC_DISPLAY_IMAGE_FORMAT_PNG,
+                        display_layer->layer, op.dest.left, op.dest.top,
+                        refined, 0, 0);
+
+                cairo_surface_destroy(refined);
+                break;
+
+            }
+
             case GUAC_DISPLAY_PLAN_OPERATION_COPY:
             case GUAC_DISPLAY_PLAN_OPERATION_RECT:
                 guac_client_log(client, GUAC_LOG_DEBUG, "Operation type %i "
@@ -380,6 +490,10 @@ void* guac_display_worker_thread(void* data) {
                 /* Do nothing */
                 break;
 
+            /* Planning tasks are handled above, prior to acquiring any locks */
+            case GUAC_DISPLAY_PLAN_OPERATION_TASK:
+                break;
+
         }
 
         guac_fifo_lock(&display->ops);
@@ -390,9 +504,14 @@ void* guac_display_worker_thread(void* data) {
         if (!(display->ops.state.value & GUAC_FIFO_STATE_NONEMPTY) && display->active_workers == 1) {
 
             /* Update the mouse cursor if it's been changed since the
-             * last frame */
+             * last frame, referencing any buffer that has been set as the
+             * cursor directly rather than copying its contents */
             guac_display_layer* cursor = display->cursor_buffer;
-            if (!guac_rect_is_empty(&cursor->last_frame.dirty)) {
+            if (display->last_frame.cursor_source != NULL)
+                cursor = display->last_frame.cursor_source;
+
+            if (display->last_frame.cursor_source_modified
+                    || !guac_rect_is_empty(&cursor->last_frame.dirty)) {
                 guac_protocol_send_cursor(client->socket,
                         display->last_frame.cursor_hotspot_x,
                         display->last_frame.cursor_hotspot_y,
@@ -403,6 +522,8 @@ void* guac_display_worker_thread(void* data) {
 
             /* Allow connected clients to move forward with rendering */
             guac_client_end_multiple_frames(client, display->last_frame.frames);
+            guac_display_stats_record_frame(display);
+            guac_display_quality_update(display);
 
             /* While connected clients moves forward with rendering,
              * commit any changed contents to client-side backing buffer */
@@ -437,6 +558,11 @@ void* guac_display_worker_thread(void* data) {
 
             }
 
+            /* Populate the client-side tile cache with any newly-cached
+             * tiles (this must happen only after all graphical updates of
+             * the frame have been sent) */
+            guac_display_tile_cache_send_stores(display);
+
             /* This is now absolutely everything for the current frame,
              * and it's safe to flush any outstanding data */
             guac_socket_flush(client->socket);
@@ -464,6 +590,11 @@ void* guac_display_worker_thread(void* data) {
 
     }
 
+    if (image_stream != NULL)
+        guac_client_free_stream(client, image_stream);
+
+    guac_encode_context_free(&encode_context);
+
     return NULL;
 
 }
@@ -121,6 +121,9 @@ guac_display* guac_display_alloc(guac_client* client) {
     display->default_layer = guac_display_add_layer(display, (guac_layer*) GUAC_DEFAULT_LAYER, 1);
     display->cursor_buffer = guac_display_alloc_buffer(display, 0);
 
+    for (int i = 0; i < GUAC_DISPLAY_BUILTIN_CURSOR_COUNT; i++)
+        display->builtin_cursor_buffers[i] = guac_display_alloc_buffer(display, 0);
+
     /* Init operation FIFO used by worker threads */
     guac_fifo_init(&display->ops, display->ops_items,
             GUAC_DISPLAY_WORKER_FIFO_SIZE, sizeof(guac_display_plan_operation));
@@ -130,6 +133,24 @@ guac_display* guac_display_alloc(guac_client* client) {
     guac_flag_init(&display->render_state);
     guac_flag_set(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
 
+    /* Init statistics, starting the first logging interval now */
+    pthread_mutex_init(&display->stats_lock, NULL);
+    display->logged_stats.timestamp = guac_timestamp_current();
+
+    /* Start lossy encoding at the highest quality, lowering quality only once
+     * the connection is known to be unable to keep up */
+    pthread_mutex_init(&display->quality_lock, NULL);
+    display->quality.quality = GUAC_DISPLAY_QUALITY_MAX;
+    display->quality.last_update = guac_timestamp_current();
+
+    pthread_mutex_init(&display->snapshot_lock, NULL);
+    pthread_mutex_init(&display->refinement_lock, NULL);
+    pthread_mutex_init(&display->record_lock, NULL);
+
+    guac_display_arena_init(&display->plan_arena);
+    guac_display_image_cache_init(&display->image_cache);
+    guac_display_tile_cache_init(&display->tile_cache);
+
     int cpu_count = guac_display_nproc();
     if (cpu_count <= 0) {
         guac_client_log(client, GUAC_LOG_WARNING, "Number of available "
@@ -151,6 +172,11 @@ guac_display* guac_display_alloc(guac_client* client) {
     for (int i = 0; i < display->worker_thread_count; i++)
         pthread_create(&(display->worker_threads[i]), NULL, guac_display_worker_thread, display);
 
+    /* Allow statistics to be retrieved through the client */
+    pthread_mutex_lock(&client->__display_lock);
+    client->__display = display;
+    pthread_mutex_unlock(&client->__display_lock);
+
     return display;
 
 }
@@ -206,11 +232,25 @@ void guac_display_stop(guac_display* display) {
 
 void guac_display_free(guac_display* display) {
 
+    /* Statistics may no longer be retrieved through the client */
+    guac_client* client = display->client;
+    pthread_mutex_lock(&client->__display_lock);
+    if (client->__display == display)
+        client->__display = NULL;
+    pthread_mutex_unlock(&client->__display_lock);
+
     guac_display_stop(display);
 
     /* All locks, FIFOs, etc. are now unused and can be safely destroyed */
     guac_flag_destroy(&display->render_state);
     guac_fifo_destroy(&display->ops);
+    pthread_mutex_destroy(&display->stats_lock);
+    pthread_mutex_destroy(&display->quality_lock);
+    pthread_mutex_destroy(&display->snapshot_lock);
+    pthread_mutex_destroy(&display->refinement_lock);
+    pthread_mutex_destroy(&display->record_lock);
+    guac_display_arena_destroy(&display->plan_arena);
+    guac_display_image_cache_destroy(&display->image_cache);
     guac_rwlock_destroy(&display->last_frame.lock);
     guac_rwlock_destroy(&display->pending_frame.lock);
 
@@ -224,6 +264,10 @@ void guac_display_free(guac_display* display) {
     while (display->last_frame.layers != NULL)
         guac_display_free_layer(display->last_frame.layers);
 
+    guac_display_tile_cache_destroy(display);
+    guac_display_atlas_destroy(display);
+
+    guac_mem_free(display->record_indices);
     guac_mem_free(display);
 
 }
@@ -248,31 +292,21 @@ void guac_display_dup(guac_display* display, guac_socket* socket) {
 
         const guac_layer* layer = current->layer;
 
-        guac_rect layer_bounds;
-        guac_display_layer_get_bounds(current, &layer_bounds);
-
-        int width = guac_rect_width(&layer_bounds);
-        int height = guac_rect_height(&layer_bounds);
+        int width = current->last_frame.width;
+        int height = current->last_frame.height;
         guac_protocol_send_size(socket, layer, width, height);
 
         if (width > 0 && height > 0) {
 
-            /* Get Cairo surface covering layer bounds */
-            unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(current->last_frame, layer_bounds);
-            cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer,
-                        current->opaque ? CAIRO_FORMAT_RGB24 : CAIRO_FORMAT_ARGB32,
-                        width, height, current->last_frame.buffer_stride);
-
-            /* Send PNG for rect */
-            guac_client_stream_png(client, socket, GUAC_COMP_OVER, layer, 0, 0, rect);
+            /* Send the contents of the layer from its snapshot, encoding
+             * only those parts modified since the last user joined */
+            LFR_guac_display_layer_snapshot_dup(current, socket);
 
             /* Resync copy of previous frame */
             guac_protocol_send_copy(socket,
                     layer, 0, 0, width, height,
                     GUAC_COMP_OVER, current->last_frame_buffer, 0, 0);
 
-            cairo_surface_destroy(rect);
-
         }
 
         /* Resync any properties that are specific to non-buffer layers */
@@ -302,8 +336,13 @@ void guac_display_dup(guac_display* display, guac_socket* socket) {
 
     }
 
+    /* Synchronize any tiles retained for reuse by established users */
+    LFR_guac_display_tile_cache_dup(display, socket);
+
     /* Synchronize mouse cursor */
     guac_display_layer* cursor = display->cursor_buffer;
+    if (display->last_frame.cursor_source != NULL)
+        cursor = display->last_frame.cursor_source;
     guac_protocol_send_cursor(socket,
             display->last_frame.cursor_hotspot_x,
             display->last_frame.cursor_hotspot_y,
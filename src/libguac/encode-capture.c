@@ -0,0 +1,71 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "encode-capture.h"
+#include "guacamole/mem.h"
+
+#include <string.h>
+
+void guac_encode_capture_init(guac_encode_capture* capture, size_t max_length) {
+    capture->buffer = NULL;
+    capture->length = 0;
+    capture->size = 0;
+    capture->max_length = max_length;
+    capture->overflow = 0;
+}
+
+void guac_encode_capture_append(guac_encode_capture* capture,
+        const void* data, size_t length) {
+
+    /* Nothing to do if not capturing, or if capture has already failed */
+    if (capture == NULL || capture->overflow)
+        return;
+
+    size_t new_length = guac_mem_ckd_add_or_die(capture->length, length);
+
+    /* Abandon capture entirely if the data will not fit within the limit */
+    if (new_length > capture->max_length) {
+        guac_encode_capture_free(capture);
+        capture->overflow = 1;
+        return;
+    }
+
+    /* Grow buffer geometrically as needed */
+    if (new_length > capture->size) {
+
+        size_t new_size = capture->size ? capture->size : 4096;
+        while (new_size < new_length)
+            new_size = guac_mem_ckd_mul_or_die(new_size, 2);
+
+        capture->buffer = guac_mem_realloc_or_die(capture->buffer, new_size);
+        capture->size = new_size;
+
+    }
+
+    memcpy(capture->buffer + capture->length, data, length);
+    capture->length = new_length;
+
+}
+
+void guac_encode_capture_free(guac_encode_capture* capture) {
+    guac_mem_free(capture->buffer);
+    capture->length = 0;
+    capture->size = 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_ENCODE_CAPTURE_H
+#define GUAC_ENCODE_CAPTURE_H
+
+#include <stddef.h>
+
+/**
+ * A growable buffer which receives a copy of all encoded image data written by
+ * guac_png_write(), guac_jpeg_write(), or guac_webp_write(), such that the
+ * encoded image can later be sent again without being re-encoded.
+ */
+typedef struct guac_encode_capture {
+
+    /**
+     * The encoded image data captured thus far, or NULL if no data has yet
+     * been captured.
+     */
+    unsigned char* buffer;
+
+    /**
+     * The number of bytes of encoded image data within the buffer.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes currently allocated for the buffer.
+     */
+    size_t size;
+
+    /**
+     * The maximum number of bytes that may be captured. If more data than
+     * this is written, the captured data is discarded and the overflow flag
+     * is set.
+     */
+    size_t max_length;
+
+    /**
+     * Non-zero if more than max_length bytes were written, in which case the
+     * captured data is incomplete and has been discarded.
+     */
+    int overflow;
+
+} guac_encode_capture;
+
+/**
+ * Initializes the given guac_encode_capture such that it is empty and will
+ * capture no more than the given number of bytes.
+ *
+ * @param capture
+ *     The guac_encode_capture to initialize.
+ *
+ * @param max_length
+ *     The maximum number of bytes that may be captured.
+ */
+void guac_encode_capture_init(guac_encode_capture* capture, size_t max_length);
+
+/**
+ * Appends the given encoded image data to the given guac_encode_capture. If
+ * the given guac_encode_capture is NULL, this function has no effect.
+ *
+ * @param capture
+ *     The guac_encode_capture that should receive the data, or NULL if no
+ *     data is being captured.
+ *
+ * @param data
+ *     The encoded image data to append.
+ *
+ * @param length
+ *     The number of bytes of data to append.
+ */
+void guac_encode_capture_append(guac_encode_capture* capture,
+        const void* data, size_t length);
+
+/**
+ * Frees any data captured by the given guac_encode_capture. The
+ * guac_encode_capture itself is not freed.
+ *
+ * @param capture
+ *     The guac_encode_capture whose data should be freed.
+ */
+void guac_encode_capture_free(guac_encode_capture* capture);
+
+#endif
+
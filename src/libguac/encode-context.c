@@ -0,0 +1,92 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "encode-context.h"
+#include "guacamole/mem.h"
+
+#include <stdio.h>
+
+#include <jpeglib.h>
+
+void guac_encode_context_init(guac_encode_context* context) {
+
+    context->png_indices = NULL;
+    context->png_indices_size = 0;
+    context->png_rows = NULL;
+    context->png_rows_size = 0;
+
+    context->jpeg_created = 0;
+    context->jpeg_scanline = NULL;
+    context->jpeg_scanline_size = 0;
+
+    context->atlas_pixels = NULL;
+    context->atlas_pixels_size = 0;
+
+#ifdef ENABLE_WEBP
+    context->webp_quality = -1;
+    context->webp_lossless = 0;
+    context->webp_argb = NULL;
+    context->webp_argb_size = 0;
+#endif
+
+}
+
+void* guac_encode_context_reserve(void* buffer, size_t* size, size_t count,
+        size_t element_size) {
+
+    if (count > *size) {
+
+        /* Grow geometrically to avoid repeated reallocation as image sizes
+         * vary slightly from one image to the next */
+        size_t new_size = *size ? *size : 1024;
+        while (new_size < count)
+            new_size = guac_mem_ckd_mul_or_die(new_size, 2);
+
+        /* Existing contents need not be preserved, so the old buffer is
+         * freed rather than copied */
+        guac_mem_free(buffer);
+        buffer = guac_mem_realloc_or_die(NULL, new_size, element_size);
+        *size = new_size;
+
+    }
+
+    return buffer;
+
+}
+
+void guac_encode_context_free(guac_encode_context* context) {
+
+    guac_mem_free(context->png_indices);
+    guac_mem_free(context->png_rows);
+    guac_mem_free(context->jpeg_scanline);
+    guac_mem_free(context->atlas_pixels);
+
+    if (context->jpeg_created) {
+        jpeg_destroy_compress(&context->jpeg);
+        context->jpeg_created = 0;
+    }
+
+#ifdef ENABLE_WEBP
+    guac_mem_free(context->webp_argb);
+#endif
+
+}
+
@@ -0,0 +1,184 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_ENCODE_CONTEXT_H
+#define GUAC_ENCODE_CONTEXT_H
+
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <jpeglib.h>
+
+#ifdef ENABLE_WEBP
+#include <webp/encode.h>
+#endif
+
+/**
+ * Long-lived state shared by successive calls to guac_png_write(),
+ * guac_jpeg_write(), and guac_webp_write(), such that the encoder objects and
+ * scratch buffers needed to encode an image are created once and reused for
+ * each following image rather than being set up from scratch every time. A
+ * guac_encode_context may only be used by one thread at a time.
+ */
+typedef struct guac_encode_context {
+
+    /**
+     * Buffer receiving the palette index of each pixel of the image being
+     * encoded as an indexed PNG.
+     */
+    unsigned char* png_indices;
+
+    /**
+     * The number of bytes currently allocated for png_indices.
+     */
+    size_t png_indices_size;
+
+    /**
+     * The array of row pointers passed to libpng for the image being encoded
+     * as an indexed PNG.
+     */
+    unsigned char** png_rows;
+
+    /**
+     * The number of row pointers currently allocated for png_rows.
+     */
+    size_t png_rows_size;
+
+    /**
+     * The libjpeg compression object reused for each JPEG. This object is
+     * created only when the first JPEG is encoded, and is valid only if
+     * jpeg_created is non-zero.
+     */
+    struct jpeg_compress_struct jpeg;
+
+    /**
+     * The libjpeg error handler associated with the jpeg compression object.
+     */
+    struct jpeg_error_mgr jpeg_error;
+
+    /**
+     * Non-zero if the jpeg compression object has been created, zero
+     * otherwise.
+     */
+    int jpeg_created;
+
+    /**
+     * Buffer receiving each scanline converted to RGB for libjpeg, if the
+     * libjpeg in use cannot read the pixel format of Cairo directly.
+     */
+    unsigned char* jpeg_scanline;
+
+    /**
+     * The number of bytes currently allocated for jpeg_scanline.
+     */
+    size_t jpeg_scanline_size;
+
+    /**
+     * Buffer receiving the image data of each atlas composed prior to being
+     * encoded (see guac_display_atlas).
+     */
+    unsigned char* atlas_pixels;
+
+    /**
+     * The number of bytes currently allocated for atlas_pixels.
+     */
+    size_t atlas_pixels_size;
+
+#ifdef ENABLE_WEBP
+    /**
+     * The WebP configuration used for the most recent WebP, valid only if
+     * webp_quality is non-negative.
+     */
+    WebPConfig webp_config;
+
+    /**
+     * The quality of the WebP configuration stored in webp_config, or -1 if
+     * no configuration has yet been stored.
+     */
+    int webp_quality;
+
+    /**
+     * Whether the WebP configuration stored in webp_config is lossless.
+     */
+    int webp_lossless;
+
+    /**
+     * Buffer receiving the ARGB pixels of the image being encoded as a WebP.
+     */
+    uint32_t* webp_argb;
+
+    /**
+     * The number of pixels currently allocated for webp_argb.
+     */
+    size_t webp_argb_size;
+#endif
+
+} guac_encode_context;
+
+/**
+ * Initializes the given guac_encode_context such that it contains no
+ * encoder objects or buffers. Objects and buffers are created only as they
+ * are first needed.
+ *
+ * @param context
+ *     The guac_encode_context to initialize.
+ */
+void guac_encode_context_init(guac_encode_context* context);
+
+/**
+ * Ensures that the given buffer of a guac_encode_context has at least the
+ * given number of elements allocated, reallocating the buffer if necessary.
+ * Existing contents are not preserved if the buffer is reallocated.
+ *
+ * @param buffer
+ *     The buffer to grow, or NULL if no buffer has yet been allocated.
+ *
+ * @param size
+ *     A pointer to the number of elements currently allocated for the
+ *     buffer. This value is updated if the buffer is reallocated.
+ *
+ * @param count
+ *     The number of elements required.
+ *
+ * @param element_size
+ *     The size of each element, in bytes.
+ *
+ * @return
+ *     The buffer that should replace the given buffer, which is guaranteed
+ *     to have at least the requested number of elements. This may be the
+ *     given buffer.
+ */
+void* guac_encode_context_reserve(void* buffer, size_t* size, size_t count,
+        size_t element_size);
+
+/**
+ * Frees all encoder objects and buffers within the given guac_encode_context.
+ * The guac_encode_context itself is not freed, and may be used again only
+ * after being reinitialized with guac_encode_context_init().
+ *
+ * @param context
+ *     The guac_encode_context to free.
+ */
+void guac_encode_context_free(guac_encode_context* context);
+
+#endif
+
@@ -19,7 +19,9 @@
 
 #include "config.h"
 
+#include "encode-context.h"
 #include "encode-jpeg.h"
+#include "encoder-priv.h"
 #include "guacamole/mem.h"
 #include "guacamole/error.h"
 #include "guacamole/protocol.h"
@@ -62,6 +64,17 @@ typedef struct guac_jpeg_destination_mgr {
      */
     unsigned char buffer[GUAC_PROTOCOL_BLOB_MAX_LENGTH];
 
+    /**
+     * The total number of bytes of JPEG data sent thus far.
+     */
+    int bytes_written;
+
+    /**
+     * The guac_encode_capture that should receive a copy of all JPEG data
+     * sent, or NULL if JPEG data is not being captured.
+     */
+    guac_encode_capture* capture;
+
 } guac_jpeg_destination_mgr;
 
 /**
@@ -99,6 +112,8 @@ static boolean guac_jpeg_empty_output_buffer(j_compress_ptr cinfo) {
     /* Write blob */
     guac_protocol_send_blob(dest->socket, dest->stream,
             dest->buffer, sizeof(dest->buffer));
+    guac_encode_capture_append(dest->capture, dest->buffer, sizeof(dest->buffer));
+    dest->bytes_written += sizeof(dest->buffer);
 
     /* Update destination offset */
     dest->parent.next_output_byte = dest->buffer;
@@ -121,9 +136,12 @@ static void guac_jpeg_term_destination(j_compress_ptr cinfo) {
     guac_jpeg_destination_mgr* dest = (guac_jpeg_destination_mgr*) cinfo->dest;
 
     /* Write final blob, if any */
-    if (dest->parent.free_in_buffer != sizeof(dest->buffer))
-        guac_protocol_send_blob(dest->socket, dest->stream, dest->buffer,
-                sizeof(dest->buffer) - dest->parent.free_in_buffer);
+    if (dest->parent.free_in_buffer != sizeof(dest->buffer)) {
+        int length = sizeof(dest->buffer) - dest->parent.free_in_buffer;
+        guac_protocol_send_blob(dest->socket, dest->stream, dest->buffer, length);
+        guac_encode_capture_append(dest->capture, dest->buffer, length);
+        dest->bytes_written += length;
+    }
 
 }
 
@@ -139,9 +157,13 @@ static void guac_jpeg_term_destination(j_compress_ptr cinfo) {
  *
  * @param stream
  *     The stream over which JPEG-encoded blobs of image data should be sent.
+ *
+ * @param capture
+ *     A guac_encode_capture that should receive a copy of all JPEG data sent,
+ *     or NULL if JPEG data need not be captured.
  */
 static void jpeg_guac_dest(j_compress_ptr cinfo, guac_socket* socket,
-        guac_stream* stream) {
+        guac_stream* stream, guac_encode_capture* capture) {
 
     guac_jpeg_destination_mgr* dest;
 
@@ -162,21 +184,41 @@ static void jpeg_guac_dest(j_compress_ptr cinfo, guac_socket* socket,
     /* Store Guacamole-specific objects */
     dest->socket = socket;
     dest->stream = stream;
+    dest->bytes_written = 0;
+    dest->capture = capture;
 
 }
 
-int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface, int quality) {
-
-    /* Get image surface properties and data */
-    cairo_format_t format = cairo_image_surface_get_format(surface);
-
-    if (format != CAIRO_FORMAT_RGB24) {
-        guac_error = GUAC_STATUS_INTERNAL_ERROR;
-        guac_error_message =
-            "Invalid Cairo image format. Unable to create JPEG.";
-        return -1;
-    }
+/**
+ * Implementation of guac_jpeg_write() which encodes using libjpeg, reusing the
+ * compression object and scratch buffers of the given guac_encode_context.
+ *
+ * @param socket
+ *     The socket to send JPEG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as JPEG blobs.
+ *
+ * @param quality
+ *     JPEG image quality.
+ *
+ * @param capture
+ *     A guac_encode_capture that should receive a copy of all encoded image
+ *     data sent, or NULL if the encoded image data need not be captured.
+ *
+ * @param context
+ *     The guac_encode_context whose compression object and scratch buffers
+ *     should be used.
+ *
+ * @return
+ *     The number of bytes of encoded image data sent.
+ */
+static int guac_jpeg_context_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, guac_encode_capture* capture,
+        guac_encode_context* context) {
 
     int width = cairo_image_surface_get_width(surface);
     int height = cairo_image_surface_get_height(surface);
@@ -186,46 +228,53 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
-    /* Prepare JPEG bits */
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
+    /* Prepare JPEG bits, creating the compression object only once. A
+     * finished compression object may be reused for any number of images,
+     * retaining its destination and any tables that need not change. */
+    struct jpeg_compress_struct* cinfo = &context->jpeg;
+    if (!context->jpeg_created) {
+        cinfo->err = jpeg_std_error(&context->jpeg_error);
+        jpeg_create_compress(cinfo);
+        context->jpeg_created = 1;
+    }
 
     /* Write JPEG directly to given stream */
-    jpeg_guac_dest(&cinfo, socket, stream);
+    jpeg_guac_dest(cinfo, socket, stream, capture);
 
-    cinfo.image_width = width; /* image width and height, in pixels */
-    cinfo.image_height = height;
-    cinfo.arith_code = TRUE;
+    cinfo->image_width = width; /* image width and height, in pixels */
+    cinfo->image_height = height;
+    cinfo->arith_code = TRUE;
 
 #ifdef JCS_EXTENSIONS
     /* The Turbo JPEG extensions allows us to use the Cairo surface
      * (BGRx) as input without converting it */
-    cinfo.input_components = 4;
-    cinfo.in_color_space = JCS_EXT_BGRX;
+    cinfo->input_components = 4;
+    cinfo->in_color_space = JCS_EXT_BGRX;
 #else
     /* Standard JPEG supports RGB as input so we will have to convert
      * the contents of the Cairo surface from (BGRx) to RGB */
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_RGB;
 
-    /* Create a buffer for the write scan line which is where we will
+    /* Reserve a buffer for the write scan line which is where we will
      * put the converted pixels (BGRx -> RGB) */
-    unsigned char *scanline_data = guac_mem_zalloc(cinfo.image_width, cinfo.input_components);
+    unsigned char *scanline_data = context->jpeg_scanline =
+        guac_encode_context_reserve(context->jpeg_scanline,
+                &context->jpeg_scanline_size,
+                guac_mem_ckd_mul_or_die(width, cinfo->input_components), 1);
 #endif
 
     /* Initialize the JPEG compressor */
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
-    jpeg_start_compress(&cinfo, TRUE);
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+    jpeg_start_compress(cinfo, TRUE);
 
     JSAMPROW row_pointer[1]; /* pointer to a single row */
 
     /* Write scanlines to be used in JPEG compression */
-    while (cinfo.next_scanline < cinfo.image_height) {
+    while (cinfo->next_scanline < cinfo->image_height) {
 
-        int row_offset = stride * cinfo.next_scanline;
+        int row_offset = stride * cinfo->next_scanline;
 
 #ifdef JCS_EXTENSIONS
         /* In Turbo JPEG we can use the raw BGRx scanline  */
@@ -249,19 +298,50 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
         row_pointer[0] = scanline_data;
 #endif
 
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+        jpeg_write_scanlines(cinfo, row_pointer, 1);
     }
 
-#ifndef JCS_EXTENSIONS
-    guac_mem_free(scanline_data);
-#endif
+    /* Finalize compression, leaving the compression object ready for the
+     * next image */
+    jpeg_finish_compress(cinfo);
+    return ((guac_jpeg_destination_mgr*) cinfo->dest)->bytes_written;
+
+}
+
+int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, guac_encode_capture* capture,
+        guac_encode_context* context) {
+
+    /* Get image surface properties and data */
+    cairo_format_t format = cairo_image_surface_get_format(surface);
+
+    if (format != CAIRO_FORMAT_RGB24) {
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message =
+            "Invalid Cairo image format. Unable to create JPEG.";
+        return -1;
+    }
+
+    /* Prefer the encoder backend, if any, falling back to libjpeg */
+    int backend_bytes = guac_encoder_jpeg_write(socket, stream,
+            surface, quality, capture);
+    if (backend_bytes >= 0)
+        return backend_bytes;
+
+    /* Reuse the given context, if any */
+    if (context != NULL)
+        return guac_jpeg_context_write(socket, stream, surface, quality,
+                capture, context);
+
+    /* Otherwise, use a context for this image alone */
+    guac_encode_context local_context;
+    guac_encode_context_init(&local_context);
 
-    /* Finalize compression */
-    jpeg_finish_compress(&cinfo);
+    int bytes_written = guac_jpeg_context_write(socket, stream, surface,
+            quality, capture, &local_context);
 
-    /* Clean up */
-    jpeg_destroy_compress(&cinfo);
-    return 0;
+    guac_encode_context_free(&local_context);
+    return bytes_written;
 
 }
 
@@ -19,6 +19,7 @@
 
 #include "config.h"
 
+#include "encode-context.h"
 #include "encode-png.h"
 #include "guacamole/mem.h"
 #include "guacamole/error.h"
@@ -38,6 +39,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
+
+/**
+ * The zlib compression level used when writing 8-bit indexed PNGs. Levels
+ * beyond this cost several times the CPU for only marginally smaller output
+ * with the kind of flat, text-heavy content that fits within a palette.
+ */
+#define GUAC_PNG_PALETTE_COMPRESSION_LEVEL 2
 
 /**
  * Data describing the current write state of PNG data.
@@ -64,6 +73,17 @@ typedef struct guac_png_write_state {
      */
     int buffer_size;
 
+    /**
+     * The total number of bytes of PNG data sent thus far.
+     */
+    int bytes_written;
+
+    /**
+     * The guac_encode_capture that should receive a copy of all PNG data
+     * sent, or NULL if PNG data is not being captured.
+     */
+    guac_encode_capture* capture;
+
 } guac_png_write_state;
 
 /**
@@ -78,8 +98,11 @@ static void guac_png_flush_data(guac_png_write_state* write_state) {
     /* Send blob */
     guac_protocol_send_blob(write_state->socket, write_state->stream,
             write_state->buffer, write_state->buffer_size);
+    guac_encode_capture_append(write_state->capture,
+            write_state->buffer, write_state->buffer_size);
 
     /* Clear buffer */
+    write_state->bytes_written += write_state->buffer_size;
     write_state->buffer_size = 0;
 
 }
@@ -178,11 +201,16 @@ static cairo_status_t guac_png_cairo_write_handler(void* closure,
  * @param surface
  *     The Cairo surface to write to the given stream and socket as PNG blobs.
  *
+ * @param capture
+ *     A guac_encode_capture that should receive a copy of all encoded image
+ *     data sent, or NULL if the encoded image data need not be captured.
+ *
  * @return
- *     Zero if the encoding operation is successful, non-zero otherwise.
+ *     The number of bytes of encoded image data sent if the encoding
+ *     operation is successful, a negative value otherwise.
  */
 static int guac_png_cairo_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface) {
+        cairo_surface_t* surface, guac_encode_capture* capture) {
 
     guac_png_write_state write_state;
 
@@ -190,6 +218,8 @@ static int guac_png_cairo_write(guac_socket* socket, guac_stream* stream,
     write_state.socket = socket;
     write_state.stream = stream;
     write_state.buffer_size = 0;
+    write_state.bytes_written = 0;
+    write_state.capture = capture;
 
     /* Write surface as PNG */
     if (cairo_surface_write_to_png_stream(surface,
@@ -202,7 +232,7 @@ static int guac_png_cairo_write(guac_socket* socket, guac_stream* stream,
 
     /* Flush remaining PNG data */
     guac_png_flush_data(&write_state);
-    return 0;
+    return write_state.bytes_written;
 
 }
 
@@ -266,15 +296,40 @@ static void guac_png_flush_handler(png_structp png) {
 
 }
 
-int guac_png_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface) {
+/**
+ * Implementation of guac_png_write() which reuses the scratch buffers of the
+ * given guac_encode_context.
+ *
+ * @param socket
+ *     The socket to send PNG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as PNG blobs.
+ *
+ * @param capture
+ *     A guac_encode_capture that should receive a copy of all encoded image
+ *     data sent, or NULL if the encoded image data need not be captured.
+ *
+ * @param context
+ *     The guac_encode_context whose scratch buffers should be used.
+ *
+ * @return
+ *     The number of bytes of encoded image data sent if the encoding
+ *     operation is successful, a negative value otherwise.
+ */
+static int guac_png_context_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, guac_encode_capture* capture,
+        guac_encode_context* context) {
 
     png_structp png;
     png_infop png_info;
     png_byte** png_rows;
     int bpp;
 
-    int x, y;
+    int y;
 
     guac_png_write_state write_state;
 
@@ -282,22 +337,27 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     cairo_format_t format = cairo_image_surface_get_format(surface);
     int width = cairo_image_surface_get_width(surface);
     int height = cairo_image_surface_get_height(surface);
-    int stride = cairo_image_surface_get_stride(surface);
     unsigned char* data = cairo_image_surface_get_data(surface);
 
     /* If not RGB24, use Cairo PNG writer */
     if (format != CAIRO_FORMAT_RGB24 || data == NULL)
-        return guac_png_cairo_write(socket, stream, surface);
+        return guac_png_cairo_write(socket, stream, surface, capture);
 
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
-    /* Attempt to build palette */
-    guac_palette* palette = guac_palette_alloc(surface);
+    /* Attempt to build palette, mapping each pixel to its palette index
+     * within the same pass */
+    unsigned char* indices = context->png_indices =
+        guac_encode_context_reserve(context->png_indices,
+                &context->png_indices_size,
+                guac_mem_ckd_mul_or_die(width, height), 1);
+
+    guac_palette* palette = guac_palette_alloc_indexed(surface, indices);
 
     /* If not possible, resort to Cairo PNG writer */
     if (palette == NULL)
-        return guac_png_cairo_write(socket, stream, surface);
+        return guac_png_cairo_write(socket, stream, surface, capture);
 
     /* Calculate BPP from palette size */
     if      (palette->size <= 2)  bpp = 1;
@@ -323,6 +383,13 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
         return -1;
     }
 
+    /* Rows of the PNG point directly into the index buffer */
+    png_rows = context->png_rows = guac_encode_context_reserve(
+            context->png_rows, &context->png_rows_size, height,
+            sizeof(png_byte*));
+    for (y=0; y<height; y++)
+        png_rows[y] = indices + guac_mem_ckd_mul_or_die(y, width);
+
     /* Set error handler */
     if (setjmp(png_jmpbuf(png))) {
         png_destroy_write_struct(&png, &png_info);
@@ -336,35 +403,26 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     write_state.socket = socket;
     write_state.stream = stream;
     write_state.buffer_size = 0;
+    write_state.bytes_written = 0;
+    write_state.capture = capture;
 
     /* Set up writer */
     png_set_write_fn(png, &write_state,
             guac_png_write_handler,
             guac_png_flush_handler);
 
-    /* Copy data from surface into PNG data */
-    png_rows = (png_byte**) guac_mem_alloc(sizeof(png_byte*), height);
-    for (y=0; y<height; y++) {
-
-        /* Allocate new PNG row */
-        png_byte* row = (png_byte*) guac_mem_alloc(sizeof(png_byte), width);
-        png_rows[y] = row;
-
-        /* Copy data from surface into current row */
-        for (x=0; x<width; x++) {
-
-            /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
-
-            /* Set index in row */
-            row[x] = guac_palette_find(palette, color);
-
-        }
-
-        /* Advance to next data row */
-        data += stride;
+    /* Indexed data gains nothing from PNG's row filters, which are designed
+     * around continuous-tone samples */
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
 
-    }
+    /* Packed rows of 16 or fewer colors are dominated by horizontal runs of
+     * identical bytes, which run-length matching alone captures nearly as
+     * well as a full LZ77 search. Wider palettes (antialiased text, UI
+     * gradients) need real matching, but only at a fast level. */
+    if (bpp < 8)
+        png_set_compression_strategy(png, Z_RLE);
+    else
+        png_set_compression_level(png, GUAC_PNG_PALETTE_COMPRESSION_LEVEL);
 
     /* Write image info */
     png_set_IHDR(
@@ -392,14 +450,30 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     /* Free palette */
     guac_palette_free(palette);
 
-    /* Free PNG data */
-    for (y=0; y<height; y++)
-        guac_mem_free(png_rows[y]);
-    guac_mem_free(png_rows);
-
     /* Ensure all data is written */
     guac_png_flush_data(&write_state);
-    return 0;
+    return write_state.bytes_written;
+
+}
+
+int guac_png_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, guac_encode_capture* capture,
+        guac_encode_context* context) {
+
+    /* Reuse the given context, if any */
+    if (context != NULL)
+        return guac_png_context_write(socket, stream, surface, capture,
+                context);
+
+    /* Otherwise, use a context for this image alone */
+    guac_encode_context local_context;
+    guac_encode_context_init(&local_context);
+
+    int result = guac_png_context_write(socket, stream, surface, capture,
+            &local_context);
+
+    guac_encode_context_free(&local_context);
+    return result;
 
 }
 
@@ -19,8 +19,11 @@
 
 #include "config.h"
 
+#include "encode-context.h"
 #include "encode-webp.h"
+#include "encoder-priv.h"
 #include "guacamole/error.h"
+#include "guacamole/mem.h"
 #include "guacamole/protocol.h"
 #include "guacamole/stream.h"
 #include "palette.h"
@@ -59,6 +62,17 @@ typedef struct guac_webp_stream_writer {
      */
     int buffer_size;
 
+    /**
+     * The total number of bytes of WebP data sent thus far.
+     */
+    int bytes_written;
+
+    /**
+     * The guac_encode_capture that should receive a copy of all WebP data
+     * sent, or NULL if WebP data is not being captured.
+     */
+    guac_encode_capture* capture;
+
 } guac_webp_stream_writer;
 
 /**
@@ -73,8 +87,11 @@ static void guac_webp_flush_data(guac_webp_stream_writer* writer) {
     /* Send blob */
     guac_protocol_send_blob(writer->socket, writer->stream,
             writer->buffer, writer->buffer_size);
+    guac_encode_capture_append(writer->capture,
+            writer->buffer, writer->buffer_size);
 
     /* Clear buffer */
+    writer->bytes_written += writer->buffer_size;
     writer->buffer_size = 0;
 
 }
@@ -91,11 +108,17 @@ static void guac_webp_flush_data(guac_webp_stream_writer* writer) {
  *
  * @param stream
  *     The stream over which WebP-encoded blobs of image data should be sent.
+ *
+ * @param capture
+ *     A guac_encode_capture that should receive a copy of all WebP data sent,
+ *     or NULL if WebP data need not be captured.
  */
 static void guac_webp_stream_writer_init(guac_webp_stream_writer* writer,
-        guac_socket* socket, guac_stream* stream) {
+        guac_socket* socket, guac_stream* stream, guac_encode_capture* capture) {
 
     writer->buffer_size = 0;
+    writer->bytes_written = 0;
+    writer->capture = capture;
 
     /* Store Guacamole-specific objects */
     writer->socket = socket;
@@ -162,29 +185,30 @@ static int guac_webp_stream_write(const uint8_t* data, size_t data_size,
     return 1;
 }
 
-int guac_webp_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface, int quality, int lossless) {
-
-    guac_webp_stream_writer writer;
-    WebPPicture picture;
-    uint32_t* argb_output;
-
-    int x, y;
-
-    int width = cairo_image_surface_get_width(surface);
-    int height = cairo_image_surface_get_height(surface);
-    int stride = cairo_image_surface_get_stride(surface);
-    cairo_format_t format = cairo_image_surface_get_format(surface);
-    unsigned char* data = cairo_image_surface_get_data(surface);
-
-    if (format != CAIRO_FORMAT_RGB24 && format != CAIRO_FORMAT_ARGB32) {
-        guac_error = GUAC_STATUS_INTERNAL_ERROR;
-        guac_error_message = "Invalid Cairo image format. Unable to create WebP.";
-        return -1;
-    }
+/**
+ * Stores within the given guac_encode_context the WebP configuration for the
+ * given quality and lossless setting, if not already stored.
+ *
+ * @param context
+ *     The guac_encode_context that should contain the WebP configuration.
+ *
+ * @param quality
+ *     WebP image quality.
+ *
+ * @param lossless
+ *     Whether the WebP image should be encoded losslessly.
+ *
+ * @return
+ *     Zero if the WebP configuration within the given guac_encode_context is
+ *     valid for the given quality and lossless setting, non-zero if a valid
+ *     configuration could not be produced.
+ */
+static int guac_webp_context_configure(guac_encode_context* context,
+        int quality, int lossless) {
 
-    /* Flush pending operations to surface */
-    cairo_surface_flush(surface);
+    /* Reuse the configuration of the previous WebP if settings match */
+    if (context->webp_quality == quality && context->webp_lossless == lossless)
+        return 0;
 
     /* Configure WebP compression bits */
     WebPConfig config;
@@ -202,6 +226,66 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
         return -1;
     }
 
+    context->webp_config = config;
+    context->webp_quality = quality;
+    context->webp_lossless = lossless;
+    return 0;
+
+}
+
+/**
+ * Implementation of guac_webp_write() which encodes using libwebp, reusing the
+ * configuration and scratch buffers of the given guac_encode_context.
+ *
+ * @param socket
+ *     The socket to send WebP blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as WebP blobs.
+ *
+ * @param quality
+ *     WebP image quality.
+ *
+ * @param lossless
+ *     Whether the WebP image should be encoded losslessly.
+ *
+ * @param capture
+ *     A guac_encode_capture that should receive a copy of all encoded image
+ *     data sent, or NULL if the encoded image data need not be captured.
+ *
+ * @param context
+ *     The guac_encode_context whose configuration and scratch buffers should
+ *     be used.
+ *
+ * @return
+ *     The number of bytes of encoded image data sent if the encoding
+ *     operation is successful, a negative value otherwise.
+ */
+static int guac_webp_context_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, int lossless,
+        guac_encode_capture* capture, guac_encode_context* context) {
+
+    guac_webp_stream_writer writer;
+    WebPPicture picture;
+    uint32_t* argb_output;
+
+    int x, y;
+
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    cairo_format_t format = cairo_image_surface_get_format(surface);
+    unsigned char* data = cairo_image_surface_get_data(surface);
+
+    /* Flush pending operations to surface */
+    cairo_surface_flush(surface);
+
+    if (guac_webp_context_configure(context, quality, lossless))
+        return -1;
+
     /* Set up WebP picture */
     if (!WebPPictureInit(&picture)) {
         return -1;
@@ -210,13 +294,18 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
     picture.width = width;
     picture.height = height;
 
-    /* Allocate and init writer */
-    if (!WebPPictureAlloc(&picture)) {
-        return -1;
-    }
+    /* Point picture at the ARGB buffer of the context rather than at memory
+     * allocated by libwebp. As libwebp does not own this buffer, it is
+     * untouched by WebPPictureFree(). */
+    picture.argb = context->webp_argb = guac_encode_context_reserve(
+            context->webp_argb, &context->webp_argb_size,
+            guac_mem_ckd_mul_or_die(width, height), sizeof(uint32_t));
+    picture.argb_stride = width;
+
+    /* Init writer */
     picture.writer = guac_webp_stream_write;
     picture.custom_ptr = &writer;
-    guac_webp_stream_writer_init(&writer, socket, stream);
+    guac_webp_stream_writer_init(&writer, socket, stream, capture);
 
     /* Copy image data into WebP picture */
     argb_output = picture.argb;
@@ -250,14 +339,49 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
     }
 
     /* Encode image */
-    const int result = WebPEncode(&config, &picture) ? 0 : -1;
+    const int result = WebPEncode(&context->webp_config, &picture) ? 0 : -1;
 
-    /* Free picture */
+    /* Free any buffers allocated by libwebp during encoding */
     WebPPictureFree(&picture);
 
     /* Ensure all data is written */
     guac_webp_flush_data(&writer);
 
+    return result ? result : writer.bytes_written;
+
+}
+
+int guac_webp_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, int lossless,
+        guac_encode_capture* capture, guac_encode_context* context) {
+
+    cairo_format_t format = cairo_image_surface_get_format(surface);
+
+    if (format != CAIRO_FORMAT_RGB24 && format != CAIRO_FORMAT_ARGB32) {
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message = "Invalid Cairo image format. Unable to create WebP.";
+        return -1;
+    }
+
+    /* Prefer the encoder backend, if any, falling back to libwebp */
+    int backend_bytes = guac_encoder_webp_write(socket, stream,
+            surface, quality, lossless, capture);
+    if (backend_bytes >= 0)
+        return backend_bytes;
+
+    /* Reuse the given context, if any */
+    if (context != NULL)
+        return guac_webp_context_write(socket, stream, surface, quality,
+                lossless, capture, context);
+
+    /* Otherwise, use a context for this image alone */
+    guac_encode_context local_context;
+    guac_encode_context_init(&local_context);
+
+    int result = guac_webp_context_write(socket, stream, surface, quality,
+            lossless, capture, &local_context);
+
+    guac_encode_context_free(&local_context);
     return result;
 
 }
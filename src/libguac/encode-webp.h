@@ -21,6 +21,8 @@
 #define GUAC_ENCODE_WEBP_H
 
 #include "config.h"
+#include "encode-capture.h"
+#include "encode-context.h"
 
 #include "guacamole/socket.h"
 #include "guacamole/stream.h"
@@ -49,10 +51,21 @@
  * @param lossless
  *     Zero for a lossy image, non-zero for lossless.
  *
+ * @param capture
+ *     A guac_encode_capture that should receive a copy of all encoded image
+ *     data sent, or NULL if the encoded image data need not be captured.
+ *
+ * @param context
+ *     The guac_encode_context whose encoder objects and scratch buffers
+ *     should be reused, or NULL if the image should be encoded using a
+ *     temporary context that is freed once encoding is complete.
+ *
  * @return
- *     Zero if the encoding operation is successful, non-zero otherwise.
+ *     The number of bytes of encoded image data sent if the encoding
+ *     operation is successful, a negative value otherwise.
  */
 int guac_webp_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface, int quality, int lossless);
+        cairo_surface_t* surface, int quality, int lossless,
+        guac_encode_capture* capture, guac_encode_context* context);
 
 #endif
@@ -0,0 +1,183 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_ENCODER_PRIV_H
+#define GUAC_ENCODER_PRIV_H
+
+#include "config.h"
+#include "encode-capture.h"
+
+#include "guacamole/socket.h"
+#include "guacamole/stream.h"
+#include "guacamole/timestamp-types.h"
+
+#include <cairo/cairo.h>
+
+/**
+ * The maximum number of bytes of encoded image data that an encoder backend
+ * may produce for a single image. As backend output must be held in full
+ * until the backend reports success (so that a failure can fall back to
+ * software without having sent partial data), output beyond this length is
+ * treated as a backend failure.
+ */
+#define GUAC_ENCODER_MAX_LENGTH 8388608
+
+/**
+ * Encodes the given surface as a JPEG using the currently-loaded encoder
+ * backend, sending the resulting data over the given stream and socket as
+ * blobs. If no backend is loaded, the backend does not support JPEG, or the
+ * backend fails, nothing is sent and the caller should encode the surface in
+ * software instead.
+ *
+ * @param socket
+ *     The socket to send JPEG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as JPEG blobs.
+ *
+ * @param quality
+ *     JPEG image quality.
+ *
+ * @param capture
+ *     A guac_encode_capture that should receive a copy of all encoded image
+ *     data sent, or NULL if the encoded image data need not be captured.
+ *
+ * @return
+ *     The number of bytes of encoded image data sent if the backend encoded
+ *     the surface, a negative value if the surface must instead be encoded
+ *     in software.
+ */
+int guac_encoder_jpeg_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, guac_encode_capture* capture);
+
+/**
+ * Encodes the given surface as a WebP using the currently-loaded encoder
+ * backend, sending the resulting data over the given stream and socket as
+ * blobs. If no backend is loaded, the backend does not support WebP, or the
+ * backend fails, nothing is sent and the caller should encode the surface in
+ * software instead.
+ *
+ * @param socket
+ *     The socket to send WebP blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as WebP blobs.
+ *
+ * @param quality
+ *     WebP image quality.
+ *
+ * @param lossless
+ *     Whether the WebP image should be encoded losslessly.
+ *
+ * @param capture
+ *     A guac_encode_capture that should receive a copy of all encoded image
+ *     data sent, or NULL if the encoded image data need not be captured.
+ *
+ * @return
+ *     The number of bytes of encoded image data sent if the backend encoded
+ *     the surface, a negative value if the surface must instead be encoded
+ *     in software.
+ */
+int guac_encoder_webp_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, int lossless,
+        guac_encode_capture* capture);
+
+/**
+ * Returns the mimetype of the video streams that the currently-loaded encoder
+ * backend can produce.
+ *
+ * @return
+ *     The mimetype of the video streams produced by the current encoder
+ *     backend, or NULL if no backend is loaded or the backend does not
+ *     support video.
+ */
+const char* guac_encoder_video_mimetype(void);
+
+/**
+ * Begins a new video stream using the currently-loaded encoder backend. The
+ * returned session must eventually be ended with guac_encoder_video_end().
+ *
+ * @param width
+ *     The width of each frame of the video, in pixels. This must be even.
+ *
+ * @param height
+ *     The height of each frame of the video, in pixels. This must be even.
+ *
+ * @return
+ *     A new video session, or NULL if no backend capable of encoding video
+ *     is loaded or the backend refused to encode video of the given size.
+ */
+void* guac_encoder_video_begin(int width, int height);
+
+/**
+ * Encodes the given surface as the next frame of the given video session,
+ * sending the resulting data over the given stream and socket as blobs. If
+ * the backend fails, nothing is sent.
+ *
+ * @param session
+ *     The video session returned by guac_encoder_video_begin().
+ *
+ * @param socket
+ *     The socket to send video blobs over.
+ *
+ * @param stream
+ *     The video stream to associate with each blob.
+ *
+ * @param frame
+ *     The Cairo surface containing the frame to encode, which must be in
+ *     CAIRO_FORMAT_RGB24 and have the dimensions given when the session
+ *     began.
+ *
+ * @param timestamp
+ *     The time that the frame was rendered.
+ *
+ * @return
+ *     The number of bytes of encoded video data sent if the frame was
+ *     encoded, a negative value otherwise.
+ */
+int guac_encoder_video_write(void* session, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* frame, guac_timestamp timestamp);
+
+/**
+ * Ends the given video session, sending any remaining encoded data over the
+ * given stream and socket as blobs and freeing the session.
+ *
+ * @param session
+ *     The video session returned by guac_encoder_video_begin().
+ *
+ * @param socket
+ *     The socket to send any remaining video blobs over, or NULL if the
+ *     stream is being abandoned and no further data should be sent.
+ *
+ * @param stream
+ *     The video stream to associate with each blob, or NULL if socket is
+ *     NULL.
+ */
+void guac_encoder_video_end(void* session, guac_socket* socket,
+        guac_stream* stream);
+
+#endif
+
@@ -0,0 +1,283 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "encode-capture.h"
+#include "encoder-priv.h"
+#include "guacamole/encoder.h"
+#include "guacamole/error.h"
+#include "guacamole/mem.h"
+#include "guacamole/plugin-constants.h"
+#include "guacamole/protocol.h"
+#include "guacamole/socket.h"
+#include "guacamole/stream.h"
+#include "guacamole/string.h"
+
+#include <cairo/cairo.h>
+#include <dlfcn.h>
+
+#include <stddef.h>
+
+/**
+ * The currently-loaded encoder backend, or NULL if all encoding is performed
+ * in software.
+ */
+static guac_encoder* guac_encoder_current = NULL;
+
+int guac_encoder_load(const char* name) {
+
+    char library[GUAC_ENCODER_LIBRARY_LIMIT] =
+        GUAC_ENCODER_LIBRARY_PREFIX;
+
+    /* Type-pun for the sake of dlsym() - cannot typecast a void* to a function
+     * pointer otherwise */
+    union {
+        guac_encoder_init_handler* init;
+        void* obj;
+    } alias;
+
+    /* Add backend name and .so suffix to library filename */
+    guac_strlcat(library, name, sizeof(library));
+    if (guac_strlcat(library, GUAC_ENCODER_LIBRARY_SUFFIX,
+                sizeof(library)) >= sizeof(library)) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Encoder backend name is too long";
+        return -1;
+    }
+
+    void* handle = dlopen(library, RTLD_NOW);
+    if (!handle) {
+        guac_error = GUAC_STATUS_NOT_FOUND;
+        guac_error_message = dlerror();
+        return -1;
+    }
+
+    dlerror(); /* Clear errors */
+
+    /* Get init function */
+    alias.obj = dlsym(handle, "guac_encoder_init");
+
+    /* Fail if cannot find guac_encoder_init */
+    if (dlerror() != NULL) {
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message = "Encoder backend does not define "
+            "guac_encoder_init()";
+        dlclose(handle);
+        return -1;
+    }
+
+    guac_encoder* backend = guac_mem_zalloc(sizeof(guac_encoder));
+    backend->__plugin_handle = handle;
+
+    /* Allow the backend to refuse if its hardware is unavailable */
+    if (alias.init(backend)) {
+        guac_mem_free(backend);
+        dlclose(handle);
+        guac_error = GUAC_STATUS_NOT_SUPPORTED;
+        guac_error_message = "Encoder backend could not be initialized";
+        return -1;
+    }
+
+    guac_encoder_unload();
+    guac_encoder_current = backend;
+    return 0;
+
+}
+
+void guac_encoder_unload(void) {
+
+    guac_encoder* backend = guac_encoder_current;
+    if (backend == NULL)
+        return;
+
+    guac_encoder_current = NULL;
+
+    if (backend->free_handler)
+        backend->free_handler(backend);
+
+    dlclose(backend->__plugin_handle);
+    guac_mem_free(backend);
+
+}
+
+/**
+ * Write handler provided to encoder backends which appends all encoded data
+ * to a guac_encode_capture.
+ *
+ * @param data
+ *     The guac_encode_capture that should receive the encoded data.
+ *
+ * @param buffer
+ *     The encoded image data to append.
+ *
+ * @param length
+ *     The number of bytes of encoded image data within the buffer.
+ */
+static void guac_encoder_capture_handler(void* data,
+        const void* buffer, size_t length) {
+    guac_encode_capture_append((guac_encode_capture*) data, buffer, length);
+}
+
+/**
+ * Sends the given fully-encoded image data over the given stream and socket
+ * as blobs, copying that data to the given capture if not NULL.
+ *
+ * @param socket
+ *     The socket to send blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param encoded
+ *     The encoded image data produced by the encoder backend.
+ *
+ * @param capture
+ *     A guac_encode_capture that should receive a copy of all encoded image
+ *     data sent, or NULL if the encoded image data need not be captured.
+ *
+ * @return
+ *     The number of bytes of encoded image data sent.
+ */
+static int guac_encoder_send(guac_socket* socket, guac_stream* stream,
+        guac_encode_capture* encoded, guac_encode_capture* capture) {
+
+    guac_protocol_send_blobs(socket, stream, encoded->buffer, encoded->length);
+    guac_encode_capture_append(capture, encoded->buffer, encoded->length);
+    return encoded->length;
+
+}
+
+int guac_encoder_jpeg_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, guac_encode_capture* capture) {
+
+    guac_encoder* backend = guac_encoder_current;
+    if (backend == NULL || backend->jpeg_handler == NULL)
+        return -1;
+
+    guac_encode_capture encoded;
+    guac_encode_capture_init(&encoded, GUAC_ENCODER_MAX_LENGTH);
+
+    /* Flush pending operations to surface */
+    cairo_surface_flush(surface);
+
+    int result = -1;
+    if (!backend->jpeg_handler(backend, surface, quality,
+                guac_encoder_capture_handler, &encoded)
+            && !encoded.overflow && encoded.length > 0)
+        result = guac_encoder_send(socket, stream, &encoded, capture);
+
+    guac_encode_capture_free(&encoded);
+    return result;
+
+}
+
+int guac_encoder_webp_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, int lossless,
+        guac_encode_capture* capture) {
+
+    guac_encoder* backend = guac_encoder_current;
+    if (backend == NULL || backend->webp_handler == NULL)
+        return -1;
+
+    guac_encode_capture encoded;
+    guac_encode_capture_init(&encoded, GUAC_ENCODER_MAX_LENGTH);
+
+    /* Flush pending operations to surface */
+    cairo_surface_flush(surface);
+
+    int result = -1;
+    if (!backend->webp_handler(backend, surface, quality, lossless,
+                guac_encoder_capture_handler, &encoded)
+            && !encoded.overflow && encoded.length > 0)
+        result = guac_encoder_send(socket, stream, &encoded, capture);
+
+    guac_encode_capture_free(&encoded);
+    return result;
+
+}
+
+const char* guac_encoder_video_mimetype(void) {
+
+    guac_encoder* backend = guac_encoder_current;
+    if (backend == NULL || backend->video_begin_handler == NULL)
+        return NULL;
+
+    return backend->video_mimetype;
+
+}
+
+void* guac_encoder_video_begin(int width, int height) {
+
+    guac_encoder* backend = guac_encoder_current;
+    if (backend == NULL || backend->video_begin_handler == NULL)
+        return NULL;
+
+    return backend->video_begin_handler(backend, width, height);
+
+}
+
+int guac_encoder_video_write(void* session, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* frame, guac_timestamp timestamp) {
+
+    guac_encoder* backend = guac_encoder_current;
+
+    guac_encode_capture encoded;
+    guac_encode_capture_init(&encoded, GUAC_ENCODER_MAX_LENGTH);
+
+    /* Flush pending operations to surface */
+    cairo_surface_flush(frame);
+
+    /* NOTE: Unlike still images, a frame may legitimately encode to nothing
+     * at all (the backend may be buffering frames internally) */
+    int result = -1;
+    if (!backend->video_frame_handler(backend, session, frame, timestamp,
+                guac_encoder_capture_handler, &encoded)
+            && !encoded.overflow)
+        result = guac_encoder_send(socket, stream, &encoded, NULL);
+
+    guac_encode_capture_free(&encoded);
+    return result;
+
+}
+
+void guac_encoder_video_end(void* session, guac_socket* socket,
+        guac_stream* stream) {
+
+    guac_encoder* backend = guac_encoder_current;
+
+    /* Abandon the stream entirely if there is nowhere to send data */
+    if (socket == NULL) {
+        backend->video_end_handler(backend, session, NULL, NULL);
+        return;
+    }
+
+    guac_encode_capture encoded;
+    guac_encode_capture_init(&encoded, GUAC_ENCODER_MAX_LENGTH);
+
+    backend->video_end_handler(backend, session,
+            guac_encoder_capture_handler, &encoded);
+
+    if (!encoded.overflow)
+        guac_encoder_send(socket, stream, &encoded, NULL);
+
+    guac_encode_capture_free(&encoded);
+
+}
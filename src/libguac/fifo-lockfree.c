@@ -0,0 +1,473 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "guacamole/fifo-lockfree.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Returns a pointer to the item storage associated with the given position
+ * within the given FIFO.
+ *
+ * @param fifo
+ *     The FIFO containing the item.
+ *
+ * @param position
+ *     The position of the item.
+ *
+ * @return
+ *     A pointer to the storage of the item at the given position.
+ */
+static void* guac_fifo_lockfree_item(guac_fifo_lockfree* fifo, size_t position) {
+    return ((char*) fifo) + fifo->items_offset
+        + fifo->item_size * (position % fifo->max_items);
+}
+
+/**
+ * Returns a pointer to the sequence number associated with the given position
+ * within the given FIFO. The sequence number of each item indicates whether
+ * that item is ready to be written (the sequence number is equal to the
+ * position) or ready to be read (the sequence number is one greater than the
+ * position).
+ *
+ * @param fifo
+ *     The FIFO containing the item.
+ *
+ * @param position
+ *     The position of the item.
+ *
+ * @return
+ *     A pointer to the sequence number of the item at the given position.
+ */
+static size_t* guac_fifo_lockfree_sequence(guac_fifo_lockfree* fifo, size_t position) {
+    size_t* sequences = (size_t*) (((char*) fifo) + fifo->sequences_offset);
+    return &sequences[position % fifo->max_items];
+}
+
+/**
+ * Sleeps until the given event counter no longer has the given value, until
+ * the given timeout elapses, or until woken spuriously. Callers must account
+ * for spurious wakeups.
+ *
+ * @param fifo
+ *     The FIFO that the event counter belongs to.
+ *
+ * @param event
+ *     The event counter to wait on.
+ *
+ * @param expected
+ *     The value of the event counter observed by the caller, prior to
+ *     determining that it must wait.
+ *
+ * @param msec_timeout
+ *     The maximum number of milliseconds to wait, or a negative value to
+ *     wait indefinitely.
+ */
+static void guac_fifo_lockfree_wait(guac_fifo_lockfree* fifo,
+        unsigned int* event, unsigned int expected, int msec_timeout) {
+
+    struct timespec timeout = {
+        .tv_sec  = msec_timeout / 1000,
+        .tv_nsec = (msec_timeout % 1000) * 1000000L
+    };
+
+#ifdef HAVE_LINUX_FUTEX_H
+    syscall(SYS_futex, event, FUTEX_WAIT, expected,
+            msec_timeout < 0 ? NULL : &timeout, NULL, 0);
+#else
+    pthread_mutex_lock(&fifo->lock);
+
+    if (__atomic_load_n(event, __ATOMIC_SEQ_CST) == expected) {
+
+        if (msec_timeout < 0)
+            pthread_cond_wait(&fifo->changed, &fifo->lock);
+
+        else {
+
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += timeout.tv_sec;
+            deadline.tv_nsec += timeout.tv_nsec;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+
+            pthread_cond_timedwait(&fifo->changed, &fifo->lock, &deadline);
+
+        }
+
+    }
+
+    pthread_mutex_unlock(&fifo->lock);
+#endif
+
+}
+
+/**
+ * Advances the given event counter and wakes threads waiting on that counter.
+ *
+ * @param fifo
+ *     The FIFO that the event counter belongs to.
+ *
+ * @param event
+ *     The event counter to advance.
+ *
+ * @param count
+ *     The maximum number of waiting threads to wake.
+ */
+static void guac_fifo_lockfree_wake(guac_fifo_lockfree* fifo,
+        unsigned int* event, int count) {
+
+    __atomic_add_fetch(event, 1, __ATOMIC_SEQ_CST);
+
+#ifdef HAVE_LINUX_FUTEX_H
+    syscall(SYS_futex, event, FUTEX_WAKE, count, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&fifo->lock);
+    pthread_cond_broadcast(&fifo->changed);
+    pthread_mutex_unlock(&fifo->lock);
+#endif
+
+}
+
+/**
+ * Wakes a single thread waiting on the given event counter, if any threads
+ * are waiting. If no threads are waiting, this function avoids any system
+ * call, and is only an atomic read.
+ *
+ * @param fifo
+ *     The FIFO that the event counter belongs to.
+ *
+ * @param event
+ *     The event counter that waiting threads are waiting on.
+ *
+ * @param waiters
+ *     The number of threads waiting on the event counter.
+ */
+static void guac_fifo_lockfree_signal(guac_fifo_lockfree* fifo,
+        unsigned int* event, unsigned int* waiters) {
+
+    /* The item just added/removed MUST be visible before checking for
+     * waiters, otherwise a waiter that has just registered itself could miss
+     * both the item and the wakeup */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(waiters, __ATOMIC_RELAXED))
+        guac_fifo_lockfree_wake(fifo, event, 1);
+
+}
+
+/**
+ * Attempts to add a copy of the given item to the end of the given FIFO
+ * without blocking.
+ *
+ * @param fifo
+ *     The FIFO to add an item to.
+ *
+ * @param item
+ *     The item to add.
+ *
+ * @return
+ *     Non-zero if the item was added, zero if the FIFO is full.
+ */
+static int guac_fifo_lockfree_try_enqueue(guac_fifo_lockfree* fifo,
+        const void* item) {
+
+    size_t position = __atomic_load_n(&fifo->tail, __ATOMIC_RELAXED);
+    size_t* sequence;
+
+    for (;;) {
+
+        sequence = guac_fifo_lockfree_sequence(fifo, position);
+        size_t value = __atomic_load_n(sequence, __ATOMIC_ACQUIRE);
+        ssize_t difference = (ssize_t) (value - position);
+
+        /* Space is available at the current position - claim it */
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&fifo->tail, &position,
+                        position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+
+        /* The item at this position has not yet been read - the FIFO is
+         * full */
+        else if (difference < 0)
+            return 0;
+
+        /* Another thread claimed this position first */
+        else
+            position = __atomic_load_n(&fifo->tail, __ATOMIC_RELAXED);
+
+    }
+
+    memcpy(guac_fifo_lockfree_item(fifo, position), item, fifo->item_size);
+    __atomic_store_n(sequence, position + 1, __ATOMIC_RELEASE);
+
+    return 1;
+
+}
+
+/**
+ * Attempts to remove the oldest item from the given FIFO without blocking.
+ *
+ * @param fifo
+ *     The FIFO to remove an item from.
+ *
+ * @param item
+ *     The buffer that should receive a copy of the removed item.
+ *
+ * @return
+ *     Non-zero if an item was removed, zero if the FIFO is empty.
+ */
+static int guac_fifo_lockfree_try_dequeue(guac_fifo_lockfree* fifo,
+        void* item) {
+
+    size_t position = __atomic_load_n(&fifo->head, __ATOMIC_RELAXED);
+    size_t* sequence;
+
+    for (;;) {
+
+        sequence = guac_fifo_lockfree_sequence(fifo, position);
+        size_t value = __atomic_load_n(sequence, __ATOMIC_ACQUIRE);
+        ssize_t difference = (ssize_t) (value - (position + 1));
+
+        /* An item is available at the current position - claim it */
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&fifo->head, &position,
+                        position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+
+        /* No item has yet been written at this position - the FIFO is
+         * empty */
+        else if (difference < 0)
+            return 0;
+
+        /* Another thread claimed this position first */
+        else
+            position = __atomic_load_n(&fifo->head, __ATOMIC_RELAXED);
+
+    }
+
+    memcpy(item, guac_fifo_lockfree_item(fifo, position), fifo->item_size);
+    __atomic_store_n(sequence, position + fifo->max_items, __ATOMIC_RELEASE);
+
+    return 1;
+
+}
+
+/**
+ * Returns the number of milliseconds remaining until the given deadline, as
+ * measured by CLOCK_MONOTONIC.
+ *
+ * @param deadline
+ *     The deadline to compare against the current time.
+ *
+ * @return
+ *     The number of milliseconds remaining until the deadline, or zero if the
+ *     deadline has passed.
+ */
+static int guac_fifo_lockfree_remaining(const struct timespec* deadline) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long long remaining = (deadline->tv_sec - now.tv_sec) * 1000LL
+        + (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+
+    return remaining > 0 ? (int) remaining : 0;
+
+}
+
+/**
+ * Adds an item to or removes an item from the given FIFO, blocking while the
+ * FIFO is full (if adding) or empty (if removing) until the given timeout
+ * elapses or the FIFO becomes invalid.
+ *
+ * @param fifo
+ *     The FIFO to add an item to or remove an item from.
+ *
+ * @param item
+ *     The item to add, or the buffer that should receive the removed item.
+ *
+ * @param enqueue
+ *     Non-zero to add an item, zero to remove an item.
+ *
+ * @param msec_timeout
+ *     The maximum number of milliseconds to wait, or a negative value to
+ *     wait indefinitely.
+ *
+ * @return
+ *     Non-zero if the item was added or removed, zero if the timeout has
+ *     elapsed or the FIFO has been invalidated.
+ */
+static int guac_fifo_lockfree_transfer(guac_fifo_lockfree* fifo,
+        void* item, int enqueue, int msec_timeout) {
+
+    /* Threads wait on the event of their own side and wake threads waiting
+     * on the event of the opposite side */
+    unsigned int* event = enqueue ? &fifo->ready_event : &fifo->nonempty_event;
+    unsigned int* waiters = enqueue ? &fifo->ready_waiters : &fifo->nonempty_waiters;
+    unsigned int* other_event = enqueue ? &fifo->nonempty_event : &fifo->ready_event;
+    unsigned int* other_waiters = enqueue ? &fifo->nonempty_waiters : &fifo->ready_waiters;
+
+    struct timespec deadline;
+    if (msec_timeout > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += msec_timeout / 1000;
+        deadline.tv_nsec += (msec_timeout % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    for (;;) {
+
+        if (!guac_fifo_lockfree_is_valid(fifo))
+            return 0;
+
+        /* Fast path: no waiting required */
+        if (enqueue ? guac_fifo_lockfree_try_enqueue(fifo, item)
+                    : guac_fifo_lockfree_try_dequeue(fifo, item)) {
+            guac_fifo_lockfree_signal(fifo, other_event, other_waiters);
+            return 1;
+        }
+
+        int remaining = msec_timeout;
+        if (msec_timeout > 0)
+            remaining = guac_fifo_lockfree_remaining(&deadline);
+
+        if (remaining == 0)
+            return 0;
+
+        /* Register as a waiter BEFORE checking once more, such that any
+         * thread changing the state of the FIFO after that check will see
+         * that a wakeup is needed */
+        unsigned int expected = __atomic_load_n(event, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+
+        int succeeded = guac_fifo_lockfree_is_valid(fifo)
+            && (enqueue ? guac_fifo_lockfree_try_enqueue(fifo, item)
+                        : guac_fifo_lockfree_try_dequeue(fifo, item));
+
+        if (!succeeded && guac_fifo_lockfree_is_valid(fifo))
+            guac_fifo_lockfree_wait(fifo, event, expected, remaining);
+
+        __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+
+        if (succeeded) {
+            guac_fifo_lockfree_signal(fifo, other_event, other_waiters);
+            return 1;
+        }
+
+    }
+
+}
+
+void guac_fifo_lockfree_init(guac_fifo_lockfree* fifo, void* items,
+        size_t* sequences, size_t max_items, size_t item_size) {
+
+    /* Init values describing the memory structure of the items array */
+    fifo->items_offset = (char*) items - (char*) fifo;
+    fifo->sequences_offset = (char*) sequences - (char*) fifo;
+    fifo->max_items = max_items;
+    fifo->item_size = item_size;
+
+    /* The fifo is currently empty, with each position ready to be written */
+    for (size_t i = 0; i < max_items; i++)
+        sequences[i] = i;
+
+    fifo->head = 0;
+    fifo->tail = 0;
+    fifo->invalid = 0;
+
+    fifo->nonempty_event = 0;
+    fifo->nonempty_waiters = 0;
+    fifo->ready_event = 0;
+    fifo->ready_waiters = 0;
+
+    /* The mutex and condition are used only for waiting, and only where
+     * futexes are unavailable, but are initialized regardless such that the
+     * structure is always in a consistent state */
+    pthread_mutexattr_t lock_attributes;
+    pthread_mutexattr_init(&lock_attributes);
+    pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&fifo->lock, &lock_attributes);
+    pthread_mutexattr_destroy(&lock_attributes);
+
+    pthread_condattr_t cond_attributes;
+    pthread_condattr_init(&cond_attributes);
+    pthread_condattr_setpshared(&cond_attributes, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&cond_attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&fifo->changed, &cond_attributes);
+    pthread_condattr_destroy(&cond_attributes);
+
+}
+
+void guac_fifo_lockfree_destroy(guac_fifo_lockfree* fifo) {
+    pthread_cond_destroy(&fifo->changed);
+    pthread_mutex_destroy(&fifo->lock);
+}
+
+void guac_fifo_lockfree_invalidate(guac_fifo_lockfree* fifo) {
+
+    __atomic_store_n(&fifo->invalid, 1, __ATOMIC_SEQ_CST);
+
+    /* Wake everything, regardless of what each thread is waiting for */
+    guac_fifo_lockfree_wake(fifo, &fifo->nonempty_event, INT_MAX);
+    guac_fifo_lockfree_wake(fifo, &fifo->ready_event, INT_MAX);
+
+}
+
+int guac_fifo_lockfree_is_valid(guac_fifo_lockfree* fifo) {
+    return !__atomic_load_n(&fifo->invalid, __ATOMIC_ACQUIRE);
+}
+
+int guac_fifo_lockfree_enqueue(guac_fifo_lockfree* fifo, const void* item) {
+    return guac_fifo_lockfree_transfer(fifo, (void*) item, 1, -1);
+}
+
+int guac_fifo_lockfree_dequeue(guac_fifo_lockfree* fifo, void* item) {
+    return guac_fifo_lockfree_transfer(fifo, item, 0, -1);
+}
+
+int guac_fifo_lockfree_timed_dequeue(guac_fifo_lockfree* fifo,
+        void* item, int msec_timeout) {
+
+    /* Unlike guac_fifo_dequeue(), a timed dequeue is never indefinite */
+    if (msec_timeout < 0)
+        msec_timeout = 0;
+
+    return guac_fifo_lockfree_transfer(fifo, item, 0, msec_timeout);
+
+}
@@ -0,0 +1,47 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef __GUAC_AUDIO_CONSTANTS_H
+#define __GUAC_AUDIO_CONSTANTS_H
+
+/**
+ * Constants related to simple streaming audio.
+ *
+ * @file audio-constants.h
+ */
+
+/**
+ * The largest absolute amplitude, in 16-bit sample units, that is still
+ * considered silence by guac_audio_stream_write_pcm(). Samples of other bit
+ * depths are scaled to 16 bits before comparison. This is roughly -66 dBFS,
+ * low enough to pass any audible signal while still matching the dither and
+ * residual noise that typically fills "silent" PCM output.
+ */
+#define GUAC_AUDIO_SILENCE_THRESHOLD 16
+
+/**
+ * The number of milliseconds of continuous silence that must be written to
+ * an audio stream before further silence is no longer sent. Silence shorter
+ * than this is sent as-is, such that brief pauses within speech or music
+ * are not clipped.
+ */
+#define GUAC_AUDIO_SILENCE_HOLDOFF 250
+
+#endif
+
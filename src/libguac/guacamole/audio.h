@@ -26,6 +26,7 @@
  * @file audio.h
  */
 
+#include "audio-constants.h"
 #include "audio-fntypes.h"
 #include "audio-types.h"
 #include "client-types.h"
@@ -107,6 +108,20 @@ struct guac_audio_stream {
      */
     void* data;
 
+    /**
+     * The number of bytes of continuous silence most recently written via
+     * guac_audio_stream_write_pcm(). This is reset to zero whenever
+     * non-silent PCM data is written or the format of the stream changes.
+     */
+    int silence_length;
+
+    /**
+     * Non-zero if silence has persisted for longer than
+     * GUAC_AUDIO_SILENCE_HOLDOFF and further silent PCM data is currently
+     * being discarded rather than encoded, zero otherwise.
+     */
+    int silence_suppressed;
+
 };
 
 /**
@@ -207,7 +222,15 @@ void guac_audio_stream_free(guac_audio_stream* stream);
 /**
  * Writes PCM data to the given audio stream. This PCM data will be
  * automatically encoded by the audio encoder associated with this stream. The
- * PCM data must be 2-channel, 44100 Hz, with signed 16-bit samples.
+ * PCM data must be in the format specified when the stream was allocated or
+ * last reset, with signed samples.
+ *
+ * Silence is detected and suppressed automatically. Once silence (samples no
+ * louder than GUAC_AUDIO_SILENCE_THRESHOLD) has persisted for longer than
+ * GUAC_AUDIO_SILENCE_HOLDOFF milliseconds, the stream is flushed and further
+ * silent PCM data is discarded rather than encoded and sent. Encoding resumes
+ * with the first PCM data that is not silent. Callers therefore need not
+ * perform their own silence detection.
  *
  * @param stream
  *     The guac_audio_stream to write PCM data through.
@@ -83,5 +83,39 @@
  */
 #define GUAC_BUFFER_POOL_INITIAL_SIZE 1024
 
+/**
+ * The maximum number of distinct phases of connection establishment that may
+ * be recorded for a guac_client via guac_client_record_connect_phase().
+ */
+#define GUAC_CLIENT_MAX_CONNECT_PHASES 16
+
+/**
+ * The maximum number of bytes in the name of a phase of connection
+ * establishment recorded via guac_client_record_connect_phase(), including
+ * null terminator.
+ */
+#define GUAC_CLIENT_CONNECT_PHASE_NAME_LENGTH 32
+
+/**
+ * The number of buckets within each guac_client_latency_histogram. Bucket i,
+ * for each i less than GUAC_CLIENT_LATENCY_BUCKETS - 1, counts the samples
+ * that were greater than the upper bound of the previous bucket and no
+ * greater than 2^i milliseconds. The final bucket counts all larger samples.
+ */
+#define GUAC_CLIENT_LATENCY_BUCKETS 14
+
+/**
+ * The maximum amount of time that may elapse between receipt of user input
+ * and confirmation of the resulting frame before measurement of the latency
+ * of that input is abandoned, in milliseconds. Input that produces no visible
+ * change would otherwise be attributed to an unrelated, later change.
+ */
+#define GUAC_CLIENT_LATENCY_TRACE_TIMEOUT 5000
+
+/**
+ * The number of distinct values of guac_client_memory_category.
+ */
+#define GUAC_CLIENT_MEMORY_CATEGORIES 5
+
 #endif
 
@@ -34,6 +34,35 @@
  */
 typedef struct guac_client guac_client;
 
+/**
+ * The duration of a single named phase of establishing the connection to the
+ * remote desktop server, as recorded by guac_client_record_connect_phase().
+ */
+typedef struct guac_client_connect_phase guac_client_connect_phase;
+
+/**
+ * A histogram of latency measurements, in milliseconds.
+ */
+typedef struct guac_client_latency_histogram guac_client_latency_histogram;
+
+/**
+ * The latency between user input and the display of the resulting changes,
+ * as measured by a guac_client and broken down into its components.
+ */
+typedef struct guac_client_latency_stats guac_client_latency_stats;
+
+/**
+ * The state of the measurement of the latency of a single user input that is
+ * currently in progress for a guac_client.
+ */
+typedef struct guac_client_latency_trace guac_client_latency_trace;
+
+/**
+ * The amount of memory attributed to each subsystem of a guac_client, as
+ * reported via guac_client_account_memory().
+ */
+typedef struct guac_client_memory_stats guac_client_memory_stats;
+
 /**
  * Possible current states of the Guacamole client. Currently, the only
  * two states are GUAC_CLIENT_RUNNING and GUAC_CLIENT_STOPPING.
@@ -93,5 +122,39 @@ typedef enum guac_client_log_level {
 
 } guac_client_log_level;
 
+/**
+ * The subsystems to which memory allocated on behalf of a guac_client may be
+ * attributed via guac_client_account_memory().
+ */
+typedef enum guac_client_memory_category {
+
+    /**
+     * Image data of the layers and buffers of a guac_display, including both
+     * the pending frame and the last frame of each.
+     */
+    GUAC_CLIENT_MEMORY_DISPLAY,
+
+    /**
+     * The contents of terminal emulator buffers, including scrollback.
+     */
+    GUAC_CLIENT_MEMORY_TERMINAL,
+
+    /**
+     * Buffers of audio data awaiting encoding or transmission.
+     */
+    GUAC_CLIENT_MEMORY_AUDIO,
+
+    /**
+     * Buffers containing clipboard data.
+     */
+    GUAC_CLIENT_MEMORY_CLIPBOARD,
+
+    /**
+     * Buffers of session recording data awaiting write to disk.
+     */
+    GUAC_CLIENT_MEMORY_RECORDING
+
+} guac_client_memory_category;
+
 #endif
 
@@ -43,8 +43,135 @@
 
 #include <pthread.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
+struct guac_client_connect_phase {
+
+    /**
+     * The name of the phase, such as "negotiation" or "first_frame". Phase
+     * names are defined by each protocol plugin.
+     */
+    char name[GUAC_CLIENT_CONNECT_PHASE_NAME_LENGTH];
+
+    /**
+     * The amount of time spent within the phase, in milliseconds.
+     */
+    guac_timestamp duration;
+
+};
+
+struct guac_client_latency_histogram {
+
+    /**
+     * The number of samples within each bucket of this histogram. The bounds
+     * of each bucket are described by GUAC_CLIENT_LATENCY_BUCKETS.
+     */
+    uint64_t buckets[GUAC_CLIENT_LATENCY_BUCKETS];
+
+    /**
+     * The total number of samples.
+     */
+    uint64_t count;
+
+    /**
+     * The sum of all samples, in milliseconds.
+     */
+    uint64_t sum;
+
+};
+
+struct guac_client_latency_stats {
+
+    /**
+     * The time between receipt of user input and the start of the flush of
+     * the first frame subsequently modified by the remote desktop (other than
+     * by the mouse cursor alone).
+     */
+    guac_client_latency_histogram server;
+
+    /**
+     * The time between the start of the flush of that frame and the end of
+     * that frame being sent, including all encoding.
+     */
+    guac_client_latency_histogram encode;
+
+    /**
+     * The time between the end of that frame being sent and receipt of the
+     * "sync" instruction confirming that the user providing the input has
+     * rendered that frame, including network transit in both directions.
+     */
+    guac_client_latency_histogram network;
+
+    /**
+     * The time between receipt of user input and receipt of the "sync"
+     * instruction confirming that the resulting frame has been rendered. This
+     * is the sum of all other components.
+     */
+    guac_client_latency_histogram total;
+
+};
+
+struct guac_client_latency_trace {
+
+    /**
+     * The current stage of the measurement. This member is internal to libguac
+     * and its values are defined only within libguac.
+     */
+    int stage;
+
+    /**
+     * The user that provided the input being measured. This pointer is only
+     * compared and is never dereferenced.
+     */
+    const guac_user* user;
+
+    /**
+     * The time that the input was received.
+     */
+    guac_timestamp input;
+
+    /**
+     * The time that the flush of the first frame modified after the input was
+     * received started.
+     */
+    guac_timestamp flush;
+
+    /**
+     * The timestamp of that frame, as sent within its "sync" instruction.
+     */
+    guac_timestamp frame;
+
+};
+
+struct guac_client_memory_stats {
+
+    /**
+     * The number of bytes currently attributed to each subsystem, indexed by
+     * guac_client_memory_category.
+     */
+    uint64_t usage[GUAC_CLIENT_MEMORY_CATEGORIES];
+
+    /**
+     * The greatest number of bytes ever attributed to each subsystem at any
+     * one time, indexed by guac_client_memory_category.
+     */
+    uint64_t peak[GUAC_CLIENT_MEMORY_CATEGORIES];
+
+    /**
+     * The number of times guac_client_reclaim_memory() has been invoked.
+     */
+    uint64_t reclaims;
+
+    /**
+     * The total number of bytes released by guac_client_reclaim_memory()
+     * from memory attributed to any subsystem.
+     */
+    uint64_t reclaimed;
+
+};
+
 struct guac_client {
 
     /**
@@ -208,6 +335,52 @@ struct guac_client {
      */
     guac_user* __pending_users;
 
+    /**
+     * The time at which the earliest user still within the list of pending
+     * users joined the connection, or zero if no user has joined since
+     * pending users were last promoted. The __pending_users_lock must be
+     * acquired before checking or altering this value.
+     */
+    guac_timestamp __pending_users_first_join;
+
+    /**
+     * The time at which the most recent user within the list of pending users
+     * joined the connection. The __pending_users_lock must be acquired before
+     * checking or altering this value.
+     */
+    guac_timestamp __pending_users_last_join;
+
+    /**
+     * The data written to the broadcast sockets of this guac_client that are
+     * received by all connected, non-pending users. Each such user reads from
+     * this log independently via their own guac_user_output. This member is
+     * internal to libguac and must not be used outside of libguac.
+     */
+    struct guac_user_output_log* __broadcast_log;
+
+    /**
+     * The data written to the broadcast sockets of this guac_client that are
+     * received by all pending users. Each such user reads from this log
+     * independently via their own guac_user_output. This member is internal
+     * to libguac and must not be used outside of libguac.
+     */
+    struct guac_user_output_log* __pending_broadcast_log;
+
+    /**
+     * Lock which guards access to __display. This member is internal to
+     * libguac and must not be used outside of libguac.
+     */
+    pthread_mutex_t __display_lock;
+
+    /**
+     * The guac_display most recently allocated for this guac_client, or NULL
+     * if no such guac_display exists or it has since been freed. This member
+     * is internal to libguac and must not be used outside of libguac. To
+     * retrieve statistics describing this display, use
+     * guac_display_get_client_stats().
+     */
+    struct guac_display* __display;
+
     /**
      * The user that first created this connection. This user will also have
      * their "owner" flag set to a non-zero value. If the owner has left the
@@ -221,6 +394,24 @@ struct guac_client {
      */
     int connected_users;
 
+    /**
+     * Non-zero if bursts of "mouse" instructions received from any user that
+     * differ only in mouse position should be coalesced, with only the latest
+     * position being passed to the mouse_handler of that user, zero if every
+     * "mouse" instruction should be handled individually. Instructions are
+     * coalesced only while further instructions have already been received
+     * and are awaiting handling. Changes in button state are never coalesced,
+     * and no other instructions (including "touch") are affected. This is
+     * zero by default.
+     *
+     * Protocols that act only upon the current mouse position, rather than
+     * upon the path taken to reach it, should set this to non-zero. Only the
+     * latest position within any burst of mouse movement then needs to be
+     * handled, and a slow mouse_handler does not cause input to back up
+     * behind intermediate positions that are already out of date.
+     */
+    int coalesce_mouse;
+
     /**
      * Handler for join events, called whenever a new user is joining an active
      * connection. Note that because users may leave the connection at any
@@ -311,6 +502,56 @@ struct guac_client {
      */
     void* __plugin_handle;
 
+    /**
+     * Lock which guards access to __connect_phases and
+     * __connect_phase_count. This member is internal to libguac and must not
+     * be used outside of libguac.
+     */
+    pthread_mutex_t __connect_phases_lock;
+
+    /**
+     * The phases of connection establishment recorded via
+     * guac_client_record_connect_phase(), in the order first recorded. This
+     * member is internal to libguac and must not be used outside of libguac.
+     * To retrieve these phases, use guac_client_get_connect_phases().
+     */
+    guac_client_connect_phase __connect_phases[GUAC_CLIENT_MAX_CONNECT_PHASES];
+
+    /**
+     * The number of entries within __connect_phases that have been recorded.
+     * This member is internal to libguac and must not be used outside of
+     * libguac.
+     */
+    int __connect_phase_count;
+
+    /**
+     * Lock which guards access to __latency_trace and __latency_stats. This
+     * member is internal to libguac and must not be used outside of libguac.
+     */
+    pthread_mutex_t __latency_lock;
+
+    /**
+     * The measurement of the latency of user input currently in progress, if
+     * any. This member is internal to libguac and must not be used outside of
+     * libguac.
+     */
+    guac_client_latency_trace __latency_trace;
+
+    /**
+     * All latency measurements completed thus far. This member is internal to
+     * libguac and must not be used outside of libguac. To retrieve these
+     * measurements, use guac_client_get_latency_stats().
+     */
+    guac_client_latency_stats __latency_stats;
+
+    /**
+     * The memory attributed to each subsystem thus far. All members of this
+     * structure are read and written atomically. This member is internal to
+     * libguac and must not be used outside of libguac. To retrieve these
+     * values, use guac_client_get_memory_stats().
+     */
+    guac_client_memory_stats __memory_stats;
+
 };
 
 /**
@@ -652,6 +893,24 @@ int guac_client_load_plugin(guac_client* client, const char* protocol);
  */
 int guac_client_get_processing_lag(guac_client* client);
 
+/**
+ * Calculates and returns the processing lag that the rate of frames sent to
+ * all users should be paced against. This is the processing lag of the owner
+ * of the connection if the owner is currently connected, or the lowest
+ * processing lag of any connected user otherwise. Unlike
+ * guac_client_get_processing_lag(), this ensures that a single slow viewer of
+ * a shared connection does not reduce the framerate experienced by everyone
+ * else.
+ *
+ * @param client
+ *     The guac_client to calculate the pacing lag of.
+ *
+ * @return
+ *     The processing lag that frames should be paced against, in
+ *     milliseconds, or zero if no users are connected.
+ */
+int guac_client_get_pacing_lag(guac_client* client);
+
 /**
  * Sends a request to the owner of the given guac_client for parameters required
  * to continue the connection started by the client. The function returns zero
@@ -890,6 +1149,119 @@ int guac_client_owner_notify_leave(guac_client* client, guac_user* quitter);
  */
 int guac_client_supports_webp(guac_client* client);
 
+/**
+ * Records the amount of time spent within the given phase of establishing the
+ * connection to the remote desktop server, such that the time taken to
+ * connect can be broken down and monitored by the process hosting the
+ * connection. If the phase has already been recorded, such as when a
+ * connection is re-established, its duration is replaced. If
+ * GUAC_CLIENT_MAX_CONNECT_PHASES distinct phases have already been recorded,
+ * this function has no effect.
+ *
+ * @param client
+ *     The guac_client whose connection phase should be recorded.
+ *
+ * @param name
+ *     The name of the phase, such as "negotiation". Names longer than
+ *     GUAC_CLIENT_CONNECT_PHASE_NAME_LENGTH - 1 bytes are truncated.
+ *
+ * @param duration
+ *     The amount of time spent within the phase, in milliseconds.
+ */
+void guac_client_record_connect_phase(guac_client* client, const char* name,
+        guac_timestamp duration);
+
+/**
+ * Retrieves a snapshot of the phases of connection establishment recorded for
+ * the given guac_client via guac_client_record_connect_phase(), in the order
+ * that each phase was first recorded.
+ *
+ * @param client
+ *     The guac_client whose connection phases should be retrieved.
+ *
+ * @param phases
+ *     An array of at least max_phases entries that should receive the
+ *     recorded phases.
+ *
+ * @param max_phases
+ *     The maximum number of phases to store within the given array.
+ *
+ * @return
+ *     The number of phases stored within the given array.
+ */
+int guac_client_get_connect_phases(guac_client* client,
+        guac_client_connect_phase* phases, int max_phases);
+
+/**
+ * Retrieves a snapshot of all measurements of the latency between user input
+ * and the display of the resulting changes for the given guac_client. Latency
+ * is measured automatically for one input at a time: each key press or mouse
+ * event with a button held that is received while no measurement is in
+ * progress is traced through the first subsequent frame containing changes to
+ * the remote desktop, up to receipt of the "sync" instruction from the same
+ * user confirming that frame has been rendered. As any such change is assumed
+ * to result from the input, measurements are statistical in nature.
+ *
+ * @param client
+ *     The guac_client whose latency measurements should be retrieved.
+ *
+ * @param stats
+ *     The guac_client_latency_stats that should receive the measurements.
+ */
+void guac_client_get_latency_stats(guac_client* client,
+        guac_client_latency_stats* stats);
+
+/**
+ * Attributes the given change in allocated memory to the given subsystem of
+ * the given guac_client. Each subsystem should invoke this function whenever
+ * memory allocated on behalf of the client grows or shrinks, such that the
+ * memory used by the process hosting the connection can be broken down by
+ * subsystem. This function is threadsafe and does not block.
+ *
+ * @param client
+ *     The guac_client on whose behalf memory was allocated or freed.
+ *
+ * @param category
+ *     The subsystem responsible for the memory.
+ *
+ * @param delta
+ *     The number of bytes allocated, or the negated number of bytes freed.
+ */
+void guac_client_account_memory(guac_client* client,
+        guac_client_memory_category category, int64_t delta);
+
+/**
+ * Retrieves a snapshot of the memory attributed to each subsystem of the
+ * given guac_client via guac_client_account_memory(), along with any memory
+ * released by guac_client_reclaim_memory().
+ *
+ * @param client
+ *     The guac_client whose memory statistics should be retrieved.
+ *
+ * @param stats
+ *     The guac_client_memory_stats that should receive the statistics.
+ */
+void guac_client_get_memory_stats(guac_client* client,
+        guac_client_memory_stats* stats);
+
+/**
+ * Releases memory held by the given guac_client that is not currently
+ * needed, such as layer buffers left larger than their layers by an earlier
+ * resize, and then returns any free memory at the top of the heap to the
+ * operating system where the C library supports doing so (malloc_trim()).
+ * As this involves briefly blocking rendering, this function is intended to
+ * be invoked only periodically by the process hosting the connection, such
+ * as when the connection has become idle.
+ *
+ * @param client
+ *     The guac_client whose memory should be reclaimed.
+ *
+ * @return
+ *     The number of bytes attributed to the subsystems of the given client
+ *     that were released.
+ */
+size_t guac_client_reclaim_memory(guac_client* client);
+
 /**
  * The default Guacamole client layer, layer 0.
  */
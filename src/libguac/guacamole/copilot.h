@@ -29,13 +29,38 @@
  */
 
 #include "client.h"
+#include "timestamp.h"
 #include "user.h"
 
+#include <pthread.h>
+
 /**
  * The maximum length of a copilot command, in characters.
  */
 #define GUAC_COPILOT_MAX_COMMAND_LENGTH 1024
 
+/**
+ * The OSC (Operating System Command) code of the marker that is printed by
+ * the shell after each workflow step executed by the copilot completes. The
+ * marker has the form "ESC ] 482210 ; STEP ; STATUS BEL", where STEP is the
+ * zero-based index of the completed step and STATUS is its exit status. As
+ * guac_terminal ignores unknown OSC codes, the marker is not displayed.
+ */
+#define GUAC_COPILOT_STEP_MARKER 482210
+
+/**
+ * The maximum number of commands retained within the command history of
+ * each copilot. Once full, the oldest command is replaced.
+ */
+#define GUAC_COPILOT_HISTORY_SIZE 50
+
+/**
+ * The maximum number of keystrokes which may be awaiting processing by each
+ * copilot. Keystrokes tracked while this many keystrokes are already waiting
+ * are dropped. This value MUST be a power of two.
+ */
+#define GUAC_COPILOT_KEYSTROKE_BUFFER_SIZE 256
+
 /**
  * The maximum length of a workflow name.
  */
@@ -46,6 +71,63 @@
  */
 #define GUAC_COPILOT_MAX_WORKFLOW_STEPS 100
 
+/**
+ * The maximum amount of time that the copilot query thread will wait for
+ * network activity before checking for newly-submitted or cancelled queries,
+ * in milliseconds. The query thread is normally woken explicitly when queries
+ * are submitted or cancelled, so this only bounds the delay if a wakeup is
+ * somehow missed.
+ */
+#define GUAC_COPILOT_QUERY_WAIT_TIMEOUT 1000
+
+/**
+ * The maximum amount of time that any single AI query may take to complete,
+ * in seconds, including connecting to the AI service. Queries which take
+ * longer are abandoned.
+ */
+#define GUAC_COPILOT_QUERY_TIMEOUT 30
+
+/**
+ * The maximum number of distinct sets of AI suggestions retained by the
+ * suggestion cache of each copilot. Once full, the least-recently-used set
+ * of suggestions is replaced.
+ */
+#define GUAC_COPILOT_CACHE_SIZE 32
+
+/**
+ * The maximum amount of time that AI suggestions are retained by the
+ * suggestion cache, in milliseconds.
+ */
+#define GUAC_COPILOT_CACHE_DURATION 300000
+
+/**
+ * The maximum total length of the AI suggestions received by a single
+ * query, in bytes. Suggestions longer than this are still sent but are not
+ * cached.
+ */
+#define GUAC_COPILOT_MAX_SUGGESTIONS_LENGTH 4096
+
+/**
+ * The name of the pipe stream over which suggestions from the AI service
+ * are sent. Suggestions are sent as plain text, one suggestion per line, as
+ * they are generated.
+ */
+#define GUAC_COPILOT_SUGGESTION_STREAM "copilot-suggestions"
+
+/**
+ * An index of all commands known to the copilot, allowing commands matching
+ * partial input to be located quickly. The structure of the index is
+ * internal to the copilot implementation.
+ */
+typedef struct guac_copilot_command_index guac_copilot_command_index;
+
+/**
+ * An AI query which has been submitted to the copilot query thread and has
+ * not yet completed. The structure of each query is internal to the copilot
+ * implementation.
+ */
+typedef struct guac_copilot_query guac_copilot_query;
+
 /**
  * Copilot command types that can be executed.
  */
@@ -94,8 +176,17 @@ typedef struct guac_copilot_context {
     /** Operating system type */
     char* os_type;
 
-    /** Last executed commands (circular buffer) */
-    char** command_history;
+    /**
+     * Last executed commands (circular buffer). The history is a single
+     * block of GUAC_COPILOT_HISTORY_SIZE fixed-size slots, each
+     * GUAC_COPILOT_MAX_COMMAND_LENGTH bytes, such that adding a command
+     * never allocates memory. Commands should be retrieved with
+     * guac_copilot_get_command().
+     */
+    char* command_history;
+
+    /** Slot containing the oldest command in history */
+    int command_start;
 
     /** Number of commands in history */
     int command_count;
@@ -134,10 +225,17 @@ typedef struct guac_copilot_workflow_step {
     /** Expected output (for validation) */
     char* expected_output;
 
-    /** Wait time after execution (milliseconds) */
+    /**
+     * Wait time after execution (milliseconds). This is used only by clients
+     * that execute workflows themselves. Workflows executed by the copilot
+     * proceed as soon as each step is reported complete by the shell.
+     */
     int wait_time;
 
-    /** Whether to continue on error */
+    /**
+     * Whether to continue on error. Steps which continue on error are
+     * independent of each other and may be sent to the shell together.
+     */
     int continue_on_error;
 
 } guac_copilot_workflow_step;
@@ -173,6 +271,91 @@ typedef struct guac_copilot_workflow {
 
 } guac_copilot_workflow;
 
+/**
+ * The state of a workflow being executed by the copilot.
+ */
+typedef struct guac_copilot_workflow_run {
+
+    /**
+     * The workflow being executed, or NULL if no workflow is being executed.
+     */
+    guac_copilot_workflow* workflow;
+
+    /**
+     * The index of the first step that has not yet been sent to the shell.
+     */
+    int sent_steps;
+
+    /**
+     * The number of steps that the shell has reported as complete.
+     */
+    int completed_steps;
+
+    /**
+     * The time that execution of the workflow started.
+     */
+    guac_timestamp started;
+
+    /**
+     * The time that the step currently being executed by the shell started,
+     * which is the time that the previous step completed or the time that
+     * the step was sent, whichever is later.
+     */
+    guac_timestamp step_started;
+
+    /**
+     * The time taken by each completed step, in milliseconds.
+     */
+    int durations[GUAC_COPILOT_MAX_WORKFLOW_STEPS];
+
+    /**
+     * The exit status of each completed step.
+     */
+    int statuses[GUAC_COPILOT_MAX_WORKFLOW_STEPS];
+
+    /**
+     * The current state of the parser locating step markers within terminal
+     * output, such that markers split across separate reads are still
+     * recognized.
+     */
+    int marker_state;
+
+    /**
+     * The numeric value currently being parsed from a step marker.
+     */
+    int marker_value;
+
+    /**
+     * The step index parsed from the current step marker.
+     */
+    int marker_step;
+
+} guac_copilot_workflow_run;
+
+struct guac_copilot;
+
+/**
+ * Handler which sends the given data to the remote shell as if typed by the
+ * user, allowing the copilot to execute workflows itself. The handler may be
+ * invoked from any thread, including the thread that calls
+ * guac_copilot_handle_output(), and so must not block waiting for that
+ * thread.
+ *
+ * @param copilot
+ *     The copilot sending the data.
+ *
+ * @param data
+ *     The data to send.
+ *
+ * @param length
+ *     The number of bytes of data to send.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+typedef int guac_copilot_input_handler(struct guac_copilot* copilot,
+        const char* data, int length);
+
 /**
  * Quick action preset.
  */
@@ -195,6 +378,34 @@ typedef struct guac_copilot_quick_action {
 
 } guac_copilot_quick_action;
 
+/**
+ * A set of AI suggestions retained by the suggestion cache.
+ */
+typedef struct guac_copilot_cache_entry {
+
+    /**
+     * The normalized context and input for which the suggestions were
+     * generated, or NULL if this entry is unused.
+     */
+    char* key;
+
+    /**
+     * The suggestions generated, one suggestion per line.
+     */
+    char* suggestions;
+
+    /**
+     * The time that the suggestions were received from the AI service.
+     */
+    guac_timestamp created;
+
+    /**
+     * The time that the suggestions were last used.
+     */
+    guac_timestamp last_used;
+
+} guac_copilot_cache_entry;
+
 /**
  * The Guacamole Copilot instance.
  */
@@ -227,12 +438,138 @@ typedef struct guac_copilot {
     /** Recorded workflow being built */
     guac_copilot_workflow* recorded_workflow;
 
+    /**
+     * Index of all commands in the command history and all commands of
+     * registered workflows, used for local suggestions.
+     */
+    guac_copilot_command_index* command_index;
+
+    /**
+     * Handler which sends input to the remote shell, or NULL if the
+     * protocol cannot execute workflows on behalf of the copilot, in which
+     * case workflow steps are only sent to the client.
+     */
+    guac_copilot_input_handler* input_handler;
+
+    /**
+     * Arbitrary protocol-specific data for use by input_handler.
+     */
+    void* data;
+
+    /**
+     * Lock which guards access to workflow_run.
+     */
+    pthread_mutex_t workflow_lock;
+
+    /**
+     * The workflow currently being executed through input_handler, if any.
+     */
+    guac_copilot_workflow_run workflow_run;
+
     /** AI endpoint URL (if using external AI service) */
     char* ai_endpoint;
 
     /** API key for AI service */
     char* ai_api_key;
 
+    /**
+     * Lock which guards access to all pending and active queries, as well as
+     * the state of the query thread. This lock is also held while the
+     * results of a query are delivered, such that cancelling the queries of
+     * a user guarantees that no further results are sent to that user.
+     */
+    pthread_mutex_t query_lock;
+
+    /**
+     * The thread which performs all AI queries for this copilot,
+     * multiplexing any number of concurrent queries over a single set of
+     * reusable connections. This thread is started only when the first
+     * query is submitted.
+     */
+    pthread_t query_thread;
+
+    /**
+     * Whether query_thread has been started.
+     */
+    int query_thread_started;
+
+    /**
+     * Whether query_thread has been requested to stop.
+     */
+    int query_thread_stopping;
+
+    /**
+     * Pipe used to wake query_thread when queries are submitted or
+     * cancelled. The query thread reads from the first file descriptor,
+     * while other threads write to the second. Both file descriptors are -1
+     * if the pipe has not been created.
+     */
+    int query_wake_fd[2];
+
+    /**
+     * Queries which have been submitted but not yet picked up by
+     * query_thread, in the order they were submitted.
+     */
+    guac_copilot_query* pending_queries;
+
+    /**
+     * Queries currently being performed by query_thread.
+     */
+    guac_copilot_query* active_queries;
+
+    /**
+     * Recently-received AI suggestions, such that repeated requests in
+     * identical context are answered without querying the AI service. Access
+     * to this cache is guarded by query_lock.
+     */
+    guac_copilot_cache_entry suggestion_cache[GUAC_COPILOT_CACHE_SIZE];
+
+    /**
+     * Ring buffer of keysyms tracked with guac_copilot_track_keystroke() that
+     * have not yet been processed. Only a single thread may track keystrokes,
+     * and that thread never blocks nor allocates memory.
+     */
+    int keystrokes[GUAC_COPILOT_KEYSTROKE_BUFFER_SIZE];
+
+    /**
+     * The total number of keystrokes ever added to the keystrokes buffer.
+     * This value is only modified by the thread tracking keystrokes and is
+     * read and written atomically.
+     */
+    unsigned int keystroke_head;
+
+    /**
+     * The total number of keystrokes ever processed from the keystrokes
+     * buffer. This value is only modified while holding keystroke_lock and is
+     * read and written atomically.
+     */
+    unsigned int keystroke_tail;
+
+    /**
+     * The number of keystrokes dropped because the keystrokes buffer was
+     * full. This value is read and written atomically.
+     */
+    unsigned int dropped_keystrokes;
+
+    /**
+     * Lock which guards processing of the keystrokes buffer, as well as
+     * typed_input and typed_length. This lock is never acquired by the
+     * thread tracking keystrokes.
+     */
+    pthread_mutex_t keystroke_lock;
+
+    /**
+     * The line currently being typed, as reconstructed from tracked
+     * keystrokes. The line is added to the command history when Enter is
+     * pressed.
+     */
+    char typed_input[GUAC_COPILOT_MAX_COMMAND_LENGTH];
+
+    /**
+     * The length of typed_input, in bytes, excluding the null terminator.
+     */
+    int typed_length;
+
 } guac_copilot;
 
 /**
@@ -273,7 +610,9 @@ void guac_copilot_update_context(guac_copilot* copilot,
         const char* protocol, const char* current_dir, const char* os_type);
 
 /**
- * Adds a command to the history for context tracking.
+ * Adds a command to the history for context tracking. Commands longer than
+ * GUAC_COPILOT_MAX_COMMAND_LENGTH - 1 bytes are truncated. This function does
+ * not allocate memory.
  *
  * @param copilot
  *     The copilot instance.
@@ -283,6 +622,55 @@ void guac_copilot_update_context(guac_copilot* copilot,
  */
 void guac_copilot_add_command(guac_copilot* copilot, const char* command);
 
+/**
+ * Returns the command at the given position within the command history,
+ * where position 0 is the oldest command and position command_count - 1 is
+ * the most recent.
+ *
+ * @param context
+ *     The copilot context containing the command history.
+ *
+ * @param index
+ *     The position of the command to return, which must be less than the
+ *     command_count of the context.
+ *
+ * @return
+ *     The command at the given position. The returned string remains valid
+ *     only until more commands are added to the history.
+ */
+const char* guac_copilot_get_command(const guac_copilot_context* context,
+        int index);
+
+/**
+ * Records a key press for context tracking. The keystroke is only stored and
+ * is not interpreted until guac_copilot_process_keystrokes() is invoked, such
+ * that this function is suitable for use within latency-sensitive input
+ * handling. This function never blocks, acquires no locks, and does not
+ * allocate memory. If too many keystrokes are already awaiting processing,
+ * the keystroke is dropped.
+ *
+ * Only a single thread may invoke this function for any given copilot.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param keysym
+ *     The X11 keysym of the key that was pressed.
+ */
+void guac_copilot_track_keystroke(guac_copilot* copilot, int keysym);
+
+/**
+ * Processes all keystrokes recorded with guac_copilot_track_keystroke() that
+ * have not yet been processed, updating the line currently being typed and
+ * adding each completed line to the command history. This function is
+ * invoked automatically by the copilot before its context is used, and may
+ * safely be invoked from any thread.
+ *
+ * @param copilot
+ *     The copilot instance.
+ */
+void guac_copilot_process_keystrokes(guac_copilot* copilot);
+
 /**
  * Handles a copilot command from the client.
  *
@@ -317,7 +705,14 @@ int guac_copilot_register_workflow(guac_copilot* copilot,
         guac_copilot_workflow* workflow);
 
 /**
- * Executes a workflow by name.
+ * Executes a workflow by name. If the copilot has an input_handler, the
+ * steps of the workflow are sent to the shell, with each run of independent
+ * steps (steps which continue on error) sent together, and each further
+ * step sent as soon as guac_copilot_handle_output() observes that all
+ * previously-sent steps have completed. Once the workflow completes, a
+ * report of the time taken by each step is sent to the client. Without an
+ * input_handler, the steps are only sent to the client, which is expected
+ * to execute them itself.
  *
  * @param copilot
  *     The copilot instance.
@@ -332,7 +727,29 @@ int guac_copilot_execute_workflow(guac_copilot* copilot,
         const char* workflow_name);
 
 /**
- * Generates command suggestions based on current context.
+ * Scans output received from the remote shell for the markers printed upon
+ * completion of each workflow step, advancing any workflow being executed.
+ * Markers split across multiple calls are recognized. This function should
+ * be invoked with all terminal output whenever the copilot has an
+ * input_handler.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param data
+ *     The output received.
+ *
+ * @param length
+ *     The number of bytes of output received.
+ */
+void guac_copilot_handle_output(guac_copilot* copilot, const char* data,
+        int length);
+
+/**
+ * Generates command suggestions based on current context. Only locally-known
+ * suggestions are returned, such that this function never blocks on the AI
+ * service. Suggestions from the AI service, if configured, may be requested
+ * with guac_copilot_suggest_commands_async().
  *
  * @param copilot
  *     The copilot instance.
@@ -352,6 +769,54 @@ int guac_copilot_execute_workflow(guac_copilot* copilot,
 int guac_copilot_suggest_commands(guac_copilot* copilot, const char* input,
         char*** suggestions, int max_suggestions);
 
+/**
+ * Requests command suggestions from the AI service based on the current
+ * context, without waiting for the AI service to respond. The query is
+ * performed in the background by the copilot query thread, and suggestions
+ * are sent to the given user over a pipe stream named
+ * GUAC_COPILOT_SUGGESTION_STREAM as the AI service generates them, with each
+ * blob containing whatever text has arrived thus far. If the query fails
+ * before any text is generated, no stream is opened.
+ *
+ * If suggestions were recently received for the same protocol, operating
+ * system, recent commands, and input, those suggestions are sent over the
+ * same kind of stream immediately, and no query is submitted.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param user
+ *     The user that should receive the suggestions, or NULL if the
+ *     suggestions should be sent to all users of the connection.
+ *
+ * @param input
+ *     Partial input from the user (can be NULL).
+ *
+ * @param max_suggestions
+ *     Maximum number of suggestions to send.
+ *
+ * @return
+ *     Zero if the query was submitted, a positive value if suggestions were
+ *     sent from the cache, or a negative value if the AI service is not
+ *     configured or the query could not be submitted.
+ */
+int guac_copilot_suggest_commands_async(guac_copilot* copilot,
+        guac_user* user, const char* input, int max_suggestions);
+
+/**
+ * Cancels all AI queries submitted on behalf of the given user. Once this
+ * function returns, no further results will be sent to that user, and it is
+ * safe for the user to be freed. This function should be invoked whenever a
+ * user leaves the connection.
+ *
+ * @param copilot
+ *     The copilot instance.
+ *
+ * @param user
+ *     The user whose queries should be cancelled.
+ */
+void guac_copilot_cancel_queries(guac_copilot* copilot, guac_user* user);
+
 /**
  * Starts recording actions for workflow creation.
  *
@@ -409,7 +874,10 @@ void guac_copilot_send_message(guac_copilot* copilot,
         const char* message_type, const char* message);
 
 /**
- * Queries OpenAI API for AI-powered assistance.
+ * Queries OpenAI API for AI-powered assistance, blocking until the query has
+ * completed. As this may take several seconds, this function must not be
+ * invoked from any thread handling user input. Use
+ * guac_copilot_suggest_commands_async() where possible.
  *
  * @param copilot
  *     The copilot instance.
@@ -49,6 +49,22 @@
  */
 #define GUAC_DISPLAY_LAYER_RAW_BPP 4
 
+/**
+ * The maximum number of distinct rectangles that may be tracked as modified
+ * within a guac_display_layer_raw_context or within the pending frame of a
+ * guac_display_layer. Additional rectangles are coalesced with whichever
+ * existing rectangle results in the least additional area.
+ */
+#define GUAC_DISPLAY_LAYER_MAX_DAMAGE 8
+
+/**
+ * The maximum number of copy hints that may be tracked within a
+ * guac_display_layer_raw_context or within the pending frame of a
+ * guac_display_layer. Additional hints are ignored, with the affected
+ * regions instead relying on the usual scroll/copy detection.
+ */
+#define GUAC_DISPLAY_LAYER_MAX_COPY_HINTS 8
+
 /**
  * @}
  */
@@ -69,6 +69,26 @@ typedef struct guac_display_layer_cairo_context guac_display_layer_cairo_context
  */
 typedef struct guac_display_layer_raw_context guac_display_layer_raw_context;
 
+/**
+ * A hint that a region of a guac_display_layer was produced by copying
+ * another region of that same layer, as recorded with
+ * guac_display_layer_raw_context_copy_hint().
+ */
+typedef struct guac_display_copy_hint guac_display_copy_hint;
+
+/**
+ * Cumulative statistics describing the cost of encoding and sending image
+ * data in a single image format.
+ */
+typedef struct guac_display_encoder_stats guac_display_encoder_stats;
+
+/**
+ * A snapshot of the cumulative statistics describing the rendering and
+ * encoding performed by a guac_display, as returned by
+ * guac_display_get_stats().
+ */
+typedef struct guac_display_stats guac_display_stats;
+
 /**
  * Pre-defined mouse cursor graphics.
  */
@@ -47,8 +47,10 @@
 #include "display-types.h"
 #include "rect.h"
 #include "socket.h"
+#include "timestamp.h"
 
 #include <cairo/cairo.h>
+#include <stdint.h>
 #include <unistd.h>
 
 /**
@@ -114,6 +116,27 @@ struct guac_display_layer_cairo_context {
 
 };
 
+struct guac_display_copy_hint {
+
+    /**
+     * The region of the layer that was overwritten by the copy.
+     */
+    guac_rect dest;
+
+    /**
+     * The X coordinate of the upper-left corner of the region that was
+     * copied, relative to the same layer.
+     */
+    int src_x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the region that was
+     * copied, relative to the same layer.
+     */
+    int src_y;
+
+};
+
 struct guac_display_layer_raw_context {
 
     /**
@@ -174,6 +197,13 @@ struct guac_display_layer_raw_context {
      * changed since the last frame. This rectangle is initially empty and must
      * be manually updated to cover any additional changed regions before
      * closing the guac_display_layer_raw_context.
+     *
+     * Rather than modifying this rectangle directly, callers should prefer
+     * guac_display_layer_raw_context_damage(), which updates this rectangle
+     * while also tracking separate changed regions individually, allowing
+     * far-apart changes to be processed without considering everything in
+     * between. If this rectangle is modified directly, the entire rectangle is
+     * considered changed.
      */
     guac_rect dirty;
 
@@ -187,6 +217,215 @@ struct guac_display_layer_raw_context {
      */
     guac_display_layer* hint_from;
 
+    /**
+     * The distinct regions of the guac_display_layer that have changed since
+     * the last frame, as recorded by guac_display_layer_raw_context_damage().
+     * The bounding box of these regions is always equal to the dirty rect
+     * unless the dirty rect has been modified directly.
+     */
+    guac_rect damage[GUAC_DISPLAY_LAYER_MAX_DAMAGE];
+
+    /**
+     * The number of regions within the damage array.
+     */
+    int damage_count;
+
+    /**
+     * Hints describing regions of the guac_display_layer that were copied
+     * from elsewhere within the same layer, as recorded by
+     * guac_display_layer_raw_context_copy_hint().
+     */
+    guac_display_copy_hint copy_hints[GUAC_DISPLAY_LAYER_MAX_COPY_HINTS];
+
+    /**
+     * The number of hints within the copy_hints array.
+     */
+    int copy_hint_count;
+
+};
+
+struct guac_display_encoder_stats {
+
+    /**
+     * The total number of images encoded and sent.
+     */
+    uint64_t images;
+
+    /**
+     * The total number of bytes of encoded image data sent, prior to the
+     * base64 encoding applied by "blob" instructions.
+     */
+    uint64_t bytes;
+
+    /**
+     * The total amount of time spent encoding and sending images, in
+     * microseconds.
+     */
+    uint64_t encode_time;
+
+};
+
+struct guac_display_stats {
+
+    /**
+     * The time that this snapshot of statistics was taken.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The total number of frame boundaries ("sync" instructions) sent.
+     */
+    uint64_t frames;
+
+    /**
+     * The total number of operations within display plans that were dropped
+     * as having no effect.
+     */
+    uint64_t nop_ops;
+
+    /**
+     * The total number of operations sent as copies of existing image data.
+     */
+    uint64_t copy_ops;
+
+    /**
+     * The total number of operations sent as solid-color rectangles.
+     */
+    uint64_t rect_ops;
+
+    /**
+     * The total number of operations sent as encoded images.
+     */
+    uint64_t img_ops;
+
+    /**
+     * Statistics for images sent as PNG.
+     */
+    guac_display_encoder_stats png;
+
+    /**
+     * Statistics for images sent as JPEG.
+     */
+    guac_display_encoder_stats jpeg;
+
+    /**
+     * Statistics for images sent as WebP.
+     */
+    guac_display_encoder_stats webp;
+
+    /**
+     * Statistics for regions streamed as video, where each "image" is a
+     * single frame of video.
+     */
+    guac_display_encoder_stats video;
+
+    /**
+     * The total number of images that were sent using previously-encoded data
+     * rather than being encoded again.
+     */
+    uint64_t cache_hits;
+
+    /**
+     * The total number of images that had to be encoded because no
+     * previously-encoded data was available.
+     */
+    uint64_t cache_misses;
+
+    /**
+     * The total number of draws that were replaced with copies of tiles
+     * retained within an offscreen buffer on the client side.
+     */
+    uint64_t tile_cache_hits;
+
+    /**
+     * The total number of tiles that were copied into an offscreen buffer on
+     * the client side for possible future reuse.
+     */
+    uint64_t tile_cache_stores;
+
+    /**
+     * The total number of atlas images sent, each containing the image data
+     * of several small draws packed together.
+     */
+    uint64_t atlas_images;
+
+    /**
+     * The total number of draws that were packed into atlas images rather
+     * than being sent as images of their own.
+     */
+    uint64_t atlas_ops;
+
+    /**
+     * The total number of times a layer has been resized such that at least
+     * one of its dimensions became smaller. The storage of such a layer is
+     * not shrunk by the resize itself, and may remain larger than required
+     * until guac_display_reclaim_memory() is invoked.
+     */
+    uint64_t layer_shrinks;
+
+    /**
+     * The largest amount of memory required to plan any single frame, in
+     * bytes.
+     */
+    uint64_t plan_memory_high_water;
+
+    /**
+     * The total number of times memory had to be allocated from the system
+     * to plan frames. Once the memory required to plan frames reaches a
+     * steady state, this value stops increasing.
+     */
+    uint64_t plan_memory_allocations;
+
+    /**
+     * The total amount of time spent producing the initial draft of each
+     * display plan by comparing the pending and previous frames, in
+     * microseconds.
+     */
+    uint64_t draft_time;
+
+    /**
+     * The total amount of time spent replacing draws of single colors with
+     * solid-color rectangles, in microseconds.
+     */
+    uint64_t rects_time;
+
+    /**
+     * The total amount of time spent searching for draws that may instead be
+     * sent as copies, in microseconds.
+     */
+    uint64_t search_time;
+
+    /**
+     * The total amount of time spent combining adjacent draws, in
+     * microseconds.
+     */
+    uint64_t combine_time;
+
+    /**
+     * The total amount of time spent committing the pending frame as the
+     * previous frame once planning is complete, in microseconds.
+     */
+    uint64_t commit_time;
+
+    /**
+     * The number of operations waiting within the queue read by the worker
+     * threads at the time this snapshot was taken.
+     */
+    int queue_depth;
+
+    /**
+     * The maximum number of operations that may be waiting within the queue
+     * read by the worker threads.
+     */
+    int queue_size;
+
+    /**
+     * The amount of time that the most recent frame was delayed by the
+     * guac_display_render_thread (if any) to compensate for client-side
+     * processing lag, in milliseconds.
+     */
+    int render_lag;
+
 };
 
 /**
@@ -260,6 +499,28 @@ void guac_display_free(guac_display* display);
  */
 void guac_display_dup(guac_display* display, guac_socket* socket);
 
+/**
+ * Writes a single frame of a session recording to the given socket,
+ * containing only those changes to the visible layers and mouse cursor of
+ * the given display that have occurred since the previous call to this
+ * function for the same display, followed by a "sync" instruction. The first
+ * call for any display writes the full display state. All changed regions are
+ * written losslessly as PNG, regardless of how those regions were sent to
+ * connected users, and changes made in quick succession between calls are
+ * written only once, as they stand at the time of the call.
+ *
+ * Unlike guac_display_dup(), this function does not wait for any frame in
+ * progress to be sent to connected users, and the socket given MUST be
+ * the same for every call for any particular display.
+ *
+ * @param display
+ *     The display whose changes should be recorded.
+ *
+ * @param socket
+ *     The socket that should receive the recorded frame.
+ */
+void guac_display_record(guac_display* display, guac_socket* socket);
+
 /**
  * Notifies the given guac_display that a specific user has left the connection
  * and need no longer be considered for future updates/events. This SHOULD
@@ -352,6 +613,75 @@ void guac_display_end_mouse_frame(guac_display* display);
  */
 void guac_display_end_multiple_frames(guac_display* display, int frames);
 
+/**
+ * Retrieves a snapshot of the statistics describing the rendering and
+ * encoding performed by the given guac_display since it was allocated. All
+ * counters are cumulative. Rates, such as frames per second or bytes per
+ * second, may be derived by comparing two snapshots taken at different times.
+ *
+ * @param display
+ *     The guac_display to retrieve statistics from.
+ *
+ * @param stats
+ *     The guac_display_stats that should receive the current statistics.
+ */
+void guac_display_get_stats(guac_display* display, guac_display_stats* stats);
+
+/**
+ * Retrieves a snapshot of the statistics of the guac_display most recently
+ * allocated for the given guac_client, exactly as guac_display_get_stats()
+ * would. This allows code outside the protocol plugin, such as the process
+ * hosting the connection, to monitor the display without access to the
+ * guac_display itself.
+ *
+ * @param client
+ *     The guac_client whose guac_display statistics should be retrieved.
+ *
+ * @param stats
+ *     The guac_display_stats that should receive the current statistics.
+ *
+ * @return
+ *     Zero if statistics were retrieved, non-zero if the given guac_client
+ *     currently has no guac_display.
+ */
+int guac_display_get_client_stats(guac_client* client, guac_display_stats* stats);
+
+/**
+ * Shrinks the image buffers of all layers of the given guac_display that
+ * remain significantly larger than their layers, as may be the case after a
+ * layer has been resized to smaller dimensions (buffers are never shrunk
+ * automatically by a resize, as layers that shrink are likely to grow
+ * again). The contents of all layers are preserved. Buffers that have been
+ * replaced with external buffers are never affected.
+ *
+ * This function blocks until any frame currently being flushed has been
+ * flushed, and blocks further drawing while buffers are being shrunk. It is
+ * thus intended to be invoked only periodically, such as when a connection
+ * has become idle.
+ *
+ * @param display
+ *     The guac_display whose layer buffers should be shrunk.
+ *
+ * @return
+ *     The number of bytes released.
+ */
+size_t guac_display_reclaim_memory(guac_display* display);
+
+/**
+ * Shrinks the image buffers of the guac_display most recently allocated for
+ * the given guac_client, exactly as guac_display_reclaim_memory() would. If
+ * the given guac_client currently has no guac_display, this function has no
+ * effect.
+ *
+ * @param client
+ *     The guac_client whose guac_display should have its layer buffers
+ *     shrunk.
+ *
+ * @return
+ *     The number of bytes released.
+ */
+size_t guac_display_reclaim_client_memory(guac_client* client);
+
 /**
  * Returns the default layer for the given display. The default layer is the
  * only layer that always exists and serves as the root-level layer for all
@@ -438,7 +768,10 @@ guac_display_layer* guac_display_cursor(guac_display* display);
 
 /**
  * Sets the remote mouse cursor to the given built-in cursor icon. This
- * function automatically invokes guac_display_end_mouse_frame().
+ * function automatically invokes guac_display_end_mouse_frame(). Each built-in
+ * cursor icon is sent to connected users only once, and is encoded only once
+ * per process, such that switching between built-in cursor icons costs only a
+ * single "cursor" instruction.
  *
  * Callers should consider using guac_display_end_mouse_frame() to update
  * connected users as soon as all changes to the mouse cursor are completed.
@@ -476,6 +809,41 @@ void guac_display_set_cursor(guac_display* display,
  */
 void guac_display_set_cursor_hotspot(guac_display* display, int x, int y);
 
+/**
+ * Sets the remote mouse cursor to the entire contents of the given buffer,
+ * with the given hotspot. Unlike drawing to the layer returned by
+ * guac_display_cursor(), this does not require the cursor image to be encoded
+ * and sent again. Once the buffer has been sent to connected users, changing
+ * the cursor to that buffer costs only a single "cursor" instruction. This
+ * makes it possible to cache frequently-used cursors within buffers allocated
+ * with guac_display_alloc_buffer().
+ *
+ * The given buffer remains the mouse cursor until this function is invoked
+ * again, until the layer returned by guac_display_cursor() is modified (such
+ * as by guac_display_set_cursor()), or until the buffer is freed. Any
+ * modifications to the buffer while it is the mouse cursor will be reflected
+ * in the mouse cursor. Changes take effect after the current pending frame is
+ * complete.
+ *
+ * Callers should consider using guac_display_end_mouse_frame() to update
+ * connected users as soon as all changes to the mouse cursor are completed.
+ *
+ * @param display
+ *     The guac_display to set the cursor of.
+ *
+ * @param buffer
+ *     The buffer containing the desired mouse cursor image, as allocated with
+ *     guac_display_alloc_buffer().
+ *
+ * @param hotspot_x
+ *     The X coordinate of the cursor hotspot, in pixels.
+ *
+ * @param hotspot_y
+ *     The Y coordinate of the cursor hotspot, in pixels.
+ */
+void guac_display_set_cursor_buffer(guac_display* display,
+        guac_display_layer* buffer, int hotspot_x, int hotspot_y);
+
 /**
  * Stores the current bounding rectangle of the given layer in the given
  * guac_rect. The boundary stored will be the boundary of the current pending
@@ -653,6 +1021,60 @@ guac_display_layer_raw_context* guac_display_layer_open_raw(guac_display_layer*
  */
 void guac_display_layer_close_raw(guac_display_layer* layer, guac_display_layer_raw_context* context);
 
+/**
+ * Records that the given rectangle of the layer associated with the given raw
+ * context has been modified, updating both the dirty rect and the list of
+ * distinct modified regions of that context. If the context already tracks
+ * GUAC_DISPLAY_LAYER_MAX_DAMAGE regions, or if the given rectangle is close
+ * enough to an existing region that processing them together is cheaper,
+ * the rectangle is coalesced with an existing region.
+ *
+ * This function is invoked automatically by
+ * guac_display_layer_raw_context_set() and
+ * guac_display_layer_raw_context_put(), and need only be invoked manually if
+ * the buffer of the context is modified directly.
+ *
+ * @param context
+ *     The raw context of the layer that was modified.
+ *
+ * @param rect
+ *     The rectangular region that was modified.
+ */
+void guac_display_layer_raw_context_damage(guac_display_layer_raw_context* context,
+        const guac_rect* rect);
+
+/**
+ * Records that the given rectangle of the layer associated with the given raw
+ * context has been overwritten with a copy of another region of the same
+ * layer, such as by a blit described exactly by the remote desktop server.
+ * The destination rectangle is recorded as modified as if by
+ * guac_display_layer_raw_context_damage().
+ *
+ * When the frame is flushed, draws within the destination rectangle are sent
+ * as copies from the previous frame wherever the image data of the
+ * corresponding source region is confirmed to be identical, without needing
+ * to be found by the usual scroll/copy detection. As the hint is verified, it
+ * is harmless for the source region to have been changed since the previous
+ * frame, though the hint will then not help. If the context already tracks
+ * GUAC_DISPLAY_LAYER_MAX_COPY_HINTS hints, the hint is ignored.
+ *
+ * @param context
+ *     The raw context of the layer that was modified.
+ *
+ * @param dest
+ *     The rectangular region that was overwritten by the copy.
+ *
+ * @param src_x
+ *     The X coordinate of the upper-left corner of the region that was
+ *     copied.
+ *
+ * @param src_y
+ *     The Y coordinate of the upper-left corner of the region that was
+ *     copied.
+ */
+void guac_display_layer_raw_context_copy_hint(guac_display_layer_raw_context* context,
+        const guac_rect* dest, int src_x, int src_y);
+
 /**
  * Fills a rectangle of image data within the given raw context with a single
  * color. All pixels within the rectangle are replaced with the given color. If
@@ -795,6 +1217,26 @@ void guac_display_render_thread_notify_modified(guac_display_render_thread* rend
  */
 void guac_display_render_thread_notify_frame(guac_display_render_thread* render_thread);
 
+/**
+ * Waits for the given render thread to flush all graphical changes that it has
+ * been notified of, and for any frame currently being sent to users to finish
+ * being sent. As the render thread paces frames against the processing lag of
+ * users, this allows callers to request further updates from a remote desktop
+ * server no faster than users can actually receive them.
+ *
+ * @param render_thread
+ *     The render thread to wait for.
+ *
+ * @param msec_timeout
+ *     The maximum number of milliseconds to wait.
+ *
+ * @return
+ *     Non-zero if all changes have been flushed and no frame is currently
+ *     being sent, zero if the timeout elapsed first.
+ */
+int guac_display_render_thread_wait_for_frame(guac_display_render_thread* render_thread,
+        unsigned int msec_timeout);
+
 /**
  * Notifies the given render thread that a specific user has changed the state
  * of the mouse, such as through moving the pointer or pressing/releasing a
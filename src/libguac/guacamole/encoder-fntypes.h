@@ -0,0 +1,213 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_ENCODER_FNTYPES_H
+#define GUAC_ENCODER_FNTYPES_H
+
+/**
+ * Function type definitions related to pluggable image encoder backends.
+ *
+ * @file encoder-fntypes.h
+ */
+
+#include "encoder-types.h"
+#include "timestamp-types.h"
+
+#include <cairo/cairo.h>
+#include <stddef.h>
+
+/**
+ * Handler which receives encoded image data from an encoder backend. Data
+ * may be provided across any number of calls, and is concatenated in order.
+ *
+ * @param data
+ *     The arbitrary data provided to the encoding handler along with this
+ *     write handler.
+ *
+ * @param buffer
+ *     The encoded image data to write.
+ *
+ * @param length
+ *     The number of bytes of encoded image data within the buffer.
+ */
+typedef void guac_encoder_write_handler(void* data,
+        const void* buffer, size_t length);
+
+/**
+ * Handler which encodes the given surface as a JPEG image. This handler may
+ * be invoked concurrently from multiple threads. If this handler fails, any
+ * data it has written is discarded and the image is instead encoded in
+ * software.
+ *
+ * @param encoder
+ *     The encoder backend being asked to encode the surface.
+ *
+ * @param surface
+ *     The surface to encode, which will always be in CAIRO_FORMAT_RGB24.
+ *
+ * @param quality
+ *     The requested JPEG quality, from 0 to 100 inclusive.
+ *
+ * @param write_handler
+ *     The handler which must receive all encoded data.
+ *
+ * @param data
+ *     Arbitrary data which must be passed to the write handler.
+ *
+ * @return
+ *     Zero if the surface was encoded successfully, non-zero otherwise.
+ */
+typedef int guac_encoder_jpeg_handler(guac_encoder* encoder,
+        cairo_surface_t* surface, int quality,
+        guac_encoder_write_handler* write_handler, void* data);
+
+/**
+ * Handler which encodes the given surface as a WebP image. This handler may
+ * be invoked concurrently from multiple threads. If this handler fails, any
+ * data it has written is discarded and the image is instead encoded in
+ * software.
+ *
+ * @param encoder
+ *     The encoder backend being asked to encode the surface.
+ *
+ * @param surface
+ *     The surface to encode, which will be in either CAIRO_FORMAT_RGB24 or
+ *     CAIRO_FORMAT_ARGB32.
+ *
+ * @param quality
+ *     The requested WebP quality, from 0 to 100 inclusive.
+ *
+ * @param lossless
+ *     Non-zero if the surface must be encoded losslessly, zero otherwise.
+ *
+ * @param write_handler
+ *     The handler which must receive all encoded data.
+ *
+ * @param data
+ *     Arbitrary data which must be passed to the write handler.
+ *
+ * @return
+ *     Zero if the surface was encoded successfully, non-zero otherwise.
+ */
+typedef int guac_encoder_webp_handler(guac_encoder* encoder,
+        cairo_surface_t* surface, int quality, int lossless,
+        guac_encoder_write_handler* write_handler, void* data);
+
+/**
+ * Handler which begins a new video stream of the given dimensions, returning
+ * an opaque session which will be passed to all subsequent video handlers for
+ * that stream. This handler may be invoked concurrently from multiple
+ * threads, though calls involving the same session are always serialized.
+ *
+ * @param encoder
+ *     The encoder backend being asked to begin a video stream.
+ *
+ * @param width
+ *     The width of each frame of the video, in pixels. This will always be
+ *     even.
+ *
+ * @param height
+ *     The height of each frame of the video, in pixels. This will always be
+ *     even.
+ *
+ * @return
+ *     A new, backend-specific video session, or NULL if a video stream of the
+ *     given dimensions cannot be encoded.
+ */
+typedef void* guac_encoder_video_begin_handler(guac_encoder* encoder,
+        int width, int height);
+
+/**
+ * Handler which encodes the given surface as the next frame of an in-progress
+ * video stream. If this handler fails, the video stream is ended and the
+ * region it covered is again updated using images.
+ *
+ * @param encoder
+ *     The encoder backend that began the video stream.
+ *
+ * @param session
+ *     The video session returned by the video begin handler.
+ *
+ * @param frame
+ *     The surface to encode, which will always be in CAIRO_FORMAT_RGB24 and
+ *     have the dimensions given when the video stream began.
+ *
+ * @param timestamp
+ *     The time that the frame was rendered.
+ *
+ * @param write_handler
+ *     The handler which must receive all encoded data.
+ *
+ * @param data
+ *     Arbitrary data which must be passed to the write handler.
+ *
+ * @return
+ *     Zero if the frame was encoded successfully, non-zero otherwise.
+ */
+typedef int guac_encoder_video_frame_handler(guac_encoder* encoder,
+        void* session, cairo_surface_t* frame, guac_timestamp timestamp,
+        guac_encoder_write_handler* write_handler, void* data);
+
+/**
+ * Handler which ends an in-progress video stream, writing any remaining
+ * encoded data and freeing the associated session.
+ *
+ * @param encoder
+ *     The encoder backend that began the video stream.
+ *
+ * @param session
+ *     The video session returned by the video begin handler.
+ *
+ * @param write_handler
+ *     The handler which must receive any remaining encoded data, or NULL if
+ *     the stream is being abandoned and no further data should be written.
+ *
+ * @param data
+ *     Arbitrary data which must be passed to the write handler.
+ */
+typedef void guac_encoder_video_end_handler(guac_encoder* encoder,
+        void* session, guac_encoder_write_handler* write_handler, void* data);
+
+/**
+ * Handler which frees all resources associated with an encoder backend,
+ * excluding the guac_encoder structure itself.
+ *
+ * @param encoder
+ *     The encoder backend being freed.
+ */
+typedef void guac_encoder_free_handler(guac_encoder* encoder);
+
+/**
+ * The function exported by each encoder backend library under the name
+ * "guac_encoder_init", which initializes the given guac_encoder, typically by
+ * opening the underlying hardware and assigning the handlers of the encoding
+ * operations it supports.
+ *
+ * @param encoder
+ *     The zero-initialized encoder backend to initialize.
+ *
+ * @return
+ *     Zero if initialization succeeded, non-zero if the backend cannot be
+ *     used on this host.
+ */
+typedef int guac_encoder_init_handler(guac_encoder* encoder);
+
+#endif
+
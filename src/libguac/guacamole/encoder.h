@@ -0,0 +1,126 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_ENCODER_H
+#define GUAC_ENCODER_H
+
+/**
+ * Provides functions and structures for loading pluggable image encoder
+ * backends, which replace libguac's built-in software JPEG and WebP encoders
+ * wherever the backend supports the requested encoding, and which may
+ * additionally allow rapidly-updating regions of the display to be streamed
+ * as video.
+ *
+ * @file encoder.h
+ */
+
+#include "encoder-fntypes.h"
+#include "encoder-types.h"
+
+struct guac_encoder {
+
+    /**
+     * Arbitrary data associated with this encoder backend, such as the
+     * handle of the underlying hardware device.
+     */
+    void* data;
+
+    /**
+     * Handler which encodes surfaces as JPEG images, or NULL if JPEG encoding
+     * should always be performed in software.
+     */
+    guac_encoder_jpeg_handler* jpeg_handler;
+
+    /**
+     * Handler which encodes surfaces as WebP images, or NULL if WebP encoding
+     * should always be performed in software.
+     */
+    guac_encoder_webp_handler* webp_handler;
+
+    /**
+     * The mimetype of the video streams produced by this encoder backend, or
+     * NULL if video streams are not supported. Regions of the display that
+     * update at a high framerate are streamed as video only if all connected
+     * users support this mimetype.
+     */
+    const char* video_mimetype;
+
+    /**
+     * Handler which begins a new video stream. This must be non-NULL if
+     * video_mimetype is non-NULL.
+     */
+    guac_encoder_video_begin_handler* video_begin_handler;
+
+    /**
+     * Handler which encodes the next frame of a video stream. This must be
+     * non-NULL if video_mimetype is non-NULL.
+     */
+    guac_encoder_video_frame_handler* video_frame_handler;
+
+    /**
+     * Handler which ends a video stream. This must be non-NULL if
+     * video_mimetype is non-NULL.
+     */
+    guac_encoder_video_end_handler* video_end_handler;
+
+    /**
+     * Handler which frees all resources associated with this encoder
+     * backend, or NULL if there are no such resources.
+     */
+    guac_encoder_free_handler* free_handler;
+
+    /**
+     * Handle to the dlopen()'d library providing this encoder backend, which
+     * will be given to dlclose() when the backend is unloaded.
+     */
+    void* __plugin_handle;
+
+};
+
+/**
+ * Loads and initializes the encoder backend having the given name, replacing
+ * any previously-loaded backend. The backend is provided by the library
+ * "libguac-encoder-NAME.so", where NAME is the given name. Once loaded, all
+ * JPEG and WebP encoding within the current process is first attempted with
+ * the backend, falling back to the built-in software encoders if the backend
+ * does not support the encoding or fails.
+ *
+ * This function is not threadsafe and must be invoked before any image data
+ * is encoded, typically immediately after a connection process starts.
+ *
+ * @param name
+ *     The name of the encoder backend to load.
+ *
+ * @return
+ *     Zero if the backend was loaded successfully, non-zero otherwise, in
+ *     which case guac_error and guac_error_message are set appropriately and
+ *     software encoding remains in use.
+ */
+int guac_encoder_load(const char* name);
+
+/**
+ * Frees the currently-loaded encoder backend, if any, restoring software
+ * encoding. This function is not threadsafe and must not be invoked while
+ * any image data may be encoded.
+ */
+void guac_encoder_unload(void);
+
+#endif
+
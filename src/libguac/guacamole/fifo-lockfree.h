@@ -0,0 +1,261 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_FIFO_LOCKFREE_H
+#define GUAC_FIFO_LOCKFREE_H
+
+#include "fifo-types.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Lock-free variant of guac_fifo, supporting any number of concurrent
+ * producers and consumers without requiring either to acquire a lock.
+ * Threads block (via futex where available) only while waiting for the FIFO
+ * to become non-empty or to have space for further items.
+ *
+ * @defgroup fifo-lockfree guac_fifo_lockfree
+ * @{
+ */
+
+/**
+ * Provides a lock-free, multi-producer/multi-consumer variant of guac_fifo
+ * (guac_fifo_lockfree).
+ *
+ * @file fifo-lockfree.h
+ */
+
+struct guac_fifo_lockfree {
+
+    /**
+     * The maximum number of items that may be stored in this FIFO.
+     */
+    size_t max_items;
+
+    /**
+     * The size of each individual item, in bytes.
+     */
+    size_t item_size;
+
+    /**
+     * The position of the next item to be removed from this FIFO. Positions
+     * increase monotonically; the index of the corresponding item within the
+     * items array is this position modulo max_items.
+     */
+    size_t head;
+
+    /**
+     * The position that will receive the next item added to this FIFO.
+     */
+    size_t tail;
+
+    /**
+     * Non-zero if this FIFO has been invalidated, zero otherwise.
+     */
+    int invalid;
+
+    /**
+     * Counter that is incremented whenever an item is added to this FIFO
+     * while any thread is waiting for the FIFO to become non-empty. Waiting
+     * threads sleep until this value changes.
+     */
+    unsigned int nonempty_event;
+
+    /**
+     * The number of threads currently waiting for this FIFO to become
+     * non-empty.
+     */
+    unsigned int nonempty_waiters;
+
+    /**
+     * Counter that is incremented whenever an item is removed from this FIFO
+     * while any thread is waiting for space to become available. Waiting
+     * threads sleep until this value changes.
+     */
+    unsigned int ready_event;
+
+    /**
+     * The number of threads currently waiting for space to become available
+     * within this FIFO.
+     */
+    unsigned int ready_waiters;
+
+    /**
+     * Mutex used to sleep while waiting for nonempty_event or ready_event to
+     * change on platforms lacking futexes. This mutex is never acquired when
+     * adding or removing items unless some thread is waiting.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition signalled whenever nonempty_event or ready_event changes on
+     * platforms lacking futexes.
+     */
+    pthread_cond_t changed;
+
+    /**
+     * The offset of the first byte of the implementation-specific array of
+     * items within this FIFO, relative to the first byte of the
+     * guac_fifo_lockfree structure.
+     */
+    ssize_t items_offset;
+
+    /**
+     * The offset of the first byte of the array of per-item sequence numbers
+     * used to coordinate access to each item, relative to the first byte of
+     * the guac_fifo_lockfree structure.
+     */
+    ssize_t sequences_offset;
+
+};
+
+/**
+ * Initializes the given guac_fifo_lockfree such that it may be safely
+ * included in shared memory and accessed by multiple processes. This function
+ * MUST be invoked once (and ONLY once) for each guac_fifo_lockfree being
+ * used, and MUST be invoked before any such FIFO is used.
+ *
+ * The FIFO is empty upon initialization.
+ *
+ * @param fifo
+ *     The FIFO to initialize.
+ *
+ * @param items
+ *     The storage that the FIFO should use for queued items. This storage
+ *     MUST be large enough to contain the maximum number of items as a
+ *     contiguous array.
+ *
+ * @param sequences
+ *     The storage that the FIFO should use to coordinate access to each
+ *     item. This storage MUST be an array of max_items size_t values.
+ *
+ * @param max_items
+ *     The maximum number of items supported by the provided storage.
+ *
+ * @param item_size
+ *     The number of bytes required for each individual item in storage.
+ */
+void guac_fifo_lockfree_init(guac_fifo_lockfree* fifo, void* items,
+        size_t* sequences, size_t max_items, size_t item_size);
+
+/**
+ * Releases all underlying resources used by the given guac_fifo_lockfree.
+ * The given guac_fifo_lockfree MAY NOT be used after this function has been
+ * called, and no thread may be blocked within any other function of this
+ * FIFO when it is called.
+ *
+ * This function does NOT free() the given guac_fifo_lockfree pointer.
+ *
+ * @param fifo
+ *     The FIFO to destroy.
+ */
+void guac_fifo_lockfree_destroy(guac_fifo_lockfree* fifo);
+
+/**
+ * Marks the given FIFO as invalid, preventing any further additions or
+ * removals from the FIFO. Attempts to add/remove items from the FIFO from
+ * this point forward will fail immediately, as will any outstanding attempts
+ * that are currently blocked.
+ *
+ * @param fifo
+ *     The FIFO to invalidate.
+ */
+void guac_fifo_lockfree_invalidate(guac_fifo_lockfree* fifo);
+
+/**
+ * Returns whether the given FIFO is still valid. A FIFO is valid if it has
+ * not yet been invalidated through a call to guac_fifo_lockfree_invalidate().
+ *
+ * @param fifo
+ *     The FIFO to test.
+ *
+ * @return
+ *     Non-zero if the given FIFO is still valid, zero otherwise.
+ */
+int guac_fifo_lockfree_is_valid(guac_fifo_lockfree* fifo);
+
+/**
+ * Adds a copy of the given item to the end of the given FIFO, and wakes any
+ * thread waiting for the FIFO to become non-empty. If there is insufficient
+ * space in the FIFO, this function will block until space is available. If
+ * the FIFO is invalid or becomes invalid, this function returns immediately.
+ *
+ * @param fifo
+ *     The FIFO to add an item to.
+ *
+ * @param item
+ *     The item to add.
+ *
+ * @return
+ *     Non-zero if the item was successfully added, zero if items cannot be
+ *     added to the FIFO because the FIFO has been invalidated.
+ */
+int guac_fifo_lockfree_enqueue(guac_fifo_lockfree* fifo, const void* item);
+
+/**
+ * Removes the oldest (first) item from the FIFO, storing a copy of that item
+ * within the provided buffer. If the FIFO is currently empty, this function
+ * will block until at least one item has been added to the FIFO or until the
+ * FIFO becomes invalid.
+ *
+ * @param fifo
+ *     The FIFO to remove an item from.
+ *
+ * @param item
+ *     The buffer that should receive a copy of the removed item.
+ *
+ * @return
+ *     Non-zero if an item was successfully removed, zero if items cannot be
+ *     removed from the FIFO because the FIFO has been invalidated.
+ */
+int guac_fifo_lockfree_dequeue(guac_fifo_lockfree* fifo, void* item);
+
+/**
+ * Removes the oldest (first) item from the FIFO, storing a copy of that item
+ * within the provided buffer. If the FIFO is currently empty, this function
+ * will block until at least one item has been added to the FIFO, until the
+ * given timeout has elapsed, or until the FIFO becomes invalid. A timeout of
+ * zero never blocks.
+ *
+ * @param fifo
+ *     The FIFO to remove an item from.
+ *
+ * @param item
+ *     The buffer that should receive a copy of the removed item.
+ *
+ * @param msec_timeout
+ *     The maximum number of milliseconds to wait for at least one item to be
+ *     present within the FIFO (or for the FIFO to become invalid).
+ *
+ * @return
+ *     Non-zero if an item was successfully removed, zero if the timeout has
+ *     elapsed or if items cannot be removed from the FIFO because the FIFO has
+ *     been invalidated.
+ */
+int guac_fifo_lockfree_timed_dequeue(guac_fifo_lockfree* fifo,
+        void* item, int msec_timeout);
+
+/**
+ * @}
+ */
+
+#endif
+
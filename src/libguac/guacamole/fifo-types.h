@@ -45,6 +45,15 @@
  */
 typedef struct guac_fifo guac_fifo;
 
+/**
+ * Lock-free variant of guac_fifo which supports any number of concurrent
+ * producers and consumers. Like guac_fifo, each implementation must provide
+ * storage for the underlying array of items, along with storage for the
+ * per-item sequence numbers used to coordinate lock-free access, through a
+ * call to guac_fifo_lockfree_init().
+ */
+typedef struct guac_fifo_lockfree guac_fifo_lockfree;
+
 /**
  * @}
  */
@@ -0,0 +1,101 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_OPCODE_H
+#define GUAC_OPCODE_H
+
+/**
+ * Provides a hash-based index for quickly locating the entry associated with
+ * a particular instruction opcode within a table of instruction handlers.
+ *
+ * @file opcode.h
+ */
+
+#include <stddef.h>
+
+/**
+ * The number of slots within each guac_opcode_index. This value must be a
+ * power of two, and must be greater than the number of entries within any
+ * indexed table.
+ */
+#define GUAC_OPCODE_INDEX_SIZE 128
+
+/**
+ * Hash-based index of the entries of a table of instruction handlers, each
+ * entry of which begins with the opcode (a null-terminated string) associated
+ * with that entry. The table is terminated by an entry whose opcode is NULL.
+ * Once built with guac_opcode_index_init(), an index is never modified and
+ * may be safely used by any number of threads.
+ */
+typedef struct guac_opcode_index {
+
+    /**
+     * Hash table of entries, using linear probing to resolve collisions.
+     * Each slot contains one plus the position of an entry within the
+     * indexed table, or 0 if the slot is unused.
+     */
+    unsigned char slots[GUAC_OPCODE_INDEX_SIZE];
+
+} guac_opcode_index;
+
+/**
+ * Builds a hash-based index of all entries within the given table of
+ * instruction handlers. Each entry of the table must begin with a pointer to
+ * the opcode of that entry, and the table must be terminated by an entry
+ * whose opcode is NULL.
+ *
+ * @param index
+ *     The guac_opcode_index to initialize.
+ *
+ * @param table
+ *     The table of instruction handlers to index.
+ *
+ * @param entry_size
+ *     The size of each entry within the table, in bytes.
+ */
+void guac_opcode_index_init(guac_opcode_index* index, const void* table,
+        size_t entry_size);
+
+/**
+ * Locates the entry having the given opcode within the table of instruction
+ * handlers previously indexed with guac_opcode_index_init(). Regardless of
+ * the number of entries present, only the entry (or entries) sharing the
+ * hash of the given opcode are compared against that opcode.
+ *
+ * @param index
+ *     The index previously built for the given table.
+ *
+ * @param table
+ *     The table of instruction handlers that was indexed.
+ *
+ * @param entry_size
+ *     The size of each entry within the table, in bytes.
+ *
+ * @param opcode
+ *     The opcode to search for.
+ *
+ * @return
+ *     A pointer to the entry having the given opcode, or NULL if no such
+ *     entry exists.
+ */
+const void* guac_opcode_index_find(const guac_opcode_index* index,
+        const void* table, size_t entry_size, const char* opcode);
+
+#endif
+
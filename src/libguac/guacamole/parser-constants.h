@@ -27,10 +27,25 @@
  */
 
 /**
- * The maximum number of characters per instruction.
+ * The default maximum number of characters per instruction element. This
+ * limit may be raised for a particular parser with
+ * guac_parser_set_max_length().
  */
 #define GUAC_INSTRUCTION_MAX_LENGTH 8192
 
+/**
+ * The largest value that may be given to guac_parser_set_max_length().
+ */
+#define GUAC_INSTRUCTION_MAX_LENGTH_LIMIT 1048576
+
+/**
+ * The maximum number of bytes within a single UTF-8 character. The
+ * instruction buffer of each parser is sized such that an element of the
+ * maximum allowed length can be buffered even if every character within that
+ * element is this long.
+ */
+#define GUAC_INSTRUCTION_MAX_CHAR_BYTES 4
+
 /**
  * The maximum number of digits to allow per length prefix.
  */
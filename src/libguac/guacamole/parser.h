@@ -30,6 +30,8 @@
 #include "parser-constants.h"
 #include "socket-types.h"
 
+#include <stddef.h>
+
 struct guac_parser {
 
     /**
@@ -78,12 +80,23 @@ struct guac_parser {
      */
     char* __instructionbuf_unparsed_end;
 
+    /**
+     * The maximum number of characters allowed within any one element of an
+     * instruction. Elements longer than this result in a parse error.
+     */
+    int __max_length;
+
+    /**
+     * The size of the instruction buffer, in bytes.
+     */
+    size_t __instructionbuf_size;
+
     /**
      * The instruction buffer. This is essentially the input buffer,
      * provided as a convenience to be used to buffer instructions until
      * those instructions are complete and ready to be parsed.
      */
-    char __instructionbuf[32768];
+    char* __instructionbuf;
 
 };
 
@@ -95,6 +108,31 @@ struct guac_parser {
  */
 guac_parser* guac_parser_alloc(void);
 
+/**
+ * Sets the maximum number of characters allowed within any one element of
+ * the instructions read by the given parser, growing the parser's internal
+ * buffer as necessary. By default, this limit is GUAC_INSTRUCTION_MAX_LENGTH.
+ * Raising this limit allows larger blobs of data to be received in a single
+ * instruction, reducing per-instruction overhead for bulk transfers like file
+ * uploads, at the cost of memory. Any data already buffered by the parser,
+ * including any partially-parsed instruction, is preserved.
+ *
+ * @param parser
+ *     The parser whose maximum element length should be set.
+ *
+ * @param max_length
+ *     The maximum number of characters to allow within any one element. This
+ *     value must be positive and may not exceed
+ *     GUAC_INSTRUCTION_MAX_LENGTH_LIMIT.
+ *
+ * @return
+ *     Zero if the limit was set successfully, or non-zero if the given limit
+ *     is invalid or memory for the larger buffer could not be allocated, in
+ *     which case guac_error is set appropriately and the parser is left
+ *     unchanged.
+ */
+int guac_parser_set_max_length(guac_parser* parser, int max_length);
+
 /**
  * Appends data from the given buffer to the given parser. The data will be
  * appended, if possible, to the in-progress instruction as a reference and
@@ -161,6 +199,36 @@ void guac_parser_free(guac_parser* parser);
  */
 int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout);
 
+/**
+ * Reads a single instruction directly from the given buffer, without copying
+ * that instruction into the parser's internal buffer. The opcode and
+ * arguments of the instruction read point directly into the given buffer,
+ * which is modified in-place and must remain valid until the next instruction
+ * is read. This allows instructions within large, memory-mapped files to be
+ * parsed without first being copied. The internal buffer of the parser is
+ * neither used nor modified.
+ *
+ * If an error occurs reading the instruction, including if the buffer ends
+ * before a complete instruction has been read, -1 is returned and guac_error
+ * is set appropriately. If the buffer ends before a complete instruction is
+ * read, guac_error will be set to GUAC_STATUS_CLOSED.
+ *
+ * @param parser
+ *     The guac_parser to use to parse the instruction.
+ *
+ * @param buffer
+ *     The buffer containing the instruction to read, beginning with the first
+ *     byte of that instruction.
+ *
+ * @param length
+ *     The number of bytes available within the buffer.
+ *
+ * @return
+ *     The number of bytes of the buffer occupied by the instruction read, or
+ *     -1 if no instruction could be read.
+ */
+int guac_parser_parse(guac_parser* parser, void* buffer, size_t length);
+
 /**
  * Reads a single instruction from the given guac_socket. This operates
  * identically to guac_parser_read(), except that an error is returned if
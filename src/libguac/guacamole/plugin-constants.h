@@ -21,7 +21,7 @@
 #define _GUAC_PLUGIN_CONSTANTS_H
 
 /**
- * Constants related to client plugins.
+ * Constants related to client plugins and encoder backends.
  *
  * @file plugin-constants.h
  */
@@ -57,5 +57,22 @@
                                                                        \
 )
 
+/**
+ * String prefix which begins the library filename of all encoder backends.
+ */
+#define GUAC_ENCODER_LIBRARY_PREFIX "libguac-encoder-"
+
+/**
+ * String suffix which ends the library filename of all encoder backends.
+ */
+#define GUAC_ENCODER_LIBRARY_SUFFIX ".so"
+
+/**
+ * The maximum number of characters (INCLUDING NULL TERMINATOR) that a
+ * character array containing the concatenation of the encoder backend library
+ * prefix, backend name, and suffix can contain.
+ */
+#define GUAC_ENCODER_LIBRARY_LIMIT 256
+
 #endif
 
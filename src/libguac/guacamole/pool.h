@@ -29,7 +29,33 @@
 
 #include "pool-types.h"
 
-#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * The number of integers tracked by each block of the bitmap of freed
+ * integers within a guac_pool. Blocks are allocated only as needed, the first
+ * time an integer within that block is freed.
+ */
+#define GUAC_POOL_BLOCK_SIZE 4096
+
+/**
+ * The number of 64-bit words within each block of the bitmap of freed
+ * integers within a guac_pool.
+ */
+#define GUAC_POOL_BLOCK_WORDS (GUAC_POOL_BLOCK_SIZE / 64)
+
+/**
+ * The number of blocks referenced by each second-level directory of the
+ * bitmap of freed integers within a guac_pool.
+ */
+#define GUAC_POOL_DIRECTORY_SIZE 1024
+
+/**
+ * The number of second-level directories of the bitmap of freed integers
+ * within a guac_pool. This value is chosen such that every non-negative int
+ * can be represented.
+ */
+#define GUAC_POOL_DIRECTORIES 512
 
 struct guac_pool {
 
@@ -41,45 +67,42 @@ struct guac_pool {
     int min_size;
 
     /**
-     * The number of integers currently in use.
+     * The number of integers currently in use. This value is updated
+     * atomically.
      */
     int active;
 
     /**
      * The next integer to be released (after no more integers remain in the
-     * pool.
+     * pool). This value is updated atomically.
      */
     int __next_value;
 
     /**
-     * The first integer in the pool, if any.
-     */
-    guac_pool_int* __head;
-
-    /**
-     * The last integer in the pool, if any.
-     */
-    guac_pool_int* __tail;
-
-    /**
-     * Lock which is acquired when the pool is being modified or accessed.
+     * The number of freed integers within the bitmap that have not yet been
+     * claimed for reuse. This value is updated atomically.
      */
-    pthread_mutex_t __lock;
-
-};
-
-struct guac_pool_int {
+    int __free_count;
 
     /**
-     * The integer value of this pool entry.
+     * The integer at which the next search of the bitmap for a freed integer
+     * should begin. Searches proceed in order from this point, wrapping back
+     * around to zero, such that freed integers are reused roughly in the
+     * order they were freed rather than immediately. This value is updated
+     * atomically.
      */
-    int value;
+    int __free_cursor;
 
     /**
-     * The next available (unused) guac_pool_int in the list of
-     * allocated but free'd ints.
+     * Bitmap of freed integers, in which each set bit represents an integer
+     * that has been freed and may be reused. The bitmap is divided into
+     * blocks of GUAC_POOL_BLOCK_SIZE bits, referenced through directories of
+     * GUAC_POOL_DIRECTORY_SIZE blocks each. Directories and blocks are
+     * allocated when first needed, installed atomically, and never freed or
+     * moved until the pool itself is freed, such that the bitmap can be
+     * safely searched and modified without a lock.
      */
-    guac_pool_int* __next;
+    uint64_t** __free_bitmap[GUAC_POOL_DIRECTORIES];
 
 };
 
@@ -324,6 +324,25 @@ int guac_protocol_send_nop(guac_socket* socket);
  */
 int guac_protocol_send_ready(guac_socket* socket, const char* id);
 
+/**
+ * Sends a compact instruction over the given guac_socket connection,
+ * acknowledging that all further instructions sent over the connection will
+ * be in the compact form of the protocol having the given version.
+ *
+ * If an error occurs sending the instruction, a non-zero value is
+ * returned, and guac_error is set appropriately.
+ *
+ * @param socket
+ *     The guac_socket connection to use.
+ *
+ * @param version
+ *     The version of the compact form of the protocol that will be used.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+int guac_protocol_send_compact(guac_socket* socket, const char* version);
+
 /**
  * Sends a set instruction over the given guac_socket connection.
  *
@@ -21,6 +21,14 @@
 #define GUAC_RECORDING_H
 
 #include <guacamole/client.h>
+#include <guacamole/display-types.h>
+#include <guacamole/flag.h>
+#include <guacamole/parser-types.h>
+#include <guacamole/socket-types.h>
+#include <guacamole/timestamp-types.h>
+#include <guacamole/user.h>
+
+#include <pthread.h>
 
 /**
  * Provides functions and structures to be use for session recording.
@@ -48,6 +56,195 @@
  */
 #define GUAC_COMMON_RECORDING_MAX_NAME_LENGTH 2048
 
+/**
+ * The number of milliseconds between keyframes within a compressed session
+ * recording, if keyframes are being produced.
+ */
+#define GUAC_RECORDING_KEYFRAME_INTERVAL 30000
+
+/**
+ * The number of bytes of a memory-mapped recording that are hinted to the
+ * kernel as needed ahead of the current read position, and that are released
+ * behind the current read position, as the recording is read.
+ */
+#define GUAC_RECORDING_MAP_WINDOW 16777216
+
+/**
+ * The suffix appended to the filename of a session recording to produce the
+ * filename of its input event sidecar, if one is written.
+ */
+#define GUAC_RECORDING_EVENTS_SUFFIX ".events"
+
+/**
+ * The flag set on the keyframe_state of a guac_recording when the thread
+ * producing keyframes for that recording should stop.
+ */
+#define GUAC_RECORDING_KEYFRAMES_STOPPING 1
+
+/**
+ * The flag set on the output_state of a guac_recording when the thread
+ * recording output directly from a guac_display should stop.
+ */
+#define GUAC_RECORDING_OUTPUT_STOPPING 1
+
+/**
+ * The maximum number of frames per second that may be recorded when output
+ * is recorded directly from a guac_display.
+ */
+#define GUAC_RECORDING_MAX_OUTPUT_RATE 60
+
+/**
+ * The format of the file written for a session recording.
+ */
+typedef enum guac_recording_format {
+
+    /**
+     * The raw Guacamole protocol data of the session, exactly as sent to
+     * connected users. This is the default, and is understood by all
+     * existing tools.
+     */
+    GUAC_RECORDING_FORMAT_RAW,
+
+    /**
+     * A container of zstd-compressed chunks of protocol data, along with
+     * periodic keyframes and an index of those keyframes, allowing playback
+     * to begin at any point in time without reading the entire recording.
+     * This format is available only if libguac was built with zstd support,
+     * and must be read using guac_recording_open_reader().
+     */
+    GUAC_RECORDING_FORMAT_COMPRESSED
+
+} guac_recording_format;
+
+/**
+ * The behavior of a session recording when data is written to the recording
+ * faster than it can be written to the recording file. Data is always first
+ * buffered in memory, with the recording file being written by a background
+ * thread.
+ */
+typedef enum guac_recording_overflow {
+
+    /**
+     * Block the thread writing to the recording until the recording file has
+     * caught up. No data is lost, but the session stalls while the recording
+     * file is slow. This is the default.
+     */
+    GUAC_RECORDING_OVERFLOW_BLOCK,
+
+    /**
+     * Discard any instruction which does not fit in memory. The session never
+     * stalls, but the recording will be missing those instructions.
+     */
+    GUAC_RECORDING_OVERFLOW_DROP,
+
+    /**
+     * Write any data which does not fit in memory to a local temporary file,
+     * copying that data to the recording file once the recording file has
+     * caught up. No data is lost and the session does not stall on the
+     * recording file itself, at the cost of local disk usage.
+     */
+    GUAC_RECORDING_OVERFLOW_SPILL
+
+} guac_recording_overflow;
+
+/**
+ * The type of an input event stored within the input event sidecar of a
+ * session recording.
+ */
+typedef enum guac_recording_event_type {
+
+    /**
+     * A key was pressed or released.
+     */
+    GUAC_RECORDING_EVENT_KEY = 'K',
+
+    /**
+     * The mouse moved or its buttons changed state.
+     */
+    GUAC_RECORDING_EVENT_MOUSE = 'M',
+
+    /**
+     * A touch contact changed state.
+     */
+    GUAC_RECORDING_EVENT_TOUCH = 'T'
+
+} guac_recording_event_type;
+
+/**
+ * A single input event stored within the input event sidecar of a session
+ * recording. Only the members relevant to the type of the event are
+ * meaningful; all others are zero.
+ */
+typedef struct guac_recording_event {
+
+    /**
+     * The type of the event.
+     */
+    guac_recording_event_type type;
+
+    /**
+     * The time at which the event occurred.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The X11 keysym of the key pressed or released (key events only).
+     */
+    int keysym;
+
+    /**
+     * Non-zero if the key was pressed, zero if it was released (key events
+     * only).
+     */
+    int pressed;
+
+    /**
+     * The X coordinate of the mouse cursor or touch contact, in pixels (mouse
+     * and touch events only).
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the mouse cursor or touch contact, in pixels (mouse
+     * and touch events only).
+     */
+    int y;
+
+    /**
+     * The current state of each mouse button, as would be passed to
+     * guac_recording_report_mouse() (mouse events only).
+     */
+    int button_mask;
+
+    /**
+     * The ID of the touch contact (touch events only).
+     */
+    int id;
+
+    /**
+     * The X radius of the touch contact, in pixels (touch events only).
+     */
+    int x_radius;
+
+    /**
+     * The Y radius of the touch contact, in pixels (touch events only).
+     */
+    int y_radius;
+
+    /**
+     * The rough angle of clockwise rotation of the touch contact, in degrees
+     * (touch events only).
+     */
+    double angle;
+
+    /**
+     * The relative force exerted by the touch contact, from 0 to 1 (touch
+     * events only).
+     */
+    double force;
+
+} guac_recording_event;
+
 /**
  * An in-progress session recording, attached to a guac_client instance such
  * that output Guacamole instructions may be dynamically intercepted and
@@ -95,6 +292,65 @@ typedef struct guac_recording {
      */
     int include_keys;
 
+    /**
+     * The format of the recording file.
+     */
+    guac_recording_format format;
+
+    /**
+     * The guac_socket which writes to the input event sidecar of the
+     * recording, or NULL if no sidecar is being written. Only the events
+     * that the recording is configured to include are written to the
+     * sidecar.
+     */
+    guac_socket* events;
+
+    /**
+     * The display from which keyframes are periodically produced, or NULL if
+     * keyframes are not currently being produced.
+     */
+    guac_display* keyframe_display;
+
+    /**
+     * The current state of the thread producing keyframes, with the
+     * GUAC_RECORDING_KEYFRAMES_STOPPING flag set when that thread should
+     * stop.
+     */
+    guac_flag keyframe_state;
+
+    /**
+     * The thread producing keyframes, valid only while keyframe_display is
+     * non-NULL.
+     */
+    pthread_t keyframe_thread;
+
+    /**
+     * The maximum number of frames per second of output to record directly
+     * from the guac_display given to guac_recording_start_output(), or zero
+     * if output is instead copied from the socket broadcasting to all
+     * connected users.
+     */
+    int output_rate;
+
+    /**
+     * The display from which output is currently being recorded, or NULL if
+     * output is not currently being recorded directly from a display.
+     */
+    guac_display* output_display;
+
+    /**
+     * The current state of the thread recording output from output_display,
+     * with the GUAC_RECORDING_OUTPUT_STOPPING flag set when that thread
+     * should stop.
+     */
+    guac_flag output_state;
+
+    /**
+     * The thread recording output from output_display, valid only while
+     * output_display is non-NULL.
+     */
+    pthread_t output_thread;
+
 } guac_recording;
 
 /**
@@ -152,6 +408,35 @@ typedef struct guac_recording {
  *     Non-zero if writing to an existing file should be allowed, or zero
  *     otherwise.
  *
+ * @param write_events
+ *     Non-zero if each included mouse, touch, and key event should also be
+ *     written to a compact binary sidecar alongside the recording, named
+ *     after the recording file with GUAC_RECORDING_EVENTS_SUFFIX appended,
+ *     zero otherwise. The sidecar can be read far more quickly than the
+ *     recording itself using guac_recording_events_map(). If the sidecar
+ *     cannot be created, a warning is logged and the recording is written
+ *     without it.
+ *
+ * @param overflow
+ *     The behavior to use if session data is produced faster than it can be
+ *     written to the recording file.
+ *
+ * @param format
+ *     The format of the recording file. If GUAC_RECORDING_FORMAT_COMPRESSED
+ *     is requested but libguac was built without zstd support, a warning is
+ *     logged and GUAC_RECORDING_FORMAT_RAW is used instead.
+ *
+ * @param output_rate
+ *     The maximum number of frames per second of output to record directly
+ *     from a guac_display once guac_recording_start_output() is called, or
+ *     zero if output should instead be copied from the socket broadcasting to
+ *     all connected users. Output recorded from a guac_display is always
+ *     lossless and does not depend on the frame rate, image quality, or
+ *     network conditions of connected users, but contains only graphical
+ *     updates (no audio or other streams). Values greater than
+ *     GUAC_RECORDING_MAX_OUTPUT_RATE are reduced to that value. This has no
+ *     effect if include_output is zero.
+ *
  * @return
  *     A new guac_recording structure representing the in-progress
  *     recording if the recording file has been successfully created and a
@@ -160,13 +445,360 @@ typedef struct guac_recording {
 guac_recording* guac_recording_create(guac_client* client,
         const char* path, const char* name, int create_path,
         int include_output, int include_mouse, int include_touch,
-        int include_keys, int allow_write_existing);
+        int include_keys, int allow_write_existing, int write_events,
+        guac_recording_overflow overflow, guac_recording_format format,
+        int output_rate);
+
+/**
+ * Parses the recording overflow behavior stored within the given argument
+ * value, which must be "block", "drop", or "spill". If the value is blank
+ * or invalid, the default value is returned, logging a warning if the value
+ * is invalid.
+ *
+ * @param user
+ *     The user that provided the argument value.
+ *
+ * @param arg_names
+ *     A NULL-terminated array of argument names, corresponding to the
+ *     provided array of argument values.
+ *
+ * @param argv
+ *     An array of argument values.
+ *
+ * @param index
+ *     The index of the entry within the argument array which should be
+ *     parsed.
+ *
+ * @param default_value
+ *     The value to return if the provided argument is blank or invalid.
+ *
+ * @return
+ *     The recording overflow behavior stored within the specified argument.
+ */
+guac_recording_overflow guac_recording_parse_args_overflow(guac_user* user,
+        const char** arg_names, const char** argv, int index,
+        guac_recording_overflow default_value);
+
+/**
+ * Parses the recording format stored within the given argument value, which
+ * must be "raw" or "compressed". If the value is blank or invalid, the
+ * default value is returned, logging a warning if the value is invalid.
+ *
+ * @param user
+ *     The user that provided the argument value.
+ *
+ * @param arg_names
+ *     A NULL-terminated array of argument names, corresponding to the
+ *     provided array of argument values.
+ *
+ * @param argv
+ *     An array of argument values.
+ *
+ * @param index
+ *     The index of the entry within the argument array which should be
+ *     parsed.
+ *
+ * @param default_value
+ *     The value to return if the provided argument is blank or invalid.
+ *
+ * @return
+ *     The recording format stored within the specified argument.
+ */
+guac_recording_format guac_recording_parse_args_format(guac_user* user,
+        const char** arg_names, const char** argv, int index,
+        guac_recording_format default_value);
+
+/**
+ * Begins periodically writing keyframes of the given display to the given
+ * recording, one every GUAC_RECORDING_KEYFRAME_INTERVAL milliseconds, using a
+ * dedicated thread. Each keyframe is produced with guac_display_dup(). If
+ * the recording does not include output or is not compressed, this function
+ * has no effect. If keyframes are already being produced for a different
+ * display, production of those keyframes is first stopped.
+ *
+ * guac_recording_stop_keyframes() MUST be called before the given display
+ * is freed.
+ *
+ * @param recording
+ *     The recording that should receive keyframes.
+ *
+ * @param display
+ *     The display from which keyframes should be produced.
+ */
+void guac_recording_start_keyframes(guac_recording* recording,
+        guac_display* display);
+
+/**
+ * Stops production of keyframes previously started with
+ * guac_recording_start_keyframes(), waiting for any keyframe currently being
+ * produced to be written. If keyframes are not being produced, this function
+ * has no effect.
+ *
+ * @param recording
+ *     The recording that should no longer receive keyframes.
+ */
+void guac_recording_stop_keyframes(guac_recording* recording);
+
+/**
+ * Begins recording output directly from the given display, writing only the
+ * changes to that display at most output_rate times per second using a
+ * dedicated thread. Each recorded frame is produced with
+ * guac_display_record(). If the recording does not include output or was not
+ * created with a non-zero output_rate, this function has no effect. If output
+ * is already being recorded from a different display, recording from that
+ * display is first stopped.
+ *
+ * guac_recording_stop_output() MUST be called before the given display is
+ * freed.
+ *
+ * @param recording
+ *     The recording that should receive the output of the display.
+ *
+ * @param display
+ *     The display whose output should be recorded.
+ */
+void guac_recording_start_output(guac_recording* recording,
+        guac_display* display);
+
+/**
+ * Stops recording output from the display previously given to
+ * guac_recording_start_output(), first recording any changes to that display
+ * that have not yet been recorded. If output is not being recorded from a
+ * display, this function has no effect.
+ *
+ * @param recording
+ *     The recording that should no longer receive the output of its display.
+ */
+void guac_recording_stop_output(guac_recording* recording);
+
+/**
+ * Opens a new guac_socket which reads the Guacamole protocol data of the
+ * session recording within the file having the given file descriptor,
+ * whether that recording is raw or compressed. Compressed recordings may be
+ * read starting from any point in time, beginning at the latest keyframe at
+ * or before the given offset. Raw recordings are read as-is, from the current
+ * position of the file descriptor, regardless of the given offset. Freeing
+ * the returned socket closes the file descriptor.
+ *
+ * @param fd
+ *     The file descriptor of the recording file, which must be open for
+ *     reading and refer to a regular file.
+ *
+ * @param offset
+ *     The number of milliseconds after the beginning of the recording at
+ *     which reading should begin, or zero to read the entire recording.
+ *
+ * @return
+ *     A newly-allocated guac_socket which reads the protocol data of the
+ *     recording, or NULL if the recording cannot be read, in which case
+ *     guac_error and guac_error_message are set appropriately and the file
+ *     descriptor is left open.
+ */
+guac_socket* guac_recording_open_reader(int fd, guac_timestamp offset);
+
+/**
+ * Retrieves the time at which the session recording within the file having
+ * the given file descriptor was started, as stored within the header of
+ * compressed recordings. This is the point in time that the offset provided to
+ * guac_recording_open_reader() is relative to, and is comparable with the
+ * timestamps of the "sync" instructions within the recording. Raw recordings
+ * do not store this time; the timestamp of their first "sync" instruction
+ * should be used instead.
+ *
+ * @param fd
+ *     The file descriptor of the recording file, which must be open for
+ *     reading and refer to a regular file.
+ *
+ * @param started
+ *     A pointer to the guac_timestamp that should receive the time at which
+ *     the recording was started.
+ *
+ * @return
+ *     Zero if the start time was read successfully, non-zero if the
+ *     recording does not store its start time (it is not compressed) or
+ *     cannot be read, in which case guac_error and guac_error_message are
+ *     set appropriately.
+ */
+int guac_recording_read_start_time(int fd, guac_timestamp* started);
+
+/**
+ * A raw session recording which has been mapped into memory in its entirety,
+ * such that its instructions can be parsed in-place, without read() calls or
+ * copying, using guac_recording_mapping_read().
+ */
+typedef struct guac_recording_mapping {
+
+    /**
+     * The file descriptor of the mapped recording file.
+     */
+    int fd;
+
+    /**
+     * The first byte of the mapped recording. The mapping is private and
+     * writable, as instructions are modified in-place as they are parsed.
+     */
+    char* data;
+
+    /**
+     * The number of bytes mapped.
+     */
+    size_t length;
+
+    /**
+     * The offset of the next instruction to be read, relative to the start of
+     * the mapping.
+     */
+    size_t offset;
+
+    /**
+     * The offset up to which the kernel has been advised that mapped data
+     * will soon be needed.
+     */
+    size_t advised;
+
+    /**
+     * The offset below which mapped data has been released, as it is no
+     * longer needed.
+     */
+    size_t released;
+
+} guac_recording_mapping;
+
+/**
+ * Maps the raw session recording within the file having the given file
+ * descriptor into memory, such that its instructions can be parsed directly
+ * from the mapping using guac_recording_mapping_read(). The recording is read
+ * from the current position of the file descriptor. Only raw recordings
+ * within regular files can be mapped; compressed recordings must instead be
+ * read using guac_recording_open_reader(). Unmapping the recording with
+ * guac_recording_unmap() closes the file descriptor.
+ *
+ * @param fd
+ *     The file descriptor of the recording file, which must be open for
+ *     reading.
+ *
+ * @return
+ *     A newly-allocated guac_recording_mapping for the recording, or NULL if
+ *     the recording cannot be mapped, in which case guac_error and
+ *     guac_error_message are set appropriately and the file descriptor is
+ *     left open.
+ */
+guac_recording_mapping* guac_recording_map(int fd);
+
+/**
+ * Reads the next instruction from the given mapped recording using the given
+ * parser, as with guac_parser_parse(). The opcode and arguments of the parsed
+ * instruction point directly into the mapping and remain valid only until the
+ * next instruction is read.
+ *
+ * @param mapping
+ *     The mapped recording to read from.
+ *
+ * @param parser
+ *     The parser to use to parse the instruction.
+ *
+ * @return
+ *     Zero if an instruction was read, non-zero otherwise, in which case
+ *     guac_error is set appropriately. Once the end of the recording is
+ *     reached, guac_error is set to GUAC_STATUS_CLOSED.
+ */
+int guac_recording_mapping_read(guac_recording_mapping* mapping,
+        guac_parser* parser);
+
+/**
+ * Unmaps the given recording, freeing all associated resources and closing
+ * its file descriptor.
+ *
+ * @param mapping
+ *     The mapped recording to unmap.
+ */
+void guac_recording_unmap(guac_recording_mapping* mapping);
+
+/**
+ * The input event sidecar of a session recording, mapped into memory in its
+ * entirety such that its events can be read without read() calls, using
+ * guac_recording_events_read().
+ */
+typedef struct guac_recording_events {
+
+    /**
+     * The file descriptor of the mapped sidecar file.
+     */
+    int fd;
+
+    /**
+     * The first byte of the mapped sidecar.
+     */
+    const unsigned char* data;
+
+    /**
+     * The number of bytes mapped.
+     */
+    size_t length;
+
+    /**
+     * The offset of the next event record to be read, relative to the start
+     * of the mapping.
+     */
+    size_t offset;
+
+    /**
+     * The length of each event record within the sidecar, in bytes.
+     */
+    size_t record_length;
+
+} guac_recording_events;
+
+/**
+ * Maps the input event sidecar within the file having the given file
+ * descriptor into memory, such that its events can be read using
+ * guac_recording_events_read(). Unmapping the sidecar with
+ * guac_recording_events_unmap() closes the file descriptor.
+ *
+ * @param fd
+ *     The file descriptor of the sidecar file, which must be open for reading
+ *     and refer to a regular file.
+ *
+ * @return
+ *     A newly-allocated guac_recording_events for the sidecar, or NULL if
+ *     the file is not an input event sidecar or cannot be mapped, in which
+ *     case guac_error and guac_error_message are set appropriately and the
+ *     file descriptor is left open.
+ */
+guac_recording_events* guac_recording_events_map(int fd);
+
+/**
+ * Reads the next input event from the given mapped sidecar, skipping any
+ * events of types unknown to this version of libguac.
+ *
+ * @param events
+ *     The mapped sidecar to read from.
+ *
+ * @param event
+ *     The guac_recording_event to populate with the next input event.
+ *
+ * @return
+ *     Zero if an input event was read, non-zero if no further complete events
+ *     remain.
+ */
+int guac_recording_events_read(guac_recording_events* events,
+        guac_recording_event* event);
+
+/**
+ * Unmaps the given input event sidecar, closing its file descriptor and
+ * freeing all associated memory.
+ *
+ * @param events
+ *     The mapped sidecar to unmap.
+ */
+void guac_recording_events_unmap(guac_recording_events* events);
 
 /**
  * Frees the resources associated with the given in-progress recording. Note
  * that, due to the manner that recordings are attached to the guac_client, the
  * underlying guac_socket is not freed. The guac_socket will be automatically
- * freed when the guac_client is freed.
+ * freed when the guac_client is freed. Production of keyframes and recording
+ * of output from a display, if started, are stopped.
  *
  * @param recording
  *     The guac_recording to free.
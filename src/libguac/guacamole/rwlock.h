@@ -38,18 +38,60 @@
  * unexpected behavior.
  */
 
+/**
+ * The number of independent reader counts maintained by each guac_rwlock.
+ * Threads acquiring the read lock increment only the count associated with
+ * the CPU they are running on (or, where the current CPU cannot be
+ * determined, a count chosen based on the calling thread), such that
+ * concurrent readers do not contend over a single shared counter. This value
+ * MUST be a power of two no greater than 16.
+ */
+#define GUAC_RWLOCK_READER_SLOTS 16
+
+/**
+ * The number of bytes reserved for each reader count of a guac_rwlock. This
+ * should be at least the size of a cache line such that each reader count
+ * occupies its own cache line.
+ */
+#define GUAC_RWLOCK_READER_SLOT_SIZE 64
+
+/**
+ * A single reader count of a guac_rwlock, padded to occupy a full cache line.
+ */
+typedef struct guac_rwlock_reader_slot {
+
+    /**
+     * The number of threads that currently hold the read lock through this
+     * reader count. This value must only be accessed atomically.
+     */
+    unsigned int readers;
+
+    /**
+     * Unused space that ensures reader counts do not share cache lines.
+     */
+    char padding[GUAC_RWLOCK_READER_SLOT_SIZE - sizeof(unsigned int)];
+
+} guac_rwlock_reader_slot;
+
 /**
  * A structure packaging together a pthread rwlock along with a key to a
  * thread-local property to keep track of the current status of the lock,
  * allowing the functions defined in this header to provide reentrant behavior.
  * Note that both the lock and key must be initialized before being provided
  * to any of these functions.
+ *
+ * Readers are tracked using distributed, per-CPU counts rather than through
+ * the pthread rwlock, such that acquiring the read lock while no writer is
+ * present involves only the reader count of the current CPU. The pthread
+ * rwlock is held for writing only by writers, serializing writers and
+ * providing something for readers to block on while a writer holds the lock.
  */
 typedef struct guac_rwlock {
 
     /**
-     * A non-reentrant pthread rwlock to be wrapped by the local lock,
-     * functions providing reentrant behavior.
+     * A non-reentrant pthread rwlock that is held for writing by the current
+     * writer, if any. Readers briefly acquire this lock for reading only to
+     * wait for an active writer to release the lock.
      */
     pthread_rwlock_t lock;
 
@@ -59,6 +101,34 @@ typedef struct guac_rwlock {
      */
     pthread_key_t key;
 
+    /**
+     * Non-zero if a writer has acquired or is in the process of acquiring the
+     * lock, zero otherwise. New readers back off while this flag is set. This
+     * value must only be accessed atomically.
+     */
+    int writer;
+
+    /**
+     * Lock which guards the readers_drained condition.
+     */
+    pthread_mutex_t drain_lock;
+
+    /**
+     * Condition which is signalled when a reader releases the lock while a
+     * writer is waiting for all readers to release the lock.
+     */
+    pthread_cond_t readers_drained;
+
+    /**
+     * The reader counts of this lock, one of which is incremented by each
+     * thread that holds the read lock. The array is aligned to
+     * GUAC_RWLOCK_READER_SLOT_SIZE, as padding alone does not prevent
+     * neighbouring reader counts from sharing a cache line if the array
+     * begins partway through one.
+     */
+    guac_rwlock_reader_slot slots[GUAC_RWLOCK_READER_SLOTS]
+        __attribute__((aligned(GUAC_RWLOCK_READER_SLOT_SIZE)));
+
 } guac_rwlock;
 
 /**
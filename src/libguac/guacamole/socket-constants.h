@@ -31,6 +31,19 @@
  */
 #define GUAC_SOCKET_OUTPUT_BUFFER_SIZE 8192
 
+/**
+ * The maximum number of bytes that may be buffered within a socket before
+ * flushing, if a larger buffer is requested via guac_socket_open_buffered().
+ */
+#define GUAC_SOCKET_OUTPUT_BUFFER_MAX_SIZE 1048576
+
+/**
+ * The minimum number of bytes that must be written in a single call before
+ * a socket will consider writing those bytes directly, alongside any buffered
+ * data, rather than copying them through its output buffer.
+ */
+#define GUAC_SOCKET_VECTORED_WRITE_THRESHOLD 4096
+
 /**
  * The number of milliseconds to wait between keep-alive pings on a socket
  * with keep-alive enabled.
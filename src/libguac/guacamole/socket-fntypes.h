@@ -82,6 +82,46 @@ typedef int guac_socket_select_handler(guac_socket* socket, int usec_timeout);
  */
 typedef ssize_t guac_socket_flush_handler(guac_socket* socket);
 
+/**
+ * Handler which reserves space directly within the internal output buffer of
+ * a guac_socket, allowing data to be written in-place rather than copied
+ * through guac_socket_write(). If the buffer has less than the requested
+ * minimum amount of space free, it is flushed first. Exclusive access to the
+ * buffer is retained until a corresponding call to the socket's
+ * guac_socket_commit_handler, which MUST be made if this handler succeeds.
+ *
+ * @param socket
+ *     The guac_socket whose output buffer space should be reserved.
+ *
+ * @param min
+ *     The minimum number of bytes that must be available within the reserved
+ *     space. This value must not exceed GUAC_SOCKET_OUTPUT_BUFFER_SIZE.
+ *
+ * @param available
+ *     Pointer to a size_t that should receive the number of bytes actually
+ *     available within the reserved space. This will be at least min.
+ *
+ * @return
+ *     A pointer to the start of the reserved space, or NULL if an error
+ *     occurs while making space available.
+ */
+typedef char* guac_socket_reserve_handler(guac_socket* socket, size_t min,
+        size_t* available);
+
+/**
+ * Handler which completes a reservation made by a guac_socket_reserve_handler,
+ * recording the given number of bytes of the reserved space as written and
+ * relinquishing exclusive access to the output buffer.
+ *
+ * @param socket
+ *     The guac_socket whose reservation should be completed.
+ *
+ * @param count
+ *     The number of bytes written to the reserved space. This value must not
+ *     exceed the amount of space available within that reservation.
+ */
+typedef void guac_socket_commit_handler(guac_socket* socket, size_t count);
+
 /**
  * When set within a guac_socket, a handler of this type will be called
  * whenever exclusive access to the guac_socket is required, such as when
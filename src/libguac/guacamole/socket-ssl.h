@@ -79,5 +79,29 @@ typedef struct guac_socket_ssl_data {
  */
 guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd);
 
+/**
+ * Hands the connection underlying the given SSL socket over to the kernel,
+ * if kernel TLS (kTLS) is handling encryption and decryption in both
+ * directions and no data has already been decrypted into user space. On
+ * success, a new file descriptor is returned through which unencrypted data
+ * may be read and written directly (and which may thus be used with
+ * splice()), with the kernel performing all encryption. The given
+ * guac_socket must then no longer be used other than to free it, and freeing
+ * it will not end the TLS session. kTLS offload is available only if enabled
+ * on the SSL_CTX (via SSL_OP_ENABLE_KTLS) and supported by both OpenSSL and
+ * the kernel for the negotiated cipher.
+ *
+ * @param socket
+ *     The guac_socket created with guac_socket_open_secure() whose
+ *     connection should be handed over to the kernel.
+ *
+ * @return
+ *     A newly-allocated file descriptor for the connection, which must
+ *     eventually be closed by the caller, or -1 if the connection cannot be
+ *     handed over to the kernel, in which case the guac_socket remains
+ *     usable.
+ */
+int guac_socket_ssl_offload(guac_socket* socket);
+
 #endif
 
@@ -0,0 +1,79 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_SOCKET_URING_H
+#define GUAC_SOCKET_URING_H
+
+/**
+ * Provides an implementation of guac_socket which performs all I/O through
+ * io_uring. This header will only be available if libguac was built with
+ * io_uring support.
+ *
+ * @file socket-uring.h
+ */
+
+#include "socket-types.h"
+
+#include <stddef.h>
+
+/**
+ * The number of buffers that the kernel may fill with received data before
+ * that data is read from the socket.
+ */
+#define GUAC_SOCKET_URING_RECV_BUFFERS 16
+
+/**
+ * The size of each buffer that the kernel fills with received data, in
+ * bytes.
+ */
+#define GUAC_SOCKET_URING_RECV_BUFFER_SIZE 8192
+
+/**
+ * Allocates and initializes a new guac_socket which performs all I/O on the
+ * given open file descriptor through io_uring, which must refer to a stream
+ * socket. Data is received through a single multishot receive into buffers
+ * provided to the kernel ahead of time, and the output buffer is registered
+ * with the kernel, such that each flush consists of a single submission and
+ * large writes are submitted as one batch together with any buffered data.
+ * The file descriptor will be automatically closed when the allocated
+ * guac_socket is freed.
+ *
+ * If io_uring is not supported by the running kernel, or if an error occurs
+ * while allocating the guac_socket object, NULL is returned, guac_error is
+ * set appropriately, and the file descriptor is left open, such that the
+ * caller may fall back to guac_socket_open_buffered().
+ *
+ * @param fd
+ *     An open file descriptor that this guac_socket object should manage.
+ *
+ * @param buffer_size
+ *     The size of the output buffer to allocate, in bytes. Values outside the
+ *     range GUAC_SOCKET_OUTPUT_BUFFER_SIZE through
+ *     GUAC_SOCKET_OUTPUT_BUFFER_MAX_SIZE are clamped to that range.
+ *
+ * @return
+ *     A newly allocated guac_socket object associated with the given file
+ *     descriptor, or NULL if io_uring cannot be used or an error occurs while
+ *     allocating the guac_socket object.
+ */
+guac_socket* guac_socket_open_uring(int fd, size_t buffer_size);
+
+#endif
+
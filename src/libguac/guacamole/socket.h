@@ -58,6 +58,19 @@ struct guac_socket {
      */
     guac_socket_flush_handler* flush_handler;
 
+    /**
+     * Handler which will be called to reserve space directly within the
+     * output buffer of this socket, if supported. If NULL, in-place writes
+     * are not supported, and guac_socket_reserve() will always fail.
+     */
+    guac_socket_reserve_handler* reserve_handler;
+
+    /**
+     * Handler which will be called to complete a reservation made by
+     * reserve_handler. This must be defined if reserve_handler is defined.
+     */
+    guac_socket_commit_handler* commit_handler;
+
     /**
      * Handler which will be called whenever a socket needs to be acquired for
      * exclusive access, such as when an instruction is about to be written.
@@ -93,18 +106,22 @@ struct guac_socket {
     guac_timestamp last_write_timestamp;
 
     /**
-     * The number of bytes present in the base64 "ready" buffer.
+     * The number of bytes present in the base64 "ready" buffer. As all
+     * complete groups of three bytes are encoded immediately, this will never
+     * exceed two.
      */
     int __ready;
 
     /**
-     * The base64 "ready" buffer. Once this buffer is filled, the data is encoded
-     * as base64 and flushed to the main write buffer.
+     * The base64 "ready" buffer, holding any trailing bytes that do not yet
+     * form a complete group of three. These bytes are encoded once further
+     * data completes the group, or with padding by guac_socket_flush_base64().
      */
     unsigned char __ready_buf[GUAC_SOCKET_BASE64_READY_BUFFER_SIZE];
 
     /**
-     * The buffer to hold the result of encoding the ready buffer as base64.
+     * The buffer to hold the result of base64 encoding when the underlying
+     * socket does not support writing in-place via reserve_handler.
      */
     char __encoded_buf[GUAC_SOCKET_BASE64_ENCODED_BUFFER_SIZE];
 
@@ -114,9 +131,23 @@ struct guac_socket {
     int __keep_alive_enabled;
 
     /**
-     * The keep-alive thread.
+     * The slot of the timer wheel of the shared keep-alive service that
+     * currently contains this socket, or a negative value if this socket is
+     * not currently scheduled for a keep-alive check.
+     */
+    int __keep_alive_slot;
+
+    /**
+     * The previous socket within the same slot of the timer wheel of the
+     * shared keep-alive service, or NULL if this socket is the first.
+     */
+    guac_socket* __keep_alive_prev;
+
+    /**
+     * The next socket within the same slot of the timer wheel of the shared
+     * keep-alive service, or NULL if this socket is the last.
      */
-    pthread_t __keep_alive_thread;
+    guac_socket* __keep_alive_next;
 
 };
 
@@ -139,7 +170,11 @@ void guac_socket_free(guac_socket* socket);
 /**
  * Declares that the given socket must automatically send a keep-alive ping
  * to ensure neither side of the socket times out while the socket is open.
- * This ping will take the form of a "nop" instruction.
+ * This ping will take the form of a "nop" instruction, sent whenever the
+ * socket has not been written to for GUAC_SOCKET_KEEP_ALIVE_INTERVAL
+ * milliseconds. Pings for all sockets within the process are sent by a
+ * single shared thread. Calling this function more than once for the same
+ * socket has no additional effect.
  *
  * @param socket
  *     The guac_socket to declare as requiring an automatic keep-alive ping.
@@ -177,6 +212,52 @@ void guac_socket_instruction_end(guac_socket* socket);
  */
 guac_socket* guac_socket_open(int fd);
 
+/**
+ * Allocates and initializes a new guac_socket object with the given open
+ * file descriptor, buffering up to the given number of bytes before flushing.
+ * Larger buffers allow more data to be coalesced into each write to the file
+ * descriptor, at the cost of memory and latency. Writes that are too large
+ * for the remaining space in the buffer are written directly, together with
+ * any data already buffered, using a single vectored write where possible.
+ * The file descriptor will be automatically closed when the allocated
+ * guac_socket is freed.
+ *
+ * If an error occurs while allocating the guac_socket object, NULL is returned,
+ * and guac_error is set appropriately.
+ *
+ * @param fd
+ *     An open file descriptor that this guac_socket object should manage.
+ *
+ * @param buffer_size
+ *     The size of the output buffer to allocate, in bytes. Values outside the
+ *     range GUAC_SOCKET_OUTPUT_BUFFER_SIZE through
+ *     GUAC_SOCKET_OUTPUT_BUFFER_MAX_SIZE are clamped to that range.
+ *
+ * @return
+ *     A newly allocated guac_socket object associated with the given file
+ *     descriptor, or NULL if an error occurs while allocating the guac_socket
+ *     object.
+ */
+guac_socket* guac_socket_open_buffered(int fd, size_t buffer_size);
+
+/**
+ * Limits the average rate at which data is written to the file descriptor of
+ * the given guac_socket, which must have been created with guac_socket_open()
+ * or guac_socket_open_buffered(). Bursts of up to one second's worth of data
+ * are written immediately. Beyond that, writes block until the average rate
+ * falls back within the limit, so a producer that cannot keep up falls
+ * behind rather than having its data queued indefinitely. This function has
+ * no effect on other kinds of guac_socket.
+ *
+ * @param socket
+ *     The guac_socket whose writes should be limited.
+ *
+ * @param bytes_per_second
+ *     The maximum average number of bytes to write per second, or zero if
+ *     writes should not be limited.
+ */
+void guac_socket_limit_bandwidth(guac_socket* socket, size_t bytes_per_second);
+
 /**
  * Allocates and initializes a new guac_socket which writes all data via
  * nest instructions to the given existing, open guac_socket. Freeing the
@@ -316,10 +397,11 @@ ssize_t guac_socket_write_string(guac_socket* socket, const char* str);
 /**
  * Writes the given binary data to the given guac_socket object as base64-
  * encoded data. The data written may be buffered until the buffer is flushed
- * automatically or manually. Beware that, because base64 data is buffered
- * on top of the write buffer already used, a call to guac_socket_flush_base64()
- * MUST be made before non-base64 writes (or writes of an independent block of
- * base64 data) can be made.
+ * automatically or manually. Beware that, because up to two trailing bytes
+ * of base64 data may be held back until a complete group of three is
+ * available, a call to guac_socket_flush_base64() MUST be made before
+ * non-base64 writes (or writes of an independent block of base64 data) can be
+ * made.
  *
  * If an error occurs while writing, a non-zero value is returned, and
  * guac_error is set appropriately.
@@ -345,6 +427,51 @@ ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t co
  */
 ssize_t guac_socket_write(guac_socket* socket, const void* buf, size_t count);
 
+/**
+ * Reserves space directly within the output buffer of the given guac_socket,
+ * such that data may be written in-place rather than copied through
+ * guac_socket_write(). The output buffer is flushed first if it does not have
+ * at least the given minimum amount of space free. If this function succeeds,
+ * exclusive access to the output buffer is held, and guac_socket_commit()
+ * MUST be called once the reserved space has been written.
+ *
+ * Not all guac_sockets support in-place writes. If the given guac_socket does
+ * not, or an error occurs, NULL is returned, and the data should instead be
+ * written with guac_socket_write().
+ *
+ * @param socket
+ *     The guac_socket whose output buffer space should be reserved.
+ *
+ * @param min
+ *     The minimum number of bytes that must be available within the reserved
+ *     space. This value must not exceed GUAC_SOCKET_OUTPUT_BUFFER_SIZE.
+ *
+ * @param available
+ *     Pointer to a size_t that should receive the number of bytes actually
+ *     available within the reserved space, which will be at least min.
+ *
+ * @return
+ *     A pointer to the start of the reserved space, or NULL if the socket
+ *     does not support in-place writes or an error occurs.
+ */
+char* guac_socket_reserve(guac_socket* socket, size_t min, size_t* available);
+
+/**
+ * Completes a reservation made with guac_socket_reserve(), recording the
+ * given number of bytes as written to the reserved space and relinquishing
+ * exclusive access to the output buffer. As with guac_socket_write(), the
+ * data may remain buffered until the socket is flushed.
+ *
+ * @param socket
+ *     The guac_socket whose reservation should be completed.
+ *
+ * @param count
+ *     The number of bytes written to the reserved space. This value must not
+ *     exceed the amount of space reported as available by
+ *     guac_socket_reserve().
+ */
+void guac_socket_commit(guac_socket* socket, size_t count);
+
 /**
  * Attempts to read data from the socket, filling up to the specified number
  * of bytes in the given buffer.
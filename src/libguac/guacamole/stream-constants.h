@@ -0,0 +1,40 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_STREAM_CONSTANTS_H
+#define GUAC_STREAM_CONSTANTS_H
+
+/**
+ * Constants related to Guacamole streams.
+ *
+ * @file stream-constants.h
+ */
+
+/**
+ * The number of blobs which may be sent along an outbound stream before
+ * an acknowledgement is required, unless the "window" member of that
+ * guac_stream is changed after allocation. A window of 1 is equivalent to
+ * stop-and-wait, where each blob must be acknowledged before the next is
+ * sent.
+ */
+#define GUAC_STREAM_DEFAULT_WINDOW 16
+
+#endif
+
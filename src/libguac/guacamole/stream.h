@@ -26,8 +26,10 @@
  * @file stream.h
  */
 
-#include "user-fntypes.h"
+#include "socket-types.h"
+#include "stream-constants.h"
 #include "stream-types.h"
+#include "user-fntypes.h"
 
 struct guac_stream {
 
@@ -105,7 +107,73 @@ struct guac_stream {
      */
     guac_user_end_handler* end_handler;
 
+    /**
+     * The maximum number of blobs which may be sent along this stream via
+     * guac_stream_send_blob() without having been acknowledged. This is
+     * GUAC_STREAM_DEFAULT_WINDOW when the stream is allocated, and may be
+     * changed by the owner of the stream prior to sending any blobs.
+     */
+    int window;
+
+    /**
+     * The number of blobs sent along this stream via guac_stream_send_blob()
+     * which have not yet been acknowledged. Acknowledgements are tracked only
+     * for user-level streams, as acks for client-level streams are not
+     * received. This value is updated atomically, such that blobs may be sent
+     * from a thread other than the one receiving acknowledgements.
+     */
+    int __unacknowledged;
+
 };
 
+/**
+ * Returns whether another blob may be sent along the given stream without
+ * exceeding its window of unacknowledged blobs. Producers of outbound
+ * streams should send blobs for as long as this function returns non-zero,
+ * rather than sending a single blob per received ack.
+ *
+ * @param stream
+ *     The outbound stream to test.
+ *
+ * @return
+ *     Non-zero if another blob may be sent along the given stream, zero if
+ *     an acknowledgement must first be received.
+ */
+int guac_stream_can_send(const guac_stream* stream);
+
+/**
+ * Sends a blob instruction along the given stream, counting that blob
+ * against the window of the stream until it is acknowledged. If an error
+ * occurs sending the instruction, a non-zero value is returned, the blob is
+ * not counted, and guac_error is set appropriately.
+ *
+ * @param socket
+ *     The guac_socket connection to use.
+ *
+ * @param stream
+ *     The stream to send the blob along.
+ *
+ * @param data
+ *     The binary data to send.
+ *
+ * @param count
+ *     The number of bytes of binary data to send.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+int guac_stream_send_blob(guac_socket* socket, guac_stream* stream,
+        const void* data, int count);
+
+/**
+ * Records receipt of an acknowledgement along the given stream, freeing
+ * one slot within its window. This is invoked automatically for each ack
+ * received for a user-level stream, prior to invoking its ack_handler.
+ *
+ * @param stream
+ *     The stream for which an acknowledgement was received.
+ */
+void guac_stream_acknowledge(guac_stream* stream);
+
 #endif
 
@@ -27,9 +27,36 @@
  */
 
 #include "config.h"
+#include "timestamp-types.h"
 
 #include <stddef.h>
 
+/**
+ * The number of milliseconds to allow each attempt to connect to one of the
+ * addresses of a host before additionally attempting the next address, as
+ * recommended by RFC 8305 ("Happy Eyeballs").
+ */
+#define GUAC_TCP_CONNECT_ATTEMPT_DELAY 250
+
+/**
+ * The time spent within each phase of establishing a TCP connection with
+ * guac_tcp_connect_timed().
+ */
+typedef struct guac_tcp_connect_timings {
+
+    /**
+     * The time spent resolving the hostname, in milliseconds.
+     */
+    guac_timestamp resolve;
+
+    /**
+     * The time spent connecting to the resolved addresses, in milliseconds,
+     * whether or not the connection was ultimately established.
+     */
+    guac_timestamp connect;
+
+} guac_tcp_connect_timings;
+
 /**
  * Given a hostname or IP address and port, attempt to connect to that system,
  * returning the file descriptor of an open socket if the connection succeeds,
@@ -37,6 +64,13 @@
  * eventually be freed with a call to close(). If this function fails,
  * guac_error will be set appropriately.
  *
+ * If the hostname resolves to multiple addresses, connections are attempted
+ * with address families alternating, and each attempt is given
+ * GUAC_TCP_CONNECT_ATTEMPT_DELAY milliseconds to succeed before the next
+ * attempt is started alongside it. The first attempt to succeed is used. An
+ * unresponsive address thus delays the connection only briefly, rather than
+ * for the entire timeout.
+ *
  * @param hostname
  *     The hostname or IP address to which to attempt connections.
  *
@@ -44,7 +78,8 @@
  *     The TCP port to which to attempt to connect.
  *
  * @param timeout
- *     The number of seconds to try the TCP connection before timing out.
+ *     The number of seconds to try the TCP connection before timing out,
+ *     across all addresses of the host.
  *
  * @return
  *     A valid socket if the connection succeeds, or a negative integer if it
@@ -52,4 +87,31 @@
  */
 int guac_tcp_connect(const char* hostname, const char* port, const int timeout);
 
+/**
+ * Connects to the given hostname or IP address and port exactly as
+ * guac_tcp_connect() does, additionally storing the time spent within each
+ * phase of establishing the connection.
+ *
+ * @param hostname
+ *     The hostname or IP address to which to attempt connections.
+ *
+ * @param port
+ *     The TCP port to which to attempt to connect.
+ *
+ * @param timeout
+ *     The number of seconds to try the TCP connection before timing out,
+ *     across all addresses of the host.
+ *
+ * @param timings
+ *     Storage for the time spent within each phase of establishing the
+ *     connection, or NULL if these timings are not needed. If resolving the
+ *     hostname fails, this is left untouched.
+ *
+ * @return
+ *     A valid socket if the connection succeeds, or a negative integer if it
+ *     fails.
+ */
+int guac_tcp_connect_timed(const char* hostname, const char* port,
+        const int timeout, guac_tcp_connect_timings* timings);
+
 #endif // GUAC_TCP_H
@@ -39,6 +39,23 @@
  */
 guac_timestamp guac_timestamp_current(void);
 
+/**
+ * Returns an arbitrary timestamp with the same meaning as the timestamps
+ * returned by guac_timestamp_current(), but which may be cheaper to obtain at
+ * the cost of precision. Depending on the platform, the returned timestamp
+ * may lag behind the current time by up to a single tick of the system timer
+ * (typically no more than a few milliseconds). This function is intended for
+ * frequently-invoked code which needs only a rough notion of the current
+ * time, such as tracking when data was last written. Code which measures
+ * short durations, such as frame timing and lag calculations, should instead
+ * use guac_timestamp_current().
+ *
+ * @return
+ *     An arbitrary millisecond timestamp which may be of lower precision than
+ *     that returned by guac_timestamp_current().
+ */
+guac_timestamp guac_timestamp_current_coarse(void);
+
 /**
  * Sleeps for the given number of milliseconds.
  *
@@ -110,6 +110,14 @@ struct guac_user_info {
      */
     const char* name;
 
+    /**
+     * Whether the remote system requested, during the handshake, that all
+     * instructions sent to it after the handshake be in the compact binary
+     * form of the Guacamole protocol rather than the usual text form. Remote
+     * systems that do not support the compact form never request it.
+     */
+    int compact;
+
 };
 
 struct guac_user {
@@ -183,6 +191,16 @@ struct guac_user {
      */
     int processing_lag;
 
+    /**
+     * The maximum number of characters to accept within any one element of
+     * the instructions received from this user. This defaults to
+     * GUAC_INSTRUCTION_MAX_LENGTH, and may be raised prior to invoking
+     * guac_user_handle_connection() to allow the user to send larger blobs,
+     * such as those of file uploads, in fewer instructions. This value may not
+     * exceed GUAC_INSTRUCTION_MAX_LENGTH_LIMIT.
+     */
+    int max_instruction_length;
+
     /**
      * Information structure containing properties exposed by the remote
      * user during the initial handshake process.
@@ -539,6 +557,14 @@ struct guac_user {
      */
     guac_user_touch_handler* touch_handler;
 
+    /**
+     * The queue of data awaiting transmission to this user via the broadcast
+     * sockets of the associated guac_client, or NULL if this user has not
+     * been added to a guac_client. This member is internal to libguac and
+     * must not be used outside of libguac.
+     */
+    struct guac_user_output* __output;
+
 };
 
 /**
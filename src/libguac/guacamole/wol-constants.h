@@ -39,6 +39,19 @@
  */
 #define GUAC_WOL_DEFAULT_CONNECTION_TIMEOUT 10
 
+/**
+ * The number of milliseconds to wait before first checking whether a system
+ * is reachable after sending a WOL packet. This interval doubles after each
+ * unsuccessful check, up to GUAC_WOL_PROBE_MAX_INTERVAL.
+ */
+#define GUAC_WOL_PROBE_INITIAL_INTERVAL 250
+
+/**
+ * The maximum number of milliseconds to wait between checks of whether a
+ * system is reachable after sending a WOL packet.
+ */
+#define GUAC_WOL_PROBE_MAX_INTERVAL 2000
+
 /**
  * The value for the local IPv4 broadcast address.
  */
@@ -30,11 +30,14 @@
 #include "wol-constants.h"
 
 /**
- * Send the wake-up packet to the specified destination, returning zero if the
- * wake was sent successfully, or non-zero if an error occurs sending the
- * wake packet.  Note that the return value does not specify whether the
- * system actually wakes up successfully, only whether or not the packet
- * is transmitted.
+ * Send the wake-up packet to the specified destination if the remote system
+ * is not already reachable, and wait for that system to become reachable.
+ * Rather than waiting a fixed amount of time between connection attempts,
+ * the remote system is checked frequently (starting every
+ * GUAC_WOL_PROBE_INITIAL_INTERVAL milliseconds and backing off to every
+ * GUAC_WOL_PROBE_MAX_INTERVAL milliseconds), such that this function returns
+ * as soon as the system can be reached. The wake-up packet is resent once
+ * every wait_time seconds for as long as the system remains unreachable.
  * 
  * @param mac_addr
  *     The MAC address to place in the magic Wake-on-LAN packet.
@@ -53,11 +56,14 @@ int guac_wol_wake(const char* mac_addr, const char* broadcast_addr,
         const unsigned short udp_port);
 
 /**
- * Send the wake-up packet to the specified destination, returning zero if the
- * wake was sent successfully, or non-zero if an error occurs sending the
- * wake packet.  Note that the return value does not specify whether the
- * system actually wakes up successfully, only whether or not the packet
- * is transmitted.
+ * Send the wake-up packet to the specified destination if the remote system
+ * is not already reachable, and wait for that system to become reachable.
+ * Rather than waiting a fixed amount of time between connection attempts,
+ * the remote system is checked frequently (starting every
+ * GUAC_WOL_PROBE_INITIAL_INTERVAL milliseconds and backing off to every
+ * GUAC_WOL_PROBE_MAX_INTERVAL milliseconds), such that this function returns
+ * as soon as the system can be reached. The wake-up packet is resent once
+ * every wait_time seconds for as long as the system remains unreachable.
  * 
  * @param mac_addr
  *     The MAC address to place in the magic Wake-on-LAN packet.
@@ -69,12 +75,13 @@ int guac_wol_wake(const char* mac_addr, const char* broadcast_addr,
  *     The UDP port to use when sending the WoL packet.
  *
  * @param wait_time
- *     The number of seconds to wait between connection attempts after the WOL
- *     packet has been sent.
+ *     The number of seconds to wait between sending WOL packets while the
+ *     system remains unreachable.
  *
  * @param retries
- *     The number of attempts to make to connect to the system before giving up
- *     on the connection.
+ *     The number of WOL packet intervals to wait for the system to become
+ *     reachable before giving up. The system is given wait_time * retries
+ *     seconds in total to become reachable.
  *
  * @param hostname
  *     The hostname or IP address of the system that has been woken up and to
@@ -89,8 +96,8 @@ int guac_wol_wake(const char* mac_addr, const char* broadcast_addr,
  *     remote system when checking to see if it is awake.
  * 
  * @return 
- *     Zero if the packet is successfully sent to the destination; non-zero
- *     if the packet cannot be sent.
+ *     Zero if the remote system is reachable; non-zero if the packet cannot
+ *     be sent or the system does not become reachable in time.
  */
 int guac_wol_wake_and_wait(const char* mac_addr, const char* broadcast_addr,
         const unsigned short udp_port, int wait_time, int retries,
@@ -0,0 +1,118 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacamole/assert.h"
+#include "guacamole/opcode.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Returns the opcode of the entry at the given position within the given
+ * table of instruction handlers.
+ *
+ * @param table
+ *     The table of instruction handlers.
+ *
+ * @param entry_size
+ *     The size of each entry within the table, in bytes.
+ *
+ * @param position
+ *     The position of the entry within the table.
+ *
+ * @return
+ *     The opcode of the entry at the given position, or NULL if the entry is
+ *     the entry terminating the table.
+ */
+static const char* guac_opcode_index_get_opcode(const void* table,
+        size_t entry_size, int position) {
+    return *((const char* const*) ((const char*) table + entry_size * position));
+}
+
+/**
+ * Returns the slot within a guac_opcode_index at which the search for the
+ * given opcode should begin. The hash used is 32-bit FNV-1a.
+ *
+ * @param opcode
+ *     The opcode to hash.
+ *
+ * @return
+ *     The starting slot for the given opcode.
+ */
+static unsigned int guac_opcode_index_hash(const char* opcode) {
+
+    uint32_t hash = 2166136261u;
+    while (*opcode != '\0') {
+        hash ^= (unsigned char) *(opcode++);
+        hash *= 16777619u;
+    }
+
+    return hash & (GUAC_OPCODE_INDEX_SIZE - 1);
+
+}
+
+void guac_opcode_index_init(guac_opcode_index* index, const void* table,
+        size_t entry_size) {
+
+    memset(index->slots, 0, sizeof(index->slots));
+
+    const char* opcode;
+    for (int position = 0; (opcode = guac_opcode_index_get_opcode(table,
+                    entry_size, position)) != NULL; position++) {
+
+        /* At least one slot must always remain unused such that searches
+         * for unknown opcodes terminate */
+        GUAC_ASSERT(position < GUAC_OPCODE_INDEX_SIZE - 1);
+
+        unsigned int slot = guac_opcode_index_hash(opcode);
+        while (index->slots[slot] != 0)
+            slot = (slot + 1) & (GUAC_OPCODE_INDEX_SIZE - 1);
+
+        index->slots[slot] = position + 1;
+
+    }
+
+}
+
+const void* guac_opcode_index_find(const guac_opcode_index* index,
+        const void* table, size_t entry_size, const char* opcode) {
+
+    unsigned int slot = guac_opcode_index_hash(opcode);
+
+    /* Check each entry sharing the same hash until an unused slot is
+     * reached */
+    int entry;
+    while ((entry = index->slots[slot]) != 0) {
+
+        int position = entry - 1;
+        if (strcmp(guac_opcode_index_get_opcode(table, entry_size, position),
+                    opcode) == 0)
+            return (const char*) table + entry_size * position;
+
+        slot = (slot + 1) & (GUAC_OPCODE_INDEX_SIZE - 1);
+
+    }
+
+    return NULL;
+
+}
+
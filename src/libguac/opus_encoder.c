@@ -0,0 +1,432 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "guacamole/mem.h"
+#include "guacamole/audio.h"
+#include "guacamole/client.h"
+#include "guacamole/protocol.h"
+#include "guacamole/socket.h"
+#include "guacamole/user.h"
+#include "opus_encoder.h"
+
+#include <ogg/ogg.h>
+#include <opus/opus.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Appends the given data to the buffer of unsent Ogg pages within the given
+ * encoder state, expanding that buffer as necessary.
+ *
+ * @param state
+ *     The encoder state whose buffer should receive the data.
+ *
+ * @param data
+ *     The data to append.
+ *
+ * @param length
+ *     The number of bytes of data to append.
+ */
+static void opus_encoder_buffer_append(opus_encoder_state* state,
+        const unsigned char* data, size_t length) {
+
+    /* Expand buffer if insufficient space remains */
+    size_t required = guac_mem_ckd_add_or_die(state->written, length);
+    if (required > state->length) {
+
+        size_t new_length = state->length * 2;
+        if (new_length < required)
+            new_length = required;
+
+        state->buffer = guac_mem_realloc_or_die(state->buffer, new_length);
+        guac_client_account_memory(state->client, GUAC_CLIENT_MEMORY_AUDIO,
+                (int64_t) new_length - (int64_t) state->length);
+        state->length = new_length;
+
+    }
+
+    memcpy(state->buffer + state->written, data, length);
+    state->written += length;
+
+}
+
+/**
+ * Moves all Ogg pages that are ready within the Ogg stream of the given
+ * encoder state into its buffer of unsent pages.
+ *
+ * @param state
+ *     The encoder state whose Ogg pages should be buffered.
+ *
+ * @param force
+ *     Non-zero if all pending packets should be placed into pages regardless
+ *     of how full those pages are, zero if only full pages should be
+ *     buffered.
+ */
+static void opus_encoder_buffer_pages(opus_encoder_state* state, int force) {
+
+    ogg_page page;
+
+    while (force ? ogg_stream_flush(&state->ogg_state, &page)
+                 : ogg_stream_pageout(&state->ogg_state, &page)) {
+        opus_encoder_buffer_append(state, page.header, page.header_len);
+        opus_encoder_buffer_append(state, page.body, page.body_len);
+    }
+
+}
+
+/**
+ * Writes the OpusHead and OpusTags header packets to the Ogg stream of the
+ * given audio stream, as required by RFC 7845, retaining a copy of the
+ * resulting pages for any users that join later.
+ *
+ * @param audio
+ *     The audio stream whose headers should be written.
+ */
+static void opus_encoder_write_headers(guac_audio_stream* audio) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+
+    opus_int32 pre_skip = 0;
+    opus_encoder_ctl(state->encoder, OPUS_GET_LOOKAHEAD(&pre_skip));
+
+    /* Identification header */
+    unsigned char head[19];
+    memcpy(head, "OpusHead", 8);
+    head[8]  = 1; /* Version */
+    head[9]  = audio->channels;
+    head[10] = pre_skip & 0xFF;
+    head[11] = (pre_skip >> 8) & 0xFF;
+    head[12] = audio->rate & 0xFF;
+    head[13] = (audio->rate >> 8) & 0xFF;
+    head[14] = (audio->rate >> 16) & 0xFF;
+    head[15] = (audio->rate >> 24) & 0xFF;
+    head[16] = 0; /* Output gain */
+    head[17] = 0;
+    head[18] = 0; /* Channel mapping family */
+
+    ogg_packet packet = {
+        .packet     = head,
+        .bytes      = sizeof(head),
+        .b_o_s      = 1,
+        .packetno   = state->packet_number++
+    };
+
+    /* The identification header must be alone within the first page */
+    ogg_stream_packetin(&state->ogg_state, &packet);
+    opus_encoder_buffer_pages(state, 1);
+
+    /* Comment header, containing only the vendor string */
+    const char* vendor = opus_get_version_string();
+    size_t vendor_length = strlen(vendor);
+    size_t tags_length = 8 + 4 + vendor_length + 4;
+
+    unsigned char* tags = guac_mem_zalloc(tags_length);
+    memcpy(tags, "OpusTags", 8);
+    tags[8]  = vendor_length & 0xFF;
+    tags[9]  = (vendor_length >> 8) & 0xFF;
+    tags[10] = (vendor_length >> 16) & 0xFF;
+    tags[11] = (vendor_length >> 24) & 0xFF;
+    memcpy(tags + 12, vendor, vendor_length);
+
+    packet = (ogg_packet) {
+        .packet     = tags,
+        .bytes      = tags_length,
+        .packetno   = state->packet_number++
+    };
+
+    /* Audio data must begin on a new page following all headers */
+    ogg_stream_packetin(&state->ogg_state, &packet);
+    opus_encoder_buffer_pages(state, 1);
+    guac_mem_free(tags);
+
+    /* Retain header pages for users that join later */
+    state->headers = guac_mem_alloc(state->written);
+    state->headers_length = state->written;
+    guac_client_account_memory(state->client, GUAC_CLIENT_MEMORY_AUDIO,
+            state->headers_length);
+    memcpy(state->headers, state->buffer, state->written);
+
+}
+
+/**
+ * Encodes the current 48 kHz frame of the given audio stream as a single Opus
+ * packet, padding it with silence if it is incomplete, and adds that packet
+ * to the Ogg stream.
+ *
+ * @param audio
+ *     The audio stream whose current frame should be encoded.
+ *
+ * @param end_of_stream
+ *     Non-zero if this is the final packet of the stream, zero otherwise.
+ */
+static void opus_encoder_encode_frame(guac_audio_stream* audio,
+        int end_of_stream) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+    unsigned char data[GUAC_OPUS_ENCODER_MAX_PACKET_SIZE];
+
+    /* Pad any incomplete frame with silence */
+    memset(state->frame + state->frame_length * audio->channels, 0,
+            (GUAC_OPUS_ENCODER_FRAME_SIZE - state->frame_length)
+            * audio->channels * sizeof(opus_int16));
+
+    opus_int32 size = opus_encode(state->encoder, state->frame,
+            GUAC_OPUS_ENCODER_FRAME_SIZE, data, sizeof(data));
+
+    state->frame_length = 0;
+
+    if (size < 0) {
+        guac_client_log(audio->client, GUAC_LOG_DEBUG, "Opus encoding of "
+                "audio frame failed: %s", opus_strerror(size));
+        return;
+    }
+
+    state->granule_position += GUAC_OPUS_ENCODER_FRAME_SIZE;
+
+    ogg_packet packet = {
+        .packet     = data,
+        .bytes      = size,
+        .e_o_s      = end_of_stream,
+        .granulepos = state->granule_position,
+        .packetno   = state->packet_number++
+    };
+
+    ogg_stream_packetin(&state->ogg_state, &packet);
+    opus_encoder_buffer_pages(state, 0);
+
+}
+
+/**
+ * Adds a single input sample for each channel to the given audio stream,
+ * producing as many 48 kHz output samples as fall between the previous input
+ * sample and this sample by linear interpolation. Each frame completed as a
+ * result is encoded.
+ *
+ * @param audio
+ *     The audio stream receiving the sample.
+ *
+ * @param sample
+ *     The 16-bit signed value of the sample for each channel.
+ */
+static void opus_encoder_add_sample(guac_audio_stream* audio,
+        const int* sample) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+    int channels = audio->channels;
+
+    while (state->phase < GUAC_OPUS_ENCODER_RATE) {
+
+        opus_int16* output = state->frame + state->frame_length * channels;
+        for (int channel = 0; channel < channels; channel++) {
+            int64_t delta = sample[channel] - state->previous[channel];
+            output[channel] = state->previous[channel]
+                + delta * state->phase / GUAC_OPUS_ENCODER_RATE;
+        }
+
+        state->phase += audio->rate;
+
+        if (++state->frame_length == GUAC_OPUS_ENCODER_FRAME_SIZE)
+            opus_encoder_encode_frame(audio, 0);
+
+    }
+
+    state->phase -= GUAC_OPUS_ENCODER_RATE;
+    memcpy(state->previous, sample, channels * sizeof(int));
+
+}
+
+static void opus_encoder_flush_handler(guac_audio_stream* audio) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+    guac_socket* socket = audio->client->socket;
+    guac_stream* stream = audio->stream;
+
+    if (state->encoder == NULL)
+        return;
+
+    /* Place all encoded packets into pages */
+    opus_encoder_buffer_pages(state, 1);
+
+    /* Flush all pages in buffer as blobs */
+    guac_protocol_send_blobs(socket, stream, state->buffer, state->written);
+
+    /* All data has been flushed */
+    state->written = 0;
+
+}
+
+static void opus_encoder_send_audio(guac_audio_stream* audio,
+        guac_socket* socket) {
+
+    /* Associate stream */
+    guac_protocol_send_audio(socket, audio->stream, opus_encoder->mimetype);
+
+}
+
+static void opus_encoder_begin_handler(guac_audio_stream* audio) {
+
+    opus_encoder_state* state;
+    int error;
+
+    /* Allocate and init encoder state */
+    audio->data = state = guac_mem_zalloc(sizeof(opus_encoder_state));
+    state->client = audio->client;
+
+    /* Opus without a channel mapping table is limited to stereo */
+    if (audio->channels < 1
+            || audio->channels > GUAC_OPUS_ENCODER_MAX_CHANNELS
+            || (audio->bps != 8 && audio->bps != 16)
+            || audio->rate <= 0) {
+        guac_client_log(audio->client, GUAC_LOG_WARNING, "Audio with %i "
+                "channel(s) of %i-bit PCM at %i Hz cannot be encoded as "
+                "Opus.", audio->channels, audio->bps, audio->rate);
+        return;
+    }
+
+    state->encoder = opus_encoder_create(GUAC_OPUS_ENCODER_RATE,
+            audio->channels, OPUS_APPLICATION_AUDIO, &error);
+
+    if (state->encoder == NULL) {
+        guac_client_log(audio->client, GUAC_LOG_WARNING, "Unable to create "
+                "Opus encoder: %s", opus_strerror(error));
+        return;
+    }
+
+    opus_encoder_ctl(state->encoder,
+            OPUS_SET_BITRATE(GUAC_OPUS_ENCODER_BITRATE));
+
+    ogg_stream_init(&state->ogg_state, rand());
+    opus_encoder_write_headers(audio);
+
+    /* Broadcast existence of stream, followed by its headers */
+    opus_encoder_send_audio(audio, audio->client->socket);
+    opus_encoder_flush_handler(audio);
+
+}
+
+static void opus_encoder_join_handler(guac_audio_stream* audio,
+        guac_user* user) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+
+    /* Streams which could not be encoded are never announced */
+    if (state->encoder == NULL)
+        return;
+
+    /* Notify user of existence of stream */
+    opus_encoder_send_audio(audio, user->socket);
+
+    /* Provide headers needed to decode the stream */
+    guac_protocol_send_blobs(user->socket, audio->stream,
+            state->headers, state->headers_length);
+
+}
+
+static void opus_encoder_end_handler(guac_audio_stream* audio) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+
+    if (state->encoder != NULL) {
+
+        /* Encode remaining audio as the final packet */
+        opus_encoder_encode_frame(audio, 1);
+        opus_encoder_flush_handler(audio);
+
+        /* Send end of stream */
+        guac_protocol_send_end(audio->client->socket, audio->stream);
+
+        opus_encoder_destroy(state->encoder);
+        ogg_stream_clear(&state->ogg_state);
+
+    }
+
+    /* Free state information */
+    guac_client_account_memory(audio->client, GUAC_CLIENT_MEMORY_AUDIO,
+            -(int64_t) (state->headers_length + state->length));
+    guac_mem_free(state->headers);
+    guac_mem_free(state->buffer);
+    guac_mem_free(state);
+
+}
+
+static void opus_encoder_write_handler(guac_audio_stream* audio,
+        const unsigned char* pcm_data, int length) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+
+    if (state->encoder == NULL)
+        return;
+
+    int bytes_per_sample = audio->bps / 8;
+    int sample_frame_size = bytes_per_sample * audio->channels;
+
+    while (length > 0) {
+
+        /* Gather bytes until a complete sample exists for every channel */
+        int chunk_size = sample_frame_size - state->partial_length;
+        if (chunk_size > length)
+            chunk_size = length;
+
+        memcpy(state->partial + state->partial_length, pcm_data, chunk_size);
+        state->partial_length += chunk_size;
+        pcm_data += chunk_size;
+        length -= chunk_size;
+
+        if (state->partial_length < sample_frame_size)
+            break;
+
+        /* Convert sample for each channel to 16-bit signed PCM */
+        int sample[GUAC_OPUS_ENCODER_MAX_CHANNELS];
+        const unsigned char* current = state->partial;
+        for (int channel = 0; channel < audio->channels; channel++) {
+
+            if (bytes_per_sample == 2)
+                sample[channel] = (int16_t) (current[0] | (current[1] << 8));
+            else
+                sample[channel] = ((int8_t) current[0]) * 256;
+
+            current += bytes_per_sample;
+
+        }
+
+        opus_encoder_add_sample(audio, sample);
+        state->partial_length = 0;
+
+    }
+
+}
+
+/* Ogg Opus encoder handlers */
+guac_audio_encoder _opus_encoder = {
+    .mimetype      = "audio/ogg; codecs=opus",
+    .begin_handler = opus_encoder_begin_handler,
+    .write_handler = opus_encoder_write_handler,
+    .flush_handler = opus_encoder_flush_handler,
+    .join_handler  = opus_encoder_join_handler,
+    .end_handler   = opus_encoder_end_handler
+};
+
+/* Actual encoder definition */
+guac_audio_encoder* opus_encoder = &_opus_encoder;
+
@@ -0,0 +1,172 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_OPUS_ENCODER_H
+#define GUAC_OPUS_ENCODER_H
+
+#include "config.h"
+
+#include "guacamole/audio.h"
+#include "guacamole/client-types.h"
+
+#include <ogg/ogg.h>
+#include <opus/opus.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The sample rate used internally by the Opus encoder, in Hz. Opus streams
+ * within Ogg are always timed at 48 kHz, and PCM at any other rate is
+ * resampled to this rate before encoding.
+ */
+#define GUAC_OPUS_ENCODER_RATE 48000
+
+/**
+ * The number of samples per channel within each Opus frame. At 48 kHz, this
+ * is 20 milliseconds of audio.
+ */
+#define GUAC_OPUS_ENCODER_FRAME_SIZE 960
+
+/**
+ * The target bitrate of the encoded audio, in bits per second.
+ */
+#define GUAC_OPUS_ENCODER_BITRATE 64000
+
+/**
+ * The maximum size of a single encoded Opus packet, in bytes.
+ */
+#define GUAC_OPUS_ENCODER_MAX_PACKET_SIZE 4000
+
+/**
+ * The maximum number of channels supported by the Opus encoder without a
+ * channel mapping table.
+ */
+#define GUAC_OPUS_ENCODER_MAX_CHANNELS 2
+
+/**
+ * The current state of the Opus encoder. Provided PCM is resampled to 48 kHz,
+ * gathered into 20 ms frames, encoded with libopus, and packed into Ogg pages
+ * which are buffered until the stream is flushed.
+ */
+typedef struct opus_encoder_state {
+
+    /**
+     * The guac_client to which the memory allocated for buffered Ogg pages
+     * is attributed.
+     */
+    guac_client* client;
+
+    /**
+     * The libopus encoder instance.
+     */
+    OpusEncoder* encoder;
+
+    /**
+     * The Ogg stream receiving encoded Opus packets.
+     */
+    ogg_stream_state ogg_state;
+
+    /**
+     * The Ogg pages containing the OpusHead and OpusTags headers, which must
+     * be sent to any user joining the stream before any audio data.
+     */
+    unsigned char* headers;
+
+    /**
+     * The size of the headers buffer, in bytes.
+     */
+    size_t headers_length;
+
+    /**
+     * Buffer of Ogg pages which have not yet been sent.
+     */
+    unsigned char* buffer;
+
+    /**
+     * The total size of the buffer of unsent Ogg pages, in bytes.
+     */
+    size_t length;
+
+    /**
+     * The current number of bytes stored within the buffer of unsent Ogg
+     * pages.
+     */
+    size_t written;
+
+    /**
+     * Any trailing bytes of a PCM sample frame that were received as part of
+     * the most recent write but which do not yet form a complete sample for
+     * every channel.
+     */
+    unsigned char partial[GUAC_OPUS_ENCODER_MAX_CHANNELS * 2];
+
+    /**
+     * The number of bytes currently stored within partial.
+     */
+    int partial_length;
+
+    /**
+     * The most recently received input sample for each channel, as 16-bit
+     * signed PCM. Output samples are interpolated between this sample and
+     * the next sample received.
+     */
+    int previous[GUAC_OPUS_ENCODER_MAX_CHANNELS];
+
+    /**
+     * The position of the next output sample between the previous input
+     * sample and the next input sample, in units of 1/48000 of an input
+     * sample.
+     */
+    int phase;
+
+    /**
+     * The 48 kHz 16-bit PCM frame currently being assembled, with samples
+     * for each channel interleaved.
+     */
+    opus_int16 frame[GUAC_OPUS_ENCODER_FRAME_SIZE
+        * GUAC_OPUS_ENCODER_MAX_CHANNELS];
+
+    /**
+     * The number of samples per channel currently stored within frame.
+     */
+    int frame_length;
+
+    /**
+     * The number of 48 kHz samples per channel encoded so far, including
+     * the encoder's pre-skip, as required for the Ogg granule position.
+     */
+    int64_t granule_position;
+
+    /**
+     * The sequence number of the next packet to be written to the Ogg
+     * stream.
+     */
+    int64_t packet_number;
+
+} opus_encoder_state;
+
+/**
+ * Audio encoder which writes Opus-encoded audio within an Ogg container.
+ */
+extern guac_audio_encoder* opus_encoder;
+
+#endif
+
@@ -29,7 +29,72 @@
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * Returns the index of the given color within the given palette, adding that
+ * color to the palette if not already present.
+ *
+ * @param palette
+ *     The palette to search and add to.
+ *
+ * @param color
+ *     The 24-bit RGB color to search for.
+ *
+ * @return
+ *     The zero-based index of the given color within the palette, or -1 if
+ *     the color is not present and the palette is already at capacity.
+ */
+static int guac_palette_insert(guac_palette* palette, int color) {
+
+    /* Calculate hash code */
+    int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
+
+    guac_palette_entry* entry;
+
+    /* Search for open palette entry */
+    for (;;) {
+
+        entry = &(palette->entries[hash]);
+
+        /* If we've found a free space, use it */
+        if (entry->index == 0) {
+
+            png_color* c;
+
+            /* Stop if already at capacity */
+            if (palette->size == 256)
+                return -1;
+
+            /* Store in palette */
+            c = &(palette->colors[palette->size]);
+            c->blue  = (color      ) & 0xFF;
+            c->green = (color >> 8 ) & 0xFF;
+            c->red   = (color >> 16) & 0xFF;
+
+            /* Add color to map */
+            entry->index = ++palette->size;
+            entry->color = color;
+
+            return entry->index - 1;
+
+        }
+
+        /* Otherwise, if already stored here, done */
+        if (entry->color == color)
+            return entry->index - 1;
+
+        /* Otherwise, collision. Move on to another bucket */
+        hash = (hash+1) & 0xFFF;
+
+    }
+
+}
+
 guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
+    return guac_palette_alloc_indexed(surface, NULL);
+}
+
+guac_palette* guac_palette_alloc_indexed(cairo_surface_t* surface,
+        unsigned char* indices) {
 
     int x, y;
 
@@ -42,54 +107,37 @@ guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
     guac_palette* palette = (guac_palette*) guac_mem_zalloc(sizeof(guac_palette));
 
     for (y=0; y<height; y++) {
-        for (x=0; x<width; x++) {
 
-            /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
-
-            /* Calculate hash code */
-            int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
-
-            guac_palette_entry* entry;
-
-            /* Search for open palette entry */
-            for (;;) {
-                
-                entry = &(palette->entries[hash]);
-
-                /* If we've found a free space, use it */
-                if (entry->index == 0) {
-
-                    png_color* c;
+        uint32_t* row = (uint32_t*) data;
 
-                    /* Stop if already at capacity */
-                    if (palette->size == 256) {
-                        guac_palette_free(palette);
-                        return NULL;
-                    }
+        /* Color and index of the run of pixels currently being read. Low-color
+         * content consists almost entirely of such runs, so the hash table
+         * need only be consulted where the color actually changes. */
+        int last_color = -1;
+        int last_index = -1;
 
-                    /* Store in palette */
-                    c = &(palette->colors[palette->size]);
-                    c->blue  = (color      ) & 0xFF;
-                    c->green = (color >> 8 ) & 0xFF;
-                    c->red   = (color >> 16) & 0xFF;
+        for (x=0; x<width; x++) {
 
-                    /* Add color to map */
-                    entry->index = ++palette->size;
-                    entry->color = color;
+            /* Get pixel color */
+            int color = row[x] & 0xFFFFFF;
 
-                    break;
+            /* Look up the index of each new color, bailing out entirely if
+             * the image has more colors than a palette can hold */
+            if (color != last_color) {
 
+                last_index = guac_palette_insert(palette, color);
+                if (last_index < 0) {
+                    guac_palette_free(palette);
+                    return NULL;
                 }
 
-                /* Otherwise, if already stored here, done */
-                if (entry->color == color)
-                    break;
-
-                /* Otherwise, collision. Move on to another bucket */
-                hash = (hash+1) & 0xFFF;
+                last_color = color;
 
             }
+
+            if (indices != NULL)
+                *(indices++) = last_index;
+
         }
 
         /* Advance to next data row */
@@ -39,6 +39,29 @@ typedef struct guac_palette {
 } guac_palette;
 
 guac_palette* guac_palette_alloc(cairo_surface_t* surface);
+
+/**
+ * Builds a palette from the colors of the given RGB24 surface, storing the
+ * palette index of each pixel within the given buffer as the palette is
+ * built. The surface is read only once, with each pixel's index derived
+ * from the same lookup that adds its color to the palette.
+ *
+ * @param surface
+ *     The surface to build a palette from.
+ *
+ * @param indices
+ *     A buffer of at least width * height bytes that should receive the
+ *     palette index of each pixel of the surface in row-major order, with no
+ *     padding between rows, or NULL if indices need not be stored.
+ *
+ * @return
+ *     A newly-allocated palette containing every color of the given surface,
+ *     or NULL if the surface contains more than 256 distinct colors. The
+ *     contents of the index buffer are undefined if NULL is returned.
+ */
+guac_palette* guac_palette_alloc_indexed(cairo_surface_t* surface,
+        unsigned char* indices);
+
 int guac_palette_find(guac_palette* palette, int color);
 void guac_palette_free(guac_palette* palette);
 
@@ -0,0 +1,183 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "parser-ascii.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef HAVE_AVX2_TARGET
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GUAC_PARSER_ASCII_NEON
+#endif
+
+/**
+ * Mask which, when applied to eight bytes read as a single 64-bit integer,
+ * is non-zero only if at least one of those bytes is not ASCII.
+ */
+#define GUAC_PARSER_ASCII_WORD_MASK 0x8080808080808080ULL
+
+size_t guac_parser_ascii_span_scalar(const char* buffer, size_t length) {
+
+    size_t span = 0;
+
+    /* Test eight bytes at a time while possible */
+    while (length - span >= sizeof(uint64_t)) {
+
+        uint64_t word;
+        memcpy(&word, buffer + span, sizeof(word));
+
+        if (word & GUAC_PARSER_ASCII_WORD_MASK)
+            break;
+
+        span += sizeof(word);
+
+    }
+
+    /* Locate the exact end of the span byte by byte */
+    while (span < length && (unsigned char) buffer[span] < 0x80)
+        span++;
+
+    return span;
+
+}
+
+#ifdef HAVE_AVX2_TARGET
+
+/**
+ * AVX2 implementation of guac_parser_ascii_span_function, testing 32 bytes at
+ * a time. As the high bit of each byte is exactly what distinguishes non-ASCII
+ * bytes, no comparison is needed; the mask of high bits is used directly.
+ *
+ * @see guac_parser_ascii_span_function
+ */
+__attribute__((target("avx2")))
+static size_t guac_parser_ascii_span_avx2(const char* buffer, size_t length) {
+
+    size_t span = 0;
+
+    while (length - span >= 32) {
+
+        __m256i bytes = _mm256_loadu_si256((const __m256i*) (buffer + span));
+        uint32_t non_ascii = (uint32_t) _mm256_movemask_epi8(bytes);
+
+        if (non_ascii)
+            return span + __builtin_ctz(non_ascii);
+
+        span += 32;
+
+    }
+
+    return span + guac_parser_ascii_span_scalar(buffer + span, length - span);
+
+}
+
+#endif
+
+#ifdef GUAC_PARSER_ASCII_NEON
+
+/**
+ * NEON implementation of guac_parser_ascii_span_function, testing 16 bytes at
+ * a time. Only whether each block is entirely ASCII is determined here; the
+ * exact position of the first non-ASCII byte within a block is located by
+ * guac_parser_ascii_span_scalar().
+ *
+ * @see guac_parser_ascii_span_function
+ */
+static size_t guac_parser_ascii_span_neon(const char* buffer, size_t length) {
+
+    size_t span = 0;
+
+    while (length - span >= 16) {
+
+        uint8x16_t bytes = vld1q_u8((const uint8_t*) (buffer + span));
+        if (vmaxvq_u8(bytes) >= 0x80)
+            break;
+
+        span += 16;
+
+    }
+
+    return span + guac_parser_ascii_span_scalar(buffer + span, length - span);
+
+}
+
+#endif
+
+/**
+ * The implementation of guac_parser_ascii_span_function that should be used on
+ * the current CPU. This is initialized exactly once, upon first use, by
+ * guac_parser_ascii_init().
+ */
+static guac_parser_ascii_span_function* guac_parser_ascii_span_impl =
+    guac_parser_ascii_span_scalar;
+
+/**
+ * Human-readable name of the implementation stored within
+ * guac_parser_ascii_span_impl.
+ */
+static const char* guac_parser_ascii_span_impl_name = "scalar";
+
+/**
+ * Control used to ensure guac_parser_ascii_init() is invoked only once.
+ */
+static pthread_once_t guac_parser_ascii_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Selects the fastest implementation of guac_parser_ascii_span_function that
+ * is supported by the current CPU. This function must be invoked only through
+ * pthread_once() with guac_parser_ascii_once.
+ */
+static void guac_parser_ascii_init(void) {
+
+#ifdef HAVE_AVX2_TARGET
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        guac_parser_ascii_span_impl = guac_parser_ascii_span_avx2;
+        guac_parser_ascii_span_impl_name = "avx2";
+        return;
+    }
+#endif
+
+#ifdef GUAC_PARSER_ASCII_NEON
+    /* NEON is mandatory on AArch64 and needs no runtime check */
+    guac_parser_ascii_span_impl = guac_parser_ascii_span_neon;
+    guac_parser_ascii_span_impl_name = "neon";
+#endif
+
+}
+
+guac_parser_ascii_span_function* guac_parser_get_ascii_span(void) {
+    pthread_once(&guac_parser_ascii_once, guac_parser_ascii_init);
+    return guac_parser_ascii_span_impl;
+}
+
+const char* guac_parser_get_ascii_span_name(void) {
+    pthread_once(&guac_parser_ascii_once, guac_parser_ascii_init);
+    return guac_parser_ascii_span_impl_name;
+}
+
@@ -0,0 +1,78 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_PARSER_ASCII_H
+#define GUAC_PARSER_ASCII_H
+
+#include <stddef.h>
+
+/**
+ * Function that determines the number of consecutive ASCII bytes (bytes
+ * having a value less than 0x80) at the start of the given buffer. As each
+ * such byte is a complete UTF-8 character, this is also the number of
+ * characters that may be skipped at once while parsing element content.
+ *
+ * @param buffer
+ *     The buffer to scan.
+ *
+ * @param length
+ *     The maximum number of bytes to scan. No bytes beyond this point will be
+ *     accessed.
+ *
+ * @return
+ *     The number of consecutive ASCII bytes at the start of the buffer, which
+ *     will not exceed the given length.
+ */
+typedef size_t guac_parser_ascii_span_function(const char* buffer,
+        size_t length);
+
+/**
+ * Portable, scalar implementation of guac_parser_ascii_span_function. The
+ * results of this implementation are the reference against which any
+ * SIMD-accelerated implementation must be identical.
+ *
+ * @see guac_parser_ascii_span_function
+ */
+guac_parser_ascii_span_function guac_parser_ascii_span_scalar;
+
+/**
+ * Returns the fastest implementation of guac_parser_ascii_span_function
+ * supported by the current CPU, as determined at runtime. If no
+ * SIMD-accelerated implementation is supported, this will be
+ * guac_parser_ascii_span_scalar().
+ *
+ * @return
+ *     The fastest available implementation of
+ *     guac_parser_ascii_span_function.
+ */
+guac_parser_ascii_span_function* guac_parser_get_ascii_span(void);
+
+/**
+ * Returns a human-readable name for the implementation returned by
+ * guac_parser_get_ascii_span(), such as "avx2", "neon", or "scalar".
+ *
+ * @return
+ *     The name of the implementation of guac_parser_ascii_span_function
+ *     selected for the current CPU.
+ */
+const char* guac_parser_get_ascii_span_name(void);
+
+#endif
+
@@ -19,12 +19,14 @@
 
 #include "config.h"
 
+#include "parser-ascii.h"
 #include "guacamole/mem.h"
 #include "guacamole/error.h"
 #include "guacamole/parser.h"
 #include "guacamole/socket.h"
 #include "guacamole/unicode.h"
 
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -37,6 +39,20 @@ static void guac_parser_reset(guac_parser* parser) {
     parser->__element_length = 0;
 }
 
+/**
+ * Returns the size of the instruction buffer required for a parser that
+ * accepts elements of up to the given number of characters.
+ *
+ * @param max_length
+ *     The maximum number of characters allowed within any one element.
+ *
+ * @return
+ *     The required size of the instruction buffer, in bytes.
+ */
+static size_t guac_parser_buffer_size(int max_length) {
+    return (size_t) max_length * GUAC_INSTRUCTION_MAX_CHAR_BYTES;
+}
+
 guac_parser* guac_parser_alloc(void) {
 
     /* Allocate space for parser */
@@ -47,6 +63,17 @@ guac_parser* guac_parser_alloc(void) {
         return NULL;
     }
 
+    /* Allocate instruction buffer for default maximum length */
+    parser->__max_length = GUAC_INSTRUCTION_MAX_LENGTH;
+    parser->__instructionbuf_size = guac_parser_buffer_size(GUAC_INSTRUCTION_MAX_LENGTH);
+    parser->__instructionbuf = guac_mem_alloc(parser->__instructionbuf_size);
+    if (parser->__instructionbuf == NULL) {
+        guac_mem_free(parser);
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Insufficient memory to allocate parser";
+        return NULL;
+    }
+
     /* Init parse start/end markers */
     parser->__instructionbuf_unparsed_start = parser->__instructionbuf;
     parser->__instructionbuf_unparsed_end = parser->__instructionbuf;
@@ -56,6 +83,47 @@ guac_parser* guac_parser_alloc(void) {
 
 }
 
+int guac_parser_set_max_length(guac_parser* parser, int max_length) {
+
+    /* Refuse limits outside the supported range */
+    if (max_length <= 0 || max_length > GUAC_INSTRUCTION_MAX_LENGTH_LIMIT) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Maximum instruction length out of range";
+        return 1;
+    }
+
+    /* Grow buffer only if needed, preserving any data already buffered */
+    size_t size = guac_parser_buffer_size(max_length);
+    if (size > parser->__instructionbuf_size) {
+
+        char* old_buffer = parser->__instructionbuf;
+        char* new_buffer = guac_mem_realloc(old_buffer, size);
+        if (new_buffer == NULL)
+            return 1;
+
+        /* Update tracking pointers, which may now be invalid */
+        parser->__instructionbuf_unparsed_start =
+            new_buffer + (parser->__instructionbuf_unparsed_start - old_buffer);
+        parser->__instructionbuf_unparsed_end =
+            new_buffer + (parser->__instructionbuf_unparsed_end - old_buffer);
+
+        /* Update parsed elements, if any */
+        for (int i = 0; i < parser->__elementc; i++)
+            parser->__elementv[i] = new_buffer + (parser->__elementv[i] - old_buffer);
+
+        if (parser->opcode != NULL)
+            parser->opcode = parser->__elementv[0];
+
+        parser->__instructionbuf = new_buffer;
+        parser->__instructionbuf_size = size;
+
+    }
+
+    parser->__max_length = max_length;
+    return 0;
+
+}
+
 int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
     char* char_buffer = (char*) buffer;
@@ -78,10 +146,19 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
             char c = *(char_buffer++);
             bytes_parsed++;
 
-            /* If digit, add to length */
-            if (c >= '0' && c <= '9')
+            /* If digit, add to length, failing as soon as the length is
+             * known to be too long */
+            if (c >= '0' && c <= '9') {
+
                 parsed_length = parsed_length*10 + c - '0';
 
+                if (parsed_length > parser->__max_length) {
+                    parser->state = GUAC_PARSE_ERROR;
+                    return 0;
+                }
+
+            }
+
             /* If period, switch to parsing content */
             else if (c == '.') {
                 parser->__elementv[parser->__elementc++] = char_buffer;
@@ -97,12 +174,6 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
         }
 
-        /* If too long, parse error */
-        if (parsed_length > GUAC_INSTRUCTION_MAX_LENGTH) {
-            parser->state = GUAC_PARSE_ERROR;
-            return 0;
-        }
-
         /* Save length */
         parser->__element_length = parsed_length;
 
@@ -111,8 +182,31 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
     /* Parse element content */
     if (parser->state == GUAC_PARSE_CONTENT) {
 
+        guac_parser_ascii_span_function* ascii_span = guac_parser_get_ascii_span();
+
         while (bytes_parsed < length && parser->__element_length >= 0) {
 
+            /* Skip directly past any run of ASCII characters within the
+             * element, as each such character is exactly one byte */
+            if (parser->__element_length > 0
+                    && (unsigned char) *char_buffer < 0x80) {
+
+                int available = length - bytes_parsed;
+                if (available > parser->__element_length)
+                    available = parser->__element_length;
+
+                int span = ascii_span(char_buffer, available);
+
+                parser->__element_length -= span;
+                bytes_parsed += span;
+                char_buffer += span;
+
+                /* Stop if the run consumed all available data */
+                if (bytes_parsed == length)
+                    break;
+
+            }
+
             /* Get length of current character */
             char c = *char_buffer;
             int char_length = guac_utf8_charsize((unsigned char) c);
@@ -164,12 +258,55 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
 }
 
+int guac_parser_parse(guac_parser* parser, void* buffer, size_t length) {
+
+    char* start = (char*) buffer;
+    char* current = start;
+
+    /* Begin next instruction if previous was ended */
+    if (parser->state == GUAC_PARSE_COMPLETE)
+        guac_parser_reset(parser);
+
+    while (parser->state != GUAC_PARSE_COMPLETE
+        && parser->state != GUAC_PARSE_ERROR) {
+
+        /* Append no more than guac_parser_append() can accept at once (no
+         * valid instruction is anywhere near this long) */
+        size_t remaining = length - (current - start);
+        if (remaining > INT_MAX)
+            remaining = INT_MAX;
+
+        int parsed = guac_parser_append(parser, current, remaining);
+
+        /* The buffer must contain the entire instruction */
+        if (parsed == 0 && parser->state != GUAC_PARSE_ERROR) {
+            guac_error = GUAC_STATUS_CLOSED;
+            guac_error_message = "End of buffer reached while reading "
+                                 "instruction";
+            return -1;
+        }
+
+        current += parsed;
+
+    }
+
+    /* Fail on error */
+    if (parser->state == GUAC_PARSE_ERROR) {
+        guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+        guac_error_message = "Instruction parse error";
+        return -1;
+    }
+
+    return current - start;
+
+}
+
 int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout) {
 
     char* unparsed_end   = parser->__instructionbuf_unparsed_end;
     char* unparsed_start = parser->__instructionbuf_unparsed_start;
     char* instr_start    = parser->__instructionbuf_unparsed_start;
-    char* buffer_end     = parser->__instructionbuf + sizeof(parser->__instructionbuf);
+    char* buffer_end     = parser->__instructionbuf + parser->__instructionbuf_size;
 
     /* Begin next instruction if previous was ended */
     if (parser->state == GUAC_PARSE_COMPLETE)
@@ -314,6 +451,7 @@ int guac_parser_shift(guac_parser* parser, void* buffer, int length) {
 }
 
 void guac_parser_free(guac_parser* parser) {
+    guac_mem_free(parser->__instructionbuf);
     guac_mem_free(parser);
 }
 
@@ -24,28 +24,24 @@
 #include "guacamole/pool.h"
 
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 guac_pool* guac_pool_alloc(int size) {
 
-    pthread_mutexattr_t lock_attributes;
-    guac_pool* pool = guac_mem_alloc(sizeof(guac_pool));
+    guac_pool* pool = guac_mem_zalloc(sizeof(guac_pool));
 
     /* If unable to allocate, just return NULL. */
     if (pool == NULL)
         return NULL;
 
-    /* Initialize empty pool */
+    /* Initialize empty pool (the bitmap of freed integers is initially
+     * empty, its directories having been zeroed) */
     pool->min_size = size;
     pool->active = 0;
     pool->__next_value = 0;
-    pool->__head = NULL;
-    pool->__tail = NULL;
-
-    /* Init lock */
-    pthread_mutexattr_init(&lock_attributes);
-    pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(&(pool->__lock), &lock_attributes);
+    pool->__free_count = 0;
+    pool->__free_cursor = 0;
 
     return pool;
 
@@ -53,18 +49,19 @@ guac_pool* guac_pool_alloc(int size) {
 
 void guac_pool_free(guac_pool* pool) {
 
-    /* Free all ints in pool */
-    guac_pool_int* current = pool->__head;
-    while (current != NULL) {
+    /* Free all blocks and directories of bitmap */
+    for (int i = 0; i < GUAC_POOL_DIRECTORIES; i++) {
 
-        guac_pool_int* old = current;
-        current = current->__next;
+        uint64_t** directory = pool->__free_bitmap[i];
+        if (directory == NULL)
+            continue;
 
-        guac_mem_free(old);
-    }
+        for (int j = 0; j < GUAC_POOL_DIRECTORY_SIZE; j++)
+            guac_mem_free(directory[j]);
+
+        guac_mem_free(directory);
 
-    /* Destroy lock */
-    pthread_mutex_destroy(&(pool->__lock));
+    }
 
     /* Free pool */
     guac_mem_free(pool);
@@ -72,99 +69,243 @@ void guac_pool_free(guac_pool* pool) {
 }
 
 /**
- * Returns the next available integer from the given guac_pool. All integers
- * returned are non-negative, and are returned in sequence, starting from 0.
+ * Atomically stores the given newly-allocated pointer at the given location
+ * if no pointer is yet stored there, returning whichever pointer is stored
+ * there afterwards. If another pointer was already stored, the given pointer
+ * is freed.
+ *
+ * @param location
+ *     The location to store the pointer at.
  *
- * Unlike the public guac_pool_next_int() function, this function is NOT atomic
- * and depends on the caller having already acquired the pool's lock.
+ * @param allocated
+ *     The newly-allocated pointer to store.
+ *
+ * @return
+ *     The pointer stored at the given location, which may or may not be the
+ *     given pointer.
+ */
+static void* guac_pool_install(void** location, void* allocated) {
+
+    void* expected = NULL;
+    if (__atomic_compare_exchange_n(location, &expected, allocated, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return allocated;
+
+    /* Another thread installed its own copy first */
+    guac_mem_free(allocated);
+    return expected;
+
+}
+
+/**
+ * Returns the block of the bitmap of freed integers with the given index,
+ * optionally allocating that block if it does not yet exist.
  *
  * @param pool
- *     The guac_pool to retrieve an integer from.
+ *     The guac_pool containing the bitmap.
+ *
+ * @param index
+ *     The index of the block, equal to the value of any integer represented
+ *     by that block divided by GUAC_POOL_BLOCK_SIZE.
+ *
+ * @param create
+ *     Non-zero if the block should be allocated if it does not yet exist,
+ *     zero otherwise.
  *
  * @return
- *     The next available integer, which may be either an integer not yet
- *     returned by a call to guac_pool_next_int, or an integer which was
- *     previously returned but has since been freed.
+ *     The requested block, or NULL if the block does not exist and create is
+ *     zero.
  */
-static int __guac_pool_next_int(guac_pool* pool) {
+static uint64_t* guac_pool_get_block(guac_pool* pool, int index,
+        int create) {
+
+    uint64_t*** directory_location =
+        &(pool->__free_bitmap[index / GUAC_POOL_DIRECTORY_SIZE]);
+
+    uint64_t** directory = __atomic_load_n(directory_location, __ATOMIC_ACQUIRE);
+    if (directory == NULL) {
 
-    int value;
+        if (!create)
+            return NULL;
 
-    /* It's unlikely that any usage of guac_pool will ever manage to reach
-     * INT_MAX concurrent requests for integers, but we definitely should bail
-     * out if ever this does happen. Tracing this sort of issue down would be
-     * extremely difficult without fail-fast behavior. */
-    GUAC_ASSERT(pool->__next_value < INT_MAX);
-    GUAC_ASSERT(pool->active < INT_MAX);
+        directory = guac_pool_install((void**) directory_location,
+                guac_mem_zalloc(sizeof(uint64_t*), GUAC_POOL_DIRECTORY_SIZE));
+        GUAC_ASSERT(directory != NULL);
 
-    pool->active++;
+    }
+
+    uint64_t** block_location = &(directory[index % GUAC_POOL_DIRECTORY_SIZE]);
+
+    uint64_t* block = __atomic_load_n(block_location, __ATOMIC_ACQUIRE);
+    if (block == NULL) {
 
-    /* If more integers are needed, return a new one. */
-    if (pool->__head == NULL || pool->__next_value < pool->min_size)
-        value = pool->__next_value++;
+        if (!create)
+            return NULL;
 
-    /* Otherwise, reuse a previously freed integer */
-    else {
+        block = guac_pool_install((void**) block_location,
+                guac_mem_zalloc(sizeof(uint64_t), GUAC_POOL_BLOCK_WORDS));
+        GUAC_ASSERT(block != NULL);
 
-        value = pool->__head->value;
+    }
+
+    return block;
 
-        /* If only one element exists, reset pool to empty. */
-        if (pool->__tail == pool->__head) {
-            guac_mem_free(pool->__head);
-            pool->__head = NULL;
-            pool->__tail = NULL;
+}
+
+/**
+ * Searches the bitmap of freed integers for any freed integer, atomically
+ * claiming and returning the first such integer found. The caller must have
+ * already reserved a freed integer by decrementing __free_count, which
+ * guarantees that such an integer will eventually be found.
+ *
+ * @param pool
+ *     The guac_pool whose bitmap should be searched.
+ *
+ * @return
+ *     The freed integer that was claimed.
+ */
+static int guac_pool_claim_freed(guac_pool* pool) {
+
+    int start = __atomic_load_n(&(pool->__free_cursor), __ATOMIC_RELAXED);
+    int word_index = start / 64;
+
+    for (;;) {
+
+        /* Freed integers are always less than the next new integer, thus
+         * the search wraps around once it passes that point */
+        int end = __atomic_load_n(&(pool->__next_value), __ATOMIC_ACQUIRE);
+        if (word_index * 64 >= end) {
+            word_index = 0;
+            continue;
         }
 
-        /* Otherwise, advance head. */
-        else {
-            guac_pool_int* old_head = pool->__head;
-            pool->__head = old_head->__next;
-            guac_mem_free(old_head);
+        /* Skip any blocks that have never contained a freed integer */
+        int block_index = word_index / GUAC_POOL_BLOCK_WORDS;
+        uint64_t* block = guac_pool_get_block(pool, block_index, 0);
+        if (block == NULL) {
+            word_index = (block_index + 1) * GUAC_POOL_BLOCK_WORDS;
+            continue;
         }
 
-    }
+        uint64_t* word = &(block[word_index % GUAC_POOL_BLOCK_WORDS]);
+        uint64_t bits = __atomic_load_n(word, __ATOMIC_ACQUIRE);
 
-    /* Again, this should never happen and would be a sign of some fairly
-     * fundamental assumption failing. It's important for such things to fail
-     * fast. */
-    GUAC_ASSERT(value >= 0);
+        /* Attempt to claim each freed integer within the current word,
+         * giving up on the word only once no freed integers remain */
+        while (bits != 0) {
 
-    return value;
+            uint64_t bit = bits & -bits;
+            uint64_t previous = __atomic_fetch_and(word, ~bit, __ATOMIC_ACQ_REL);
 
-}
+            if (previous & bit) {
+                int value = word_index * 64 + __builtin_ctzll(bit);
+                __atomic_store_n(&(pool->__free_cursor), value + 1,
+                        __ATOMIC_RELAXED);
+                return value;
+            }
 
-int guac_pool_next_int(guac_pool* pool) {
+            /* Another thread claimed this integer first */
+            bits = previous & ~bit;
 
-    pthread_mutex_lock(&(pool->__lock));
-    int value = __guac_pool_next_int(pool);
-    pthread_mutex_unlock(&(pool->__lock));
+        }
 
-    return value;
+        word_index++;
+
+    }
 
 }
 
-int guac_pool_next_int_below(guac_pool* pool, int limit) {
+/**
+ * Returns the next available integer from the given guac_pool that is below
+ * the given limit, if possible. All integers returned are non-negative, and
+ * are returned in sequence, starting from 0. This operation is atomic and
+ * never blocks.
+ *
+ * @param pool
+ *     The guac_pool to retrieve an integer from.
+ *
+ * @param limit
+ *     The exclusive upper bound on the number of integers that may be in use
+ *     at once, and on any new integer returned.
+ *
+ * @return
+ *     The next available integer, which may be either an integer not yet
+ *     returned by a call to guac_pool_next_int, or an integer which was
+ *     previously returned but has since been freed, or -1 if limit integers
+ *     are already in use.
+ */
+static int __guac_pool_next_int(guac_pool* pool, int limit) {
+
+    /* Reserve the right to use an integer, bailing out if doing so would
+     * exceed the limit */
+    int active = __atomic_load_n(&(pool->active), __ATOMIC_RELAXED);
+    do {
+        if (active >= limit)
+            return -1;
+    } while (!__atomic_compare_exchange_n(&(pool->active), &active,
+                active + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    /* With fewer than limit integers in use (including the one just
+     * reserved), either a freed integer is available or a new integer below
+     * limit can be returned. Neither may be immediately visible while other
+     * threads are in the middle of freeing an integer, in which case we
+     * simply retry. */
+    for (;;) {
+
+        int next_value = __atomic_load_n(&(pool->__next_value), __ATOMIC_ACQUIRE);
+        int free_count = __atomic_load_n(&(pool->__free_count), __ATOMIC_ACQUIRE);
+
+        /* Reuse a freed integer if the minimum size has been reached (or if
+         * a new integer could not be returned anyway) */
+        if (free_count > 0
+                && (next_value >= pool->min_size || next_value >= limit)) {
+
+            if (__atomic_compare_exchange_n(&(pool->__free_count), &free_count,
+                        free_count - 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+                return guac_pool_claim_freed(pool);
 
-    pthread_mutex_lock(&(pool->__lock));
+        }
 
-    int value;
+        /* Otherwise, return a new integer */
+        else if (next_value < limit) {
 
-    /* Explicitly bail out now if there we would need to return a new integer,
-     * but can't without reaching the given limit */
-    if (pool->active >= limit || (pool->__next_value >= limit && pool->__head == NULL)) {
-        value = -1;
-    }
+            /* It's unlikely that any usage of guac_pool will ever manage to
+             * reach INT_MAX concurrent requests for integers, but we
+             * definitely should bail out if ever this does happen. Tracing
+             * this sort of issue down would be extremely difficult without
+             * fail-fast behavior. */
+            GUAC_ASSERT(next_value < INT_MAX);
+
+            if (__atomic_compare_exchange_n(&(pool->__next_value), &next_value,
+                        next_value + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+                return next_value;
+
+        }
 
-    /* In all other cases, attempt to obtain the requested integer (either
-     * reusing a freed integer or allocating a new one), but verify that some
-     * fundamental misuse of guac_pool hasn't resulted in values defying
-     * expectations */
-    else {
-        value = __guac_pool_next_int(pool);
-        GUAC_ASSERT(value < limit);
     }
 
-    pthread_mutex_unlock(&(pool->__lock));
+}
+
+int guac_pool_next_int(guac_pool* pool) {
+
+    int value = __guac_pool_next_int(pool, INT_MAX);
+
+    /* Again, this should never happen and would be a sign of some fairly
+     * fundamental assumption failing. It's important for such things to fail
+     * fast. */
+    GUAC_ASSERT(value >= 0);
+
+    return value;
+
+}
+
+int guac_pool_next_int_below(guac_pool* pool, int limit) {
+
+    /* Attempt to obtain the requested integer (either reusing a freed
+     * integer or allocating a new one), but verify that some fundamental
+     * misuse of guac_pool hasn't resulted in values defying expectations */
+    int value = __guac_pool_next_int(pool, limit);
+    GUAC_ASSERT(value < limit);
 
     return value;
 
@@ -184,29 +325,26 @@ int guac_pool_next_int_below_or_die(guac_pool* pool, int limit) {
 
 void guac_pool_free_int(guac_pool* pool, int value) {
 
-    /* Allocate and initialize new returned value */
-    guac_pool_int* pool_int = guac_mem_alloc(sizeof(guac_pool_int));
-    pool_int->value = value;
-    pool_int->__next = NULL;
+    GUAC_ASSERT(value >= 0);
 
-    /* Acquire exclusive access */
-    pthread_mutex_lock(&(pool->__lock));
+    uint64_t* block = guac_pool_get_block(pool,
+            value / GUAC_POOL_BLOCK_SIZE, 1);
 
-    GUAC_ASSERT(pool->active > 0);
-    pool->active--;
+    uint64_t bit = UINT64_C(1) << (value % 64);
+    uint64_t previous = __atomic_fetch_or(
+            &(block[(value % GUAC_POOL_BLOCK_SIZE) / 64]), bit,
+            __ATOMIC_ACQ_REL);
 
-    /* If pool empty, store as sole entry. */
-    if (pool->__tail == NULL)
-        pool->__head = pool->__tail = pool_int;
+    /* An integer must not be freed twice */
+    GUAC_ASSERT(!(previous & bit));
 
-    /* Otherwise, append to end of pool. */
-    else {
-        pool->__tail->__next = pool_int;
-        pool->__tail = pool_int;
-    }
+    /* Only after the freed integer is visible within the bitmap may it be
+     * counted (and thus claimed), and only after it has been counted may it
+     * cease being considered in use */
+    __atomic_fetch_add(&(pool->__free_count), 1, __ATOMIC_ACQ_REL);
 
-    /* Value has been freed */
-    pthread_mutex_unlock(&(pool->__lock));
+    int active = __atomic_fetch_sub(&(pool->active), 1, __ATOMIC_ACQ_REL);
+    GUAC_ASSERT(active > 0);
 
 }
 
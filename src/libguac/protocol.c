@@ -96,6 +96,221 @@ ssize_t __guac_socket_write_length_double(guac_socket* socket, double d) {
 
 }
 
+/**
+ * The size of the buffer in which each instruction is built by a
+ * guac_protocol_builder, in bytes. This is sufficient for any instruction
+ * having an opcode of up to 16 characters and up to nine integer arguments.
+ */
+#define GUAC_PROTOCOL_BUILDER_SIZE 256
+
+/**
+ * The maximum number of bytes required to append a single integer argument
+ * to an instruction: a comma, the length of the value (at most two digits),
+ * a period, and the value itself (at most nineteen digits plus a sign).
+ */
+#define GUAC_PROTOCOL_BUILDER_MAX_INT 24
+
+/**
+ * An instruction being built in memory, such that the entire instruction may
+ * be written to its socket with a single call to guac_socket_write(). This
+ * avoids the repeated formatting and separate writes of each element that
+ * would otherwise be needed for the frequently-sent drawing instructions.
+ */
+typedef struct guac_protocol_builder {
+
+    /**
+     * The socket that the instruction will be written to.
+     */
+    guac_socket* socket;
+
+    /**
+     * Non-zero if an error has occurred while writing any part of the
+     * instruction that did not fit within the buffer.
+     */
+    int error;
+
+    /**
+     * The number of bytes currently within the buffer.
+     */
+    size_t length;
+
+    /**
+     * The portion of the instruction not yet written to the socket.
+     */
+    char buffer[GUAC_PROTOCOL_BUILDER_SIZE];
+
+} guac_protocol_builder;
+
+/**
+ * Begins building a new instruction having the given opcode, which must be a
+ * string literal already prefixed with its length, such as "4.copy". As the
+ * opcode is a literal, its length is known at compile time.
+ *
+ * @param builder
+ *     The guac_protocol_builder to initialize.
+ *
+ * @param sock
+ *     The guac_socket that the instruction will be written to.
+ *
+ * @param opcode
+ *     The length-prefixed opcode of the instruction, as a string literal.
+ */
+#define guac_protocol_builder_begin(builder, sock, opcode)                    \
+    do {                                                                      \
+        (builder)->socket = (sock);                                           \
+        (builder)->error = 0;                                                 \
+        (builder)->length = sizeof(opcode) - 1;                               \
+        memcpy((builder)->buffer, (opcode), sizeof(opcode) - 1);              \
+    } while (0)
+
+/**
+ * Writes the decimal representation of the given integer to the given buffer,
+ * producing exactly the same digits as the "%"PRIi64 format. The buffer must
+ * have space for at least twenty characters. No null terminator is written.
+ *
+ * @param buffer
+ *     The buffer to write the integer to.
+ *
+ * @param value
+ *     The integer to write.
+ *
+ * @return
+ *     The number of characters written.
+ */
+static size_t guac_protocol_format_int(char* buffer, int64_t value) {
+
+    char digits[20];
+    size_t count = 0;
+
+    /* Negate via unsigned arithmetic such that INT64_MIN is handled */
+    uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+
+    /* Produce digits in reverse order */
+    do {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    char* current = buffer;
+    if (value < 0)
+        *(current++) = '-';
+
+    while (count > 0)
+        *(current++) = digits[--count];
+
+    return current - buffer;
+
+}
+
+/**
+ * Writes all data currently within the buffer of the given builder to its
+ * socket, emptying the buffer. Any error is recorded within the builder.
+ *
+ * @param builder
+ *     The guac_protocol_builder to flush.
+ */
+static void guac_protocol_builder_flush(guac_protocol_builder* builder) {
+
+    if (builder->length > 0 && guac_socket_write(builder->socket,
+                builder->buffer, builder->length))
+        builder->error = 1;
+
+    builder->length = 0;
+
+}
+
+/**
+ * Appends the given integer to the instruction being built as a new
+ * argument, including the leading comma and length.
+ *
+ * @param builder
+ *     The guac_protocol_builder to append to.
+ *
+ * @param value
+ *     The value of the argument to append.
+ */
+static void guac_protocol_builder_int(guac_protocol_builder* builder,
+        int64_t value) {
+
+    if (GUAC_PROTOCOL_BUILDER_SIZE - builder->length < GUAC_PROTOCOL_BUILDER_MAX_INT)
+        guac_protocol_builder_flush(builder);
+
+    char digits[20];
+    size_t length = guac_protocol_format_int(digits, value);
+
+    /* The length of an integer never exceeds two digits */
+    char* current = builder->buffer + builder->length;
+    *(current++) = ',';
+    current += guac_protocol_format_int(current, length);
+    *(current++) = '.';
+    memcpy(current, digits, length);
+
+    builder->length = current + length - builder->buffer;
+
+}
+
+/**
+ * Appends the given string to the instruction being built as a new argument,
+ * including the leading comma and length. Strings too large for the
+ * remaining space within the buffer are written directly to the socket.
+ *
+ * @param builder
+ *     The guac_protocol_builder to append to.
+ *
+ * @param str
+ *     The value of the argument to append.
+ */
+static void guac_protocol_builder_string(guac_protocol_builder* builder,
+        const char* str) {
+
+    size_t size = strlen(str);
+
+    if (GUAC_PROTOCOL_BUILDER_SIZE - builder->length < GUAC_PROTOCOL_BUILDER_MAX_INT)
+        guac_protocol_builder_flush(builder);
+
+    /* Element lengths are in Unicode characters, not bytes */
+    char* current = builder->buffer + builder->length;
+    *(current++) = ',';
+    current += guac_protocol_format_int(current, guac_utf8_strlen(str));
+    *(current++) = '.';
+    builder->length = current - builder->buffer;
+
+    /* Write the string directly if it will not fit */
+    if (size > GUAC_PROTOCOL_BUILDER_SIZE - builder->length) {
+        guac_protocol_builder_flush(builder);
+        if (guac_socket_write(builder->socket, str, size))
+            builder->error = 1;
+        return;
+    }
+
+    memcpy(current, str, size);
+    builder->length += size;
+
+}
+
+/**
+ * Terminates the instruction being built and writes all remaining data to
+ * its socket.
+ *
+ * @param builder
+ *     The guac_protocol_builder containing the instruction to write.
+ *
+ * @return
+ *     Zero if the entire instruction was written successfully, non-zero
+ *     otherwise.
+ */
+static int guac_protocol_builder_end(guac_protocol_builder* builder) {
+
+    if (builder->length == GUAC_PROTOCOL_BUILDER_SIZE)
+        guac_protocol_builder_flush(builder);
+
+    builder->buffer[builder->length++] = ';';
+    guac_protocol_builder_flush(builder);
+
+    return builder->error;
+
+}
+
 /**
  * Loop through the provided NULL-terminated array, writing the values in the
  * array to the given socket. Values are written as a series of Guacamole
@@ -322,22 +537,17 @@ int guac_protocol_send_cfill(guac_socket* socket,
         int r, int g, int b, int a) {
 
     int ret_val;
+    guac_protocol_builder builder;
 
     guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.cfill,")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, r)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, g)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_begin(&builder, socket, "5.cfill");
+    guac_protocol_builder_int(&builder, mode);
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, r);
+    guac_protocol_builder_int(&builder, g);
+    guac_protocol_builder_int(&builder, b);
+    guac_protocol_builder_int(&builder, a);
+    ret_val = guac_protocol_builder_end(&builder);
 
     guac_socket_instruction_end(socket);
     return ret_val;
@@ -416,33 +626,40 @@ int guac_protocol_send_clipboard(guac_socket* socket, const guac_stream* stream,
 
 }
 
+int guac_protocol_send_compact(guac_socket* socket, const char* version) {
+
+    int ret_val;
+
+    guac_socket_instruction_begin(socket);
+    ret_val =
+           guac_socket_write_string(socket, "7.compact,")
+        || __guac_socket_write_length_string(socket, version)
+        || guac_socket_write_string(socket, ";");
+
+    guac_socket_instruction_end(socket);
+    return ret_val;
+
+}
+
 int guac_protocol_send_copy(guac_socket* socket,
         const guac_layer* srcl, int srcx, int srcy, int w, int h,
         guac_composite_mode mode, const guac_layer* dstl, int dstx, int dsty) {
 
     int ret_val;
+    guac_protocol_builder builder;
 
     guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.copy,")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dsty)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_begin(&builder, socket, "4.copy");
+    guac_protocol_builder_int(&builder, srcl->index);
+    guac_protocol_builder_int(&builder, srcx);
+    guac_protocol_builder_int(&builder, srcy);
+    guac_protocol_builder_int(&builder, w);
+    guac_protocol_builder_int(&builder, h);
+    guac_protocol_builder_int(&builder, mode);
+    guac_protocol_builder_int(&builder, dstl->index);
+    guac_protocol_builder_int(&builder, dstx);
+    guac_protocol_builder_int(&builder, dsty);
+    ret_val = guac_protocol_builder_end(&builder);
 
     guac_socket_instruction_end(socket);
     return ret_val;
@@ -963,22 +1180,17 @@ int guac_protocol_send_img(guac_socket* socket, const guac_stream* stream,
         const char* mimetype, int x, int y) {
 
     int ret_val;
+    guac_protocol_builder builder;
 
     guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.img,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_begin(&builder, socket, "3.img");
+    guac_protocol_builder_int(&builder, stream->index);
+    guac_protocol_builder_int(&builder, mode);
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_string(&builder, mimetype);
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+    ret_val = guac_protocol_builder_end(&builder);
 
     guac_socket_instruction_end(socket);
     return ret_val;
@@ -1034,20 +1246,16 @@ int guac_protocol_send_rect(guac_socket* socket,
         const guac_layer* layer, int x, int y, int width, int height) {
 
     int ret_val;
+    guac_protocol_builder builder;
 
     guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.rect,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, width)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, height)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_begin(&builder, socket, "4.rect");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+    guac_protocol_builder_int(&builder, width);
+    guac_protocol_builder_int(&builder, height);
+    ret_val = guac_protocol_builder_end(&builder);
 
     guac_socket_instruction_end(socket);
     return ret_val;
@@ -1203,14 +1411,13 @@ int guac_protocol_send_sync(guac_socket* socket, guac_timestamp timestamp,
         int frames) {
 
     int ret_val;
+    guac_protocol_builder builder;
 
     guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "4.sync,")
-        || __guac_socket_write_length_int(socket, timestamp)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, frames)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_begin(&builder, socket, "4.sync");
+    guac_protocol_builder_int(&builder, timestamp);
+    guac_protocol_builder_int(&builder, frames);
+    ret_val = guac_protocol_builder_end(&builder);
 
     guac_socket_instruction_end(socket);
     return ret_val;
@@ -1222,28 +1429,20 @@ int guac_protocol_send_transfer(guac_socket* socket,
         guac_transfer_function fn, const guac_layer* dstl, int dstx, int dsty) {
 
     int ret_val;
+    guac_protocol_builder builder;
 
     guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "8.transfer,")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, fn)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dsty)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_begin(&builder, socket, "8.transfer");
+    guac_protocol_builder_int(&builder, srcl->index);
+    guac_protocol_builder_int(&builder, srcx);
+    guac_protocol_builder_int(&builder, srcy);
+    guac_protocol_builder_int(&builder, w);
+    guac_protocol_builder_int(&builder, h);
+    guac_protocol_builder_int(&builder, fn);
+    guac_protocol_builder_int(&builder, dstl->index);
+    guac_protocol_builder_int(&builder, dstx);
+    guac_protocol_builder_int(&builder, dsty);
+    ret_val = guac_protocol_builder_end(&builder);
 
     guac_socket_instruction_end(socket);
     return ret_val;
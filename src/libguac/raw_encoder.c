@@ -59,6 +59,8 @@ static void raw_encoder_begin_handler(guac_audio_stream* audio) {
             audio->rate, audio->channels, audio->bps) / 8 / 1000;
 
     state->buffer = guac_mem_alloc(state->length);
+    guac_client_account_memory(audio->client, GUAC_CLIENT_MEMORY_AUDIO,
+            state->length);
 
 }
 
@@ -78,6 +80,8 @@ static void raw_encoder_end_handler(guac_audio_stream* audio) {
     guac_protocol_send_end(audio->client->socket, audio->stream);
 
     /* Free state information */
+    guac_client_account_memory(audio->client, GUAC_CLIENT_MEMORY_AUDIO,
+            -(int64_t) state->length);
     guac_mem_free(state->buffer);
     guac_mem_free(state);
 
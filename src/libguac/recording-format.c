@@ -0,0 +1,208 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "guacamole/recording.h"
+#include "recording-format.h"
+
+#include <stdint.h>
+#include <string.h>
+
+void guac_recording_format_write_uint32(unsigned char* buffer, uint32_t value) {
+    buffer[0] = value >> 24;
+    buffer[1] = value >> 16;
+    buffer[2] = value >> 8;
+    buffer[3] = value;
+}
+
+void guac_recording_format_write_uint64(unsigned char* buffer, uint64_t value) {
+    guac_recording_format_write_uint32(buffer, value >> 32);
+    guac_recording_format_write_uint32(buffer + 4, value);
+}
+
+uint32_t guac_recording_format_read_uint32(const unsigned char* buffer) {
+    return ((uint32_t) buffer[0] << 24)
+         | ((uint32_t) buffer[1] << 16)
+         | ((uint32_t) buffer[2] << 8)
+         |  (uint32_t) buffer[3];
+}
+
+uint64_t guac_recording_format_read_uint64(const unsigned char* buffer) {
+    return ((uint64_t) guac_recording_format_read_uint32(buffer) << 32)
+         |  (uint64_t) guac_recording_format_read_uint32(buffer + 4);
+}
+
+void guac_recording_format_write_record(unsigned char* buffer,
+        const guac_recording_format_record* record) {
+
+    buffer[0] = record->type;
+    guac_recording_format_write_uint32(buffer + 1, record->length);
+    guac_recording_format_write_uint32(buffer + 5, record->decompressed_length);
+    guac_recording_format_write_uint64(buffer + 9, record->timestamp);
+    guac_recording_format_write_uint64(buffer + 17, record->position);
+
+}
+
+int guac_recording_format_read_record(const unsigned char* buffer,
+        guac_recording_format_record* record) {
+
+    record->type = buffer[0];
+    record->length = guac_recording_format_read_uint32(buffer + 1);
+    record->decompressed_length = guac_recording_format_read_uint32(buffer + 5);
+    record->timestamp = guac_recording_format_read_uint64(buffer + 9);
+    record->position = guac_recording_format_read_uint64(buffer + 17);
+
+    /* Reject records of unknown type */
+    if (record->type != GUAC_RECORDING_FORMAT_DATA
+            && record->type != GUAC_RECORDING_FORMAT_KEYFRAME
+            && record->type != GUAC_RECORDING_FORMAT_INDEX)
+        return 1;
+
+    /* Reject records that are implausibly large */
+    if (record->length > GUAC_RECORDING_FORMAT_MAX_RECORD_SIZE
+            || record->decompressed_length > GUAC_RECORDING_FORMAT_MAX_RECORD_SIZE)
+        return 1;
+
+    return 0;
+
+}
+
+void guac_recording_format_write_events_header(unsigned char* buffer) {
+    memcpy(buffer, GUAC_RECORDING_EVENTS_MAGIC,
+            GUAC_RECORDING_FORMAT_MAGIC_LENGTH);
+    guac_recording_format_write_uint32(buffer + 8,
+            GUAC_RECORDING_EVENTS_VERSION);
+    guac_recording_format_write_uint32(buffer + 12,
+            GUAC_RECORDING_EVENTS_RECORD_LENGTH);
+}
+
+int guac_recording_format_read_events_header(const unsigned char* buffer,
+        size_t* record_length) {
+
+    if (memcmp(buffer, GUAC_RECORDING_EVENTS_MAGIC,
+                GUAC_RECORDING_FORMAT_MAGIC_LENGTH) != 0)
+        return 1;
+
+    /* Later versions may only extend records, never reinterpret them */
+    if (guac_recording_format_read_uint32(buffer + 8) < 1)
+        return 1;
+
+    *record_length = guac_recording_format_read_uint32(buffer + 12);
+    if (*record_length < GUAC_RECORDING_EVENTS_RECORD_LENGTH)
+        return 1;
+
+    return 0;
+
+}
+
+/**
+ * Converts the given value to the fixed-point representation used by stored
+ * touch events.
+ *
+ * @param value
+ *     The value to convert.
+ *
+ * @return
+ *     The given value in fixed-point form, where
+ *     GUAC_RECORDING_EVENTS_FIXED_ONE represents 1.
+ */
+static int32_t guac_recording_format_to_fixed(double value) {
+    return (int32_t) (value * GUAC_RECORDING_EVENTS_FIXED_ONE);
+}
+
+void guac_recording_format_write_event(unsigned char* buffer,
+        const guac_recording_event* event) {
+
+    int32_t values[GUAC_RECORDING_EVENTS_VALUES] = { 0 };
+
+    switch (event->type) {
+
+        case GUAC_RECORDING_EVENT_KEY:
+            values[0] = event->keysym;
+            values[1] = event->pressed;
+            break;
+
+        case GUAC_RECORDING_EVENT_MOUSE:
+            values[0] = event->x;
+            values[1] = event->y;
+            values[2] = event->button_mask;
+            break;
+
+        case GUAC_RECORDING_EVENT_TOUCH:
+            values[0] = event->id;
+            values[1] = event->x;
+            values[2] = event->y;
+            values[3] = event->x_radius;
+            values[4] = event->y_radius;
+            values[5] = guac_recording_format_to_fixed(event->angle);
+            values[6] = guac_recording_format_to_fixed(event->force);
+            break;
+
+    }
+
+    guac_recording_format_write_uint64(buffer, event->timestamp);
+    buffer[8] = event->type;
+    buffer[9] = buffer[10] = buffer[11] = 0;
+
+    for (int i = 0; i < GUAC_RECORDING_EVENTS_VALUES; i++)
+        guac_recording_format_write_uint32(buffer + 12 + i * 4, values[i]);
+
+}
+
+int guac_recording_format_read_event(const unsigned char* buffer,
+        guac_recording_event* event) {
+
+    int32_t values[GUAC_RECORDING_EVENTS_VALUES];
+    for (int i = 0; i < GUAC_RECORDING_EVENTS_VALUES; i++)
+        values[i] = (int32_t) guac_recording_format_read_uint32(buffer + 12 + i * 4);
+
+    memset(event, 0, sizeof(guac_recording_event));
+    event->timestamp = guac_recording_format_read_uint64(buffer);
+    event->type = buffer[8];
+
+    switch (event->type) {
+
+        case GUAC_RECORDING_EVENT_KEY:
+            event->keysym = values[0];
+            event->pressed = values[1];
+            return 0;
+
+        case GUAC_RECORDING_EVENT_MOUSE:
+            event->x = values[0];
+            event->y = values[1];
+            event->button_mask = values[2];
+            return 0;
+
+        case GUAC_RECORDING_EVENT_TOUCH:
+            event->id = values[0];
+            event->x = values[1];
+            event->y = values[2];
+            event->x_radius = values[3];
+            event->y_radius = values[4];
+            event->angle = (double) values[5] / GUAC_RECORDING_EVENTS_FIXED_ONE;
+            event->force = (double) values[6] / GUAC_RECORDING_EVENTS_FIXED_ONE;
+            return 0;
+
+    }
+
+    /* Unknown event type */
+    return 1;
+
+}
+
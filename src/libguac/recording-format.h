@@ -0,0 +1,376 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_RECORDING_FORMAT_H
+#define GUAC_RECORDING_FORMAT_H
+
+/**
+ * The compressed container format for session recordings. A compressed
+ * recording begins with a header of GUAC_RECORDING_FORMAT_HEADER_LENGTH
+ * bytes:
+ *
+ *   8 bytes - GUAC_RECORDING_FORMAT_MAGIC
+ *   4 bytes - GUAC_RECORDING_FORMAT_VERSION
+ *   8 bytes - the timestamp at which the recording began
+ *
+ * The header is followed by a series of records, each beginning with a
+ * header of GUAC_RECORDING_FORMAT_RECORD_HEADER_LENGTH bytes:
+ *
+ *   1 byte  - the record type
+ *   4 bytes - the number of bytes of data following the record header
+ *   4 bytes - the number of bytes of data once decompressed
+ *   8 bytes - the timestamp of the record (keyframes only)
+ *   8 bytes - the position of the record within the uncompressed protocol
+ *             data of the recording
+ *
+ * The data of each GUAC_RECORDING_FORMAT_DATA record is a single zstd frame
+ * containing the next portion of the raw protocol data of the recording. The
+ * data of each GUAC_RECORDING_FORMAT_KEYFRAME record is a single zstd frame
+ * containing protocol data that, by itself, reproduces the full state of the
+ * display as of the given position. Keyframes are redundant when reading a
+ * recording from the beginning, and are skipped in that case.
+ *
+ * A recording which was properly closed ends with an uncompressed
+ * GUAC_RECORDING_FORMAT_INDEX record listing each keyframe as a pair of
+ * 8-byte values (the timestamp of the keyframe and the file offset of its
+ * record), followed by a trailer of GUAC_RECORDING_FORMAT_TRAILER_LENGTH
+ * bytes:
+ *
+ *   8 bytes - the file offset of the index record
+ *   8 bytes - GUAC_RECORDING_FORMAT_TRAILER_MAGIC
+ *
+ * All integers are unsigned and big-endian. A recording which was not
+ * properly closed lacks the index, but may still be read and searched by
+ * walking the record headers.
+ *
+ * Input events may additionally be written to a separate sidecar file
+ * (GUAC_RECORDING_EVENTS_SUFFIX), allowing them to be read without parsing
+ * the recording itself. A sidecar begins with a header of
+ * GUAC_RECORDING_EVENTS_HEADER_LENGTH bytes:
+ *
+ *   8 bytes - GUAC_RECORDING_EVENTS_MAGIC
+ *   4 bytes - GUAC_RECORDING_EVENTS_VERSION
+ *   4 bytes - the length of each event record, in bytes
+ *
+ * The header is followed by a series of fixed-length event records, each
+ * consisting of:
+ *
+ *   8 bytes - the timestamp of the event
+ *   1 byte  - the event type, such as GUAC_RECORDING_EVENT_KEY
+ *   3 bytes - reserved (zero)
+ *   4 bytes - each of GUAC_RECORDING_EVENTS_VALUES signed values, whose
+ *             meaning depends on the type of the event
+ *
+ * Key events store the keysym and whether the key is pressed. Mouse events
+ * store the X and Y coordinates and the button mask. Touch events store the
+ * touch ID, the X and Y coordinates, the X and Y radius, and the angle and
+ * force as fixed-point values with GUAC_RECORDING_EVENTS_FIXED_ONE
+ * representing 1. Readers must skip any trailing bytes of records longer
+ * than GUAC_RECORDING_EVENTS_RECORD_LENGTH, and any event of unknown type.
+ *
+ * @file recording-format.h
+ */
+
+#include "guacamole/recording.h"
+#include "guacamole/timestamp-types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The value at the beginning of every compressed recording.
+ */
+#define GUAC_RECORDING_FORMAT_MAGIC "GUACZREC"
+
+/**
+ * The value at the end of every compressed recording which has been properly
+ * closed.
+ */
+#define GUAC_RECORDING_FORMAT_TRAILER_MAGIC "GUACZIDX"
+
+/**
+ * The length of GUAC_RECORDING_FORMAT_MAGIC and
+ * GUAC_RECORDING_FORMAT_TRAILER_MAGIC, in bytes.
+ */
+#define GUAC_RECORDING_FORMAT_MAGIC_LENGTH 8
+
+/**
+ * The version of the compressed recording format produced and understood by
+ * this version of libguac.
+ */
+#define GUAC_RECORDING_FORMAT_VERSION 1
+
+/**
+ * The length of the header at the beginning of every compressed recording,
+ * in bytes.
+ */
+#define GUAC_RECORDING_FORMAT_HEADER_LENGTH 20
+
+/**
+ * The length of the header at the beginning of every record, in bytes.
+ */
+#define GUAC_RECORDING_FORMAT_RECORD_HEADER_LENGTH 25
+
+/**
+ * The length of the trailer at the end of every compressed recording which
+ * has been properly closed, in bytes.
+ */
+#define GUAC_RECORDING_FORMAT_TRAILER_LENGTH 16
+
+/**
+ * The length of each entry within the index record, in bytes.
+ */
+#define GUAC_RECORDING_FORMAT_INDEX_ENTRY_LENGTH 16
+
+/**
+ * The maximum number of bytes of uncompressed protocol data within each
+ * GUAC_RECORDING_FORMAT_DATA record.
+ */
+#define GUAC_RECORDING_FORMAT_CHUNK_SIZE 1048576
+
+/**
+ * The maximum number of bytes of data within any record, compressed or
+ * otherwise. Records claiming to be larger are treated as corrupt.
+ */
+#define GUAC_RECORDING_FORMAT_MAX_RECORD_SIZE 268435456
+
+/**
+ * The zstd compression level used for all records.
+ */
+#define GUAC_RECORDING_FORMAT_COMPRESSION_LEVEL 3
+
+/**
+ * The type of a record containing the next portion of the protocol data of
+ * the recording.
+ */
+#define GUAC_RECORDING_FORMAT_DATA 'D'
+
+/**
+ * The type of a record containing a snapshot of the full display state.
+ */
+#define GUAC_RECORDING_FORMAT_KEYFRAME 'K'
+
+/**
+ * The type of the record listing all keyframes of the recording.
+ */
+#define GUAC_RECORDING_FORMAT_INDEX 'I'
+
+/**
+ * The value at the beginning of every input event sidecar.
+ */
+#define GUAC_RECORDING_EVENTS_MAGIC "GUACEVTS"
+
+/**
+ * The version of the input event sidecar format produced and understood by
+ * this version of libguac.
+ */
+#define GUAC_RECORDING_EVENTS_VERSION 1
+
+/**
+ * The length of the header at the beginning of every input event sidecar,
+ * in bytes.
+ */
+#define GUAC_RECORDING_EVENTS_HEADER_LENGTH 16
+
+/**
+ * The length of each event record written by this version of libguac, in
+ * bytes.
+ */
+#define GUAC_RECORDING_EVENTS_RECORD_LENGTH 40
+
+/**
+ * The number of signed values stored within each event record.
+ */
+#define GUAC_RECORDING_EVENTS_VALUES 7
+
+/**
+ * The fixed-point value representing 1 within the angle and force of stored
+ * touch events.
+ */
+#define GUAC_RECORDING_EVENTS_FIXED_ONE 65536
+
+/**
+ * The header of a single record within a compressed recording.
+ */
+typedef struct guac_recording_format_record {
+
+    /**
+     * The type of the record, such as GUAC_RECORDING_FORMAT_DATA.
+     */
+    char type;
+
+    /**
+     * The number of bytes of data following the record header.
+     */
+    uint32_t length;
+
+    /**
+     * The number of bytes of data once decompressed.
+     */
+    uint32_t decompressed_length;
+
+    /**
+     * The timestamp of the record, if the record is a keyframe.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The position of the record within the uncompressed protocol data of the
+     * recording. For keyframes, this is the position of the protocol data
+     * that immediately follows the keyframe.
+     */
+    uint64_t position;
+
+} guac_recording_format_record;
+
+/**
+ * Stores the given value in big-endian byte order.
+ *
+ * @param buffer
+ *     The buffer to store the value within. This buffer must have space for at
+ *     least 4 bytes.
+ *
+ * @param value
+ *     The value to store.
+ */
+void guac_recording_format_write_uint32(unsigned char* buffer, uint32_t value);
+
+/**
+ * Stores the given value in big-endian byte order.
+ *
+ * @param buffer
+ *     The buffer to store the value within. This buffer must have space for at
+ *     least 8 bytes.
+ *
+ * @param value
+ *     The value to store.
+ */
+void guac_recording_format_write_uint64(unsigned char* buffer, uint64_t value);
+
+/**
+ * Reads a value stored in big-endian byte order.
+ *
+ * @param buffer
+ *     The buffer containing at least 4 bytes of data.
+ *
+ * @return
+ *     The value stored within the buffer.
+ */
+uint32_t guac_recording_format_read_uint32(const unsigned char* buffer);
+
+/**
+ * Reads a value stored in big-endian byte order.
+ *
+ * @param buffer
+ *     The buffer containing at least 8 bytes of data.
+ *
+ * @return
+ *     The value stored within the buffer.
+ */
+uint64_t guac_recording_format_read_uint64(const unsigned char* buffer);
+
+/**
+ * Stores the given record header within the given buffer.
+ *
+ * @param buffer
+ *     The buffer to store the record header within. This buffer must have
+ *     space for at least GUAC_RECORDING_FORMAT_RECORD_HEADER_LENGTH bytes.
+ *
+ * @param record
+ *     The record header to store.
+ */
+void guac_recording_format_write_record(unsigned char* buffer,
+        const guac_recording_format_record* record);
+
+/**
+ * Reads the record header stored within the given buffer.
+ *
+ * @param buffer
+ *     The buffer containing at least GUAC_RECORDING_FORMAT_RECORD_HEADER_LENGTH
+ *     bytes of data.
+ *
+ * @param record
+ *     The record header to populate.
+ *
+ * @return
+ *     Zero if the stored record header is valid, non-zero otherwise.
+ */
+int guac_recording_format_read_record(const unsigned char* buffer,
+        guac_recording_format_record* record);
+
+/**
+ * Stores the header of an input event sidecar within the given buffer.
+ *
+ * @param buffer
+ *     The buffer to store the header within. This buffer must have space for
+ *     at least GUAC_RECORDING_EVENTS_HEADER_LENGTH bytes.
+ */
+void guac_recording_format_write_events_header(unsigned char* buffer);
+
+/**
+ * Reads the header of an input event sidecar stored within the given buffer,
+ * returning the length of each event record that follows.
+ *
+ * @param buffer
+ *     The buffer containing at least GUAC_RECORDING_EVENTS_HEADER_LENGTH
+ *     bytes of data.
+ *
+ * @param record_length
+ *     A pointer to the size_t that should receive the length of each event
+ *     record, in bytes.
+ *
+ * @return
+ *     Zero if the stored header is that of an input event sidecar which can
+ *     be read by this version of libguac, non-zero otherwise.
+ */
+int guac_recording_format_read_events_header(const unsigned char* buffer,
+        size_t* record_length);
+
+/**
+ * Stores the given input event within the given buffer as an event record.
+ *
+ * @param buffer
+ *     The buffer to store the event record within. This buffer must have
+ *     space for at least GUAC_RECORDING_EVENTS_RECORD_LENGTH bytes.
+ *
+ * @param event
+ *     The input event to store.
+ */
+void guac_recording_format_write_event(unsigned char* buffer,
+        const guac_recording_event* event);
+
+/**
+ * Reads the input event stored within the given event record.
+ *
+ * @param buffer
+ *     The buffer containing at least GUAC_RECORDING_EVENTS_RECORD_LENGTH
+ *     bytes of data.
+ *
+ * @param event
+ *     The input event to populate.
+ *
+ * @return
+ *     Zero if the stored event is of a known type, non-zero otherwise.
+ */
+int guac_recording_format_read_event(const unsigned char* buffer,
+        guac_recording_event* event);
+
+#endif
+
@@ -0,0 +1,666 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "guacamole/error.h"
+#include "guacamole/mem.h"
+#include "guacamole/parser.h"
+#include "guacamole/recording.h"
+#include "guacamole/socket.h"
+#include "recording-format.h"
+
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/**
+ * Reads exactly the given number of bytes from the given file descriptor at
+ * the given offset.
+ *
+ * @param fd
+ *     The file descriptor to read from.
+ *
+ * @param buffer
+ *     The buffer to read into.
+ *
+ * @param length
+ *     The number of bytes to read.
+ *
+ * @param offset
+ *     The offset within the file at which to begin reading.
+ *
+ * @return
+ *     Zero if exactly the given number of bytes were read, non-zero if an
+ *     error occurs or the end of the file is reached first.
+ */
+static int guac_recording_reader_pread(int fd, void* buffer, size_t length,
+        uint64_t offset) {
+
+    char* current = (char*) buffer;
+
+    while (length > 0) {
+
+        ssize_t retval = pread(fd, current, length, offset);
+        if (retval < 0 && errno == EINTR)
+            continue;
+
+        if (retval <= 0)
+            return 1;
+
+        current += retval;
+        length -= retval;
+        offset += retval;
+
+    }
+
+    return 0;
+
+}
+
+#ifdef ENABLE_ZSTD
+/**
+ * Data associated with a socket which reads the protocol data of a
+ * compressed recording.
+ */
+typedef struct guac_recording_reader_data {
+
+    /**
+     * The file descriptor of the recording file.
+     */
+    int fd;
+
+    /**
+     * The offset within the recording file of the next record to be read.
+     */
+    uint64_t offset;
+
+    /**
+     * Non-zero if the next keyframe record read should be used, zero if
+     * keyframe records should be skipped. Only the keyframe at which reading
+     * begins is used; all others are redundant.
+     */
+    int use_keyframe;
+
+    /**
+     * The zstd context used to decompress records.
+     */
+    ZSTD_DCtx* zstd;
+
+    /**
+     * The compressed data of the current record.
+     */
+    char* compressed;
+
+    /**
+     * The number of bytes allocated for compressed.
+     */
+    size_t compressed_size;
+
+    /**
+     * The decompressed protocol data of the current record.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes allocated for buffer.
+     */
+    size_t size;
+
+    /**
+     * The number of bytes of protocol data within buffer.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes of protocol data within buffer which have already
+     * been read.
+     */
+    size_t position;
+
+} guac_recording_reader_data;
+
+/**
+ * Reads and decompresses the next record of the recording which contains
+ * protocol data that should be read, skipping any records which should not.
+ *
+ * @param data
+ *     The data associated with the reader socket.
+ *
+ * @return
+ *     Positive if protocol data has been decompressed into the buffer, zero
+ *     if the end of the recording has been reached, or negative if an error
+ *     occurs, in which case guac_error is set appropriately.
+ */
+static int guac_recording_reader_next(guac_recording_reader_data* data) {
+
+    unsigned char header[GUAC_RECORDING_FORMAT_RECORD_HEADER_LENGTH];
+    guac_recording_format_record record;
+
+    for (;;) {
+
+        /* A missing or incomplete record marks the end of a recording which is
+         * still in progress or was not properly closed */
+        if (guac_recording_reader_pread(data->fd, header, sizeof(header),
+                    data->offset)
+                || guac_recording_format_read_record(header, &record))
+            return 0;
+
+        /* The index is always last */
+        if (record.type == GUAC_RECORDING_FORMAT_INDEX)
+            return 0;
+
+        uint64_t payload_offset = data->offset + sizeof(header);
+        data->offset = payload_offset + record.length;
+
+        /* Skip all but the keyframe at which reading began */
+        if (record.type == GUAC_RECORDING_FORMAT_KEYFRAME) {
+            if (!data->use_keyframe)
+                continue;
+            data->use_keyframe = 0;
+        }
+
+        /* Grow buffers as necessary */
+        if (record.length > data->compressed_size) {
+            data->compressed_size = record.length;
+            data->compressed = guac_mem_realloc_or_die(data->compressed,
+                    data->compressed_size);
+        }
+
+        if (record.decompressed_length > data->size) {
+            data->size = record.decompressed_length;
+            data->buffer = guac_mem_realloc_or_die(data->buffer, data->size);
+        }
+
+        if (guac_recording_reader_pread(data->fd, data->compressed,
+                    record.length, payload_offset))
+            return 0;
+
+        size_t length = ZSTD_decompressDCtx(data->zstd,
+                data->buffer, record.decompressed_length,
+                data->compressed, record.length);
+
+        if (ZSTD_isError(length) || length != record.decompressed_length) {
+            guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+            guac_error_message = "Corrupt record within compressed recording";
+            return -1;
+        }
+
+        data->length = length;
+        data->position = 0;
+
+        if (length > 0)
+            return 1;
+
+    }
+
+}
+
+static ssize_t guac_recording_reader_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guac_recording_reader_data* data =
+        (guac_recording_reader_data*) socket->data;
+
+    /* Decompress further data once all current data has been read */
+    if (data->position == data->length) {
+        int retval = guac_recording_reader_next(data);
+        if (retval <= 0)
+            return retval;
+    }
+
+    size_t available = data->length - data->position;
+    if (count > available)
+        count = available;
+
+    memcpy(buf, data->buffer + data->position, count);
+    data->position += count;
+
+    return count;
+
+}
+
+static int guac_recording_reader_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    /* Data can always be read from the underlying file without waiting */
+    return 1;
+
+}
+
+static int guac_recording_reader_free_handler(guac_socket* socket) {
+
+    guac_recording_reader_data* data =
+        (guac_recording_reader_data*) socket->data;
+
+    close(data->fd);
+
+    ZSTD_freeDCtx(data->zstd);
+    guac_mem_free(data->compressed);
+    guac_mem_free(data->buffer);
+    guac_mem_free(data);
+
+    return 0;
+
+}
+
+/**
+ * Locates the latest keyframe at or before the given timestamp within the
+ * given compressed recording, using the index at the end of the recording if
+ * present, and otherwise walking the headers of all records.
+ *
+ * @param fd
+ *     The file descriptor of the recording file.
+ *
+ * @param timestamp
+ *     The timestamp of the desired point in time.
+ *
+ * @param keyframe_offset
+ *     Storage for the offset of the keyframe record found, if any.
+ *
+ * @return
+ *     Non-zero if a suitable keyframe was found, zero otherwise.
+ */
+static int guac_recording_reader_find_keyframe(int fd,
+        guac_timestamp timestamp, uint64_t* keyframe_offset) {
+
+    unsigned char trailer[GUAC_RECORDING_FORMAT_TRAILER_LENGTH];
+    unsigned char header[GUAC_RECORDING_FORMAT_RECORD_HEADER_LENGTH];
+    guac_recording_format_record record;
+    int found = 0;
+
+    /* Use the index of a properly-closed recording */
+    off_t end = lseek(fd, 0, SEEK_END);
+    if (end >= GUAC_RECORDING_FORMAT_HEADER_LENGTH
+                + GUAC_RECORDING_FORMAT_TRAILER_LENGTH
+            && !guac_recording_reader_pread(fd, trailer, sizeof(trailer),
+                end - GUAC_RECORDING_FORMAT_TRAILER_LENGTH)
+            && memcmp(trailer + 8, GUAC_RECORDING_FORMAT_TRAILER_MAGIC,
+                GUAC_RECORDING_FORMAT_MAGIC_LENGTH) == 0) {
+
+        uint64_t index_offset = guac_recording_format_read_uint64(trailer);
+
+        if (!guac_recording_reader_pread(fd, header, sizeof(header),
+                    index_offset)
+                && !guac_recording_format_read_record(header, &record)
+                && record.type == GUAC_RECORDING_FORMAT_INDEX) {
+
+            unsigned char* index = guac_mem_alloc(record.length);
+            if (!guac_recording_reader_pread(fd, index, record.length,
+                        index_offset + sizeof(header))) {
+
+                /* Entries are in order of timestamp */
+                for (size_t i = 0; i + GUAC_RECORDING_FORMAT_INDEX_ENTRY_LENGTH
+                        <= record.length;
+                        i += GUAC_RECORDING_FORMAT_INDEX_ENTRY_LENGTH) {
+
+                    guac_timestamp entry_timestamp =
+                        guac_recording_format_read_uint64(index + i);
+
+                    if (entry_timestamp > timestamp)
+                        break;
+
+                    *keyframe_offset =
+                        guac_recording_format_read_uint64(index + i + 8);
+                    found = 1;
+
+                }
+
+                guac_mem_free(index);
+                return found;
+
+            }
+
+            guac_mem_free(index);
+
+        }
+
+    }
+
+    /* Otherwise, walk the headers of each record */
+    uint64_t offset = GUAC_RECORDING_FORMAT_HEADER_LENGTH;
+    while (!guac_recording_reader_pread(fd, header, sizeof(header), offset)
+            && !guac_recording_format_read_record(header, &record)
+            && record.type != GUAC_RECORDING_FORMAT_INDEX) {
+
+        if (record.type == GUAC_RECORDING_FORMAT_KEYFRAME) {
+
+            if (record.timestamp > timestamp)
+                break;
+
+            *keyframe_offset = offset;
+            found = 1;
+
+        }
+
+        offset += sizeof(header) + record.length;
+
+    }
+
+    return found;
+
+}
+#endif
+
+guac_socket* guac_recording_open_reader(int fd, guac_timestamp offset) {
+
+    unsigned char header[GUAC_RECORDING_FORMAT_HEADER_LENGTH];
+
+    /* Anything other than a compressed recording is read as-is */
+    if (guac_recording_reader_pread(fd, header, sizeof(header), 0)
+            || memcmp(header, GUAC_RECORDING_FORMAT_MAGIC,
+                GUAC_RECORDING_FORMAT_MAGIC_LENGTH) != 0)
+        return guac_socket_open(fd);
+
+#ifdef ENABLE_ZSTD
+    if (guac_recording_format_read_uint32(header + 8)
+            != GUAC_RECORDING_FORMAT_VERSION) {
+        guac_error = GUAC_STATUS_NOT_SUPPORTED;
+        guac_error_message = "Unsupported version of compressed recording";
+        return NULL;
+    }
+
+    ZSTD_DCtx* zstd = ZSTD_createDCtx();
+    if (zstd == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate zstd decompression context";
+        return NULL;
+    }
+
+    guac_recording_reader_data* data =
+        guac_mem_zalloc(sizeof(guac_recording_reader_data));
+
+    data->fd = fd;
+    data->zstd = zstd;
+    data->offset = GUAC_RECORDING_FORMAT_HEADER_LENGTH;
+
+    /* Begin at the latest keyframe prior to the requested point in time */
+    guac_timestamp started = guac_recording_format_read_uint64(header + 12);
+    if (offset > 0 && guac_recording_reader_find_keyframe(fd,
+                started + offset, &data->offset))
+        data->use_keyframe = 1;
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = data;
+
+    socket->read_handler   = guac_recording_reader_read_handler;
+    socket->select_handler = guac_recording_reader_select_handler;
+    socket->free_handler   = guac_recording_reader_free_handler;
+
+    return socket;
+#else
+    guac_error = GUAC_STATUS_NOT_SUPPORTED;
+    guac_error_message = "Compressed recordings are not supported by this "
+        "build of libguac";
+    return NULL;
+#endif
+
+}
+
+
+int guac_recording_read_start_time(int fd, guac_timestamp* started) {
+
+    unsigned char header[GUAC_RECORDING_FORMAT_HEADER_LENGTH];
+
+    /* Only compressed recordings store the time that they started */
+    if (guac_recording_reader_pread(fd, header, sizeof(header), 0)
+            || memcmp(header, GUAC_RECORDING_FORMAT_MAGIC,
+                GUAC_RECORDING_FORMAT_MAGIC_LENGTH) != 0) {
+        guac_error = GUAC_STATUS_NOT_SUPPORTED;
+        guac_error_message = "Raw recordings do not store their start time";
+        return 1;
+    }
+
+    *started = guac_recording_format_read_uint64(header + 12);
+    return 0;
+
+}
+
+/**
+ * Advises the kernel regarding the expected use of the given range of a
+ * mapped recording, as with madvise(). The start of the given range is
+ * automatically aligned to the boundary of the page containing it. Failures
+ * are ignored, as such advice serves only as a hint.
+ *
+ * @param mapping
+ *     The mapped recording.
+ *
+ * @param start
+ *     The offset of the start of the range, relative to the start of the
+ *     mapping.
+ *
+ * @param end
+ *     The offset of the end of the range (exclusive), relative to the start
+ *     of the mapping.
+ *
+ * @param advice
+ *     The advice to provide, as would be provided to madvise().
+ */
+static void guac_recording_mapping_advise(guac_recording_mapping* mapping,
+        size_t start, size_t end, int advice) {
+
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    start -= start % page_size;
+
+    if (end > start)
+        madvise(mapping->data + start, end - start, advice);
+
+}
+
+guac_recording_mapping* guac_recording_map(int fd) {
+
+    unsigned char header[GUAC_RECORDING_FORMAT_MAGIC_LENGTH];
+
+    /* Compressed recordings must be decompressed before being parsed */
+    if (!guac_recording_reader_pread(fd, header, sizeof(header), 0)
+            && memcmp(header, GUAC_RECORDING_FORMAT_MAGIC,
+                GUAC_RECORDING_FORMAT_MAGIC_LENGTH) == 0) {
+        guac_error = GUAC_STATUS_NOT_SUPPORTED;
+        guac_error_message = "Compressed recordings cannot be mapped";
+        return NULL;
+    }
+
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    struct stat file_stat;
+    if (start < 0 || fstat(fd, &file_stat)) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to determine size of recording";
+        return NULL;
+    }
+
+    /* Only non-empty regular files that fit within the address space of the
+     * current process can be mapped */
+    if (!S_ISREG(file_stat.st_mode) || file_stat.st_size <= start
+            || (uintmax_t) file_stat.st_size > SIZE_MAX) {
+        guac_error = GUAC_STATUS_NOT_SUPPORTED;
+        guac_error_message = "Recording cannot be mapped";
+        return NULL;
+    }
+
+    /* Mappings must begin at a page boundary */
+    off_t page_size = (off_t) sysconf(_SC_PAGESIZE);
+    off_t mapped_start = start - start % page_size;
+    size_t length = (size_t) (file_stat.st_size - mapped_start);
+
+    /* Instructions are parsed in-place, so the mapping must be writable
+     * (without those changes affecting the file) */
+    void* data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+            fd, mapped_start);
+    if (data == MAP_FAILED) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to map recording into memory";
+        return NULL;
+    }
+
+    guac_recording_mapping* mapping = guac_mem_alloc(sizeof(guac_recording_mapping));
+    mapping->fd = fd;
+    mapping->data = data;
+    mapping->length = length;
+    mapping->offset = start - mapped_start;
+    mapping->advised = 0;
+    mapping->released = 0;
+
+#ifdef MADV_SEQUENTIAL
+    guac_recording_mapping_advise(mapping, 0, length, MADV_SEQUENTIAL);
+#endif
+
+    return mapping;
+
+}
+
+int guac_recording_mapping_read(guac_recording_mapping* mapping,
+        guac_parser* parser) {
+
+#ifdef MADV_DONTNEED
+    /* Release data for instructions that have already been handled, such
+     * that memory usage remains bounded despite instructions being modified
+     * in-place as they are parsed */
+    if (mapping->offset - mapping->released >= GUAC_RECORDING_MAP_WINDOW) {
+        size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+        size_t released = mapping->offset - mapping->offset % page_size;
+        guac_recording_mapping_advise(mapping, mapping->released, released,
+                MADV_DONTNEED);
+        mapping->released = released;
+    }
+#endif
+
+#ifdef MADV_WILLNEED
+    /* Request that the upcoming portion of the recording be read ahead well
+     * before it is needed */
+    if (mapping->advised < mapping->length
+            && mapping->offset + GUAC_RECORDING_MAP_WINDOW / 2 >= mapping->advised) {
+
+        size_t advised = mapping->offset + GUAC_RECORDING_MAP_WINDOW;
+        if (advised > mapping->length)
+            advised = mapping->length;
+
+        guac_recording_mapping_advise(mapping, mapping->advised, advised,
+                MADV_WILLNEED);
+        mapping->advised = advised;
+
+    }
+#endif
+
+    if (mapping->offset == mapping->length) {
+        guac_error = GUAC_STATUS_CLOSED;
+        guac_error_message = "End of recording reached";
+        return 1;
+    }
+
+    int parsed = guac_parser_parse(parser, mapping->data + mapping->offset,
+            mapping->length - mapping->offset);
+    if (parsed < 0)
+        return 1;
+
+    mapping->offset += parsed;
+    return 0;
+
+}
+
+void guac_recording_unmap(guac_recording_mapping* mapping) {
+    munmap(mapping->data, mapping->length);
+    close(mapping->fd);
+    guac_mem_free(mapping);
+}
+
+guac_recording_events* guac_recording_events_map(int fd) {
+
+    unsigned char header[GUAC_RECORDING_EVENTS_HEADER_LENGTH];
+    size_t record_length;
+
+    /* Refuse anything other than a sidecar this version can read */
+    if (guac_recording_reader_pread(fd, header, sizeof(header), 0)
+            || guac_recording_format_read_events_header(header,
+                &record_length)) {
+        guac_error = GUAC_STATUS_NOT_SUPPORTED;
+        guac_error_message = "File is not an input event sidecar";
+        return NULL;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat)) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to determine size of input event sidecar";
+        return NULL;
+    }
+
+    if (!S_ISREG(file_stat.st_mode)
+            || (uintmax_t) file_stat.st_size > SIZE_MAX) {
+        guac_error = GUAC_STATUS_NOT_SUPPORTED;
+        guac_error_message = "Input event sidecar cannot be mapped";
+        return NULL;
+    }
+
+    size_t length = (size_t) file_stat.st_size;
+    void* data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to map input event sidecar into memory";
+        return NULL;
+    }
+
+#ifdef MADV_SEQUENTIAL
+    madvise(data, length, MADV_SEQUENTIAL);
+#endif
+
+    guac_recording_events* events = guac_mem_alloc(sizeof(guac_recording_events));
+    events->fd = fd;
+    events->data = data;
+    events->length = length;
+    events->offset = GUAC_RECORDING_EVENTS_HEADER_LENGTH;
+    events->record_length = record_length;
+
+    return events;
+
+}
+
+int guac_recording_events_read(guac_recording_events* events,
+        guac_recording_event* event) {
+
+    /* Read records until one of a known type is found, ignoring any partial
+     * record at the end of an in-progress sidecar */
+    while (events->length - events->offset >= events->record_length) {
+
+        const unsigned char* record = events->data + events->offset;
+        events->offset += events->record_length;
+
+        if (!guac_recording_format_read_event(record, event))
+            return 0;
+
+    }
+
+    return 1;
+
+}
+
+void guac_recording_events_unmap(guac_recording_events* events) {
+    munmap((void*) events->data, events->length);
+    close(events->fd);
+    guac_mem_free(events);
+}
+
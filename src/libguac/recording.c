@@ -19,12 +19,17 @@
 
 #include "guacamole/mem.h"
 #include "guacamole/client.h"
+#include "guacamole/display.h"
 #include "guacamole/error.h"
 #include "guacamole/file.h"
+#include "guacamole/flag.h"
 #include "guacamole/protocol.h"
 #include "guacamole/recording.h"
 #include "guacamole/socket.h"
 #include "guacamole/timestamp.h"
+#include "guacamole/user.h"
+#include "recording-format.h"
+#include "socket-recording.h"
 
 #ifdef __MINGW32__
 #include <direct.h>
@@ -34,15 +39,92 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+/**
+ * Creates the input event sidecar of a recording, writing its header. The
+ * sidecar is written from a separate thread, exactly like the recording
+ * itself. If the sidecar cannot be created, a warning is logged.
+ *
+ * @param client
+ *     The client being recorded.
+ *
+ * @param path
+ *     The full absolute path to the directory containing the recording file.
+ *
+ * @param filename
+ *     The filename ultimately used for the recording file, without path.
+ *
+ * @param allow_write_existing
+ *     Non-zero if an existing sidecar should be overwritten, zero otherwise.
+ *
+ * @param overflow
+ *     The behavior to use if events are produced faster than they can be
+ *     written to the sidecar.
+ *
+ * @return
+ *     A guac_socket which writes to the new sidecar, or NULL if the sidecar
+ *     could not be created.
+ */
+static guac_socket* guac_recording_open_events(guac_client* client,
+        const char* path, const char* filename, int allow_write_existing,
+        guac_recording_overflow overflow) {
+
+    char events_filename[GUAC_COMMON_RECORDING_MAX_NAME_LENGTH];
+    unsigned char header[GUAC_RECORDING_EVENTS_HEADER_LENGTH];
+
+    int length = snprintf(events_filename, sizeof(events_filename), "%s%s",
+            filename, GUAC_RECORDING_EVENTS_SUFFIX);
+    if (length >= sizeof(events_filename)) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Input events will not be "
+                "written to a separate file: Name too long");
+        return NULL;
+    }
+
+    guac_open_how how = {
+        .oflags = O_CREAT | O_WRONLY
+            | (allow_write_existing ? O_TRUNC : O_EXCL),
+        .mode = S_IRUSR | S_IWUSR | S_IRGRP,
+        .flags = GUAC_O_LOCKED
+    };
+
+    int fd = guac_openat(path, events_filename, &how);
+    if (fd == -1) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Input events will not be "
+                "written to a separate file: %s: %s", guac_error_message,
+                guac_status_string(guac_error));
+        return NULL;
+    }
+
+    guac_socket* socket = guac_socket_open_recording(client, fd, overflow,
+            GUAC_RECORDING_FORMAT_RAW);
+    if (socket == NULL) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Input events will not be "
+                "written to a separate file: Unable to start writer thread.");
+        close(fd);
+        return NULL;
+    }
+
+    guac_recording_format_write_events_header(header);
+    guac_socket_write(socket, header, sizeof(header));
+
+    guac_client_log(client, GUAC_LOG_INFO, "Input events of session will "
+            "also be saved within \"%s\" as \"%s\".", path, events_filename);
+
+    return socket;
+
+}
+
 guac_recording* guac_recording_create(guac_client* client,
         const char* path, const char* name, int create_path,
         int include_output, int include_mouse, int include_touch,
-        int include_keys, int allow_write_existing) {
+        int include_keys, int allow_write_existing, int write_events,
+        guac_recording_overflow overflow, guac_recording_format format,
+        int output_rate) {
 
     char filename[GUAC_COMMON_RECORDING_MAX_NAME_LENGTH];
 
@@ -69,17 +151,57 @@ guac_recording* guac_recording_create(guac_client* client,
         return NULL;
     }
 
+#ifndef ENABLE_ZSTD
+    /* Compressed recordings require zstd */
+    if (format == GUAC_RECORDING_FORMAT_COMPRESSED) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Compressed recordings "
+                "are not supported by this build of libguac. The recording "
+                "will be written in raw form.");
+        format = GUAC_RECORDING_FORMAT_RAW;
+    }
+#endif
+
+    /* Write to the recording file from a separate thread, such that a slow
+     * recording file does not slow the session itself */
+    guac_socket* socket = guac_socket_open_recording(client, fd, overflow,
+            format);
+    if (socket == NULL) {
+        guac_client_log(client, GUAC_LOG_ERROR, "Creation of recording "
+                "failed: Unable to start recording writer thread.");
+        close(fd);
+        return NULL;
+    }
+
     /* Create recording structure with reference to underlying socket */
     guac_recording* recording = guac_mem_alloc(sizeof(guac_recording));
-    recording->socket = guac_socket_open(fd);
+    recording->socket = socket;
     recording->include_output = include_output;
     recording->include_mouse = include_mouse;
     recording->include_touch = include_touch;
     recording->include_keys = include_keys;
+    recording->format = format;
+    recording->events = NULL;
+    recording->keyframe_display = NULL;
+    recording->output_display = NULL;
+
+    /* Output recorded directly from a display is limited to a sane rate */
+    if (output_rate < 0 || !include_output)
+        output_rate = 0;
+    else if (output_rate > GUAC_RECORDING_MAX_OUTPUT_RATE)
+        output_rate = GUAC_RECORDING_MAX_OUTPUT_RATE;
+
+    recording->output_rate = output_rate;
+
+    /* Write included input events to a sidecar, if requested and if any
+     * input events are included at all */
+    if (write_events && (include_mouse || include_touch || include_keys))
+        recording->events = guac_recording_open_events(client, path, filename,
+                allow_write_existing, overflow);
 
     /* Replace client socket with wrapped recording socket only if including
-     * output within the recording */
-    if (include_output)
+     * output within the recording, and only if that output is not instead
+     * recorded directly from a display */
+    if (include_output && !output_rate)
         client->socket = guac_socket_tee(client->socket, recording->socket);
 
     /* Recording creation succeeded */
@@ -90,25 +212,260 @@ guac_recording* guac_recording_create(guac_client* client,
 
 }
 
+guac_recording_overflow guac_recording_parse_args_overflow(guac_user* user,
+        const char** arg_names, const char** argv, int index,
+        guac_recording_overflow default_value) {
+
+    /* Pull parameter value from argv */
+    const char* value = argv[index];
+
+    /* Use default value if blank */
+    if (value[0] == 0) {
+        guac_user_log(user, GUAC_LOG_DEBUG, "Parameter \"%s\" omitted. Using "
+                "default value.", arg_names[index]);
+        return default_value;
+    }
+
+    if (strcmp(value, "block") == 0)
+        return GUAC_RECORDING_OVERFLOW_BLOCK;
+
+    if (strcmp(value, "drop") == 0)
+        return GUAC_RECORDING_OVERFLOW_DROP;
+
+    if (strcmp(value, "spill") == 0)
+        return GUAC_RECORDING_OVERFLOW_SPILL;
+
+    /* All other values are invalid */
+    guac_user_log(user, GUAC_LOG_WARNING, "Parameter \"%s\" must be "
+            "\"block\", \"drop\", or \"spill\". Using default value.",
+            arg_names[index]);
+
+    return default_value;
+
+}
+
+guac_recording_format guac_recording_parse_args_format(guac_user* user,
+        const char** arg_names, const char** argv, int index,
+        guac_recording_format default_value) {
+
+    /* Pull parameter value from argv */
+    const char* value = argv[index];
+
+    /* Use default value if blank */
+    if (value[0] == 0) {
+        guac_user_log(user, GUAC_LOG_DEBUG, "Parameter \"%s\" omitted. Using "
+                "default value.", arg_names[index]);
+        return default_value;
+    }
+
+    if (strcmp(value, "raw") == 0)
+        return GUAC_RECORDING_FORMAT_RAW;
+
+    if (strcmp(value, "compressed") == 0)
+        return GUAC_RECORDING_FORMAT_COMPRESSED;
+
+    /* All other values are invalid */
+    guac_user_log(user, GUAC_LOG_WARNING, "Parameter \"%s\" must be "
+            "\"raw\" or \"compressed\". Using default value.",
+            arg_names[index]);
+
+    return default_value;
+
+}
+
+/**
+ * Thread which writes a keyframe of the display associated with the given
+ * recording every GUAC_RECORDING_KEYFRAME_INTERVAL milliseconds, until
+ * GUAC_RECORDING_KEYFRAMES_STOPPING is set.
+ *
+ * @param data
+ *     The guac_recording that should receive keyframes.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_recording_keyframe_thread(void* data) {
+
+    guac_recording* recording = (guac_recording*) data;
+
+    while (!guac_flag_timedwait_and_lock(&recording->keyframe_state,
+                GUAC_RECORDING_KEYFRAMES_STOPPING,
+                GUAC_RECORDING_KEYFRAME_INTERVAL)) {
+        guac_socket_recording_keyframe(recording->socket,
+                recording->keyframe_display);
+    }
+
+    guac_flag_unlock(&recording->keyframe_state);
+    return NULL;
+
+}
+
+void guac_recording_start_keyframes(guac_recording* recording,
+        guac_display* display) {
+
+    guac_recording_stop_keyframes(recording);
+
+    /* Keyframes are meaningful only for compressed recordings of output */
+    if (!recording->include_output
+            || recording->format != GUAC_RECORDING_FORMAT_COMPRESSED)
+        return;
+
+    guac_flag_init(&recording->keyframe_state);
+    recording->keyframe_display = display;
+
+    if (pthread_create(&recording->keyframe_thread, NULL,
+                guac_recording_keyframe_thread, recording)) {
+        guac_flag_destroy(&recording->keyframe_state);
+        recording->keyframe_display = NULL;
+    }
+
+}
+
+void guac_recording_stop_keyframes(guac_recording* recording) {
+
+    if (recording->keyframe_display == NULL)
+        return;
+
+    guac_flag_set(&recording->keyframe_state,
+            GUAC_RECORDING_KEYFRAMES_STOPPING);
+
+    pthread_join(recording->keyframe_thread, NULL);
+    guac_flag_destroy(&recording->keyframe_state);
+
+    recording->keyframe_display = NULL;
+
+}
+
+/**
+ * Thread which records the changes to the display associated with the given
+ * recording at most output_rate times per second, until
+ * GUAC_RECORDING_OUTPUT_STOPPING is set. A final frame is recorded once
+ * GUAC_RECORDING_OUTPUT_STOPPING is set, such that the recording ends with
+ * the final state of the display.
+ *
+ * @param data
+ *     The guac_recording that should receive the output of its display.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_recording_output_thread(void* data) {
+
+    guac_recording* recording = (guac_recording*) data;
+    int interval = 1000 / recording->output_rate;
+
+    do {
+        guac_display_record(recording->output_display, recording->socket);
+    } while (!guac_flag_timedwait_and_lock(&recording->output_state,
+                GUAC_RECORDING_OUTPUT_STOPPING, interval));
+
+    guac_flag_unlock(&recording->output_state);
+    guac_display_record(recording->output_display, recording->socket);
+
+    return NULL;
+
+}
+
+void guac_recording_start_output(guac_recording* recording,
+        guac_display* display) {
+
+    guac_recording_stop_output(recording);
+
+    /* Output is recorded from a display only if requested */
+    if (!recording->output_rate)
+        return;
+
+    guac_flag_init(&recording->output_state);
+    recording->output_display = display;
+
+    if (pthread_create(&recording->output_thread, NULL,
+                guac_recording_output_thread, recording)) {
+        guac_flag_destroy(&recording->output_state);
+        recording->output_display = NULL;
+    }
+
+}
+
+void guac_recording_stop_output(guac_recording* recording) {
+
+    if (recording->output_display == NULL)
+        return;
+
+    guac_flag_set(&recording->output_state,
+            GUAC_RECORDING_OUTPUT_STOPPING);
+
+    pthread_join(recording->output_thread, NULL);
+    guac_flag_destroy(&recording->output_state);
+
+    recording->output_display = NULL;
+
+}
+
 void guac_recording_free(guac_recording* recording) {
 
+    guac_recording_stop_keyframes(recording);
+    guac_recording_stop_output(recording);
+
     /* If not including broadcast output, the output socket is not associated
      * with the client, and must be freed manually */
-    if (!recording->include_output)
+    if (!recording->include_output || recording->output_rate)
         guac_socket_free(recording->socket);
 
+    /* Freeing the sidecar socket writes any remaining events */
+    if (recording->events != NULL)
+        guac_socket_free(recording->events);
+
     /* Free recording itself */
     guac_mem_free(recording);
 
 }
 
+/**
+ * Writes the given input event to the input event sidecar of the given
+ * recording, if a sidecar is being written.
+ *
+ * @param recording
+ *     The recording whose sidecar should receive the event.
+ *
+ * @param event
+ *     The input event to write.
+ */
+static void guac_recording_write_event(guac_recording* recording,
+        const guac_recording_event* event) {
+
+    unsigned char record[GUAC_RECORDING_EVENTS_RECORD_LENGTH];
+
+    if (recording->events == NULL)
+        return;
+
+    guac_recording_format_write_event(record, event);
+
+    /* Each event is written whole or, on overflow, dropped whole */
+    guac_socket_instruction_begin(recording->events);
+    guac_socket_write(recording->events, record, sizeof(record));
+    guac_socket_instruction_end(recording->events);
+
+}
+
 void guac_recording_report_mouse(guac_recording* recording,
         int x, int y, int button_mask) {
 
     /* Report mouse location only if recording should contain mouse events */
-    if (recording->include_mouse)
-        guac_protocol_send_mouse(recording->socket, x, y, button_mask,
-                guac_timestamp_current());
+    if (!recording->include_mouse)
+        return;
+
+    guac_timestamp timestamp = guac_timestamp_current();
+    guac_protocol_send_mouse(recording->socket, x, y, button_mask, timestamp);
+
+    guac_recording_event event = {
+        .type = GUAC_RECORDING_EVENT_MOUSE,
+        .timestamp = timestamp,
+        .x = x,
+        .y = y,
+        .button_mask = button_mask
+    };
+
+    guac_recording_write_event(recording, &event);
 
 }
 
@@ -117,9 +474,26 @@ void guac_recording_report_touch(guac_recording* recording,
         double angle, double force) {
 
     /* Report touches only if recording should contain touch events */
-    if (recording->include_touch)
-        guac_protocol_send_touch(recording->socket, id, x, y,
-                x_radius, y_radius, angle, force, guac_timestamp_current());
+    if (!recording->include_touch)
+        return;
+
+    guac_timestamp timestamp = guac_timestamp_current();
+    guac_protocol_send_touch(recording->socket, id, x, y,
+            x_radius, y_radius, angle, force, timestamp);
+
+    guac_recording_event event = {
+        .type = GUAC_RECORDING_EVENT_TOUCH,
+        .timestamp = timestamp,
+        .id = id,
+        .x = x,
+        .y = y,
+        .x_radius = x_radius,
+        .y_radius = y_radius,
+        .angle = angle,
+        .force = force
+    };
+
+    guac_recording_write_event(recording, &event);
 
 }
 
@@ -127,9 +501,20 @@ void guac_recording_report_key(guac_recording* recording,
         int keysym, int pressed) {
 
     /* Report key state only if recording should contain key events */
-    if (recording->include_keys)
-        guac_protocol_send_key(recording->socket, keysym, pressed,
-                guac_timestamp_current());
+    if (!recording->include_keys)
+        return;
+
+    guac_timestamp timestamp = guac_timestamp_current();
+    guac_protocol_send_key(recording->socket, keysym, pressed, timestamp);
+
+    guac_recording_event event = {
+        .type = GUAC_RECORDING_EVENT_KEY,
+        .timestamp = timestamp,
+        .keysym = keysym,
+        .pressed = pressed
+    };
+
+    guac_recording_write_event(recording, &event);
 
 }
 
@@ -17,11 +17,17 @@
  * under the License.
  */
 
-#include <pthread.h>
-#include <stdint.h>
+#include "config.h"
 #include "guacamole/error.h"
 #include "guacamole/rwlock.h"
 
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef HAVE_SCHED_GETCPU
+#include <sched.h>
+#endif
+
 /**
  * The value indicating that the current thread holds neither the read or write
  * locks.
@@ -48,6 +54,23 @@ void guac_rwlock_init(guac_rwlock* lock) {
     /* Initialize the rwlock */
     pthread_rwlock_init(&(lock->lock), &lock_attributes);
 
+    /* The mutex and condition used by writers to wait for readers must be
+     * shared with child processes, as well */
+    pthread_mutexattr_t drain_lock_attributes;
+    pthread_mutexattr_init(&drain_lock_attributes);
+    pthread_mutexattr_setpshared(&drain_lock_attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&(lock->drain_lock), &drain_lock_attributes);
+
+    pthread_condattr_t drained_attributes;
+    pthread_condattr_init(&drained_attributes);
+    pthread_condattr_setpshared(&drained_attributes, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&(lock->readers_drained), &drained_attributes);
+
+    /* There are no readers or writers initially */
+    lock->writer = 0;
+    for (int i = 0; i < GUAC_RWLOCK_READER_SLOTS; i++)
+        lock->slots[i].readers = 0;
+
     /* Initialize the  flags to 0, as threads won't have acquired it yet */
     pthread_key_create(&(lock->key), (void *) 0);
 
@@ -58,19 +81,15 @@ void guac_rwlock_destroy(guac_rwlock* lock) {
     /* Destroy the rwlock */
     pthread_rwlock_destroy(&(lock->lock));
 
+    /* Destroy the reader/writer handoff */
+    pthread_cond_destroy(&(lock->readers_drained));
+    pthread_mutex_destroy(&(lock->drain_lock));
+
     /* Destroy the thread-local key */
     pthread_key_delete(lock->key);
 
 }
 
-/**
- * Clean up and destroy the provided guac reentrant rwlock.
- *
- * @param lock
- *     The guac reentrant rwlock to be destroyed.
- */
-void guac_rwlock_destroy(guac_rwlock* lock);
-
 /**
  * Extract and return the flag indicating which lock is held, if any, from the
  * provided key value. The flag is always stored in the least-significant
@@ -86,11 +105,29 @@ static uintptr_t get_lock_flag(uintptr_t value) {
     return value & 0xF;
 }
 
+/**
+ * Extract and return the index of the reader count that was incremented when
+ * the current thread acquired the read lock. The index is always stored in
+ * the second least-significant nibble of the value, and is meaningful only if
+ * the current thread holds the read lock.
+ *
+ * @param value
+ *     The key value containing the reader count index.
+ *
+ * @return
+ *     The index of the reader count that was incremented when the current
+ *     thread acquired the read lock.
+ */
+static uintptr_t get_lock_slot(uintptr_t value) {
+    return (value >> 4) & 0xF;
+}
+
 /**
  * Extract and return the lock count from the provided key. This returned value
  * is the difference between the number of lock and unlock requests made by the
  * current thread. This count is always stored in the remaining value after the
- * least-significant nibble where the flag is stored.
+ * two least-significant nibbles where the flag and reader count index are
+ * stored.
  *
  * @param value
  *     The key value containing the count.
@@ -100,28 +137,34 @@ static uintptr_t get_lock_flag(uintptr_t value) {
  *     the current thread.
  */
 static uintptr_t get_lock_count(uintptr_t value) {
-    return value >> 4;
+    return value >> 8;
 }
 
 /**
- * Given a flag indicating if and how the current thread controls a lock, and
- * a count of the depth of lock requests, return a value containing the flag
- * in the least-significant nibble, and the count in the rest.
+ * Given a flag indicating if and how the current thread controls a lock, the
+ * index of the reader count used to acquire the read lock, and a count of the
+ * depth of lock requests, return a value containing the flag in the
+ * least-significant nibble, the reader count index in the next nibble, and
+ * the count in the rest.
  *
  * @param flag
  *     A flag indicating which lock, if any, is held by the current thread.
  *
+ * @param slot
+ *     The index of the reader count incremented when the current thread
+ *     acquired the read lock, if the read lock is held.
+ *
  * @param count
  *     The depth of the lock attempt by the current thread, i.e. the number of
  *     lock requests minus unlock requests.
  *
  * @return
- *     A value containing the flag in the least-significant nibble, and the
- *     count in the rest, cast to a void* for thread-local storage.
+ *     A value containing the flag, reader count index, and count, cast to a
+ *     void* for thread-local storage.
  */
-static void* get_value_from_flag_and_count(
-        uintptr_t flag, uintptr_t count) {
-    return (void*) ((flag & 0xF) | count << 4);
+static void* get_value_from_flag_slot_and_count(
+        uintptr_t flag, uintptr_t slot, uintptr_t count) {
+    return (void*) ((flag & 0xF) | (slot & 0xF) << 4 | count << 8);
 }
 
 /**
@@ -140,12 +183,162 @@ static int would_overflow_count(uintptr_t current_count) {
 
     /**
      * The count will overflow if it's already equal or greater to the maximum
-     * possible value that can be stored in a uintptr_t excluding the first nibble.
+     * possible value that can be stored in a uintptr_t excluding the first two
+     * nibbles.
      */
-    return current_count >= (UINTPTR_MAX >> 4);
+    return current_count >= (UINTPTR_MAX >> 8);
 
 }
 
+/**
+ * Returns the index of the reader count that the current thread should
+ * increment to acquire the read lock. Where possible, this is based on the
+ * CPU that the current thread is running on, such that threads on different
+ * CPUs increment counters within different cache lines. If the current CPU
+ * cannot be determined, the index is derived from the location of the
+ * current thread's stack, which is distinct for each thread.
+ *
+ * @return
+ *     The index of the reader count that should be used by the current
+ *     thread, which is guaranteed to be less than GUAC_RWLOCK_READER_SLOTS.
+ */
+static unsigned int guac_rwlock_current_slot() {
+
+#ifdef HAVE_SCHED_GETCPU
+    int cpu = sched_getcpu();
+    if (cpu >= 0)
+        return (unsigned int) cpu & (GUAC_RWLOCK_READER_SLOTS - 1);
+#endif
+
+    /* Thread stacks are typically separated by at least 64 KB */
+    char location;
+    uintptr_t address = (uintptr_t) &location;
+    return (unsigned int) ((address >> 16) ^ (address >> 20))
+        & (GUAC_RWLOCK_READER_SLOTS - 1);
+
+}
+
+/**
+ * Decrements the given reader count of the given lock, waking any writer
+ * that may be waiting for all readers to release the lock.
+ *
+ * @param reentrant_rwlock
+ *     The lock whose reader count should be decremented.
+ *
+ * @param slot
+ *     The index of the reader count to decrement.
+ */
+static void guac_rwlock_release_reader(guac_rwlock* reentrant_rwlock,
+        unsigned int slot) {
+
+    __atomic_sub_fetch(&(reentrant_rwlock->slots[slot].readers), 1, __ATOMIC_SEQ_CST);
+
+    /* Wake the writer only if one is actually waiting. As both the decrement
+     * above and the writer's update to its flag are sequentially consistent,
+     * either the writer will see the decremented count or this thread will
+     * see the writer's flag. */
+    if (__atomic_load_n(&(reentrant_rwlock->writer), __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&(reentrant_rwlock->drain_lock));
+        pthread_cond_broadcast(&(reentrant_rwlock->readers_drained));
+        pthread_mutex_unlock(&(reentrant_rwlock->drain_lock));
+    }
+
+}
+
+/**
+ * Acquires the given lock for reading, without regard for reentrancy. If a
+ * writer currently holds or is waiting to acquire the lock, this function
+ * blocks until that writer has released the lock.
+ *
+ * @param reentrant_rwlock
+ *     The lock to acquire for reading.
+ *
+ * @return
+ *     The index of the reader count that was incremented to acquire the read
+ *     lock. This index must be provided to guac_rwlock_release_reader() when
+ *     the read lock is released.
+ */
+static unsigned int guac_rwlock_acquire_reader(guac_rwlock* reentrant_rwlock) {
+
+    for (;;) {
+
+        unsigned int slot = guac_rwlock_current_slot();
+        __atomic_add_fetch(&(reentrant_rwlock->slots[slot].readers), 1, __ATOMIC_SEQ_CST);
+
+        /* The read lock is held if no writer is present */
+        if (!__atomic_load_n(&(reentrant_rwlock->writer), __ATOMIC_SEQ_CST))
+            return slot;
+
+        /* Otherwise, back off and wait for the writer to finish. Writers set
+         * their flag only while holding the pthread rwlock for writing, and
+         * clear that flag before releasing the pthread rwlock, so acquiring
+         * the pthread rwlock for reading blocks until the writer is done. */
+        guac_rwlock_release_reader(reentrant_rwlock, slot);
+        pthread_rwlock_rdlock(&(reentrant_rwlock->lock));
+        pthread_rwlock_unlock(&(reentrant_rwlock->lock));
+
+    }
+
+}
+
+/**
+ * Returns whether any thread currently holds the given lock for reading.
+ *
+ * @param reentrant_rwlock
+ *     The lock to check.
+ *
+ * @return
+ *     Non-zero if at least one thread holds the given lock for reading, zero
+ *     otherwise.
+ */
+static int guac_rwlock_has_readers(guac_rwlock* reentrant_rwlock) {
+
+    for (int i = 0; i < GUAC_RWLOCK_READER_SLOTS; i++) {
+        if (__atomic_load_n(&(reentrant_rwlock->slots[i].readers), __ATOMIC_SEQ_CST))
+            return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Acquires the given lock for writing, without regard for reentrancy. This
+ * function blocks until all other writers and readers have released the
+ * lock.
+ *
+ * @param reentrant_rwlock
+ *     The lock to acquire for writing.
+ */
+static void guac_rwlock_acquire_writer(guac_rwlock* reentrant_rwlock) {
+
+    /* Wait for other writers */
+    pthread_rwlock_wrlock(&(reentrant_rwlock->lock));
+
+    /* Prevent new readers from acquiring the lock */
+    __atomic_store_n(&(reentrant_rwlock->writer), 1, __ATOMIC_SEQ_CST);
+
+    /* Wait for existing readers */
+    pthread_mutex_lock(&(reentrant_rwlock->drain_lock));
+    while (guac_rwlock_has_readers(reentrant_rwlock))
+        pthread_cond_wait(&(reentrant_rwlock->readers_drained),
+                &(reentrant_rwlock->drain_lock));
+    pthread_mutex_unlock(&(reentrant_rwlock->drain_lock));
+
+}
+
+/**
+ * Releases the given lock, which must currently be held for writing by the
+ * current thread, without regard for reentrancy.
+ *
+ * @param reentrant_rwlock
+ *     The lock to release.
+ */
+static void guac_rwlock_release_writer(guac_rwlock* reentrant_rwlock) {
+    __atomic_store_n(&(reentrant_rwlock->writer), 0, __ATOMIC_SEQ_CST);
+    pthread_rwlock_unlock(&(reentrant_rwlock->lock));
+}
+
 int guac_rwlock_acquire_write_lock(guac_rwlock* reentrant_rwlock) {
 
     uintptr_t key_value = (uintptr_t) pthread_getspecific(reentrant_rwlock->key);
@@ -165,8 +358,8 @@ int guac_rwlock_acquire_write_lock(guac_rwlock* reentrant_rwlock) {
 
     /* If the current thread already holds the write lock, increment the count */
     if (flag == GUAC_REENTRANT_LOCK_WRITE_LOCK) {
-        pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_and_count(
-                flag, count + 1));
+        pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_slot_and_count(
+                flag, 0, count + 1));
 
         /* This thread already has the lock */
         return 0;
@@ -180,14 +373,14 @@ int guac_rwlock_acquire_write_lock(guac_rwlock* reentrant_rwlock) {
      * shouldn't cause any issues, however.
      */
     if (flag == GUAC_REENTRANT_LOCK_READ_LOCK)
-        pthread_rwlock_unlock(&(reentrant_rwlock->lock));
+        guac_rwlock_release_reader(reentrant_rwlock, get_lock_slot(key_value));
 
     /* Acquire the write lock */
-    pthread_rwlock_wrlock(&(reentrant_rwlock->lock));
+    guac_rwlock_acquire_writer(reentrant_rwlock);
 
     /* Mark that the current thread has the lock, and increment the count */
-    pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_and_count(
-            GUAC_REENTRANT_LOCK_WRITE_LOCK, count + 1));
+    pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_slot_and_count(
+            GUAC_REENTRANT_LOCK_WRITE_LOCK, 0, count + 1));
 
     return 0;
 
@@ -197,6 +390,7 @@ int guac_rwlock_acquire_read_lock(guac_rwlock* reentrant_rwlock) {
 
     uintptr_t key_value = (uintptr_t) pthread_getspecific(reentrant_rwlock->key);
     uintptr_t flag = get_lock_flag(key_value);
+    uintptr_t slot = get_lock_slot(key_value);
     uintptr_t count = get_lock_count(key_value);
 
     /* If acquiring this lock again would overflow the counter storage */
@@ -217,19 +411,19 @@ int guac_rwlock_acquire_read_lock(guac_rwlock* reentrant_rwlock) {
     ) {
 
         /* Increment the depth counter */
-        pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_and_count(
-                flag, count + 1));
+        pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_slot_and_count(
+                flag, slot, count + 1));
 
         /* This thread already has the lock */
         return 0;
     }
 
     /* Acquire the lock */
-    pthread_rwlock_rdlock(&(reentrant_rwlock->lock));
+    slot = guac_rwlock_acquire_reader(reentrant_rwlock);
 
     /* Set the flag that the current thread has the read lock */
-    pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_and_count(
-                GUAC_REENTRANT_LOCK_READ_LOCK, 1));
+    pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_slot_and_count(
+                GUAC_REENTRANT_LOCK_READ_LOCK, slot, 1));
 
     return 0;
 
@@ -239,6 +433,7 @@ int guac_rwlock_release_lock(guac_rwlock* reentrant_rwlock) {
 
     uintptr_t key_value = (uintptr_t) pthread_getspecific(reentrant_rwlock->key);
     uintptr_t flag = get_lock_flag(key_value);
+    uintptr_t slot = get_lock_slot(key_value);
     uintptr_t count = get_lock_count(key_value);
 
     /*
@@ -258,18 +453,21 @@ int guac_rwlock_release_lock(guac_rwlock* reentrant_rwlock) {
     /* Release the lock if this is the last locked level */
     if (count == 1) {
 
-        pthread_rwlock_unlock(&(reentrant_rwlock->lock));
+        if (flag == GUAC_REENTRANT_LOCK_WRITE_LOCK)
+            guac_rwlock_release_writer(reentrant_rwlock);
+        else
+            guac_rwlock_release_reader(reentrant_rwlock, slot);
 
         /* Set the flag that the current thread holds no locks */
-        pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_and_count(
-                GUAC_REENTRANT_LOCK_NO_LOCK, 0));
+        pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_slot_and_count(
+                GUAC_REENTRANT_LOCK_NO_LOCK, 0, 0));
 
         return 0;
     }
 
     /* Do not release the lock since it's still in use - just decrement */
-    pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_and_count(
-            flag, count - 1));
+    pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_slot_and_count(
+            flag, slot, count - 1));
 
     return 0;
 
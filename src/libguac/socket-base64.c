@@ -0,0 +1,245 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "socket-base64.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef HAVE_AVX2_TARGET
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GUAC_SOCKET_BASE64_NEON
+#endif
+
+/**
+ * The 64 characters of the base64 alphabet, in order of the six-bit values
+ * they represent.
+ */
+static const char guac_socket_base64_characters[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void guac_socket_base64_encode_scalar(const unsigned char* restrict src,
+        size_t triplets, char* restrict output) {
+
+    /* Encode each group of three bytes as four characters */
+    for (; triplets > 0; triplets--) {
+
+        uint32_t group = ((uint32_t) src[0] << 16)
+                       | ((uint32_t) src[1] << 8)
+                       |  (uint32_t) src[2];
+
+        output[0] = guac_socket_base64_characters[ group >> 18        ];
+        output[1] = guac_socket_base64_characters[(group >> 12) & 0x3F];
+        output[2] = guac_socket_base64_characters[(group >>  6) & 0x3F];
+        output[3] = guac_socket_base64_characters[ group        & 0x3F];
+
+        src += 3;
+        output += 4;
+
+    }
+
+}
+
+#ifdef HAVE_AVX2_TARGET
+
+/**
+ * AVX2 implementation of guac_socket_base64_encode_function. Groups of eight
+ * triplets are encoded at once, with each 128-bit lane holding four triplets.
+ * Because each lane is loaded as a full 16 bytes, only 12 of which are
+ * encoded, the vector loop only runs while at least 28 bytes of input remain;
+ * the remainder is handled by guac_socket_base64_encode_scalar().
+ *
+ * @see guac_socket_base64_encode_function
+ */
+__attribute__((target("avx2")))
+static void guac_socket_base64_encode_avx2(const unsigned char* restrict src,
+        size_t triplets, char* restrict output) {
+
+    /* Duplicates the bytes of each triplet such that each 32-bit element
+     * holds the three bytes of a single triplet as [b, a, c, b] */
+    const __m256i shuffle = _mm256_setr_epi8(
+        1, 0, 2, 1,  4, 3, 5, 4,  7, 6, 8, 7,  10, 9, 11, 10,
+        1, 0, 2, 1,  4, 3, 5, 4,  7, 6, 8, 7,  10, 9, 11, 10);
+
+    /* Offsets which must be added to each six-bit value to produce its
+     * ASCII character, indexed by the class of that value (see below) */
+    const __m256i offsets = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0);
+
+    while (triplets >= 10) {
+
+        /* Load four triplets into each 128-bit lane */
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                    _mm_loadu_si128((const __m128i*) src)),
+                    _mm_loadu_si128((const __m128i*) (src + 12)), 1);
+
+        in = _mm256_shuffle_epi8(in, shuffle);
+
+        /* Split each triplet into four six-bit values, one per byte, using
+         * multiplication to shift each 16-bit half independently */
+        __m256i hi = _mm256_mulhi_epu16(
+                _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00)),
+                _mm256_set1_epi32(0x04000040));
+
+        __m256i lo = _mm256_mullo_epi16(
+                _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0)),
+                _mm256_set1_epi32(0x01000010));
+
+        __m256i values = _mm256_or_si256(hi, lo);
+
+        /* Classify each value: 0 for 26-51 ('a'-'z'), 1-11 for 52-62 (digits
+         * and '+'), 12 for 63 ('/'), and 13 for 0-25 ('A'-'Z') */
+        __m256i classes = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+        __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), values);
+        classes = _mm256_or_si256(classes,
+                _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+
+        _mm256_storeu_si256((__m256i*) output, _mm256_add_epi8(values,
+                    _mm256_shuffle_epi8(offsets, classes)));
+
+        src += 24;
+        output += 32;
+        triplets -= 8;
+
+    }
+
+    guac_socket_base64_encode_scalar(src, triplets, output);
+
+}
+
+#endif
+
+#ifdef GUAC_SOCKET_BASE64_NEON
+
+/**
+ * NEON implementation of guac_socket_base64_encode_function. Sixteen triplets
+ * are encoded at once, using de-interleaving loads to separate the bytes of
+ * each triplet and a four-register table lookup to map six-bit values to
+ * characters.
+ *
+ * @see guac_socket_base64_encode_function
+ */
+static void guac_socket_base64_encode_neon(const unsigned char* restrict src,
+        size_t triplets, char* restrict output) {
+
+    const uint8_t* characters = (const uint8_t*) guac_socket_base64_characters;
+    const uint8x16_t mask = vdupq_n_u8(0x3F);
+
+    uint8x16x4_t table;
+    table.val[0] = vld1q_u8(characters);
+    table.val[1] = vld1q_u8(characters + 16);
+    table.val[2] = vld1q_u8(characters + 32);
+    table.val[3] = vld1q_u8(characters + 48);
+
+    while (triplets >= 16) {
+
+        uint8x16x3_t in = vld3q_u8(src);
+        uint8x16x4_t out;
+
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4),
+                    vshrq_n_u8(in.val[1], 4)), mask);
+        out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2),
+                    vshrq_n_u8(in.val[2], 6)), mask);
+        out.val[3] = vandq_u8(in.val[2], mask);
+
+        out.val[0] = vqtbl4q_u8(table, out.val[0]);
+        out.val[1] = vqtbl4q_u8(table, out.val[1]);
+        out.val[2] = vqtbl4q_u8(table, out.val[2]);
+        out.val[3] = vqtbl4q_u8(table, out.val[3]);
+
+        vst4q_u8((uint8_t*) output, out);
+
+        src += 48;
+        output += 64;
+        triplets -= 16;
+
+    }
+
+    guac_socket_base64_encode_scalar(src, triplets, output);
+
+}
+
+#endif
+
+/**
+ * The implementation of guac_socket_base64_encode_function that should be
+ * used on the current CPU. This is initialized exactly once, upon first use,
+ * by guac_socket_base64_init().
+ */
+static guac_socket_base64_encode_function* guac_socket_base64_encode_impl =
+    guac_socket_base64_encode_scalar;
+
+/**
+ * Human-readable name of the implementation stored within
+ * guac_socket_base64_encode_impl.
+ */
+static const char* guac_socket_base64_encode_impl_name = "scalar";
+
+/**
+ * Control used to ensure guac_socket_base64_init() is invoked only once.
+ */
+static pthread_once_t guac_socket_base64_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Selects the fastest implementation of guac_socket_base64_encode_function
+ * that is supported by the current CPU. This function must be invoked only
+ * through pthread_once() with guac_socket_base64_once.
+ */
+static void guac_socket_base64_init(void) {
+
+#ifdef HAVE_AVX2_TARGET
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        guac_socket_base64_encode_impl = guac_socket_base64_encode_avx2;
+        guac_socket_base64_encode_impl_name = "avx2";
+        return;
+    }
+#endif
+
+#ifdef GUAC_SOCKET_BASE64_NEON
+    /* NEON is mandatory on AArch64 and needs no runtime check */
+    guac_socket_base64_encode_impl = guac_socket_base64_encode_neon;
+    guac_socket_base64_encode_impl_name = "neon";
+#endif
+
+}
+
+guac_socket_base64_encode_function* guac_socket_get_base64_encode(void) {
+    pthread_once(&guac_socket_base64_once, guac_socket_base64_init);
+    return guac_socket_base64_encode_impl;
+}
+
+const char* guac_socket_get_base64_encode_name(void) {
+    pthread_once(&guac_socket_base64_once, guac_socket_base64_init);
+    return guac_socket_base64_encode_impl_name;
+}
+
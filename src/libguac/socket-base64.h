@@ -0,0 +1,78 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_SOCKET_BASE64_H
+#define GUAC_SOCKET_BASE64_H
+
+#include <stddef.h>
+
+/**
+ * Function that encodes whole groups of three bytes as base64, writing
+ * exactly four characters of output for each group. No padding is ever
+ * written, as partial groups are never encoded by functions of this type.
+ *
+ * @param src
+ *     The data to encode. Exactly (triplets * 3) bytes will be read, and no
+ *     bytes beyond that point will be accessed.
+ *
+ * @param triplets
+ *     The number of three-byte groups to encode.
+ *
+ * @param output
+ *     The buffer that should receive the encoded data. This buffer must have
+ *     space for at least (triplets * 4) characters. The output is NOT
+ *     null-terminated.
+ */
+typedef void guac_socket_base64_encode_function(const unsigned char* restrict src,
+        size_t triplets, char* restrict output);
+
+/**
+ * Portable, scalar implementation of guac_socket_base64_encode_function. The
+ * results of this implementation are the reference against which any
+ * SIMD-accelerated implementation must be identical.
+ *
+ * @see guac_socket_base64_encode_function
+ */
+guac_socket_base64_encode_function guac_socket_base64_encode_scalar;
+
+/**
+ * Returns the fastest implementation of guac_socket_base64_encode_function
+ * supported by the current CPU, as determined at runtime. If no
+ * SIMD-accelerated implementation is supported, this will be
+ * guac_socket_base64_encode_scalar().
+ *
+ * @return
+ *     The fastest available implementation of
+ *     guac_socket_base64_encode_function.
+ */
+guac_socket_base64_encode_function* guac_socket_get_base64_encode(void);
+
+/**
+ * Returns a human-readable name for the implementation returned by
+ * guac_socket_get_base64_encode(), such as "avx2", "neon", or "scalar".
+ *
+ * @return
+ *     The name of the implementation of guac_socket_base64_encode_function
+ *     selected for the current CPU.
+ */
+const char* guac_socket_get_base64_encode_name(void);
+
+#endif
+
@@ -24,26 +24,11 @@
 #include "guacamole/error.h"
 #include "guacamole/socket.h"
 #include "guacamole/user.h"
+#include "user-output.h"
 
 #include <pthread.h>
 #include <stdlib.h>
-
-/**
- * A function that will broadcast arbitrary data to a subset of users for
- * the provided client, using the provided user callback for any user-specific
- * operations.
- *
- * @param client
- *     The guac_client associated with the users to broadcast to.
- *
- * @param callback
- *     A callback that should be invoked with each broadcasted user.
- *
- * @param data
- *     Arbitrary data that may be used to broadcast to the subset of users.
- */
-typedef void guac_socket_broadcast_handler(
-        guac_client* client, guac_user_callback* callback, void* data);
+#include <string.h>
 
 /**
  * Data associated with an open socket which writes to a subset of connected
@@ -58,34 +43,43 @@ typedef struct guac_socket_broadcast_data {
     guac_client* client;
 
     /**
-     * Lock which is acquired when an instruction is being written, and
-     * released when the instruction is finished being written.
+     * Recursive lock which is acquired when an instruction is being written,
+     * and released when the instruction is finished being written. This lock
+     * is also briefly acquired for any write, such that data written outside
+     * of an instruction is not interleaved with an instruction being written
+     * by another thread.
      */
     pthread_mutex_t socket_lock;
 
     /**
-     * The function to broadcast
+     * The shared log receiving all data written to this socket, read
+     * independently by each user that should receive that data.
      */
-    guac_socket_broadcast_handler* broadcast_handler;
-
-} guac_socket_broadcast_data;
+    guac_user_output_log* log;
 
-/**
- * Single chunk of data, to be broadcast to all users.
- */
-typedef struct __write_chunk {
+    /**
+     * Non-zero if an instruction is currently being written, zero otherwise.
+     */
+    int in_instruction;
 
     /**
-     * The buffer to write.
+     * The data of the instruction currently being written. Data is appended
+     * to the log only once the instruction is complete, such that each user
+     * either receives the whole instruction or none of it.
      */
-    const void* buffer;
+    char* instruction;
 
     /**
-     * The number of bytes in the buffer.
+     * The number of bytes of data within the instruction buffer.
      */
     size_t length;
 
-} __write_chunk;
+    /**
+     * The number of bytes allocated for the instruction buffer.
+     */
+    size_t size;
+
+} guac_socket_broadcast_data;
 
 /**
  * Callback which handles read requests on the broadcast socket. This callback
@@ -114,35 +108,13 @@ static ssize_t __guac_socket_broadcast_read_handler(guac_socket* socket,
 }
 
 /**
- * Callback invoked by the broadcast handler which write a given chunk of
- * data to that user's socket. If the write attempt fails, the user is
- * signalled to stop with guac_user_stop().
- *
- * @param user
- *     The user that the chunk of data should be written to.
- *
- * @param data
- *     A pointer to a __write_chunk which describes the data to be written.
- *
- * @return
- *     Always NULL.
- */
-static void* __write_chunk_callback(guac_user* user, void* data) {
-
-    __write_chunk* chunk = (__write_chunk*) data;
-
-    /* Attempt write, disconnect on failure */
-    if (guac_socket_write(user->socket, chunk->buffer, chunk->length))
-        guac_user_stop(user);
-
-    return NULL;
-
-}
-
-/**
- * Socket write handler which operates on each of the sockets of all connected
- * users. This write handler will always succeed, but any failing user-specific
- * writes will invoke guac_user_stop() on the failing user.
+ * Socket write handler which appends the given data to the shared log read
+ * by all users receiving data from the broadcast socket. Data written within
+ * an instruction is held until the instruction is complete, and then
+ * appended as a single unit, such that it is copied only once regardless of
+ * the number of users. This write handler will always succeed, but any
+ * failing user-specific writes will invoke guac_user_stop() on the failing
+ * user.
  *
  * @param socket
  *     The socket to which the given data must be written.
@@ -164,47 +136,44 @@ static ssize_t __guac_socket_broadcast_write_handler(guac_socket* socket,
     guac_socket_broadcast_data* data =
         (guac_socket_broadcast_data*) socket->data;
 
-    /* Build chunk */
-    __write_chunk chunk;
-    chunk.buffer = buf;
-    chunk.length = count;
+    /* The lock is recursive, and will already be held by the current thread
+     * if an instruction is being written */
+    pthread_mutex_lock(&(data->socket_lock));
 
-    /* Broadcast chunk to the users */
-    data->broadcast_handler(data->client, __write_chunk_callback, &chunk);
+    /* Data written outside of any instruction is treated as complete */
+    if (!data->in_instruction) {
+        guac_user_output_log_append(data->log, buf, count);
+        goto done;
+    }
 
-    return count;
+    /* Grow instruction buffer as necessary */
+    size_t required = guac_mem_ckd_add_or_die(data->length, count);
+    if (required > data->size) {
 
-}
+        size_t size = data->size;
+        while (size < required)
+            size = guac_mem_ckd_mul_or_die(size, 2);
 
-/**
- * Callback which is invoked by the broadcast handler to flush all
- * pending data on the given user's socket. If an error occurs while flushing
- * a user's socket, that user is signalled to stop with guac_user_stop().
- *
- * @param user
- *     The user whose socket should be flushed.
- *
- * @param data
- *     Arbitrary data passed to the broadcast handler. This is not needed
- *     by this callback, and should be left as NULL.
- *
- * @return
- *     Always NULL.
- */
-static void* __flush_callback(guac_user* user, void* data) {
+        data->instruction = guac_mem_realloc_or_die(data->instruction, size);
+        data->size = size;
 
-    /* Attempt flush, disconnect on failure */
-    if (guac_socket_flush(user->socket))
-        guac_user_stop(user);
+    }
 
-    return NULL;
+    memcpy(data->instruction + data->length, buf, count);
+    data->length += count;
+
+done:
+    pthread_mutex_unlock(&(data->socket_lock));
+    return count;
 
 }
 
 /**
- * Socket flush handler which operates on each of the sockets of all connected
- * users. This flush handler will always succeed, but any failing user-specific
- * flush will invoke guac_user_stop() on the failing user.
+ * Socket flush handler which requests that the sockets of all users
+ * receiving data from the broadcast socket be flushed once everything
+ * written thus far has been delivered. This flush handler will always
+ * succeed, but any failing user-specific flush will invoke guac_user_stop()
+ * on the failing user.
  *
  * @param socket
  *     The broadcast socket to flush.
@@ -219,41 +188,17 @@ static ssize_t __guac_socket_broadcast_flush_handler(guac_socket* socket) {
         (guac_socket_broadcast_data*) socket->data;
 
     /* Flush the users */
-    data->broadcast_handler(data->client, __flush_callback, NULL);
+    guac_user_output_log_flush(data->log);
 
     return 0;
 
 }
 
 /**
- * Callback which is invoked by the broadcast handler to lock the given
- * user's socket in preparation for the beginning of a Guacamole protocol
- * instruction.
- *
- * @param user
- *     The user whose socket should be locked.
- *
- * @param data
- *     Arbitrary data passed to the broadcast handler. This is not needed
- *     by this callback, and should be left as NULL.
- *
- * @return
- *     Always NULL.
- */
-static void* __lock_callback(guac_user* user, void* data) {
-
-    /* Lock socket */
-    guac_socket_instruction_begin(user->socket);
-
-    return NULL;
-
-}
-
-/**
- * Socket lock handler which acquires the socket locks of all connected users.
- * Socket-level locks are acquired in preparation for the beginning of a new
- * Guacamole instruction to ensure that parallel writes are only interleaved at
- * instruction boundaries.
+ * Socket lock handler which acquires exclusive access to the broadcast
+ * socket in preparation for the beginning of a new Guacamole instruction,
+ * ensuring that parallel writes are only interleaved at instruction
+ * boundaries.
  *
  * @param socket
  *     The broadcast socket to lock.
@@ -266,38 +211,15 @@ static void __guac_socket_broadcast_lock_handler(guac_socket* socket) {
     /* Acquire exclusive access to socket */
     pthread_mutex_lock(&(data->socket_lock));
 
-    /* Lock sockets of the users */
-    data->broadcast_handler(data->client, __lock_callback, NULL);
-
-}
-
-/**
- * Callback which is invoked by the broadcast handler to unlock the given
- * user's socket at the end of a Guacamole protocol instruction.
- *
- * @param user
- *     The user whose socket should be unlocked.
- *
- * @param data
- *     Arbitrary data passed to the broadcast handler. This is not needed
- *     by this callback, and should be left as NULL.
- *
- * @return
- *     Always NULL.
- */
-static void* __unlock_callback(guac_user* user, void* data) {
-
-    /* Unlock socket */
-    guac_socket_instruction_end(user->socket);
-
-    return NULL;
+    data->in_instruction = 1;
+    data->length = 0;
 
 }
 
 /**
- * Socket unlock handler which releases the socket locks of all connected users.
- * Socket-level locks are released after a Guacamole instruction has finished
- * being written.
+ * Socket unlock handler which appends the completed instruction to the
+ * shared log of the broadcast socket, making that instruction available to
+ * all users, and relinquishes exclusive access to the socket.
  *
  * @param socket
  *     The broadcast socket to unlock.
@@ -307,8 +229,11 @@ static void __guac_socket_broadcast_unlock_handler(guac_socket* socket) {
     guac_socket_broadcast_data* data =
         (guac_socket_broadcast_data*) socket->data;
 
-    /* Unlock sockets of all users */
-    data->broadcast_handler(data->client, __unlock_callback, NULL);
+    /* Deliver the instruction to all users at once */
+    guac_user_output_log_append(data->log, data->instruction, data->length);
+
+    data->in_instruction = 0;
+    data->length = 0;
 
     /* Relinquish exclusive access to socket */
     pthread_mutex_unlock(&(data->socket_lock));
@@ -361,37 +286,41 @@ static int __guac_socket_broadcast_free_handler(guac_socket* socket) {
     /* Destroy locks */
     pthread_mutex_destroy(&(data->socket_lock));
 
+    guac_mem_free(data->instruction);
     guac_mem_free(data);
     return 0;
 
 }
 
 /**
- * Construct and return a socket that will broadcast to the users given by
- * by the provided broadcast handler.
+ * Construct and return a socket that will broadcast to the users reading
+ * from the given log.
  *
  * @param client
  *     The client who's users are being broadcast to.
  *
- * @param broadcast_handler
- *     The handler that will perform the broadcast against a subset of users
- *     of the provided client.
+ * @param log
+ *     The shared log that should receive all data written to the socket.
  *
  * @return
  *     The newly constructed broadcast socket
  */
-static guac_socket* __guac_socket_init(
-        guac_client* client, guac_socket_broadcast_handler* broadcast_handler) {
+static guac_socket* __guac_socket_init(guac_client* client,
+        guac_user_output_log* log) {
 
     pthread_mutexattr_t lock_attributes;
 
     /* Allocate socket and associated data */
     guac_socket* socket = guac_socket_alloc();
     guac_socket_broadcast_data* data =
-        guac_mem_alloc(sizeof(guac_socket_broadcast_data));
+        guac_mem_zalloc(sizeof(guac_socket_broadcast_data));
 
-    /* Set the provided broadcast handler */
-    data->broadcast_handler = broadcast_handler;
+    /* Set the log receiving all written data */
+    data->log = log;
+
+    /* Instructions grow this buffer as necessary */
+    data->instruction = guac_mem_alloc(GUAC_USER_OUTPUT_SEGMENT_SIZE);
+    data->size = GUAC_USER_OUTPUT_SEGMENT_SIZE;
 
     /* Store client as socket data */
     data->client = client;
@@ -399,9 +328,11 @@ static guac_socket* __guac_socket_init(
 
     pthread_mutexattr_init(&lock_attributes);
     pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_settype(&lock_attributes, PTHREAD_MUTEX_RECURSIVE);
 
     /* Init lock */
     pthread_mutex_init(&(data->socket_lock), &lock_attributes);
+    pthread_mutexattr_destroy(&lock_attributes);
 
     /* Set read/write handlers */
     socket->read_handler   = __guac_socket_broadcast_read_handler;
@@ -418,15 +349,16 @@ static guac_socket* __guac_socket_init(
 
 guac_socket* guac_socket_broadcast(guac_client* client) {
 
-    /* Broadcast to all connected non-pending users*/
-    return __guac_socket_init(client, guac_client_foreach_user);
+    /* Broadcast to all connected non-pending users, skipping ahead for any
+     * users that fall too far behind */
+    return __guac_socket_init(client, client->__broadcast_log);
 
 }
 
 guac_socket* guac_socket_broadcast_pending(guac_client* client) {
 
-    /* Broadcast to all connected pending users*/
-    return __guac_socket_init(client, guac_client_foreach_pending_user);
+    /* Broadcast to all connected pending users, delivering everything (this
+     * is the data that synchronizes each user with the connection) */
+    return __guac_socket_init(client, client->__pending_broadcast_log);
 
 }
-
@@ -0,0 +1,698 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "guacamole/error.h"
+#include "guacamole/mem.h"
+#include "guacamole/socket.h"
+#include "socket-compact.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+const char* const guac_socket_compact_opcodes[] = {
+    "ack",      "arc",        "argv",    "audio",      "blob",
+    "body",     "cfill",      "clip",    "close",      "copy",
+    "cstroke",  "cursor",     "curve",   "disconnect", "dispose",
+    "distort",  "end",        "error",   "file",       "filesystem",
+    "identity", "img",        "line",    "lstroke",    "mouse",
+    "move",     "msg",        "name",    "nest",       "nop",
+    "pipe",     "pop",        "push",    "ready",      "rect",
+    "required", "reset",      "set",     "shade",      "size",
+    "start",    "sync",       "transfer", "transform", "undefine",
+    "video",    NULL
+};
+
+/**
+ * The states of the parser which splits the text instructions written to a
+ * compact socket into elements.
+ */
+typedef enum guac_socket_compact_state {
+
+    /**
+     * The decimal length prefix of an element is being read.
+     */
+    GUAC_SOCKET_COMPACT_PARSE_LENGTH,
+
+    /**
+     * The content of an element is being read.
+     */
+    GUAC_SOCKET_COMPACT_PARSE_CONTENT
+
+} guac_socket_compact_state;
+
+/**
+ * Data specific to the compact implementation of guac_socket.
+ */
+typedef struct guac_socket_compact_data {
+
+    /**
+     * The guac_socket to which instructions in compact form are written.
+     */
+    guac_socket* parent;
+
+    /**
+     * Lock which guards all parsing and translation state below.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * The current state of the parser.
+     */
+    guac_socket_compact_state state;
+
+    /**
+     * The number of Unicode characters remaining in the element currently
+     * being read, or the portion of the length prefix read thus far.
+     */
+    size_t remaining;
+
+    /**
+     * The index of the element currently being read within its instruction,
+     * where the opcode is element zero.
+     */
+    int element_index;
+
+    /**
+     * Whether the current instruction is a "blob" instruction, the third
+     * element of which (the data) is base64.
+     */
+    int blob;
+
+    /**
+     * The content of the element currently being read.
+     */
+    char* element;
+
+    /**
+     * The number of bytes within element.
+     */
+    size_t element_length;
+
+    /**
+     * The number of bytes allocated for element.
+     */
+    size_t element_size;
+
+    /**
+     * The compact form of all elements of the current instruction read thus
+     * far.
+     */
+    unsigned char* output;
+
+    /**
+     * The number of bytes within output.
+     */
+    size_t output_length;
+
+    /**
+     * The number of bytes allocated for output.
+     */
+    size_t output_size;
+
+} guac_socket_compact_data;
+
+/**
+ * Ensures that at least the given number of bytes may be appended to the
+ * given buffer, growing the buffer if necessary.
+ *
+ * @param buffer
+ *     A pointer to the buffer, which will be updated if the buffer must be
+ *     reallocated.
+ *
+ * @param size
+ *     A pointer to the number of bytes allocated for the buffer, which will
+ *     be updated if the buffer must be reallocated.
+ *
+ * @param length
+ *     The number of bytes currently within the buffer.
+ *
+ * @param required
+ *     The number of bytes that must be able to be appended.
+ */
+static void guac_socket_compact_reserve(void** buffer, size_t* size,
+        size_t length, size_t required) {
+
+    if (*size - length >= required)
+        return;
+
+    size_t new_size = *size * 2;
+    if (new_size < length + required)
+        new_size = length + required;
+
+    *buffer = guac_mem_realloc(*buffer, new_size);
+    *size = new_size;
+
+}
+
+/**
+ * Appends the given unsigned integer to the current compact instruction as
+ * an LEB128 varint.
+ *
+ * @param data
+ *     The data of the compact socket.
+ *
+ * @param value
+ *     The value to append.
+ */
+static void guac_socket_compact_append_varint(guac_socket_compact_data* data,
+        uint64_t value) {
+
+    guac_socket_compact_reserve((void**) &data->output, &data->output_size,
+            data->output_length, 10);
+
+    do {
+
+        unsigned char byte = value & 0x7F;
+        value >>= 7;
+
+        if (value != 0)
+            byte |= 0x80;
+
+        data->output[data->output_length++] = byte;
+
+    } while (value != 0);
+
+}
+
+/**
+ * Appends the given tag byte to the current compact instruction.
+ *
+ * @param data
+ *     The data of the compact socket.
+ *
+ * @param tag
+ *     The tag to append.
+ */
+static void guac_socket_compact_append_tag(guac_socket_compact_data* data,
+        unsigned char tag) {
+
+    guac_socket_compact_reserve((void**) &data->output, &data->output_size,
+            data->output_length, 1);
+
+    data->output[data->output_length++] = tag;
+
+}
+
+/**
+ * Parses the given element as an integer, succeeding only if the element is
+ * exactly the canonical decimal representation of that integer, such that
+ * formatting the integer as decimal reproduces the element.
+ *
+ * @param element
+ *     The content of the element.
+ *
+ * @param length
+ *     The number of bytes within the element.
+ *
+ * @param value
+ *     Pointer to an int64_t that will receive the parsed value.
+ *
+ * @return
+ *     Non-zero if the element is a canonical integer, zero otherwise.
+ */
+static int guac_socket_compact_parse_int(const char* element, size_t length,
+        int64_t* value) {
+
+    int negative = length > 0 && *element == '-';
+    if (negative) {
+        element++;
+        length--;
+    }
+
+    /* Keep to 18 digits, which never overflow, and reject "", "-0", and
+     * leading zeroes */
+    if (length == 0 || length > 18 || (*element == '0' && (length > 1 || negative)))
+        return 0;
+
+    int64_t result = 0;
+    for (size_t i = 0; i < length; i++) {
+
+        if (element[i] < '0' || element[i] > '9')
+            return 0;
+
+        result = result * 10 + (element[i] - '0');
+
+    }
+
+    *value = negative ? -result : result;
+    return 1;
+
+}
+
+/**
+ * Returns the six-bit value of the given base64 character.
+ *
+ * @param c
+ *     The character to decode.
+ *
+ * @return
+ *     The value of the character, or -1 if the character is not part of the
+ *     base64 alphabet.
+ */
+static int guac_socket_compact_base64_value(char c) {
+
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+
+    return -1;
+
+}
+
+/**
+ * Decodes the given base64 element, succeeding only if the element is
+ * exactly the padded base64 encoding that would be produced for the decoded
+ * data, such that encoding the data again reproduces the element.
+ *
+ * @param element
+ *     The content of the element.
+ *
+ * @param length
+ *     The number of bytes within the element.
+ *
+ * @param output
+ *     The buffer that should receive the decoded data, which must have space
+ *     for at least (length / 4 * 3) bytes.
+ *
+ * @param decoded
+ *     Pointer to a size_t that will receive the number of bytes decoded.
+ *
+ * @return
+ *     Non-zero if the element is canonical base64, zero otherwise.
+ */
+static int guac_socket_compact_decode_base64(const char* element,
+        size_t length, unsigned char* output, size_t* decoded) {
+
+    if (length % 4 != 0)
+        return 0;
+
+    unsigned char* current = output;
+    for (size_t i = 0; i < length; i += 4) {
+
+        int a = guac_socket_compact_base64_value(element[i]);
+        int b = guac_socket_compact_base64_value(element[i + 1]);
+        int c = guac_socket_compact_base64_value(element[i + 2]);
+        int d = guac_socket_compact_base64_value(element[i + 3]);
+
+        if (a < 0 || b < 0)
+            return 0;
+
+        *(current++) = (a << 2) | (b >> 4);
+
+        /* Padding may only appear within the final group, and any bits it
+         * leaves unused must be zero */
+        if (c < 0 || d < 0) {
+
+            int last = (i + 4 == length);
+
+            if (last && c < 0 && element[i + 2] == '='
+                    && element[i + 3] == '=' && (b & 0x0F) == 0)
+                break;
+
+            if (last && c >= 0 && element[i + 3] == '=' && (c & 0x03) == 0) {
+                *(current++) = ((b & 0x0F) << 4) | (c >> 2);
+                break;
+            }
+
+            return 0;
+
+        }
+
+        *(current++) = ((b & 0x0F) << 4) | (c >> 2);
+        *(current++) = ((c & 0x03) << 6) | d;
+
+    }
+
+    *decoded = current - output;
+    return 1;
+
+}
+
+/**
+ * Appends the element that has just been read to the current compact
+ * instruction, choosing the most compact tag that reproduces the element
+ * exactly.
+ *
+ * @param data
+ *     The data of the compact socket.
+ */
+static void guac_socket_compact_end_element(guac_socket_compact_data* data) {
+
+    const char* element = data->element;
+    size_t length = data->element_length;
+
+    /* Opcodes may be common enough to have an index */
+    if (data->element_index == 0) {
+
+        data->blob = (length == 4 && memcmp(element, "blob", 4) == 0);
+
+        for (int i = 0; guac_socket_compact_opcodes[i] != NULL; i++) {
+            const char* opcode = guac_socket_compact_opcodes[i];
+            if (strlen(opcode) == length && memcmp(opcode, element, length) == 0) {
+                guac_socket_compact_append_tag(data, GUAC_SOCKET_COMPACT_OPCODE);
+                guac_socket_compact_append_tag(data, i);
+                goto next;
+            }
+        }
+
+    }
+
+    /* Send the data of blobs without base64 */
+    else if (data->blob && data->element_index == 2) {
+
+        guac_socket_compact_reserve((void**) &data->output, &data->output_size,
+                data->output_length, 11 + length / 4 * 3);
+
+        /* Decode after the space reserved for the tag and length */
+        unsigned char* decoded = data->output + data->output_length + 11;
+        size_t decoded_length;
+        if (guac_socket_compact_decode_base64(element, length, decoded,
+                    &decoded_length)) {
+            guac_socket_compact_append_tag(data, GUAC_SOCKET_COMPACT_BLOB);
+            guac_socket_compact_append_varint(data, decoded_length);
+            memmove(data->output + data->output_length, decoded, decoded_length);
+            data->output_length += decoded_length;
+            goto next;
+        }
+
+    }
+
+    /* Send integers as varints */
+    int64_t value;
+    if (data->element_index != 0
+            && guac_socket_compact_parse_int(element, length, &value)) {
+        guac_socket_compact_append_tag(data, GUAC_SOCKET_COMPACT_INT);
+        guac_socket_compact_append_varint(data,
+                ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+        goto next;
+    }
+
+    /* Send everything else as-is */
+    guac_socket_compact_append_tag(data, GUAC_SOCKET_COMPACT_STRING);
+    guac_socket_compact_append_varint(data, length);
+    guac_socket_compact_reserve((void**) &data->output, &data->output_size,
+            data->output_length, length);
+    memcpy(data->output + data->output_length, element, length);
+    data->output_length += length;
+
+next:
+    data->element_index++;
+    data->element_length = 0;
+
+}
+
+/**
+ * Translates the given portion of the text instructions written to a compact
+ * socket, writing each instruction to the parent socket as soon as it is
+ * completely read.
+ *
+ * @param data
+ *     The data of the compact socket.
+ *
+ * @param buf
+ *     The text to translate.
+ *
+ * @param count
+ *     The number of bytes of text.
+ *
+ * @return
+ *     Zero if the text was translated and written successfully, non-zero if
+ *     the text is not a valid series of instructions or an error occurs
+ *     while writing.
+ */
+static int guac_socket_compact_translate(guac_socket_compact_data* data,
+        const char* buf, size_t count) {
+
+    for (size_t i = 0; i < count; i++) {
+
+        char c = buf[i];
+
+        /* Read the length prefix of each element */
+        if (data->state == GUAC_SOCKET_COMPACT_PARSE_LENGTH) {
+
+            if (c == '.')
+                data->state = GUAC_SOCKET_COMPACT_PARSE_CONTENT;
+
+            else if (c >= '0' && c <= '9'
+                    && data->remaining <= GUAC_SOCKET_OUTPUT_BUFFER_MAX_SIZE)
+                data->remaining = data->remaining * 10 + (c - '0');
+
+            else {
+                guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+                guac_error_message = "Invalid element length written to "
+                    "compact socket";
+                return 1;
+            }
+
+            continue;
+
+        }
+
+        /* Continuation bytes of a character never end an element */
+        if ((c & 0xC0) == 0x80 || data->remaining > 0) {
+
+            if ((c & 0xC0) != 0x80)
+                data->remaining--;
+
+            guac_socket_compact_reserve((void**) &data->element,
+                    &data->element_size, data->element_length, 1);
+            data->element[data->element_length++] = c;
+            continue;
+
+        }
+
+        /* Elements end with a comma, instructions with a semicolon */
+        if (c != ',' && c != ';') {
+            guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+            guac_error_message = "Invalid element terminator written to "
+                "compact socket";
+            return 1;
+        }
+
+        guac_socket_compact_end_element(data);
+        data->state = GUAC_SOCKET_COMPACT_PARSE_LENGTH;
+
+        if (c == ';') {
+
+            guac_socket_compact_append_tag(data, GUAC_SOCKET_COMPACT_END);
+
+            int retval = guac_socket_write(data->parent, data->output,
+                    data->output_length);
+
+            data->output_length = 0;
+            data->element_index = 0;
+
+            if (retval)
+                return 1;
+
+        }
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Callback function which reads only from the parent socket.
+ *
+ * @param socket
+ *     The compact socket to read from.
+ *
+ * @param buf
+ *     The buffer to read data into.
+ *
+ * @param count
+ *     The maximum number of bytes to read into the given buffer.
+ *
+ * @return
+ *     The value returned by guac_socket_read() when invoked on the parent
+ *     socket with the given parameters.
+ */
+static ssize_t guac_socket_compact_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guac_socket_compact_data* data = (guac_socket_compact_data*) socket->data;
+
+    /* Data received from the user is never in compact form */
+    return guac_socket_read(data->parent, buf, count);
+
+}
+
+/**
+ * Callback function which translates the given text into compact form,
+ * writing each complete instruction to the parent socket.
+ *
+ * @param socket
+ *     The compact socket to write through.
+ *
+ * @param buf
+ *     The buffer of data to write.
+ *
+ * @param count
+ *     The number of bytes in the buffer to be written.
+ *
+ * @return
+ *     The number of bytes written if the write was successful, or -1 if an
+ *     error occurs.
+ */
+static ssize_t guac_socket_compact_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_compact_data* data = (guac_socket_compact_data*) socket->data;
+
+    pthread_mutex_lock(&(data->lock));
+    int retval = guac_socket_compact_translate(data, buf, count);
+    pthread_mutex_unlock(&(data->lock));
+
+    if (retval)
+        return -1;
+
+    return count;
+
+}
+
+/**
+ * Callback function which flushes the parent socket. Any partially-written
+ * instruction remains pending until the remainder is written.
+ *
+ * @param socket
+ *     The compact socket to flush.
+ *
+ * @return
+ *     The value returned by guac_socket_flush() when invoked on the parent
+ *     socket.
+ */
+static ssize_t guac_socket_compact_flush_handler(guac_socket* socket) {
+
+    guac_socket_compact_data* data = (guac_socket_compact_data*) socket->data;
+    return guac_socket_flush(data->parent);
+
+}
+
+/**
+ * Callback function which delegates the lock operation to the parent socket.
+ *
+ * @param socket
+ *     The compact socket on which guac_socket_instruction_begin() was
+ *     invoked.
+ */
+static void guac_socket_compact_lock_handler(guac_socket* socket) {
+
+    guac_socket_compact_data* data = (guac_socket_compact_data*) socket->data;
+    guac_socket_instruction_begin(data->parent);
+
+}
+
+/**
+ * Callback function which delegates the unlock operation to the parent
+ * socket.
+ *
+ * @param socket
+ *     The compact socket on which guac_socket_instruction_end() was invoked.
+ */
+static void guac_socket_compact_unlock_handler(guac_socket* socket) {
+
+    guac_socket_compact_data* data = (guac_socket_compact_data*) socket->data;
+    guac_socket_instruction_end(data->parent);
+
+}
+
+/**
+ * Callback function which delegates the select operation to the parent
+ * socket.
+ *
+ * @param socket
+ *     The compact socket on which guac_socket_select() was invoked.
+ *
+ * @param usec_timeout
+ *     The timeout to specify when invoking guac_socket_select() on the
+ *     parent socket.
+ *
+ * @return
+ *     The value returned by guac_socket_select() when invoked with the
+ *     given parameters on the parent socket.
+ */
+static int guac_socket_compact_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guac_socket_compact_data* data = (guac_socket_compact_data*) socket->data;
+    return guac_socket_select(data->parent, usec_timeout);
+
+}
+
+/**
+ * Callback function which frees all data associated with the given compact
+ * socket, but not the parent socket.
+ *
+ * @param socket
+ *     The compact socket being freed.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guac_socket_compact_free_handler(guac_socket* socket) {
+
+    guac_socket_compact_data* data = (guac_socket_compact_data*) socket->data;
+
+    pthread_mutex_destroy(&(data->lock));
+    guac_mem_free(data->element);
+    guac_mem_free(data->output);
+    guac_mem_free(data);
+
+    return 0;
+
+}
+
+guac_socket* guac_socket_open_compact(guac_socket* parent) {
+
+    guac_socket_compact_data* data = guac_mem_zalloc(sizeof(guac_socket_compact_data));
+    data->parent = parent;
+    data->state = GUAC_SOCKET_COMPACT_PARSE_LENGTH;
+
+    data->element_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+    data->element = guac_mem_alloc(data->element_size);
+
+    data->output_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+    data->output = guac_mem_alloc(data->output_size);
+
+    pthread_mutex_init(&(data->lock), NULL);
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = data;
+
+    socket->read_handler   = guac_socket_compact_read_handler;
+    socket->write_handler  = guac_socket_compact_write_handler;
+    socket->select_handler = guac_socket_compact_select_handler;
+    socket->lock_handler   = guac_socket_compact_lock_handler;
+    socket->unlock_handler = guac_socket_compact_unlock_handler;
+    socket->flush_handler  = guac_socket_compact_flush_handler;
+    socket->free_handler   = guac_socket_compact_free_handler;
+
+    return socket;
+
+}
+
@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_SOCKET_COMPACT_H
+#define GUAC_SOCKET_COMPACT_H
+
+/**
+ * The compact form of the Guacamole protocol, which a client may request
+ * during the handshake by sending a "compact" instruction whose only argument
+ * is the value of GUAC_SOCKET_COMPACT_VERSION. If the requested version is
+ * supported, the server acknowledges the request with an identical "compact"
+ * instruction just before "ready", and every instruction that the server
+ * sends after that acknowledgement is in compact form. Instructions sent by
+ * the client are always in the usual text form.
+ *
+ * Each instruction in compact form is a series of elements, each beginning
+ * with a single tag byte, followed by a GUAC_SOCKET_COMPACT_END tag. All
+ * lengths and integers are unsigned LEB128 varints:
+ *
+ *   GUAC_SOCKET_COMPACT_OPCODE  - a single byte index into
+ *                                 guac_socket_compact_opcodes
+ *   GUAC_SOCKET_COMPACT_STRING  - a varint byte length, followed by that many
+ *                                 bytes of UTF-8
+ *   GUAC_SOCKET_COMPACT_INT     - a zigzag-encoded varint, standing for the
+ *                                 decimal representation of that integer
+ *   GUAC_SOCKET_COMPACT_BLOB    - a varint byte length, followed by that many
+ *                                 bytes of raw data, standing for the base64
+ *                                 encoding of that data
+ *
+ * Each compact instruction therefore decodes to exactly the text instruction
+ * it was produced from.
+ *
+ * @file socket-compact.h
+ */
+
+#include "guacamole/socket-types.h"
+
+/**
+ * The version of the compact form of the protocol implemented by
+ * guac_socket_open_compact().
+ */
+#define GUAC_SOCKET_COMPACT_VERSION "1"
+
+/**
+ * Tag marking the end of an instruction in compact form.
+ */
+#define GUAC_SOCKET_COMPACT_END 0x00
+
+/**
+ * Tag for an element that is a UTF-8 string.
+ */
+#define GUAC_SOCKET_COMPACT_STRING 0x01
+
+/**
+ * Tag for an element that is an integer in canonical decimal form.
+ */
+#define GUAC_SOCKET_COMPACT_INT 0x02
+
+/**
+ * Tag for an element that is base64-encoded binary data.
+ */
+#define GUAC_SOCKET_COMPACT_BLOB 0x03
+
+/**
+ * Tag for an element that is one of the common opcodes listed within
+ * guac_socket_compact_opcodes.
+ */
+#define GUAC_SOCKET_COMPACT_OPCODE 0x04
+
+/**
+ * The opcodes which may be sent in compact form as a single byte index,
+ * terminated by NULL. This list is part of the compact form of the protocol
+ * and may only be appended to along with a change in
+ * GUAC_SOCKET_COMPACT_VERSION.
+ */
+extern const char* const guac_socket_compact_opcodes[];
+
+/**
+ * Allocates a new guac_socket which translates all instructions written to
+ * it into compact form, writing the result to the given guac_socket. Reads
+ * are passed through to the given guac_socket unchanged. Freeing the returned
+ * guac_socket does not free the given guac_socket.
+ *
+ * @param socket
+ *     The guac_socket that instructions in compact form should be written
+ *     to.
+ *
+ * @return
+ *     A newly-allocated guac_socket which translates all instructions written
+ *     to it into compact form.
+ */
+guac_socket* guac_socket_open_compact(guac_socket* socket);
+
+#endif
+
@@ -22,10 +22,12 @@
 #include "guacamole/mem.h"
 #include "guacamole/error.h"
 #include "guacamole/socket.h"
+#include "guacamole/timestamp.h"
 #include "wait-fd.h"
 
 #include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +36,8 @@
 
 #ifdef ENABLE_WINSOCK
 #include <winsock2.h>
+#else
+#include <sys/uio.h>
 #endif
 
 /**
@@ -49,13 +53,18 @@ typedef struct guac_socket_fd_data {
     /**
      * The number of bytes currently in the main write buffer.
      */
-    int written;
+    size_t written;
+
+    /**
+     * The size of the main write buffer, in bytes.
+     */
+    size_t size;
 
     /**
      * The main write buffer. Bytes written go here before being flushed
      * to the open file descriptor.
      */
-    char out_buf[GUAC_SOCKET_OUTPUT_BUFFER_SIZE];
+    char* out_buf;
 
     /**
      * Lock which is acquired when an instruction is being written, and
@@ -69,8 +78,82 @@ typedef struct guac_socket_fd_data {
      */
     pthread_mutex_t buffer_lock;
 
+    /**
+     * The maximum average rate at which data may be written to the file
+     * descriptor, in bytes per second, or zero if writes are not limited.
+     * See guac_socket_limit_bandwidth().
+     */
+    size_t bandwidth_limit;
+
+    /**
+     * The number of bytes that may currently be written without waiting.
+     * This may be negative if previous writes have exceeded the limit, in
+     * which case the next write must first wait for the deficit to be
+     * recovered.
+     */
+    int64_t allowance;
+
+    /**
+     * The time that allowance was last replenished.
+     */
+    guac_timestamp allowance_timestamp;
+
 } guac_socket_fd_data;
 
+/**
+ * Replenishes the write allowance of the given socket for the time that has
+ * elapsed since it was last replenished, allowing no more than one second's
+ * worth of data to accumulate.
+ *
+ * @param data
+ *     The data of the socket whose allowance should be replenished.
+ */
+static void guac_socket_fd_replenish(guac_socket_fd_data* data) {
+
+    guac_timestamp now = guac_timestamp_current();
+
+    data->allowance += (now - data->allowance_timestamp)
+        * (int64_t) data->bandwidth_limit / 1000;
+
+    if (data->allowance > (int64_t) data->bandwidth_limit)
+        data->allowance = data->bandwidth_limit;
+
+    data->allowance_timestamp = now;
+
+}
+
+/**
+ * Waits as necessary to keep writes to the given socket within its bandwidth
+ * limit, if any, and then deducts the given number of bytes from its write
+ * allowance. Rather than buffering data, this blocks the writing thread, such
+ * that the effects of the limit propagate back to whatever is producing the
+ * data. This function must ONLY be called if the buffer lock has already been
+ * acquired.
+ *
+ * @param data
+ *     The data of the socket about to be written to.
+ *
+ * @param count
+ *     The number of bytes about to be written.
+ */
+static void guac_socket_fd_throttle(guac_socket_fd_data* data, size_t count) {
+
+    if (data->bandwidth_limit == 0)
+        return;
+
+    guac_socket_fd_replenish(data);
+
+    /* Wait for any deficit from previous writes to be recovered */
+    if (data->allowance < 0) {
+        guac_timestamp_msleep(-data->allowance * 1000
+                / (int64_t) data->bandwidth_limit + 1);
+        guac_socket_fd_replenish(data);
+    }
+
+    data->allowance -= count;
+
+}
+
 /**
  * Writes the entire contents of the given buffer to the file descriptor
  * associated with the given socket, retrying as necessary until the whole
@@ -96,6 +179,8 @@ ssize_t guac_socket_fd_write(guac_socket* socket,
     guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
     const char* buffer = buf;
 
+    guac_socket_fd_throttle(data, count);
+
     /* Write until completely written */
     while (count > 0) {
 
@@ -126,6 +211,90 @@ ssize_t guac_socket_fd_write(guac_socket* socket,
 
 }
 
+/**
+ * Writes the contents of the internal output buffer of the given socket,
+ * followed by the entire contents of the given buffer, to the file descriptor
+ * associated with that socket. Where supported, both are written with a
+ * single vectored write, avoiding any copy of the given buffer. The internal
+ * output buffer is empty once this function succeeds. This function must ONLY
+ * be called if the buffer lock has already been acquired.
+ *
+ * @param socket
+ *     The guac_socket associated with the file descriptor to which the
+ *     buffered data and given buffer should be written.
+ *
+ * @param buf
+ *     The buffer of data to write after any buffered data.
+ *
+ * @param count
+ *     The number of bytes within the given buffer.
+ *
+ * @return
+ *     Zero if all data was written successfully, or a negative value if an
+ *     error occurs.
+ */
+static ssize_t guac_socket_fd_write_vectored(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
+
+#ifdef ENABLE_WINSOCK
+    /* Simply write each buffer in turn if writev() is unavailable */
+    if (guac_socket_fd_write(socket, data->out_buf, data->written))
+        return -1;
+
+    data->written = 0;
+    return guac_socket_fd_write(socket, buf, count);
+#else
+    struct iovec iov[2] = {
+        { .iov_base = data->out_buf,  .iov_len = data->written },
+        { .iov_base = (void*) buf,    .iov_len = count         }
+    };
+
+    struct iovec* current = iov;
+    int remaining = 2;
+
+    guac_socket_fd_throttle(data, data->written + count);
+
+    /* Skip buffered data entirely if there is none */
+    if (data->written == 0) {
+        current++;
+        remaining--;
+    }
+
+    /* Write until all vectors are completely written */
+    while (remaining > 0) {
+
+        ssize_t retval = writev(data->fd, current, remaining);
+
+        /* Record errors in guac_error */
+        if (retval < 0) {
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error writing data to socket";
+            return retval;
+        }
+
+        /* Advance past all completely-written vectors */
+        while (remaining > 0 && (size_t) retval >= current->iov_len) {
+            retval -= current->iov_len;
+            current++;
+            remaining--;
+        }
+
+        /* Advance within any partially-written vector */
+        if (remaining > 0) {
+            current->iov_base = (char*) current->iov_base + retval;
+            current->iov_len -= retval;
+        }
+
+    }
+
+    data->written = 0;
+    return 0;
+#endif
+
+}
+
 /**
  * Attempts to read from the underlying file descriptor of the given
  * guac_socket, populating the given buffer.
@@ -250,11 +419,24 @@ static ssize_t guac_socket_fd_write_buffered(guac_socket* socket,
     const char* current = buf;
     guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
 
+    /* Write large blocks of data that would overflow the buffer directly,
+     * together with anything already buffered, rather than copying them
+     * through the buffer in pieces */
+    if (count >= GUAC_SOCKET_VECTORED_WRITE_THRESHOLD
+            && count > data->size - data->written) {
+
+        if (guac_socket_fd_write_vectored(socket, buf, count))
+            return -1;
+
+        return original_count;
+
+    }
+
     /* Append to buffer, flush if necessary */
     while (count > 0) {
 
-        int chunk_size;
-        int remaining = sizeof(data->out_buf) - data->written;
+        size_t chunk_size;
+        size_t remaining = data->size - data->written;
 
         /* If no space left in buffer, flush and retry */
         if (remaining == 0) {
@@ -324,6 +506,68 @@ static ssize_t guac_socket_fd_write_handler(guac_socket* socket,
 
 }
 
+/**
+ * Reserves space directly within the internal output buffer of the given
+ * socket, flushing the buffer first if less than the requested amount of
+ * space is free. The buffer lock is acquired by this function and is only
+ * released by guac_socket_fd_commit_handler() or if an error occurs.
+ *
+ * @param socket
+ *     The guac_socket whose output buffer space should be reserved.
+ *
+ * @param min
+ *     The minimum number of bytes that must be available.
+ *
+ * @param available
+ *     Pointer to a size_t that should receive the number of bytes actually
+ *     available.
+ *
+ * @return
+ *     A pointer to the first free byte of the output buffer, or NULL if an
+ *     error occurs while flushing the buffer.
+ */
+static char* guac_socket_fd_reserve_handler(guac_socket* socket,
+        size_t min, size_t* available) {
+
+    guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
+
+    /* Acquire exclusive access to buffer */
+    pthread_mutex_lock(&(data->buffer_lock));
+
+    /* Flush buffer if insufficient space remains */
+    if (data->size - data->written < min
+            && guac_socket_fd_flush(socket)) {
+        pthread_mutex_unlock(&(data->buffer_lock));
+        return NULL;
+    }
+
+    *available = data->size - data->written;
+    return data->out_buf + data->written;
+
+}
+
+/**
+ * Records the given number of bytes as having been written to the space
+ * reserved by guac_socket_fd_reserve_handler(), releasing the buffer lock.
+ *
+ * @param socket
+ *     The guac_socket whose reservation should be completed.
+ *
+ * @param count
+ *     The number of bytes written to the reserved space.
+ */
+static void guac_socket_fd_commit_handler(guac_socket* socket,
+        size_t count) {
+
+    guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
+
+    data->written += count;
+
+    /* Relinquish exclusive access to buffer */
+    pthread_mutex_unlock(&(data->buffer_lock));
+
+}
+
 /**
  * Waits for data on the underlying file descriptor of the given socket to
  * become available such that the next read operation will not block.
@@ -383,6 +627,7 @@ static int guac_socket_fd_free_handler(guac_socket* socket) {
     /* Close file descriptor */
     close(data->fd);
 
+    guac_mem_free(data->out_buf);
     guac_mem_free(data);
     return 0;
 
@@ -418,10 +663,16 @@ static void guac_socket_fd_unlock_handler(guac_socket* socket) {
 
 }
 
-guac_socket* guac_socket_open(int fd) {
+guac_socket* guac_socket_open_buffered(int fd, size_t buffer_size) {
 
     pthread_mutexattr_t lock_attributes;
 
+    /* Constrain buffer size to supported bounds */
+    if (buffer_size < GUAC_SOCKET_OUTPUT_BUFFER_SIZE)
+        buffer_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+    else if (buffer_size > GUAC_SOCKET_OUTPUT_BUFFER_MAX_SIZE)
+        buffer_size = GUAC_SOCKET_OUTPUT_BUFFER_MAX_SIZE;
+
     /* Allocate socket and associated data */
     guac_socket* socket = guac_socket_alloc();
     guac_socket_fd_data* data = guac_mem_alloc(sizeof(guac_socket_fd_data));
@@ -429,6 +680,9 @@ guac_socket* guac_socket_open(int fd) {
     /* Store file descriptor as socket data */
     data->fd = fd;
     data->written = 0;
+    data->size = buffer_size;
+    data->out_buf = guac_mem_alloc(buffer_size);
+    data->bandwidth_limit = 0;
     socket->data = data;
 
     pthread_mutexattr_init(&lock_attributes);
@@ -445,9 +699,33 @@ guac_socket* guac_socket_open(int fd) {
     socket->lock_handler   = guac_socket_fd_lock_handler;
     socket->unlock_handler = guac_socket_fd_unlock_handler;
     socket->flush_handler  = guac_socket_fd_flush_handler;
+    socket->reserve_handler = guac_socket_fd_reserve_handler;
+    socket->commit_handler  = guac_socket_fd_commit_handler;
     socket->free_handler   = guac_socket_fd_free_handler;
 
     return socket;
 
 }
 
+guac_socket* guac_socket_open(int fd) {
+    return guac_socket_open_buffered(fd, GUAC_SOCKET_OUTPUT_BUFFER_SIZE);
+}
+
+void guac_socket_limit_bandwidth(guac_socket* socket, size_t bytes_per_second) {
+
+    /* Only sockets backed by file descriptors can be limited */
+    if (socket->write_handler != guac_socket_fd_write_handler)
+        return;
+
+    guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
+
+    pthread_mutex_lock(&(data->buffer_lock));
+
+    /* Begin with a full second's worth of allowance */
+    data->bandwidth_limit = bytes_per_second;
+    data->allowance = bytes_per_second;
+    data->allowance_timestamp = guac_timestamp_current();
+
+    pthread_mutex_unlock(&(data->buffer_lock));
+
+}
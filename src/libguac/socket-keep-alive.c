@@ -0,0 +1,294 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "socket-keep-alive.h"
+
+#include "guacamole/protocol.h"
+#include "guacamole/socket.h"
+#include "guacamole/timestamp.h"
+
+#include <pthread.h>
+#include <time.h>
+
+/**
+ * Lock which guards all state of the keep-alive service, including the
+ * __keep_alive_* members of each guac_socket.
+ */
+static pthread_mutex_t guac_socket_keep_alive_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Condition which is signalled whenever a socket is added to the keep-alive
+ * service, or whenever a keep-alive ping finishes being sent.
+ */
+static pthread_cond_t guac_socket_keep_alive_modified = PTHREAD_COND_INITIALIZER;
+
+/**
+ * The slots of the timer wheel, each being the first socket of a list of
+ * sockets that should be checked when the wheel reaches that slot. The
+ * additional, final list contains the sockets currently being checked.
+ */
+static guac_socket* guac_socket_keep_alive_wheel[GUAC_SOCKET_KEEP_ALIVE_WHEEL_SIZE + 1];
+
+/**
+ * The number of sockets currently within the keep-alive service, including
+ * any socket currently being sent a keep-alive ping.
+ */
+static int guac_socket_keep_alive_count = 0;
+
+/**
+ * The number of times the timer wheel has advanced.
+ */
+static unsigned int guac_socket_keep_alive_tick = 0;
+
+/**
+ * The socket currently being sent a keep-alive ping, or NULL if no ping is
+ * being sent.
+ */
+static guac_socket* guac_socket_keep_alive_busy = NULL;
+
+/**
+ * Non-zero if the keep-alive thread has been started, zero otherwise.
+ */
+static int guac_socket_keep_alive_started = 0;
+
+/**
+ * Adds the given socket to the slot of the timer wheel that the wheel will
+ * reach after the given number of milliseconds, rounding up to the next tick.
+ * The socket must not currently be within any slot, and the keep-alive lock
+ * must be held.
+ *
+ * @param socket
+ *     The guac_socket to schedule.
+ *
+ * @param delay
+ *     The number of milliseconds until the socket should next be checked.
+ */
+static void guac_socket_keep_alive_schedule(guac_socket* socket,
+        guac_timestamp delay) {
+
+    /* Always wait at least one tick, and never longer than the full wheel */
+    guac_timestamp ticks = (delay + GUAC_SOCKET_KEEP_ALIVE_TICK - 1)
+        / GUAC_SOCKET_KEEP_ALIVE_TICK;
+
+    if (ticks < 1)
+        ticks = 1;
+    else if (ticks > GUAC_SOCKET_KEEP_ALIVE_WHEEL_SIZE)
+        ticks = GUAC_SOCKET_KEEP_ALIVE_WHEEL_SIZE;
+
+    int slot = (guac_socket_keep_alive_tick + ticks)
+        % GUAC_SOCKET_KEEP_ALIVE_WHEEL_SIZE;
+
+    socket->__keep_alive_slot = slot;
+    socket->__keep_alive_prev = NULL;
+    socket->__keep_alive_next = guac_socket_keep_alive_wheel[slot];
+
+    if (socket->__keep_alive_next != NULL)
+        socket->__keep_alive_next->__keep_alive_prev = socket;
+
+    guac_socket_keep_alive_wheel[slot] = socket;
+
+}
+
+/**
+ * Removes the given socket from whichever slot of the timer wheel currently
+ * contains it. The socket must currently be within a slot, and the
+ * keep-alive lock must be held.
+ *
+ * @param socket
+ *     The guac_socket to unschedule.
+ */
+static void guac_socket_keep_alive_unschedule(guac_socket* socket) {
+
+    if (socket->__keep_alive_prev != NULL)
+        socket->__keep_alive_prev->__keep_alive_next = socket->__keep_alive_next;
+    else
+        guac_socket_keep_alive_wheel[socket->__keep_alive_slot] =
+            socket->__keep_alive_next;
+
+    if (socket->__keep_alive_next != NULL)
+        socket->__keep_alive_next->__keep_alive_prev = socket->__keep_alive_prev;
+
+    socket->__keep_alive_slot = GUAC_SOCKET_KEEP_ALIVE_UNSCHEDULED;
+    socket->__keep_alive_prev = NULL;
+    socket->__keep_alive_next = NULL;
+
+}
+
+/**
+ * The start routine of the thread shared by all sockets requiring keep-alive
+ * pings. Each tick, the sockets within the current slot of the timer wheel
+ * are checked, with any socket that has been idle for at least
+ * GUAC_SOCKET_KEEP_ALIVE_INTERVAL milliseconds being sent a "nop", and each
+ * socket being rescheduled for the point at which it would next become idle.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_socket_keep_alive_thread(void* data) {
+
+    const int processing = GUAC_SOCKET_KEEP_ALIVE_WHEEL_SIZE;
+
+    /* Calculate sleep interval */
+    struct timespec interval;
+    interval.tv_sec  =  GUAC_SOCKET_KEEP_ALIVE_TICK / 1000;
+    interval.tv_nsec = (GUAC_SOCKET_KEEP_ALIVE_TICK % 1000) * 1000000L;
+
+    pthread_mutex_lock(&guac_socket_keep_alive_lock);
+    for (;;) {
+
+        /* Wait for sockets to be added to the service */
+        while (guac_socket_keep_alive_count == 0)
+            pthread_cond_wait(&guac_socket_keep_alive_modified,
+                    &guac_socket_keep_alive_lock);
+
+        /* Sleep until next tick */
+        pthread_mutex_unlock(&guac_socket_keep_alive_lock);
+        nanosleep(&interval, NULL);
+        pthread_mutex_lock(&guac_socket_keep_alive_lock);
+
+        int slot = ++guac_socket_keep_alive_tick
+            % GUAC_SOCKET_KEEP_ALIVE_WHEEL_SIZE;
+
+        /* Move all sockets within the current slot to the list of sockets
+         * being checked, such that rescheduling cannot add them back to the
+         * list currently being walked */
+        guac_socket* current = guac_socket_keep_alive_wheel[slot];
+        guac_socket_keep_alive_wheel[slot] = NULL;
+        guac_socket_keep_alive_wheel[processing] = current;
+
+        for (; current != NULL; current = current->__keep_alive_next)
+            current->__keep_alive_slot = processing;
+
+        guac_socket* socket;
+        while ((socket = guac_socket_keep_alive_wheel[processing]) != NULL) {
+
+            guac_socket_keep_alive_unschedule(socket);
+
+            /* Sockets that have closed no longer require pings */
+            if (socket->state != GUAC_SOCKET_OPEN) {
+                guac_socket_keep_alive_count--;
+                continue;
+            }
+
+            guac_timestamp idle = guac_timestamp_current_coarse()
+                - socket->last_write_timestamp;
+
+            /* Send NOP keep-alive if it's been a while since the last
+             * output, without holding the lock (the socket cannot be freed
+             * while marked as busy) */
+            if (idle >= GUAC_SOCKET_KEEP_ALIVE_INTERVAL) {
+
+                guac_socket_keep_alive_busy = socket;
+                pthread_mutex_unlock(&guac_socket_keep_alive_lock);
+
+                int error = guac_protocol_send_nop(socket)
+                    || guac_socket_flush(socket);
+
+                pthread_mutex_lock(&guac_socket_keep_alive_lock);
+                guac_socket_keep_alive_busy = NULL;
+                pthread_cond_broadcast(&guac_socket_keep_alive_modified);
+
+                /* Stop pinging sockets that can no longer be written */
+                if (error) {
+                    guac_socket_keep_alive_count--;
+                    continue;
+                }
+
+                idle = 0;
+
+            }
+
+            /* Check again once the socket may have become idle */
+            guac_socket_keep_alive_schedule(socket,
+                    GUAC_SOCKET_KEEP_ALIVE_INTERVAL - idle);
+
+        }
+
+    }
+
+    /* The keep-alive thread runs for the life of the process */
+    return NULL;
+
+}
+
+void guac_socket_keep_alive_add(guac_socket* socket) {
+
+    pthread_mutex_lock(&guac_socket_keep_alive_lock);
+
+    /* Sockets are pinged by the service only once */
+    if (socket->__keep_alive_enabled)
+        goto done;
+
+    /* Start the shared keep-alive thread upon first use */
+    if (!guac_socket_keep_alive_started) {
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, guac_socket_keep_alive_thread, NULL))
+            goto done;
+
+        pthread_detach(thread);
+        guac_socket_keep_alive_started = 1;
+
+    }
+
+    /* Check the socket once it may have become idle */
+    guac_timestamp idle = guac_timestamp_current_coarse()
+        - socket->last_write_timestamp;
+
+    socket->__keep_alive_enabled = 1;
+    guac_socket_keep_alive_schedule(socket,
+            GUAC_SOCKET_KEEP_ALIVE_INTERVAL - idle);
+    guac_socket_keep_alive_count++;
+
+    pthread_cond_broadcast(&guac_socket_keep_alive_modified);
+
+done:
+    pthread_mutex_unlock(&guac_socket_keep_alive_lock);
+
+}
+
+void guac_socket_keep_alive_remove(guac_socket* socket) {
+
+    pthread_mutex_lock(&guac_socket_keep_alive_lock);
+
+    if (!socket->__keep_alive_enabled)
+        goto done;
+
+    /* Wait for any in-progress ping to complete */
+    while (guac_socket_keep_alive_busy == socket)
+        pthread_cond_wait(&guac_socket_keep_alive_modified,
+                &guac_socket_keep_alive_lock);
+
+    /* The socket may already have been dropped by the service if it closed
+     * or could not be written */
+    if (socket->__keep_alive_slot != GUAC_SOCKET_KEEP_ALIVE_UNSCHEDULED) {
+        guac_socket_keep_alive_unschedule(socket);
+        guac_socket_keep_alive_count--;
+    }
+
+    socket->__keep_alive_enabled = 0;
+
+done:
+    pthread_mutex_unlock(&guac_socket_keep_alive_lock);
+
+}
@@ -0,0 +1,79 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_SOCKET_KEEP_ALIVE_H
+#define GUAC_SOCKET_KEEP_ALIVE_H
+
+/**
+ * Private service which sends keep-alive pings on behalf of all sockets
+ * within the current process that require them. Rather than each socket
+ * having its own thread, a single thread maintains a timer wheel of all such
+ * sockets, checking each socket only when it may have become idle.
+ *
+ * @file socket-keep-alive.h
+ */
+
+#include "guacamole/socket-constants.h"
+#include "guacamole/socket-types.h"
+
+/**
+ * The number of slots within the timer wheel of the keep-alive service. Each
+ * slot covers GUAC_SOCKET_KEEP_ALIVE_TICK milliseconds, with the wheel as a
+ * whole covering exactly GUAC_SOCKET_KEEP_ALIVE_INTERVAL milliseconds.
+ */
+#define GUAC_SOCKET_KEEP_ALIVE_WHEEL_SIZE 10
+
+/**
+ * The number of milliseconds between each advance of the timer wheel of the
+ * keep-alive service. This is the precision with which keep-alive pings are
+ * scheduled.
+ */
+#define GUAC_SOCKET_KEEP_ALIVE_TICK \
+    (GUAC_SOCKET_KEEP_ALIVE_INTERVAL / GUAC_SOCKET_KEEP_ALIVE_WHEEL_SIZE)
+
+/**
+ * The value of the __keep_alive_slot member of any guac_socket that is not
+ * currently scheduled within the timer wheel of the keep-alive service.
+ */
+#define GUAC_SOCKET_KEEP_ALIVE_UNSCHEDULED -1
+
+/**
+ * Begins sending keep-alive pings on the given socket whenever that socket
+ * has not been written to for GUAC_SOCKET_KEEP_ALIVE_INTERVAL milliseconds,
+ * starting the shared keep-alive thread if it is not already running. If
+ * keep-alive pings are already enabled for the socket, this function has no
+ * effect.
+ *
+ * @param socket
+ *     The guac_socket that requires keep-alive pings.
+ */
+void guac_socket_keep_alive_add(guac_socket* socket);
+
+/**
+ * Stops sending keep-alive pings on the given socket, waiting for any ping
+ * currently being sent on that socket to complete. If keep-alive pings are
+ * not enabled for the socket, this function has no effect.
+ *
+ * @param socket
+ *     The guac_socket that no longer requires keep-alive pings.
+ */
+void guac_socket_keep_alive_remove(guac_socket* socket);
+
+#endif
+
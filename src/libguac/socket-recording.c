@@ -0,0 +1,1379 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "guacamole/client.h"
+#include "guacamole/display.h"
+#include "guacamole/mem.h"
+#include "guacamole/recording.h"
+#include "guacamole/socket.h"
+#include "guacamole/timestamp.h"
+#include "recording-format.h"
+#include "socket-recording.h"
+
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * A keyframe that has been or is being produced for a compressed recording,
+ * queued for the writer thread.
+ */
+typedef struct guac_socket_recording_keyframe_data {
+
+    /**
+     * The position within the uncompressed protocol data of the recording at
+     * which the state captured by this keyframe was current.
+     */
+    uint64_t position;
+
+    /**
+     * The time at which the state captured by this keyframe was current.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The protocol data of the keyframe.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of protocol data within buffer.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for buffer.
+     */
+    size_t size;
+
+    /**
+     * Non-zero if the keyframe is complete and may be written, zero if the
+     * keyframe is still being produced.
+     */
+    int ready;
+
+    /**
+     * The next keyframe in the queue, or NULL if this is the last keyframe.
+     */
+    struct guac_socket_recording_keyframe_data* next;
+
+} guac_socket_recording_keyframe_data;
+
+/**
+ * Data associated with an open socket which writes to a session recording
+ * file asynchronously. The ring buffer is shared between the single thread
+ * currently holding socket_lock (the producer) and the writer thread (the
+ * consumer) without locking, with each side advancing only its own position
+ * within the buffer.
+ */
+typedef struct guac_socket_recording_data {
+
+    /**
+     * The guac_client to which memory allocated by this socket is
+     * attributed, or NULL if that memory is not attributed to any client.
+     */
+    guac_client* client;
+
+    /**
+     * The file descriptor of the recording file.
+     */
+    int fd;
+
+    /**
+     * The behavior to use when the ring buffer is full.
+     */
+    guac_recording_overflow overflow;
+
+    /**
+     * The format of the recording file.
+     */
+    guac_recording_format format;
+
+    /**
+     * Recursive lock which is acquired when an instruction is being written,
+     * and released when the instruction is finished being written. This lock
+     * is also briefly acquired for any write, such that data written outside
+     * of an instruction is not interleaved with an instruction being written
+     * by another thread.
+     */
+    pthread_mutex_t socket_lock;
+
+    /**
+     * The number of nested calls to guac_socket_instruction_begin() that
+     * have not yet been matched by guac_socket_instruction_end().
+     */
+    int in_instruction;
+
+    /**
+     * Non-zero if the remainder of the instruction currently being written
+     * should be discarded, as the start of that instruction did not fit
+     * within the ring buffer and GUAC_RECORDING_OVERFLOW_DROP is in use.
+     */
+    int dropping;
+
+    /**
+     * The ring buffer, GUAC_SOCKET_RECORDING_BUFFER_SIZE bytes in size.
+     */
+    char* buffer;
+
+    /**
+     * The total number of bytes ever made available to the writer thread.
+     * Written only by the producer, and only with data which is complete
+     * (whole instructions, or data written outside of any instruction).
+     */
+    size_t head;
+
+    /**
+     * The total number of bytes ever copied into the ring buffer by the
+     * producer, including the data of any instruction still being written.
+     * Accessed only by the producer.
+     */
+    size_t pending;
+
+    /**
+     * The total number of bytes ever written to the recording file from the
+     * ring buffer. Written only by the writer thread.
+     */
+    size_t tail;
+
+    /**
+     * Temporary file receiving all written data while the ring buffer is
+     * overflowing and GUAC_RECORDING_OVERFLOW_SPILL is in use, or NULL if no
+     * such file has yet been needed.
+     */
+    FILE* spill;
+
+    /**
+     * Non-zero if written data is currently being appended to the spill file
+     * rather than the ring buffer. Once set, this remains set until the
+     * writer thread has drained both the ring buffer and the spill file.
+     */
+    int spilling;
+
+    /**
+     * The number of bytes appended to the spill file since it was last
+     * emptied. Written only by the producer.
+     */
+    off_t spill_written;
+
+    /**
+     * The number of bytes read back from the spill file since it was last
+     * emptied. Accessed only by the writer thread.
+     */
+    off_t spill_read;
+
+    /**
+     * Lock which guards waits on data_available and space_available.
+     */
+    pthread_mutex_t state_lock;
+
+    /**
+     * Condition signalled when data has been published for a writer thread
+     * that is waiting, or when the socket is being freed.
+     */
+    pthread_cond_t data_available;
+
+    /**
+     * Condition signalled when the writer thread frees space within the ring
+     * buffer for a producer that is waiting.
+     */
+    pthread_cond_t space_available;
+
+    /**
+     * Non-zero if the writer thread is waiting on data_available.
+     */
+    int writer_waiting;
+
+    /**
+     * Non-zero if the producer is waiting on space_available.
+     */
+    int producer_waiting;
+
+    /**
+     * Non-zero if the socket is being freed and the writer thread should
+     * exit once all data has been written.
+     */
+    int stopping;
+
+    /**
+     * Non-zero if writing to the recording file has failed, in which case
+     * all further data is discarded.
+     */
+    int failed;
+
+    /**
+     * The total number of bytes ever accepted by the producer, whether copied
+     * into the ring buffer or appended to the spill file, less any bytes of
+     * an instruction that was subsequently dropped. Accessed only by the
+     * producer.
+     */
+    uint64_t accepted;
+
+    /**
+     * The total number of bytes ever taken from the ring buffer or spill file
+     * by the writer thread. Accessed only by the writer thread.
+     */
+    uint64_t consumed;
+
+    /**
+     * The queue of keyframes not yet written, in order of position, or NULL
+     * if there are no such keyframes. Guarded by state_lock.
+     */
+    guac_socket_recording_keyframe_data* keyframes;
+
+    /**
+     * The last keyframe within the queue, or NULL if the queue is empty.
+     * Guarded by state_lock.
+     */
+    guac_socket_recording_keyframe_data* last_keyframe;
+
+#ifdef ENABLE_ZSTD
+    /**
+     * The zstd context used by the writer thread to compress records.
+     */
+    ZSTD_CCtx* zstd;
+#endif
+
+    /**
+     * The uncompressed protocol data of the record currently being built by
+     * the writer thread, GUAC_RECORDING_FORMAT_CHUNK_SIZE bytes in size.
+     */
+    char* chunk;
+
+    /**
+     * The number of bytes of protocol data within chunk.
+     */
+    size_t chunk_length;
+
+    /**
+     * The position within the uncompressed protocol data of the recording of
+     * the first byte within chunk.
+     */
+    uint64_t chunk_position;
+
+    /**
+     * The time at which the first byte was added to chunk.
+     */
+    guac_timestamp chunk_started;
+
+    /**
+     * The current size of the recording file, in bytes.
+     */
+    uint64_t file_offset;
+
+    /**
+     * The contents of the index record, containing one entry for each
+     * keyframe written so far.
+     */
+    unsigned char* index;
+
+    /**
+     * The number of bytes within index.
+     */
+    size_t index_length;
+
+    /**
+     * The number of bytes allocated for index.
+     */
+    size_t index_size;
+
+    /**
+     * The writer thread.
+     */
+    pthread_t writer;
+
+} guac_socket_recording_data;
+
+/**
+ * Data associated with a socket that captures a keyframe produced by
+ * guac_display_dup() for a recording socket.
+ */
+typedef struct guac_socket_recording_capture_data {
+
+    /**
+     * The data of the recording socket receiving the keyframe.
+     */
+    guac_socket_recording_data* recording;
+
+    /**
+     * The keyframe being captured, or NULL if nothing has been written yet.
+     */
+    guac_socket_recording_keyframe_data* keyframe;
+
+} guac_socket_recording_capture_data;
+
+/**
+ * Returns the number of bytes of free space within the ring buffer, from the
+ * perspective of the producer.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @return
+ *     The number of bytes which may be copied into the ring buffer without
+ *     overwriting data not yet written to the recording file.
+ */
+static size_t guac_socket_recording_space(guac_socket_recording_data* data) {
+    return GUAC_SOCKET_RECORDING_BUFFER_SIZE
+        - (data->pending - __atomic_load_n(&data->tail, __ATOMIC_SEQ_CST));
+}
+
+/**
+ * Copies the given data into the ring buffer without making it available to
+ * the writer thread. There must be at least the given number of bytes of
+ * free space within the ring buffer.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param buf
+ *     The data to copy.
+ *
+ * @param count
+ *     The number of bytes to copy.
+ */
+static void guac_socket_recording_copy(guac_socket_recording_data* data,
+        const char* buf, size_t count) {
+
+    size_t offset = data->pending & (GUAC_SOCKET_RECORDING_BUFFER_SIZE - 1);
+    size_t first = GUAC_SOCKET_RECORDING_BUFFER_SIZE - offset;
+    if (first > count)
+        first = count;
+
+    /* Copy up to end of buffer, wrapping around for the remainder */
+    memcpy(data->buffer + offset, buf, first);
+    memcpy(data->buffer, buf + first, count - first);
+
+    data->pending += count;
+    data->accepted += count;
+
+}
+
+/**
+ * Makes all data copied into the ring buffer available to the writer thread,
+ * waking the writer thread if it is waiting.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ */
+static void guac_socket_recording_publish(guac_socket_recording_data* data) {
+
+    if (data->head == data->pending)
+        return;
+
+    __atomic_store_n(&data->head, data->pending, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&data->writer_waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&data->state_lock);
+        pthread_cond_signal(&data->data_available);
+        pthread_mutex_unlock(&data->state_lock);
+    }
+
+}
+
+/**
+ * Blocks the producer until the writer thread has freed space within the
+ * ring buffer, or until writing to the recording file has failed.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ */
+static void guac_socket_recording_wait(guac_socket_recording_data* data) {
+
+    pthread_mutex_lock(&data->state_lock);
+    __atomic_store_n(&data->producer_waiting, 1, __ATOMIC_SEQ_CST);
+
+    while (guac_socket_recording_space(data) == 0
+            && !__atomic_load_n(&data->failed, __ATOMIC_SEQ_CST))
+        pthread_cond_wait(&data->space_available, &data->state_lock);
+
+    __atomic_store_n(&data->producer_waiting, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&data->state_lock);
+
+}
+
+/**
+ * Appends the given data to the spill file, creating that file if it does
+ * not yet exist. If the spill file cannot be created or written, the data is
+ * discarded.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param buf
+ *     The data to append.
+ *
+ * @param count
+ *     The number of bytes to append.
+ */
+static void guac_socket_recording_spill(guac_socket_recording_data* data,
+        const char* buf, size_t count) {
+
+    if (data->spill == NULL) {
+        data->spill = tmpfile();
+        if (data->spill == NULL)
+            return;
+    }
+
+    __atomic_store_n(&data->spilling, 1, __ATOMIC_SEQ_CST);
+
+    int spill_fd = fileno(data->spill);
+    while (count > 0) {
+
+        ssize_t written = pwrite(spill_fd, buf, count, data->spill_written);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        buf += written;
+        count -= written;
+        data->accepted += written;
+        __atomic_store_n(&data->spill_written,
+                data->spill_written + written, __ATOMIC_SEQ_CST);
+
+    }
+
+}
+
+/**
+ * Wakes the producer if it is waiting for space within the ring buffer.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ */
+static void guac_socket_recording_signal_space(
+        guac_socket_recording_data* data) {
+
+    if (__atomic_load_n(&data->producer_waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&data->state_lock);
+        pthread_cond_signal(&data->space_available);
+        pthread_mutex_unlock(&data->state_lock);
+    }
+
+}
+
+/**
+ * Writes the given data to the recording file in its entirety. If writing
+ * fails, the socket is marked as failed.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes to write.
+ */
+static void guac_socket_recording_write_fd(guac_socket_recording_data* data,
+        const char* buf, size_t count) {
+
+    while (count > 0 && !data->failed) {
+
+        ssize_t written = write(data->fd, buf, count);
+        if (written < 0) {
+            if (errno != EINTR)
+                __atomic_store_n(&data->failed, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        buf += written;
+        count -= written;
+
+    }
+
+}
+
+#ifdef ENABLE_ZSTD
+/**
+ * Writes a single record to the recording file, compressing the given data
+ * unless the record is an index. If compression fails, the socket is marked
+ * as failed.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param record
+ *     The header of the record to write. The length and decompressed_length
+ *     of this header are populated automatically.
+ *
+ * @param buf
+ *     The data of the record, prior to compression.
+ *
+ * @param length
+ *     The number of bytes of data within buf.
+ */
+static void guac_socket_recording_write_record(
+        guac_socket_recording_data* data, guac_recording_format_record* record,
+        const void* buf, size_t length) {
+
+    unsigned char header[GUAC_RECORDING_FORMAT_RECORD_HEADER_LENGTH];
+    record->decompressed_length = length;
+
+    /* The index is stored as-is */
+    if (record->type == GUAC_RECORDING_FORMAT_INDEX) {
+        record->length = length;
+        guac_recording_format_write_record(header, record);
+        guac_socket_recording_write_fd(data, (char*) header, sizeof(header));
+        guac_socket_recording_write_fd(data, buf, length);
+        data->file_offset += sizeof(header) + length;
+        return;
+    }
+
+    size_t bound = ZSTD_compressBound(length);
+    char* compressed = guac_mem_alloc(bound);
+
+    size_t compressed_length = ZSTD_compressCCtx(data->zstd, compressed, bound,
+            buf, length, GUAC_RECORDING_FORMAT_COMPRESSION_LEVEL);
+
+    if (ZSTD_isError(compressed_length))
+        __atomic_store_n(&data->failed, 1, __ATOMIC_SEQ_CST);
+
+    else {
+        record->length = compressed_length;
+        guac_recording_format_write_record(header, record);
+        guac_socket_recording_write_fd(data, (char*) header, sizeof(header));
+        guac_socket_recording_write_fd(data, compressed, compressed_length);
+        data->file_offset += sizeof(header) + compressed_length;
+    }
+
+    guac_mem_free(compressed);
+
+}
+
+/**
+ * Writes all protocol data within the current chunk as a single data
+ * record, if the chunk is non-empty.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ */
+static void guac_socket_recording_flush_chunk(guac_socket_recording_data* data) {
+
+    if (data->chunk_length == 0)
+        return;
+
+    guac_recording_format_record record = {
+        .type = GUAC_RECORDING_FORMAT_DATA,
+        .position = data->chunk_position
+    };
+
+    guac_socket_recording_write_record(data, &record, data->chunk,
+            data->chunk_length);
+
+    data->chunk_length = 0;
+
+}
+
+/**
+ * Returns whether the first queued keyframe is associated with the current
+ * position of the writer thread. The state_lock must already be held.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @return
+ *     Non-zero if the first queued keyframe must be written before any
+ *     further protocol data, zero otherwise.
+ */
+static int guac_socket_recording_keyframe_due(guac_socket_recording_data* data) {
+    return data->keyframes != NULL
+        && data->keyframes->position == data->consumed;
+}
+
+/**
+ * Writes each queued keyframe associated with the current position of the
+ * writer thread, preceded by any protocol data that came before that
+ * position, such that the following data record begins exactly where the
+ * keyframe applies.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param wait
+ *     Non-zero if this function should wait for any such keyframe that is
+ *     still being produced, zero if such keyframes should be left queued.
+ */
+static void guac_socket_recording_write_keyframes(
+        guac_socket_recording_data* data, int wait) {
+
+    for (;;) {
+
+        pthread_mutex_lock(&data->state_lock);
+
+        while (wait && guac_socket_recording_keyframe_due(data)
+                && !data->keyframes->ready)
+            pthread_cond_wait(&data->data_available, &data->state_lock);
+
+        /* Stop once there is no keyframe which can be written now */
+        guac_socket_recording_keyframe_data* keyframe = data->keyframes;
+        if (!guac_socket_recording_keyframe_due(data) || !keyframe->ready) {
+            pthread_mutex_unlock(&data->state_lock);
+            return;
+        }
+
+        data->keyframes = keyframe->next;
+        if (data->keyframes == NULL)
+            data->last_keyframe = NULL;
+
+        pthread_mutex_unlock(&data->state_lock);
+
+        guac_socket_recording_flush_chunk(data);
+
+        /* Add keyframe to index */
+        if (data->index_length + GUAC_RECORDING_FORMAT_INDEX_ENTRY_LENGTH
+                > data->index_size) {
+            size_t old_size = data->index_size;
+            data->index_size = guac_mem_ckd_mul_or_die(
+                    data->index_size + GUAC_RECORDING_FORMAT_INDEX_ENTRY_LENGTH, 2);
+            data->index = guac_mem_realloc_or_die(data->index, data->index_size);
+            guac_socket_recording_account(data,
+                    (int64_t) data->index_size - (int64_t) old_size);
+        }
+
+        guac_recording_format_write_uint64(data->index + data->index_length,
+                keyframe->timestamp);
+        guac_recording_format_write_uint64(data->index + data->index_length + 8,
+                data->file_offset);
+        data->index_length += GUAC_RECORDING_FORMAT_INDEX_ENTRY_LENGTH;
+
+        guac_recording_format_record record = {
+            .type = GUAC_RECORDING_FORMAT_KEYFRAME,
+            .timestamp = keyframe->timestamp,
+            .position = keyframe->position
+        };
+
+        guac_socket_recording_write_record(data, &record, keyframe->buffer,
+                keyframe->length);
+
+        guac_mem_free(keyframe->buffer);
+        guac_mem_free(keyframe);
+
+    }
+
+}
+
+/**
+ * Writes the header at the beginning of a compressed recording.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ */
+static void guac_socket_recording_write_header(guac_socket_recording_data* data) {
+
+    unsigned char header[GUAC_RECORDING_FORMAT_HEADER_LENGTH];
+
+    memcpy(header, GUAC_RECORDING_FORMAT_MAGIC,
+            GUAC_RECORDING_FORMAT_MAGIC_LENGTH);
+    guac_recording_format_write_uint32(header + 8,
+            GUAC_RECORDING_FORMAT_VERSION);
+    guac_recording_format_write_uint64(header + 12,
+            guac_timestamp_current());
+
+    guac_socket_recording_write_fd(data, (char*) header, sizeof(header));
+    data->file_offset += sizeof(header);
+
+}
+
+/**
+ * Writes all remaining data of a compressed recording, followed by the index
+ * of all keyframes and the trailer.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ */
+static void guac_socket_recording_write_index(guac_socket_recording_data* data) {
+
+    unsigned char trailer[GUAC_RECORDING_FORMAT_TRAILER_LENGTH];
+
+    guac_socket_recording_write_keyframes(data, 1);
+    guac_socket_recording_flush_chunk(data);
+
+    uint64_t index_offset = data->file_offset;
+
+    guac_recording_format_record record = {
+        .type = GUAC_RECORDING_FORMAT_INDEX,
+        .position = data->consumed
+    };
+
+    guac_socket_recording_write_record(data, &record, data->index,
+            data->index_length);
+
+    guac_recording_format_write_uint64(trailer, index_offset);
+    memcpy(trailer + 8, GUAC_RECORDING_FORMAT_TRAILER_MAGIC,
+            GUAC_RECORDING_FORMAT_MAGIC_LENGTH);
+
+    guac_socket_recording_write_fd(data, (char*) trailer, sizeof(trailer));
+
+}
+#endif
+
+/**
+ * Handles protocol data taken from the ring buffer or spill file by the
+ * writer thread, writing that data to the recording file either directly or
+ * within compressed records, depending on the format of the recording.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param buf
+ *     The protocol data to write.
+ *
+ * @param length
+ *     The number of bytes of protocol data to write.
+ */
+static void guac_socket_recording_output(guac_socket_recording_data* data,
+        const char* buf, size_t length) {
+
+#ifdef ENABLE_ZSTD
+    if (data->format == GUAC_RECORDING_FORMAT_COMPRESSED) {
+
+        while (length > 0) {
+
+            /* Keyframes must land exactly between the data preceding and
+             * following the point where they were produced */
+            guac_socket_recording_write_keyframes(data, 1);
+
+            size_t available = length;
+
+            pthread_mutex_lock(&data->state_lock);
+            if (data->keyframes != NULL
+                    && data->keyframes->position - data->consumed < available)
+                available = data->keyframes->position - data->consumed;
+            pthread_mutex_unlock(&data->state_lock);
+
+            if (available > GUAC_RECORDING_FORMAT_CHUNK_SIZE - data->chunk_length)
+                available = GUAC_RECORDING_FORMAT_CHUNK_SIZE - data->chunk_length;
+
+            if (data->chunk_length == 0) {
+                data->chunk_position = data->consumed;
+                data->chunk_started = guac_timestamp_current();
+            }
+
+            memcpy(data->chunk + data->chunk_length, buf, available);
+            data->chunk_length += available;
+            data->consumed += available;
+            buf += available;
+            length -= available;
+
+            if (data->chunk_length == GUAC_RECORDING_FORMAT_CHUNK_SIZE)
+                guac_socket_recording_flush_chunk(data);
+
+        }
+
+        return;
+
+    }
+#endif
+
+    guac_socket_recording_write_fd(data, buf, length);
+    data->consumed += length;
+
+}
+
+/**
+ * Drains the spill file to the recording file, returning to use of the ring
+ * buffer once the spill file has been fully drained. This function is called
+ * by the writer thread only while the ring buffer is empty.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param block
+ *     A buffer of GUAC_SOCKET_RECORDING_WRITE_SIZE bytes which may be used to
+ *     read data back from the spill file.
+ */
+static void guac_socket_recording_drain_spill(guac_socket_recording_data* data,
+        char* block) {
+
+    off_t written = __atomic_load_n(&data->spill_written, __ATOMIC_SEQ_CST);
+
+    /* Copy any unread spilled data to the recording file */
+    if (data->spill_read < written) {
+
+        size_t length = written - data->spill_read;
+        if (length > GUAC_SOCKET_RECORDING_WRITE_SIZE)
+            length = GUAC_SOCKET_RECORDING_WRITE_SIZE;
+
+        ssize_t retval = pread(fileno(data->spill), block, length,
+                data->spill_read);
+
+        if (retval > 0) {
+            guac_socket_recording_output(data, block, retval);
+            data->spill_read += retval;
+        }
+
+        /* Give up on the spilled data entirely if it cannot be read */
+        else if (retval < 0 && errno != EINTR)
+            __atomic_store_n(&data->failed, 1, __ATOMIC_SEQ_CST);
+
+        if (!data->failed)
+            return;
+
+    }
+
+    /* Otherwise, resume use of the ring buffer if the producer has not
+     * spilled anything further in the meantime */
+    pthread_mutex_lock(&data->socket_lock);
+
+    /* The spill file is reused from the beginning next time, with any stale
+     * data beyond spill_written never being read */
+    if (data->failed || data->spill_read == data->spill_written) {
+        data->spill_written = 0;
+        data->spill_read = 0;
+        __atomic_store_n(&data->spilling, 0, __ATOMIC_SEQ_CST);
+    }
+
+    pthread_mutex_unlock(&data->socket_lock);
+
+}
+
+/**
+ * The writer thread of a recording socket, copying data from the ring buffer
+ * and spill file to the recording file until the socket is freed.
+ *
+ * @param arg
+ *     The data associated with the recording socket.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_socket_recording_writer(void* arg) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) arg;
+    char* block = guac_mem_alloc(GUAC_SOCKET_RECORDING_WRITE_SIZE);
+
+#ifdef ENABLE_ZSTD
+    if (data->format == GUAC_RECORDING_FORMAT_COMPRESSED)
+        guac_socket_recording_write_header(data);
+#endif
+
+    for (;;) {
+
+        size_t head = __atomic_load_n(&data->head, __ATOMIC_SEQ_CST);
+
+        /* Write any data available within the ring buffer */
+        if (head != data->tail) {
+
+            size_t offset = data->tail & (GUAC_SOCKET_RECORDING_BUFFER_SIZE - 1);
+            size_t length = head - data->tail;
+
+            if (length > GUAC_SOCKET_RECORDING_BUFFER_SIZE - offset)
+                length = GUAC_SOCKET_RECORDING_BUFFER_SIZE - offset;
+
+            if (length > GUAC_SOCKET_RECORDING_WRITE_SIZE)
+                length = GUAC_SOCKET_RECORDING_WRITE_SIZE;
+
+            /* Data is released once written, or discarded upon failure */
+            guac_socket_recording_output(data, data->buffer + offset, length);
+            __atomic_store_n(&data->tail, data->tail + length,
+                    __ATOMIC_SEQ_CST);
+
+            guac_socket_recording_signal_space(data);
+            continue;
+
+        }
+
+        /* Move on to spilled data only once the ring buffer is empty, as
+         * everything within the ring buffer was written before the spill */
+        if (__atomic_load_n(&data->spilling, __ATOMIC_SEQ_CST)) {
+
+            /* The producer publishes to the ring buffer before it begins
+             * spilling, so anything published since head was read above
+             * must be written first */
+            if (__atomic_load_n(&data->head, __ATOMIC_SEQ_CST) != data->tail)
+                continue;
+
+            guac_socket_recording_drain_spill(data, block);
+            continue;
+        }
+
+#ifdef ENABLE_ZSTD
+        /* Write any keyframes completed while idle */
+        if (data->format == GUAC_RECORDING_FORMAT_COMPRESSED)
+            guac_socket_recording_write_keyframes(data, 0);
+#endif
+
+        /* Wait for further data, exiting only once everything written prior
+         * to the socket being freed has been written */
+        pthread_mutex_lock(&data->state_lock);
+        __atomic_store_n(&data->writer_waiting, 1, __ATOMIC_SEQ_CST);
+
+        /* Data within a partial chunk is written after a limited time, even
+         * if no further data arrives */
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += GUAC_SOCKET_RECORDING_CHUNK_DURATION / 1000;
+
+        int timed_out = 0;
+        while (__atomic_load_n(&data->head, __ATOMIC_SEQ_CST) == data->tail
+                && !__atomic_load_n(&data->spilling, __ATOMIC_SEQ_CST)
+                && !data->stopping && !timed_out) {
+
+            if (data->chunk_length == 0 && !data->keyframes)
+                pthread_cond_wait(&data->data_available, &data->state_lock);
+
+            else
+                timed_out = pthread_cond_timedwait(&data->data_available,
+                        &data->state_lock, &deadline) != 0;
+
+        }
+
+        __atomic_store_n(&data->writer_waiting, 0, __ATOMIC_SEQ_CST);
+
+        int done = data->stopping
+            && __atomic_load_n(&data->head, __ATOMIC_SEQ_CST) == data->tail
+            && !__atomic_load_n(&data->spilling, __ATOMIC_SEQ_CST);
+
+        pthread_mutex_unlock(&data->state_lock);
+
+        if (done)
+            break;
+
+#ifdef ENABLE_ZSTD
+        if (timed_out)
+            guac_socket_recording_flush_chunk(data);
+#endif
+
+    }
+
+#ifdef ENABLE_ZSTD
+    if (data->format == GUAC_RECORDING_FORMAT_COMPRESSED)
+        guac_socket_recording_write_index(data);
+#endif
+
+    guac_mem_free(block);
+    return NULL;
+
+}
+
+static ssize_t guac_socket_recording_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_recording_data* data =
+        (guac_socket_recording_data*) socket->data;
+
+    const char* current = (const char*) buf;
+    size_t remaining = count;
+
+    pthread_mutex_lock(&data->socket_lock);
+
+    /* Discard data that can no longer be written, including the remainder
+     * of any instruction that has already been partially dropped */
+    if (__atomic_load_n(&data->failed, __ATOMIC_SEQ_CST) || data->dropping)
+        remaining = 0;
+
+    /* Once spilling, all data must be spilled to preserve ordering */
+    else if (__atomic_load_n(&data->spilling, __ATOMIC_SEQ_CST)) {
+        guac_socket_recording_spill(data, current, remaining);
+        remaining = 0;
+    }
+
+    while (remaining > 0) {
+
+        /* Copy as much as possible into the ring buffer */
+        size_t space = guac_socket_recording_space(data);
+        if (remaining <= space) {
+            guac_socket_recording_copy(data, current, remaining);
+            break;
+        }
+
+        /* Wait for the writer thread to make room */
+        if (data->overflow == GUAC_RECORDING_OVERFLOW_BLOCK) {
+
+            guac_socket_recording_copy(data, current, space);
+            current += space;
+            remaining -= space;
+
+            guac_socket_recording_publish(data);
+            guac_socket_recording_wait(data);
+
+            if (__atomic_load_n(&data->failed, __ATOMIC_SEQ_CST))
+                break;
+
+        }
+
+        /* Discard the entire instruction, including anything already copied
+         * into the ring buffer but not yet published */
+        else if (data->overflow == GUAC_RECORDING_OVERFLOW_DROP) {
+            data->accepted -= data->pending - data->head;
+            data->pending = data->head;
+            data->dropping = (data->in_instruction > 0);
+            break;
+        }
+
+        /* Append this and all further data to the spill file until the
+         * writer thread has caught up */
+        else {
+            guac_socket_recording_publish(data);
+            guac_socket_recording_spill(data, current, remaining);
+            break;
+        }
+
+    }
+
+    /* Data written outside of an instruction is complete as-is */
+    if (data->in_instruction == 0)
+        guac_socket_recording_publish(data);
+
+    pthread_mutex_unlock(&data->socket_lock);
+    return count;
+
+}
+
+static ssize_t guac_socket_recording_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    /* Recordings are write-only */
+    return 0;
+
+}
+
+static int guac_socket_recording_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    /* Recordings are write-only */
+    return 0;
+
+}
+
+static ssize_t guac_socket_recording_flush_handler(guac_socket* socket) {
+
+    /* All complete data is published as soon as it is written, and is
+     * written to the recording file asynchronously */
+    return 0;
+
+}
+
+static void guac_socket_recording_lock_handler(guac_socket* socket) {
+
+    guac_socket_recording_data* data =
+        (guac_socket_recording_data*) socket->data;
+
+    pthread_mutex_lock(&data->socket_lock);
+    data->in_instruction++;
+
+}
+
+static void guac_socket_recording_unlock_handler(guac_socket* socket) {
+
+    guac_socket_recording_data* data =
+        (guac_socket_recording_data*) socket->data;
+
+    /* Make the instruction available to the writer thread once complete */
+    if (--data->in_instruction == 0) {
+        data->dropping = 0;
+        guac_socket_recording_publish(data);
+    }
+
+    pthread_mutex_unlock(&data->socket_lock);
+
+}
+
+/**
+ * Attributes the given change in allocated memory to the guac_client
+ * associated with the given recording socket data, if any.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param delta
+ *     The number of bytes allocated, or the negated number of bytes freed.
+ */
+static void guac_socket_recording_account(guac_socket_recording_data* data,
+        int64_t delta) {
+
+    if (data->client != NULL)
+        guac_client_account_memory(data->client, GUAC_CLIENT_MEMORY_RECORDING,
+                delta);
+
+}
+
+/**
+ * Returns the number of bytes allocated for the long-lived buffers of the
+ * given recording socket data: the ring buffer, the compressed chunk
+ * (if any), and the keyframe index.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @return
+ *     The number of bytes allocated for the buffers of the given data.
+ */
+static size_t guac_socket_recording_memory(guac_socket_recording_data* data) {
+
+    size_t memory = GUAC_SOCKET_RECORDING_BUFFER_SIZE + data->index_size;
+
+    if (data->chunk != NULL)
+        memory += GUAC_RECORDING_FORMAT_CHUNK_SIZE;
+
+    return memory;
+
+}
+
+/**
+ * Releases all resources associated with the given recording socket data,
+ * other than the writer thread and file descriptor.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ */
+static void guac_socket_recording_free_data(guac_socket_recording_data* data) {
+
+    guac_socket_recording_account(data,
+            -(int64_t) guac_socket_recording_memory(data));
+
+    /* Free any keyframes that were never written */
+    guac_socket_recording_keyframe_data* keyframe = data->keyframes;
+    while (keyframe != NULL) {
+        guac_socket_recording_keyframe_data* next = keyframe->next;
+        guac_mem_free(keyframe->buffer);
+        guac_mem_free(keyframe);
+        keyframe = next;
+    }
+
+#ifdef ENABLE_ZSTD
+    if (data->zstd != NULL)
+        ZSTD_freeCCtx(data->zstd);
+#endif
+
+    pthread_cond_destroy(&(data->space_available));
+    pthread_cond_destroy(&(data->data_available));
+    pthread_mutex_destroy(&(data->state_lock));
+    pthread_mutex_destroy(&(data->socket_lock));
+
+    guac_mem_free(data->index);
+    guac_mem_free(data->chunk);
+    guac_mem_free(data->buffer);
+    guac_mem_free(data);
+
+}
+
+static int guac_socket_recording_free_handler(guac_socket* socket) {
+
+    guac_socket_recording_data* data =
+        (guac_socket_recording_data*) socket->data;
+
+    /* Wait for all written data to reach the recording file */
+    pthread_mutex_lock(&data->state_lock);
+    data->stopping = 1;
+    pthread_cond_signal(&data->data_available);
+    pthread_mutex_unlock(&data->state_lock);
+
+    pthread_join(data->writer, NULL);
+
+    if (data->spill != NULL)
+        fclose(data->spill);
+
+    close(data->fd);
+
+    guac_socket_recording_free_data(data);
+    return 0;
+
+}
+
+guac_socket* guac_socket_open_recording(guac_client* client, int fd,
+        guac_recording_overflow overflow, guac_recording_format format) {
+
+    pthread_mutexattr_t lock_attributes;
+
+    guac_socket_recording_data* data =
+        guac_mem_zalloc(sizeof(guac_socket_recording_data));
+
+    data->client = client;
+    data->fd = fd;
+    data->overflow = overflow;
+    data->format = GUAC_RECORDING_FORMAT_RAW;
+    data->buffer = guac_mem_alloc(GUAC_SOCKET_RECORDING_BUFFER_SIZE);
+
+    pthread_mutexattr_init(&lock_attributes);
+    pthread_mutexattr_settype(&lock_attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&(data->socket_lock), &lock_attributes);
+    pthread_mutexattr_destroy(&lock_attributes);
+
+    pthread_mutex_init(&(data->state_lock), NULL);
+    pthread_cond_init(&(data->data_available), NULL);
+    pthread_cond_init(&(data->space_available), NULL);
+
+#ifdef ENABLE_ZSTD
+    /* Allocate everything needed to build compressed records */
+    if (format == GUAC_RECORDING_FORMAT_COMPRESSED) {
+
+        data->zstd = ZSTD_createCCtx();
+        if (data->zstd == NULL) {
+            guac_socket_recording_free_data(data);
+            return NULL;
+        }
+
+        data->format = GUAC_RECORDING_FORMAT_COMPRESSED;
+        data->chunk = guac_mem_alloc(GUAC_RECORDING_FORMAT_CHUNK_SIZE);
+
+    }
+#endif
+
+    guac_socket_recording_account(data, guac_socket_recording_memory(data));
+
+    /* Start writer thread */
+    if (pthread_create(&(data->writer), NULL,
+                guac_socket_recording_writer, data)) {
+        guac_socket_recording_free_data(data);
+        return NULL;
+    }
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = data;
+
+    socket->read_handler   = guac_socket_recording_read_handler;
+    socket->write_handler  = guac_socket_recording_write_handler;
+    socket->select_handler = guac_socket_recording_select_handler;
+    socket->flush_handler  = guac_socket_recording_flush_handler;
+    socket->lock_handler   = guac_socket_recording_lock_handler;
+    socket->unlock_handler = guac_socket_recording_unlock_handler;
+    socket->free_handler   = guac_socket_recording_free_handler;
+
+    return socket;
+
+}
+
+/**
+ * Queues a new keyframe for the recording socket with the given data,
+ * associated with the current position of the producer. The socket lock of
+ * the recording socket is acquired to determine that position, such that the
+ * keyframe is never associated with a point in the middle of an instruction.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @return
+ *     The newly-queued keyframe, which is not yet ready to be written.
+ */
+static guac_socket_recording_keyframe_data* guac_socket_recording_queue_keyframe(
+        guac_socket_recording_data* data) {
+
+    guac_socket_recording_keyframe_data* keyframe =
+        guac_mem_zalloc(sizeof(guac_socket_recording_keyframe_data));
+
+    pthread_mutex_lock(&(data->socket_lock));
+
+    keyframe->position = data->accepted;
+    keyframe->timestamp = guac_timestamp_current();
+
+    pthread_mutex_lock(&(data->state_lock));
+
+    if (data->last_keyframe != NULL)
+        data->last_keyframe->next = keyframe;
+    else
+        data->keyframes = keyframe;
+
+    data->last_keyframe = keyframe;
+
+    pthread_mutex_unlock(&(data->state_lock));
+    pthread_mutex_unlock(&(data->socket_lock));
+
+    return keyframe;
+
+}
+
+static ssize_t guac_socket_recording_capture_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_recording_capture_data* capture =
+        (guac_socket_recording_capture_data*) socket->data;
+
+    /* guac_display_dup() writes nothing until it has waited for any frame in
+     * progress to finish, and holds off any new frame until it returns, so
+     * the first write marks exactly where the captured state is current */
+    guac_socket_recording_keyframe_data* keyframe = capture->keyframe;
+    if (keyframe == NULL)
+        keyframe = capture->keyframe =
+            guac_socket_recording_queue_keyframe(capture->recording);
+
+    /* Grow buffer as necessary to contain all captured data */
+    if (keyframe->length + count > keyframe->size) {
+        keyframe->size = guac_mem_ckd_mul_or_die(keyframe->length + count, 2);
+        keyframe->buffer = guac_mem_realloc_or_die(keyframe->buffer,
+                keyframe->size);
+    }
+
+    memcpy(keyframe->buffer + keyframe->length, buf, count);
+    keyframe->length += count;
+
+    return count;
+
+}
+
+static int guac_socket_recording_capture_free_handler(guac_socket* socket) {
+
+    guac_socket_recording_capture_data* capture =
+        (guac_socket_recording_capture_data*) socket->data;
+
+    guac_socket_recording_data* data = capture->recording;
+
+    /* Release the completed keyframe to the writer thread */
+    if (capture->keyframe != NULL) {
+        pthread_mutex_lock(&(data->state_lock));
+        capture->keyframe->ready = 1;
+        pthread_cond_signal(&(data->data_available));
+        pthread_mutex_unlock(&(data->state_lock));
+    }
+
+    guac_mem_free(capture);
+    return 0;
+
+}
+
+void guac_socket_recording_keyframe(guac_socket* socket,
+        guac_display* display) {
+
+    guac_socket_recording_data* data =
+        (guac_socket_recording_data*) socket->data;
+
+    /* Keyframes are meaningful only within compressed recordings */
+    if (data->format != GUAC_RECORDING_FORMAT_COMPRESSED)
+        return;
+
+    guac_socket_recording_capture_data* capture =
+        guac_mem_zalloc(sizeof(guac_socket_recording_capture_data));
+    capture->recording = data;
+
+    guac_socket* capture_socket = guac_socket_alloc();
+    capture_socket->data = capture;
+    capture_socket->write_handler = guac_socket_recording_capture_write_handler;
+    capture_socket->free_handler  = guac_socket_recording_capture_free_handler;
+
+    guac_display_dup(display, capture_socket);
+    guac_socket_free(capture_socket);
+
+}
+
@@ -0,0 +1,116 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_SOCKET_RECORDING_H
+#define GUAC_SOCKET_RECORDING_H
+
+/**
+ * A guac_socket implementation which writes to a session recording file
+ * asynchronously. Data written to the socket is copied into a ring buffer
+ * from which a dedicated writer thread drains data to the recording file,
+ * such that the latency of writing to the recording file (which may reside
+ * on slow or remote storage) is never added to the latency of the session
+ * itself.
+ *
+ * @file socket-recording.h
+ */
+
+#include "guacamole/client-types.h"
+#include "guacamole/display-types.h"
+#include "guacamole/recording.h"
+#include "guacamole/socket-types.h"
+
+#include <stddef.h>
+
+/**
+ * The number of bytes of data which may be buffered in memory for a
+ * recording socket before the overflow behavior of that socket takes effect.
+ * This value MUST be a power of two.
+ */
+#define GUAC_SOCKET_RECORDING_BUFFER_SIZE 4194304
+
+/**
+ * The maximum number of bytes of data written to the recording file by a
+ * single call to write() from the writer thread.
+ */
+#define GUAC_SOCKET_RECORDING_WRITE_SIZE 65536
+
+/**
+ * The maximum number of milliseconds that protocol data may remain buffered
+ * within a partially-filled chunk of a compressed recording while the writer
+ * thread is otherwise idle.
+ */
+#define GUAC_SOCKET_RECORDING_CHUNK_DURATION 1000
+
+/**
+ * Opens a new guac_socket which writes to the given file descriptor in the
+ * background, buffering up to GUAC_SOCKET_RECORDING_BUFFER_SIZE bytes in
+ * memory. If that buffer fills, the given overflow behavior determines
+ * whether writes block, whole instructions are dropped, or data spills to a
+ * temporary file until the writer thread catches up. Freeing the returned
+ * socket waits for all data written to reach the file descriptor, and then
+ * closes that file descriptor.
+ *
+ * If the compressed format is requested, the writer thread also compresses
+ * the written data, producing the container described by
+ * recording-format.h, such that compression never adds to the latency of
+ * the session.
+ *
+ * @param client
+ *     The guac_client to which the memory allocated by the returned socket
+ *     should be attributed, or NULL if that memory should not be attributed
+ *     to any client.
+ *
+ * @param fd
+ *     The file descriptor of the recording file.
+ *
+ * @param overflow
+ *     The behavior to use when data is written faster than it can be
+ *     written to the recording file.
+ *
+ * @param format
+ *     The format of the recording file. GUAC_RECORDING_FORMAT_COMPRESSED may
+ *     only be used if libguac was built with zstd support.
+ *
+ * @return
+ *     A newly-allocated guac_socket which writes to the given file descriptor
+ *     asynchronously, or NULL if the writer thread cannot be started.
+ */
+guac_socket* guac_socket_open_recording(guac_client* client, int fd,
+        guac_recording_overflow overflow, guac_recording_format format);
+
+/**
+ * Writes a keyframe containing the current state of the given display to the
+ * given recording socket, which must have been opened with
+ * guac_socket_open_recording() using GUAC_RECORDING_FORMAT_COMPRESSED. The
+ * keyframe is produced using guac_display_dup(), and is associated with the
+ * exact point in the recorded protocol data at which that state was current.
+ *
+ * @param socket
+ *     The recording socket that should receive the keyframe.
+ *
+ * @param display
+ *     The display whose current state should be written.
+ */
+void guac_socket_recording_keyframe(guac_socket* socket,
+        guac_display* display);
+
+#endif
+
@@ -27,6 +27,7 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <openssl/ssl.h>
 
@@ -183,3 +184,32 @@ guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd) {
 
 }
 
+int guac_socket_ssl_offload(guac_socket* socket) {
+
+#ifdef SSL_OP_ENABLE_KTLS
+    guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
+
+    /* Both directions must be handled by the kernel */
+    if (!BIO_get_ktls_send(SSL_get_wbio(data->ssl))
+            || !BIO_get_ktls_recv(SSL_get_rbio(data->ssl)))
+        return -1;
+
+    /* Data already decrypted by OpenSSL would otherwise be lost */
+    if (SSL_has_pending(data->ssl))
+        return -1;
+
+    int fd = dup(data->fd);
+    if (fd < 0)
+        return -1;
+
+    /* The TLS session continues through the new file descriptor, and must
+     * not be ended when the guac_socket is freed */
+    SSL_set_quiet_shutdown(data->ssl, 1);
+
+    return fd;
+#else
+    /* kTLS is not supported by this version of OpenSSL */
+    return -1;
+#endif
+
+}
@@ -0,0 +1,870 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "guacamole/error.h"
+#include "guacamole/mem.h"
+#include "guacamole/socket.h"
+#include "guacamole/socket-uring.h"
+
+#include <errno.h>
+#include <liburing.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/**
+ * The ID of the group of provided buffers used for received data. As each
+ * socket has its own io_uring instance for receiving data, the same ID may
+ * be used by all sockets.
+ */
+#define GUAC_SOCKET_URING_BUFFER_GROUP 0
+
+/**
+ * The number of submission queue entries of the io_uring instance used for
+ * sending data. At most two sends are ever submitted at once: one for the
+ * output buffer and one for data written directly.
+ */
+#define GUAC_SOCKET_URING_SEND_ENTRIES 2
+
+/**
+ * The number of submission queue entries of the io_uring instance used for
+ * receiving data. Only a single multishot receive is ever submitted.
+ */
+#define GUAC_SOCKET_URING_RECV_ENTRIES 2
+
+/**
+ * Data associated with an open socket which performs all I/O on a file
+ * descriptor through io_uring. Sending and receiving each have their own
+ * io_uring instance, as data is typically sent and received by different
+ * threads, and an io_uring instance may only be safely used by one thread at
+ * a time.
+ */
+typedef struct guac_socket_uring_data {
+
+    /**
+     * The associated file descriptor.
+     */
+    int fd;
+
+    /**
+     * The io_uring instance used for sending data. This instance may only be
+     * used while the buffer lock is held.
+     */
+    struct io_uring send_ring;
+
+    /**
+     * Whether the output buffer has been registered with send_ring as fixed
+     * buffer 0. If registration fails, such as due to resource limits, the
+     * output buffer is sent like any other buffer.
+     */
+    int fixed;
+
+    /**
+     * The io_uring instance used for receiving data. This instance is only
+     * used by the thread reading from the socket.
+     */
+    struct io_uring recv_ring;
+
+    /**
+     * The ring through which buffers for received data are provided to the
+     * kernel.
+     */
+    struct io_uring_buf_ring* recv_buffer_ring;
+
+    /**
+     * Storage for all GUAC_SOCKET_URING_RECV_BUFFERS buffers provided to the
+     * kernel, each GUAC_SOCKET_URING_RECV_BUFFER_SIZE bytes, contiguously.
+     */
+    char* recv_buffers;
+
+    /**
+     * Whether the multishot receive is currently armed. The kernel disarms
+     * a multishot receive if it runs out of provided buffers or encounters
+     * an error, in which case it must be submitted again.
+     */
+    int recv_armed;
+
+    /**
+     * Whether the remote end of the socket has closed the connection, such
+     * that all further reads should return zero.
+     */
+    int recv_closed;
+
+    /**
+     * The ID of the provided buffer containing data received but not yet
+     * read, if recv_length is non-zero.
+     */
+    int recv_buffer;
+
+    /**
+     * The first byte of received data not yet read.
+     */
+    char* recv_current;
+
+    /**
+     * The number of bytes of received data not yet read.
+     */
+    size_t recv_length;
+
+    /**
+     * The number of bytes currently in the main write buffer.
+     */
+    size_t written;
+
+    /**
+     * The size of the main write buffer, in bytes.
+     */
+    size_t size;
+
+    /**
+     * The main write buffer. Bytes written go here before being sent.
+     */
+    char* out_buf;
+
+    /**
+     * Lock which is acquired when an instruction is being written, and
+     * released when the instruction is finished being written.
+     */
+    pthread_mutex_t socket_lock;
+
+    /**
+     * Lock which protects access to the internal buffer of this socket, as
+     * well as send_ring, guaranteeing atomicity of writes and flushes.
+     */
+    pthread_mutex_t buffer_lock;
+
+} guac_socket_uring_data;
+
+/**
+ * Sends the entire contents of each of the given buffers, in order, to the
+ * file descriptor associated with the given socket. All buffers are
+ * submitted together as a single chain of linked sends, and are resubmitted
+ * only if a send completes partially. This function must ONLY be called if
+ * the buffer lock has already been acquired.
+ *
+ * @param data
+ *     The data of the socket to send through.
+ *
+ * @param iov
+ *     The buffers to send. The contents of this array are modified as data
+ *     is sent.
+ *
+ * @param count
+ *     The number of buffers within iov, which may be no greater than
+ *     GUAC_SOCKET_URING_SEND_ENTRIES.
+ *
+ * @return
+ *     Zero if all data was sent successfully, or a negative value if an
+ *     error occurs.
+ */
+static int guac_socket_uring_send(guac_socket_uring_data* data,
+        struct iovec* iov, int count) {
+
+    /* Skip any buffers that are already empty */
+    while (count > 0 && iov->iov_len == 0) {
+        iov++;
+        count--;
+    }
+
+    while (count > 0) {
+
+        /* Queue a send for each remaining buffer, linked such that each
+         * begins only after the previous has completed */
+        for (int i = 0; i < count; i++) {
+
+            struct io_uring_sqe* sqe = io_uring_get_sqe(&data->send_ring);
+            char* base = iov[i].iov_base;
+
+            /* Use the registered copy of the output buffer where possible */
+            if (data->fixed && base >= data->out_buf
+                    && base < data->out_buf + data->size)
+                io_uring_prep_write_fixed(sqe, data->fd, base,
+                        iov[i].iov_len, 0, 0);
+            else
+                io_uring_prep_write(sqe, data->fd, base, iov[i].iov_len, 0);
+
+            io_uring_sqe_set_data64(sqe, i);
+            if (i < count - 1)
+                sqe->flags |= IOSQE_IO_LINK;
+
+        }
+
+        int retval = io_uring_submit_and_wait(&data->send_ring, count);
+        if (retval < 0) {
+            errno = -retval;
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error submitting data to socket";
+            return -1;
+        }
+
+        /* Advance each buffer by the amount sent. A partial send cancels
+         * any sends linked after it, which are simply resubmitted. */
+        int error = 0;
+        for (int i = 0; i < count; i++) {
+
+            struct io_uring_cqe* cqe;
+            retval = io_uring_wait_cqe(&data->send_ring, &cqe);
+            if (retval < 0) {
+                errno = -retval;
+                guac_error = GUAC_STATUS_SEE_ERRNO;
+                guac_error_message = "Error awaiting completion of write to socket";
+                return -1;
+            }
+
+            int index = io_uring_cqe_get_data64(cqe);
+            int result = cqe->res;
+            io_uring_cqe_seen(&data->send_ring, cqe);
+
+            if (result > 0) {
+                iov[index].iov_base = (char*) iov[index].iov_base + result;
+                iov[index].iov_len -= result;
+            }
+            else if (result < 0 && result != -ECANCELED && error == 0)
+                error = -result;
+
+        }
+
+        /* Record errors in guac_error only after all completions have been
+         * consumed, such that the next send begins with an empty queue */
+        if (error) {
+            errno = error;
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error writing data to socket";
+            return -1;
+        }
+
+        /* Drop all completely-sent buffers */
+        while (count > 0 && iov->iov_len == 0) {
+            iov++;
+            count--;
+        }
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Sends the contents of the output buffer of the given socket immediately,
+ * without first locking access to the output buffer. This function must ONLY
+ * be called if the buffer lock has already been acquired.
+ *
+ * @param socket
+ *     The guac_socket to flush.
+ *
+ * @return
+ *     Zero if the flush operation was successful, non-zero otherwise.
+ */
+static ssize_t guac_socket_uring_flush(guac_socket* socket) {
+
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+
+    struct iovec iov = { .iov_base = data->out_buf, .iov_len = data->written };
+    if (guac_socket_uring_send(data, &iov, 1))
+        return 1;
+
+    data->written = 0;
+    return 0;
+
+}
+
+/**
+ * Flushes the internal buffer of the given guac_socket, sending all data
+ * through the underlying file descriptor.
+ *
+ * @param socket
+ *     The guac_socket to flush.
+ *
+ * @return
+ *     Zero if the flush operation was successful, non-zero otherwise.
+ */
+static ssize_t guac_socket_uring_flush_handler(guac_socket* socket) {
+
+    int retval;
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+
+    /* Acquire exclusive access to buffer */
+    pthread_mutex_lock(&(data->buffer_lock));
+
+    /* Flush contents of buffer */
+    retval = guac_socket_uring_flush(socket);
+
+    /* Relinquish exclusive access to buffer */
+    pthread_mutex_unlock(&(data->buffer_lock));
+
+    return retval;
+
+}
+
+/**
+ * Writes the contents of the buffer to the output buffer of the given socket,
+ * flushing the output buffer as necessary, without first locking access to the
+ * output buffer. This function must ONLY be called if the buffer lock has
+ * already been acquired.
+ *
+ * @param socket
+ *     The guac_socket to write the given buffer to.
+ *
+ * @param buf
+ *     The buffer to write to the given socket.
+ *
+ * @param count
+ *     The number of bytes in the given buffer.
+ *
+ * @return
+ *     The number of bytes written, or a negative value if an error occurs
+ *     during write.
+ */
+static ssize_t guac_socket_uring_write_buffered(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    size_t original_count = count;
+    const char* current = buf;
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+
+    /* Send large blocks of data that would overflow the buffer directly, in
+     * the same batch as anything already buffered */
+    if (count >= GUAC_SOCKET_VECTORED_WRITE_THRESHOLD
+            && count > data->size - data->written) {
+
+        struct iovec iov[GUAC_SOCKET_URING_SEND_ENTRIES] = {
+            { .iov_base = data->out_buf,  .iov_len = data->written },
+            { .iov_base = (void*) buf,    .iov_len = count         }
+        };
+
+        if (guac_socket_uring_send(data, iov, 2))
+            return -1;
+
+        data->written = 0;
+        return original_count;
+
+    }
+
+    /* Append to buffer, flush if necessary */
+    while (count > 0) {
+
+        size_t chunk_size;
+        size_t remaining = data->size - data->written;
+
+        /* If no space left in buffer, flush and retry */
+        if (remaining == 0) {
+
+            /* Abort if error occurs during flush */
+            if (guac_socket_uring_flush(socket))
+                return -1;
+
+            /* Retry buffer append */
+            continue;
+
+        }
+
+        /* Calculate size of chunk to be written to buffer */
+        chunk_size = count;
+        if (chunk_size > remaining)
+            chunk_size = remaining;
+
+        /* Update output buffer */
+        memcpy(data->out_buf + data->written, current, chunk_size);
+        data->written += chunk_size;
+
+        /* Update provided buffer */
+        current += chunk_size;
+        count   -= chunk_size;
+
+    }
+
+    /* All bytes have been written, possibly some to the internal buffer */
+    return original_count;
+
+}
+
+/**
+ * Appends the provided data to the internal buffer for future sending. The
+ * actual send will occur only upon flush, or when the internal buffer is
+ * full.
+ *
+ * @param socket
+ *     The guac_socket being write to.
+ *
+ * @param buf
+ *     The arbitrary buffer containing the data to be written.
+ *
+ * @param count
+ *     The number of bytes contained within the buffer.
+ *
+ * @return
+ *     The number of bytes written, or -1 if an error occurs.
+ */
+static ssize_t guac_socket_uring_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    int retval;
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+
+    /* Acquire exclusive access to buffer */
+    pthread_mutex_lock(&(data->buffer_lock));
+
+    /* Write provided data to buffer */
+    retval = guac_socket_uring_write_buffered(socket, buf, count);
+
+    /* Relinquish exclusive access to buffer */
+    pthread_mutex_unlock(&(data->buffer_lock));
+
+    return retval;
+
+}
+
+/**
+ * Reserves space directly within the internal output buffer of the given
+ * socket, flushing the buffer first if less than the requested amount of
+ * space is free. The buffer lock is acquired by this function and is only
+ * released by guac_socket_uring_commit_handler() or if an error occurs.
+ *
+ * @param socket
+ *     The guac_socket whose output buffer space should be reserved.
+ *
+ * @param min
+ *     The minimum number of bytes that must be available.
+ *
+ * @param available
+ *     Pointer to a size_t that should receive the number of bytes actually
+ *     available.
+ *
+ * @return
+ *     A pointer to the first free byte of the output buffer, or NULL if an
+ *     error occurs while flushing the buffer.
+ */
+static char* guac_socket_uring_reserve_handler(guac_socket* socket,
+        size_t min, size_t* available) {
+
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+
+    /* Acquire exclusive access to buffer */
+    pthread_mutex_lock(&(data->buffer_lock));
+
+    /* Flush buffer if insufficient space remains */
+    if (data->size - data->written < min
+            && guac_socket_uring_flush(socket)) {
+        pthread_mutex_unlock(&(data->buffer_lock));
+        return NULL;
+    }
+
+    *available = data->size - data->written;
+    return data->out_buf + data->written;
+
+}
+
+/**
+ * Records the given number of bytes as having been written to the space
+ * reserved by guac_socket_uring_reserve_handler(), releasing the buffer lock.
+ *
+ * @param socket
+ *     The guac_socket whose reservation should be completed.
+ *
+ * @param count
+ *     The number of bytes written to the reserved space.
+ */
+static void guac_socket_uring_commit_handler(guac_socket* socket,
+        size_t count) {
+
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+
+    data->written += count;
+
+    /* Relinquish exclusive access to buffer */
+    pthread_mutex_unlock(&(data->buffer_lock));
+
+}
+
+/**
+ * Returns the provided buffer having the given ID to the kernel, such that
+ * it may be filled with further received data.
+ *
+ * @param data
+ *     The data of the socket that received data into the buffer.
+ *
+ * @param id
+ *     The ID of the buffer to return.
+ */
+static void guac_socket_uring_recycle(guac_socket_uring_data* data, int id) {
+
+    io_uring_buf_ring_add(data->recv_buffer_ring,
+            data->recv_buffers + id * GUAC_SOCKET_URING_RECV_BUFFER_SIZE,
+            GUAC_SOCKET_URING_RECV_BUFFER_SIZE, id,
+            io_uring_buf_ring_mask(GUAC_SOCKET_URING_RECV_BUFFERS), 0);
+
+    io_uring_buf_ring_advance(data->recv_buffer_ring, 1);
+
+}
+
+/**
+ * Waits for received data to become available on the given socket, arming
+ * the multishot receive as necessary. Once this function succeeds, either
+ * received data is pending within recv_current or the remote end has closed
+ * the connection.
+ *
+ * @param data
+ *     The data of the socket to wait for.
+ *
+ * @param usec_timeout
+ *     The maximum amount of time to wait for data, in microseconds, or -1 to
+ *     potentially wait forever.
+ *
+ * @return
+ *     A positive value on success, zero if the timeout elapsed and no data is
+ *     available, or a negative value if an error occurs, in which case errno
+ *     is set appropriately.
+ */
+static int guac_socket_uring_receive(guac_socket_uring_data* data,
+        int usec_timeout) {
+
+    while (data->recv_length == 0 && !data->recv_closed) {
+
+        /* Receive continuously into provided buffers until disarmed */
+        if (!data->recv_armed) {
+
+            struct io_uring_sqe* sqe = io_uring_get_sqe(&data->recv_ring);
+            io_uring_prep_recv_multishot(sqe, data->fd, NULL, 0, 0);
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            sqe->buf_group = GUAC_SOCKET_URING_BUFFER_GROUP;
+
+            int retval = io_uring_submit(&data->recv_ring);
+            if (retval < 0) {
+                errno = -retval;
+                return -1;
+            }
+
+            data->recv_armed = 1;
+
+        }
+
+        /* Wait for the next completion of the receive */
+        struct io_uring_cqe* cqe;
+        int retval;
+        if (usec_timeout < 0)
+            retval = io_uring_wait_cqe(&data->recv_ring, &cqe);
+        else {
+            struct __kernel_timespec timeout = {
+                .tv_sec  = usec_timeout / 1000000,
+                .tv_nsec = (usec_timeout % 1000000) * 1000
+            };
+            retval = io_uring_wait_cqe_timeout(&data->recv_ring, &cqe, &timeout);
+        }
+
+        if (retval == -ETIME)
+            return 0;
+
+        if (retval < 0) {
+            errno = -retval;
+            return -1;
+        }
+
+        int result = cqe->res;
+        unsigned int flags = cqe->flags;
+        io_uring_cqe_seen(&data->recv_ring, cqe);
+
+        /* The receive must be resubmitted once the kernel stops it */
+        if (!(flags & IORING_CQE_F_MORE))
+            data->recv_armed = 0;
+
+        /* Running out of buffers merely stops the receive. As buffers are
+         * returned before further completions are consumed, all buffers are
+         * available again by the time this completion is seen. */
+        if (result == -ENOBUFS)
+            continue;
+
+        if (result < 0) {
+            errno = -result;
+            return -1;
+        }
+
+        /* A zero-length receive indicates the connection has been closed */
+        if (result == 0) {
+            data->recv_closed = 1;
+            break;
+        }
+
+        data->recv_buffer = flags >> IORING_CQE_BUFFER_SHIFT;
+        data->recv_current = data->recv_buffers
+            + data->recv_buffer * GUAC_SOCKET_URING_RECV_BUFFER_SIZE;
+        data->recv_length = result;
+
+    }
+
+    return 1;
+
+}
+
+/**
+ * Reads data previously received on the underlying file descriptor of the
+ * given guac_socket, waiting for data to be received if none is pending.
+ *
+ * @param socket
+ *     The guac_socket being read from.
+ *
+ * @param buf
+ *     The arbitrary buffer which we must populate with data.
+ *
+ * @param count
+ *     The maximum number of bytes to read into the buffer.
+ *
+ * @return
+ *     The number of bytes read, zero if the connection has been closed, or
+ *     -1 if an error occurs.
+ */
+static ssize_t guac_socket_uring_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+
+    /* Record errors in guac_error */
+    if (guac_socket_uring_receive(data, -1) < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error reading data from socket";
+        return -1;
+    }
+
+    if (data->recv_length == 0)
+        return 0;
+
+    if (count > data->recv_length)
+        count = data->recv_length;
+
+    memcpy(buf, data->recv_current, count);
+    data->recv_current += count;
+    data->recv_length -= count;
+
+    /* Return the buffer to the kernel once all its data has been read */
+    if (data->recv_length == 0)
+        guac_socket_uring_recycle(data, data->recv_buffer);
+
+    return count;
+
+}
+
+/**
+ * Waits for data on the underlying file descriptor of the given socket to
+ * become available such that the next read operation will not block.
+ *
+ * @param socket
+ *     The guac_socket to wait for.
+ *
+ * @param usec_timeout
+ *     The maximum amount of time to wait for data, in microseconds, or -1 to
+ *     potentially wait forever.
+ *
+ * @return
+ *     A positive value on success, zero if the timeout elapsed and no data is
+ *     available, or a negative value if an error occurs.
+ */
+static int guac_socket_uring_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+    int retval = guac_socket_uring_receive(data, usec_timeout);
+
+    /* Properly set guac_error */
+    if (retval <  0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error while waiting for data on socket";
+    }
+
+    else if (retval == 0) {
+        guac_error = GUAC_STATUS_TIMEOUT;
+        guac_error_message = "Timeout while waiting for data on socket";
+    }
+
+    return retval;
+
+}
+
+/**
+ * Frees all implementation-specific data associated with the given socket, but
+ * not the socket object itself.
+ *
+ * @param socket
+ *     The guac_socket whose associated data should be freed.
+ *
+ * @return
+ *     Zero if the data was successfully freed, non-zero otherwise. This
+ *     implementation always succeeds, and will always return zero.
+ */
+static int guac_socket_uring_free_handler(guac_socket* socket) {
+
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+
+    /* Destroy locks */
+    pthread_mutex_destroy(&(data->socket_lock));
+    pthread_mutex_destroy(&(data->buffer_lock));
+
+    /* Tear down io_uring instances, cancelling any pending receive */
+    io_uring_free_buf_ring(&data->recv_ring, data->recv_buffer_ring,
+            GUAC_SOCKET_URING_RECV_BUFFERS, GUAC_SOCKET_URING_BUFFER_GROUP);
+    io_uring_queue_exit(&data->recv_ring);
+    io_uring_queue_exit(&data->send_ring);
+
+    /* Close file descriptor */
+    close(data->fd);
+
+    guac_mem_free(data->recv_buffers);
+    guac_mem_free(data->out_buf);
+    guac_mem_free(data);
+    return 0;
+
+}
+
+/**
+ * Acquires exclusive access to the given socket.
+ *
+ * @param socket
+ *     The guac_socket to which exclusive access is required.
+ */
+static void guac_socket_uring_lock_handler(guac_socket* socket) {
+
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+
+    /* Acquire exclusive access to socket */
+    pthread_mutex_lock(&(data->socket_lock));
+
+}
+
+/**
+ * Relinquishes exclusive access to the given socket.
+ *
+ * @param socket
+ *     The guac_socket to which exclusive access is no longer required.
+ */
+static void guac_socket_uring_unlock_handler(guac_socket* socket) {
+
+    guac_socket_uring_data* data = (guac_socket_uring_data*) socket->data;
+
+    /* Relinquish exclusive access to socket */
+    pthread_mutex_unlock(&(data->socket_lock));
+
+}
+
+/**
+ * Initializes the io_uring instances of the given socket data, providing all
+ * receive buffers to the kernel and registering the output buffer.
+ *
+ * @param data
+ *     The socket data whose io_uring instances should be initialized. The
+ *     fd, size, out_buf, and recv_buffers members must already be set.
+ *
+ * @return
+ *     Zero if initialization succeeded, or a negative errno value if
+ *     io_uring cannot be used.
+ */
+static int guac_socket_uring_init_rings(guac_socket_uring_data* data) {
+
+    int retval = io_uring_queue_init(GUAC_SOCKET_URING_SEND_ENTRIES,
+            &data->send_ring, 0);
+    if (retval < 0)
+        return retval;
+
+    retval = io_uring_queue_init(GUAC_SOCKET_URING_RECV_ENTRIES,
+            &data->recv_ring, 0);
+    if (retval < 0) {
+        io_uring_queue_exit(&data->send_ring);
+        return retval;
+    }
+
+    /* Provide all receive buffers to the kernel up front */
+    data->recv_buffer_ring = io_uring_setup_buf_ring(&data->recv_ring,
+            GUAC_SOCKET_URING_RECV_BUFFERS, GUAC_SOCKET_URING_BUFFER_GROUP,
+            0, &retval);
+    if (data->recv_buffer_ring == NULL) {
+        io_uring_queue_exit(&data->recv_ring);
+        io_uring_queue_exit(&data->send_ring);
+        return retval;
+    }
+
+    for (int i = 0; i < GUAC_SOCKET_URING_RECV_BUFFERS; i++)
+        guac_socket_uring_recycle(data, i);
+
+    /* Registering the output buffer is an optimization only */
+    struct iovec out = { .iov_base = data->out_buf, .iov_len = data->size };
+    data->fixed = io_uring_register_buffers(&data->send_ring, &out, 1) == 0;
+
+    return 0;
+
+}
+
+guac_socket* guac_socket_open_uring(int fd, size_t buffer_size) {
+
+    pthread_mutexattr_t lock_attributes;
+
+    /* Constrain buffer size to supported bounds */
+    if (buffer_size < GUAC_SOCKET_OUTPUT_BUFFER_SIZE)
+        buffer_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+    else if (buffer_size > GUAC_SOCKET_OUTPUT_BUFFER_MAX_SIZE)
+        buffer_size = GUAC_SOCKET_OUTPUT_BUFFER_MAX_SIZE;
+
+    guac_socket_uring_data* data = guac_mem_zalloc(sizeof(guac_socket_uring_data));
+
+    data->fd = fd;
+    data->size = buffer_size;
+    data->out_buf = guac_mem_alloc(buffer_size);
+    data->recv_buffers = guac_mem_alloc(GUAC_SOCKET_URING_RECV_BUFFERS,
+            GUAC_SOCKET_URING_RECV_BUFFER_SIZE);
+
+    /* Fail without taking ownership of the file descriptor if io_uring is
+     * unavailable, such that the caller may fall back to other sockets */
+    int retval = guac_socket_uring_init_rings(data);
+    if (retval < 0) {
+        guac_mem_free(data->recv_buffers);
+        guac_mem_free(data->out_buf);
+        guac_mem_free(data);
+        errno = -retval;
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to initialize io_uring";
+        return NULL;
+    }
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = data;
+
+    pthread_mutexattr_init(&lock_attributes);
+    pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
+
+    /* Init locks */
+    pthread_mutex_init(&(data->socket_lock), &lock_attributes);
+    pthread_mutex_init(&(data->buffer_lock), &lock_attributes);
+
+    /* Set read/write handlers */
+    socket->read_handler    = guac_socket_uring_read_handler;
+    socket->write_handler   = guac_socket_uring_write_handler;
+    socket->select_handler  = guac_socket_uring_select_handler;
+    socket->lock_handler    = guac_socket_uring_lock_handler;
+    socket->unlock_handler  = guac_socket_uring_unlock_handler;
+    socket->flush_handler   = guac_socket_uring_flush_handler;
+    socket->reserve_handler = guac_socket_uring_reserve_handler;
+    socket->commit_handler  = guac_socket_uring_commit_handler;
+    socket->free_handler    = guac_socket_uring_free_handler;
+
+    return socket;
+
+}
+
@@ -303,6 +303,68 @@ static ssize_t guac_socket_wsa_write_handler(guac_socket* socket,
 
 }
 
+/**
+ * Reserves space directly within the internal output buffer of the given
+ * socket, flushing the buffer first if less than the requested amount of
+ * space is free. The buffer lock is acquired by this function and is only
+ * released by guac_socket_wsa_commit_handler() or if an error occurs.
+ *
+ * @param socket
+ *     The guac_socket whose output buffer space should be reserved.
+ *
+ * @param min
+ *     The minimum number of bytes that must be available.
+ *
+ * @param available
+ *     Pointer to a size_t that should receive the number of bytes actually
+ *     available.
+ *
+ * @return
+ *     A pointer to the first free byte of the output buffer, or NULL if an
+ *     error occurs while flushing the buffer.
+ */
+static char* guac_socket_wsa_reserve_handler(guac_socket* socket,
+        size_t min, size_t* available) {
+
+    guac_socket_wsa_data* data = (guac_socket_wsa_data*) socket->data;
+
+    /* Acquire exclusive access to buffer */
+    pthread_mutex_lock(&(data->buffer_lock));
+
+    /* Flush buffer if insufficient space remains */
+    if (sizeof(data->out_buf) - data->written < min
+            && guac_socket_wsa_flush(socket)) {
+        pthread_mutex_unlock(&(data->buffer_lock));
+        return NULL;
+    }
+
+    *available = sizeof(data->out_buf) - data->written;
+    return data->out_buf + data->written;
+
+}
+
+/**
+ * Records the given number of bytes as having been written to the space
+ * reserved by guac_socket_wsa_reserve_handler(), releasing the buffer lock.
+ *
+ * @param socket
+ *     The guac_socket whose reservation should be completed.
+ *
+ * @param count
+ *     The number of bytes written to the reserved space.
+ */
+static void guac_socket_wsa_commit_handler(guac_socket* socket,
+        size_t count) {
+
+    guac_socket_wsa_data* data = (guac_socket_wsa_data*) socket->data;
+
+    data->written += count;
+
+    /* Relinquish exclusive access to buffer */
+    pthread_mutex_unlock(&(data->buffer_lock));
+
+}
+
 /**
  * Waits for data on the underlying SOCKET handle of the given socket to
  * become available such that the next read operation will not block.
@@ -441,6 +503,8 @@ guac_socket* guac_socket_open_wsa(SOCKET sock) {
     socket->lock_handler   = guac_socket_wsa_lock_handler;
     socket->unlock_handler = guac_socket_wsa_unlock_handler;
     socket->flush_handler  = guac_socket_wsa_flush_handler;
+    socket->reserve_handler = guac_socket_wsa_reserve_handler;
+    socket->commit_handler  = guac_socket_wsa_commit_handler;
     socket->free_handler   = guac_socket_wsa_free_handler;
 
     return socket;
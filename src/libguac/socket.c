@@ -19,9 +19,10 @@
 
 #include "config.h"
 
+#include "socket-base64.h"
+#include "socket-keep-alive.h"
 #include "guacamole/mem.h"
 #include "guacamole/error.h"
-#include "guacamole/protocol.h"
 #include "guacamole/socket.h"
 #include "guacamole/timestamp.h"
 
@@ -43,48 +44,11 @@ char __guac_socket_BASE64_CHARACTERS[64] = {
     '8', '9', '+', '/'
 };
 
-static void* __guac_socket_keep_alive_thread(void* data) {
-
-    int old_cancelstate;
-
-    /* Calculate sleep interval */
-    struct timespec interval;
-    interval.tv_sec  =  GUAC_SOCKET_KEEP_ALIVE_INTERVAL / 1000;
-    interval.tv_nsec = (GUAC_SOCKET_KEEP_ALIVE_INTERVAL % 1000) * 1000000L;
-
-    /* Socket keep-alive loop */
-    guac_socket* socket = (guac_socket*) data;
-    while (socket->state == GUAC_SOCKET_OPEN) {
-
-        /* Send NOP keep-alive if it's been a while since the last output */
-        guac_timestamp timestamp = guac_timestamp_current();
-        if (timestamp - socket->last_write_timestamp >
-                GUAC_SOCKET_KEEP_ALIVE_INTERVAL) {
-
-            /* Send NOP */
-            if (guac_protocol_send_nop(socket)
-                || guac_socket_flush(socket))
-                break;
-
-        }
-
-        /* Sleep until next keep-alive check, but allow thread cancellation
-         * during that sleep */
-        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
-        nanosleep(&interval, NULL);
-        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
-
-    }
-
-    return NULL;
-
-}
-
 static ssize_t __guac_socket_write(guac_socket* socket,
         const void* buf, size_t count) {
 
     /* Update timestamp of last write */
-    socket->last_write_timestamp = guac_timestamp_current();
+    socket->last_write_timestamp = guac_timestamp_current_coarse();
 
     /* If handler defined, call it. */
     if (socket->write_handler)
@@ -118,6 +82,25 @@ ssize_t guac_socket_write(guac_socket* socket,
 
 }
 
+char* guac_socket_reserve(guac_socket* socket, size_t min, size_t* available) {
+
+    /* In-place writes are possible only if supported by the socket */
+    if (socket->reserve_handler == NULL || socket->commit_handler == NULL)
+        return NULL;
+
+    return socket->reserve_handler(socket, min, available);
+
+}
+
+void guac_socket_commit(guac_socket* socket, size_t count) {
+
+    /* Update timestamp of last write */
+    socket->last_write_timestamp = guac_timestamp_current_coarse();
+
+    socket->commit_handler(socket, count);
+
+}
+
 ssize_t guac_socket_read(guac_socket* socket, void* buf, size_t count) {
 
     /* If handler defined, call it. */
@@ -154,10 +137,13 @@ guac_socket* guac_socket_alloc(void) {
     socket->__ready = 0;
     socket->data = NULL;
     socket->state = GUAC_SOCKET_OPEN;
-    socket->last_write_timestamp = guac_timestamp_current();
+    socket->last_write_timestamp = guac_timestamp_current_coarse();
 
     /* No keep alive ping by default */
     socket->__keep_alive_enabled = 0;
+    socket->__keep_alive_slot = GUAC_SOCKET_KEEP_ALIVE_UNSCHEDULED;
+    socket->__keep_alive_prev = NULL;
+    socket->__keep_alive_next = NULL;
 
     /* No handlers yet */
     socket->read_handler   = NULL;
@@ -165,6 +151,8 @@ guac_socket* guac_socket_alloc(void) {
     socket->select_handler = NULL;
     socket->free_handler   = NULL;
     socket->flush_handler  = NULL;
+    socket->reserve_handler = NULL;
+    socket->commit_handler  = NULL;
     socket->lock_handler   = NULL;
     socket->unlock_handler = NULL;
 
@@ -174,10 +162,8 @@ guac_socket* guac_socket_alloc(void) {
 
 void guac_socket_require_keep_alive(guac_socket* socket) {
 
-    /* Start keep-alive thread */
-    socket->__keep_alive_enabled = 1;
-    pthread_create(&(socket->__keep_alive_thread), NULL,
-                __guac_socket_keep_alive_thread, (void*) socket);
+    /* Schedule keep-alive pings with the shared keep-alive thread */
+    guac_socket_keep_alive_add(socket);
 
 }
 
@@ -201,6 +187,10 @@ void guac_socket_free(guac_socket* socket) {
 
     guac_socket_flush(socket);
 
+    /* Stop keep-alive pings, if enabled, before the underlying resources of
+     * the socket are freed */
+    guac_socket_keep_alive_remove(socket);
+
     /* Call free handler if defined */
     if (socket->free_handler)
         socket->free_handler(socket);
@@ -208,12 +198,6 @@ void guac_socket_free(guac_socket* socket) {
     /* Mark as closed */
     socket->state = GUAC_SOCKET_CLOSED;
 
-    /* Stop keep-alive thread, if enabled */
-    if (socket->__keep_alive_enabled) {
-        pthread_cancel(socket->__keep_alive_thread);
-        pthread_join(socket->__keep_alive_thread, NULL);
-    }
-
     guac_mem_free(socket);
 }
 
@@ -312,34 +296,94 @@ ssize_t __guac_socket_encode_base64(int a, int b, int c, char* output) {
     return 0;
 }
 
-ssize_t guac_socket_flush_base64(guac_socket* socket) {
-    const unsigned char* src = socket->__ready_buf;
+/**
+ * Encodes the given complete groups of three bytes as base64, writing the
+ * result to the given guac_socket. If the socket supports in-place writes,
+ * the data is encoded directly into its output buffer. Otherwise, the data is
+ * encoded in chunks into the socket's internal base64 buffer and written with
+ * guac_socket_write().
+ *
+ * @param socket
+ *     The guac_socket to write the encoded data to.
+ *
+ * @param src
+ *     The data to encode, which must be exactly (triplets * 3) bytes long.
+ *
+ * @param triplets
+ *     The number of groups of three bytes to encode.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while writing.
+ */
+static ssize_t __guac_socket_write_base64_triplets(guac_socket* socket,
+        const unsigned char* src, size_t triplets) {
 
-    int encodedCount = 0;
-    int remaining = socket->__ready;
+    guac_socket_base64_encode_function* encode =
+        guac_socket_get_base64_encode();
 
-    /* Encode bytes in groups of three */
-    while (remaining > 2) {
-        __guac_socket_encode_base64(src[0], src[1], src[2], socket->__encoded_buf + encodedCount);
+    while (triplets > 0) {
 
-        remaining -= 3;
-        src += 3;
-        encodedCount += 4;
-    }
+        size_t available;
+        size_t chunk;
+
+        /* Encode directly into the output buffer if possible */
+        char* output = guac_socket_reserve(socket, 4, &available);
+        if (output != NULL) {
+
+            chunk = available / 4;
+            if (chunk > triplets)
+                chunk = triplets;
+
+            encode(src, chunk, output);
+            guac_socket_commit(socket, chunk * 4);
+
+        }
+
+        /* Reservation is only ever refused by sockets that do not support it
+         * at all, or due to an error during the flush that would have been
+         * required to make space available */
+        else if (socket->reserve_handler != NULL)
+            return 1;
+
+        /* Otherwise, fall back to encoding via the intermediate buffer */
+        else {
+
+            chunk = GUAC_SOCKET_BASE64_ENCODED_BUFFER_SIZE / 4;
+            if (chunk > triplets)
+                chunk = triplets;
+
+            encode(src, chunk, socket->__encoded_buf);
+            if (guac_socket_write(socket, socket->__encoded_buf, chunk * 4))
+                return 1;
+
+        }
+
+        src += chunk * 3;
+        triplets -= chunk;
 
-    /* Take care of partial remnants */
-    if (remaining == 2) {
-        __guac_socket_encode_base64(src[0], src[1], -1, socket->__encoded_buf + encodedCount);
-        encodedCount += 4;
-    }
-    else if (remaining == 1) {
-        __guac_socket_encode_base64(src[0], -1, -1, socket->__encoded_buf + encodedCount);
-        encodedCount += 4;
     }
 
+    return 0;
+
+}
+
+ssize_t guac_socket_flush_base64(guac_socket* socket) {
+
+    const unsigned char* src = socket->__ready_buf;
+
+    /* Nothing to do if no partial group remains */
+    if (socket->__ready == 0)
+        return 0;
+
+    /* Encode remaining one or two bytes with padding */
+    if (socket->__ready == 2)
+        __guac_socket_encode_base64(src[0], src[1], -1, socket->__encoded_buf);
+    else
+        __guac_socket_encode_base64(src[0], -1, -1, socket->__encoded_buf);
+
     /* Write buffer to socket */
-    int retval = guac_socket_write(socket, socket->__encoded_buf, encodedCount);
-    if (retval < 0)
+    int retval = guac_socket_write(socket, socket->__encoded_buf, 4);
+    if (retval)
         return retval;
 
     socket->__ready = 0;
@@ -350,31 +394,40 @@ ssize_t guac_socket_flush_base64(guac_socket* socket) {
 
 ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t count) {
 
-    const unsigned char* src = (const unsigned char*)buf;
-    size_t remaining = count;
-    int len;
-    int retval;
+    const unsigned char* src = (const unsigned char*) buf;
+    size_t triplets;
 
-    while (remaining > 0) {
-        /* Fill ready buffer as much as possible */
-        len = GUAC_SOCKET_BASE64_READY_BUFFER_SIZE - socket->__ready;
-        if (remaining < len)
-            len = remaining;
+    /* Complete any partial group left over from a previous write */
+    if (socket->__ready > 0) {
 
-        memcpy(socket->__ready_buf + socket->__ready, src, len);
+        while (socket->__ready < 3 && count > 0) {
+            socket->__ready_buf[socket->__ready++] = *(src++);
+            count--;
+        }
 
-        socket->__ready += len;
-        src += len;
-        remaining -= len;
+        /* Retain partial group until more data is available */
+        if (socket->__ready < 3)
+            return 0;
+
+        if (__guac_socket_write_base64_triplets(socket, socket->__ready_buf, 1))
+            return 1;
+
+        socket->__ready = 0;
 
-        /* Flush ready buffer when full */
-        if (socket->__ready == GUAC_SOCKET_BASE64_READY_BUFFER_SIZE) {
-            retval = guac_socket_flush_base64(socket);
-            if (retval < 0)
-                return retval;
-        }
     }
 
+    /* Encode all complete groups without further copying */
+    triplets = count / 3;
+    if (__guac_socket_write_base64_triplets(socket, src, triplets))
+        return 1;
+
+    /* Retain any trailing partial group */
+    src += triplets * 3;
+    count -= triplets * 3;
+
+    memcpy(socket->__ready_buf, src, count);
+    socket->__ready = count;
+
     return 0;
 
 }
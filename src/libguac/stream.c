@@ -0,0 +1,54 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "guacamole/protocol.h"
+#include "guacamole/socket.h"
+#include "guacamole/stream.h"
+
+int guac_stream_can_send(const guac_stream* stream) {
+    return __atomic_load_n(&stream->__unacknowledged, __ATOMIC_SEQ_CST)
+        < stream->window;
+}
+
+int guac_stream_send_blob(guac_socket* socket, guac_stream* stream,
+        const void* data, int count) {
+
+    if (guac_protocol_send_blob(socket, stream, data, count))
+        return 1;
+
+    /* Blob is now in flight until acknowledged */
+    __atomic_add_fetch(&stream->__unacknowledged, 1, __ATOMIC_SEQ_CST);
+    return 0;
+
+}
+
+void guac_stream_acknowledge(guac_stream* stream) {
+
+    /* Free one slot, never dropping below zero (the ack confirming creation
+     * of the stream is not associated with any blob) */
+    int unacknowledged = __atomic_load_n(&stream->__unacknowledged,
+            __ATOMIC_SEQ_CST);
+
+    while (unacknowledged > 0 && !__atomic_compare_exchange_n(
+                &stream->__unacknowledged, &unacknowledged, unacknowledged - 1,
+                0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+
+}
+
@@ -19,7 +19,9 @@
 
 #include "config.h"
 #include "guacamole/error.h"
+#include "guacamole/mem.h"
 #include "guacamole/tcp.h"
+#include "guacamole/timestamp.h"
 
 #include <errno.h>
 #include <fcntl.h>
@@ -34,16 +36,123 @@
 #define EBADFD EBADF
 #endif
 
-int guac_tcp_connect(const char* hostname, const char* port, const int timeout) {
+/**
+ * Orders the given list of addresses such that address families alternate,
+ * beginning with the family of the first address, as recommended by RFC 8305.
+ * The relative order of addresses within each family is preserved.
+ *
+ * @param addresses
+ *     The list of addresses returned by getaddrinfo().
+ *
+ * @param count
+ *     Storage for the number of addresses within the returned array.
+ *
+ * @return
+ *     A newly-allocated array of pointers to each address within the given
+ *     list, in the order that connections should be attempted. This array
+ *     must eventually be freed with guac_mem_free().
+ */
+static struct addrinfo** guac_tcp_order_addresses(struct addrinfo* addresses,
+        int* count) {
+
+    int total = 0;
+    for (struct addrinfo* current = addresses; current != NULL; current = current->ai_next)
+        total++;
+
+    struct addrinfo** ordered = guac_mem_alloc(sizeof(struct addrinfo*), total);
+
+    /* Split addresses into those of the first family and all others */
+    struct addrinfo** first = guac_mem_alloc(sizeof(struct addrinfo*), total);
+    struct addrinfo** other = guac_mem_alloc(sizeof(struct addrinfo*), total);
+    int first_count = 0;
+    int other_count = 0;
+
+    for (struct addrinfo* current = addresses; current != NULL; current = current->ai_next) {
+        if (current->ai_family == addresses->ai_family)
+            first[first_count++] = current;
+        else
+            other[other_count++] = current;
+    }
+
+    /* Interleave the two, appending whatever remains of the longer */
+    int length = 0;
+    for (int i = 0; i < first_count || i < other_count; i++) {
+
+        if (i < first_count)
+            ordered[length++] = first[i];
+
+        if (i < other_count)
+            ordered[length++] = other[i];
+
+    }
+
+    guac_mem_free(first);
+    guac_mem_free(other);
+
+    *count = total;
+    return ordered;
+
+}
+
+/**
+ * Begins a non-blocking connection attempt to the given address.
+ *
+ * @param address
+ *     The address to connect to.
+ *
+ * @param fd
+ *     Storage for the file descriptor of the socket used for the attempt.
+ *
+ * @return
+ *     Positive if the connection succeeded immediately, zero if the
+ *     connection is in progress, or negative if the attempt failed, in which
+ *     case guac_error is set appropriately and no socket remains open.
+ */
+static int guac_tcp_start_attempt(const struct addrinfo* address, int* fd) {
+
+    *fd = socket(address->ai_family, SOCK_STREAM, 0);
+    if (*fd < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to create socket.";
+        return -1;
+    }
+
+    /* Get current socket options */
+    int opt = fcntl(*fd, F_GETFL, NULL);
+    if (opt < 0) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Failed to retrieve socket options.";
+        close(*fd);
+        return -1;
+    }
+
+    /* Set socket to non-blocking */
+    if (fcntl(*fd, F_SETFL, opt | O_NONBLOCK) < 0) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Failed to set non-blocking socket.";
+        close(*fd);
+        return -1;
+    }
+
+    if (connect(*fd, address->ai_addr, address->ai_addrlen) == 0)
+        return 1;
+
+    if (errno == EINPROGRESS)
+        return 0;
+
+    guac_error = GUAC_STATUS_REFUSED;
+    guac_error_message = "Unable to connect via socket.";
+    close(*fd);
+    return -1;
+
+}
+
+int guac_tcp_connect_timed(const char* hostname, const char* port,
+        const int timeout, guac_tcp_connect_timings* timings) {
 
     int retval;
 
-    int fd = EBADFD;
     struct addrinfo* addresses;
-    struct addrinfo* current_address;
-
-    char connected_address[1024];
-    char connected_port[64];
 
     struct addrinfo hints = {
         .ai_family   = AF_UNSPEC,
@@ -51,6 +160,8 @@ int guac_tcp_connect(const char* hostname, const char* port, const int timeout)
         .ai_protocol = IPPROTO_TCP
     };
 
+    guac_timestamp resolve_start = guac_timestamp_current();
+
     /* Get addresses for requested hostname and port. */
     if ((retval = getaddrinfo(hostname, port, &hints, &addresses))) {
         guac_error = GUAC_STATUS_INVALID_ARGUMENT;
@@ -58,108 +169,163 @@ int guac_tcp_connect(const char* hostname, const char* port, const int timeout)
         return retval;
     }
 
-    /* Attempt connection to each address until success */
-    for (current_address = addresses; current_address != NULL; current_address = current_address->ai_next) {
+    guac_timestamp connect_start = guac_timestamp_current();
+    guac_timestamp deadline = connect_start + (guac_timestamp) timeout * 1000;
 
-        /* Resolve hostname */
-        if ((retval = getnameinfo(current_address->ai_addr,
-                current_address->ai_addrlen,
-                connected_address, sizeof(connected_address),
-                connected_port, sizeof(connected_port),
-                NI_NUMERICHOST | NI_NUMERICSERV))) {
+    int count;
+    struct addrinfo** ordered = guac_tcp_order_addresses(addresses, &count);
 
-            guac_error = GUAC_STATUS_INVALID_ARGUMENT;
-            guac_error_message = "Error resolving host.";
+    /* File descriptors of all connection attempts still in progress, -1 for
+     * any attempt not yet started or no longer in progress */
+    int* attempts = guac_mem_alloc(sizeof(int), count);
+    for (int i = 0; i < count; i++)
+        attempts[i] = -1;
+
+    int fd = -1;
+    int next = 0;
+    int in_progress = 0;
+    guac_timestamp next_attempt = connect_start;
+
+    guac_error = GUAC_STATUS_REFUSED;
+    guac_error_message = "Unable to connect to remote host.";
+
+    /* Start each attempt in turn, allowing each at least
+     * GUAC_TCP_CONNECT_ATTEMPT_DELAY milliseconds to succeed before starting
+     * the next, until any attempt succeeds */
+    for (;;) {
+
+        guac_timestamp now = guac_timestamp_current();
+
+        /* Start the next attempt if it is time (or if nothing else is in
+         * progress) */
+        if (next < count && (now >= next_attempt || in_progress == 0)) {
+
+            int result = guac_tcp_start_attempt(ordered[next], &attempts[next]);
+            if (result > 0) {
+                fd = attempts[next];
+                attempts[next] = -1;
+                break;
+            }
+
+            if (result == 0) {
+                in_progress++;
+                next_attempt = now + GUAC_TCP_CONNECT_ATTEMPT_DELAY;
+            }
+            else
+                attempts[next] = -1;
+
+            next++;
             continue;
+
         }
 
-        /* Get socket or return the error. */
-        fd = socket(current_address->ai_family, SOCK_STREAM, 0);
-        if (fd < 0) {
-            freeaddrinfo(addresses);
-            return fd;
+        /* Fail if no attempts remain */
+        if (in_progress == 0)
+            break;
+
+        /* Fail once the timeout has elapsed */
+        if (now >= deadline) {
+            guac_error = GUAC_STATUS_REFUSED;
+            guac_error_message = "Timeout connecting via socket.";
+            break;
         }
 
-        /* Variable to store current socket options. */
-        int opt;
+        /* Wait for any attempt to complete, or until it is time to start
+         * the next attempt */
+        guac_timestamp wait_until = deadline;
+        if (next < count && next_attempt < wait_until)
+            wait_until = next_attempt;
 
-        /* Get current socket options */
-        if ((opt = fcntl(fd, F_GETFL, NULL)) < 0) {
-            guac_error = GUAC_STATUS_INVALID_ARGUMENT;
-            guac_error_message = "Failed to retrieve socket options.";
-            close(fd);
-            continue;
+        fd_set fdset;
+        FD_ZERO(&fdset);
+
+        int max_fd = -1;
+        for (int i = 0; i < next; i++) {
+            if (attempts[i] != -1) {
+                FD_SET(attempts[i], &fdset);
+                if (attempts[i] > max_fd)
+                    max_fd = attempts[i];
+            }
         }
 
-        /* Set socket to non-blocking */
-        if (fcntl(fd, F_SETFL, opt | O_NONBLOCK) < 0) {
+        guac_timestamp wait = wait_until - now;
+        struct timeval tv = {
+            .tv_sec = wait / 1000,
+            .tv_usec = (wait % 1000) * 1000
+        };
+
+        retval = select(max_fd + 1, NULL, &fdset, NULL, &tv);
+        if (retval < 0) {
+            if (errno == EINTR)
+                continue;
             guac_error = GUAC_STATUS_INVALID_ARGUMENT;
-            guac_error_message = "Failed to set non-blocking socket.";
-            close(fd);
-            continue;
+            guac_error_message = "Error attempting to connect via socket.";
+            break;
         }
 
-        /* Structure that stores our timeout setting. */
-        struct timeval tv;
-        tv.tv_sec = timeout;
-        tv.tv_usec = 0;
-
-        /* Connect and wait for timeout */
-        if ((retval = connect(fd, current_address->ai_addr, current_address->ai_addrlen)) < 0) {
-            if (errno == EINPROGRESS) {
-                /* Set up timeout. */
-                fd_set fdset;
-                FD_ZERO(&fdset);
-                FD_SET(fd, &fdset);
-                
-                retval = select(fd + 1, NULL, &fdset, NULL, &tv);
+        /* Check each attempt that has completed, successfully or not */
+        for (int i = 0; i < next && fd == -1; i++) {
+
+            if (attempts[i] == -1 || !FD_ISSET(attempts[i], &fdset))
+                continue;
+
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(attempts[i], SOL_SOCKET, SO_ERROR, &error, &length) == 0
+                    && error == 0) {
+                fd = attempts[i];
+                attempts[i] = -1;
             }
-            
+
+            /* Failed attempts allow the next attempt to start immediately */
             else {
                 guac_error = GUAC_STATUS_REFUSED;
                 guac_error_message = "Unable to connect via socket.";
-                close(fd);
-                continue;
+                close(attempts[i]);
+                attempts[i] = -1;
+                next_attempt = now;
             }
-        }
 
-        /* Successful connection */
-        if (retval > 0) {
-            /* Restore previous socket options. */
-            if (fcntl(fd, F_SETFL, opt) < 0) {
-                guac_error = GUAC_STATUS_INVALID_ARGUMENT;
-                guac_error_message = "Failed to reset socket options.";
-                close(fd);
-                continue;
-            }
+            in_progress--;
 
-            break;
         }
 
-        if (retval == 0) {
-            guac_error = GUAC_STATUS_REFUSED;
-            guac_error_message = "Timeout connecting via socket.";
-        }
-        else {
-            guac_error = GUAC_STATUS_INVALID_ARGUMENT;
-            guac_error_message = "Error attempting to connect via socket.";
-        }
+        if (fd != -1)
+            break;
 
-        /* Some error has occurred - free resources before next iteration. */
-        close(fd);
+    }
 
+    /* Abandon all other attempts */
+    for (int i = 0; i < next; i++) {
+        if (attempts[i] != -1)
+            close(attempts[i]);
     }
 
-    /* Free addrinfo */
+    guac_mem_free(attempts);
+    guac_mem_free(ordered);
     freeaddrinfo(addresses);
 
-    /* If unable to connect to anything, set error status. */
-    if (current_address == NULL) {
-        guac_error = GUAC_STATUS_REFUSED;
-        guac_error_message = "Unable to connect to remote host.";
+    if (timings != NULL) {
+        timings->resolve = connect_start - resolve_start;
+        timings->connect = guac_timestamp_current() - connect_start;
+    }
+
+    if (fd == -1)
+        return -1;
+
+    /* Restore blocking behavior */
+    int opt = fcntl(fd, F_GETFL, NULL);
+    if (opt < 0 || fcntl(fd, F_SETFL, opt & ~O_NONBLOCK) < 0) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Failed to reset socket options.";
+        close(fd);
+        return -1;
     }
 
-    /* Return the fd, or the error message if the socket connection failed. */
     return fd;
 
 }
+
+int guac_tcp_connect(const char* hostname, const char* port, const int timeout) {
+    return guac_tcp_connect_timed(hostname, port, timeout, NULL);
+}
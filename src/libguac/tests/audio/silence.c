@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/audio.h>
+
+#include <string.h>
+
+/**
+ * The total number of bytes of PCM data received by the mock encoder.
+ */
+static int test_written;
+
+/**
+ * The number of times the mock encoder has been flushed.
+ */
+static int test_flushes;
+
+/**
+ * Mock write handler which counts the bytes of PCM data received.
+ */
+static void test_write_handler(guac_audio_stream* audio,
+        const unsigned char* pcm_data, int length) {
+    test_written += length;
+}
+
+/**
+ * Mock flush handler which counts the number of flushes.
+ */
+static void test_flush_handler(guac_audio_stream* audio) {
+    test_flushes++;
+}
+
+/**
+ * Test which verifies that guac_audio_stream_write_pcm() continues to pass
+ * silence through for GUAC_AUDIO_SILENCE_HOLDOFF milliseconds, then flushes
+ * once and discards further silence until non-silent data is written.
+ */
+void test_audio__silence() {
+
+    guac_audio_encoder encoder = {
+        .mimetype      = "audio/L16",
+        .write_handler = test_write_handler,
+        .flush_handler = test_flush_handler
+    };
+
+    guac_audio_stream audio = {
+        .encoder  = &encoder,
+        .rate     = 8000,
+        .channels = 1,
+        .bps      = 16
+    };
+
+    /* 10 ms of 16-bit mono PCM at 8000 Hz */
+    unsigned char pcm[160];
+    memset(pcm, 0, sizeof(pcm));
+
+    /* Low-level noise within the threshold counts as silence */
+    pcm[0] = GUAC_AUDIO_SILENCE_THRESHOLD;
+    pcm[2] = (unsigned char) -GUAC_AUDIO_SILENCE_THRESHOLD;
+    pcm[3] = 0xFF;
+
+    test_written = 0;
+    test_flushes = 0;
+
+    /* Silence within the holdoff is sent as-is */
+    int chunks = GUAC_AUDIO_SILENCE_HOLDOFF / 10;
+    for (int i = 0; i < chunks; i++)
+        guac_audio_stream_write_pcm(&audio, pcm, sizeof(pcm));
+
+    CU_ASSERT_EQUAL(test_written, chunks * (int) sizeof(pcm));
+    CU_ASSERT_EQUAL(test_flushes, 0);
+    CU_ASSERT_FALSE(audio.silence_suppressed);
+
+    /* Silence beyond the holdoff is discarded after a single flush */
+    for (int i = 0; i < 10; i++)
+        guac_audio_stream_write_pcm(&audio, pcm, sizeof(pcm));
+
+    CU_ASSERT_EQUAL(test_written, chunks * (int) sizeof(pcm));
+    CU_ASSERT_EQUAL(test_flushes, 1);
+    CU_ASSERT_TRUE(audio.silence_suppressed);
+
+    /* Any sample above the threshold resumes encoding immediately */
+    pcm[sizeof(pcm) - 2] = GUAC_AUDIO_SILENCE_THRESHOLD + 1;
+    guac_audio_stream_write_pcm(&audio, pcm, sizeof(pcm));
+
+    CU_ASSERT_EQUAL(test_written, (chunks + 1) * (int) sizeof(pcm));
+    CU_ASSERT_FALSE(audio.silence_suppressed);
+    CU_ASSERT_EQUAL(audio.silence_length, 0);
+
+}
+
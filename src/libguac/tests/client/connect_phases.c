@@ -0,0 +1,73 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+
+#include <stdio.h>
+
+/**
+ * Test which verifies that guac_client_record_connect_phase() records each
+ * distinct phase once, in the order first recorded, replacing the duration of
+ * phases recorded again, and ignoring phases beyond
+ * GUAC_CLIENT_MAX_CONNECT_PHASES.
+ */
+void test_client__connect_phases() {
+
+    guac_client_connect_phase phases[GUAC_CLIENT_MAX_CONNECT_PHASES];
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    /* No phases are initially recorded */
+    CU_ASSERT_EQUAL(guac_client_get_connect_phases(client, phases,
+                GUAC_CLIENT_MAX_CONNECT_PHASES), 0);
+
+    guac_client_record_connect_phase(client, "negotiation", 120);
+    guac_client_record_connect_phase(client, "first_frame", 40);
+    guac_client_record_connect_phase(client, "negotiation", 80);
+
+    /* Re-recording a phase replaces only its duration */
+    CU_ASSERT_EQUAL_FATAL(guac_client_get_connect_phases(client, phases,
+                GUAC_CLIENT_MAX_CONNECT_PHASES), 2);
+    CU_ASSERT_STRING_EQUAL(phases[0].name, "negotiation");
+    CU_ASSERT_EQUAL(phases[0].duration, 80);
+    CU_ASSERT_STRING_EQUAL(phases[1].name, "first_frame");
+    CU_ASSERT_EQUAL(phases[1].duration, 40);
+
+    /* Retrieval is limited to the space provided */
+    CU_ASSERT_EQUAL(guac_client_get_connect_phases(client, phases, 1), 1);
+
+    /* Phases beyond the maximum are ignored */
+    for (int i = 0; i < GUAC_CLIENT_MAX_CONNECT_PHASES; i++) {
+        char name[GUAC_CLIENT_CONNECT_PHASE_NAME_LENGTH];
+        snprintf(name, sizeof(name), "phase%i", i);
+        guac_client_record_connect_phase(client, name, i);
+    }
+
+    CU_ASSERT_EQUAL(guac_client_get_connect_phases(client, phases,
+                GUAC_CLIENT_MAX_CONNECT_PHASES), GUAC_CLIENT_MAX_CONNECT_PHASES);
+    CU_ASSERT_STRING_EQUAL(phases[GUAC_CLIENT_MAX_CONNECT_PHASES - 1].name,
+            "phase13");
+
+    guac_client_free(client);
+
+}
+
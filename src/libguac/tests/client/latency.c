@@ -0,0 +1,102 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "client-latency.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/timestamp.h>
+
+#include <stdint.h>
+
+/**
+ * Test which verifies that latency is measured only once input has been
+ * followed by changes to the remote desktop, the frame containing those
+ * changes, and confirmation of that frame by the same user that provided the
+ * input.
+ */
+void test_client__latency() {
+
+    guac_client_latency_stats stats;
+
+    /* Users are only compared by the trace and never dereferenced */
+    int user_a_data, user_b_data;
+    const guac_user* user_a = (const guac_user*) &user_a_data;
+    const guac_user* user_b = (const guac_user*) &user_b_data;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    /* Frames sent without any preceding input are not measured */
+    guac_timestamp frame = guac_timestamp_current();
+    guac_client_trace_damage(client);
+    guac_client_trace_frame(client, frame);
+    guac_client_trace_sync(client, user_a, frame);
+
+    guac_client_get_latency_stats(client, &stats);
+    CU_ASSERT_EQUAL(stats.total.count, 0);
+
+    /* Frames without changes do not complete a measurement */
+    guac_client_trace_input(client, user_a);
+    guac_client_trace_frame(client, frame);
+    guac_client_trace_sync(client, user_a, frame);
+
+    guac_client_get_latency_stats(client, &stats);
+    CU_ASSERT_EQUAL(stats.total.count, 0);
+
+    /* Further input is ignored while a measurement is in progress */
+    guac_client_trace_input(client, user_b);
+    guac_client_trace_damage(client);
+
+    frame = guac_timestamp_current();
+    guac_client_trace_frame(client, frame);
+
+    /* Only the user that provided the input can confirm the frame, and only
+     * by confirming that frame or a later frame */
+    guac_client_trace_sync(client, user_b, frame);
+    guac_client_trace_sync(client, user_a, frame - 1);
+
+    guac_client_get_latency_stats(client, &stats);
+    CU_ASSERT_EQUAL(stats.total.count, 0);
+
+    guac_client_trace_sync(client, user_a, frame);
+
+    guac_client_get_latency_stats(client, &stats);
+    CU_ASSERT_EQUAL(stats.server.count, 1);
+    CU_ASSERT_EQUAL(stats.encode.count, 1);
+    CU_ASSERT_EQUAL(stats.network.count, 1);
+    CU_ASSERT_EQUAL(stats.total.count, 1);
+
+    /* Each measurement is counted within exactly one bucket */
+    uint64_t count = 0;
+    for (int i = 0; i < GUAC_CLIENT_LATENCY_BUCKETS; i++)
+        count += stats.total.buckets[i];
+
+    CU_ASSERT_EQUAL(count, 1);
+    CU_ASSERT(stats.total.sum >= stats.network.sum);
+
+    /* Confirming the same frame again has no further effect */
+    guac_client_trace_sync(client, user_a, frame);
+
+    guac_client_get_latency_stats(client, &stats);
+    CU_ASSERT_EQUAL(stats.total.count, 1);
+
+    guac_client_free(client);
+
+}
@@ -0,0 +1,94 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+
+/**
+ * Test which verifies that guac_client_account_memory() tracks the memory
+ * attributed to each subsystem independently, including the greatest amount
+ * of memory attributed to each at any one time.
+ */
+void test_client__memory_accounting() {
+
+    guac_client_memory_stats stats;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    /* No memory is initially attributed to any subsystem */
+    guac_client_get_memory_stats(client, &stats);
+    for (int i = 0; i < GUAC_CLIENT_MEMORY_CATEGORIES; i++) {
+        CU_ASSERT_EQUAL(stats.usage[i], 0);
+        CU_ASSERT_EQUAL(stats.peak[i], 0);
+    }
+
+    guac_client_account_memory(client, GUAC_CLIENT_MEMORY_TERMINAL, 4096);
+    guac_client_account_memory(client, GUAC_CLIENT_MEMORY_TERMINAL, 8192);
+    guac_client_account_memory(client, GUAC_CLIENT_MEMORY_TERMINAL, -10240);
+    guac_client_account_memory(client, GUAC_CLIENT_MEMORY_CLIPBOARD, 262144);
+
+    /* Freed memory reduces usage but not the peak */
+    guac_client_get_memory_stats(client, &stats);
+    CU_ASSERT_EQUAL(stats.usage[GUAC_CLIENT_MEMORY_TERMINAL], 2048);
+    CU_ASSERT_EQUAL(stats.peak[GUAC_CLIENT_MEMORY_TERMINAL], 12288);
+    CU_ASSERT_EQUAL(stats.usage[GUAC_CLIENT_MEMORY_CLIPBOARD], 262144);
+    CU_ASSERT_EQUAL(stats.peak[GUAC_CLIENT_MEMORY_CLIPBOARD], 262144);
+
+    /* Other subsystems are unaffected */
+    CU_ASSERT_EQUAL(stats.usage[GUAC_CLIENT_MEMORY_DISPLAY], 0);
+    CU_ASSERT_EQUAL(stats.usage[GUAC_CLIENT_MEMORY_AUDIO], 0);
+    CU_ASSERT_EQUAL(stats.usage[GUAC_CLIENT_MEMORY_RECORDING], 0);
+
+    /* Growth beyond the previous peak raises the peak */
+    guac_client_account_memory(client, GUAC_CLIENT_MEMORY_TERMINAL, 16384);
+    guac_client_get_memory_stats(client, &stats);
+    CU_ASSERT_EQUAL(stats.usage[GUAC_CLIENT_MEMORY_TERMINAL], 18432);
+    CU_ASSERT_EQUAL(stats.peak[GUAC_CLIENT_MEMORY_TERMINAL], 18432);
+
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that guac_client_reclaim_memory() may be invoked for a
+ * guac_client having no guac_display, releasing no attributed memory but
+ * still counting each invocation.
+ */
+void test_client__memory_reclaim() {
+
+    guac_client_memory_stats stats;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_client_account_memory(client, GUAC_CLIENT_MEMORY_AUDIO, 65536);
+
+    CU_ASSERT_EQUAL(guac_client_reclaim_memory(client), 0);
+    CU_ASSERT_EQUAL(guac_client_reclaim_memory(client), 0);
+
+    guac_client_get_memory_stats(client, &stats);
+    CU_ASSERT_EQUAL(stats.reclaims, 2);
+    CU_ASSERT_EQUAL(stats.reclaimed, 0);
+    CU_ASSERT_EQUAL(stats.usage[GUAC_CLIENT_MEMORY_AUDIO], 65536);
+
+    guac_client_free(client);
+
+}
@@ -0,0 +1,116 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "copilot-index.h"
+
+#include <CUnit/CUnit.h>
+#include <string.h>
+
+/**
+ * Test which verifies that guac_copilot_command_index_find() returns only
+ * commands beginning with the given prefix, ranking history commands by
+ * recency above built-in commands, and omitting built-in commands for other
+ * protocols.
+ */
+void test_copilot__index_find() {
+
+    const char* matches[GUAC_COPILOT_INDEX_MAX_MATCHES];
+    char history[3][16] = { "ls -l", "docker ps", "ls -la" };
+
+    guac_copilot_command_index* index = guac_copilot_command_index_alloc(3);
+
+    guac_copilot_command_index_add_builtin(index, "docker images", "ssh");
+    guac_copilot_command_index_add_builtin(index, "ls -lah", "ssh");
+    guac_copilot_command_index_add_builtin(index, "dir", "rdp");
+
+    for (int i = 0; i < 3; i++)
+        guac_copilot_command_index_add_history(index, history[i]);
+
+    /* Recent history first, then built-in commands */
+    CU_ASSERT_EQUAL_FATAL(guac_copilot_command_index_find(index, "ls", "ssh",
+                matches, 5), 3);
+    CU_ASSERT_STRING_EQUAL(matches[0], "ls -la");
+    CU_ASSERT_STRING_EQUAL(matches[1], "ls -l");
+    CU_ASSERT_STRING_EQUAL(matches[2], "ls -lah");
+
+    /* Exact matches are not suggested */
+    CU_ASSERT_EQUAL_FATAL(guac_copilot_command_index_find(index, "ls -la",
+                "ssh", matches, 5), 1);
+    CU_ASSERT_STRING_EQUAL(matches[0], "ls -lah");
+
+    /* Built-in commands of other protocols are omitted */
+    CU_ASSERT_EQUAL(guac_copilot_command_index_find(index, "d", "ssh",
+                matches, 5), 2);
+    CU_ASSERT_EQUAL(guac_copilot_command_index_find(index, "di", "ssh",
+                matches, 5), 0);
+
+    /* The number of matches is limited */
+    CU_ASSERT_EQUAL_FATAL(guac_copilot_command_index_find(index, NULL, "ssh",
+                matches, 2), 2);
+    CU_ASSERT_STRING_EQUAL(matches[0], "ls -la");
+    CU_ASSERT_STRING_EQUAL(matches[1], "docker ps");
+
+    guac_copilot_command_index_free(index);
+
+}
+
+/**
+ * Test which verifies that commands released from the history are removed
+ * from the index unless another occurrence or a built-in command of the same
+ * value remains.
+ */
+void test_copilot__index_release() {
+
+    const char* matches[GUAC_COPILOT_INDEX_MAX_MATCHES];
+    char history[4][16] = { "pwd", "whoami", "pwd", "df -h" };
+
+    guac_copilot_command_index* index = guac_copilot_command_index_alloc(4);
+    guac_copilot_command_index_add_builtin(index, "df -h", NULL);
+
+    for (int i = 0; i < 4; i++)
+        guac_copilot_command_index_add_history(index, history[i]);
+
+    /* Releasing an older occurrence leaves the newer occurrence */
+    guac_copilot_command_index_release(index, history[0], NULL);
+    CU_ASSERT_EQUAL_FATAL(guac_copilot_command_index_find(index, "p", NULL,
+                matches, 5), 1);
+    CU_ASSERT_PTR_EQUAL(matches[0], history[2]);
+
+    /* Releasing the referenced occurrence may move to another occurrence */
+    guac_copilot_command_index_release(index, history[2], history[0]);
+    CU_ASSERT_EQUAL_FATAL(guac_copilot_command_index_find(index, "p", NULL,
+                matches, 5), 1);
+    CU_ASSERT_PTR_EQUAL(matches[0], history[0]);
+
+    /* Commands absent from the history are removed */
+    guac_copilot_command_index_release(index, history[1], NULL);
+    CU_ASSERT_EQUAL(guac_copilot_command_index_find(index, "w", NULL,
+                matches, 5), 0);
+
+    /* Built-in commands remain once absent from the history */
+    guac_copilot_command_index_release(index, history[3], NULL);
+    CU_ASSERT_EQUAL_FATAL(guac_copilot_command_index_find(index, "df", NULL,
+                matches, 5), 1);
+    CU_ASSERT_STRING_EQUAL(matches[0], "df -h");
+    CU_ASSERT_PTR_NOT_EQUAL(matches[0], history[3]);
+
+    guac_copilot_command_index_free(index);
+
+}
@@ -0,0 +1,87 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Test which verifies that memory allocated from a guac_display_arena is
+ * suitably aligned, distinct, and usable across a reset.
+ */
+void test_display__arena_alloc() {
+
+    guac_display_arena arena;
+    guac_display_arena_init(&arena);
+
+    unsigned char* a = guac_display_arena_alloc(&arena, 3, 1);
+    unsigned char* b = guac_display_arena_alloc(&arena, 100, sizeof(uint64_t));
+
+    CU_ASSERT_EQUAL((uintptr_t) a % GUAC_DISPLAY_ARENA_ALIGNMENT, 0);
+    CU_ASSERT_EQUAL((uintptr_t) b % GUAC_DISPLAY_ARENA_ALIGNMENT, 0);
+
+    /* Allocations must not overlap */
+    memset(a, 0xAA, 3);
+    memset(b, 0x55, 100 * sizeof(uint64_t));
+    CU_ASSERT_EQUAL(a[0], 0xAA);
+    CU_ASSERT_EQUAL(a[2], 0xAA);
+
+    guac_display_arena_reset(&arena);
+
+    unsigned char* c = guac_display_arena_alloc(&arena, 1000, 1);
+    CU_ASSERT_EQUAL((uintptr_t) c % GUAC_DISPLAY_ARENA_ALIGNMENT, 0);
+    memset(c, 0, 1000);
+
+    guac_display_arena_destroy(&arena);
+
+}
+
+/**
+ * Test which verifies that a guac_display_arena ceases to allocate memory
+ * from the system once the amount of memory required between resets reaches
+ * a steady state, and that the high-water mark reflects that amount.
+ */
+void test_display__arena_steady_state() {
+
+    guac_display_arena arena;
+    guac_display_arena_init(&arena);
+
+    for (int i = 0; i < 3; i++) {
+        guac_display_arena_alloc(&arena, 200000, 1);
+        guac_display_arena_alloc(&arena, 1000, 16);
+        guac_display_arena_reset(&arena);
+    }
+
+    uint64_t allocations = arena.allocations;
+    CU_ASSERT(arena.high_water >= 216000);
+
+    for (int i = 0; i < 10; i++) {
+        guac_display_arena_alloc(&arena, 200000, 1);
+        guac_display_arena_alloc(&arena, 1000, 16);
+        guac_display_arena_reset(&arena);
+    }
+
+    CU_ASSERT_EQUAL(arena.allocations, allocations);
+
+    guac_display_arena_destroy(&arena);
+
+}
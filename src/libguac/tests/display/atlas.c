@@ -0,0 +1,158 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "display-plan.h"
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+
+#include <pthread.h>
+
+/**
+ * Initializes the given image operation as a draw of the given rectangle
+ * within the given layer.
+ *
+ * @param op
+ *     The operation to initialize.
+ *
+ * @param layer
+ *     The layer receiving the draw.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the rectangle.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the rectangle.
+ *
+ * @param size
+ *     The width and height of the rectangle.
+ */
+static void test_atlas_op(guac_display_plan_operation* op,
+        guac_display_layer* layer, int x, int y, int size) {
+
+    *op = (guac_display_plan_operation) {
+        .layer = layer,
+        .type = GUAC_DISPLAY_PLAN_OPERATION_IMG
+    };
+
+    guac_rect_init(&op->dest, x, y, size, size);
+
+}
+
+/**
+ * Test which verifies that small draws on opaque layers are packed into
+ * atlases along horizontal shelves and spread across the worker threads,
+ * that all other draws are left in their original order, and that too few
+ * eligible draws are not packed at all.
+ */
+void test_display__atlas_pack() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_display* display = guac_mem_zalloc(sizeof(guac_display));
+    display->client = client;
+    display->worker_thread_count = 2;
+    pthread_mutex_init(&display->stats_lock, NULL);
+
+    guac_display_layer opaque = { .display = display, .opaque = 1 };
+    guac_display_layer transparent = { .display = display, .opaque = 0 };
+
+    guac_display_plan_operation ops[20];
+    guac_display_plan_operation* pending[20];
+
+    /* Ten small draws on an opaque layer, interleaved with one large draw
+     * and one small draw on a non-opaque layer */
+    int count = 0;
+    for (int i = 0; i < 10; i++) {
+        test_atlas_op(&ops[count], &opaque, i * 100, 0, 32);
+        pending[count] = &ops[count];
+        count++;
+        if (i == 3) {
+            test_atlas_op(&ops[count], &opaque, 0, 200, 128);
+            pending[count] = &ops[count];
+            count++;
+        }
+        else if (i == 6) {
+            test_atlas_op(&ops[count], &transparent, 0, 400, 32);
+            pending[count] = &ops[count];
+            count++;
+        }
+    }
+
+    /* The small opaque draws are split evenly between two atlases */
+    unsigned int remaining = guac_display_atlas_pack(display, pending, count);
+    CU_ASSERT_EQUAL_FATAL(remaining, 2);
+    CU_ASSERT_PTR_EQUAL(pending[0], &ops[4]);
+    CU_ASSERT_PTR_EQUAL(pending[1], &ops[8]);
+
+    CU_ASSERT_EQUAL_FATAL(display->atlas_count, 2);
+    for (int i = 0; i < 2; i++) {
+
+        guac_display_atlas* atlas = &display->atlases[i];
+        CU_ASSERT_PTR_NOT_NULL(atlas->buffer);
+        CU_ASSERT_EQUAL_FATAL(atlas->count, 5);
+        CU_ASSERT_EQUAL(atlas->width, 160);
+        CU_ASSERT_EQUAL(atlas->height, 32);
+
+        for (int j = 0; j < 5; j++) {
+            CU_ASSERT_EQUAL(atlas->entries[j].x, j * 32);
+            CU_ASSERT_EQUAL(atlas->entries[j].y, 0);
+            CU_ASSERT_PTR_EQUAL(atlas->entries[j].layer, &opaque);
+        }
+
+    }
+
+    CU_ASSERT_EQUAL(display->atlases[0].entries[0].dest.left, 0);
+    CU_ASSERT_EQUAL(display->atlases[1].entries[0].dest.left, 500);
+
+    /* Entries beyond the width of an atlas begin a new shelf */
+    display->worker_thread_count = 1;
+    for (int i = 0; i < 17; i++) {
+        test_atlas_op(&ops[i], &opaque, i * 64, 0, 32);
+        pending[i] = &ops[i];
+    }
+
+    remaining = guac_display_atlas_pack(display, pending, 17);
+    CU_ASSERT_EQUAL(remaining, 0);
+    CU_ASSERT_EQUAL_FATAL(display->atlas_count, 1);
+    CU_ASSERT_EQUAL_FATAL(display->atlases[0].count, 17);
+    CU_ASSERT_EQUAL(display->atlases[0].width, 512);
+    CU_ASSERT_EQUAL(display->atlases[0].height, 64);
+    CU_ASSERT_EQUAL(display->atlases[0].entries[16].x, 0);
+    CU_ASSERT_EQUAL(display->atlases[0].entries[16].y, 32);
+
+    /* Too few eligible draws are sent as individual images */
+    remaining = guac_display_atlas_pack(display, pending,
+            GUAC_DISPLAY_ATLAS_MIN_ENTRIES - 1);
+    CU_ASSERT_EQUAL(remaining, GUAC_DISPLAY_ATLAS_MIN_ENTRIES - 1);
+    CU_ASSERT_EQUAL(display->atlas_count, 0);
+
+    CU_ASSERT_EQUAL(display->stats.atlas_images, 3);
+    CU_ASSERT_EQUAL(display->stats.atlas_ops, 27);
+
+    guac_display_atlas_destroy(display);
+    CU_ASSERT_PTR_NULL(display->atlases[0].buffer);
+
+    pthread_mutex_destroy(&display->stats_lock);
+    guac_mem_free(display);
+    guac_client_free(client);
+
+}
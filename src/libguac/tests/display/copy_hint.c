@@ -0,0 +1,93 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/display.h>
+#include <guacamole/rect.h>
+
+/**
+ * Test which verifies that guac_display_layer_raw_context_copy_hint() records
+ * both the hint itself and the destination of the copy as damage.
+ */
+void test_display__copy_hint_record() {
+
+    guac_display_layer_raw_context context = { 0 };
+    guac_rect dest = { .left = 0, .top = 0, .right = 640, .bottom = 400 };
+
+    guac_display_layer_raw_context_copy_hint(&context, &dest, 0, 16);
+    CU_ASSERT_EQUAL_FATAL(context.copy_hint_count, 1);
+    CU_ASSERT_EQUAL(context.copy_hints[0].dest.right, 640);
+    CU_ASSERT_EQUAL(context.copy_hints[0].dest.bottom, 400);
+    CU_ASSERT_EQUAL(context.copy_hints[0].src_x, 0);
+    CU_ASSERT_EQUAL(context.copy_hints[0].src_y, 16);
+
+    CU_ASSERT_EQUAL(context.damage_count, 1);
+    CU_ASSERT_EQUAL(context.dirty.left, 0);
+    CU_ASSERT_EQUAL(context.dirty.top, 0);
+    CU_ASSERT_EQUAL(context.dirty.right, 640);
+    CU_ASSERT_EQUAL(context.dirty.bottom, 400);
+
+}
+
+/**
+ * Test which verifies that copies onto themselves and empty copies are not
+ * recorded as hints, while copies onto themselves are still recorded as
+ * damage.
+ */
+void test_display__copy_hint_trivial() {
+
+    guac_display_layer_raw_context context = { 0 };
+    guac_rect dest = { .left = 10, .top = 20, .right = 30, .bottom = 40 };
+    guac_rect empty = { .left = 10, .top = 20, .right = 10, .bottom = 40 };
+
+    guac_display_layer_raw_context_copy_hint(&context, &dest, 10, 20);
+    CU_ASSERT_EQUAL(context.copy_hint_count, 0);
+    CU_ASSERT_EQUAL(context.damage_count, 1);
+
+    guac_display_layer_raw_context_copy_hint(&context, &empty, 0, 0);
+    CU_ASSERT_EQUAL(context.copy_hint_count, 0);
+    CU_ASSERT_EQUAL(context.damage_count, 1);
+
+}
+
+/**
+ * Test which verifies that the list of copy hints never exceeds
+ * GUAC_DISPLAY_LAYER_MAX_COPY_HINTS entries, while every copy is still
+ * recorded as damage.
+ */
+void test_display__copy_hint_overflow() {
+
+    guac_display_layer_raw_context context = { 0 };
+
+    for (int i = 0; i < GUAC_DISPLAY_LAYER_MAX_COPY_HINTS * 2; i++) {
+        guac_rect dest = {
+            .left   = i * 100,
+            .top    = 0,
+            .right  = i * 100 + 10,
+            .bottom = 10
+        };
+        guac_display_layer_raw_context_copy_hint(&context, &dest, i * 100, 50);
+        CU_ASSERT(context.copy_hint_count <= GUAC_DISPLAY_LAYER_MAX_COPY_HINTS);
+    }
+
+    CU_ASSERT_EQUAL(context.copy_hint_count, GUAC_DISPLAY_LAYER_MAX_COPY_HINTS);
+    CU_ASSERT_EQUAL(context.dirty.right, (GUAC_DISPLAY_LAYER_MAX_COPY_HINTS * 2 - 1) * 100 + 10);
+
+}
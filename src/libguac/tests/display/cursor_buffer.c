@@ -0,0 +1,79 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/display.h>
+#include <guacamole/mem.h>
+#include <guacamole/rwlock.h>
+
+/**
+ * Test which verifies that guac_display_set_cursor_buffer() sets the given
+ * buffer as the source of the mouse cursor image, that modifying that buffer
+ * forces the cursor to be resent without affecting anything other than the
+ * cursor, and that modifying the cursor layer itself makes that layer the
+ * source of the mouse cursor image once again.
+ */
+void test_display__cursor_buffer() {
+
+    /* The display and its layers are far too large for the stack */
+    guac_display* display = guac_mem_zalloc(sizeof(guac_display));
+    guac_rwlock_init(&display->pending_frame.lock);
+
+    guac_display_layer* cursor = guac_mem_zalloc(sizeof(guac_display_layer));
+    guac_display_layer* buffer = guac_mem_zalloc(sizeof(guac_display_layer));
+    guac_display_layer* other = guac_mem_zalloc(sizeof(guac_display_layer));
+    cursor->display = buffer->display = other->display = display;
+    display->cursor_buffer = cursor;
+
+    guac_display_set_cursor_buffer(display, buffer, 3, 4);
+    CU_ASSERT_PTR_EQUAL(display->pending_frame.cursor_source, buffer);
+    CU_ASSERT_TRUE(display->pending_frame.cursor_source_modified);
+    CU_ASSERT_EQUAL(display->pending_frame.cursor_hotspot_x, 3);
+    CU_ASSERT_EQUAL(display->pending_frame.cursor_hotspot_y, 4);
+
+    /* Changes to the buffer must be reflected in the cursor, affecting only
+     * the cursor */
+    guac_display_layer_move(buffer, 10, 10);
+    CU_ASSERT_PTR_EQUAL(display->pending_frame.cursor_source, buffer);
+    CU_ASSERT_TRUE(display->pending_frame.cursor_source_modified);
+    CU_ASSERT_FALSE(display->pending_frame_dirty_excluding_mouse);
+
+    /* Unrelated layers do not affect the cursor */
+    display->pending_frame.cursor_source_modified = 0;
+    guac_display_layer_move(other, 10, 10);
+    CU_ASSERT_PTR_EQUAL(display->pending_frame.cursor_source, buffer);
+    CU_ASSERT_FALSE(display->pending_frame.cursor_source_modified);
+    CU_ASSERT_TRUE(display->pending_frame_dirty_excluding_mouse);
+
+    /* Changes to the cursor layer replace the buffer */
+    display->pending_frame.cursor_source_modified = 0;
+    guac_display_layer_move(cursor, 0, 0);
+    CU_ASSERT_PTR_NULL(display->pending_frame.cursor_source);
+    CU_ASSERT_TRUE(display->pending_frame.cursor_source_modified);
+
+    guac_rwlock_destroy(&display->pending_frame.lock);
+    guac_mem_free(other);
+    guac_mem_free(buffer);
+    guac_mem_free(cursor);
+    guac_mem_free(display);
+
+}
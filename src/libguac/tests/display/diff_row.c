@@ -0,0 +1,98 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "display-plan.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The width of the test rows, in pixels. This is intentionally not a multiple
+ * of 64 to ensure partial cells are also handled correctly.
+ */
+#define TEST_ROW_WIDTH 331
+
+/**
+ * The number of 64-pixel cells spanned by each test row.
+ */
+#define TEST_ROW_CELLS ((TEST_ROW_WIDTH + 63) / 64)
+
+/**
+ * Test which verifies that guac_display_plan_diff_row_scalar() reports
+ * exactly the pixels that differ, with each cell's bitmap beginning at the
+ * leftmost pixel of that cell.
+ */
+void test_display__diff_row_scalar() {
+
+    uint32_t row_a[TEST_ROW_WIDTH] = { 0 };
+    uint32_t row_b[TEST_ROW_WIDTH] = { 0 };
+    uint64_t changed[TEST_ROW_CELLS];
+
+    row_b[0] = 1;
+    row_b[63] = 1;
+    row_b[130] = 1;
+    row_b[TEST_ROW_WIDTH - 1] = 1;
+
+    guac_display_plan_diff_row_scalar(row_a, row_b, TEST_ROW_WIDTH, changed);
+
+    CU_ASSERT_EQUAL(changed[0], (1ULL << 0) | (1ULL << 63));
+    CU_ASSERT_EQUAL(changed[1], 0);
+    CU_ASSERT_EQUAL(changed[2], 1ULL << 2);
+    CU_ASSERT_EQUAL(changed[3], 0);
+    CU_ASSERT_EQUAL(changed[4], 0);
+    CU_ASSERT_EQUAL(changed[5], 1ULL << ((TEST_ROW_WIDTH - 1) % 64));
+
+}
+
+/**
+ * Test which verifies that the comparison implementation selected for the
+ * current CPU by guac_display_plan_get_diff_row() produces results identical
+ * to the scalar reference implementation for all row widths.
+ */
+void test_display__diff_row_matches_scalar() {
+
+    uint32_t row_a[TEST_ROW_WIDTH];
+    uint32_t row_b[TEST_ROW_WIDTH];
+
+    srand(0x4446);
+    for (int i = 0; i < TEST_ROW_WIDTH; i++) {
+        row_a[i] = (uint32_t) rand();
+        row_b[i] = (rand() % 8) ? row_a[i] : (uint32_t) rand();
+    }
+
+    guac_display_plan_diff_row_function* diff_row = guac_display_plan_get_diff_row();
+
+    for (int width = 1; width <= TEST_ROW_WIDTH; width++) {
+
+        uint64_t expected[TEST_ROW_CELLS];
+        uint64_t actual[TEST_ROW_CELLS];
+
+        int cells = (width + 63) / 64;
+
+        guac_display_plan_diff_row_scalar(row_a, row_b, width, expected);
+        diff_row(row_a, row_b, width, actual);
+
+        CU_ASSERT_EQUAL_FATAL(memcmp(expected, actual, cells * sizeof(uint64_t)), 0);
+
+    }
+
+}
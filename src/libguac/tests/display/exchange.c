@@ -0,0 +1,103 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+#include <guacamole/rect.h>
+
+#include <stdint.h>
+
+/**
+ * The width and height of the buffers of the test layer, in pixels.
+ */
+#define TEST_SIZE 64
+
+/**
+ * Initializes the given layer state with a zeroed buffer of TEST_SIZE by
+ * TEST_SIZE pixels.
+ *
+ * @param state
+ *     The layer state to initialize.
+ */
+static void test_state_init(guac_display_layer_state* state) {
+    state->width = state->height = TEST_SIZE;
+    state->buffer_width = state->buffer_height = TEST_SIZE;
+    state->buffer_stride = TEST_SIZE * GUAC_DISPLAY_LAYER_RAW_BPP;
+    state->buffer = guac_mem_zalloc(TEST_SIZE, state->buffer_stride);
+}
+
+/**
+ * Test which verifies that exchanging the pending and last frame buffers of a
+ * layer leaves the last frame containing the pending frame, and that restoring
+ * the stale region afterwards reproduces the pending frame exactly without
+ * touching anything outside that region.
+ */
+void test_display__exchange_buffers() {
+
+    guac_display_layer layer = { 0 };
+    test_state_init(&layer.last_frame);
+    test_state_init(&layer.pending_frame);
+
+    /* The pending frame differs from the last frame only within the
+     * changed region */
+    guac_rect changed;
+    guac_rect_init(&changed, 8, 16, 20, 10);
+
+    uint32_t* pixels = (uint32_t*) layer.pending_frame.buffer;
+    for (int y = changed.top; y < changed.bottom; y++) {
+        for (int x = changed.left; x < changed.right; x++)
+            pixels[y * TEST_SIZE + x] = 0xFF000000 | (y << 8) | x;
+    }
+
+    unsigned char* pending_buffer = layer.pending_frame.buffer;
+    unsigned char* last_buffer = layer.last_frame.buffer;
+
+    PFW_LFW_guac_display_layer_exchange_buffers(&layer, &changed);
+
+    /* The buffers are exchanged rather than copied */
+    CU_ASSERT_PTR_EQUAL(layer.last_frame.buffer, pending_buffer);
+    CU_ASSERT_PTR_EQUAL(layer.pending_frame.buffer, last_buffer);
+    CU_ASSERT_EQUAL(layer.pending_frame_stale.left, changed.left);
+    CU_ASSERT_EQUAL(layer.pending_frame_stale.top, changed.top);
+    CU_ASSERT_EQUAL(layer.pending_frame_stale.right, changed.right);
+    CU_ASSERT_EQUAL(layer.pending_frame_stale.bottom, changed.bottom);
+
+    /* Mark a pixel outside the stale region, which must be left alone */
+    ((uint32_t*) layer.pending_frame.buffer)[0] = 0x12345678;
+
+    PFW_LFR_guac_display_layer_restore_stale(&layer);
+    CU_ASSERT(guac_rect_is_empty(&layer.pending_frame_stale));
+
+    const uint32_t* restored = (const uint32_t*) layer.pending_frame.buffer;
+    const uint32_t* last = (const uint32_t*) layer.last_frame.buffer;
+    for (int i = 1; i < TEST_SIZE * TEST_SIZE; i++)
+        CU_ASSERT_EQUAL_FATAL(restored[i], last[i]);
+
+    CU_ASSERT_EQUAL(restored[0], 0x12345678);
+
+    /* Restoring once nothing is stale has no effect */
+    PFW_LFR_guac_display_layer_restore_stale(&layer);
+    CU_ASSERT_EQUAL(restored[0], 0x12345678);
+
+    guac_mem_free(layer.pending_frame.buffer);
+    guac_mem_free(layer.last_frame.buffer);
+
+}
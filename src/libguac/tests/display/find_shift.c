@@ -0,0 +1,171 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+
+/**
+ * The number of lines within each sequence of line hashes tested.
+ */
+#define TEST_LINES 200
+
+/**
+ * Returns an arbitrary line hash that is unique to the given value.
+ *
+ * @param value
+ *     The value whose unique hash should be returned.
+ *
+ * @return
+ *     An arbitrary hash that differs for each distinct value.
+ */
+static uint64_t test_line_hash(int value) {
+    return 0x9E3779B97F4A7C15ULL * (uint64_t) (value + 1);
+}
+
+/**
+ * Test which verifies that guac_display_plan_find_shift() finds the offset
+ * and extent of lines that have scrolled upward, with new lines replacing
+ * those that scrolled out of view.
+ */
+void test_display__find_shift_scroll() {
+
+    uint64_t old_hashes[TEST_LINES];
+    uint64_t new_hashes[TEST_LINES];
+
+    /* Scroll up by 17 lines, revealing 17 new lines at the bottom */
+    for (int i = 0; i < TEST_LINES; i++) {
+        old_hashes[i] = test_line_hash(i);
+        new_hashes[i] = test_line_hash(i + 17);
+    }
+
+    guac_display_arena arena;
+    guac_display_arena_init(&arena);
+
+    guac_display_plan_shift shift;
+    CU_ASSERT_TRUE_FATAL(guac_display_plan_find_shift(&arena, old_hashes,
+                new_hashes, TEST_LINES, 32, &shift));
+
+    CU_ASSERT_EQUAL(shift.offset, -17);
+    CU_ASSERT_EQUAL(shift.start, 0);
+    CU_ASSERT_EQUAL(shift.length, TEST_LINES - 17);
+
+    /* Scroll down by 5 lines instead */
+    for (int i = 0; i < TEST_LINES; i++)
+        new_hashes[i] = test_line_hash(i - 5);
+
+    CU_ASSERT_TRUE_FATAL(guac_display_plan_find_shift(&arena, old_hashes,
+                new_hashes, TEST_LINES, 32, &shift));
+
+    CU_ASSERT_EQUAL(shift.offset, 5);
+    CU_ASSERT_EQUAL(shift.start, 5);
+    CU_ASSERT_EQUAL(shift.length, TEST_LINES - 5);
+
+    guac_display_arena_destroy(&arena);
+
+}
+
+/**
+ * Test which verifies that lines shared by many other lines (such as blank
+ * lines) neither prevent a shift from being found nor break up the run of
+ * shifted lines, and that only the scrolled portion of a sequence is
+ * reported.
+ */
+void test_display__find_shift_blank_lines() {
+
+    uint64_t old_hashes[TEST_LINES];
+    uint64_t new_hashes[TEST_LINES];
+
+    /* Every third line is blank, with the first 41 lines being a fixed
+     * header that does not scroll (the last line of the header is not
+     * blank, as a blank line would match at any offset) */
+    for (int i = 0; i < TEST_LINES; i++)
+        old_hashes[i] = (i % 3 == 0) ? 0 : test_line_hash(i);
+
+    for (int i = 0; i < TEST_LINES; i++) {
+        if (i < 41)
+            new_hashes[i] = old_hashes[i];
+        else if (i + 9 < TEST_LINES)
+            new_hashes[i] = old_hashes[i + 9];
+        else
+            new_hashes[i] = test_line_hash(1000 + i);
+    }
+
+    guac_display_arena arena;
+    guac_display_arena_init(&arena);
+
+    guac_display_plan_shift shift;
+    CU_ASSERT_TRUE_FATAL(guac_display_plan_find_shift(&arena, old_hashes,
+                new_hashes, TEST_LINES, 32, &shift));
+
+    CU_ASSERT_EQUAL(shift.offset, -9);
+    CU_ASSERT_EQUAL(shift.start, 41);
+    CU_ASSERT_EQUAL(shift.length, TEST_LINES - 9 - 41);
+
+    guac_display_arena_destroy(&arena);
+
+}
+
+/**
+ * Test which verifies that guac_display_plan_find_shift() finds nothing for
+ * unchanged lines, for unrelated lines, and for shifted runs shorter than
+ * the minimum length.
+ */
+void test_display__find_shift_none() {
+
+    uint64_t old_hashes[TEST_LINES];
+    uint64_t new_hashes[TEST_LINES];
+
+    guac_display_arena arena;
+    guac_display_arena_init(&arena);
+
+    guac_display_plan_shift shift;
+
+    /* Unchanged */
+    for (int i = 0; i < TEST_LINES; i++)
+        old_hashes[i] = new_hashes[i] = test_line_hash(i);
+
+    CU_ASSERT_FALSE(guac_display_plan_find_shift(&arena, old_hashes,
+                new_hashes, TEST_LINES, 32, &shift));
+
+    /* Entirely new content */
+    for (int i = 0; i < TEST_LINES; i++)
+        new_hashes[i] = test_line_hash(TEST_LINES + i);
+
+    CU_ASSERT_FALSE(guac_display_plan_find_shift(&arena, old_hashes,
+                new_hashes, TEST_LINES, 32, &shift));
+
+    /* Only 20 lines shifted, with all others new */
+    for (int i = 0; i < 20; i++)
+        new_hashes[100 + i] = old_hashes[110 + i];
+
+    CU_ASSERT_FALSE(guac_display_plan_find_shift(&arena, old_hashes,
+                new_hashes, TEST_LINES, 32, &shift));
+
+    CU_ASSERT_TRUE(guac_display_plan_find_shift(&arena, old_hashes,
+                new_hashes, TEST_LINES, 16, &shift));
+    CU_ASSERT_EQUAL(shift.offset, -10);
+    CU_ASSERT_EQUAL(shift.start, 100);
+    CU_ASSERT_EQUAL(shift.length, 20);
+
+    guac_display_arena_destroy(&arena);
+
+}
+
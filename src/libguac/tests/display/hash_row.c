@@ -0,0 +1,115 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "display-plan.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The width of the test image, in pixels. This is intentionally not a
+ * multiple of the SIMD vector width to ensure any remaining pixels are also
+ * handled correctly.
+ */
+#define TEST_IMAGE_WIDTH 301
+
+/**
+ * The height of the test image, in pixels.
+ */
+#define TEST_IMAGE_HEIGHT 150
+
+/**
+ * Test which verifies that the hash implementation selected for the current
+ * CPU by guac_display_plan_get_hash_row() produces results identical to the
+ * scalar reference implementation.
+ */
+void test_display__hash_row_matches_scalar() {
+
+    uint32_t image[TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT];
+    uint64_t expected[TEST_IMAGE_WIDTH] = { 0 };
+    uint64_t actual[TEST_IMAGE_WIDTH] = { 0 };
+
+    srand(0x4841);
+    for (int i = 0; i < TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT; i++)
+        image[i] = (uint32_t) rand() ^ ((uint32_t) rand() << 16);
+
+    guac_display_plan_hash_row_function* hash_row = guac_display_plan_get_hash_row();
+
+    const uint32_t* row = image;
+    for (int y = 0; y < TEST_IMAGE_HEIGHT; y++) {
+
+        guac_display_plan_hash_row_scalar(row, TEST_IMAGE_WIDTH, expected);
+        hash_row(row, TEST_IMAGE_WIDTH, actual);
+
+        CU_ASSERT_EQUAL_FATAL(memcmp(expected, actual, sizeof(expected)), 0);
+
+        row += TEST_IMAGE_WIDTH;
+
+    }
+
+}
+
+/**
+ * Test which verifies that the hash produced by guac_display_plan_hash_row()
+ * depends only on the most recent 64x64 pixels, such that identical regions of
+ * image data produce identical hashes regardless of surrounding contents.
+ */
+void test_display__hash_row_sliding_window() {
+
+    uint32_t image[TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT];
+    uint64_t cell_hash[TEST_IMAGE_WIDTH] = { 0 };
+
+    /* Fill the image with random data, and then copy a single 64x64 region
+     * to a different location */
+    srand(0x5357);
+    for (int i = 0; i < TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT; i++)
+        image[i] = (uint32_t) rand();
+
+    for (int y = 0; y < 64; y++)
+        memcpy(image + (y + 80) * TEST_IMAGE_WIDTH + 130,
+                image + (y + 3) * TEST_IMAGE_WIDTH + 7,
+                64 * sizeof(uint32_t));
+
+    guac_display_plan_hash_row_function* hash_row = guac_display_plan_get_hash_row();
+
+    uint64_t original = 0;
+    uint64_t copy = 0;
+
+    /* The hash of each region becomes available at its bottom-right corner */
+    const uint32_t* row = image;
+    for (int y = 0; y < TEST_IMAGE_HEIGHT; y++) {
+
+        hash_row(row, TEST_IMAGE_WIDTH, cell_hash);
+
+        if (y == 3 + 63)
+            original = cell_hash[7 + 63];
+        else if (y == 80 + 63)
+            copy = cell_hash[130 + 63];
+
+        row += TEST_IMAGE_WIDTH;
+
+    }
+
+    CU_ASSERT_NOT_EQUAL(original, 0);
+    CU_ASSERT_EQUAL(original, copy);
+
+}
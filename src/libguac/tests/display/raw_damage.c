@@ -0,0 +1,107 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/display.h>
+#include <guacamole/rect.h>
+
+/**
+ * Test which verifies that nearby damaged regions reported through
+ * guac_display_layer_raw_context_damage() are coalesced, while distant
+ * regions are tracked separately, and that the dirty rect always covers all
+ * damaged regions.
+ */
+void test_display__raw_damage_coalesce() {
+
+    guac_display_layer_raw_context context = { 0 };
+
+    guac_rect a = { .left = 0,    .top = 0,    .right = 10,   .bottom = 10 };
+    guac_rect b = { .left = 12,   .top = 0,    .right = 20,   .bottom = 10 };
+    guac_rect c = { .left = 1000, .top = 1000, .right = 1010, .bottom = 1010 };
+
+    guac_display_layer_raw_context_damage(&context, &a);
+    guac_display_layer_raw_context_damage(&context, &b);
+    CU_ASSERT_EQUAL(context.damage_count, 1);
+    CU_ASSERT_EQUAL(context.damage[0].left, 0);
+    CU_ASSERT_EQUAL(context.damage[0].right, 20);
+
+    guac_display_layer_raw_context_damage(&context, &c);
+    CU_ASSERT_EQUAL(context.damage_count, 2);
+
+    CU_ASSERT_EQUAL(context.dirty.left, 0);
+    CU_ASSERT_EQUAL(context.dirty.top, 0);
+    CU_ASSERT_EQUAL(context.dirty.right, 1010);
+    CU_ASSERT_EQUAL(context.dirty.bottom, 1010);
+
+}
+
+/**
+ * Test which verifies that the list of damaged regions never exceeds
+ * GUAC_DISPLAY_LAYER_MAX_DAMAGE entries, and that every reported region
+ * remains covered by some entry once the list is full.
+ */
+void test_display__raw_damage_overflow() {
+
+    guac_display_layer_raw_context context = { 0 };
+    guac_rect reported[GUAC_DISPLAY_LAYER_MAX_DAMAGE * 4];
+
+    for (int i = 0; i < GUAC_DISPLAY_LAYER_MAX_DAMAGE * 4; i++) {
+        reported[i] = (guac_rect) {
+            .left   = (i % 8) * 1000,
+            .top    = (i / 8) * 1000,
+            .right  = (i % 8) * 1000 + 10,
+            .bottom = (i / 8) * 1000 + 10
+        };
+        guac_display_layer_raw_context_damage(&context, &reported[i]);
+        CU_ASSERT(context.damage_count <= GUAC_DISPLAY_LAYER_MAX_DAMAGE);
+    }
+
+    for (int i = 0; i < GUAC_DISPLAY_LAYER_MAX_DAMAGE * 4; i++) {
+
+        int covered = 0;
+        for (int j = 0; j < context.damage_count; j++) {
+            const guac_rect* region = &context.damage[j];
+            if (region->left <= reported[i].left
+                    && region->top <= reported[i].top
+                    && region->right >= reported[i].right
+                    && region->bottom >= reported[i].bottom)
+                covered = 1;
+        }
+
+        CU_ASSERT(covered);
+
+    }
+
+}
+
+/**
+ * Test which verifies that empty rectangles do not affect the damaged
+ * regions or dirty rect of a raw context.
+ */
+void test_display__raw_damage_empty() {
+
+    guac_display_layer_raw_context context = { 0 };
+    guac_rect empty = { .left = 5, .top = 5, .right = 5, .bottom = 10 };
+
+    guac_display_layer_raw_context_damage(&context, &empty);
+    CU_ASSERT_EQUAL(context.damage_count, 0);
+    CU_ASSERT(guac_rect_is_empty(&context.dirty));
+
+}
@@ -0,0 +1,86 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+
+#include <string.h>
+
+/**
+ * Test which verifies that completing a frame flags for recording exactly
+ * those cells of a recorded layer that were modified within that frame, that
+ * layers not yet recorded are left alone, and that the recording state
+ * follows changes in layer size.
+ */
+void test_display__record_update() {
+
+    guac_display_layer layer = { 0 };
+    layer.last_frame.width = 200;
+    layer.last_frame.height = 100;
+    layer.last_frame.dirty = (guac_rect) { .left = 0, .top = 0, .right = 1, .bottom = 1 };
+
+    layer.pending_frame_cells_width = GUAC_DISPLAY_CELL_DIMENSION(200);
+    layer.pending_frame_cells_height = GUAC_DISPLAY_CELL_DIMENSION(100);
+    layer.pending_frame_cells = guac_mem_zalloc(layer.pending_frame_cells_width,
+            layer.pending_frame_cells_height, sizeof(guac_display_layer_cell));
+
+    /* Layers never recorded will be recorded in full, and are not tracked */
+    PFR_LFW_guac_display_layer_record_update(&layer, 1);
+    CU_ASSERT_PTR_NULL(layer.record.cells);
+
+    /* Once recorded, the state covers every cell, all needing recording */
+    layer.record.recorded = 1;
+    PFR_LFW_guac_display_layer_record_update(&layer, 1);
+    CU_ASSERT_EQUAL_FATAL(layer.record.width, 4);
+    CU_ASSERT_EQUAL_FATAL(layer.record.height, 2);
+    for (int i = 0; i < 8; i++)
+        CU_ASSERT(layer.record.cells[i]);
+
+    /* Modify only the cell at (128, 64) */
+    memset(layer.record.cells, 0, 8);
+    layer.pending_frame_cells[1 * layer.pending_frame_cells_width + 2].last_frame = 2;
+
+    PFR_LFW_guac_display_layer_record_update(&layer, 2);
+    for (int i = 0; i < 8; i++)
+        CU_ASSERT_EQUAL(layer.record.cells[i], i == 6);
+
+    /* Cells modified in earlier frames do not affect later frames */
+    layer.record.cells[6] = 0;
+    PFR_LFW_guac_display_layer_record_update(&layer, 3);
+    for (int i = 0; i < 8; i++)
+        CU_ASSERT_FALSE(layer.record.cells[i]);
+
+    /* Invalidation flags everything */
+    LFW_guac_display_layer_record_invalidate(&layer);
+    for (int i = 0; i < 8; i++)
+        CU_ASSERT(layer.record.cells[i]);
+
+    /* Resizing such that the number of cells changes flags everything */
+    memset(layer.record.cells, 0, 8);
+    layer.last_frame.width = 300;
+    PFR_LFW_guac_display_layer_record_update(&layer, 4);
+    CU_ASSERT_EQUAL_FATAL(layer.record.width, 5);
+    for (int i = 0; i < 10; i++)
+        CU_ASSERT(layer.record.cells[i]);
+
+    guac_display_layer_record_free(&layer);
+    guac_mem_free(layer.pending_frame_cells);
+
+}
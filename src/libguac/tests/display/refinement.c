@@ -0,0 +1,162 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-plan.h"
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+
+#include <pthread.h>
+
+/**
+ * Returns the refinement state of the cell at the given cell coordinates
+ * within the given layer.
+ *
+ * @param layer
+ *     The layer containing the cell.
+ *
+ * @param x
+ *     The X coordinate of the cell, in cells.
+ *
+ * @param y
+ *     The Y coordinate of the cell, in cells.
+ *
+ * @return
+ *     The time at which the cell was last sent using lossy compression, or
+ *     zero if it was last sent losslessly.
+ */
+static guac_timestamp test_refinement_cell(guac_display_layer* layer, int x, int y) {
+    return layer->refinement.cells[y * layer->refinement.width + x];
+}
+
+/**
+ * Test which verifies that regions sent using lossy compression are tracked
+ * per cell, that lossless updates clear only the cells they wholly cover, and
+ * that rectangles and copies within a plan update the tracked state of their
+ * destination (with copies carrying the state of their source as it was in
+ * the previous frame).
+ */
+void test_display__refinement_track() {
+
+    guac_layer last_frame_buffer = { .index = -1 };
+    guac_layer tile_cache_buffer = { .index = -2 };
+
+    guac_display* display = guac_mem_zalloc(sizeof(guac_display));
+    pthread_mutex_init(&display->refinement_lock, NULL);
+    guac_display_arena_init(&display->plan_arena);
+
+    guac_display_layer layer = { 0 };
+    layer.display = display;
+    layer.last_frame_buffer = &last_frame_buffer;
+    layer.pending_frame.width = 300;
+    layer.pending_frame.height = 200;
+
+    display->pending_frame.layers = &layer;
+    display->last_frame.layers = &layer;
+
+    guac_display_plan_operation ops[3] = { 0 };
+    guac_display_plan plan = {
+        .display = display,
+        .ops = ops,
+        .length = 1
+    };
+
+    /* An otherwise-empty plan sizes the refinement state to match the layer,
+     * with everything considered to have been sent losslessly */
+    PFR_LFW_guac_display_plan_track_refinement(&plan);
+    CU_ASSERT_EQUAL_FATAL(layer.refinement.width, 5);
+    CU_ASSERT_EQUAL_FATAL(layer.refinement.height, 4);
+    for (int i = 0; i < 20; i++)
+        CU_ASSERT_EQUAL(layer.refinement.cells[i], 0);
+
+    /* Lossy updates mark every cell they touch */
+    guac_rect lossy = { .left = 0, .top = 0, .right = 128, .bottom = 64 };
+    LFR_guac_display_layer_refinement_mark(&layer, &lossy, 100);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 0, 0), 100);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 1, 0), 100);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 2, 0), 0);
+
+    /* Lossless updates clear only those cells that they wholly cover */
+    guac_rect lossless = { .left = 0, .top = 0, .right = 100, .bottom = 64 };
+    LFR_guac_display_layer_refinement_mark(&layer, &lossless, 0);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 0, 0), 0);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 1, 0), 100);
+
+    /* Cells along the edge of the layer are wholly covered if everything
+     * within the bounds of the layer is covered */
+    guac_rect edge = { .left = 256, .top = 192, .right = 300, .bottom = 200 };
+    LFR_guac_display_layer_refinement_mark(&layer, &edge, 50);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 4, 3), 50);
+    LFR_guac_display_layer_refinement_mark(&layer, &edge, 0);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 4, 3), 0);
+
+    /* Copy the lossy cell (1, 0) to (2, 2) while filling that same cell, and
+     * copy from the tile cache (which is not tracked) over cell (3, 3) */
+    LFR_guac_display_layer_refinement_mark(&layer, &(guac_rect) {
+        .left = 192, .top = 192, .right = 256, .bottom = 256 }, 75);
+
+    ops[0] = (guac_display_plan_operation) {
+        .layer = &layer,
+        .type = GUAC_DISPLAY_PLAN_OPERATION_COPY,
+        .dest = { .left = 128, .top = 128, .right = 192, .bottom = 192 },
+        .src.layer_rect = {
+            .layer = &last_frame_buffer,
+            .rect = { .left = 64, .top = 0, .right = 128, .bottom = 64 }
+        }
+    };
+
+    ops[1] = (guac_display_plan_operation) {
+        .layer = &layer,
+        .type = GUAC_DISPLAY_PLAN_OPERATION_RECT,
+        .dest = { .left = 64, .top = 0, .right = 128, .bottom = 64 }
+    };
+
+    ops[2] = (guac_display_plan_operation) {
+        .layer = &layer,
+        .type = GUAC_DISPLAY_PLAN_OPERATION_COPY,
+        .dest = { .left = 192, .top = 192, .right = 256, .bottom = 256 },
+        .src.layer_rect = {
+            .layer = &tile_cache_buffer,
+            .rect = { .left = 0, .top = 0, .right = 64, .bottom = 64 }
+        }
+    };
+
+    plan.length = 3;
+    PFR_LFW_guac_display_plan_track_refinement(&plan);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 2, 2), 100);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 1, 0), 0);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 3, 3), 75);
+
+    /* Growing the layer preserves existing state */
+    layer.pending_frame.width = 500;
+    plan.length = 1;
+    ops[0].type = GUAC_DISPLAY_PLAN_OPERATION_NOP;
+    PFR_LFW_guac_display_plan_track_refinement(&plan);
+    CU_ASSERT_EQUAL_FATAL(layer.refinement.width, 8);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 2, 2), 100);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 3, 3), 75);
+    CU_ASSERT_EQUAL(test_refinement_cell(&layer, 7, 3), 0);
+
+    guac_display_layer_refinement_free(&layer);
+    guac_display_arena_destroy(&display->plan_arena);
+    pthread_mutex_destroy(&display->refinement_lock);
+    guac_mem_free(display);
+
+}
@@ -0,0 +1,71 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/display.h>
+#include <guacamole/flag.h>
+#include <guacamole/mem.h>
+
+/**
+ * Test which verifies that guac_display_render_thread_wait_for_frame() waits
+ * both for all notified changes to be flushed and for any in-progress frame
+ * to finish being sent.
+ */
+void test_display__render_wait() {
+
+    /* The display is far too large for the stack */
+    guac_display* display = guac_mem_zalloc(sizeof(guac_display));
+    guac_flag_init(&display->render_state);
+    guac_flag_set(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
+
+    /* The render loop itself is not started, such that the flushing of
+     * changes can be simulated */
+    guac_display_render_thread render_thread = { .display = display };
+    guac_flag_init(&render_thread.state);
+    guac_flag_set(&render_thread.state, GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_FLUSHED);
+
+    CU_ASSERT_TRUE(guac_display_render_thread_wait_for_frame(&render_thread, 0));
+
+    /* Changes that have not yet been flushed must be waited for */
+    guac_display_render_thread_notify_modified(&render_thread);
+    CU_ASSERT_EQUAL(render_thread.notifications, 1);
+    CU_ASSERT_FALSE(guac_display_render_thread_wait_for_frame(&render_thread, 10));
+
+    guac_display_render_thread_notify_frame(&render_thread);
+    CU_ASSERT_EQUAL(render_thread.notifications, 2);
+    CU_ASSERT_FALSE(guac_display_render_thread_wait_for_frame(&render_thread, 10));
+
+    guac_flag_set(&render_thread.state, GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_FLUSHED);
+    CU_ASSERT_TRUE(guac_display_render_thread_wait_for_frame(&render_thread, 10));
+
+    /* Frames that are still being sent must also be waited for */
+    guac_flag_clear(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
+    CU_ASSERT_FALSE(guac_display_render_thread_wait_for_frame(&render_thread, 10));
+
+    guac_flag_set(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
+    CU_ASSERT_TRUE(guac_display_render_thread_wait_for_frame(&render_thread, 10));
+
+    guac_flag_destroy(&render_thread.state);
+    guac_flag_destroy(&display->render_state);
+    guac_mem_free(display);
+
+}
@@ -0,0 +1,75 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+
+/**
+ * Test which verifies that completing a frame marks stale exactly those tiles
+ * of a layer snapshot that contain a cell modified within that frame, and
+ * that the snapshot follows changes in layer size.
+ */
+void test_display__snapshot_stale() {
+
+    guac_display_layer layer = { 0 };
+    layer.last_frame.width = 600;
+    layer.last_frame.height = 300;
+    layer.last_frame.dirty = (guac_rect) { .left = 0, .top = 0, .right = 1, .bottom = 1 };
+
+    layer.pending_frame_cells_width = GUAC_DISPLAY_CELL_DIMENSION(600);
+    layer.pending_frame_cells_height = GUAC_DISPLAY_CELL_DIMENSION(300);
+    layer.pending_frame_cells = guac_mem_zalloc(layer.pending_frame_cells_width,
+            layer.pending_frame_cells_height, sizeof(guac_display_layer_cell));
+
+    /* A new snapshot consists entirely of stale tiles */
+    PFR_LFW_guac_display_layer_snapshot_update(&layer, 1);
+    CU_ASSERT_EQUAL_FATAL(layer.snapshot.width, 3);
+    CU_ASSERT_EQUAL_FATAL(layer.snapshot.height, 2);
+    for (int i = 0; i < 6; i++) {
+        CU_ASSERT(layer.snapshot.tiles[i].stale);
+        layer.snapshot.tiles[i].stale = 0;
+    }
+
+    /* Modify the cell at (320, 256), which lies within tile (1, 1) */
+    layer.pending_frame_cells[4 * layer.pending_frame_cells_width + 5].last_frame = 2;
+
+    PFR_LFW_guac_display_layer_snapshot_update(&layer, 2);
+    for (int i = 0; i < 6; i++)
+        CU_ASSERT_EQUAL(layer.snapshot.tiles[i].stale, i == 4);
+
+    /* Cells modified in earlier frames do not affect later frames */
+    layer.snapshot.tiles[4].stale = 0;
+    PFR_LFW_guac_display_layer_snapshot_update(&layer, 3);
+    for (int i = 0; i < 6; i++)
+        CU_ASSERT_FALSE(layer.snapshot.tiles[i].stale);
+
+    /* Resizing such that the number of tiles changes discards all tiles */
+    layer.last_frame.width = 1000;
+    PFR_LFW_guac_display_layer_snapshot_update(&layer, 4);
+    CU_ASSERT_EQUAL_FATAL(layer.snapshot.width, 4);
+    for (int i = 0; i < 8; i++)
+        CU_ASSERT(layer.snapshot.tiles[i].stale);
+
+    guac_display_layer_snapshot_free(&layer);
+    guac_mem_free(layer.pending_frame_cells);
+
+}
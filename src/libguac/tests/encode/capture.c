@@ -0,0 +1,88 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "encode-capture.h"
+
+#include <CUnit/CUnit.h>
+#include <string.h>
+
+/**
+ * Test which verifies that guac_encode_capture_append() accumulates all
+ * appended data, in order, across multiple calls that require the buffer to
+ * grow.
+ */
+void test_encode__capture_append() {
+
+    unsigned char data[10000];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = (unsigned char) (i * 7);
+
+    guac_encode_capture capture;
+    guac_encode_capture_init(&capture, sizeof(data));
+
+    guac_encode_capture_append(&capture, data, 3000);
+    guac_encode_capture_append(&capture, data + 3000, 7000);
+
+    CU_ASSERT_FALSE(capture.overflow);
+    CU_ASSERT_EQUAL(capture.length, sizeof(data));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(capture.buffer);
+    CU_ASSERT_EQUAL(memcmp(capture.buffer, data, sizeof(data)), 0);
+
+    guac_encode_capture_free(&capture);
+    CU_ASSERT_PTR_NULL(capture.buffer);
+
+}
+
+/**
+ * Test which verifies that exceeding the maximum length of a
+ * guac_encode_capture discards all captured data and causes further appends
+ * to be ignored.
+ */
+void test_encode__capture_overflow() {
+
+    unsigned char data[100] = { 0 };
+
+    guac_encode_capture capture;
+    guac_encode_capture_init(&capture, 150);
+
+    guac_encode_capture_append(&capture, data, sizeof(data));
+    CU_ASSERT_FALSE(capture.overflow);
+
+    guac_encode_capture_append(&capture, data, sizeof(data));
+    CU_ASSERT_TRUE(capture.overflow);
+    CU_ASSERT_PTR_NULL(capture.buffer);
+    CU_ASSERT_EQUAL(capture.length, 0);
+
+    guac_encode_capture_append(&capture, data, 10);
+    CU_ASSERT_PTR_NULL(capture.buffer);
+    CU_ASSERT_EQUAL(capture.length, 0);
+
+    guac_encode_capture_free(&capture);
+
+}
+
+/**
+ * Test which verifies that guac_encode_capture_append() silently ignores a
+ * NULL guac_encode_capture.
+ */
+void test_encode__capture_null() {
+    unsigned char data[16] = { 0 };
+    guac_encode_capture_append(NULL, data, sizeof(data));
+}
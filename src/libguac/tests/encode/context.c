@@ -0,0 +1,74 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "encode-context.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Test which verifies that guac_encode_context_reserve() allocates at least
+ * the requested number of elements, retaining the same buffer for requests
+ * that fit within the current allocation and replacing it only for larger
+ * requests.
+ */
+void test_encode__context_reserve() {
+
+    guac_encode_context context;
+    guac_encode_context_init(&context);
+
+    CU_ASSERT_PTR_NULL(context.png_indices);
+    CU_ASSERT_EQUAL(context.png_indices_size, 0);
+
+    /* Initial request allocates a buffer that is entirely writable */
+    context.png_indices = guac_encode_context_reserve(context.png_indices,
+            &context.png_indices_size, 5000, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(context.png_indices);
+    CU_ASSERT_TRUE(context.png_indices_size >= 5000);
+    memset(context.png_indices, 0xAA, 5000);
+
+    /* Smaller requests reuse the existing buffer */
+    unsigned char* original = context.png_indices;
+    size_t original_size = context.png_indices_size;
+    context.png_indices = guac_encode_context_reserve(context.png_indices,
+            &context.png_indices_size, 100, 1);
+    CU_ASSERT_PTR_EQUAL(context.png_indices, original);
+    CU_ASSERT_EQUAL(context.png_indices_size, original_size);
+
+    /* Larger requests grow the buffer */
+    context.png_indices = guac_encode_context_reserve(context.png_indices,
+            &context.png_indices_size, original_size + 1, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(context.png_indices);
+    CU_ASSERT_TRUE(context.png_indices_size > original_size);
+    memset(context.png_indices, 0x55, original_size + 1);
+
+    /* Element sizes other than one byte are accounted for */
+    context.png_rows = guac_encode_context_reserve(context.png_rows,
+            &context.png_rows_size, 3000, sizeof(unsigned char*));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(context.png_rows);
+    CU_ASSERT_TRUE(context.png_rows_size >= 3000);
+    memset(context.png_rows, 0, 3000 * sizeof(unsigned char*));
+
+    guac_encode_context_free(&context);
+    CU_ASSERT_PTR_NULL(context.png_indices);
+    CU_ASSERT_PTR_NULL(context.png_rows);
+
+}
+
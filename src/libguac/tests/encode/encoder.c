@@ -0,0 +1,55 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "encoder-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/encoder.h>
+#include <guacamole/error.h>
+#include <string.h>
+
+/**
+ * Test which verifies that guac_encoder_load() fails cleanly if the requested
+ * encoder backend is not installed or its name is invalid, leaving software
+ * encoding in use.
+ */
+void test_encode__encoder_load_missing() {
+
+    char long_name[512];
+    memset(long_name, 'x', sizeof(long_name) - 1);
+    long_name[sizeof(long_name) - 1] = '\0';
+
+    CU_ASSERT_NOT_EQUAL(guac_encoder_load("test-nonexistent"), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_NOT_FOUND);
+
+    CU_ASSERT_NOT_EQUAL(guac_encoder_load(long_name), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_NO_MEMORY);
+
+    /* With no backend loaded, callers must always fall back to software */
+    CU_ASSERT(guac_encoder_jpeg_write(NULL, NULL, NULL, 90, NULL) < 0);
+    CU_ASSERT(guac_encoder_webp_write(NULL, NULL, NULL, 90, 0, NULL) < 0);
+    CU_ASSERT_PTR_NULL(guac_encoder_video_mimetype());
+    CU_ASSERT_PTR_NULL(guac_encoder_video_begin(640, 480));
+
+    /* Unloading without any loaded backend has no effect */
+    guac_encoder_unload();
+
+}
+
@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "palette.h"
+
+#include <CUnit/CUnit.h>
+#include <cairo/cairo.h>
+#include <stdint.h>
+
+/**
+ * The width of each test surface, in pixels. This is deliberately not a
+ * multiple of four so that rows of the surface are padded while rows of the
+ * produced index buffer are not.
+ */
+#define TEST_WIDTH 19
+
+/**
+ * The height of each test surface, in pixels.
+ */
+#define TEST_HEIGHT 17
+
+/**
+ * Test which verifies that guac_palette_alloc_indexed() produces an index
+ * for every pixel which refers to that pixel's color within the palette,
+ * regardless of the contents of the unused alpha channel.
+ */
+void test_encode__palette_indexed() {
+
+    int stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, TEST_WIDTH);
+    unsigned char data[TEST_HEIGHT * stride];
+    unsigned char indices[TEST_WIDTH * TEST_HEIGHT];
+
+    /* Horizontal runs of four colors, with garbage in the alpha byte */
+    for (int y = 0; y < TEST_HEIGHT; y++) {
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        for (int x = 0; x < TEST_WIDTH; x++)
+            row[x] = ((x / 5 + y) & 0x3) * 0x102030 | ((x * y) << 24);
+    }
+
+    cairo_surface_t* surface = cairo_image_surface_create_for_data(data,
+            CAIRO_FORMAT_RGB24, TEST_WIDTH, TEST_HEIGHT, stride);
+
+    guac_palette* palette = guac_palette_alloc_indexed(surface, indices);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(palette);
+    CU_ASSERT_EQUAL(palette->size, 4);
+
+    for (int y = 0; y < TEST_HEIGHT; y++) {
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        for (int x = 0; x < TEST_WIDTH; x++) {
+
+            int color = row[x] & 0xFFFFFF;
+            int index = indices[y * TEST_WIDTH + x];
+
+            CU_ASSERT_EQUAL(index, guac_palette_find(palette, color));
+
+            png_color* entry = &palette->colors[index];
+            CU_ASSERT_EQUAL(entry->red,   (color >> 16) & 0xFF);
+            CU_ASSERT_EQUAL(entry->green, (color >> 8) & 0xFF);
+            CU_ASSERT_EQUAL(entry->blue,  color & 0xFF);
+
+        }
+    }
+
+    guac_palette_free(palette);
+    cairo_surface_destroy(surface);
+
+}
+
+/**
+ * Test which verifies that guac_palette_alloc_indexed() fails if the surface
+ * contains more colors than a palette can hold.
+ */
+void test_encode__palette_overflow() {
+
+    int stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, TEST_WIDTH);
+    unsigned char data[TEST_HEIGHT * stride];
+    unsigned char indices[TEST_WIDTH * TEST_HEIGHT];
+
+    /* Every pixel a distinct color (323 colors total) */
+    for (int y = 0; y < TEST_HEIGHT; y++) {
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        for (int x = 0; x < TEST_WIDTH; x++)
+            row[x] = y * TEST_WIDTH + x;
+    }
+
+    cairo_surface_t* surface = cairo_image_surface_create_for_data(data,
+            CAIRO_FORMAT_RGB24, TEST_WIDTH, TEST_HEIGHT, stride);
+
+    CU_ASSERT_PTR_NULL(guac_palette_alloc_indexed(surface, indices));
+    CU_ASSERT_PTR_NULL(guac_palette_alloc(surface));
+
+    cairo_surface_destroy(surface);
+
+}
+
@@ -0,0 +1,304 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/fifo-lockfree.h>
+#include <guacamole/timestamp.h>
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * The maximum number of items permitted in the FIFO under test. This is
+ * deliberately small (and not a power of two) such that the FIFO is
+ * frequently full.
+ */
+#define TEST_MAX_ITEMS 7
+
+/**
+ * The number of threads adding items to the FIFO under test.
+ */
+#define TEST_PRODUCERS 4
+
+/**
+ * The number of threads removing items from the FIFO under test.
+ */
+#define TEST_CONSUMERS 4
+
+/**
+ * The number of items added by each producer thread.
+ */
+#define TEST_ITEMS_PER_PRODUCER 20000
+
+/**
+ * The maximum number of milliseconds that a consumer thread will wait for
+ * further items before assuming that all items have been received.
+ */
+#define TEST_TIMEOUT 250
+
+/**
+ * A single item within the FIFO under test.
+ */
+typedef struct test_item {
+
+    /**
+     * The index of the producer thread that added this item.
+     */
+    int producer;
+
+    /**
+     * The zero-based sequence number of this item relative to all other
+     * items added by the same producer thread.
+     */
+    int sequence;
+
+} test_item;
+
+/**
+ * A guac_fifo_lockfree along with the storage required for its items.
+ */
+typedef struct test_fifo {
+
+    /**
+     * The FIFO under test.
+     */
+    guac_fifo_lockfree base;
+
+    /**
+     * Storage for all items in the FIFO.
+     */
+    test_item items[TEST_MAX_ITEMS];
+
+    /**
+     * Storage for the sequence numbers of each item in the FIFO.
+     */
+    size_t sequences[TEST_MAX_ITEMS];
+
+} test_fifo;
+
+/**
+ * The state of a single consumer thread.
+ */
+typedef struct test_consumer {
+
+    /**
+     * The FIFO that items should be removed from.
+     */
+    test_fifo* fifo;
+
+    /**
+     * The number of items received from each producer thread.
+     */
+    int received[TEST_PRODUCERS];
+
+    /**
+     * Non-zero if any item was received out of order relative to other items
+     * from the same producer.
+     */
+    int out_of_order;
+
+} test_consumer;
+
+/**
+ * The state of a single producer thread.
+ */
+typedef struct test_producer {
+
+    /**
+     * The FIFO that items should be added to.
+     */
+    test_fifo* fifo;
+
+    /**
+     * The index of this producer thread.
+     */
+    int index;
+
+} test_producer;
+
+/**
+ * Thread which adds TEST_ITEMS_PER_PRODUCER items to the test FIFO.
+ *
+ * @param data
+ *     The test_producer describing the state of this producer.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* test_producer_thread(void* data) {
+
+    test_producer* producer = (test_producer*) data;
+
+    for (int i = 0; i < TEST_ITEMS_PER_PRODUCER; i++) {
+        test_item item = { .producer = producer->index, .sequence = i };
+        CU_ASSERT_TRUE(guac_fifo_lockfree_enqueue(&producer->fifo->base, &item));
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Thread which removes items from the test FIFO until no items have been
+ * received for TEST_TIMEOUT milliseconds, verifying that items from each
+ * producer are received in order.
+ *
+ * @param data
+ *     The test_consumer describing the state of this consumer.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* test_consumer_thread(void* data) {
+
+    test_consumer* consumer = (test_consumer*) data;
+    int last[TEST_PRODUCERS];
+
+    for (int i = 0; i < TEST_PRODUCERS; i++)
+        last[i] = -1;
+
+    test_item item;
+    while (guac_fifo_lockfree_timed_dequeue(&consumer->fifo->base, &item, TEST_TIMEOUT)) {
+
+        if (item.sequence <= last[item.producer])
+            consumer->out_of_order = 1;
+
+        last[item.producer] = item.sequence;
+        consumer->received[item.producer]++;
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Verifies that every item added to a guac_fifo_lockfree by several
+ * concurrent producers is removed exactly once by several concurrent
+ * consumers, with the items of each producer removed in the order they were
+ * added.
+ */
+void test_fifo__lockfree_mpmc() {
+
+    test_fifo fifo;
+    guac_fifo_lockfree_init(&fifo.base, fifo.items, fifo.sequences,
+            TEST_MAX_ITEMS, sizeof(test_item));
+
+    test_producer producers[TEST_PRODUCERS];
+    test_consumer consumers[TEST_CONSUMERS] = { 0 };
+    pthread_t producer_threads[TEST_PRODUCERS];
+    pthread_t consumer_threads[TEST_CONSUMERS];
+
+    for (int i = 0; i < TEST_CONSUMERS; i++) {
+        consumers[i].fifo = &fifo;
+        CU_ASSERT_FALSE_FATAL(pthread_create(&consumer_threads[i], NULL,
+                    test_consumer_thread, &consumers[i]));
+    }
+
+    for (int i = 0; i < TEST_PRODUCERS; i++) {
+        producers[i].fifo = &fifo;
+        producers[i].index = i;
+        CU_ASSERT_FALSE_FATAL(pthread_create(&producer_threads[i], NULL,
+                    test_producer_thread, &producers[i]));
+    }
+
+    for (int i = 0; i < TEST_PRODUCERS; i++)
+        CU_ASSERT_FALSE(pthread_join(producer_threads[i], NULL));
+
+    for (int i = 0; i < TEST_CONSUMERS; i++)
+        CU_ASSERT_FALSE(pthread_join(consumer_threads[i], NULL));
+
+    /* Every item must have been received exactly once, in order */
+    for (int producer = 0; producer < TEST_PRODUCERS; producer++) {
+
+        int total = 0;
+        for (int i = 0; i < TEST_CONSUMERS; i++)
+            total += consumers[i].received[producer];
+
+        CU_ASSERT_EQUAL(total, TEST_ITEMS_PER_PRODUCER);
+
+    }
+
+    for (int i = 0; i < TEST_CONSUMERS; i++)
+        CU_ASSERT_FALSE(consumers[i].out_of_order);
+
+    guac_fifo_lockfree_destroy(&fifo.base);
+
+}
+
+/**
+ * Thread which attempts to remove a single item from the given test FIFO,
+ * blocking indefinitely.
+ *
+ * @param data
+ *     The test_fifo to remove an item from.
+ *
+ * @return
+ *     Non-NULL if an item was removed, NULL otherwise.
+ */
+static void* test_blocked_consumer_thread(void* data) {
+
+    test_fifo* fifo = (test_fifo*) data;
+    test_item item;
+
+    return guac_fifo_lockfree_dequeue(&fifo->base, &item) ? data : NULL;
+
+}
+
+/**
+ * Verifies that a timed dequeue from an empty guac_fifo_lockfree fails once
+ * the timeout elapses, and that invalidating the FIFO wakes any thread
+ * blocked waiting for an item.
+ */
+void test_fifo__lockfree_timeout_invalidate() {
+
+    test_fifo fifo;
+    test_item item = { 0 };
+    guac_fifo_lockfree_init(&fifo.base, fifo.items, fifo.sequences,
+            TEST_MAX_ITEMS, sizeof(test_item));
+
+    /* An empty FIFO times out */
+    guac_timestamp start = guac_timestamp_current();
+    CU_ASSERT_FALSE(guac_fifo_lockfree_timed_dequeue(&fifo.base, &item, 50));
+    CU_ASSERT(guac_timestamp_current() - start >= 40);
+
+    /* A zero timeout never blocks, but still succeeds if non-empty */
+    CU_ASSERT_FALSE(guac_fifo_lockfree_timed_dequeue(&fifo.base, &item, 0));
+    CU_ASSERT_TRUE(guac_fifo_lockfree_enqueue(&fifo.base, &item));
+    CU_ASSERT_TRUE(guac_fifo_lockfree_timed_dequeue(&fifo.base, &item, 0));
+
+    /* Invalidation wakes blocked consumers, which then fail */
+    pthread_t consumer_thread;
+    CU_ASSERT_FALSE_FATAL(pthread_create(&consumer_thread, NULL,
+                test_blocked_consumer_thread, &fifo));
+
+    guac_timestamp_msleep(50);
+    guac_fifo_lockfree_invalidate(&fifo.base);
+
+    void* result;
+    CU_ASSERT_FALSE(pthread_join(consumer_thread, &result));
+    CU_ASSERT_PTR_NULL(result);
+
+    /* Nothing may be added to an invalid FIFO */
+    CU_ASSERT_FALSE(guac_fifo_lockfree_is_valid(&fifo.base));
+    CU_ASSERT_FALSE(guac_fifo_lockfree_enqueue(&fifo.base, &item));
+
+    guac_fifo_lockfree_destroy(&fifo.base);
+
+}
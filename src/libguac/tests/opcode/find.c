@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/opcode.h>
+
+#include <stddef.h>
+
+/**
+ * An arbitrary entry of a table of instruction handlers, beginning with the
+ * opcode of that entry as required by guac_opcode_index.
+ */
+typedef struct test_opcode_entry {
+
+    /**
+     * The opcode associated with this entry.
+     */
+    const char* opcode;
+
+    /**
+     * An arbitrary value associated with this entry.
+     */
+    int value;
+
+} test_opcode_entry;
+
+/**
+ * A NULL-terminated table of entries, with opcodes matching those of the
+ * standard instruction handlers of libguac.
+ */
+static test_opcode_entry test_opcode_table[] = {
+    { "sync",       0  }, { "touch",      1  }, { "mouse",      2  },
+    { "key",        3  }, { "clipboard",  4  }, { "disconnect", 5  },
+    { "size",       6  }, { "file",       7  }, { "pipe",       8  },
+    { "ack",        9  }, { "blob",       10 }, { "end",        11 },
+    { "get",        12 }, { "put",        13 }, { "audio",      14 },
+    { "argv",       15 }, { "nop",        16 }, { "select",     17 },
+    { "connect",    18 }, { "image",      19 }, { "timezone",   20 },
+    { "name",       21 }, { NULL,         -1 }
+};
+
+/**
+ * Test which verifies that every entry of an indexed table can be found by
+ * its opcode, and that opcodes not present within the table are not found.
+ */
+void test_opcode__find() {
+
+    guac_opcode_index index;
+    guac_opcode_index_init(&index, test_opcode_table,
+            sizeof(test_opcode_entry));
+
+    /* Every entry must be found, and must be the entry itself */
+    for (test_opcode_entry* current = test_opcode_table;
+            current->opcode != NULL; current++) {
+        const test_opcode_entry* found = guac_opcode_index_find(&index,
+                test_opcode_table, sizeof(test_opcode_entry),
+                current->opcode);
+        CU_ASSERT_PTR_EQUAL(found, current);
+    }
+
+    /* Opcodes not present (including prefixes and extensions of present
+     * opcodes) must not be found */
+    CU_ASSERT_PTR_NULL(guac_opcode_index_find(&index, test_opcode_table,
+            sizeof(test_opcode_entry), ""));
+    CU_ASSERT_PTR_NULL(guac_opcode_index_find(&index, test_opcode_table,
+            sizeof(test_opcode_entry), "syn"));
+    CU_ASSERT_PTR_NULL(guac_opcode_index_find(&index, test_opcode_table,
+            sizeof(test_opcode_entry), "syncs"));
+    CU_ASSERT_PTR_NULL(guac_opcode_index_find(&index, test_opcode_table,
+            sizeof(test_opcode_entry), "Sync"));
+    CU_ASSERT_PTR_NULL(guac_opcode_index_find(&index, test_opcode_table,
+            sizeof(test_opcode_entry), "unknown"));
+
+}
+
+/**
+ * Test which verifies that an index of a table containing no entries other
+ * than the terminating entry never finds any opcode.
+ */
+void test_opcode__find_empty() {
+
+    test_opcode_entry empty[] = { { NULL, -1 } };
+
+    guac_opcode_index index;
+    guac_opcode_index_init(&index, empty, sizeof(test_opcode_entry));
+
+    CU_ASSERT_PTR_NULL(guac_opcode_index_find(&index, empty,
+            sizeof(test_opcode_entry), "sync"));
+    CU_ASSERT_PTR_NULL(guac_opcode_index_find(&index, empty,
+            sizeof(test_opcode_entry), ""));
+
+}
+
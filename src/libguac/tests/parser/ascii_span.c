@@ -0,0 +1,119 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "parser-ascii.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/parser.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Test which verifies that the ASCII scanning implementation selected for the
+ * current CPU by guac_parser_get_ascii_span() produces results identical to
+ * the scalar reference implementation, for non-ASCII bytes at every position
+ * and for every length.
+ */
+void test_parser__ascii_span_matches_scalar() {
+
+    char buffer[100];
+    guac_parser_ascii_span_function* ascii_span = guac_parser_get_ascii_span();
+
+    for (size_t position = 0; position <= sizeof(buffer); position++) {
+
+        memset(buffer, 'A', sizeof(buffer));
+        if (position < sizeof(buffer))
+            buffer[position] = (char) 0xC3;
+
+        for (size_t length = 0; length <= sizeof(buffer); length++) {
+            size_t expected = guac_parser_ascii_span_scalar(buffer, length);
+            CU_ASSERT_EQUAL_FATAL(ascii_span(buffer, length), expected);
+            CU_ASSERT_EQUAL_FATAL(expected, position < length ? position : length);
+        }
+
+    }
+
+}
+
+/**
+ * Test which verifies that guac_parser correctly parses instructions
+ * containing long elements of both ASCII and multibyte UTF-8 characters, no
+ * matter where the data passed to guac_parser_append() is split.
+ */
+void test_parser__append_long_elements() {
+
+    /* 300 ASCII characters, followed by 60 characters mixing ASCII with two-
+     * and three-byte characters */
+    char ascii[301];
+    char mixed[20 * (1 + 2 + 3) + 1];
+    memset(ascii, 'x', 300);
+    ascii[300] = '\0';
+
+    char* current = mixed;
+    for (int i = 0; i < 20; i++) {
+        memcpy(current, "a\xc3\xa1\xe2\x82\xac", 6);
+        current += 6;
+    }
+    *current = '\0';
+
+    char instruction[512];
+    int length = snprintf(instruction, sizeof(instruction),
+            "4.blob,300.%s,60.%s;", ascii, mixed);
+
+    for (int split = 1; split < length; split++) {
+
+        char buffer[512];
+        memcpy(buffer, instruction, length);
+
+        guac_parser* parser = guac_parser_alloc();
+        CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+        /* Parse first portion, then everything that remains */
+        int offset = 0;
+        int end = split;
+        while (parser->state != GUAC_PARSE_COMPLETE
+                && parser->state != GUAC_PARSE_ERROR) {
+
+            int parsed = guac_parser_append(parser, buffer + offset, end - offset);
+            offset += parsed;
+
+            if (parsed == 0) {
+                if (end == length)
+                    break;
+                end = length;
+            }
+
+        }
+
+        CU_ASSERT_EQUAL_FATAL(parser->state, GUAC_PARSE_COMPLETE);
+        CU_ASSERT_EQUAL(offset, length);
+        CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+        CU_ASSERT_STRING_EQUAL(parser->opcode, "blob");
+        CU_ASSERT_STRING_EQUAL(parser->argv[0], ascii);
+        CU_ASSERT_STRING_EQUAL(parser->argv[1], mixed);
+
+        guac_parser_free(parser);
+
+    }
+
+}
+
@@ -0,0 +1,154 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The number of characters within the large element of the test instruction,
+ * which exceeds GUAC_INSTRUCTION_MAX_LENGTH.
+ */
+#define TEST_ELEMENT_LENGTH 30000
+
+/**
+ * Allocates a buffer containing a "blob" instruction whose final element is
+ * TEST_ELEMENT_LENGTH characters long.
+ *
+ * @param length
+ *     Pointer to an int that should receive the length of the instruction, in
+ *     bytes, excluding the null terminator.
+ *
+ * @return
+ *     A newly-allocated, null-terminated buffer containing the instruction,
+ *     which must eventually be freed with guac_mem_free().
+ */
+static char* alloc_large_instruction(int* length) {
+
+    char* instruction = guac_mem_alloc(TEST_ELEMENT_LENGTH + 64);
+
+    int prefix = sprintf(instruction, "4.blob,1.0,%i.", TEST_ELEMENT_LENGTH);
+    memset(instruction + prefix, 'Q', TEST_ELEMENT_LENGTH);
+    strcpy(instruction + prefix + TEST_ELEMENT_LENGTH, ";");
+
+    *length = prefix + TEST_ELEMENT_LENGTH + 1;
+    return instruction;
+
+}
+
+/**
+ * Test which verifies that guac_parser rejects elements longer than
+ * GUAC_INSTRUCTION_MAX_LENGTH by default, and accepts them once the limit has
+ * been raised with guac_parser_set_max_length().
+ */
+void test_parser__max_length_append() {
+
+    int length;
+    char* instruction = alloc_large_instruction(&length);
+
+    /* Default limit rejects the instruction */
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    int offset = 0;
+    int parsed;
+    while ((parsed = guac_parser_append(parser, instruction + offset, length - offset)) > 0)
+        offset += parsed;
+
+    CU_ASSERT_EQUAL(parser->state, GUAC_PARSE_ERROR);
+    guac_parser_free(parser);
+    guac_mem_free(instruction);
+
+    /* Raised limit accepts the instruction (which must be regenerated, as the
+     * parser modifies the buffer in-place) */
+    instruction = alloc_large_instruction(&length);
+    parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+    CU_ASSERT_EQUAL(guac_parser_set_max_length(parser, TEST_ELEMENT_LENGTH), 0);
+
+    offset = 0;
+    while ((parsed = guac_parser_append(parser, instruction + offset, length - offset)) > 0)
+        offset += parsed;
+
+    CU_ASSERT_EQUAL_FATAL(parser->state, GUAC_PARSE_COMPLETE);
+    CU_ASSERT_EQUAL(offset, length);
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+    CU_ASSERT_EQUAL(strlen(parser->argv[1]), TEST_ELEMENT_LENGTH);
+
+    /* Limits outside the supported range are refused */
+    CU_ASSERT_NOT_EQUAL(guac_parser_set_max_length(parser, 0), 0);
+    CU_ASSERT_NOT_EQUAL(guac_parser_set_max_length(parser,
+                GUAC_INSTRUCTION_MAX_LENGTH_LIMIT + 1), 0);
+
+    guac_parser_free(parser);
+    guac_mem_free(instruction);
+
+}
+
+/**
+ * Test which verifies that raising the maximum element length of a guac_parser
+ * partway through reading an instruction from a guac_socket preserves the
+ * data already buffered, and allows the remainder of the instruction to be
+ * read.
+ */
+void test_parser__max_length_read() {
+
+    int length;
+    char* instruction = alloc_large_instruction(&length);
+
+    int fd[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    /* Send a short instruction followed by the large instruction. The entire
+     * data fits within the pipe, so no separate writer is needed. */
+    CU_ASSERT_EQUAL_FATAL(write(fd[1], "4.test,1.a;", 11), 11);
+    CU_ASSERT_EQUAL_FATAL(write(fd[1], instruction, length), length);
+    close(fd[1]);
+
+    guac_socket* socket = guac_socket_open(fd[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    /* The first read buffers the start of the large instruction */
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, socket, 1000000), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "test");
+    CU_ASSERT_NOT_EQUAL(guac_parser_length(parser), 0);
+
+    CU_ASSERT_EQUAL(guac_parser_set_max_length(parser, TEST_ELEMENT_LENGTH), 0);
+
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, socket, 1000000), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "blob");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "0");
+    CU_ASSERT_EQUAL(strlen(parser->argv[1]), TEST_ELEMENT_LENGTH);
+
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+    guac_mem_free(instruction);
+
+}
+
@@ -0,0 +1,73 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/error.h>
+#include <guacamole/parser.h>
+
+#include <string.h>
+
+/**
+ * Test which verifies that guac_parser_parse() reads consecutive Guacamole
+ * instructions directly from a buffer, with the parsed elements pointing into
+ * that buffer, and that a trailing partial instruction is reported as the end
+ * of the buffer.
+ */
+void test_parser__parse() {
+
+    /* Allocate parser */
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    /* Instruction input */
+    char buffer[] = "4.test,8.testdata,5.zxcvb;3.two,3.σπα;4.part,3.ial";
+    size_t length = strlen(buffer);
+
+    /* First instruction */
+    int parsed = guac_parser_parse(parser, buffer, length);
+    CU_ASSERT_EQUAL_FATAL(parsed, 26);
+    CU_ASSERT_EQUAL(parser->state, GUAC_PARSE_COMPLETE);
+    CU_ASSERT_PTR_EQUAL(parser->opcode, buffer + 2);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "test");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "testdata");
+    CU_ASSERT_STRING_EQUAL(parser->argv[1], "zxcvb");
+
+    /* Second instruction (containing multibyte characters) */
+    char* current = buffer + parsed;
+    length -= parsed;
+
+    parsed = guac_parser_parse(parser, current, length);
+    CU_ASSERT_EQUAL_FATAL(parsed, 15);
+    CU_ASSERT_EQUAL(parser->state, GUAC_PARSE_COMPLETE);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "two");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 1);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "σπα");
+
+    /* Incomplete final instruction */
+    current += parsed;
+    length -= parsed;
+
+    CU_ASSERT_EQUAL(guac_parser_parse(parser, current, length), -1);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_CLOSED);
+
+    guac_parser_free(parser);
+
+}
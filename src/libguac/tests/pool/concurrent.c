@@ -0,0 +1,143 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/pool.h>
+#include <pthread.h>
+
+/**
+ * The number of threads concurrently retrieving and freeing integers.
+ */
+#define TEST_THREADS 8
+
+/**
+ * The number of integers each thread retrieves and frees.
+ */
+#define TEST_ITERATIONS 20000
+
+/**
+ * The exclusive upper bound on integers retrieved from the pool under test,
+ * chosen to be smaller than the number of threads such that the limit is
+ * regularly reached.
+ */
+#define TEST_LIMIT 6
+
+/**
+ * State shared by all threads using the pool under test.
+ */
+typedef struct test_pool_state {
+
+    /**
+     * The pool under test.
+     */
+    guac_pool* pool;
+
+    /**
+     * The number of threads currently holding each integer. Each value must
+     * only be accessed atomically.
+     */
+    int holders[TEST_LIMIT];
+
+    /**
+     * Non-zero if any integer outside the limit was retrieved, or if any
+     * integer was held by more than one thread simultaneously. This value
+     * must only be accessed atomically.
+     */
+    int violated;
+
+} test_pool_state;
+
+/**
+ * Repeatedly retrieves an integer from the pool below TEST_LIMIT, verifies
+ * that no other thread holds the same integer, and frees that integer.
+ *
+ * @param data
+ *     The test_pool_state shared by all threads.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* test_pool_thread(void* data) {
+
+    test_pool_state* state = (test_pool_state*) data;
+
+    for (int i = 0; i < TEST_ITERATIONS; i++) {
+
+        int value = guac_pool_next_int_below(state->pool, TEST_LIMIT);
+
+        /* All integers may legitimately be in use by other threads */
+        if (value == -1)
+            continue;
+
+        if (value < 0 || value >= TEST_LIMIT) {
+            __atomic_store_n(&state->violated, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        if (__atomic_add_fetch(&state->holders[value], 1, __ATOMIC_SEQ_CST) != 1)
+            __atomic_store_n(&state->violated, 1, __ATOMIC_SEQ_CST);
+
+        __atomic_sub_fetch(&state->holders[value], 1, __ATOMIC_SEQ_CST);
+        guac_pool_free_int(state->pool, value);
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Test which verifies that guac_pool never provides the same integer to more
+ * than one thread at a time, and never exceeds the limit given to
+ * guac_pool_next_int_below(), even when many threads retrieve and free
+ * integers concurrently.
+ */
+void test_pool__concurrent() {
+
+    test_pool_state state = { 0 };
+    pthread_t threads[TEST_THREADS];
+
+    state.pool = guac_pool_alloc(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(state.pool);
+
+    for (int i = 0; i < TEST_THREADS; i++)
+        CU_ASSERT_EQUAL_FATAL(pthread_create(&threads[i], NULL,
+                    test_pool_thread, &state), 0);
+
+    for (int i = 0; i < TEST_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    CU_ASSERT_FALSE(state.violated);
+    CU_ASSERT_EQUAL(state.pool->active, 0);
+
+    /* With every integer freed, all integers below the limit must again be
+     * available, and no further integers */
+    int seen[TEST_LIMIT] = { 0 };
+    for (int i = 0; i < TEST_LIMIT; i++) {
+        int value = guac_pool_next_int_below(state.pool, TEST_LIMIT);
+        CU_ASSERT_FATAL(value >= 0 && value < TEST_LIMIT);
+        CU_ASSERT_EQUAL(seen[value]++, 0);
+    }
+
+    CU_ASSERT_EQUAL(guac_pool_next_int_below(state.pool, TEST_LIMIT), -1);
+
+    guac_pool_free(state.pool);
+
+}
+
@@ -0,0 +1,170 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Test string which contains exactly four Unicode characters encoded in UTF-8.
+ * This particular test string uses several characters which encode to multiple
+ * bytes in UTF-8.
+ */
+#define UTF8_4 "\xe7\x8a\xac\xf0\x90\xac\x80z\xc3\xa1"
+
+/**
+ * A string of exactly 64 characters.
+ */
+#define STRING_64 "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+
+/**
+ * A string of exactly 320 characters, larger than the buffer used to build
+ * each instruction.
+ */
+#define STRING_320 STRING_64 STRING_64 STRING_64 STRING_64 STRING_64
+
+/**
+ * Writes a series of drawing instructions using a normal guac_socket wrapping
+ * the given file descriptor. The instructions written correspond to the
+ * instructions verified by read_expected_instructions(). The given file
+ * descriptor is automatically closed as a result of calling this function.
+ *
+ * @param fd
+ *     The file descriptor to write instructions to.
+ */
+static void write_instructions(int fd) {
+
+    guac_socket* socket = guac_socket_open(fd);
+
+    /* Write nothing if socket cannot be allocated (test will fail in parent
+     * process due to failure to read) */
+    if (socket == NULL) {
+        close(fd);
+        return;
+    }
+
+    guac_layer layer = { .index = -12 };
+    guac_layer buffer = { .index = 0 };
+    guac_stream stream = { .index = 3 };
+
+    guac_protocol_send_copy(socket, &layer, 0, -1, 1920, 1080,
+            GUAC_COMP_OVER, &buffer, 2147483647, -2147483647 - 1);
+    guac_protocol_send_rect(socket, &buffer, 10, 20, 300, 4000);
+    guac_protocol_send_cfill(socket, GUAC_COMP_SRC, &layer, 255, 128, 0, 255);
+    guac_protocol_send_transfer(socket, &buffer, 1, 2, 3, 4,
+            GUAC_TRANSFER_BINARY_XOR, &layer, 5, 6);
+    guac_protocol_send_img(socket, &stream, GUAC_COMP_OVER, &layer,
+            "image/" UTF8_4, 7, 8);
+    guac_protocol_send_img(socket, &stream, GUAC_COMP_OVER, &layer,
+            STRING_320, 9, 10);
+    guac_protocol_send_sync(socket, INT64_MAX, 0);
+    guac_protocol_send_sync(socket, INT64_MIN, 1);
+    guac_socket_flush(socket);
+
+    guac_socket_free(socket);
+
+}
+
+/**
+ * Reads raw bytes from the given file descriptor until no further bytes
+ * remain, verifying that those bytes represent the series of Guacamole
+ * instructions expected to be written by write_instructions(). The given
+ * file descriptor is automatically closed as a result of calling this
+ * function.
+ *
+ * @param fd
+ *     The file descriptor to read data from.
+ */
+static void read_expected_instructions(int fd) {
+
+    char expected[] =
+        "4.copy,3.-12,1.0,2.-1,4.1920,4.1080,2.14,1.0,10.2147483647,11.-2147483648;"
+        "4.rect,1.0,2.10,2.20,3.300,4.4000;"
+        "5.cfill,2.12,3.-12,3.255,3.128,1.0,3.255;"
+        "8.transfer,1.0,1.1,1.2,1.3,1.4,1.6,3.-12,1.5,1.6;"
+        "3.img,1.3,2.14,3.-12,10.image/" UTF8_4 ",1.7,1.8;"
+        "3.img,1.3,2.14,3.-12,320." STRING_320 ",1.9,2.10;"
+        "4.sync,19.9223372036854775807,1.0;"
+        "4.sync,20.-9223372036854775808,1.1;";
+
+    int numread;
+    char buffer[2048];
+    int offset = 0;
+
+    /* Read everything available into buffer */
+    while ((numread = read(fd, &(buffer[offset]),
+                    sizeof(buffer) - offset - 1)) > 0) {
+        offset += numread;
+    }
+
+    /* Verify length of read data */
+    CU_ASSERT_EQUAL(offset, strlen(expected));
+
+    /* Add NULL terminator */
+    buffer[offset] = '\0';
+
+    /* Read value should be equal to expected value */
+    CU_ASSERT_STRING_EQUAL(buffer, expected);
+
+    /* File descriptor is no longer needed */
+    close(fd);
+
+}
+
+/**
+ * Tests that the drawing instructions built in memory by guac_protocol_send_*()
+ * are written exactly as if each element had been written separately,
+ * including negative and extreme integers, Unicode strings, and strings too
+ * large to be built in memory.
+ */
+void test_protocol__send_drawing() {
+
+    int fd[2];
+
+    /* Create pipe */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    int read_fd = fd[0];
+    int write_fd = fd[1];
+
+    /* Fork into writer process (child) and reader process (parent) */
+    int childpid;
+    CU_ASSERT_NOT_EQUAL_FATAL((childpid = fork()), -1);
+
+    /* Attempt to write a series of instructions within the child process */
+    if (childpid == 0) {
+        close(read_fd);
+        write_instructions(write_fd);
+        exit(0);
+    }
+
+    /* Read and verify the expected instructions within the parent process */
+    close(write_fd);
+    read_expected_instructions(read_fd);
+
+}
+
@@ -0,0 +1,168 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "recording-format.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/recording.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Writes the given data to a new temporary file, returning a file descriptor
+ * for that file open for reading at its beginning. The file is unlinked
+ * immediately, and is removed once the file descriptor is closed.
+ *
+ * @param data
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes of data to write.
+ *
+ * @return
+ *     A file descriptor for the new temporary file.
+ */
+static int write_temp_file(const unsigned char* data, size_t length) {
+
+    char path[] = "/tmp/guac-recording-events-test-XXXXXX";
+
+    int fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+    unlink(path);
+
+    CU_ASSERT_EQUAL_FATAL(write(fd, data, length), length);
+    CU_ASSERT_EQUAL_FATAL(lseek(fd, 0, SEEK_SET), 0);
+
+    return fd;
+
+}
+
+/**
+ * Test which verifies that key, mouse, and touch events written to an input
+ * event sidecar are read back intact and in order, that events of unknown
+ * type are skipped, and that a trailing partial record (as within an
+ * in-progress sidecar) is ignored.
+ */
+void test_recording__events_read() {
+
+    unsigned char data[GUAC_RECORDING_EVENTS_HEADER_LENGTH
+        + GUAC_RECORDING_EVENTS_RECORD_LENGTH * 4 + 7];
+
+    guac_recording_event key = {
+        .type = GUAC_RECORDING_EVENT_KEY,
+        .timestamp = 1700000000000,
+        .keysym = 0xFFE3,
+        .pressed = 1
+    };
+
+    guac_recording_event mouse = {
+        .type = GUAC_RECORDING_EVENT_MOUSE,
+        .timestamp = 1700000000010,
+        .x = 640,
+        .y = 480,
+        .button_mask = 5
+    };
+
+    guac_recording_event touch = {
+        .type = GUAC_RECORDING_EVENT_TOUCH,
+        .timestamp = 1700000000020,
+        .id = 3,
+        .x = -12,
+        .y = 34,
+        .x_radius = 5,
+        .y_radius = 6,
+        .angle = 45.5,
+        .force = 0.25
+    };
+
+    unsigned char* current = data;
+    memset(data, 0xFF, sizeof(data));
+
+    guac_recording_format_write_events_header(current);
+    current += GUAC_RECORDING_EVENTS_HEADER_LENGTH;
+
+    guac_recording_format_write_event(current, &key);
+    current += GUAC_RECORDING_EVENTS_RECORD_LENGTH;
+
+    /* Event of a type unknown to this version of libguac */
+    guac_recording_format_write_event(current, &mouse);
+    current[8] = 'X';
+    current += GUAC_RECORDING_EVENTS_RECORD_LENGTH;
+
+    guac_recording_format_write_event(current, &mouse);
+    current += GUAC_RECORDING_EVENTS_RECORD_LENGTH;
+
+    guac_recording_format_write_event(current, &touch);
+
+    int fd = write_temp_file(data, sizeof(data));
+
+    guac_recording_events* events = guac_recording_events_map(fd);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(events);
+
+    guac_recording_event event;
+
+    CU_ASSERT_EQUAL_FATAL(guac_recording_events_read(events, &event), 0);
+    CU_ASSERT_EQUAL(event.type, GUAC_RECORDING_EVENT_KEY);
+    CU_ASSERT_EQUAL(event.timestamp, key.timestamp);
+    CU_ASSERT_EQUAL(event.keysym, key.keysym);
+    CU_ASSERT_EQUAL(event.pressed, 1);
+
+    CU_ASSERT_EQUAL_FATAL(guac_recording_events_read(events, &event), 0);
+    CU_ASSERT_EQUAL(event.type, GUAC_RECORDING_EVENT_MOUSE);
+    CU_ASSERT_EQUAL(event.timestamp, mouse.timestamp);
+    CU_ASSERT_EQUAL(event.x, mouse.x);
+    CU_ASSERT_EQUAL(event.y, mouse.y);
+    CU_ASSERT_EQUAL(event.button_mask, mouse.button_mask);
+
+    CU_ASSERT_EQUAL_FATAL(guac_recording_events_read(events, &event), 0);
+    CU_ASSERT_EQUAL(event.type, GUAC_RECORDING_EVENT_TOUCH);
+    CU_ASSERT_EQUAL(event.timestamp, touch.timestamp);
+    CU_ASSERT_EQUAL(event.id, touch.id);
+    CU_ASSERT_EQUAL(event.x, touch.x);
+    CU_ASSERT_EQUAL(event.y, touch.y);
+    CU_ASSERT_EQUAL(event.x_radius, touch.x_radius);
+    CU_ASSERT_EQUAL(event.y_radius, touch.y_radius);
+    CU_ASSERT_DOUBLE_EQUAL(event.angle, touch.angle, 0.0001);
+    CU_ASSERT_DOUBLE_EQUAL(event.force, touch.force, 0.0001);
+
+    /* The trailing partial record must not be read */
+    CU_ASSERT_NOT_EQUAL(guac_recording_events_read(events, &event), 0);
+
+    guac_recording_events_unmap(events);
+
+}
+
+/**
+ * Test which verifies that files other than input event sidecars, such as
+ * raw recordings, are refused by guac_recording_events_map().
+ */
+void test_recording__events_reject() {
+
+    const char* recording = "4.sync,4.1000;";
+
+    int fd = write_temp_file((const unsigned char*) recording,
+            strlen(recording));
+
+    CU_ASSERT_PTR_NULL(guac_recording_events_map(fd));
+    close(fd);
+
+}
+
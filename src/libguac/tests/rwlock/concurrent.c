@@ -0,0 +1,214 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/rwlock.h>
+#include <pthread.h>
+
+/**
+ * The number of threads concurrently acquiring the lock under test.
+ */
+#define TEST_THREADS 8
+
+/**
+ * The number of times each thread acquires the lock under test.
+ */
+#define TEST_ITERATIONS 20000
+
+/**
+ * The number of iterations between each acquisition of the write lock. All
+ * other iterations acquire only the read lock.
+ */
+#define TEST_WRITE_INTERVAL 16
+
+/**
+ * State shared by all threads acquiring the lock under test.
+ */
+typedef struct test_rwlock_state {
+
+    /**
+     * The lock under test.
+     */
+    guac_rwlock lock;
+
+    /**
+     * The number of threads that currently believe they hold the read lock.
+     * This value must only be accessed atomically.
+     */
+    int readers;
+
+    /**
+     * The number of threads that currently believe they hold the write lock.
+     * This value must only be accessed atomically.
+     */
+    int writers;
+
+    /**
+     * A counter modified only while the write lock is held.
+     */
+    int writes;
+
+    /**
+     * Non-zero if any thread observed a reader and writer (or two writers)
+     * holding the lock simultaneously. This value must only be accessed
+     * atomically.
+     */
+    int violated;
+
+} test_rwlock_state;
+
+/**
+ * Verifies that no other thread holds the write lock while the current thread
+ * holds the read lock, recording any violation within the given state.
+ *
+ * @param state
+ *     The shared state of the test.
+ */
+static void test_rwlock_check_read(test_rwlock_state* state) {
+
+    __atomic_add_fetch(&state->readers, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&state->writers, __ATOMIC_SEQ_CST))
+        __atomic_store_n(&state->violated, 1, __ATOMIC_SEQ_CST);
+
+    __atomic_sub_fetch(&state->readers, 1, __ATOMIC_SEQ_CST);
+
+}
+
+/**
+ * Verifies that no other thread holds the read or write lock while the
+ * current thread holds the write lock, recording any violation within the
+ * given state.
+ *
+ * @param state
+ *     The shared state of the test.
+ */
+static void test_rwlock_check_write(test_rwlock_state* state) {
+
+    if (__atomic_add_fetch(&state->writers, 1, __ATOMIC_SEQ_CST) != 1
+            || __atomic_load_n(&state->readers, __ATOMIC_SEQ_CST))
+        __atomic_store_n(&state->violated, 1, __ATOMIC_SEQ_CST);
+
+    state->writes++;
+
+    __atomic_sub_fetch(&state->writers, 1, __ATOMIC_SEQ_CST);
+
+}
+
+/**
+ * Thread which repeatedly acquires the lock under test, mostly for reading,
+ * both directly and reentrantly. Every TEST_WRITE_INTERVAL iterations, the
+ * write lock is acquired, alternating between acquiring it directly and
+ * upgrading from a held read lock.
+ *
+ * @param data
+ *     The test_rwlock_state shared by all threads.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* test_rwlock_thread(void* data) {
+
+    test_rwlock_state* state = (test_rwlock_state*) data;
+
+    for (int i = 0; i < TEST_ITERATIONS; i++) {
+
+        /* Upgrade from a held read lock */
+        if (i % (TEST_WRITE_INTERVAL * 2) == 0) {
+            CU_ASSERT_EQUAL(guac_rwlock_acquire_read_lock(&state->lock), 0);
+            CU_ASSERT_EQUAL(guac_rwlock_acquire_write_lock(&state->lock), 0);
+            test_rwlock_check_write(state);
+            CU_ASSERT_EQUAL(guac_rwlock_release_lock(&state->lock), 0);
+            CU_ASSERT_EQUAL(guac_rwlock_release_lock(&state->lock), 0);
+        }
+
+        /* Acquire the write lock directly, reading reentrantly */
+        else if (i % TEST_WRITE_INTERVAL == 0) {
+            CU_ASSERT_EQUAL(guac_rwlock_acquire_write_lock(&state->lock), 0);
+            CU_ASSERT_EQUAL(guac_rwlock_acquire_read_lock(&state->lock), 0);
+            test_rwlock_check_write(state);
+            CU_ASSERT_EQUAL(guac_rwlock_release_lock(&state->lock), 0);
+            CU_ASSERT_EQUAL(guac_rwlock_release_lock(&state->lock), 0);
+        }
+
+        /* Read reentrantly */
+        else {
+            CU_ASSERT_EQUAL(guac_rwlock_acquire_read_lock(&state->lock), 0);
+            CU_ASSERT_EQUAL(guac_rwlock_acquire_read_lock(&state->lock), 0);
+            test_rwlock_check_read(state);
+            CU_ASSERT_EQUAL(guac_rwlock_release_lock(&state->lock), 0);
+            test_rwlock_check_read(state);
+            CU_ASSERT_EQUAL(guac_rwlock_release_lock(&state->lock), 0);
+        }
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Verifies that guac_rwlock never allows a writer to hold the lock at the
+ * same time as any other reader or writer, even when the lock is acquired
+ * reentrantly and upgraded from read to write by many concurrent threads.
+ */
+void test_rwlock__concurrent() {
+
+    test_rwlock_state state = { 0 };
+    guac_rwlock_init(&state.lock);
+
+    pthread_t threads[TEST_THREADS];
+    for (int i = 0; i < TEST_THREADS; i++)
+        CU_ASSERT_EQUAL_FATAL(pthread_create(&threads[i], NULL,
+                    test_rwlock_thread, &state), 0);
+
+    for (int i = 0; i < TEST_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    CU_ASSERT_FALSE(state.violated);
+    CU_ASSERT_EQUAL(state.writes,
+            TEST_THREADS * ((TEST_ITERATIONS + TEST_WRITE_INTERVAL - 1) / TEST_WRITE_INTERVAL));
+
+    guac_rwlock_destroy(&state.lock);
+
+}
+
+/**
+ * Verifies that releasing a guac_rwlock more times than it was acquired by
+ * the current thread fails, and that the lock remains usable afterwards.
+ */
+void test_rwlock__release_unheld() {
+
+    guac_rwlock lock;
+    guac_rwlock_init(&lock);
+
+    CU_ASSERT_NOT_EQUAL(guac_rwlock_release_lock(&lock), 0);
+
+    CU_ASSERT_EQUAL(guac_rwlock_acquire_read_lock(&lock), 0);
+    CU_ASSERT_EQUAL(guac_rwlock_release_lock(&lock), 0);
+    CU_ASSERT_NOT_EQUAL(guac_rwlock_release_lock(&lock), 0);
+
+    CU_ASSERT_EQUAL(guac_rwlock_acquire_write_lock(&lock), 0);
+    CU_ASSERT_EQUAL(guac_rwlock_release_lock(&lock), 0);
+    CU_ASSERT_NOT_EQUAL(guac_rwlock_release_lock(&lock), 0);
+
+    guac_rwlock_destroy(&lock);
+
+}
@@ -0,0 +1,237 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "socket-base64.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The number of bytes of random data to encode. This is intentionally not a
+ * multiple of three to ensure padding is also handled.
+ */
+#define TEST_DATA_LENGTH 3001
+
+/**
+ * The number of characters required to hold the base64 encoding of
+ * TEST_DATA_LENGTH bytes, including padding.
+ */
+#define TEST_ENCODED_LENGTH (((TEST_DATA_LENGTH + 2) / 3) * 4)
+
+/**
+ * Buffer receiving all data written by write_captured().
+ */
+static char captured[TEST_ENCODED_LENGTH];
+
+/**
+ * The number of bytes currently stored within the captured buffer.
+ */
+static size_t captured_length;
+
+/**
+ * guac_socket_write_handler which appends all data written to the captured
+ * buffer. As this socket defines no reserve_handler, writing base64 to this
+ * socket exercises the fallback path through guac_socket_write().
+ */
+static ssize_t write_captured(guac_socket* socket, const void* buf, size_t count) {
+
+    if (captured_length + count > sizeof(captured))
+        return -1;
+
+    memcpy(captured + captured_length, buf, count);
+    captured_length += count;
+    return count;
+
+}
+
+/**
+ * Fills the given buffer with random bytes, then writes those bytes as base64
+ * to the given socket in irregularly-sized pieces, such that partial groups of
+ * three bytes must be carried between writes.
+ *
+ * @param socket
+ *     The guac_socket to write to.
+ *
+ * @param data
+ *     A buffer of TEST_DATA_LENGTH bytes to populate with random data.
+ */
+static void write_random_base64(guac_socket* socket, unsigned char* data) {
+
+    srand(0x6236);
+    for (int i = 0; i < TEST_DATA_LENGTH; i++)
+        data[i] = rand();
+
+    size_t offset = 0;
+    size_t length = 1;
+    while (offset < TEST_DATA_LENGTH) {
+
+        if (length > TEST_DATA_LENGTH - offset)
+            length = TEST_DATA_LENGTH - offset;
+
+        CU_ASSERT_EQUAL(guac_socket_write_base64(socket, data + offset, length), 0);
+
+        offset += length;
+        length = (length * 7 + 1) % 97;
+
+    }
+
+    CU_ASSERT_EQUAL(guac_socket_flush_base64(socket), 0);
+
+}
+
+/**
+ * Produces the expected base64 encoding of the given TEST_DATA_LENGTH bytes
+ * using only the scalar reference implementation.
+ *
+ * @param data
+ *     The TEST_DATA_LENGTH bytes to encode.
+ *
+ * @param expected
+ *     A buffer of at least TEST_ENCODED_LENGTH characters to receive the
+ *     encoded data.
+ */
+static void encode_expected(const unsigned char* data, char* expected) {
+
+    size_t triplets = TEST_DATA_LENGTH / 3;
+    guac_socket_base64_encode_scalar(data, triplets, expected);
+
+    /* TEST_DATA_LENGTH leaves exactly one trailing byte, which is encoded as
+     * though followed by zeroes, with the unused characters as padding */
+    unsigned char last[3] = { data[triplets * 3], 0, 0 };
+    guac_socket_base64_encode_scalar(last, 1, expected + triplets * 4);
+    memcpy(expected + triplets * 4 + 2, "==", 2);
+
+}
+
+/**
+ * Test which verifies that the base64 implementation selected for the current
+ * CPU by guac_socket_get_base64_encode() produces results identical to the
+ * scalar reference implementation for every length up to a few vectors' worth
+ * of data.
+ */
+void test_socket__base64_encode_matches_scalar() {
+
+    unsigned char data[300];
+    char expected[400];
+    char actual[400];
+
+    srand(0x4236);
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = rand();
+
+    guac_socket_base64_encode_function* encode = guac_socket_get_base64_encode();
+
+    for (size_t triplets = 0; triplets <= sizeof(data) / 3; triplets++) {
+        guac_socket_base64_encode_scalar(data, triplets, expected);
+        encode(data, triplets, actual);
+        CU_ASSERT_EQUAL_FATAL(memcmp(expected, actual, triplets * 4), 0);
+    }
+
+}
+
+/**
+ * Test which verifies that guac_socket_write_base64() produces standard
+ * base64 (as defined by RFC 4648) when data is split across multiple writes.
+ */
+void test_socket__base64_write_split() {
+
+    captured_length = 0;
+
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->write_handler = write_captured;
+
+    CU_ASSERT_EQUAL(guac_socket_write_base64(socket, "fo", 2), 0);
+    CU_ASSERT_EQUAL(guac_socket_write_base64(socket, "oba", 3), 0);
+    CU_ASSERT_EQUAL(guac_socket_write_base64(socket, "r", 1), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush_base64(socket), 0);
+
+    CU_ASSERT_EQUAL(guac_socket_write_base64(socket, "fooba", 5), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush_base64(socket), 0);
+
+    CU_ASSERT_EQUAL(captured_length, 16);
+    CU_ASSERT_EQUAL(memcmp(captured, "Zm9vYmFyZm9vYmE=", 16), 0);
+
+    guac_socket_free(socket);
+
+}
+
+/**
+ * Test which verifies that base64 written to a socket lacking support for
+ * in-place writes is encoded correctly.
+ */
+void test_socket__base64_write_fallback() {
+
+    unsigned char data[TEST_DATA_LENGTH];
+    char expected[TEST_ENCODED_LENGTH];
+
+    captured_length = 0;
+
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->write_handler = write_captured;
+
+    write_random_base64(socket, data);
+    guac_socket_free(socket);
+
+    encode_expected(data, expected);
+    CU_ASSERT_EQUAL(captured_length, TEST_ENCODED_LENGTH);
+    CU_ASSERT_EQUAL(memcmp(captured, expected, TEST_ENCODED_LENGTH), 0);
+
+}
+
+/**
+ * Test which verifies that base64 written to a file descriptor socket, which
+ * supports in-place writes via guac_socket_reserve(), is encoded correctly.
+ */
+void test_socket__base64_write_fd() {
+
+    unsigned char data[TEST_DATA_LENGTH];
+    char expected[TEST_ENCODED_LENGTH];
+    char actual[TEST_ENCODED_LENGTH + 1];
+
+    int fd[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    guac_socket* socket = guac_socket_open(fd[1]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* The encoded data is small enough to fit entirely within the pipe, and
+     * thus can be written in full before being read back */
+    write_random_base64(socket, data);
+    guac_socket_free(socket);
+
+    size_t length = 0;
+    ssize_t retval;
+    while ((retval = read(fd[0], actual + length, sizeof(actual) - length)) > 0)
+        length += retval;
+
+    close(fd[0]);
+
+    encode_expected(data, expected);
+    CU_ASSERT_EQUAL(length, TEST_ENCODED_LENGTH);
+    CU_ASSERT_EQUAL(memcmp(actual, expected, TEST_ENCODED_LENGTH), 0);
+
+}
+
@@ -0,0 +1,194 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "socket-compact.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <string.h>
+
+/**
+ * All data written to the socket returned by open_capture_socket().
+ */
+static unsigned char captured[4096];
+
+/**
+ * The number of bytes within captured.
+ */
+static size_t captured_length;
+
+/**
+ * Write handler which appends all data written to captured.
+ *
+ * @param socket
+ *     The guac_socket being written to.
+ *
+ * @param buf
+ *     The data being written.
+ *
+ * @param count
+ *     The number of bytes being written.
+ *
+ * @return
+ *     The number of bytes written.
+ */
+static ssize_t capture_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    if (count > sizeof(captured) - captured_length)
+        count = sizeof(captured) - captured_length;
+
+    memcpy(captured + captured_length, buf, count);
+    captured_length += count;
+    return count;
+
+}
+
+/**
+ * Returns a new guac_socket which stores everything written to it within
+ * captured, resetting captured.
+ *
+ * @return
+ *     A newly-allocated guac_socket which writes to captured.
+ */
+static guac_socket* open_capture_socket() {
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->write_handler = capture_write_handler;
+
+    captured_length = 0;
+    return socket;
+
+}
+
+/**
+ * Returns the index of the given opcode within guac_socket_compact_opcodes.
+ *
+ * @param opcode
+ *     The opcode to locate.
+ *
+ * @return
+ *     The index of the given opcode, or -1 if the opcode is not present.
+ */
+static int opcode_index(const char* opcode) {
+
+    for (int i = 0; guac_socket_compact_opcodes[i] != NULL; i++) {
+        if (strcmp(guac_socket_compact_opcodes[i], opcode) == 0)
+            return i;
+    }
+
+    return -1;
+
+}
+
+/**
+ * Verifies that instructions written to a compact socket are translated into
+ * their compact form, with common opcodes replaced by indexes, integers sent
+ * as zigzag varints, and blob data sent as raw bytes.
+ */
+void test_socket__compact_translate() {
+
+    guac_socket* capture = open_capture_socket();
+    guac_socket* socket = guac_socket_open_compact(capture);
+
+    guac_layer layer = { .index = -1 };
+    guac_stream stream = { .index = 2 };
+
+    guac_protocol_send_rect(socket, &layer, 0, 64, 300, 0);
+    guac_protocol_send_blob(socket, &stream, "abcd", 4);
+    guac_protocol_send_name(socket, "007");
+    guac_socket_flush(socket);
+
+    unsigned char expected[] = {
+
+        /* 4.rect,2.-1,1.0,2.64,3.300,1.0; */
+        GUAC_SOCKET_COMPACT_OPCODE, opcode_index("rect"),
+        GUAC_SOCKET_COMPACT_INT, 0x01,
+        GUAC_SOCKET_COMPACT_INT, 0x00,
+        GUAC_SOCKET_COMPACT_INT, 0x80, 0x01,
+        GUAC_SOCKET_COMPACT_INT, 0xD8, 0x04,
+        GUAC_SOCKET_COMPACT_INT, 0x00,
+        GUAC_SOCKET_COMPACT_END,
+
+        /* 4.blob,1.2,8.YWJjZA==; */
+        GUAC_SOCKET_COMPACT_OPCODE, opcode_index("blob"),
+        GUAC_SOCKET_COMPACT_INT, 0x04,
+        GUAC_SOCKET_COMPACT_BLOB, 0x04, 'a', 'b', 'c', 'd',
+        GUAC_SOCKET_COMPACT_END,
+
+        /* 4.name,3.007; (not a canonical integer) */
+        GUAC_SOCKET_COMPACT_OPCODE, opcode_index("name"),
+        GUAC_SOCKET_COMPACT_STRING, 0x03, '0', '0', '7',
+        GUAC_SOCKET_COMPACT_END
+
+    };
+
+    CU_ASSERT_EQUAL(captured_length, sizeof(expected));
+    CU_ASSERT_EQUAL(memcmp(captured, expected, sizeof(expected)), 0);
+
+    guac_socket_free(socket);
+    guac_socket_free(capture);
+
+}
+
+/**
+ * Verifies that elements which cannot be reproduced exactly from a compact
+ * integer or raw data, as well as unknown opcodes and multibyte characters
+ * split across writes, are sent as strings.
+ */
+void test_socket__compact_strings() {
+
+    guac_socket* capture = open_capture_socket();
+    guac_socket* socket = guac_socket_open_compact(capture);
+
+    /* Unknown opcode, "-0", non-canonical base64, and a two-character
+     * string containing a multibyte character, split mid-character */
+    guac_socket_write_string(socket, "3.foo,2.-0;4.blob,1.0,4.YR==;2.\xc3");
+    guac_socket_write_string(socket, "\xa1z;");
+    guac_socket_flush(socket);
+
+    unsigned char expected[] = {
+
+        GUAC_SOCKET_COMPACT_STRING, 0x03, 'f', 'o', 'o',
+        GUAC_SOCKET_COMPACT_STRING, 0x02, '-', '0',
+        GUAC_SOCKET_COMPACT_END,
+
+        GUAC_SOCKET_COMPACT_OPCODE, opcode_index("blob"),
+        GUAC_SOCKET_COMPACT_INT, 0x00,
+        GUAC_SOCKET_COMPACT_STRING, 0x04, 'Y', 'R', '=', '=',
+        GUAC_SOCKET_COMPACT_END,
+
+        GUAC_SOCKET_COMPACT_STRING, 0x03, 0xC3, 0xA1, 'z',
+        GUAC_SOCKET_COMPACT_END
+
+    };
+
+    CU_ASSERT_EQUAL(captured_length, sizeof(expected));
+    CU_ASSERT_EQUAL(memcmp(captured, expected, sizeof(expected)), 0);
+
+    guac_socket_free(socket);
+    guac_socket_free(capture);
+
+}
+
@@ -0,0 +1,121 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The bandwidth limit applied to the socket under test, in bytes per second.
+ */
+#define TEST_BANDWIDTH_LIMIT 40000
+
+/**
+ * The size of each block of data written to the socket under test.
+ */
+#define TEST_BLOCK_SIZE 10000
+
+/**
+ * The number of blocks of data written to the socket under test.
+ */
+#define TEST_BLOCK_COUNT 10
+
+/**
+ * The data received from the read end of the pipe.
+ */
+static char received[TEST_BLOCK_SIZE * TEST_BLOCK_COUNT + 1];
+
+/**
+ * The number of bytes stored within received.
+ */
+static size_t received_length;
+
+/**
+ * Thread which reads all data from the read end of a pipe until end-of-file,
+ * storing that data within received.
+ *
+ * @param data
+ *     A pointer to the file descriptor of the read end of the pipe.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* read_thread(void* data) {
+
+    int fd = *((int*) data);
+    ssize_t retval;
+
+    received_length = 0;
+    while ((retval = read(fd, received + received_length,
+                    sizeof(received) - received_length)) > 0)
+        received_length += retval;
+
+    return NULL;
+
+}
+
+/**
+ * Test which verifies that a guac_socket whose bandwidth is limited writes
+ * all data intact, but takes no less time to do so than the limit allows
+ * beyond the initial one-second burst.
+ */
+void test_socket__fd_bandwidth_limit() {
+
+    static char block[TEST_BLOCK_SIZE];
+
+    int fd[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    pthread_t reader;
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&reader, NULL, read_thread, &fd[0]), 0);
+
+    guac_socket* socket = guac_socket_open(fd[1]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    guac_socket_limit_bandwidth(socket, TEST_BANDWIDTH_LIMIT);
+
+    guac_timestamp start = guac_timestamp_current();
+
+    for (int i = 0; i < TEST_BLOCK_COUNT; i++) {
+        memset(block, 'A' + i, sizeof(block));
+        CU_ASSERT_EQUAL(guac_socket_write(socket, block, sizeof(block)), 0);
+        CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+    }
+
+    guac_timestamp elapsed = guac_timestamp_current() - start;
+    guac_socket_free(socket);
+    pthread_join(reader, NULL);
+    close(fd[0]);
+
+    /* Everything but the initial burst and final block must be paced */
+    int minimum = (TEST_BLOCK_SIZE * (TEST_BLOCK_COUNT - 1)
+            - TEST_BANDWIDTH_LIMIT) * 1000 / TEST_BANDWIDTH_LIMIT;
+    CU_ASSERT(elapsed >= minimum);
+
+    CU_ASSERT_EQUAL_FATAL(received_length, TEST_BLOCK_SIZE * TEST_BLOCK_COUNT);
+    for (int i = 0; i < TEST_BLOCK_COUNT; i++) {
+        CU_ASSERT_EQUAL(received[i * TEST_BLOCK_SIZE], 'A' + i);
+        CU_ASSERT_EQUAL(received[(i + 1) * TEST_BLOCK_SIZE - 1], 'A' + i);
+    }
+
+}
+
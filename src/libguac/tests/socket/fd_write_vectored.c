@@ -0,0 +1,105 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The size of the large block of data written by each test. This is larger
+ * than GUAC_SOCKET_OUTPUT_BUFFER_SIZE, such that the block cannot be copied
+ * into the output buffer of a default socket, yet small enough to fit within
+ * a pipe without a separate reader.
+ */
+#define TEST_BLOCK_SIZE 20000
+
+/**
+ * Writes a mixture of small and large blocks of data to a socket wrapping the
+ * write end of a pipe, verifying that exactly the same data, in the same
+ * order, is read back from the other end.
+ *
+ * @param buffer_size
+ *     The output buffer size to request via guac_socket_open_buffered().
+ */
+static void verify_mixed_writes(size_t buffer_size) {
+
+    static char block[TEST_BLOCK_SIZE];
+    static char expected[TEST_BLOCK_SIZE * 2 + 64];
+    static char actual[sizeof(expected) + 1];
+
+    srand(0x7776);
+    for (int i = 0; i < TEST_BLOCK_SIZE; i++)
+        block[i] = rand();
+
+    int fd[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    guac_socket* socket = guac_socket_open_buffered(fd[1], buffer_size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Small write which is buffered, followed by a large write which must be
+     * written along with the buffered data, etc. */
+    size_t length = 0;
+    const char* pieces[] = { "5.START,", block, ";", block + 100, "3.END;" };
+    size_t sizes[] = { 8, TEST_BLOCK_SIZE, 1, TEST_BLOCK_SIZE - 100, 6 };
+
+    for (int i = 0; i < 5; i++) {
+        CU_ASSERT_EQUAL(guac_socket_write(socket, pieces[i], sizes[i]), 0);
+        memcpy(expected + length, pieces[i], sizes[i]);
+        length += sizes[i];
+    }
+
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+    guac_socket_free(socket);
+
+    size_t received = 0;
+    ssize_t retval;
+    while ((retval = read(fd[0], actual + received, sizeof(actual) - received)) > 0)
+        received += retval;
+
+    close(fd[0]);
+
+    CU_ASSERT_EQUAL(received, length);
+    CU_ASSERT_EQUAL(memcmp(actual, expected, length), 0);
+
+}
+
+/**
+ * Test which verifies that writes too large for the output buffer of a
+ * default-sized guac_socket are written intact and in order relative to the
+ * surrounding buffered writes.
+ */
+void test_socket__fd_write_vectored() {
+    verify_mixed_writes(GUAC_SOCKET_OUTPUT_BUFFER_SIZE);
+}
+
+/**
+ * Test which verifies that a guac_socket with an output buffer large enough to
+ * hold every write, as well as a guac_socket whose requested buffer size is
+ * below the supported minimum, both write all data intact and in order.
+ */
+void test_socket__fd_write_buffer_size() {
+    verify_mixed_writes(TEST_BLOCK_SIZE * 4);
+    verify_mixed_writes(1);
+}
+
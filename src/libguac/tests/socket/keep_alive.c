@@ -0,0 +1,107 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+#include <guacamole/socket-constants.h>
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The maximum number of times to check for a keep-alive ping having been
+ * sent before giving up. Checks are made every millisecond.
+ */
+#define TEST_KEEP_ALIVE_ATTEMPTS (GUAC_SOCKET_KEEP_ALIVE_INTERVAL * 2)
+
+/**
+ * All data written to the test socket thus far.
+ */
+static char written[256];
+
+/**
+ * The number of bytes within the written buffer.
+ */
+static size_t written_length = 0;
+
+/**
+ * Lock guarding access to written and written_length.
+ */
+static pthread_mutex_t written_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Write handler for the test socket which appends all data written to the
+ * written buffer.
+ */
+static ssize_t test_write_handler(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    pthread_mutex_lock(&written_lock);
+
+    if (written_length + count <= sizeof(written)) {
+        memcpy(written + written_length, buf, count);
+        written_length += count;
+    }
+
+    pthread_mutex_unlock(&written_lock);
+    return count;
+
+}
+
+/**
+ * Test which verifies that a socket which has been idle for longer than
+ * GUAC_SOCKET_KEEP_ALIVE_INTERVAL is sent exactly one "nop" by the shared
+ * keep-alive service, even if keep-alive is requested more than once, and
+ * that the socket may be safely freed while keep-alive is enabled.
+ */
+void test_socket__keep_alive() {
+
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->write_handler = test_write_handler;
+
+    /* Pretend the socket has already been idle for the full interval */
+    socket->last_write_timestamp = guac_timestamp_current()
+        - GUAC_SOCKET_KEEP_ALIVE_INTERVAL;
+
+    guac_socket_require_keep_alive(socket);
+    guac_socket_require_keep_alive(socket);
+
+    size_t length = 0;
+    for (int i = 0; i < TEST_KEEP_ALIVE_ATTEMPTS && length == 0; i++) {
+
+        usleep(1000);
+
+        pthread_mutex_lock(&written_lock);
+        length = written_length;
+        pthread_mutex_unlock(&written_lock);
+
+    }
+
+    /* The socket is not idle again until a full interval has elapsed */
+    pthread_mutex_lock(&written_lock);
+    CU_ASSERT_EQUAL(written_length, 6);
+    CU_ASSERT_NSTRING_EQUAL(written, "3.nop;", 6);
+    pthread_mutex_unlock(&written_lock);
+
+    guac_socket_free(socket);
+
+}
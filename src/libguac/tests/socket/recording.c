@@ -0,0 +1,247 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "socket-recording.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/recording.h>
+#include <guacamole/socket.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The number of instructions written to the recording socket under test,
+ * which is chosen such that the instructions overflow the in-memory buffer of
+ * the socket several times over.
+ */
+#define TEST_INSTRUCTION_COUNT 262144
+
+/**
+ * The length of each instruction written, in bytes.
+ */
+#define TEST_INSTRUCTION_LENGTH 32
+
+/**
+ * The total number of bytes written to the recording socket under test.
+ */
+#define TEST_TOTAL_LENGTH (TEST_INSTRUCTION_COUNT * TEST_INSTRUCTION_LENGTH)
+
+/**
+ * The data received from the read end of the pipe.
+ */
+static char* received;
+
+/**
+ * The number of bytes stored within received.
+ */
+static size_t received_length;
+
+/**
+ * Thread which waits briefly, such that the recording socket under test is
+ * forced to overflow, and then reads all data from the read end of a pipe
+ * until end-of-file, storing that data within received.
+ *
+ * @param data
+ *     A pointer to the file descriptor of the read end of the pipe.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* read_thread(void* data) {
+
+    int fd = *((int*) data);
+    ssize_t retval;
+
+    struct timespec delay = { .tv_sec = 0, .tv_nsec = 250000000 };
+    nanosleep(&delay, NULL);
+
+    received_length = 0;
+    while ((retval = read(fd, received + received_length,
+                    TEST_TOTAL_LENGTH - received_length)) > 0)
+        received_length += retval;
+
+    return NULL;
+
+}
+
+/**
+ * Writes TEST_INSTRUCTION_COUNT instructions to a new recording socket using
+ * the given overflow behavior, storing everything that reaches the recording
+ * file within received.
+ *
+ * @param overflow
+ *     The overflow behavior of the recording socket under test.
+ */
+static void write_recording(guac_recording_overflow overflow) {
+
+    int fd[2];
+    pthread_t reader;
+    char instruction[TEST_INSTRUCTION_LENGTH + 1];
+
+    received = malloc(TEST_TOTAL_LENGTH);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(received);
+
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&reader, NULL, read_thread, &fd[0]), 0);
+
+    guac_socket* socket = guac_socket_open_recording(NULL, fd[1], overflow,
+            GUAC_RECORDING_FORMAT_RAW);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    for (int i = 0; i < TEST_INSTRUCTION_COUNT; i++) {
+
+        snprintf(instruction, sizeof(instruction),
+                "4.test,21.%021i;", i);
+
+        /* Write each instruction in two parts */
+        guac_socket_instruction_begin(socket);
+        guac_socket_write(socket, instruction, 10);
+        guac_socket_write(socket, instruction + 10,
+                TEST_INSTRUCTION_LENGTH - 10);
+        guac_socket_instruction_end(socket);
+
+    }
+
+    /* Freeing the socket writes everything and closes the pipe */
+    guac_socket_free(socket);
+
+    pthread_join(reader, NULL);
+    close(fd[0]);
+
+}
+
+/**
+ * Verifies that the data received consists only of complete, well-formed
+ * instructions written in order, returning the number of such instructions.
+ *
+ * @return
+ *     The number of instructions received.
+ */
+static int verify_recording() {
+
+    char expected[TEST_INSTRUCTION_LENGTH + 1];
+    int last = -1;
+
+    CU_ASSERT_EQUAL_FATAL(received_length % TEST_INSTRUCTION_LENGTH, 0);
+
+    int count = received_length / TEST_INSTRUCTION_LENGTH;
+    for (int i = 0; i < count; i++) {
+
+        const char* current = received + i * TEST_INSTRUCTION_LENGTH;
+        int index = atoi(current + 10);
+
+        /* Instructions must be intact and in order */
+        snprintf(expected, sizeof(expected), "4.test,21.%021i;", index);
+        CU_ASSERT_NSTRING_EQUAL_FATAL(current, expected,
+                TEST_INSTRUCTION_LENGTH);
+        CU_ASSERT_FATAL(index > last);
+
+        last = index;
+
+    }
+
+    free(received);
+    return count;
+
+}
+
+/**
+ * Test which verifies that a recording socket which blocks on overflow writes
+ * every instruction intact and in order.
+ */
+void test_socket__recording_block() {
+    write_recording(GUAC_RECORDING_OVERFLOW_BLOCK);
+    CU_ASSERT_EQUAL(verify_recording(), TEST_INSTRUCTION_COUNT);
+}
+
+/**
+ * Test which verifies that a recording socket which drops on overflow writes
+ * only whole instructions, in order.
+ */
+void test_socket__recording_drop() {
+    write_recording(GUAC_RECORDING_OVERFLOW_DROP);
+    CU_ASSERT(verify_recording() <= TEST_INSTRUCTION_COUNT);
+}
+
+/**
+ * Test which verifies that a recording socket which spills to a temporary
+ * file on overflow writes every instruction intact and in order.
+ */
+void test_socket__recording_spill() {
+    write_recording(GUAC_RECORDING_OVERFLOW_SPILL);
+    CU_ASSERT_EQUAL(verify_recording(), TEST_INSTRUCTION_COUNT);
+}
+
+/**
+ * Test which verifies that a recording written in compressed form reads back
+ * with guac_recording_open_reader() as exactly the protocol data written.
+ */
+void test_socket__recording_compressed() {
+
+    char path[] = "/tmp/guac-recording-test-XXXXXX";
+    char instruction[TEST_INSTRUCTION_LENGTH + 1];
+
+    int fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+
+    /* Read back through a separate open file description, such that reading
+     * begins at the start of the file regardless of what has been written */
+    int read_fd = open(path, O_RDONLY);
+    CU_ASSERT_FATAL(read_fd >= 0);
+    unlink(path);
+
+    guac_socket* socket = guac_socket_open_recording(NULL, fd,
+            GUAC_RECORDING_OVERFLOW_BLOCK, GUAC_RECORDING_FORMAT_COMPRESSED);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    for (int i = 0; i < TEST_INSTRUCTION_COUNT; i++) {
+        snprintf(instruction, sizeof(instruction), "4.test,21.%021i;", i);
+        guac_socket_instruction_begin(socket);
+        guac_socket_write(socket, instruction, TEST_INSTRUCTION_LENGTH);
+        guac_socket_instruction_end(socket);
+    }
+
+    /* Freeing the socket writes the remainder of the recording */
+    guac_socket_free(socket);
+
+    guac_socket* reader = guac_recording_open_reader(read_fd, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+
+    received = malloc(TEST_TOTAL_LENGTH);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(received);
+
+    ssize_t retval;
+    received_length = 0;
+    while ((retval = guac_socket_read(reader, received + received_length,
+                    TEST_TOTAL_LENGTH - received_length)) > 0)
+        received_length += retval;
+
+    guac_socket_free(reader);
+
+    CU_ASSERT_EQUAL(verify_recording(), TEST_INSTRUCTION_COUNT);
+
+}
+
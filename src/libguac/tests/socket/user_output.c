@@ -0,0 +1,235 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "user-output.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The maximum number of times to check for data having been written before
+ * giving up.
+ */
+#define TEST_USER_OUTPUT_ATTEMPTS 1000
+
+/**
+ * All data written to the socket of the test user thus far.
+ */
+static char written[256];
+
+/**
+ * The number of bytes within the written buffer.
+ */
+static size_t written_length = 0;
+
+/**
+ * Lock guarding access to written and written_length.
+ */
+static pthread_mutex_t written_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Write handler for the socket of the test user which appends all data
+ * written to the written buffer.
+ */
+static ssize_t test_write_handler(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    pthread_mutex_lock(&written_lock);
+
+    if (written_length + count <= sizeof(written)) {
+        memcpy(written + written_length, buf, count);
+        written_length += count;
+    }
+
+    pthread_mutex_unlock(&written_lock);
+    return count;
+
+}
+
+/**
+ * Flushes the given log, waiting until at least the given number of bytes
+ * have been written to the socket of the test user or until
+ * TEST_USER_OUTPUT_ATTEMPTS checks have been made.
+ *
+ * @return
+ *     The number of bytes written thus far.
+ */
+static size_t test_wait_for_length(guac_user_output_log* log, size_t length) {
+
+    guac_user_output_log_flush(log);
+
+    size_t current = 0;
+    for (int i = 0; i < TEST_USER_OUTPUT_ATTEMPTS; i++) {
+
+        pthread_mutex_lock(&written_lock);
+        current = written_length;
+        pthread_mutex_unlock(&written_lock);
+
+        if (current >= length)
+            break;
+
+        usleep(1000);
+
+    }
+
+    return current;
+
+}
+
+/**
+ * Resets the written buffer to empty.
+ */
+static void test_reset_written() {
+    pthread_mutex_lock(&written_lock);
+    written_length = 0;
+    pthread_mutex_unlock(&written_lock);
+}
+
+/**
+ * Test which verifies that a guac_user_output receives data appended to a
+ * log only while attached, that data received while pending always precedes
+ * data received after promotion, and that a user falling more than
+ * GUAC_USER_OUTPUT_MAX_LENGTH bytes behind a bounded log stops receiving
+ * data from that log until resynchronized.
+ */
+void test_socket__user_output() {
+
+    guac_client* client = guac_client_alloc();
+    guac_user* user = guac_user_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(user);
+
+    user->socket = guac_socket_alloc();
+    user->socket->write_handler = test_write_handler;
+    test_reset_written();
+
+    guac_user_output_log* pending = guac_user_output_log_alloc(0);
+    guac_user_output_log* full = guac_user_output_log_alloc(1);
+
+    guac_user_output* output = guac_user_output_alloc(client, user);
+
+    /* Data appended before attaching is not received */
+    guac_user_output_log_append(pending, "xyz", 3);
+    guac_user_output_attach(output, pending);
+    guac_user_output_log_append(pending, "abc", 3);
+    CU_ASSERT_EQUAL(test_wait_for_length(pending, 3), 3);
+    CU_ASSERT_NSTRING_EQUAL(written, "abc", 3);
+
+    /* Promotion ends receipt of data for pending users, while data for full
+     * users follows everything received while pending */
+    guac_user_output_promote(output, full);
+    guac_user_output_log_append(pending, "def", 3);
+    guac_user_output_log_append(full, "ghi", 3);
+    CU_ASSERT_EQUAL(test_wait_for_length(full, 6), 6);
+    CU_ASSERT_NSTRING_EQUAL(written, "abcghi", 6);
+    CU_ASSERT_FALSE(guac_user_output_needs_resync(output));
+
+    /* Falling too far behind a bounded log stops further data from being
+     * received from that log */
+    char* oversized = guac_mem_zalloc(GUAC_USER_OUTPUT_MAX_LENGTH + 1);
+    guac_user_output_log_append(full, oversized,
+            GUAC_USER_OUTPUT_MAX_LENGTH + 1);
+    guac_mem_free(oversized);
+    CU_ASSERT_TRUE(guac_user_output_needs_resync(output));
+    guac_user_output_log_append(full, "mno", 3);
+
+    /* Data for pending users is received again once reattached */
+    guac_user_output_attach(output, pending);
+    CU_ASSERT_FALSE(guac_user_output_needs_resync(output));
+    guac_user_output_log_append(pending, "pqr", 3);
+    CU_ASSERT_EQUAL(test_wait_for_length(pending, 9), 9);
+    CU_ASSERT_NSTRING_EQUAL(written, "abcghipqr", 9);
+
+    /* Promotion again allows data for full users */
+    guac_user_output_promote(output, full);
+    guac_user_output_log_append(full, "stu", 3);
+    CU_ASSERT_EQUAL(test_wait_for_length(full, 12), 12);
+    CU_ASSERT_NSTRING_EQUAL(written, "abcghipqrstu", 12);
+
+    guac_user_output_free(output);
+    guac_user_output_log_free(pending);
+    guac_user_output_log_free(full);
+    guac_socket_free(user->socket);
+    guac_user_free(user);
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that instructions written to a broadcast socket are
+ * appended to the shared log read by each user only once complete, while
+ * data written outside of any instruction is delivered immediately, and that
+ * the data is delivered to every reader of the log.
+ */
+void test_socket__user_output_broadcast() {
+
+    guac_client* client = guac_client_alloc();
+    guac_user* user = guac_user_alloc();
+    guac_user* other = guac_user_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(user);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(other);
+
+    user->socket = guac_socket_alloc();
+    user->socket->write_handler = test_write_handler;
+    other->socket = guac_socket_alloc();
+    other->socket->write_handler = test_write_handler;
+    test_reset_written();
+
+    guac_user_output* output = guac_user_output_alloc(client, user);
+    guac_user_output* other_output = guac_user_output_alloc(client, other);
+    guac_user_output_promote(output, client->__broadcast_log);
+    guac_user_output_promote(other_output, client->__broadcast_log);
+
+    /* Incomplete instructions must not be written */
+    guac_socket_instruction_begin(client->socket);
+    guac_socket_write(client->socket, "abc", 3);
+    CU_ASSERT_EQUAL(test_wait_for_length(client->__broadcast_log, 1), 0);
+
+    /* Completed instructions are written to every user */
+    guac_socket_instruction_end(client->socket);
+    CU_ASSERT_EQUAL(test_wait_for_length(client->__broadcast_log, 6), 6);
+    CU_ASSERT_NSTRING_EQUAL(written, "abcabc", 6);
+
+    /* Data written outside of any instruction is written immediately */
+    guac_socket_write(client->socket, "def", 3);
+    CU_ASSERT_EQUAL(test_wait_for_length(client->__broadcast_log, 12), 12);
+    CU_ASSERT_NSTRING_EQUAL(written + 6, "defdef", 6);
+
+    /* Data written to the pending broadcast socket is not received */
+    guac_socket_write(client->pending_socket, "ghi", 3);
+    CU_ASSERT_EQUAL(test_wait_for_length(client->__pending_broadcast_log, 13), 12);
+
+    guac_user_output_free(output);
+    guac_user_output_free(other_output);
+    guac_socket_free(user->socket);
+    guac_socket_free(other->socket);
+    guac_user_free(user);
+    guac_user_free(other);
+    guac_client_free(client);
+
+}
@@ -0,0 +1,72 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Test which verifies that guac_stream_send_blob() counts each blob sent
+ * against the window of the stream, and that guac_stream_acknowledge()
+ * frees space within that window without underflowing.
+ */
+void test_stream__window() {
+
+    int fd = open("/dev/null", O_WRONLY);
+    CU_ASSERT_FATAL(fd >= 0);
+
+    guac_socket* socket = guac_socket_open(fd);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_stream stream = {
+        .index = 0,
+        .window = 3,
+        .__unacknowledged = 0
+    };
+
+    /* Exactly as many blobs as the window allows may be in flight */
+    int sent = 0;
+    while (guac_stream_can_send(&stream)) {
+        CU_ASSERT_EQUAL_FATAL(guac_stream_send_blob(socket, &stream, "x", 1), 0);
+        sent++;
+    }
+
+    CU_ASSERT_EQUAL(sent, 3);
+    CU_ASSERT_EQUAL(stream.__unacknowledged, 3);
+
+    /* Each acknowledgement allows exactly one further blob */
+    guac_stream_acknowledge(&stream);
+    CU_ASSERT_TRUE(guac_stream_can_send(&stream));
+    CU_ASSERT_EQUAL(guac_stream_send_blob(socket, &stream, "x", 1), 0);
+    CU_ASSERT_FALSE(guac_stream_can_send(&stream));
+
+    /* Acknowledgements beyond the number of blobs in flight are ignored */
+    for (int i = 0; i < 5; i++)
+        guac_stream_acknowledge(&stream);
+
+    CU_ASSERT_EQUAL(stream.__unacknowledged, 0);
+
+    guac_socket_free(socket);
+
+}
+
@@ -57,6 +57,28 @@ guac_timestamp guac_timestamp_current(void) {
 
 }
 
+guac_timestamp guac_timestamp_current_coarse(void) {
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC_COARSE)
+
+    struct timespec current;
+
+    /* Get current time as of the last timer tick, which is typically
+     * available without the overhead of reading the hardware clock */
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &current);
+
+    /* Calculate milliseconds */
+    return (guac_timestamp) current.tv_sec * 1000 + current.tv_nsec / 1000000;
+
+#else
+
+    /* Fall back to the precise clock if no coarse clock is available */
+    return guac_timestamp_current();
+
+#endif
+
+}
+
 void guac_timestamp_msleep(int duration) {
 
     /* Split milliseconds into equivalent seconds + nanoseconds */
@@ -19,17 +19,21 @@
 
 #include "config.h"
 
+#include "client-latency.h"
 #include "guacamole/mem.h"
 #include "guacamole/client.h"
 #include "guacamole/object.h"
+#include "guacamole/opcode.h"
 #include "guacamole/protocol.h"
 #include "guacamole/stream.h"
 #include "guacamole/string.h"
 #include "guacamole/timestamp.h"
 #include "guacamole/user.h"
+#include "socket-compact.h"
 #include "user-handlers.h"
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -67,6 +71,7 @@ __guac_instruction_handler_mapping __guac_handshake_handler_map[] = {
     {"image",    __guac_handshake_image_handler},
     {"timezone", __guac_handshake_timezone_handler},
     {"name",     __guac_handshake_name_handler},
+    {"compact",  __guac_handshake_compact_handler},
     {NULL,       NULL}
 };
 
@@ -114,6 +119,8 @@ int __guac_handle_sync(guac_user* user, int argc, char** argv) {
     if (timestamp > user->client->last_sent_timestamp)
         return -1;
 
+    guac_client_trace_sync(user->client, user, timestamp);
+
     /* Only update lag calculations if timestamp is sane */
     if (timestamp >= user->last_received_timestamp) {
 
@@ -178,6 +185,12 @@ int __guac_handle_touch(guac_user* user, int argc, char** argv) {
 }
 
 int __guac_handle_mouse(guac_user* user, int argc, char** argv) {
+
+    /* Mouse movement alone typically has no visible result beyond the
+     * locally-rendered cursor, thus only input with buttons held is traced */
+    if (atoi(argv[2]) != 0)
+        guac_client_trace_input(user->client, user);
+
     if (user->mouse_handler)
         return user->mouse_handler(
             user,
@@ -186,9 +199,15 @@ int __guac_handle_mouse(guac_user* user, int argc, char** argv) {
             atoi(argv[2])  /* mask */
         );
     return 0;
+
 }
 
 int __guac_handle_key(guac_user* user, int argc, char** argv) {
+
+    /* Trace only presses, as releases typically have no visible result */
+    if (atoi(argv[1]) != 0)
+        guac_client_trace_input(user->client, user);
+
     if (user->key_handler)
         return user->key_handler(
             user,
@@ -196,6 +215,7 @@ int __guac_handle_key(guac_user* user, int argc, char** argv) {
             atoi(argv[1])  /* pressed */
         );
     return 0;
+
 }
 
 /**
@@ -473,6 +493,9 @@ int __guac_handle_ack(guac_user* user, int argc, char** argv) {
     if (stream->index == GUAC_USER_CLOSED_STREAM_INDEX)
         return 0;
 
+    /* Free space within window for further blobs */
+    guac_stream_acknowledge(stream);
+
     /* Call stream handler if defined */
     if (stream->ack_handler)
         return stream->ack_handler(user, stream, argv[1],
@@ -706,6 +729,20 @@ int __guac_handshake_name_handler(guac_user* user, int argc, char** argv) {
 
 }
 
+int __guac_handshake_compact_handler(guac_user* user, int argc, char** argv) {
+
+    /* Switch to the compact form only if the requested version is known */
+    user->info.compact = (argc > 0
+            && strcmp(argv[0], GUAC_SOCKET_COMPACT_VERSION) == 0);
+
+    if (!user->info.compact)
+        guac_user_log(user, GUAC_LOG_DEBUG, "Unsupported version of compact "
+                "protocol requested. Instructions will be sent as text.");
+
+    return 0;
+
+}
+
 int __guac_handshake_timezone_handler(guac_user* user, int argc, char** argv) {
     
     /* Free any past value */
@@ -759,20 +796,90 @@ void guac_free_mimetypes(char** mimetypes) {
 
 }
 
-int __guac_user_call_opcode_handler(__guac_instruction_handler_mapping* map,
-        guac_user* user, const char* opcode, int argc, char** argv) {
+/**
+ * Index of the entries of __guac_instruction_handler_map.
+ */
+static guac_opcode_index __guac_instruction_handler_index;
+
+/**
+ * Index of the entries of __guac_handshake_handler_map.
+ */
+static guac_opcode_index __guac_handshake_handler_index;
+
+/**
+ * Guard ensuring the indexes of the instruction and handshake handler maps
+ * are built exactly once.
+ */
+static pthread_once_t __guac_handler_index_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Builds the indexes of both __guac_instruction_handler_map and
+ * __guac_handshake_handler_map. This function is intended to be invoked only
+ * through pthread_once().
+ */
+static void __guac_user_init_handler_indexes(void) {
+    guac_opcode_index_init(&__guac_instruction_handler_index,
+            __guac_instruction_handler_map,
+            sizeof(__guac_instruction_handler_mapping));
+    guac_opcode_index_init(&__guac_handshake_handler_index,
+            __guac_handshake_handler_map,
+            sizeof(__guac_instruction_handler_mapping));
+}
+
+/**
+ * Returns the entry within the given map of instruction handlers having the
+ * given opcode. The built-in maps are searched through their indexes, while
+ * any other map is searched linearly.
+ *
+ * @param map
+ *     The NULL-terminated map of instruction handlers to search.
+ *
+ * @param opcode
+ *     The opcode to search for.
+ *
+ * @return
+ *     The entry having the given opcode, or NULL if no such entry exists.
+ */
+static __guac_instruction_handler_mapping* __guac_user_find_opcode_handler(
+        __guac_instruction_handler_mapping* map, const char* opcode) {
+
+    const guac_opcode_index* index = NULL;
+
+    pthread_once(&__guac_handler_index_once, __guac_user_init_handler_indexes);
+
+    if (map == __guac_instruction_handler_map)
+        index = &__guac_instruction_handler_index;
+    else if (map == __guac_handshake_handler_map)
+        index = &__guac_handshake_handler_index;
+
+    if (index != NULL)
+        return (__guac_instruction_handler_mapping*) guac_opcode_index_find(
+                index, map, sizeof(__guac_instruction_handler_mapping), opcode);
 
     /* For each defined instruction */
     __guac_instruction_handler_mapping* current = map;
     while (current->opcode != NULL) {
 
-        /* If recognized, call handler */
         if (strcmp(opcode, current->opcode) == 0)
-            return current->handler(user, argc, argv);
+            return current;
 
         current++;
     }
 
+    return NULL;
+
+}
+
+int __guac_user_call_opcode_handler(__guac_instruction_handler_mapping* map,
+        guac_user* user, const char* opcode, int argc, char** argv) {
+
+    /* If recognized, call handler */
+    __guac_instruction_handler_mapping* mapping =
+        __guac_user_find_opcode_handler(map, opcode);
+
+    if (mapping != NULL)
+        return mapping->handler(user, argc, argv);
+
     /* If unrecognized, log and ignore */
     guac_user_log(user, GUAC_LOG_DEBUG, "Handler not found for \"%s\"",
             opcode);
@@ -224,6 +224,13 @@ __guac_instruction_handler __guac_handshake_image_handler;
  */
 __guac_instruction_handler __guac_handshake_name_handler;
 
+/**
+ * Internal handler function that is called when the compact instruction is
+ * received during the handshake process, requesting that all instructions
+ * sent after the handshake be in the compact form of the protocol.
+ */
+__guac_instruction_handler __guac_handshake_compact_handler;
+
 /**
  * Internal handler function that is called when the timezone instruction is
  * received during the handshake process, specifying the timezone of the
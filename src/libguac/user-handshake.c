@@ -19,6 +19,7 @@
 
 #include "config.h"
 
+#include "client-latency.h"
 #include "guacamole/mem.h"
 #include "guacamole/client.h"
 #include "guacamole/error.h"
@@ -26,6 +27,7 @@
 #include "guacamole/protocol.h"
 #include "guacamole/socket.h"
 #include "guacamole/user.h"
+#include "socket-compact.h"
 #include "user-handlers.h"
 
 #include <pthread.h>
@@ -55,6 +57,35 @@ typedef struct guac_user_input_thread_params {
 
 } guac_user_input_thread_params;
 
+/**
+ * A "mouse" instruction received from a user whose handling has been deferred
+ * such that it may be coalesced with any immediately-following "mouse"
+ * instructions that differ only in mouse position.
+ */
+typedef struct guac_user_pending_mouse {
+
+    /**
+     * Non-zero if a "mouse" instruction is currently pending, zero otherwise.
+     */
+    int pending;
+
+    /**
+     * The X coordinate of the mouse within the pending instruction.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the mouse within the pending instruction.
+     */
+    int y;
+
+    /**
+     * The button mask within the pending instruction.
+     */
+    int mask;
+
+} guac_user_pending_mouse;
+
 /**
  * Prints an error message using the logging facilities of the given user,
  * automatically including any information present in guac_error.
@@ -115,6 +146,62 @@ static void guac_user_log_handshake_failure(guac_user* user) {
 
 }
 
+/**
+ * Logs the failure of the handler of the given instruction and stops the
+ * given user.
+ *
+ * @param user
+ *     The user that sent the instruction.
+ *
+ * @param opcode
+ *     The opcode of the instruction whose handler failed.
+ */
+static void guac_user_handler_failed(guac_user* user, const char* opcode) {
+
+    /* Log error */
+    guac_user_log_guac_error(user, GUAC_LOG_WARNING,
+            "User connection aborted");
+
+    /* Log handler details */
+    guac_user_log(user, GUAC_LOG_DEBUG, "Failing instruction handler in user was \"%s\"", opcode);
+
+    guac_user_stop(user);
+
+}
+
+/**
+ * Passes the given pending "mouse" instruction, if any, to the mouse_handler
+ * of the given user, clearing that instruction.
+ *
+ * @param user
+ *     The user that sent the pending instruction.
+ *
+ * @param mouse
+ *     The pending "mouse" instruction to handle.
+ *
+ * @return
+ *     Zero if there was no pending instruction or the instruction was handled
+ *     successfully, non-zero if the mouse_handler failed, in which case the
+ *     user has been stopped.
+ */
+static int guac_user_flush_mouse(guac_user* user,
+        guac_user_pending_mouse* mouse) {
+
+    if (!mouse->pending)
+        return 0;
+
+    mouse->pending = 0;
+
+    if (user->mouse_handler
+            && user->mouse_handler(user, mouse->x, mouse->y, mouse->mask)) {
+        guac_user_handler_failed(user, "mouse");
+        return 1;
+    }
+
+    return 0;
+
+}
+
 /**
  * The thread which handles all user input, calling event handlers for received
  * instructions.
@@ -138,9 +225,18 @@ static void* guac_user_input_thread(void* data) {
     guac_client* client = user->client;
     guac_socket* socket = user->socket;
 
+    guac_user_pending_mouse mouse = { 0 };
+
     /* Guacamole user input loop */
     while (client->state == GUAC_CLIENT_RUNNING && user->active) {
 
+        /* Handle any deferred mouse movement before waiting for further
+         * instructions (movement is deferred only while more instructions
+         * have already been received) */
+        if (guac_parser_length(parser) == 0
+                && guac_user_flush_mouse(user, &mouse))
+            return NULL;
+
         /* Read instruction, stop on error */
         if (guac_parser_read(parser, socket, usec_timeout)) {
 
@@ -162,18 +258,40 @@ static void* guac_user_input_thread(void* data) {
         guac_error = GUAC_STATUS_SUCCESS;
         guac_error_message = NULL;
 
-        /* Call handler, stop on error */
-        if (__guac_user_call_opcode_handler(__guac_instruction_handler_map, 
-                user, parser->opcode, parser->argc, parser->argv)) {
+        /* Defer handling of mouse instructions, replacing any deferred mouse
+         * instruction that differs only in position */
+        if (client->coalesce_mouse && parser->argc >= 3
+                && strcmp(parser->opcode, "mouse") == 0) {
 
-            /* Log error */
-            guac_user_log_guac_error(user, GUAC_LOG_WARNING,
-                    "User connection aborted");
+            int mask = atoi(parser->argv[2]);
 
-            /* Log handler details */
-            guac_user_log(user, GUAC_LOG_DEBUG, "Failing instruction handler in user was \"%s\"", parser->opcode);
+            /* Deferred input is traced as of its receipt, like any other
+             * "mouse" instruction (see __guac_handle_mouse()) */
+            if (mask != 0)
+                guac_client_trace_input(client, user);
+
+            /* Changes in button state are always handled */
+            if (mouse.pending && mouse.mask != mask
+                    && guac_user_flush_mouse(user, &mouse))
+                return NULL;
+
+            mouse.pending = 1;
+            mouse.x = atoi(parser->argv[0]);
+            mouse.y = atoi(parser->argv[1]);
+            mouse.mask = mask;
+            continue;
+
+        }
 
-            guac_user_stop(user);
+        /* All other instructions are handled in order after any deferred
+         * mouse instruction */
+        if (guac_user_flush_mouse(user, &mouse))
+            return NULL;
+
+        /* Call handler, stop on error */
+        if (__guac_user_call_opcode_handler(__guac_instruction_handler_map, 
+                user, parser->opcode, parser->argc, parser->argv)) {
+            guac_user_handler_failed(user, parser->opcode);
             return NULL;
         }
 
@@ -299,6 +417,7 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
     user->info.video_mimetypes = NULL;
     user->info.name = NULL;
     user->info.timezone = NULL;
+    user->info.compact = 0;
     
     /* Count number of arguments. */
     int num_args;
@@ -317,6 +436,20 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
     }
 
     guac_parser* parser = guac_parser_alloc();
+    if (parser == NULL) {
+        guac_user_log_handshake_failure(user);
+        guac_user_log_guac_error(user, GUAC_LOG_DEBUG,
+                "Error allocating parser for new user");
+        return 1;
+    }
+
+    /* Accept instructions as large as allowed for this user */
+    if (user->max_instruction_length != GUAC_INSTRUCTION_MAX_LENGTH
+            && guac_parser_set_max_length(parser, user->max_instruction_length))
+        guac_user_log(user, GUAC_LOG_WARNING, "Unable to accept instructions "
+                "of up to %i characters. The default limit of %i characters "
+                "will be used instead.", user->max_instruction_length,
+                GUAC_INSTRUCTION_MAX_LENGTH);
 
     /* Perform the handshake with the client. */
     if (__guac_user_handshake(user, parser, usec_timeout)) {
@@ -324,6 +457,16 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
         return 1;
     }
 
+    /* Switch to the compact form of the protocol if requested, sending the
+     * acknowledgement as the last instruction in text form */
+    guac_socket* text_socket = socket;
+    if (user->info.compact) {
+        guac_protocol_send_compact(socket, GUAC_SOCKET_COMPACT_VERSION);
+        socket = user->socket = guac_socket_open_compact(text_socket);
+        guac_user_log(user, GUAC_LOG_DEBUG, "Instructions will be sent using "
+                "the compact form of the protocol.");
+    }
+
     /* Acknowledge connection availability */
     guac_protocol_send_ready(socket, client->connection_id);
     guac_socket_flush(socket);
@@ -332,6 +475,12 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
     if (parser->argc != (num_args + 1)) {
         guac_client_log(client, GUAC_LOG_ERROR, "Client did not return the "
                 "expected number of arguments.");
+
+        if (socket != text_socket) {
+            user->socket = text_socket;
+            guac_socket_free(socket);
+        }
+
         return 1;
     }
     
@@ -378,6 +527,12 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
     
     guac_parser_free(parser);
 
+    /* Restore the original socket, which belongs to the caller */
+    if (socket != text_socket) {
+        user->socket = text_socket;
+        guac_socket_free(socket);
+    }
+
     /* Successful disconnect */
     return 0;
 
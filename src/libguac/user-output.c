@@ -0,0 +1,662 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "user-output.h"
+
+#include "guacamole/client.h"
+#include "guacamole/mem.h"
+#include "guacamole/socket.h"
+#include "guacamole/user.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Releases a single reference to the given segment, freeing the segment if
+ * no references remain. The lock of the log containing the segment must be
+ * held.
+ *
+ * @param segment
+ *     The guac_user_output_segment to release.
+ */
+static void guac_user_output_segment_release(guac_user_output_segment* segment) {
+    if (--segment->refs == 0)
+        guac_mem_free(segment);
+}
+
+/**
+ * Wakes the thread draining the given output queue, such that it checks for
+ * data to write regardless of whether it has already been woken for that
+ * data. The lock of the queue must not be held.
+ *
+ * @param output
+ *     The guac_user_output to wake.
+ */
+static void guac_user_output_wake(guac_user_output* output) {
+
+    pthread_mutex_lock(&output->lock);
+
+    output->woken = 1;
+    pthread_cond_signal(&output->modified);
+
+    pthread_mutex_unlock(&output->lock);
+
+}
+
+/**
+ * Returns the log that the given reader is currently attached to. The lock
+ * of the guac_user_output owning the reader must not be held.
+ *
+ * @param reader
+ *     The guac_user_output_reader to check.
+ *
+ * @return
+ *     The log that the given reader is attached to, or NULL if the reader is
+ *     not attached to any log.
+ */
+static guac_user_output_log* guac_user_output_reader_get_log(
+        guac_user_output_reader* reader) {
+
+    pthread_mutex_lock(&reader->output->lock);
+    guac_user_output_log* log = reader->log;
+    pthread_mutex_unlock(&reader->output->lock);
+
+    return log;
+
+}
+
+/**
+ * Removes all segments from the beginning of the given log that no reader
+ * is within. Segments that are still being written retain their own
+ * references and are freed once those writes complete. The lock of the log
+ * must be held.
+ *
+ * @param log
+ *     The guac_user_output_log to trim.
+ */
+static void guac_user_output_log_trim(guac_user_output_log* log) {
+
+    while (log->head != NULL && log->head->cursors == 0) {
+        guac_user_output_segment* head = log->head;
+        log->head = head->next;
+        guac_user_output_segment_release(head);
+    }
+
+    if (log->head == NULL)
+        log->tail = NULL;
+
+}
+
+/**
+ * Attaches the given reader to the end of the given log, such that only data
+ * appended after this point is read. The reader must not already be attached
+ * to any log, and the lock of the log must be held.
+ *
+ * @param reader
+ *     The guac_user_output_reader to attach.
+ *
+ * @param log
+ *     The guac_user_output_log to attach the reader to.
+ */
+static void guac_user_output_reader_attach(guac_user_output_reader* reader,
+        guac_user_output_log* log) {
+
+    reader->segment = log->tail;
+    if (reader->segment != NULL)
+        reader->segment->cursors++;
+
+    reader->position = log->length;
+    reader->stop = SIZE_MAX;
+    reader->notified = 0;
+    reader->generation++;
+
+    reader->prev = NULL;
+    reader->next = log->readers;
+
+    if (log->readers != NULL)
+        log->readers->prev = reader;
+
+    log->readers = reader;
+
+    pthread_mutex_lock(&reader->output->lock);
+    reader->log = log;
+    reader->lagging = 0;
+    pthread_mutex_unlock(&reader->output->lock);
+
+}
+
+/**
+ * Detaches the given reader from the log it is currently attached to, waking
+ * the thread of the guac_user_output owning the reader such that it may move
+ * on to any other data. The lock of that log must be held.
+ *
+ * @param reader
+ *     The guac_user_output_reader to detach.
+ *
+ * @param lagging
+ *     Non-zero if the reader is being detached because its user fell too far
+ *     behind, zero otherwise.
+ */
+static void guac_user_output_reader_detach(guac_user_output_reader* reader,
+        int lagging) {
+
+    guac_user_output_log* log = reader->log;
+
+    if (reader->prev != NULL)
+        reader->prev->next = reader->next;
+    else
+        log->readers = reader->next;
+
+    if (reader->next != NULL)
+        reader->next->prev = reader->prev;
+
+    reader->prev = NULL;
+    reader->next = NULL;
+
+    if (reader->segment != NULL) {
+        reader->segment->cursors--;
+        reader->segment = NULL;
+    }
+
+    pthread_mutex_lock(&reader->output->lock);
+    reader->log = NULL;
+    reader->lagging = lagging;
+    reader->output->woken = 1;
+    pthread_cond_signal(&reader->output->modified);
+    pthread_mutex_unlock(&reader->output->lock);
+
+    guac_user_output_log_trim(log);
+
+}
+
+/**
+ * Moves the given reader forward to the given position, moving its cursor
+ * into later segments as those segments are reached. The lock of the log
+ * that the reader is attached to must be held.
+ *
+ * @param reader
+ *     The guac_user_output_reader to advance.
+ *
+ * @param position
+ *     The new position of the reader within its log.
+ */
+static void guac_user_output_reader_advance(guac_user_output_reader* reader,
+        size_t position) {
+
+    guac_user_output_segment* segment = reader->segment;
+    while (segment->next != NULL
+            && position >= segment->offset + segment->length) {
+        segment->cursors--;
+        segment = segment->next;
+        segment->cursors++;
+    }
+
+    reader->segment = segment;
+    reader->position = position;
+
+}
+
+/**
+ * Writes as much data as is available to the given reader to the socket of
+ * the user of the given output queue. The data is written directly from the
+ * segments of the log without holding the lock of the log, with each
+ * segment being pinned by an additional reference until the write
+ * completes. If the reader has reached the position at which it should stop,
+ * it is detached.
+ *
+ * @param output
+ *     The guac_user_output owning the reader.
+ *
+ * @param reader
+ *     The guac_user_output_reader to drain.
+ *
+ * @return
+ *     Non-zero if any data was written or the state of the reader changed
+ *     such that it should be checked again, zero if no data was available.
+ */
+static int guac_user_output_drain(guac_user_output* output,
+        guac_user_output_reader* reader) {
+
+    guac_user_output_segment* segments[GUAC_USER_OUTPUT_MAX_SEGMENTS];
+    const char* data[GUAC_USER_OUTPUT_MAX_SEGMENTS];
+    size_t lengths[GUAC_USER_OUTPUT_MAX_SEGMENTS];
+    int count = 0;
+
+    guac_user_output_log* log = guac_user_output_reader_get_log(reader);
+    if (log == NULL)
+        return 0;
+
+    pthread_mutex_lock(&log->lock);
+
+    /* The reader may have been detached before the lock was acquired */
+    if (reader->log != log) {
+        pthread_mutex_unlock(&log->lock);
+        return 1;
+    }
+
+    /* Any data appended from this point forward requires a new wakeup */
+    reader->notified = 0;
+
+    unsigned int generation = reader->generation;
+    size_t end = (log->length < reader->stop) ? log->length : reader->stop;
+    size_t position = reader->position;
+
+    /* Pin each segment containing data that has not yet been written */
+    guac_user_output_segment* segment = reader->segment;
+    while (segment != NULL && position < end
+            && count < GUAC_USER_OUTPUT_MAX_SEGMENTS) {
+
+        size_t segment_end = segment->offset + segment->length;
+        if (position < segment_end) {
+
+            size_t available = (end < segment_end ? end : segment_end)
+                - position;
+
+            segment->refs++;
+            segments[count] = segment;
+            data[count] = segment->data + (position - segment->offset);
+            lengths[count] = available;
+            count++;
+
+            position += available;
+
+        }
+
+        segment = segment->next;
+
+    }
+
+    /* Detach once everything up to the requested stopping point has been
+     * received */
+    if (count == 0) {
+
+        if (position >= reader->stop)
+            guac_user_output_reader_detach(reader, 0);
+
+        pthread_mutex_unlock(&log->lock);
+        return 0;
+
+    }
+
+    pthread_mutex_unlock(&log->lock);
+
+    /* Write the complete instructions as a single unit, such that they are
+     * not interleaved with instructions sent directly to the user */
+    guac_socket* socket = output->user->socket;
+    int error = 0;
+
+    guac_socket_instruction_begin(socket);
+    for (int i = 0; i < count && !error; i++)
+        error = guac_socket_write(socket, data[i], lengths[i]);
+    guac_socket_instruction_end(socket);
+
+    if (error)
+        guac_user_stop(output->user);
+
+    pthread_mutex_lock(&log->lock);
+
+    /* Advance only if the reader was not detached (and possibly reattached)
+     * while the data was being written */
+    if (guac_user_output_reader_get_log(reader) == log
+            && reader->generation == generation)
+        guac_user_output_reader_advance(reader, position);
+
+    for (int i = 0; i < count; i++)
+        guac_user_output_segment_release(segments[i]);
+
+    guac_user_output_log_trim(log);
+
+    pthread_mutex_unlock(&log->lock);
+    return 1;
+
+}
+
+/**
+ * The start routine of the thread draining each guac_user_output, writing
+ * data from the logs that the queue is attached to to the socket of its user
+ * until signalled to stop.
+ *
+ * @param data
+ *     The guac_user_output to drain.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_user_output_thread(void* data) {
+
+    guac_user_output* output = (guac_user_output*) data;
+
+    pthread_mutex_lock(&output->lock);
+    for (;;) {
+
+        /* Wait for something to do */
+        while (!output->stopping && !output->woken)
+            pthread_cond_wait(&output->modified, &output->lock);
+
+        if (output->stopping)
+            break;
+
+        output->woken = 0;
+        pthread_mutex_unlock(&output->lock);
+
+        /* Write out everything that can be written, always writing the data
+         * received while pending before any data received as a full user */
+        for (;;) {
+
+            if (guac_user_output_drain(output, &output->pending))
+                continue;
+
+            if (guac_user_output_reader_get_log(&output->pending) != NULL)
+                break;
+
+            if (!guac_user_output_drain(output, &output->full))
+                break;
+
+        }
+
+        pthread_mutex_lock(&output->lock);
+
+        /* Flush only once all data has been written */
+        if (output->flush_requested) {
+
+            output->flush_requested = 0;
+            pthread_mutex_unlock(&output->lock);
+
+            if (guac_socket_flush(output->user->socket))
+                guac_user_stop(output->user);
+
+            pthread_mutex_lock(&output->lock);
+
+        }
+
+    }
+    pthread_mutex_unlock(&output->lock);
+
+    return NULL;
+
+}
+
+guac_user_output_log* guac_user_output_log_alloc(int bounded) {
+
+    guac_user_output_log* log = guac_mem_zalloc(sizeof(guac_user_output_log));
+    log->bounded = bounded;
+
+    pthread_mutex_init(&log->lock, NULL);
+
+    return log;
+
+}
+
+void guac_user_output_log_free(guac_user_output_log* log) {
+
+    guac_user_output_segment* segment = log->head;
+    while (segment != NULL) {
+        guac_user_output_segment* next = segment->next;
+        guac_user_output_segment_release(segment);
+        segment = next;
+    }
+
+    pthread_mutex_destroy(&log->lock);
+    guac_mem_free(log);
+
+}
+
+void guac_user_output_log_append(guac_user_output_log* log,
+        const void* buffer, size_t length) {
+
+    if (length == 0)
+        return;
+
+    pthread_mutex_lock(&log->lock);
+
+    /* There is no need to retain data that nobody will read */
+    if (log->readers == NULL)
+        goto done;
+
+    guac_user_output_segment* tail = log->tail;
+
+    /* Append to the current segment if possible, allocating a new segment
+     * if the data will not fit */
+    if (tail != NULL && tail->size - tail->length >= length) {
+        memcpy(tail->data + tail->length, buffer, length);
+        tail->length += length;
+    }
+
+    else {
+
+        size_t size = GUAC_USER_OUTPUT_SEGMENT_SIZE;
+        if (length > size)
+            size = length;
+
+        guac_user_output_segment* segment = guac_mem_alloc(
+                guac_mem_ckd_add_or_die(sizeof(guac_user_output_segment), size));
+
+        segment->next = NULL;
+        segment->refs = 1;
+        segment->cursors = 0;
+        segment->offset = log->length;
+        segment->length = length;
+        segment->size = size;
+        memcpy(segment->data, buffer, length);
+
+        if (tail != NULL)
+            tail->next = segment;
+        else
+            log->head = segment;
+
+        log->tail = segment;
+
+        /* Readers that were attached while the log was empty begin within
+         * the new segment */
+        for (guac_user_output_reader* reader = log->readers; reader != NULL;
+                reader = reader->next) {
+            if (reader->segment == NULL) {
+                reader->segment = segment;
+                segment->cursors++;
+            }
+        }
+
+    }
+
+    log->length += length;
+
+    guac_user_output_reader* reader = log->readers;
+    while (reader != NULL) {
+
+        guac_user_output_reader* next = reader->next;
+
+        /* Readers that cannot keep up stop reading from bounded logs (their
+         * users are moved back to the list of pending users by the
+         * guac_client's own pending user thread, which rebuilds their view
+         * of the connection from current state rather than replaying every
+         * intermediate change) */
+        if (log->bounded
+                && log->length - reader->position > GUAC_USER_OUTPUT_MAX_LENGTH) {
+
+            guac_user_output* output = reader->output;
+            guac_client_log(output->client, GUAC_LOG_DEBUG, "User \"%s\" "
+                    "could not keep up with the connection. Skipping ahead "
+                    "to the current state of the connection.",
+                    output->user->user_id);
+
+            guac_user_output_reader_detach(reader, 1);
+
+        }
+
+        /* Wake each reader only once until it next reads */
+        else if (!reader->notified) {
+            reader->notified = 1;
+            guac_user_output_wake(reader->output);
+        }
+
+        reader = next;
+
+    }
+
+done:
+    pthread_mutex_unlock(&log->lock);
+
+}
+
+void guac_user_output_log_flush(guac_user_output_log* log) {
+
+    pthread_mutex_lock(&log->lock);
+
+    for (guac_user_output_reader* reader = log->readers; reader != NULL;
+            reader = reader->next) {
+
+        guac_user_output* output = reader->output;
+
+        pthread_mutex_lock(&output->lock);
+        output->flush_requested = 1;
+        output->woken = 1;
+        pthread_cond_signal(&output->modified);
+        pthread_mutex_unlock(&output->lock);
+
+    }
+
+    pthread_mutex_unlock(&log->lock);
+
+}
+
+guac_user_output* guac_user_output_alloc(guac_client* client, guac_user* user) {
+
+    guac_user_output* output = guac_mem_zalloc(sizeof(guac_user_output));
+    output->client = client;
+    output->user = user;
+
+    output->pending.output = output;
+    output->full.output = output;
+
+    pthread_mutex_init(&output->lock, NULL);
+    pthread_cond_init(&output->modified, NULL);
+    pthread_create(&output->thread, NULL, guac_user_output_thread, output);
+
+    return output;
+
+}
+
+void guac_user_output_free(guac_user_output* output) {
+
+    pthread_mutex_lock(&output->lock);
+    output->stopping = 1;
+    pthread_cond_signal(&output->modified);
+    pthread_mutex_unlock(&output->lock);
+
+    pthread_join(output->thread, NULL);
+
+    guac_user_output_detach(output);
+
+    pthread_cond_destroy(&output->modified);
+    pthread_mutex_destroy(&output->lock);
+
+    guac_mem_free(output);
+
+}
+
+/**
+ * Detaches the given reader from whichever log it is currently attached to,
+ * if any. The lock of the guac_user_output owning the reader and the lock of
+ * any log must not be held.
+ *
+ * @param reader
+ *     The guac_user_output_reader to detach.
+ */
+static void guac_user_output_reader_detach_any(guac_user_output_reader* reader) {
+
+    guac_user_output_log* log = guac_user_output_reader_get_log(reader);
+    if (log == NULL)
+        return;
+
+    pthread_mutex_lock(&log->lock);
+
+    /* The reader may have been detached in the meantime, but can only be
+     * reattached by the caller */
+    if (reader->log == log)
+        guac_user_output_reader_detach(reader, 0);
+
+    pthread_mutex_unlock(&log->lock);
+
+}
+
+void guac_user_output_detach(guac_user_output* output) {
+
+    guac_user_output_reader_detach_any(&output->pending);
+    guac_user_output_reader_detach_any(&output->full);
+
+    pthread_mutex_lock(&output->lock);
+    output->full.lagging = 0;
+    pthread_mutex_unlock(&output->lock);
+
+}
+
+void guac_user_output_attach(guac_user_output* output,
+        guac_user_output_log* log) {
+
+    guac_user_output_detach(output);
+
+    pthread_mutex_lock(&log->lock);
+    guac_user_output_reader_attach(&output->pending, log);
+    pthread_mutex_unlock(&log->lock);
+
+}
+
+void guac_user_output_promote(guac_user_output* output,
+        guac_user_output_log* log) {
+
+    guac_user_output_reader* pending = &output->pending;
+
+    /* Stop reading data for pending users once everything sent thus far has
+     * been written */
+    guac_user_output_log* pending_log = guac_user_output_reader_get_log(pending);
+    if (pending_log != NULL) {
+
+        pthread_mutex_lock(&pending_log->lock);
+
+        if (pending->log == pending_log) {
+            pending->stop = pending_log->length;
+            if (pending->position >= pending->stop)
+                guac_user_output_reader_detach(pending, 0);
+        }
+
+        pthread_mutex_unlock(&pending_log->lock);
+
+    }
+
+    /* Data for full users is written only after the above */
+    guac_user_output_reader_detach_any(&output->full);
+
+    pthread_mutex_lock(&log->lock);
+    guac_user_output_reader_attach(&output->full, log);
+    pthread_mutex_unlock(&log->lock);
+
+}
+
+int guac_user_output_needs_resync(guac_user_output* output) {
+
+    pthread_mutex_lock(&output->lock);
+    int needs_resync = output->full.lagging;
+    pthread_mutex_unlock(&output->lock);
+
+    return needs_resync;
+
+}
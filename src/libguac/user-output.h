@@ -0,0 +1,432 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_USER_OUTPUT_H
+#define GUAC_USER_OUTPUT_H
+
+/**
+ * Private logs of data written to the broadcast sockets of a guac_client, and
+ * the per-user queues which deliver that data. Each instruction written to a
+ * broadcast socket is appended exactly once to a shared log of reference-
+ * counted segments, and each user reads from that log independently through
+ * their own guac_user_output, drained by a dedicated thread, such that a user
+ * whose connection cannot keep up does not block delivery of data to any
+ * other user. A user that falls too far behind a bounded log is considered
+ * lagging and stops reading from that log, at which point the user's view of
+ * the connection is rebuilt from current state in the same manner as a
+ * newly-joined user.
+ *
+ * @file user-output.h
+ */
+
+#include "config.h"
+
+#include "guacamole/client-types.h"
+#include "guacamole/user-types.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * The maximum number of bytes that any user may fall behind a bounded
+ * guac_user_output_log before that user is considered lagging. Data sent to
+ * pending users while synchronizing their view of the connection is not
+ * subject to this limit.
+ */
+#define GUAC_USER_OUTPUT_MAX_LENGTH 8388608
+
+/**
+ * The minimum number of bytes allocated for each segment of a
+ * guac_user_output_log. Larger segments are allocated as needed to hold
+ * larger instructions.
+ */
+#define GUAC_USER_OUTPUT_SEGMENT_SIZE 65536
+
+/**
+ * The maximum number of segments that will be written to the socket of a
+ * user in a single pass of the thread draining that user's queue.
+ */
+#define GUAC_USER_OUTPUT_MAX_SEGMENTS 16
+
+typedef struct guac_user_output guac_user_output;
+
+typedef struct guac_user_output_log guac_user_output_log;
+
+/**
+ * A contiguous, immutable block of data within a guac_user_output_log. Once
+ * appended, data within a segment is never modified, and may be written to
+ * the sockets of any number of users without holding the lock of the log.
+ */
+typedef struct guac_user_output_segment {
+
+    /**
+     * The segment following this segment within the log, or NULL if this is
+     * the last segment of the log.
+     */
+    struct guac_user_output_segment* next;
+
+    /**
+     * The number of references to this segment. The log holds one reference
+     * while the segment remains part of the log, and each write of the
+     * segment that is in progress holds one more. The segment is freed once
+     * this reaches zero.
+     */
+    int refs;
+
+    /**
+     * The number of readers whose current position lies within this
+     * segment. Segments at the beginning of the log are removed once no
+     * reader remains within them.
+     */
+    int cursors;
+
+    /**
+     * The offset of the first byte of this segment within the log, relative
+     * to the first byte ever appended to the log.
+     */
+    size_t offset;
+
+    /**
+     * The number of bytes of data currently stored within this segment.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for data.
+     */
+    size_t size;
+
+    /**
+     * The data stored within this segment.
+     */
+    char data[];
+
+} guac_user_output_segment;
+
+/**
+ * The position of a single guac_user_output within a guac_user_output_log.
+ * Except where noted, all members are guarded by the lock of the log that
+ * the reader is attached to.
+ */
+typedef struct guac_user_output_reader {
+
+    /**
+     * The guac_user_output that this reader belongs to.
+     */
+    guac_user_output* output;
+
+    /**
+     * The log that this reader is currently attached to, or NULL if the
+     * reader is not attached to any log. This member is modified only while
+     * holding both the lock of the relevant log and the lock of the
+     * guac_user_output, and may be read while holding either.
+     */
+    guac_user_output_log* log;
+
+    /**
+     * The segment containing the current position of this reader, or NULL if
+     * the log contained no segments when the reader was attached.
+     */
+    guac_user_output_segment* segment;
+
+    /**
+     * The offset within the log of the next byte this reader will write to
+     * the socket of its user.
+     */
+    size_t position;
+
+    /**
+     * The offset within the log at which this reader should be detached, or
+     * SIZE_MAX if the reader should remain attached indefinitely.
+     */
+    size_t stop;
+
+    /**
+     * The number of times this reader has been attached to any log. This is
+     * used to determine whether a reader was detached and reattached while
+     * its data was being written without holding the lock of the log.
+     */
+    unsigned int generation;
+
+    /**
+     * Non-zero if the guac_user_output has already been woken for data
+     * appended since it last read from this reader, zero otherwise.
+     */
+    int notified;
+
+    /**
+     * Non-zero if this reader was detached because its user fell too far
+     * behind a bounded log, zero otherwise. This member is guarded by the
+     * lock of the guac_user_output.
+     */
+    int lagging;
+
+    /**
+     * The previous reader attached to the same log, or NULL if this is the
+     * first such reader.
+     */
+    struct guac_user_output_reader* prev;
+
+    /**
+     * The next reader attached to the same log, or NULL if this is the last
+     * such reader.
+     */
+    struct guac_user_output_reader* next;
+
+} guac_user_output_reader;
+
+/**
+ * Shared log of all data written to the broadcast sockets of a guac_client
+ * for a particular set of users. Data is retained only until every attached
+ * reader has written it.
+ */
+struct guac_user_output_log {
+
+    /**
+     * Lock which guards access to all other members of this structure, the
+     * segments of the log, and the readers attached to the log.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Non-zero if readers that fall more than GUAC_USER_OUTPUT_MAX_LENGTH
+     * bytes behind should be detached and considered lagging, zero if all
+     * data must be delivered regardless of how much is retained.
+     */
+    int bounded;
+
+    /**
+     * The first segment of the log, or NULL if no data is retained.
+     */
+    guac_user_output_segment* head;
+
+    /**
+     * The last segment of the log, or NULL if no data is retained.
+     */
+    guac_user_output_segment* tail;
+
+    /**
+     * The total number of bytes ever appended to the log.
+     */
+    size_t length;
+
+    /**
+     * The first reader attached to this log, or NULL if no readers are
+     * attached.
+     */
+    guac_user_output_reader* readers;
+
+};
+
+/**
+ * Queue of data awaiting transmission to a single user, read from the shared
+ * logs of the user's guac_client.
+ */
+struct guac_user_output {
+
+    /**
+     * The guac_client that the user is connected to.
+     */
+    guac_client* client;
+
+    /**
+     * The user receiving the queued data.
+     */
+    guac_user* user;
+
+    /**
+     * Lock which guards access to the flags of this structure. If the lock of
+     * a log must also be held, the lock of the log must be acquired first.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever woken is set.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * The thread which writes queued data to the socket of the user.
+     */
+    pthread_t thread;
+
+    /**
+     * The position of the user within the log of data sent to pending users.
+     * All data read through this reader is written before any data read
+     * through full.
+     */
+    guac_user_output_reader pending;
+
+    /**
+     * The position of the user within the log of data sent to full,
+     * non-pending users.
+     */
+    guac_user_output_reader full;
+
+    /**
+     * Non-zero if the thread draining this queue has been woken since it
+     * last checked for data, zero otherwise.
+     */
+    int woken;
+
+    /**
+     * Non-zero if the socket of the user should be flushed once all data
+     * available thus far has been written, zero otherwise.
+     */
+    int flush_requested;
+
+    /**
+     * Non-zero if the thread draining this queue should stop, zero otherwise.
+     */
+    int stopping;
+
+};
+
+/**
+ * Allocates a new, empty log.
+ *
+ * @param bounded
+ *     Non-zero if readers that fall more than GUAC_USER_OUTPUT_MAX_LENGTH
+ *     bytes behind should be detached and considered lagging, zero
+ *     otherwise.
+ *
+ * @return
+ *     A newly-allocated guac_user_output_log which must eventually be freed
+ *     with guac_user_output_log_free().
+ */
+guac_user_output_log* guac_user_output_log_alloc(int bounded);
+
+/**
+ * Frees the given log and all data retained within it. No readers may be
+ * attached to the log.
+ *
+ * @param log
+ *     The guac_user_output_log to free.
+ */
+void guac_user_output_log_free(guac_user_output_log* log);
+
+/**
+ * Appends the given data to the given log, making that data available to
+ * all attached readers. The data is copied once regardless of the number of
+ * readers. If no readers are attached, the data is discarded. The data
+ * appended by a single call is always written to each user as a unit, and
+ * should thus consist only of complete instructions.
+ *
+ * @param log
+ *     The guac_user_output_log to append data to.
+ *
+ * @param buffer
+ *     The data to append.
+ *
+ * @param length
+ *     The number of bytes of data to append.
+ */
+void guac_user_output_log_append(guac_user_output_log* log,
+        const void* buffer, size_t length);
+
+/**
+ * Requests that the socket of each user reading from the given log be
+ * flushed once all data appended thus far has been written.
+ *
+ * @param log
+ *     The guac_user_output_log whose readers should be flushed.
+ */
+void guac_user_output_log_flush(guac_user_output_log* log);
+
+/**
+ * Allocates a new output queue for the given user, starting the thread that
+ * drains that queue into the user's socket. The queue receives no data until
+ * attached to a log with guac_user_output_attach().
+ *
+ * @param client
+ *     The guac_client that the user is connected to.
+ *
+ * @param user
+ *     The user whose broadcast data should be queued.
+ *
+ * @return
+ *     A newly-allocated guac_user_output which must eventually be freed with
+ *     guac_user_output_free().
+ */
+guac_user_output* guac_user_output_alloc(guac_client* client, guac_user* user);
+
+/**
+ * Stops the thread draining the given output queue, detaches the queue from
+ * all logs, and frees the queue. Any data not yet written is discarded.
+ *
+ * @param output
+ *     The guac_user_output to free.
+ */
+void guac_user_output_free(guac_user_output* output);
+
+/**
+ * Begins delivering all data appended to the given log of data for pending
+ * users from this point forward. Any data still awaiting delivery from a log
+ * of data for pending users, as well as any data from a log of data for full
+ * users, is discarded.
+ *
+ * @param output
+ *     The guac_user_output of the user that is now pending.
+ *
+ * @param log
+ *     The log of data sent to pending users.
+ */
+void guac_user_output_attach(guac_user_output* output,
+        guac_user_output_log* log);
+
+/**
+ * Begins delivering all data appended to the given log of data for full
+ * users from this point forward, once all data appended thus far to the log
+ * of data for pending users has been written. No further data appended to
+ * the log of data for pending users is delivered.
+ *
+ * @param output
+ *     The guac_user_output of the user being promoted.
+ *
+ * @param log
+ *     The log of data sent to full users.
+ */
+void guac_user_output_promote(guac_user_output* output,
+        guac_user_output_log* log);
+
+/**
+ * Stops delivering data appended to any log after this point. Data appended
+ * prior to this call may or may not be delivered.
+ *
+ * @param output
+ *     The guac_user_output to detach from all logs.
+ */
+void guac_user_output_detach(guac_user_output* output);
+
+/**
+ * Returns whether the user of the given output queue fell too far behind the
+ * log of data for full users, such that the user should now be moved back to
+ * the list of pending users of the guac_client for their view of the
+ * connection to be rebuilt.
+ *
+ * @param output
+ *     The guac_user_output to check.
+ *
+ * @return
+ *     Non-zero if the user should be resynchronized, zero otherwise.
+ */
+int guac_user_output_needs_resync(guac_user_output* output);
+
+#endif
@@ -25,6 +25,7 @@
 #include "guacamole/mem.h"
 #include "guacamole/client.h"
 #include "guacamole/object.h"
+#include "guacamole/parser-constants.h"
 #include "guacamole/pool.h"
 #include "guacamole/protocol.h"
 #include "guacamole/socket.h"
@@ -55,6 +56,7 @@ guac_user* guac_user_alloc(void) {
     user->last_received_timestamp = guac_timestamp_current();
     user->last_frame_duration = 0;
     user->processing_lag = 0;
+    user->max_instruction_length = GUAC_INSTRUCTION_MAX_LENGTH;
     user->active = 1;
 
     /* Allocate stream pool */
@@ -119,6 +121,8 @@ guac_stream* guac_user_alloc_stream(guac_user* user) {
     allocd_stream->ack_handler = NULL;
     allocd_stream->blob_handler = NULL;
     allocd_stream->end_handler = NULL;
+    allocd_stream->window = GUAC_STREAM_DEFAULT_WINDOW;
+    allocd_stream->__unacknowledged = 0;
 
     return allocd_stream;
 
@@ -260,7 +264,7 @@ void guac_user_stream_png(guac_user* user, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/png", x, y);
 
     /* Write PNG data */
-    guac_png_write(socket, stream, surface);
+    guac_png_write(socket, stream, surface, NULL, NULL);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -281,7 +285,7 @@ void guac_user_stream_jpeg(guac_user* user, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/jpeg", x, y);
 
     /* Write JPEG data */
-    guac_jpeg_write(socket, stream, surface, quality);
+    guac_jpeg_write(socket, stream, surface, quality, NULL, NULL);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -303,7 +307,7 @@ void guac_user_stream_webp(guac_user* user, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/webp", x, y);
 
     /* Write WebP data */
-    guac_webp_write(socket, stream, surface, quality, lossless);
+    guac_webp_write(socket, stream, surface, quality, lossless, NULL, NULL);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -336,21 +336,41 @@ int guac_wol_wake(const char* mac_addr, const char* broadcast_addr,
     return -1;
 }
 
+/**
+ * Attempts a single connection to the given host, immediately closing that
+ * connection if it succeeds.
+ *
+ * @param hostname
+ *     The hostname or IP address of the system to connect to.
+ *
+ * @param port
+ *     The TCP port to connect to.
+ *
+ * @param timeout
+ *     The number of seconds to wait for the connection to succeed.
+ *
+ * @return
+ *     Non-zero if the connection succeeded, zero otherwise.
+ */
+static int guac_wol_probe(const char* hostname, const char* port,
+        const int timeout) {
+
+    int sockfd = guac_tcp_connect(hostname, port, timeout);
+    if (sockfd < 0)
+        return 0;
+
+    close(sockfd);
+    return 1;
+
+}
+
 int guac_wol_wake_and_wait(const char* mac_addr, const char* broadcast_addr,
         const unsigned short udp_port, int wait_time, int retries,
         const char* hostname, const char* port, const int timeout) {
 
-    /* Attempt to connect, first. */
-    int sockfd = guac_tcp_connect(hostname, port, timeout);
-
     /* If connection succeeds, no need to wake the system. */
-    if (sockfd > 0) {
-        close(sockfd);
+    if (guac_wol_probe(hostname, port, timeout))
         return 0;
-    }
-
-    /* Close the fd to avoid resource leak. */
-    close(sockfd);
 
     /* Send the magic WOL packet and store return value. */
     int retval = guac_wol_wake(mac_addr, broadcast_addr, udp_port);
@@ -359,23 +379,38 @@ int guac_wol_wake_and_wait(const char* mac_addr, const char* broadcast_addr,
     if (retval)
         return retval;
 
-    /* Try to connect on the specified TCP port and hostname or IP. */
-    for (int i = 0; i < retries; i++) {
+    /* Allow the system as long to wake as the configured retries would have
+     * allowed, but probe for readiness far more often so that the connection
+     * proceeds as soon as the system is reachable */
+    guac_timestamp now = guac_timestamp_current();
+    guac_timestamp deadline = now + (guac_timestamp) wait_time * retries * 1000;
+    guac_timestamp next_packet = now + (guac_timestamp) wait_time * 1000;
+    int interval = GUAC_WOL_PROBE_INITIAL_INTERVAL;
+
+    while (now < deadline) {
+
+        if (interval > deadline - now)
+            interval = deadline - now;
 
-        sockfd = guac_tcp_connect(hostname, port, timeout);
+        guac_timestamp_msleep(interval);
 
-        /* Connection succeeded - close socket and exit. */
-        if (sockfd > 0) {
-            close(sockfd);
+        if (guac_wol_probe(hostname, port, timeout))
             return 0;
+
+        now = guac_timestamp_current();
+
+        /* Magic packets are not guaranteed to arrive, so repeat the packet
+         * once per configured wait interval */
+        if (now >= next_packet) {
+            guac_wol_wake(mac_addr, broadcast_addr, udp_port);
+            next_packet = now + (guac_timestamp) wait_time * 1000;
         }
 
-        /**
-         * Connection did not succed - close the socket and sleep for the
-         * specified amount of time before retrying.
-         */
-        close(sockfd);
-        guac_timestamp_msleep(wait_time * 1000);
+        /* Back off gradually while the system is still waking */
+        interval *= 2;
+        if (interval > GUAC_WOL_PROBE_MAX_INTERVAL)
+            interval = GUAC_WOL_PROBE_MAX_INTERVAL;
+
     }
 
     /* Failed to connect, set error message and return an error. */
@@ -21,11 +21,13 @@
 #include "terminal/terminal.h"
 
 #include <guacamole/client.h>
+#include <guacamole/mem.h>
 #include <libwebsockets.h>
 
 #include <pthread.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 
 void guac_kubernetes_receive_data(guac_client* client,
         const char* buffer, size_t length) {
@@ -62,39 +64,76 @@ void guac_kubernetes_send_message(guac_client* client,
 
     pthread_mutex_lock(&(kubernetes_client->outbound_message_lock));
 
-    /* Add message to buffer if space is available */
-    if (kubernetes_client->outbound_messages_waiting
-            < GUAC_KUBERNETES_MAX_OUTBOUND_MESSAGES) {
+    /* Wait for room within the queue, providing backpressure to the sender
+     * rather than dropping data (a single message is always accepted if the
+     * queue is empty, regardless of its size) */
+    while (kubernetes_client->outbound_bytes > 0
+            && kubernetes_client->outbound_bytes + length
+                > GUAC_KUBERNETES_MAX_OUTBOUND_BYTES
+            && client->state == GUAC_CLIENT_RUNNING) {
 
-        /* Calculate storage position of next message */
-        int index = (kubernetes_client->outbound_messages_top
-                  + kubernetes_client->outbound_messages_waiting)
-                  % GUAC_KUBERNETES_MAX_OUTBOUND_MESSAGES;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += GUAC_KUBERNETES_SERVICE_INTERVAL / 1000;
 
-        /* Obtain pointer to message slot at calculated position */
-        guac_kubernetes_message* message =
-            &(kubernetes_client->outbound_messages[index]);
+        pthread_cond_timedwait(&(kubernetes_client->outbound_message_sent),
+                &(kubernetes_client->outbound_message_lock), &deadline);
 
-        /* Copy details of message into buffer */
+    }
+
+    /* Data can no longer be sent once the client is stopping */
+    if (client->state != GUAC_CLIENT_RUNNING) {
+        pthread_mutex_unlock(&(kubernetes_client->outbound_message_lock));
+        return;
+    }
+
+    guac_kubernetes_message* tail = kubernetes_client->outbound_messages_tail;
+
+    /* Combine STDIN data with any STDIN message still waiting to be sent */
+    if (channel == GUAC_KUBERNETES_CHANNEL_STDIN && tail != NULL
+            && tail->channel == channel
+            && tail->length + length <= tail->size) {
+        memcpy(tail->data + tail->length, data, length);
+        tail->length += length;
+    }
+
+    /* Otherwise, add a new message to the end of the queue, leaving room for
+     * further STDIN data */
+    else {
+
+        int size = length;
+        if (channel == GUAC_KUBERNETES_CHANNEL_STDIN
+                && size < GUAC_KUBERNETES_MAX_MESSAGE_SIZE)
+            size = GUAC_KUBERNETES_MAX_MESSAGE_SIZE;
+
+        guac_kubernetes_message* message = guac_mem_alloc(
+                guac_mem_ckd_add_or_die(sizeof(guac_kubernetes_message), size));
+
+        /* Copy details of message into queue */
+        message->next = NULL;
         message->channel = channel;
         memcpy(message->data, data, length);
         message->length = length;
+        message->size = size;
 
-        /* One more message is now waiting */
-        kubernetes_client->outbound_messages_waiting++;
+        if (tail != NULL)
+            tail->next = message;
+        else
+            kubernetes_client->outbound_messages_head = message;
 
-        /* Notify libwebsockets that we need a callback to send pending
-         * messages */
-        lws_callback_on_writable(kubernetes_client->wsi);
-        lws_cancel_service(kubernetes_client->context);
+        kubernetes_client->outbound_messages_tail = message;
 
     }
 
-    /* Warn if data has to be dropped */
-    else
-        guac_client_log(client, GUAC_LOG_WARNING, "Send buffer could not be "
-                "flushed in time to handle additional data. Outbound "
-                "message dropped.");
+    kubernetes_client->outbound_bytes += length;
+
+    /* Wake the libwebsockets service thread immediately, which will then
+     * request a callback to send pending messages (writable callbacks cannot
+     * safely be requested from outside the service thread) */
+#ifndef HAVE_LWS_CALLBACK_EVENT_WAIT_CANCELLED
+    lws_callback_on_writable(kubernetes_client->wsi);
+#endif
+    lws_cancel_service(kubernetes_client->context);
 
     pthread_mutex_unlock(&(kubernetes_client->outbound_message_lock));
 
@@ -108,35 +147,71 @@ bool guac_kubernetes_write_pending_message(guac_client* client) {
 
     pthread_mutex_lock(&(kubernetes_client->outbound_message_lock));
 
-    /* Send one message from top of buffer */
-    if (kubernetes_client->outbound_messages_waiting > 0) {
-
-        /* Obtain pointer to message at top */
-        int top = kubernetes_client->outbound_messages_top;
-        guac_kubernetes_message* message =
-            &(kubernetes_client->outbound_messages[top]);
+    /* Remove oldest message from queue, such that no further data can be
+     * combined with it */
+    guac_kubernetes_message* message = kubernetes_client->outbound_messages_head;
+    if (message != NULL) {
 
-        /* Write message including channel index */
-        lws_write(kubernetes_client->wsi,
-                ((unsigned char*) message) + LWS_PRE,
-                message->length + 1, LWS_WRITE_BINARY);
+        kubernetes_client->outbound_messages_head = message->next;
+        if (message->next == NULL)
+            kubernetes_client->outbound_messages_tail = NULL;
 
-        /* Advance top to next message */
-        kubernetes_client->outbound_messages_top++;
-        kubernetes_client->outbound_messages_top %=
-            GUAC_KUBERNETES_MAX_OUTBOUND_MESSAGES;
-
-        /* One less message is waiting */
-        kubernetes_client->outbound_messages_waiting--;
+        /* Wake any thread waiting for room within the queue */
+        kubernetes_client->outbound_bytes -= message->length;
+        pthread_cond_broadcast(&(kubernetes_client->outbound_message_sent));
 
     }
 
     /* Record whether messages remained at time of completion */
-    messages_remain = (kubernetes_client->outbound_messages_waiting > 0);
+    messages_remain = (kubernetes_client->outbound_messages_head != NULL);
 
     pthread_mutex_unlock(&(kubernetes_client->outbound_message_lock));
 
+    /* Write message including channel index */
+    if (message != NULL) {
+        lws_write(kubernetes_client->wsi, (unsigned char*) &(message->channel),
+                message->length + 1, LWS_WRITE_BINARY);
+        guac_mem_free(message);
+    }
+
     return messages_remain;
 
 }
 
+bool guac_kubernetes_has_pending_messages(guac_client* client) {
+
+    guac_kubernetes_client* kubernetes_client =
+        (guac_kubernetes_client*) client->data;
+
+    pthread_mutex_lock(&(kubernetes_client->outbound_message_lock));
+    bool messages_pending = (kubernetes_client->outbound_messages_head != NULL);
+    pthread_mutex_unlock(&(kubernetes_client->outbound_message_lock));
+
+    return messages_pending;
+
+}
+
+void guac_kubernetes_discard_messages(guac_client* client) {
+
+    guac_kubernetes_client* kubernetes_client =
+        (guac_kubernetes_client*) client->data;
+
+    pthread_mutex_lock(&(kubernetes_client->outbound_message_lock));
+
+    guac_kubernetes_message* message = kubernetes_client->outbound_messages_head;
+    while (message != NULL) {
+        guac_kubernetes_message* next = message->next;
+        guac_mem_free(message);
+        message = next;
+    }
+
+    kubernetes_client->outbound_messages_head = NULL;
+    kubernetes_client->outbound_messages_tail = NULL;
+    kubernetes_client->outbound_bytes = 0;
+
+    /* Wake any thread still waiting for room within the queue */
+    pthread_cond_broadcast(&(kubernetes_client->outbound_message_sent));
+
+    pthread_mutex_unlock(&(kubernetes_client->outbound_message_lock));
+
+}
@@ -27,11 +27,11 @@
 #include <stdint.h>
 
 /**
- * The maximum amount of data to include in any particular WebSocket message
- * to Kubernetes. This excludes the storage space required for the channel
- * index.
+ * The maximum amount of STDIN data to combine into any particular WebSocket
+ * message to Kubernetes. This excludes the storage space required for the
+ * channel index.
  */
-#define GUAC_KUBERNETES_MAX_MESSAGE_SIZE 1024
+#define GUAC_KUBERNETES_MAX_MESSAGE_SIZE 65536
 
 /**
  * The index of the Kubernetes channel used for STDIN.
@@ -58,6 +58,22 @@
  */
 typedef struct guac_kubernetes_message {
 
+    /**
+     * The next message in the outbound message queue, or NULL if this is the
+     * newest message.
+     */
+    struct guac_kubernetes_message* next;
+
+    /**
+     * The length of the data to be sent, excluding the channel index.
+     */
+    int length;
+
+    /**
+     * The number of bytes of data that this message has room for.
+     */
+    int size;
+
     /**
      * lws_write() requires leading padding of LWS_PRE bytes to provide
      * scratch space for WebSocket framing.
@@ -72,14 +88,9 @@ typedef struct guac_kubernetes_message {
 
     /**
      * The data that should be sent to Kubernetes (along with the channel
-     * index).
-     */
-    char data[GUAC_KUBERNETES_MAX_MESSAGE_SIZE];
-
-    /**
-     * The length of the data to be sent, excluding the channel index.
+     * index). Room is allocated for exactly size bytes.
      */
-    int length;
+    char data[];
 
 } guac_kubernetes_message;
 
@@ -102,9 +113,11 @@ void guac_kubernetes_receive_data(guac_client* client,
 /**
  * Requests that the given data be sent along the given channel to the
  * Kubernetes server when the WebSocket connection is next available for
- * writing. If the WebSocket connection has not been available for writing for
- * long enough that the outbound message buffer is full, the request to send
- * this particular message will be dropped.
+ * writing. STDIN data is appended to any STDIN message still waiting to be
+ * sent, such that data sent in quick succession forms a single WebSocket
+ * message. If the WebSocket connection has not been available for writing for
+ * long enough that GUAC_KUBERNETES_MAX_OUTBOUND_BYTES are already waiting,
+ * this function blocks until enough data has been sent or the client stops.
  *
  * @param client
  *     The guac_client associated with the Kubernetes connection.
@@ -139,5 +152,28 @@ void guac_kubernetes_send_message(guac_client* client,
  */
 bool guac_kubernetes_write_pending_message(guac_client* client);
 
+/**
+ * Returns whether any messages are waiting within the outbound message queue
+ * to be written with guac_kubernetes_write_pending_message().
+ *
+ * @param client
+ *     The guac_client associated with the Kubernetes connection.
+ *
+ * @return
+ *     true if messages are waiting to be written, false otherwise.
+ */
+bool guac_kubernetes_has_pending_messages(guac_client* client);
+
+/**
+ * Frees all messages remaining within the outbound message queue without
+ * sending them, waking any thread waiting within
+ * guac_kubernetes_send_message(). This function should be invoked only once
+ * the WebSocket connection has been closed and the client is stopping.
+ *
+ * @param client
+ *     The guac_client associated with the Kubernetes connection.
+ */
+void guac_kubernetes_discard_messages(guac_client* client);
+
 #endif
 
@@ -97,7 +97,9 @@ static int guac_kubernetes_lws_callback(struct lws* wsi,
         /* Connected / logged in */
         case LWS_CALLBACK_CLIENT_ESTABLISHED:
             guac_client_log(client, GUAC_LOG_INFO,
-                    "Kubernetes connection successful.");
+                    "Kubernetes connection successful (attached in %i ms).",
+                    (int) (guac_timestamp_current()
+                        - kubernetes_client->connect_started));
 
             /* Allow terminal to render */
             guac_terminal_start(kubernetes_client->term);
@@ -113,6 +115,15 @@ static int guac_kubernetes_lws_callback(struct lws* wsi,
             guac_kubernetes_receive_data(client, (const char*) in, length);
             break;
 
+#ifdef HAVE_LWS_CALLBACK_EVENT_WAIT_CANCELLED
+        /* Service thread woken by lws_cancel_service(), such as when new
+         * outbound messages have been queued by another thread */
+        case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+            if (guac_kubernetes_has_pending_messages(client))
+                lws_callback_on_writable(kubernetes_client->wsi);
+            break;
+#endif
+
         /* WebSocket is ready for writing */
         case LWS_CALLBACK_CLIENT_WRITEABLE:
 
@@ -238,7 +249,11 @@ void* guac_kubernetes_client_thread(void* data) {
                 !settings->recording_exclude_mouse,
                 0, /* Touch events not supported */
                 settings->recording_include_keys,
-                settings->recording_write_existing);
+                settings->recording_write_existing,
+                settings->recording_write_events,
+                settings->recording_overflow,
+                settings->recording_format,
+                0 /* Output is always copied as sent to users */);
     }
 
     /* Create terminal options with required parameters */
@@ -277,7 +292,9 @@ void* guac_kubernetes_client_thread(void* data) {
                 settings->typescript_path,
                 settings->typescript_name,
                 settings->create_typescript_path,
-                settings->typescript_write_existing);
+                settings->typescript_write_existing,
+                settings->typescript_format,
+                settings->typescript_compress);
     }
 
     /* Init libwebsockets context creation parameters */
@@ -329,6 +346,7 @@ void* guac_kubernetes_client_thread(void* data) {
     connection_info.path = endpoint_path;
 
     /* Open WebSocket connection to Kubernetes */
+    kubernetes_client->connect_started = guac_timestamp_current();
     kubernetes_client->wsi = lws_client_connect_via_info(&connection_info);
     if (kubernetes_client->wsi == NULL) {
         guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
@@ -336,8 +354,9 @@ void* guac_kubernetes_client_thread(void* data) {
         goto fail;
     }
 
-    /* Init outbound message buffer */
+    /* Init outbound message queue */
     pthread_mutex_init(&(kubernetes_client->outbound_message_lock), NULL);
+    pthread_cond_init(&(kubernetes_client->outbound_message_sent), NULL);
 
     /* Start input thread */
     if (pthread_create(&(input_thread), NULL, guac_kubernetes_input_thread, (void*) client)) {
@@ -360,9 +379,11 @@ void* guac_kubernetes_client_thread(void* data) {
 
     }
 
-    /* Kill client and Wait for input thread to die */
+    /* Kill client and Wait for input thread to die (waking the input thread
+     * if it is waiting for room within the outbound message queue) */
     guac_terminal_stop(kubernetes_client->term);
     guac_client_stop(client);
+    guac_kubernetes_discard_messages(client);
     pthread_join(input_thread, NULL);
 
 fail:
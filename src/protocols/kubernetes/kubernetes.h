@@ -27,6 +27,7 @@
 
 #include <guacamole/client.h>
 #include <guacamole/recording.h>
+#include <guacamole/timestamp.h>
 #include <libwebsockets.h>
 
 #include <pthread.h>
@@ -38,11 +39,11 @@
 #define GUAC_KUBERNETES_LWS_PROTOCOL "v4.channel.k8s.io"
 
 /**
- * The maximum number of messages to allow within the outbound message buffer.
- * If messages are sent despite the buffer being full, those messages will be
- * dropped.
+ * The maximum number of bytes of data to allow within the outbound message
+ * queue. Attempts to send further data block until enough queued data has
+ * been sent.
  */
-#define GUAC_KUBERNETES_MAX_OUTBOUND_MESSAGES 8
+#define GUAC_KUBERNETES_MAX_OUTBOUND_BYTES 1048576
 
 /**
  * The maximum number of milliseconds to wait for a libwebsockets event to
@@ -71,28 +72,34 @@ typedef struct guac_kubernetes_client {
     struct lws* wsi;
 
     /**
-     * Outbound message ring buffer for outbound WebSocket messages. As
-     * libwebsockets uses an event loop for all operations, outbound messages
-     * may be sent only in context of a particular event received via a
-     * callback. Until that event is received, pending data must accumulate in
-     * a buffer.
+     * The oldest message within the queue of outbound WebSocket messages, or
+     * NULL if no messages are waiting. As libwebsockets uses an event loop for
+     * all operations, outbound messages may be sent only in context of a
+     * particular event received via a callback. Until that event is received,
+     * pending data must accumulate in this queue.
      */
-    guac_kubernetes_message outbound_messages[GUAC_KUBERNETES_MAX_OUTBOUND_MESSAGES];
+    guac_kubernetes_message* outbound_messages_head;
 
     /**
-     * The number of messages currently waiting in the outbound message
-     * buffer.
+     * The newest message within the queue of outbound WebSocket messages, or
+     * NULL if no messages are waiting.
      */
-    int outbound_messages_waiting;
+    guac_kubernetes_message* outbound_messages_tail;
 
     /**
-     * The index of the oldest entry in the outbound message buffer. Newer
-     * messages follow this entry.
+     * The total number of bytes of data within all messages of the outbound
+     * message queue.
      */
-    int outbound_messages_top;
+    size_t outbound_bytes;
 
     /**
-     * Lock which is acquired when the outbound message buffer is being read
+     * Condition which is signalled whenever data is removed from the outbound
+     * message queue, waking any thread waiting for room within the queue.
+     */
+    pthread_cond_t outbound_message_sent;
+
+    /**
+     * Lock which is acquired when the outbound message queue is being read
      * or manipulated.
      */
     pthread_mutex_t outbound_message_lock;
@@ -125,6 +132,12 @@ typedef struct guac_kubernetes_client {
      */
     guac_recording* recording;
 
+    /**
+     * The time at which the WebSocket connection to the Kubernetes server
+     * was requested, used to measure how long attaching to the pod takes.
+     */
+    guac_timestamp connect_started;
+
 } guac_kubernetes_client;
 
 /**
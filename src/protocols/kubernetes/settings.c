@@ -22,6 +22,7 @@
 #include "terminal/terminal.h"
 
 #include <guacamole/mem.h>
+#include <guacamole/recording.h>
 #include <guacamole/user.h>
 
 #include <stdlib.h>
@@ -46,6 +47,8 @@ const char* GUAC_KUBERNETES_CLIENT_ARGS[] = {
     "typescript-name",
     "create-typescript-path",
     "typescript-write-existing",
+    "typescript-format",
+    "typescript-compress",
     "recording-path",
     "recording-name",
     "recording-exclude-output",
@@ -53,6 +56,9 @@ const char* GUAC_KUBERNETES_CLIENT_ARGS[] = {
     "recording-include-keys",
     "create-recording-path",
     "recording-write-existing",
+    "recording-overflow",
+    "recording-format",
+    "recording-write-events",
     "read-only",
     "backspace",
     "scrollback",
@@ -158,8 +164,8 @@ enum KUBERNETES_ARGS_IDX {
 
     /**
      * The name that should be given to typescripts which are written in the
-     * given path. Each typescript will consist of two files: "NAME" and
-     * "NAME.timing".
+     * given path. Unless the combined format is used, each typescript will
+     * consist of two files: "NAME" and "NAME.timing".
      */
     IDX_TYPESCRIPT_NAME,
 
@@ -175,6 +181,19 @@ enum KUBERNETES_ARGS_IDX {
      */
     IDX_TYPESCRIPT_WRITE_EXISTING,
 
+    /**
+     * The layout of the typescript files: "split" (the default) for a
+     * separate data and timing file compatible with scriptreplay, or
+     * "combined" for a single file containing both.
+     */
+    IDX_TYPESCRIPT_FORMAT,
+
+    /**
+     * "true" if the typescript files should be compressed with zstd, "false"
+     * or blank otherwise.
+     */
+    IDX_TYPESCRIPT_COMPRESS,
+
     /**
      * The full absolute path to the directory in which screen recordings
      * should be written.
@@ -225,6 +244,27 @@ enum KUBERNETES_ARGS_IDX {
      */
     IDX_RECORDING_WRITE_EXISTING,
 
+    /**
+     * The behavior to use if session data is produced faster than it can be
+     * written to the recording file: "block" (the default), "drop", or
+     * "spill".
+     */
+    IDX_RECORDING_OVERFLOW,
+
+    /**
+     * The format of the recording file: "raw" (the default), or "compressed"
+     * for a compressed recording which can be played back starting from any
+     * point in time.
+     */
+    IDX_RECORDING_FORMAT,
+
+    /**
+     * "true" if the mouse, touch, and key events included within the
+     * recording should also be written to a separate, compact binary file
+     * alongside the recording, "false" or blank otherwise.
+     */
+    IDX_RECORDING_WRITE_EVENTS,
+
     /**
      * "true" if this connection should be read-only (user input should be
      * dropped), "false" or blank otherwise.
@@ -384,6 +424,17 @@ guac_kubernetes_settings* guac_kubernetes_parse_args(guac_user* user,
         guac_user_parse_args_boolean(user, GUAC_KUBERNETES_CLIENT_ARGS, argv,
                 IDX_TYPESCRIPT_WRITE_EXISTING, false);
 
+    /* Parse typescript file format */
+    settings->typescript_format =
+        guac_terminal_typescript_parse_args_format(user, GUAC_KUBERNETES_CLIENT_ARGS,
+                argv, IDX_TYPESCRIPT_FORMAT,
+                GUAC_TERMINAL_TYPESCRIPT_FORMAT_SPLIT);
+
+    /* Parse typescript compression flag */
+    settings->typescript_compress =
+        guac_user_parse_args_boolean(user, GUAC_KUBERNETES_CLIENT_ARGS, argv,
+                IDX_TYPESCRIPT_COMPRESS, false);
+
     /* Read recording path */
     settings->recording_path =
         guac_user_parse_args_string(user, GUAC_KUBERNETES_CLIENT_ARGS, argv,
@@ -419,6 +470,21 @@ guac_kubernetes_settings* guac_kubernetes_parse_args(guac_user* user,
         guac_user_parse_args_boolean(user, GUAC_KUBERNETES_CLIENT_ARGS, argv,
                 IDX_RECORDING_WRITE_EXISTING, false);
 
+    /* Parse recording overflow behavior */
+    settings->recording_overflow =
+        guac_recording_parse_args_overflow(user, GUAC_KUBERNETES_CLIENT_ARGS, argv,
+                IDX_RECORDING_OVERFLOW, GUAC_RECORDING_OVERFLOW_BLOCK);
+
+    /* Parse recording file format */
+    settings->recording_format =
+        guac_recording_parse_args_format(user, GUAC_KUBERNETES_CLIENT_ARGS, argv,
+                IDX_RECORDING_FORMAT, GUAC_RECORDING_FORMAT_RAW);
+
+    /* Parse input event sidecar flag */
+    settings->recording_write_events =
+        guac_user_parse_args_boolean(user, GUAC_KUBERNETES_CLIENT_ARGS, argv,
+                IDX_RECORDING_WRITE_EVENTS, false);
+
     /* Parse backspace key code */
     settings->backspace =
         guac_user_parse_args_int(user, GUAC_KUBERNETES_CLIENT_ARGS, argv,
@@ -33,6 +33,7 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 /**
@@ -209,6 +210,13 @@ static void guac_rdp_audio_buffer_wait(guac_rdp_audio_buffer* audio_buffer) {
  * the software running within the RDP server. Once started, this thread runs
  * until the associated audio buffer is freed via guac_rdp_audio_buffer_free().
  *
+ * Each packet is copied out of the audio buffer before being flushed, such
+ * that the audio buffer's lock is not held while the packet is sent and
+ * received audio data can continue to be written in the meantime. As
+ * sending a packet requires the RDP message lock, and the audio buffer is
+ * otherwise modified by RDP channel handlers while that lock is held, the
+ * message lock is always acquired before the audio buffer's lock.
+ *
  * @param data
  *     A pointer to the guac_rdp_audio_buffer that should be flushed.
  *
@@ -218,6 +226,12 @@ static void guac_rdp_audio_buffer_wait(guac_rdp_audio_buffer* audio_buffer) {
 static void* guac_rdp_audio_buffer_flush_thread(void* data) {
 
     guac_rdp_audio_buffer* audio_buffer = (guac_rdp_audio_buffer*) data;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) audio_buffer->client->data;
+
+    /* Copy of the packet currently being flushed, owned by this thread */
+    char* flush_packet = NULL;
+    size_t flush_packet_size = 0;
+
     while (!audio_buffer->stopping) {
 
         pthread_mutex_lock(&(audio_buffer->lock));
@@ -236,15 +250,38 @@ static void* guac_rdp_audio_buffer_flush_thread(void* data) {
 
         }
 
+        pthread_mutex_unlock(&(audio_buffer->lock));
+
+        /* Reacquire, respecting the order of the RDP message lock */
+        pthread_mutex_lock(&(rdp_client->message_lock));
+        pthread_mutex_lock(&(audio_buffer->lock));
+
+        /* The state of the buffer may have changed while reacquiring */
+        if (!guac_rdp_audio_buffer_may_flush(audio_buffer)) {
+            pthread_mutex_unlock(&(audio_buffer->lock));
+            pthread_mutex_unlock(&(rdp_client->message_lock));
+            continue;
+        }
+
         guac_client_log(audio_buffer->client, GUAC_LOG_TRACE, "Current audio input latency: %i ms (%i bytes waiting in buffer)",
                 guac_rdp_audio_buffer_duration(&audio_buffer->out_format, audio_buffer->bytes_written),
                 audio_buffer->bytes_written);
 
-        /* Only actually invoke if defined */
-        if (audio_buffer->flush_handler) {
+        guac_rdp_audio_buffer_flush_handler* flush_handler = audio_buffer->flush_handler;
+        int length = audio_buffer->packet_size;
+
+        /* Copy packet for flushing only if it will actually be flushed */
+        if (flush_handler) {
+
             guac_rdp_audio_buffer_schedule_flush(audio_buffer);
-            audio_buffer->flush_handler(audio_buffer,
-                    audio_buffer->packet_size);
+
+            if (flush_packet_size < audio_buffer->packet_size) {
+                flush_packet = guac_mem_realloc_or_die(flush_packet, audio_buffer->packet_size);
+                flush_packet_size = audio_buffer->packet_size;
+            }
+
+            memcpy(flush_packet, audio_buffer->packet, length);
+
         }
 
         /* Shift buffer back by one packet */
@@ -254,8 +291,15 @@ static void* guac_rdp_audio_buffer_flush_thread(void* data) {
         pthread_cond_broadcast(&(audio_buffer->modified));
         pthread_mutex_unlock(&(audio_buffer->lock));
 
+        /* Only actually invoke if defined */
+        if (flush_handler)
+            flush_handler(audio_buffer, flush_packet, length);
+
+        pthread_mutex_unlock(&(rdp_client->message_lock));
+
     }
 
+    guac_mem_free(flush_packet);
     return NULL;
 
 }
@@ -433,100 +477,163 @@ void guac_rdp_audio_buffer_begin(guac_rdp_audio_buffer* audio_buffer,
 }
 
 /**
- * Reads a single sample from the given buffer of data, using the input
- * format defined within the given audio buffer. Each read sample is
- * translated to a signed 16-bit value, even if the input format is 8-bit.
- * The offset into the given buffer will be determined according to the
- * input and output formats, the number of bytes sent thus far, and the
- * number of bytes received (excluding the contents of the buffer).
+ * Converts the given buffer of received audio data from the input format of
+ * the given audio buffer to its output format, appending the result to the
+ * packet buffer. The position of each output sample within the input data is
+ * determined according to the input and output formats, the number of bytes
+ * sent thus far, and the number of bytes received (excluding the contents of
+ * the given buffer). Conversion continues until no data remains within the
+ * given buffer that has not already been mapped to an output sample.
+ *
+ * Wherever the data of an entire output frame can be copied directly from
+ * the corresponding input frame, it is copied as a single block rather than
+ * sample by sample. Output samples which do not fit within the packet buffer
+ * are dropped, but are still counted as sent such that the positions of all
+ * later samples remain correct.
  *
  * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
  * invoking this function.
  *
  * @param audio_buffer
- *     The audio buffer dictating the format of the given data buffer, as
- *     well as the offset from which the sample should be read.
+ *     The audio buffer dictating the input and output formats, and whose
+ *     packet buffer should receive the converted audio data.
  *
  * @param buffer
- *     The buffer of raw PCM audio data from which the sample should be read.
- *     This buffer MUST NOT contain data already taken into account by the
- *     audio buffer's total_bytes_received counter.
+ *     The buffer of raw PCM audio data to convert. This buffer MUST NOT
+ *     contain data already taken into account by the audio buffer's
+ *     total_bytes_received counter.
  *
  * @param length
  *     The number of bytes within the given buffer of PCM data.
  *
- * @param sample
- *     A pointer to the int16_t in which the read sample should be stored. If
- *     the input format is 8-bit, the sample will be shifted left by 8 bits
- *     to produce a 16-bit sample.
- *
  * @return
- *     Non-zero if a sample was successfully read, zero if no data remains
- *     within the given buffer that has not already been mapped to an
- *     output sample.
+ *     The number of bytes of converted audio data that were dropped due to
+ *     insufficient space within the packet buffer.
  */
-static int guac_rdp_audio_buffer_read_sample(
-        guac_rdp_audio_buffer* audio_buffer, const char* buffer, int length,
-        int16_t* sample) {
+static int guac_rdp_audio_buffer_convert(guac_rdp_audio_buffer* audio_buffer,
+        const char* buffer, int length) {
+
+    const guac_rdp_audio_format* in_format = &audio_buffer->in_format;
+    const guac_rdp_audio_format* out_format = &audio_buffer->out_format;
+
+    int in_bps = in_format->bps;
+    int in_channels = in_format->channels;
+    int in_frame_size = in_bps * in_channels;
+
+    int out_bps = out_format->bps;
+    int out_channels = out_format->channels;
+    int out_frame_size = out_bps * out_channels;
+
+    char* output = audio_buffer->packet + audio_buffer->bytes_written;
+    int available = audio_buffer->packet_buffer_size - audio_buffer->bytes_written;
+    int dropped = 0;
+
+    /* Frames can be copied as-is if only the rate (if anything) differs */
+    int copy_frames = (in_bps == out_bps && in_channels == out_channels);
+
+    /* If the formats are identical, the entire buffer maps directly onto
+     * the output */
+    if (copy_frames && in_format->rate == out_format->rate
+            && audio_buffer->total_bytes_sent == audio_buffer->total_bytes_received) {
+
+        int copied = length < available ? length : available;
+        memcpy(output, buffer, copied);
 
-    int in_bps = audio_buffer->in_format.bps;
-    int in_rate = audio_buffer->in_format.rate;
-    int in_channels = audio_buffer->in_format.channels;
+        audio_buffer->bytes_written += copied;
+        audio_buffer->total_bytes_sent += length;
+        return length - copied;
 
-    int out_bps = audio_buffer->out_format.bps;
-    int out_rate = audio_buffer->out_format.rate;
-    int out_channels = audio_buffer->out_format.channels;
+    }
 
     /* Calculate position within audio output */
-    int current_sample  = audio_buffer->total_bytes_sent / out_bps;
-    int current_frame   = current_sample / out_channels;
+    int current_sample = audio_buffer->total_bytes_sent / out_bps;
+    int64_t current_frame = current_sample / out_channels;
     int current_channel = current_sample % out_channels;
 
-    /* Map output channel to input channel */
-    if (current_channel >= in_channels)
-        current_channel = in_channels - 1;
+    for (;;) {
 
-    /* Transform output position to input position */
-    current_frame = (int) current_frame * ((double) in_rate / out_rate);
-    current_sample = current_frame * in_channels + current_channel;
+        /* Transform output position to input position */
+        int64_t in_frame = current_frame * in_format->rate / out_format->rate;
 
-    /* Calculate offset within given buffer from absolute input position */
-    int offset = current_sample * in_bps
-               - audio_buffer->total_bytes_received;
+        /* Calculate offset within given buffer from absolute input position */
+        int64_t offset = in_frame * in_frame_size
+                       - audio_buffer->total_bytes_received;
 
-    /* It should be impossible for the offset to ever go negative */
-    assert(offset >= 0);
+        /* It should be impossible for the offset to ever go negative */
+        assert(offset >= 0);
 
-    /* Apply offset to buffer */
-    buffer += offset;
-    length -= offset;
+        /* Copy entire frame at once if possible */
+        if (copy_frames && current_channel == 0
+                && offset + in_frame_size <= length
+                && available >= out_frame_size) {
 
-    /* Read only if sufficient data is present in the given buffer */
-    if (length < in_bps)
-        return 0;
+            memcpy(output, buffer + offset, out_frame_size);
+            output += out_frame_size;
+            available -= out_frame_size;
 
-    /* Simply read sample directly if input is 16-bit */
-    if (in_bps == 2) {
-        *sample = *((int16_t*) buffer);
-        return 1;
-    }
+            audio_buffer->bytes_written += out_frame_size;
+            audio_buffer->total_bytes_sent += out_frame_size;
+            current_frame++;
+            continue;
 
-    /* Translate to 16-bit if input is 8-bit */
-    if (in_bps == 1) {
-        *sample = *buffer << 8;
-        return 1;
-    }
+        }
+
+        /* Otherwise, convert each sample of the frame individually */
+        for (; current_channel < out_channels; current_channel++) {
+
+            /* Map output channel to input channel */
+            int in_channel = current_channel;
+            if (in_channel >= in_channels)
+                in_channel = in_channels - 1;
+
+            /* Read only if sufficient data is present in the given buffer */
+            int64_t sample_offset = offset + in_channel * in_bps;
+            if (sample_offset + in_bps > length)
+                return dropped;
 
-    /* Accepted audio formats are required to be 8- or 16-bit */
-    return 0;
+            const char* current = buffer + sample_offset;
+            int16_t sample;
+
+            /* Simply read sample directly if input is 16-bit, translating to
+             * 16-bit if input is 8-bit (accepted audio formats are required
+             * to be 8- or 16-bit) */
+            if (in_bps == 2)
+                sample = *((int16_t*) current);
+            else
+                sample = *current * 256;
+
+            /* Store as 16-bit or 8-bit, depending on output format, dropping
+             * the sample if there is no space */
+            if (available >= out_bps) {
+
+                if (out_bps == 2)
+                    *((int16_t*) output) = sample;
+                else
+                    *output = sample >> 8;
+
+                output += out_bps;
+                available -= out_bps;
+                audio_buffer->bytes_written += out_bps;
+
+            }
+            else
+                dropped += out_bps;
+
+            audio_buffer->total_bytes_sent += out_bps;
+
+        }
+
+        /* Advance to next frame */
+        current_channel = 0;
+        current_frame++;
+
+    }
 
 }
 
 void guac_rdp_audio_buffer_write(guac_rdp_audio_buffer* audio_buffer,
         char* buffer, int length) {
 
-    int16_t sample;
-
     pthread_mutex_lock(&(audio_buffer->lock));
 
     guac_client_log(audio_buffer->client, GUAC_LOG_TRACE, "Received %i bytes (%i ms) of audio data",
@@ -540,38 +647,12 @@ void guac_rdp_audio_buffer_write(guac_rdp_audio_buffer* audio_buffer,
         return;
     }
 
-    /* Truncate received samples if exceeding size of buffer */
-    int available = audio_buffer->packet_buffer_size - audio_buffer->bytes_written;
-    if (length > available) {
-        guac_client_log(audio_buffer->client, GUAC_LOG_DEBUG, "Truncating %i "
-                "bytes of received audio data to %i bytes (insufficient space "
-                "in buffer).", length, available);
-        length = available;
-    }
-
-    int out_bps = audio_buffer->out_format.bps;
-
-    /* Continuously write packets until no data remains */
-    while (guac_rdp_audio_buffer_read_sample(audio_buffer,
-                buffer, length, &sample) > 0) {
-
-        char* current = audio_buffer->packet + audio_buffer->bytes_written;
-
-        /* Store as 16-bit or 8-bit, depending on output format */
-        if (out_bps == 2)
-            *((int16_t*) current) = sample;
-        else if (out_bps == 1)
-            *current = sample >> 8;
-
-        /* Accepted audio formats are required to be 8- or 16-bit */
-        else
-            assert(0);
-
-        /* Update byte counters */
-        audio_buffer->bytes_written += out_bps;
-        audio_buffer->total_bytes_sent += out_bps;
-
-    } /* end packet write loop */
+    /* Convert and store all received samples */
+    int dropped = guac_rdp_audio_buffer_convert(audio_buffer, buffer, length);
+    if (dropped > 0)
+        guac_client_log(audio_buffer->client, GUAC_LOG_DEBUG, "Dropped %i "
+                "bytes of converted audio data (insufficient space in "
+                "buffer).", dropped);
 
     /* Track current position in audio stream */
     audio_buffer->total_bytes_received += length;
@@ -45,16 +45,25 @@ typedef struct guac_rdp_audio_buffer guac_rdp_audio_buffer;
  * Handler which is invoked when a guac_rdp_audio_buffer's internal packet
  * buffer has reached capacity and must be flushed.
  *
+ * The handler is invoked with the RDP message lock held, but without the
+ * lock of the audio buffer itself, and is provided a copy of the packet to
+ * be flushed rather than the internal packet buffer.
+ *
  * @param audio_buffer
  *     The guac_rdp_audio_buffer that has reached capacity and needs to be
  *     flushed.
  *
+ * @param packet
+ *     The audio data to be flushed. This data is only guaranteed to remain
+ *     valid until the handler returns.
+ *
  * @param length
- *     The number of bytes stored within the buffer. This is guaranteed to be
- *     identical to the packet_size value specified when the audio buffer was
- *     initialized.
+ *     The number of bytes of audio data to be flushed. This is guaranteed to
+ *     be identical to the packet_size value specified when the audio buffer
+ *     was initialized.
  */
-typedef void guac_rdp_audio_buffer_flush_handler(guac_rdp_audio_buffer* audio_buffer, int length);
+typedef void guac_rdp_audio_buffer_flush_handler(guac_rdp_audio_buffer* audio_buffer,
+        const char* packet, int length);
 
 /**
  * A description of an arbitrary PCM audio format.
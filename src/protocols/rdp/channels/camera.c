@@ -29,7 +29,10 @@
 #endif
 #include <guacamole/client.h>
 #include <guacamole/mem.h>
+#include <guacamole/timestamp.h>
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -38,13 +41,16 @@
 
 guac_rdp_camera* guac_rdp_camera_alloc(guac_client* client) {
 
-    guac_rdp_camera* camera = guac_mem_alloc(sizeof(guac_rdp_camera));
+    guac_rdp_camera* camera = guac_mem_zalloc(sizeof(guac_rdp_camera));
     camera->client = client;
     camera->virtual_device_path = NULL;
     camera->active = 0;
     camera->video_stream = NULL;
     camera->device_fd = -1;
 
+    pthread_mutex_init(&(camera->lock), NULL);
+    pthread_cond_init(&(camera->modified), NULL);
+
     return camera;
 
 }
@@ -57,11 +63,145 @@ void guac_rdp_camera_free(guac_rdp_camera* camera) {
     /* Stop video stream and cleanup */
     guac_rdp_camera_stop_stream(camera);
 
+    /* Free buffers retained for queued frames */
+    for (int i = 0; i < GUAC_RDP_CAMERA_MAX_FRAMES; i++)
+        guac_mem_free(camera->frames[i].data);
+
+    pthread_cond_destroy(&(camera->modified));
+    pthread_mutex_destroy(&(camera->lock));
+
     guac_mem_free(camera->virtual_device_path);
     guac_mem_free(camera);
 
 }
 
+/**
+ * Logs the frame rate and throughput of the given camera since statistics
+ * were last logged, if at least GUAC_RDP_CAMERA_STATS_INTERVAL milliseconds
+ * have elapsed. The lock of the camera must be held.
+ *
+ * @param camera
+ *     The camera whose statistics should be logged.
+ */
+static void guac_rdp_camera_log_stats(guac_rdp_camera* camera) {
+
+    guac_timestamp now = guac_timestamp_current();
+    guac_timestamp elapsed = now - camera->last_stats_timestamp;
+    if (elapsed < GUAC_RDP_CAMERA_STATS_INTERVAL)
+        return;
+
+    guac_rdp_camera_stats* current = &(camera->stats);
+    guac_rdp_camera_stats* last = &(camera->last_stats);
+
+    guac_client_log(camera->client, GUAC_LOG_DEBUG, "Camera redirection: "
+            "%.1f frames/s, %.1f KiB/s written, %lu frame(s) dropped in "
+            "the last %ims.",
+            (current->frames_written - last->frames_written) * 1000.0 / elapsed,
+            (current->bytes_written - last->bytes_written) * 1000.0 / 1024 / elapsed,
+            current->frames_dropped - last->frames_dropped,
+            (int) elapsed);
+
+    camera->last_stats = camera->stats;
+    camera->last_stats_timestamp = now;
+
+}
+
+/**
+ * Writes the entirety of the given frame to the given file descriptor,
+ * retrying as necessary if interrupted or if only part of the frame could be
+ * written at once.
+ *
+ * @param fd
+ *     The file descriptor to write to.
+ *
+ * @param frame
+ *     The frame to write.
+ *
+ * @return
+ *     Zero if the entire frame was written, non-zero if an error occurs.
+ */
+static int guac_rdp_camera_write_frame(int fd,
+        const guac_rdp_camera_frame* frame) {
+
+    const char* current = frame->data;
+    int remaining = frame->length;
+
+    while (remaining > 0) {
+
+        ssize_t written = write(fd, current, remaining);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+
+        current += written;
+        remaining -= written;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Writes each frame queued by guac_rdp_camera_handle_video_data() to the
+ * virtual camera device, in order. The lock of the camera is not held while
+ * a frame is written, such that further frames can be queued (or dropped)
+ * without waiting for the device. Once started, this thread runs until
+ * stopped by guac_rdp_camera_stop_stream().
+ *
+ * @param data
+ *     A pointer to the guac_rdp_camera whose frames should be written.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_rdp_camera_writer_thread(void* data) {
+
+    guac_rdp_camera* camera = (guac_rdp_camera*) data;
+
+    pthread_mutex_lock(&(camera->lock));
+
+    while (!camera->stopping) {
+
+        /* Wait for a frame to be queued */
+        if (camera->frame_count == 0) {
+            pthread_cond_wait(&(camera->modified), &(camera->lock));
+            continue;
+        }
+
+        /* The oldest frame remains queued (and thus untouched by other
+         * threads) until written */
+        guac_rdp_camera_frame* frame = &(camera->frames[camera->frame_head]);
+        int fd = camera->device_fd;
+
+        pthread_mutex_unlock(&(camera->lock));
+        int result = guac_rdp_camera_write_frame(fd, frame);
+        pthread_mutex_lock(&(camera->lock));
+
+        if (result)
+            guac_client_log(camera->client, GUAC_LOG_WARNING,
+                "Failed to write video data to virtual device");
+
+        else {
+            camera->stats.frames_written++;
+            camera->stats.bytes_written += frame->length;
+        }
+
+        /* Release frame */
+        camera->frame_head = (camera->frame_head + 1) % GUAC_RDP_CAMERA_MAX_FRAMES;
+        camera->frame_count--;
+
+        guac_rdp_camera_log_stats(camera);
+
+    }
+
+    pthread_mutex_unlock(&(camera->lock));
+    return NULL;
+
+}
+
 #ifdef HAVE_FREERDP_CAMERA
 
 /**
@@ -192,6 +332,22 @@ int guac_rdp_camera_start_stream(guac_rdp_camera* camera) {
     guac_client_log(client, GUAC_LOG_DEBUG,
         "Created virtual camera device: %s", camera->virtual_device_path);
 
+    /* Write all video data to the device from a dedicated thread */
+    camera->stopping = 0;
+    camera->frame_head = 0;
+    camera->frame_count = 0;
+    camera->last_stats_timestamp = guac_timestamp_current();
+
+    if (pthread_create(&(camera->writer_thread), NULL,
+                guac_rdp_camera_writer_thread, camera)) {
+        guac_client_log(client, GUAC_LOG_ERROR,
+            "Failed to start camera writer thread");
+        guac_rdp_camera_stop_stream(camera);
+        return -1;
+    }
+
+    camera->writer_started = 1;
+
     return 0;
 }
 
@@ -200,6 +356,26 @@ void guac_rdp_camera_stop_stream(guac_rdp_camera* camera) {
     if (camera == NULL)
         return;
 
+    /* Stop writing frames, abandoning any that remain queued */
+    pthread_mutex_lock(&(camera->lock));
+    camera->stopping = 1;
+    pthread_cond_broadcast(&(camera->modified));
+    pthread_mutex_unlock(&(camera->lock));
+
+    if (camera->writer_started) {
+
+        pthread_join(camera->writer_thread, NULL);
+        camera->writer_started = 0;
+
+        guac_client_log(camera->client, GUAC_LOG_DEBUG, "Camera redirection "
+                "stopped: %lu frame(s) received, %lu written, %lu dropped.",
+                camera->stats.frames_received, camera->stats.frames_written,
+                camera->stats.frames_dropped);
+
+    }
+
+    camera->frame_count = 0;
+
     /* Close and remove virtual device */
     if (camera->device_fd != -1) {
         close(camera->device_fd);
@@ -222,18 +398,46 @@ int guac_rdp_camera_handle_video_data(guac_rdp_camera* camera,
     if (camera == NULL || camera->device_fd == -1 || data == NULL || length <= 0)
         return -1;
 
-    /* Write video data to virtual device pipe */
-    ssize_t bytes_written = write(camera->device_fd, data, length);
+    pthread_mutex_lock(&(camera->lock));
 
-    if (bytes_written != length) {
-        guac_client_log(camera->client, GUAC_LOG_WARNING,
-            "Failed to write video data to virtual device");
-        return -1;
+    camera->stats.frames_received++;
+
+    /* Drop the entire frame if the device is not keeping up */
+    if (camera->frame_count == GUAC_RDP_CAMERA_MAX_FRAMES) {
+        camera->stats.frames_dropped++;
+        pthread_mutex_unlock(&(camera->lock));
+        return 0;
     }
 
+    /* Copy frame into next free slot, reusing its buffer where possible */
+    guac_rdp_camera_frame* frame = &(camera->frames[
+        (camera->frame_head + camera->frame_count) % GUAC_RDP_CAMERA_MAX_FRAMES]);
+
+    if (frame->size < length) {
+        frame->data = guac_mem_realloc_or_die(frame->data, length);
+        frame->size = length;
+    }
+
+    memcpy(frame->data, data, length);
+    frame->length = length;
+
+    camera->frame_count++;
+    pthread_cond_signal(&(camera->modified));
+
+    pthread_mutex_unlock(&(camera->lock));
+
     return 0;
 }
 
+void guac_rdp_camera_get_stats(guac_rdp_camera* camera,
+        guac_rdp_camera_stats* stats) {
+
+    pthread_mutex_lock(&(camera->lock));
+    *stats = camera->stats;
+    pthread_mutex_unlock(&(camera->lock));
+
+}
+
 int guac_rdp_camera_blob_handler(guac_user* user, guac_stream* stream,
         void* data, int length) {
 
@@ -23,6 +23,76 @@
 #include <freerdp/freerdp.h>
 #include <guacamole/client.h>
 #include <guacamole/stream.h>
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+
+/**
+ * The maximum number of frames of video data that may be queued for writing
+ * to the virtual camera device. Frames received while this many frames are
+ * already queued are dropped.
+ */
+#define GUAC_RDP_CAMERA_MAX_FRAMES 8
+
+/**
+ * The interval at which the frame rate and throughput of camera redirection
+ * are logged while video data is being received, in milliseconds.
+ */
+#define GUAC_RDP_CAMERA_STATS_INTERVAL 5000
+
+/**
+ * A single frame of video data queued for writing to the virtual camera
+ * device. The buffer of each frame is retained and reused for later frames,
+ * such that queueing a frame does not allocate memory once the buffer is
+ * large enough.
+ */
+typedef struct guac_rdp_camera_frame {
+
+    /**
+     * The video data of this frame.
+     */
+    char* data;
+
+    /**
+     * The number of bytes of video data within this frame.
+     */
+    int length;
+
+    /**
+     * The number of bytes allocated for data.
+     */
+    int size;
+
+} guac_rdp_camera_frame;
+
+/**
+ * Counters describing the video data received and written by camera
+ * redirection, as returned by guac_rdp_camera_get_stats().
+ */
+typedef struct guac_rdp_camera_stats {
+
+    /**
+     * The total number of frames received from the browser client.
+     */
+    unsigned long frames_received;
+
+    /**
+     * The total number of frames written to the virtual camera device.
+     */
+    unsigned long frames_written;
+
+    /**
+     * The total number of frames dropped because the virtual camera device
+     * could not keep up.
+     */
+    unsigned long frames_dropped;
+
+    /**
+     * The total number of bytes written to the virtual camera device.
+     */
+    unsigned long long bytes_written;
+
+} guac_rdp_camera_stats;
 
 /**
  * Webcam/camera redirection support for RDP. Receives video stream data
@@ -56,6 +126,68 @@ typedef struct guac_rdp_camera {
      */
     int device_fd;
 
+    /**
+     * Lock which guards the frame queue, the writer thread state, and the
+     * statistics of this camera.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition signalled whenever a frame is queued or the writer thread
+     * should stop.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * Ring of frames awaiting writing to the virtual camera device. The frame
+     * at frame_head is written by writer_thread, which releases it only once
+     * the write has completed.
+     */
+    guac_rdp_camera_frame frames[GUAC_RDP_CAMERA_MAX_FRAMES];
+
+    /**
+     * The index of the oldest frame within the frame queue.
+     */
+    int frame_head;
+
+    /**
+     * The number of frames within the frame queue.
+     */
+    int frame_count;
+
+    /**
+     * The thread which writes queued frames to the virtual camera device,
+     * such that a slow consumer of the device never blocks the thread
+     * handling input from the user.
+     */
+    pthread_t writer_thread;
+
+    /**
+     * Whether writer_thread has been started.
+     */
+    int writer_started;
+
+    /**
+     * Whether writer_thread has been requested to stop.
+     */
+    int stopping;
+
+    /**
+     * Counters describing video data received and written thus far.
+     */
+    guac_rdp_camera_stats stats;
+
+    /**
+     * The counters as of the last time statistics were logged, such that the
+     * current frame rate and throughput can be calculated.
+     */
+    guac_rdp_camera_stats last_stats;
+
+    /**
+     * The time that statistics were last logged.
+     */
+    guac_timestamp last_stats_timestamp;
+
 } guac_rdp_camera;
 
 /**
@@ -88,8 +220,12 @@ void guac_rdp_camera_free(guac_rdp_camera* camera);
 void guac_rdp_camera_load_plugin(rdpContext* context);
 
 /**
- * Handles incoming video stream data from the browser client. This function
- * writes the received video data to the virtual camera device pipe.
+ * Handles incoming video stream data from the browser client, queueing the
+ * received data as a single frame for writing to the virtual camera device
+ * pipe. Each blob received from the browser client contains exactly one
+ * frame. This function never blocks on the virtual camera device; if too
+ * many frames are already waiting to be written, the frame is dropped in its
+ * entirety.
  *
  * @param camera
  *     The camera module receiving the video data.
@@ -101,14 +237,29 @@ void guac_rdp_camera_load_plugin(rdpContext* context);
  *     The length of the received video data.
  *
  * @return
- *     Zero if successful, non-zero if an error occurs.
+ *     Zero if the frame was queued or intentionally dropped, non-zero if an
+ *     error occurs.
  */
 int guac_rdp_camera_handle_video_data(guac_rdp_camera* camera,
         const void* data, int length);
 
+/**
+ * Retrieves the current counters describing video data received and written
+ * by the given camera redirection module.
+ *
+ * @param camera
+ *     The camera module to retrieve the statistics of.
+ *
+ * @param stats
+ *     The structure that should receive a copy of the current counters.
+ */
+void guac_rdp_camera_get_stats(guac_rdp_camera* camera,
+        guac_rdp_camera_stats* stats);
+
 /**
  * Starts the camera video stream. Creates a virtual device and begins
- * accepting video data from the browser client.
+ * accepting video data from the browser client, starting the thread which
+ * writes received frames to that device.
  *
  * @param camera
  *     The camera module to start.
@@ -119,7 +270,8 @@ int guac_rdp_camera_handle_video_data(guac_rdp_camera* camera,
 int guac_rdp_camera_start_stream(guac_rdp_camera* camera);
 
 /**
- * Stops the camera video stream and cleans up the virtual device.
+ * Stops the camera video stream and cleans up the virtual device, discarding
+ * any frames not yet written.
  *
  * @param camera
  *     The camera module to stop.
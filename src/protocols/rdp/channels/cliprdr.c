@@ -372,7 +372,11 @@ static UINT guac_rdp_cliprdr_format_data_request(CliprdrClientContext* cliprdr,
     guac_iconv_write* remote_writer;
     const char* input = clipboard->clipboard->buffer;
 
-    int output_buf_size = clipboard->clipboard->available;
+    /* Allocate only as much space as the current contents could possibly
+     * require once converted, rather than the full size of the clipboard */
+    int input_length = clipboard->clipboard->length;
+    int output_buf_size = guac_mem_ckd_mul_or_die(input_length,
+            GUAC_RDP_CLIPBOARD_MAX_EXPANSION) + GUAC_RDP_CLIPBOARD_MAX_EXPANSION;
     char* output = guac_mem_alloc(output_buf_size);
 
     /* Map requested clipboard format to a guac_iconv writer */
@@ -403,7 +407,7 @@ static UINT guac_rdp_cliprdr_format_data_request(CliprdrClientContext* cliprdr,
      * requested */
     BYTE* start = (BYTE*) output;
     guac_iconv_read* local_reader = settings->normalize_clipboard ? GUAC_READ_UTF8_NORMALIZED : GUAC_READ_UTF8;
-    guac_iconv(local_reader, &input, clipboard->clipboard->length,
+    guac_iconv(local_reader, &input, input_length,
             remote_writer, &output, output_buf_size);
 
     CLIPRDR_FORMAT_DATA_RESPONSE data_response = {
@@ -472,12 +476,8 @@ static UINT guac_rdp_cliprdr_format_data_response(CliprdrClientContext* cliprdr,
         return CHANNEL_RC_OK;
     }
 
-    int output_buf_size = clipboard->clipboard->available;
-    char* received_data = guac_mem_alloc(output_buf_size);
-
     guac_iconv_read* remote_reader;
-    const char* input = (char*) format_data_response->requestedFormatData;
-    char* output = received_data;
+    int unit_size;
 
     /* Find correct source encoding */
     switch (clipboard->requested_format) {
@@ -485,11 +485,13 @@ static UINT guac_rdp_cliprdr_format_data_response(CliprdrClientContext* cliprdr,
         /* Non-Unicode (Windows CP-1252) */
         case CF_TEXT:
             remote_reader = settings->normalize_clipboard ? GUAC_READ_CP1252_NORMALIZED : GUAC_READ_CP1252;
+            unit_size = 1;
             break;
 
         /* Unicode (UTF-16) */
         case CF_UNICODETEXT:
             remote_reader = settings->normalize_clipboard ? GUAC_READ_UTF16_NORMALIZED : GUAC_READ_UTF16;
+            unit_size = 2;
             break;
 
         /* If the format ID stored within the guac_rdp_clipboard structure is actually
@@ -501,7 +503,6 @@ static UINT guac_rdp_cliprdr_format_data_response(CliprdrClientContext* cliprdr,
         default:
             guac_client_log(client, GUAC_LOG_DEBUG, "Requested clipboard data "
                     "in unsupported format (0x%X).", clipboard->requested_format);
-            guac_mem_free(received_data);
             return CHANNEL_RC_OK;
 
     }
@@ -513,18 +514,56 @@ static UINT guac_rdp_cliprdr_format_data_response(CliprdrClientContext* cliprdr,
     data_len = format_data_response->dataLen;
     #endif
 
-    /* Convert, store, and forward the clipboard data received from RDP
-     * server */
-    if (guac_iconv(remote_reader, &input, data_len,
-            GUAC_WRITE_UTF8, &output, output_buf_size)) {
-        int length = strnlen(received_data, output_buf_size);
-        guac_common_clipboard_reset(clipboard->clipboard, "text/plain");
-        guac_common_clipboard_append(clipboard->clipboard, received_data, length);
-        guac_common_clipboard_send(clipboard->clipboard, client);
-    }
+    const char* input = (char*) format_data_response->requestedFormatData;
+    const char* input_end = input + data_len;
+
+    /* Each unit of input (a CP-1252 byte or a UTF-16 code unit) produces at
+     * most three bytes of UTF-8 */
+    char received_data[GUAC_RDP_CLIPBOARD_CONVERT_BLOCK_SIZE];
+    int block_length = (sizeof(received_data) / 3) * unit_size;
+
+    guac_common_clipboard_reset(clipboard->clipboard, "text/plain");
+
+    /* Convert and store the clipboard data received from the RDP server one
+     * block at a time, until the null terminator is reached */
+    int terminated = 0;
+    while (!terminated && input < input_end) {
+
+        int in_remaining = input_end - input;
+        if (in_remaining > block_length) {
+
+            in_remaining = block_length;
 
-    guac_mem_free(received_data);
+            /* Do not end a block between the halves of a CRLF pair, as that
+             * pair would then not be normalized. Any CR is instead left for
+             * the following block. */
+            const char* last = input + in_remaining - unit_size;
+            if (last[0] == '\r' && (unit_size == 1 || last[1] == '\0'))
+                in_remaining -= unit_size;
+
+        }
+
+        char* output = received_data;
+        terminated = guac_iconv(remote_reader, &input, in_remaining,
+                GUAC_WRITE_UTF8, &output, sizeof(received_data));
+
+        /* Store converted data, excluding the null terminator */
+        int length = output - received_data;
+        if (terminated)
+            length = strnlen(received_data, length);
+
+        if (guac_common_clipboard_append(clipboard->clipboard,
+                    received_data, length) < length) {
+            guac_client_log(client, GUAC_LOG_WARNING, "Clipboard data "
+                    "received from the RDP server exceeds the maximum "
+                    "clipboard size and has been truncated.");
+            break;
+        }
+
+    }
 
+    /* Forward the clipboard data received from RDP server */
+    guac_common_clipboard_send(clipboard->clipboard, client);
     return CHANNEL_RC_OK;
 
 }
@@ -629,7 +668,7 @@ guac_rdp_clipboard* guac_rdp_clipboard_alloc(guac_client* client, int buffer_siz
     /* Allocate clipboard and underlying storage */
     guac_rdp_clipboard* clipboard = guac_mem_zalloc(sizeof(guac_rdp_clipboard));
     clipboard->client = client;
-    clipboard->clipboard = guac_common_clipboard_alloc(buffer_size);
+    clipboard->clipboard = guac_common_clipboard_alloc(client, buffer_size);
     clipboard->requested_format = CF_TEXT;
 
     return clipboard;
@@ -29,6 +29,22 @@
 #include <winpr/stream.h>
 #include <winpr/wtypes.h>
 
+/**
+ * The maximum number of bytes of UTF-8 produced by each step of converting
+ * clipboard data received from the RDP server. Received data is converted
+ * and stored in blocks of this size, rather than through an intermediate
+ * buffer as large as the clipboard itself.
+ */
+#define GUAC_RDP_CLIPBOARD_CONVERT_BLOCK_SIZE 12288
+
+/**
+ * The maximum number of bytes that converting a single byte of UTF-8
+ * clipboard data to any format supported by the RDP server may produce. This
+ * is the case of a newline character converted to a CRLF pair of UTF-16
+ * characters.
+ */
+#define GUAC_RDP_CLIPBOARD_MAX_EXPANSION 4
+
 /**
  * RDP clipboard, leveraging the "CLIPRDR" channel.
  */
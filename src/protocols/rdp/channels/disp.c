@@ -44,6 +44,7 @@ guac_rdp_disp* guac_rdp_disp_alloc(guac_client* client) {
 
     /* No requests have been made */
     disp->last_request = guac_timestamp_current();
+    disp->last_change = 0;
     disp->reconnect_needed = 0;
     disp->resize_needed = false;
 
@@ -437,6 +438,8 @@ void guac_rdp_disp_set_size(guac_rdp_disp* disp, guac_rdp_settings* settings,
     else if (!guac_rdp_disp_close_monitor(disp, x_position))
         return;
 
+    disp->last_change = guac_timestamp_current();
+
     /* Send display update notification if possible */
     guac_rdp_disp_update_size(disp, settings, rdp_inst);
 
@@ -455,6 +458,14 @@ void guac_rdp_disp_update_size(guac_rdp_disp* disp,
     if (rdp_inst != NULL && !disp->resize_needed)
         return;
 
+    /* Wait for the requested size to stop changing (such as while the user
+     * is still dragging the edge of their browser window), such that the
+     * remote display is not needlessly resized and redrawn at each
+     * intermediate size */
+    if (rdp_inst != NULL
+            && now - disp->last_change < settings->resize_quiet_period)
+        return;
+
     int monitors_count = disp->monitors_count;
     int width = guac_rdp_disp_get_total_width(disp);
     int height = guac_rdp_disp_get_total_height(disp);
@@ -86,6 +86,12 @@ typedef struct guac_rdp_disp {
      */
     guac_timestamp last_request;
 
+    /**
+     * The timestamp of the most recent change to the requested size or
+     * layout of any monitor, or 0 if no such change has occurred.
+     */
+    guac_timestamp last_change;
+
     /**
      * Monitor properties (size, position). 
      */
@@ -194,8 +200,10 @@ void guac_rdp_disp_set_size(guac_rdp_disp* disp, guac_rdp_settings* settings,
 
 /**
  * Sends an actual display update request to the RDP server based on previous
- * calls to guac_rdp_disp_set_size(). If an update was recently sent, the
- * update may be delayed until a future call to this function. If the RDP
+ * calls to guac_rdp_disp_set_size(). If an update was recently sent, or if
+ * the requested size has changed within the last resize_quiet_period
+ * milliseconds, the update may be delayed until a future call to this
+ * function. If the RDP
  * session has not yet been established, the request will be delayed until the
  * session exists.
  *
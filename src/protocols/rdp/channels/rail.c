@@ -28,7 +28,9 @@
 #include <freerdp/rail.h>
 #include <freerdp/window.h>
 #include <guacamole/client.h>
+#include <guacamole/display.h>
 #include <guacamole/mem.h>
+#include <guacamole/rect.h>
 #include <winpr/wtypes.h>
 #include <winpr/wtsapi.h>
 
@@ -244,9 +246,71 @@ static UINT guac_rdp_rail_handshake_ex(RailClientContext* rail,
     return guac_rdp_rail_complete_handshake(rail);
 }
 
+/**
+ * Returns the RAIL window having the given ID, optionally allocating a new
+ * layer for that window if it is not yet known.
+ *
+ * @param client
+ *     The guac_client associated with the RDP session.
+ *
+ * @param id
+ *     The ID assigned to the window by the RDP server.
+ *
+ * @param create
+ *     Non-zero if a new window should be added if no window having the given
+ *     ID exists, zero otherwise.
+ *
+ * @return
+ *     The RAIL window having the given ID, or NULL if no such window exists
+ *     and no new window could be (or should be) added.
+ */
+static guac_rdp_rail_window* guac_rdp_rail_get_window(guac_client* client,
+        UINT32 id, int create) {
+
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    for (int i = 0; i < rdp_client->rail_windows_count; i++) {
+        if (rdp_client->rail_windows[i].id == id)
+            return &(rdp_client->rail_windows[i]);
+    }
+
+    if (!create)
+        return NULL;
+
+    if (rdp_client->rail_windows_count >= GUAC_RDP_RAIL_MAX_WINDOWS) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Too many RAIL windows. "
+                "Window 0x%08X will not be displayed.", id);
+        return NULL;
+    }
+
+    guac_display_layer* layer = guac_display_alloc_layer(rdp_client->display, 1);
+    guac_display_layer_set_lossless(layer, rdp_client->settings->lossless);
+
+    /* New windows are stacked above all others until the server describes
+     * the actual Z-order */
+    guac_display_layer_stack(layer, rdp_client->rail_windows_count + 1);
+
+    guac_rdp_rail_window* window =
+        &(rdp_client->rail_windows[rdp_client->rail_windows_count++]);
+
+    *window = (guac_rdp_rail_window) {
+        .id = id,
+        .layer = layer,
+        .visible = 1
+    };
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Allocated layer for RAIL window "
+            "0x%08X.", id);
+
+    return window;
+
+}
+
 /**
  * A callback function that is executed when an update for a RAIL window is
- * received from the RDP server.
+ * received from the RDP server. Each RAIL window is rendered using its own
+ * layer, which is moved and resized to match the window described by the
+ * server.
  *
  * @param context
  *     A pointer to the rdpContext structure used by FreeRDP to handle the
@@ -275,6 +339,9 @@ static BOOL guac_rdp_rail_window_update(rdpContext* context,
 
     UINT32 fieldFlags = orderInfo->fieldFlags;
 
+    guac_rdp_rail_window* window = guac_rdp_rail_get_window(client,
+            orderInfo->windowId, 1);
+
     /* If the flag for window visibilty is set, check visibility. */
     if (fieldFlags & WINDOW_ORDER_FIELD_SHOW) {
         guac_client_log(client, GUAC_LOG_TRACE, "RAIL window visibility change: %d", windowState->showState);
@@ -290,12 +357,192 @@ static BOOL guac_rdp_rail_window_update(rdpContext* context,
             syscommand.command = SC_RESTORE;
             rdp_client->rail_interface->ClientSystemCommand(rdp_client->rail_interface, &syscommand);
         }
+
+        /* Hide the layer of the window until it is restored, as its contents
+         * within FreeRDP's GDI are not guaranteed to be meaningful */
+        if (window != NULL) {
+            window->visible =
+                   windowState->showState != GUAC_RDP_RAIL_WINDOW_STATE_HIDDEN
+                && windowState->showState != GUAC_RDP_RAIL_WINDOW_STATE_MINIMIZED;
+            guac_display_layer_set_opacity(window->layer,
+                    window->visible ? 0xFF : 0x00);
+        }
+
+    }
+
+    if (window == NULL)
+        return TRUE;
+
+    /* Move layer along with window, such that only a "move" need be sent */
+    if (fieldFlags & WINDOW_ORDER_FIELD_WND_OFFSET) {
+        int width = guac_rect_width(&window->bounds);
+        int height = guac_rect_height(&window->bounds);
+        guac_rect_init(&window->bounds, windowState->windowOffsetX,
+                windowState->windowOffsetY, width, height);
+        guac_display_layer_move(window->layer, window->bounds.left,
+                window->bounds.top);
+    }
+
+    /* Resize layer along with window. The new contents of the window will be
+     * painted by the server and copied by guac_rdp_rail_paint(). */
+    if (fieldFlags & WINDOW_ORDER_FIELD_WND_SIZE) {
+        guac_rect_init(&window->bounds, window->bounds.left,
+                window->bounds.top, windowState->windowWidth,
+                windowState->windowHeight);
+        guac_display_layer_resize(window->layer,
+                guac_rect_width(&window->bounds),
+                guac_rect_height(&window->bounds));
     }
 
     return TRUE;
 
 }
 
+/**
+ * A callback function that is executed when a RAIL window is deleted by the
+ * RDP server, freeing the layer associated with that window.
+ *
+ * @param context
+ *     A pointer to the rdpContext structure used by FreeRDP to handle the
+ *     window update.
+ *
+ * @param orderInfo
+ *     A pointer to the data structure that contains information about what
+ *     window was deleted.
+ *
+ * @return
+ *     TRUE if the client-side processing of the deletion was successful;
+ *     otherwise FALSE. This implementation always returns TRUE.
+ */
+static BOOL guac_rdp_rail_window_delete(rdpContext* context,
+        RAIL_CONST WINDOW_ORDER_INFO* orderInfo) {
+
+    guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    guac_rdp_rail_window* window = guac_rdp_rail_get_window(client,
+            orderInfo->windowId, 0);
+
+    if (window == NULL)
+        return TRUE;
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Freeing layer of deleted RAIL "
+            "window 0x%08X.", window->id);
+
+    guac_display_free_layer(window->layer);
+
+    /* Fill the gap with the last window, if any */
+    *window = rdp_client->rail_windows[--rdp_client->rail_windows_count];
+
+    return TRUE;
+
+}
+
+/**
+ * A callback function that is executed when the RDP server describes the
+ * state of the remote desktop as a whole, restacking the layers of all RAIL
+ * windows to match the Z-order of those windows, if provided.
+ *
+ * @param context
+ *     A pointer to the rdpContext structure used by FreeRDP to handle the
+ *     desktop update.
+ *
+ * @param orderInfo
+ *     A pointer to the data structure that contains information about what
+ *     aspects of the desktop were updated.
+ *
+ * @param monitoredDesktop
+ *     A pointer to the data structure that contains details of the updates
+ *     to the desktop, as indicated by flags in the orderInfo field.
+ *
+ * @return
+ *     TRUE if the client-side processing of the updates was successful;
+ *     otherwise FALSE. This implementation always returns TRUE.
+ */
+static BOOL guac_rdp_rail_monitored_desktop(rdpContext* context,
+        RAIL_CONST WINDOW_ORDER_INFO* orderInfo,
+        RAIL_CONST MONITORED_DESKTOP_ORDER* monitoredDesktop) {
+
+    guac_client* client = ((rdp_freerdp_context*) context)->client;
+
+    if (!(orderInfo->fieldFlags & WINDOW_ORDER_FIELD_DESKTOP_ZORDER))
+        return TRUE;
+
+    /* The first window in the Z-order is the topmost window */
+    int count = monitoredDesktop->numWindowIds;
+    for (int i = 0; i < count; i++) {
+
+        guac_rdp_rail_window* window = guac_rdp_rail_get_window(client,
+                monitoredDesktop->windowIds[i], 0);
+
+        if (window != NULL)
+            guac_display_layer_stack(window->layer, count - i);
+
+    }
+
+    return TRUE;
+
+}
+
+void guac_rdp_rail_paint(rdpContext* context, const GDI_RGN* regions,
+        int count) {
+
+    guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+    rdpGdi* gdi = context->gdi;
+
+    guac_rect gdi_bounds;
+    guac_rect_init(&gdi_bounds, 0, 0, gdi->width, gdi->height);
+
+    for (int i = 0; i < rdp_client->rail_windows_count; i++) {
+
+        guac_rdp_rail_window* window = &(rdp_client->rail_windows[i]);
+        if (!window->visible || guac_rect_is_empty(&window->bounds))
+            continue;
+
+        guac_display_layer_raw_context* raw_context = NULL;
+
+        for (int j = 0; j < count; j++) {
+
+            const GDI_RGN* region = &regions[j];
+            if (region->null)
+                continue;
+
+            /* Determine the portion of the window that was redrawn */
+            guac_rect dirty;
+            guac_rect_init(&dirty, region->x, region->y, region->w, region->h);
+            guac_rect_constrain(&dirty, &gdi_bounds);
+            guac_rect_constrain(&dirty, &window->bounds);
+            if (guac_rect_is_empty(&dirty))
+                continue;
+
+            if (raw_context == NULL)
+                raw_context = guac_display_layer_open_raw(window->layer);
+
+            /* Copy that portion into the layer of the window, relative to the
+             * upper-left corner of the window */
+            guac_rect dst;
+            guac_rect_init(&dst, dirty.left - window->bounds.left,
+                    dirty.top - window->bounds.top, guac_rect_width(&dirty),
+                    guac_rect_height(&dirty));
+            guac_rect_constrain(&dst, &raw_context->bounds);
+            if (guac_rect_is_empty(&dst))
+                continue;
+
+            guac_display_layer_raw_context_put(raw_context, &dst,
+                    GUAC_RECT_CONST_BUFFER(dirty, gdi->primary_buffer,
+                        gdi->stride, GUAC_DISPLAY_LAYER_RAW_BPP),
+                    gdi->stride);
+
+        }
+
+        if (raw_context != NULL)
+            guac_display_layer_close_raw(window->layer, raw_context);
+
+    }
+
+}
+
 /**
  * Callback which associates handlers specific to Guacamole with the
  * RailClientContext instance allocated by FreeRDP to deal with received
@@ -336,6 +583,8 @@ static void guac_rdp_rail_channel_connected(rdpContext* context,
     rail->ServerHandshake = guac_rdp_rail_handshake;
     rail->ServerHandshakeEx = guac_rdp_rail_handshake_ex;
     context->update->window->WindowUpdate = guac_rdp_rail_window_update;
+    context->update->window->WindowDelete = guac_rdp_rail_window_delete;
+    context->update->window->MonitoredDesktop = guac_rdp_rail_monitored_desktop;
 
     guac_client_log(client, GUAC_LOG_DEBUG, "RAIL (RemoteApp) channel "
             "connected.");
@@ -345,6 +594,11 @@ static void guac_rdp_rail_channel_connected(rdpContext* context,
 void guac_rdp_rail_load_plugin(rdpContext* context) {
 
     guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    /* Any windows of a previous connection were freed along with its
+     * display */
+    rdp_client->rail_windows_count = 0;
 
     /* Attempt to load FreeRDP support for the RAIL channel */
     if (guac_freerdp_channels_load_plugin(context, "rail", context->settings)) {
@@ -23,7 +23,11 @@
 #include "config.h"
 
 #include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
 #include <freerdp/window.h>
+#include <guacamole/display.h>
+#include <guacamole/rect.h>
+#include <winpr/wtypes.h>
 
 #ifdef FREERDP_RAIL_CALLBACKS_REQUIRE_CONST
 /**
@@ -49,6 +53,42 @@
  */
 #define GUAC_RDP_RAIL_WINDOW_STATE_MINIMIZED 0x02
 
+/**
+ * The maximum number of RAIL windows that may be tracked at any one time.
+ * Each such window is rendered using its own layer.
+ */
+#define GUAC_RDP_RAIL_MAX_WINDOWS 256
+
+/**
+ * A single window of a RemoteApp session, rendered using its own layer such
+ * that moving the window requires only that the layer be moved, and such that
+ * portions of the remote desktop outside all windows need not be sent at all.
+ */
+typedef struct guac_rdp_rail_window {
+
+    /**
+     * The ID assigned to this window by the RDP server.
+     */
+    UINT32 id;
+
+    /**
+     * The layer containing the contents of this window.
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The region of the remote desktop currently covered by this window.
+     */
+    guac_rect bounds;
+
+    /**
+     * Non-zero if this window is currently visible, zero if it is hidden or
+     * minimized.
+     */
+    int visible;
+
+} guac_rdp_rail_window;
+
 /**
  * Initializes RemoteApp support for RDP and handling of the RAIL channel. If
  * failures occur, messages noting the specifics of those failures will be
@@ -62,5 +102,24 @@
  */
 void guac_rdp_rail_load_plugin(rdpContext* context);
 
+/**
+ * Copies the given regions of FreeRDP's GDI, which have been invalidated by
+ * drawing operations, into the layers of each RAIL window that they overlap.
+ * Any portion of these regions not covered by a RAIL window is ignored. This
+ * function should be invoked when FreeRDP has finished drawing, in place of
+ * marking those regions as modified within the default layer.
+ *
+ * @param context
+ *     The rdpContext associated with the active RDP session.
+ *
+ * @param regions
+ *     An array of all invalidated regions of FreeRDP's GDI.
+ *
+ * @param count
+ *     The number of regions within the array.
+ */
+void guac_rdp_rail_paint(rdpContext* context, const GDI_RGN* regions,
+        int count);
+
 #endif
 
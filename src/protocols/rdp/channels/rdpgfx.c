@@ -27,10 +27,415 @@
 #include <freerdp/gdi/gfx.h>
 #include <freerdp/event.h>
 #include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/mem.h>
+#include <guacamole/rect.h>
 
+#include <inttypes.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * Human-readable names for each guac_rdp_rdpgfx_codec, for the sake of
+ * logging.
+ */
+static const char* GUAC_RDP_RDPGFX_CODEC_NAMES[GUAC_RDP_RDPGFX_CODEC_COUNT] = {
+    [GUAC_RDP_RDPGFX_CODEC_UNCOMPRESSED] = "uncompressed",
+    [GUAC_RDP_RDPGFX_CODEC_LOSSLESS]     = "planar/clear/alpha",
+    [GUAC_RDP_RDPGFX_CODEC_REMOTEFX]     = "RemoteFX/progressive",
+    [GUAC_RDP_RDPGFX_CODEC_H264]         = "H.264",
+    [GUAC_RDP_RDPGFX_CODEC_OTHER]        = "other"
+};
+
+/**
+ * Returns the class of codec that the given RDPGFX codec ID belongs to.
+ *
+ * @param codec_id
+ *     The RDPGFX codec ID of a received surface command.
+ *
+ * @return
+ *     The guac_rdp_rdpgfx_codec covering the given codec ID.
+ */
+static guac_rdp_rdpgfx_codec guac_rdp_rdpgfx_classify_codec(UINT32 codec_id) {
+
+    switch (codec_id) {
+
+        case RDPGFX_CODECID_UNCOMPRESSED:
+            return GUAC_RDP_RDPGFX_CODEC_UNCOMPRESSED;
+
+        case RDPGFX_CODECID_PLANAR:
+        case RDPGFX_CODECID_CLEARCODEC:
+        case RDPGFX_CODECID_ALPHA:
+            return GUAC_RDP_RDPGFX_CODEC_LOSSLESS;
+
+        case RDPGFX_CODECID_CAVIDEO:
+        case RDPGFX_CODECID_CAPROGRESSIVE:
+        case RDPGFX_CODECID_CAPROGRESSIVE_V2:
+            return GUAC_RDP_RDPGFX_CODEC_REMOTEFX;
+
+        case RDPGFX_CODECID_AVC420:
+        case RDPGFX_CODECID_AVC444:
+        case RDPGFX_CODECID_AVC444v2:
+            return GUAC_RDP_RDPGFX_CODEC_H264;
+
+    }
+
+    return GUAC_RDP_RDPGFX_CODEC_OTHER;
+
+}
+
+/**
+ * Returns the rdp_freerdp_context of the RDP session associated with the
+ * given RDPGFX channel. The RDPGFX channel must have been associated with
+ * FreeRDP's GDI through gdi_graphics_pipeline_init().
+ *
+ * @param rdpgfx
+ *     The RdpgfxClientContext associated with the RDPGFX channel.
+ *
+ * @return
+ *     The rdp_freerdp_context of the associated RDP session.
+ */
+static rdp_freerdp_context* guac_rdp_rdpgfx_get_context(RdpgfxClientContext* rdpgfx) {
+    rdpGdi* gdi = (rdpGdi*) rdpgfx->custom;
+    return (rdp_freerdp_context*) gdi->context;
+}
+
+/**
+ * Handler for RDPGFX SurfaceCommand PDUs which records the codec of each
+ * command before passing the command to the handler installed by FreeRDP's
+ * GDI, which decodes the command into the GDI surface.
+ *
+ * Surface commands cannot be forwarded to the Guacamole client without
+ * decoding. Later RDPGFX operations (SurfaceToSurface, SurfaceToCache,
+ * CacheToSurface, SolidFill) read from and write to the decoded surfaces, and
+ * AVC444 streams are split across two H.264 streams that only make sense once
+ * recombined, so the decoded GDI surfaces must always be maintained.
+ *
+ * @param rdpgfx
+ *     The RdpgfxClientContext associated with the RDPGFX channel.
+ *
+ * @param cmd
+ *     The received surface command.
+ *
+ * @return
+ *     The result of FreeRDP's handler, or CHANNEL_RC_OK if there is no such
+ *     handler.
+ */
+static UINT guac_rdp_rdpgfx_surface_command(RdpgfxClientContext* rdpgfx,
+        const RDPGFX_SURFACE_COMMAND* cmd) {
+
+    rdp_freerdp_context* context = guac_rdp_rdpgfx_get_context(rdpgfx);
+
+    guac_rdp_rdpgfx_codec codec = guac_rdp_rdpgfx_classify_codec(cmd->codecId);
+    context->rdpgfx.commands[codec]++;
+    context->rdpgfx.bytes[codec] += cmd->length;
+
+    if (context->rdpgfx.surface_command == NULL)
+        return CHANNEL_RC_OK;
+
+    return context->rdpgfx.surface_command(rdpgfx, cmd);
+
+}
+
+/**
+ * Retrieves the location within the display that the given RDPGFX surface is
+ * mapped to. Surfaces that are not mapped to the display have no such
+ * location.
+ *
+ * @param rdpgfx
+ *     The RdpgfxClientContext associated with the RDPGFX channel.
+ *
+ * @param surface_id
+ *     The ID of the RDPGFX surface.
+ *
+ * @param x
+ *     Storage for the X coordinate of the upper-left corner of the surface
+ *     within the display.
+ *
+ * @param y
+ *     Storage for the Y coordinate of the upper-left corner of the surface
+ *     within the display.
+ *
+ * @return
+ *     Non-zero if the surface is mapped to the display, zero otherwise.
+ */
+static int guac_rdp_rdpgfx_get_origin(RdpgfxClientContext* rdpgfx,
+        UINT16 surface_id, int* x, int* y) {
+
+    gdiGfxSurface* surface = (gdiGfxSurface*) rdpgfx->GetSurfaceData(rdpgfx, surface_id);
+    if (surface == NULL || !surface->outputMapped)
+        return 0;
+
+    *x = surface->outputOriginX;
+    *y = surface->outputOriginY;
+    return 1;
+
+}
+
+/**
+ * Records a copy within the display, as described by an RDPGFX message, such
+ * that it can later be passed to guac_display as a copy hint. If the maximum
+ * number of pending copies has been reached, the copy is ignored.
+ *
+ * @param gfx
+ *     The Guacamole RDPGFX state of the RDP session.
+ *
+ * @param src_x
+ *     The X coordinate of the upper-left corner of the region copied, within
+ *     the display.
+ *
+ * @param src_y
+ *     The Y coordinate of the upper-left corner of the region copied, within
+ *     the display.
+ *
+ * @param dest_x
+ *     The X coordinate of the upper-left corner of the destination of the
+ *     copy, within the display.
+ *
+ * @param dest_y
+ *     The Y coordinate of the upper-left corner of the destination of the
+ *     copy, within the display.
+ *
+ * @param width
+ *     The width of the region copied, in pixels.
+ *
+ * @param height
+ *     The height of the region copied, in pixels.
+ */
+static void guac_rdp_rdpgfx_add_copy_hint(guac_rdp_rdpgfx* gfx, int src_x,
+        int src_y, int dest_x, int dest_y, int width, int height) {
+
+    int count = gfx->copy_hint_count;
+    if (count >= GUAC_DISPLAY_LAYER_MAX_COPY_HINTS)
+        return;
+
+    guac_display_copy_hint* hint = &gfx->copy_hints[count];
+    guac_rect_init(&hint->dest, dest_x, dest_y, width, height);
+    hint->src_x = src_x;
+    hint->src_y = src_y;
+
+    gfx->copy_hint_count = count + 1;
+
+}
+
+/**
+ * Handler for RDPGFX SurfaceToSurface PDUs which passes the PDU to the
+ * handler installed by FreeRDP's GDI, additionally recording a copy hint for
+ * each copy that occurs between surfaces mapped to the display.
+ *
+ * @param rdpgfx
+ *     The RdpgfxClientContext associated with the RDPGFX channel.
+ *
+ * @param pdu
+ *     The received SurfaceToSurface PDU.
+ *
+ * @return
+ *     The result of FreeRDP's handler.
+ */
+static UINT guac_rdp_rdpgfx_surface_to_surface(RdpgfxClientContext* rdpgfx,
+        const RDPGFX_SURFACE_TO_SURFACE_PDU* pdu) {
+
+    guac_rdp_rdpgfx* gfx = &guac_rdp_rdpgfx_get_context(rdpgfx)->rdpgfx;
+
+    UINT result = gfx->surface_to_surface(rdpgfx, pdu);
+    if (result != CHANNEL_RC_OK)
+        return result;
+
+    int src_x, src_y, dest_x, dest_y;
+    if (!guac_rdp_rdpgfx_get_origin(rdpgfx, pdu->surfaceIdSrc, &src_x, &src_y)
+            || !guac_rdp_rdpgfx_get_origin(rdpgfx, pdu->surfaceIdDest, &dest_x, &dest_y))
+        return result;
+
+    const RECTANGLE_16* rect = pdu->rectSrc;
+    int width = rect->right - rect->left;
+    int height = rect->bottom - rect->top;
+
+    for (UINT16 i = 0; i < pdu->destPtsCount; i++) {
+        const RDPGFX_POINT16* point = &pdu->destPts[i];
+        guac_rdp_rdpgfx_add_copy_hint(gfx, src_x + rect->left, src_y + rect->top,
+                dest_x + point->x, dest_y + point->y, width, height);
+    }
+
+    return result;
+
+}
+
+/**
+ * Handler for RDPGFX SurfaceToCache PDUs which passes the PDU to the handler
+ * installed by FreeRDP's GDI, additionally recording where within the display
+ * (if anywhere) the contents of the cache slot came from.
+ *
+ * @param rdpgfx
+ *     The RdpgfxClientContext associated with the RDPGFX channel.
+ *
+ * @param pdu
+ *     The received SurfaceToCache PDU.
+ *
+ * @return
+ *     The result of FreeRDP's handler.
+ */
+static UINT guac_rdp_rdpgfx_surface_to_cache(RdpgfxClientContext* rdpgfx,
+        const RDPGFX_SURFACE_TO_CACHE_PDU* pdu) {
+
+    guac_rdp_rdpgfx* gfx = &guac_rdp_rdpgfx_get_context(rdpgfx)->rdpgfx;
+
+    UINT result = gfx->surface_to_cache(rdpgfx, pdu);
+    if (result != CHANNEL_RC_OK || pdu->cacheSlot >= gfx->cache_slots)
+        return result;
+
+    guac_rdp_rdpgfx_cache_origin* origin = &gfx->cache_origins[pdu->cacheSlot];
+    const RECTANGLE_16* rect = pdu->rectSrc;
+
+    int x = 0, y = 0;
+    origin->mapped = guac_rdp_rdpgfx_get_origin(rdpgfx, pdu->surfaceId, &x, &y);
+    origin->x = x + rect->left;
+    origin->y = y + rect->top;
+    origin->width = rect->right - rect->left;
+    origin->height = rect->bottom - rect->top;
+
+    return result;
+
+}
+
+/**
+ * Handler for RDPGFX CacheToSurface PDUs which passes the PDU to the handler
+ * installed by FreeRDP's GDI, additionally recording a copy hint for each
+ * copy of a cache slot populated from the display back onto the display.
+ *
+ * @param rdpgfx
+ *     The RdpgfxClientContext associated with the RDPGFX channel.
+ *
+ * @param pdu
+ *     The received CacheToSurface PDU.
+ *
+ * @return
+ *     The result of FreeRDP's handler.
+ */
+static UINT guac_rdp_rdpgfx_cache_to_surface(RdpgfxClientContext* rdpgfx,
+        const RDPGFX_CACHE_TO_SURFACE_PDU* pdu) {
+
+    guac_rdp_rdpgfx* gfx = &guac_rdp_rdpgfx_get_context(rdpgfx)->rdpgfx;
+
+    UINT result = gfx->cache_to_surface(rdpgfx, pdu);
+    if (result != CHANNEL_RC_OK || pdu->cacheSlot >= gfx->cache_slots)
+        return result;
+
+    /* NOTE: The display may have changed since the slot was populated. Such
+     * hints are harmless, as guac_display verifies every hint. */
+    const guac_rdp_rdpgfx_cache_origin* origin = &gfx->cache_origins[pdu->cacheSlot];
+
+    int dest_x, dest_y;
+    if (!origin->mapped
+            || !guac_rdp_rdpgfx_get_origin(rdpgfx, pdu->surfaceId, &dest_x, &dest_y))
+        return result;
+
+    for (UINT16 i = 0; i < pdu->destPtsCount; i++) {
+        const RDPGFX_POINT16* point = &pdu->destPts[i];
+        guac_rdp_rdpgfx_add_copy_hint(gfx, origin->x, origin->y,
+                dest_x + point->x, dest_y + point->y,
+                origin->width, origin->height);
+    }
+
+    return result;
+
+}
+
+/**
+ * Handler for RDPGFX MapSurfaceToOutput PDUs which passes the PDU to the
+ * handler installed by FreeRDP's GDI, additionally recording a copy hint if a
+ * surface that was already mapped to the display is moved. Once the contents
+ * of the surface are redrawn at the new location, the move can then be sent
+ * as a copy rather than being found by guac_display's scroll detection or
+ * sent again as image data.
+ *
+ * @param rdpgfx
+ *     The RdpgfxClientContext associated with the RDPGFX channel.
+ *
+ * @param pdu
+ *     The received MapSurfaceToOutput PDU.
+ *
+ * @return
+ *     The result of FreeRDP's handler.
+ */
+static UINT guac_rdp_rdpgfx_map_surface_to_output(RdpgfxClientContext* rdpgfx,
+        const RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU* pdu) {
+
+    guac_rdp_rdpgfx* gfx = &guac_rdp_rdpgfx_get_context(rdpgfx)->rdpgfx;
+
+    int old_x, old_y;
+    int was_mapped = guac_rdp_rdpgfx_get_origin(rdpgfx, pdu->surfaceId, &old_x, &old_y);
+
+    UINT result = gfx->map_surface_to_output(rdpgfx, pdu);
+    if (result != CHANNEL_RC_OK || !was_mapped)
+        return result;
+
+    int new_x, new_y;
+    if (!guac_rdp_rdpgfx_get_origin(rdpgfx, pdu->surfaceId, &new_x, &new_y)
+            || (new_x == old_x && new_y == old_y))
+        return result;
+
+    gdiGfxSurface* surface = (gdiGfxSurface*) rdpgfx->GetSurfaceData(rdpgfx, pdu->surfaceId);
+    guac_rdp_rdpgfx_add_copy_hint(gfx, old_x, old_y, new_x, new_y,
+            surface->width, surface->height);
+
+    return result;
+
+}
+
+void guac_rdp_rdpgfx_flush_copy_hints(rdpContext* context,
+        guac_display_layer_raw_context* raw_context) {
+
+    guac_rdp_rdpgfx* gfx = &((rdp_freerdp_context*) context)->rdpgfx;
+
+    if (raw_context != NULL) {
+        for (int i = 0; i < gfx->copy_hint_count; i++) {
+
+            const guac_display_copy_hint* hint = &gfx->copy_hints[i];
+
+            /* Copies that extend beyond the display are left to the usual
+             * scroll/copy detection */
+            guac_rect dest = hint->dest;
+            guac_rect_constrain(&dest, &raw_context->bounds);
+            if (dest.left != hint->dest.left || dest.top != hint->dest.top
+                    || dest.right != hint->dest.right || dest.bottom != hint->dest.bottom)
+                continue;
+
+            guac_display_layer_raw_context_copy_hint(raw_context, &dest,
+                    hint->src_x, hint->src_y);
+
+        }
+    }
+
+    gfx->copy_hint_count = 0;
+
+}
+
+/**
+ * Logs the number of surface commands and bytes of encoded image data
+ * received for each codec over the RDPGFX channel, skipping any codecs that
+ * were not used.
+ *
+ * @param context
+ *     The rdp_freerdp_context of the RDP session whose RDPGFX usage should be
+ *     logged.
+ */
+static void guac_rdp_rdpgfx_log_usage(rdp_freerdp_context* context) {
+
+    for (int i = 0; i < GUAC_RDP_RDPGFX_CODEC_COUNT; i++) {
+
+        if (context->rdpgfx.commands[i] == 0)
+            continue;
+
+        guac_client_log(context->client, GUAC_LOG_DEBUG, "RDPGFX: %u %s "
+                "surface commands (%" PRIu64 " bytes) decoded for "
+                "re-encoding.", context->rdpgfx.commands[i],
+                GUAC_RDP_RDPGFX_CODEC_NAMES[i], context->rdpgfx.bytes[i]);
+
+    }
+
+}
+
 /**
  * Callback which associates handlers specific to Guacamole with the
  * RdpgfxClientContext instance allocated by FreeRDP to deal with received
@@ -62,12 +467,38 @@ static void guac_rdp_rdpgfx_channel_connected(rdpContext* context,
     RdpgfxClientContext* rdpgfx = (RdpgfxClientContext*) args->pInterface;
     rdpGdi* gdi = context->gdi;
 
-    if (!gdi_graphics_pipeline_init(gdi, rdpgfx))
+    if (!gdi_graphics_pipeline_init(gdi, rdpgfx)) {
         guac_client_log(client, GUAC_LOG_WARNING, "Rendering backend for RDPGFX "
                 "channel could not be loaded. Graphics may not render at all!");
-    else
-        guac_client_log(client, GUAC_LOG_DEBUG, "RDPGFX channel will be used for "
-                "the RDP Graphics Pipeline Extension.");
+        return;
+    }
+
+    guac_rdp_rdpgfx* gfx = &((rdp_freerdp_context*) context)->rdpgfx;
+
+    /* Track the codecs used by surface commands, leaving the decoding itself
+     * to FreeRDP */
+    gfx->surface_command = rdpgfx->SurfaceCommand;
+    rdpgfx->SurfaceCommand = guac_rdp_rdpgfx_surface_command;
+
+    /* Observe blits between surfaces and the cache, such that they can be
+     * passed to guac_display as copy hints (cache slots are numbered starting
+     * at 1) */
+    gfx->cache_slots = rdpgfx->MaxCacheSlots + 1;
+    gfx->cache_origins = guac_mem_zalloc(sizeof(guac_rdp_rdpgfx_cache_origin),
+            gfx->cache_slots);
+    gfx->copy_hint_count = 0;
+
+    gfx->surface_to_surface = rdpgfx->SurfaceToSurface;
+    gfx->surface_to_cache = rdpgfx->SurfaceToCache;
+    gfx->cache_to_surface = rdpgfx->CacheToSurface;
+    gfx->map_surface_to_output = rdpgfx->MapSurfaceToOutput;
+    rdpgfx->SurfaceToSurface = guac_rdp_rdpgfx_surface_to_surface;
+    rdpgfx->SurfaceToCache = guac_rdp_rdpgfx_surface_to_cache;
+    rdpgfx->CacheToSurface = guac_rdp_rdpgfx_cache_to_surface;
+    rdpgfx->MapSurfaceToOutput = guac_rdp_rdpgfx_map_surface_to_output;
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "RDPGFX channel will be used for "
+            "the RDP Graphics Pipeline Extension.");
 
 }
 
@@ -99,6 +530,28 @@ static void guac_rdp_rdpgfx_channel_disconnected(rdpContext* context,
     /* Un-init GDI-backed support for the Graphics Pipeline */
     RdpgfxClientContext* rdpgfx = (RdpgfxClientContext*) args->pInterface;
     rdpGdi* gdi = context->gdi;
+
+    rdp_freerdp_context* rdp_context = (rdp_freerdp_context*) context;
+    guac_rdp_rdpgfx_log_usage(rdp_context);
+
+    /* Restore the handlers of FreeRDP's GDI prior to uninit */
+    guac_rdp_rdpgfx* gfx = &rdp_context->rdpgfx;
+    rdpgfx->SurfaceCommand = gfx->surface_command;
+    rdpgfx->SurfaceToSurface = gfx->surface_to_surface;
+    rdpgfx->SurfaceToCache = gfx->surface_to_cache;
+    rdpgfx->CacheToSurface = gfx->cache_to_surface;
+    rdpgfx->MapSurfaceToOutput = gfx->map_surface_to_output;
+
+    gfx->surface_command = NULL;
+    gfx->surface_to_surface = NULL;
+    gfx->surface_to_cache = NULL;
+    gfx->cache_to_surface = NULL;
+    gfx->map_surface_to_output = NULL;
+
+    guac_mem_free(gfx->cache_origins);
+    gfx->cache_slots = 0;
+    gfx->copy_hint_count = 0;
+
     gdi_graphics_pipeline_uninit(gdi, rdpgfx);
 
     guac_client_log(client, GUAC_LOG_DEBUG, "RDPGFX channel support unloaded.");
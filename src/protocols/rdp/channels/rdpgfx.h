@@ -25,6 +25,161 @@
 #include <freerdp/client/rdpgfx.h>
 #include <freerdp/freerdp.h>
 #include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <winpr/wtypes.h>
+
+#include <stdint.h>
+
+/**
+ * The classes of codec that RDPGFX surface commands may use, as tracked for the
+ * sake of reporting how the graphics of an RDP session were delivered. Each
+ * of these is decoded by FreeRDP into the GDI before being re-encoded by
+ * guac_display.
+ */
+typedef enum guac_rdp_rdpgfx_codec {
+
+    /**
+     * Uncompressed image data (RDPGFX_CODECID_UNCOMPRESSED).
+     */
+    GUAC_RDP_RDPGFX_CODEC_UNCOMPRESSED,
+
+    /**
+     * Planar, ClearCodec, or Alpha codec data, all of which are lossless.
+     */
+    GUAC_RDP_RDPGFX_CODEC_LOSSLESS,
+
+    /**
+     * RemoteFX or RemoteFX Progressive data.
+     */
+    GUAC_RDP_RDPGFX_CODEC_REMOTEFX,
+
+    /**
+     * H.264 data, whether AVC420 or AVC444.
+     */
+    GUAC_RDP_RDPGFX_CODEC_H264,
+
+    /**
+     * Any other codec.
+     */
+    GUAC_RDP_RDPGFX_CODEC_OTHER,
+
+    /**
+     * The number of values within this enum. This is not a valid codec.
+     */
+    GUAC_RDP_RDPGFX_CODEC_COUNT
+
+} guac_rdp_rdpgfx_codec;
+
+/**
+ * The location within the display that the contents of an RDPGFX cache slot
+ * were most recently copied from.
+ */
+typedef struct guac_rdp_rdpgfx_cache_origin {
+
+    /**
+     * Non-zero if the cache slot was populated from a surface mapped to the
+     * display, zero otherwise.
+     */
+    int mapped;
+
+    /**
+     * The X coordinate of the upper-left corner of the cached region within
+     * the display at the time it was cached.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the cached region within
+     * the display at the time it was cached.
+     */
+    int y;
+
+    /**
+     * The width of the cached region, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the cached region, in pixels.
+     */
+    int height;
+
+} guac_rdp_rdpgfx_cache_origin;
+
+/**
+ * The state of Guacamole's handling of the RDPGFX channel. FreeRDP's GDI
+ * remains responsible for decoding and compositing all RDPGFX surfaces, with
+ * Guacamole wrapping several of the GDI's handlers to observe the RDPGFX
+ * messages received.
+ */
+typedef struct guac_rdp_rdpgfx {
+
+    /**
+     * The SurfaceCommand handler installed by FreeRDP's GDI, or NULL if the
+     * RDPGFX channel is not connected.
+     */
+    pcRdpgfxSurfaceCommand surface_command;
+
+    /**
+     * The SurfaceToSurface handler installed by FreeRDP's GDI, or NULL if
+     * the RDPGFX channel is not connected.
+     */
+    pcRdpgfxSurfaceToSurface surface_to_surface;
+
+    /**
+     * The SurfaceToCache handler installed by FreeRDP's GDI, or NULL if the
+     * RDPGFX channel is not connected.
+     */
+    pcRdpgfxSurfaceToCache surface_to_cache;
+
+    /**
+     * The CacheToSurface handler installed by FreeRDP's GDI, or NULL if the
+     * RDPGFX channel is not connected.
+     */
+    pcRdpgfxCacheToSurface cache_to_surface;
+
+    /**
+     * The MapSurfaceToOutput handler installed by FreeRDP's GDI, or NULL if
+     * the RDPGFX channel is not connected.
+     */
+    pcRdpgfxMapSurfaceToOutput map_surface_to_output;
+
+    /**
+     * The display location that each cache slot was populated from, indexed
+     * by cache slot, or NULL if the RDPGFX channel is not connected.
+     */
+    guac_rdp_rdpgfx_cache_origin* cache_origins;
+
+    /**
+     * The number of entries within the cache_origins array.
+     */
+    UINT32 cache_slots;
+
+    /**
+     * Copies within the display described by RDPGFX messages since the last
+     * time FreeRDP finished drawing to the display, to be passed to
+     * guac_display as copy hints.
+     */
+    guac_display_copy_hint copy_hints[GUAC_DISPLAY_LAYER_MAX_COPY_HINTS];
+
+    /**
+     * The number of hints within the copy_hints array.
+     */
+    int copy_hint_count;
+
+    /**
+     * The number of surface commands received for each codec, indexed by
+     * guac_rdp_rdpgfx_codec.
+     */
+    unsigned int commands[GUAC_RDP_RDPGFX_CODEC_COUNT];
+
+    /**
+     * The total number of bytes of encoded image data received within surface
+     * commands for each codec, indexed by guac_rdp_rdpgfx_codec.
+     */
+    uint64_t bytes[GUAC_RDP_RDPGFX_CODEC_COUNT];
+
+} guac_rdp_rdpgfx;
 
 /**
  * Adds FreeRDP's "rdpgfx" plugin to the list of dynamic virtual channel plugins
@@ -45,5 +200,22 @@
  */
 void guac_rdp_rdpgfx_load_plugin(rdpContext* context);
 
+/**
+ * Records all copies within the display that have been described by RDPGFX
+ * messages since the last call to this function as copy hints within the
+ * given raw context, clearing the list of pending copies. This function
+ * should be invoked once FreeRDP has finished drawing to the display, before
+ * the raw context is closed.
+ *
+ * @param context
+ *     The rdpContext associated with the active RDP session.
+ *
+ * @param raw_context
+ *     The raw context of the default layer that FreeRDP has drawn to, or NULL
+ *     if the pending copies should simply be discarded.
+ */
+void guac_rdp_rdpgfx_flush_copy_hints(rdpContext* context,
+        guac_display_layer_raw_context* raw_context);
+
 #endif
 
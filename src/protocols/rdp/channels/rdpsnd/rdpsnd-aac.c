@@ -0,0 +1,193 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "channels/rdpsnd/rdpsnd-aac.h"
+
+#include <guacamole/audio.h>
+#include <guacamole/client.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * All sample rates which can be represented within an ADTS header, in order
+ * of their corresponding sampling frequency index.
+ */
+static const int guac_rdpsnd_adts_rates[] = {
+    96000, 88200, 64000, 48000, 44100, 32000,
+    24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+/**
+ * Returns the ADTS sampling frequency index of the given sample rate.
+ *
+ * @param rate
+ *     The sample rate to look up, in Hz.
+ *
+ * @return
+ *     The ADTS sampling frequency index of the given sample rate, or -1 if
+ *     the rate cannot be represented within an ADTS header.
+ */
+static int guac_rdpsnd_adts_rate_index(int rate) {
+
+    int count = sizeof(guac_rdpsnd_adts_rates)
+        / sizeof(guac_rdpsnd_adts_rates[0]);
+
+    for (int i = 0; i < count; i++) {
+        if (guac_rdpsnd_adts_rates[i] == rate)
+            return i;
+    }
+
+    return -1;
+
+}
+
+int guac_rdpsnd_aac_format_supported(int rate, int channels) {
+    return guac_rdpsnd_adts_rate_index(rate) != -1
+        && channels >= 1 && channels <= 7;
+}
+
+/**
+ * Callback for guac_client_for_owner() and guac_client_foreach_user() which
+ * determines whether the given user has declared support for AAC. If the
+ * given data is non-NULL, it is a pointer to an int which is set to non-zero
+ * if the user supports AAC.
+ *
+ * @param user
+ *     The user to check, or NULL if there is no such user.
+ *
+ * @param data
+ *     A pointer to an int to set if the user supports AAC, or NULL.
+ *
+ * @return
+ *     A non-NULL value if the user supports AAC, NULL otherwise.
+ */
+static void* guac_rdpsnd_user_supports_aac(guac_user* user, void* data) {
+
+    if (user == NULL)
+        return NULL;
+
+    for (int i = 0; user->info.audio_mimetypes[i] != NULL; i++) {
+        if (strcmp(user->info.audio_mimetypes[i],
+                    GUAC_RDPSND_AAC_MIMETYPE) == 0) {
+
+            if (data != NULL)
+                *((int*) data) = 1;
+
+            return user;
+
+        }
+    }
+
+    return NULL;
+
+}
+
+int guac_rdpsnd_aac_supported(guac_client* client) {
+
+    /* Prefer the capabilities of the owner, as with other audio encoders */
+    if (guac_client_for_owner(client, guac_rdpsnd_user_supports_aac, NULL)
+            != NULL)
+        return 1;
+
+    /* Failing that, check ANY connected user */
+    int supported = 0;
+    guac_client_foreach_user(client, guac_rdpsnd_user_supports_aac,
+            &supported);
+
+    return supported;
+
+}
+
+static void guac_rdpsnd_aac_send_audio(guac_audio_stream* audio,
+        guac_socket* socket) {
+
+    /* Associate stream */
+    guac_protocol_send_audio(socket, audio->stream, GUAC_RDPSND_AAC_MIMETYPE);
+
+}
+
+static void guac_rdpsnd_aac_begin_handler(guac_audio_stream* audio) {
+
+    /* Broadcast existence of stream */
+    guac_rdpsnd_aac_send_audio(audio, audio->client->socket);
+
+}
+
+static void guac_rdpsnd_aac_join_handler(guac_audio_stream* audio,
+        guac_user* user) {
+
+    /* Notify user of existence of stream */
+    guac_rdpsnd_aac_send_audio(audio, user->socket);
+
+}
+
+static void guac_rdpsnd_aac_end_handler(guac_audio_stream* audio) {
+
+    /* Send end of stream */
+    guac_protocol_send_end(audio->client->socket, audio->stream);
+
+}
+
+static void guac_rdpsnd_aac_write_handler(guac_audio_stream* audio,
+        const unsigned char* data, int length) {
+
+    guac_socket* socket = audio->client->socket;
+
+    int rate_index = guac_rdpsnd_adts_rate_index(audio->rate);
+    int frame_length = length + GUAC_RDPSND_ADTS_HEADER_SIZE;
+
+    /* Drop anything that cannot be represented by a single ADTS frame */
+    if (rate_index == -1 || frame_length > 0x1FFF)
+        return;
+
+    /* ADTS header for a single AAC-LC access unit without CRC */
+    unsigned char header[GUAC_RDPSND_ADTS_HEADER_SIZE] = {
+        0xFF,
+        0xF1,
+        (1 << 6) | (rate_index << 2) | ((audio->channels >> 2) & 0x1),
+        ((audio->channels & 0x3) << 6) | ((frame_length >> 11) & 0x3),
+        (frame_length >> 3) & 0xFF,
+        ((frame_length & 0x7) << 5) | 0x1F,
+        0xFC
+    };
+
+    /* Send each ADTS frame as a header followed by its access unit, without
+     * copying the access unit */
+    guac_protocol_send_blob(socket, audio->stream, header, sizeof(header));
+    guac_protocol_send_blobs(socket, audio->stream, data, length);
+
+}
+
+/* AAC passthrough encoder handlers */
+guac_audio_encoder _guac_rdpsnd_aac_encoder = {
+    .mimetype      = GUAC_RDPSND_AAC_MIMETYPE,
+    .begin_handler = guac_rdpsnd_aac_begin_handler,
+    .write_handler = guac_rdpsnd_aac_write_handler,
+    .join_handler  = guac_rdpsnd_aac_join_handler,
+    .end_handler   = guac_rdpsnd_aac_end_handler
+};
+
+/* Actual encoder definition */
+guac_audio_encoder* guac_rdpsnd_aac_encoder = &_guac_rdpsnd_aac_encoder;
+
@@ -0,0 +1,84 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_RDP_CHANNELS_RDPSND_AAC_H
+#define GUAC_RDP_CHANNELS_RDPSND_AAC_H
+
+#include <guacamole/audio.h>
+#include <guacamole/client.h>
+
+/**
+ * The format tag of the Microsoft AAC audio format, as sent by the RDP
+ * server within the Server Audio Formats and Version PDU. Audio in this
+ * format is raw AAC-LC, with each Wave PDU containing a single access unit.
+ */
+#define GUAC_RDPSND_WAVE_FORMAT_AAC_MS 0xA106
+
+/**
+ * The mimetype which must be advertised by a user for compressed AAC audio
+ * to be passed through to that user rather than PCM.
+ */
+#define GUAC_RDPSND_AAC_MIMETYPE "audio/aac"
+
+/**
+ * The size of the ADTS header prepended to each AAC access unit, in bytes.
+ */
+#define GUAC_RDPSND_ADTS_HEADER_SIZE 7
+
+/**
+ * Audio encoder which passes AAC received from the RDP server through to
+ * users without decoding, framing each access unit with an ADTS header such
+ * that the stream can be decoded by the browser. Each call to the write
+ * handler of this encoder must provide exactly one raw AAC access unit.
+ */
+extern guac_audio_encoder* guac_rdpsnd_aac_encoder;
+
+/**
+ * Returns whether AAC received from the RDP server can be passed through to
+ * the users of the given client. AAC is passed through only if the owner of
+ * the connection, or any other user if there is no owner, has declared
+ * support for GUAC_RDPSND_AAC_MIMETYPE.
+ *
+ * @param client
+ *     The guac_client whose users should be checked.
+ *
+ * @return
+ *     Non-zero if AAC can be passed through, zero otherwise.
+ */
+int guac_rdpsnd_aac_supported(guac_client* client);
+
+/**
+ * Returns whether the given AAC format can be framed with an ADTS header.
+ * ADTS can represent only a fixed set of sample rates and at most seven
+ * channels.
+ *
+ * @param rate
+ *     The sample rate of the AAC format, in Hz.
+ *
+ * @param channels
+ *     The number of channels within the AAC format.
+ *
+ * @return
+ *     Non-zero if the format can be represented with ADTS, zero otherwise.
+ */
+int guac_rdpsnd_aac_format_supported(int rate, int channels);
+
+#endif
+
@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include "channels/rdpsnd/rdpsnd-aac.h"
 #include "channels/rdpsnd/rdpsnd-messages.h"
 #include "channels/rdpsnd/rdpsnd.h"
 #include "rdp.h"
@@ -50,6 +51,14 @@ void guac_rdpsnd_formats_handler(guac_rdp_common_svc* svc,
     /* Reset own format count */
     rdpsnd->format_count = 0;
 
+    /* Remember the encoder automatically chosen for PCM, unless compressed
+     * audio is already being passed through */
+    if (audio != NULL && audio->encoder != guac_rdpsnd_aac_encoder)
+        rdpsnd->pcm_encoder = audio->encoder;
+
+    /* Offer compressed audio only if users can decode it directly */
+    int aac_supported = (audio != NULL) && guac_rdpsnd_aac_supported(client);
+
     /* 
      * Check to make sure the stream has at least 20 bytes (14 byte seek,
      * 2 x UTF16 reads, and 2 x UTF8 seeks).
@@ -146,9 +155,10 @@ void guac_rdpsnd_formats_handler(guac_rdp_common_svc* svc,
 
                     /* Add channel */
                     int current = rdpsnd->format_count++;
-                    rdpsnd->formats[current].rate     = rate;
-                    rdpsnd->formats[current].channels = channels;
-                    rdpsnd->formats[current].bps      = bps;
+                    rdpsnd->formats[current].format_tag = format_tag;
+                    rdpsnd->formats[current].rate       = rate;
+                    rdpsnd->formats[current].channels   = channels;
+                    rdpsnd->formats[current].bps        = bps;
 
                     /* Log format */
                     guac_client_log(client, GUAC_LOG_INFO,
@@ -158,7 +168,8 @@ void guac_rdpsnd_formats_handler(guac_rdp_common_svc* svc,
 
                     /* Ensure audio stream is configured to use accepted
                      * format */
-                    guac_audio_stream_reset(audio, NULL, rate, channels, bps);
+                    guac_audio_stream_reset(audio, rdpsnd->pcm_encoder,
+                            rate, channels, bps);
 
                     /* Queue format for sending as accepted */
                     Stream_EnsureRemainingCapacity(output_stream,
@@ -182,6 +193,41 @@ void guac_rdpsnd_formats_handler(guac_rdp_common_svc* svc,
 
             }
 
+            /* If AAC that users can decode, accept for passthrough */
+            else if (format_tag == GUAC_RDPSND_WAVE_FORMAT_AAC_MS
+                    && aac_supported
+                    && guac_rdpsnd_aac_format_supported(rate, channels)) {
+
+                /* If can fit another format, accept it */
+                if (rdpsnd->format_count < GUAC_RDP_MAX_FORMATS) {
+
+                    /* Add channel */
+                    int current = rdpsnd->format_count++;
+                    rdpsnd->formats[current].format_tag = format_tag;
+                    rdpsnd->formats[current].rate       = rate;
+                    rdpsnd->formats[current].channels   = channels;
+                    rdpsnd->formats[current].bps        = bps;
+
+                    /* Log format */
+                    guac_client_log(client, GUAC_LOG_INFO,
+                            "Accepted format: AAC with %i channels at %i Hz "
+                            "(passthrough)", channels, rate);
+
+                    /* Queue format for sending as accepted */
+                    Stream_EnsureRemainingCapacity(output_stream,
+                            18 + body_size);
+                    Stream_Write(output_stream, format_start, 18 + body_size);
+
+                }
+
+                /* Otherwise, log that we dropped one */
+                else
+                    guac_client_log(client, GUAC_LOG_INFO,
+                            "Dropped valid format: AAC with %i channels at "
+                            "%i Hz", channels, rate);
+
+            }
+
         }
     }
 
@@ -297,12 +343,27 @@ void guac_rdpsnd_wave_info_handler(guac_rdp_common_svc* svc,
 
     /* Reset audio stream if format has changed */
     if (audio != NULL) {
-        if (format < GUAC_RDP_MAX_FORMATS)
-            guac_audio_stream_reset(audio, NULL,
+
+        /* Track any encoder assigned for PCM since formats were negotiated */
+        if (audio->encoder != guac_rdpsnd_aac_encoder)
+            rdpsnd->pcm_encoder = audio->encoder;
+
+        if (format < rdpsnd->format_count) {
+
+            /* Pass compressed audio through to users as-is, restoring the
+             * original encoder for PCM */
+            guac_audio_encoder* encoder = rdpsnd->pcm_encoder;
+            if (rdpsnd->formats[format].format_tag
+                    == GUAC_RDPSND_WAVE_FORMAT_AAC_MS)
+                encoder = guac_rdpsnd_aac_encoder;
+
+            guac_audio_stream_reset(audio, encoder,
                     rdpsnd->formats[format].rate,
                     rdpsnd->formats[format].channels,
                     rdpsnd->formats[format].bps);
-    
+
+        }
+
         else
             guac_client_log(svc->client, GUAC_LOG_WARNING, "RDP server "
                     "attempted to specify an invalid audio format. Sound may "
@@ -339,9 +400,20 @@ void guac_rdpsnd_wave_handler(guac_rdp_common_svc* svc,
 
     /* Write rest of audio packet */
     if (audio != NULL) {
-        guac_audio_stream_write_pcm(audio, buffer,
-                rdpsnd->incoming_wave_size + 4);
+
+        /* AAC data is already compressed and is handed to the passthrough
+         * encoder directly, bypassing the PCM silence detection performed by
+         * guac_audio_stream_write_pcm() */
+        if (audio->encoder == guac_rdpsnd_aac_encoder)
+            audio->encoder->write_handler(audio, buffer,
+                    rdpsnd->incoming_wave_size + 4);
+
+        else
+            guac_audio_stream_write_pcm(audio, buffer,
+                    rdpsnd->incoming_wave_size + 4);
+
         guac_audio_stream_flush(audio);
+
     }
 
     /* Write Wave Confirmation PDU */
@@ -23,6 +23,7 @@
 #include "channels/common-svc.h"
 
 #include <freerdp/freerdp.h>
+#include <guacamole/audio.h>
 #include <guacamole/client.h>
 
 /**
@@ -32,11 +33,18 @@
 #define GUAC_RDP_MAX_FORMATS 16
 
 /**
- * Abstract representation of a PCM format, including the sample rate, number
- * of channels, and bits per sample.
+ * Abstract representation of an audio format, including the sample rate,
+ * number of channels, and bits per sample.
  */
 typedef struct guac_rdpsnd_pcm_format {
 
+    /**
+     * The format tag identifying the encoding of audio in this format. This
+     * will be either WAVE_FORMAT_PCM or, if compressed audio is being passed
+     * through to users, GUAC_RDPSND_WAVE_FORMAT_AAC_MS.
+     */
+    int format_tag;
+
     /**
      * The sample rate of this PCM format.
      */
@@ -93,8 +101,9 @@ typedef struct guac_rdpsnd {
 
     /**
      * All formats agreed upon by server and client during the initial format
-     * exchange. All of these formats will be PCM, which is the only format
-     * guaranteed to be supported (based on the official RDP documentation).
+     * exchange. These formats will be PCM, which is the only format
+     * guaranteed to be supported (based on the official RDP documentation),
+     * except for any compressed formats that users can decode directly.
      */
     guac_rdpsnd_pcm_format formats[GUAC_RDP_MAX_FORMATS];
 
@@ -103,6 +112,13 @@ typedef struct guac_rdpsnd {
      */
     int format_count;
 
+    /**
+     * The audio encoder that was automatically assigned to the audio stream
+     * for PCM, or NULL if none has been assigned. This encoder is restored
+     * whenever the server switches from a compressed format back to PCM.
+     */
+    guac_audio_encoder* pcm_encoder;
+
 } guac_rdpsnd;
 
 /**
@@ -218,7 +218,8 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
 
     /* Create queue for input events (to avoid RDP I/O blocking processing of
      * further Guacamole instructions) and associated signalling handle */
-    guac_fifo_init(&rdp_client->input_events, &rdp_client->input_events_items,
+    guac_fifo_lockfree_init(&rdp_client->input_events,
+            &rdp_client->input_events_items, rdp_client->input_events_sequences,
             GUAC_RDP_INPUT_EVENT_QUEUE_SIZE, sizeof(guac_rdp_input_event));
 
     rdp_client->input_event_queued = CreateEvent(NULL, TRUE, FALSE, NULL);
@@ -274,7 +275,7 @@ int guac_rdp_client_free_handler(guac_client* client) {
     pthread_join(rdp_client->client_thread, NULL);
 
     /* Clean up event queue and associated signalling handle */
-    guac_fifo_destroy(&rdp_client->input_events);
+    guac_fifo_lockfree_destroy(&rdp_client->input_events);
     CloseHandle(rdp_client->input_event_queued);
 
     /* Free parsed settings */
@@ -293,6 +294,9 @@ int guac_rdp_client_free_handler(guac_client* client) {
     /* Free multi-touch support module (RDPEI) */
     guac_rdp_rdpei_free(rdp_client->rdpei);
 
+    /* Stop copilot, including any in-progress queries */
+    guac_copilot_free(rdp_client->copilot);
+
     /* Clean up filesystem, if allocated */
     if (rdp_client->filesystem != NULL)
         guac_rdp_fs_free(rdp_client->filesystem);
@@ -305,6 +309,9 @@ int guac_rdp_client_free_handler(guac_client* client) {
         rdp_client->active_job = NULL;
     }
 
+    /* Terminate any print filter process started in advance */
+    guac_rdp_print_filter_free(rdp_client->print_filter);
+
 #ifdef ENABLE_COMMON_SSH
     /* Free SFTP filesystem, if loaded */
     if (rdp_client->sftp_filesystem)
@@ -74,8 +74,9 @@ void guac_rdp_copilot_track_keystroke(guac_rdp_client* rdp_client,
     if (rdp_client->copilot == NULL || !pressed)
         return;
 
-    /* Track Ctrl+Alt+H for Copilot activation (handled by client) */
-    /* We just track general activity here */
+    /* Keystrokes are only recorded here, and are interpreted later by the
+     * copilot when context is needed, keeping key handling fast */
+    guac_copilot_track_keystroke(rdp_client->copilot, keysym);
 
 }
 
@@ -36,7 +36,10 @@
 void guac_rdp_copilot_init(guac_client* client, guac_rdp_client* rdp_client);
 
 /**
- * Tracks a keystroke for Copilot context.
+ * Tracks a keystroke for Copilot context. This function is invoked for every
+ * key event handled by the RDP client thread, and only records the keystroke
+ * without blocking, acquiring locks, or allocating memory. It may only be
+ * invoked by the RDP client thread.
  *
  * @param rdp_client
  *     The RDP client data.
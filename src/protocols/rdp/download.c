@@ -53,8 +53,14 @@ int guac_rdp_download_ack_handler(guac_user* user, guac_stream* stream,
         return 0;
     }
 
-    /* If successful, read data */
-    if (status == GUAC_PROTOCOL_STATUS_SUCCESS) {
+    /* Return stream to user if the transfer has failed */
+    if (status != GUAC_PROTOCOL_STATUS_SUCCESS) {
+        guac_user_free_stream(user, stream);
+        return 0;
+    }
+
+    /* Read and send data until the window of the stream is full */
+    while (guac_stream_can_send(stream)) {
 
         /* Attempt read into buffer */
         char buffer[4096];
@@ -65,12 +71,13 @@ int guac_rdp_download_ack_handler(guac_user* user, guac_stream* stream,
         /* If bytes read, send as blob */
         if (bytes_read > 0) {
             download_status->offset += bytes_read;
-            guac_protocol_send_blob(user->socket, stream,
+            guac_stream_send_blob(user->socket, stream,
                     buffer, bytes_read);
+            continue;
         }
 
         /* If EOF, send end */
-        else if (bytes_read == 0) {
+        if (bytes_read == 0) {
             guac_protocol_send_end(user->socket, stream);
             guac_user_free_stream(user, stream);
             guac_mem_free(download_status);
@@ -85,13 +92,11 @@ int guac_rdp_download_ack_handler(guac_user* user, guac_stream* stream,
             guac_mem_free(download_status);
         }
 
-        guac_socket_flush(user->socket);
+        break;
 
     }
 
-    /* Otherwise, return stream to user */
-    else
-        guac_user_free_stream(user, stream);
+    guac_socket_flush(user->socket);
 
     return 0;
 
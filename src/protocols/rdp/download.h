@@ -47,6 +47,8 @@ typedef struct guac_rdp_download_status {
 
 /**
  * Handler for acknowledgements of receipt of data related to file downloads.
+ * Each acknowledgement results in as many further blobs being sent as the
+ * window of the stream allows.
  */
 guac_user_ack_handler guac_rdp_download_ack_handler;
 
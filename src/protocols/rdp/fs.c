@@ -367,9 +367,16 @@ int guac_rdp_fs_open(guac_rdp_fs* fs, const char* path,
     file->fd  = fd;
     file->dir = NULL;
     file->dir_pattern[0] = '\0';
+    file->dir_entries = NULL;
+    file->dir_entry_count = 0;
+    file->dir_entry_index = 0;
+    file->dir_snapshot_mtime.tv_sec = 0;
+    file->dir_snapshot_mtime.tv_nsec = 0;
     file->absolute_path = guac_strdup(normalized_path);
     file->real_path = guac_strdup(real_path);
     file->bytes_written = 0;
+    file->next_read_offset = 0;
+    file->read_ahead_offset = 0;
 
     guac_client_log(fs->client, GUAC_LOG_DEBUG,
             "%s: Opened \"%s\" as file_id=%i",
@@ -423,13 +430,34 @@ int guac_rdp_fs_read(guac_rdp_fs* fs, int file_id, uint64_t offset,
     }
 
     /* Attempt read */
-    lseek(file->fd, offset, SEEK_SET);
-    bytes_read = read(file->fd, buffer, length);
+    bytes_read = pread(file->fd, buffer, length, offset);
 
     /* Translate errno on error */
     if (bytes_read < 0)
         return guac_rdp_fs_get_errorcode(errno);
 
+#ifdef POSIX_FADV_WILLNEED
+    /* While the file is being read sequentially, keep the kernel reading
+     * ahead of the server, such that disk I/O overlaps with the round trip
+     * of each read request rather than stalling the RDP event thread */
+    uint64_t end = offset + bytes_read;
+    if (offset != file->next_read_offset)
+        file->read_ahead_offset = 0;
+
+    else if (bytes_read == length
+            && file->read_ahead_offset < end + GUAC_RDP_FS_READ_AHEAD / 2) {
+
+        uint64_t start = file->read_ahead_offset > end ? file->read_ahead_offset : end;
+        uint64_t limit = end + GUAC_RDP_FS_READ_AHEAD;
+
+        posix_fadvise(file->fd, start, limit - start, POSIX_FADV_WILLNEED);
+        file->read_ahead_offset = limit;
+
+    }
+
+    file->next_read_offset = end;
+#endif
+
     return bytes_read;
 
 }
@@ -446,13 +474,30 @@ int guac_rdp_fs_write(guac_rdp_fs* fs, int file_id, uint64_t offset,
         return GUAC_RDP_FS_EINVAL;
     }
 
-    /* Attempt write */
-    lseek(file->fd, offset, SEEK_SET);
-    bytes_written = write(file->fd, buffer, length);
+    /* Attempt write, continuing after any partial writes such that the
+     * server need not reissue the remainder */
+    bytes_written = 0;
+    while (bytes_written < length) {
 
-    /* Translate errno on error */
-    if (bytes_written < 0)
-        return guac_rdp_fs_get_errorcode(errno);
+        int result = pwrite(file->fd, (char*) buffer + bytes_written,
+                length - bytes_written, offset + bytes_written);
+
+        /* Translate errno on error, but only if nothing has been written
+         * (otherwise report what succeeded) */
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            if (bytes_written == 0)
+                return guac_rdp_fs_get_errorcode(errno);
+            break;
+        }
+
+        if (result == 0)
+            break;
+
+        bytes_written += result;
+
+    }
 
     file->bytes_written += bytes_written;
     return bytes_written;
@@ -551,6 +596,26 @@ int guac_rdp_fs_truncate(guac_rdp_fs* fs, int file_id, int length) {
 
 }
 
+/**
+ * Frees all entries within the directory snapshot of the given file, if any,
+ * leaving the file without a snapshot.
+ *
+ * @param file
+ *     The file whose directory snapshot should be freed.
+ */
+static void guac_rdp_fs_free_dir_snapshot(guac_rdp_fs_file* file) {
+
+    for (int i = 0; i < file->dir_entry_count; i++) {
+        guac_mem_free(file->dir_entries[i].name);
+        guac_mem_free(file->dir_entries[i].absolute_path);
+    }
+
+    guac_mem_free(file->dir_entries);
+    file->dir_entry_count = 0;
+    file->dir_entry_index = 0;
+
+}
+
 void guac_rdp_fs_close(guac_rdp_fs* fs, int file_id) {
 
     guac_rdp_fs_file* file = guac_rdp_fs_get_file(fs, file_id);
@@ -571,6 +636,9 @@ void guac_rdp_fs_close(guac_rdp_fs* fs, int file_id) {
     if (file->dir != NULL)
         closedir(file->dir);
 
+    /* Free any snapshot of directory contents */
+    guac_rdp_fs_free_dir_snapshot(file);
+
     /* Close file */
     close(file->fd);
 
@@ -612,6 +680,137 @@ const char* guac_rdp_fs_read_dir(guac_rdp_fs* fs, int file_id) {
 
 }
 
+int guac_rdp_fs_snapshot_dir(guac_rdp_fs* fs, int file_id) {
+
+    struct stat dir_stat;
+    struct dirent* result;
+    int capacity = 0;
+
+    guac_rdp_fs_file* file = guac_rdp_fs_get_file(fs, file_id);
+    if (file == NULL)
+        return GUAC_RDP_FS_EINVAL;
+
+    /* Open directory if not yet open, stop if error */
+    if (file->dir == NULL) {
+        file->dir = fdopendir(file->fd);
+        if (file->dir == NULL)
+            return guac_rdp_fs_get_errorcode(errno);
+    }
+
+    if (fstat(dirfd(file->dir), &dir_stat))
+        return guac_rdp_fs_get_errorcode(errno);
+
+    /* Reuse existing snapshot if the directory has not since changed */
+    if (file->dir_entries != NULL
+            && file->dir_snapshot_mtime.tv_sec == dir_stat.st_mtim.tv_sec
+            && file->dir_snapshot_mtime.tv_nsec == dir_stat.st_mtim.tv_nsec) {
+        file->dir_entry_index = 0;
+        return 0;
+    }
+
+    guac_rdp_fs_free_dir_snapshot(file);
+    file->dir_snapshot_mtime = dir_stat.st_mtim;
+    rewinddir(file->dir);
+
+    /* Read all entries, retrieving file information without opening each */
+    while ((result = readdir(file->dir)) != NULL) {
+
+        char entry_path[GUAC_RDP_FS_MAX_PATH];
+        struct stat entry_stat;
+
+        /* Skip entries whose paths cannot be represented */
+        if (guac_rdp_fs_convert_path(file->absolute_path, result->d_name,
+                    entry_path))
+            continue;
+
+        /* The parent directory must be resolved within the simulated
+         * filesystem, as the drive root has no parent */
+        if (strcmp(result->d_name, "..") == 0) {
+            char real_path[GUAC_RDP_FS_MAX_PATH];
+            __guac_rdp_fs_translate_path(fs, entry_path, real_path);
+            if (stat(real_path, &entry_stat))
+                continue;
+        }
+
+        /* All other entries can be resolved relative to the directory */
+        else if (fstatat(dirfd(file->dir), result->d_name, &entry_stat, 0))
+            continue;
+
+        /* Expand snapshot storage as needed */
+        if (file->dir_entry_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            file->dir_entries = guac_mem_realloc_or_die(file->dir_entries,
+                    capacity, sizeof(guac_rdp_fs_dir_entry));
+        }
+
+        guac_rdp_fs_dir_entry* entry =
+            &(file->dir_entries[file->dir_entry_count++]);
+
+        entry->name = guac_strdup(result->d_name);
+        entry->absolute_path = guac_strdup(entry_path);
+        entry->size  = entry_stat.st_size;
+        entry->ctime = WINDOWS_TIME(entry_stat.st_ctime);
+        entry->mtime = WINDOWS_TIME(entry_stat.st_mtime);
+        entry->atime = WINDOWS_TIME(entry_stat.st_atime);
+
+        if (S_ISDIR(entry_stat.st_mode))
+            entry->attributes = FILE_ATTRIBUTE_DIRECTORY;
+        else
+            entry->attributes = FILE_ATTRIBUTE_NORMAL;
+
+    }
+
+    guac_client_log(fs->client, GUAC_LOG_DEBUG,
+            "%s: Took snapshot of %i entries within \"%s\" (file_id=%i)",
+            __func__, file->dir_entry_count, file->absolute_path, file_id);
+
+    return 0;
+
+}
+
+const guac_rdp_fs_dir_entry* guac_rdp_fs_next_dir_entry(guac_rdp_fs* fs,
+        int file_id, const char* pattern) {
+
+    guac_rdp_fs_file* file = guac_rdp_fs_get_file(fs, file_id);
+    if (file == NULL)
+        return NULL;
+
+    /* Take snapshot if not yet taken */
+    if (file->dir_entries == NULL && guac_rdp_fs_snapshot_dir(fs, file_id))
+        return NULL;
+
+    /* Patterns without wildcards, and patterns which consist only of a
+     * literal prefix followed by a single trailing "*" (the common case for
+     * directory listings), can be matched without fnmatch() */
+    size_t literal_length = strcspn(pattern, "*?[");
+    int literal = (pattern[literal_length] == '\0');
+    int prefix = (pattern[literal_length] == '*'
+            && pattern[literal_length + 1] == '\0');
+
+    while (file->dir_entry_index < file->dir_entry_count) {
+
+        const guac_rdp_fs_dir_entry* entry =
+            &(file->dir_entries[file->dir_entry_index++]);
+
+        if (literal) {
+            if (strcmp(entry->absolute_path, pattern) == 0)
+                return entry;
+        }
+
+        else if (prefix) {
+            if (strncmp(entry->absolute_path, pattern, literal_length) == 0)
+                return entry;
+        }
+
+        else if (!guac_rdp_fs_matches(entry->absolute_path, pattern))
+            return entry;
+
+    }
+
+    return NULL;
+
+}
+
 const char* guac_rdp_fs_basename(const char* path) {
 
     for (const char* c = path; *c != '\0'; c++) {
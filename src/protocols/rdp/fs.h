@@ -38,6 +38,7 @@
 
 #include <dirent.h>
 #include <stdint.h>
+#include <time.h>
 
 /**
  * The maximum number of file IDs to provide.
@@ -54,6 +55,13 @@
  */
 #define GUAC_RDP_MAX_PATH_DEPTH 64
 
+/**
+ * The number of bytes beyond the end of a sequential read that the kernel
+ * should be asked to begin reading ahead of time, such that the next read
+ * requested by the RDP server can be satisfied without waiting on the disk.
+ */
+#define GUAC_RDP_FS_READ_AHEAD 1048576
+
 /**
  * Error code returned when no more file IDs can be allocated.
  */
@@ -114,6 +122,50 @@
  */
 #define WINDOWS_TIME(t) ((t + ((uint64_t) 11644473600)) * 10000000)
 
+/**
+ * A single entry within a snapshot of the contents of a directory, including
+ * the file information that would otherwise need to be retrieved by opening
+ * that entry.
+ */
+typedef struct guac_rdp_fs_dir_entry {
+
+    /**
+     * The filename of this entry, as returned by readdir().
+     */
+    char* name;
+
+    /**
+     * The absolute path of this entry within the simulated filesystem.
+     */
+    char* absolute_path;
+
+    /**
+     * Bitwise OR of all associated Windows file attributes.
+     */
+    int attributes;
+
+    /**
+     * The size of this entry, in bytes.
+     */
+    uint64_t size;
+
+    /**
+     * The time this entry was created, as a Windows timestamp.
+     */
+    uint64_t ctime;
+
+    /**
+     * The time this entry was last modified, as a Windows timestamp.
+     */
+    uint64_t mtime;
+
+    /**
+     * The time this entry was last accessed, as a Windows timestamp.
+     */
+    uint64_t atime;
+
+} guac_rdp_fs_dir_entry;
+
 /**
  * An arbitrary file on the virtual filesystem of the Guacamole drive.
  */
@@ -150,6 +202,31 @@ typedef struct guac_rdp_fs_file {
      */
     char dir_pattern[GUAC_RDP_FS_MAX_PATH];
 
+    /**
+     * Snapshot of all entries within this directory, or NULL if no snapshot
+     * has yet been taken. This field only applies if the file is being used
+     * as a directory, and is populated by guac_rdp_fs_snapshot_dir().
+     */
+    guac_rdp_fs_dir_entry* dir_entries;
+
+    /**
+     * The number of entries within the dir_entries snapshot.
+     */
+    int dir_entry_count;
+
+    /**
+     * The index of the next entry within the dir_entries snapshot that
+     * should be returned by guac_rdp_fs_next_dir_entry().
+     */
+    int dir_entry_index;
+
+    /**
+     * The modification time of this directory at the time the dir_entries
+     * snapshot was taken. If the directory's modification time differs from
+     * this value, the snapshot is out of date.
+     */
+    struct timespec dir_snapshot_mtime;
+
     /**
      * Bitwise OR of all associated Windows file attributes.
      */
@@ -180,6 +257,18 @@ typedef struct guac_rdp_fs_file {
      */
     uint64_t bytes_written;
 
+    /**
+     * The offset immediately following the end of the most recent read from
+     * the file. A read beginning at this offset is considered sequential.
+     */
+    uint64_t next_read_offset;
+
+    /**
+     * The offset up to which the kernel has already been asked to read ahead,
+     * or zero if no read-ahead has been requested.
+     */
+    uint64_t read_ahead_offset;
+
 } guac_rdp_fs_file;
 
 /**
@@ -603,6 +692,50 @@ int guac_rdp_fs_convert_path(const char* parent, const char* rel_path,
  */
 const char* guac_rdp_fs_read_dir(guac_rdp_fs* fs, int file_id);
 
+/**
+ * Takes a snapshot of the entries within the directory having the given file
+ * ID, including the file information of each entry, and rewinds that snapshot
+ * such that the next call to guac_rdp_fs_next_dir_entry() returns its first
+ * entry. If a snapshot was already taken and the directory has not been
+ * modified since, the existing snapshot is reused.
+ *
+ * @param fs
+ *     The filesystem containing the directory to snapshot.
+ *
+ * @param file_id
+ *     The ID of the directory to snapshot, as returned by guac_rdp_fs_open().
+ *
+ * @return
+ *     Zero if the snapshot is ready for reading, or an error code less than
+ *     zero if the directory could not be read.
+ */
+int guac_rdp_fs_snapshot_dir(guac_rdp_fs* fs, int file_id);
+
+/**
+ * Returns the next entry within the snapshot of the directory having the
+ * given file ID whose absolute path matches the given pattern, or NULL if no
+ * further entries match. If no snapshot has yet been taken, one is taken
+ * automatically, as if by guac_rdp_fs_snapshot_dir().
+ *
+ * @param fs
+ *     The filesystem containing the directory to read entries from.
+ *
+ * @param file_id
+ *     The ID of the directory to read entries from, as returned by
+ *     guac_rdp_fs_open().
+ *
+ * @param pattern
+ *     The pattern to check the absolute path of each entry against, using
+ *     the same semantics as guac_rdp_fs_matches().
+ *
+ * @return
+ *     The next matching entry within the directory snapshot, or NULL if no
+ *     more entries match. The returned entry remains valid only until the
+ *     snapshot is next refreshed or the directory is closed.
+ */
+const guac_rdp_fs_dir_entry* guac_rdp_fs_next_dir_entry(guac_rdp_fs* fs,
+        int file_id, const char* pattern);
+
 /**
  * Returns the file having the given ID, or NULL if no such file exists.
  *
@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include "channels/rail.h"
 #include "color.h"
 #include "rdp.h"
 #include "settings.h"
@@ -140,6 +141,12 @@ BOOL guac_rdp_gdi_begin_paint(rdpContext* context) {
     guac_display_layer_raw_context* current_context = guac_display_layer_open_raw(default_layer);
     rdp_client->current_context = current_context;
 
+    /* For RemoteApp, the contents of FreeRDP's GDI are instead copied into
+     * the layers of each RAIL window, and the remainder of the desktop is
+     * never sent */
+    if (rdp_client->settings->remote_app != NULL)
+        return TRUE;
+
     /* Resynchronize default layer buffer details with FreeRDP's GDI */
     current_context->buffer = gdi->primary_buffer;
     current_context->stride = gdi->stride;
@@ -149,6 +156,82 @@ BOOL guac_rdp_gdi_begin_paint(rdpContext* context) {
 
 }
 
+/**
+ * Records the given region of FreeRDP's GDI, which has been invalidated by
+ * drawing operations, as modified within the given raw context. Only the
+ * portion of the region within the bounds of the rendering surface is
+ * considered. If multiple monitors are in use, the region is additionally
+ * split along the boundaries of each monitor, such that a change on one
+ * monitor never causes the display to consider neighboring monitors, and
+ * such that any part of the region lying outside every monitor (within the
+ * unused corners of a virtual desktop whose monitors differ in size) is
+ * ignored, unless the monitor layout does not cover the region at all.
+ *
+ * @param rdp_client
+ *     The RDP client whose monitor layout should be considered.
+ *
+ * @param current_context
+ *     The raw context of the default layer that FreeRDP is drawing to.
+ *
+ * @param region
+ *     The invalidated region of FreeRDP's GDI.
+ */
+static void guac_rdp_gdi_damage(guac_rdp_client* rdp_client,
+        guac_display_layer_raw_context* current_context,
+        const GDI_RGN* region) {
+
+    /* Ignore regions that have not actually been invalidated */
+    if (region->null)
+        return;
+
+    /* guac_rect uses signed arithmetic for all values. While FreeRDP
+     * definitely performs its own checks and ensures these values cannot get
+     * so large as to cause problems with signed arithmetic, it's worth
+     * checking and bailing out here if an external bug breaks that. */
+    GUAC_ASSERT(region->w <= INT_MAX && region->h <= INT_MAX);
+
+    /* Mark modified region as dirty, but only within the bounds of the
+     * rendering surface */
+    guac_rect dst_rect;
+    guac_rect_init(&dst_rect, region->x, region->y, region->w, region->h);
+    guac_rect_constrain(&dst_rect, &current_context->bounds);
+
+    guac_rdp_disp* disp = rdp_client->disp;
+    if (disp->monitors_count <= 1) {
+        guac_display_layer_raw_context_damage(current_context, &dst_rect);
+        return;
+    }
+
+    /* Consider each monitor separately */
+    int damaged = 0;
+    for (int i = 0; i < disp->monitors_count; i++) {
+
+        const guac_rdp_disp_monitor* monitor = &disp->monitors[i];
+        if (monitor->requested_width <= 0 || monitor->requested_height <= 0)
+            continue;
+
+        guac_rect monitor_rect;
+        guac_rect_init(&monitor_rect, monitor->left_offset, monitor->top_offset,
+                monitor->requested_width, monitor->requested_height);
+
+        if (!guac_rect_intersects(&monitor_rect, &dst_rect))
+            continue;
+
+        guac_rect monitor_dirty = dst_rect;
+        guac_rect_constrain(&monitor_dirty, &monitor_rect);
+        guac_display_layer_raw_context_damage(current_context, &monitor_dirty);
+        damaged = 1;
+
+    }
+
+    /* If the monitor layout does not yet describe the region at all (such as
+     * while a new layout is still being negotiated), fall back to the region
+     * as a whole */
+    if (!damaged)
+        guac_display_layer_raw_context_damage(current_context, &dst_rect);
+
+}
+
 BOOL guac_rdp_gdi_end_paint(rdpContext* context) {
 
     guac_client* client = ((rdp_freerdp_context*) context)->client;
@@ -174,28 +257,45 @@ BOOL guac_rdp_gdi_end_paint(rdpContext* context) {
     if (gdi->primary->hdc->hwnd->invalid->null)
         goto paint_complete;
 
-    INT32 x = gdi->primary->hdc->hwnd->invalid->x;
-    INT32 y = gdi->primary->hdc->hwnd->invalid->y;
-    UINT32 w = gdi->primary->hdc->hwnd->invalid->w;
-    UINT32 h = gdi->primary->hdc->hwnd->invalid->h;
+    /* Mark each individually-invalidated region as modified, rather than
+     * only their bounding rectangle, such that far-apart updates do not
+     * require comparing everything in between */
+    GDI_WND* hwnd = gdi->primary->hdc->hwnd;
 
-    /* guac_rect uses signed arithmetic for all values. While FreeRDP
-     * definitely performs its own checks and ensures these values cannot get
-     * so large as to cause problems with signed arithmetic, it's worth
-     * checking and bailing out here if an external bug breaks that. */
-    GUAC_ASSERT(w <= INT_MAX && h <= INT_MAX);
+    /* For RemoteApp, update only the layers of the RAIL windows */
+    if (rdp_client->settings->remote_app != NULL) {
 
-    /* Mark modified region as dirty, but only within the bounds of the
-     * rendering surface */
-    guac_rect dst_rect;
-    guac_rect_init(&dst_rect, x, y, w, h);
-    guac_rect_constrain(&dst_rect, &current_context->bounds);
-    guac_rect_extend(&current_context->dirty, &dst_rect);
+        if (hwnd->ninvalid > 0 && hwnd->cinvalid != NULL)
+            guac_rdp_rail_paint(context, hwnd->cinvalid, hwnd->ninvalid);
+        else
+            guac_rdp_rail_paint(context, hwnd->invalid, 1);
+
+        rdp_client->gdi_modified = 1;
+        goto paint_complete;
+
+    }
+
+    if (hwnd->ninvalid > 0 && hwnd->cinvalid != NULL) {
+        for (INT32 i = 0; i < hwnd->ninvalid; i++)
+            guac_rdp_gdi_damage(rdp_client, current_context, &hwnd->cinvalid[i]);
+    }
+
+    /* Fall back to only the bounding rectangle if individual regions are not
+     * available */
+    else
+        guac_rdp_gdi_damage(rdp_client, current_context, hwnd->invalid);
+
+    /* Pass along any copies described exactly by the RDPGFX channel, such
+     * that they need not be found by guac_display's own scroll detection */
+    guac_rdp_rdpgfx_flush_copy_hints(context, current_context);
 
     rdp_client->gdi_modified = 1;
 
 paint_complete:
 
+    /* Copies are meaningful only alongside the paint that applied them */
+    guac_rdp_rdpgfx_flush_copy_hints(context, NULL);
+
     /* Clear GDI state for future draws */
     gdi->primary->hdc->hwnd->invalid->null = TRUE;
     gdi->primary->hdc->hwnd->ninvalid = 0;
@@ -235,18 +335,21 @@ BOOL guac_rdp_gdi_desktop_resize(rdpContext* context) {
     GUAC_ASSERT(gdi->primary_buffer != NULL);
 
     /* Update our reference to the GDI buffer, as well as any structural
-     * details, which may now all be different */
-    current_context->buffer = gdi->primary_buffer;
-    current_context->stride = gdi->stride;
-    guac_rect_init(&current_context->bounds, 0, 0, gdi->width, gdi->height);
+     * details, which may now all be different. For RemoteApp, the default
+     * layer does not use FreeRDP's GDI buffer and need only be resized. */
+    if (rdp_client->settings->remote_app == NULL) {
+        current_context->buffer = gdi->primary_buffer;
+        current_context->stride = gdi->stride;
+        guac_rect_init(&current_context->bounds, 0, 0, gdi->width, gdi->height);
+    }
+
+    guac_display_layer_close_raw(default_layer, current_context);
 
     /* Resize layer to match new display dimensions and underlying buffer */
     guac_display_layer_resize(default_layer, gdi->width, gdi->height);
     guac_client_log(client, GUAC_LOG_DEBUG, "Server resized display to %ix%i",
             gdi->width, gdi->height);
 
-    guac_display_layer_close_raw(default_layer, current_context);
-
     /* Build JSON string containing monitor information */
     char* json = guac_rdp_build_monitor_layout_json(rdp_client);
 
@@ -19,6 +19,7 @@
 
 #include "channels/disp.h"
 #include "channels/rdpei.h"
+#include "copilot-rdp.h"
 #include "input.h"
 #include "guacamole/display.h"
 #include "keyboard.h"
@@ -190,6 +191,9 @@ static void guac_rdp_handle_key_event(guac_rdp_client* rdp_client,
     guac_rdp_keyboard_update_keysym(rdp_client->keyboard,
                 keysym, pressed, GUAC_RDP_KEY_SOURCE_CLIENT);
 
+    /* Record keystroke for copilot context (never blocks) */
+    guac_rdp_copilot_track_keystroke(rdp_client, keysym, pressed);
+
 complete:
     guac_rwlock_release_lock(&(rdp_client->lock));
 
@@ -244,39 +248,98 @@ complete:
 void guac_rdp_input_event_enqueue(guac_rdp_client* rdp_client,
         const guac_rdp_input_event* input_event) {
 
-    guac_fifo_enqueue_and_lock(&rdp_client->input_events, input_event);
+    /* The event is set only after the input event is visible within the
+     * queue, such that the RDP client thread either sees the input event
+     * while handling already-queued events or is woken again */
+    guac_fifo_lockfree_enqueue(&rdp_client->input_events, input_event);
     SetEvent(rdp_client->input_event_queued);
-    guac_fifo_unlock(&rdp_client->input_events);
+
+}
+
+/**
+ * Processes a single input event of any type, updating client state and
+ * sending any associated RDP PDUs via the provided RDP client instance.
+ *
+ * @param rdp_client
+ *     The RDP client instance that should be updated and used to send any PDUs
+ *     associated with the event.
+ *
+ * @param event
+ *     The input event to process.
+ */
+static void guac_rdp_handle_input_event(guac_rdp_client* rdp_client,
+        const guac_rdp_input_event* event) {
+
+    switch (event->type) {
+
+        /* Mouse event */
+        case GUAC_RDP_INPUT_EVENT_MOUSE:
+            guac_rdp_handle_mouse_event(rdp_client, event);
+            break;
+
+        /* Keyboard event */
+        case GUAC_RDP_INPUT_EVENT_KEY:
+            guac_rdp_handle_key_event(rdp_client, event);
+            break;
+
+        /* Touch event */
+        case GUAC_RDP_INPUT_EVENT_TOUCH:
+            guac_rdp_handle_touch_event(rdp_client, event);
+            break;
+
+    }
 
 }
 
 void guac_rdp_handle_input_events(guac_rdp_client* rdp_client) {
 
-    guac_fifo_lock(&rdp_client->input_events);
+    /* Reset the event BEFORE handling queued input events, such that any
+     * input event queued after the final dequeue below sets the event
+     * again */
+    ResetEvent(rdp_client->input_event_queued);
+
+    /* The most recent pure mouse movement that has not yet been handled. Runs
+     * of consecutive movements from the same user are collapsed into the last
+     * movement of the run, as each would otherwise be sent as its own PDU. */
+    guac_rdp_input_event pending_move;
+    int has_pending_move = 0;
+
+    /* The button state in effect after all mouse events dequeued so far, which
+     * is modified only by this thread */
+    int mask = rdp_client->mouse_button_mask;
 
     guac_rdp_input_event input_event;
-    while (guac_fifo_timed_dequeue(&rdp_client->input_events, &input_event, 0)) {
-        switch (input_event.type) {
+    while (guac_fifo_lockfree_timed_dequeue(&rdp_client->input_events, &input_event, 0)) {
+
+        /* Defer mouse events that do not change the button state, replacing
+         * any deferred movement of the same user */
+        if (input_event.type == GUAC_RDP_INPUT_EVENT_MOUSE
+                && input_event.details.mouse.mask == mask) {
 
-            /* Mouse event */
-            case GUAC_RDP_INPUT_EVENT_MOUSE:
-                guac_rdp_handle_mouse_event(rdp_client, &input_event);
-                break;
+            if (has_pending_move && pending_move.user != input_event.user)
+                guac_rdp_handle_input_event(rdp_client, &pending_move);
 
-            /* Keyboard event */
-            case GUAC_RDP_INPUT_EVENT_KEY:
-                guac_rdp_handle_key_event(rdp_client, &input_event);
-                break;
+            pending_move = input_event;
+            has_pending_move = 1;
+            continue;
 
-            /* Touch event */
-            case GUAC_RDP_INPUT_EVENT_TOUCH:
-                guac_rdp_handle_touch_event(rdp_client, &input_event);
-                break;
+        }
 
+        /* All other events are handled in order, after any deferred
+         * movement that preceded them */
+        if (has_pending_move) {
+            guac_rdp_handle_input_event(rdp_client, &pending_move);
+            has_pending_move = 0;
         }
+
+        if (input_event.type == GUAC_RDP_INPUT_EVENT_MOUSE)
+            mask = input_event.details.mouse.mask;
+
+        guac_rdp_handle_input_event(rdp_client, &input_event);
+
     }
 
-    ResetEvent(rdp_client->input_event_queued);
-    guac_fifo_unlock(&rdp_client->input_events);
+    if (has_pending_move)
+        guac_rdp_handle_input_event(rdp_client, &pending_move);
 
 }
@@ -28,7 +28,9 @@
 #include <guacamole/mem.h>
 #include <guacamole/rwlock.h>
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 /**
  * Translates the given keysym into the corresponding lock flag, as would be
@@ -174,42 +176,31 @@ static void guac_rdp_send_synchronize_event(guac_rdp_client* rdp_client,
 }
 
 /**
- * Given a keyboard instance and X11 keysym, returns a pointer to the
- * keys_by_keysym entry that represents the key having that keysym within the
- * keyboard, regardless of whether the key is currently defined. If no such key
- * can exist (the keysym cannot be mapped or is out of range), NULL is
- * returned.
- *
- * @param keyboard
- *     The guac_rdp_keyboard associated with the current RDP session.
+ * Given an X11 keysym, returns the index of the entry within the two-level
+ * keysym lookup table of a guac_rdp_keyboard that represents the key having
+ * that keysym. If no such key can exist (the keysym cannot be mapped or is out
+ * of range), -1 is returned.
  *
  * @param keysym
- *     The keysym of the key to lookup within the given keyboard.
+ *     The keysym of the key to lookup.
  *
  * @return
- *     A pointer to the keys_by_keysym entry which represents or can represent
- *     the key having the given keysym, or NULL if no such keysym can be
- *     defined within a guac_rdp_keyboard structure.
+ *     The index of the lookup table entry which represents or can represent
+ *     the key having the given keysym, or -1 if no such keysym can be defined
+ *     within a guac_rdp_keyboard structure.
  */
-static guac_rdp_key** guac_rdp_keyboard_map_key(guac_rdp_keyboard* keyboard,
-        int keysym) {
-
-    int index;
+static int guac_rdp_keyboard_map_key(int keysym) {
 
     /* Map keysyms between 0x0000 and 0xFFFF directly */
     if (keysym >= 0x0000 && keysym <= 0xFFFF)
-        index = keysym;
+        return keysym;
 
     /* Map all Unicode keysyms from U+0000 to U+FFFF */
-    else if (keysym >= 0x1000000 && keysym <= 0x100FFFF)
-        index = 0x10000 + (keysym & 0xFFFF);
+    if (keysym >= 0x1000000 && keysym <= 0x100FFFF)
+        return 0x10000 + (keysym & 0xFFFF);
 
     /* All other keysyms are unmapped */
-    else
-        return NULL;
-
-    /* Corresponding key mapping (defined or not) has been located */
-    return &(keyboard->keys_by_keysym[index]);
+    return -1;
 
 }
 
@@ -299,12 +290,20 @@ static int guac_rdp_keyboard_get_cost(guac_rdp_keyboard* keyboard,
 static guac_rdp_key* guac_rdp_keyboard_get_key(guac_rdp_keyboard* keyboard,
         int keysym) {
 
+    int index = guac_rdp_keyboard_map_key(keysym);
+    if (index < 0)
+        return NULL;
+
     /* Verify that the key is actually defined */
-    guac_rdp_key** key_by_keysym = guac_rdp_keyboard_map_key(keyboard, keysym);
-    if (key_by_keysym == NULL)
+    int block = keyboard->key_blocks_by_keysym[index / GUAC_RDP_KEYBOARD_BLOCK_SIZE];
+    if (block == 0)
         return NULL;
 
-    return *key_by_keysym;
+    int key = keyboard->key_blocks[block - 1][index % GUAC_RDP_KEYBOARD_BLOCK_SIZE];
+    if (key == 0)
+        return NULL;
+
+    return &keyboard->keys[key - 1];
 
 }
 
@@ -371,15 +370,35 @@ static void guac_rdp_keyboard_add_mapping(guac_rdp_keyboard* keyboard,
 
     /* Locate corresponding keysym-to-key translation entry within keyboard
      * structure */
-    guac_rdp_key** key_by_keysym = guac_rdp_keyboard_map_key(keyboard, mapping->keysym);
-    if (key_by_keysym == NULL) {
+    int index = guac_rdp_keyboard_map_key(mapping->keysym);
+    if (index < 0) {
         guac_client_log(keyboard->client, GUAC_LOG_DEBUG, "Ignoring unmappable keysym 0x%X", mapping->keysym);
         return;
     }
 
+    /* Allocate the block of the lookup table covering this keysym if no
+     * other keysyms in the same range have yet been defined */
+    uint16_t* block_by_keysym =
+        &keyboard->key_blocks_by_keysym[index / GUAC_RDP_KEYBOARD_BLOCK_SIZE];
+
+    if (*block_by_keysym == 0) {
+
+        keyboard->key_blocks = guac_mem_realloc_or_die(keyboard->key_blocks,
+                keyboard->num_key_blocks + 1, sizeof(*keyboard->key_blocks));
+
+        memset(keyboard->key_blocks[keyboard->num_key_blocks], 0,
+                sizeof(*keyboard->key_blocks));
+
+        *block_by_keysym = ++keyboard->num_key_blocks;
+
+    }
+
+    uint16_t* key_by_keysym = &keyboard->key_blocks[*block_by_keysym - 1]
+        [index % GUAC_RDP_KEYBOARD_BLOCK_SIZE];
+
     /* If not yet pointing to a key, point keysym-to-key translation entry at
      * next available storage */
-    if (*key_by_keysym == NULL) {
+    if (*key_by_keysym == 0) {
 
         if (keyboard->num_keys == GUAC_RDP_KEYBOARD_MAX_KEYSYMS) {
             guac_client_log(keyboard->client, GUAC_LOG_DEBUG, "Key definition "
@@ -389,11 +408,11 @@ static void guac_rdp_keyboard_add_mapping(guac_rdp_keyboard* keyboard,
             return;
         }
 
-        *key_by_keysym = &keyboard->keys[keyboard->num_keys++];
+        *key_by_keysym = ++keyboard->num_keys;
 
     }
 
-    guac_rdp_key* key = *key_by_keysym;
+    guac_rdp_key* key = &keyboard->keys[*key_by_keysym - 1];
 
     /* Add new definition only if sufficient space remains */
     if (key->num_definitions == GUAC_RDP_KEY_MAX_DEFINITIONS) {
@@ -456,6 +475,7 @@ guac_rdp_keyboard* guac_rdp_keyboard_alloc(guac_client* client,
 }
 
 void guac_rdp_keyboard_free(guac_rdp_keyboard* keyboard) {
+    guac_mem_free(keyboard->key_blocks);
     guac_mem_free(keyboard);
 }
 
@@ -25,11 +25,26 @@
 #include <freerdp/freerdp.h>
 #include <guacamole/client.h>
 
+#include <stdint.h>
+
 /**
  * The maximum number of distinct keysyms that any particular keyboard may support.
  */
 #define GUAC_RDP_KEYBOARD_MAX_KEYSYMS 1024
 
+/**
+ * The number of keysyms covered by each block of the lookup table used to
+ * locate the guac_rdp_key associated with a particular keysym.
+ */
+#define GUAC_RDP_KEYBOARD_BLOCK_SIZE 256
+
+/**
+ * The total number of blocks required for the lookup table used to locate
+ * the guac_rdp_key associated with a particular keysym to cover all 0x20000
+ * mappable keysyms.
+ */
+#define GUAC_RDP_KEYBOARD_BLOCKS (0x20000 / GUAC_RDP_KEYBOARD_BLOCK_SIZE)
+
 /**
  * The maximum number of unique modifier variations that any particular keysym
  * may define. For example, on a US English keyboard, an uppercase "A" may be
@@ -133,18 +148,37 @@ typedef struct guac_rdp_keyboard {
     guac_rdp_key keys[GUAC_RDP_KEYBOARD_MAX_KEYSYMS];
 
     /**
-     * Lookup table into the overall keys array, locating the guac_rdp_key
-     * associated with any particular keysym. If a keysym has no corresponding
-     * guac_rdp_key within the keys array, its entry within this lookuptable
-     * will be NULL.
+     * The first level of the lookup table into the overall keys array,
+     * locating the guac_rdp_key associated with any particular keysym. Each
+     * entry corresponds to GUAC_RDP_KEYBOARD_BLOCK_SIZE consecutive keysym
+     * indices and contains one plus the index of the block within key_blocks
+     * that maps those keysyms, or 0 if no keysyms in that range are defined.
      *
      * The index of the key for a given keysym is determined based on a
      * simple transformation of the keysym itself. Keysyms between 0x0000 and
      * 0xFFFF inclusive are mapped to 0x00000 through 0x0FFFF, while keysyms
      * between 0x1000000 and 0x100FFFF inclusive (keysyms which are derived
      * from Unicode) are mapped to 0x10000 through 0x1FFFF.
+     *
+     * As keymaps cluster their keysyms within a small number of ranges, only
+     * a handful of blocks are typically needed, in contrast to a flat table
+     * large enough to cover every keysym.
+     */
+    uint16_t key_blocks_by_keysym[GUAC_RDP_KEYBOARD_BLOCKS];
+
+    /**
+     * The second level of the lookup table into the overall keys array. Each
+     * entry of each block contains one plus the index of the guac_rdp_key
+     * within the keys array that is associated with the corresponding keysym,
+     * or 0 if that keysym has no corresponding guac_rdp_key. Blocks are
+     * allocated only as needed while the keymap is loaded.
+     */
+    uint16_t (*key_blocks)[GUAC_RDP_KEYBOARD_BLOCK_SIZE];
+
+    /**
+     * The number of blocks within the key_blocks array.
      */
-    guac_rdp_key* keys_by_keysym[0x20000];
+    int num_key_blocks;
 
     /**
      * The total number of keys that the user of the connection is currently
@@ -29,42 +29,163 @@
 #include <guacamole/client.h>
 #include <guacamole/display.h>
 #include <guacamole/mem.h>
+#include <guacamole/rect.h>
 #include <winpr/crt.h>
 
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Returns a 64-bit FNV-1a hash of the given pointer image and its dimensions.
+ *
+ * @param buffer
+ *     The pointer image, in the native pixel format of guac_display.
+ *
+ * @param width
+ *     The width of the pointer image, in pixels.
+ *
+ * @param height
+ *     The height of the pointer image, in pixels.
+ *
+ * @return
+ *     A hash of the given pointer image.
+ */
+static uint64_t guac_rdp_pointer_hash(const unsigned char* buffer,
+        int width, int height) {
+
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    hash = (hash ^ (uint64_t) width) * 0x100000001B3ULL;
+    hash = (hash ^ (uint64_t) height) * 0x100000001B3ULL;
+
+    size_t length = guac_mem_ckd_mul_or_die(width, height,
+            GUAC_DISPLAY_LAYER_RAW_BPP);
+
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ buffer[i]) * 0x100000001B3ULL;
+
+    return hash;
+
+}
+
+/**
+ * Returns whether the given buffer contains exactly the given pointer image.
+ *
+ * @param layer
+ *     The buffer to compare against.
+ *
+ * @param buffer
+ *     The pointer image, in the native pixel format of guac_display.
+ *
+ * @param width
+ *     The width of the pointer image, in pixels.
+ *
+ * @param height
+ *     The height of the pointer image, in pixels.
+ *
+ * @return
+ *     Non-zero if the buffer contains exactly the given pointer image, zero
+ *     otherwise.
+ */
+static int guac_rdp_pointer_matches(guac_display_layer* layer,
+        const unsigned char* buffer, int width, int height) {
+
+    guac_display_layer_raw_context* context = guac_display_layer_open_raw(layer);
+
+    int matches = guac_rect_width(&context->bounds) >= width
+        && guac_rect_height(&context->bounds) >= height;
+
+    size_t stride = guac_mem_ckd_mul_or_die(width, GUAC_DISPLAY_LAYER_RAW_BPP);
+    const unsigned char* row = context->buffer;
+
+    for (int y = 0; matches && y < height; y++) {
+        matches = !memcmp(row, buffer, stride);
+        row += context->stride;
+        buffer += stride;
+    }
+
+    guac_display_layer_close_raw(layer, context);
+    return matches;
+
+}
+
 BOOL guac_rdp_pointer_new(rdpContext* context, rdpPointer* pointer) {
 
     guac_client* client = ((rdp_freerdp_context*) context)->client;
     guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+    guac_rdp_pointer* guac_pointer = (guac_rdp_pointer*) pointer;
+
+    int width = pointer->width;
+    int height = pointer->height;
+    size_t stride = guac_mem_ckd_mul_or_die(width, GUAC_DISPLAY_LAYER_RAW_BPP);
+    unsigned char* image = guac_mem_zalloc(stride, height);
+
+    /* Convert to alpha cursor using mask data */
+    freerdp_image_copy_from_pointer_data(image,
+        guac_rdp_get_native_pixel_format(TRUE), stride, 0, 0,
+        width, height, pointer->xorMaskData,
+        pointer->lengthXorMask, pointer->andMaskData,
+        pointer->lengthAndMask, pointer->xorBpp,
+        &context->gdi->palette);
+
+    uint64_t hash = guac_rdp_pointer_hash(image, width, height);
+
+    /* Reuse the buffer of any identical pointer, which has already been sent
+     * to connected users */
+    guac_rdp_pointer_cache_entry* unused = NULL;
+    for (int i = 0; i < GUAC_RDP_POINTER_CACHE_SIZE; i++) {
+
+        guac_rdp_pointer_cache_entry* entry = &(rdp_client->pointer_cache[i]);
+        if (entry->layer == NULL) {
+            if (unused == NULL)
+                unused = entry;
+            continue;
+        }
+
+        if (entry->hash == hash && entry->width == width
+                && entry->height == height
+                && guac_rdp_pointer_matches(entry->layer, image, width, height)) {
+            entry->refs++;
+            guac_pointer->layer = entry->layer;
+            guac_pointer->cache_entry = entry;
+            guac_mem_free(image);
+            return TRUE;
+        }
+
+    }
 
     /* Allocate buffer */
     guac_display_layer* buffer = guac_display_alloc_buffer(rdp_client->display, 0);
 
-    guac_display_layer_resize(buffer, pointer->width, pointer->height);
+    guac_display_layer_resize(buffer, width, height);
     guac_display_layer_raw_context* dst_context = guac_display_layer_open_raw(buffer);
 
     guac_rect dst_rect = {
         .left   = 0,
         .top    = 0,
-        .right  = pointer->width,
-        .bottom = pointer->height
+        .right  = width,
+        .bottom = height
     };
 
     guac_rect_constrain(&dst_rect, &dst_context->bounds);
-
-    /* Convert to alpha cursor using mask data */
-    freerdp_image_copy_from_pointer_data(GUAC_DISPLAY_LAYER_RAW_BUFFER(dst_context, dst_rect),
-        guac_rdp_get_native_pixel_format(TRUE), dst_context->stride, 0, 0,
-        pointer->width, pointer->height, pointer->xorMaskData,
-        pointer->lengthXorMask, pointer->andMaskData,
-        pointer->lengthAndMask, pointer->xorBpp,
-        &context->gdi->palette);
-
-    guac_rect_extend(&dst_context->dirty, &dst_rect);
+    guac_display_layer_raw_context_put(dst_context, &dst_rect, image, stride);
 
     guac_display_layer_close_raw(buffer, dst_context);
-
-    /* Remember buffer */
-    ((guac_rdp_pointer*) pointer)->layer = buffer;
+    guac_mem_free(image);
+
+    /* Remember buffer, sharing it with future identical pointers if the
+     * cache has room */
+    guac_pointer->layer = buffer;
+    guac_pointer->cache_entry = unused;
+
+    if (unused != NULL) {
+        *unused = (guac_rdp_pointer_cache_entry) {
+            .hash = hash,
+            .width = width,
+            .height = height,
+            .layer = buffer,
+            .refs = 1
+        };
+    }
 
     return TRUE;
 
@@ -75,33 +196,11 @@ BOOL guac_rdp_pointer_set(rdpContext* context, POINTER_SET_CONST rdpPointer* poi
     guac_client* client = ((rdp_freerdp_context*) context)->client;
     guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
 
-    guac_display_layer* src_layer = ((guac_rdp_pointer*) pointer)->layer;
-    guac_display_layer_raw_context* src_context = guac_display_layer_open_raw(src_layer);
-
-    guac_display_layer* cursor_layer = guac_display_cursor(rdp_client->display);
-
-    guac_display_layer_resize(cursor_layer, pointer->width, pointer->height);
-    guac_display_layer_raw_context* dst_context = guac_display_layer_open_raw(cursor_layer);
-
-    guac_rect ptr_rect = {
-        .left   = 0,
-        .top    = 0,
-        .right  = pointer->width,
-        .bottom = pointer->height
-    };
-
-    guac_rect_constrain(&ptr_rect, &src_context->bounds);
-    guac_rect_constrain(&ptr_rect, &dst_context->bounds);
-
-    /* Set cursor */
-    guac_display_layer_raw_context_put(dst_context, &ptr_rect, src_context->buffer, src_context->stride);
-    dst_context->hint_from = src_layer;
-    guac_rect_extend(&dst_context->dirty, &ptr_rect);
-
-    guac_display_set_cursor_hotspot(rdp_client->display, pointer->xPos, pointer->yPos);
-
-    guac_display_layer_close_raw(cursor_layer, dst_context);
-    guac_display_layer_close_raw(src_layer, src_context);
+    /* Set cursor to the buffer already containing the pointer image, such
+     * that only a "cursor" instruction need be sent */
+    guac_display_set_cursor_buffer(rdp_client->display,
+            ((guac_rdp_pointer*) pointer)->layer,
+            pointer->xPos, pointer->yPos);
 
     guac_display_render_thread_notify_modified(rdp_client->render_thread);
     return TRUE;
@@ -110,10 +209,17 @@ BOOL guac_rdp_pointer_set(rdpContext* context, POINTER_SET_CONST rdpPointer* poi
 
 void guac_rdp_pointer_free(rdpContext* context, rdpPointer* pointer) {
 
-    guac_display_layer* buffer = ((guac_rdp_pointer*) pointer)->layer;
+    guac_rdp_pointer* guac_pointer = (guac_rdp_pointer*) pointer;
+    guac_rdp_pointer_cache_entry* entry = guac_pointer->cache_entry;
+
+    /* Free buffer only once no other pointers share it */
+    if (entry == NULL)
+        guac_display_free_layer(guac_pointer->layer);
 
-    /* Free buffer */
-    guac_display_free_layer(buffer);
+    else if (--entry->refs == 0) {
+        guac_display_free_layer(entry->layer);
+        entry->layer = NULL;
+    }
 
     /* NOTE: FreeRDP-allocated memory for the rdpPointer will be automatically
      * released after this free handler is invoked */
@@ -25,12 +25,55 @@
 #include <guacamole/display.h>
 #include <winpr/wtypes.h>
 
+#include <stdint.h>
+
 #ifdef RDP_POINTER_SET_REQUIRES_CONST
 #define POINTER_SET_CONST const
 #else
 #define POINTER_SET_CONST
 #endif
 
+/**
+ * The maximum number of distinct pointer images that may be shared between
+ * pointers through the pointer cache of an RDP session.
+ */
+#define GUAC_RDP_POINTER_CACHE_SIZE 32
+
+/**
+ * A distinct pointer image, stored within a buffer that has been sent to all
+ * connected users and that may be shared by any number of pointers. Setting
+ * any such pointer as the current cursor need only reference this buffer.
+ */
+typedef struct guac_rdp_pointer_cache_entry {
+
+    /**
+     * A hash of the image data of the pointer, as well as its dimensions.
+     */
+    uint64_t hash;
+
+    /**
+     * The width of the pointer image, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the pointer image, in pixels.
+     */
+    int height;
+
+    /**
+     * The buffer containing the pointer image, or NULL if this entry is
+     * unused.
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The number of pointers currently sharing this entry.
+     */
+    int refs;
+
+} guac_rdp_pointer_cache_entry;
+
 /**
  * Guacamole-specific rdpPointer data.
  */
@@ -46,11 +89,21 @@ typedef struct guac_rdp_pointer {
      */
     guac_display_layer* layer;
 
+    /**
+     * The entry within the pointer cache of the RDP session that owns the
+     * layer of this pointer, or NULL if the cache was full and the layer is
+     * owned by this pointer alone.
+     */
+    guac_rdp_pointer_cache_entry* cache_entry;
+
 } guac_rdp_pointer;
 
 /**
  * Caches a new pointer, which can later be set via guac_rdp_pointer_set() as
- * the current mouse pointer.
+ * the current mouse pointer. If the image of the pointer is identical to that
+ * of a pointer already within the pointer cache of the RDP session, the
+ * buffer of that pointer is shared rather than allocating and sending a new
+ * buffer.
  *
  * @param context
  *     The rdpContext associated with the current RDP session.
@@ -65,7 +118,9 @@ BOOL guac_rdp_pointer_new(rdpContext* context, rdpPointer* pointer);
 
 /**
  * Sets the given cached pointer as the current pointer. The given pointer must
- * have already been initialized through a call to guac_rdp_pointer_new().
+ * have already been initialized through a call to guac_rdp_pointer_new(). The
+ * image of the pointer is not sent again; the cursor is instead set directly
+ * to the buffer containing the image.
  *
  * @param context
  *     The rdpContext associated with the current RDP session.
@@ -25,9 +25,12 @@
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
 #include <guacamole/stream.h>
+#include <guacamole/timestamp.h>
 #include <guacamole/user.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -55,8 +58,8 @@ char* const guac_rdp_pdf_filter_command[] = {
 };
 
 /**
- * Updates the state of the given print job. Any threads currently blocked by a
- * call to guac_rdp_print_job_wait_for_ack() will be unblocked.
+ * Updates the state of the given print job. Any threads currently waiting on
+ * the state_modified conditional of the print job will be unblocked.
  *
  * @param job
  *     The print job whose state should be updated.
@@ -71,44 +74,12 @@ static void guac_rdp_print_job_set_state(guac_rdp_print_job* job,
 
     /* Update stream state, signalling modification */
     job->state = state;
-    pthread_cond_signal(&(job->state_modified));
+    pthread_cond_broadcast(&(job->state_modified));
 
     pthread_mutex_unlock(&(job->state_lock));
 
 }
 
-/**
- * Suspends execution of the current thread until the state of the given print
- * job is not GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK. If the state of the print
- * job is GUAC_RDP_PRINT_JOB_ACK_RECEIVED, the state is automatically reset
- * back to GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK prior to returning.
- *
- * @param job
- *     The print job to wait for.
- *
- * @return
- *     Zero if the state of the print job is GUAC_RDP_PRINT_JOB_CLOSED,
- *     non-zero if the state was GUAC_RDP_PRINT_JOB_ACK_RECEIVED and has been
- *     automatically reset to GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK.
- */
-static int guac_rdp_print_job_wait_for_ack(guac_rdp_print_job* job) {
-
-    /* Wait for ack if stream open and not yet received */
-    pthread_mutex_lock(&(job->state_lock));
-    if (job->state == GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK)
-        pthread_cond_wait(&job->state_modified, &job->state_lock);
-
-    /* Reset state if ack received */
-    int got_ack = (job->state == GUAC_RDP_PRINT_JOB_ACK_RECEIVED);
-    if (got_ack)
-        job->state = GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK;
-
-    /* Return whether ack was successfully received */
-    pthread_mutex_unlock(&(job->state_lock));
-    return got_ack;
-
-}
-
 /**
  * Sends a "file" instruction to the given user describing the PDF file that
  * will be sent using the output of the given print job. If the given user no
@@ -175,8 +146,8 @@ static void* guac_rdp_print_job_send_blob(guac_user* user, void* data) {
         return NULL;
     }
 
-    /* Send single blob of print data */
-    guac_protocol_send_blob(user->socket, job->stream,
+    /* Send single blob of print data, counting it against the window */
+    guac_stream_send_blob(user->socket, job->stream,
             blob->buffer, blob->length);
 
     guac_socket_flush(user->socket);
@@ -252,9 +223,19 @@ static int guac_rdp_print_filter_ack_handler(guac_user* user,
 
     guac_rdp_print_job* job = (guac_rdp_print_job*) stream->data;
 
-    /* Update state for successful acks */
-    if (status == GUAC_PROTOCOL_STATUS_SUCCESS)
-        guac_rdp_print_job_set_state(job, GUAC_RDP_PRINT_JOB_ACK_RECEIVED);
+    /* Successful acks either confirm the stream is ready or free space
+     * within its window, either of which may allow more data to be sent */
+    if (status == GUAC_PROTOCOL_STATUS_SUCCESS) {
+
+        pthread_mutex_lock(&(job->state_lock));
+
+        if (job->state == GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK)
+            job->state = GUAC_RDP_PRINT_JOB_ACK_RECEIVED;
+
+        pthread_cond_broadcast(&(job->state_modified));
+        pthread_mutex_unlock(&(job->state_lock));
+
+    }
 
     /* Terminate stream if ack signals an error */
     else {
@@ -320,6 +301,16 @@ static pid_t guac_rdp_create_filter_process(guac_client* client,
         return -1;
     }
 
+    /* Do not leak either pipe into any other child process (such as the filter
+     * process of a later print job), as that process would then hold the
+     * input of this filter open indefinitely. The ends reassigned as
+     * STDIN/STDOUT of the child below are unaffected, as dup2() does not
+     * preserve this flag. */
+    fcntl(stdin_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(stdin_pipe[1], F_SETFD, FD_CLOEXEC);
+    fcntl(stdout_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(stdout_pipe[1], F_SETFD, FD_CLOEXEC);
+
     /* Store parent side of stdin/stdout */
     *input_fd = stdin_pipe[1];
     *output_fd = stdout_pipe[0];
@@ -376,11 +367,66 @@ static pid_t guac_rdp_create_filter_process(guac_client* client,
 
 }
 
+guac_rdp_print_filter* guac_rdp_print_filter_alloc(guac_client* client) {
+
+    guac_rdp_print_filter* filter = guac_mem_alloc(sizeof(guac_rdp_print_filter));
+
+    filter->pid = guac_rdp_create_filter_process(client,
+            &filter->input_fd, &filter->output_fd);
+
+    if (filter->pid == -1) {
+        guac_mem_free(filter);
+        return NULL;
+    }
+
+    return filter;
+
+}
+
+void guac_rdp_print_filter_free(guac_rdp_print_filter* filter) {
+
+    if (filter == NULL)
+        return;
+
+    kill(filter->pid, SIGKILL);
+    close(filter->input_fd);
+    close(filter->output_fd);
+
+    guac_mem_free(filter);
+
+}
+
+/**
+ * Returns whether the given print filter process is still waiting for input.
+ * A filter process that has not yet received any input produces no output,
+ * thus any pending output (including end-of-file, as would result from the
+ * process terminating) indicates that the process can no longer be used.
+ *
+ * @param filter
+ *     The print filter process to test.
+ *
+ * @return
+ *     Non-zero if the print filter process is still waiting for input, zero
+ *     otherwise.
+ */
+static int guac_rdp_print_filter_is_ready(guac_rdp_print_filter* filter) {
+
+    struct pollfd output = {
+        .fd = filter->output_fd,
+        .events = POLLIN
+    };
+
+    return poll(&output, 1, 0) == 0;
+
+}
+
 /**
  * Thread which continuously reads from the output file descriptor associated
- * with the given print job, writing filtered PDF output to the associated
- * Guacamole stream, and terminating only after the print job has completed
- * processing or the associated Guacamole stream has closed.
+ * with the given print job, storing filtered PDF output within the output
+ * buffer of the print job until the filter process terminates, the print job
+ * is killed, or an error occurs. Reading blocks only while the output buffer
+ * is full, allowing the filter process to run in parallel with the
+ * transmission of its output.
  *
  * @param data
  *     A pointer to the guac_rdp_print_job representing the print job that
@@ -389,56 +435,157 @@ static pid_t guac_rdp_create_filter_process(guac_client* client,
  * @return
  *     Always NULL.
  */
-static void* guac_rdp_print_job_output_thread(void* data) {
+static void* guac_rdp_print_job_filter_thread(void* data) {
 
-    int length;
-    char buffer[6048];
+    int length = 0;
 
     guac_rdp_print_job* job = (guac_rdp_print_job*) data;
     guac_client_log(job->client, GUAC_LOG_DEBUG, "Reading output from filter "
             "process...");
 
-    /* Read continuously while data remains */
-    while ((length = read(job->output_fd, buffer, sizeof(buffer))) > 0) {
+    pthread_mutex_lock(&(job->state_lock));
 
-        /* Wait for client to be ready for blob */
-        if (guac_rdp_print_job_wait_for_ack(job)) {
+    for (;;) {
 
-            guac_rdp_print_blob blob = {
-                .job    = job,
-                .buffer = buffer,
-                .length = length
-            };
+        /* Wait for space within buffer */
+        while (job->state != GUAC_RDP_PRINT_JOB_CLOSED
+                && job->buffer_length == GUAC_RDP_PRINT_JOB_BUFFER_SIZE)
+            pthread_cond_wait(&(job->state_modified), &(job->state_lock));
 
-            /* Write a single blob of output */
-            guac_client_for_user(job->client, job->user,
-                    guac_rdp_print_job_send_blob, &blob);
+        if (job->state == GUAC_RDP_PRINT_JOB_CLOSED)
+            break;
 
-        }
+        /* Read into the contiguous free space following the buffered data.
+         * That space is not touched by the output thread, so the lock need
+         * not be held while reading. */
+        int end = (job->buffer_start + job->buffer_length)
+            % GUAC_RDP_PRINT_JOB_BUFFER_SIZE;
+
+        int available = GUAC_RDP_PRINT_JOB_BUFFER_SIZE - job->buffer_length;
+        if (available > GUAC_RDP_PRINT_JOB_BUFFER_SIZE - end)
+            available = GUAC_RDP_PRINT_JOB_BUFFER_SIZE - end;
+
+        pthread_mutex_unlock(&(job->state_lock));
+        length = read(job->output_fd, job->buffer + end, available);
+        pthread_mutex_lock(&(job->state_lock));
+
+        if (length <= 0)
+            break;
+
+        /* Notify output thread of new data */
+        job->buffer_length += length;
+        pthread_cond_broadcast(&(job->state_modified));
+
+    }
+
+    /* Warn of read errors */
+    if (length < 0 && job->state != GUAC_RDP_PRINT_JOB_CLOSED)
+        guac_client_log(job->client, GUAC_LOG_ERROR,
+                "Error reading from filter: %s", strerror(errno));
+
+    /* No further output will be added to the buffer */
+    job->filter_done = 1;
+    pthread_cond_broadcast(&(job->state_modified));
+
+    pthread_mutex_unlock(&(job->state_lock));
+    return NULL;
+
+}
+
+/**
+ * Thread which continuously sends the contents of the output buffer of the
+ * given print job along the associated Guacamole stream, terminating only
+ * after the print job has completed processing and all output has been sent,
+ * or the associated Guacamole stream has closed. Blobs are sent for as long
+ * as the window of the stream allows, rather than waiting for an ack after
+ * each blob.
+ *
+ * @param data
+ *     A pointer to the guac_rdp_print_job representing the print job whose
+ *     output should be sent.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_rdp_print_job_output_thread(void* data) {
+
+    char buffer[GUAC_PROTOCOL_BLOB_MAX_LENGTH];
+
+    guac_rdp_print_job* job = (guac_rdp_print_job*) data;
+
+    pthread_mutex_lock(&(job->state_lock));
+
+    for (;;) {
+
+        /* Wait until a blob can be sent or nothing more can be sent */
+        while (job->state != GUAC_RDP_PRINT_JOB_CLOSED
+                && (job->state == GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK
+                    || !guac_stream_can_send(job->stream)
+                    || job->buffer_length == 0)
+                && !(job->buffer_length == 0 && job->filter_done))
+            pthread_cond_wait(&(job->state_modified), &(job->state_lock));
 
         /* Abort if stream is closed */
-        else {
+        if (job->state == GUAC_RDP_PRINT_JOB_CLOSED) {
             guac_client_log(job->client, GUAC_LOG_DEBUG, "Print stream "
                     "explicitly aborted.");
             break;
         }
 
+        /* Done once all filter output has been sent */
+        if (job->buffer_length == 0)
+            break;
+
+        /* Pull the next blob from the buffer, which may wrap around */
+        int length = job->buffer_length;
+        if (length > (int) sizeof(buffer))
+            length = (int) sizeof(buffer);
+
+        int first = GUAC_RDP_PRINT_JOB_BUFFER_SIZE - job->buffer_start;
+        if (first > length)
+            first = length;
+
+        memcpy(buffer, job->buffer + job->buffer_start, first);
+        memcpy(buffer + first, job->buffer, length - first);
+
+        job->buffer_start = (job->buffer_start + length)
+            % GUAC_RDP_PRINT_JOB_BUFFER_SIZE;
+        job->buffer_length -= length;
+
+        /* Notify filter thread of freed space */
+        pthread_cond_broadcast(&(job->state_modified));
+        pthread_mutex_unlock(&(job->state_lock));
+
+        guac_rdp_print_blob blob = {
+            .job    = job,
+            .buffer = buffer,
+            .length = length
+        };
+
+        /* Write a single blob of output */
+        guac_client_for_user(job->client, job->user,
+                guac_rdp_print_job_send_blob, &blob);
+
+        pthread_mutex_lock(&(job->state_lock));
+
     }
 
-    /* Warn of read errors */
-    if (length < 0)
-        guac_client_log(job->client, GUAC_LOG_ERROR,
-                "Error reading from filter: %s", strerror(errno));
+    pthread_mutex_unlock(&(job->state_lock));
 
     /* Terminate stream */
     guac_client_for_user(job->client, job->user,
             guac_rdp_print_job_end_stream, job);
 
+    /* Wait for filter output to be fully read (or abandoned) before closing
+     * the file descriptors it reads from */
+    pthread_join(job->filter_thread, NULL);
+
     /* Ensure all associated file descriptors are closed */
     close(job->input_fd);
     close(job->output_fd);
 
-    guac_client_log(job->client, GUAC_LOG_DEBUG, "Print job completed.");
+    guac_client_log(job->client, GUAC_LOG_DEBUG, "Print job completed "
+            "after %i ms.", (int) (guac_timestamp_current() - job->created));
     return NULL;
 
 }
@@ -470,28 +617,65 @@ void* guac_rdp_print_job_alloc(guac_user* user, void* data) {
 
     /* Prepare stream for receipt of acks */
     stream->ack_handler = guac_rdp_print_filter_ack_handler;
+    stream->window = GUAC_RDP_PRINT_JOB_WINDOW;
     stream->data = job;
 
-    /* Create print filter process */
-    job->filter_pid = guac_rdp_create_filter_process(job->client,
-            &job->input_fd, &job->output_fd);
+    job->created = guac_timestamp_current();
+
+    /* Use the print filter process started in advance for this job, if that
+     * process is still usable */
+    guac_rdp_client* rdp_client = (guac_rdp_client*) job->client->data;
+    guac_rdp_print_filter* filter = rdp_client->print_filter;
+    rdp_client->print_filter = NULL;
+
+    if (filter != NULL && !guac_rdp_print_filter_is_ready(filter)) {
+        guac_client_log(job->client, GUAC_LOG_DEBUG, "Pre-started PDF filter "
+                "process PID=%i is no longer usable.", filter->pid);
+        guac_rdp_print_filter_free(filter);
+        filter = NULL;
+    }
+
+    /* Otherwise, start a new filter process now */
+    if (filter == NULL)
+        filter = guac_rdp_print_filter_alloc(job->client);
+
+    else
+        guac_client_log(job->client, GUAC_LOG_DEBUG, "Using pre-started PDF "
+                "filter process PID=%i.", filter->pid);
 
     /* Abort if print filter process cannot be created */
-    if (job->filter_pid == -1) {
+    if (filter == NULL) {
         guac_user_free_stream(user, stream);
         guac_mem_free(job);
         return NULL;
     }
 
+    job->filter_pid = filter->pid;
+    job->input_fd = filter->input_fd;
+    job->output_fd = filter->output_fd;
+    guac_mem_free(filter);
+
     /* Init stream state signal and lock */
     job->state = GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK;
     pthread_cond_init(&job->state_modified, NULL);
     pthread_mutex_init(&job->state_lock, NULL);
 
-    /* Start output thread */
+    /* Init buffer of filtered output awaiting transmission */
+    job->buffer = guac_mem_alloc(GUAC_RDP_PRINT_JOB_BUFFER_SIZE);
+    job->buffer_start = 0;
+    job->buffer_length = 0;
+    job->filter_done = 0;
+
+    /* Start filter and output threads */
+    pthread_create(&job->filter_thread, NULL,
+            guac_rdp_print_job_filter_thread, job);
     pthread_create(&job->output_thread, NULL,
             guac_rdp_print_job_output_thread, job);
 
+    /* Start the filter process for the next print job in advance, such that
+     * subsequent jobs need not wait for the filter to start */
+    rdp_client->print_filter = guac_rdp_print_filter_alloc(job->client);
+
     /* Print job allocated successfully */
     return job;
 
@@ -658,8 +842,10 @@ void guac_rdp_print_job_free(guac_rdp_print_job* job) {
 
     /* Destroy lock */
     pthread_mutex_destroy(&(job->state_lock));
+    pthread_cond_destroy(&(job->state_modified));
 
     /* Free base structure */
+    guac_mem_free(job->buffer);
     guac_mem_free(job);
 
 }
@@ -22,6 +22,7 @@
 
 #include <guacamole/client.h>
 #include <guacamole/stream.h>
+#include <guacamole/timestamp.h>
 #include <guacamole/user.h>
 
 #include <pthread.h>
@@ -45,6 +46,22 @@
  */
 #define GUAC_RDP_PRINT_JOB_TITLE_SEARCH_LENGTH 2048
 
+/**
+ * The maximum number of bytes of filtered PDF output which may be buffered
+ * while awaiting transmission to the Guacamole user. The print filter process
+ * continues to run while this buffer has space, regardless of how quickly
+ * the user acknowledges received data.
+ */
+#define GUAC_RDP_PRINT_JOB_BUFFER_SIZE 262144
+
+/**
+ * The number of blobs of filtered PDF output which may be sent to the
+ * Guacamole user before an acknowledgement is required. This overrides the
+ * default window of the print stream, as print jobs may be many megabytes in
+ * size and are otherwise bound by the round trip time of each ack.
+ */
+#define GUAC_RDP_PRINT_JOB_WINDOW 64
+
 /**
  * The current state of an RDP print job.
  */
@@ -59,8 +76,7 @@ typedef enum guac_rdp_print_job_state {
     /**
      * The print stream has been opened with the Guacamole client, and the
      * client has responded with an "ack", confirming that it is ready to
-     * receive data (or that data has been received and it is ready to receive
-     * more).
+     * receive data. Further data is sent as the window of the stream allows.
      */
     GUAC_RDP_PRINT_JOB_ACK_RECEIVED,
 
@@ -72,6 +88,31 @@ typedef enum guac_rdp_print_job_state {
 
 } guac_rdp_print_job_state;
 
+/**
+ * A running print filter process which converts PostScript data written to
+ * its input into PDF data read from its output.
+ */
+typedef struct guac_rdp_print_filter {
+
+    /**
+     * The PID of the print filter process.
+     */
+    pid_t pid;
+
+    /**
+     * File descriptor that should be written to when sending PostScript data
+     * to the print filter process.
+     */
+    int input_fd;
+
+    /**
+     * File descriptor that should be read from when receiving PDF output from
+     * the print filter process.
+     */
+    int output_fd;
+
+} guac_rdp_print_filter;
+
 /**
  * Data specific to an instance of the printer device.
  */
@@ -125,19 +166,52 @@ typedef struct guac_rdp_print_job {
     guac_rdp_print_job_state state;
 
     /**
-     * Lock which is acquired prior to modifying the state property or waiting
-     * on the state_modified conditional.
+     * Lock which is acquired prior to modifying the state property or the
+     * contents of the output buffer, or waiting on the state_modified
+     * conditional.
      */
     pthread_mutex_t state_lock;
 
     /**
      * Conditional which signals modification to the state property of this
-     * structure.
+     * structure, modification of the output buffer, or receipt of an ack.
      */
     pthread_cond_t state_modified;
 
     /**
-     * Thread which transfers data from the printer to the Guacamole client.
+     * Circular buffer of GUAC_RDP_PRINT_JOB_BUFFER_SIZE bytes containing
+     * filtered PDF output which has been read from the print filter process
+     * but not yet sent to the Guacamole user.
+     */
+    char* buffer;
+
+    /**
+     * The offset of the first unsent byte within the output buffer.
+     */
+    int buffer_start;
+
+    /**
+     * The number of unsent bytes within the output buffer, beginning at
+     * buffer_start and wrapping around to the beginning of the buffer as
+     * necessary.
+     */
+    int buffer_length;
+
+    /**
+     * Non-zero if all output of the print filter process has been read into
+     * the output buffer, zero otherwise.
+     */
+    int filter_done;
+
+    /**
+     * Thread which reads filtered PDF output from the print filter process
+     * into the output buffer.
+     */
+    pthread_t filter_thread;
+
+    /**
+     * Thread which transfers data from the output buffer to the Guacamole
+     * client.
      */
     pthread_t output_thread;
 
@@ -146,6 +220,11 @@ typedef struct guac_rdp_print_job {
      */
     int bytes_received;
 
+    /**
+     * The time that this print job was created, in milliseconds.
+     */
+    guac_timestamp created;
+
 } guac_rdp_print_job;
 
 /**
@@ -170,6 +249,31 @@ typedef struct guac_rdp_print_blob {
 
 } guac_rdp_print_blob;
 
+/**
+ * Starts a new print filter process, such that it is ready to process a
+ * future print job without that job needing to wait for the filter process
+ * to start. Starting the filter process (Ghostscript) can take a significant
+ * amount of time, which would otherwise be incurred by every print job.
+ *
+ * @param client
+ *     The guac_client associated with the print filter process.
+ *
+ * @return
+ *     A newly-allocated guac_rdp_print_filter representing the running print
+ *     filter process, or NULL if the filter process could not be created.
+ */
+guac_rdp_print_filter* guac_rdp_print_filter_alloc(guac_client* client);
+
+/**
+ * Forcibly terminates the given print filter process, if still running, and
+ * frees the given guac_rdp_print_filter. If the given filter is NULL, this
+ * function has no effect.
+ *
+ * @param filter
+ *     The print filter to terminate and free.
+ */
+void guac_rdp_print_filter_free(guac_rdp_print_filter* filter);
+
 /**
  * Allocates a new print job for the given user. It is expected that this
  * function will be invoked via a call to guac_client_for_user() or
@@ -74,7 +74,11 @@
 #include <winpr/synch.h>
 #include <winpr/wtypes.h>
 
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 /**
@@ -100,6 +104,8 @@ static BOOL rdp_freerdp_load_channels(freerdp* instance) {
     guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
     guac_rdp_settings* settings = rdp_client->settings;
 
+    guac_timestamp load_start = guac_timestamp_current();
+
     /* Load "disp" plugin for display update */
     if (settings->resize_method == GUAC_RESIZE_DISPLAY_UPDATE)
         guac_rdp_disp_load_plugin(context);
@@ -148,6 +154,11 @@ static BOOL rdp_freerdp_load_channels(freerdp* instance) {
                 "input support will be disabled.");
     }
 
+    /* Note time spent setting up channels */
+    guac_rdp_connect_timing* timing = &(rdp_client->connect_timing);
+    timing->handshake_start = guac_timestamp_current();
+    timing->load_channels += timing->handshake_start - load_start;
+
     return TRUE;
 }
 
@@ -176,6 +187,10 @@ static BOOL rdp_freerdp_pre_connect(freerdp* instance) {
     guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
     guac_rdp_settings* settings = rdp_client->settings;
 
+    guac_rdp_connect_timing* timing = &(rdp_client->connect_timing);
+    guac_timestamp pre_connect_start = guac_timestamp_current();
+    guac_timestamp nested_load_channels = timing->load_channels;
+
     /* Push desired settings to FreeRDP */
     guac_rdp_push_settings(client, settings, instance);
 
@@ -232,6 +247,11 @@ static BOOL rdp_freerdp_pre_connect(freerdp* instance) {
         rdp_freerdp_load_channels(instance);
     #endif
 
+    /* Note time spent preparing, excluding any channels loaded above */
+    timing->handshake_start = guac_timestamp_current();
+    timing->pre_connect += timing->handshake_start - pre_connect_start
+        - (timing->load_channels - nested_load_channels);
+
     return TRUE;
 }
 
@@ -272,6 +292,8 @@ static BOOL rdp_freerdp_authenticate(freerdp* instance, char** username,
     guac_rdp_settings* settings = rdp_client->settings;
     char* params[4] = {NULL};
     int i = 0;
+
+    guac_timestamp authenticate_start = guac_timestamp_current();
     
     /* If the client does not support the "required" instruction, warn and
      * quit.
@@ -323,6 +345,10 @@ static BOOL rdp_freerdp_authenticate(freerdp* instance, char** username,
         *domain = guac_strdup(settings->domain);
         
     }
+
+    /* Exclude time spent waiting for credentials from the handshake */
+    rdp_client->connect_timing.authenticate +=
+        guac_timestamp_current() - authenticate_start;
     
     /* Always return TRUE allowing connection to retry. */
     return TRUE;
@@ -413,6 +439,10 @@ static DWORD rdp_freerdp_verify_certificate(freerdp* instance,
     guac_rdp_client* rdp_client =
         (guac_rdp_client*) client->data;
 
+    /* The TLS handshake has reached the point of verifying the server */
+    if (rdp_client->connect_timing.certificate == 0)
+        rdp_client->connect_timing.certificate = guac_timestamp_current();
+
     /* Bypass validation if ignore_certificate given */
     if (rdp_client->settings->ignore_certificate) {
         guac_client_log(client, GUAC_LOG_INFO, "Certificate validation bypassed");
@@ -499,6 +529,102 @@ static int guac_rdp_handle_events(guac_rdp_client* rdp_client) {
 
 }
 
+/**
+ * Records the given phase of connection establishment via
+ * guac_client_record_connect_phase(), appending its duration to the given
+ * human-readable summary of all phases. Phases with negative durations, which
+ * are the result of steps that were never reached, are ignored.
+ *
+ * @param client
+ *     The guac_client associated with the RDP session.
+ *
+ * @param summary
+ *     The buffer containing the human-readable summary.
+ *
+ * @param length
+ *     The size of the summary buffer, in bytes.
+ *
+ * @param name
+ *     The name of the phase.
+ *
+ * @param duration
+ *     The time spent within the phase, in milliseconds.
+ */
+static void guac_rdp_record_connect_phase(guac_client* client, char* summary,
+        size_t length, const char* name, guac_timestamp duration) {
+
+    if (duration < 0)
+        return;
+
+    guac_client_record_connect_phase(client, name, duration);
+
+    size_t used = strlen(summary);
+    snprintf(summary + used, length - used, "%s%s=%" PRId64 "ms",
+            used ? ", " : "", name, (int64_t) duration);
+
+}
+
+/**
+ * Reports the time taken by each phase of the most recent attempt to
+ * establish the RDP connection, both within the logs and through
+ * guac_client_record_connect_phase(), if the first frame of that connection
+ * has been sent and the timing has not already been reported.
+ *
+ * @param client
+ *     The guac_client associated with the RDP session.
+ */
+static void guac_rdp_report_connect_timing(guac_client* client) {
+
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+    guac_rdp_connect_timing* timing = &(rdp_client->connect_timing);
+
+    if (timing->reported)
+        return;
+
+    /* Wait for the first frame */
+    guac_display_stats stats;
+    guac_display_get_stats(rdp_client->display, &stats);
+    if (stats.frames == 0)
+        return;
+
+    guac_timestamp now = guac_timestamp_current();
+    timing->reported = 1;
+
+    /* DNS resolution, the TCP connection, and the TLS handshake can be
+     * distinguished from the remainder of the handshake (NLA, licensing, and
+     * capability exchange) only if the server certificate was verified */
+    guac_timestamp transport = -1;
+    guac_timestamp negotiation = timing->connected - timing->handshake_start
+        - timing->authenticate;
+
+    if (timing->certificate != 0) {
+        transport = timing->certificate - timing->handshake_start;
+        negotiation -= transport;
+    }
+
+    char summary[512] = "";
+    guac_rdp_record_connect_phase(client, summary, sizeof(summary), "setup",
+            timing->connect_start - timing->start);
+    guac_rdp_record_connect_phase(client, summary, sizeof(summary),
+            "pre_connect", timing->pre_connect);
+    guac_rdp_record_connect_phase(client, summary, sizeof(summary),
+            "channels", timing->load_channels);
+    guac_rdp_record_connect_phase(client, summary, sizeof(summary),
+            "transport", transport);
+    guac_rdp_record_connect_phase(client, summary, sizeof(summary),
+            "authenticate", timing->authenticate);
+    guac_rdp_record_connect_phase(client, summary, sizeof(summary),
+            "negotiation", negotiation);
+    guac_rdp_record_connect_phase(client, summary, sizeof(summary),
+            "first_frame", now - timing->connected);
+    guac_rdp_record_connect_phase(client, summary, sizeof(summary),
+            "total", now - timing->start);
+
+    guac_client_log(client, GUAC_LOG_INFO, "RDP connection established in "
+            "%" PRId64 "ms (%s)", (int64_t) (now - timing->start), summary);
+
+}
+
 /**
  * Connects to an RDP server as described by the guac_rdp_settings structure
  * associated with the given client, allocating and freeing all objects
@@ -523,6 +649,11 @@ static int guac_rdp_handle_connection(guac_client* client) {
     guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
     guac_rdp_settings* settings = rdp_client->settings;
 
+    /* Time each phase of this connection attempt from scratch */
+    guac_rdp_connect_timing* timing = &(rdp_client->connect_timing);
+    memset(timing, 0, sizeof(guac_rdp_connect_timing));
+    timing->start = guac_timestamp_current();
+
     /* Init random number generator */
     srandom(time(NULL));
 
@@ -531,6 +662,10 @@ static int guac_rdp_handle_connection(guac_client* client) {
     /* Create display */
     rdp_client->display = guac_display_alloc(client);
 
+    /* Any pointers cached for a previous connection were freed along with
+     * that connection's display */
+    memset(rdp_client->pointer_cache, 0, sizeof(rdp_client->pointer_cache));
+
     guac_display_layer* default_layer = guac_display_default_layer(rdp_client->display);
     guac_display_layer_resize(default_layer, rdp_client->settings->width, rdp_client->settings->height);
 
@@ -538,6 +673,17 @@ static int guac_rdp_handle_connection(guac_client* client) {
      * heuristics) */
     guac_display_layer_set_lossless(default_layer, settings->lossless);
 
+    /* Periodically record keyframes of the display, if the recording format
+     * supports seeking */
+    if (rdp_client->recording != NULL)
+        guac_recording_start_keyframes(rdp_client->recording,
+                rdp_client->display);
+
+    /* Record output directly from the display, if requested */
+    if (rdp_client->recording != NULL)
+        guac_recording_start_output(rdp_client->recording,
+                rdp_client->display);
+
     rdp_client->current_surface = default_layer;
 
     rdp_client->available_svc = guac_common_list_alloc();
@@ -590,11 +736,14 @@ static int guac_rdp_handle_connection(guac_client* client) {
     guac_rwlock_acquire_read_lock(&(rdp_client->lock));
 
     /* Connect to RDP server */
+    timing->connect_start = guac_timestamp_current();
     if (!freerdp_connect(rdp_inst)) {
         guac_rdp_client_abort(client, rdp_inst);
         goto fail;
     }
 
+    timing->connected = guac_timestamp_current();
+
     /* Upgrade to write lock again for further exclusive operations */
     guac_rwlock_release_lock(&(rdp_client->lock));
     guac_rwlock_acquire_write_lock(&(rdp_client->lock));
@@ -630,6 +779,20 @@ static int guac_rdp_handle_connection(guac_client* client) {
             if (!guac_rdp_handle_events(rdp_client))
                 wait_result = -1;
 
+            /* Notify display of any changes to the GDI that may have
+             * occurred while handling events/messages, without waiting for
+             * the server to stop sending updates */
+            if (rdp_client->gdi_modified) {
+                guac_display_render_thread_notify_modified(rdp_client->render_thread);
+                rdp_client->gdi_modified = 0;
+            }
+
+            /* Handle any input events that have been received (this is done
+             * after each batch of FreeRDP events, rather than only once the
+             * server stops sending updates, such that a continuous stream of
+             * updates cannot starve user input) */
+            guac_rdp_handle_input_events(rdp_client);
+
             /* Test whether the RDP server is closing the connection */
 #ifdef HAVE_DISCONNECT_CONTEXT
             connection_closing = freerdp_shall_disconnect_context(rdp_inst->context);
@@ -640,15 +803,8 @@ static int guac_rdp_handle_connection(guac_client* client) {
         } while (!connection_closing &&
                 (wait_result = rdp_guac_client_wait_for_events(client, 0)) > 0);
 
-        /* Notify display of any changes to the GDI that may have occurred
-         * while handling events/messages */
-        if (rdp_client->gdi_modified) {
-            guac_display_render_thread_notify_modified(rdp_client->render_thread);
-            rdp_client->gdi_modified = 0;
-        }
-
-        /* Handle any input events that have been received */
-        guac_rdp_handle_input_events(rdp_client);
+        /* Report how long connecting took once the first frame is sent */
+        guac_rdp_report_connect_timing(client);
 
         /* Close connection cleanly if server is disconnecting */
         if (connection_closing)
@@ -684,6 +840,13 @@ static int guac_rdp_handle_connection(guac_client* client) {
     context->buffer = NULL;
     guac_display_layer_close_raw(default_layer, context);
 
+    /* Stop recording keyframes and output of the display before it is
+     * freed */
+    if (rdp_client->recording != NULL) {
+        guac_recording_stop_keyframes(rdp_client->recording);
+        guac_recording_stop_output(rdp_client->recording);
+    }
+
     /* Ensure all background rendering processes are stopped before freeing
      * underlying memory */
     guac_display_stop(rdp_client->display);
@@ -934,7 +1097,11 @@ void* guac_rdp_client_thread(void* data) {
                 !settings->recording_exclude_mouse,
                 !settings->recording_exclude_touch,
                 settings->recording_include_keys,
-                settings->recording_write_existing);
+                settings->recording_write_existing,
+                settings->recording_write_events,
+                settings->recording_overflow,
+                settings->recording_format,
+                settings->recording_frame_rate);
     }
 
     /* Continue handling connections until error or client disconnect */
@@ -24,6 +24,8 @@
 #include "channels/camera.h"
 #include "channels/cliprdr.h"
 #include "channels/disp.h"
+#include "channels/rail.h"
+#include "channels/rdpgfx.h"
 #include "channels/rdpei.h"
 #include <guacamole/copilot.h>
 #include "common/clipboard.h"
@@ -32,6 +34,7 @@
 #include "fs.h"
 #include "input.h"
 #include "keyboard.h"
+#include "pointer.h"
 #include "print-job.h"
 #include "settings.h"
 
@@ -47,9 +50,10 @@
 #include <guacamole/audio.h>
 #include <guacamole/client.h>
 #include <guacamole/display.h>
-#include <guacamole/fifo.h>
+#include <guacamole/fifo-lockfree.h>
 #include <guacamole/rwlock.h>
 #include <guacamole/recording.h>
+#include <guacamole/timestamp-types.h>
 #include <winpr/wtypes.h>
 
 #include <pthread.h>
@@ -74,6 +78,70 @@
  */
 #define GUAC_RDP_INPUT_EVENT_QUEUE_SIZE 4096
 
+/**
+ * Timestamps and durations describing the progress of the most recent attempt
+ * to establish the RDP connection, from the start of the attempt until the
+ * first frame is sent to users. All timestamps are as returned by
+ * guac_timestamp_current(), and are zero if not yet reached. All durations
+ * are in milliseconds.
+ */
+typedef struct guac_rdp_connect_timing {
+
+    /**
+     * The time that the connection attempt began.
+     */
+    guac_timestamp start;
+
+    /**
+     * The time that freerdp_connect() was invoked, after the display and
+     * FreeRDP instance were prepared.
+     */
+    guac_timestamp connect_start;
+
+    /**
+     * The total time spent within the PreConnect callback, excluding any
+     * time spent loading channels.
+     */
+    guac_timestamp pre_connect;
+
+    /**
+     * The total time spent loading channels.
+     */
+    guac_timestamp load_channels;
+
+    /**
+     * The time that the PreConnect callback and any channel loading last
+     * completed, after which FreeRDP begins connecting to the RDP server.
+     */
+    guac_timestamp handshake_start;
+
+    /**
+     * The time that the certificate of the RDP server was first presented
+     * for verification, marking the end of DNS resolution, the TCP
+     * connection, and the TLS handshake. This is zero if FreeRDP never
+     * requested verification.
+     */
+    guac_timestamp certificate;
+
+    /**
+     * The total time spent within the Authenticate callback, which is
+     * dominated by waiting for the user to provide credentials.
+     */
+    guac_timestamp authenticate;
+
+    /**
+     * The time that freerdp_connect() returned successfully.
+     */
+    guac_timestamp connected;
+
+    /**
+     * Non-zero if the first frame has been sent and the timing of this
+     * attempt has been reported, zero otherwise.
+     */
+    int reported;
+
+} guac_rdp_connect_timing;
+
 /**
  * RDP-specific client data.
  */
@@ -141,22 +209,38 @@ typedef struct guac_rdp_client {
      * time within Guacamole's event handlers. If an attempt to send an RDP
      * event to the RDP server takes a noticable amount of time, that time will
      * otherwise block handling of Guacamole events, including critical events
-     * like "sync" (resulting in miscalculation of processing lag).
+     * like "sync" (resulting in miscalculation of processing lag). As events
+     * are added by any number of user threads, a lock-free FIFO is used so
+     * that those threads never contend with the RDP client thread for a
+     * lock.
      */
-    guac_fifo input_events;
+    guac_fifo_lockfree input_events;
 
     /**
      * Storage for the input_events queue (see above).
      */
     guac_rdp_input_event input_events_items[GUAC_RDP_INPUT_EVENT_QUEUE_SIZE];
 
+    /**
+     * Storage for the sequence numbers of each item within the input_events
+     * queue (see above).
+     */
+    size_t input_events_sequences[GUAC_RDP_INPUT_EVENT_QUEUE_SIZE];
+
     /**
      * FreeRDP event handle that is set with SetEvent() when at least one input
-     * event has been added to the input_events queue. When all input events
-     * have been processed, this event handle is cleared with ResetEvent().
+     * event has been added to the input_events queue. This event handle is
+     * cleared with ResetEvent() immediately before the queue is drained, such
+     * that any event enqueued while draining will signal the handle again.
      */
     HANDLE input_event_queued;
 
+    /**
+     * All distinct pointer images received from the RDP server that are
+     * currently in use, each stored within its own buffer.
+     */
+    guac_rdp_pointer_cache_entry pointer_cache[GUAC_RDP_POINTER_CACHE_SIZE];
+
     /**
      * The current state of the keyboard with respect to the RDP session.
      */
@@ -187,6 +271,12 @@ typedef struct guac_rdp_client {
      */
     guac_rdp_print_job* active_job;
 
+    /**
+     * A print filter process which has already been started and is ready to
+     * process the next print job, or NULL if no such process is running.
+     */
+    guac_rdp_print_filter* print_filter;
+
 #ifdef ENABLE_COMMON_SSH
     /**
      * The user and credentials used to authenticate for SFTP.
@@ -260,6 +350,24 @@ typedef struct guac_rdp_client {
      */
     RailClientContext* rail_interface;
 
+    /**
+     * All RAIL windows currently known to exist, each of which is rendered
+     * using its own layer. This is used only if RemoteApp is in use.
+     */
+    guac_rdp_rail_window rail_windows[GUAC_RDP_RAIL_MAX_WINDOWS];
+
+    /**
+     * The number of RAIL windows stored within rail_windows.
+     */
+    int rail_windows_count;
+
+    /**
+     * The timing of each phase of the most recent attempt to establish the
+     * RDP connection. This is reported with guac_client_record_connect_phase()
+     * once the first frame has been sent.
+     */
+    guac_rdp_connect_timing connect_timing;
+
 } guac_rdp_client;
 
 /**
@@ -284,6 +392,12 @@ typedef struct rdp_freerdp_context {
      */
     UINT32 palette[256];
 
+    /**
+     * The state of Guacamole's handling of the RDPGFX channel, which wraps
+     * the handling provided by FreeRDP's GDI.
+     */
+    guac_rdp_rdpgfx rdpgfx;
+
 } rdp_freerdp_context;
 
 /**
@@ -321,7 +435,8 @@ void guac_rdp_input_event_enqueue(guac_rdp_client* rdp_client,
  * Processes all events that have been enqueued with
  * guac_rdp_input_event_enqueue(), clearing the event queue and the state of
  * the input_event_queued handle. Events are processed in the order they are
- * received.
+ * received, except that consecutive mouse movements from the same user that
+ * do not change the button state are collapsed into the last such movement.
  *
  * @param rdp_client
  *     The RDP client instance whose queued input events should be processed.
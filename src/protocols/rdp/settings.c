@@ -28,8 +28,10 @@
 #include <freerdp/constants.h>
 #include <freerdp/settings.h>
 #include <freerdp/freerdp.h>
+#include <freerdp/version.h>
 #include <guacamole/client.h>
 #include <guacamole/mem.h>
+#include <guacamole/recording.h>
 #include <guacamole/fips.h>
 #include <guacamole/string.h>
 #include <guacamole/user.h>
@@ -38,7 +40,10 @@
 #include <winpr/wtypes.h>
 
 #include <errno.h>
+#include <inttypes.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -96,6 +101,7 @@ const char* GUAC_RDP_CLIENT_ARGS[] = {
     "disable-bitmap-caching",
     "disable-offscreen-caching",
     "disable-glyph-caching",
+    "bitmap-cache-path",
     "disable-gfx",
     "preconnection-id",
     "preconnection-blob",
@@ -127,7 +133,12 @@ const char* GUAC_RDP_CLIENT_ARGS[] = {
     "recording-include-keys",
     "create-recording-path",
     "recording-write-existing",
+    "recording-overflow",
+    "recording-format",
+    "recording-write-events",
+    "recording-frame-rate",
     "resize-method",
+    "resize-quiet-period",
     "secondary-monitors",
     "enable-audio-input",
     "enable-camera",
@@ -416,6 +427,13 @@ enum RDP_ARGS_IDX {
      */
     IDX_DISABLE_GLYPH_CACHING,
 
+    /**
+     * The directory in which persistent bitmap cache files should be stored,
+     * such that the bitmap cache survives reconnects. If omitted, the bitmap
+     * cache is not persisted.
+     */
+    IDX_BITMAP_CACHE_PATH,
+
     /**
      * "true" if the RDP Graphics Pipeline Extension should not be used, and
      * traditional RDP graphics should be used instead, "false" or blank if the
@@ -597,12 +615,48 @@ enum RDP_ARGS_IDX {
      */
     IDX_RECORDING_WRITE_EXISTING,
 
+    /**
+     * The behavior to use if session data is produced faster than it can be
+     * written to the recording file: "block" (the default), "drop", or
+     * "spill".
+     */
+    IDX_RECORDING_OVERFLOW,
+
+    /**
+     * The format of the recording file: "raw" (the default), or "compressed"
+     * for a compressed recording which can be played back starting from any
+     * point in time.
+     */
+    IDX_RECORDING_FORMAT,
+
+    /**
+     * "true" if the mouse, touch, and key events included within the
+     * recording should also be written to a separate, compact binary file
+     * alongside the recording, "false" or blank otherwise.
+     */
+    IDX_RECORDING_WRITE_EVENTS,
+
+    /**
+     * The maximum number of frames per second to record if graphical output
+     * should be recorded directly from the display, losslessly and
+     * independently of connected users, or zero or blank if the output sent
+     * to connected users should be recorded as-is.
+     */
+    IDX_RECORDING_FRAME_RATE,
+
     /**
      * The method to use to apply screen size changes requested by the user.
      * Valid values are blank, "display-update", and "reconnect".
      */
     IDX_RESIZE_METHOD,
 
+    /**
+     * The number of milliseconds that the requested screen size must remain
+     * unchanged before that size is applied to the remote display, or blank
+     * (or "0") to apply size changes as soon as allowed.
+     */
+    IDX_RESIZE_QUIET_PERIOD,
+
     /**
      * The maximum allowed count of secondary monitors.
      * 0 to disable.
@@ -1035,6 +1089,11 @@ guac_rdp_settings* guac_rdp_parse_args(guac_user* user,
                 GUAC_RDP_CLIENT_ARGS[IDX_DISABLE_GLYPH_CACHING]);
     }
 
+    /* Persistent bitmap cache (only meaningful if bitmap caching is enabled) */
+    settings->bitmap_cache_path =
+        guac_user_parse_args_string(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_BITMAP_CACHE_PATH, NULL);
+
     /* Preconnection ID */
     settings->preconnection_id = -1;
     if (argv[IDX_PRECONNECTION_ID][0] != '\0') {
@@ -1241,6 +1300,26 @@ guac_rdp_settings* guac_rdp_parse_args(guac_user* user,
         guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
                 IDX_RECORDING_WRITE_EXISTING, 0);
 
+    /* Parse recording overflow behavior */
+    settings->recording_overflow =
+        guac_recording_parse_args_overflow(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_RECORDING_OVERFLOW, GUAC_RECORDING_OVERFLOW_BLOCK);
+
+    /* Parse recording file format */
+    settings->recording_format =
+        guac_recording_parse_args_format(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_RECORDING_FORMAT, GUAC_RECORDING_FORMAT_RAW);
+
+    /* Parse input event sidecar flag */
+    settings->recording_write_events =
+        guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_RECORDING_WRITE_EVENTS, false);
+
+    /* Parse rate of output recorded directly from the display */
+    settings->recording_frame_rate =
+        guac_user_parse_args_int(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_RECORDING_FRAME_RATE, 0);
+
     /* No resize method */
     if (strcmp(argv[IDX_RESIZE_METHOD], "") == 0) {
         guac_user_log(user, GUAC_LOG_INFO, "Resize method: none");
@@ -1266,6 +1345,11 @@ guac_rdp_settings* guac_rdp_parse_args(guac_user* user,
         settings->resize_method = GUAC_RESIZE_NONE;
     }
 
+    /* Wait for size to settle before resizing (default 0 = no wait) */
+    settings->resize_quiet_period =
+        guac_user_parse_args_int(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_RESIZE_QUIET_PERIOD, 0);
+
     /* Maximum secondary monitors (default 0 = disabled) */
     settings->max_secondary_monitors =
         guac_user_parse_args_int(user, GUAC_RDP_CLIENT_ARGS, argv,
@@ -1450,6 +1534,7 @@ void guac_rdp_settings_free(guac_rdp_settings* settings) {
     guac_mem_free(settings->preconnection_blob);
     guac_mem_free(settings->recording_name);
     guac_mem_free(settings->recording_path);
+    guac_mem_free(settings->bitmap_cache_path);
     guac_mem_free(settings->remote_app);
     guac_mem_free(settings->remote_app_args);
     guac_mem_free(settings->remote_app_dir);
@@ -1573,6 +1658,65 @@ int guac_rdp_get_depth(freerdp* rdp) {
 #endif
 }
 
+#if FREERDP_VERSION_MAJOR >= 3
+/**
+ * Incorporates the given string into the given 64-bit FNV-1a hash, followed
+ * by a terminating null byte such that adjacent strings cannot run together.
+ * NULL strings are treated as empty strings.
+ *
+ * @param hash
+ *     The current value of the hash.
+ *
+ * @param str
+ *     The string to incorporate into the hash, or NULL.
+ *
+ * @return
+ *     The new value of the hash.
+ */
+static uint64_t guac_rdp_hash_string(uint64_t hash, const char* str) {
+
+    if (str != NULL) {
+        for (; *str != '\0'; str++)
+            hash = (hash ^ (unsigned char) *str) * 0x100000001B3ULL;
+    }
+
+    return hash * 0x100000001B3ULL;
+
+}
+
+/**
+ * Returns the full path of the persistent bitmap cache file that should be
+ * used for the connection described by the given settings. The file is named
+ * after a hash of the server and user, such that connections to different
+ * servers or as different users never share cached bitmaps, while file names
+ * remain safe regardless of the contents of those values.
+ *
+ * @param guac_settings
+ *     The settings of the connection, which must have a non-NULL
+ *     bitmap_cache_path.
+ *
+ * @return
+ *     A newly-allocated string containing the path of the persistent bitmap
+ *     cache file, which must eventually be freed with guac_mem_free().
+ */
+static char* guac_rdp_get_bitmap_cache_file(guac_rdp_settings* guac_settings) {
+
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    hash = guac_rdp_hash_string(hash, guac_settings->hostname);
+    hash = (hash ^ (uint64_t) guac_settings->port) * 0x100000001B3ULL;
+    hash = guac_rdp_hash_string(hash, guac_settings->domain);
+    hash = guac_rdp_hash_string(hash, guac_settings->username);
+
+    size_t length = strlen(guac_settings->bitmap_cache_path) + 32;
+    char* path = guac_mem_alloc(length);
+    snprintf(path, length, "%s/guac-rdp-%016" PRIx64 ".bmc",
+            guac_settings->bitmap_cache_path, hash);
+
+    return path;
+
+}
+#endif
+
 void guac_rdp_push_settings(guac_client* client,
         guac_rdp_settings* guac_settings, freerdp* rdp) {
 
@@ -1627,6 +1771,14 @@ void guac_rdp_push_settings(guac_client* client,
         freerdp_settings_set_uint32(rdp_settings, FreeRDP_ColorDepth, RDP_GFX_REQUIRED_DEPTH);
         freerdp_settings_set_bool(rdp_settings, FreeRDP_SoftwareGdi, TRUE);
 
+#if FREERDP_VERSION_MAJOR >= 3
+        /* Decode the tiles of RemoteFX and progressive frames in parallel
+         * using FreeRDP's thread pool */
+        freerdp_settings_set_uint32(rdp_settings, FreeRDP_ThreadingFlags,
+                freerdp_settings_get_uint32(rdp_settings, FreeRDP_ThreadingFlags)
+                & ~THREADING_FLAGS_DISABLE_THREADS);
+#endif
+
     }
 
     /* Set individual flags - some FreeRDP versions overwrite flags set by guac_rdp_get_performance_flags() above */
@@ -1801,6 +1953,26 @@ void guac_rdp_push_settings(guac_client* client,
     }
 
     freerdp_settings_set_bool(rdp_settings, FreeRDP_BitmapCacheEnabled, !guac_settings->disable_bitmap_caching);
+
+    /* Persist the bitmap cache across connections, such that reconnecting
+     * does not require the server to resend the entire desktop (FreeRDP 3
+     * loads and saves the cache file itself, including for the RDPGFX cache
+     * import offer) */
+    if (guac_settings->bitmap_cache_path != NULL && !guac_settings->disable_bitmap_caching) {
+#if FREERDP_VERSION_MAJOR >= 3
+        char* bitmap_cache_file = guac_rdp_get_bitmap_cache_file(guac_settings);
+        freerdp_settings_set_bool(rdp_settings, FreeRDP_BitmapCachePersistEnabled, TRUE);
+        freerdp_settings_set_string(rdp_settings, FreeRDP_BitmapCachePersistFile, bitmap_cache_file);
+        guac_client_log(client, GUAC_LOG_DEBUG, "Bitmap cache will be "
+                "persisted within \"%s\".", bitmap_cache_file);
+        guac_mem_free(bitmap_cache_file);
+#else
+        guac_client_log(client, GUAC_LOG_WARNING, "The \"%s\" parameter "
+                "requires FreeRDP 3 and will be ignored.",
+                GUAC_RDP_CLIENT_ARGS[IDX_BITMAP_CACHE_PATH]);
+#endif
+    }
+
     freerdp_settings_set_uint32(rdp_settings, FreeRDP_OffscreenSupportLevel, !guac_settings->disable_offscreen_caching);
     freerdp_settings_set_uint32(rdp_settings, FreeRDP_GlyphSupportLevel, 
             (!guac_settings->disable_glyph_caching ? GLYPH_SUPPORT_FULL : GLYPH_SUPPORT_NONE));
@@ -2037,6 +2209,12 @@ void guac_rdp_push_settings(guac_client* client,
     }
 
     rdp_settings->BitmapCacheEnabled = !guac_settings->disable_bitmap_caching;
+
+    /* Persistent bitmap caches are only supported by FreeRDP 3 */
+    if (guac_settings->bitmap_cache_path != NULL && !guac_settings->disable_bitmap_caching)
+        guac_client_log(client, GUAC_LOG_WARNING, "The \"%s\" parameter "
+                "requires FreeRDP 3 and will be ignored.",
+                GUAC_RDP_CLIENT_ARGS[IDX_BITMAP_CACHE_PATH]);
     rdp_settings->OffscreenSupportLevel = !guac_settings->disable_offscreen_caching;
     rdp_settings->GlyphSupportLevel = !guac_settings->disable_glyph_caching ? GLYPH_SUPPORT_FULL : GLYPH_SUPPORT_NONE;
     rdp_settings->OsMajorType = OSMAJORTYPE_UNSPECIFIED;
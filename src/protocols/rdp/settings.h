@@ -25,6 +25,7 @@
 
 #include <freerdp/freerdp.h>
 #include <guacamole/client.h>
+#include <guacamole/recording.h>
 #include <guacamole/user.h>
 
 /**
@@ -432,6 +433,13 @@ typedef struct guac_rdp_settings {
      */
     int disable_glyph_caching;
 
+    /**
+     * The directory in which the persistent bitmap cache file for this
+     * connection should be stored, or NULL if the bitmap cache should not be
+     * persisted across connections.
+     */
+    char* bitmap_cache_path;
+
     /**
      * The preconnection ID to send within the preconnection PDU when
      * initiating an RDP connection, if any. If no preconnection ID is
@@ -596,11 +604,43 @@ typedef struct guac_rdp_settings {
      */
     int recording_write_existing;
 
+    /**
+     * The behavior to use if session data is produced faster than it can be
+     * written to the recording file.
+     */
+    guac_recording_overflow recording_overflow;
+
+    /**
+     * The format of the recording file.
+     */
+    guac_recording_format recording_format;
+
+    /**
+     * Whether included input events should also be written to a separate,
+     * compact binary file alongside the recording.
+     */
+    bool recording_write_events;
+
+    /**
+     * The maximum number of frames per second of graphical output to record
+     * directly from the display, or zero if the output sent to connected
+     * users should be recorded as-is.
+     */
+    int recording_frame_rate;
+
     /** 
      * The method to apply when the user's display changes size.
      */
     guac_rdp_resize_method resize_method;
 
+    /**
+     * The number of milliseconds that the requested display size must remain
+     * unchanged before the remote display is resized, or 0 if the remote
+     * display should be resized as soon as the display update rate limit
+     * allows.
+     */
+    int resize_quiet_period;
+
     /**
      * The maximum allowed count of secondary monitors.
      */
@@ -174,6 +174,9 @@ int guac_rdp_user_leave_handler(guac_user* user) {
     if (rdp_client->display != NULL)
         guac_display_notify_user_left(rdp_client->display, user);
 
+    /* Abandon any copilot queries made on behalf of the user */
+    guac_copilot_cancel_queries(rdp_client->copilot, user);
+
     /* Free settings if not owner (owner settings will be freed with client) */
     if (!user->owner) {
         guac_rdp_settings* settings = (guac_rdp_settings*) user->data;
@@ -57,12 +57,7 @@ int guac_ssh_argv_callback(guac_user* user, const char* mimetype,
     /* Update SSH pty size if connected */
     int term_width = guac_terminal_get_columns(terminal);
     int term_height = guac_terminal_get_rows(terminal);
-    if (ssh_client->term_channel != NULL) {
-        pthread_mutex_lock(&(ssh_client->term_channel_lock));
-        libssh2_channel_request_pty_size(ssh_client->term_channel,
-                term_width, term_height);
-        pthread_mutex_unlock(&(ssh_client->term_channel_lock));
-    }
+    guac_ssh_request_pty_size(ssh_client, term_width, term_height);
 
     return 0;
 
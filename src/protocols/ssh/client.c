@@ -28,8 +28,10 @@
 
 #include <langinfo.h>
 #include <locale.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <guacamole/argv.h>
 #include <guacamole/client.h>
@@ -75,12 +77,20 @@ int guac_client_init(guac_client* client) {
     /* Store back-reference to the guac_client */
     ssh_client->client = client;
 
+    /* The pipe for waking the SSH client thread is created only once the
+     * connection is established */
+    ssh_client->wake_fd[0] = -1;
+    ssh_client->wake_fd[1] = -1;
+    pthread_mutex_init(&(ssh_client->pty_size_lock), NULL);
+
     /* Set handlers */
     client->join_handler = guac_ssh_user_join_handler;
     client->join_pending_handler = guac_ssh_join_pending_handler;
     client->free_handler = guac_ssh_client_free_handler;
     client->leave_handler = guac_ssh_user_leave_handler;
 
+    client->coalesce_mouse = 1;
+
     /* Register handlers for argument values that may be sent after the handshake */
     guac_argv_register(GUAC_SSH_ARGV_COLOR_SCHEME, guac_ssh_argv_callback, NULL, GUAC_ARGV_OPTION_ECHO);
     guac_argv_register(GUAC_SSH_ARGV_FONT_NAME, guac_ssh_argv_callback, NULL, GUAC_ARGV_OPTION_ECHO);
@@ -103,12 +113,6 @@ int guac_ssh_client_free_handler(guac_client* client) {
 
     guac_ssh_client* ssh_client = (guac_ssh_client*) client->data;
 
-    /* Close SSH channel */
-    if (ssh_client->term_channel != NULL) {
-        libssh2_channel_send_eof(ssh_client->term_channel);
-        libssh2_channel_close(ssh_client->term_channel);
-    }
-
     /* Free terminal (which may still be using term_channel) */
     if (ssh_client->term != NULL) {
         /* Stop the terminal to unblock any pending reads/writes */
@@ -119,9 +123,21 @@ int guac_ssh_client_free_handler(guac_client* client) {
         guac_terminal_free(ssh_client->term);
     }
 
-    /* Free terminal channel now that the terminal is finished */
-    if (ssh_client->term_channel != NULL)
+    /* Close and free terminal channel now that the terminal is finished (the
+     * SSH client thread is the only other user of the channel) */
+    if (ssh_client->term_channel != NULL) {
+        libssh2_channel_send_eof(ssh_client->term_channel);
+        libssh2_channel_close(ssh_client->term_channel);
         libssh2_channel_free(ssh_client->term_channel);
+    }
+
+    /* Close pipe used for waking the SSH client thread */
+    if (ssh_client->wake_fd[0] != -1) {
+        close(ssh_client->wake_fd[0]);
+        close(ssh_client->wake_fd[1]);
+    }
+
+    pthread_mutex_destroy(&(ssh_client->pty_size_lock));
 
     /* Clean up the SFTP filesystem object and session */
     if (ssh_client->sftp_filesystem) {
@@ -129,6 +145,9 @@ int guac_ssh_client_free_handler(guac_client* client) {
         guac_common_ssh_destroy_session(ssh_client->sftp_session);
     }
 
+    /* Stop copilot, including any in-progress queries */
+    guac_copilot_free(ssh_client->copilot);
+
     /* Clean up recording, if in progress */
     if (ssh_client->recording != NULL)
         guac_recording_free(ssh_client->recording);
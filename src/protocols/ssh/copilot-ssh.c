@@ -26,9 +26,133 @@
 #include <guacamole/mem.h>
 #include <guacamole/string.h>
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * The strings which, if present within terminal output, indicate that an
+ * error has occurred.
+ */
+static const char* GUAC_SSH_COPILOT_ERROR_PATTERNS[] = {
+    "error",
+    "Error",
+    "ERROR",
+    "failed",
+    "Failed",
+    NULL
+};
+
+/**
+ * The maximum number of states of the error pattern matcher. This must be at
+ * least one more than the total length of all error patterns.
+ */
+#define GUAC_SSH_COPILOT_MAX_SCAN_STATES 64
+
+/**
+ * The transitions of the error pattern matcher, a deterministic automaton
+ * built from GUAC_SSH_COPILOT_ERROR_PATTERNS using the Aho-Corasick
+ * construction, such that all patterns are found with a single table lookup
+ * per byte of output. State zero is the initial state.
+ */
+static uint8_t guac_ssh_copilot_scan_next[GUAC_SSH_COPILOT_MAX_SCAN_STATES][256];
+
+/**
+ * For each state of the error pattern matcher, non-zero if reaching that
+ * state means that an error pattern has been found, zero otherwise.
+ */
+static uint8_t guac_ssh_copilot_scan_match[GUAC_SSH_COPILOT_MAX_SCAN_STATES];
+
+/**
+ * Guards building of the error pattern matcher, which is built only once per
+ * process.
+ */
+static pthread_once_t guac_ssh_copilot_scan_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Builds the transition and match tables of the error pattern matcher from
+ * GUAC_SSH_COPILOT_ERROR_PATTERNS. This function is invoked only once, via
+ * pthread_once().
+ */
+static void guac_ssh_copilot_build_scanner(void) {
+
+    /* Links from each state to the state representing its longest proper
+     * suffix that is also a pattern prefix */
+    uint8_t fail[GUAC_SSH_COPILOT_MAX_SCAN_STATES] = { 0 };
+    uint8_t queue[GUAC_SSH_COPILOT_MAX_SCAN_STATES];
+    int states = 1;
+
+    /* Build trie of all patterns, where zero denotes a missing transition
+     * (no state other than the root can transition to the root) */
+    for (const char** pattern = GUAC_SSH_COPILOT_ERROR_PATTERNS;
+            *pattern != NULL; pattern++) {
+
+        int state = 0;
+        for (const unsigned char* c = (const unsigned char*) *pattern;
+                *c != '\0'; c++) {
+
+            if (guac_ssh_copilot_scan_next[state][*c] == 0)
+                guac_ssh_copilot_scan_next[state][*c] = states++;
+
+            state = guac_ssh_copilot_scan_next[state][*c];
+
+        }
+
+        guac_ssh_copilot_scan_match[state] = 1;
+
+    }
+
+    /* Convert trie into automaton in breadth-first order, such that the
+     * failure link of each state is complete before it is needed */
+    int head = 0;
+    int tail = 0;
+
+    for (int c = 0; c < 256; c++) {
+        int child = guac_ssh_copilot_scan_next[0][c];
+        if (child != 0)
+            queue[tail++] = child;
+    }
+
+    while (head < tail) {
+
+        int state = queue[head++];
+        guac_ssh_copilot_scan_match[state] |=
+            guac_ssh_copilot_scan_match[fail[state]];
+
+        for (int c = 0; c < 256; c++) {
+
+            int child = guac_ssh_copilot_scan_next[state][c];
+
+            /* Missing transitions follow the failure link */
+            if (child == 0) {
+                guac_ssh_copilot_scan_next[state][c] =
+                    guac_ssh_copilot_scan_next[fail[state]][c];
+                continue;
+            }
+
+            fail[child] = guac_ssh_copilot_scan_next[fail[state]][c];
+            queue[tail++] = child;
+
+        }
+
+    }
+
+}
+
+/**
+ * Sends the given data to the SSH session as terminal input, allowing the
+ * copilot to execute workflows. This function implements
+ * guac_copilot_input_handler.
+ */
+static int guac_ssh_copilot_input_handler(guac_copilot* copilot,
+        const char* data, int length) {
+
+    guac_ssh_client* ssh_client = (guac_ssh_client*) copilot->data;
+    return guac_terminal_send_data(ssh_client->term, data, length) < 0;
+
+}
+
 void guac_ssh_copilot_init(guac_client* client, guac_ssh_client* ssh_client) {
 
     if (ssh_client->settings->enable_copilot == 0)
@@ -45,6 +169,10 @@ void guac_ssh_copilot_init(guac_client* client, guac_ssh_client* ssh_client) {
 
     ssh_client->copilot = copilot;
 
+    /* Allow workflows to be executed directly within the terminal */
+    copilot->input_handler = guac_ssh_copilot_input_handler;
+    copilot->data = ssh_client;
+
     /* Set OpenAI API key if provided */
     if (ssh_client->settings->copilot_openai_key != NULL &&
             strlen(ssh_client->settings->copilot_openai_key) > 0) {
@@ -116,12 +244,23 @@ void guac_ssh_copilot_track_output(guac_ssh_client* ssh_client,
     if (ssh_client->copilot == NULL || output == NULL)
         return;
 
-    /* Look for error patterns in output */
-    if (strstr(output, "error") != NULL ||
-        strstr(output, "Error") != NULL ||
-        strstr(output, "ERROR") != NULL ||
-        strstr(output, "failed") != NULL ||
-        strstr(output, "Failed") != NULL) {
+    /* Advance any workflow awaiting completion of its steps */
+    guac_copilot_handle_output(ssh_client->copilot, output, length);
+
+    pthread_once(&guac_ssh_copilot_scan_once, guac_ssh_copilot_build_scanner);
+
+    /* Look for error patterns in output, continuing any partial match from
+     * previous output */
+    int state = ssh_client->copilot_scan_state;
+    int found = 0;
+    for (int i = 0; i < length; i++) {
+        state = guac_ssh_copilot_scan_next[state][(unsigned char) output[i]];
+        found |= guac_ssh_copilot_scan_match[state];
+    }
+
+    ssh_client->copilot_scan_state = state;
+
+    if (found) {
 
         /* Store last error for context */
         char* error_snippet = guac_mem_alloc(256);
@@ -84,13 +84,9 @@ int guac_ssh_user_size_handler(guac_user* user, int width, int height,
     guac_terminal_resize(terminal, width, height);
 
     /* Update SSH pty size if connected */
-    if (ssh_client->term_channel != NULL) {
-        pthread_mutex_lock(&(ssh_client->term_channel_lock));
-        libssh2_channel_request_pty_size(ssh_client->term_channel,
-                guac_terminal_get_columns(terminal),
-                guac_terminal_get_rows(terminal));
-        pthread_mutex_unlock(&(ssh_client->term_channel_lock));
-    }
+    guac_ssh_request_pty_size(ssh_client,
+            guac_terminal_get_columns(terminal),
+            guac_terminal_get_rows(terminal));
 
     return 0;
 }
@@ -30,10 +30,19 @@
  */
 #define GUAC_SSH_STDIN_PIPE_NAME "STDIN"
 
+/**
+ * The name reserved for the inbound pipe stream whose blobs are used as
+ * queries to search the terminal emulator's contents, including its
+ * scrollback.
+ */
+#define GUAC_SSH_SEARCH_PIPE_NAME "SEARCH"
+
 /**
  * Handles an incoming stream from a Guacamole "pipe" instruction. If the pipe
  * is named "STDIN", the contents of the pipe stream are redirected to
- * STDIN of the terminal emulator for as long as the pipe is open.
+ * STDIN of the terminal emulator for as long as the pipe is open. If the pipe
+ * is named "SEARCH", each blob received along the pipe stream is used to
+ * search the contents of the terminal.
  */
 guac_user_pipe_handler guac_ssh_pipe_handler;
 
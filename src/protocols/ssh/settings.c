@@ -27,6 +27,7 @@
 #include "terminal/terminal.h"
 
 #include <guacamole/mem.h>
+#include <guacamole/recording.h>
 #include <guacamole/user.h>
 #include <guacamole/wol-constants.h>
 
@@ -60,6 +61,8 @@ const char* GUAC_SSH_CLIENT_ARGS[] = {
     "typescript-name",
     "create-typescript-path",
     "typescript-write-existing",
+    "typescript-format",
+    "typescript-compress",
     "recording-path",
     "recording-name",
     "recording-exclude-output",
@@ -67,8 +70,14 @@ const char* GUAC_SSH_CLIENT_ARGS[] = {
     "recording-include-keys",
     "create-recording-path",
     "recording-write-existing",
+    "recording-overflow",
+    "recording-format",
+    "recording-write-events",
     "read-only",
     "server-alive-interval",
+    "channel-window-size",
+    "channel-packet-size",
+    "read-buffer-size",
     "backspace",
     "terminal-type",
     "scrollback",
@@ -198,8 +207,8 @@ enum SSH_ARGS_IDX {
 
     /**
      * The name that should be given to typescripts which are written in the
-     * given path. Each typescript will consist of two files: "NAME" and
-     * "NAME.timing".
+     * given path. Unless the combined format is used, each typescript will
+     * consist of two files: "NAME" and "NAME.timing".
      */
     IDX_TYPESCRIPT_NAME,
 
@@ -215,6 +224,19 @@ enum SSH_ARGS_IDX {
      */
     IDX_TYPESCRIPT_WRITE_EXISTING,
 
+    /**
+     * The layout of the typescript files: "split" (the default) for a
+     * separate data and timing file compatible with scriptreplay, or
+     * "combined" for a single file containing both.
+     */
+    IDX_TYPESCRIPT_FORMAT,
+
+    /**
+     * "true" if the typescript files should be compressed with zstd, "false"
+     * or blank otherwise.
+     */
+    IDX_TYPESCRIPT_COMPRESS,
+
     /**
      * The full absolute path to the directory in which screen recordings
      * should be written.
@@ -265,6 +287,27 @@ enum SSH_ARGS_IDX {
      */
     IDX_RECORDING_WRITE_EXISTING,
 
+    /**
+     * The behavior to use if session data is produced faster than it can be
+     * written to the recording file: "block" (the default), "drop", or
+     * "spill".
+     */
+    IDX_RECORDING_OVERFLOW,
+
+    /**
+     * The format of the recording file: "raw" (the default), or "compressed"
+     * for a compressed recording which can be played back starting from any
+     * point in time.
+     */
+    IDX_RECORDING_FORMAT,
+
+    /**
+     * "true" if the mouse, touch, and key events included within the
+     * recording should also be written to a separate, compact binary file
+     * alongside the recording, "false" or blank otherwise.
+     */
+    IDX_RECORDING_WRITE_EVENTS,
+
     /**
      * "true" if this connection should be read-only (user input should be
      * dropped), "false" or blank otherwise.
@@ -278,6 +321,26 @@ enum SSH_ARGS_IDX {
      */
     IDX_SERVER_ALIVE_INTERVAL,
 
+    /**
+     * The receive window, in bytes, to use for the SSH channels of the
+     * connection. By default, or if zero, the window is sized automatically
+     * from the measured round-trip time of the connection.
+     */
+    IDX_CHANNEL_WINDOW_SIZE,
+
+    /**
+     * The maximum packet size, in bytes, to request for the SSH channels of
+     * the connection. By default, or if zero, the largest packet size that
+     * libssh2 supports is used.
+     */
+    IDX_CHANNEL_PACKET_SIZE,
+
+    /**
+     * The size, in bytes, of the buffer used to read terminal output from the
+     * SSH server. By default, this will be GUAC_SSH_DEFAULT_READ_BUFFER_SIZE.
+     */
+    IDX_READ_BUFFER_SIZE,
+
     /**
      * The ASCII code, as an integer, to send for the backspace key, as configured
      * by the SSH connection from the client.  By default this will be
@@ -515,6 +578,17 @@ guac_ssh_settings* guac_ssh_parse_args(guac_user* user,
         guac_user_parse_args_boolean(user, GUAC_SSH_CLIENT_ARGS, argv,
                 IDX_TYPESCRIPT_WRITE_EXISTING, false);
 
+    /* Parse typescript file format */
+    settings->typescript_format =
+        guac_terminal_typescript_parse_args_format(user, GUAC_SSH_CLIENT_ARGS,
+                argv, IDX_TYPESCRIPT_FORMAT,
+                GUAC_TERMINAL_TYPESCRIPT_FORMAT_SPLIT);
+
+    /* Parse typescript compression flag */
+    settings->typescript_compress =
+        guac_user_parse_args_boolean(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_TYPESCRIPT_COMPRESS, false);
+
     /* Read recording path */
     settings->recording_path =
         guac_user_parse_args_string(user, GUAC_SSH_CLIENT_ARGS, argv,
@@ -550,11 +624,48 @@ guac_ssh_settings* guac_ssh_parse_args(guac_user* user,
         guac_user_parse_args_boolean(user, GUAC_SSH_CLIENT_ARGS, argv,
                 IDX_RECORDING_WRITE_EXISTING, false);
 
+    /* Parse recording overflow behavior */
+    settings->recording_overflow =
+        guac_recording_parse_args_overflow(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_RECORDING_OVERFLOW, GUAC_RECORDING_OVERFLOW_BLOCK);
+
+    /* Parse recording file format */
+    settings->recording_format =
+        guac_recording_parse_args_format(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_RECORDING_FORMAT, GUAC_RECORDING_FORMAT_RAW);
+
+    /* Parse input event sidecar flag */
+    settings->recording_write_events =
+        guac_user_parse_args_boolean(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_RECORDING_WRITE_EVENTS, false);
+
     /* Parse server alive interval */
     settings->server_alive_interval =
         guac_user_parse_args_int(user, GUAC_SSH_CLIENT_ARGS, argv,
                 IDX_SERVER_ALIVE_INTERVAL, 0);
 
+    /* Parse SSH channel window and packet sizes (automatic if zero) */
+    settings->channel_window_size =
+        guac_user_parse_args_int(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_CHANNEL_WINDOW_SIZE, 0);
+
+    settings->channel_packet_size =
+        guac_user_parse_args_int(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_CHANNEL_PACKET_SIZE, 0);
+
+    /* Parse terminal output read buffer size */
+    settings->read_buffer_size =
+        guac_user_parse_args_int(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_READ_BUFFER_SIZE, GUAC_SSH_DEFAULT_READ_BUFFER_SIZE);
+
+    if (settings->read_buffer_size < GUAC_SSH_MIN_READ_BUFFER_SIZE
+            || settings->read_buffer_size > GUAC_SSH_MAX_READ_BUFFER_SIZE) {
+        guac_user_log(user, GUAC_LOG_WARNING, "Invalid read buffer size: "
+                "\"%s\". Using the default size: %i.",
+                argv[IDX_READ_BUFFER_SIZE], GUAC_SSH_DEFAULT_READ_BUFFER_SIZE);
+        settings->read_buffer_size = GUAC_SSH_DEFAULT_READ_BUFFER_SIZE;
+    }
+
     /* Parse backspace key setting */
     settings->backspace =
         guac_user_parse_args_int(user, GUAC_SSH_CLIENT_ARGS, argv,
@@ -21,7 +21,9 @@
 #define GUAC_SSH_SETTINGS_H
 
 #include "config.h"
+#include "terminal/typescript.h"
 
+#include <guacamole/recording.h>
 #include <guacamole/user.h>
 
 #include <stdbool.h>
@@ -53,6 +55,25 @@
  */
 #define GUAC_SSH_DEFAULT_POLL_TIMEOUT 1000
 
+/**
+ * The default size of the buffer used to read terminal output from the SSH
+ * server, in bytes. This is large enough to hold the full payload of any
+ * packet received on the terminal channel.
+ */
+#define GUAC_SSH_DEFAULT_READ_BUFFER_SIZE 32768
+
+/**
+ * The smallest allowed size of the buffer used to read terminal output from
+ * the SSH server, in bytes.
+ */
+#define GUAC_SSH_MIN_READ_BUFFER_SIZE 1024
+
+/**
+ * The largest allowed size of the buffer used to read terminal output from
+ * the SSH server, in bytes.
+ */
+#define GUAC_SSH_MAX_READ_BUFFER_SIZE 1048576
+
 /**
  * Settings for the SSH connection. The values for this structure are parsed
  * from the arguments given during the Guacamole protocol handshake using the
@@ -231,6 +252,16 @@ typedef struct guac_ssh_settings {
      */
     bool typescript_write_existing;
 
+    /**
+     * The layout of the files that make up the typescript, if enabled.
+     */
+    guac_terminal_typescript_format typescript_format;
+
+    /**
+     * Whether the typescript files should be compressed with zstd.
+     */
+    bool typescript_compress;
+
     /**
      * The path in which the screen recording should be saved, if enabled. If
      * no screen recording should be saved, this will be NULL.
@@ -280,11 +311,46 @@ typedef struct guac_ssh_settings {
      */
     bool recording_write_existing;
 
+    /**
+     * The behavior to use if session data is produced faster than it can be
+     * written to the recording file.
+     */
+    guac_recording_overflow recording_overflow;
+
+    /**
+     * The format of the recording file.
+     */
+    guac_recording_format recording_format;
+
+    /**
+     * Whether included input events should also be written to a separate,
+     * compact binary file alongside the recording.
+     */
+    bool recording_write_events;
+
     /**
      * The number of seconds between sending server alive messages.
      */
     int server_alive_interval;
 
+    /**
+     * The receive window to use for the SSH channels of the connection, in
+     * bytes, or zero if the window should be sized automatically.
+     */
+    int channel_window_size;
+
+    /**
+     * The maximum packet size to request for the SSH channels of the
+     * connection, in bytes, or zero if the default should be used.
+     */
+    int channel_packet_size;
+
+    /**
+     * The size of the buffer used to read terminal output from the SSH
+     * server, in bytes.
+     */
+    int read_buffer_size;
+
     /**
      * The integer ASCII code of the command to send for backspace.
      */
@@ -22,6 +22,7 @@
 #include "argv.h"
 #include "common-ssh/sftp.h"
 #include "common-ssh/ssh.h"
+#include "copilot-ssh.h"
 #include "settings.h"
 #include "sftp.h"
 #include "ssh.h"
@@ -49,6 +50,7 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <poll.h>
@@ -60,6 +62,7 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 /**
  * Produces a new user object containing a username and password or private
@@ -198,28 +201,81 @@ static char* guac_ssh_get_credential(guac_client *client, char* cred_name) {
 
 }
 
-void* ssh_input_thread(void* data) {
+void guac_ssh_request_pty_size(guac_ssh_client* ssh_client, int columns,
+        int rows) {
 
-    guac_client* client = (guac_client*) data;
-    guac_ssh_client* ssh_client = (guac_ssh_client*) client->data;
+    /* Nothing to resize until the terminal channel is open */
+    if (ssh_client->term_channel == NULL)
+        return;
 
-    char buffer[8192];
-    int bytes_read;
+    pthread_mutex_lock(&(ssh_client->pty_size_lock));
+    ssh_client->pty_columns = columns;
+    ssh_client->pty_rows = rows;
+    ssh_client->pty_size_pending = 1;
+    pthread_mutex_unlock(&(ssh_client->pty_size_lock));
 
-    /* Write all data read */
-    while ((bytes_read = guac_terminal_read_stdin(ssh_client->term, buffer, sizeof(buffer))) > 0) {
-        pthread_mutex_lock(&(ssh_client->term_channel_lock));
-        libssh2_channel_write(ssh_client->term_channel, buffer, bytes_read);
-        pthread_mutex_unlock(&(ssh_client->term_channel_lock));
+    /* Wake the SSH client thread to send the request (failure here can only
+     * mean that the thread is already due to wake) */
+    char wake = 0;
+    if (write(ssh_client->wake_fd[1], &wake, 1) < 0 && errno != EAGAIN)
+        guac_client_log(ssh_client->client, GUAC_LOG_DEBUG, "Unable to wake "
+                "SSH client thread: %s", strerror(errno));
 
-        /* Make sure ssh_input_thread can be terminated anyway */
-        if (client->state == GUAC_CLIENT_STOPPING)
-            break;
-    }
+}
 
-    /* Stop the client so that ssh_client_thread can be terminated */
-    guac_client_stop(client);
-    return NULL;
+/**
+ * Sends any pending request to resize the pty of the terminal channel, as
+ * made with guac_ssh_request_pty_size(). This function must only be invoked
+ * by the SSH client thread. If the request cannot be sent without blocking,
+ * it remains pending and is sent when this function is next invoked.
+ *
+ * @param ssh_client
+ *     The SSH client whose pending pty size request should be sent.
+ */
+static void guac_ssh_send_pty_size(guac_ssh_client* ssh_client) {
+
+    pthread_mutex_lock(&(ssh_client->pty_size_lock));
+    int pending = ssh_client->pty_size_pending;
+    int columns = ssh_client->pty_columns;
+    int rows = ssh_client->pty_rows;
+    pthread_mutex_unlock(&(ssh_client->pty_size_lock));
+
+    if (!pending)
+        return;
+
+    if (libssh2_channel_request_pty_size(ssh_client->term_channel,
+                columns, rows) == LIBSSH2_ERROR_EAGAIN)
+        return;
+
+    /* The request is complete unless a different size was requested
+     * meanwhile */
+    pthread_mutex_lock(&(ssh_client->pty_size_lock));
+    if (ssh_client->pty_columns == columns && ssh_client->pty_rows == rows)
+        ssh_client->pty_size_pending = 0;
+    pthread_mutex_unlock(&(ssh_client->pty_size_lock));
+
+}
+
+/**
+ * Returns whether data can be read from the given file descriptor without
+ * blocking.
+ *
+ * @param fd
+ *     The file descriptor to test.
+ *
+ * @return
+ *     Non-zero if data (or end-of-file) can be read from the given file
+ *     descriptor without blocking, zero otherwise.
+ */
+static int guac_ssh_fd_readable(int fd) {
+
+    struct pollfd fds[] = {{
+        .fd      = fd,
+        .events  = POLLIN,
+        .revents = 0,
+    }};
+
+    return poll(fds, 1, 0) > 0;
 
 }
 
@@ -229,9 +285,13 @@ void* ssh_client_thread(void* data) {
     guac_ssh_client* ssh_client = (guac_ssh_client*) client->data;
     guac_ssh_settings* settings = ssh_client->settings;
 
-    char buffer[8192];
+    char* buffer;
 
-    pthread_t input_thread;
+    /* Terminal input that has been read from STDIN but not yet accepted by
+     * the SSH server */
+    char input[GUAC_SSH_STDIN_BUFFER_SIZE];
+    int input_offset = 0;
+    int input_length = 0;
 
     /* If Wake-on-LAN is enabled, attempt to wake. */
     if (settings->wol_send_packet) {
@@ -286,7 +346,11 @@ void* ssh_client_thread(void* data) {
                 !settings->recording_exclude_mouse,
                 0, /* Touch events not supported */
                 settings->recording_include_keys,
-                settings->recording_write_existing);
+                settings->recording_write_existing,
+                settings->recording_write_events,
+                settings->recording_overflow,
+                settings->recording_format,
+                0 /* Output is always copied as sent to users */);
     }
 
     /* Create terminal options with required parameters */
@@ -324,7 +388,9 @@ void* ssh_client_thread(void* data) {
                 settings->typescript_path,
                 settings->typescript_name,
                 settings->create_typescript_path,
-                settings->typescript_write_existing);
+                settings->typescript_write_existing,
+                settings->typescript_format,
+                settings->typescript_compress);
     }
 
     /* Get user and credentials */
@@ -347,11 +413,27 @@ void* ssh_client_thread(void* data) {
         return NULL;
     }
 
-    pthread_mutex_init(&ssh_client->term_channel_lock, NULL);
+    /* Use any explicitly configured channel window and packet sizes */
+    guac_common_ssh_set_channel_sizes(ssh_client->session,
+            settings->channel_window_size, settings->channel_packet_size);
+
+    /* Create pipe for waking the SSH client thread when another thread needs
+     * it to act on the terminal channel */
+    int wake_fd[2];
+    if (pipe(wake_fd)
+            || fcntl(wake_fd[0], F_SETFL, O_NONBLOCK)
+            || fcntl(wake_fd[1], F_SETFL, O_NONBLOCK)) {
+        guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
+                "Unable to create pipe for SSH I/O.");
+        return NULL;
+    }
+
+    ssh_client->wake_fd[0] = wake_fd[0];
+    ssh_client->wake_fd[1] = wake_fd[1];
 
     /* Open channel for terminal */
     ssh_client->term_channel =
-        libssh2_channel_open_session(ssh_client->session->session);
+        guac_common_ssh_open_channel(ssh_client->session);
     if (ssh_client->term_channel == NULL) {
         guac_client_abort(client, GUAC_PROTOCOL_STATUS_UPSTREAM_ERROR,
                 "Unable to open terminal channel.");
@@ -398,6 +480,9 @@ void* ssh_client_thread(void* data) {
             return NULL;
         }
 
+        guac_common_ssh_set_channel_sizes(ssh_client->sftp_session,
+                settings->channel_window_size, settings->channel_packet_size);
+
         /* Request SFTP */
         ssh_client->sftp_filesystem = guac_common_ssh_create_sftp_filesystem(
                     ssh_client->sftp_session, settings->sftp_root_directory,
@@ -469,57 +554,49 @@ void* ssh_client_thread(void* data) {
     guac_client_log(client, GUAC_LOG_INFO, "SSH connection successful.");
     guac_terminal_start(ssh_client->term);
 
-    /* Start input thread */
-    if (pthread_create(&(input_thread), NULL, ssh_input_thread, (void*) client)) {
-        guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR, "Unable to start input thread");
-        return NULL;
-    }
+    /* Allocate buffer for terminal output */
+    buffer = guac_mem_alloc(settings->read_buffer_size);
 
     /* Set non-blocking */
     libssh2_session_set_blocking(ssh_client->session->session, 0);
 
-    /* While data available, write to terminal */
+    /* Handle all I/O of the terminal channel, in both directions, until the
+     * channel or client is closed */
     int bytes_read = 0;
     for (;;) {
 
-        /* Track total amount of data read */
+        /* Track whether any progress was made in either direction */
         int total_read = 0;
+        int total_written = 0;
 
         /* Timeout for polling socket activity */
         int timeout;
 
-        pthread_mutex_lock(&(ssh_client->term_channel_lock));
-
         /* Stop reading at EOF */
-        if (libssh2_channel_eof(ssh_client->term_channel)) {
-            pthread_mutex_unlock(&(ssh_client->term_channel_lock));
+        if (libssh2_channel_eof(ssh_client->term_channel))
             break;
-        }
 
         /* Client is stopping, break the loop */
-        if (client->state == GUAC_CLIENT_STOPPING) {
-            pthread_mutex_unlock(&(ssh_client->term_channel_lock));
+        if (client->state == GUAC_CLIENT_STOPPING)
             break;
-        }
 
         /* Send keepalive at configured interval */
         if (settings->server_alive_interval > 0) {
             timeout = 0;
-            if (libssh2_keepalive_send(ssh_client->session->session, &timeout) > 0) {
-                pthread_mutex_unlock(&(ssh_client->term_channel_lock));
+            if (libssh2_keepalive_send(ssh_client->session->session, &timeout) > 0)
                 break;
-            }
             timeout *= 1000;
         }
         /* If keepalive is not configured, sleep for the default of 1 second */
         else
             timeout = GUAC_SSH_DEFAULT_POLL_TIMEOUT;
 
+        /* Send any requested change in pty size */
+        guac_ssh_send_pty_size(ssh_client);
+
         /* Read terminal data */
         bytes_read = libssh2_channel_read(ssh_client->term_channel,
-                buffer, sizeof(buffer));
-
-        pthread_mutex_unlock(&(ssh_client->term_channel_lock));
+                buffer, settings->read_buffer_size);
 
         /* Attempt to write data received. Exit on failure. */
         if (bytes_read > 0) {
@@ -527,12 +604,53 @@ void* ssh_client_thread(void* data) {
             if (written < 0)
                 break;
 
+            /* Let copilot observe output (such as workflow progress) */
+            guac_ssh_copilot_track_output(ssh_client, buffer, bytes_read);
+
             total_read += bytes_read;
         }
 
         else if (bytes_read < 0 && bytes_read != LIBSSH2_ERROR_EAGAIN)
             break;
 
+        /* Read further terminal input only once all previous input has been
+         * accepted by the SSH server, providing backpressure to STDIN */
+        int stdin_fd = guac_terminal_get_stdin_fd(ssh_client->term);
+        if (input_offset == input_length && guac_ssh_fd_readable(stdin_fd)) {
+
+            /* Stop the client if STDIN has been closed */
+            input_length = guac_terminal_read_stdin(ssh_client->term,
+                    input, sizeof(input));
+            if (input_length <= 0)
+                break;
+
+            input_offset = 0;
+
+        }
+
+        /* Send as much terminal input as the SSH server will accept */
+        while (input_offset < input_length) {
+
+            ssize_t written = libssh2_channel_write(ssh_client->term_channel,
+                    input + input_offset, input_length - input_offset);
+
+            if (written == LIBSSH2_ERROR_EAGAIN)
+                break;
+
+            if (written < 0) {
+                input_length = -1;
+                break;
+            }
+
+            input_offset += written;
+            total_written += written;
+
+        }
+
+        /* Exit if input cannot be sent */
+        if (input_length < 0)
+            break;
+
 #ifdef ENABLE_SSH_AGENT
         /* If agent open, handle any agent packets */
         if (ssh_client->auth_agent != NULL) {
@@ -544,29 +662,52 @@ void* ssh_client_thread(void* data) {
         }
 #endif
 
-        /* Wait for more data if reads turn up empty */
-        if (total_read == 0) {
-
-            /* Wait on the SSH session file descriptor only */
-            struct pollfd fds[] = {{
-                .fd      = ssh_client->session->fd,
-                .events  = POLLIN,
-                .revents = 0,
-            }};
+        /* Wait for more data if nothing could be read or written */
+        if (total_read == 0 && total_written == 0) {
+
+            /* Wait for the SSH session to become readable (or writable, if
+             * libssh2 is waiting to send), for new terminal input if there
+             * is room for it, or for a request from another thread */
+            int directions = libssh2_session_block_directions(
+                    ssh_client->session->session);
+
+            struct pollfd fds[] = {
+                {
+                    .fd      = ssh_client->session->fd,
+                    .events  = POLLIN
+                        | ((directions & LIBSSH2_SESSION_BLOCK_OUTBOUND) ? POLLOUT : 0),
+                    .revents = 0,
+                },
+                {
+                    .fd      = input_offset == input_length ? stdin_fd : -1,
+                    .events  = POLLIN,
+                    .revents = 0,
+                },
+                {
+                    .fd      = ssh_client->wake_fd[0],
+                    .events  = POLLIN,
+                    .revents = 0,
+                }
+            };
 
             /* Wait up to computed timeout */
-            if (poll(fds, 1, timeout) < 0)
+            if (poll(fds, 3, timeout) < 0)
                 break;
 
+            /* Requests are handled with each iteration of the loop, so the
+             * pipe need only be emptied */
+            if (fds[2].revents & POLLIN) {
+                char wake[64];
+                while (read(ssh_client->wake_fd[0], wake, sizeof(wake)) > 0);
+            }
+
         }
 
     }
 
-    /* Kill client and Wait for input thread to die */
+    /* Kill client */
     guac_client_stop(client);
-    pthread_join(input_thread, NULL);
-
-    pthread_mutex_destroy(&ssh_client->term_channel_lock);
+    guac_mem_free(buffer);
 
     guac_client_log(client, GUAC_LOG_INFO, "SSH connection ended.");
     return NULL;
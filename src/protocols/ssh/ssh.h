@@ -40,6 +40,14 @@
 
 #include <pthread.h>
 
+/**
+ * The maximum number of bytes of terminal input to read from STDIN and send
+ * along the SSH channel at once. Interactive keystrokes are always sent
+ * immediately, while data arriving faster than it can be sent (pastes and
+ * input streams) accumulates and is sent in batches of up to this size.
+ */
+#define GUAC_SSH_STDIN_BUFFER_SIZE 32768
+
 /**
  * SSH-specific client data.
  */
@@ -60,6 +68,13 @@ typedef struct guac_ssh_client {
      */
     guac_copilot* copilot;
 
+    /**
+     * The state of the matcher used by guac_ssh_copilot_track_output() to
+     * scan terminal output for errors, such that errors split across
+     * separate reads are still detected.
+     */
+    int copilot_scan_state;
+
 #ifdef ENABLE_SSH_AGENT
     /**
      * The current agent, if any.
@@ -93,14 +108,42 @@ typedef struct guac_ssh_client {
     guac_common_ssh_sftp_filesystem* sftp_filesystem;
 
     /**
-     * SSH terminal channel, used by the SSH client thread.
+     * SSH terminal channel. Once the SSH connection is established, this
+     * channel is used exclusively by the SSH client thread, which handles
+     * all reads and writes from a single event loop.
      */
     LIBSSH2_CHANNEL* term_channel;
 
     /**
-     * Lock dictating access to the SSH terminal channel.
+     * Pipe used to wake the SSH client thread when a request must be handled
+     * by that thread (such as a change in pty size). The SSH client thread
+     * reads from the first file descriptor, while other threads write to the
+     * second. Both file descriptors are -1 if the pipe has not been created.
+     */
+    int wake_fd[2];
+
+    /**
+     * Lock guarding pty_size_pending, pty_columns, and pty_rows.
+     */
+    pthread_mutex_t pty_size_lock;
+
+    /**
+     * Whether the pty of the terminal channel must be resized to pty_columns
+     * and pty_rows by the SSH client thread.
      */
-    pthread_mutex_t term_channel_lock;
+    int pty_size_pending;
+
+    /**
+     * The width that the pty of the terminal channel should have, in
+     * characters.
+     */
+    int pty_columns;
+
+    /**
+     * The height that the pty of the terminal channel should have, in
+     * characters.
+     */
+    int pty_rows;
 
     /**
      * The terminal which will render all output from the SSH client.
@@ -128,5 +171,24 @@ typedef struct guac_ssh_client {
  */
 void* ssh_client_thread(void* data);
 
+/**
+ * Requests that the pty of the terminal channel be resized to the given
+ * dimensions. The request is sent by the SSH client thread, which is woken
+ * if necessary, such that this function may safely be invoked from any
+ * thread. If the terminal channel has not yet been opened, this function
+ * has no effect.
+ *
+ * @param ssh_client
+ *     The SSH client whose pty should be resized.
+ *
+ * @param columns
+ *     The desired width of the pty, in characters.
+ *
+ * @param rows
+ *     The desired height of the pty, in characters.
+ */
+void guac_ssh_request_pty_size(guac_ssh_client* ssh_client, int columns,
+        int rows);
+
 #endif
 
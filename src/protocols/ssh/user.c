@@ -109,6 +109,9 @@ int guac_ssh_user_leave_handler(guac_user* user) {
     /* Remove the user from the terminal */
     guac_terminal_remove_user(ssh_client->term, user);
 
+    /* Abandon any copilot queries made on behalf of the user */
+    guac_copilot_cancel_queries(ssh_client->copilot, user);
+
     /* Free settings if not owner (owner settings will be freed with client) */
     if (!user->owner) {
         guac_ssh_settings* settings = (guac_ssh_settings*) user->data;
@@ -21,7 +21,9 @@
 #define GUAC_TELNET_SETTINGS_H
 
 #include "config.h"
+#include "terminal/typescript.h"
 
+#include <guacamole/recording.h>
 #include <guacamole/user.h>
 
 #include <sys/types.h>
@@ -207,6 +209,16 @@ typedef struct guac_telnet_settings {
      */
     bool typescript_write_existing;
 
+    /**
+     * The layout of the files that make up the typescript, if enabled.
+     */
+    guac_terminal_typescript_format typescript_format;
+
+    /**
+     * Whether the typescript files should be compressed with zstd.
+     */
+    bool typescript_compress;
+
     /**
      * The path in which the screen recording should be saved, if enabled. If
      * no screen recording should be saved, this will be NULL.
@@ -256,6 +268,23 @@ typedef struct guac_telnet_settings {
      */
     bool recording_write_existing;
 
+    /**
+     * The behavior to use if session data is produced faster than it can be
+     * written to the recording file.
+     */
+    guac_recording_overflow recording_overflow;
+
+    /**
+     * The format of the recording file.
+     */
+    guac_recording_format recording_format;
+
+    /**
+     * Whether included input events should also be written to a separate,
+     * compact binary file alongside the recording.
+     */
+    bool recording_write_events;
+
     /**
      * The ASCII code, as an integer, that the telnet client will use when the
      * backspace key is pressed.  By default, this is 127, ASCII delete, if
@@ -269,6 +269,54 @@ static void guac_telnet_search(guac_client* client, const char* buffer, int size
  * telnet_init() and will be called for every event fired by libtelnet,
  * including feature enable/disable and receipt/transmission of data.
  */
+/**
+ * Writes all terminal output that has been received from the telnet server
+ * but not yet written to the terminal.
+ *
+ * @param telnet_client
+ *     The telnet client whose pending terminal output should be written.
+ */
+static void guac_telnet_flush_output(guac_telnet_client* telnet_client) {
+
+    if (telnet_client->output_length > 0) {
+        guac_terminal_write(telnet_client->term, telnet_client->output_buffer,
+                telnet_client->output_length);
+        telnet_client->output_length = 0;
+    }
+
+}
+
+/**
+ * Adds the given terminal output to the output pending for the terminal,
+ * writing any pending output first if there is insufficient space.
+ *
+ * @param telnet_client
+ *     The telnet client that received the given terminal output.
+ *
+ * @param buffer
+ *     The terminal output received.
+ *
+ * @param size
+ *     The number of bytes of terminal output received.
+ */
+static void guac_telnet_queue_output(guac_telnet_client* telnet_client,
+        const char* buffer, int size) {
+
+    if (telnet_client->output_length + size > telnet_client->output_size)
+        guac_telnet_flush_output(telnet_client);
+
+    /* Output that cannot be buffered at all is written directly */
+    if (size > telnet_client->output_size) {
+        guac_terminal_write(telnet_client->term, buffer, size);
+        return;
+    }
+
+    memcpy(telnet_client->output_buffer + telnet_client->output_length,
+            buffer, size);
+    telnet_client->output_length += size;
+
+}
+
 static void __guac_telnet_event_handler(telnet_t* telnet, telnet_event_t* event, void* data) {
 
     guac_client* client = (guac_client*) data;
@@ -279,7 +327,7 @@ static void __guac_telnet_event_handler(telnet_t* telnet, telnet_event_t* event,
 
         /* Terminal output received */
         case TELNET_EV_DATA:
-            guac_terminal_write(telnet_client->term, event->data.buffer, event->data.size);
+            guac_telnet_queue_output(telnet_client, event->data.buffer, event->data.size);
             guac_telnet_search(client, event->data.buffer, event->data.size);
             break;
 
@@ -386,7 +434,15 @@ static telnet_t* __guac_telnet_create_session(guac_client* client) {
     guac_telnet_client* telnet_client = (guac_telnet_client*) client->data;
     guac_telnet_settings* settings = telnet_client->settings;
 
-    int fd = guac_tcp_connect(settings->hostname, settings->port, settings->timeout);
+    guac_tcp_connect_timings timings;
+    int fd = guac_tcp_connect_timed(settings->hostname, settings->port,
+            settings->timeout, &timings);
+
+    /* Report time spent resolving and connecting to the telnet server */
+    if (fd >= 0) {
+        guac_client_record_connect_phase(client, "resolve", timings.resolve);
+        guac_client_record_connect_phase(client, "connect", timings.connect);
+    }
 
     /* Open telnet session */
     telnet_t* telnet = telnet_init(__telnet_options, __guac_telnet_event_handler, 0, client);
@@ -490,7 +546,6 @@ void* guac_telnet_client_thread(void* data) {
     guac_telnet_settings* settings = telnet_client->settings;
 
     pthread_t input_thread;
-    char buffer[8192];
     int wait_result;
 
     /* If Wake-on-LAN is enabled, attempt to wake. */
@@ -537,7 +592,11 @@ void* guac_telnet_client_thread(void* data) {
                 !settings->recording_exclude_mouse,
                 0, /* Touch events not supported */
                 settings->recording_include_keys,
-                settings->recording_write_existing);
+                settings->recording_write_existing,
+                settings->recording_write_events,
+                settings->recording_overflow,
+                settings->recording_format,
+                0 /* Output is always copied as sent to users */);
     }
 
     /* Create terminal options with required parameters */
@@ -576,7 +635,9 @@ void* guac_telnet_client_thread(void* data) {
                 settings->typescript_path,
                 settings->typescript_name,
                 settings->create_typescript_path,
-                settings->typescript_write_existing);
+                settings->typescript_write_existing,
+                settings->typescript_format,
+                settings->typescript_compress);
     }
 
     /* Open telnet session */
@@ -601,6 +662,14 @@ void* guac_telnet_client_thread(void* data) {
         return NULL;
     }
 
+    /* Allocate buffers for data read from the socket and for the terminal
+     * output it contains */
+    int read_size = GUAC_TELNET_MIN_READ_SIZE;
+    char* buffer = guac_mem_alloc(read_size);
+    telnet_client->output_buffer = guac_mem_alloc(read_size);
+    telnet_client->output_size = read_size;
+    telnet_client->output_length = 0;
+
     /* While data available, write to terminal */
     while ((wait_result = __guac_telnet_wait(telnet_client->socket_fd)) >= 0) {
 
@@ -608,11 +677,23 @@ void* guac_telnet_client_thread(void* data) {
         if (wait_result == 0)
             continue;
 
-        int bytes_read = read(telnet_client->socket_fd, buffer, sizeof(buffer));
+        int bytes_read = read(telnet_client->socket_fd, buffer, read_size);
         if (bytes_read <= 0)
             break;
 
+        /* Write all terminal output within the data read at once */
         telnet_recv(telnet_client->telnet, buffer, bytes_read);
+        guac_telnet_flush_output(telnet_client);
+
+        /* Read more at once if the server is sending faster than the current
+         * read size allows */
+        if (bytes_read == read_size && read_size < GUAC_TELNET_MAX_READ_SIZE) {
+            read_size *= 2;
+            buffer = guac_mem_realloc_or_die(buffer, read_size);
+            telnet_client->output_buffer = guac_mem_realloc_or_die(
+                    telnet_client->output_buffer, read_size);
+            telnet_client->output_size = read_size;
+        }
 
     }
 
@@ -620,6 +701,10 @@ void* guac_telnet_client_thread(void* data) {
     guac_client_stop(client);
     pthread_join(input_thread, NULL);
 
+    guac_mem_free(buffer);
+    guac_mem_free(telnet_client->output_buffer);
+    telnet_client->output_buffer = NULL;
+
     guac_client_log(client, GUAC_LOG_INFO, "Telnet connection ended.");
     return NULL;
 
@@ -29,6 +29,20 @@
 
 #include <stdint.h>
 
+/**
+ * The number of bytes initially requested by each read from the socket
+ * connected to the telnet server.
+ */
+#define GUAC_TELNET_MIN_READ_SIZE 8192
+
+/**
+ * The maximum number of bytes requested by each read from the socket
+ * connected to the telnet server. The read size doubles from
+ * GUAC_TELNET_MIN_READ_SIZE each time a read fills the entire buffer, up to
+ * this limit.
+ */
+#define GUAC_TELNET_MAX_READ_SIZE 131072
+
 /**
  * Telnet-specific client data.
  */
@@ -71,6 +85,24 @@ typedef struct guac_telnet_client {
      */
     guac_terminal* term;
 
+    /**
+     * Terminal output received from the telnet server that has not yet been
+     * written to the terminal. Data events produced by libtelnet for a single
+     * read from the socket are combined here and written to the terminal at
+     * once. This buffer is used only by the telnet client thread.
+     */
+    char* output_buffer;
+
+    /**
+     * The number of bytes of terminal output within output_buffer.
+     */
+    int output_length;
+
+    /**
+     * The size of output_buffer, in bytes.
+     */
+    int output_size;
+
     /**
      * The in-progress session recording, or NULL if no recording is in
      * progress.
@@ -115,12 +115,19 @@ int guac_client_init(guac_client* client) {
     /* Initialize the message lock. */
     pthread_mutex_init(&(vnc_client->message_lock), NULL);
 
+    /* Initialize the queue of input events awaiting the input thread */
+    guac_fifo_lockfree_init(&vnc_client->input_events,
+            &vnc_client->input_events_items, vnc_client->input_events_sequences,
+            GUAC_VNC_INPUT_EVENT_QUEUE_SIZE, sizeof(guac_vnc_input_event));
+
     /* Set handlers */
     client->join_handler = guac_vnc_user_join_handler;
     client->join_pending_handler = guac_vnc_join_pending_handler;
     client->leave_handler = guac_vnc_user_leave_handler;
     client->free_handler = guac_vnc_client_free_handler;
 
+    client->coalesce_mouse = 1;
+
     return 0;
 }
 
@@ -141,6 +148,11 @@ int guac_vnc_client_free_handler(guac_client* client) {
         /* Wait for client thread to finish */
         pthread_join(vnc_client->client_thread, NULL);
 
+        /* Wait for input thread to finish */
+        guac_fifo_lockfree_invalidate(&vnc_client->input_events);
+        if (vnc_client->input_thread_started)
+            pthread_join(vnc_client->input_thread, NULL);
+
         /* Free memory that may not be free'd by libvncclient's
          * rfbClientCleanup() prior to libvncclient 0.9.12 */
 
@@ -196,6 +208,12 @@ int guac_vnc_client_free_handler(guac_client* client) {
     if (vnc_client->clipboard != NULL)
         guac_common_clipboard_free(vnc_client->clipboard);
 
+    /* Free pixel format conversion tables */
+    guac_vnc_converter_free(&(vnc_client->converter));
+
+    /* Free cached cursor images */
+    guac_vnc_cursor_cache_free(vnc_client->cursor_cache);
+
     /* Free display */
     if (vnc_client->display != NULL)
         guac_display_free(vnc_client->display);
@@ -218,6 +236,9 @@ int guac_vnc_client_free_handler(guac_client* client) {
     /* Clean up the message lock. */
     pthread_mutex_destroy(&(vnc_client->message_lock));
 
+    /* Clean up the input event queue */
+    guac_fifo_lockfree_destroy(&vnc_client->input_events);
+
     /* Free generic data struct */
     guac_mem_free(client->data);
 
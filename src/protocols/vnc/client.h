@@ -32,6 +32,15 @@
  */
 #define GUAC_VNC_MESSAGE_CHECK_INTERVAL 1000
 
+/**
+ * The maximum amount of time to wait for the changes from a framebuffer update
+ * to be sent to users before handling further messages from the VNC server,
+ * in milliseconds. This must be large enough to cover the lag compensation
+ * performed by the guac_display render thread, but small enough that other
+ * messages from the VNC server are not unreasonably delayed.
+ */
+#define GUAC_VNC_MAX_FRAME_WAIT 750
+
 /**
  * The number of milliseconds to wait between connection attempts.
  */
@@ -0,0 +1,450 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "convert.h"
+
+#include <guacamole/mem.h>
+#include <rfb/rfbclient.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define GUAC_VNC_CONVERT_SSE2
+#endif
+
+/**
+ * Returns the value of the given component of the given VNC pixel, scaled to
+ * the range 0 through 255.
+ *
+ * @param value
+ *     The VNC pixel value.
+ *
+ * @param shift
+ *     The number of bits the component is shifted left within the pixel.
+ *
+ * @param max
+ *     The maximum value of the component.
+ *
+ * @return
+ *     The value of the component, scaled to the range 0 through 255.
+ */
+static uint32_t guac_vnc_convert_component(uint32_t value, int shift,
+        int max) {
+    return ((value >> shift) & max) * 0x100 / (max + 1);
+}
+
+/**
+ * Converts the given VNC pixel value to the 32-bit RGB format used by
+ * guac_display, without the aid of any lookup tables.
+ *
+ * @param format
+ *     The pixel format of the VNC pixel.
+ *
+ * @param swap_red_blue
+ *     Non-zero if the red and blue components should be swapped, zero
+ *     otherwise.
+ *
+ * @param value
+ *     The VNC pixel value.
+ *
+ * @return
+ *     The converted pixel.
+ */
+static uint32_t guac_vnc_convert_pixel(const rfbPixelFormat* format,
+        int swap_red_blue, uint32_t value) {
+
+    uint32_t red   = guac_vnc_convert_component(value, format->redShift,   format->redMax);
+    uint32_t green = guac_vnc_convert_component(value, format->greenShift, format->greenMax);
+    uint32_t blue  = guac_vnc_convert_component(value, format->blueShift,  format->blueMax);
+
+    if (swap_red_blue)
+        return 0xFF000000 | (blue << 16) | (green << 8) | red;
+
+    return 0xFF000000 | (red << 16) | (green << 8) | blue;
+
+}
+
+/**
+ * Returns the number of bits within the given component maximum if that
+ * maximum is one less than a power of two no greater than 256, such that
+ * scaling the component to 8 bits is only a shift, or zero otherwise.
+ *
+ * @param max
+ *     The maximum value of the component.
+ *
+ * @return
+ *     The number of bits in the component, or zero.
+ */
+static int guac_vnc_convert_component_bits(int max) {
+
+    for (int bits = 1; bits <= 8; bits++) {
+        if (max == (1 << bits) - 1)
+            return bits;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Implementation of guac_vnc_convert_row_function for 8-bit pixel formats,
+ * translating each pixel through the lookup table of the converter.
+ *
+ * @see guac_vnc_convert_row_function
+ */
+static void guac_vnc_convert_row_8(const guac_vnc_converter* converter,
+        const unsigned char* restrict src, uint32_t* restrict dst, int width) {
+
+    const uint32_t* table = converter->table;
+    for (int x = 0; x < width; x++)
+        dst[x] = table[src[x]];
+
+}
+
+/**
+ * Implementation of guac_vnc_convert_row_function for 16-bit pixel formats,
+ * translating each pixel through the lookup table of the converter.
+ *
+ * @see guac_vnc_convert_row_function
+ */
+static void guac_vnc_convert_row_16(const guac_vnc_converter* converter,
+        const unsigned char* restrict src, uint32_t* restrict dst, int width) {
+
+    const uint32_t* table = converter->table;
+    for (int x = 0; x < width; x++) {
+        uint16_t value;
+        memcpy(&value, src + x * 2, sizeof(value));
+        dst[x] = table[value];
+    }
+
+}
+
+/**
+ * Implementation of guac_vnc_convert_row_function for 32-bit pixel formats in
+ * which no component has more than 256 possible values, combining the
+ * contribution of each component from the lookup tables of the converter.
+ *
+ * @see guac_vnc_convert_row_function
+ */
+static void guac_vnc_convert_row_32(const guac_vnc_converter* converter,
+        const unsigned char* restrict src, uint32_t* restrict dst, int width) {
+
+    const rfbPixelFormat* format = &converter->format;
+    for (int x = 0; x < width; x++) {
+
+        uint32_t value;
+        memcpy(&value, src + x * 4, sizeof(value));
+
+        dst[x] = 0xFF000000
+            | converter->red[(value >> format->redShift) & format->redMax]
+            | converter->green[(value >> format->greenShift) & format->greenMax]
+            | converter->blue[(value >> format->blueShift) & format->blueMax];
+
+    }
+
+}
+
+/**
+ * Implementation of guac_vnc_convert_row_function for 32-bit pixel formats in
+ * which some component has more than 256 possible values, converting each
+ * pixel arithmetically.
+ *
+ * @see guac_vnc_convert_row_function
+ */
+static void guac_vnc_convert_row_32_generic(const guac_vnc_converter* converter,
+        const unsigned char* restrict src, uint32_t* restrict dst, int width) {
+
+    for (int x = 0; x < width; x++) {
+        uint32_t value;
+        memcpy(&value, src + x * 4, sizeof(value));
+        dst[x] = guac_vnc_convert_pixel(&converter->format,
+                converter->swap_red_blue, value);
+    }
+
+}
+
+/**
+ * Swaps the red and blue components of the given 32-bit RGB pixel, forcing
+ * the alpha component to 0xFF.
+ *
+ * @param value
+ *     The pixel to convert.
+ *
+ * @return
+ *     The converted pixel.
+ */
+static uint32_t guac_vnc_convert_swap_pixel(uint32_t value) {
+    return 0xFF000000 | (value & 0x0000FF00)
+        | ((value >> 16) & 0xFF) | ((value & 0xFF) << 16);
+}
+
+/**
+ * Implementation of guac_vnc_convert_row_function for the 32-bit pixel format
+ * natively used by guac_display, but with the red and blue components
+ * swapped.
+ *
+ * @see guac_vnc_convert_row_function
+ */
+static void guac_vnc_convert_row_32_swap(const guac_vnc_converter* converter,
+        const unsigned char* restrict src, uint32_t* restrict dst, int width) {
+
+    int x = 0;
+
+#ifdef GUAC_VNC_CONVERT_SSE2
+    /* Swap four pixels at a time. SSE2 is part of the baseline x86-64
+     * instruction set and thus requires no runtime check. */
+    const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+    const __m128i green = _mm_set1_epi32(0x0000FF00);
+    const __m128i low = _mm_set1_epi32(0x000000FF);
+    for (; x + 4 <= width; x += 4) {
+
+        __m128i value = _mm_loadu_si128((const __m128i*) (src + x * 4));
+
+        __m128i result = _mm_or_si128(alpha, _mm_and_si128(value, green));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_srli_epi32(value, 16), low));
+        result = _mm_or_si128(result, _mm_slli_epi32(_mm_and_si128(value, low), 16));
+
+        _mm_storeu_si128((__m128i*) (dst + x), result);
+
+    }
+#endif
+
+    for (; x < width; x++) {
+        uint32_t value;
+        memcpy(&value, src + x * 4, sizeof(value));
+        dst[x] = guac_vnc_convert_swap_pixel(value);
+    }
+
+}
+
+#ifdef GUAC_VNC_CONVERT_SSE2
+
+/**
+ * Implementation of guac_vnc_convert_row_function for 16-bit pixel formats in
+ * which every component has a power-of-two number of possible values (such as
+ * RGB565 and RGB555), such that each component can be scaled to 8 bits using
+ * only shifts. Eight pixels are converted at a time.
+ *
+ * @see guac_vnc_convert_row_function
+ */
+static void guac_vnc_convert_row_16_sse2(const guac_vnc_converter* converter,
+        const unsigned char* restrict src, uint32_t* restrict dst, int width) {
+
+    const rfbPixelFormat* format = &converter->format;
+
+    /* Components destined for the low bits of the output, before any swap */
+    int low_shift = format->blueShift;
+    int low_max = format->blueMax;
+    int high_shift = format->redShift;
+    int high_max = format->redMax;
+
+    if (converter->swap_red_blue) {
+        low_shift = format->redShift;
+        low_max = format->redMax;
+        high_shift = format->blueShift;
+        high_max = format->blueMax;
+    }
+
+    const __m128i low_count = _mm_cvtsi32_si128(low_shift);
+    const __m128i low_mask = _mm_set1_epi16(low_max);
+    const __m128i low_scale = _mm_cvtsi32_si128(8 - guac_vnc_convert_component_bits(low_max));
+
+    const __m128i green_count = _mm_cvtsi32_si128(format->greenShift);
+    const __m128i green_mask = _mm_set1_epi16(format->greenMax);
+    const __m128i green_scale = _mm_cvtsi32_si128(16 - guac_vnc_convert_component_bits(format->greenMax));
+
+    const __m128i high_count = _mm_cvtsi32_si128(high_shift);
+    const __m128i high_mask = _mm_set1_epi16(high_max);
+    const __m128i high_scale = _mm_cvtsi32_si128(8 - guac_vnc_convert_component_bits(high_max));
+
+    const __m128i alpha = _mm_set1_epi16((short) 0xFF00);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+
+        __m128i value = _mm_loadu_si128((const __m128i*) (src + x * 2));
+
+        /* Scale each component to 8 bits within each 16-bit lane ... */
+        __m128i low = _mm_sll_epi16(_mm_and_si128(_mm_srl_epi16(value, low_count), low_mask), low_scale);
+        __m128i green = _mm_sll_epi16(_mm_and_si128(_mm_srl_epi16(value, green_count), green_mask), green_scale);
+        __m128i high = _mm_sll_epi16(_mm_and_si128(_mm_srl_epi16(value, high_count), high_mask), high_scale);
+
+        /* ... combine into the low and high halves of each output pixel ... */
+        __m128i low_half = _mm_or_si128(low, green);
+        __m128i high_half = _mm_or_si128(high, alpha);
+
+        /* ... and interleave those halves into complete pixels */
+        _mm_storeu_si128((__m128i*) (dst + x), _mm_unpacklo_epi16(low_half, high_half));
+        _mm_storeu_si128((__m128i*) (dst + x + 4), _mm_unpackhi_epi16(low_half, high_half));
+
+    }
+
+    /* Convert any remaining pixels individually */
+    guac_vnc_convert_row_16(converter, src + x * 2, dst + x, width - x);
+
+}
+
+#endif
+
+void guac_vnc_converter_init(guac_vnc_converter* converter,
+        const rfbPixelFormat* format, int swap_red_blue) {
+
+    guac_vnc_converter_free(converter);
+
+    converter->format = *format;
+    converter->swap_red_blue = swap_red_blue;
+
+    switch (format->bitsPerPixel) {
+
+        /* Convert 8-bit and 16-bit pixels through a table covering every
+         * possible pixel value */
+        case 8:
+        case 16: {
+
+            size_t length = (size_t) 1 << format->bitsPerPixel;
+            converter->table = guac_mem_alloc(sizeof(uint32_t), length);
+
+            for (size_t value = 0; value < length; value++)
+                converter->table[value] = guac_vnc_convert_pixel(format,
+                        swap_red_blue, value);
+
+            if (format->bitsPerPixel == 8) {
+                converter->convert_row = guac_vnc_convert_row_8;
+                break;
+            }
+
+            converter->convert_row = guac_vnc_convert_row_16;
+
+#ifdef GUAC_VNC_CONVERT_SSE2
+            /* Formats like RGB565 and RGB555 need only shifts */
+            if (guac_vnc_convert_component_bits(format->redMax)
+                    && guac_vnc_convert_component_bits(format->greenMax)
+                    && guac_vnc_convert_component_bits(format->blueMax))
+                converter->convert_row = guac_vnc_convert_row_16_sse2;
+#endif
+
+            break;
+
+        }
+
+        default:
+
+            /* The native format of guac_display need only have its red and
+             * blue components swapped */
+            if (swap_red_blue && format->redShift == 16 && format->greenShift == 8
+                    && format->blueShift == 0 && format->redMax == 0xFF
+                    && format->greenMax == 0xFF && format->blueMax == 0xFF) {
+                converter->convert_row = guac_vnc_convert_row_32_swap;
+                break;
+            }
+
+            /* Components with more than 256 values cannot be tabulated */
+            if (format->redMax > 0xFF || format->greenMax > 0xFF
+                    || format->blueMax > 0xFF) {
+                converter->convert_row = guac_vnc_convert_row_32_generic;
+                break;
+            }
+
+            for (int value = 0; value < 256; value++) {
+
+                uint32_t red   = value <= format->redMax   ? value * 0x100 / (format->redMax   + 1) : 0;
+                uint32_t green = value <= format->greenMax ? value * 0x100 / (format->greenMax + 1) : 0;
+                uint32_t blue  = value <= format->blueMax  ? value * 0x100 / (format->blueMax  + 1) : 0;
+
+                converter->red[value]   = swap_red_blue ? red  : red  << 16;
+                converter->green[value] = green << 8;
+                converter->blue[value]  = swap_red_blue ? blue << 16 : blue;
+
+            }
+
+            converter->convert_row = guac_vnc_convert_row_32;
+            break;
+
+    }
+
+}
+
+int guac_vnc_converter_matches(const guac_vnc_converter* converter,
+        const rfbPixelFormat* format, int swap_red_blue) {
+
+    const rfbPixelFormat* current = &converter->format;
+
+    return converter->convert_row != NULL
+        && converter->swap_red_blue == swap_red_blue
+        && current->bitsPerPixel == format->bitsPerPixel
+        && current->redShift   == format->redShift
+        && current->greenShift == format->greenShift
+        && current->blueShift  == format->blueShift
+        && current->redMax     == format->redMax
+        && current->greenMax   == format->greenMax
+        && current->blueMax    == format->blueMax;
+
+}
+
+void guac_vnc_converter_free(guac_vnc_converter* converter) {
+    guac_mem_free(converter->table);
+    converter->table = NULL;
+    converter->convert_row = NULL;
+}
+
+void guac_vnc_convert_apply_mask(const unsigned char* restrict mask,
+        uint32_t* restrict dst, int width) {
+
+    int x = 0;
+
+#ifdef GUAC_VNC_CONVERT_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+
+    /* Clear the alpha component of every pixel whose mask value is zero,
+     * sixteen pixels at a time */
+    for (; x + 16 <= width; x += 16) {
+
+        /* Expand each transparent mask byte to a full 32-bit lane */
+        __m128i transparent = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (mask + x)), zero);
+        __m128i low = _mm_unpacklo_epi8(transparent, transparent);
+        __m128i high = _mm_unpackhi_epi8(transparent, transparent);
+
+        __m128i lanes[4] = {
+            _mm_unpacklo_epi16(low, low),
+            _mm_unpackhi_epi16(low, low),
+            _mm_unpacklo_epi16(high, high),
+            _mm_unpackhi_epi16(high, high)
+        };
+
+        for (int i = 0; i < 4; i++) {
+            __m128i* pixels = (__m128i*) (dst + x + i * 4);
+            __m128i value = _mm_loadu_si128(pixels);
+            _mm_storeu_si128(pixels, _mm_andnot_si128(_mm_and_si128(lanes[i], alpha), value));
+        }
+
+    }
+#endif
+
+    /* Apply the mask to any remaining pixels individually */
+    for (; x < width; x++) {
+        if (!mask[x])
+            dst[x] &= 0x00FFFFFF;
+    }
+
+}
@@ -0,0 +1,173 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_VNC_CONVERT_H
+#define GUAC_VNC_CONVERT_H
+
+#include "config.h"
+
+#include <rfb/rfbclient.h>
+
+#include <stdint.h>
+
+/**
+ * The state required to convert pixels from the pixel format of a VNC
+ * framebuffer to the 32-bit RGB format used by guac_display.
+ */
+typedef struct guac_vnc_converter guac_vnc_converter;
+
+/**
+ * A function which converts a single row of pixels from the pixel format of a
+ * VNC framebuffer to the 32-bit RGB format used by guac_display. The alpha
+ * component of each converted pixel is always 0xFF.
+ *
+ * @param converter
+ *     The converter describing the pixel format of the VNC framebuffer.
+ *
+ * @param src
+ *     The first pixel of the row within the VNC framebuffer.
+ *
+ * @param dst
+ *     The first pixel of the row within the guac_display buffer.
+ *
+ * @param width
+ *     The number of pixels within the row.
+ */
+typedef void guac_vnc_convert_row_function(const guac_vnc_converter* converter,
+        const unsigned char* restrict src, uint32_t* restrict dst, int width);
+
+struct guac_vnc_converter {
+
+    /**
+     * The VNC pixel format that this converter was built for.
+     */
+    rfbPixelFormat format;
+
+    /**
+     * Non-zero if the red and blue components are swapped by this converter,
+     * zero otherwise.
+     */
+    int swap_red_blue;
+
+    /**
+     * The fastest function able to convert rows of pixels in the pixel format
+     * of this converter.
+     */
+    guac_vnc_convert_row_function* convert_row;
+
+    /**
+     * For 8-bit and 16-bit pixel formats, a table containing the converted
+     * value of every possible pixel value, indexed by that value. This is
+     * NULL for 32-bit pixel formats.
+     */
+    uint32_t* table;
+
+    /**
+     * For 32-bit pixel formats in which no component has more than 256
+     * possible values, the value contributed to each converted pixel by each
+     * possible value of the red component.
+     */
+    uint32_t red[256];
+
+    /**
+     * For 32-bit pixel formats in which no component has more than 256
+     * possible values, the value contributed to each converted pixel by each
+     * possible value of the green component.
+     */
+    uint32_t green[256];
+
+    /**
+     * For 32-bit pixel formats in which no component has more than 256
+     * possible values, the value contributed to each converted pixel by each
+     * possible value of the blue component.
+     */
+    uint32_t blue[256];
+
+};
+
+/**
+ * Builds the lookup tables and selects the conversion function required to
+ * convert pixels in the given VNC pixel format, replacing any tables built by
+ * a previous call to this function. The converter must either be zeroed or
+ * have been initialized by a previous call to this function.
+ *
+ * @param converter
+ *     The converter to build.
+ *
+ * @param format
+ *     The pixel format of the VNC framebuffer.
+ *
+ * @param swap_red_blue
+ *     Non-zero if the red and blue components should be swapped, zero
+ *     otherwise.
+ */
+void guac_vnc_converter_init(guac_vnc_converter* converter,
+        const rfbPixelFormat* format, int swap_red_blue);
+
+/**
+ * Returns whether the given converter was built for the given VNC pixel
+ * format by guac_vnc_converter_init().
+ *
+ * @param converter
+ *     The converter to test.
+ *
+ * @param format
+ *     The pixel format of the VNC framebuffer.
+ *
+ * @param swap_red_blue
+ *     Non-zero if the red and blue components should be swapped, zero
+ *     otherwise.
+ *
+ * @return
+ *     Non-zero if the converter was built for the given pixel format, zero
+ *     otherwise.
+ */
+int guac_vnc_converter_matches(const guac_vnc_converter* converter,
+        const rfbPixelFormat* format, int swap_red_blue);
+
+/**
+ * Frees any lookup tables built for the given converter by
+ * guac_vnc_converter_init(). The converter itself is not freed.
+ *
+ * @param converter
+ *     The converter whose lookup tables should be freed.
+ */
+void guac_vnc_converter_free(guac_vnc_converter* converter);
+
+/**
+ * Applies the given cursor mask to a row of pixels previously converted with
+ * a guac_vnc_convert_row_function, making each pixel fully transparent if its
+ * corresponding mask value is zero. Pixels whose mask value is non-zero are
+ * left fully opaque.
+ *
+ * @param mask
+ *     The mask values of the row, one byte per pixel, as provided by
+ *     libvncclient for cursor images.
+ *
+ * @param dst
+ *     The first converted pixel of the row.
+ *
+ * @param width
+ *     The number of pixels within the row.
+ */
+void guac_vnc_convert_apply_mask(const unsigned char* restrict mask,
+        uint32_t* restrict dst, int width);
+
+#endif
@@ -20,6 +20,8 @@
 #include "config.h"
 
 #include "client.h"
+#include "convert.h"
+#include "cursor.h"
 #include "vnc.h"
 
 #include <guacamole/client.h>
@@ -27,6 +29,7 @@
 #include <guacamole/layer.h>
 #include <guacamole/mem.h>
 #include <guacamole/protocol.h>
+#include <guacamole/rect.h>
 #include <guacamole/socket.h>
 #include <rfb/rfbclient.h>
 #include <rfb/rfbproto.h>
@@ -35,85 +38,191 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 
-void guac_vnc_cursor(rfbClient* client, int x, int y, int w, int h, int vnc_bpp) {
+/**
+ * Returns a 64-bit FNV-1a hash of the given cursor image and mask, exactly as
+ * received from the VNC server, and its dimensions.
+ *
+ * @param data
+ *     The cursor image followed by its mask.
+ *
+ * @param length
+ *     The length of data, in bytes.
+ *
+ * @param width
+ *     The width of the cursor image, in pixels.
+ *
+ * @param height
+ *     The height of the cursor image, in pixels.
+ *
+ * @return
+ *     A hash of the given cursor image.
+ */
+static uint64_t guac_vnc_cursor_hash(const unsigned char* data, size_t length,
+        int width, int height) {
 
-    guac_client* gc = rfbClientGetClientData(client, GUAC_VNC_CLIENT_KEY);
-    guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    hash = (hash ^ (uint64_t) width) * 0x100000001B3ULL;
+    hash = (hash ^ (uint64_t) height) * 0x100000001B3ULL;
+
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+
+    return hash;
+
+}
+
+/**
+ * Converts the given cursor image and mask, exactly as received from the VNC
+ * server, into a new buffer.
+ *
+ * @param vnc_client
+ *     The VNC client associated with the VNC session in which the cursor
+ *     image was received.
+ *
+ * @param client
+ *     The underlying rfbClient.
+ *
+ * @param data
+ *     The cursor image followed by its mask.
+ *
+ * @param width
+ *     The width of the cursor image, in pixels.
+ *
+ * @param height
+ *     The height of the cursor image, in pixels.
+ *
+ * @param vnc_bpp
+ *     The number of bytes in each pixel of the cursor image.
+ *
+ * @return
+ *     A new buffer containing the converted cursor image.
+ */
+static guac_display_layer* guac_vnc_cursor_convert(guac_vnc_client* vnc_client,
+        rfbClient* client, const unsigned char* data, int width, int height,
+        int vnc_bpp) {
+
+    /* Rebuild pixel conversion tables if the pixel format has changed */
+    guac_vnc_converter* converter = &(vnc_client->converter);
+    if (!guac_vnc_converter_matches(converter, &client->format,
+                vnc_client->settings->swap_red_blue))
+        guac_vnc_converter_init(converter, &client->format,
+                vnc_client->settings->swap_red_blue);
 
-    /* Begin drawing operation directly to cursor layer */
-    guac_display_layer* cursor_layer = guac_display_cursor(vnc_client->display);
-    guac_display_layer_resize(cursor_layer, w, h);
-    guac_display_set_cursor_hotspot(vnc_client->display, x, y);
-    guac_display_layer_raw_context* context = guac_display_layer_open_raw(cursor_layer);
+    guac_display_layer* buffer = guac_display_alloc_buffer(vnc_client->display, 0);
+    guac_display_layer_resize(buffer, width, height);
+    guac_display_layer_raw_context* context = guac_display_layer_open_raw(buffer);
 
     /* Convert operation coordinates to guac_rect for easier manipulation */
     guac_rect op_bounds;
-    guac_rect_init(&op_bounds, 0, 0, w, h);
+    guac_rect_init(&op_bounds, 0, 0, width, height);
 
-    /* Ensure draw is within current bounds of the pending frame */
+    /* Ensure draw is within current bounds of the buffer */
     guac_rect_constrain(&op_bounds, &context->bounds);
 
-    /* VNC image buffer */
-    unsigned char* vnc_current_row = client->rcSource;
-    unsigned char* vnc_mask        = client->rcMask;
-    size_t         vnc_stride      = guac_mem_ckd_mul_or_die(vnc_bpp, w);
+    /* VNC image and mask, where the mask immediately follows the image */
+    size_t vnc_stride = guac_mem_ckd_mul_or_die(vnc_bpp, width);
+    const unsigned char* vnc_current_row = data;
+    const unsigned char* vnc_mask = data + guac_mem_ckd_mul_or_die(vnc_stride, height);
 
-    /* Copy image data from VNC client to RGBA buffer */
+    /* Convert each row, applying the mask as alpha */
     unsigned char* layer_current_row = GUAC_RECT_MUTABLE_BUFFER(op_bounds, context->buffer, context->stride, GUAC_DISPLAY_LAYER_RAW_BPP);
-    for (int dy = 0; dy < h; dy++) {
+    for (int dy = 0; dy < guac_rect_height(&op_bounds); dy++) {
 
-        /* Get current Guacamole buffer row, advance to next */
         uint32_t* layer_current_pixel = (uint32_t*) layer_current_row;
-        layer_current_row += context->stride;
 
-        /* Get current VNC framebuffer row, advance to next */
-        const unsigned char* vnc_current_pixel = vnc_current_row;
+        converter->convert_row(converter, vnc_current_row, layer_current_pixel,
+                guac_rect_width(&op_bounds));
+        guac_vnc_convert_apply_mask(vnc_mask, layer_current_pixel,
+                guac_rect_width(&op_bounds));
+
+        layer_current_row += context->stride;
         vnc_current_row += vnc_stride;
+        vnc_mask += width;
 
-        for (int dx = 0; dx < w; dx++) {
+    }
 
-            /* Read current pixel value */
-            uint32_t v;
-            switch (vnc_bpp) {
-                case 4:
-                    v = *((uint32_t*) vnc_current_pixel);
-                    break;
+    /* Mark modified region as dirty */
+    guac_display_layer_raw_context_damage(context, &op_bounds);
 
-                case 2:
-                    v = *((uint16_t*) vnc_current_pixel);
-                    break;
+    guac_display_layer_close_raw(buffer, context);
+    return buffer;
 
-                default:
-                    v = *((uint8_t*)  vnc_current_pixel);
-            }
+}
 
-            /* Translate mask to alpha */
-            uint8_t alpha = *(vnc_mask++) ? 0xFF : 0x00;
+void guac_vnc_cursor(rfbClient* client, int x, int y, int w, int h, int vnc_bpp) {
 
-            /* Translate value to RGB */
-            uint8_t red   = (v >> client->format.redShift)   * 0x100 / (client->format.redMax   + 1);
-            uint8_t green = (v >> client->format.greenShift) * 0x100 / (client->format.greenMax + 1);
-            uint8_t blue  = (v >> client->format.blueShift)  * 0x100 / (client->format.blueMax  + 1);
+    guac_client* gc = rfbClientGetClientData(client, GUAC_VNC_CLIENT_KEY);
+    guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
 
-            /* Output ARGB */
-            if (vnc_client->settings->swap_red_blue)
-                *(layer_current_pixel++) = (alpha << 24) | (blue << 16) | (green << 8) | red;
-            else
-                *(layer_current_pixel++) = (alpha << 24) | (red  << 16) | (green << 8) | blue;
+    /* The cursor image and mask are cached exactly as received, such that
+     * cached cursors need not be converted at all */
+    size_t image_length = guac_mem_ckd_mul_or_die(vnc_bpp, w, h);
+    size_t mask_length = guac_mem_ckd_mul_or_die(w, h);
+    size_t length = guac_mem_ckd_add_or_die(image_length, mask_length);
+
+    unsigned char* data = guac_mem_alloc(length);
+    memcpy(data, client->rcSource, image_length);
+    memcpy(data + image_length, client->rcMask, mask_length);
+
+    uint64_t hash = guac_vnc_cursor_hash(data, length, w, h);
+    uint64_t now = ++vnc_client->cursor_cache_clock;
+
+    /* Find an identical cursor that has already been sent to connected
+     * users, noting the least-recently used entry in case there is none */
+    guac_vnc_cursor_cache_entry* cached = NULL;
+    guac_vnc_cursor_cache_entry* oldest = NULL;
+    for (int i = 0; i < GUAC_VNC_CURSOR_CACHE_SIZE; i++) {
+
+        guac_vnc_cursor_cache_entry* entry = &(vnc_client->cursor_cache[i]);
+        if (entry->layer != NULL && entry->hash == hash
+                && entry->width == w && entry->height == h
+                && entry->length == length
+                && !memcmp(entry->data, data, length)) {
+            cached = entry;
+            break;
+        }
 
-            /* Advance to next pixel in VNC framebuffer */
-            vnc_current_pixel += vnc_bpp;
+        if (oldest == NULL || entry->last_used < oldest->last_used)
+            oldest = entry;
 
-        }
     }
 
-    /* Mark modified region as dirty */
-    guac_rect_extend(&context->dirty, &op_bounds);
+    /* Convert and cache any new cursor, replacing the least-recently used
+     * cursor if the cache is full */
+    guac_display_layer* replaced = NULL;
+    if (cached == NULL) {
+
+        cached = oldest;
+        replaced = cached->layer;
+        guac_mem_free(cached->data);
+
+        *cached = (guac_vnc_cursor_cache_entry) {
+            .hash = hash,
+            .data = data,
+            .length = length,
+            .width = w,
+            .height = h,
+            .layer = guac_vnc_cursor_convert(vnc_client, client,
+                    data, w, h, vnc_bpp)
+        };
+
+    }
+
+    else
+        guac_mem_free(data);
+
+    cached->last_used = now;
+
+    /* Cached cursors cost only a single "cursor" instruction */
+    guac_display_set_cursor_buffer(vnc_client->display, cached->layer, x, y);
+
+    /* The replaced buffer may have been the cursor until now */
+    if (replaced != NULL)
+        guac_display_free_layer(replaced);
 
-    /* Draw operation is now complete */
-    guac_display_layer_close_raw(cursor_layer, context);
     guac_display_render_thread_notify_modified(vnc_client->render_thread);
 
     /* libvncclient does not free rcMask as it does rcSource */
@@ -124,3 +233,17 @@ void guac_vnc_cursor(rfbClient* client, int x, int y, int w, int h, int vnc_bpp)
 
 }
 
+void guac_vnc_cursor_cache_free(guac_vnc_cursor_cache_entry* cache) {
+
+    for (int i = 0; i < GUAC_VNC_CURSOR_CACHE_SIZE; i++) {
+
+        guac_vnc_cursor_cache_entry* entry = &(cache[i]);
+        if (entry->layer != NULL)
+            guac_display_free_layer(entry->layer);
+
+        guac_mem_free(entry->data);
+        *entry = (guac_vnc_cursor_cache_entry) { 0 };
+
+    }
+
+}
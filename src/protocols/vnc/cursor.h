@@ -22,9 +22,68 @@
 
 #include "config.h"
 
+#include <guacamole/display.h>
 #include <rfb/rfbclient.h>
 #include <rfb/rfbproto.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of distinct cursor images that may be cached within
+ * buffers during a VNC session.
+ */
+#define GUAC_VNC_CURSOR_CACHE_SIZE 16
+
+/**
+ * A distinct cursor image received from the VNC server, stored within a
+ * buffer that has been sent to all connected users. Setting the cursor to an
+ * image that has already been cached need only reference this buffer.
+ */
+typedef struct guac_vnc_cursor_cache_entry {
+
+    /**
+     * A hash of the cursor image and mask exactly as received from the VNC
+     * server, as well as its dimensions.
+     */
+    uint64_t hash;
+
+    /**
+     * A copy of the cursor image and mask exactly as received from the VNC
+     * server, used to verify that a cursor with a matching hash is truly
+     * identical. This is NULL if this entry is unused.
+     */
+    unsigned char* data;
+
+    /**
+     * The length of data, in bytes.
+     */
+    size_t length;
+
+    /**
+     * The width of the cursor image, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the cursor image, in pixels.
+     */
+    int height;
+
+    /**
+     * The buffer containing the converted cursor image, or NULL if this
+     * entry is unused.
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The value of the cache clock when this entry was last used, such that
+     * the least-recently used entry can be replaced when the cache is full.
+     */
+    uint64_t last_used;
+
+} guac_vnc_cursor_cache_entry;
+
 /**
  * Callback invoked by libVNCServer when it receives a new cursor image from
  * the VNC server. The cursor image itself will be split across
@@ -54,5 +113,15 @@
  */
 void guac_vnc_cursor(rfbClient* client, int x, int y, int w, int h, int vnc_bpp);
 
+/**
+ * Frees all buffers and data associated with the given cursor cache, leaving
+ * every entry unused.
+ *
+ * @param cache
+ *     The cursor cache to free, which must contain exactly
+ *     GUAC_VNC_CURSOR_CACHE_SIZE entries.
+ */
+void guac_vnc_cursor_cache_free(guac_vnc_cursor_cache_entry* cache);
+
 #endif
 
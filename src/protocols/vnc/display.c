@@ -26,9 +26,11 @@
 
 #include <cairo/cairo.h>
 #include <guacamole/client.h>
+#include <guacamole/display.h>
 #include <guacamole/layer.h>
 #include <guacamole/mem.h>
 #include <guacamole/protocol.h>
+#include <guacamole/rect.h>
 #include <guacamole/socket.h>
 #include <guacamole/timestamp.h>
 #include <rfb/rfbclient.h>
@@ -43,106 +45,198 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 
+/**
+ * Records the given change to the framebuffer of libvncclient, such that it
+ * will be applied to the guac_display by the next call to
+ * guac_vnc_display_flush_changes().
+ *
+ * @param vnc_client
+ *     The VNC client associated with the VNC session in which the change
+ *     was made.
+ *
+ * @param change
+ *     The change to record.
+ */
+static void guac_vnc_record_change(guac_vnc_client* vnc_client,
+        const guac_vnc_pending_change* change) {
+
+    /* Combine changes into a single region once there is no room to track
+     * them individually (any copy is then simply treated as new data) */
+    if (vnc_client->pending_change_count >= GUAC_VNC_MAX_PENDING_CHANGES) {
+        guac_rect_extend(&vnc_client->pending_overflow, &change->rect);
+        return;
+    }
+
+    vnc_client->pending_changes[vnc_client->pending_change_count++] = *change;
+
+}
+
 void guac_vnc_update(rfbClient* client, int x, int y, int w, int h) {
 
     guac_client* gc = rfbClientGetClientData(client, GUAC_VNC_CLIENT_KEY);
     guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
-    guac_display_layer* default_layer = guac_display_default_layer(vnc_client->display);
 
-    guac_display_layer_raw_context* context = vnc_client->current_context;
-    unsigned int vnc_bpp = client->format.bitsPerPixel / 8;
-    size_t vnc_stride = guac_mem_ckd_mul_or_die(vnc_bpp, client->width);
+    /* The new image data is copied from the framebuffer of libvncclient
+     * only once the current message has been handled */
+    guac_vnc_pending_change change = { .is_copy = 0 };
+    guac_rect_init(&change.rect, x, y, w, h);
+    guac_vnc_record_change(vnc_client, &change);
 
-    /* Convert operation coordinates to guac_rect for easier manipulation */
-    guac_rect op_bounds;
-    guac_rect_init(&op_bounds, x, y, w, h);
+    vnc_client->update_received = 1;
+    vnc_client->encoding_monitor.pixels += (uint64_t) w * h;
 
-    /* Ensure operation bounds are within possibly updated bounds of the
-     * pending frame (now the RFB client framebuffer) */
-    guac_rect_constrain(&op_bounds, &context->bounds);
+}
 
-    /* NOTE: The guac_display will be pointed directly at the libvncclient
-     * framebuffer if the pixel format used is identical to that expected by
-     * guac_display. No need to manually copy anything around in that case. */
+void guac_vnc_copyrect(rfbClient* client, int src_x, int src_y, int w, int h, int dest_x, int dest_y) {
 
-    /* All framebuffer formats must be manually converted if not identical to
-     * the format used by guac_display */
-    if (vnc_bpp != GUAC_DISPLAY_LAYER_RAW_BPP || vnc_client->settings->swap_red_blue) {
+    guac_client* gc = rfbClientGetClientData(client, GUAC_VNC_CLIENT_KEY);
+    guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
 
-        /* Ensure draw is within current bounds of the pending frame */
-        guac_rect_constrain(&op_bounds, &context->bounds);
+    /* Use original, wrapped proc to perform actual copy between regions of
+     * libvncclient's display buffer */
+    vnc_client->rfb_GotCopyRect(client, src_x, src_y, w, h, dest_x, dest_y);
 
-        const unsigned char* vnc_current_row = GUAC_RECT_CONST_BUFFER(op_bounds, client->frameBuffer, vnc_stride, vnc_bpp);
-        unsigned char* layer_current_row = GUAC_RECT_MUTABLE_BUFFER(op_bounds, context->buffer, context->stride, GUAC_DISPLAY_LAYER_RAW_BPP);
-        for (int dy = op_bounds.top; dy < op_bounds.bottom; dy++) {
+    /* Record the exact source and destination of the copy such that the
+     * corresponding region of the next frame can be sent as a copy without
+     * needing to be found through scroll/copy detection */
+    guac_vnc_pending_change change = {
+        .is_copy = 1,
+        .src_x = src_x,
+        .src_y = src_y
+    };
+    guac_rect_init(&change.rect, dest_x, dest_y, w, h);
+    guac_vnc_record_change(vnc_client, &change);
 
-            /* Get current Guacamole buffer row, advance to next */
-            uint32_t* layer_current_pixel = (uint32_t*) layer_current_row;
-            layer_current_row += context->stride;
+}
 
-            /* Get current VNC framebuffer row, advance to next */
-            const unsigned char* vnc_current_pixel = vnc_current_row;
-            vnc_current_row += vnc_stride;
+/**
+ * Copies the given region of the framebuffer of libvncclient into the given
+ * raw context of the default layer, converting pixels as needed, and marks
+ * that region as damaged.
+ *
+ * @param vnc_client
+ *     The VNC client associated with the VNC session.
+ *
+ * @param rfb_client
+ *     The underlying rfbClient.
+ *
+ * @param context
+ *     The open raw context of the default layer.
+ *
+ * @param rect
+ *     The region to copy. This will be constrained to the bounds of the
+ *     given context.
+ */
+static void guac_vnc_display_copy_region(guac_vnc_client* vnc_client,
+        rfbClient* rfb_client, guac_display_layer_raw_context* context,
+        guac_rect* rect) {
 
-            for (int dx = op_bounds.left; dx < op_bounds.right; dx++) {
+    guac_rect_constrain(rect, &context->bounds);
+    if (guac_rect_is_empty(rect))
+        return;
 
-                /* Read current VNC pixel value */
-                uint32_t v;
-                switch (vnc_bpp) {
+    unsigned int vnc_bpp = rfb_client->format.bitsPerPixel / 8;
+    size_t vnc_stride = guac_mem_ckd_mul_or_die(vnc_bpp, rfb_client->width);
 
-                    case 2:
-                        v = *((uint16_t*) vnc_current_pixel);
-                        break;
+    const unsigned char* vnc_current_row = GUAC_RECT_CONST_BUFFER(*rect, rfb_client->frameBuffer, vnc_stride, vnc_bpp);
+    unsigned char* layer_current_row = GUAC_RECT_MUTABLE_BUFFER(*rect, context->buffer, context->stride, GUAC_DISPLAY_LAYER_RAW_BPP);
+    int width = guac_rect_width(rect);
 
-                    default:
-                        v = *((uint8_t*) vnc_current_pixel);
+    /* Copy rows verbatim if the framebuffer format is identical to the
+     * format used by guac_display */
+    if (vnc_bpp == GUAC_DISPLAY_LAYER_RAW_BPP && !vnc_client->settings->swap_red_blue) {
 
-                }
+        size_t length = guac_mem_ckd_mul_or_die(width, GUAC_DISPLAY_LAYER_RAW_BPP);
+        for (int dy = rect->top; dy < rect->bottom; dy++) {
+            memcpy(layer_current_row, vnc_current_row, length);
+            layer_current_row += context->stride;
+            vnc_current_row += vnc_stride;
+        }
 
-                /* Translate value to 32-bit RGB */
-                uint8_t red   = (v >> client->format.redShift)   * 0x100 / (client->format.redMax   + 1);
-                uint8_t green = (v >> client->format.greenShift) * 0x100 / (client->format.greenMax + 1);
-                uint8_t blue  = (v >> client->format.blueShift)  * 0x100 / (client->format.blueMax  + 1);
+    }
 
-                /* Output RGB */
-                if (vnc_client->settings->swap_red_blue)
-                    *(layer_current_pixel++) = 0xFF000000 | (blue << 16) | (green << 8) | red;
-                else
-                    *(layer_current_pixel++) = 0xFF000000 | (red  << 16) | (green << 8) | blue;
+    /* All other framebuffer formats must be converted */
+    else {
 
-                /* Advance to next pixel in VNC framebuffer */
-                vnc_current_pixel += vnc_bpp;
+        /* Rebuild conversion tables if the pixel format has changed since
+         * they were built by guac_vnc_set_pixel_format() */
+        guac_vnc_converter* converter = &(vnc_client->converter);
+        if (!guac_vnc_converter_matches(converter, &rfb_client->format,
+                    vnc_client->settings->swap_red_blue))
+            guac_vnc_converter_init(converter, &rfb_client->format,
+                    vnc_client->settings->swap_red_blue);
 
-            }
-        }
+        for (int dy = rect->top; dy < rect->bottom; dy++) {
 
-    } /* end manual convert */
+            converter->convert_row(converter, vnc_current_row,
+                    (uint32_t*) layer_current_row, width);
 
-    /* Mark modified region as dirty */
-    guac_rect_extend(&context->dirty, &op_bounds);
+            layer_current_row += context->stride;
+            vnc_current_row += vnc_stride;
+
+        }
 
-    /* Hint at source of copied data if this update involved CopyRect */
-    if (vnc_client->copy_rect_used) {
-        context->hint_from = default_layer;
-        vnc_client->copy_rect_used = 0;
     }
 
-    guac_display_render_thread_notify_modified(vnc_client->render_thread);
+    guac_display_layer_raw_context_damage(context, rect);
 
 }
 
-void guac_vnc_copyrect(rfbClient* client, int src_x, int src_y, int w, int h, int dest_x, int dest_y) {
+void guac_vnc_display_flush_changes(guac_client* client) {
 
-    guac_client* gc = rfbClientGetClientData(client, GUAC_VNC_CLIENT_KEY);
-    guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
+    guac_vnc_client* vnc_client = (guac_vnc_client*) client->data;
+    rfbClient* rfb_client = vnc_client->rfb_client;
+    guac_display_layer* default_layer = guac_display_default_layer(vnc_client->display);
 
-    vnc_client->copy_rect_used = 1;
+    /* Resize the surface if VNC screen size has changed (this call
+     * automatically deals with invalid dimensions and is a no-op
+     * if the size has not changed) */
+    guac_display_layer_resize(default_layer, rfb_client->width, rfb_client->height);
 
-    /* Use original, wrapped proc to perform actual copy between regions of
-     * libvncclient's display buffer */
-    vnc_client->rfb_GotCopyRect(client, src_x, src_y, w, h, dest_x, dest_y);
+    if (vnc_client->pending_change_count == 0
+            && guac_rect_is_empty(&vnc_client->pending_overflow))
+        return;
+
+    /* The guac_display need be locked only while changes are copied */
+    guac_display_layer_raw_context* context = guac_display_layer_open_raw(default_layer);
+
+    for (int i = 0; i < vnc_client->pending_change_count; i++) {
+
+        guac_vnc_pending_change* change = &(vnc_client->pending_changes[i]);
+
+        /* Copies are recorded as such, with the copied data itself included
+         * so that the pending frame remains identical to the framebuffer */
+        if (change->is_copy) {
+
+            guac_rect dest = change->rect;
+            guac_rect_constrain(&dest, &context->bounds);
+            if (guac_rect_is_empty(&dest))
+                continue;
+
+            guac_display_layer_raw_context_copy_hint(context, &dest,
+                    change->src_x + dest.left - change->rect.left,
+                    change->src_y + dest.top - change->rect.top);
+
+        }
+
+        guac_vnc_display_copy_region(vnc_client, rfb_client, context,
+                &change->rect);
+
+    }
+
+    if (!guac_rect_is_empty(&vnc_client->pending_overflow))
+        guac_vnc_display_copy_region(vnc_client, rfb_client, context,
+                &vnc_client->pending_overflow);
+
+    guac_display_layer_close_raw(default_layer, context);
+
+    vnc_client->pending_change_count = 0;
+    guac_rect_init(&vnc_client->pending_overflow, 0, 0, 0, 0);
+
+    guac_display_render_thread_notify_modified(vnc_client->render_thread);
 
 }
 
@@ -308,6 +402,10 @@ void guac_vnc_display_set_size(rfbClient* client, int requested_width, int reque
 #endif // LIBVNC_HAS_RESIZE_SUPPORT
 
 void guac_vnc_set_pixel_format(rfbClient* client, int color_depth) {
+
+    guac_client* gc = rfbClientGetClientData(client, GUAC_VNC_CLIENT_KEY);
+    guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
+
     client->format.trueColour = 1;
     switch(color_depth) {
         case 8:
@@ -344,6 +442,14 @@ void guac_vnc_set_pixel_format(rfbClient* client, int color_depth) {
             client->format.redMax       = 0xff;
             client->format.greenMax     = 0xff;
     }
+
+    /* Build the tables required to convert from the requested format, if
+     * conversion will be needed */
+    if (client->format.bitsPerPixel / 8 != GUAC_DISPLAY_LAYER_RAW_BPP
+            || vnc_client->settings->swap_red_blue)
+        guac_vnc_converter_init(&(vnc_client->converter), &client->format,
+                vnc_client->settings->swap_red_blue);
+
 }
 
 rfbBool guac_vnc_malloc_framebuffer(rfbClient* rfb_client) {
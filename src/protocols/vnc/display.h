@@ -22,10 +22,51 @@
 
 #include "config.h"
 
+#include <guacamole/client.h>
+#include <guacamole/rect.h>
 #include <guacamole/user.h>
 #include <rfb/rfbclient.h>
 #include <rfb/rfbproto.h>
 
+/**
+ * The maximum number of changes to the VNC framebuffer that may be recorded
+ * while handling a single message from the VNC server. Any further changes
+ * are combined into a single changed region.
+ */
+#define GUAC_VNC_MAX_PENDING_CHANGES 256
+
+/**
+ * A change made by libvncclient to its framebuffer that has not yet been
+ * applied to the guac_display.
+ */
+typedef struct guac_vnc_pending_change {
+
+    /**
+     * The region of the framebuffer that changed.
+     */
+    guac_rect rect;
+
+    /**
+     * Non-zero if the region was changed by a CopyRect, in which case src_x
+     * and src_y describe the source of the copy, zero if the region received
+     * new image data.
+     */
+    int is_copy;
+
+    /**
+     * For copies, the X coordinate of the upper-left corner of the source
+     * rectangle, in pixels.
+     */
+    int src_x;
+
+    /**
+     * For copies, the Y coordinate of the upper-left corner of the source
+     * rectangle, in pixels.
+     */
+    int src_y;
+
+} guac_vnc_pending_change;
+
 /**
  * Callback invoked by libVNCServer when it receives a new binary image data
  * from the VNC server. The image itself will be stored in the designated sub-
@@ -147,5 +188,19 @@ void guac_vnc_set_pixel_format(rfbClient* client, int color_depth);
  */
 rfbBool guac_vnc_malloc_framebuffer(rfbClient* rfb_client);
 
+/**
+ * Applies all changes that libvncclient has made to its framebuffer since the
+ * last call to this function to the default layer of the guac_display,
+ * converting pixels as needed. The framebuffer of libvncclient and the buffer
+ * of the guac_display are separate, such that the guac_display need only be
+ * locked while those changes are copied, and never while libvncclient is
+ * decoding further messages. This function must be invoked from the thread
+ * handling messages from the VNC server.
+ *
+ * @param client
+ *     The guac_client associated with the VNC connection.
+ */
+void guac_vnc_display_flush_changes(guac_client* client);
+
 #endif
 
@@ -0,0 +1,344 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "encodings.h"
+
+#include <guacamole/client.h>
+#include <guacamole/timestamp.h>
+#include <rfb/rfbclient.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#ifdef HAVE_CLOCK_GETTIME
+#include <time.h>
+#endif
+
+#ifdef HAVE_STRUCT_TCP_INFO_TCPI_RTT
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+/**
+ * Returns the current value of a monotonic clock, in microseconds.
+ *
+ * @return
+ *     The current value of a monotonic clock, in microseconds.
+ */
+static uint64_t guac_vnc_encodings_clock(void) {
+
+#ifdef HAVE_CLOCK_GETTIME
+
+    struct timespec current;
+
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &current);
+#else
+    clock_gettime(CLOCK_REALTIME, &current);
+#endif
+
+    return (uint64_t) current.tv_sec * 1000000 + current.tv_nsec / 1000;
+
+#else
+
+    struct timeval current;
+    gettimeofday(&current, NULL);
+
+    return (uint64_t) current.tv_sec * 1000000 + current.tv_usec;
+
+#endif
+
+}
+
+/**
+ * Returns the CPU time consumed so far by the current thread, in
+ * microseconds. If per-thread CPU time is not available on this platform,
+ * zero is always returned, and all connections will appear network-bound.
+ *
+ * @return
+ *     The CPU time consumed by the current thread, in microseconds, or zero
+ *     if this cannot be determined.
+ */
+static uint64_t guac_vnc_encodings_cpu_clock(void) {
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec current;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &current) == 0)
+        return (uint64_t) current.tv_sec * 1000000 + current.tv_nsec / 1000;
+#endif
+
+    return 0;
+
+}
+
+/**
+ * Queries the kernel for the smoothed round-trip time and the total number of
+ * bytes received on the connection to the VNC server.
+ *
+ * @param rfb_client
+ *     The rfbClient of the connection to the VNC server.
+ *
+ * @param rtt
+ *     Storage for the round-trip time, in milliseconds. This is left
+ *     untouched if the round-trip time cannot be determined.
+ *
+ * @param bytes_received
+ *     Storage for the total number of bytes received. This is left untouched
+ *     if that number cannot be determined.
+ *
+ * @return
+ *     Non-zero if the total number of bytes received was determined, zero
+ *     otherwise.
+ */
+static int guac_vnc_encodings_tcp_info(rfbClient* rfb_client,
+        unsigned int* rtt, uint64_t* bytes_received) {
+
+#ifdef HAVE_STRUCT_TCP_INFO_TCPI_RTT
+
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+
+    if (getsockopt(rfb_client->sock, IPPROTO_TCP, TCP_INFO, &info, &length))
+        return 0;
+
+    *rtt = info.tcpi_rtt / 1000;
+
+#ifdef HAVE_STRUCT_TCP_INFO_TCPI_BYTES_RECEIVED
+    *bytes_received = info.tcpi_bytes_received;
+    return 1;
+#endif
+
+#endif
+
+    return 0;
+
+}
+
+const char* guac_vnc_encoding_profile_string(guac_vnc_encoding_profile profile) {
+
+    switch (profile) {
+
+        case GUAC_VNC_ENCODING_PROFILE_SLOW:
+        case GUAC_VNC_ENCODING_PROFILE_MODERATE:
+            return "tight copyrect zrle hextile zlib corre rre raw";
+
+        case GUAC_VNC_ENCODING_PROFILE_RAW:
+            return "raw copyrect zrle hextile zlib corre rre";
+
+        default:
+            return "zrle copyrect hextile zlib corre rre raw";
+
+    }
+
+}
+
+/**
+ * Returns the encoding profile best suited to the given measurements of the
+ * connection to the VNC server.
+ *
+ * @param current
+ *     The encoding profile currently in use.
+ *
+ * @param rtt
+ *     The round-trip time of the connection, in milliseconds, or zero if
+ *     unknown.
+ *
+ * @param rate
+ *     The rate that framebuffer data arrived while framebuffer updates were
+ *     being received, in bytes per second.
+ *
+ * @param network_bound
+ *     Non-zero if most of the time spent handling framebuffer updates was
+ *     spent waiting for data rather than decoding it, zero otherwise.
+ *
+ * @return
+ *     The encoding profile best suited to the given measurements.
+ */
+static guac_vnc_encoding_profile guac_vnc_encodings_choose(
+        guac_vnc_encoding_profile current, unsigned int rtt, uint64_t rate,
+        int network_bound) {
+
+    /* Only aggressive compression is reasonable for high-latency links
+     * regardless of their bandwidth */
+    if (rtt >= GUAC_VNC_ENCODINGS_SLOW_RTT)
+        return GUAC_VNC_ENCODING_PROFILE_SLOW;
+
+    /* Compress in proportion to how constrained the link actually is */
+    if (network_bound && rate < GUAC_VNC_ENCODINGS_SLOW_RATE)
+        return GUAC_VNC_ENCODING_PROFILE_SLOW;
+
+    if (network_bound && rate < GUAC_VNC_ENCODINGS_FAST_RATE)
+        return GUAC_VNC_ENCODING_PROFILE_MODERATE;
+
+    /* On the local network, avoid the cost of decoding compressed updates if
+     * that cost is what is holding things back, continuing with raw updates
+     * only for as long as the network keeps up with them */
+    if (rtt <= GUAC_VNC_ENCODINGS_LAN_RTT) {
+
+        if (current == GUAC_VNC_ENCODING_PROFILE_RAW)
+            return rate >= GUAC_VNC_ENCODINGS_RAW_RATE
+                ? GUAC_VNC_ENCODING_PROFILE_RAW
+                : GUAC_VNC_ENCODING_PROFILE_FAST;
+
+        if (!network_bound)
+            return GUAC_VNC_ENCODING_PROFILE_RAW;
+
+    }
+
+    return GUAC_VNC_ENCODING_PROFILE_FAST;
+
+}
+
+/**
+ * Negotiates the given encoding profile with the VNC server.
+ *
+ * @param client
+ *     The guac_client associated with the VNC connection.
+ *
+ * @param monitor
+ *     The monitor of the connection to the VNC server.
+ *
+ * @param rfb_client
+ *     The rfbClient of the connection to the VNC server.
+ *
+ * @param profile
+ *     The encoding profile to negotiate.
+ */
+static void guac_vnc_encodings_apply(guac_client* client,
+        guac_vnc_encoding_monitor* monitor, rfbClient* rfb_client,
+        guac_vnc_encoding_profile profile) {
+
+    const char* encodings = guac_vnc_encoding_profile_string(profile);
+
+    free((char*) rfb_client->appData.encodingsString);
+    rfb_client->appData.encodingsString = strdup(encodings);
+
+    /* Choose the JPEG quality used by Tight unless configured explicitly */
+    if (monitor->quality_level < 0) {
+        rfb_client->appData.enableJPEG = TRUE;
+        rfb_client->appData.qualityLevel =
+            profile == GUAC_VNC_ENCODING_PROFILE_SLOW ? 3 : 7;
+    }
+
+    if (!SetFormatAndEncodings(rfb_client)) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Unable to change the "
+                "encodings used by the VNC server to \"%s\".", encodings);
+        return;
+    }
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Switched VNC encodings to "
+            "\"%s\" based on measured connection quality.", encodings);
+
+    monitor->profile = profile;
+
+}
+
+void guac_vnc_encoding_monitor_init(guac_vnc_encoding_monitor* monitor,
+        int quality_level) {
+
+    *monitor = (guac_vnc_encoding_monitor) {
+        .profile        = GUAC_VNC_ENCODING_PROFILE_FAST,
+        .candidate      = GUAC_VNC_ENCODING_PROFILE_FAST,
+        .quality_level  = quality_level,
+        .interval_start = guac_timestamp_current()
+    };
+
+}
+
+void guac_vnc_encoding_monitor_begin(guac_vnc_encoding_monitor* monitor,
+        rfbClient* rfb_client) {
+
+    unsigned int rtt;
+    guac_vnc_encodings_tcp_info(rfb_client, &rtt, &monitor->bytes_received);
+
+    monitor->message_start = guac_vnc_encodings_clock();
+    monitor->message_cpu = guac_vnc_encodings_cpu_clock();
+    monitor->pixels = 0;
+
+}
+
+void guac_vnc_encoding_monitor_end(guac_client* client,
+        guac_vnc_encoding_monitor* monitor, rfbClient* rfb_client) {
+
+    /* Only framebuffer updates say anything about how well the current
+     * encodings suit the connection */
+    if (monitor->pixels > 0) {
+
+        unsigned int rtt = 0;
+        uint64_t bytes_received = monitor->bytes_received;
+
+        monitor->busy += guac_vnc_encodings_clock() - monitor->message_start;
+        monitor->cpu += guac_vnc_encodings_cpu_clock() - monitor->message_cpu;
+
+        /* Fall back to the size of the updated framebuffer data if the
+         * number of bytes actually received is unknown */
+        if (guac_vnc_encodings_tcp_info(rfb_client, &rtt, &bytes_received))
+            monitor->bytes += bytes_received - monitor->bytes_received;
+        else
+            monitor->bytes += monitor->pixels * (rfb_client->format.bitsPerPixel / 8);
+
+    }
+
+    guac_timestamp now = guac_timestamp_current();
+    if (now - monitor->interval_start < GUAC_VNC_ENCODINGS_INTERVAL)
+        return;
+
+    /* Reconsider encodings only if the framebuffer changed enough during the
+     * interval for the measurements to be meaningful */
+    if (monitor->busy >= GUAC_VNC_ENCODINGS_MIN_BUSY) {
+
+        unsigned int rtt = 0;
+        uint64_t bytes_received;
+        guac_vnc_encodings_tcp_info(rfb_client, &rtt, &bytes_received);
+
+        uint64_t rate = monitor->bytes * 1000000 / monitor->busy;
+        int network_bound = monitor->cpu < monitor->busy / 2;
+
+        guac_vnc_encoding_profile profile = guac_vnc_encodings_choose(
+                monitor->profile, rtt, rate, network_bound);
+
+        if (profile == monitor->candidate)
+            monitor->candidate_intervals++;
+        else {
+            monitor->candidate = profile;
+            monitor->candidate_intervals = 1;
+        }
+
+        /* Renegotiate only once the better-suited profile is consistently
+         * chosen, such that brief changes in conditions do not cause the
+         * encodings to flap */
+        if (monitor->candidate != monitor->profile
+                && monitor->candidate_intervals >= GUAC_VNC_ENCODINGS_STABLE_INTERVALS)
+            guac_vnc_encodings_apply(client, monitor, rfb_client,
+                    monitor->candidate);
+
+    }
+
+    monitor->interval_start = now;
+    monitor->busy = 0;
+    monitor->cpu = 0;
+    monitor->bytes = 0;
+
+}
+
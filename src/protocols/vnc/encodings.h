@@ -0,0 +1,257 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_VNC_ENCODINGS_H
+#define GUAC_VNC_ENCODINGS_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+#include <rfb/rfbclient.h>
+
+#include <stdint.h>
+
+/**
+ * The value of the "encodings" parameter which requests that encodings be
+ * chosen automatically based on the measured quality of the connection to the
+ * VNC server, rather than specified statically.
+ */
+#define GUAC_VNC_ENCODINGS_AUTO "auto"
+
+/**
+ * The amount of time over which the connection to the VNC server is measured
+ * before the encodings in use are reconsidered, in milliseconds.
+ */
+#define GUAC_VNC_ENCODINGS_INTERVAL 5000
+
+/**
+ * The minimum amount of time that must have been spent receiving framebuffer
+ * updates within a measurement interval for that interval to be considered
+ * representative of the connection, in microseconds. Intervals where the
+ * framebuffer barely changed say nothing about the link.
+ */
+#define GUAC_VNC_ENCODINGS_MIN_BUSY 100000
+
+/**
+ * The number of consecutive measurement intervals that must agree on a
+ * different encoding profile before that profile is actually negotiated.
+ */
+#define GUAC_VNC_ENCODINGS_STABLE_INTERVALS 2
+
+/**
+ * The round-trip time at or above which the VNC server is considered to be
+ * behind a high-latency link (satellite, etc.), in milliseconds.
+ */
+#define GUAC_VNC_ENCODINGS_SLOW_RTT 300
+
+/**
+ * The round-trip time at or below which the VNC server is considered to be on
+ * the local network, in milliseconds.
+ */
+#define GUAC_VNC_ENCODINGS_LAN_RTT 5
+
+/**
+ * The rate at which framebuffer data must arrive, in bytes per second, for a
+ * network-bound connection not to be considered slow.
+ */
+#define GUAC_VNC_ENCODINGS_SLOW_RATE 1000000
+
+/**
+ * The rate at which framebuffer data must arrive, in bytes per second, for a
+ * network-bound connection to be considered fast.
+ */
+#define GUAC_VNC_ENCODINGS_FAST_RATE 10000000
+
+/**
+ * The rate at which raw framebuffer data must continue to arrive, in bytes
+ * per second, for raw encoding to remain in use.
+ */
+#define GUAC_VNC_ENCODINGS_RAW_RATE 32000000
+
+/**
+ * The sets of encodings that may be automatically selected, from the most to
+ * the least aggressively compressed.
+ */
+typedef enum guac_vnc_encoding_profile {
+
+    /**
+     * Tight encoding with low-quality JPEG, for slow or high-latency links.
+     */
+    GUAC_VNC_ENCODING_PROFILE_SLOW,
+
+    /**
+     * Tight encoding with high-quality JPEG, for links of moderate speed.
+     */
+    GUAC_VNC_ENCODING_PROFILE_MODERATE,
+
+    /**
+     * ZRLE encoding, for fast links. This is the initial profile.
+     */
+    GUAC_VNC_ENCODING_PROFILE_FAST,
+
+    /**
+     * Raw encoding, for local networks where decoding compressed updates
+     * costs more than the bandwidth saved.
+     */
+    GUAC_VNC_ENCODING_PROFILE_RAW
+
+} guac_vnc_encoding_profile;
+
+/**
+ * Measurements of the connection to the VNC server, used to automatically
+ * choose the encodings requested from that server.
+ */
+typedef struct guac_vnc_encoding_monitor {
+
+    /**
+     * The encoding profile currently negotiated with the VNC server.
+     */
+    guac_vnc_encoding_profile profile;
+
+    /**
+     * The encoding profile most recently chosen from measurements, which
+     * will be negotiated once chosen for GUAC_VNC_ENCODINGS_STABLE_INTERVALS
+     * consecutive intervals.
+     */
+    guac_vnc_encoding_profile candidate;
+
+    /**
+     * The number of consecutive intervals for which the candidate profile
+     * has been chosen.
+     */
+    int candidate_intervals;
+
+    /**
+     * The JPEG quality level configured for the connection, or -1 if the
+     * quality level may be chosen automatically.
+     */
+    int quality_level;
+
+    /**
+     * The time that the current measurement interval began, as returned by
+     * guac_timestamp_current().
+     */
+    guac_timestamp interval_start;
+
+    /**
+     * The total wall-clock time spent handling framebuffer updates within the
+     * current interval, in microseconds.
+     */
+    uint64_t busy;
+
+    /**
+     * The total CPU time consumed by the VNC client thread while handling
+     * framebuffer updates within the current interval, in microseconds.
+     */
+    uint64_t cpu;
+
+    /**
+     * The total number of bytes received from the VNC server while handling
+     * framebuffer updates within the current interval. If the number of bytes
+     * received cannot be queried, this is instead the size of the updated
+     * framebuffer data.
+     */
+    uint64_t bytes;
+
+    /**
+     * The total number of bytes received on the connection to the VNC server
+     * as of the start of the message currently being handled, if known.
+     */
+    uint64_t bytes_received;
+
+    /**
+     * The wall-clock time that handling of the current message began, in
+     * microseconds.
+     */
+    uint64_t message_start;
+
+    /**
+     * The CPU time of the VNC client thread as of the start of the message
+     * currently being handled, in microseconds.
+     */
+    uint64_t message_cpu;
+
+    /**
+     * The number of framebuffer pixels updated by the message currently
+     * being handled.
+     */
+    uint64_t pixels;
+
+} guac_vnc_encoding_monitor;
+
+/**
+ * Returns the encodings string that should be used for the given profile.
+ *
+ * @param profile
+ *     The encoding profile to return the encodings of.
+ *
+ * @return
+ *     The space-separated list of encodings of the given profile, in
+ *     libvncclient's format.
+ */
+const char* guac_vnc_encoding_profile_string(guac_vnc_encoding_profile profile);
+
+/**
+ * Initializes the given monitor, which will initially use
+ * GUAC_VNC_ENCODING_PROFILE_FAST.
+ *
+ * @param monitor
+ *     The monitor to initialize.
+ *
+ * @param quality_level
+ *     The JPEG quality level configured for the connection, or -1 if the
+ *     quality level may be chosen automatically.
+ */
+void guac_vnc_encoding_monitor_init(guac_vnc_encoding_monitor* monitor,
+        int quality_level);
+
+/**
+ * Notes the start of handling a message from the VNC server.
+ *
+ * @param monitor
+ *     The monitor of the connection to the VNC server.
+ *
+ * @param rfb_client
+ *     The rfbClient of the connection to the VNC server.
+ */
+void guac_vnc_encoding_monitor_begin(guac_vnc_encoding_monitor* monitor,
+        rfbClient* rfb_client);
+
+/**
+ * Notes the end of handling a message from the VNC server, accumulating
+ * measurements if that message updated the framebuffer. If the current
+ * measurement interval has elapsed, the encodings in use are reconsidered and,
+ * if a different profile is consistently better suited to the connection, are
+ * renegotiated with SetFormatAndEncodings().
+ *
+ * @param client
+ *     The guac_client associated with the VNC connection.
+ *
+ * @param monitor
+ *     The monitor of the connection to the VNC server.
+ *
+ * @param rfb_client
+ *     The rfbClient of the connection to the VNC server.
+ */
+void guac_vnc_encoding_monitor_end(guac_client* client,
+        guac_vnc_encoding_monitor* monitor, rfbClient* rfb_client);
+
+#endif
+
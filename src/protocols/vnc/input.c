@@ -20,12 +20,132 @@
 #include "config.h"
 
 #include "display.h"
+#include "input.h"
 #include "vnc.h"
 
+#include <guacamole/client.h>
 #include <guacamole/display.h>
+#include <guacamole/fifo-lockfree.h>
 #include <guacamole/recording.h>
 #include <guacamole/user.h>
 #include <rfb/rfbclient.h>
+#include <rfb/rfbproto.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Appends the VNC message corresponding to the given input event to the
+ * given batch of messages. A mouse event which does not change the button
+ * state replaces the immediately preceding mouse event, if any.
+ *
+ * @param rfb_client
+ *     The rfbClient that the batch will be written to.
+ *
+ * @param event
+ *     The input event to append.
+ *
+ * @param batch
+ *     The buffer containing the batch of messages.
+ *
+ * @param length
+ *     The current length of the batch, in bytes. This will be updated to
+ *     reflect any appended message.
+ *
+ * @param last_mouse
+ *     The offset of the last message within the batch if that message is a
+ *     mouse event, or -1 otherwise. This will be updated to reflect any
+ *     appended message.
+ */
+static void guac_vnc_input_append(rfbClient* rfb_client,
+        const guac_vnc_input_event* event, uint8_t* batch, size_t* length,
+        ptrdiff_t* last_mouse) {
+
+    if (event->type == GUAC_VNC_INPUT_EVENT_MOUSE) {
+
+        if (!SupportsClient2Server(rfb_client, rfbPointerEvent))
+            return;
+
+        int x = event->x_or_keysym < 0 ? 0 : event->x_or_keysym;
+        int y = event->y_or_pressed < 0 ? 0 : event->y_or_pressed;
+
+        /* Motion alone need only update the position of the preceding
+         * mouse event */
+        uint8_t* msg = batch + *length;
+        if (*last_mouse >= 0 && batch[*last_mouse + 1] == (uint8_t) event->mask)
+            msg = batch + *last_mouse;
+        else {
+            *last_mouse = *length;
+            *length += sz_rfbPointerEventMsg;
+        }
+
+        msg[0] = rfbPointerEvent;
+        msg[1] = (uint8_t) event->mask;
+        msg[2] = (uint8_t) (x >> 8);
+        msg[3] = (uint8_t) x;
+        msg[4] = (uint8_t) (y >> 8);
+        msg[5] = (uint8_t) y;
+
+    }
+
+    else {
+
+        if (!SupportsClient2Server(rfb_client, rfbKeyEvent))
+            return;
+
+        uint32_t keysym = (uint32_t) event->x_or_keysym;
+
+        uint8_t* msg = batch + *length;
+        *length += sz_rfbKeyEventMsg;
+        *last_mouse = -1;
+
+        msg[0] = rfbKeyEvent;
+        msg[1] = event->y_or_pressed ? 1 : 0;
+        msg[2] = 0;
+        msg[3] = 0;
+        msg[4] = (uint8_t) (keysym >> 24);
+        msg[5] = (uint8_t) (keysym >> 16);
+        msg[6] = (uint8_t) (keysym >> 8);
+        msg[7] = (uint8_t) keysym;
+
+    }
+
+}
+
+void* guac_vnc_input_thread(void* data) {
+
+    guac_client* client = (guac_client*) data;
+    guac_vnc_client* vnc_client = (guac_vnc_client*) client->data;
+    rfbClient* rfb_client = vnc_client->rfb_client;
+
+    /* Key events are the largest messages that may be batched */
+    uint8_t batch[GUAC_VNC_INPUT_BATCH_SIZE * sz_rfbKeyEventMsg];
+    guac_vnc_input_event event;
+
+    /* Wait for at least one event, then send it along with any others that
+     * have been queued in the meantime */
+    while (guac_fifo_lockfree_dequeue(&vnc_client->input_events, &event)) {
+
+        size_t length = 0;
+        ptrdiff_t last_mouse = -1;
+
+        do {
+            guac_vnc_input_append(rfb_client, &event, batch, &length,
+                    &last_mouse);
+        } while (length + sz_rfbKeyEventMsg <= sizeof(batch)
+                && guac_fifo_lockfree_timed_dequeue(&vnc_client->input_events,
+                    &event, 0));
+
+        if (length > 0 && !rfb_client->appData.viewOnly
+                && !WriteToRFBServer(rfb_client, (char*) batch, length))
+            guac_client_log(client, GUAC_LOG_DEBUG, "Unable to send input "
+                    "events to VNC server.");
+
+    }
+
+    return NULL;
+
+}
 
 int guac_vnc_user_mouse_handler(guac_user* user, int x, int y, int mask) {
 
@@ -40,9 +160,17 @@ int guac_vnc_user_mouse_handler(guac_user* user, int x, int y, int mask) {
     if (vnc_client->recording != NULL)
         guac_recording_report_mouse(vnc_client->recording, x, y, mask);
 
-    /* Send VNC event only if finished connecting */
-    if (rfb_client != NULL)
-        SendPointerEvent(rfb_client, x, y, mask);
+    /* Queue VNC event only if finished connecting, such that the event is
+     * sent by the input thread without waiting on the client thread */
+    if (rfb_client != NULL) {
+        guac_vnc_input_event event = {
+            .type = GUAC_VNC_INPUT_EVENT_MOUSE,
+            .x_or_keysym = x,
+            .y_or_pressed = y,
+            .mask = mask
+        };
+        guac_fifo_lockfree_enqueue(&vnc_client->input_events, &event);
+    }
 
     return 0;
 }
@@ -57,9 +185,16 @@ int guac_vnc_user_key_handler(guac_user* user, int keysym, int pressed) {
         guac_recording_report_key(vnc_client->recording,
                 keysym, pressed);
 
-    /* Send VNC event only if finished connecting */
-    if (rfb_client != NULL)
-        SendKeyEvent(rfb_client, keysym, pressed);
+    /* Queue VNC event only if finished connecting, such that the event is
+     * sent by the input thread without waiting on the client thread */
+    if (rfb_client != NULL) {
+        guac_vnc_input_event event = {
+            .type = GUAC_VNC_INPUT_EVENT_KEY,
+            .x_or_keysym = keysym,
+            .y_or_pressed = pressed
+        };
+        guac_fifo_lockfree_enqueue(&vnc_client->input_events, &event);
+    }
 
     return 0;
 }
@@ -24,6 +24,81 @@
 
 #include <guacamole/user.h>
 
+/**
+ * The maximum number of input events to allow in the event queue.
+ */
+#define GUAC_VNC_INPUT_EVENT_QUEUE_SIZE 4096
+
+/**
+ * The maximum number of input events that may be combined into a single
+ * write to the VNC server.
+ */
+#define GUAC_VNC_INPUT_BATCH_SIZE 64
+
+/**
+ * The type of a guac_vnc_input_event.
+ */
+typedef enum guac_vnc_input_event_type {
+
+    /**
+     * A change in the position or button state of the mouse.
+     */
+    GUAC_VNC_INPUT_EVENT_MOUSE,
+
+    /**
+     * A key being pressed or released.
+     */
+    GUAC_VNC_INPUT_EVENT_KEY
+
+} guac_vnc_input_event_type;
+
+/**
+ * An input event received from a user, which will be sent to the VNC server
+ * by the input thread (see guac_vnc_input_thread()).
+ */
+typedef struct guac_vnc_input_event {
+
+    /**
+     * The type of this event.
+     */
+    guac_vnc_input_event_type type;
+
+    /**
+     * For mouse events, the X coordinate of the mouse pointer. For key
+     * events, the keysym of the key.
+     */
+    int x_or_keysym;
+
+    /**
+     * For mouse events, the Y coordinate of the mouse pointer. For key
+     * events, non-zero if the key is pressed and zero if released.
+     */
+    int y_or_pressed;
+
+    /**
+     * For mouse events, the mask of mouse buttons currently pressed. This is
+     * unused for key events.
+     */
+    int mask;
+
+} guac_vnc_input_event;
+
+/**
+ * Input thread which sends each input event queued by the mouse and key
+ * handlers to the VNC server, independently of the client thread and of any
+ * decoding of framebuffer updates. All events queued since the last write are
+ * combined into a single write, as are consecutive mouse motion events that
+ * do not change the button state. The thread runs until the input event
+ * queue is invalidated.
+ *
+ * @param data
+ *     The guac_client instance associated with the VNC connection.
+ *
+ * @return
+ *     Always NULL.
+ */
+void* guac_vnc_input_thread(void* data);
+
 /**
  * Handler for Guacamole user mouse events.
  */
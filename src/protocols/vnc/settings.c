@@ -23,9 +23,12 @@
 #include "client.h"
 #include "common/defaults.h"
 #include "common/clipboard.h"
+#include "encodings.h"
 #include "settings.h"
 
 #include <guacamole/mem.h>
+#include <guacamole/recording.h>
+#include <guacamole/string.h>
 #include <guacamole/user.h>
 #include <guacamole/wol-constants.h>
 
@@ -89,6 +92,10 @@ const char* GUAC_VNC_CLIENT_ARGS[] = {
     "recording-include-keys",
     "create-recording-path",
     "recording-write-existing",
+    "recording-overflow",
+    "recording-format",
+    "recording-write-events",
+    "recording-frame-rate",
     "clipboard-buffer-size",
     "disable-copy",
     "disable-paste",
@@ -136,6 +143,10 @@ enum VNC_ARGS_IDX {
      * specified, this will be:
      *
      *     "zrle ultra copyrect hextile zlib corre rre raw".
+     *
+     * If "auto", encodings will instead be chosen and renegotiated
+     * automatically based on the measured quality of the connection to the
+     * VNC server.
      */
     IDX_ENCODINGS,
 
@@ -365,6 +376,35 @@ enum VNC_ARGS_IDX {
      */
     IDX_RECORDING_WRITE_EXISTING,
 
+    /**
+     * The behavior to use if session data is produced faster than it can be
+     * written to the recording file: "block" (the default), "drop", or
+     * "spill".
+     */
+    IDX_RECORDING_OVERFLOW,
+
+    /**
+     * The format of the recording file: "raw" (the default), or "compressed"
+     * for a compressed recording which can be played back starting from any
+     * point in time.
+     */
+    IDX_RECORDING_FORMAT,
+
+    /**
+     * "true" if the mouse, touch, and key events included within the
+     * recording should also be written to a separate, compact binary file
+     * alongside the recording, "false" or blank otherwise.
+     */
+    IDX_RECORDING_WRITE_EVENTS,
+
+    /**
+     * The maximum number of frames per second to record if graphical output
+     * should be recorded directly from the display, losslessly and
+     * independently of connected users, or zero or blank if the output sent
+     * to connected users should be recorded as-is.
+     */
+    IDX_RECORDING_FRAME_RATE,
+
     /**
      * The maximum number of bytes to allow within the clipboard.
      */
@@ -541,6 +581,15 @@ guac_vnc_settings* guac_vnc_parse_args(guac_user* user,
                 IDX_ENCODINGS,
                 "zrle ultra copyrect hextile zlib corre rre raw");
 
+    /* Choose encodings automatically if requested, starting with those
+     * suited to a reasonably fast link */
+    if (strcmp(settings->encodings, GUAC_VNC_ENCODINGS_AUTO) == 0) {
+        settings->adaptive_encodings = true;
+        guac_mem_free(settings->encodings);
+        settings->encodings = guac_strdup(guac_vnc_encoding_profile_string(
+                    GUAC_VNC_ENCODING_PROFILE_FAST));
+    }
+
     /* Parse autoretry */
     settings->retries =
         guac_user_parse_args_int(user, GUAC_VNC_CLIENT_ARGS, argv,
@@ -686,6 +735,26 @@ guac_vnc_settings* guac_vnc_parse_args(guac_user* user,
         guac_user_parse_args_boolean(user, GUAC_VNC_CLIENT_ARGS, argv,
                 IDX_RECORDING_WRITE_EXISTING, false);
 
+    /* Parse recording overflow behavior */
+    settings->recording_overflow =
+        guac_recording_parse_args_overflow(user, GUAC_VNC_CLIENT_ARGS, argv,
+                IDX_RECORDING_OVERFLOW, GUAC_RECORDING_OVERFLOW_BLOCK);
+
+    /* Parse recording file format */
+    settings->recording_format =
+        guac_recording_parse_args_format(user, GUAC_VNC_CLIENT_ARGS, argv,
+                IDX_RECORDING_FORMAT, GUAC_RECORDING_FORMAT_RAW);
+
+    /* Parse input event sidecar flag */
+    settings->recording_write_events =
+        guac_user_parse_args_boolean(user, GUAC_VNC_CLIENT_ARGS, argv,
+                IDX_RECORDING_WRITE_EVENTS, false);
+
+    /* Parse rate of output recorded directly from the display */
+    settings->recording_frame_rate =
+        guac_user_parse_args_int(user, GUAC_VNC_CLIENT_ARGS, argv,
+                IDX_RECORDING_FRAME_RATE, 0);
+
     /* Parse clipboard copy disable flag */
     settings->disable_copy =
         guac_user_parse_args_boolean(user, GUAC_VNC_CLIENT_ARGS, argv,
@@ -22,6 +22,8 @@
 
 #include "config.h"
 
+#include <guacamole/recording.h>
+
 #include <stdbool.h>
 
 /**
@@ -70,6 +72,14 @@ typedef struct guac_vnc_settings {
      */
     char* encodings;
 
+    /**
+     * Whether the encodings used within the VNC session should be chosen
+     * automatically based on the measured quality of the connection to the
+     * VNC server. If true, the encodings above are only those used
+     * initially.
+     */
+    bool adaptive_encodings;
+
     /**
      * Whether the red and blue components of each color should be swapped.
      * This is mainly used for VNC servers that do not properly handle
@@ -317,6 +327,30 @@ typedef struct guac_vnc_settings {
      * Disabled by default.
      */
     bool recording_write_existing;
+
+    /**
+     * The behavior to use if session data is produced faster than it can be
+     * written to the recording file.
+     */
+    guac_recording_overflow recording_overflow;
+
+    /**
+     * The format of the recording file.
+     */
+    guac_recording_format recording_format;
+
+    /**
+     * Whether included input events should also be written to a separate,
+     * compact binary file alongside the recording.
+     */
+    bool recording_write_events;
+
+    /**
+     * The maximum number of frames per second of graphical output to record
+     * directly from the display, or zero if the output sent to connected
+     * users should be recorded as-is.
+     */
+    int recording_frame_rate;
     
     /**
      * Whether or not to send the magic Wake-on-LAN (WoL) packet prior to
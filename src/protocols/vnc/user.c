@@ -66,7 +66,8 @@ int guac_vnc_user_join_handler(guac_user* user, int argc, char** argv) {
 
         /* Init clipboard. */
         vnc_client->clipboard =
-            guac_common_clipboard_alloc(settings->clipboard_buffer_size);
+            guac_common_clipboard_alloc(user->client,
+                    settings->clipboard_buffer_size);
 
         /* Start client thread */
         if (pthread_create(&vnc_client->client_thread, NULL, guac_vnc_client_thread, user->client)) {
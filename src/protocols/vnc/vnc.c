@@ -25,6 +25,7 @@
 #include "common/clipboard.h"
 #include "cursor.h"
 #include "display.h"
+#include "input.h"
 #include "log.h"
 #include "settings.h"
 #include "vnc.h"
@@ -234,6 +235,13 @@ rfbClient* guac_vnc_get_client(guac_client* client) {
     if (vnc_settings->encodings)
         rfb_client->appData.encodingsString = strdup(vnc_settings->encodings);
 
+    /* Begin measuring the connection if encodings are to be chosen
+     * automatically */
+    if (vnc_settings->adaptive_encodings)
+        guac_vnc_encoding_monitor_init(&vnc_client->encoding_monitor,
+                vnc_settings->quality_level >= 0 && vnc_settings->quality_level <= 9
+                    ? vnc_settings->quality_level : -1);
+
     /* Connect */
     if (rfbInitClient(rfb_client, NULL, NULL))
         return rfb_client;
@@ -285,32 +293,33 @@ static rfbBool guac_vnc_handle_messages(guac_client* client) {
 
     guac_vnc_client* vnc_client = (guac_vnc_client*) client->data;
     rfbClient* rfb_client = vnc_client->rfb_client;
-    guac_display_layer* default_layer = guac_display_default_layer(vnc_client->display);
-
-    /* All potential drawing operations must occur while holding an open context */
-    guac_display_layer_raw_context* context = guac_display_layer_open_raw(default_layer);
-    vnc_client->current_context = context;
 
     /* Actually handle messages (this may result in drawing to the
-     * guac_display, resizing the display buffer, etc.) */
-    rfbBool retval = HandleRFBServerMessage(rfb_client);
+     * framebuffer of libvncclient, resizing that framebuffer, etc.). The
+     * guac_display is not locked while doing so, such that messages can be
+     * decoded while the previous frame is being encoded. */
+    if (vnc_client->settings->adaptive_encodings)
+        guac_vnc_encoding_monitor_begin(&vnc_client->encoding_monitor, rfb_client);
 
-    /* Use the buffer of libvncclient directly if it matches the guac_display
-     * format */
-    unsigned int vnc_bpp = rfb_client->format.bitsPerPixel / 8;
-    if (vnc_bpp == GUAC_DISPLAY_LAYER_RAW_BPP && !vnc_client->settings->swap_red_blue) {
+    rfbBool retval = HandleRFBServerMessage(rfb_client);
 
-        context->buffer = rfb_client->frameBuffer;
-        context->stride = guac_mem_ckd_mul_or_die(vnc_bpp, rfb_client->width);
+    /* Reconsider the encodings in use as the connection is measured */
+    if (retval && vnc_client->settings->adaptive_encodings)
+        guac_vnc_encoding_monitor_end(client, &vnc_client->encoding_monitor,
+                rfb_client);
 
-        /* Update bounds of pending frame to match those of RFB framebuffer */
-        guac_rect_init(&context->bounds, 0, 0, rfb_client->width, rfb_client->height);
+    /* Request further updates only for the part of the framebuffer that
+     * guac_display can actually show (libvncclient resets this region to
+     * cover the whole framebuffer whenever the framebuffer is resized) */
+    if (rfb_client->updateRect.w > GUAC_DISPLAY_MAX_WIDTH)
+        rfb_client->updateRect.w = GUAC_DISPLAY_MAX_WIDTH;
 
-    }
+    if (rfb_client->updateRect.h > GUAC_DISPLAY_MAX_HEIGHT)
+        rfb_client->updateRect.h = GUAC_DISPLAY_MAX_HEIGHT;
 
-    /* There will be no further drawing operations */
-    guac_display_layer_close_raw(default_layer, context);
-    vnc_client->current_context = NULL;
+    /* Apply everything changed by the message to the guac_display, which
+     * keeps its own copy of the framebuffer */
+    guac_vnc_display_flush_changes(client);
 
 #ifdef LIBVNC_HAS_RESIZE_SUPPORT
     // If screen was not previously initialized, check for it and set it.
@@ -337,11 +346,6 @@ static rfbBool guac_vnc_handle_messages(guac_client* client) {
     }
 #endif // LIBVNC_HAS_RESIZE_SUPPORT
 
-    /* Resize the surface if VNC screen size has changed (this call
-     * automatically deals with invalid dimensions and is a no-op
-     * if the size has not changed) */
-    guac_display_layer_resize(default_layer, rfb_client->width, rfb_client->height);
-
     return retval;
 
 }
@@ -587,7 +591,11 @@ void* guac_vnc_client_thread(void* data) {
                 !settings->recording_exclude_mouse,
                 0, /* Touch events not supported */
                 settings->recording_include_keys,
-                settings->recording_write_existing);
+                settings->recording_write_existing,
+                settings->recording_write_events,
+                settings->recording_overflow,
+                settings->recording_format,
+                settings->recording_frame_rate);
     }
 
     /* Create display */
@@ -599,6 +607,17 @@ void* guac_vnc_client_thread(void* data) {
     guac_display_layer_set_lossless(guac_display_default_layer(vnc_client->display),
             settings->lossless);
 
+    /* Periodically record keyframes of the display, if the recording format
+     * supports seeking */
+    if (vnc_client->recording != NULL)
+        guac_recording_start_keyframes(vnc_client->recording,
+                vnc_client->display);
+
+    /* Record output directly from the display, if requested */
+    if (vnc_client->recording != NULL)
+        guac_recording_start_output(vnc_client->recording,
+                vnc_client->display);
+
     /* If compression and display quality have been configured, set those. */
     if (settings->compress_level >= 0 && settings->compress_level <= 9)
         rfb_client->appData.compressLevel = settings->compress_level;
@@ -624,6 +643,15 @@ void* guac_vnc_client_thread(void* data) {
 
     vnc_client->render_thread = guac_display_render_thread_create(vnc_client->display);
 
+    /* Send user input from its own thread, such that input is never held
+     * back by the handling of framebuffer updates */
+    if (pthread_create(&vnc_client->input_thread, NULL,
+                guac_vnc_input_thread, client))
+        guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
+                "Unable to start input thread.");
+    else
+        vnc_client->input_thread_started = 1;
+
     /* Handle messages from VNC server while client is running */
     while (client->state == GUAC_CLIENT_RUNNING) {
 
@@ -639,6 +667,18 @@ void* guac_vnc_client_thread(void* data) {
                 break;
             }
 
+            /* libvncclient requests the next incremental update as soon as
+             * each update has been handled. Holding off on handling that next
+             * update until the current changes have actually been sent to
+             * users ties the rate of those requests to the rate that users
+             * can receive frames, rather than having the VNC server encode
+             * frames that would only be discarded. */
+            if (vnc_client->update_received) {
+                vnc_client->update_received = 0;
+                guac_display_render_thread_wait_for_frame(vnc_client->render_thread,
+                        GUAC_VNC_MAX_FRAME_WAIT);
+            }
+
             wait_result = guac_vnc_wait_for_messages(rfb_client, 0);
 
         }
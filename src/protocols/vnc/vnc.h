@@ -24,11 +24,16 @@
 
 #include "common/clipboard.h"
 #include "common/iconv.h"
+#include "convert.h"
+#include "cursor.h"
 #include "display.h"
+#include "encodings.h"
+#include "input.h"
 #include "settings.h"
 
 #include <guacamole/client.h>
 #include <guacamole/display.h>
+#include <guacamole/fifo-lockfree.h>
 #include <guacamole/layer.h>
 #include <rfb/rfbclient.h>
 
@@ -79,6 +84,34 @@ typedef struct guac_vnc_client {
      */
     rfbClient* rfb_client;
 
+    /**
+     * The thread which sends queued input events to the VNC server (see
+     * guac_vnc_input_thread()).
+     */
+    pthread_t input_thread;
+
+    /**
+     * Whether input_thread has been started.
+     */
+    int input_thread_started;
+
+    /**
+     * Queue of all input events received from users that have not yet been
+     * sent to the VNC server by the input thread.
+     */
+    guac_fifo_lockfree input_events;
+
+    /**
+     * Storage for the input_events queue (see above).
+     */
+    guac_vnc_input_event input_events_items[GUAC_VNC_INPUT_EVENT_QUEUE_SIZE];
+
+    /**
+     * Storage for the sequence numbers of each item within the input_events
+     * queue (see above).
+     */
+    size_t input_events_sequences[GUAC_VNC_INPUT_EVENT_QUEUE_SIZE];
+
     /**
      * The original framebuffer malloc procedure provided by the initialized
      * rfbClient.
@@ -91,12 +124,6 @@ typedef struct guac_vnc_client {
      */
     GotCopyRectProc rfb_GotCopyRect;
 
-    /**
-     * Whether copyrect  was used to produce the latest update received
-     * by the VNC server.
-     */
-    int copy_rect_used;
-
     /**
      * Client settings, parsed from args.
      */
@@ -108,10 +135,23 @@ typedef struct guac_vnc_client {
     guac_display* display;
 
     /**
-     * The context of the current drawing (update) operation, if any. If no
-     * operation is in progress, this will be NULL.
+     * The changes made by libvncclient to its framebuffer that have not yet
+     * been applied to the guac_display by guac_vnc_display_flush_changes(),
+     * in the order they were made.
      */
-    guac_display_layer_raw_context* current_context;
+    guac_vnc_pending_change pending_changes[GUAC_VNC_MAX_PENDING_CHANGES];
+
+    /**
+     * The number of entries within pending_changes.
+     */
+    int pending_change_count;
+
+    /**
+     * A region covering all changes that could not be recorded within
+     * pending_changes due to lack of space. This is empty if no such changes
+     * have been made.
+     */
+    guac_rect pending_overflow;
 
     /**
      * The current instance of the guac_display render thread. If the thread
@@ -119,6 +159,12 @@ typedef struct guac_vnc_client {
      */
     guac_display_render_thread* render_thread;
 
+    /**
+     * Whether the message most recently handled from the VNC server updated
+     * the contents of the framebuffer.
+     */
+    int update_received;
+
     /**
      * Internal clipboard.
      */
@@ -164,6 +210,32 @@ typedef struct guac_vnc_client {
      */
     guac_iconv_write* clipboard_writer;
 
+    /**
+     * The lookup tables and conversion function used to convert pixels from
+     * the pixel format of the VNC framebuffer to that of guac_display, if
+     * those formats differ.
+     */
+    guac_vnc_converter converter;
+
+    /**
+     * Buffers containing the cursor images most recently received from the
+     * VNC server, such that cursor images already sent to connected users
+     * need not be converted or sent again.
+     */
+    guac_vnc_cursor_cache_entry cursor_cache[GUAC_VNC_CURSOR_CACHE_SIZE];
+
+    /**
+     * A counter which is incremented each time the cursor changes, used to
+     * determine which entry of the cursor cache was least recently used.
+     */
+    uint64_t cursor_cache_clock;
+
+    /**
+     * Measurements of the connection to the VNC server, used to choose
+     * encodings automatically if the "encodings" parameter is "auto".
+     */
+    guac_vnc_encoding_monitor encoding_monitor;
+
 #ifdef LIBVNC_HAS_RESIZE_SUPPORT
     /**
      * Whether or not the server has sent the required message to initialize
@@ -24,38 +24,105 @@
 #include <guacamole/audio.h>
 #include <guacamole/mem.h>
 #include <guacamole/client.h>
+#include <guacamole/socket.h>
 #include <guacamole/user.h>
 #include <pulse/pulseaudio.h>
 
 /**
- * Returns whether the given buffer contains only silence (only null bytes).
+ * Returns the number of bytes of PCM data that represent the given duration
+ * of audio.
  *
- * @param buffer
- *     The audio buffer to check.
+ * @param milliseconds
+ *     The duration of audio, in milliseconds.
  *
- * @param length
- *     The length of the buffer to check.
+ * @return
+ *     The number of bytes of PCM data representing the given duration.
+ */
+static int guac_pa_latency_bytes(int milliseconds) {
+    return GUAC_PULSE_AUDIO_RATE / 1000 * GUAC_PULSE_AUDIO_CHANNELS
+        * (GUAC_PULSE_AUDIO_BPS / 8) * milliseconds;
+}
+
+/**
+ * Populates the given PulseAudio buffer attributes such that fragments of the
+ * given duration are received, and such that no more than a few fragments are
+ * ever buffered by PulseAudio.
+ *
+ * @param attr
+ *     The buffer attributes to populate.
+ *
+ * @param latency
+ *     The duration of audio that should be contained in each fragment, in
+ *     milliseconds.
+ */
+static void guac_pa_buffer_attr(pa_buffer_attr* attr, int latency) {
+
+    attr->fragsize  = guac_pa_latency_bytes(latency);
+    attr->maxlength = attr->fragsize * GUAC_PULSE_AUDIO_FRAGMENTS;
+
+    /* Attributes specific to playback streams */
+    attr->tlength   = (uint32_t) -1;
+    attr->prebuf    = (uint32_t) -1;
+    attr->minreq    = (uint32_t) -1;
+
+}
+
+/**
+ * Returns the amount of audio that should be sent within each audio packet
+ * given the current processing lag of connected users. Audio is sent in the
+ * smallest packets possible while users keep up, with packet size growing
+ * with lag such that lagging users receive fewer, larger packets.
+ *
+ * @param client
+ *     The client whose users will receive the audio.
  *
  * @return
- *     Non-zero if the audio buffer contains silence, zero otherwise.
+ *     The amount of audio to send within each packet, in milliseconds.
  */
-static int guac_pa_is_silence(const void* buffer, size_t length) {
+static int guac_pa_target_latency(guac_client* client) {
 
-    int i;
+    int latency = GUAC_PULSE_AUDIO_MIN_LATENCY
+        + guac_client_get_pacing_lag(client);
 
-    const unsigned char* current = (const unsigned char*) buffer;
+    if (latency > GUAC_PULSE_AUDIO_MAX_LATENCY)
+        latency = GUAC_PULSE_AUDIO_MAX_LATENCY;
 
-    /* For each byte in buffer */
-    for (i = 0; i < length; i++) {
+    return latency;
 
-        /* If current value non-zero, then not silence */
-        if (*(current++))
-            return 0;
+}
 
-    }
+/**
+ * Updates the amount of audio requested within each fragment received from
+ * PulseAudio to track the processing lag of connected users. To avoid
+ * constantly renegotiating with PulseAudio while lag fluctuates, fragments
+ * are resized only once the target changes by at least a factor of two.
+ *
+ * @param guac_stream
+ *     The guac_pa_stream receiving audio data from PulseAudio.
+ *
+ * @param stream
+ *     The PulseAudio stream whose fragment size should be updated.
+ */
+static void guac_pa_update_latency(guac_pa_stream* guac_stream,
+        pa_stream* stream) {
 
-    /* Otherwise, the buffer contains 100% silence */
-    return 1;
+    int latency = guac_pa_target_latency(guac_stream->client);
+    if (latency < guac_stream->latency * 2
+            && latency * 2 > guac_stream->latency)
+        return;
+
+    guac_client_log(guac_stream->client, GUAC_LOG_DEBUG, "Adjusting "
+            "PulseAudio fragments from %ims to %ims.",
+            guac_stream->latency, latency);
+
+    pa_buffer_attr attr;
+    guac_pa_buffer_attr(&attr, latency);
+    guac_stream->latency = latency;
+
+    pa_operation* operation = pa_stream_set_buffer_attr(stream, &attr,
+            NULL, NULL);
+    if (operation != NULL)
+        pa_operation_unref(operation);
 
 }
 
@@ -82,19 +149,29 @@ static void __stream_read_callback(pa_stream* stream, size_t length,
     const void* buffer;
 
     /* Read data */
-    pa_stream_peek(stream, &buffer, &length);
+    if (pa_stream_peek(stream, &buffer, &length) < 0 || length == 0)
+        return;
 
-    /* Continuously write received PCM data */
-    if (!guac_pa_is_silence(buffer, length))
+    /* Continuously write received PCM data (silence is suppressed within
+     * the audio stream itself). Holes within the stream (NULL data) carry
+     * no audio and are simply skipped. */
+    if (buffer != NULL) {
         guac_audio_stream_write_pcm(audio, buffer, length);
-
-    /* Flush upon silence */
-    else
-        guac_audio_stream_flush(audio);
+        guac_stream->pending += length;
+    }
 
     /* Advance buffer */
     pa_stream_drop(stream);
 
+    /* Send audio as soon as a full packet is available, rather than waiting
+     * for the encoder's buffer to fill */
+    if (guac_stream->pending >= guac_pa_latency_bytes(guac_stream->latency)) {
+        guac_audio_stream_flush(audio);
+        guac_socket_flush(guac_stream->client->socket);
+        guac_stream->pending = 0;
+        guac_pa_update_latency(guac_stream, stream);
+    }
+
 }
 
 /**
@@ -189,8 +266,7 @@ static void __context_get_sink_info_callback(pa_context* context,
     spec.rate     = GUAC_PULSE_AUDIO_RATE;
     spec.channels = GUAC_PULSE_AUDIO_CHANNELS;
 
-    attr.maxlength = -1;
-    attr.fragsize  = GUAC_PULSE_AUDIO_FRAGMENT_SIZE;
+    guac_pa_buffer_attr(&attr, guac_stream->latency);
 
     /* Create stream */
     stream = pa_stream_new(context, "Guacamole Audio", &spec, NULL);
@@ -316,6 +392,8 @@ guac_pa_stream* guac_pa_stream_alloc(guac_client* client,
     guac_pa_stream* stream = guac_mem_alloc(sizeof(guac_pa_stream));
     stream->client = client;
     stream->audio = audio;
+    stream->latency = GUAC_PULSE_AUDIO_MIN_LATENCY;
+    stream->pending = 0;
     stream->pa_mainloop = pa_threaded_mainloop_new();
 
     /* Create context */
@@ -28,21 +28,32 @@
 #include <pulse/pulseaudio.h>
 
 /**
- * The number of bytes to request for the audio fragments received from
- * PulseAudio.
+ * The smallest amount of audio to request within each fragment received from
+ * PulseAudio and to send within each audio packet, in milliseconds. This is
+ * the latency targeted while clients keep up with the connection.
  */
-#define GUAC_PULSE_AUDIO_FRAGMENT_SIZE 8192
+#define GUAC_PULSE_AUDIO_MIN_LATENCY 20
 
 /**
- * The minimum number of PCM bytes to wait for before flushing an audio
- * packet. The current value is 48K, which works out to be around 280ms.
+ * The largest amount of audio to request within each fragment received from
+ * PulseAudio and to send within each audio packet, in milliseconds. Larger
+ * packets are used only while clients are lagging, as fewer, larger packets
+ * are more tolerant of jitter.
  */
-#define GUAC_PULSE_PCM_WRITE_RATE 49152
+#define GUAC_PULSE_AUDIO_MAX_LATENCY 200
 
 /**
- * Rate of audio to stream, in Hz.
+ * The number of fragments of audio that PulseAudio may buffer before older
+ * audio is discarded, bounding the latency that can accumulate if audio is
+ * not read quickly enough.
  */
-#define GUAC_PULSE_AUDIO_RATE 44100
+#define GUAC_PULSE_AUDIO_FRAGMENTS 4
+
+/**
+ * Rate of audio to stream, in Hz. This is the native rate of Opus, such that
+ * audio need not be resampled if Opus is supported by the client.
+ */
+#define GUAC_PULSE_AUDIO_RATE 48000
 
 /**
  * The number of channels to stream.
@@ -75,6 +86,20 @@ typedef struct guac_pa_stream {
      */
     pa_threaded_mainloop* pa_mainloop;
 
+    /**
+     * The amount of audio currently requested within each fragment received
+     * from PulseAudio and sent within each audio packet, in milliseconds.
+     * This is adjusted according to the processing lag of connected users,
+     * and is only accessed by the PulseAudio event loop.
+     */
+    int latency;
+
+    /**
+     * The number of bytes of PCM data written to the audio stream since it
+     * was last flushed. This is only accessed by the PulseAudio event loop.
+     */
+    int pending;
+
 } guac_pa_stream;
 
 /**
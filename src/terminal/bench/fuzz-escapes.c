@@ -0,0 +1,516 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+/*
+ * Feeds pseudo-random output, weighted heavily toward control functions and
+ * escape sequences, through guac_terminal_write() of a real terminal,
+ * exercising the handlers of the terminal emulator (guac_terminal_csi(),
+ * guac_terminal_osc(), and others) far beyond what typical applications
+ * produce. The terminal is periodically flushed and resized, and the cursor is
+ * verified to remain within the bounds of the terminal after each write.
+ *
+ * Any given seed always produces the same sequence of inputs, such that a
+ * failure can be reproduced by rerunning with the seed reported. The fuzzer is
+ * most useful when libguac and libguac-terminal are built with a sanitizer
+ * such as AddressSanitizer (-fsanitize=address).
+ *
+ * Usage: fuzz_terminal_escapes [SEED [ITERATIONS]]
+ */
+
+#include "terminal/terminal.h"
+#include "terminal/terminal-priv.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/mem.h>
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The seed used if no seed is provided on the command line.
+ */
+#define FUZZ_DEFAULT_SEED 1
+
+/**
+ * The number of inputs generated if no number of iterations is provided on
+ * the command line.
+ */
+#define FUZZ_DEFAULT_ITERATIONS 20000
+
+/**
+ * The maximum number of tokens (runs of text, control functions, or escape
+ * sequences) within each generated input.
+ */
+#define FUZZ_MAX_TOKENS 64
+
+/**
+ * The maximum length of each generated input, in bytes.
+ */
+#define FUZZ_MAX_LENGTH 8192
+
+/**
+ * The number of generated inputs between each flush of the terminal.
+ */
+#define FUZZ_FLUSH_INTERVAL 16
+
+/**
+ * The number of generated inputs between each resize of the terminal.
+ */
+#define FUZZ_RESIZE_INTERVAL 256
+
+/**
+ * The OSC operations recognized by guac_terminal_osc(), each of which is
+ * chosen far more often than an arbitrary operation number.
+ */
+static const int fuzz_osc_operations[] = {
+    0, 2, 4, 482200, 482201, 482202, 482203, 482204
+};
+
+/**
+ * A single generated input.
+ */
+typedef struct fuzz_input {
+
+    /**
+     * The generated data.
+     */
+    char data[FUZZ_MAX_LENGTH];
+
+    /**
+     * The number of bytes of generated data.
+     */
+    int length;
+
+} fuzz_input;
+
+/**
+ * The current state of the pseudo-random number generator.
+ */
+static uint64_t fuzz_state;
+
+/**
+ * Returns the next value produced by a simple, deterministic pseudo-random
+ * number generator (xorshift64*).
+ *
+ * @param limit
+ *     The exclusive upper bound of the value to return.
+ *
+ * @return
+ *     A pseudo-random value between zero (inclusive) and the given limit
+ *     (exclusive).
+ */
+static uint32_t fuzz_random(uint32_t limit) {
+
+    fuzz_state ^= fuzz_state >> 12;
+    fuzz_state ^= fuzz_state << 25;
+    fuzz_state ^= fuzz_state >> 27;
+
+    return (uint32_t) ((fuzz_state * 0x2545F4914F6CDD1DULL) >> 32) % limit;
+
+}
+
+/**
+ * Write handler for the socket of the simulated client, discarding all data.
+ *
+ * @param socket
+ *     The guac_socket being written to.
+ *
+ * @param buf
+ *     The data being written.
+ *
+ * @param count
+ *     The number of bytes being written.
+ *
+ * @return
+ *     The number of bytes written, which is always the number of bytes
+ *     provided.
+ */
+static ssize_t fuzz_socket_write(guac_socket* socket, const void* buf,
+        size_t count) {
+    return count;
+}
+
+/**
+ * Appends a single byte to the given input, if space remains.
+ *
+ * @param input
+ *     The input to append to.
+ *
+ * @param c
+ *     The byte to append.
+ */
+static void fuzz_append(fuzz_input* input, int c) {
+    if (input->length < FUZZ_MAX_LENGTH)
+        input->data[input->length++] = (char) c;
+}
+
+/**
+ * Appends a number to the given input, usually small, but occasionally very
+ * large or overflowing.
+ *
+ * @param input
+ *     The input to append to.
+ */
+static void fuzz_append_number(fuzz_input* input) {
+
+    char number[32];
+    switch (fuzz_random(8)) {
+
+        /* Numbers outside any reasonable range */
+        case 0:
+            snprintf(number, sizeof(number), "%u", fuzz_random(UINT32_MAX));
+            break;
+
+        /* Numbers commonly near the bounds of the terminal */
+        case 1:
+        case 2:
+            snprintf(number, sizeof(number), "%u", fuzz_random(512));
+            break;
+
+        default:
+            snprintf(number, sizeof(number), "%u", fuzz_random(10));
+            break;
+
+    }
+
+    for (char* c = number; *c != '\0'; c++)
+        fuzz_append(input, *c);
+
+}
+
+/**
+ * Appends a CSI sequence to the given input, with arbitrary parameters,
+ * intermediate bytes, and final byte.
+ *
+ * @param input
+ *     The input to append to.
+ */
+static void fuzz_append_csi(fuzz_input* input) {
+
+    fuzz_append(input, 0x1B);
+    fuzz_append(input, '[');
+
+    /* Private parameter prefix */
+    if (fuzz_random(4) == 0)
+        fuzz_append(input, "?>=<"[fuzz_random(4)]);
+
+    /* Parameters, possibly empty and possibly far more than are supported */
+    int parameters = fuzz_random(4) ? fuzz_random(4) : fuzz_random(64);
+    for (int i = 0; i < parameters; i++) {
+
+        if (i > 0)
+            fuzz_append(input, fuzz_random(8) ? ';' : ':');
+
+        if (fuzz_random(8))
+            fuzz_append_number(input);
+
+    }
+
+    /* Intermediate bytes */
+    if (fuzz_random(8) == 0)
+        fuzz_append(input, 0x20 + fuzz_random(16));
+
+    /* Final byte, usually valid, occasionally an intervening control
+     * character or arbitrary byte */
+    switch (fuzz_random(16)) {
+
+        case 0:
+            fuzz_append(input, fuzz_random(0x20));
+            break;
+
+        case 1:
+            fuzz_append(input, fuzz_random(256));
+            break;
+
+        default:
+            fuzz_append(input, 0x40 + fuzz_random(0x3F));
+            break;
+
+    }
+
+}
+
+/**
+ * Appends an OSC sequence to the given input, usually for an operation
+ * recognized by the terminal, with an arbitrary payload and terminator.
+ *
+ * @param input
+ *     The input to append to.
+ */
+static void fuzz_append_osc(fuzz_input* input) {
+
+    fuzz_append(input, 0x1B);
+    fuzz_append(input, ']');
+
+    /* Operation */
+    char operation[32];
+    if (fuzz_random(4))
+        snprintf(operation, sizeof(operation), "%d", fuzz_osc_operations[
+                fuzz_random(sizeof(fuzz_osc_operations) / sizeof(fuzz_osc_operations[0]))]);
+    else
+        snprintf(operation, sizeof(operation), "%u", fuzz_random(UINT32_MAX));
+
+    for (char* c = operation; *c != '\0'; c++)
+        fuzz_append(input, *c);
+
+    fuzz_append(input, ';');
+
+    /* Payload, mixing numbers, separators, and printable text, occasionally
+     * long enough to exceed any internal buffer */
+    int length = fuzz_random(8) ? fuzz_random(32) : fuzz_random(4096);
+    for (int i = 0; i < length; i++) {
+        switch (fuzz_random(4)) {
+
+            case 0:
+                fuzz_append_number(input);
+                break;
+
+            case 1:
+                fuzz_append(input, ";:/#,"[fuzz_random(5)]);
+                break;
+
+            default:
+                fuzz_append(input, 0x20 + fuzz_random(0x5F));
+                break;
+
+        }
+    }
+
+    /* Terminator: BEL, ST, 8-bit ST, or nothing at all */
+    switch (fuzz_random(4)) {
+
+        case 0:
+            fuzz_append(input, 0x07);
+            break;
+
+        case 1:
+            fuzz_append(input, 0x1B);
+            fuzz_append(input, '\\');
+            break;
+
+        case 2:
+            fuzz_append(input, 0x9C);
+            break;
+
+    }
+
+}
+
+/**
+ * Appends a run of text to the given input, consisting of printable ASCII,
+ * valid UTF-8 (including double-width characters), or invalid UTF-8.
+ *
+ * @param input
+ *     The input to append to.
+ */
+static void fuzz_append_text(fuzz_input* input) {
+
+    int length = fuzz_random(8) ? fuzz_random(16) : fuzz_random(1024);
+    for (int i = 0; i < length; i++) {
+        switch (fuzz_random(8)) {
+
+            /* CJK Unified Ideographs (double-width) */
+            case 0: {
+                int codepoint = 0x4E00 + fuzz_random(0x5000);
+                fuzz_append(input, 0xE0 | (codepoint >> 12));
+                fuzz_append(input, 0x80 | ((codepoint >> 6) & 0x3F));
+                fuzz_append(input, 0x80 | (codepoint & 0x3F));
+                break;
+            }
+
+            /* Combining characters and other two-byte sequences */
+            case 1: {
+                int codepoint = 0x80 + fuzz_random(0x780);
+                fuzz_append(input, 0xC0 | (codepoint >> 6));
+                fuzz_append(input, 0x80 | (codepoint & 0x3F));
+                break;
+            }
+
+            /* Arbitrary (and likely invalid) bytes */
+            case 2:
+                fuzz_append(input, 0x80 + fuzz_random(0x80));
+                break;
+
+            default:
+                fuzz_append(input, 0x20 + fuzz_random(0x5F));
+                break;
+
+        }
+    }
+
+}
+
+/**
+ * Generates a new pseudo-random input consisting of an arbitrary mix of
+ * text, control characters, and escape sequences.
+ *
+ * @param input
+ *     The input to populate.
+ */
+static void fuzz_generate(fuzz_input* input) {
+
+    input->length = 0;
+
+    int tokens = 1 + fuzz_random(FUZZ_MAX_TOKENS);
+    for (int i = 0; i < tokens; i++) {
+        switch (fuzz_random(10)) {
+
+            case 0:
+            case 1:
+            case 2:
+                fuzz_append_csi(input);
+                break;
+
+            case 3:
+                fuzz_append_osc(input);
+                break;
+
+            /* Escape followed by any single byte, covering ESC sequences,
+             * character set selection, DCS, APC, etc. */
+            case 4:
+                fuzz_append(input, 0x1B);
+                fuzz_append(input, fuzz_random(256));
+                if (fuzz_random(2))
+                    fuzz_append(input, fuzz_random(256));
+                break;
+
+            /* C0 and C1 control characters */
+            case 5:
+                fuzz_append(input, fuzz_random(2)
+                        ? fuzz_random(0x20) : 0x80 + fuzz_random(0x20));
+                break;
+
+            default:
+                fuzz_append_text(input);
+                break;
+
+        }
+    }
+
+}
+
+/**
+ * Verifies that the cursor of the given terminal lies within the bounds of
+ * the terminal, aborting with a description of the failure otherwise.
+ *
+ * @param terminal
+ *     The terminal to verify.
+ *
+ * @param seed
+ *     The seed being used, included within any failure message.
+ *
+ * @param iteration
+ *     The current iteration, included within any failure message.
+ */
+static void fuzz_verify(guac_terminal* terminal, uint64_t seed,
+        int iteration) {
+
+    guac_terminal_lock(terminal);
+
+    /* The cursor may sit just past the last column while a wrap is pending */
+    if (terminal->cursor_row < 0 || terminal->cursor_row >= terminal->term_height
+            || terminal->cursor_col < 0 || terminal->cursor_col > terminal->term_width) {
+        fprintf(stderr, "seed %llu, iteration %i: cursor (%i, %i) outside "
+                "%ix%i terminal\n", (unsigned long long) seed, iteration,
+                terminal->cursor_row, terminal->cursor_col,
+                terminal->term_width, terminal->term_height);
+        abort();
+    }
+
+    guac_terminal_unlock(terminal);
+
+}
+
+int main(int argc, char** argv) {
+
+    uint64_t seed = FUZZ_DEFAULT_SEED;
+    int iterations = FUZZ_DEFAULT_ITERATIONS;
+
+    if (argc > 1)
+        seed = strtoull(argv[1], NULL, 10);
+
+    if (argc > 2)
+        iterations = atoi(argv[2]);
+
+    /* xorshift requires a non-zero state */
+    fuzz_state = seed ? seed : FUZZ_DEFAULT_SEED;
+
+    guac_client* client = guac_client_alloc();
+
+    /* Discard all output */
+    guac_socket_free(client->socket);
+    client->socket = guac_socket_alloc();
+    client->socket->write_handler = fuzz_socket_write;
+
+    /* Frames are flushed explicitly, not by the render thread of the
+     * terminal, which exits immediately if the client is not running */
+    client->state = GUAC_CLIENT_STOPPING;
+
+    guac_terminal_options* options = guac_terminal_options_create(800, 600, 96);
+    guac_terminal* terminal = guac_terminal_create(client, options);
+    guac_mem_free(options);
+
+    if (terminal == NULL) {
+        fprintf(stderr, "Unable to create terminal\n");
+        guac_client_free(client);
+        return 1;
+    }
+
+    guac_terminal_start(terminal);
+
+    fuzz_input* input = guac_mem_alloc(sizeof(fuzz_input));
+    uint64_t total = 0;
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+
+        fuzz_generate(input);
+        guac_terminal_write(terminal, input->data, input->length);
+        total += input->length;
+
+        fuzz_verify(terminal, seed, iteration);
+
+        if (iteration % FUZZ_RESIZE_INTERVAL == FUZZ_RESIZE_INTERVAL - 1)
+            guac_terminal_resize(terminal, 100 + fuzz_random(1500),
+                    100 + fuzz_random(1000));
+
+        if (iteration % FUZZ_FLUSH_INTERVAL == FUZZ_FLUSH_INTERVAL - 1) {
+            guac_terminal_lock(terminal);
+            guac_terminal_flush(terminal);
+            guac_terminal_unlock(terminal);
+            guac_display_end_frame(terminal->graphical_display);
+        }
+
+    }
+
+    printf("fuzz-escapes: seed %llu, %i inputs, %llu bytes\n",
+            (unsigned long long) seed, iterations, (unsigned long long) total);
+
+    guac_mem_free(input);
+    guac_terminal_free(terminal);
+    guac_client_free(client);
+
+    return 0;
+
+}
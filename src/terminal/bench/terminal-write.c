@@ -0,0 +1,591 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+/*
+ * Measures the cost of handling terminal output, feeding synthetic VT streams
+ * representative of common workloads through guac_terminal_write() of a real
+ * terminal whose output is written to a socket that merely counts bytes. For
+ * each stream, the rate at which output is parsed into the terminal buffer,
+ * the drawing performed by each flushed frame, the amount of data sent per
+ * frame, and the number of system allocations required for planning are
+ * reported.
+ */
+
+#include "bench.h"
+#include "terminal/display.h"
+#include "terminal/terminal.h"
+#include "terminal/terminal-priv.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/mem.h>
+#include <guacamole/socket.h>
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The width of the simulated terminal, in pixels.
+ */
+#define BENCH_TERMINAL_WIDTH 1024
+
+/**
+ * The height of the simulated terminal, in pixels.
+ */
+#define BENCH_TERMINAL_HEIGHT 768
+
+/**
+ * The resolution of the simulated terminal, in DPI.
+ */
+#define BENCH_TERMINAL_DPI 96
+
+/**
+ * The minimum length of each generated stream, in bytes.
+ */
+#define BENCH_STREAM_LENGTH (4 * 1024 * 1024)
+
+/**
+ * The number of bytes passed to each call to guac_terminal_write(), matching
+ * the size of the reads performed by the protocol implementations.
+ */
+#define BENCH_WRITE_SIZE 4096
+
+/**
+ * The number of bytes written to the terminal between each flushed frame,
+ * approximating the amount of output received within a single frame while
+ * output is flooding the terminal.
+ */
+#define BENCH_FRAME_BYTES 65536
+
+/**
+ * A growable buffer containing a generated VT stream.
+ */
+typedef struct bench_stream {
+
+    /**
+     * The generated data.
+     */
+    char* data;
+
+    /**
+     * The number of bytes of generated data.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for the data buffer.
+     */
+    size_t size;
+
+} bench_stream;
+
+/**
+ * Function which appends a single unit of output, such as a line of text or
+ * a full screen refresh, to the stream generated for a workload.
+ *
+ * @param stream
+ *     The stream to append to.
+ *
+ * @param rows
+ *     The number of rows of the terminal receiving the stream.
+ *
+ * @param columns
+ *     The number of columns of the terminal receiving the stream.
+ *
+ * @param index
+ *     The number of units already generated for the stream.
+ */
+typedef void bench_workload_generate(bench_stream* stream, int rows,
+        int columns, int index);
+
+/**
+ * A single workload fed through guac_terminal_write().
+ */
+typedef struct bench_workload {
+
+    /**
+     * The name of the workload, as included within reported results.
+     */
+    const char* name;
+
+    /**
+     * The function that generates each unit of the stream of the workload.
+     */
+    bench_workload_generate* generate;
+
+} bench_workload;
+
+/**
+ * The total number of bytes written to the socket of the simulated client.
+ */
+static uint64_t bench_bytes_written = 0;
+
+/**
+ * Lock guarding access to bench_bytes_written.
+ */
+static pthread_mutex_t bench_bytes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Write handler for the socket of the simulated client, discarding all data
+ * while counting the number of bytes written.
+ *
+ * @param socket
+ *     The guac_socket being written to.
+ *
+ * @param buf
+ *     The data being written.
+ *
+ * @param count
+ *     The number of bytes being written.
+ *
+ * @return
+ *     The number of bytes written, which is always the number of bytes
+ *     provided.
+ */
+static ssize_t bench_socket_write(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    pthread_mutex_lock(&bench_bytes_lock);
+    bench_bytes_written += count;
+    pthread_mutex_unlock(&bench_bytes_lock);
+
+    return count;
+
+}
+
+/**
+ * Returns the total number of bytes written to the socket of the simulated
+ * client thus far.
+ *
+ * @return
+ *     The total number of bytes written.
+ */
+static uint64_t bench_get_bytes_written(void) {
+
+    pthread_mutex_lock(&bench_bytes_lock);
+    uint64_t bytes = bench_bytes_written;
+    pthread_mutex_unlock(&bench_bytes_lock);
+
+    return bytes;
+
+}
+
+/**
+ * Returns an arbitrary but deterministic 32-bit value derived from the given
+ * values.
+ *
+ * @param a
+ *     The first value to hash.
+ *
+ * @param b
+ *     The second value to hash.
+ *
+ * @return
+ *     A 32-bit value derived from the given values.
+ */
+static uint32_t bench_hash(uint32_t a, uint32_t b) {
+
+    uint32_t h = a * 0x9E3779B1 ^ b * 0x85EBCA77;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6D;
+    h ^= h >> 12;
+
+    return h;
+
+}
+
+/**
+ * Appends printf-style formatted data to the given stream, growing the
+ * stream as necessary.
+ *
+ * @param stream
+ *     The stream to append to.
+ *
+ * @param format
+ *     A printf-style format string.
+ *
+ * @param ...
+ *     Any arguments to use when filling the format string.
+ */
+static void bench_stream_printf(bench_stream* stream,
+        const char* format, ...) {
+
+    for (;;) {
+
+        size_t available = stream->size - stream->length;
+
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(stream->data + stream->length, available,
+                format, args);
+        va_end(args);
+
+        if (length < 0)
+            return;
+
+        /* Done if the formatted data (and its null terminator) fit */
+        if ((size_t) length < available) {
+            stream->length += length;
+            return;
+        }
+
+        stream->size = stream->size * 2 + length;
+        stream->data = guac_mem_realloc_or_die(stream->data, stream->size);
+
+    }
+
+}
+
+/**
+ * Appends the UTF-8 encoding of the given codepoint to the given stream.
+ * Only codepoints within the Basic Multilingual Plane are supported.
+ *
+ * @param stream
+ *     The stream to append to.
+ *
+ * @param codepoint
+ *     The codepoint to append.
+ */
+static void bench_stream_utf8(bench_stream* stream, int codepoint) {
+
+    if (codepoint < 0x80)
+        bench_stream_printf(stream, "%c", codepoint);
+
+    else if (codepoint < 0x800)
+        bench_stream_printf(stream, "%c%c",
+                0xC0 | (codepoint >> 6),
+                0x80 | (codepoint & 0x3F));
+
+    else
+        bench_stream_printf(stream, "%c%c%c",
+                0xE0 | (codepoint >> 12),
+                0x80 | ((codepoint >> 6) & 0x3F),
+                0x80 | (codepoint & 0x3F));
+
+}
+
+/**
+ * Generates the output of "yes", a single short line repeated endlessly.
+ */
+static void bench_generate_yes(bench_stream* stream, int rows, int columns,
+        int index) {
+    bench_stream_printf(stream, "y\r\n");
+}
+
+/**
+ * Generates the output of a build whose progress is colorized, occasionally
+ * interrupted by compiler warnings that quote the offending source.
+ */
+static void bench_generate_build_log(bench_stream* stream, int rows,
+        int columns, int index) {
+
+    uint32_t hash = bench_hash(index, 0);
+
+    bench_stream_printf(stream,
+            "\x1B[32m[%3d%%] \x1B[0m\x1B[32mBuilding C object "
+            "src/module%u/CMakeFiles/module%u.dir/source-file-%u.c.o\x1B[0m\r\n",
+            index / 100 % 101, hash % 16, hash % 16, hash % 1000);
+
+    if (hash % 17 == 0) {
+        bench_stream_printf(stream,
+                "\x1B[1msrc/module%u/source-file-%u.c:%u:%u: "
+                "\x1B[35mwarning: \x1B[0m\x1B[1munused variable 'value%u' "
+                "[\x1B[35m-Wunused-variable\x1B[0m\x1B[1m]\x1B[0m\r\n"
+                "  %4u |     int value%u = 0;\r\n"
+                "       |         \x1B[32m^~~~~~\x1B[0m\r\n",
+                hash % 16, hash % 1000, hash % 4000, hash % 40,
+                index, hash % 4000, index);
+    }
+
+}
+
+/**
+ * Generates the output of vim scrolling through a syntax-highlighted source
+ * file one line at a time, using a scrolling region above the status line.
+ */
+static void bench_generate_vim_scroll(bench_stream* stream, int rows,
+        int columns, int index) {
+
+    /* Switch to alternate buffer upon start */
+    if (index == 0)
+        bench_stream_printf(stream, "\x1B[?1049h\x1B[H\x1B[2J");
+
+    /* Scroll text above status line up by one row */
+    bench_stream_printf(stream, "\x1B[1;%dr\x1B[%d;1H\n",
+            rows - 1, rows - 1);
+
+    /* Draw newly-exposed line of source, including line number */
+    uint32_t hash = bench_hash(index, 0);
+    int indent = (hash % 4) * 4;
+    bench_stream_printf(stream,
+            "\x1B[%d;1H\x1B[33m%5d \x1B[m%*s\x1B[38;5;81mstatic\x1B[m "
+            "\x1B[38;5;118mint\x1B[m function_%u(\x1B[38;5;118mconst\x1B[m "
+            "\x1B[38;5;118mchar\x1B[m* name, \x1B[38;5;118mint\x1B[m count) {"
+            " \x1B[38;5;242m/* %u */\x1B[m\x1B[K",
+            rows - 1, index + 1, indent, "", hash % 1000, hash);
+
+    /* Update status line */
+    bench_stream_printf(stream,
+            "\x1B[r\x1B[%d;1H\x1B[7m source-file.c%*s%d,1%*s%d%% \x1B[m"
+            "\x1B[%d;7H",
+            rows, columns - 40, "", index + 1, 10, "",
+            index % 100, rows - 1);
+
+}
+
+/**
+ * Generates the output of htop, with each unit being a full refresh of the
+ * CPU meters and process list.
+ */
+static void bench_generate_htop(bench_stream* stream, int rows,
+        int columns, int index) {
+
+    /* Switch to alternate buffer upon start */
+    if (index == 0)
+        bench_stream_printf(stream, "\x1B[?1049h\x1B[H\x1B[2J");
+
+    /* CPU meters */
+    int meter_width = columns / 2 - 12;
+    for (int cpu = 0; cpu < 8 && cpu + 1 < rows; cpu++) {
+
+        int used = bench_hash(index, cpu) % (meter_width + 1);
+        int system = used / 4;
+
+        bench_stream_printf(stream,
+                "\x1B[%d;1H\x1B[36m%4d\x1B[39m\x1B[1m[\x1B[0m"
+                "\x1B[32m%.*s\x1B[31m%.*s\x1B[0m%*s"
+                "\x1B[1m%5.1f%%]\x1B[0m",
+                cpu + 1, cpu,
+                used - system, "||||||||||||||||||||||||||||||||||||||||"
+                               "||||||||||||||||||||||||||||||||||||||||",
+                system, "||||||||||||||||||||||||||||||||||||||||",
+                meter_width - used, "",
+                100.0 * used / meter_width);
+
+    }
+
+    /* Process list header */
+    bench_stream_printf(stream,
+            "\x1B[10;1H\x1B[30;42m    PID USER      PRI  NI  VIRT   RES S "
+            "CPU%% MEM%%   TIME+  Command%*s\x1B[0m",
+            columns - 64, "");
+
+    /* Process list */
+    for (int row = 11; row < rows; row++) {
+
+        uint32_t hash = bench_hash(index, row);
+        bench_stream_printf(stream,
+                "\x1B[%d;1H%s%7u \x1B[32muser\x1B[39m      20   0 %4uM %4uM "
+                "\x1B[1m%c\x1B[0m%s %4.1f %4.1f %2u:%02u.%02u "
+                "\x1B[36m/usr/bin/process-%u\x1B[39m --option=%u\x1B[0m\x1B[K",
+                row, (row == 11) ? "\x1B[30;46m" : "",
+                hash % 100000, hash % 4096, hash % 1024,
+                (hash % 7) ? 'S' : 'R', (row == 11) ? "\x1B[30;46m" : "",
+                (hash % 1000) / 10.0, (hash % 500) / 10.0,
+                hash % 60, hash % 59, hash % 99,
+                row, hash % 100);
+
+    }
+
+}
+
+/**
+ * Generates lines of CJK text, consisting almost entirely of double-width
+ * characters interspersed with ASCII punctuation.
+ */
+static void bench_generate_cjk(bench_stream* stream, int rows, int columns,
+        int index) {
+
+    int length = bench_hash(index, 0) % columns;
+    for (int i = 0; i < length; i++) {
+
+        uint32_t hash = bench_hash(index, i + 1);
+
+        /* Occasional ASCII punctuation and spaces */
+        if (hash % 11 == 0)
+            bench_stream_utf8(stream, (hash % 2) ? ',' : ' ');
+
+        /* CJK Unified Ideographs */
+        else
+            bench_stream_utf8(stream, 0x4E00 + hash % 0x5000);
+
+    }
+
+    bench_stream_printf(stream, "\r\n");
+
+}
+
+/**
+ * Flushes all pending changes to the given terminal as a single frame,
+ * measuring the time taken to flush.
+ *
+ * @param terminal
+ *     The terminal to flush.
+ *
+ * @return
+ *     The amount of time taken to flush the terminal, in nanoseconds.
+ */
+static int64_t bench_flush_frame(guac_terminal* terminal) {
+
+    int64_t start = guac_bench_now();
+
+    guac_terminal_lock(terminal);
+    guac_terminal_flush(terminal);
+    guac_terminal_unlock(terminal);
+
+    guac_display_end_frame(terminal->graphical_display);
+
+    return guac_bench_now() - start;
+
+}
+
+/**
+ * Feeds the stream of the given workload through a newly-allocated terminal,
+ * reporting the resulting measurements.
+ *
+ * @param workload
+ *     The workload to replay.
+ */
+static void bench_replay(const bench_workload* workload) {
+
+    guac_client* client = guac_client_alloc();
+
+    /* Discard all output while counting the number of bytes sent */
+    guac_socket_free(client->socket);
+    client->socket = guac_socket_alloc();
+    client->socket->write_handler = bench_socket_write;
+
+    /* Frames are flushed explicitly by the benchmark, not by the render
+     * thread of the terminal, which exits immediately if the client is not
+     * running */
+    client->state = GUAC_CLIENT_STOPPING;
+
+    guac_terminal_options* options = guac_terminal_options_create(
+            BENCH_TERMINAL_WIDTH, BENCH_TERMINAL_HEIGHT, BENCH_TERMINAL_DPI);
+
+    guac_terminal* terminal = guac_terminal_create(client, options);
+    guac_mem_free(options);
+
+    if (terminal == NULL) {
+        fprintf(stderr, "%s: unable to create terminal\n", workload->name);
+        guac_client_free(client);
+        return;
+    }
+
+    guac_terminal_start(terminal);
+
+    /* Generate the stream to fit the dimensions of the terminal */
+    int rows = guac_terminal_get_rows(terminal);
+    int columns = guac_terminal_get_columns(terminal);
+
+    bench_stream stream = {
+        .data = guac_mem_alloc(BENCH_STREAM_LENGTH),
+        .length = 0,
+        .size = BENCH_STREAM_LENGTH
+    };
+
+    for (int index = 0; stream.length < BENCH_STREAM_LENGTH; index++)
+        workload->generate(&stream, rows, columns, index);
+
+    guac_display_stats before;
+    guac_display_get_stats(terminal->graphical_display, &before);
+    guac_terminal_display_stats drawn = terminal->display->stats;
+    uint64_t bytes = bench_get_bytes_written();
+
+    int64_t write_time = 0;
+    int64_t flush_time = 0;
+    int frames = 0;
+
+    size_t unflushed = 0;
+    for (size_t offset = 0; offset < stream.length; offset += BENCH_WRITE_SIZE) {
+
+        size_t length = stream.length - offset;
+        if (length > BENCH_WRITE_SIZE)
+            length = BENCH_WRITE_SIZE;
+
+        int64_t start = guac_bench_now();
+        guac_terminal_write(terminal, stream.data + offset, length);
+        write_time += guac_bench_now() - start;
+
+        unflushed += length;
+        if (unflushed >= BENCH_FRAME_BYTES) {
+            flush_time += bench_flush_frame(terminal);
+            unflushed = 0;
+            frames++;
+        }
+
+    }
+
+    /* Flush any remaining output */
+    if (unflushed) {
+        flush_time += bench_flush_frame(terminal);
+        frames++;
+    }
+
+    guac_display_stats after;
+    guac_display_get_stats(terminal->graphical_display, &after);
+    bytes = bench_get_bytes_written() - bytes;
+
+    guac_terminal_display_stats* current = &terminal->display->stats;
+    uint64_t operations =
+          current->copy_rects  - drawn.copy_rects
+        + current->clear_rects - drawn.clear_rects
+        + current->glyphs      - drawn.glyphs;
+
+    char name[64];
+    snprintf(name, sizeof(name), "terminal-write/%s", workload->name);
+
+    double per_frame = frames;
+    guac_bench_report(name, "parse", stream.length, "MB/s", write_time);
+    guac_bench_report(name, "cells", current->cells - drawn.cells, "Mcells/s",
+            write_time + flush_time);
+    guac_bench_report_value(name, "flush", flush_time / 1000.0 / per_frame, "us/frame");
+    guac_bench_report_value(name, "ops", operations / per_frame, "ops/frame");
+    guac_bench_report_value(name, "sent", bytes / per_frame, "bytes/frame");
+    guac_bench_report_value(name, "allocations",
+            (after.plan_memory_allocations - before.plan_memory_allocations) / per_frame,
+            "allocs/frame");
+
+    guac_terminal_free(terminal);
+    guac_client_free(client);
+    guac_mem_free(stream.data);
+
+}
+
+int main(int argc, char** argv) {
+
+    const bench_workload workloads[] = {
+        { "yes",        bench_generate_yes        },
+        { "build-log",  bench_generate_build_log  },
+        { "vim-scroll", bench_generate_vim_scroll },
+        { "htop",       bench_generate_htop       },
+        { "cjk",        bench_generate_cjk        }
+    };
+
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+        bench_replay(&workloads[i]);
+
+    return 0;
+
+}
@@ -25,8 +25,11 @@
 #include <guacamole/mem.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 /**
  * The minimum number of columns to allocate for a buffer row, regardless of
@@ -36,132 +39,1136 @@
 #define GUAC_TERMINAL_BUFFER_ROW_MIN_SIZE 256
 
 /**
- * A single variable-length row of terminal data.
+ * The maximum number of distinct sets of attributes that may be interned
+ * within the attribute table of a single buffer. Each interned set of
+ * attributes is referenced by compressed rows using a 16-bit ID.
+ */
+#define GUAC_TERMINAL_BUFFER_MAX_ATTRIBUTES 65535
+
+/**
+ * The initial number of entries allocated for the attribute table of a
+ * buffer.
+ */
+#define GUAC_TERMINAL_BUFFER_INITIAL_ATTRIBUTES 64
+
+/**
+ * The value stored within the attribute table index to represent an unused
+ * entry.
+ */
+#define GUAC_TERMINAL_BUFFER_NO_ATTRIBUTES 0xFFFF
+
+/**
+ * The maximum number of bytes required to store any single value encoded
+ * with guac_terminal_buffer_put_varint().
+ */
+#define GUAC_TERMINAL_BUFFER_MAX_VARINT_LENGTH 5
+
+/**
+ * The maximum number of bytes of compressed data produced by
+ * guac_terminal_buffer_row_compress() for any single row.
+ */
+#define GUAC_TERMINAL_BUFFER_MAX_COMPRESSED_LENGTH \
+    ((GUAC_TERMINAL_MAX_COLUMNS * 3 + 1) * GUAC_TERMINAL_BUFFER_MAX_VARINT_LENGTH)
+
+/**
+ * The number of rows initially allocated for a buffer, if its capacity is
+ * larger. Buffers grow as rows are added, up to their capacity. This MUST be
+ * a power of two no smaller than twice GUAC_TERMINAL_MAX_ROWS, such that the
+ * visible rows and scrollback rows of a buffer can always be distinguished.
+ */
+#define GUAC_TERMINAL_BUFFER_INITIAL_ROWS (GUAC_TERMINAL_MAX_ROWS * 2)
+
+/**
+ * The number of most-recent scrollback rows that are kept compressed in
+ * memory. Older scrollback rows are moved to the buffer's spill file.
+ */
+#define GUAC_TERMINAL_BUFFER_HOT_ROWS 8192
+
+/**
+ * The number of scrollback rows which may remain decompressed after being
+ * accessed (such as for scrolling or selection) before the least recently
+ * accessed of those rows is compressed again.
+ */
+#define GUAC_TERMINAL_BUFFER_THAWED_ROWS 256
+
+/**
+ * The minimum size of a buffer's spill file, in bytes, before its unused
+ * space is reclaimed.
+ */
+#define GUAC_TERMINAL_BUFFER_SPILL_COMPACT_SIZE 1048576
+
+/**
+ * The template passed to mkstemp() when creating a buffer's spill file. The
+ * file is unlinked immediately after creation.
+ */
+#define GUAC_TERMINAL_BUFFER_SPILL_TEMPLATE "/tmp/guac-scrollback.XXXXXX"
+
+/**
+ * A single variable-length row of terminal data. Rows which have scrolled
+ * out of view may be compressed, in which case the characters array is
+ * released and the contents of the row are stored in compressed form until
+ * the row is next accessed.
  */
 typedef struct guac_terminal_buffer_row {
 
-    /**
-     * Array of guac_terminal_char representing the contents of the row.
-     */
-    guac_terminal_char* characters;
+    /**
+     * Array of guac_terminal_char representing the contents of the row, or
+     * NULL if no characters have yet been allocated or the row is
+     * compressed.
+     */
+    guac_terminal_char* characters;
+
+    /**
+     * The contents of this row in compressed form, or NULL if the row is not
+     * compressed. Compressed data consists of runs of characters sharing the
+     * same attributes, each run being the varint-encoded ID of those
+     * attributes within the buffer's attribute table, the varint-encoded
+     * number of characters in the run, and then each character as a
+     * varint-encoded value and width. Trailing characters identical to the
+     * buffer's default character are omitted.
+     */
+    unsigned char* compressed;
+
+    /**
+     * The number of bytes of compressed data, whether stored in memory or
+     * within the buffer's spill file. This is only meaningful if the row is
+     * compressed or spilled.
+     */
+    unsigned int compressed_length;
+
+    /**
+     * Whether the compressed contents of this row are stored within the
+     * buffer's spill file rather than in memory.
+     */
+    bool spilled;
+
+    /**
+     * The offset of this row's compressed contents within the buffer's spill
+     * file. This is only meaningful if the row is spilled.
+     */
+    off_t spill_offset;
+
+    /**
+     * The length of this row in characters. This is the number of initialized
+     * characters in the buffer, usually equal to the number of characters
+     * in the screen width at the time this row was created.
+     */
+    unsigned int length;
+
+    /**
+     * The number of elements in the characters array. After the length
+     * equals this value, the array must be resized.
+     */
+    unsigned int available;
+
+    /**
+     * True if the current row has been wrapped to avoid going off the screen.
+     * False otherwise.
+     */
+    bool wrapped_row;
+
+} guac_terminal_buffer_row;
+
+struct guac_terminal_buffer {
+
+    /**
+     * The character to assign to newly-allocated cells.
+     */
+    guac_terminal_char default_character;
+
+    /**
+     * Array of buffer rows. This array functions as a ring buffer.
+     * When a new row needs to be appended, the top reference is moved down
+     * and the old top row is replaced.
+     */
+    guac_terminal_buffer_row* rows;
+
+    /**
+     * The index of the first row in the buffer (the row which represents row 0
+     * with respect to the terminal display). This is also the index of the row
+     * to replace when insufficient space remains in the buffer to add a new
+     * row.
+     */
+    unsigned int top;
+
+    /**
+     * The number of rows currently stored in the buffer.
+     */
+    unsigned int length;
+
+    /**
+     * The number of rows currently allocated for the buffer. This is always
+     * a power of two, and grows as necessary until reaching capacity.
+     */
+    unsigned int available;
+
+    /**
+     * The maximum number of rows the buffer may contain. This is always a
+     * power of two.
+     */
+    unsigned int capacity;
+
+    /**
+     * File descriptor of the temporary file containing the compressed
+     * contents of all spilled rows, or -1 if no such file has yet been
+     * created.
+     */
+    int spill_fd;
+
+    /**
+     * Whether creating or writing the spill file has failed, in which case
+     * rows are no longer spilled and instead remain compressed in memory.
+     */
+    bool spill_failed;
+
+    /**
+     * The current size of the spill file, in bytes. New spilled rows are
+     * appended at this offset.
+     */
+    off_t spill_length;
+
+    /**
+     * The number of bytes within the spill file that belong to rows which
+     * are still spilled. All other bytes are unused.
+     */
+    off_t spill_live;
+
+    /**
+     * Ring of the indices of scrollback rows which were decompressed when
+     * accessed, in order of access.
+     */
+    unsigned int thawed[GUAC_TERMINAL_BUFFER_THAWED_ROWS];
+
+    /**
+     * The number of entries currently within the thawed ring.
+     */
+    int thawed_count;
+
+    /**
+     * The position within the thawed ring of the oldest entry.
+     */
+    int thawed_oldest;
+
+    /**
+     * Table of all distinct sets of attributes used by characters within
+     * compressed rows, indexed by attribute ID.
+     */
+    guac_terminal_attributes* attributes;
+
+    /**
+     * The number of entries currently within the attribute table.
+     */
+    unsigned int attribute_count;
+
+    /**
+     * The number of entries allocated for the attribute table.
+     */
+    unsigned int attribute_available;
+
+    /**
+     * Open-addressed hash index of the attribute table, mapping each set of
+     * attributes to its ID. Unused entries contain
+     * GUAC_TERMINAL_BUFFER_NO_ATTRIBUTES. The size of this index is always
+     * twice attribute_available.
+     */
+    uint16_t* attribute_index;
+
+    /**
+     * The total number of bytes currently allocated in memory for the
+     * contents of all rows, whether as arrays of characters or as compressed
+     * data.
+     */
+    size_t row_memory;
+
+};
+
+/**
+ * Returns whether the two given colors are identical, including both their
+ * palette indices and their RGB components.
+ *
+ * @param a
+ *     The first color to compare.
+ *
+ * @param b
+ *     The second color to compare.
+ *
+ * @return
+ *     true if the given colors are identical, false otherwise.
+ */
+static bool guac_terminal_buffer_color_equal(const guac_terminal_color* a,
+        const guac_terminal_color* b) {
+
+    return a->palette_index == b->palette_index
+        && a->red   == b->red
+        && a->green == b->green
+        && a->blue  == b->blue;
+
+}
+
+/**
+ * Returns whether the two given sets of attributes are identical.
+ *
+ * @param a
+ *     The first set of attributes to compare.
+ *
+ * @param b
+ *     The second set of attributes to compare.
+ *
+ * @return
+ *     true if the given sets of attributes are identical, false otherwise.
+ */
+static bool guac_terminal_buffer_attributes_equal(
+        const guac_terminal_attributes* a, const guac_terminal_attributes* b) {
+
+    return a->bold        == b->bold
+        && a->half_bright == b->half_bright
+        && a->cursor      == b->cursor
+        && a->reverse     == b->reverse
+        && a->underscore  == b->underscore
+        && guac_terminal_buffer_color_equal(&a->foreground, &b->foreground)
+        && guac_terminal_buffer_color_equal(&a->background, &b->background);
+
+}
+
+/**
+ * Returns whether the two given characters are identical, including their
+ * attributes.
+ *
+ * @param a
+ *     The first character to compare.
+ *
+ * @param b
+ *     The second character to compare.
+ *
+ * @return
+ *     true if the given characters are identical, false otherwise.
+ */
+static bool guac_terminal_buffer_char_equal(const guac_terminal_char* a,
+        const guac_terminal_char* b) {
+
+    return a->value == b->value
+        && a->width == b->width
+        && guac_terminal_buffer_attributes_equal(&a->attributes, &b->attributes);
+
+}
+
+/**
+ * Hashes the given set of attributes for use within the attribute table
+ * index.
+ *
+ * @param attributes
+ *     The attributes to hash.
+ *
+ * @return
+ *     An arbitrary hash of the given attributes.
+ */
+static unsigned int guac_terminal_buffer_attributes_hash(
+        const guac_terminal_attributes* attributes) {
+
+    uint32_t hash = attributes->bold
+        | (attributes->half_bright << 1)
+        | (attributes->cursor      << 2)
+        | (attributes->reverse     << 3)
+        | (attributes->underscore  << 4);
+
+    const guac_terminal_color* colors[] = {
+        &attributes->foreground,
+        &attributes->background
+    };
+
+    for (int i = 0; i < 2; i++) {
+        hash = hash * 31 + colors[i]->palette_index;
+        hash = hash * 31 + ((colors[i]->red << 16)
+                | (colors[i]->green << 8) | colors[i]->blue);
+    }
+
+    return hash * 2654435761u;
+
+}
+
+/**
+ * Rebuilds the attribute table index of the given buffer such that it covers
+ * every entry currently within the attribute table.
+ *
+ * @param buffer
+ *     The buffer whose attribute table index should be rebuilt.
+ */
+static void guac_terminal_buffer_index_attributes(guac_terminal_buffer* buffer) {
+
+    unsigned int size = buffer->attribute_available * 2;
+    unsigned int mask = size - 1;
+
+    buffer->attribute_index = guac_mem_realloc_or_die(buffer->attribute_index,
+            sizeof(uint16_t), size);
+
+    for (unsigned int i = 0; i < size; i++)
+        buffer->attribute_index[i] = GUAC_TERMINAL_BUFFER_NO_ATTRIBUTES;
+
+    for (unsigned int id = 0; id < buffer->attribute_count; id++) {
+
+        unsigned int index = guac_terminal_buffer_attributes_hash(
+                &buffer->attributes[id]) & mask;
+
+        while (buffer->attribute_index[index] != GUAC_TERMINAL_BUFFER_NO_ATTRIBUTES)
+            index = (index + 1) & mask;
+
+        buffer->attribute_index[index] = id;
+
+    }
+
+}
+
+/**
+ * Returns the ID of the given set of attributes within the attribute table
+ * of the given buffer, adding the attributes to the table if not yet
+ * present.
+ *
+ * @param buffer
+ *     The buffer whose attribute table should be used.
+ *
+ * @param attributes
+ *     The attributes to look up.
+ *
+ * @return
+ *     The ID of the given attributes, or -1 if the attributes are not yet
+ *     present and the attribute table is full.
+ */
+static int guac_terminal_buffer_intern_attributes(guac_terminal_buffer* buffer,
+        const guac_terminal_attributes* attributes) {
+
+    unsigned int mask = buffer->attribute_available * 2 - 1;
+    unsigned int index = guac_terminal_buffer_attributes_hash(attributes) & mask;
+
+    /* Search for existing entry */
+    uint16_t id;
+    while ((id = buffer->attribute_index[index]) != GUAC_TERMINAL_BUFFER_NO_ATTRIBUTES) {
+
+        if (guac_terminal_buffer_attributes_equal(&buffer->attributes[id], attributes))
+            return id;
+
+        index = (index + 1) & mask;
+
+    }
+
+    /* Fail if no further attributes can be represented */
+    if (buffer->attribute_count >= GUAC_TERMINAL_BUFFER_MAX_ATTRIBUTES)
+        return -1;
+
+    id = buffer->attribute_count++;
+    buffer->attributes[id] = *attributes;
+
+    /* Grow table (and thus rebuild index) if now full */
+    if (buffer->attribute_count == buffer->attribute_available) {
+        buffer->attribute_available *= 2;
+        buffer->attributes = guac_mem_realloc_or_die(buffer->attributes,
+                sizeof(guac_terminal_attributes), buffer->attribute_available);
+        guac_terminal_buffer_index_attributes(buffer);
+    }
+
+    /* Otherwise, simply add to index */
+    else
+        buffer->attribute_index[index] = id;
+
+    return id;
+
+}
+
+/**
+ * Stores the given value within the given buffer using a variable-length
+ * encoding, seven bits per byte, least-significant bits first, with the high
+ * bit of each byte set if more bytes follow.
+ *
+ * @param output
+ *     The buffer to write to. At least GUAC_TERMINAL_BUFFER_MAX_VARINT_LENGTH
+ *     bytes must be available.
+ *
+ * @param value
+ *     The value to store.
+ *
+ * @return
+ *     The number of bytes written.
+ */
+static int guac_terminal_buffer_put_varint(unsigned char* output,
+        uint32_t value) {
+
+    int length = 0;
+
+    while (value >= 0x80) {
+        output[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+
+    output[length++] = value;
+    return length;
+
+}
+
+/**
+ * Reads a value previously stored with guac_terminal_buffer_put_varint(),
+ * advancing the given pointer past the encoded value.
+ *
+ * @param input
+ *     Pointer to the current position within the encoded data. This pointer
+ *     will be advanced past the value read.
+ *
+ * @return
+ *     The decoded value.
+ */
+static uint32_t guac_terminal_buffer_get_varint(const unsigned char** input) {
+
+    uint32_t value = 0;
+    int shift = 0;
+
+    const unsigned char* current = *input;
+    while (*current & 0x80) {
+        value |= (uint32_t) (*(current++) & 0x7F) << shift;
+        shift += 7;
+    }
+
+    value |= (uint32_t) *(current++) << shift;
+
+    *input = current;
+    return value;
+
+}
+
+/**
+ * Initializes the given row as an empty row having no allocated storage.
+ *
+ * @param row
+ *     The row to initialize.
+ */
+static void guac_terminal_buffer_row_init(guac_terminal_buffer_row* row) {
+    row->available = 0;
+    row->length = 0;
+    row->wrapped_row = false;
+    row->characters = NULL;
+    row->compressed = NULL;
+    row->compressed_length = 0;
+    row->spilled = false;
+    row->spill_offset = 0;
+}
+
+guac_terminal_buffer* guac_terminal_buffer_alloc(int rows,
+        const guac_terminal_char* default_character) {
+
+    /* Allocate scrollback */
+    guac_terminal_buffer* buffer =
+        guac_mem_alloc(sizeof(guac_terminal_buffer));
+
+    int i;
+    guac_terminal_buffer_row* row;
+
+    /* Round capacity up to a power of two, such that row indices may be
+     * wrapped with a simple mask */
+    unsigned int capacity = 1;
+    while (capacity < rows)
+        capacity <<= 1;
+
+    /* Init scrollback data (rows beyond the initial allocation are allocated
+     * only as needed) */
+    buffer->default_character = *default_character;
+    buffer->capacity = capacity;
+    buffer->available = capacity;
+    if (buffer->available > GUAC_TERMINAL_BUFFER_INITIAL_ROWS)
+        buffer->available = GUAC_TERMINAL_BUFFER_INITIAL_ROWS;
+    buffer->top = 0;
+    buffer->length = 0;
+    buffer->rows = guac_mem_alloc(sizeof(guac_terminal_buffer_row), buffer->available);
+
+    /* Init scrollback rows (storage for characters is allocated only once
+     * each row is actually used) */
+    row = buffer->rows;
+    for (i=0; i<buffer->available; i++) {
+        guac_terminal_buffer_row_init(row);
+        row++;
+    }
+
+    /* No rows initially have any contents */
+    buffer->row_memory = 0;
+
+    /* No rows are initially spilled or thawed */
+    buffer->spill_fd = -1;
+    buffer->spill_failed = false;
+    buffer->spill_length = 0;
+    buffer->spill_live = 0;
+    buffer->thawed_count = 0;
+    buffer->thawed_oldest = 0;
+
+    /* Init attribute table for compressed rows */
+    buffer->attribute_count = 0;
+    buffer->attribute_available = GUAC_TERMINAL_BUFFER_INITIAL_ATTRIBUTES;
+    buffer->attributes = guac_mem_alloc(sizeof(guac_terminal_attributes),
+            buffer->attribute_available);
+    buffer->attribute_index = NULL;
+    guac_terminal_buffer_index_attributes(buffer);
+
+    return buffer;
+
+}
+
+void guac_terminal_buffer_free(guac_terminal_buffer* buffer) {
+
+    int i;
+    guac_terminal_buffer_row* row = buffer->rows;
+
+    /* Free all rows */
+    for (i=0; i<buffer->available; i++) {
+        guac_mem_free(row->characters);
+        guac_mem_free(row->compressed);
+        row++;
+    }
+
+    /* Free spilled rows */
+    if (buffer->spill_fd != -1)
+        close(buffer->spill_fd);
+
+    /* Free attribute table */
+    guac_mem_free(buffer->attribute_index);
+    guac_mem_free(buffer->attributes);
+
+    /* Free actual buffer */
+    guac_mem_free(buffer->rows);
+    guac_mem_free(buffer);
+
+}
+
+void guac_terminal_buffer_reset(guac_terminal_buffer* buffer) {
+    buffer->top = 0;
+    buffer->length = 0;
+}
+
+size_t guac_terminal_buffer_memory(guac_terminal_buffer* buffer) {
+
+    return sizeof(guac_terminal_buffer)
+        + sizeof(guac_terminal_buffer_row) * buffer->available
+        + (sizeof(guac_terminal_attributes) + 2 * sizeof(uint16_t))
+            * buffer->attribute_available
+        + buffer->row_memory;
+
+}
+
+/**
+ * Rounds the given value up to the nearest possible row length. To avoid
+ * unnecessary, repeated resizing of rows, each row length is rounded up to the
+ * nearest power of two.
+ *
+ * @param value
+ *     The value to round.
+ *
+ * @return
+ *     The power of two that is closest to the given value without exceeding
+ *     that value.
+ */
+static unsigned int guac_terminal_buffer_row_length(int value) {
+
+    GUAC_ASSERT(value >= 0);
+    GUAC_ASSERT(value <= GUAC_TERMINAL_MAX_COLUMNS);
+
+    unsigned int rounded = GUAC_TERMINAL_BUFFER_ROW_MIN_SIZE;
+    while (rounded < value)
+        rounded <<= 1;
+
+    return rounded;
+
+}
+
+/**
+ * Compresses the given row, replacing its characters array with an
+ * equivalent compressed representation. If the row cannot be compressed, or
+ * is not worth compressing, it is left untouched.
+ *
+ * @param buffer
+ *     The buffer containing the row.
+ *
+ * @param row
+ *     The row to compress.
+ */
+static void guac_terminal_buffer_row_compress(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row) {
+
+    /* Nothing to do if already compressed or never used */
+    if (row->compressed != NULL || row->characters == NULL)
+        return;
+
+    /* Omit trailing characters which equal the default */
+    int length = row->length;
+    while (length > 0 && guac_terminal_buffer_char_equal(
+                &row->characters[length - 1], &buffer->default_character))
+        length--;
+
+    /* Each character requires at most one varint, and each run requires at
+     * most two */
+    unsigned char* output = guac_mem_alloc(length * 3 + 1,
+            GUAC_TERMINAL_BUFFER_MAX_VARINT_LENGTH);
+    size_t output_length = 0;
+
+    int column = 0;
+    while (column < length) {
+
+        const guac_terminal_attributes* attributes = &row->characters[column].attributes;
+        int id = guac_terminal_buffer_intern_attributes(buffer, attributes);
+        if (id < 0)
+            goto fail;
+
+        /* Find extent of run of identical attributes */
+        int run_end = column + 1;
+        while (run_end < length && guac_terminal_buffer_attributes_equal(
+                    &row->characters[run_end].attributes, attributes))
+            run_end++;
+
+        output_length += guac_terminal_buffer_put_varint(output + output_length, id);
+        output_length += guac_terminal_buffer_put_varint(output + output_length, run_end - column);
+
+        /* Store value and width of each character, offsetting the value such
+         * that GUAC_CHAR_CONTINUATION can be represented */
+        for (; column < run_end; column++) {
+
+            const guac_terminal_char* character = &row->characters[column];
+            if (character->value < GUAC_CHAR_CONTINUATION
+                    || character->width < 0 || character->width > 3)
+                goto fail;
+
+            uint32_t value = (uint32_t) (character->value + 1) << 2;
+            if (character->value != GUAC_CHAR_CONTINUATION)
+                value |= character->width;
+
+            output_length += guac_terminal_buffer_put_varint(output + output_length, value);
+
+        }
+
+    }
+
+    /* Terminate compressed data with an impossible attribute ID, such that
+     * even an empty row has non-NULL compressed data */
+    output_length += guac_terminal_buffer_put_varint(output + output_length,
+            GUAC_TERMINAL_BUFFER_MAX_ATTRIBUTES);
+
+    /* Replace characters with compressed data, trimmed to size */
+    row->compressed = guac_mem_realloc_or_die(output, output_length);
+    row->compressed_length = output_length;
+    buffer->row_memory += output_length;
+    buffer->row_memory -= sizeof(guac_terminal_char) * row->available;
+    guac_mem_free(row->characters);
+    row->available = 0;
+    return;
+
+fail:
+    guac_mem_free(output);
+
+}
+
+/**
+ * Decompresses the given row, which must have been compressed with
+ * guac_terminal_buffer_row_compress(), restoring its characters array.
+ *
+ * @param buffer
+ *     The buffer containing the row.
+ *
+ * @param row
+ *     The row to decompress.
+ */
+static void guac_terminal_buffer_row_decompress(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row) {
+
+    row->available = guac_terminal_buffer_row_length(row->length);
+    row->characters = guac_mem_alloc(sizeof(guac_terminal_char), row->available);
+    buffer->row_memory += sizeof(guac_terminal_char) * row->available;
+
+    const unsigned char* input = row->compressed;
+    guac_terminal_char* current = row->characters;
+
+    /* Restore each run of characters */
+    uint32_t id;
+    while ((id = guac_terminal_buffer_get_varint(&input)) < buffer->attribute_count) {
+
+        uint32_t count = guac_terminal_buffer_get_varint(&input);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t value = guac_terminal_buffer_get_varint(&input);
+            current->value = (int) (value >> 2) - 1;
+            current->width = value & 0x3;
+            current->attributes = buffer->attributes[id];
+            current++;
+        }
+
+    }
+
+    /* Restore any omitted trailing characters */
+    guac_terminal_char* end = row->characters + row->available;
+    while (current < end)
+        *(current++) = buffer->default_character;
+
+    buffer->row_memory -= row->compressed_length;
+    guac_mem_free(row->compressed);
+
+}
+
+/**
+ * Returns whether the row at the given index within the rows array of the
+ * given buffer is currently part of the scrollback region (above the visible
+ * rows) rather than a visible row.
+ *
+ * @param buffer
+ *     The buffer containing the row.
+ *
+ * @param index
+ *     The index of the row within the rows array.
+ *
+ * @return
+ *     true if the row is part of the scrollback region, false otherwise.
+ */
+static bool guac_terminal_buffer_is_scrollback(guac_terminal_buffer* buffer,
+        unsigned int index) {
+
+    /* Visible rows and scrollback rows can only be distinguished if the
+     * buffer can contain more than the maximum number of visible rows */
+    if (buffer->available <= GUAC_TERMINAL_MAX_ROWS)
+        return false;
+
+    return ((index - buffer->top) & (buffer->available - 1)) >= GUAC_TERMINAL_MAX_ROWS;
+
+}
+
+/**
+ * Opens the spill file of the given buffer, if not already open.
+ *
+ * @param buffer
+ *     The buffer whose spill file should be opened.
+ *
+ * @return
+ *     Zero if the spill file is open, non-zero if the spill file could not be
+ *     created.
+ */
+static int guac_terminal_buffer_open_spill(guac_terminal_buffer* buffer) {
+
+    if (buffer->spill_fd != -1)
+        return 0;
+
+    if (buffer->spill_failed)
+        return 1;
+
+    /* Create anonymous temporary file which disappears once closed */
+    char path[] = GUAC_TERMINAL_BUFFER_SPILL_TEMPLATE;
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        buffer->spill_failed = true;
+        return 1;
+    }
+
+    unlink(path);
+
+    buffer->spill_fd = fd;
+    return 0;
+
+}
+
+/**
+ * Writes the given data in its entirety to the given file at the given
+ * offset.
+ *
+ * @param fd
+ *     The file to write to.
+ *
+ * @param data
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes to write.
+ *
+ * @param offset
+ *     The offset within the file to begin writing at.
+ *
+ * @return
+ *     Zero if all data was written, non-zero otherwise.
+ */
+static int guac_terminal_buffer_pwrite_all(int fd, const unsigned char* data,
+        size_t length, off_t offset) {
+
+    while (length > 0) {
+
+        ssize_t written = pwrite(fd, data, length, offset);
+        if (written <= 0)
+            return 1;
+
+        data += written;
+        length -= written;
+        offset += written;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Reads exactly the given number of bytes from the given file at the given
+ * offset.
+ *
+ * @param fd
+ *     The file to read from.
+ *
+ * @param data
+ *     The buffer to read into.
+ *
+ * @param length
+ *     The number of bytes to read.
+ *
+ * @param offset
+ *     The offset within the file to begin reading at.
+ *
+ * @return
+ *     Zero if all requested data was read, non-zero otherwise.
+ */
+static int guac_terminal_buffer_pread_all(int fd, unsigned char* data,
+        size_t length, off_t offset) {
+
+    while (length > 0) {
+
+        ssize_t received = pread(fd, data, length, offset);
+        if (received <= 0)
+            return 1;
+
+        data += received;
+        length -= received;
+        offset += received;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Moves the compressed contents of the given row from memory into the spill
+ * file of the given buffer. If the row is not compressed, or the spill file
+ * cannot be written, the row is left untouched.
+ *
+ * @param buffer
+ *     The buffer containing the row.
+ *
+ * @param row
+ *     The row to spill.
+ */
+static void guac_terminal_buffer_row_spill(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row) {
+
+    if (row->compressed == NULL || buffer->spill_failed
+            || guac_terminal_buffer_open_spill(buffer))
+        return;
+
+    /* Stop spilling entirely if the file cannot be written, leaving rows
+     * compressed in memory */
+    if (guac_terminal_buffer_pwrite_all(buffer->spill_fd, row->compressed,
+                row->compressed_length, buffer->spill_length)) {
+        buffer->spill_failed = true;
+        return;
+    }
+
+    row->spill_offset = buffer->spill_length;
+    row->spilled = true;
+    buffer->row_memory -= row->compressed_length;
+    guac_mem_free(row->compressed);
+
+    buffer->spill_length += row->compressed_length;
+    buffer->spill_live += row->compressed_length;
+
+}
+
+/**
+ * Reads the compressed contents of the given spilled row back into memory.
+ * If the contents cannot be read, the row is restored as a row of default
+ * characters.
+ *
+ * @param buffer
+ *     The buffer containing the row.
+ *
+ * @param row
+ *     The spilled row to restore.
+ */
+static void guac_terminal_buffer_row_unspill(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row) {
+
+    size_t size = row->compressed_length;
+    if (size < GUAC_TERMINAL_BUFFER_MAX_VARINT_LENGTH)
+        size = GUAC_TERMINAL_BUFFER_MAX_VARINT_LENGTH;
+
+    row->compressed = guac_mem_alloc(size);
+    buffer->spill_live -= row->compressed_length;
+    row->spilled = false;
+
+    /* Fall back to an empty row (a lone terminating attribute ID) if the
+     * spilled data is unreadable */
+    if (guac_terminal_buffer_pread_all(buffer->spill_fd, row->compressed,
+                row->compressed_length, row->spill_offset)) {
+        row->compressed_length = guac_terminal_buffer_put_varint(
+                row->compressed, GUAC_TERMINAL_BUFFER_MAX_ATTRIBUTES);
+    }
+
+    buffer->row_memory += row->compressed_length;
+
+}
 
-    /**
-     * The length of this row in characters. This is the number of initialized
-     * characters in the buffer, usually equal to the number of characters
-     * in the screen width at the time this row was created.
-     */
-    unsigned int length;
+/**
+ * Rewrites the spill file of the given buffer such that it contains only the
+ * contents of rows which are still spilled, reclaiming space used by rows
+ * which have since been restored or overwritten. If the new file cannot be
+ * written, the existing file remains in use for the rows already spilled,
+ * but no further rows are spilled.
+ *
+ * @param buffer
+ *     The buffer whose spill file should be compacted.
+ */
+static void guac_terminal_buffer_compact_spill(guac_terminal_buffer* buffer) {
 
-    /**
-     * The number of elements in the characters array. After the length
-     * equals this value, the array must be resized.
-     */
-    unsigned int available;
+    int old_fd = buffer->spill_fd;
 
-    /**
-     * True if the current row has been wrapped to avoid going off the screen.
-     * False otherwise.
-     */
-    bool wrapped_row;
+    /* Continue using the existing file (without further spilling) if a new
+     * file cannot be created */
+    buffer->spill_fd = -1;
+    if (guac_terminal_buffer_open_spill(buffer)) {
+        buffer->spill_fd = old_fd;
+        return;
+    }
 
-} guac_terminal_buffer_row;
+    unsigned char* data = NULL;
+    size_t data_available = 0;
 
-struct guac_terminal_buffer {
+    off_t* offsets = guac_mem_alloc(sizeof(off_t), buffer->available);
 
-    /**
-     * The character to assign to newly-allocated cells.
-     */
-    guac_terminal_char default_character;
+    /* Copy each spilled row to the new file */
+    off_t new_length = 0;
+    for (unsigned int i = 0; i < buffer->available; i++) {
 
-    /**
-     * Array of buffer rows. This array functions as a ring buffer.
-     * When a new row needs to be appended, the top reference is moved down
-     * and the old top row is replaced.
-     */
-    guac_terminal_buffer_row* rows;
+        guac_terminal_buffer_row* row = &buffer->rows[i];
+        if (!row->spilled)
+            continue;
 
-    /**
-     * The index of the first row in the buffer (the row which represents row 0
-     * with respect to the terminal display). This is also the index of the row
-     * to replace when insufficient space remains in the buffer to add a new
-     * row.
-     */
-    unsigned int top;
+        if (row->compressed_length > data_available) {
+            data_available = row->compressed_length;
+            data = guac_mem_realloc_or_die(data, data_available);
+        }
 
-    /**
-     * The number of rows currently stored in the buffer.
-     */
-    unsigned int length;
+        if (guac_terminal_buffer_pread_all(old_fd, data,
+                    row->compressed_length, row->spill_offset)
+                || guac_terminal_buffer_pwrite_all(buffer->spill_fd, data,
+                    row->compressed_length, new_length))
+            goto fail;
 
-    /**
-     * The number of rows in the buffer. This is the total capacity
-     * of the buffer.
-     */
-    unsigned int available;
+        offsets[i] = new_length;
+        new_length += row->compressed_length;
 
-};
+    }
 
-guac_terminal_buffer* guac_terminal_buffer_alloc(int rows,
-        const guac_terminal_char* default_character) {
+    /* Switch to new file only once all rows have been copied */
+    for (unsigned int i = 0; i < buffer->available; i++) {
+        if (buffer->rows[i].spilled)
+            buffer->rows[i].spill_offset = offsets[i];
+    }
 
-    /* Allocate scrollback */
-    guac_terminal_buffer* buffer =
-        guac_mem_alloc(sizeof(guac_terminal_buffer));
+    close(old_fd);
+    buffer->spill_length = new_length;
+    buffer->spill_live = new_length;
 
-    int i;
-    guac_terminal_buffer_row* row;
+    guac_mem_free(offsets);
+    guac_mem_free(data);
+    return;
 
-    /* Init scrollback data */
-    buffer->default_character = *default_character;
-    buffer->available = rows;
-    buffer->top = 0;
-    buffer->length = 0;
-    buffer->rows = guac_mem_alloc(sizeof(guac_terminal_buffer_row), buffer->available);
+fail:
+    close(buffer->spill_fd);
+    buffer->spill_fd = old_fd;
+    buffer->spill_failed = true;
+    guac_mem_free(offsets);
+    guac_mem_free(data);
 
-    /* Init scrollback rows */
-    row = buffer->rows;
-    for (i=0; i<rows; i++) {
+}
 
-        /* Allocate row  */
-        row->available = GUAC_TERMINAL_BUFFER_ROW_MIN_SIZE;
-        row->length = 0;
-        row->wrapped_row = false;
-        row->characters = guac_mem_alloc(sizeof(guac_terminal_char), row->available);
+/**
+ * Records that the scrollback row at the given index has just been
+ * decompressed due to being accessed. If too many scrollback rows are now
+ * decompressed, the least recently accessed of those rows is compressed (and
+ * spilled, if old enough) again.
+ *
+ * @param buffer
+ *     The buffer containing the row.
+ *
+ * @param index
+ *     The index of the row within the rows array.
+ */
+static void guac_terminal_buffer_thaw(guac_terminal_buffer* buffer,
+        unsigned int index) {
 
-        /* Next row */
-        row++;
+    /* Refreeze least recently thawed row if no space remains */
+    if (buffer->thawed_count == GUAC_TERMINAL_BUFFER_THAWED_ROWS) {
 
-    }
+        unsigned int oldest = buffer->thawed[buffer->thawed_oldest];
+        buffer->thawed_oldest = (buffer->thawed_oldest + 1) % GUAC_TERMINAL_BUFFER_THAWED_ROWS;
+        buffer->thawed_count--;
 
-    return buffer;
+        /* Ignore rows which have since scrolled back into view */
+        if (guac_terminal_buffer_is_scrollback(buffer, oldest)) {
 
-}
+            guac_terminal_buffer_row* row = &buffer->rows[oldest];
+            guac_terminal_buffer_row_compress(buffer, row);
 
-void guac_terminal_buffer_free(guac_terminal_buffer* buffer) {
+            /* Spill again if beyond the in-memory portion of scrollback */
+            if (((buffer->top - oldest) & (buffer->available - 1)) > GUAC_TERMINAL_BUFFER_HOT_ROWS)
+                guac_terminal_buffer_row_spill(buffer, row);
 
-    int i;
-    guac_terminal_buffer_row* row = buffer->rows;
+        }
 
-    /* Free all rows */
-    for (i=0; i<buffer->available; i++) {
-        guac_mem_free(row->characters);
-        row++;
     }
 
-    /* Free actual buffer */
-    guac_mem_free(buffer->rows);
-    guac_mem_free(buffer);
+    int position = (buffer->thawed_oldest + buffer->thawed_count) % GUAC_TERMINAL_BUFFER_THAWED_ROWS;
+    buffer->thawed[position] = index;
+    buffer->thawed_count++;
 
 }
 
-void guac_terminal_buffer_reset(guac_terminal_buffer* buffer) {
+/**
+ * Doubles the number of rows allocated for the given buffer, preserving the
+ * relative positions of all rows. The buffer must not already be at
+ * capacity.
+ *
+ * @param buffer
+ *     The buffer to grow.
+ */
+static void guac_terminal_buffer_grow(guac_terminal_buffer* buffer) {
+
+    unsigned int old_available = buffer->available;
+    unsigned int old_mask = old_available - 1;
+
+    unsigned int new_available = old_available * 2;
+    unsigned int new_mask = new_available - 1;
+
+    guac_terminal_buffer_row* old_rows = buffer->rows;
+    guac_terminal_buffer_row* new_rows = guac_mem_alloc(
+            sizeof(guac_terminal_buffer_row), new_available);
+
+    for (unsigned int i = 0; i < new_available; i++)
+        guac_terminal_buffer_row_init(&new_rows[i]);
+
+    /* Move every row, relative to the new top of zero. All visible rows lie
+     * within the first GUAC_TERMINAL_MAX_ROWS rows from the top, with all
+     * remaining rows being scrollback. */
+    int first = GUAC_TERMINAL_MAX_ROWS - (int) old_available;
+    for (int row = first; row < GUAC_TERMINAL_MAX_ROWS; row++)
+        new_rows[(unsigned int) row & new_mask] = old_rows[(buffer->top + row) & old_mask];
+
+    guac_mem_free(old_rows);
+
+    buffer->rows = new_rows;
+    buffer->available = new_available;
     buffer->top = 0;
-    buffer->length = 0;
+
+    /* Indices of thawed rows are no longer valid */
+    buffer->thawed_count = 0;
+    buffer->thawed_oldest = 0;
+
 }
 
 /**
- * Returns the row at the given location. The row returned is guaranteed to be at least the given
- * width.
+ * Returns the row at the given location. If the row is spilled or
+ * compressed, it is first restored.
  *
  * @param buffer
  *     The buffer to retrieve a row from.
@@ -180,33 +1187,24 @@ static guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buff
         return NULL;
 
     /* Normalize row index into a scrollback buffer index */
-    unsigned int index = (buffer->top + row) % buffer->available;
-    return &(buffer->rows[index]);
+    unsigned int index = (buffer->top + row) & (buffer->available - 1);
+    guac_terminal_buffer_row* buffer_row = &(buffer->rows[index]);
 
-}
+    /* Restore row contents if spilled and/or compressed */
+    if (buffer_row->spilled || buffer_row->compressed != NULL) {
 
-/**
- * Rounds the given value up to the nearest possible row length. To avoid
- * unnecessary, repeated resizing of rows, each row length is rounded up to the
- * nearest power of two.
- *
- * @param value
- *     The value to round.
- *
- * @return
- *     The power of two that is closest to the given value without exceeding
- *     that value.
- */
-static unsigned int guac_terminal_buffer_row_length(int value) {
+        if (buffer_row->spilled)
+            guac_terminal_buffer_row_unspill(buffer, buffer_row);
 
-    GUAC_ASSERT(value >= 0);
-    GUAC_ASSERT(value <= GUAC_TERMINAL_MAX_COLUMNS);
+        guac_terminal_buffer_row_decompress(buffer, buffer_row);
 
-    unsigned int rounded = GUAC_TERMINAL_BUFFER_ROW_MIN_SIZE;
-    while (rounded < value)
-        rounded <<= 1;
+        /* Compress scrollback rows again once no longer being accessed */
+        if (row < 0)
+            guac_terminal_buffer_thaw(buffer, index);
 
-    return rounded;
+    }
+
+    return buffer_row;
 
 }
 
@@ -214,19 +1212,23 @@ static unsigned int guac_terminal_buffer_row_length(int value) {
  * Expands the amount of space allocated for the given row such that it
  * may contain at least the given number of characters, if possible. If the row
  * cannot be expanded due to buffer size limitations, it will be expanded to
- * the greatest size allowed without exceeding those limits.
+ * the greatest size allowed without exceeding those limits. Any
+ * newly-allocated character cells are filled with the default character of
+ * the given buffer.
+ *
+ * @param buffer
+ *     The buffer containing the row.
  *
  * @param row
  *     The row to expand.
  *
  * @param length
  *     The number of characters that the row must be able to store.
- *
- * @param default_character
- *     The character that should fill any newly-allocated character cells.
  */
-static void guac_terminal_buffer_row_expand(guac_terminal_buffer_row* row, int length,
-        const guac_terminal_char* default_character) {
+static void guac_terminal_buffer_row_expand(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row, int length) {
+
+    const guac_terminal_char* default_character = &buffer->default_character;
 
     /* Bail out if no resize/init is necessary */
     if (length <= row->length)
@@ -239,9 +1241,11 @@ static void guac_terminal_buffer_row_expand(guac_terminal_buffer_row* row, int l
     /* Expand allocated memory if there is otherwise insufficient space to fit
      * the provided length */
     if (length > row->available) {
+        buffer->row_memory -= sizeof(guac_terminal_char) * row->available;
         row->available = guac_terminal_buffer_row_length(length);
         row->characters = guac_mem_realloc_or_die(row->characters,
                 sizeof(guac_terminal_char), row->available);
+        buffer->row_memory += sizeof(guac_terminal_char) * row->available;
     }
 
     /* Initialize new part of row */
@@ -352,7 +1356,7 @@ void guac_terminal_buffer_copy_columns(guac_terminal_buffer* buffer, int row,
     if (buffer_row == NULL)
         return;
 
-    guac_terminal_buffer_row_expand(buffer_row, end_column + offset + 1, &buffer->default_character);
+    guac_terminal_buffer_row_expand(buffer, buffer_row, end_column + offset + 1);
     GUAC_ASSERT(buffer_row->length >= end_column + offset + 1);
 
     /* Fit relevant extents of operation within bounds (NOTE: Because this
@@ -409,11 +1413,12 @@ void guac_terminal_buffer_copy_rows(guac_terminal_buffer* buffer,
         if (src_row == NULL || dst_row == NULL)
             continue;
 
-        guac_terminal_buffer_row_expand(dst_row, src_row->length, &buffer->default_character);
+        guac_terminal_buffer_row_expand(buffer, dst_row, src_row->length);
         GUAC_ASSERT(dst_row->length >= src_row->length);
 
         /* Copy data */
-        memcpy(dst_row->characters, src_row->characters, guac_mem_ckd_mul_or_die(sizeof(guac_terminal_char), src_row->length));
+        if (src_row->length > 0)
+            memcpy(dst_row->characters, src_row->characters, guac_mem_ckd_mul_or_die(sizeof(guac_terminal_char), src_row->length));
         dst_row->length = src_row->length;
         dst_row->wrapped_row = src_row->wrapped_row;
 
@@ -432,12 +1437,48 @@ void guac_terminal_buffer_scroll_up(guac_terminal_buffer* buffer, int amount) {
     if (amount <= 0)
         return;
 
-    buffer->top = (buffer->top + amount) % buffer->available;
+    /* Allocate more rows if needed (and allowed) rather than replacing the
+     * oldest rows, always leaving room for the maximum number of visible
+     * rows such that scrollback never wraps around into them before the
+     * buffer is at capacity */
+    while (buffer->length + amount + GUAC_TERMINAL_MAX_ROWS > buffer->available
+            && buffer->available < buffer->capacity)
+        guac_terminal_buffer_grow(buffer);
+
+    unsigned int mask = buffer->available - 1;
+    buffer->top = (buffer->top + amount) & mask;
 
     buffer->length += amount;
     if (buffer->length > buffer->available)
         buffer->length = buffer->available;
 
+    if (amount > buffer->available)
+        amount = buffer->available;
+
+    /* Compress all rows which have just scrolled out of view (they will be
+     * decompressed automatically if accessed again) */
+    for (int row = -amount; row < 0; row++)
+        guac_terminal_buffer_row_compress(buffer,
+                &(buffer->rows[(buffer->top + row) & mask]));
+
+    /* Move compressed rows which have just left the in-memory portion of
+     * scrollback to the spill file */
+    if (buffer->available > GUAC_TERMINAL_MAX_ROWS
+                + GUAC_TERMINAL_BUFFER_HOT_ROWS + amount) {
+
+        for (int row = -GUAC_TERMINAL_BUFFER_HOT_ROWS - amount;
+                row < -GUAC_TERMINAL_BUFFER_HOT_ROWS; row++)
+            guac_terminal_buffer_row_spill(buffer,
+                    &(buffer->rows[(buffer->top + row) & mask]));
+
+        /* Reclaim space once mostly used by rows no longer spilled */
+        if (!buffer->spill_failed
+                && buffer->spill_length > GUAC_TERMINAL_BUFFER_SPILL_COMPACT_SIZE
+                && buffer->spill_length > buffer->spill_live * 2)
+            guac_terminal_buffer_compact_spill(buffer);
+
+    }
+
 }
 
 void guac_terminal_buffer_scroll_down(guac_terminal_buffer* buffer, int amount) {
@@ -445,7 +1486,261 @@ void guac_terminal_buffer_scroll_down(guac_terminal_buffer* buffer, int amount)
     if (amount <= 0)
         return;
 
-    buffer->top = (buffer->top - amount) % buffer->available;
+    buffer->top = (buffer->top - amount) & (buffer->available - 1);
+
+}
+
+/**
+ * Appends a new row, initially filled with the buffer's default character, to
+ * the output of guac_terminal_buffer_reflow(), growing the output arrays as
+ * necessary.
+ *
+ * @param buffer
+ *     The buffer being rewrapped.
+ *
+ * @param rows
+ *     A pointer to the array of output characters, where each row occupies
+ *     exactly width characters.
+ *
+ * @param wrapped
+ *     A pointer to the array of flags recording whether each output row is
+ *     wrapped onto the next.
+ *
+ * @param count
+ *     A pointer to the number of output rows, which will be incremented.
+ *
+ * @param available
+ *     A pointer to the number of rows allocated within each output array.
+ *
+ * @param width
+ *     The width of each output row, in columns.
+ *
+ * @return
+ *     A pointer to the first character of the newly-appended row.
+ */
+static guac_terminal_char* guac_terminal_buffer_reflow_append(
+        guac_terminal_buffer* buffer, guac_terminal_char** rows,
+        bool** wrapped, int* count, int* available, int width) {
+
+    /* Double storage as needed */
+    if (*count == *available) {
+        *available *= 2;
+        *rows = guac_mem_realloc_or_die(*rows, sizeof(guac_terminal_char),
+                *available, width);
+        *wrapped = guac_mem_realloc_or_die(*wrapped, sizeof(bool),
+                *available);
+    }
+
+    guac_terminal_char* row = *rows + (size_t) *count * width;
+    for (int column = 0; column < width; column++)
+        row[column] = buffer->default_character;
+
+    (*wrapped)[*count] = false;
+    (*count)++;
+
+    return row;
+
+}
+
+int guac_terminal_buffer_reflow(guac_terminal_buffer* buffer, int height,
+        int old_width, int new_width, int* cursor_row, int* cursor_col) {
+
+    if (height <= 0 || old_width <= 0 || new_width <= 0)
+        return 0;
+
+    if (height > GUAC_TERMINAL_MAX_ROWS)
+        height = GUAC_TERMINAL_MAX_ROWS;
+
+    /* Determine how many rows of the screen are actually in use, including
+     * the row containing the cursor */
+    int used = 0;
+    for (int row = 0; row < height; row++) {
+
+        guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row);
+        if (buffer_row == NULL)
+            break;
+
+        for (int column = 0; column < buffer_row->length; column++) {
+            if (!guac_terminal_buffer_char_equal(&buffer_row->characters[column],
+                        &buffer->default_character)) {
+                used = row + 1;
+                break;
+            }
+        }
+
+    }
+
+    if (*cursor_row >= 0 && *cursor_row < height && *cursor_row >= used)
+        used = *cursor_row + 1;
+
+    if (used == 0)
+        return 0;
+
+    /* Rewrapped rows are built separately, as the number of rows required
+     * may differ from the number of rows being replaced */
+    int out_count = 0;
+    int out_available = used;
+    guac_terminal_char* out_rows = guac_mem_alloc(sizeof(guac_terminal_char),
+            out_available, new_width);
+    bool* out_wrapped = guac_mem_alloc(sizeof(bool), out_available);
+
+    /* Contents of the line currently being joined */
+    int line_length = 0;
+    int line_available = GUAC_TERMINAL_MAX_COLUMNS;
+    guac_terminal_char* line = guac_mem_alloc(sizeof(guac_terminal_char),
+            line_available);
+
+    /* Offset of the cursor within the current line, if the cursor lies
+     * within that line, or -1 otherwise */
+    int cursor_offset = -1;
+    int new_cursor_row = 0;
+    int new_cursor_col = 0;
+
+    for (int row = 0; row < used; row++) {
+
+        guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row);
+        int length = buffer_row->length;
+
+        /* The final row of the screen always ends its line */
+        bool wrapped = buffer_row->wrapped_row && row < used - 1;
+
+        /* Wrapped rows contain only what fit within the old width */
+        if (wrapped && length > old_width)
+            length = old_width;
+
+        /* Trailing blank cells (including any padding left by wide
+         * characters which did not fit) are not part of the text */
+        while (length > 0 && guac_terminal_buffer_char_equal(
+                    &buffer_row->characters[length - 1],
+                    &buffer->default_character))
+            length--;
+
+        /* Keep the cell beneath the cursor, even if blank */
+        int needed = length;
+        if (row == *cursor_row) {
+            if (*cursor_col >= needed)
+                needed = *cursor_col;
+            cursor_offset = line_length + *cursor_col;
+        }
+
+        if (line_length + needed > line_available) {
+            line_available = line_length + needed;
+            line = guac_mem_realloc_or_die(line, sizeof(guac_terminal_char),
+                    line_available);
+        }
+
+        memcpy(line + line_length, buffer_row->characters,
+                sizeof(guac_terminal_char) * length);
+
+        for (int column = length; column < needed; column++)
+            line[line_length + column] = buffer->default_character;
+
+        line_length += needed;
+
+        if (wrapped)
+            continue;
+
+        /* Wrap the completed line at the new width */
+        guac_terminal_char* current = guac_terminal_buffer_reflow_append(buffer,
+                &out_rows, &out_wrapped, &out_count, &out_available, new_width);
+
+        int column = 0;
+        for (int offset = 0; offset < line_length;) {
+
+            /* Keep each character together with its continuation cells */
+            int char_width = 1;
+            if (line[offset].value != GUAC_CHAR_CONTINUATION) {
+                while (offset + char_width < line_length && char_width < line[offset].width
+                        && line[offset + char_width].value == GUAC_CHAR_CONTINUATION)
+                    char_width++;
+            }
+
+            /* Begin a new row if the character does not fit */
+            if (column + char_width > new_width && column > 0) {
+                out_wrapped[out_count - 1] = true;
+                current = guac_terminal_buffer_reflow_append(buffer,
+                        &out_rows, &out_wrapped, &out_count, &out_available,
+                        new_width);
+                column = 0;
+            }
+
+            if (cursor_offset >= offset && cursor_offset < offset + char_width) {
+                new_cursor_row = out_count - 1;
+                new_cursor_col = column;
+            }
+
+            /* Characters wider than the terminal are truncated */
+            for (int i = 0; i < char_width && column < new_width; i++)
+                current[column++] = line[offset + i];
+
+            offset += char_width;
+
+        }
+
+        /* A cursor just past the end of the line remains there */
+        if (cursor_offset >= line_length) {
+            new_cursor_row = out_count - 1;
+            new_cursor_col = column < new_width ? column : new_width - 1;
+        }
+
+        line_length = 0;
+        cursor_offset = -1;
+
+    }
+
+    guac_mem_free(line);
+
+    /* Discard the earliest rewrapped rows if there are more than the buffer
+     * could ever hold */
+    int skip = 0;
+    if (out_count > (int) buffer->capacity)
+        skip = out_count - (int) buffer->capacity;
+
+    /* Scroll any excess rows into the scrollback */
+    int shift = out_count - skip - height;
+    if (shift > 0)
+        guac_terminal_buffer_scroll_up(buffer, shift);
+    else
+        shift = 0;
+
+    /* Replace old rows with rewrapped rows */
+    for (int i = skip; i < out_count; i++) {
+
+        guac_terminal_buffer_row* buffer_row =
+            guac_terminal_buffer_get_row(buffer, i - skip - shift);
+        if (buffer_row == NULL)
+            continue;
+
+        buffer_row->length = 0;
+        guac_terminal_buffer_row_expand(buffer, buffer_row, new_width);
+
+        memcpy(buffer_row->characters, out_rows + (size_t) i * new_width,
+                sizeof(guac_terminal_char) * buffer_row->length);
+
+        buffer_row->wrapped_row = out_wrapped[i];
+
+    }
+
+    /* Clear any rows no longer occupied by text */
+    for (int row = out_count - skip - shift; row < used; row++) {
+        guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row);
+        buffer_row->length = 0;
+        buffer_row->wrapped_row = false;
+    }
+
+    if (buffer->length < out_count - skip - shift)
+        buffer->length = out_count - skip - shift;
+
+    guac_mem_free(out_rows);
+    guac_mem_free(out_wrapped);
+
+    /* Move cursor along with the character beneath it */
+    if (*cursor_row >= 0 && *cursor_row < used) {
+        *cursor_row = new_cursor_row - skip - shift;
+        *cursor_col = new_cursor_col;
+    }
+
+    return shift;
 
 }
 
@@ -466,6 +1761,67 @@ unsigned int guac_terminal_buffer_get_columns(guac_terminal_buffer* buffer,
 
 }
 
+unsigned int guac_terminal_buffer_get_values(guac_terminal_buffer* buffer,
+        int row, int* values, unsigned int max_length, bool* is_wrapped) {
+
+    if (abs(row) >= buffer->available)
+        return 0;
+
+    unsigned int index = (buffer->top + row) & (buffer->available - 1);
+    guac_terminal_buffer_row* buffer_row = &(buffer->rows[index]);
+
+    if (is_wrapped != NULL)
+        *is_wrapped = buffer_row->wrapped_row;
+
+    unsigned int length = buffer_row->length;
+    if (length > max_length)
+        length = max_length;
+
+    /* Copy values directly from rows which are not compressed */
+    if (!buffer_row->spilled && buffer_row->compressed == NULL) {
+        for (unsigned int i = 0; i < length; i++)
+            values[i] = buffer_row->characters[i].value;
+        return length;
+    }
+
+    /* Read spilled data without restoring the row itself, such that reading
+     * the entire scrollback does not repeatedly thaw and refreeze rows */
+    unsigned char spilled[GUAC_TERMINAL_BUFFER_MAX_COMPRESSED_LENGTH];
+    const unsigned char* input = buffer_row->compressed;
+    if (buffer_row->spilled) {
+
+        if (buffer_row->compressed_length > sizeof(spilled)
+                || guac_terminal_buffer_pread_all(buffer->spill_fd, spilled,
+                    buffer_row->compressed_length, buffer_row->spill_offset))
+            return 0;
+
+        input = spilled;
+
+    }
+
+    /* Decode only the value of each character, stopping at the end of the
+     * compressed data (the terminating attribute ID) */
+    unsigned int column = 0;
+    const unsigned char* end = input + buffer_row->compressed_length;
+    while (input < end && guac_terminal_buffer_get_varint(&input) < buffer->attribute_count) {
+
+        uint32_t count = guac_terminal_buffer_get_varint(&input);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t value = guac_terminal_buffer_get_varint(&input);
+            if (column < length)
+                values[column++] = (int) (value >> 2) - 1;
+        }
+
+    }
+
+    /* Restore any omitted trailing characters */
+    while (column < length)
+        values[column++] = buffer->default_character.value;
+
+    return length;
+
+}
+
 void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
         int start_column, int end_column, guac_terminal_char* character) {
 
@@ -491,7 +1847,7 @@ void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
     start_column = guac_terminal_fit_to_range(start_column, 0, GUAC_TERMINAL_MAX_COLUMNS - 1);
     end_column = guac_terminal_fit_to_range(end_column, 0, GUAC_TERMINAL_MAX_COLUMNS - 1);
 
-    guac_terminal_buffer_row_expand(buffer_row, end_column + 1, &buffer->default_character);
+    guac_terminal_buffer_row_expand(buffer, buffer_row, end_column + 1);
     GUAC_ASSERT(buffer_row->length >= end_column + 1);
 
     int remaining_continuation_chars = 0;
@@ -519,6 +1875,46 @@ void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
 
 }
 
+void guac_terminal_buffer_set_ascii(guac_terminal_buffer* buffer, int row,
+        int start_column, const char* text, int length,
+        const guac_terminal_attributes* attributes) {
+
+    /* Do nothing if there's nothing to do or if nothing sanely can be done
+     * (row is impossibly large) */
+    if (length <= 0 || row >= GUAC_TERMINAL_MAX_ROWS || row <= -GUAC_TERMINAL_MAX_ROWS)
+        return;
+
+    /* Do nothing if there is no such row within the buffer (the given row index
+     * does not refer to an actual row, even considering scrollback) */
+    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row);
+    if (buffer_row == NULL)
+        return;
+
+    start_column = guac_terminal_fit_to_range(start_column, 0, GUAC_TERMINAL_MAX_COLUMNS - 1);
+    int end_column = guac_terminal_fit_to_range(start_column + length - 1, 0, GUAC_TERMINAL_MAX_COLUMNS - 1);
+
+    guac_terminal_buffer_row_expand(buffer, buffer_row, end_column + 1);
+    GUAC_ASSERT(buffer_row->length >= end_column + 1);
+
+    guac_terminal_char* current = &buffer_row->characters[start_column];
+    for (int i = start_column; i <= end_column; i++) {
+        current->value = (unsigned char) *(text++);
+        current->attributes = *attributes;
+        current->width = 1;
+        current++;
+    }
+
+    /* Update length depending on row written (printable characters are
+     * never null) */
+    if (row >= buffer->length)
+        buffer->length = row + 1;
+
+    /* Force breaks around destination region */
+    guac_terminal_buffer_force_break(buffer, row, start_column);
+    guac_terminal_buffer_force_break(buffer, row, end_column + 1);
+
+}
+
 void guac_terminal_buffer_set_cursor(guac_terminal_buffer* buffer, int row,
         int column, bool is_cursor) {
 
@@ -534,7 +1930,7 @@ void guac_terminal_buffer_set_cursor(guac_terminal_buffer* buffer, int row,
 
     column = guac_terminal_fit_to_range(column, 0, GUAC_TERMINAL_MAX_COLUMNS - 1);
 
-    guac_terminal_buffer_row_expand(buffer_row, column + 1, &buffer->default_character);
+    guac_terminal_buffer_row_expand(buffer, buffer_row, column + 1);
     GUAC_ASSERT(buffer_row->length >= column + 1);
 
     buffer_row->characters[column].attributes.cursor = is_cursor;
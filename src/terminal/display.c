@@ -17,9 +17,9 @@
  * under the License.
  */
 
-#include "common/surface.h"
 #include "terminal/common.h"
 #include "terminal/display.h"
+#include "terminal/glyph-atlas.h"
 #include "terminal/palette.h"
 #include "terminal/terminal.h"
 #include "terminal/terminal-priv.h"
@@ -34,9 +34,9 @@
 #include <glib-object.h>
 #include <guacamole/assert.h>
 #include <guacamole/client.h>
+#include <guacamole/display.h>
 #include <guacamole/mem.h>
-#include <guacamole/protocol.h>
-#include <guacamole/socket.h>
+#include <guacamole/rect.h>
 #include <pango/pangocairo.h>
 
 /* Maps any codepoint onto a number between 0 and 511 inclusive */
@@ -99,13 +99,38 @@ int __guac_terminal_set_colors(guac_terminal_display* display,
 }
 
 /**
- * Sends the given character to the terminal at the given row and column,
- * rendering the character immediately. This bypasses the guac_terminal_display
- * mechanism and is intended for flushing of updates only.
+ * Packs the red, green, and blue components of the given color into a single
+ * 24-bit RGB value.
+ *
+ * @param color
+ *     The color to pack.
+ *
+ * @return
+ *     The given color as a 24-bit RGB value.
  */
-int __guac_terminal_set(guac_terminal_display* display, int row, int col, int codepoint) {
+static uint32_t __guac_terminal_pack_color(const guac_terminal_color* color) {
+    return (color->red << 16) | (color->green << 8) | color->blue;
+}
 
-    int width;
+/**
+ * Renders the given character using the current glyph colors, storing the
+ * result within the given slot of the glyph atlas.
+ *
+ * @param display
+ *     The display whose font, colors, and glyph atlas should be used.
+ *
+ * @param slot
+ *     The index of the glyph atlas slot that should receive the rendered
+ *     glyph.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the character to render.
+ *
+ * @param width
+ *     The width of the character, in columns.
+ */
+static void __guac_terminal_render_glyph(guac_terminal_display* display,
+        int slot, int codepoint, int width) {
 
     int bytes;
     char utf8[4];
@@ -116,23 +141,16 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     /* Use background color */
     const guac_terminal_color* background = &display->glyph_background;
 
+    guac_terminal_glyph_atlas* atlas = display->glyph_atlas;
+
     cairo_surface_t* surface;
     cairo_t* cairo;
     int surface_width, surface_height;
-   
+
     PangoLayout* layout;
     int layout_width, layout_height;
     int ideal_layout_width, ideal_layout_height;
 
-    /* Calculate width in columns */
-    width = wcwidth(codepoint);
-    if (width < 0)
-        width = 1;
-
-    /* Do nothing if glyph is empty */
-    if (width == 0)
-        return 0;
-
     /* Convert to UTF-8 */
     bytes = guac_terminal_encode_utf8(codepoint, utf8);
 
@@ -142,9 +160,13 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     ideal_layout_width = surface_width * PANGO_SCALE;
     ideal_layout_height = surface_height * PANGO_SCALE;
 
-    /* Prepare surface */
-    surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
-                                         surface_width, surface_height);
+    /* Render directly into the atlas slot */
+    unsigned char* slot_buffer = atlas->image
+        + guac_terminal_glyph_atlas_slot_y(atlas, slot) * atlas->stride
+        + guac_terminal_glyph_atlas_slot_x(atlas, slot) * GUAC_DISPLAY_LAYER_RAW_BPP;
+
+    surface = cairo_image_surface_create_for_data(slot_buffer,
+            CAIRO_FORMAT_RGB24, surface_width, surface_height, atlas->stride);
     cairo = cairo_create(surface);
 
     /* Fill background */
@@ -156,11 +178,28 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     cairo_rectangle(cairo, 0, 0, surface_width, surface_height); 
     cairo_fill(cairo);
 
-    /* Get layout */
-    layout = pango_cairo_create_layout(cairo);
-    pango_layout_set_font_description(layout, display->font_desc);
+    /* Reuse the same layout for all glyphs, retargeting it to the surface of
+     * the current glyph */
+    if (display->glyph_layout == NULL) {
+        display->glyph_layout = pango_cairo_create_layout(cairo);
+        pango_layout_set_alignment(display->glyph_layout, PANGO_ALIGN_CENTER);
+    }
+    else
+        pango_cairo_update_layout(cairo, display->glyph_layout);
+
+    layout = display->glyph_layout;
+
+    /* Update font only if changed since the last glyph was rendered */
+    guac_terminal_font* font = display->font;
+    if (display->glyph_layout_font != font) {
+        pango_layout_set_font_description(layout, font->description);
+        display->glyph_layout_font = font;
+    }
+
+    /* Clear any bounds imposed when scaling the previous glyph */
+    pango_layout_set_width(layout, -1);
+    pango_layout_set_height(layout, -1);
     pango_layout_set_text(layout, utf8, bytes);
-    pango_layout_set_alignment(layout, PANGO_ALIGN_CENTER);
 
     pango_layout_get_size(layout, &layout_width, &layout_height);
 
@@ -188,17 +227,70 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     cairo_move_to(cairo, 0.0, 0.0);
     pango_cairo_show_layout(cairo, layout);
 
-    /* Draw */
-    guac_common_surface_draw(display->display_surface,
-        display->char_width * col,
-        display->char_height * row,
-        surface);
+    /* Ensure all drawing has reached the atlas image before it is read */
+    cairo_surface_flush(surface);
 
     /* Free all */
-    g_object_unref(layout);
     cairo_destroy(cairo);
     cairo_surface_destroy(surface);
 
+}
+
+/**
+ * Draws the given character to the terminal at the given row and column,
+ * rendering the character immediately. This bypasses the guac_terminal_display
+ * mechanism and is intended for flushing of updates only. Each distinct
+ * combination of character and colors is rendered only once and is
+ * thereafter copied from the display's glyph atlas.
+ */
+int __guac_terminal_set(guac_terminal_display* display,
+        guac_display_layer_raw_context* context, int row, int col,
+        int codepoint) {
+
+    guac_terminal_glyph_atlas* atlas = display->glyph_atlas;
+
+    /* Calculate width in columns */
+    int width = wcwidth(codepoint);
+    if (width < 0)
+        width = 1;
+
+    /* Do nothing if glyph is empty */
+    if (width == 0)
+        return 0;
+
+    /* Wide characters never exceed the width of an atlas slot */
+    if (width > GUAC_TERMINAL_MAX_CHAR_WIDTH)
+        width = GUAC_TERMINAL_MAX_CHAR_WIDTH;
+
+    uint32_t foreground = __guac_terminal_pack_color(&display->glyph_foreground);
+    uint32_t background = __guac_terminal_pack_color(&display->glyph_background);
+
+    /* Render glyph only if not already present within the atlas */
+    int slot = guac_terminal_glyph_atlas_find(atlas, codepoint,
+            foreground, background);
+    if (slot == -1) {
+        slot = guac_terminal_glyph_atlas_insert(atlas, codepoint,
+                foreground, background);
+        __guac_terminal_render_glyph(display, slot, codepoint, width);
+    }
+
+    /* Copy rendered glyph into place, clipping any portion of a wide
+     * character that extends beyond the layer */
+    guac_rect dst;
+    guac_rect_init(&dst, display->char_width * col, display->char_height * row,
+            width * display->char_width, display->char_height);
+    guac_rect_constrain(&dst, &context->bounds);
+
+    if (guac_rect_is_empty(&dst))
+        return 0;
+
+    const unsigned char* slot_buffer = atlas->image
+        + guac_terminal_glyph_atlas_slot_y(atlas, slot) * atlas->stride
+        + guac_terminal_glyph_atlas_slot_x(atlas, slot) * GUAC_DISPLAY_LAYER_RAW_BPP;
+
+    guac_display_layer_raw_context_put(context, &dst, slot_buffer,
+            atlas->stride);
+
     return 0;
 
 }
@@ -217,38 +309,47 @@ static int get_margin_by_dpi(int dpi) {
 }
 
 guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
-        const char* font_name, int font_size, int dpi,
-        guac_terminal_color* foreground, guac_terminal_color* background,
-        guac_terminal_color (*palette)[256]) {
+        guac_display* graphical_display, const char* font_name,
+        int font_size, int dpi, guac_terminal_color* foreground,
+        guac_terminal_color* background, guac_terminal_color (*palette)[256]) {
 
     /* Allocate display */
     guac_terminal_display* display = guac_mem_alloc(sizeof(guac_terminal_display));
     display->client = client;
+    display->graphical_display = graphical_display;
 
     /* Initially no font loaded */
-    display->font_desc = NULL;
+    display->font = NULL;
+    display->glyph_layout = NULL;
+    display->glyph_layout_font = NULL;
     display->char_width = 0;
     display->char_height = 0;
 
-    /* Create default surface */
-    display->display_layer = guac_client_alloc_layer(client);
-    display->select_layer = guac_client_alloc_layer(client);
-    display->display_surface = guac_common_surface_alloc(client,
-            client->socket, display->display_layer, 0, 0);
+    /* Create layer containing the terminal itself */
+    display->display_layer = guac_display_alloc_layer(graphical_display, 1);
 
     /* Never use lossy compression for terminal contents */
-    guac_common_surface_set_lossless(display->display_surface, 1);
+    guac_display_layer_set_lossless(display->display_layer, 1);
+
+    /* Selection is drawn with solid colors and made translucent through the
+     * opacity of its layer */
+    display->select_layer = guac_display_alloc_layer(graphical_display, 0);
+    guac_display_layer_set_opacity(display->select_layer,
+            GUAC_TERMINAL_SELECTION_OPACITY);
+
+    /* Rendered glyphs are cached server-side */
+    display->glyph_atlas = guac_terminal_glyph_atlas_alloc();
 
     /* Select layer is a child of the display layer */
-    guac_protocol_send_move(client->socket, display->select_layer,
-            display->display_layer, 0, 0, 0);
+    guac_display_layer_set_parent(display->select_layer,
+            display->display_layer);
 
     /* Calculate margin size by DPI */
     display->margin = get_margin_by_dpi(dpi);
 
     /* Offset the Default Layer to make margins even on all sides */
-    guac_protocol_send_move(client->socket, display->display_layer,
-        GUAC_DEFAULT_LAYER, display->margin, display->margin, 0);
+    guac_display_layer_move(display->display_layer,
+            display->margin, display->margin);
 
     display->default_foreground = display->glyph_foreground = *foreground;
     display->default_background = display->glyph_background = *background;
@@ -258,7 +359,9 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
     display->width = 0;
     display->height = 0;
     display->operations = NULL;
+    display->damage = NULL;
     display->unflushed_set = false;
+    display->stats = (guac_terminal_display_stats) { 0 };
 
     /* Initially nothing selected */
     display->text_selected = false;
@@ -267,6 +370,9 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
     if (guac_terminal_display_set_font(display, font_name, font_size, dpi)) {
         guac_client_abort(display->client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
                 "Unable to set initial font \"%s\"", font_name);
+        guac_terminal_glyph_atlas_free(display->glyph_atlas);
+        guac_display_free_layer(display->select_layer);
+        guac_display_free_layer(display->display_layer);
         guac_mem_free(display);
         return NULL;
     }
@@ -277,14 +383,25 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
 
 void guac_terminal_display_free(guac_terminal_display* display) {
 
-    /* Free font description */
-    pango_font_description_free(display->font_desc);
+    /* Release font and the layout used to render it */
+    if (display->glyph_layout != NULL)
+        g_object_unref(display->glyph_layout);
+
+    guac_terminal_font_release(display->font);
+
+    /* Free glyph atlas */
+    guac_terminal_glyph_atlas_free(display->glyph_atlas);
+
+    /* Free layers */
+    guac_display_free_layer(display->select_layer);
+    guac_display_free_layer(display->display_layer);
 
     /* Free default palette. */
     guac_mem_free(display->default_palette);
 
     /* Free operations buffers */
     guac_mem_free(display->operations);
+    guac_mem_free(display->damage);
 
     /* Free display */
     guac_mem_free(display);
@@ -347,6 +464,50 @@ int guac_terminal_display_lookup_color(guac_terminal_display* display,
 
 }
 
+/**
+ * Records that the given range of columns within the given row of the
+ * display may contain pending operations.
+ *
+ * @param display
+ *     The display containing the modified row.
+ *
+ * @param row
+ *     The row containing the modified columns.
+ *
+ * @param start_column
+ *     The first column of the modified range, inclusive.
+ *
+ * @param end_column
+ *     The last column of the modified range, inclusive.
+ */
+static void __guac_terminal_display_damage(guac_terminal_display* display,
+        int row, int start_column, int end_column) {
+
+    guac_terminal_display_damage* damage = &display->damage[row];
+
+    if (start_column < damage->left)
+        damage->left = start_column;
+
+    if (end_column > damage->right)
+        damage->right = end_column;
+
+}
+
+/**
+ * Records that all pending operations within the display have been flushed.
+ *
+ * @param display
+ *     The display whose operations have been flushed.
+ */
+static void __guac_terminal_display_clear_damage(guac_terminal_display* display) {
+
+    for (int row = 0; row < display->height; row++) {
+        display->damage[row].left = display->width;
+        display->damage[row].right = -1;
+    }
+
+}
+
 void guac_terminal_display_copy_columns(guac_terminal_display* display, int row,
         int start_column, int end_column, int offset) {
 
@@ -383,6 +544,8 @@ void guac_terminal_display_copy_columns(guac_terminal_display* display, int row,
 
     /* Copy data */
     memmove(dst, src, guac_mem_ckd_mul_or_die(sizeof(guac_terminal_operation), (end_column - start_column + 1)));
+    __guac_terminal_display_damage(display, row,
+            start_column + offset, end_column + offset);
 
     /* Update operations */
     for (int column = start_column; column <= end_column; column++) {
@@ -446,6 +609,11 @@ void guac_terminal_display_copy_rows(guac_terminal_display* display,
     memmove(dst, src, guac_mem_ckd_mul_or_die(sizeof(guac_terminal_operation),
                 display->width, (end_row - start_row + 1)));
 
+    /* Every column of each destination row is now either a copy or an
+     * operation copied from the source row */
+    for (int row = start_row; row <= end_row; row++)
+        __guac_terminal_display_damage(display, row + offset, 0, display->width - 1);
+
     /* Update operations */
     for (int row = start_row; row <= end_row; row++) {
 
@@ -500,6 +668,7 @@ void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
         /* Set operation */
         current->type      = GUAC_CHAR_SET;
         current->character = *character;
+        __guac_terminal_display_damage(display, row, col, col);
 
         /* Next character */
         current += character->width;
@@ -515,6 +684,23 @@ void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
 
 }
 
+/**
+ * Resizes the display and selection layers of the given display to exactly
+ * fit its current dimensions in characters and current character size.
+ *
+ * @param display
+ *     The display whose layers should be resized.
+ */
+static void __guac_terminal_display_resize_layers(guac_terminal_display* display) {
+
+    int width = display->char_width * display->width;
+    int height = display->char_height * display->height;
+
+    guac_display_layer_resize(display->display_layer, width, height);
+    guac_display_layer_resize(display->select_layer, width, height);
+
+}
+
 void guac_terminal_display_resize(guac_terminal_display* display, int width, int height) {
 
     /* Resize display only if dimensions have changed */
@@ -538,14 +724,24 @@ void guac_terminal_display_resize(guac_terminal_display* display, int width, int
     if (display->operations != NULL)
         guac_mem_free(display->operations);
 
+    guac_mem_free(display->damage);
+
     /* Alloc operations */
     display->operations = guac_mem_alloc(width, height,
             sizeof(guac_terminal_operation));
 
+    display->damage = guac_mem_alloc(height,
+            sizeof(guac_terminal_display_damage));
+
     /* Init each operation buffer row */
     guac_terminal_operation* current = display->operations;
     for (int y = 0; y < height; y++) {
 
+        /* Only the newly-exposed part of the screen must be drawn */
+        guac_terminal_display_damage* damage = &display->damage[y];
+        damage->left = (y < display->height) ? display->width : 0;
+        damage->right = width - 1;
+
         /* Init entire row to NOP */
         for (int x = 0; x < width; x++) {
 
@@ -569,27 +765,113 @@ void guac_terminal_display_resize(guac_terminal_display* display, int width, int
     display->width = width;
     display->height = height;
 
-    /* Send display size */
-    guac_common_surface_resize(
-            display->display_surface,
-            display->char_width  * width,
-            display->char_height * height);
+    /* Resize layers to match */
+    __guac_terminal_display_resize_layers(display);
+
+}
+
+/**
+ * Copies a rectangle of image data within the buffer of the given raw
+ * context, correctly handling any overlap between the source and
+ * destination. Both rectangles are constrained to the bounds of the buffer,
+ * and the destination is marked as damaged.
+ *
+ * @param context
+ *     The raw context of the layer whose image data should be copied.
+ *
+ * @param src_x
+ *     The X coordinate of the upper-left corner of the source rectangle.
+ *
+ * @param src_y
+ *     The Y coordinate of the upper-left corner of the source rectangle.
+ *
+ * @param width
+ *     The width of the rectangle, in pixels.
+ *
+ * @param height
+ *     The height of the rectangle, in pixels.
+ *
+ * @param dst_x
+ *     The X coordinate of the upper-left corner of the destination.
+ *
+ * @param dst_y
+ *     The Y coordinate of the upper-left corner of the destination.
+ */
+static void __guac_terminal_display_copy_rect(
+        guac_display_layer_raw_context* context, int src_x, int src_y,
+        int width, int height, int dst_x, int dst_y) {
+
+    int dx = dst_x - src_x;
+    int dy = dst_y - src_y;
+
+    /* Clip destination to the buffer, then the corresponding source */
+    guac_rect dst;
+    guac_rect_init(&dst, dst_x, dst_y, width, height);
+    guac_rect_constrain(&dst, &context->bounds);
+
+    guac_rect src;
+    guac_rect_init(&src, dst.left - dx, dst.top - dy,
+            guac_rect_width(&dst), guac_rect_height(&dst));
+    guac_rect_constrain(&src, &context->bounds);
+
+    if (guac_rect_is_empty(&src))
+        return;
+
+    /* Any clipping of the source applies equally to the destination */
+    guac_rect_init(&dst, src.left + dx, src.top + dy,
+            guac_rect_width(&src), guac_rect_height(&src));
+
+    size_t stride = context->stride;
+    size_t length = guac_mem_ckd_mul_or_die(guac_rect_width(&dst),
+            GUAC_DISPLAY_LAYER_RAW_BPP);
+
+    const unsigned char* src_buffer = GUAC_RECT_CONST_BUFFER(src,
+            context->buffer, stride, GUAC_DISPLAY_LAYER_RAW_BPP);
+
+    unsigned char* dst_buffer = GUAC_RECT_MUTABLE_BUFFER(dst,
+            context->buffer, stride, GUAC_DISPLAY_LAYER_RAW_BPP);
 
-    guac_protocol_send_size(display->client->socket,
-            display->select_layer,
-            display->char_width  * width,
-            display->char_height * height);
+    int rows = guac_rect_height(&dst);
+
+    /* Copy bottom-up if the destination is below the source, such that no
+     * row is overwritten before it has been read */
+    if (dst.top > src.top) {
+        src_buffer += (rows - 1) * stride;
+        dst_buffer += (rows - 1) * stride;
+        for (int row = 0; row < rows; row++) {
+            memmove(dst_buffer, src_buffer, length);
+            src_buffer -= stride;
+            dst_buffer -= stride;
+        }
+    }
+
+    /* Otherwise, top-down */
+    else {
+        for (int row = 0; row < rows; row++) {
+            memmove(dst_buffer, src_buffer, length);
+            src_buffer += stride;
+            dst_buffer += stride;
+        }
+    }
+
+    guac_display_layer_raw_context_damage(context, &dst);
 
 }
 
-void __guac_terminal_display_flush_copy(guac_terminal_display* display) {
+void __guac_terminal_display_flush_copy(guac_terminal_display* display,
+        guac_display_layer_raw_context* context) {
 
-    guac_terminal_operation* current = display->operations;
     int row, col;
 
     /* For each operation */
     for (row=0; row<display->height; row++) {
-        for (col=0; col<display->width; col++) {
+
+        /* Visit only the columns which may contain pending operations */
+        const guac_terminal_display_damage* damage = &display->damage[row];
+        guac_terminal_operation* current =
+            &display->operations[row * display->width + damage->left];
+
+        for (col=damage->left; col<=damage->right; col++) {
 
             /* If operation is a copy operation */
             if (current->type == GUAC_CHAR_COPY) {
@@ -684,16 +966,15 @@ void __guac_terminal_display_flush_copy(guac_terminal_display* display) {
 
                 }
 
-                /* Send copy */
-                guac_common_surface_copy(
+                display->stats.copy_rects++;
+                display->stats.cells += rect_width * rect_height;
 
-                        display->display_surface,
+                /* Perform copy */
+                __guac_terminal_display_copy_rect(context,
                         current->column * display->char_width,
                         current->row * display->char_height,
                         rect_width * display->char_width,
                         rect_height * display->char_height,
-
-                        display->display_surface,
                         col * display->char_width,
                         row * display->char_height);
 
@@ -707,14 +988,20 @@ void __guac_terminal_display_flush_copy(guac_terminal_display* display) {
 
 }
 
-void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
+void __guac_terminal_display_flush_clear(guac_terminal_display* display,
+        guac_display_layer_raw_context* context) {
 
-    guac_terminal_operation* current = display->operations;
     int row, col;
 
     /* For each operation */
     for (row=0; row<display->height; row++) {
-        for (col=0; col<display->width; col++) {
+
+        /* Visit only the columns which may contain pending operations */
+        const guac_terminal_display_damage* damage = &display->damage[row];
+        guac_terminal_operation* current =
+            &display->operations[row * display->width + damage->left];
+
+        for (col=damage->left; col<=damage->right; col++) {
 
             /* If operation is a clear operation (set to space) */
             if (current->type == GUAC_CHAR_SET &&
@@ -821,15 +1108,21 @@ void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
 
                 }
 
-                /* Send rect */
-                guac_common_surface_set(
-                        display->display_surface,
+                display->stats.clear_rects++;
+                display->stats.cells += rect_width * rect_height;
+
+                /* Fill rect */
+                guac_rect dst;
+                guac_rect_init(&dst,
                         col * display->char_width,
                         row * display->char_height,
                         rect_width * display->char_width,
-                        rect_height * display->char_height,
-                        color.red, color.green, color.blue,
-                        0xFF);
+                        rect_height * display->char_height);
+                guac_rect_constrain(&dst, &context->bounds);
+
+                if (!guac_rect_is_empty(&dst))
+                    guac_display_layer_raw_context_set(context, &dst,
+                            0xFF000000 | __guac_terminal_pack_color(&color));
 
             } /* end if clear operation */
 
@@ -841,14 +1134,20 @@ void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
 
 }
 
-void __guac_terminal_display_flush_set(guac_terminal_display* display) {
+void __guac_terminal_display_flush_set(guac_terminal_display* display,
+        guac_display_layer_raw_context* context) {
 
-    guac_terminal_operation* current = display->operations;
     int row, col;
 
     /* For each operation */
     for (row=0; row<display->height; row++) {
-        for (col=0; col<display->width; col++) {
+
+        /* Visit only the columns which may contain pending operations */
+        const guac_terminal_display_damage* damage = &display->damage[row];
+        guac_terminal_operation* current =
+            &display->operations[row * display->width + damage->left];
+
+        for (col=damage->left; col<=damage->right; col++) {
 
             /* Perform given operation */
             if (current->type == GUAC_CHAR_SET) {
@@ -863,12 +1162,15 @@ void __guac_terminal_display_flush_set(guac_terminal_display* display) {
                 __guac_terminal_set_colors(display,
                         &(current->character.attributes));
 
-                /* Send character */
-                __guac_terminal_set(display, row, col, codepoint);
+                /* Draw character */
+                __guac_terminal_set(display, context, row, col, codepoint);
 
                 /* Mark operation as handled */
                 current->type = GUAC_CHAR_NOP;
 
+                display->stats.glyphs++;
+                display->stats.cells++;
+
             }
 
             /* Next operation */
@@ -883,65 +1185,64 @@ void __guac_terminal_display_flush_set(guac_terminal_display* display) {
 }
 void guac_terminal_display_flush_operations(guac_terminal_display* display) {
 
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_raw(display->display_layer);
+
     /* Flush operations, copies first, then clears, then sets. */
-    __guac_terminal_display_flush_copy(display);
-    __guac_terminal_display_flush_clear(display);
-    __guac_terminal_display_flush_set(display);
+    __guac_terminal_display_flush_copy(display, context);
+    __guac_terminal_display_flush_clear(display, context);
+    __guac_terminal_display_flush_set(display, context);
 
-}
+    guac_display_layer_close_raw(display->display_layer, context);
 
-void guac_terminal_display_flush(guac_terminal_display* display) {
-
-    /* Flush operations */
-    guac_terminal_display_flush_operations(display);
+    /* No operations remain anywhere within the display */
+    __guac_terminal_display_clear_damage(display);
 
-    /* Flush surface */
-    guac_common_surface_flush(display->display_surface);
+    display->stats.flushes++;
 
 }
 
-void guac_terminal_display_dup(
-        guac_terminal_display* display, guac_client* client, guac_socket* socket) {
-
-    /* Create default surface */
-    guac_common_surface_dup(display->display_surface, client, socket);
-
-    /* Select layer is a child of the display layer */
-    guac_protocol_send_move(socket, display->select_layer,
-            display->display_layer, 0, 0, 0);
-
-    /* Offset the Default Layer to make margins even on all sides */
-    guac_protocol_send_move(socket, display->display_layer,
-        GUAC_DEFAULT_LAYER, display->margin, display->margin, 0);
+void guac_terminal_display_flush(guac_terminal_display* display) {
 
-    /* Send select layer size */
-    guac_protocol_send_size(socket, display->select_layer,
-            display->char_width  * display->width,
-            display->char_height * display->height);
+    /* Flush operations */
+    guac_terminal_display_flush_operations(display);
 
 }
 
-void guac_terminal_display_select(guac_terminal_display* display,
-        int start_row, int start_col, int end_row, int end_col) {
-
-    guac_socket* socket = display->client->socket;
-    guac_layer* select_layer = display->select_layer;
-
-    /* Do nothing if selection is unchanged */
-    if (display->text_selected
-            && display->selection_start_row    == start_row
-            && display->selection_start_column == start_col
-            && display->selection_end_row      == end_row
-            && display->selection_end_column   == end_col)
-        return;
-
-    /* Text is now selected */
-    display->text_selected = true;
+/**
+ * Fills the region of the selection layer covering the given range of
+ * selected text with the given color. The start and end of the range may be
+ * given in either order.
+ *
+ * @param display
+ *     The display whose selection layer is being drawn to.
+ *
+ * @param context
+ *     The raw context of the selection layer.
+ *
+ * @param start_row
+ *     The row at which the range starts.
+ *
+ * @param start_col
+ *     The column at which the range starts.
+ *
+ * @param end_row
+ *     The row at which the range ends.
+ *
+ * @param end_col
+ *     The column at which the range ends.
+ *
+ * @param color
+ *     The 32-bit ARGB color to fill the region with.
+ */
+static void __guac_terminal_display_fill_selection(
+        guac_terminal_display* display,
+        guac_display_layer_raw_context* context, int start_row,
+        int start_col, int end_row, int end_col, uint32_t color) {
 
-    display->selection_start_row = start_row;
-    display->selection_start_column = start_col;
-    display->selection_end_row = end_row;
-    display->selection_end_column = end_col;
+    /* The up to three rectangles covering the range */
+    guac_rect rects[3];
+    int count = 0;
 
     /* If single row, just need one rectangle */
     if (start_row == end_row) {
@@ -954,11 +1255,9 @@ void guac_terminal_display_select(guac_terminal_display* display,
         }
 
         /* Select characters between columns */
-        guac_protocol_send_rect(socket, select_layer,
-
+        guac_rect_init(&rects[count++],
                 start_col * display->char_width,
                 start_row * display->char_height,
-
                 (end_col - start_col + 1) * display->char_width,
                 display->char_height);
 
@@ -983,37 +1282,73 @@ void guac_terminal_display_select(guac_terminal_display* display,
         }
 
         /* First row */
-        guac_protocol_send_rect(socket, select_layer,
-
+        guac_rect_init(&rects[count++],
                 start_col * display->char_width,
                 start_row * display->char_height,
-
-                display->width * display->char_width,
+                (display->width - start_col) * display->char_width,
                 display->char_height);
 
         /* Middle */
-        guac_protocol_send_rect(socket, select_layer,
-
+        guac_rect_init(&rects[count++],
                 0,
                 (start_row + 1) * display->char_height,
-
                 display->width * display->char_width,
                 (end_row - start_row - 1) * display->char_height);
 
         /* Last row */
-        guac_protocol_send_rect(socket, select_layer,
-
+        guac_rect_init(&rects[count++],
                 0,
                 end_row * display->char_height,
-
                 (end_col + 1) * display->char_width,
                 display->char_height);
 
     }
 
-    /* Draw new selection, erasing old */
-    guac_protocol_send_cfill(socket, GUAC_COMP_SRC, select_layer,
-            0x00, 0x80, 0xFF, 0x60);
+    for (int i = 0; i < count; i++) {
+        guac_rect_constrain(&rects[i], &context->bounds);
+        if (!guac_rect_is_empty(&rects[i]))
+            guac_display_layer_raw_context_set(context, &rects[i], color);
+    }
+
+}
+
+void guac_terminal_display_select(guac_terminal_display* display,
+        int start_row, int start_col, int end_row, int end_col) {
+
+    /* Do nothing if selection is unchanged */
+    if (display->text_selected
+            && display->selection_start_row    == start_row
+            && display->selection_start_column == start_col
+            && display->selection_end_row      == end_row
+            && display->selection_end_column   == end_col)
+        return;
+
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_raw(display->select_layer);
+
+    /* Erase old selection */
+    if (display->text_selected)
+        __guac_terminal_display_fill_selection(display, context,
+                display->selection_start_row,
+                display->selection_start_column,
+                display->selection_end_row,
+                display->selection_end_column,
+                0x00000000);
+
+    /* Draw new selection */
+    __guac_terminal_display_fill_selection(display, context,
+            start_row, start_col, end_row, end_col,
+            GUAC_TERMINAL_SELECTION_COLOR);
+
+    guac_display_layer_close_raw(display->select_layer, context);
+
+    /* Text is now selected */
+    display->text_selected = true;
+
+    display->selection_start_row = start_row;
+    display->selection_start_column = start_col;
+    display->selection_end_row = end_row;
+    display->selection_end_column = end_col;
 
 }
 
@@ -1023,12 +1358,17 @@ void guac_terminal_display_clear_select(guac_terminal_display* display) {
     if (!display->text_selected)
         return;
 
-    guac_socket* socket = display->client->socket;
-    guac_layer* select_layer = display->select_layer;
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_raw(display->select_layer);
+
+    __guac_terminal_display_fill_selection(display, context,
+            display->selection_start_row,
+            display->selection_start_column,
+            display->selection_end_row,
+            display->selection_end_column,
+            0x00000000);
 
-    guac_protocol_send_rect(socket, select_layer, 0, 0, 1, 1);
-    guac_protocol_send_cfill(socket, GUAC_COMP_SRC, select_layer,
-            0x00, 0x00, 0x00, 0x00);
+    guac_display_layer_close_raw(display->select_layer, context);
 
     /* Text is no longer selected */
     display->text_selected = false;
@@ -1038,47 +1378,25 @@ void guac_terminal_display_clear_select(guac_terminal_display* display) {
 int guac_terminal_display_set_font(guac_terminal_display* display,
         const char* font_name, int font_size, int dpi) {
 
-    PangoFontDescription* font_desc;
+    /* Inherit any unspecified properties from the current font */
+    if (display->font != NULL) {
 
-    /* Build off existing font description if possible */
-    if (display->font_desc != NULL)
-        font_desc = pango_font_description_copy(display->font_desc);
+        if (font_name == NULL)
+            font_name = display->font->family;
 
-    /* Create new font description if there is nothing to copy */
-    else {
-        font_desc = pango_font_description_new();
-        pango_font_description_set_weight(font_desc, PANGO_WEIGHT_NORMAL);
-    }
-
-    /* Optionally update font name */
-    if (font_name != NULL)
-        pango_font_description_set_family(font_desc, font_name);
+        if (font_size == -1) {
+            font_size = display->font->size;
+            dpi = display->font->dpi;
+        }
 
-    /* Optionally update size */
-    if (font_size != -1) {
-        pango_font_description_set_size(font_desc,
-                font_size * PANGO_SCALE * dpi / 96);
     }
 
-    PangoFontMap* font_map = pango_cairo_font_map_get_default();
-    PangoContext* context = pango_font_map_create_context(font_map);
-
-    /* Load font from font map */
-    PangoFont* font = pango_font_map_load_font(font_map, context, font_desc);
+    /* Resolve font, reusing any previous resolution within this process */
+    guac_terminal_font* font = guac_terminal_font_acquire(font_name,
+            font_size, dpi);
     if (font == NULL) {
         guac_client_log(display->client, GUAC_LOG_INFO, "Unable to load "
-                "font \"%s\"", pango_font_description_get_family(font_desc));
-        pango_font_description_free(font_desc);
-        return 1;
-    }
-
-    /* Get metrics from loaded font */
-    PangoFontMetrics* metrics = pango_font_get_metrics(font, NULL);
-    if (metrics == NULL) {
-        guac_client_log(display->client, GUAC_LOG_INFO, "Unable to get font "
-                "metrics for font \"%s\"",
-                pango_font_description_get_family(font_desc));
-        pango_font_description_free(font_desc);
+                "font \"%s\"", font_name);
         return 1;
     }
 
@@ -1086,26 +1404,32 @@ int guac_terminal_display_set_font(guac_terminal_display* display,
     int pixel_width = display->width * display->char_width;
     int pixel_height = display->height * display->char_height;
 
-    /* Calculate character dimensions using metrics */
-    display->char_width =
-        pango_font_metrics_get_approximate_digit_width(metrics) / PANGO_SCALE;
-    display->char_height =
-        (pango_font_metrics_get_descent(metrics)
-            + pango_font_metrics_get_ascent(metrics)) / PANGO_SCALE;
+    /* Use character dimensions of new font */
+    display->char_width = font->char_width;
+    display->char_height = font->char_height;
 
-    /* Atomically replace old font description */
-    PangoFontDescription* old_font_desc = display->font_desc;
-    display->font_desc = font_desc;
-    pango_font_description_free(old_font_desc);
+    /* Atomically replace old font */
+    guac_terminal_font* old_font = display->font;
+    display->font = font;
+    display->glyph_layout_font = NULL;
+    if (old_font != NULL)
+        guac_terminal_font_release(old_font);
+
+    /* Discard any glyphs rendered with the old font */
+    guac_terminal_glyph_atlas_reset(display->glyph_atlas,
+            display->char_width * GUAC_TERMINAL_MAX_CHAR_WIDTH,
+            display->char_height);
 
     /* Recalculate dimensions which will fit within current surface */
     int new_width = pixel_width / display->char_width;
     int new_height = pixel_height / display->char_height;
 
-    /* Resize display if dimensions have changed */
+    /* Resize display if dimensions have changed, otherwise just resize the
+     * layers to match the new character size */
     if (new_width != display->width || new_height != display->height)
         guac_terminal_display_resize(display, new_width, new_height);
-
+    else
+        __guac_terminal_display_resize_layers(display);
 
     return 0;
 
@@ -0,0 +1,230 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "terminal/font-cache.h"
+
+#include <glib-object.h>
+#include <guacamole/mem.h>
+#include <guacamole/string.h>
+#include <pango/pangocairo.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * All cached fonts, ordered from most recently to least recently acquired.
+ * Unused entries are NULL and follow all used entries.
+ */
+static guac_terminal_font* guac_terminal_font_cache[GUAC_TERMINAL_FONT_CACHE_SIZE];
+
+/**
+ * Lock which guards access to the cache and to the reference counts of all
+ * fonts.
+ */
+static pthread_mutex_t guac_terminal_font_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Frees the given font and all associated Pango resources. The font must not
+ * be referenced by any terminal nor stored within the cache.
+ *
+ * @param font
+ *     The font to free.
+ */
+static void guac_terminal_font_free(guac_terminal_font* font) {
+    pango_font_description_free(font->description);
+    guac_mem_free(font->family);
+    guac_mem_free(font);
+}
+
+/**
+ * Resolves the font having the given family, size, and resolution, measuring
+ * the dimensions of its characters.
+ *
+ * @param family
+ *     The font family.
+ *
+ * @param size
+ *     The font size, in points.
+ *
+ * @param dpi
+ *     The resolution at which the font will be rendered, in DPI.
+ *
+ * @return
+ *     A newly-allocated font having a reference count of zero, or NULL if the
+ *     font cannot be loaded.
+ */
+static guac_terminal_font* guac_terminal_font_load(const char* family,
+        int size, int dpi) {
+
+    PangoFontDescription* description = pango_font_description_new();
+    pango_font_description_set_weight(description, PANGO_WEIGHT_NORMAL);
+    pango_font_description_set_family(description, family);
+    pango_font_description_set_size(description,
+            size * PANGO_SCALE * dpi / 96);
+
+    PangoFontMap* font_map = pango_cairo_font_map_get_default();
+    PangoContext* context = pango_font_map_create_context(font_map);
+
+    /* Load font from font map */
+    PangoFont* pango_font = pango_font_map_load_font(font_map, context,
+            description);
+    g_object_unref(context);
+
+    if (pango_font == NULL) {
+        pango_font_description_free(description);
+        return NULL;
+    }
+
+    /* Get metrics from loaded font */
+    PangoFontMetrics* metrics = pango_font_get_metrics(pango_font, NULL);
+    g_object_unref(pango_font);
+
+    if (metrics == NULL) {
+        pango_font_description_free(description);
+        return NULL;
+    }
+
+    guac_terminal_font* font = guac_mem_alloc(sizeof(guac_terminal_font));
+    font->family = guac_strdup(family);
+    font->size = size;
+    font->dpi = dpi;
+    font->description = description;
+    font->refcount = 0;
+    font->cached = false;
+
+    /* Calculate character dimensions using metrics */
+    font->char_width =
+        pango_font_metrics_get_approximate_digit_width(metrics) / PANGO_SCALE;
+    font->char_height =
+        (pango_font_metrics_get_descent(metrics)
+            + pango_font_metrics_get_ascent(metrics)) / PANGO_SCALE;
+
+    pango_font_metrics_unref(metrics);
+
+    /* Fonts lacking dimensions cannot be used to lay out a terminal */
+    if (font->char_width <= 0 || font->char_height <= 0) {
+        guac_terminal_font_free(font);
+        return NULL;
+    }
+
+    return font;
+
+}
+
+/**
+ * Moves the cache entry at the given index to the front of the cache, such
+ * that it becomes the most recently acquired font. The cache must be locked.
+ *
+ * @param index
+ *     The index of the entry to move.
+ */
+static void guac_terminal_font_cache_promote(int index) {
+
+    guac_terminal_font* font = guac_terminal_font_cache[index];
+    memmove(&guac_terminal_font_cache[1], &guac_terminal_font_cache[0],
+            index * sizeof(guac_terminal_font*));
+    guac_terminal_font_cache[0] = font;
+
+}
+
+/**
+ * Stores the given font within the cache as the most recently acquired
+ * font, evicting the least recently acquired font that is not in use if the
+ * cache is full. If every cached font is in use, the given font is not cached.
+ * The cache must be locked.
+ *
+ * @param font
+ *     The font to store.
+ */
+static void guac_terminal_font_cache_insert(guac_terminal_font* font) {
+
+    /* Find an empty entry, or the least recently acquired unused font */
+    int index;
+    for (index = GUAC_TERMINAL_FONT_CACHE_SIZE - 1; index >= 0; index--) {
+
+        guac_terminal_font* current = guac_terminal_font_cache[index];
+        if (current == NULL)
+            break;
+
+        if (current->refcount == 0) {
+            guac_terminal_font_free(current);
+            break;
+        }
+
+    }
+
+    if (index < 0)
+        return;
+
+    guac_terminal_font_cache[index] = font;
+    guac_terminal_font_cache_promote(index);
+    font->cached = true;
+
+}
+
+guac_terminal_font* guac_terminal_font_acquire(const char* family, int size,
+        int dpi) {
+
+    pthread_mutex_lock(&guac_terminal_font_cache_lock);
+
+    /* Use cached font if available */
+    for (int i = 0; i < GUAC_TERMINAL_FONT_CACHE_SIZE; i++) {
+
+        guac_terminal_font* font = guac_terminal_font_cache[i];
+        if (font == NULL)
+            break;
+
+        if (font->size == size && font->dpi == dpi
+                && strcmp(font->family, family) == 0) {
+            font->refcount++;
+            guac_terminal_font_cache_promote(i);
+            pthread_mutex_unlock(&guac_terminal_font_cache_lock);
+            return font;
+        }
+
+    }
+
+    /* Otherwise load and cache the font */
+    guac_terminal_font* font = guac_terminal_font_load(family, size, dpi);
+    if (font != NULL) {
+        font->refcount++;
+        guac_terminal_font_cache_insert(font);
+    }
+
+    pthread_mutex_unlock(&guac_terminal_font_cache_lock);
+    return font;
+
+}
+
+void guac_terminal_font_release(guac_terminal_font* font) {
+
+    pthread_mutex_lock(&guac_terminal_font_cache_lock);
+
+    /* Fonts outside the cache are freed as soon as they are unused, while
+     * cached fonts remain until evicted */
+    bool unused = (--font->refcount == 0) && !font->cached;
+
+    pthread_mutex_unlock(&guac_terminal_font_cache_lock);
+
+    if (unused)
+        guac_terminal_font_free(font);
+
+}
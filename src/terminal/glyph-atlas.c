@@ -0,0 +1,292 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "terminal/glyph-atlas.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/mem.h>
+
+#include <stdint.h>
+
+/**
+ * Hashes the given glyph key onto a bucket index within the hash table of a
+ * guac_terminal_glyph_atlas.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the glyph.
+ *
+ * @param foreground
+ *     The foreground color of the glyph, as a 24-bit RGB value.
+ *
+ * @param background
+ *     The background color of the glyph, as a 24-bit RGB value.
+ *
+ * @return
+ *     The index of the first bucket to probe for the given glyph.
+ */
+static unsigned int guac_terminal_glyph_atlas_hash(int codepoint,
+        uint32_t foreground, uint32_t background) {
+
+    uint32_t hash = (uint32_t) codepoint * 2654435761u;
+    hash ^= foreground * 40503u;
+    hash ^= (background << 7) ^ (background >> 11);
+    hash ^= hash >> 15;
+
+    return hash & (GUAC_TERMINAL_GLYPH_ATLAS_BUCKETS - 1);
+
+}
+
+/**
+ * Marks every entry within the hash table of the given atlas as unused and
+ * returns all slots to the pool of available slots.
+ *
+ * @param atlas
+ *     The glyph atlas to clear.
+ */
+static void guac_terminal_glyph_atlas_clear(guac_terminal_glyph_atlas* atlas) {
+
+    for (int i = 0; i < GUAC_TERMINAL_GLYPH_ATLAS_BUCKETS; i++)
+        atlas->entries[i].codepoint = -1;
+
+    atlas->next_slot = 0;
+    atlas->newest = -1;
+    atlas->oldest = -1;
+
+}
+
+/**
+ * Removes the given slot from the least-recently-used list of the given
+ * atlas. The slot must currently be within the list.
+ *
+ * @param atlas
+ *     The glyph atlas containing the slot.
+ *
+ * @param index
+ *     The index of the slot to remove.
+ */
+static void guac_terminal_glyph_atlas_unlink(guac_terminal_glyph_atlas* atlas,
+        int index) {
+
+    guac_terminal_glyph_atlas_slot* slot = &atlas->slots[index];
+
+    if (slot->newer != -1)
+        atlas->slots[slot->newer].older = slot->older;
+    else
+        atlas->newest = slot->older;
+
+    if (slot->older != -1)
+        atlas->slots[slot->older].newer = slot->newer;
+    else
+        atlas->oldest = slot->newer;
+
+}
+
+/**
+ * Adds the given slot to the least-recently-used list of the given atlas as
+ * the most recently used slot. The slot must not currently be within the
+ * list.
+ *
+ * @param atlas
+ *     The glyph atlas containing the slot.
+ *
+ * @param index
+ *     The index of the slot to add.
+ */
+static void guac_terminal_glyph_atlas_link(guac_terminal_glyph_atlas* atlas,
+        int index) {
+
+    guac_terminal_glyph_atlas_slot* slot = &atlas->slots[index];
+
+    slot->newer = -1;
+    slot->older = atlas->newest;
+
+    if (atlas->newest != -1)
+        atlas->slots[atlas->newest].newer = index;
+    else
+        atlas->oldest = index;
+
+    atlas->newest = index;
+
+}
+
+/**
+ * Removes the given entry from the hash table of the given atlas, shifting
+ * any subsequent entries of the same probe sequence backward such that no
+ * lookup is broken by the resulting gap.
+ *
+ * @param atlas
+ *     The glyph atlas containing the entry.
+ *
+ * @param bucket
+ *     The index of the hash table entry to remove.
+ */
+static void guac_terminal_glyph_atlas_remove(guac_terminal_glyph_atlas* atlas,
+        unsigned int bucket) {
+
+    const unsigned int mask = GUAC_TERMINAL_GLYPH_ATLAS_BUCKETS - 1;
+
+    unsigned int gap = bucket;
+    unsigned int index = bucket;
+
+    atlas->entries[gap].codepoint = -1;
+
+    for (;;) {
+
+        index = (index + 1) & mask;
+
+        guac_terminal_glyph_atlas_entry* entry = &atlas->entries[index];
+        if (entry->codepoint == -1)
+            break;
+
+        /* Move entry into gap only if its probe sequence passes through the
+         * gap (its ideal bucket is not cyclically within (gap, index]) */
+        unsigned int ideal = guac_terminal_glyph_atlas_hash(entry->codepoint,
+                entry->foreground, entry->background);
+        if (((index - ideal) & mask) < ((index - gap) & mask))
+            continue;
+
+        atlas->entries[gap] = *entry;
+        atlas->slots[entry->slot].bucket = gap;
+        entry->codepoint = -1;
+        gap = index;
+
+    }
+
+}
+
+guac_terminal_glyph_atlas* guac_terminal_glyph_atlas_alloc(void) {
+
+    guac_terminal_glyph_atlas* atlas =
+        guac_mem_alloc(sizeof(guac_terminal_glyph_atlas));
+
+    atlas->image = NULL;
+    atlas->stride = 0;
+    atlas->slot_width = 0;
+    atlas->slot_height = 0;
+    guac_terminal_glyph_atlas_clear(atlas);
+
+    return atlas;
+
+}
+
+void guac_terminal_glyph_atlas_free(guac_terminal_glyph_atlas* atlas) {
+    guac_mem_free(atlas->image);
+    guac_mem_free(atlas);
+}
+
+void guac_terminal_glyph_atlas_reset(guac_terminal_glyph_atlas* atlas,
+        int slot_width, int slot_height) {
+
+    /* Resize only if the slot size has actually changed */
+    if (slot_width != atlas->slot_width || slot_height != atlas->slot_height) {
+
+        atlas->slot_width = slot_width;
+        atlas->slot_height = slot_height;
+
+        /* Glyphs are rendered directly into the atlas with Cairo */
+        atlas->stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24,
+                slot_width * GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS);
+
+        guac_mem_free(atlas->image);
+        atlas->image = guac_mem_alloc(atlas->stride,
+                slot_height * GUAC_TERMINAL_GLYPH_ATLAS_ROWS);
+
+    }
+
+    guac_terminal_glyph_atlas_clear(atlas);
+
+}
+
+int guac_terminal_glyph_atlas_find(guac_terminal_glyph_atlas* atlas,
+        int codepoint, uint32_t foreground, uint32_t background) {
+
+    unsigned int index = guac_terminal_glyph_atlas_hash(codepoint,
+            foreground, background);
+
+    /* Probe until the glyph or an unused entry is found */
+    for (;;) {
+
+        guac_terminal_glyph_atlas_entry* entry = &atlas->entries[index];
+
+        if (entry->codepoint == -1)
+            return -1;
+
+        /* Mark glyph as most recently used */
+        if (entry->codepoint == codepoint
+                && entry->foreground == foreground
+                && entry->background == background) {
+            guac_terminal_glyph_atlas_unlink(atlas, entry->slot);
+            guac_terminal_glyph_atlas_link(atlas, entry->slot);
+            return entry->slot;
+        }
+
+        index = (index + 1) & (GUAC_TERMINAL_GLYPH_ATLAS_BUCKETS - 1);
+
+    }
+
+}
+
+int guac_terminal_glyph_atlas_insert(guac_terminal_glyph_atlas* atlas,
+        int codepoint, uint32_t foreground, uint32_t background) {
+
+    int slot;
+
+    /* Use a never-used slot while any remain */
+    if (atlas->next_slot < GUAC_TERMINAL_GLYPH_ATLAS_SLOTS)
+        slot = atlas->next_slot++;
+
+    /* Otherwise, evict the least-recently-used glyph */
+    else {
+        slot = atlas->oldest;
+        guac_terminal_glyph_atlas_unlink(atlas, slot);
+        guac_terminal_glyph_atlas_remove(atlas, atlas->slots[slot].bucket);
+    }
+
+    unsigned int index = guac_terminal_glyph_atlas_hash(codepoint,
+            foreground, background);
+
+    /* Find first unused entry (one must exist, as there are more buckets
+     * than slots) */
+    while (atlas->entries[index].codepoint != -1)
+        index = (index + 1) & (GUAC_TERMINAL_GLYPH_ATLAS_BUCKETS - 1);
+
+    guac_terminal_glyph_atlas_entry* entry = &atlas->entries[index];
+    entry->codepoint = codepoint;
+    entry->foreground = foreground;
+    entry->background = background;
+    entry->slot = slot;
+
+    atlas->slots[slot].bucket = index;
+    guac_terminal_glyph_atlas_link(atlas, slot);
+
+    return slot;
+
+}
+
+int guac_terminal_glyph_atlas_slot_x(guac_terminal_glyph_atlas* atlas,
+        int slot) {
+    return (slot % GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS) * atlas->slot_width;
+}
+
+int guac_terminal_glyph_atlas_slot_y(guac_terminal_glyph_atlas* atlas,
+        int slot) {
+    return (slot / GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS) * atlas->slot_height;
+}
+
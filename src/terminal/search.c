@@ -0,0 +1,591 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "terminal/buffer.h"
+#include "terminal/search.h"
+#include "terminal/select.h"
+#include "terminal/terminal.h"
+#include "terminal/terminal-priv.h"
+#include "terminal/types.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/unicode.h>
+#include <guacamole/user.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * The maximum number of codepoints within a guac_terminal_search_text: an
+ * entire row, plus enough codepoints from the rows it wraps onto to contain
+ * the remainder of any match starting within that row.
+ */
+#define GUAC_TERMINAL_SEARCH_TEXT_LENGTH \
+    (GUAC_TERMINAL_MAX_COLUMNS + GUAC_TERMINAL_SEARCH_MAX_LENGTH)
+
+/**
+ * The maximum number of bytes of UTF-8 accepted within a single blob of a
+ * search stream.
+ */
+#define GUAC_TERMINAL_SEARCH_MAX_BYTES (GUAC_TERMINAL_SEARCH_MAX_LENGTH * 4)
+
+/**
+ * The text of a single row of the terminal, prepared for comparison against
+ * a search query.
+ */
+typedef struct guac_terminal_search_text {
+
+    /**
+     * The codepoints of the row, followed by the codepoints of any rows that
+     * the row wraps onto. Blank cells are represented as spaces, and the
+     * additional columns of multi-column characters are omitted.
+     */
+    int codepoints[GUAC_TERMINAL_SEARCH_TEXT_LENGTH];
+
+    /**
+     * The row containing each codepoint.
+     */
+    int rows[GUAC_TERMINAL_SEARCH_TEXT_LENGTH];
+
+    /**
+     * The column containing each codepoint.
+     */
+    int columns[GUAC_TERMINAL_SEARCH_TEXT_LENGTH];
+
+    /**
+     * The number of codepoints from the row itself. Only matches starting
+     * within these codepoints are considered matches within the row.
+     */
+    int row_length;
+
+    /**
+     * The total number of codepoints, including those from rows that the row
+     * wraps onto.
+     */
+    int length;
+
+} guac_terminal_search_text;
+
+/**
+ * Returns the given codepoint as it should be compared during a search. If
+ * case is being ignored, uppercase ASCII letters are converted to lowercase.
+ *
+ * @param codepoint
+ *     The codepoint to convert.
+ *
+ * @param ignore_case
+ *     Whether the search ignores case.
+ *
+ * @return
+ *     The codepoint to compare.
+ */
+static int guac_terminal_search_fold(int codepoint, bool ignore_case) {
+
+    if (ignore_case && codepoint >= 'A' && codepoint <= 'Z')
+        return codepoint - 'A' + 'a';
+
+    return codepoint;
+
+}
+
+/**
+ * Appends the codepoints of the given row to the given search text.
+ *
+ * @param terminal
+ *     The terminal containing the row.
+ *
+ * @param text
+ *     The search text to append to.
+ *
+ * @param row
+ *     The row to read.
+ *
+ * @param limit
+ *     The maximum number of codepoints to append.
+ *
+ * @return
+ *     Whether the row was automatically wrapped onto the following row.
+ */
+static bool guac_terminal_search_append_row(guac_terminal* terminal,
+        guac_terminal_search_text* text, int row, int limit) {
+
+    int values[GUAC_TERMINAL_MAX_COLUMNS];
+    bool wrapped = false;
+
+    /* Read without restoring compressed or spilled rows */
+    int length = guac_terminal_buffer_get_values(terminal->current_buffer,
+            row, values, GUAC_TERMINAL_MAX_COLUMNS, &wrapped);
+
+    for (int column = 0; column < length && limit > 0; column++) {
+
+        int codepoint = values[column];
+        if (codepoint == GUAC_CHAR_CONTINUATION)
+            continue;
+
+        /* Blank cells match spaces */
+        if (codepoint == 0)
+            codepoint = GUAC_CHAR_SPACE;
+
+        text->codepoints[text->length] = guac_terminal_search_fold(codepoint,
+                terminal->search_ignore_case);
+        text->rows[text->length] = row;
+        text->columns[text->length] = column;
+        text->length++;
+        limit--;
+
+    }
+
+    return wrapped;
+
+}
+
+/**
+ * Reads the given row into the given search text, along with as much of
+ * the rows it wraps onto as could be part of a match starting within the
+ * row.
+ *
+ * @param terminal
+ *     The terminal containing the row.
+ *
+ * @param text
+ *     The search text to populate.
+ *
+ * @param row
+ *     The row to read.
+ *
+ * @param last_row
+ *     The last row of the terminal that may be read.
+ */
+static void guac_terminal_search_read(guac_terminal* terminal,
+        guac_terminal_search_text* text, int row, int last_row) {
+
+    text->length = 0;
+    bool wrapped = guac_terminal_search_append_row(terminal, text, row,
+            GUAC_TERMINAL_MAX_COLUMNS);
+    text->row_length = text->length;
+
+    /* Include enough of any continuation of the row to contain a match
+     * which starts at its final codepoint */
+    int remaining = terminal->search_length - 1;
+    while (wrapped && row < last_row && remaining > 0) {
+        int length = text->length;
+        wrapped = guac_terminal_search_append_row(terminal, text, ++row, remaining);
+        remaining -= text->length - length;
+    }
+
+}
+
+/**
+ * Locates a match for the current search query that starts within the row
+ * read into the given search text, considering only matches starting at the
+ * given range of columns.
+ *
+ * @param terminal
+ *     The terminal being searched.
+ *
+ * @param text
+ *     The search text of the row to search.
+ *
+ * @param min_column
+ *     The first column at which a match may start, inclusive.
+ *
+ * @param max_column
+ *     The last column at which a match may start, inclusive.
+ *
+ * @param backward
+ *     true if the last match within the range should be returned, false if
+ *     the first match should be returned.
+ *
+ * @return
+ *     The index of the first codepoint of the match within the search text,
+ *     or -1 if there is no such match.
+ */
+static int guac_terminal_search_row(guac_terminal* terminal,
+        const guac_terminal_search_text* text, int min_column, int max_column,
+        bool backward) {
+
+    const int* query = terminal->search_query;
+    int length = terminal->search_length;
+
+    int last = text->length - length;
+    if (last >= text->row_length)
+        last = text->row_length - 1;
+
+    int match = -1;
+    for (int i = 0; i <= last; i++) {
+
+        /* Test only the first codepoint until a candidate is found */
+        if (text->codepoints[i] != query[0])
+            continue;
+
+        int column = text->columns[i];
+        if (column < min_column)
+            continue;
+
+        if (column > max_column)
+            break;
+
+        if (memcmp(&text->codepoints[i + 1], &query[1],
+                    (length - 1) * sizeof(int)) != 0)
+            continue;
+
+        match = i;
+        if (!backward)
+            break;
+
+    }
+
+    return match;
+
+}
+
+/**
+ * Scrolls the display of the given terminal, if necessary, such that the
+ * given range of rows is visible, centering those rows within the display
+ * if scrolling is required.
+ *
+ * @param terminal
+ *     The terminal to scroll.
+ *
+ * @param start_row
+ *     The first row that should be visible.
+ *
+ * @param end_row
+ *     The last row that should be visible.
+ */
+static void guac_terminal_search_reveal(guac_terminal* terminal,
+        int start_row, int end_row) {
+
+    int top = -terminal->scroll_offset;
+    int bottom = top + terminal->term_height - 1;
+
+    if (start_row >= top && end_row <= bottom)
+        return;
+
+    int scroll_offset = terminal->term_height / 2 - start_row;
+    if (scroll_offset > terminal->scroll_offset)
+        guac_terminal_scroll_display_up(terminal,
+                scroll_offset - terminal->scroll_offset);
+    else
+        guac_terminal_scroll_display_down(terminal,
+                terminal->scroll_offset - scroll_offset);
+
+}
+
+/**
+ * Searches for the current search query, starting at the current search
+ * position and proceeding in the given direction. If a match is found, the
+ * search position is updated, the match is highlighted, and the display is
+ * scrolled to reveal the match.
+ *
+ * @param terminal
+ *     The terminal to search.
+ *
+ * @param backward
+ *     true if the search should proceed toward older rows (upward), false if
+ *     the search should proceed toward newer rows (downward).
+ *
+ * @param inclusive
+ *     Whether a match starting exactly at the current search position should
+ *     be considered.
+ *
+ * @return
+ *     true if a match was found, false otherwise.
+ */
+static bool guac_terminal_search_find(guac_terminal* terminal,
+        bool backward, bool inclusive) {
+
+    int first_row = -guac_terminal_get_available_scroll(terminal);
+    int last_row = terminal->term_height - 1;
+
+    int row = terminal->search_row;
+    int column = terminal->search_column;
+
+    /* The search position may refer to rows that have since left the
+     * scrollback */
+    if (row < first_row) {
+        if (backward)
+            return false;
+        row = first_row;
+        column = 0;
+        inclusive = true;
+    }
+
+    else if (row > last_row) {
+        if (!backward)
+            return false;
+        row = last_row;
+        column = GUAC_TERMINAL_MAX_COLUMNS;
+        inclusive = true;
+    }
+
+    guac_terminal_search_text* text = guac_mem_alloc(sizeof(guac_terminal_search_text));
+
+    int match = -1;
+    for (; row >= first_row && row <= last_row; row += backward ? -1 : 1) {
+
+        guac_terminal_search_read(terminal, text, row, last_row);
+
+        /* Only the row containing the search position is restricted by
+         * column */
+        int min_column = 0;
+        int max_column = GUAC_TERMINAL_MAX_COLUMNS;
+        if (row == terminal->search_row) {
+            if (backward)
+                max_column = inclusive ? column : column - 1;
+            else
+                min_column = inclusive ? column : column + 1;
+        }
+
+        match = guac_terminal_search_row(terminal, text, min_column,
+                max_column, backward);
+        if (match >= 0)
+            break;
+
+    }
+
+    if (match >= 0) {
+
+        int start_row = text->rows[match];
+        int start_column = text->columns[match];
+        int end_row = text->rows[match + terminal->search_length - 1];
+        int end_column = text->columns[match + terminal->search_length - 1];
+
+        terminal->search_row = start_row;
+        terminal->search_column = start_column;
+        terminal->search_matched = true;
+
+        guac_terminal_select_range(terminal, start_row, start_column,
+                end_row, end_column);
+        guac_terminal_search_reveal(terminal, start_row, end_row);
+
+    }
+
+    guac_mem_free(text);
+    return match >= 0;
+
+}
+
+/**
+ * Decodes the given UTF-8 search query into the codepoints that should be
+ * compared against the terminal contents, determining whether case should be
+ * ignored. Case is ignored unless the query contains uppercase characters.
+ *
+ * @param query
+ *     The query to decode, as a null-terminated UTF-8 string.
+ *
+ * @param codepoints
+ *     An array of at least GUAC_TERMINAL_SEARCH_MAX_LENGTH integers which
+ *     should receive the decoded codepoints. Text beyond
+ *     GUAC_TERMINAL_SEARCH_MAX_LENGTH codepoints is ignored.
+ *
+ * @param ignore_case
+ *     Pointer to a bool which should receive whether the search should
+ *     ignore case.
+ *
+ * @return
+ *     The number of codepoints decoded.
+ */
+static int guac_terminal_search_decode(const char* query, int* codepoints,
+        bool* ignore_case) {
+
+    int length = 0;
+    int remaining = strlen(query);
+    *ignore_case = true;
+
+    while (remaining > 0 && length < GUAC_TERMINAL_SEARCH_MAX_LENGTH) {
+
+        int codepoint;
+        int bytes = guac_utf8_read(query, remaining, &codepoint);
+        if (bytes == 0)
+            break;
+
+        /* Match case only if the query itself contains uppercase */
+        if (codepoint >= 'A' && codepoint <= 'Z')
+            *ignore_case = false;
+
+        codepoints[length++] = codepoint;
+        query += bytes;
+        remaining -= bytes;
+
+    }
+
+    for (int i = 0; i < length; i++)
+        codepoints[i] = guac_terminal_search_fold(codepoints[i], *ignore_case);
+
+    return length;
+
+}
+
+bool guac_terminal_search(guac_terminal* terminal, const char* query,
+        bool backward) {
+
+    bool ignore_case;
+    int codepoints[GUAC_TERMINAL_SEARCH_MAX_LENGTH];
+    int length = guac_terminal_search_decode(query, codepoints, &ignore_case);
+
+    /* An empty query ends the search, clearing any highlighted match */
+    if (length == 0) {
+        if (terminal->search_matched) {
+            terminal->text_selected = false;
+            terminal->selection_committed = false;
+            guac_terminal_notify(terminal);
+        }
+        guac_terminal_search_end(terminal);
+        return false;
+    }
+
+    /* Begin at the bottom of the terminal (or, if searching downward, the
+     * oldest row) if no search is yet in progress. Otherwise, continue from
+     * the current search position. */
+    if (terminal->search_length == 0) {
+        if (backward) {
+            terminal->search_row = terminal->term_height - 1;
+            terminal->search_column = GUAC_TERMINAL_MAX_COLUMNS;
+        }
+        else {
+            terminal->search_row = -guac_terminal_get_available_scroll(terminal);
+            terminal->search_column = 0;
+        }
+    }
+
+    memcpy(terminal->search_query, codepoints, length * sizeof(int));
+    terminal->search_length = length;
+    terminal->search_ignore_case = ignore_case;
+
+    if (guac_terminal_search_find(terminal, backward, true))
+        return true;
+
+    /* Clear the highlight of any previous match that no longer matches the
+     * query, retaining the search position in case the query is corrected */
+    if (terminal->search_matched) {
+        terminal->search_matched = false;
+        terminal->text_selected = false;
+        terminal->selection_committed = false;
+        guac_terminal_notify(terminal);
+    }
+
+    return false;
+
+}
+
+bool guac_terminal_search_next(guac_terminal* terminal, bool backward) {
+
+    if (terminal->search_length == 0)
+        return false;
+
+    return guac_terminal_search_find(terminal, backward, false);
+
+}
+
+void guac_terminal_search_end(guac_terminal* terminal) {
+    terminal->search_length = 0;
+    terminal->search_matched = false;
+}
+
+/**
+ * Handler for "blob" instructions which searches the terminal for the text
+ * contained within each received blob. If the text is identical to the
+ * query of the search already in progress, the search advances to the next
+ * older match. Otherwise, the received text replaces the current query and
+ * the search continues from the current match, allowing queries to be
+ * refined as they are typed.
+ *
+ * @see guac_user_blob_handler
+ */
+static int guac_terminal_search_stream_blob_handler(guac_user* user,
+        guac_stream* stream, void* data, int length) {
+
+    guac_terminal* term = (guac_terminal*) stream->data;
+
+    if (length > GUAC_TERMINAL_SEARCH_MAX_BYTES) {
+        guac_protocol_send_ack(user->socket, stream, "Search query too long.",
+                GUAC_PROTOCOL_STATUS_CLIENT_OVERRUN);
+        guac_socket_flush(user->socket);
+        return 0;
+    }
+
+    char query[GUAC_TERMINAL_SEARCH_MAX_BYTES + 1];
+    memcpy(query, data, length);
+    query[length] = '\0';
+
+    guac_terminal_lock(term);
+
+    /* Advance to the next match only if the query is unchanged */
+    bool ignore_case;
+    int codepoints[GUAC_TERMINAL_SEARCH_MAX_LENGTH];
+    int query_length = guac_terminal_search_decode(query, codepoints, &ignore_case);
+    bool unchanged = term->search_length > 0
+        && query_length == term->search_length
+        && ignore_case == term->search_ignore_case
+        && memcmp(codepoints, term->search_query, query_length * sizeof(int)) == 0;
+
+    bool found;
+    if (unchanged)
+        found = guac_terminal_search_next(term, true);
+    else
+        found = guac_terminal_search(term, query, true);
+
+    guac_terminal_unlock(term);
+
+    guac_protocol_send_ack(user->socket, stream,
+            found ? "Match found." : "No match found.",
+            GUAC_PROTOCOL_STATUS_SUCCESS);
+
+    guac_socket_flush(user->socket);
+    return 0;
+
+}
+
+/**
+ * Handler for "end" instructions which ends the search associated with the
+ * given stream, leaving the current match (if any) highlighted.
+ *
+ * @see guac_user_end_handler
+ */
+static int guac_terminal_search_stream_end_handler(guac_user* user,
+        guac_stream* stream) {
+
+    guac_terminal* term = (guac_terminal*) stream->data;
+
+    guac_terminal_lock(term);
+    guac_terminal_search_end(term);
+    guac_terminal_unlock(term);
+
+    return 0;
+
+}
+
+int guac_terminal_search_stream(guac_terminal* term, guac_user* user,
+        guac_stream* stream) {
+
+    stream->blob_handler = guac_terminal_search_stream_blob_handler;
+    stream->end_handler = guac_terminal_search_stream_end_handler;
+    stream->data = term;
+
+    guac_protocol_send_ack(user->socket, stream, "Ready to search.",
+            GUAC_PROTOCOL_STATUS_SUCCESS);
+
+    guac_socket_flush(user->socket);
+    return 0;
+
+}
+
@@ -231,6 +231,110 @@ void guac_terminal_select_resume(guac_terminal* terminal,
 
 }
 
+void guac_terminal_select_range(guac_terminal* terminal,
+        int start_row, int start_column, int end_row, int end_column) {
+
+    guac_terminal_selection_point_init(&terminal->selection_start,
+        terminal, start_row, start_column, GUAC_TERMINAL_COLUMN_SIDE_LEFT);
+    guac_terminal_selection_point_init(&terminal->selection_end,
+        terminal, end_row, end_column, GUAC_TERMINAL_COLUMN_SIDE_RIGHT);
+
+    /* Expand range to fully contain any multi-column characters at either
+     * end */
+    const guac_terminal_selection_point* start = &terminal->selection_start;
+    const guac_terminal_selection_point* end = &terminal->selection_end;
+    terminal->selection_start_row = start_row;
+    terminal->selection_start_column = start->char_starting_column;
+    terminal->selection_end_row = end_row;
+    terminal->selection_end_column = end->char_starting_column + end->char_width - 1;
+
+    /* The highlighted range is complete, and is cleared as soon as any of
+     * its characters are modified */
+    terminal->text_selected = true;
+    terminal->selection_committed = true;
+    guac_terminal_notify(terminal);
+
+}
+
+/**
+ * The state of text being copied from the terminal into its clipboard. Copied
+ * text is encoded as UTF-8 into an intermediate buffer, which is appended to
+ * the clipboard only when full, such that copying large selections does not
+ * require appending to the clipboard (and acquiring its lock) for each row.
+ */
+typedef struct guac_terminal_clipboard_writer {
+
+    /**
+     * The terminal whose clipboard is receiving the copied text.
+     */
+    guac_terminal* terminal;
+
+    /**
+     * UTF-8 text that has been copied but not yet appended to the
+     * clipboard.
+     */
+    char buffer[GUAC_COMMON_CLIPBOARD_BLOCK_SIZE];
+
+    /**
+     * The number of bytes of text within the buffer.
+     */
+    int length;
+
+    /**
+     * Whether the clipboard has been filled, such that any further text
+     * cannot be copied.
+     */
+    bool truncated;
+
+} guac_terminal_clipboard_writer;
+
+/**
+ * Appends all text within the buffer of the given clipboard writer to the
+ * clipboard, emptying the buffer.
+ *
+ * @param writer
+ *     The clipboard writer to flush.
+ */
+static void guac_terminal_clipboard_flush(guac_terminal_clipboard_writer* writer) {
+
+    int appended = guac_common_clipboard_append(writer->terminal->clipboard,
+            writer->buffer, writer->length);
+
+    if (appended < writer->length)
+        writer->truncated = true;
+
+    writer->length = 0;
+
+}
+
+/**
+ * Appends the UTF-8 encoding of the given codepoint to the buffer of the given
+ * clipboard writer, flushing the buffer first if it may lack space.
+ *
+ * @param writer
+ *     The clipboard writer to append to.
+ *
+ * @param codepoint
+ *     The codepoint to append.
+ */
+static void guac_terminal_clipboard_write(guac_terminal_clipboard_writer* writer,
+        int codepoint) {
+
+    /* Ensure there is room for the longest possible UTF-8 sequence */
+    if (writer->length > (int) sizeof(writer->buffer) - 4)
+        guac_terminal_clipboard_flush(writer);
+
+    /* ASCII maps directly to a single byte */
+    if (codepoint < 0x80)
+        writer->buffer[writer->length++] = (char) codepoint;
+
+    else
+        writer->length += guac_utf8_write(codepoint,
+                writer->buffer + writer->length,
+                sizeof(writer->buffer) - writer->length);
+
+}
+
 /**
  * Appends the text within the given array of terminal characters to the
  * clipboard. The provided coordinates are considered inclusively (the
@@ -238,9 +342,8 @@ void guac_terminal_select_resume(guac_terminal* terminal,
  * out-of-bounds coordinates will be automatically clipped within the bounds of
  * the given array.
  *
- * @param terminal
- *     The guac_terminal instance associated with the buffer containing the
- *     text being copied and the clipboard receiving the copied text.
+ * @param writer
+ *     The clipboard writer receiving the copied text.
  *
  * @param characters
  *     The array of characters copied into the clipboard.
@@ -258,10 +361,10 @@ void guac_terminal_select_resume(guac_terminal* terminal,
  *     clipboard associated with the given terminal, where 0 is the first
  *     (left-most) column within the row.
  */
-static void guac_terminal_clipboard_append_characters(guac_terminal* terminal,
-        guac_terminal_char* characters, unsigned int length, int start, int end) {
+static void guac_terminal_clipboard_append_characters(
+        guac_terminal_clipboard_writer* writer, guac_terminal_char* characters,
+        unsigned int length, int start, int end) {
 
-    char buffer[1024];
     int eol;
 
     /* If selection is entirely outside the bounds of the row, then there is
@@ -279,38 +382,19 @@ static void guac_terminal_clipboard_append_characters(guac_terminal* terminal,
             break;
     }
 
-    /* Repeatedly convert chunks of terminal buffer rows until entire specified
-     * region has been appended to clipboard */
-    for (int i = start; i <= end;) {
-
-        int remaining = sizeof(buffer);
-        char* current = buffer;
+    for (int i = start; i <= end; i++) {
 
-        /* Convert as many codepoints within the given range as possible */
-        for (; i <= end; i++) {
+        int codepoint = characters[i].value;
 
-            int codepoint = characters[i].value;
+        /* Fill empty with spaces if not at end of line */
+        if (codepoint == 0 && i < eol)
+            codepoint = GUAC_CHAR_SPACE;
 
-            /* Fill empty with spaces if not at end of line */
-            if (codepoint == 0 && i < eol)
-                codepoint = GUAC_CHAR_SPACE;
+        /* Ignore null (blank) characters */
+        if (codepoint == 0 || codepoint == GUAC_CHAR_CONTINUATION)
+            continue;
 
-            /* Ignore null (blank) characters */
-            if (codepoint == 0 || codepoint == GUAC_CHAR_CONTINUATION)
-                continue;
-
-            /* Encode current codepoint as UTF-8 */
-            int bytes = guac_utf8_write(codepoint, current, remaining);
-            if (bytes == 0)
-                break;
-
-            current += bytes;
-            remaining -= bytes;
-
-        }
-
-        /* Append converted buffer to clipboard */
-        guac_common_clipboard_append(terminal->clipboard, buffer, current - buffer);
+        guac_terminal_clipboard_write(writer, codepoint);
 
     }
 
@@ -336,26 +420,45 @@ void guac_terminal_select_end(guac_terminal* terminal) {
     int end_row = terminal->selection_end_row;
     int end_col = terminal->selection_end_column;
 
+    guac_terminal_clipboard_writer writer = {
+        .terminal = terminal,
+        .length = 0,
+        .truncated = false
+    };
+
     guac_terminal_char* characters;
     bool last_row_was_wrapped = true;
 
-    for (int row = start_row; row <= end_row; row++) {
+    /* Stop copying once the clipboard is full, as nothing further could be
+     * stored */
+    for (int row = start_row; row <= end_row && !writer.truncated; row++) {
 
         /* Add a newline only if the previous line was not wrapped */
         if (!last_row_was_wrapped)
-            guac_common_clipboard_append(terminal->clipboard, "\n", 1);
+            guac_terminal_clipboard_write(&writer, '\n');
 
         /* Append next row from desired region, adjusting the start/end column
          * to account for selections that start or end in the middle of a row.
          * With the exception of the start and end rows, all other rows are
          * copied in their entirety. */
         int length = guac_terminal_buffer_get_columns(terminal->current_buffer, &characters, &last_row_was_wrapped, row);
-        guac_terminal_clipboard_append_characters(terminal, characters, length,
+        guac_terminal_clipboard_append_characters(&writer, characters, length,
             (row == start_row) ? start_col : 0,
             (row == end_row)   ? end_col   : length - 1);
 
     }
 
+    /* Append any remaining text */
+    if (!writer.truncated)
+        guac_terminal_clipboard_flush(&writer);
+
+    if (writer.truncated)
+        guac_client_log(client, GUAC_LOG_WARNING, "Selected text exceeds "
+                "the maximum clipboard size of %i bytes and has been "
+                "truncated. The clipboard size may be increased with the "
+                "\"clipboard-buffer-size\" parameter.",
+                terminal->clipboard->available);
+
     /* Broadcast copied data to all connected users only if allowed */
     if (!terminal->disable_copy) {
         guac_common_clipboard_send(terminal->clipboard, client);
@@ -33,7 +33,9 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wchar.h>
 
 /**
@@ -233,13 +235,129 @@ static void guac_terminal_move_cursor(guac_terminal* term, int row, int col) {
 
 }
 
+/**
+ * The number of bytes remaining in the UTF-8 sequence currently being decoded
+ * by guac_terminal_echo().
+ */
+static int bytes_remaining = 0;
+
+/**
+ * The codepoint currently being decoded by guac_terminal_echo(), or the most
+ * recently decoded codepoint if no UTF-8 sequence is in progress.
+ */
+static int codepoint = 0;
+
+/**
+ * Mask which, when applied to eight bytes read as a single 64-bit integer,
+ * selects the high bit of each byte.
+ */
+#define GUAC_TERMINAL_WORD_HIGH_BITS 0x8080808080808080ULL
+
+/**
+ * Value which, when multiplied by a single byte value, repeats that value
+ * across all eight bytes of a 64-bit integer.
+ */
+#define GUAC_TERMINAL_WORD_ONES 0x0101010101010101ULL
+
+/**
+ * Returns the number of leading bytes within the given buffer which are
+ * printable ASCII characters (0x20 through 0x7E inclusive). Eight bytes are
+ * classified at a time where possible.
+ *
+ * @param buffer
+ *     The buffer to test.
+ *
+ * @param length
+ *     The number of bytes within the buffer.
+ *
+ * @return
+ *     The number of leading printable ASCII bytes within the buffer.
+ */
+static int guac_terminal_printable_span(const char* buffer, int length) {
+
+    int span = 0;
+
+    /* Test eight bytes at a time while possible */
+    while (length - span >= (int) sizeof(uint64_t)) {
+
+        uint64_t word;
+        memcpy(&word, buffer + span, sizeof(word));
+
+        /* The high bit of at least one byte will be set by the subtraction
+         * if any byte is less than 0x20 (and not itself at least 0x80) */
+        uint64_t below = (word - GUAC_TERMINAL_WORD_ONES * 0x20) & ~word;
+
+        /* The high bit of at least one byte will be set by the addition (or
+         * already be set) if any byte is at least 0x7F */
+        uint64_t above = (word + GUAC_TERMINAL_WORD_ONES * 0x01) | word;
+
+        if ((below | above) & GUAC_TERMINAL_WORD_HIGH_BITS)
+            break;
+
+        span += sizeof(word);
+
+    }
+
+    /* Locate the exact end of the span byte by byte */
+    while (span < length && buffer[span] >= 0x20 && buffer[span] < 0x7F)
+        span++;
+
+    return span;
+
+}
+
+int guac_terminal_echo_ascii(guac_terminal* term, const char* buffer,
+        int length) {
+
+    /* Printable ASCII can be written in bulk only if it would be written
+     * verbatim, one column per character */
+    if (term->pipe_stream != NULL || term->insert_mode
+            || term->char_mapping[term->active_char_set] != NULL)
+        return 0;
+
+    int span = guac_terminal_printable_span(buffer, length);
+    if (span == 0)
+        return 0;
+
+    int remaining = span;
+    while (remaining > 0) {
+
+        /* Wrap if necessary */
+        if (term->cursor_col >= term->term_width) {
+
+            /* New line */
+            term->cursor_col = 0;
+            guac_terminal_linefeed(term, true);
+        }
+
+        /* Write as much of the span as fits within the current row */
+        int run = term->term_width - term->cursor_col;
+        if (run > remaining)
+            run = remaining;
+
+        guac_terminal_set_ascii(term, term->cursor_row, term->cursor_col,
+                buffer, run);
+
+        /* Advance cursor */
+        term->cursor_col += run;
+        buffer += run;
+        remaining -= run;
+
+    }
+
+    /* Leave decoder in the same state as if each character had been echoed
+     * individually */
+    codepoint = (unsigned char) buffer[-1];
+    bytes_remaining = 0;
+
+    return span;
+
+}
+
 int guac_terminal_echo(guac_terminal* term, unsigned char c) {
 
     int width;
 
-    static int bytes_remaining = 0;
-    static int codepoint = 0;
-
     const int* char_mapping = term->char_mapping[term->active_char_set];
 
     /* Echo to pipe stream if open and not starting an ESC sequence */
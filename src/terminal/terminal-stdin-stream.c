@@ -36,11 +36,17 @@ static int guac_terminal_input_stream_blob_handler(guac_user* user,
 
     guac_terminal* term = (guac_terminal*) stream->data;
 
-    /* Attempt to write received data */
     guac_terminal_lock(term);
-    int result = guac_terminal_write_all(term->stdin_pipe_fd[1], data, length);
+    int fd = term->stdin_pipe_fd[1];
     guac_terminal_unlock(term);
 
+    /* Attempt to write received data. The terminal is not kept locked while
+     * writing, as the write blocks until the connection has accepted enough
+     * prior input, and terminal output must continue to be handled
+     * meanwhile. Acknowledgement is likewise delayed, throttling the sender
+     * to the rate at which input is actually accepted. */
+    int result = guac_terminal_write_all(fd, data, length);
+
     /* Acknowledge receipt of data and result of write attempt */
     if (result <= 0) {
 
@@ -18,7 +18,6 @@
  */
 
 #include "common/clipboard.h"
-#include "common/cursor.h"
 #include "common/iconv.h"
 #include "terminal/buffer.h"
 #include "terminal/color-scheme.h"
@@ -44,10 +43,12 @@
 #include <wchar.h>
 
 #include <guacamole/client.h>
+#include <guacamole/display.h>
 #include <guacamole/error.h>
 #include <guacamole/flag.h>
 #include <guacamole/mem.h>
 #include <guacamole/protocol.h>
+#include <guacamole/rect.h>
 #include <guacamole/socket.h>
 #include <guacamole/string.h>
 #include <guacamole/timestamp.h>
@@ -59,8 +60,11 @@
 static void __guac_terminal_set_columns(guac_terminal* terminal, int row,
         int start_column, int end_column, guac_terminal_char* character) {
 
-    guac_terminal_display_set_columns(terminal->display, row + terminal->scroll_offset,
-            start_column, end_column, character);
+    /* Display will be redrawn from buffer if flooding */
+    if (!terminal->flooding)
+        guac_terminal_display_set_columns(terminal->display,
+                row + terminal->scroll_offset, start_column, end_column,
+                character);
 
     guac_terminal_buffer_set_columns(terminal->current_buffer, row,
             start_column, end_column, character);
@@ -142,6 +146,8 @@ void guac_terminal_reset(guac_terminal* term) {
     /* Reset flags */
     term->text_selected = false;
     term->selection_committed = false;
+    term->search_length = 0;
+    term->search_matched = false;
     term->application_cursor_keys = false;
     term->automatic_carriage_return = false;
     term->insert_mode = false;
@@ -172,28 +178,38 @@ void guac_terminal_reset(guac_terminal* term) {
  *
  * @param terminal
  *     The terminal whose background should be painted or repainted.
- *
- * @param socket
- *     The socket over which instructions required to paint / repaint the
- *     terminal background should be send.
  */
-static void guac_terminal_repaint_default_layer(guac_terminal* terminal,
-        guac_socket* socket) {
+static void guac_terminal_repaint_default_layer(guac_terminal* terminal) {
 
     int width = terminal->width;
     int height = terminal->height;
     guac_terminal_display* display = terminal->display;
 
+    guac_display_layer* default_layer =
+        guac_display_default_layer(terminal->graphical_display);
+
     /* Get background color */
     const guac_terminal_color* color = &display->default_background;
+    uint32_t background = 0xFF000000
+                        | (color->red   << 16)
+                        | (color->green << 8)
+                        |  color->blue;
 
     /* Reset size */
-    guac_protocol_send_size(socket, GUAC_DEFAULT_LAYER, width, height);
+    guac_display_layer_resize(default_layer, width, height);
 
     /* Paint background color */
-    guac_protocol_send_rect(socket, GUAC_DEFAULT_LAYER, 0, 0, width, height);
-    guac_protocol_send_cfill(socket, GUAC_COMP_OVER, GUAC_DEFAULT_LAYER,
-            color->red, color->green, color->blue, 0xFF);
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_raw(default_layer);
+
+    guac_rect dst;
+    guac_rect_init(&dst, 0, 0, width, height);
+    guac_rect_constrain(&dst, &context->bounds);
+
+    if (!guac_rect_is_empty(&dst))
+        guac_display_layer_raw_context_set(context, &dst, background);
+
+    guac_display_layer_close_raw(default_layer, context);
 
 }
 
@@ -220,9 +236,8 @@ void* guac_terminal_thread(void* data) {
         if (guac_terminal_render_frame(terminal))
             break;
 
-        /* Signal end of frame */
-        guac_client_end_frame(client);
-        guac_socket_flush(client->socket);
+        /* Signal end of frame, sending only what has actually changed */
+        guac_display_end_frame(terminal->graphical_display);
 
     }
 
@@ -386,6 +401,11 @@ guac_terminal* guac_terminal_create(guac_client* client,
     /* Init modified flag and conditional */
     guac_flag_init(&term->modified);
 
+    /* Output is not initially flooding */
+    term->unflushed_output = 0;
+    term->flooding = false;
+    term->last_key_timestamp = 0;
+
     /* Maximum and requested scrollback are initially the same */
     term->max_scrollback = options->max_scrollback;
     term->requested_scrollback = options->max_scrollback;
@@ -399,10 +419,15 @@ guac_terminal* guac_terminal_create(guac_client* client,
     /* Init current and alternate buffer */
     term->current_buffer = term->normal_buffer = guac_terminal_buffer_alloc(initial_scrollback, &default_char);
     term->alternate_buffer = guac_terminal_buffer_alloc(GUAC_TERMINAL_MAX_ROWS, &default_char);
+    term->accounted_memory = 0;
+
+    /* Init underlying graphical display, through which all rendering is
+     * performed */
+    term->graphical_display = guac_display_alloc(client);
 
     /* Init display */
     term->display = guac_terminal_display_alloc(client,
-            options->font_name, options->font_size, options->dpi,
+            term->graphical_display, options->font_name, options->font_size, options->dpi,
             &default_char.attributes.foreground,
             &default_char.attributes.background,
             (guac_terminal_color(*)[256]) default_palette);
@@ -410,17 +435,16 @@ guac_terminal* guac_terminal_create(guac_client* client,
     /* Fail if display init failed */
     if (term->display == NULL) {
         guac_client_log(client, GUAC_LOG_DEBUG, "Display initialization failed");
+        guac_display_free(term->graphical_display);
         guac_mem_free(term);
         return NULL;
     }
 
-    /* Init common cursor */
-    term->cursor = guac_common_cursor_alloc(client);
-
     /* Init terminal state */
     term->current_attributes = default_char.attributes;
     term->default_char = default_char;
-    term->clipboard = guac_common_clipboard_alloc(options->clipboard_buffer_size);
+    term->clipboard = guac_common_clipboard_alloc(client,
+            options->clipboard_buffer_size);
     term->disable_copy = options->disable_copy;
 
     /* Calculate available text display area by character size */
@@ -466,12 +490,14 @@ guac_terminal* guac_terminal_create(guac_client* client,
     pthread_mutex_init(&(term->lock), NULL);
 
     /* Repaint and resize overall display */
-    guac_terminal_repaint_default_layer(term, term->client->socket);
+    guac_terminal_repaint_default_layer(term);
     guac_terminal_display_resize(term->display,
             term->term_width, term->term_height);
 
     /* Allocate scrollbar */
-    term->scrollbar = guac_terminal_scrollbar_alloc(term->client, GUAC_DEFAULT_LAYER,
+    term->scrollbar = guac_terminal_scrollbar_alloc(term->client,
+            term->graphical_display,
+            guac_display_default_layer(term->graphical_display),
             term->outer_width, term->outer_height, term->term_height);
 
     /* Associate scrollbar with this terminal */
@@ -492,7 +518,7 @@ guac_terminal* guac_terminal_create(guac_client* client,
 
     /* Initialize mouse cursor */
     term->current_cursor = GUAC_TERMINAL_CURSOR_BLANK;
-    guac_common_cursor_set_blank(term->cursor);
+    guac_display_set_cursor(term->graphical_display, GUAC_DISPLAY_CURSOR_NONE);
 
     /* Start terminal thread */
     if (pthread_create(&(term->thread), NULL,
@@ -550,7 +576,14 @@ void guac_terminal_free(guac_terminal* term) {
     /* Free display */
     guac_terminal_display_free(term->display);
 
+    /* Free underlying graphical display only after all layers have been
+     * freed and no further frames can be rendered */
+    guac_display_stop(term->graphical_display);
+    guac_display_free(term->graphical_display);
+
     /* Free buffers */
+    guac_client_account_memory(term->client, GUAC_CLIENT_MEMORY_TERMINAL,
+            -(int64_t) term->accounted_memory);
     guac_terminal_buffer_free(term->normal_buffer);
     guac_terminal_buffer_free(term->alternate_buffer);
 
@@ -598,6 +631,36 @@ static int guac_terminal_wait(guac_terminal* terminal, int msec_timeout) {
 
 }
 
+/**
+ * Returns the maximum duration of the frame currently being rendered by the
+ * given terminal, in milliseconds. While output is flooding the terminal,
+ * frames are extended according to the processing lag of connected clients
+ * such that lagging clients are not sent frames faster than they can handle.
+ *
+ * @param terminal
+ *     The terminal rendering the frame.
+ *
+ * @return
+ *     The maximum duration of the current frame, in milliseconds.
+ */
+static int guac_terminal_frame_duration(guac_terminal* terminal) {
+
+    if (!terminal->flooding)
+        return GUAC_TERMINAL_FRAME_DURATION;
+
+    /* Pace frames according to the connection owner (or the fastest user)
+     * such that a single slow viewer does not hold back everyone else */
+    int processing_lag = guac_client_get_pacing_lag(terminal->client);
+    if (processing_lag > GUAC_TERMINAL_MAX_LAG_COMPENSATION)
+        processing_lag = GUAC_TERMINAL_MAX_LAG_COMPENSATION;
+
+    if (processing_lag > GUAC_TERMINAL_FRAME_DURATION)
+        return processing_lag;
+
+    return GUAC_TERMINAL_FRAME_DURATION;
+
+}
+
 int guac_terminal_render_frame(guac_terminal* terminal) {
 
     guac_client* client = terminal->client;
@@ -612,9 +675,19 @@ int guac_terminal_render_frame(guac_terminal* terminal) {
 
         do {
 
+            /* Flush immediately if output has arrived since a keystroke that
+             * has not yet been reflected in any frame (most likely the echo
+             * of that keystroke), unless that keystroke has resulted in a
+             * flood of output */
+            if (terminal->started && !terminal->flooding
+                    && terminal->unflushed_output > 0
+                    && terminal->last_key_timestamp >= frame_start)
+                break;
+
             /* Calculate time remaining in frame */
             guac_timestamp frame_end = guac_timestamp_current();
-            int frame_remaining = frame_start + GUAC_TERMINAL_FRAME_DURATION
+            int frame_remaining = frame_start
+                                + guac_terminal_frame_duration(terminal)
                                 - frame_end;
 
             /* Wait again if frame remaining */
@@ -643,6 +716,10 @@ int guac_terminal_read_stdin(guac_terminal* terminal, char* c, int size) {
     return read(stdin_fd, c, size);
 }
 
+int guac_terminal_get_stdin_fd(guac_terminal* terminal) {
+    return terminal->stdin_pipe_fd[0];
+}
+
 void guac_terminal_notify(guac_terminal* terminal) {
 
     /* Signal modification */
@@ -752,6 +829,49 @@ int guac_terminal_set(guac_terminal* term, int row, int col, int codepoint) {
 
 }
 
+void guac_terminal_set_ascii(guac_terminal* term, int row, int col,
+        const char* text, int length) {
+
+    int end_col = col + length - 1;
+
+    /* Build characters with current attributes */
+    guac_terminal_char guac_char = {
+        .attributes = term->current_attributes,
+        .width      = 1
+    };
+
+    /* Display will be redrawn from buffer if flooding */
+    if (!term->flooding) {
+        for (int i = 0; i < length; i++) {
+            guac_char.value = (unsigned char) text[i];
+            guac_terminal_display_set_columns(term->display,
+                    row + term->scroll_offset, col + i, col + i, &guac_char);
+        }
+    }
+
+    guac_terminal_buffer_set_ascii(term->current_buffer, row, col, text,
+            length, &term->current_attributes);
+
+    /* Clear selection if region is modified */
+    guac_terminal_select_touch(term, row, col, row, end_col);
+
+    /* If visible cursor in current row, preserve state */
+    if (row == term->visible_cursor_row
+            && term->visible_cursor_col >= col
+            && term->visible_cursor_col <= end_col) {
+
+        /* Create copy of character with cursor attribute set */
+        guac_terminal_char cursor_character = guac_char;
+        cursor_character.value = (unsigned char) text[term->visible_cursor_col - col];
+        cursor_character.attributes.cursor = true;
+
+        __guac_terminal_set_columns(term, row,
+                term->visible_cursor_col, term->visible_cursor_col, &cursor_character);
+
+    }
+
+}
+
 void guac_terminal_commit_cursor(guac_terminal* term) {
 
     /* If no change, done */
@@ -800,8 +920,35 @@ void guac_terminal_commit_cursor(guac_terminal* term) {
 int guac_terminal_write(guac_terminal* term, const char* buffer, int length) {
 
     guac_terminal_lock(term);
+
+    /* Stop updating the display directly once more than a screenful of
+     * output has arrived within the current frame */
+    term->unflushed_output += length;
+    if (term->unflushed_output > term->term_width * term->term_height)
+        term->flooding = true;
+
     for (int written = 0; written < length; written++) {
 
+        /* Echo runs of printable ASCII in bulk where possible */
+        if (term->char_handler == guac_terminal_echo) {
+
+            int run = guac_terminal_echo_ascii(term, buffer, length - written);
+            if (run > 0) {
+
+                /* Write all characters of run to typescript, if any */
+                if (term->typescript != NULL) {
+                    for (int i = 0; i < run; i++)
+                        guac_terminal_typescript_write(term->typescript, buffer[i]);
+                }
+
+                buffer += run;
+                written += run - 1;
+                continue;
+
+            }
+
+        }
+
         /* Read and advance to next character */
         char current = *(buffer++);
 
@@ -832,8 +979,11 @@ void guac_terminal_scroll_up(guac_terminal* term,
     /* If scrolling entire display, update scroll offset */
     if (start_row == 0 && end_row == term->term_height - 1) {
 
-        /* Scroll up visibly */
-        guac_terminal_display_copy_rows(term->display, start_row + amount, end_row, -amount);
+        /* Scroll up visibly (display will be redrawn from buffer if
+         * flooding) */
+        if (!term->flooding)
+            guac_terminal_display_copy_rows(term->display,
+                    start_row + amount, end_row, -amount);
 
         /* Advance by scroll amount */
         guac_terminal_buffer_scroll_up(term->current_buffer, amount);
@@ -853,6 +1003,9 @@ void guac_terminal_scroll_up(guac_terminal* term,
             term->selection_end_row -= amount;
         }
 
+        /* Update search position */
+        term->search_row -= amount;
+
     }
 
     /* Otherwise, just copy row data upwards */
@@ -1106,8 +1259,11 @@ void guac_terminal_scroll_display_up(guac_terminal* terminal,
 void guac_terminal_copy_columns(guac_terminal* terminal, int row,
         int start_column, int end_column, int offset) {
 
-    guac_terminal_display_copy_columns(terminal->display, row + terminal->scroll_offset,
-            start_column, end_column, offset);
+    /* Display will be redrawn from buffer if flooding */
+    if (!terminal->flooding)
+        guac_terminal_display_copy_columns(terminal->display,
+                row + terminal->scroll_offset, start_column, end_column,
+                offset);
 
     guac_terminal_buffer_copy_columns(terminal->current_buffer, row,
             start_column, end_column, offset);
@@ -1126,8 +1282,11 @@ void guac_terminal_copy_columns(guac_terminal* terminal, int row,
 void guac_terminal_copy_rows(guac_terminal* terminal,
         int start_row, int end_row, int offset) {
 
-    guac_terminal_display_copy_rows(terminal->display,
-            start_row + terminal->scroll_offset, end_row + terminal->scroll_offset, offset);
+    /* Display will be redrawn from buffer if flooding */
+    if (!terminal->flooding)
+        guac_terminal_display_copy_rows(terminal->display,
+                start_row + terminal->scroll_offset,
+                end_row + terminal->scroll_offset, offset);
 
     guac_terminal_buffer_copy_rows(terminal->current_buffer,
             start_row, end_row, offset);
@@ -1192,6 +1351,71 @@ static void __guac_terminal_redraw_rect(guac_terminal* term, int start_row, int
 
 }
 
+/**
+ * Rewraps the text currently on screen such that lines which were
+ * automatically wrapped at the current terminal width are instead wrapped at
+ * the given new width. Only the visible screen of the normal buffer is
+ * rewrapped; the alternate buffer is left to full-screen applications, which
+ * redraw themselves after a resize, and rows within the scrollback keep their
+ * original wrapping such that the cost of a resize does not grow with the
+ * amount of scrollback. The caller is responsible for redrawing the screen.
+ *
+ * @param term
+ *     The terminal being resized.
+ *
+ * @param width
+ *     The new width of the terminal, in characters.
+ *
+ * @return
+ *     true if the screen was rewrapped and must be redrawn, false otherwise.
+ */
+static bool __guac_terminal_reflow(guac_terminal* term, int width) {
+
+    if (width == term->term_width
+            || term->current_buffer != term->normal_buffer)
+        return false;
+
+    /* Selected text may move anywhere */
+    if (term->text_selected)
+        guac_terminal_select_touch(term,
+                -guac_terminal_get_available_scroll(term), 0,
+                term->term_height - 1, term->term_width);
+
+    /* Remove the rendered cursor, which will be recommitted at its new
+     * location */
+    if (term->visible_cursor_row != -1 && term->visible_cursor_col != -1)
+        guac_terminal_buffer_set_cursor(term->current_buffer,
+                term->visible_cursor_row, term->visible_cursor_col, false);
+
+    term->visible_cursor_row = -1;
+    term->visible_cursor_col = -1;
+
+    int shift = guac_terminal_buffer_reflow(term->current_buffer,
+            term->term_height, term->term_width, width,
+            &term->cursor_row, &term->cursor_col);
+
+    /* Keep any scrolled-back view on the same rows of history */
+    if (shift > 0) {
+
+        int available_scroll = guac_terminal_get_available_scroll(term);
+
+        if (term->scroll_offset > 0)
+            term->scroll_offset += shift;
+
+        if (term->scroll_offset > available_scroll)
+            term->scroll_offset = available_scroll;
+
+        guac_terminal_scrollbar_set_bounds(term->scrollbar,
+                -available_scroll, 0);
+        guac_terminal_scrollbar_set_value(term->scrollbar,
+                -term->scroll_offset);
+
+    }
+
+    return true;
+
+}
+
 /**
  * Internal terminal resize routine. Accepts width/height in CHARACTERS
  * (not pixels like the public function).
@@ -1207,6 +1431,9 @@ static void __guac_terminal_redraw_rect(guac_terminal* term, int start_row, int
  */
 static void __guac_terminal_resize(guac_terminal* term, int width, int height) {
 
+    /* Rewrap the screen first if the width is changing */
+    bool reflowed = __guac_terminal_reflow(term, width);
+
     /* If height is decreasing, shift display up */
     if (height < term->term_height) {
 
@@ -1315,13 +1542,14 @@ static void __guac_terminal_resize(guac_terminal* term, int width, int height) {
     term->term_width = width;
     term->term_height = height;
 
+    /* Redraw entire screen if rewrapped */
+    if (reflowed)
+        __guac_terminal_redraw_rect(term, 0, 0, height - 1, width - 1);
+
 }
 
 int guac_terminal_resize(guac_terminal* terminal, int width, int height) {
 
-    guac_terminal_display* display = terminal->display;
-    guac_client* client = display->client;
-
     /* Acquire exclusive access to terminal */
     guac_terminal_lock(terminal);
 
@@ -1344,7 +1572,7 @@ int guac_terminal_resize(guac_terminal* terminal, int width, int height) {
     terminal->width = adjusted_width;
 
     /* Resize default layer to given pixel dimensions */
-    guac_terminal_repaint_default_layer(terminal, client->socket);
+    guac_terminal_repaint_default_layer(terminal);
 
     /* Resize terminal if row/column dimensions have changed */
     if (columns != terminal->term_width || rows != terminal->term_height) {
@@ -1379,12 +1607,30 @@ void guac_terminal_flush(guac_terminal* terminal) {
     if (terminal->pipe_stream_flags & GUAC_TERMINAL_PIPE_AUTOFLUSH)
         guac_terminal_pipe_stream_flush(terminal);
 
+    /* Rebuild display from final buffer state if flooding */
+    if (terminal->flooding) {
+        terminal->flooding = false;
+        __guac_terminal_redraw_rect(terminal, 0, 0,
+                terminal->term_height - 1, terminal->term_width - 1);
+    }
+
+    terminal->unflushed_output = 0;
+
     /* Flush display state */
     guac_terminal_select_redraw(terminal);
     guac_terminal_commit_cursor(terminal);
     guac_terminal_display_flush(terminal->display);
     guac_terminal_scrollbar_flush(terminal->scrollbar);
 
+    /* Attribute any growth or shrinkage of the buffers (including
+     * scrollback) since the last flush to the client */
+    size_t memory = guac_terminal_buffer_memory(terminal->normal_buffer)
+                  + guac_terminal_buffer_memory(terminal->alternate_buffer);
+
+    guac_client_account_memory(terminal->client, GUAC_CLIENT_MEMORY_TERMINAL,
+            (int64_t) memory - (int64_t) terminal->accounted_memory);
+    terminal->accounted_memory = memory;
+
 }
 
 void guac_terminal_lock(guac_terminal* terminal) {
@@ -1424,10 +1670,15 @@ static int __guac_terminal_send_key(guac_terminal* term, int keysym, int pressed
         return 0;
     }
 
+    /* Flush the echo of this keystroke as soon as it arrives */
+    if (pressed)
+        term->last_key_timestamp = guac_timestamp_current();
+
     /* Hide mouse cursor if not already hidden */
     if (term->current_cursor != GUAC_TERMINAL_CURSOR_BLANK) {
         term->current_cursor = GUAC_TERMINAL_CURSOR_BLANK;
-        guac_common_cursor_set_blank(term->cursor);
+        guac_display_set_cursor(term->graphical_display,
+                GUAC_DISPLAY_CURSOR_NONE);
         guac_terminal_notify(term);
     }
 
@@ -1734,7 +1985,8 @@ static int __guac_terminal_send_mouse(guac_terminal* term, guac_user* user,
     int pressed_mask  = ~term->mouse_mask &  mask;
 
     /* Store current mouse location/state */
-    guac_common_cursor_update(term->cursor, user, x, y, mask);
+    guac_display_notify_user_moved_mouse(term->graphical_display,
+            user, x, y, mask);
 
     /* Notify scrollbar, do not handle anything handled by scrollbar */
     if (guac_terminal_scrollbar_handle_mouse(term->scrollbar, x, y, mask)) {
@@ -1742,7 +1994,8 @@ static int __guac_terminal_send_mouse(guac_terminal* term, guac_user* user,
         /* Set pointer cursor if mouse is over scrollbar */
         if (term->current_cursor != GUAC_TERMINAL_CURSOR_POINTER) {
             term->current_cursor = GUAC_TERMINAL_CURSOR_POINTER;
-            guac_common_cursor_set_pointer(term->cursor);
+            guac_display_set_cursor(term->graphical_display,
+                    GUAC_DISPLAY_CURSOR_POINTER);
             guac_terminal_notify(term);
         }
 
@@ -1760,7 +2013,8 @@ static int __guac_terminal_send_mouse(guac_terminal* term, guac_user* user,
     /* Show mouse cursor if not already shown */
     if (term->current_cursor != GUAC_TERMINAL_CURSOR_IBAR) {
         term->current_cursor = GUAC_TERMINAL_CURSOR_IBAR;
-        guac_common_cursor_set_ibar(term->cursor);
+        guac_display_set_cursor(term->graphical_display,
+                GUAC_DISPLAY_CURSOR_IBAR);
         guac_terminal_notify(term);
     }
 
@@ -2035,11 +2289,12 @@ void guac_terminal_pipe_stream_close(guac_terminal* term) {
 }
 
 int guac_terminal_create_typescript(guac_terminal* term, const char* path,
-        const char* name, int create_path, int allow_write_existing) {
+        const char* name, int create_path, int allow_write_existing,
+        guac_terminal_typescript_format format, int compress) {
 
     /* Create typescript */
-    term->typescript = guac_terminal_typescript_alloc(
-            path, name, create_path, allow_write_existing);
+    term->typescript = guac_terminal_typescript_alloc(path, name,
+            create_path, allow_write_existing, format, compress);
 
     /* Log failure */
     if (term->typescript == NULL) {
@@ -2049,11 +2304,23 @@ int guac_terminal_create_typescript(guac_terminal* term, const char* path,
         return 1;
     }
 
+    if (compress && !term->typescript->compress)
+        guac_client_log(term->client, GUAC_LOG_WARNING, "Typescript "
+                "compression was requested, but guacamole-server was built "
+                "without zstd support. The typescript will NOT be "
+                "compressed.");
+
     /* If typescript was successfully created, log filenames */
-    guac_client_log(term->client, GUAC_LOG_INFO, "Typescript of terminal "
-            "session will be saved within \"%s\" to \"%s\". Corresponding "
-            "timing file is \"%s\".", path, term->typescript->data_filename,
-            term->typescript->timing_filename);
+    if (format == GUAC_TERMINAL_TYPESCRIPT_FORMAT_COMBINED)
+        guac_client_log(term->client, GUAC_LOG_INFO, "Typescript of terminal "
+                "session will be saved within \"%s\" to \"%s\", including "
+                "timing information.", path, term->typescript->data_filename);
+
+    else
+        guac_client_log(term->client, GUAC_LOG_INFO, "Typescript of terminal "
+                "session will be saved within \"%s\" to \"%s\". Corresponding "
+                "timing file is \"%s\".", path, term->typescript->data_filename,
+                term->typescript->timing_filename);
 
     /* Typescript creation succeeded */
     return 0;
@@ -2076,15 +2343,9 @@ int guac_terminal_create_typescript(guac_terminal* term, const char* path,
 static void __guac_terminal_sync_socket(
         guac_client* client, guac_terminal* term, guac_socket* socket) {
 
-    /* Synchronize display state with new user */
-    guac_terminal_repaint_default_layer(term, socket);
-    guac_terminal_display_dup(term->display, client, socket);
-
-    /* Synchronize mouse cursor */
-    guac_common_cursor_dup(term->cursor, client, socket);
-
-    /* Paint scrollbar for joining users */
-    guac_terminal_scrollbar_dup(term->scrollbar, client, socket);
+    /* Synchronize display state (including the scrollbar and mouse cursor)
+     * with new user */
+    guac_display_dup(term->graphical_display, socket);
 
 }
 
@@ -2163,8 +2424,10 @@ void guac_terminal_apply_font(guac_terminal* terminal, const char* font_name,
     guac_terminal_lock(terminal);
 
     /* Update stored copy of font name, if changed */
-    if (font_name != NULL)
+    if (font_name != NULL) {
+        guac_mem_free_const(terminal->font_name);
         terminal->font_name = guac_strdup(font_name);
+    }
 
     /* Update stored copy of font size, if changed */
     if (font_size != -1)
@@ -2224,13 +2487,13 @@ void guac_terminal_clipboard_append(guac_terminal* terminal,
 void guac_terminal_remove_user(guac_terminal* terminal, guac_user* user) {
 
     /* Remove the user from the terminal cursor */
-    guac_common_cursor_remove_user(terminal->cursor, user);
+    guac_display_notify_user_left(terminal->graphical_display, user);
 }
 
 void guac_terminal_redraw_default_layer(guac_terminal* terminal) {
 
     /* Redraw terminal text and background */
-    guac_terminal_repaint_default_layer(terminal, terminal->client->socket);
+    guac_terminal_repaint_default_layer(terminal);
     __guac_terminal_redraw_rect(terminal, 0, 0,
             terminal->term_height - 1,
             terminal->term_width - 1);
@@ -35,6 +35,8 @@
 
 #include "types.h"
 
+#include <stddef.h>
+
 /**
  * A buffer containing a constant number of arbitrary-length rows.
  * New rows can be appended to the buffer, with the oldest row replaced with
@@ -65,6 +67,20 @@ void guac_terminal_buffer_free(guac_terminal_buffer* buffer);
  */
 void guac_terminal_buffer_reset(guac_terminal_buffer* buffer);
 
+/**
+ * Returns the number of bytes of memory currently allocated for the given
+ * buffer, including all rows of scrollback that remain in memory. Rows whose
+ * contents have been spilled to disk are not included.
+ *
+ * @param buffer
+ *     The buffer to measure.
+ *
+ * @return
+ *     The number of bytes of memory currently allocated for the given
+ *     buffer.
+ */
+size_t guac_terminal_buffer_memory(guac_terminal_buffer* buffer);
+
 /**
  * Copies the given range of columns to a new location, offset from
  * the original by the given number of columns.
@@ -109,6 +125,49 @@ void guac_terminal_buffer_scroll_up(guac_terminal_buffer* buffer, int amount);
  */
 void guac_terminal_buffer_scroll_down(guac_terminal_buffer* buffer, int amount);
 
+/**
+ * Rewraps the rows currently occupying the given number of rows at the top of
+ * the buffer (the visible screen) such that each line of text is wrapped at
+ * the given new width rather than the given old width. Consecutive rows that
+ * were automatically wrapped are joined back into a single line before being
+ * wrapped again, and trailing blank cells are discarded. If the rewrapped
+ * text requires more rows than are available, the buffer is scrolled up such
+ * that the earliest rows move into the scrollback, exactly as if the text
+ * had been written at the new width.
+ *
+ * Only rows at or after row zero are considered. Rows within the scrollback
+ * are left untouched, such that the cost of rewrapping depends only on the
+ * size of the screen and not on the amount of scrollback.
+ *
+ * @param buffer
+ *     The buffer to rewrap.
+ *
+ * @param height
+ *     The number of rows at the top of the buffer that make up the screen.
+ *
+ * @param old_width
+ *     The width, in columns, at which the rows within the screen were
+ *     originally wrapped.
+ *
+ * @param new_width
+ *     The width, in columns, at which the rows within the screen should be
+ *     wrapped.
+ *
+ * @param cursor_row
+ *     A pointer to the row of the terminal cursor, which will be updated to
+ *     reflect the new location of the character beneath the cursor.
+ *
+ * @param cursor_col
+ *     A pointer to the column of the terminal cursor, which will be updated
+ *     to reflect the new location of the character beneath the cursor.
+ *
+ * @return
+ *     The number of rows that the buffer was scrolled up to make room for the
+ *     rewrapped text, or zero if no scrolling was necessary.
+ */
+int guac_terminal_buffer_reflow(guac_terminal_buffer* buffer, int height,
+        int old_width, int new_width, int* cursor_row, int* cursor_col);
+
 /**
  * Sets the given range of columns within the given row to the given
  * character.
@@ -116,6 +175,35 @@ void guac_terminal_buffer_scroll_down(guac_terminal_buffer* buffer, int amount);
 void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
         int start_column, int end_column, guac_terminal_char* character);
 
+/**
+ * Sets consecutive columns within the given row to each of the given
+ * printable ASCII characters, all having the given attributes. This is
+ * equivalent to invoking guac_terminal_buffer_set_columns() once for each
+ * character, but updates the row only once.
+ *
+ * @param buffer
+ *     The buffer associated with the row being modified.
+ *
+ * @param row
+ *     The row to modify.
+ *
+ * @param start_column
+ *     The column that should receive the first character.
+ *
+ * @param text
+ *     The printable ASCII characters to store. Each of these characters
+ *     MUST have a width of exactly one column.
+ *
+ * @param length
+ *     The number of characters to store.
+ *
+ * @param attributes
+ *     The attributes to apply to every stored character.
+ */
+void guac_terminal_buffer_set_ascii(guac_terminal_buffer* buffer, int row,
+        int start_column, const char* text, int length,
+        const guac_terminal_attributes* attributes);
+
 /**
  * Get the char (int ASCII code) at a specific row/col of the display.
  *
@@ -134,6 +222,40 @@ void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
 unsigned int guac_terminal_buffer_get_columns(guac_terminal_buffer* buffer,
         guac_terminal_char** characters, bool* is_wrapped, int row);
 
+/**
+ * Copies the character values (Unicode codepoints) of the given row into the
+ * given array, without otherwise altering the buffer. Unlike
+ * guac_terminal_buffer_get_columns(), rows which have been compressed or
+ * spilled to disk are decoded in place rather than restored, making this
+ * suitable for reading large portions of the scrollback.
+ *
+ * @param buffer
+ *     The buffer containing the row.
+ *
+ * @param row
+ *     The index of the row to read, where zero is the top-most row. Negative
+ *     indices represent rows in the scrollback buffer, above the top-most
+ *     row.
+ *
+ * @param values
+ *     The array to populate with the value of each character in the row,
+ *     indexed by column. Multi-column characters are followed by
+ *     GUAC_CHAR_CONTINUATION for each additional column.
+ *
+ * @param max_length
+ *     The maximum number of values to store within the given array.
+ *
+ * @param is_wrapped
+ *     Pointer to a bool which should receive whether the row was
+ *     automatically wrapped, or NULL if this is not needed.
+ *
+ * @return
+ *     The number of values stored within the given array, or zero if the
+ *     row does not exist or cannot be read.
+ */
+unsigned int guac_terminal_buffer_get_values(guac_terminal_buffer* buffer,
+        int row, int* values, unsigned int max_length, bool* is_wrapped);
+
 /**
  * Returns the number of rows actually available for rendering within the given
  * buffer, taking the scrollback size into account. Regardless of the true
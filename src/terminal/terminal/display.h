@@ -26,12 +26,13 @@
  * @file display.h
  */
 
-#include "common/surface.h"
+#include "font-cache.h"
+#include "glyph-atlas.h"
 #include "palette.h"
 #include "types.h"
 
 #include <guacamole/client.h>
-#include <guacamole/layer.h>
+#include <guacamole/display.h>
 #include <pango/pangocairo.h>
 
 #include <stdbool.h>
@@ -47,6 +48,19 @@
  */
 #define GUAC_TERMINAL_MARGINS 2
 
+/**
+ * The color of the highlight drawn over selected text, as a 32-bit ARGB
+ * value. The highlight is drawn fully opaque, with its translucency instead
+ * provided by GUAC_TERMINAL_SELECTION_OPACITY.
+ */
+#define GUAC_TERMINAL_SELECTION_COLOR 0xFF0080FF
+
+/**
+ * The opacity of the layer containing the selection highlight, where 0 is
+ * fully transparent and 255 is fully opaque.
+ */
+#define GUAC_TERMINAL_SELECTION_OPACITY 0x60
+
 /**
  * 1 inch is 25.4 millimeters, and we can therefore use the following
  * to create a mm to px formula: (mm × dpi) ÷ 25.4 = px.
@@ -106,6 +120,62 @@ typedef struct guac_terminal_operation {
 
 } guac_terminal_operation;
 
+/**
+ * The range of columns within a single row of a guac_terminal_display that
+ * may contain pending operations. All columns outside this range are
+ * guaranteed to contain GUAC_CHAR_NOP.
+ */
+typedef struct guac_terminal_display_damage {
+
+    /**
+     * The first column that may contain a pending operation. If the row has
+     * no pending operations, this will be greater than right.
+     */
+    int left;
+
+    /**
+     * The last column that may contain a pending operation. If the row has
+     * no pending operations, this will be less than left.
+     */
+    int right;
+
+} guac_terminal_display_damage;
+
+/**
+ * Running totals of the drawing performed by a guac_terminal_display as
+ * pending operations are flushed. These totals only ever increase and are
+ * exposed so that the cost of terminal rendering can be measured.
+ */
+typedef struct guac_terminal_display_stats {
+
+    /**
+     * The number of times pending operations have been flushed.
+     */
+    uint64_t flushes;
+
+    /**
+     * The number of rectangles copied from elsewhere within the display.
+     */
+    uint64_t copy_rects;
+
+    /**
+     * The number of rectangles filled with a solid background color.
+     */
+    uint64_t clear_rects;
+
+    /**
+     * The number of individual glyphs drawn.
+     */
+    uint64_t glyphs;
+
+    /**
+     * The total number of character cells updated by any of the above
+     * operations.
+     */
+    uint64_t cells;
+
+} guac_terminal_display_stats;
+
 /**
  * Set of all pending operations for the currently-visible screen area, and the
  * contextual information necessary to interpret and render those changes.
@@ -117,11 +187,25 @@ typedef struct guac_terminal_display {
      */
     guac_client* client;
 
+    /**
+     * The guac_display that receives all graphical updates, and which is
+     * responsible for deciding how those updates are sent to connected
+     * users.
+     */
+    guac_display* graphical_display;
+
     /**
      * Array of all operations pending for the visible screen area.
      */
     guac_terminal_operation* operations;
 
+    /**
+     * The range of columns containing pending operations within each row of
+     * the operations array, such that flushing need only visit the portions
+     * of the display that have actually changed.
+     */
+    guac_terminal_display_damage* damage;
+
     /**
      * The width of the screen, in characters.
      */
@@ -138,9 +222,22 @@ typedef struct guac_terminal_display {
     int margin;
 
     /**
-     * The description of the font to use for rendering.
+     * The font to use for rendering, shared with any other terminals using
+     * the same font through the process-wide font cache.
+     */
+    guac_terminal_font* font;
+
+    /**
+     * The Pango layout reused to render every glyph, or NULL if no glyph has
+     * yet been rendered.
+     */
+    PangoLayout* glyph_layout;
+
+    /**
+     * The font currently assigned to glyph_layout, or NULL if no glyph has
+     * yet been rendered.
      */
-    PangoFontDescription* font_desc;
+    guac_terminal_font* glyph_layout_font;
 
     /**
      * The width of each character, in pixels.
@@ -186,19 +283,19 @@ typedef struct guac_terminal_display {
     guac_terminal_color glyph_background;
 
     /**
-     * The surface containing the actual terminal.
+     * Cache of all glyphs previously rendered using the current font.
      */
-    guac_common_surface* display_surface;
+    guac_terminal_glyph_atlas* glyph_atlas;
 
     /**
      * Layer which contains the actual terminal.
      */
-    guac_layer* display_layer;
+    guac_display_layer* display_layer;
 
     /**
      * Sub-layer of display layer which highlights selected text.
      */
-    guac_layer* select_layer;
+    guac_display_layer* select_layer;
 
     /**
      * Whether text is currently selected.
@@ -231,16 +328,23 @@ typedef struct guac_terminal_display {
      */
     bool unflushed_set;
 
+    /**
+     * Running totals of all drawing performed while flushing pending
+     * operations.
+     */
+    guac_terminal_display_stats stats;
+
 } guac_terminal_display;
 
 /**
  * Allocates a new display having the given default foreground and background
- * colors.
+ * colors. All rendering is performed through layers of the given guac_display,
+ * which must remain allocated until the terminal display is freed.
  */
 guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
-        const char* font_name, int font_size, int dpi,
-        guac_terminal_color* foreground, guac_terminal_color* background,
-        guac_terminal_color (*palette)[256]);
+        guac_display* graphical_display, const char* font_name,
+        int font_size, int dpi, guac_terminal_color* foreground,
+        guac_terminal_color* background, guac_terminal_color (*palette)[256]);
 
 /**
  * Frees the given display.
@@ -331,33 +435,14 @@ void guac_terminal_display_resize(guac_terminal_display* display, int width, int
 void guac_terminal_display_flush_operations(guac_terminal_display* display);
 
 /**
- * Flushes all pending operations within the given guac_terminal_display,
- * then flushes the display surface.
+ * Flushes all pending operations within the given guac_terminal_display into
+ * the pending frame of its guac_display. The frame itself is not ended.
  *
  * @param display
  *     The terminal display to flush.
  */
 void guac_terminal_display_flush(guac_terminal_display* display);
 
-/**
- * Initializes and syncs the current terminal display state for all joining
- * users associated with the provided socket, sending the necessary instructions
- * to completely recreate and redraw the terminal rendering over the given
- * socket.
- *
- * @param display
- *     The terminal display to sync to the users associated with the provided
- *     socket.
- *
- * @param client
- *     The client whose users are joining.
- *
- * @param socket
- *     The socket over which any necessary instructions should be sent.
- */
-void guac_terminal_display_dup(
-        guac_terminal_display* display, guac_client* client, guac_socket* socket);
-
 /**
  * Draws the text selection rectangle from the given coordinates to the given end coordinates.
  */
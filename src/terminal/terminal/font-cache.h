@@ -0,0 +1,129 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_TERMINAL_FONT_CACHE_H
+#define GUAC_TERMINAL_FONT_CACHE_H
+
+/**
+ * A process-wide cache of the fonts used by terminals, allowing the
+ * comparatively expensive work of resolving a font and measuring its
+ * characters to be performed only once for each combination of font family,
+ * size, and resolution, no matter how many times that font is selected.
+ *
+ * @file font-cache.h
+ */
+
+#include <pango/pangocairo.h>
+#include <stdbool.h>
+
+/**
+ * The maximum number of fonts retained within the cache while no terminal is
+ * using them. Fonts that are in use are never evicted.
+ */
+#define GUAC_TERMINAL_FONT_CACHE_SIZE 16
+
+/**
+ * A resolved and measured font, shared by all terminals using the same font
+ * family, size, and resolution. Once cached, a font is never modified, and
+ * fonts are instead switched by acquiring a different font from the
+ * cache.
+ */
+typedef struct guac_terminal_font {
+
+    /**
+     * The font family, as requested.
+     */
+    char* family;
+
+    /**
+     * The font size, in points.
+     */
+    int size;
+
+    /**
+     * The resolution at which the font is rendered, in DPI.
+     */
+    int dpi;
+
+    /**
+     * The Pango description of the font, for use when rendering glyphs.
+     */
+    PangoFontDescription* description;
+
+    /**
+     * The width of a single column of text rendered with this font, in
+     * pixels.
+     */
+    int char_width;
+
+    /**
+     * The height of a single row of text rendered with this font, in pixels.
+     */
+    int char_height;
+
+    /**
+     * The number of references to this font acquired with
+     * guac_terminal_font_acquire() that have not yet been released. This
+     * member is guarded by the lock of the cache.
+     */
+    int refcount;
+
+    /**
+     * Whether this font is stored within the cache. A font that could not be
+     * cached because all entries of the cache were in use is freed as soon as
+     * its last reference is released. This member is guarded by the lock of
+     * the cache.
+     */
+    bool cached;
+
+} guac_terminal_font;
+
+/**
+ * Acquires a reference to the font having the given family, size, and
+ * resolution, resolving and measuring that font only if it is not already
+ * cached. This function is threadsafe.
+ *
+ * @param family
+ *     The font family.
+ *
+ * @param size
+ *     The font size, in points.
+ *
+ * @param dpi
+ *     The resolution at which the font will be rendered, in DPI.
+ *
+ * @return
+ *     The requested font, which must eventually be released with
+ *     guac_terminal_font_release(), or NULL if the font cannot be loaded.
+ */
+guac_terminal_font* guac_terminal_font_acquire(const char* family, int size,
+        int dpi);
+
+/**
+ * Releases a reference to the given font previously acquired with
+ * guac_terminal_font_acquire(). The font must not be used by the caller
+ * after it has been released. This function is threadsafe.
+ *
+ * @param font
+ *     The font to release.
+ */
+void guac_terminal_font_release(guac_terminal_font* font);
+
+#endif
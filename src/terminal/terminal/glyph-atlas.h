@@ -0,0 +1,295 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_TERMINAL_GLYPH_ATLAS_H
+#define GUAC_TERMINAL_GLYPH_ATLAS_H
+
+/**
+ * A cache of rendered terminal glyphs, allowing each distinct glyph to be
+ * rasterized only once and then copied into place.
+ *
+ * @file glyph-atlas.h
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The number of glyph slots in each row of the atlas image.
+ */
+#define GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS 32
+
+/**
+ * The number of rows of glyph slots within the atlas image.
+ */
+#define GUAC_TERMINAL_GLYPH_ATLAS_ROWS 32
+
+/**
+ * The total number of glyphs which may be stored within the atlas before it
+ * must be reset.
+ */
+#define GUAC_TERMINAL_GLYPH_ATLAS_SLOTS \
+    (GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS * GUAC_TERMINAL_GLYPH_ATLAS_ROWS)
+
+/**
+ * The number of buckets within the hash table mapping glyphs to atlas slots.
+ * This MUST be a power of two and SHOULD be comfortably larger than
+ * GUAC_TERMINAL_GLYPH_ATLAS_SLOTS, such that linear probing remains short even
+ * when the atlas is nearly full.
+ */
+#define GUAC_TERMINAL_GLYPH_ATLAS_BUCKETS 2048
+
+/**
+ * A single entry within the hash table of a guac_terminal_glyph_atlas,
+ * associating a rendered glyph with the atlas slot containing it.
+ */
+typedef struct guac_terminal_glyph_atlas_entry {
+
+    /**
+     * The Unicode codepoint of the rendered glyph, or -1 if this entry is
+     * unused.
+     */
+    int codepoint;
+
+    /**
+     * The foreground color of the rendered glyph, as a 24-bit RGB value.
+     */
+    uint32_t foreground;
+
+    /**
+     * The background color of the rendered glyph, as a 24-bit RGB value.
+     */
+    uint32_t background;
+
+    /**
+     * The index of the atlas slot containing the rendered glyph.
+     */
+    int slot;
+
+} guac_terminal_glyph_atlas_entry;
+
+/**
+ * The state of a single slot within a guac_terminal_glyph_atlas, including
+ * its position within the atlas' least-recently-used list.
+ */
+typedef struct guac_terminal_glyph_atlas_slot {
+
+    /**
+     * The index of the hash table entry referring to this slot.
+     */
+    int bucket;
+
+    /**
+     * The index of the next more-recently-used slot, or -1 if this slot is
+     * the most recently used.
+     */
+    int newer;
+
+    /**
+     * The index of the next less-recently-used slot, or -1 if this slot is
+     * the least recently used.
+     */
+    int older;
+
+} guac_terminal_glyph_atlas_slot;
+
+/**
+ * Server-side cache of rendered glyphs. Glyphs are stored within a grid of
+ * fixed-size slots in a 32-bit RGB image having the same pixel format as the
+ * raw buffer of an opaque guac_display_layer, each slot being wide enough to
+ * hold a glyph spanning GUAC_TERMINAL_MAX_CHAR_WIDTH columns. Once all slots
+ * are in use, the least-recently-used glyph is evicted to make room for each
+ * new glyph. Glyphs are copied out of the atlas directly into the pending
+ * frame of the terminal's guac_display, which then decides how best to send
+ * the result.
+ */
+typedef struct guac_terminal_glyph_atlas {
+
+    /**
+     * The image containing all rendered glyphs, or NULL if no glyph size has
+     * yet been assigned.
+     */
+    unsigned char* image;
+
+    /**
+     * The number of bytes in each row of the atlas image.
+     */
+    size_t stride;
+
+    /**
+     * The width of each glyph slot, in pixels.
+     */
+    int slot_width;
+
+    /**
+     * The height of each glyph slot, in pixels.
+     */
+    int slot_height;
+
+    /**
+     * The index of the next never-used slot. If equal to
+     * GUAC_TERMINAL_GLYPH_ATLAS_SLOTS, the atlas is full and new glyphs
+     * replace the least-recently-used glyph.
+     */
+    int next_slot;
+
+    /**
+     * The index of the most-recently-used slot, or -1 if no slots are in use.
+     */
+    int newest;
+
+    /**
+     * The index of the least-recently-used slot, or -1 if no slots are in
+     * use.
+     */
+    int oldest;
+
+    /**
+     * The state of each slot within the atlas.
+     */
+    guac_terminal_glyph_atlas_slot slots[GUAC_TERMINAL_GLYPH_ATLAS_SLOTS];
+
+    /**
+     * Hash table of all glyphs currently stored within the atlas, using
+     * linear probing to resolve collisions.
+     */
+    guac_terminal_glyph_atlas_entry entries[GUAC_TERMINAL_GLYPH_ATLAS_BUCKETS];
+
+} guac_terminal_glyph_atlas;
+
+/**
+ * Allocates a new, empty glyph atlas. The atlas will not be able to store
+ * any glyphs until a glyph size is assigned with
+ * guac_terminal_glyph_atlas_reset().
+ *
+ * @return
+ *     A newly-allocated glyph atlas, which must eventually be freed with
+ *     guac_terminal_glyph_atlas_free().
+ */
+guac_terminal_glyph_atlas* guac_terminal_glyph_atlas_alloc(void);
+
+/**
+ * Frees the given glyph atlas, including its image.
+ *
+ * @param atlas
+ *     The glyph atlas to free.
+ */
+void guac_terminal_glyph_atlas_free(guac_terminal_glyph_atlas* atlas);
+
+/**
+ * Discards all glyphs stored within the given atlas, resizing its slots such
+ * that each can hold a glyph of the given size. This must be invoked whenever
+ * the font used to render glyphs changes.
+ *
+ * @param atlas
+ *     The glyph atlas to reset.
+ *
+ * @param slot_width
+ *     The width of each glyph slot, in pixels.
+ *
+ * @param slot_height
+ *     The height of each glyph slot, in pixels.
+ */
+void guac_terminal_glyph_atlas_reset(guac_terminal_glyph_atlas* atlas,
+        int slot_width, int slot_height);
+
+/**
+ * Searches the given atlas for a previously-rendered glyph having the given
+ * codepoint and colors. If found, the glyph becomes the most recently used
+ * glyph within the atlas.
+ *
+ * @param atlas
+ *     The glyph atlas to search.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the glyph.
+ *
+ * @param foreground
+ *     The foreground color of the glyph, as a 24-bit RGB value.
+ *
+ * @param background
+ *     The background color of the glyph, as a 24-bit RGB value.
+ *
+ * @return
+ *     The index of the slot containing the glyph, or -1 if the glyph is not
+ *     present within the atlas.
+ */
+int guac_terminal_glyph_atlas_find(guac_terminal_glyph_atlas* atlas,
+        int codepoint, uint32_t foreground, uint32_t background);
+
+/**
+ * Reserves a slot within the given atlas for a glyph having the given
+ * codepoint and colors, which the caller must then render into the slot's
+ * area of the atlas image. If the atlas is full, the least-recently-used
+ * glyph is discarded to make room. The glyph must not already be present
+ * within the atlas.
+ *
+ * @param atlas
+ *     The glyph atlas to store the glyph within.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the glyph.
+ *
+ * @param foreground
+ *     The foreground color of the glyph, as a 24-bit RGB value.
+ *
+ * @param background
+ *     The background color of the glyph, as a 24-bit RGB value.
+ *
+ * @return
+ *     The index of the slot reserved for the glyph.
+ */
+int guac_terminal_glyph_atlas_insert(guac_terminal_glyph_atlas* atlas,
+        int codepoint, uint32_t foreground, uint32_t background);
+
+/**
+ * Returns the X coordinate of the upper-left corner of the given slot within
+ * the atlas image.
+ *
+ * @param atlas
+ *     The glyph atlas containing the slot.
+ *
+ * @param slot
+ *     The index of the slot.
+ *
+ * @return
+ *     The X coordinate of the slot, in pixels.
+ */
+int guac_terminal_glyph_atlas_slot_x(guac_terminal_glyph_atlas* atlas,
+        int slot);
+
+/**
+ * Returns the Y coordinate of the upper-left corner of the given slot within
+ * the atlas image.
+ *
+ * @param atlas
+ *     The glyph atlas containing the slot.
+ *
+ * @param slot
+ *     The index of the slot.
+ *
+ * @return
+ *     The Y coordinate of the slot, in pixels.
+ */
+int guac_terminal_glyph_atlas_slot_y(guac_terminal_glyph_atlas* atlas,
+        int slot);
+
+#endif
+
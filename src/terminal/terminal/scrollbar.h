@@ -27,7 +27,7 @@
  */
 
 #include <guacamole/client.h>
-#include <guacamole/layer.h>
+#include <guacamole/display.h>
 
 /**
  * The width of the scrollbar, in pixels.
@@ -45,6 +45,29 @@
  */
 #define GUAC_TERMINAL_SCROLLBAR_MIN_HEIGHT 64
 
+/**
+ * The color of the layer containing the scrollbar handle, as a 32-bit ARGB
+ * value.
+ */
+#define GUAC_TERMINAL_SCROLLBAR_CONTAINER_COLOR 0xFF808080
+
+/**
+ * The opacity of the layer containing the scrollbar handle, where 0 is fully
+ * transparent and 255 is fully opaque.
+ */
+#define GUAC_TERMINAL_SCROLLBAR_CONTAINER_OPACITY 0x40
+
+/**
+ * The color of the draggable handle of the scrollbar, as a 32-bit ARGB value.
+ */
+#define GUAC_TERMINAL_SCROLLBAR_HANDLE_COLOR 0xFFA0A0A0
+
+/**
+ * The opacity of the draggable handle of the scrollbar, where 0 is fully
+ * transparent and 255 is fully opaque.
+ */
+#define GUAC_TERMINAL_SCROLLBAR_HANDLE_OPACITY 0x8F
+
 /**
  * The state of all scrollbar components, describing all variable aspects of
  * the scrollbar's appearance.
@@ -121,7 +144,7 @@ struct guac_terminal_scrollbar {
     /**
      * The layer containing the scrollbar.
      */
-    const guac_layer* parent;
+    guac_display_layer* parent;
 
     /**
      * The width of the parent layer, in pixels.
@@ -136,13 +159,14 @@ struct guac_terminal_scrollbar {
     /**
      * The scrollbar itself.
      */
-    guac_layer* container;
+    guac_display_layer* container;
 
     /**
      * The draggable handle within the scrollbar, representing the current
-     * scroll value.
+     * scroll value. The handle is a sibling of the container within the
+     * parent layer, stacked above the container.
      */
-    guac_layer* handle;
+    guac_display_layer* handle;
 
     /**
      * The minimum scroll value.
@@ -206,12 +230,17 @@ struct guac_terminal_scrollbar {
  * position of the scrollbar. Currently, the scrollbar is always anchored to
  * the right edge of the parent layer.
  *
- * This will cause instructions to be written to the client's socket, but the
- * client's socket will not be automatically flushed.
+ * The layers of the scrollbar are allocated from the given guac_display, and
+ * all changes to the scrollbar become part of the pending frame of that
+ * display.
  *
  * @param client
  *     The client to associate with the new scrollbar.
  *
+ * @param display
+ *     The guac_display from which the layers of the scrollbar should be
+ *     allocated.
+ *
  * @param parent
  *     The layer which will contain the newly-allocated scrollbar.
  *
@@ -230,8 +259,8 @@ struct guac_terminal_scrollbar {
  *     A newly allocated scrollbar.
  */
 guac_terminal_scrollbar* guac_terminal_scrollbar_alloc(guac_client* client,
-        const guac_layer* parent, int parent_width, int parent_height,
-        int visible_area);
+        guac_display* display, guac_display_layer* parent, int parent_width,
+        int parent_height, int visible_area);
 
 /**
  * Frees the given scrollbar.
@@ -242,35 +271,14 @@ guac_terminal_scrollbar* guac_terminal_scrollbar_alloc(guac_client* client,
 void guac_terminal_scrollbar_free(guac_terminal_scrollbar* scrollbar);
 
 /**
- * Flushes the render state of the given scrollbar, updating the remote display
- * accordingly.
- *
- * This may cause instructions to be written to the client's socket, but the
- * client's socket will not be automatically flushed.
+ * Flushes the render state of the given scrollbar into the pending frame of
+ * the guac_display containing its layers.
  *
  * @param scrollbar
  *     The scrollbar whose render state is to be flushed.
  */
 void guac_terminal_scrollbar_flush(guac_terminal_scrollbar* scrollbar);
 
-/**
- * Forces a complete redraw / resync of scrollbar state for all joining users
- * associated with the provided socket, sending the necessary instructions to
- * completely recreate and redraw the scrollbar rendering over the given
- * socket.
- *
- * @param scrollbar
- *     The scrollbar to sync to the given users.
- *
- * @param client
- *     The client associated with the joining users.
- *
- * @param socket
- *     The socket over which any necessary instructions should be sent.
- */
-void guac_terminal_scrollbar_dup(guac_terminal_scrollbar* scrollbar,
-        guac_client* client, guac_socket* socket);
-
 /**
  * Sets the minimum and maximum allowed scroll values of the given scrollbar
  * to the given values. If necessary, the current value of the scrollbar will
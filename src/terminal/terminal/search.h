@@ -0,0 +1,99 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_TERMINAL_SEARCH_H
+#define GUAC_TERMINAL_SEARCH_H
+
+/**
+ * Functions related to searching the contents of a terminal, including its
+ * scrollback, for text.
+ *
+ * @file search.h
+ */
+
+#include "terminal.h"
+
+#include <stdbool.h>
+
+/**
+ * The maximum length of a search query, in codepoints.
+ */
+#define GUAC_TERMINAL_SEARCH_MAX_LENGTH 256
+
+/**
+ * Searches the contents of the given terminal for the given text,
+ * highlighting the match found (if any) as a committed selection and
+ * scrolling the display such that the match is visible. If a search is
+ * already in progress, the search continues from the start of the current
+ * match, such that extending the query refines the current match (as in an
+ * incremental search). Otherwise, the search begins at the bottom of the
+ * terminal. Matching is case-insensitive unless the query contains uppercase
+ * characters. This function should only be invoked while the guac_terminal
+ * is locked through a call to guac_terminal_lock().
+ *
+ * @param terminal
+ *     The terminal to search.
+ *
+ * @param query
+ *     The text to search for, as a null-terminated UTF-8 string. Text beyond
+ *     GUAC_TERMINAL_SEARCH_MAX_LENGTH codepoints is ignored.
+ *
+ * @param backward
+ *     true if the search should proceed toward older rows (upward), false if
+ *     the search should proceed toward newer rows (downward).
+ *
+ * @return
+ *     true if a match was found, false otherwise.
+ */
+bool guac_terminal_search(guac_terminal* terminal, const char* query,
+        bool backward);
+
+/**
+ * Moves to the next match of the search in progress, in the given
+ * direction, highlighting that match and scrolling the display such that it
+ * is visible. If no further match exists in that direction, the current
+ * match remains highlighted. This function should only be invoked while the
+ * guac_terminal is locked through a call to guac_terminal_lock().
+ *
+ * @param terminal
+ *     The terminal to search.
+ *
+ * @param backward
+ *     true if the search should proceed toward older rows (upward), false if
+ *     the search should proceed toward newer rows (downward).
+ *
+ * @return
+ *     true if another match was found, false otherwise (including if no
+ *     search is in progress).
+ */
+bool guac_terminal_search_next(guac_terminal* terminal, bool backward);
+
+/**
+ * Ends the search in progress, if any. The current match, if any, remains
+ * highlighted until modified or otherwise deselected. This function should
+ * only be invoked while the guac_terminal is locked through a call to
+ * guac_terminal_lock().
+ *
+ * @param terminal
+ *     The terminal whose search should end.
+ */
+void guac_terminal_search_end(guac_terminal* terminal);
+
+#endif
+
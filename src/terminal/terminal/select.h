@@ -116,6 +116,38 @@ void guac_terminal_select_update(guac_terminal* terminal, int row, int column,
  */
 void guac_terminal_select_resume(guac_terminal* terminal, int row, int column,
         guac_terminal_column_side side);
+
+/**
+ * Highlights the given range of characters as a committed selection, as if
+ * the range had been selected by the user, without storing the selected
+ * character data within the clipboard. Any existing selection is replaced.
+ * This function should only be invoked while the guac_terminal is locked
+ * through a call to guac_terminal_lock().
+ *
+ * @param terminal
+ *     The guac_terminal instance associated with the text being selected.
+ *
+ * @param start_row
+ *     The row number of the first character to select, where the first
+ *     (top-most) row in the terminal is row 0. Rows within the scrollback
+ *     buffer (above the top-most row of the terminal) will be negative.
+ *
+ * @param start_column
+ *     The column number of the first character to select, where the first
+ *     (left-most) column in the terminal is column 0. If this column contains
+ *     part of a multi-column character, the entire character is selected.
+ *
+ * @param end_row
+ *     The row number of the last character to select, inclusive.
+ *
+ * @param end_column
+ *     The column number of the last character to select, inclusive. If this
+ *     column contains part of a multi-column character, the entire character
+ *     is selected.
+ */
+void guac_terminal_select_range(guac_terminal* terminal, int start_row,
+        int start_column, int end_row, int end_column);
+
 /**
  * Ends text selection, removing any highlight and storing the selected
  * character data within the clipboard associated with the given terminal. If
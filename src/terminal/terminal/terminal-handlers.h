@@ -44,6 +44,30 @@
  */
 int guac_terminal_echo(guac_terminal* term, unsigned char c);
 
+/**
+ * Echoes the leading run of printable ASCII characters within the given
+ * buffer to the terminal in bulk, exactly as if each character had been
+ * passed to guac_terminal_echo() individually. Nothing is echoed if the
+ * buffer does not begin with printable ASCII, or if those characters could
+ * not be written verbatim (a pipe stream is open, insert mode is enabled, or
+ * the active character set is not the default).
+ *
+ * @param term
+ *     The terminal that received the given data. The terminal must currently
+ *     be using guac_terminal_echo() as its character handler.
+ *
+ * @param buffer
+ *     The data received by the given terminal.
+ *
+ * @param length
+ *     The number of bytes of data within the buffer.
+ *
+ * @return
+ *     The number of bytes echoed, which may be zero.
+ */
+int guac_terminal_echo_ascii(guac_terminal* term, const char* buffer,
+        int length);
+
 /**
  * Handles any characters which follow an ANSI ESC (0x1B) character.
  *
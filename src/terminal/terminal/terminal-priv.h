@@ -21,15 +21,17 @@
 #define GUAC_TERMINAL_PRIV_H
 
 #include "common/clipboard.h"
-#include "common/cursor.h"
 #include "buffer.h"
 #include "display.h"
 #include "scrollbar.h"
+#include "search.h"
 #include "terminal.h"
 #include "typescript.h"
 #include "selection-point.h"
 
+#include <guacamole/display.h>
 #include <guacamole/flag.h>
+#include <guacamole/timestamp.h>
 
 /**
  * The bitwise flag set on the modified flag of guac_terminal when the terminal
@@ -101,6 +103,31 @@ struct guac_terminal {
       */
     guac_flag modified;
 
+    /**
+     * The number of bytes of output received through guac_terminal_write()
+     * since the last frame was flushed.
+     */
+    int unflushed_output;
+
+    /**
+     * Whether output is currently arriving faster than frames can be flushed.
+     * While flooding, character operations update only the terminal buffer,
+     * and the visible display is redrawn from the final buffer state when the
+     * next frame is flushed. This avoids repeatedly updating and scrolling
+     * display operations for rows that will never be visible. Flooding begins
+     * once more than a screenful of output has been received within a single
+     * frame.
+     */
+    bool flooding;
+
+    /**
+     * The time at which a key was last pressed by any user. Any output
+     * received after a keystroke that has not yet been reflected in a frame
+     * is most likely the echo of that keystroke, and is flushed without
+     * waiting for further output.
+     */
+    guac_timestamp last_key_timestamp;
+
     /**
      * Pipe which will be the source of user input. When a terminal code
      * generates synthesized user input, that data will be written to
@@ -153,9 +180,12 @@ struct guac_terminal {
     guac_terminal_typescript* typescript;
 
     /**
-     * Terminal-wide mouse cursor, synchronized across all users.
+     * The guac_display which receives all graphical updates to the terminal,
+     * including the mouse cursor, and which is responsible for sending those
+     * updates to all users. Frames are ended by the terminal thread, and no
+     * guac_display_render_thread is used.
      */
-    guac_common_cursor* cursor;
+    guac_display* graphical_display;
 
     /**
      * Graphical representation of the current scroll state.
@@ -328,6 +358,13 @@ struct guac_terminal {
      */
     guac_terminal_buffer* current_buffer;
 
+    /**
+     * The number of bytes of memory allocated for the normal and alternate
+     * buffers as most recently attributed to the guac_client via
+     * guac_client_account_memory().
+     */
+    size_t accounted_memory;
+
     /**
      * Automatically place a tabstop every N characters. If zero, then no
      * tabstops exist automatically.
@@ -396,6 +433,41 @@ struct guac_terminal {
      */
     int selection_end_column;
 
+    /**
+     * The query of the search in progress, as an array of codepoints which
+     * have already been converted as required for comparison.
+     */
+    int search_query[GUAC_TERMINAL_SEARCH_MAX_LENGTH];
+
+    /**
+     * The number of codepoints within search_query, or zero if no search is
+     * in progress.
+     */
+    int search_length;
+
+    /**
+     * Whether the search in progress ignores case.
+     */
+    bool search_ignore_case;
+
+    /**
+     * Whether the search in progress has a highlighted match at the current
+     * search position.
+     */
+    bool search_matched;
+
+    /**
+     * The row at which the current match starts, or from which the search
+     * in progress will continue.
+     */
+    int search_row;
+
+    /**
+     * The column at which the current match starts, or from which the search
+     * in progress will continue.
+     */
+    int search_column;
+
     /**
      * Whether the cursor (arrow) keys should send cursor sequences
      * or application sequences (DECCKM).
@@ -536,6 +608,31 @@ void guac_terminal_reset(guac_terminal* term);
  */
 int guac_terminal_set(guac_terminal* term, int row, int col, int codepoint);
 
+/**
+ * Sets consecutive characters starting at the given row and column to each of
+ * the given printable ASCII characters, using the current attributes. This is
+ * equivalent to invoking guac_terminal_set() once for each character, but
+ * updates the terminal buffer only once.
+ *
+ * @param term
+ *     The terminal to modify.
+ *
+ * @param row
+ *     The row to modify.
+ *
+ * @param col
+ *     The column that should receive the first character.
+ *
+ * @param text
+ *     The printable ASCII characters to store. These characters MUST all
+ *     fit within the given row.
+ *
+ * @param length
+ *     The number of characters to store.
+ */
+void guac_terminal_set_ascii(guac_terminal* term, int row, int col,
+        const char* text, int length);
+
 /**
  * Clears the given region within a single row.
  */
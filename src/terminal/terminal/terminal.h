@@ -27,6 +27,8 @@
  * @file terminal.h
  */
 
+#include "typescript.h"
+
 #include <pthread.h>
 #include <stdbool.h>
 
@@ -86,6 +88,13 @@
  */
 #define GUAC_TERMINAL_FRAME_TIMEOUT 10
 
+/**
+ * The maximum amount of additional time to extend a single frame while
+ * output is flooding the terminal, to allow clients that are lagging behind
+ * to catch up, in milliseconds.
+ */
+#define GUAC_TERMINAL_MAX_LAG_COMPENSATION 500
+
 /**
  * The maximum number of custom tab stops.
  */
@@ -366,6 +375,23 @@ int guac_terminal_render_frame(guac_terminal* terminal);
  */
 int guac_terminal_read_stdin(guac_terminal* terminal, char* c, int size);
 
+/**
+ * Returns the file descriptor from which guac_terminal_read_stdin() reads,
+ * such that callers handling terminal I/O from a single thread may wait for
+ * input to become available with poll() alongside other file descriptors,
+ * rather than blocking within guac_terminal_read_stdin(). Once poll()
+ * reports that the file descriptor is readable, guac_terminal_read_stdin()
+ * will not block.
+ *
+ * @param terminal
+ *     The terminal whose STDIN file descriptor should be returned.
+ *
+ * @return
+ *     The file descriptor from which terminal input is read, or -1 if the
+ *     terminal has been stopped.
+ */
+int guac_terminal_get_stdin_fd(guac_terminal* terminal);
+
 /**
  * Notifies the terminal that rendering should begin and that user input should
  * now be accepted. This function must be invoked following terminal creation
@@ -595,6 +621,34 @@ int guac_terminal_write(guac_terminal* term, const char* buffer, int length);
 int guac_terminal_send_stream(guac_terminal* term, guac_user* user,
         guac_stream* stream);
 
+/**
+ * Initializes the handlers of the given guac_stream such that each blob
+ * received along the stream is used as a query to search the contents of
+ * the terminal, including its scrollback. The first match is highlighted
+ * and scrolled into view, with each blob that changes the query refining
+ * the search from the current match and each blob that repeats the query
+ * advancing to the next older match. The search ends when the stream is
+ * closed through receiving an "end" instruction.
+ *
+ * Calling this function will overwrite the data member of the given
+ * guac_stream.
+ *
+ * @param term
+ *     The terminal emulator which should be searched.
+ *
+ * @param user
+ *     The user that opened the stream.
+ *
+ * @param stream
+ *     The guac_stream which will provide the search queries.
+ *
+ * @return
+ *     Zero if the stream has successfully been configured to search the
+ *     terminal, non-zero otherwise.
+ */
+int guac_terminal_search_stream(guac_terminal* term, guac_user* user,
+        guac_stream* stream);
+
 /**
  * Sends data through STDIN as if typed by the user, using the format string
  * given and any args (similar to printf). If terminal input is currently
@@ -752,8 +806,9 @@ void guac_terminal_clipboard_append(guac_terminal* terminal,
 void guac_terminal_remove_user(guac_terminal* terminal, guac_user* user);
 
 /**
- * Requests that the terminal write all output to a pair of typescript
- * files within the given path and using the given base name. If
+ * Requests that the terminal write all output to a typescript (a pair of
+ * files, or a single combined file, depending on the requested format) within
+ * the given path and using the given base name. If
  * allow_write_existing is non-zero, these may be existing files; otherwise,
  * the existing files may not be written to, and a non-zero value will be
  * returned.
@@ -785,12 +840,21 @@ void guac_terminal_remove_user(guac_terminal* terminal, guac_user* user);
  *     Non-zero if writing to existing files should be allowed, or zero
  *     otherwise.
  *
+ * @param format
+ *     The layout of the files that should make up the typescript.
+ *
+ * @param compress
+ *     Non-zero if the typescript files should be compressed with zstd, zero
+ *     otherwise. If zstd support is not available, a warning is logged and
+ *     the typescript is written uncompressed.
+ *
  * @return
  *     Zero if the typescript files have been successfully created and a
  *     typescript will be written, non-zero otherwise.
  */
 int guac_terminal_create_typescript(guac_terminal* term, const char* path,
-        const char* name, int create_path, int allow_write_existing);
+        const char* name, int create_path, int allow_write_existing,
+        guac_terminal_typescript_format format, int compress);
 
 /**
  * Immediately applies the given color scheme to the given terminal, overriding
@@ -28,6 +28,10 @@
  */
 
 #include <guacamole/timestamp.h>
+#include <guacamole/user.h>
+
+#include <pthread.h>
+#include <stddef.h>
 
 /**
  * A NULL-terminated string of raw bytes which should be written at the
@@ -74,17 +78,84 @@
  */
 #define GUAC_TERMINAL_TYPESCRIPT_TIMING_SUFFIX "timing"
 
+/**
+ * A NULL-terminated string of raw bytes which is written at the beginning of
+ * any typescript using the GUAC_TERMINAL_TYPESCRIPT_FORMAT_COMBINED format,
+ * in place of GUAC_TERMINAL_TYPESCRIPT_HEADER.
+ */
+#define GUAC_TERMINAL_TYPESCRIPT_COMBINED_MAGIC "#guac-typescript 1\n"
+
+/**
+ * The maximum number of bytes of raw terminal output which may be buffered
+ * by the terminal before that output is handed off to the typescript's
+ * writer thread.
+ */
+#define GUAC_TERMINAL_TYPESCRIPT_BUFFER_SIZE 4096
+
+/**
+ * The size of the ring buffer through which flushed terminal output is
+ * handed off to the typescript's writer thread, in bytes. This MUST be a
+ * power of two. If the writer thread falls this far behind, flushing the
+ * typescript will block until space is available.
+ */
+#define GUAC_TERMINAL_TYPESCRIPT_RING_SIZE 1048576
+
+/**
+ * The maximum number of bytes that the writer thread will accumulate for
+ * any one file before writing those bytes (compressing them, if
+ * compression is enabled) with a single call to write().
+ */
+#define GUAC_TERMINAL_TYPESCRIPT_BATCH_SIZE 65536
+
+/**
+ * The maximum amount of time that the writer thread will hold a partial
+ * batch of output before writing it, in milliseconds.
+ */
+#define GUAC_TERMINAL_TYPESCRIPT_BATCH_DURATION 1000
+
+/**
+ * The zstd compression level used for compressed typescripts.
+ */
+#define GUAC_TERMINAL_TYPESCRIPT_COMPRESSION_LEVEL 3
+
+/**
+ * The layout of the files that make up a typescript.
+ */
+typedef enum guac_terminal_typescript_format {
+
+    /**
+     * A data file containing raw terminal output, plus a separate timing
+     * file, as produced by script and understood by scriptreplay. This is the
+     * default.
+     */
+    GUAC_TERMINAL_TYPESCRIPT_FORMAT_SPLIT,
+
+    /**
+     * A single file beginning with GUAC_TERMINAL_TYPESCRIPT_COMBINED_MAGIC,
+     * followed by zero or more records. Each record is a line of timing
+     * information identical to a line of the timing file of the split
+     * format ("DELAY LENGTH\n"), immediately followed by exactly LENGTH bytes
+     * of raw terminal output.
+     */
+    GUAC_TERMINAL_TYPESCRIPT_FORMAT_COMBINED
+
+} guac_terminal_typescript_format;
+
 /**
  * An active typescript, consisting of a data file (raw terminal output) and
- * timing file (related timestamps and byte counts).
+ * timing file (related timestamps and byte counts), or of a single combined
+ * file containing both. Output is buffered by the terminal and periodically
+ * handed off through a ring buffer to a dedicated writer thread, such that
+ * the terminal never waits on the underlying files unless that ring buffer
+ * is full.
  */
 typedef struct guac_terminal_typescript {
 
     /**
-     * Buffer of raw terminal output which has not yet been written to the
-     * data file.
+     * Buffer of raw terminal output which has not yet been handed off to the
+     * writer thread.
      */
-    char buffer[4096];
+    char buffer[GUAC_TERMINAL_TYPESCRIPT_BUFFER_SIZE];
 
     /**
      * The number of bytes currently stored in the buffer.
@@ -99,7 +170,8 @@ typedef struct guac_terminal_typescript {
 
     /**
      * The filename of the file (excluding path) which will contain the timing
-     * information for this typescript.
+     * information for this typescript. If the typescript uses the combined
+     * format, this will be an empty string.
      */
     char timing_filename[GUAC_TERMINAL_TYPESCRIPT_MAX_NAME_LENGTH];
 
@@ -112,7 +184,8 @@ typedef struct guac_terminal_typescript {
     /**
      * The file descriptor of the file into which timing information
      * (timestamps and byte counts) related to the raw terminal output in the
-     * data file should be written.
+     * data file should be written. If the typescript uses the combined
+     * format, this will be -1.
      */
     int timing_fd;
 
@@ -122,16 +195,105 @@ typedef struct guac_terminal_typescript {
      */
     guac_timestamp last_flush;
 
+    /**
+     * The layout of the files that make up this typescript.
+     */
+    guac_terminal_typescript_format format;
+
+    /**
+     * Non-zero if the contents of each file of this typescript are written
+     * as a series of zstd frames, zero otherwise. If zstd support was not
+     * available at build time, this is always zero.
+     */
+    int compress;
+
+    /**
+     * The zstd compression context (ZSTD_CCtx) used by the writer thread to
+     * compress output, or NULL if compression is not enabled.
+     */
+    void* zstd;
+
+    /**
+     * Ring buffer of GUAC_TERMINAL_TYPESCRIPT_RING_SIZE bytes containing
+     * flushed output that has not yet been consumed by the writer thread.
+     * Each flush is stored as a guac_terminal_typescript_record followed by
+     * the flushed bytes.
+     */
+    char* ring;
+
+    /**
+     * The total number of bytes ever published to the ring buffer by the
+     * terminal. This value is only modified by the terminal and is read and
+     * written atomically.
+     */
+    size_t head;
+
+    /**
+     * The total number of bytes ever consumed from the ring buffer by the
+     * writer thread. This value is only modified by the writer thread and is
+     * read and written atomically.
+     */
+    size_t tail;
+
+    /**
+     * Lock which guards waiting on data_available and space_available, as
+     * well as the value of stopping.
+     */
+    pthread_mutex_t state_lock;
+
+    /**
+     * Condition which is signalled when data is published to the ring
+     * buffer, or when the writer thread should stop.
+     */
+    pthread_cond_t data_available;
+
+    /**
+     * Condition which is signalled when the writer thread consumes data from
+     * the ring buffer, or when writing has failed.
+     */
+    pthread_cond_t space_available;
+
+    /**
+     * Non-zero if the writer thread is waiting (or about to wait) on
+     * data_available. This value is read and written atomically.
+     */
+    int writer_waiting;
+
+    /**
+     * Non-zero if the terminal is waiting (or about to wait) on
+     * space_available. This value is read and written atomically.
+     */
+    int producer_waiting;
+
+    /**
+     * Non-zero if writing to any file of this typescript has failed, in
+     * which case all further output is discarded. This value is read and
+     * written atomically.
+     */
+    int failed;
+
+    /**
+     * Non-zero if the typescript is being freed, and the writer thread should
+     * exit after writing everything remaining within the ring buffer.
+     */
+    int stopping;
+
+    /**
+     * The thread which consumes the ring buffer, writing its contents to the
+     * files of this typescript.
+     */
+    pthread_t writer;
+
 } guac_terminal_typescript;
 
 /**
- * Creates a pair of typescript files within the given path and using the
+ * Creates the files of a new typescript within the given path and using the
  * given base name, returning an abstraction which represents those files.
  * Terminal output will be written to these files, along with timing
- * information. If the create_path flag is non-zero, the given path will be
- * created if it does not yet exist. If allow_write_existing is non-zero,
- * these may be existing files; otherwise, any existing file will cause this
- * function to fail, returning NULL.
+ * information, by a dedicated writer thread. If the create_path flag is
+ * non-zero, the given path will be created if it does not yet exist. If
+ * allow_write_existing is non-zero, these may be existing files; otherwise,
+ * any existing file will cause this function to fail, returning NULL.
  *
  * @param path
  *     The full absolute path to a directory in which the typescript files
@@ -150,12 +312,21 @@ typedef struct guac_terminal_typescript {
  *     Non-zero if writing to existing files should be allowed, or zero
  *     otherwise.
  *
+ * @param format
+ *     The layout of the files that should make up the typescript.
+ *
+ * @param compress
+ *     Non-zero if the typescript files should be compressed with zstd, zero
+ *     otherwise. If zstd support is not available, this is ignored, and the
+ *     compress member of the returned typescript will be zero.
+ *
  * @return
  *     A new guac_terminal_typescript representing the typescript files
  *     requested, or NULL if creation of the typescript files failed.
  */
 guac_terminal_typescript* guac_terminal_typescript_alloc(const char* path,
-        const char* name, int create_path, int allow_write_existing);
+        const char* name, int create_path, int allow_write_existing,
+        guac_terminal_typescript_format format, int compress);
 
 /**
  * Writes a single byte of terminal data to the typescript, flushing and
@@ -172,8 +343,11 @@ void guac_terminal_typescript_write(guac_terminal_typescript* typescript,
         char c);
 
 /**
- * Flushes any pending data to the typescript, writing a new timestamp to the
- * timing file if any data was flushed.
+ * Flushes any pending data to the typescript, handing that data off to the
+ * writer thread along with a new timestamp if any data was flushed. This
+ * function blocks only if the writer thread has fallen
+ * GUAC_TERMINAL_TYPESCRIPT_RING_SIZE bytes behind. If writing has failed,
+ * pending data is discarded.
  *
  * @param typescript
  *     The typescript which should be flushed.
@@ -182,13 +356,45 @@ void guac_terminal_typescript_flush(guac_terminal_typescript* typescript);
 
 /**
  * Frees all resources associated with the given typescript, flushing and
- * closing the data and timing files and freeing all related memory. If the
- * provided typescript is NULL, this function has no effect.
+ * closing the data and timing files and freeing all related memory. This
+ * function blocks until the writer thread has written all data flushed to
+ * the typescript. If the provided typescript is NULL, this function has no
+ * effect.
  *
  * @param typescript
  *     The typescript to free.
  */
 void guac_terminal_typescript_free(guac_terminal_typescript* typescript);
 
+/**
+ * Parses the given typescript format parameter ("split" or "combined"),
+ * returning the corresponding guac_terminal_typescript_format. If the
+ * parameter is blank or invalid, the default value is returned, and a
+ * message is logged for the given user.
+ *
+ * @param user
+ *     The user who submitted the given parameter values.
+ *
+ * @param arg_names
+ *     A NULL-terminated array containing the names of all expected
+ *     parameters, in order.
+ *
+ * @param argv
+ *     The values of all parameters submitted by the user.
+ *
+ * @param index
+ *     The index of the parameter to parse within argv.
+ *
+ * @param default_value
+ *     The format to return if the parameter is blank or invalid.
+ *
+ * @return
+ *     The parsed typescript format, or default_value if the parameter is
+ *     blank or invalid.
+ */
+guac_terminal_typescript_format guac_terminal_typescript_parse_args_format(
+        guac_user* user, const char** arg_names, const char** argv, int index,
+        guac_terminal_typescript_format default_value);
+
 #endif
 
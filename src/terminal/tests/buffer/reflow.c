@@ -0,0 +1,234 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "terminal/buffer.h"
+#include "terminal/types.h"
+
+#include <CUnit/CUnit.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * The number of rows within the buffer used by each test.
+ */
+#define TEST_REFLOW_ROWS 16
+
+/**
+ * The number of rows making up the screen within each test.
+ */
+#define TEST_REFLOW_HEIGHT 4
+
+/**
+ * The character used to fill cells which have never been written.
+ */
+static const guac_terminal_char test_reflow_default_char = {
+    .value = 0,
+    .attributes = {
+        .foreground = { .palette_index = 7 },
+        .background = { .palette_index = 0 }
+    },
+    .width = 1
+};
+
+/**
+ * Writes the given text to the given row of the buffer, starting at column
+ * zero, with each character occupying a single column.
+ *
+ * @param buffer
+ *     The buffer to write to.
+ *
+ * @param row
+ *     The row to write to.
+ *
+ * @param text
+ *     The text to write.
+ *
+ * @param wrapped
+ *     Whether the row should be marked as automatically wrapped onto the
+ *     following row.
+ */
+static void test_reflow_write(guac_terminal_buffer* buffer, int row,
+        const char* text, bool wrapped) {
+
+    guac_terminal_char character = test_reflow_default_char;
+
+    for (int column = 0; text[column] != '\0'; column++) {
+        character.value = text[column];
+        guac_terminal_buffer_set_columns(buffer, row, column, column, &character);
+    }
+
+    guac_terminal_buffer_set_wrapped(buffer, row, wrapped);
+
+}
+
+/**
+ * Verifies that the given row of the buffer begins with exactly the given
+ * text, followed only by blank cells, and has the given wrapped state.
+ *
+ * @param buffer
+ *     The buffer to verify.
+ *
+ * @param row
+ *     The row to verify.
+ *
+ * @param text
+ *     The text expected at the beginning of the row.
+ *
+ * @param wrapped
+ *     Whether the row is expected to be marked as wrapped.
+ */
+static void test_reflow_verify(guac_terminal_buffer* buffer, int row,
+        const char* text, bool wrapped) {
+
+    guac_terminal_char* characters;
+    bool is_wrapped;
+    int length = guac_terminal_buffer_get_columns(buffer, &characters,
+            &is_wrapped, row);
+
+    int text_length = strlen(text);
+    CU_ASSERT_TRUE_FATAL(length >= text_length);
+
+    for (int column = 0; column < text_length; column++)
+        CU_ASSERT_EQUAL(characters[column].value, text[column]);
+
+    for (int column = text_length; column < length; column++)
+        CU_ASSERT_EQUAL(characters[column].value, 0);
+
+    CU_ASSERT_EQUAL(is_wrapped, wrapped);
+
+}
+
+/**
+ * Verifies that narrowing the screen wraps long lines at the new width,
+ * moving rows which no longer fit into the scrollback.
+ */
+void test_buffer__reflow_narrow() {
+
+    guac_terminal_buffer* buffer =
+        guac_terminal_buffer_alloc(TEST_REFLOW_ROWS, &test_reflow_default_char);
+
+    test_reflow_write(buffer, 0, "abcdefgh", false);
+    test_reflow_write(buffer, 1, "ij", false);
+    test_reflow_write(buffer, 2, "klmnop", false);
+
+    int cursor_row = 2;
+    int cursor_col = 5;
+
+    int shift = guac_terminal_buffer_reflow(buffer, TEST_REFLOW_HEIGHT,
+            8, 4, &cursor_row, &cursor_col);
+
+    /* Five rows are now needed, one more than fits on screen */
+    CU_ASSERT_EQUAL(shift, 1);
+
+    test_reflow_verify(buffer, -1, "abcd", true);
+    test_reflow_verify(buffer,  0, "efgh", false);
+    test_reflow_verify(buffer,  1, "ij",   false);
+    test_reflow_verify(buffer,  2, "klmn", true);
+    test_reflow_verify(buffer,  3, "op",   false);
+
+    /* The cursor remains beneath the 'p' */
+    CU_ASSERT_EQUAL(cursor_row, 3);
+    CU_ASSERT_EQUAL(cursor_col, 1);
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
+/**
+ * Verifies that widening the screen joins rows which were automatically
+ * wrapped, without joining rows which ended normally.
+ */
+void test_buffer__reflow_widen() {
+
+    guac_terminal_buffer* buffer =
+        guac_terminal_buffer_alloc(TEST_REFLOW_ROWS, &test_reflow_default_char);
+
+    test_reflow_write(buffer, 0, "abcd", true);
+    test_reflow_write(buffer, 1, "efgh", true);
+    test_reflow_write(buffer, 2, "ij",   false);
+    test_reflow_write(buffer, 3, "kl",   false);
+
+    int cursor_row = 3;
+    int cursor_col = 2;
+
+    int shift = guac_terminal_buffer_reflow(buffer, TEST_REFLOW_HEIGHT,
+            4, 8, &cursor_row, &cursor_col);
+
+    CU_ASSERT_EQUAL(shift, 0);
+
+    test_reflow_verify(buffer, 0, "abcdefgh", true);
+    test_reflow_verify(buffer, 1, "ij", false);
+    test_reflow_verify(buffer, 2, "kl", false);
+    test_reflow_verify(buffer, 3, "",   false);
+
+    /* The cursor remains just past the end of the final line */
+    CU_ASSERT_EQUAL(cursor_row, 2);
+    CU_ASSERT_EQUAL(cursor_col, 2);
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
+/**
+ * Verifies that wide characters are never split across rows when rewrapped.
+ */
+void test_buffer__reflow_wide() {
+
+    guac_terminal_buffer* buffer =
+        guac_terminal_buffer_alloc(TEST_REFLOW_ROWS, &test_reflow_default_char);
+
+    test_reflow_write(buffer, 0, "abc", false);
+
+    guac_terminal_char wide = test_reflow_default_char;
+    wide.value = 0x4E2D;
+    wide.width = 2;
+    guac_terminal_buffer_set_columns(buffer, 0, 3, 4, &wide);
+
+    int cursor_row = 1;
+    int cursor_col = 0;
+
+    guac_terminal_buffer_reflow(buffer, TEST_REFLOW_HEIGHT,
+            8, 4, &cursor_row, &cursor_col);
+
+    guac_terminal_char* characters;
+    bool wrapped;
+
+    /* The wide character must move to the next row intact */
+    int length = guac_terminal_buffer_get_columns(buffer, &characters,
+            &wrapped, 0);
+    CU_ASSERT_TRUE_FATAL(length >= 4);
+    CU_ASSERT_EQUAL(characters[2].value, 'c');
+    CU_ASSERT_EQUAL(characters[3].value, 0);
+    CU_ASSERT_TRUE(wrapped);
+
+    length = guac_terminal_buffer_get_columns(buffer, &characters,
+            &wrapped, 1);
+    CU_ASSERT_TRUE_FATAL(length >= 2);
+    CU_ASSERT_EQUAL(characters[0].value, 0x4E2D);
+    CU_ASSERT_EQUAL(characters[1].value, GUAC_CHAR_CONTINUATION);
+    CU_ASSERT_FALSE(wrapped);
+
+    /* The cursor's empty row follows the rewrapped line */
+    CU_ASSERT_EQUAL(cursor_row, 2);
+    CU_ASSERT_EQUAL(cursor_col, 0);
+
+    guac_terminal_buffer_free(buffer);
+
+}
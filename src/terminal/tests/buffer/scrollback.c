@@ -0,0 +1,280 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "terminal/buffer.h"
+#include "terminal/types.h"
+
+#include <CUnit/CUnit.h>
+#include <stdbool.h>
+
+/**
+ * The number of rows within the buffer used by each test.
+ */
+#define TEST_BUFFER_ROWS 16
+
+/**
+ * The number of columns written to each row by each test.
+ */
+#define TEST_BUFFER_COLUMNS 80
+
+/**
+ * Returns the character that test_buffer_fill() stores at the given row and
+ * column.
+ *
+ * @param row
+ *     The row of the character.
+ *
+ * @param column
+ *     The column of the character.
+ *
+ * @return
+ *     The character expected at the given row and column.
+ */
+static guac_terminal_char test_buffer_char(int row, int column) {
+
+    guac_terminal_char character = {
+        .value = 'A' + ((row + column) % 26),
+        .attributes = {
+            .bold = (column / 10) % 2,
+            .underscore = row % 2,
+            .foreground = {
+                .palette_index = (column / 20) % 8,
+                .red = row * 8, .green = column, .blue = 0x40
+            },
+            .background = {
+                .palette_index = -1,
+                .red = 0x10, .green = 0x20, .blue = row
+            }
+        },
+        .width = 1
+    };
+
+    /* Include a wide character (and its continuation) on every row */
+    if (column == 40) {
+        character.value = 0x4E2D;
+        character.width = 2;
+    }
+    else if (column == 41)
+        character.value = GUAC_CHAR_CONTINUATION;
+
+    return character;
+
+}
+
+/**
+ * Writes distinct characters to the first TEST_BUFFER_COLUMNS columns of each
+ * of the given number of rows, starting at row zero.
+ *
+ * @param buffer
+ *     The buffer to write to.
+ *
+ * @param rows
+ *     The number of rows to write.
+ */
+static void test_buffer_fill(guac_terminal_buffer* buffer, int rows) {
+
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < TEST_BUFFER_COLUMNS; column++) {
+
+            guac_terminal_char character = test_buffer_char(row, column);
+            if (character.value == GUAC_CHAR_CONTINUATION)
+                continue;
+
+            guac_terminal_buffer_set_columns(buffer, row, column,
+                    column + character.width - 1, &character);
+
+        }
+    }
+
+}
+
+/**
+ * Verifies that the given row of the buffer contains exactly the characters
+ * that test_buffer_fill() would have written to the given original row when
+ * the buffer was filled.
+ *
+ * @param buffer
+ *     The buffer to verify.
+ *
+ * @param row
+ *     The current index of the row to verify.
+ *
+ * @param original_row
+ *     The index of the row at the time it was written.
+ */
+static void test_buffer_verify(guac_terminal_buffer* buffer, int row,
+        int original_row) {
+
+    guac_terminal_char* characters;
+    int length = guac_terminal_buffer_get_columns(buffer, &characters, NULL, row);
+    CU_ASSERT_TRUE_FATAL(length >= TEST_BUFFER_COLUMNS);
+
+    for (int column = 0; column < TEST_BUFFER_COLUMNS; column++) {
+
+        guac_terminal_char expected = test_buffer_char(original_row, column);
+        guac_terminal_char* actual = &characters[column];
+
+        CU_ASSERT_EQUAL(actual->value, expected.value);
+
+        /* Continuation characters share the attributes of the character they
+         * continue */
+        if (expected.value == GUAC_CHAR_CONTINUATION)
+            expected.attributes = test_buffer_char(original_row, column - 1).attributes;
+        else
+            CU_ASSERT_EQUAL(actual->width, expected.width);
+
+        CU_ASSERT_EQUAL(actual->attributes.bold, expected.attributes.bold);
+        CU_ASSERT_EQUAL(actual->attributes.underscore, expected.attributes.underscore);
+        CU_ASSERT_EQUAL(actual->attributes.foreground.palette_index,
+                expected.attributes.foreground.palette_index);
+        CU_ASSERT_EQUAL(actual->attributes.foreground.red,
+                expected.attributes.foreground.red);
+        CU_ASSERT_EQUAL(actual->attributes.foreground.green,
+                expected.attributes.foreground.green);
+        CU_ASSERT_EQUAL(actual->attributes.background.blue,
+                expected.attributes.background.blue);
+
+    }
+
+}
+
+/**
+ * Verifies that rows scrolled into the scrollback region of a buffer retain
+ * their exact contents, including wide characters and attributes, when
+ * accessed again.
+ */
+void test_buffer__scrollback_contents() {
+
+    guac_terminal_char default_char = {
+        .value = 0,
+        .attributes = {
+            .foreground = { .palette_index = 7 },
+            .background = { .palette_index = 0 }
+        },
+        .width = 1
+    };
+
+    guac_terminal_buffer* buffer =
+        guac_terminal_buffer_alloc(TEST_BUFFER_ROWS, &default_char);
+
+    test_buffer_fill(buffer, 8);
+
+    /* Scroll all but the last written row out of view */
+    guac_terminal_buffer_scroll_up(buffer, 3);
+    guac_terminal_buffer_scroll_up(buffer, 4);
+
+    /* Every row must be unchanged, whether in view or not */
+    for (int row = 0; row < 8; row++)
+        test_buffer_verify(buffer, row - 7, row);
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
+/**
+ * Verifies that rows which scroll back into view after being within the
+ * scrollback region can still be modified normally.
+ */
+void test_buffer__scrollback_modify() {
+
+    guac_terminal_char default_char = {
+        .value = 0,
+        .attributes = {
+            .foreground = { .palette_index = 7 },
+            .background = { .palette_index = 0 }
+        },
+        .width = 1
+    };
+
+    guac_terminal_buffer* buffer =
+        guac_terminal_buffer_alloc(TEST_BUFFER_ROWS, &default_char);
+
+    test_buffer_fill(buffer, 4);
+    guac_terminal_buffer_scroll_up(buffer, 2);
+    guac_terminal_buffer_scroll_down(buffer, 2);
+
+    /* Overwrite part of a row which was previously scrolled out of view */
+    guac_terminal_char replacement = default_char;
+    replacement.value = '#';
+    guac_terminal_buffer_set_columns(buffer, 1, 0, 9, &replacement);
+
+    guac_terminal_char* characters;
+    int length = guac_terminal_buffer_get_columns(buffer, &characters, NULL, 1);
+    CU_ASSERT_TRUE_FATAL(length >= TEST_BUFFER_COLUMNS);
+
+    for (int column = 0; column < 10; column++)
+        CU_ASSERT_EQUAL(characters[column].value, '#');
+
+    guac_terminal_char expected = test_buffer_char(1, 10);
+    CU_ASSERT_EQUAL(characters[10].value, expected.value);
+
+    /* Other rows must be unaffected */
+    test_buffer_verify(buffer, 0, 0);
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
+/**
+ * Verifies that the character values of rows within the scrollback region
+ * can be read with guac_terminal_buffer_get_values(), and that doing so does
+ * not alter the rows read.
+ */
+void test_buffer__scrollback_values() {
+
+    guac_terminal_char default_char = {
+        .value = 0,
+        .attributes = {
+            .foreground = { .palette_index = 7 },
+            .background = { .palette_index = 0 }
+        },
+        .width = 1
+    };
+
+    guac_terminal_buffer* buffer =
+        guac_terminal_buffer_alloc(TEST_BUFFER_ROWS, &default_char);
+
+    test_buffer_fill(buffer, 8);
+    guac_terminal_buffer_set_wrapped(buffer, 2, true);
+    guac_terminal_buffer_scroll_up(buffer, 7);
+
+    int values[TEST_BUFFER_COLUMNS];
+    for (int row = 0; row < 8; row++) {
+
+        bool wrapped;
+        int length = guac_terminal_buffer_get_values(buffer, row - 7, values,
+                TEST_BUFFER_COLUMNS, &wrapped);
+
+        CU_ASSERT_EQUAL_FATAL(length, TEST_BUFFER_COLUMNS);
+        CU_ASSERT_EQUAL(wrapped, row == 2);
+
+        for (int column = 0; column < TEST_BUFFER_COLUMNS; column++)
+            CU_ASSERT_EQUAL(values[column], test_buffer_char(row, column).value);
+
+    }
+
+    /* Rows must be otherwise unaffected */
+    for (int row = 0; row < 8; row++)
+        test_buffer_verify(buffer, row - 7, row);
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
@@ -17,28 +17,447 @@
  * under the License.
  */
 
+#include "config.h"
 #include "common/io.h"
 #include "terminal/typescript.h"
 
 #include <guacamole/file.h>
 #include <guacamole/mem.h>
 #include <guacamole/timestamp.h>
+#include <guacamole/user.h>
+
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
+/**
+ * The header preceding each flush of terminal output within the ring buffer
+ * of a typescript.
+ */
+typedef struct guac_terminal_typescript_record {
+
+    /**
+     * The number of milliseconds elapsed between the previous flush and this
+     * flush, limited to GUAC_TERMINAL_TYPESCRIPT_MAX_DELAY.
+     */
+    int elapsed_time;
+
+    /**
+     * The number of bytes of terminal output following this header.
+     */
+    int length;
+
+} guac_terminal_typescript_record;
+
+/**
+ * The maximum length of a single line of timing information, in bytes.
+ */
+#define GUAC_TERMINAL_TYPESCRIPT_MAX_TIMING_LENGTH 32
+
+/**
+ * Output accumulated by the writer thread for a single file of a typescript,
+ * which has not yet been written to that file.
+ */
+typedef struct guac_terminal_typescript_batch {
+
+    /**
+     * The file descriptor of the file that this batch will be written to.
+     */
+    int fd;
+
+    /**
+     * The accumulated output, GUAC_TERMINAL_TYPESCRIPT_BATCH_SIZE bytes in
+     * size.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes currently stored within buffer.
+     */
+    size_t length;
+
+} guac_terminal_typescript_batch;
+
+/**
+ * Copies data into the ring buffer of the given typescript at the given
+ * absolute position, wrapping around the end of the ring buffer as
+ * necessary. Only the terminal may call this function, and only for space
+ * that is known to be free.
+ *
+ * @param typescript
+ *     The typescript whose ring buffer should receive the data.
+ *
+ * @param position
+ *     The absolute position (as used by head and tail) that the data should
+ *     be copied to.
+ *
+ * @param buf
+ *     The data to copy.
+ *
+ * @param length
+ *     The number of bytes of data within buf.
+ */
+static void guac_terminal_typescript_ring_put(
+        guac_terminal_typescript* typescript, size_t position,
+        const void* buf, size_t length) {
+
+    size_t offset = position & (GUAC_TERMINAL_TYPESCRIPT_RING_SIZE - 1);
+    size_t first = GUAC_TERMINAL_TYPESCRIPT_RING_SIZE - offset;
+
+    if (first > length)
+        first = length;
+
+    memcpy(typescript->ring + offset, buf, first);
+    memcpy(typescript->ring, (const char*) buf + first, length - first);
+
+}
+
+/**
+ * Copies data out of the ring buffer of the given typescript from the given
+ * absolute position, wrapping around the end of the ring buffer as
+ * necessary. Only the writer thread may call this function, and only for
+ * data that is known to have been published.
+ *
+ * @param typescript
+ *     The typescript whose ring buffer contains the data.
+ *
+ * @param position
+ *     The absolute position (as used by head and tail) of the data to copy.
+ *
+ * @param buf
+ *     The buffer that should receive the data.
+ *
+ * @param length
+ *     The number of bytes of data to copy.
+ */
+static void guac_terminal_typescript_ring_get(
+        guac_terminal_typescript* typescript, size_t position,
+        void* buf, size_t length) {
+
+    size_t offset = position & (GUAC_TERMINAL_TYPESCRIPT_RING_SIZE - 1);
+    size_t first = GUAC_TERMINAL_TYPESCRIPT_RING_SIZE - offset;
+
+    if (first > length)
+        first = length;
+
+    memcpy(buf, typescript->ring + offset, first);
+    memcpy((char*) buf + first, typescript->ring, length - first);
+
+}
+
+/**
+ * Writes the contents of the given batch to its file, compressing those
+ * contents into a single zstd frame if compression is enabled, and empties
+ * the batch. If writing fails, the typescript is marked as failed, and all
+ * further output is discarded.
+ *
+ * @param typescript
+ *     The typescript that the batch belongs to.
+ *
+ * @param batch
+ *     The batch to write.
+ *
+ * @param compressed
+ *     A buffer of at least ZSTD_compressBound(GUAC_TERMINAL_TYPESCRIPT_BATCH_SIZE)
+ *     bytes which may be used to hold compressed output, or NULL if
+ *     compression is not enabled.
+ */
+static void guac_terminal_typescript_write_batch(
+        guac_terminal_typescript* typescript,
+        guac_terminal_typescript_batch* batch, char* compressed) {
+
+    if (batch->length == 0)
+        return;
+
+    char* output = batch->buffer;
+    size_t length = batch->length;
+    batch->length = 0;
+
+    /* Output is discarded once writing has failed */
+    if (__atomic_load_n(&typescript->failed, __ATOMIC_SEQ_CST))
+        return;
+
+#ifdef ENABLE_ZSTD
+    /* Each batch is a separate frame, as a stream of concatenated zstd
+     * frames is itself a valid zstd stream */
+    if (compressed != NULL) {
+
+        size_t compressed_length = ZSTD_compressCCtx(typescript->zstd,
+                compressed,
+                ZSTD_compressBound(GUAC_TERMINAL_TYPESCRIPT_BATCH_SIZE),
+                output, length, GUAC_TERMINAL_TYPESCRIPT_COMPRESSION_LEVEL);
+
+        if (ZSTD_isError(compressed_length))
+            goto failed;
+
+        output = compressed;
+        length = compressed_length;
+
+    }
+#endif
+
+    if (guac_common_write(batch->fd, output, length) < 0)
+        goto failed;
+
+    return;
+
+failed:
+
+    /* Wake the terminal if it is waiting for space that will now never
+     * become available */
+    pthread_mutex_lock(&typescript->state_lock);
+    __atomic_store_n(&typescript->failed, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&typescript->space_available);
+    pthread_mutex_unlock(&typescript->state_lock);
+
+}
+
+/**
+ * Appends the given data to the given batch. The batch MUST have enough
+ * space for the data.
+ *
+ * @param batch
+ *     The batch to append the data to.
+ *
+ * @param buf
+ *     The data to append.
+ *
+ * @param length
+ *     The number of bytes of data within buf.
+ */
+static void guac_terminal_typescript_batch_append(
+        guac_terminal_typescript_batch* batch, const void* buf,
+        size_t length) {
+    memcpy(batch->buffer + batch->length, buf, length);
+    batch->length += length;
+}
+
+/**
+ * Moves the record at the tail of the ring buffer of the given typescript
+ * into the given batches, first writing the batches to their files if they
+ * lack space for the record. The space within the ring buffer occupied by
+ * the record is released to the terminal.
+ *
+ * @param typescript
+ *     The typescript whose ring buffer contains at least one record.
+ *
+ * @param data
+ *     The batch for the data file.
+ *
+ * @param timing
+ *     The batch for the timing file. For combined typescripts, this is the
+ *     same as data.
+ *
+ * @param compressed
+ *     A buffer which may be used to compress batches, as required by
+ *     guac_terminal_typescript_write_batch().
+ */
+static void guac_terminal_typescript_consume(
+        guac_terminal_typescript* typescript,
+        guac_terminal_typescript_batch* data,
+        guac_terminal_typescript_batch* timing, char* compressed) {
+
+    guac_terminal_typescript_record record;
+    guac_terminal_typescript_ring_get(typescript, typescript->tail,
+            &record, sizeof(record));
+
+    /* Produce single line of timestamp output */
+    char timestamp_buffer[GUAC_TERMINAL_TYPESCRIPT_MAX_TIMING_LENGTH];
+    int timestamp_length = snprintf(timestamp_buffer, sizeof(timestamp_buffer),
+            "%0.6f %i\n", record.elapsed_time / 1000.0, record.length);
+
+    /* Calculate actual length of timestamp line */
+    if (timestamp_length > sizeof(timestamp_buffer))
+        timestamp_length = sizeof(timestamp_buffer);
+
+    /* Make room for the record within the batches, if necessary */
+    size_t timing_length = timestamp_length;
+    if (timing == data)
+        timing_length += record.length;
+
+    if (data->length + record.length > GUAC_TERMINAL_TYPESCRIPT_BATCH_SIZE
+            || timing->length + timing_length > GUAC_TERMINAL_TYPESCRIPT_BATCH_SIZE) {
+        guac_terminal_typescript_write_batch(typescript, timing, compressed);
+        guac_terminal_typescript_write_batch(typescript, data, compressed);
+    }
+
+    guac_terminal_typescript_batch_append(timing, timestamp_buffer,
+            timestamp_length);
+
+    guac_terminal_typescript_ring_get(typescript,
+            typescript->tail + sizeof(record),
+            data->buffer + data->length, record.length);
+    data->length += record.length;
+
+    /* Release the record to the terminal */
+    __atomic_store_n(&typescript->tail,
+            typescript->tail + sizeof(record) + record.length,
+            __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&typescript->producer_waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&typescript->state_lock);
+        pthread_cond_signal(&typescript->space_available);
+        pthread_mutex_unlock(&typescript->state_lock);
+    }
+
+}
+
+/**
+ * Thread which consumes the ring buffer of the given typescript, writing its
+ * contents to the typescript files in batches. Batches are written once they
+ * are full or have been held for GUAC_TERMINAL_TYPESCRIPT_BATCH_DURATION
+ * milliseconds. The thread exits once the typescript is being freed and
+ * everything flushed to the ring buffer has been written.
+ *
+ * @param arg
+ *     The guac_terminal_typescript to write.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_terminal_typescript_writer(void* arg) {
+
+    guac_terminal_typescript* typescript = (guac_terminal_typescript*) arg;
+
+    guac_terminal_typescript_batch data = {
+        .fd = typescript->data_fd,
+        .buffer = guac_mem_alloc(GUAC_TERMINAL_TYPESCRIPT_BATCH_SIZE)
+    };
+
+    guac_terminal_typescript_batch timing_storage = {
+        .fd = typescript->timing_fd
+    };
+
+    /* Timing information of combined typescripts is interleaved with the
+     * data itself */
+    guac_terminal_typescript_batch* timing = &data;
+    if (typescript->format == GUAC_TERMINAL_TYPESCRIPT_FORMAT_SPLIT) {
+        timing_storage.buffer = guac_mem_alloc(GUAC_TERMINAL_TYPESCRIPT_BATCH_SIZE);
+        timing = &timing_storage;
+    }
+
+    char* compressed = NULL;
+#ifdef ENABLE_ZSTD
+    if (typescript->zstd != NULL)
+        compressed = guac_mem_alloc(
+                ZSTD_compressBound(GUAC_TERMINAL_TYPESCRIPT_BATCH_SIZE));
+#endif
+
+    /* Write header */
+    if (typescript->format == GUAC_TERMINAL_TYPESCRIPT_FORMAT_SPLIT)
+        guac_terminal_typescript_batch_append(&data,
+                GUAC_TERMINAL_TYPESCRIPT_HEADER,
+                sizeof(GUAC_TERMINAL_TYPESCRIPT_HEADER) - 1);
+    else
+        guac_terminal_typescript_batch_append(&data,
+                GUAC_TERMINAL_TYPESCRIPT_COMBINED_MAGIC,
+                sizeof(GUAC_TERMINAL_TYPESCRIPT_COMBINED_MAGIC) - 1);
+
+    struct timespec deadline;
+    int held = 0;
+
+    for (;;) {
+
+        /* Move everything available into the current batches */
+        while (__atomic_load_n(&typescript->head, __ATOMIC_SEQ_CST)
+                != typescript->tail) {
+
+            /* Partial batches are held for only a limited time */
+            if (!held) {
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec += GUAC_TERMINAL_TYPESCRIPT_BATCH_DURATION / 1000;
+                held = 1;
+            }
+
+            guac_terminal_typescript_consume(typescript, &data, timing,
+                    compressed);
+
+        }
+
+        /* Wait for further data, exiting only once everything flushed prior
+         * to the typescript being freed has been consumed */
+        pthread_mutex_lock(&typescript->state_lock);
+        __atomic_store_n(&typescript->writer_waiting, 1, __ATOMIC_SEQ_CST);
+
+        int timed_out = 0;
+        while (__atomic_load_n(&typescript->head, __ATOMIC_SEQ_CST)
+                    == typescript->tail
+                && !typescript->stopping && !timed_out) {
+
+            if (!held)
+                pthread_cond_wait(&typescript->data_available,
+                        &typescript->state_lock);
+
+            else
+                timed_out = pthread_cond_timedwait(&typescript->data_available,
+                        &typescript->state_lock, &deadline) != 0;
+
+        }
+
+        __atomic_store_n(&typescript->writer_waiting, 0, __ATOMIC_SEQ_CST);
+
+        int done = typescript->stopping
+            && __atomic_load_n(&typescript->head, __ATOMIC_SEQ_CST)
+                == typescript->tail;
+
+        pthread_mutex_unlock(&typescript->state_lock);
+
+        if (done)
+            break;
+
+        if (timed_out) {
+            guac_terminal_typescript_write_batch(typescript, timing, compressed);
+            guac_terminal_typescript_write_batch(typescript, &data, compressed);
+            held = 0;
+        }
+
+    }
+
+    /* Write footer, making room for it if necessary */
+    if (typescript->format == GUAC_TERMINAL_TYPESCRIPT_FORMAT_SPLIT) {
+
+        if (data.length + sizeof(GUAC_TERMINAL_TYPESCRIPT_FOOTER) - 1
+                > GUAC_TERMINAL_TYPESCRIPT_BATCH_SIZE)
+            guac_terminal_typescript_write_batch(typescript, &data, compressed);
+
+        guac_terminal_typescript_batch_append(&data,
+                GUAC_TERMINAL_TYPESCRIPT_FOOTER,
+                sizeof(GUAC_TERMINAL_TYPESCRIPT_FOOTER) - 1);
+
+    }
+
+    /* Timing is written first such that the data file never describes less
+     * output than the timing file */
+    if (timing != &data)
+        guac_terminal_typescript_write_batch(typescript, timing, compressed);
+    guac_terminal_typescript_write_batch(typescript, &data, compressed);
+
+    guac_mem_free(compressed);
+    guac_mem_free(timing_storage.buffer);
+    guac_mem_free(data.buffer);
+    return NULL;
+
+}
+
 guac_terminal_typescript* guac_terminal_typescript_alloc(const char* path,
-        const char* name, int create_path, int allow_write_existing) {
+        const char* name, int create_path, int allow_write_existing,
+        guac_terminal_typescript_format format, int compress) {
 
     /* Allocate space for new typescript */
     guac_terminal_typescript* typescript =
-        guac_mem_alloc(sizeof(guac_terminal_typescript));
+        guac_mem_zalloc(sizeof(guac_terminal_typescript));
 
     guac_open_how data_how = {
         .oflags = O_CREAT | O_WRONLY,
@@ -60,35 +479,70 @@ guac_terminal_typescript* guac_terminal_typescript_alloc(const char* path,
         return NULL;
     }
 
-    /* Append suffix to basename */
-    if (snprintf(typescript->timing_filename, sizeof(typescript->timing_filename),
-                "%s.%s", typescript->data_filename, GUAC_TERMINAL_TYPESCRIPT_TIMING_SUFFIX)
-            >= sizeof(typescript->timing_filename)) {
-        close(typescript->data_fd);
-        guac_mem_free(typescript);
-        return NULL;
+    /* Combined typescripts have no separate timing file */
+    typescript->timing_fd = -1;
+    if (format == GUAC_TERMINAL_TYPESCRIPT_FORMAT_SPLIT) {
+
+        /* Append suffix to basename */
+        if (snprintf(typescript->timing_filename, sizeof(typescript->timing_filename),
+                    "%s.%s", typescript->data_filename, GUAC_TERMINAL_TYPESCRIPT_TIMING_SUFFIX)
+                >= sizeof(typescript->timing_filename)) {
+            close(typescript->data_fd);
+            guac_mem_free(typescript);
+            return NULL;
+        }
+
+        guac_open_how timing_how = {
+            .oflags = O_CREAT | O_WRONLY,
+            .mode = S_IRUSR | S_IWUSR | S_IRGRP
+        };
+
+        /* Attempt to open typescript timing file */
+        typescript->timing_fd = guac_openat(path, typescript->timing_filename, &timing_how);
+        if (typescript->timing_fd == -1) {
+            close(typescript->data_fd);
+            guac_mem_free(typescript);
+            return NULL;
+        }
+
     }
 
-    guac_open_how timing_how = {
-        .oflags = O_CREAT | O_WRONLY,
-        .mode = S_IRUSR | S_IWUSR | S_IRGRP
-    };
+    typescript->format = format;
 
-    /* Attempt to open typescript timing file */
-    typescript->timing_fd = guac_openat(path, typescript->timing_filename, &timing_how);
-    if (typescript->timing_fd == -1) {
-        close(typescript->data_fd);
-        guac_mem_free(typescript);
-        return NULL;
-    }
+#ifdef ENABLE_ZSTD
+    if (compress)
+        typescript->zstd = ZSTD_createCCtx();
+#endif
+
+    /* Compression is enabled only if supported by this build */
+    typescript->compress = (typescript->zstd != NULL);
 
     /* Typescript starts out flushed */
     typescript->length = 0;
     typescript->last_flush = guac_timestamp_current();
 
-    /* Write header */
-    guac_common_write(typescript->data_fd, GUAC_TERMINAL_TYPESCRIPT_HEADER,
-            sizeof(GUAC_TERMINAL_TYPESCRIPT_HEADER) - 1);
+    typescript->ring = guac_mem_alloc(GUAC_TERMINAL_TYPESCRIPT_RING_SIZE);
+    pthread_mutex_init(&typescript->state_lock, NULL);
+    pthread_cond_init(&typescript->data_available, NULL);
+    pthread_cond_init(&typescript->space_available, NULL);
+
+    /* The header is written by the writer thread, as are all other
+     * contents of the typescript files */
+    if (pthread_create(&typescript->writer, NULL,
+                guac_terminal_typescript_writer, typescript)) {
+        pthread_cond_destroy(&typescript->space_available);
+        pthread_cond_destroy(&typescript->data_available);
+        pthread_mutex_destroy(&typescript->state_lock);
+#ifdef ENABLE_ZSTD
+        ZSTD_freeCCtx(typescript->zstd);
+#endif
+        guac_mem_free(typescript->ring);
+        if (typescript->timing_fd != -1)
+            close(typescript->timing_fd);
+        close(typescript->data_fd);
+        guac_mem_free(typescript);
+        return NULL;
+    }
 
     return typescript;
 
@@ -121,22 +575,53 @@ void guac_terminal_typescript_flush(guac_terminal_typescript* typescript) {
     if (elapsed_time > GUAC_TERMINAL_TYPESCRIPT_MAX_DELAY)
         elapsed_time = GUAC_TERMINAL_TYPESCRIPT_MAX_DELAY;
 
-    /* Produce single line of timestamp output */
-    char timestamp_buffer[32];
-    int timestamp_length = snprintf(timestamp_buffer, sizeof(timestamp_buffer),
-            "%0.6f %i\n", elapsed_time / 1000.0, typescript->length);
+    guac_terminal_typescript_record record = {
+        .elapsed_time = elapsed_time,
+        .length = typescript->length
+    };
 
-    /* Calculate actual length of timestamp line */
-    if (timestamp_length > sizeof(timestamp_buffer))
-        timestamp_length = sizeof(timestamp_buffer);
+    size_t record_length = sizeof(record) + record.length;
+
+    /* Wait for the writer thread to make room within the ring buffer, if
+     * necessary */
+    if (GUAC_TERMINAL_TYPESCRIPT_RING_SIZE - (typescript->head
+                - __atomic_load_n(&typescript->tail, __ATOMIC_SEQ_CST))
+            < record_length) {
+
+        pthread_mutex_lock(&typescript->state_lock);
+        __atomic_store_n(&typescript->producer_waiting, 1, __ATOMIC_SEQ_CST);
 
-    /* Write timestamp to timing file */
-    guac_common_write(typescript->timing_fd,
-            timestamp_buffer, timestamp_length);
+        while (GUAC_TERMINAL_TYPESCRIPT_RING_SIZE - (typescript->head
+                    - __atomic_load_n(&typescript->tail, __ATOMIC_SEQ_CST))
+                < record_length
+                && !__atomic_load_n(&typescript->failed, __ATOMIC_SEQ_CST))
+            pthread_cond_wait(&typescript->space_available,
+                    &typescript->state_lock);
 
-    /* Empty buffer into data file */
-    guac_common_write(typescript->data_fd,
-            typescript->buffer, typescript->length);
+        __atomic_store_n(&typescript->producer_waiting, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&typescript->state_lock);
+
+    }
+
+    /* Output is discarded once writing has failed */
+    if (!__atomic_load_n(&typescript->failed, __ATOMIC_SEQ_CST)) {
+
+        guac_terminal_typescript_ring_put(typescript, typescript->head,
+                &record, sizeof(record));
+        guac_terminal_typescript_ring_put(typescript,
+                typescript->head + sizeof(record),
+                typescript->buffer, record.length);
+
+        __atomic_store_n(&typescript->head, typescript->head + record_length,
+                __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&typescript->writer_waiting, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_lock(&typescript->state_lock);
+            pthread_cond_signal(&typescript->data_available);
+            pthread_mutex_unlock(&typescript->state_lock);
+        }
+
+    }
 
     /* Buffer is now flushed */
     typescript->length = 0;
@@ -153,16 +638,59 @@ void guac_terminal_typescript_free(guac_terminal_typescript* typescript) {
     /* Flush any pending data */
     guac_terminal_typescript_flush(typescript);
 
-    /* Write footer */
-    guac_common_write(typescript->data_fd, GUAC_TERMINAL_TYPESCRIPT_FOOTER,
-            sizeof(GUAC_TERMINAL_TYPESCRIPT_FOOTER) - 1);
+    /* Wait for all flushed data (and the footer) to be written */
+    pthread_mutex_lock(&typescript->state_lock);
+    typescript->stopping = 1;
+    pthread_cond_signal(&typescript->data_available);
+    pthread_mutex_unlock(&typescript->state_lock);
+
+    pthread_join(typescript->writer, NULL);
 
     /* Close file descriptors */
     close(typescript->data_fd);
-    close(typescript->timing_fd);
+    if (typescript->timing_fd != -1)
+        close(typescript->timing_fd);
+
+    pthread_cond_destroy(&typescript->space_available);
+    pthread_cond_destroy(&typescript->data_available);
+    pthread_mutex_destroy(&typescript->state_lock);
+
+#ifdef ENABLE_ZSTD
+    ZSTD_freeCCtx(typescript->zstd);
+#endif
 
     /* Free allocated typescript data */
+    guac_mem_free(typescript->ring);
     guac_mem_free(typescript);
 
 }
 
+guac_terminal_typescript_format guac_terminal_typescript_parse_args_format(
+        guac_user* user, const char** arg_names, const char** argv, int index,
+        guac_terminal_typescript_format default_value) {
+
+    /* Pull parameter value from argv */
+    const char* value = argv[index];
+
+    /* Use default value if blank */
+    if (value[0] == 0) {
+        guac_user_log(user, GUAC_LOG_DEBUG, "Parameter \"%s\" omitted. Using "
+                "default value.", arg_names[index]);
+        return default_value;
+    }
+
+    if (strcmp(value, "split") == 0)
+        return GUAC_TERMINAL_TYPESCRIPT_FORMAT_SPLIT;
+
+    if (strcmp(value, "combined") == 0)
+        return GUAC_TERMINAL_TYPESCRIPT_FORMAT_COMBINED;
+
+    /* All other values are invalid */
+    guac_user_log(user, GUAC_LOG_WARNING, "Parameter \"%s\" must be "
+            "\"split\" or \"combined\". Using default value.",
+            arg_names[index]);
+
+    return default_value;
+
+}
+